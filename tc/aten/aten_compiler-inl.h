@@ -15,11 +15,15 @@
  */
 #include "tc/aten/aten_compiler.h"
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
 
 #include "tc/core/scope_guard.h"
+#include "tc/lang/parse_cache.h"
+#include "tc/lang/tree_views.h"
 
 namespace tc {
 
@@ -34,12 +38,141 @@ void ATenCompilationUnit<ExecutorType>::define(const std::string& language) {
   executionEngine_->define(language);
 }
 
+template <typename ExecutorType>
+void ATenCompilationUnit<ExecutorType>::definePipeline(
+    const std::string& name,
+    const std::vector<std::string>& defNames) {
+  executionEngine_->definePipeline(name, defNames);
+}
+
+template <typename ExecutorType>
+void ATenCompilationUnit<ExecutorType>::defineGradient(
+    const std::string& name,
+    const std::string& gradName) {
+  executionEngine_->defineGradient(name, gradName);
+}
+
+template <typename ExecutorType>
+void ATenCompilationUnit<ExecutorType>::defineFactoredContractions(
+    const std::string& name,
+    const std::string& newName,
+    const std::unordered_map<std::string, int64_t>& sizes) {
+  executionEngine_->defineFactoredContractions(name, newName, sizes);
+}
+
+template <typename ExecutorType>
+void ATenCompilationUnit<ExecutorType>::recordShapeManifest(bool record) {
+  executionEngine_->recordShapeManifest(record);
+}
+
+template <typename ExecutorType>
+ShapeManifestProto ATenCompilationUnit<ExecutorType>::shapeManifest() const {
+  return executionEngine_->shapeManifest();
+}
+
+template <typename ExecutorType>
+std::vector<size_t> ATenCompilationUnit<ExecutorType>::replayShapeManifest(
+    const ShapeManifestProto& manifest,
+    uint64_t minRuns) {
+  return executionEngine_->replayShapeManifest(manifest, minRuns);
+}
+
 namespace {
 
+// Whether the TC "def" may read the output "name" before writing it or
+// leave some of its elements unwritten, in which case a freshly allocated
+// output is zero-filled first.  An output defined by a single statement
+// that assigns it or is an initialized reduction (e.g., +=!), over the
+// inferred ranges of its indices and without reading it otherwise, is fully
+// overwritten by the kernel.
+bool needsZeroFill(const lang::Def& def, const std::string& name) {
+  std::function<bool(const lang::TreeRef&)> reads =
+      [&](const lang::TreeRef& tree) -> bool {
+    if (tree->kind() == lang::TK_ACCESS &&
+        lang::Access(tree).name().name() == name) {
+      return true;
+    }
+    for (const auto& t : tree->trees()) {
+      if (reads(t)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  size_t definitions = 0;
+  for (const auto& stmt : def.statements()) {
+    if (stmt.ident().name() != name) {
+      continue;
+    }
+    if (++definitions > 1) {
+      return true;
+    }
+    switch (stmt.assignment()->kind()) {
+      case '=':
+      case lang::TK_PLUS_EQ_B:
+      case lang::TK_TIMES_EQ_B:
+      case lang::TK_MIN_EQ_B:
+      case lang::TK_MAX_EQ_B:
+        break;
+      default:
+        return true;
+    }
+    if (reads(stmt.rhs()) || reads(stmt.whereClauses().tree())) {
+      return true;
+    }
+    for (const auto& wc : stmt.whereClauses()) {
+      if (wc->kind() != lang::TK_RANGE_CONSTRAINT) {
+        continue;
+      }
+      auto index = lang::RangeConstraint(wc).ident().name();
+      for (const auto& lhsIndex : stmt.indices()) {
+        if (lhsIndex.name() == index) {
+          return true;
+        }
+      }
+    }
+  }
+  return definitions == 0;
+}
+
+bool sameSizes(at::IntList a, const std::vector<int64_t>& b) {
+  return a.size() == b.size() && std::equal(b.begin(), b.end(), a.begin());
+}
+
+// The position of the input of "inputs" whose storage the output "output"
+// of the TC "def" reuses when it is allocated by the wrappers, or -1.
+// An output that aliases an input (e.g., -> (O aliases I)) only reuses it
+// if it is packed and has the type and the shape "info" of the output,
+// the output is allocated separately otherwise.
+int reusedInput(
+    const lang::Def& def,
+    size_t output,
+    const std::vector<at::Tensor>& inputs,
+    const DLTensor* info) {
+  auto alias = def.returns()[output].alias();
+  if (!alias.present()) {
+    return -1;
+  }
+  for (size_t i = 0; i < def.params().size(); ++i) {
+    if (def.params()[i].ident().name() != alias.get().name()) {
+      continue;
+    }
+    const auto& input = inputs[i];
+    std::vector<int64_t> shape(info->shape, info->shape + info->ndim);
+    if (input.is_contiguous() && sameSizes(input.sizes(), shape) &&
+        input.type().scalarType() == at::toScalarType(info->dtype)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 // given the tensor shape and DLType, allocate storage for the tensor output
 // type.
 void prepareOutputs(
     lang::TreeRef func,
+    const std::vector<at::Tensor>& inputs,
     const std::vector<const DLTensor*> tensorInfo,
     const at::Backend& backend,
     std::vector<at::Tensor>& outputs) {
@@ -49,14 +182,23 @@ void prepareOutputs(
     throw lang::ErrorReport(func) << "expected " << tensorInfo.size()
                                   << " outputs but found " << outputs.size();
   }
+  lang::Def def(lang::checkCached(func));
   for (int i = 0; i < tensorInfo.size(); ++i) {
     auto info = tensorInfo[i];
     auto stype = at::toScalarType(info->dtype);
     if (outputs.size() < tensorInfo.size()) {
+      auto reused = reusedInput(def, i, inputs, info);
+      if (reused >= 0) {
+        outputs.push_back(inputs[reused]);
+        continue;
+      }
       outputs.push_back(at::getType(backend, stype)
                             .tensor(at::IntList(info->shape, info->ndim)));
-      // TODO: we just malloc'ed I guess we can pay a memset
-      outputs.back().zero_();
+      // Only pay for the memset when the kernel does not overwrite all of
+      // the output.
+      if (needsZeroFill(def, def.returns()[i].ident().name())) {
+        outputs.back().zero_();
+      }
     } else {
       // In-place ATen operators have a trailing _
       std::vector<int64_t> shape(info->shape, info->shape + info->ndim);
@@ -80,6 +222,25 @@ size_t ATenCompilationUnit<ExecutorType>::compile(
       name, inputDLTensorsPair.first, options.toProtobufSerializedString());
 }
 
+template <typename ExecutorType>
+size_t ATenCompilationUnit<ExecutorType>::compile(
+    const std::string& name,
+    const std::vector<at::Tensor>& inputs,
+    const std::vector<at::Tensor>& outputs,
+    const typename ExecutorType::MappingOptionsType& options) {
+  auto inputDLTensorsPair = toConstDlpackTensors(inputs);
+  auto outputDLTensorsPair = toConstDlpackTensors(outputs);
+  ScopeGuard g([&]() {
+    deleteDlmTensors(inputDLTensorsPair.second);
+    deleteDlmTensors(outputDLTensorsPair.second);
+  });
+  return executionEngine_->compile(
+      name,
+      inputDLTensorsPair.first,
+      outputDLTensorsPair.first,
+      options.toProtobufSerializedString());
+}
+
 template <typename ExecutorType>
 std::vector<const DLTensor*>
 ATenCompilationUnit<ExecutorType>::inferOutputTensorInfo(
@@ -97,25 +258,143 @@ Duration ATenCompilationUnit<ExecutorType>::run(
     const std::vector<at::Tensor>& inputs,
     std::vector<at::Tensor>& outputs,
     size_t handle,
-    bool profile) {
+    bool profile,
+    const typename ExecutorType::RuntimeInformation& info) {
   at::Backend backend = inputs[0].type().backend();
   auto inputDLTensorsPair = toConstDlpackTensors(inputs);
   ScopeGuard g1([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
   auto outTensorInfo =
       executionEngine_->inferOutputTensorInfo(name, inputDLTensorsPair.first);
   prepareOutputs(
-      executionEngine_->treeForFunction(name), outTensorInfo, backend, outputs);
+      executionEngine_->treeForFunction(name),
+      inputs,
+      outTensorInfo,
+      backend,
+      outputs);
   auto outputDLTensorsPair = toDlpackTensors(outputs);
   ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
   return executionEngine_->run(
-      handle, inputDLTensorsPair.first, outputDLTensorsPair.first, profile);
+      handle,
+      inputDLTensorsPair.first,
+      outputDLTensorsPair.first,
+      profile,
+      [](const ExecutorType*) { return false; },
+      info);
+}
+
+template <typename ExecutorType>
+typename ATenCompilationUnit<ExecutorType>::BoundCall
+ATenCompilationUnit<ExecutorType>::bind(
+    const std::string& name,
+    const std::vector<at::Tensor>& inputs,
+    const typename ExecutorType::MappingOptionsType& options) {
+  BoundCall call(this, name, options);
+  call.rebind(inputs);
+  return call;
+}
+
+template <typename ExecutorType>
+ATenCompilationUnit<ExecutorType>::BoundCall::BoundCall(
+    ATenCompilationUnit* unit,
+    const std::string& name,
+    const typename ExecutorType::MappingOptionsType& options)
+    : unit_(unit), name_(name), options_(options) {}
+
+template <typename ExecutorType>
+bool ATenCompilationUnit<ExecutorType>::BoundCall::matches(
+    const std::vector<at::Tensor>& inputs) const {
+  if (inputs.size() != inputSignatures_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const auto& signature = inputSignatures_[i];
+    if (&inputs[i].type() != signature.type ||
+        !sameSizes(inputs[i].sizes(), signature.sizes) ||
+        !sameSizes(inputs[i].strides(), signature.strides)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Only done on the first run of a signature, the cost of compile and
+// inferOutputTensorInfo is paid once.
+template <typename ExecutorType>
+void ATenCompilationUnit<ExecutorType>::BoundCall::rebind(
+    const std::vector<at::Tensor>& inputs) {
+  handle_ = unit_->compile(name_, inputs, options_);
+  auto outputsInfo = unit_->inferOutputTensorInfo(name_, inputs);
+  lang::Def def(
+      lang::checkCached(unit_->executionEngine_->treeForFunction(name_)));
+
+  inputSignatures_.clear();
+  for (const auto& input : inputs) {
+    auto sizes = input.sizes();
+    auto strides = input.strides();
+    inputSignatures_.push_back({{sizes.begin(), sizes.end()},
+                                {strides.begin(), strides.end()},
+                                &input.type()});
+  }
+  outputShapes_.clear();
+  outputTypes_.clear();
+  zeroFill_.clear();
+  reusedInputs_.clear();
+  for (size_t i = 0; i < outputsInfo.size(); ++i) {
+    auto info = outputsInfo[i];
+    outputShapes_.emplace_back(info->shape, info->shape + info->ndim);
+    outputTypes_.push_back(at::toScalarType(info->dtype));
+    zeroFill_.push_back(needsZeroFill(def, def.returns()[i].ident().name()));
+    reusedInputs_.push_back(reusedInput(def, i, inputs, info));
+  }
+  backend_ = inputs[0].type().backend();
+  inputPtrs_.resize(inputs.size());
+  outputPtrs_.resize(outputsInfo.size());
+}
+
+template <typename ExecutorType>
+void ATenCompilationUnit<ExecutorType>::BoundCall::run(
+    const std::vector<at::Tensor>& inputs,
+    std::vector<at::Tensor>& outputs,
+    const typename ExecutorType::RuntimeInformation& info) {
+  if (!matches(inputs)) {
+    rebind(inputs);
+  }
+  if (outputs.empty()) {
+    for (size_t i = 0; i < outputShapes_.size(); ++i) {
+      if (reusedInputs_[i] >= 0) {
+        outputs.push_back(inputs[reusedInputs_[i]]);
+        continue;
+      }
+      outputs.push_back(at::getType(backend_, outputTypes_[i])
+                            .tensor(at::IntList(outputShapes_[i])));
+      if (zeroFill_[i]) {
+        outputs.back().zero_();
+      }
+    }
+  } else {
+    CHECK_EQ(outputs.size(), outputShapes_.size())
+        << "wrong number of outputs for " << name_;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      if (!sameSizes(outputs[i].sizes(), outputShapes_[i])) {
+        outputs[i].resize_(outputShapes_[i]);
+      }
+    }
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    inputPtrs_[i] = inputs[i].data_ptr();
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    outputPtrs_[i] = outputs[i].data_ptr();
+  }
+  unit_->executionEngine_->uncheckedRun(handle_, inputPtrs_, outputPtrs_, info);
 }
 
 template <typename ExecutorType>
 void ATenCompilationUnit<ExecutorType>::uncheckedRun(
     const std::vector<at::Tensor>& inputs,
     std::vector<at::Tensor>& outputs,
-    size_t handle) {
+    size_t handle,
+    const typename ExecutorType::RuntimeInformation& info) {
   CHECK_LT(0, outputs.size());
 
   constexpr auto kReservedSize = 8;
@@ -139,7 +418,7 @@ void ATenCompilationUnit<ExecutorType>::uncheckedRun(
   }
   O.resize(i);
 
-  executionEngine_->uncheckedRun(handle, I, O);
+  executionEngine_->uncheckedRun(handle, I, O, info);
 }
 
 } // namespace tc
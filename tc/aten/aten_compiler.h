@@ -17,6 +17,7 @@
 
 #include <chrono>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <ATen/ATen.h>
@@ -33,6 +34,63 @@ namespace tc {
 template <typename ExecutorType>
 class ATenCompilationUnit {
  public:
+  /// A TC compiled for the signature (sizes, strides and types) of its
+  /// inputs, which keeps the handle, the output shapes and the argument
+  /// layout of that signature.  Runs on inputs of the same signature only
+  /// update the data pointers and launch: the DLPack conversions, the output
+  /// shape inference and the handle lookup of ATenCompilationUnit::run are
+  /// skipped.  Inputs of another signature rebind the call first.
+  /// A bound call must not outlive the unit that bound it.
+  class BoundCall {
+   public:
+    /// Run the TC on inputs and fill in outputs, which are allocated if
+    /// empty and resized if their shapes do not match.  Allocated outputs
+    /// that alias an input reuse its storage when they can.
+    void run(
+        const std::vector<at::Tensor>& inputs,
+        std::vector<at::Tensor>& outputs,
+        const typename ExecutorType::RuntimeInformation& info =
+            typename ExecutorType::RuntimeInformation());
+
+    /// Handle of the kernel compiled for the current signature.
+    size_t handle() const {
+      return handle_;
+    }
+
+    /// Whether inputs have the signature the call is bound to, i.e.,
+    /// whether run launches without rebinding.
+    bool matches(const std::vector<at::Tensor>& inputs) const;
+
+   private:
+    friend class ATenCompilationUnit;
+
+    struct TensorSignature {
+      std::vector<int64_t> sizes;
+      std::vector<int64_t> strides;
+      const at::Type* type;
+    };
+
+    BoundCall(
+        ATenCompilationUnit* unit,
+        const std::string& name,
+        const typename ExecutorType::MappingOptionsType& options);
+
+    void rebind(const std::vector<at::Tensor>& inputs);
+
+    ATenCompilationUnit* unit_;
+    std::string name_;
+    typename ExecutorType::MappingOptionsType options_;
+    size_t handle_;
+    std::vector<TensorSignature> inputSignatures_;
+    std::vector<std::vector<int64_t>> outputShapes_;
+    std::vector<at::ScalarType> outputTypes_;
+    std::vector<bool> zeroFill_;
+    std::vector<int> reusedInputs_;
+    at::Backend backend_;
+    std::vector<const void*> inputPtrs_;
+    std::vector<void*> outputPtrs_;
+  };
+
   explicit ATenCompilationUnit();
 
   /// Define a database from input TC language where language can have many
@@ -40,6 +98,38 @@ class ATenCompilationUnit {
   /// by passing it to the run function.
   void define(const std::string& language);
 
+  /// Define name as the pipeline of the previously defined TCs defNames,
+  /// compiled to a single kernel (see ExecutionEngine::definePipeline).
+  void definePipeline(
+      const std::string& name,
+      const std::vector<std::string>& defNames);
+
+  /// Define gradName as the backward TC of the previously defined TC name
+  /// (see ExecutionEngine::defineGradient).
+  void defineGradient(const std::string& name, const std::string& gradName);
+
+  /// Define newName as the previously defined TC name with its contractions
+  /// factored pairwise (see ExecutionEngine::defineFactoredContractions).
+  void defineFactoredContractions(
+      const std::string& name,
+      const std::string& newName,
+      const std::unordered_map<std::string, int64_t>& sizes = {});
+
+  /// Record the kernels compiled from now on, with their runs, in the shape
+  /// manifest of the unit (see ExecutionEngine::recordShapeManifest).
+  void recordShapeManifest(bool record);
+
+  /// The kernels recorded, the most run first (see
+  /// ExecutionEngine::shapeManifest).
+  ShapeManifestProto shapeManifest() const;
+
+  /// Compile the kernels of manifest run at least minRuns times, in
+  /// parallel, and define the TCs it holds that are not defined (see
+  /// ExecutionEngine::replayShapeManifest).
+  std::vector<size_t> replayShapeManifest(
+      const ShapeManifestProto& manifest,
+      uint64_t minRuns = 1);
+
   /// Given a TC name, compile the TC
   // TODO: Pass struct to allow autotuning
   size_t compile(
@@ -47,6 +137,22 @@ class ATenCompilationUnit {
       const std::vector<at::Tensor>& inputs,
       const typename ExecutorType::MappingOptionsType& options);
 
+  /// Same as compile but the kernel writes outputs of the strides of
+  /// outputs, e.g. narrowed views of a concatenation, in place (see
+  /// ExecutionEngine::compile).
+  size_t compile(
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      const std::vector<at::Tensor>& outputs,
+      const typename ExecutorType::MappingOptionsType& options);
+
+  /// Compile the TC name for the signature of inputs, like compile, and
+  /// return the call bound to that signature.
+  BoundCall bind(
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      const typename ExecutorType::MappingOptionsType& options);
+
   /// Get the output Tensor info
   std::vector<const DLTensor*> inferOutputTensorInfo(
       const std::string& name,
@@ -55,12 +161,18 @@ class ATenCompilationUnit {
   /// Given a TC name, run the TC and fill the outputs vector the results if
   /// profile is set it returns the runtime in nanoseconds.
   /// Compilation must have already occured.
+  /// The runtime information (e.g. the CUDA stream) is forwarded to the
+  /// executor.
+  /// If outputs is empty, the outputs that alias an input reuse its storage
+  /// when they can (see BoundCall::run).
   Duration run(
       const std::string& name,
       const std::vector<at::Tensor>& inputs,
       std::vector<at::Tensor>& outputs,
       size_t handle,
-      bool profile = false);
+      bool profile = false,
+      const typename ExecutorType::RuntimeInformation& info =
+          typename ExecutorType::RuntimeInformation());
 
   /// This is the "low-latency" mode in which we just propagate ATen tensors
   /// Sizes are not checked and it is the user's responsibility to ensure that
@@ -68,7 +180,9 @@ class ATenCompilationUnit {
   void uncheckedRun(
       const std::vector<at::Tensor>& inputs,
       std::vector<at::Tensor>& outputs,
-      size_t handle);
+      size_t handle,
+      const typename ExecutorType::RuntimeInformation& info =
+          typename ExecutorType::RuntimeInformation());
 
  private:
   std::unique_ptr<ExecutionEngine<ExecutorType>> executionEngine_;
@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/cost_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include <glog/logging.h>
+
+namespace tc {
+namespace autotune {
+
+namespace {
+
+// Splits rows into the left and right children of the tree node at index
+// node, recursively, until the depth or the leaf size limits are reached.
+class TreeBuilder {
+ public:
+  TreeBuilder(
+      const std::vector<std::vector<double>>& features,
+      const std::vector<double>& residuals,
+      const GradientBoostedTrees::Options& options)
+      : features_(features), residuals_(residuals), options_(options) {}
+
+  template <typename Node>
+  int build(std::vector<Node>& tree, std::vector<size_t> rows, size_t depth) {
+    double sum = 0.0;
+    for (auto r : rows) {
+      sum += residuals_[r];
+    }
+    int node = tree.size();
+    tree.push_back(Node{0, 0.0, sum / rows.size(), -1, -1});
+    if (depth >= options_.maxDepth or
+        rows.size() < 2 * std::max<size_t>(options_.minSamplesPerLeaf, 1)) {
+      return node;
+    }
+
+    // Maximize the decrease of the sum of squared residuals, i.e.
+    // sumLeft^2 / nLeft + sumRight^2 / nRight
+    double bestGain = sum * sum / rows.size() + 1e-12;
+    size_t bestFeature = 0;
+    double bestThreshold = 0.0;
+    bool found = false;
+    auto minLeaf = std::max<size_t>(options_.minSamplesPerLeaf, 1);
+    for (size_t f = 0; f < features_.front().size(); ++f) {
+      std::sort(rows.begin(), rows.end(), [this, f](size_t a, size_t b) {
+        return features_[a][f] < features_[b][f];
+      });
+      double sumLeft = 0.0;
+      for (size_t k = 1; k < rows.size(); ++k) {
+        sumLeft += residuals_[rows[k - 1]];
+        auto lower = features_[rows[k - 1]][f];
+        auto upper = features_[rows[k]][f];
+        if (k < minLeaf or rows.size() - k < minLeaf or lower == upper) {
+          continue;
+        }
+        auto sumRight = sum - sumLeft;
+        auto gain =
+            sumLeft * sumLeft / k + sumRight * sumRight / (rows.size() - k);
+        if (gain > bestGain) {
+          bestGain = gain;
+          bestFeature = f;
+          bestThreshold = (lower + upper) / 2;
+          found = true;
+        }
+      }
+    }
+    if (not found) {
+      return node;
+    }
+
+    std::vector<size_t> left, right;
+    for (auto r : rows) {
+      (features_[r][bestFeature] <= bestThreshold ? left : right).push_back(r);
+    }
+    auto leftChild = build(tree, std::move(left), depth + 1);
+    auto rightChild = build(tree, std::move(right), depth + 1);
+    tree[node].feature = bestFeature;
+    tree[node].threshold = bestThreshold;
+    tree[node].left = leftChild;
+    tree[node].right = rightChild;
+    return node;
+  }
+
+ private:
+  const std::vector<std::vector<double>>& features_;
+  const std::vector<double>& residuals_;
+  const GradientBoostedTrees::Options& options_;
+};
+
+} // namespace
+
+GradientBoostedTrees GradientBoostedTrees::fit(
+    const std::vector<std::vector<double>>& features,
+    const std::vector<double>& targets,
+    const Options& options) {
+  CHECK_EQ(features.size(), targets.size());
+  CHECK(not features.empty()) << "cannot fit a model without samples";
+  for (const auto& f : features) {
+    CHECK_EQ(f.size(), features.front().size())
+        << "feature vectors of different sizes";
+  }
+
+  GradientBoostedTrees model;
+  model.learningRate_ = options.learningRate;
+  model.bias_ = std::accumulate(targets.begin(), targets.end(), 0.0) /
+      targets.size();
+  std::vector<double> predictions(targets.size(), model.bias_);
+  std::vector<double> residuals(targets.size());
+  std::vector<size_t> rows(targets.size());
+  std::iota(rows.begin(), rows.end(), 0);
+  for (size_t t = 0; t < options.numberTrees; ++t) {
+    for (size_t i = 0; i < targets.size(); ++i) {
+      residuals[i] = targets[i] - predictions[i];
+    }
+    Tree tree;
+    TreeBuilder(features, residuals, options).build(tree, rows, 0);
+    for (size_t i = 0; i < targets.size(); ++i) {
+      predictions[i] += model.learningRate_ * predict(tree, features[i]);
+    }
+    model.trees_.push_back(std::move(tree));
+  }
+  return model;
+}
+
+double GradientBoostedTrees::predict(
+    const Tree& tree,
+    const std::vector<double>& features) {
+  int node = 0;
+  while (tree[node].left >= 0) {
+    node = features.at(tree[node].feature) <= tree[node].threshold
+        ? tree[node].left
+        : tree[node].right;
+  }
+  return tree[node].value;
+}
+
+double GradientBoostedTrees::predict(
+    const std::vector<double>& features) const {
+  double res = bias_;
+  for (const auto& tree : trees_) {
+    res += learningRate_ * predict(tree, features);
+  }
+  return res;
+}
+
+namespace {
+// Tile sizes beyond are not encoded.
+constexpr size_t kMaxEncodedTileSizes = 8;
+
+double logSize(uint64_t size) {
+  return std::log2(1.0 + size);
+}
+
+void appendSchedulerOptions(
+    std::vector<double>& res,
+    const SchedulerOptionsProto& options) {
+  res.push_back(static_cast<double>(options.fusion_strategy()));
+  res.push_back(options.allow_skewing());
+  res.push_back(options.positive_orthant());
+}
+
+void appendDim(std::vector<double>& res, const CudaDimProto& dim) {
+  res.push_back(logSize(dim.x()));
+  res.push_back(logSize(dim.has_y() ? dim.y() : 1));
+  res.push_back(logSize(dim.has_z() ? dim.z() : 1));
+}
+} // namespace
+
+std::vector<double> CostModel::features(const CudaMappingOptions& options) {
+  const auto& proto = options.proto();
+  const auto& generic = proto.generic_mapping_options();
+  std::vector<double> res;
+  appendSchedulerOptions(res, generic.outer_schedule_options());
+  appendSchedulerOptions(res, generic.intra_tile_schedule_options());
+  res.push_back(generic.fix_parameters_before_scheduling());
+  res.push_back(generic.tile_imperfectly_nested());
+  res.push_back(generic.match_library_calls());
+  const auto& tiles = generic.tiling().sizes();
+  res.push_back(tiles.size());
+  for (size_t i = 0; i < kMaxEncodedTileSizes; ++i) {
+    res.push_back(i < static_cast<size_t>(tiles.size()) ? logSize(tiles.Get(i))
+                                                        : 0.0);
+  }
+  res.push_back(generic.has_unroll() ? logSize(generic.unroll()) : 0.0);
+  appendDim(res, proto.block());
+  appendDim(res, proto.grid());
+  res.push_back(proto.use_shared_memory());
+  res.push_back(proto.use_private_memory());
+  res.push_back(proto.unroll_copy_shared());
+  res.push_back(proto.use_dynamic_shared_memory());
+  const auto& compiler = proto.compiler_options();
+  res.push_back(logSize(compiler.max_register_count()));
+  res.push_back(compiler.use_launch_bounds());
+  res.push_back(compiler.min_blocks_per_multiprocessor());
+  return res;
+}
+
+std::vector<double> CostModel::features(
+    const std::vector<tc::detail::TensorInfo>& inputs) {
+  std::vector<double> res;
+  for (const auto& input : inputs) {
+    for (auto s : input.shape) {
+      res.push_back(logSize(std::max<int64_t>(s, 0)));
+    }
+  }
+  return res;
+}
+
+std::vector<double> CostModel::allFeatures(
+    const CudaMappingOptions& options,
+    const std::vector<tc::detail::TensorInfo>& inputs) const {
+  auto res = features(options);
+  auto inputFeatures = features(inputs);
+  res.insert(res.end(), inputFeatures.begin(), inputFeatures.end());
+  return res;
+}
+
+std::unique_ptr<CostModel> CostModel::train(
+    const std::vector<OptionsCache::TuningSample>& samples,
+    const CostModelOptions& options) {
+  std::vector<std::vector<double>> features;
+  std::vector<double> targets;
+  for (const auto& sample : samples) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  sample.medianRuntime)
+                  .count();
+    if (us <= 0) {
+      continue;
+    }
+    auto f = CostModel::features(sample.options);
+    auto inputFeatures = CostModel::features(sample.inputs);
+    f.insert(f.end(), inputFeatures.begin(), inputFeatures.end());
+    // Entries of a TC with inputs of another rank cannot be compared
+    if (not features.empty() and f.size() != features.front().size()) {
+      continue;
+    }
+    features.push_back(std::move(f));
+    targets.push_back(std::log(static_cast<double>(us)));
+  }
+  if (features.empty() or features.size() < options.minTrainingSamples) {
+    return nullptr;
+  }
+  auto numberFeatures = features.front().size();
+  return std::unique_ptr<CostModel>(new CostModel(
+      GradientBoostedTrees::fit(features, targets, options.trees),
+      numberFeatures));
+}
+
+double CostModel::predictLogRuntime(
+    const CudaMappingOptions& options,
+    const std::vector<tc::detail::TensorInfo>& inputs) const {
+  auto f = allFeatures(options, inputs);
+  CHECK_EQ(f.size(), numberFeatures_)
+      << "inputs do not match the ones the model was trained on";
+  return model_.predict(f);
+}
+
+} // namespace autotune
+} // namespace tc
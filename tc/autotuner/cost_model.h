@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+
+namespace tc {
+namespace autotune {
+
+/// Ensemble of regression trees fit by gradient boosting with the squared
+/// loss: each tree fits the residuals of the previous ones.
+class GradientBoostedTrees {
+ public:
+  struct Options {
+    size_t numberTrees = 100;
+    size_t maxDepth = 3;
+    size_t minSamplesPerLeaf = 2;
+    double learningRate = 0.1;
+  };
+
+  /// All feature vectors must have the same size.
+  static GradientBoostedTrees fit(
+      const std::vector<std::vector<double>>& features,
+      const std::vector<double>& targets,
+      const Options& options);
+
+  double predict(const std::vector<double>& features) const;
+
+ private:
+  /// Leaves have no children, the feature and threshold of inner nodes send
+  /// samples with features[feature] <= threshold to the left child.
+  struct Node {
+    size_t feature;
+    double threshold;
+    double value;
+    int left;
+    int right;
+  };
+  using Tree = std::vector<Node>;
+
+  static double predict(const Tree& tree, const std::vector<double>& features);
+
+  double bias_ = 0.0;
+  double learningRate_ = 0.0;
+  std::vector<Tree> trees_;
+};
+
+/// Settings of the surrogate model screening the bred candidates in the
+/// autotuner, disabled by default.
+struct CostModelOptions {
+  /// Number of candidates bred and ranked by the model for each candidate
+  /// compiled and benchmarked, i.e. only the predicted best 1 / oversampling
+  /// are evaluated. 1 disables the model.
+  size_t oversampling = 1;
+  /// The model is only used once that many samples of the TC are recorded in
+  /// the OptionsCache.
+  size_t minTrainingSamples = 32;
+  GradientBoostedTrees::Options trees;
+};
+
+/// Surrogate of the runtime of a TC, predicts the logarithm of the runtime of
+/// mapping options from their values and the input sizes.  Trained on the
+/// runtimes recorded in the OptionsCache for the TC, whatever the sizes.
+class CostModel {
+ public:
+  /// Returns nullptr if fewer than options.minTrainingSamples usable samples
+  /// are given.
+  static std::unique_ptr<CostModel> train(
+      const std::vector<OptionsCache::TuningSample>& samples,
+      const CostModelOptions& options);
+
+  double predictLogRuntime(
+      const CudaMappingOptions& options,
+      const std::vector<tc::detail::TensorInfo>& inputs) const;
+
+  /// Fixed size encoding of mapping options, sizes are log-scaled.
+  static std::vector<double> features(const CudaMappingOptions& options);
+  /// Logarithm of each input dimension, in order.
+  static std::vector<double> features(
+      const std::vector<tc::detail::TensorInfo>& inputs);
+
+ private:
+  explicit CostModel(GradientBoostedTrees model, size_t numberFeatures)
+      : model_(std::move(model)), numberFeatures_(numberFeatures) {}
+
+  std::vector<double> allFeatures(
+      const CudaMappingOptions& options,
+      const std::vector<tc::detail::TensorInfo>& inputs) const;
+
+  GradientBoostedTrees model_;
+  size_t numberFeatures_;
+};
+
+} // namespace autotune
+} // namespace tc
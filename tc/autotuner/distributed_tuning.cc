@@ -0,0 +1,670 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/distributed_tuning.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <cuda_runtime_api.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <tuning.pb.h>
+
+#include "tc/autotuner/genetic_tuning_harness.h"
+#include "tc/autotuner/utils/memory_budget.h"
+#include "tc/autotuner/utils/resource_model.h"
+#include "tc/autotuner/utils/utils.h"
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/flags.h"
+#include "tc/core/scope_guard.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/math.h"
+#include "tc/core/utils/memory.h"
+#include "tc/core/utils/socket.h"
+#include "tc/external/isl.h"
+
+namespace tc {
+namespace autotune {
+
+namespace {
+
+using socketutils::throwErrno;
+
+// Messages are small (a TC, some shapes and options), anything larger is
+// a protocol error
+constexpr uint32_t kMaxMessageSize = 64 << 20;
+
+void setSocketOption(int fd, int level, int option) {
+  int one = 1;
+  if (setsockopt(fd, level, option, &one, sizeof(one)) != 0) {
+    throwErrno("setsockopt");
+  }
+}
+
+} // namespace
+
+TuningConnection TuningConnection::connect(const std::string& endpoint) {
+  auto pos = endpoint.rfind(':');
+  if (pos == std::string::npos or pos == 0 or pos + 1 == endpoint.size()) {
+    throw std::invalid_argument(
+        "expected a host:port tuning worker, got " + endpoint);
+  }
+  auto host = endpoint.substr(0, pos);
+  auto port = endpoint.substr(pos + 1);
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  auto err = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+  if (err != 0) {
+    throw std::runtime_error(
+        "cannot resolve " + endpoint + ": " + gai_strerror(err));
+  }
+  std::unique_ptr<addrinfo, void (*)(addrinfo*)> addressesGuard(
+      addresses, freeaddrinfo);
+  for (auto address = addresses; address; address = address->ai_next) {
+    int fd =
+        socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      TuningConnection connection(fd);
+      setSocketOption(fd, IPPROTO_TCP, TCP_NODELAY);
+      // Benchmarking a candidate may take minutes, rely on keepalive rather
+      // than on a timeout to notice dead workers
+      setSocketOption(fd, SOL_SOCKET, SO_KEEPALIVE);
+      return connection;
+    }
+    close(fd);
+  }
+  throwErrno("cannot connect to " + endpoint);
+}
+
+TuningConnection::TuningConnection(TuningConnection&& other) : fd_(other.fd_) {
+  other.fd_ = -1;
+}
+
+TuningConnection& TuningConnection::operator=(TuningConnection&& other) {
+  std::swap(fd_, other.fd_);
+  return *this;
+}
+
+TuningConnection::~TuningConnection() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void TuningConnection::send(const google::protobuf::MessageLite& message) {
+  socketutils::sendMessage(fd_, message, kMaxMessageSize);
+}
+
+bool TuningConnection::receive(google::protobuf::MessageLite& message) {
+  return socketutils::receiveMessage(fd_, message, kMaxMessageSize);
+}
+
+std::vector<std::string> parseTuningWorkers() {
+  std::stringstream ss(FLAGS_tuner_workers);
+  std::vector<std::string> res;
+  for (std::string endpoint; std::getline(ss, endpoint, ',');) {
+    if (not endpoint.empty()) {
+      res.push_back(endpoint);
+    }
+  }
+  return res;
+}
+
+bool RemoteTuningEvaluator::evaluate(
+    const TuningRequestProto& request,
+    TuningResultProto& result) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    try {
+      if (not connection_) {
+        connection_ = make_unique<TuningConnection>(
+            TuningConnection::connect(endpoint_));
+      }
+      connection_->send(request);
+      if (connection_->receive(result)) {
+        return true;
+      }
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "[TUNER][REMOTE] worker " << endpoint_ << ": "
+                   << e.what();
+    }
+    connection_ = nullptr;
+  }
+  return false;
+}
+
+constexpr size_t SandboxedTuningEvaluator::kMaxConsecutiveCrashes;
+constexpr int SandboxedTuningEvaluator::kKernelTimeoutExitStatus;
+
+namespace {
+
+// The flags of tc/core/flags.cc changed from their defaults, e.g. the
+// pruning and benchmarking settings, except those selecting the GPUs and
+// the evaluators
+std::vector<std::string> forwardedFlags() {
+  std::vector<gflags::CommandLineFlagInfo> flags;
+  gflags::GetAllFlags(&flags);
+  std::vector<std::string> res;
+  const std::string tcFlagsFile = "core/flags.cc";
+  for (const auto& flag : flags) {
+    if (flag.is_default or flag.filename.size() < tcFlagsFile.size() or
+        flag.filename.compare(
+            flag.filename.size() - tcFlagsFile.size(),
+            tcFlagsFile.size(),
+            tcFlagsFile) != 0 or
+        flag.name == "tuner_gpus" or flag.name == "tuner_workers" or
+        flag.name == "tuner_sandbox_worker") {
+      continue;
+    }
+    res.push_back("--" + flag.name + "=" + flag.current_value);
+  }
+  return res;
+}
+
+// Socket pairs are created and their worker ends closed under this lock, so
+// that no other worker subprocess inherits them and keeps them open after
+// the one they belong to died.
+std::mutex sandboxSpawnMutex;
+
+} // namespace
+
+SandboxedTuningEvaluator::SandboxedTuningEvaluator(
+    const std::string& workerBinary,
+    size_t gpu)
+    : workerBinary_(workerBinary),
+      gpu_(gpu),
+      pid_(-1),
+      numConsecutiveCrashes_(0) {
+  // The workers are started with the first request, fail early if they
+  // cannot be
+  if (access(workerBinary_.c_str(), X_OK) != 0) {
+    throwErrno("cannot execute the tuning worker " + workerBinary_);
+  }
+}
+
+SandboxedTuningEvaluator::~SandboxedTuningEvaluator() {
+  stop();
+}
+
+void SandboxedTuningEvaluator::start() {
+  std::lock_guard<std::mutex> lock(sandboxSpawnMutex);
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    throwErrno("socketpair");
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+  // Everything is allocated before fork, only async-signal-safe calls are
+  // allowed in the child of a multithreaded process
+  std::vector<std::string> args{workerBinary_,
+                                "--connection_fd=" + std::to_string(fds[1]),
+                                "--tuner_gpus=" + std::to_string(gpu_)};
+  for (const auto& flag : forwardedFlags()) {
+    args.push_back(flag);
+  }
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  auto pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    throwErrno("fork");
+  }
+  if (pid == 0) {
+    execv(workerBinary_.c_str(), argv.data());
+    _exit(127);
+  }
+  close(fds[1]);
+  pid_ = pid;
+  connection_ = make_unique<TuningConnection>(fds[0]);
+  LOG_IF(INFO, FLAGS_debug_tuner) << "[TUNER][SANDBOX] started worker " << pid_
+                                  << " on gpu " << gpu_;
+}
+
+int SandboxedTuningEvaluator::stop() {
+  // Closing the connection makes a live worker exit
+  connection_ = nullptr;
+  int status = 0;
+  if (pid_ > 0) {
+    while (waitpid(pid_, &status, 0) < 0 and errno == EINTR) {
+      ;
+    }
+    pid_ = -1;
+  }
+  return status;
+}
+
+bool SandboxedTuningEvaluator::evaluate(
+    const TuningRequestProto& request,
+    TuningResultProto& result) {
+  if (not connection_) {
+    try {
+      start();
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "[TUNER][SANDBOX] cannot start a worker on gpu " << gpu_
+                 << ": " << e.what();
+      return false;
+    }
+  }
+  try {
+    connection_->send(request);
+    if (connection_->receive(result)) {
+      numConsecutiveCrashes_ = 0;
+      return true;
+    }
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[TUNER][SANDBOX] worker on gpu " << gpu_ << ": "
+                 << e.what();
+  }
+
+  // The worker may still be alive after a protocol error
+  if (pid_ > 0) {
+    kill(pid_, SIGKILL);
+  }
+  auto status = stop();
+  if (WIFEXITED(status) and
+      WEXITSTATUS(status) == kKernelTimeoutExitStatus) {
+    LOG(WARNING) << "[TUNER][SANDBOX] kernel of candidate " << request.id()
+                 << " timed out on gpu " << gpu_ << ", marking it invalid";
+    result.Clear();
+    result.set_id(request.id());
+    result.set_invalid(true);
+    return true;
+  }
+  std::stringstream ss;
+  if (WIFSIGNALED(status)) {
+    ss << "signal " << WTERMSIG(status);
+  } else {
+    ss << "exit status " << WEXITSTATUS(status);
+  }
+  LOG(WARNING) << "[TUNER][SANDBOX] worker on gpu " << gpu_ << " died ("
+               << ss.str() << ") evaluating candidate " << request.id()
+               << ", marking it invalid";
+  if (++numConsecutiveCrashes_ >= kMaxConsecutiveCrashes) {
+    LOG(ERROR) << "[TUNER][SANDBOX] " << numConsecutiveCrashes_
+               << " candidates in a row crashed the worker on gpu " << gpu_;
+    return false;
+  }
+  result.Clear();
+  result.set_id(request.id());
+  result.set_invalid(true);
+  return true;
+}
+
+namespace {
+
+// Device tensors allocated by the worker, the kernels we tune do not depend
+// on the values for their performance so they are just zeroed.
+class DeviceTensors {
+ public:
+  ~DeviceTensors() {
+    clear();
+  }
+
+  void clear() {
+    for (auto& t : tensors_) {
+      cudaFree(t->data);
+    }
+    tensors_.clear();
+  }
+
+  void add(dlutils::DLTensorUPtr t) {
+    size_t numElements = 1;
+    for (int i = 0; i < t->ndim; ++i) {
+      if (t->shape[i] == 0) {
+        numElements = 0;
+        break;
+      }
+      numElements += (t->shape[i] - 1) * t->strides[i];
+    }
+    auto bytes = std::max(
+        numElements * t->dtype.lanes * ((t->dtype.bits + 7) / 8), size_t(1));
+    t->data = nullptr;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&t->data, bytes));
+    tensors_.push_back(std::move(t));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemset(tensors_.back()->data, 0, bytes));
+  }
+
+  std::vector<const DLTensor*> constPtrs() const {
+    return dlutils::extractRawPtrs(tensors_);
+  }
+
+  std::vector<DLTensor*> ptrs() const {
+    std::vector<DLTensor*> res;
+    for (const auto& t : tensors_) {
+      res.push_back(t.get());
+    }
+    return res;
+  }
+
+ private:
+  std::vector<dlutils::DLTensorUPtr> tensors_;
+};
+
+// Exits the process when it stays armed past its deadline, i.e. when a
+// kernel does not return: a running kernel cannot be interrupted, the
+// sandboxed worker is restarted instead.
+class KernelWatchdog {
+ public:
+  explicit KernelWatchdog(std::chrono::milliseconds timeout)
+      : timeout_(timeout), thread_([this]() { watch(); }) {}
+
+  ~KernelWatchdog() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  // Expects numRuns kernel runs to end within their timeouts from now on
+  void arm(size_t numRuns) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      deadline_ = Clock::now() + numRuns * timeout_;
+    }
+    cv_.notify_one();
+  }
+
+  void disarm() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deadline_ = Clock::time_point::max();
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void watch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (not stop_) {
+      if (deadline_ == Clock::time_point::max()) {
+        cv_.wait(lock);
+      } else if (Clock::now() >= deadline_) {
+        LOG(ERROR) << "[TUNER][WORKER] kernel timed out after "
+                   << timeout_.count() << "ms, exiting";
+        google::FlushLogFiles(google::GLOG_INFO);
+        _exit(SandboxedTuningEvaluator::kKernelTimeoutExitStatus);
+      } else {
+        cv_.wait_until(lock, deadline_);
+      }
+    }
+  }
+
+  const std::chrono::milliseconds timeout_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  Clock::time_point deadline_ = Clock::time_point::max();
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+// State of a connection to a coordinator: the engine holding the TC and the
+// tensors of the last request, which are only rebuilt when the TC, kernel or
+// input shapes change.  Kernel runs are watched by watchdog, if any.
+class TuningSession {
+ public:
+  TuningSession(size_t gpu, KernelWatchdog* watchdog)
+      : gpu_(gpu), watchdog_(watchdog) {}
+
+  TuningResultProto evaluate(const TuningRequestProto& request);
+
+ private:
+  void prepare(const TuningRequestProto& request);
+
+  // Arms the watchdog, if any, for the next numRuns kernel runs
+  void expectRuns(size_t numRuns) {
+    if (watchdog_) {
+      watchdog_->arm(numRuns);
+    }
+  }
+
+  const size_t gpu_;
+  KernelWatchdog* const watchdog_;
+  std::string key_;
+  std::unique_ptr<ExecutionEngine<CudaTcExecutor>> engine_;
+  DeviceTensors inputs_;
+  DeviceTensors outputs_;
+};
+
+void TuningSession::prepare(const TuningRequestProto& request) {
+  std::stringstream key;
+  key << request.tc() << '\0' << request.kernel_name();
+  for (const auto& input : request.inputs()) {
+    key << '\0' << input.SerializeAsString();
+  }
+  if (key.str() == key_) {
+    return;
+  }
+  key_.clear();
+  outputs_.clear();
+  inputs_.clear();
+
+  engine_ = make_unique<ExecutionEngine<CudaTcExecutor>>();
+  engine_->define(request.tc());
+  for (const auto& input : request.inputs()) {
+    tc::detail::TensorInfo info(input);
+    auto t = dlutils::makeDLTensorWithSizes(
+        dlutils::getGPUDLContext(gpu_), info.dType, info.shape);
+    dlutils::SetStrides(*t, info.strides);
+    inputs_.add(std::move(t));
+  }
+  for (auto output : engine_->inferOutputTensorInfo(
+           request.kernel_name(), inputs_.constPtrs())) {
+    auto t = dlutils::makeDLTensor(output);
+    t->ctx = dlutils::getGPUDLContext(gpu_);
+    outputs_.add(std::move(t));
+  }
+  key_ = key.str();
+}
+
+TuningResultProto TuningSession::evaluate(const TuningRequestProto& request) {
+  TuningResultProto result;
+  result.set_id(request.id());
+  result.set_invalid(true);
+  try {
+    prepare(request);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[TUNER][WORKER] cannot set up " << request.kernel_name()
+                 << ": " << e.what();
+    key_.clear();
+    return result;
+  }
+
+  auto inputs = inputs_.constPtrs();
+  auto outputs = outputs_.ptrs();
+  CudaMappingOptions options(request.options());
+  size_t handle;
+  try {
+    auto admission = MemoryBudget::compilations().admit();
+    isl::with_exceptions::ScopedMaxOperations maxOperations(
+        FLAGS_tuner_compile_max_isl_operations);
+    auto pruningFunction = makeStaticPruningFunction(nullptr);
+    if (request.final_measurement()) {
+      // Final measurements are of candidates that already ran
+      pruningFunction = [](const CudaTcExecutor*) { return false; };
+    }
+    handle = engine_->compile(
+        request.kernel_name(),
+        inputs,
+        options.toProtobufSerializedString(),
+        pruningFunction);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[TUNER][WORKER] failed compilation: " << e.what();
+    return result;
+  }
+  if (handle == InvalidHandle) {
+    return result;
+  }
+
+  auto bestTimeSoFar = request.best_time_us() == 0
+      ? std::numeric_limits<size_t>::max()
+      : request.best_time_us();
+  try {
+    using Harness = detail::GeneticTunerHarness<CudaBackend>;
+    ScopeGuard sgWatchdog([this]() {
+      if (watchdog_) {
+        watchdog_->disarm();
+      }
+    });
+    auto budget = MeasurementBudget::fromFlags();
+    expectRuns(Harness::kReducedWarmupIterations);
+    if (request.final_measurement()) {
+      budget = MeasurementBudget::fromFlags(
+          Harness::kFinalMeasurementBudgetFactor);
+      for (size_t i = 0; i < Harness::kReducedWarmupIterations; ++i) {
+        engine_->run(handle, inputs, outputs);
+      }
+    } else if (Harness::warmupOrPrune(
+                   *engine_, outputs, inputs, handle, bestTimeSoFar)) {
+      engine_->clear(handle);
+      return result;
+    }
+    auto runtimes = measureUntilStable(
+        [&]() -> Duration {
+          expectRuns(1);
+          return engine_->run(handle, inputs, outputs, true);
+        },
+        budget);
+    engine_->clear(handle);
+    for (auto r : runtimes) {
+      result.add_runtimes_us(
+          std::chrono::duration_cast<std::chrono::microseconds>(r).count());
+    }
+    auto runtime =
+        std::chrono::duration_cast<std::chrono::microseconds>(median(runtimes))
+            .count();
+    result.set_invalid(runtime == 0);
+    result.set_runtime_us(runtime);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[TUNER][WORKER] runtime error on gpu " << gpu_ << ": "
+                 << e.what();
+    // Same recovery as GeneticTunerHarness: drop the accumulated errors and
+    // fail hard if the device is not usable anymore
+    while (cudaGetLastError() != cudaSuccess) {
+      ;
+    }
+    try {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    } catch (const std::exception& e) {
+      LOG(FATAL) << "[CUDA][FATAL] cuda error on gpu " << gpu_ << ": "
+                 << e.what();
+    }
+  }
+  return result;
+}
+
+void serveConnection(int fd, size_t gpu, KernelWatchdog* watchdog) {
+  TuningConnection connection(fd);
+  WithDevice wd(gpu);
+  TuningSession session(gpu, watchdog);
+  TuningRequestProto request;
+  try {
+    while (connection.receive(request)) {
+      connection.send(session.evaluate(request));
+    }
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[TUNER][WORKER] connection lost: " << e.what();
+  }
+}
+
+} // namespace
+
+void serveTuningConnection(int fd, size_t gpu) {
+  // The sandboxed worker only serves this connection, it can exit on a
+  // kernel timeout
+  std::unique_ptr<KernelWatchdog> watchdog;
+  if (FLAGS_tuner_kernel_timeout_ms > 0) {
+    watchdog = make_unique<KernelWatchdog>(
+        std::chrono::milliseconds(FLAGS_tuner_kernel_timeout_ms));
+  }
+  serveConnection(fd, gpu, watchdog.get());
+}
+
+void runTuningWorker(uint16_t port, const std::vector<size_t>& gpus) {
+  CHECK(not gpus.empty()) << "A tuning worker needs at least one GPU";
+  int listenFd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    throwErrno("socket");
+  }
+  setSocketOption(listenFd, SOL_SOCKET, SO_REUSEADDR);
+  // Accept IPv4 connections as well
+  int zero = 0;
+  setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+  sockaddr_in6 address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(port);
+  if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    throwErrno("bind to port " + std::to_string(port));
+  }
+  if (listen(listenFd, SOMAXCONN) != 0) {
+    throwErrno("listen");
+  }
+  LOG(INFO) << "[TUNER][WORKER] listening on port " << port << " with "
+            << gpus.size() << " gpu(s)";
+
+  for (size_t numConnections = 0;; ++numConnections) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR or errno == ECONNABORTED) {
+        continue;
+      }
+      throwErrno("accept");
+    }
+    auto gpu = gpus[numConnections % gpus.size()];
+    LOG(INFO) << "[TUNER][WORKER] serving a new connection on gpu " << gpu;
+    std::thread([fd, gpu]() { serveConnection(fd, gpu, nullptr); }).detach();
+  }
+}
+
+} // namespace autotune
+} // namespace tc
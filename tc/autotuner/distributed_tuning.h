@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/message_lite.h>
+
+namespace tc {
+class TuningRequestProto;
+class TuningResultProto;
+
+namespace autotune {
+
+/**
+ * Distributed autotuning: a coordinator runs the genetic search (see
+ * GeneticTunerHarness and --tuner_workers) and sends every candidate, as a
+ * TuningRequestProto, to a worker that compiles and benchmarks it on one of
+ * its GPUs and returns its median runtime in a TuningResultProto.
+ *
+ * Requests carry the TC and the input shapes, workers allocate their own
+ * tensors and keep no state besides the compiled kernels of the TC they
+ * currently tune.  Workers are started with runTuningWorker, e.g. through
+ * the tc_tuning_worker tool.
+ *
+ * The same protocol isolates the tuning process from the candidates that
+ * crash the GPU (see --tuner_sandbox_worker): local worker subprocesses,
+ * one per GPU, evaluate the candidates and are restarted when they die.
+ */
+
+/// A TCP connection carrying size-prefixed protobuf messages.  I/O errors
+/// throw std::runtime_error.
+class TuningConnection {
+ public:
+  /// Connects to endpoint, given as host:port
+  static TuningConnection connect(const std::string& endpoint);
+
+  explicit TuningConnection(int fd) : fd_(fd) {}
+  TuningConnection(TuningConnection&& other);
+  TuningConnection& operator=(TuningConnection&& other);
+  TuningConnection(const TuningConnection&) = delete;
+  TuningConnection& operator=(const TuningConnection&) = delete;
+  ~TuningConnection();
+
+  void send(const google::protobuf::MessageLite& message);
+  /// Returns false if the peer closed the connection instead of sending a
+  /// new message.
+  bool receive(google::protobuf::MessageLite& message);
+
+ private:
+  int fd_;
+};
+
+/// The host:port endpoints of FLAGS_tuner_workers
+std::vector<std::string> parseTuningWorkers();
+
+/// Evaluates the candidates of a coordinator outside of its process, one
+/// request at a time
+class TuningEvaluator {
+ public:
+  virtual ~TuningEvaluator() {}
+
+  /// For logging
+  virtual std::string name() const = 0;
+  /// Returns false if the evaluator is lost, in which case the request was
+  /// not evaluated
+  virtual bool evaluate(
+      const TuningRequestProto& request,
+      TuningResultProto& result) = 0;
+};
+
+/// A tuning worker reached at endpoint (host:port).  A failed connection is
+/// reopened once before giving up on the request, e.g. when the worker was
+/// restarted.
+class RemoteTuningEvaluator : public TuningEvaluator {
+ public:
+  explicit RemoteTuningEvaluator(const std::string& endpoint)
+      : endpoint_(endpoint) {}
+
+  std::string name() const override {
+    return endpoint_;
+  }
+  bool evaluate(const TuningRequestProto& request, TuningResultProto& result)
+      override;
+
+ private:
+  const std::string endpoint_;
+  std::unique_ptr<TuningConnection> connection_;
+};
+
+/// A subprocess running workerBinary (tc_tuning_worker) on gpu, connected
+/// through a socket pair and started with the non-default TC flags of this
+/// process.  When the subprocess dies, e.g. after an illegal memory access
+/// that leaves the GPU unusable, the request is reported invalid and the
+/// subprocess is restarted.  The evaluator is lost after
+/// kMaxConsecutiveCrashes requests in a row crashed.  The subprocess is
+/// started with the first request.  A subprocess exiting with
+/// kKernelTimeoutExitStatus ran a kernel past --tuner_kernel_timeout_ms,
+/// the request is reported invalid as well but it does not count as a crash.
+class SandboxedTuningEvaluator : public TuningEvaluator {
+ public:
+  static constexpr size_t kMaxConsecutiveCrashes = 8;
+  static constexpr int kKernelTimeoutExitStatus = 124;
+
+  SandboxedTuningEvaluator(const std::string& workerBinary, size_t gpu);
+  ~SandboxedTuningEvaluator();
+
+  std::string name() const override {
+    return "sandbox on gpu " + std::to_string(gpu_);
+  }
+  bool evaluate(const TuningRequestProto& request, TuningResultProto& result)
+      override;
+
+ private:
+  void start();
+  /// Closes the connection and reaps the subprocess, returns its wait status
+  int stop();
+
+  const std::string workerBinary_;
+  const size_t gpu_;
+  pid_t pid_;
+  std::unique_ptr<TuningConnection> connection_;
+  size_t numConsecutiveCrashes_;
+};
+
+/// Serves the requests received on the connected socket fd on gpu until the
+/// coordinator closes it, used by the subprocesses of
+/// SandboxedTuningEvaluator.  The process exits with
+/// SandboxedTuningEvaluator::kKernelTimeoutExitStatus when a kernel does not
+/// return within --tuner_kernel_timeout_ms.
+void serveTuningConnection(int fd, size_t gpu);
+
+/// Serves tuning requests on port, this never returns.  Each connection is
+/// served by its own thread on one of gpus, assigned round-robin.  To avoid
+/// skewing the measurements, a coordinator should open as many connections to
+/// a worker as it has GPUs.
+void runTuningWorker(uint16_t port, const std::vector<size_t>& gpus);
+
+} // namespace autotune
+} // namespace tc
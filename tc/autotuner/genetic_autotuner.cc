@@ -16,24 +16,30 @@
 
 #include "tc/autotuner/genetic_autotuner.h"
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
+#include <cstdio>
 #include <thread>
 
+#include "tc/core/cpu/cpu_backend.h"
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_heuristic_options.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
+#include "tc/core/polyhedral/scop.h"
 #include "tc/core/scope_guard.h"
-#include "tc/lang/parser.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/lang/parse_cache.h"
 
 namespace tc {
 namespace autotune {
 namespace detail {
 
 GeneticAutotuner::GeneticAutotuner(const std::string& tc) : tc_(tc) {
-  lang::Parser parser(tc);
-  while (parser.L.cur().kind != lang::TK_EOF) {
-    auto treeRef = parser.parseFunction();
+  for (const auto& treeRef : lang::parseCached(tc)) {
     auto name = lang::Def(treeRef).name().name();
     tcNameMap_.emplace(std::make_pair(name, treeRef));
   }
@@ -42,6 +48,12 @@ GeneticAutotuner::GeneticAutotuner(const std::string& tc) : tc_(tc) {
 namespace {
 
 void enableOrLoadCache(const std::string& filename) {
+  if (not FLAGS_tuner_cache_backend.empty() and
+      not tc::OptionsCache::hasBackend()) {
+    auto backend = tc::makeCacheBackend(FLAGS_tuner_cache_backend);
+    tc::OptionsCache::setBackend(backend, "options");
+    tc::CudaCache::setBackend(backend, "cuda");
+  }
   tc::OptionsCache::enableCache();
   tc::CudaCache::enableCache();
   if (!filename.empty()) {
@@ -49,22 +61,41 @@ void enableOrLoadCache(const std::string& filename) {
     tc::CudaCache::loadCacheFromProtobuf(tc::makeCudaFilename(filename));
   }
 }
+
+// Not fatal, the cache files, if any, hold the results.
+template <typename CC>
+void storeToBackend() {
+  try {
+    CC::storeToBackend();
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Failed to store the tuning results to the cache backend: "
+               << e.what();
+  }
+}
 } // namespace
 
 void GeneticAutotuner::storeCaches(const std::string& filename) {
-  if (filename.empty()) {
+  if (filename.empty() and not tc::OptionsCache::hasBackend()) {
     std::cout << "No filepath provided, not saving cache" << std::endl;
-  } else {
+    return;
+  }
+  // The backend receives what the files hold, the kernels of the best
+  // options only.
+  tc::OptionsCache::getCache()->keepOnlyBestCandidates(10);
+  if (not filename.empty()) {
     std::cout << "Dumping cache to " << filename << ".cuda/options"
               << std::endl;
-    tc::OptionsCache::getCache()->keepOnlyBestCandidates(10);
     tc::OptionsCache::dumpCacheToProtobuf(tc::makeOptionsFilename(filename));
+  }
+  storeToBackend<tc::OptionsCache>();
 
-    tc::OptionsCache::getCache()->keepOnlyBestCandidates(1);
-    tc::removeFromCudaCacheEntriesNotInOptionsCache(
-        *tc::CudaCache::getCache(), *tc::OptionsCache::getCache());
+  tc::OptionsCache::getCache()->keepOnlyBestCandidates(1);
+  tc::removeFromCudaCacheEntriesNotInOptionsCache(
+      *tc::CudaCache::getCache(), *tc::OptionsCache::getCache());
+  if (not filename.empty()) {
     tc::CudaCache::dumpCacheToProtobuf(tc::makeCudaFilename(filename));
   }
+  storeToBackend<tc::CudaCache>();
 }
 
 std::vector<CudaMappingOptions> GeneticAutotuner::load(
@@ -96,8 +127,292 @@ llvm::Optional<CudaMappingOptions> GeneticAutotuner::tune(
     std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
     CudaMappingOptions baseMapping,
     std::vector<CudaMappingOptions> startingPoints,
-    const TuningParameterFixer& fixedParams) {
+    const TuningParameterFixer& fixedParams,
+    const CostModelOptions& costModel,
+    const TuningStopCriteria& stopCriteria) {
+  return tuneImpl(
+      cacheFileName,
+      tcName,
+      inputs,
+      outputs,
+      baseMapping,
+      startingPoints,
+      fixedParams,
+      costModel,
+      stopCriteria,
+      1.0,
+      {},
+      nullptr,
+      FLAGS_tuner_gen_generations,
+      FLAGS_tuner_search_strategy);
+}
+
+llvm::Optional<CudaMappingOptions> GeneticAutotuner::tuneJointly(
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::vector<JointInputs>& inputSets,
+    CudaMappingOptions baseMapping,
+    std::vector<CudaMappingOptions> startingPoints,
+    const TuningParameterFixer& fixedParams,
+    JointTuningReport* report,
+    const CostModelOptions& costModel,
+    const TuningStopCriteria& stopCriteria) {
+  CHECK_GT(inputSets.size(), 0) << "No input set to tune for";
+  auto outputs = inputSets.front().outputs;
+  return tuneImpl(
+      cacheFileName,
+      tcName,
+      inputSets.front().inputs,
+      outputs,
+      baseMapping,
+      startingPoints,
+      fixedParams,
+      costModel,
+      stopCriteria,
+      inputSets.front().weight,
+      std::vector<JointInputs>(inputSets.begin() + 1, inputSets.end()),
+      report,
+      FLAGS_tuner_gen_generations,
+      FLAGS_tuner_search_strategy);
+}
+
+llvm::Optional<CudaMappingOptions> GeneticAutotuner::retune(
+    const std::string& previousCacheFileName,
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+    std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+    CudaMappingOptions baseMapping,
+    const TuningParameterFixer& fixedParams,
+    const CostModelOptions& costModel,
+    const TuningStopCriteria& stopCriteria) {
+  CHECK_EQ(1, tcNameMap_.count(tcName)) << "Error looking up " << tcName;
+  CHECK_GT(inputs.size(), 0);
+  CHECK_GT(outputs.size(), 0);
+  if (previousCacheFileName.empty() or
+      previousCacheFileName == cacheFileName) {
+    throw std::invalid_argument(
+        "Re-tuning needs a previous cache file distinct from the cache file "
+        "the results are stored in");
+  }
+
+  // Only the options are restored, the kernels of the previous cache were
+  // generated by the previous binary
+  tc::OptionsCache::loadCacheFromProtobuf(
+      tc::makeOptionsFilename(previousCacheFileName));
+  auto startingPoints = tc::OptionsCache::getCache()->retrieveTopKOptions(
+      canonicalTc(tcNameMap_.at(tcName)),
+      inputs.begin()->second,
+      dlutils::constPtrs(outputs.begin()->second),
+      FLAGS_tuner_retune_top_k);
+  LOG_IF(WARNING, startingPoints.empty())
+      << "No options for " << tcName << " in "
+      << tc::makeOptionsFilename(previousCacheFileName)
+      << ", re-tuning from the base mapping options";
+  if (startingPoints.size() < FLAGS_tuner_gen_pop_size and
+      std::find(startingPoints.begin(), startingPoints.end(), baseMapping) ==
+          startingPoints.end()) {
+    startingPoints.push_back(baseMapping);
+  }
+
+  // Starts from a fresh cache, or from the one of a previous re-tuning run
+  auto restoreFromProto = FLAGS_tuner_gen_restore_from_proto;
+  FLAGS_tuner_gen_restore_from_proto = false;
+  ScopeGuard sg([restoreFromProto]() {
+    FLAGS_tuner_gen_restore_from_proto = restoreFromProto;
+  });
+  return tuneImpl(
+      cacheFileName,
+      tcName,
+      inputs,
+      outputs,
+      baseMapping,
+      startingPoints,
+      fixedParams,
+      costModel,
+      stopCriteria,
+      1.0,
+      {},
+      nullptr,
+      FLAGS_tuner_retune_generations,
+      FLAGS_tuner_retune_search_strategy);
+}
+
+llvm::Optional<CudaMappingOptions> GeneticAutotuner::tuneKernels(
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+    std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+    CudaMappingOptions baseMapping,
+    const TuningParameterFixer& fixedParams,
+    const CostModelOptions& costModel,
+    const TuningStopCriteria& stopCriteria) {
+  CHECK_EQ(1, tcNameMap_.count(tcName)) << "Error looking up " << tcName;
+  CHECK_GT(inputs.size(), 0);
+  baseMapping.splitKernels(true).cooperativeKernels(false);
+  // The split is decided by the outer scheduling, the options of the
+  // kernels do not change the number of kernels.
+  size_t numberKernels;
+  {
+    CudaTcExecutor executor(
+        tcName,
+        inputs.begin()->second,
+        baseMapping.toProtobufSerializedString(),
+        tcNameMap_.at(tcName));
+    executor.generateCuda(baseMapping);
+    numberKernels = executor.splitKernels.size() + 1;
+  }
+  LOG(INFO) << "Tuning the " << numberKernels << " kernels of " << tcName
+            << " in turn";
+
+  const auto& generic = baseMapping.generic.proto;
+  const auto& compilerOptions = baseMapping.proto().compiler_options();
+  auto kernelParams = fixedParams;
+  kernelParams.fixOuterScheduleFusionStrategy(
+          baseMapping.generic.outerScheduleOptions.proto.fusion_strategy())
+      // The pairs never fused of the base options are kept by all kernels
+      .fixOuterScheduleFusionPartition(0)
+      .fixFixParametersBeforeScheduling(
+          generic.fix_parameters_before_scheduling())
+      .fixMatchLibraryCalls(generic.match_library_calls())
+      .fixInlinePointwiseTemporaries(generic.inline_pointwise_temporaries())
+      .fixSplitKernels(true)
+      .fixCooperativeKernels(false)
+      .fixGridReductions(false)
+      .fixVectorizeWidth(baseMapping.proto().vectorize_width())
+      .fixDp4aPacking(baseMapping.proto().dp4a_packing())
+      .fixMaxRegisterCount(compilerOptions.max_register_count())
+      .fixUseFastMath(compilerOptions.use_fast_math())
+      .fixUseLaunchBounds(compilerOptions.use_launch_bounds())
+      .fixMinBlocksPerMultiprocessor(
+          compilerOptions.min_blocks_per_multiprocessor());
+  if (compilerOptions.has_jit_optimization_level()) {
+    kernelParams.fixJitOptimizationLevel(
+        compilerOptions.jit_optimization_level());
+  }
+
+  auto best = baseMapping;
+  for (size_t kernel = 0; kernel < numberKernels; ++kernel) {
+    auto tuned = tuneImpl(
+        cacheFileName,
+        tcName,
+        inputs,
+        outputs,
+        best,
+        {best},
+        kernelParams,
+        costModel,
+        stopCriteria,
+        1.0,
+        {},
+        nullptr,
+        FLAGS_tuner_gen_generations,
+        FLAGS_tuner_search_strategy,
+        kernel);
+    if (not tuned) {
+      return tuned;
+    }
+    best = *tuned;
+  }
+  return best;
+}
+
+llvm::Optional<CpuMappingOptions> GeneticAutotuner::tuneCpu(
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+    std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+    CpuMappingOptions baseMapping,
+    std::vector<CpuMappingOptions> startingPoints,
+    const TuningParameterFixer& fixedParams,
+    const TuningStopCriteria& stopCriteria) {
+  CHECK_EQ(1, tcNameMap_.count(tcName)) << "Error looking up " << tcName;
+  CHECK_GT(inputs.size(), 0);
+  tc::CpuOptionsCache::enableCache();
+  if (not cacheFileName.empty()) {
+    tc::CpuOptionsCache::loadCacheFromProtobuf(
+        tc::makeCpuOptionsFilename(cacheFileName));
+  }
+  if (startingPoints.empty()) {
+    startingPoints.push_back(baseMapping);
+  }
+
+  GeneticTunerHarness<CpuBackend> tuner(
+      FLAGS_tuner_gen_pop_size,
+      FLAGS_tuner_gen_crossover_rate,
+      FLAGS_tuner_gen_mutation_rate,
+      FLAGS_tuner_gen_number_elites,
+      tcNameMap_.at(tcName),
+      tcName,
+      inputs,
+      outputs,
+      baseMapping,
+      startingPoints,
+      fixedParams);
+  {
+    std::lock_guard<std::mutex> lock(progressMutex_);
+    progress_ = tuner.progress();
+  }
+  tuner.setStopCriteria(stopCriteria);
+  tuner.run(FLAGS_tuner_gen_generations);
+
+  if (not cacheFileName.empty()) {
+    tc::CpuOptionsCache::getCache()->keepOnlyBestCandidates(10);
+    tc::CpuOptionsCache::dumpCacheToProtobuf(
+        tc::makeCpuOptionsFilename(cacheFileName));
+  }
+  auto remeasured = tuner.remeasuredBestOptions();
+  if (remeasured) {
+    return remeasured;
+  }
+
+  ExecutionEngine<CpuTcExecutor> ee;
+  ee.define(tc_);
+  auto outputInfo = ee.inferOutputTensorInfo(tcName, inputs.begin()->second);
+  auto best = tc::CpuOptionsCache::getCache()->retrieveBestOptions(
+      canonicalTc(tcNameMap_.at(tcName)),
+      inputs.begin()->second,
+      outputInfo);
+  if (not best) {
+    return llvm::Optional<CpuMappingOptions>();
+  }
+  return *best;
+}
+
+TuningProgress::Snapshot GeneticAutotuner::progress() const {
+  std::lock_guard<std::mutex> lock(progressMutex_);
+  if (not progress_) {
+    return TuningProgress::Snapshot();
+  }
+  return progress_->snapshot();
+}
+
+llvm::Optional<CudaMappingOptions> GeneticAutotuner::tuneImpl(
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+    std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+    CudaMappingOptions baseMapping,
+    std::vector<CudaMappingOptions> startingPoints,
+    const TuningParameterFixer& fixedParams,
+    const CostModelOptions& costModel,
+    const TuningStopCriteria& stopCriteria,
+    double weight,
+    const std::vector<JointInputs>& jointInputs,
+    JointTuningReport* report,
+    size_t numGenerations,
+    const std::string& searchStrategy,
+    int tunedKernel) {
   CHECK_EQ(1, tcNameMap_.count(tcName)) << "Error looking up " << tcName;
+  // Pointwise TCs are scheduled trivially, the mapping options barely
+  // change their runtime.
+  if (FLAGS_tuner_skip_pointwise and
+      polyhedral::Scop::makeScop(
+          isl::with_exceptions::globalIslCtx(), tcNameMap_.at(tcName))
+          ->isPointwise()) {
+    LOG(INFO) << tcName << " is pointwise, returning the base mapping options";
+    return baseMapping;
+  }
   enableOrLoadCache(cacheFileName);
 
   if (FLAGS_tuner_gen_restore_from_proto && !(cacheFileName.empty())) {
@@ -115,7 +430,34 @@ llvm::Optional<CudaMappingOptions> GeneticAutotuner::tune(
         std::back_inserter(startingPoints));
   }
 
-  GeneticTunerHarness tuner(
+  // Shape-aware options start the search from a better point than the
+  // fixed sizes of the base mapping options.
+  if (FLAGS_tuner_seed_heuristic_options and tunedKernel < 0 and
+      startingPoints.size() < FLAGS_tuner_gen_pop_size) {
+    CHECK_GT(inputs.size(), 0);
+    try {
+      startingPoints.push_back(makeHeuristicCudaMappingOptions(
+          tcNameMap_.at(tcName), inputs.begin()->second));
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "No heuristic options for " << tcName << ": "
+                   << e.what();
+    }
+  }
+
+  // The base mapping options are the baseline of the target speedup, make
+  // sure they are evaluated
+  if (stopCriteria.targetSpeedup > 0 and
+      std::find(startingPoints.begin(), startingPoints.end(), baseMapping) ==
+          startingPoints.end()) {
+    if (startingPoints.size() < FLAGS_tuner_gen_pop_size) {
+      startingPoints.insert(startingPoints.begin(), baseMapping);
+    } else {
+      LOG(WARNING) << "No room left in the first generation for the base "
+                      "mapping options, the target speedup is ignored";
+    }
+  }
+
+  GeneticTunerHarness<CudaBackend> tuner(
       FLAGS_tuner_gen_pop_size,
       FLAGS_tuner_gen_crossover_rate,
       FLAGS_tuner_gen_mutation_rate,
@@ -126,7 +468,32 @@ llvm::Optional<CudaMappingOptions> GeneticAutotuner::tune(
       outputs,
       baseMapping,
       startingPoints,
-      fixedParams);
+      fixedParams,
+      weight,
+      jointInputs,
+      tunedKernel);
+  {
+    std::lock_guard<std::mutex> lock(progressMutex_);
+    progress_ = tuner.progress();
+  }
+  tuner.setCostModel(costModel);
+  tuner.setStopCriteria(stopCriteria);
+  if (searchStrategy != FLAGS_tuner_search_strategy) {
+    tuner.setSearchStrategy(searchStrategy);
+  }
+  if (not cacheFileName.empty()) {
+    // Save the tuning progress so that an interrupted run can be resumed with
+    // --tuner_gen_restore_from_proto. Written aside and renamed so that a
+    // crash does not corrupt the previous checkpoint.
+    tuner.setCheckpointCallback([cacheFileName]() {
+      auto filename = tc::makeOptionsFilename(cacheFileName);
+      tc::OptionsCache::dumpCacheToProtobuf(filename + ".tmp");
+      if (std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+        LOG(WARNING) << "Failed to checkpoint the options cache to "
+                     << filename;
+      }
+    });
+  }
 
   sigterm_ = 0;
   sigint_ = 0;
@@ -142,7 +509,7 @@ llvm::Optional<CudaMappingOptions> GeneticAutotuner::tune(
 
   std::thread tunerThread([&]() {
     try {
-      tuner.run(FLAGS_tuner_gen_generations);
+      tuner.run(numGenerations);
     } catch (const std::exception& e) {
       std::cerr << "Exception during autotuning: " << e.what()
                 << "\n dumping cache to " << cacheFileName << ".cuda/options"
@@ -180,6 +547,26 @@ llvm::Optional<CudaMappingOptions> GeneticAutotuner::tune(
     storeCaches(cacheFileName);
   }
 
+  if (report) {
+    *report = tuner.jointTuningReport();
+  }
+
+  // The final re-measurement on an idle GPU is more reliable than the
+  // medians recorded in the cache while tuning
+  auto remeasured = tuner.remeasuredBestOptions();
+  if (remeasured) {
+    return remeasured;
+  }
+
+  // The cache holds the runtimes of each input set, not their aggregate. The
+  // report is only empty when no candidate was valid.
+  if (not jointInputs.empty()) {
+    if (tuner.jointTuningReport().runtimes.empty()) {
+      return llvm::Optional<CudaMappingOptions>();
+    }
+    return tuner.bestMappingOption();
+  }
+
   ExecutionEngine<CudaTcExecutor> ee;
   ee.define(tc_);
   auto outputPtrs = ee.inferOutputTensorInfo(tcName, inputs.begin()->second);
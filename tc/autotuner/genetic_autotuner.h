@@ -17,6 +17,7 @@
 #include <chrono>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "tc/autotuner/genetic_tuning_harness.h"
@@ -50,11 +51,102 @@ class GeneticAutotuner {
       std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
       CudaMappingOptions baseMapping,
       std::vector<CudaMappingOptions> startingPoints,
-      const TuningParameterFixer& fixedParams);
+      const TuningParameterFixer& fixedParams,
+      const CostModelOptions& costModel = CostModelOptions(),
+      const TuningStopCriteria& stopCriteria = TuningStopCriteria::fromFlags());
+
+  /// Tunes a single set of options for all the input sets, which minimizes
+  /// the weighted geometric mean of their runtimes. The first input set is
+  /// the one the results are stored under in the options cache. If report is
+  /// not null, it is set to the runtimes of the returned options on each
+  /// input set compared to the best ones recorded in the cache.
+  llvm::Optional<CudaMappingOptions> tuneJointly(
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::vector<JointInputs>& inputSets,
+      CudaMappingOptions baseMapping,
+      std::vector<CudaMappingOptions> startingPoints,
+      const TuningParameterFixer& fixedParams,
+      JointTuningReport* report = nullptr,
+      const CostModelOptions& costModel = CostModelOptions(),
+      const TuningStopCriteria& stopCriteria = TuningStopCriteria::fromFlags());
+
+  /// Re-tunes after a TC or compiler upgrade, which may change the kernels
+  /// generated for the options in previousCacheFileName.  The best
+  /// FLAGS_tuner_retune_top_k options of the previous cache are benchmarked
+  /// again and used as the starting points of a short local search (see
+  /// FLAGS_tuner_retune_generations and FLAGS_tuner_retune_search_strategy).
+  /// The results are stored in cacheFileName, stamped with the current TC
+  /// version; the previous cache is left untouched.
+  llvm::Optional<CudaMappingOptions> retune(
+      const std::string& previousCacheFileName,
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+      std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+      CudaMappingOptions baseMapping,
+      const TuningParameterFixer& fixedParams,
+      const CostModelOptions& costModel = CostModelOptions(),
+      const TuningStopCriteria& stopCriteria = TuningStopCriteria::fromFlags());
+
+  /// Tunes the options of each kernel of the split kernels of the TC (see
+  /// CudaMappingOptions::kernelOptions) in turn, in launch order, the other
+  /// kernels keeping their best options so far, starting from baseMapping
+  /// with split kernels.  tune with split kernels instead searches a single
+  /// set of options shared by all the kernels.  The parameters that only
+  /// apply to the whole TC are fixed to those of baseMapping.
+  llvm::Optional<CudaMappingOptions> tuneKernels(
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+      std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+      CudaMappingOptions baseMapping,
+      const TuningParameterFixer& fixedParams,
+      const CostModelOptions& costModel = CostModelOptions(),
+      const TuningStopCriteria& stopCriteria = TuningStopCriteria::fromFlags());
+
+  /// Tunes CpuMappingOptions, benchmarking the candidates on the cores of
+  /// FLAGS_tuner_cpus, for which inputs and outputs are given.  The runtimes
+  /// are recorded in the CpuOptionsCache, stored and loaded from
+  /// makeCpuOptionsFilename(cacheFileName) unless it is empty.  The cost
+  /// model and distributed tuning are not supported on CPU.
+  llvm::Optional<CpuMappingOptions> tuneCpu(
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+      std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+      CpuMappingOptions baseMapping,
+      std::vector<CpuMappingOptions> startingPoints,
+      const TuningParameterFixer& fixedParams,
+      const TuningStopCriteria& stopCriteria = TuningStopCriteria::fromFlags());
+
+  /// Progress of the current tuning, or of the last one once it is over,
+  /// empty before the first.  May be called from another thread than the
+  /// tuning one.
+  TuningProgress::Snapshot progress() const;
 
  private:
+  llvm::Optional<CudaMappingOptions> tuneImpl(
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
+      std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
+      CudaMappingOptions baseMapping,
+      std::vector<CudaMappingOptions> startingPoints,
+      const TuningParameterFixer& fixedParams,
+      const CostModelOptions& costModel,
+      const TuningStopCriteria& stopCriteria,
+      double weight,
+      const std::vector<JointInputs>& jointInputs,
+      JointTuningReport* report,
+      size_t numGenerations,
+      const std::string& searchStrategy,
+      int tunedKernel = -1);
+
   std::string tc_;
   std::map<std::string, lang::TreeRef> tcNameMap_;
+  mutable std::mutex progressMutex_;
+  std::shared_ptr<const TuningProgress> progress_;
 };
 
 } // namespace detail
@@ -18,13 +18,17 @@
 
 #include <chrono>
 #include <csignal>
+#include <sstream>
 #include <thread>
+#include <unordered_map>
 
 #include "tc/core/cuda/cuda.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
 #include "tc/core/scope_guard.h"
+#include "tc/lang/canonicalize.h"
+#include "tc/lang/parse_cache.h"
 #include "tc/lang/parser.h"
 
 namespace tc {
@@ -66,6 +70,43 @@ std::vector<at::Tensor> cloneTensors(const std::vector<at::Tensor>& inputs) {
   return copies;
 }
 
+// Runs the TC once to get outputs and clones the inputs and outputs on each
+// gpu. The DLManagedTensors are appended to managedTensors.
+JointInputs cloneOnGpus(
+    tc::ATenCompilationUnit<CudaTcExecutor>& atCompl,
+    const std::string& tcName,
+    const std::vector<at::Tensor>& inputs,
+    const CudaMappingOptions& baseMapping,
+    std::unordered_map<size_t, std::vector<DLManagedTensor*>>&
+        managedTensors) {
+  auto handle = atCompl.compile(tcName, inputs, baseMapping);
+  std::vector<at::Tensor> outputs;
+  atCompl.run(tcName, inputs, outputs, handle);
+
+  JointInputs tensors;
+  tensors.weight = 1.0;
+  for (auto gpu : tc::autotune::detail::parseGpus()) {
+    WithDevice wd(gpu);
+    auto& managed = managedTensors[gpu];
+    auto gpuInputs = cloneTensors(inputs);
+    auto gpuInputDLTensorsPair = tc::toConstDlpackTensors(gpuInputs);
+    tensors.inputs.emplace(gpu, gpuInputDLTensorsPair.first);
+    managed.insert(
+        managed.end(),
+        gpuInputDLTensorsPair.second.begin(),
+        gpuInputDLTensorsPair.second.end());
+
+    auto gpuOutputs = cloneTensors(outputs);
+    auto gpuOutputDLTensorsPair = tc::toDlpackTensors(gpuOutputs);
+    tensors.outputs.emplace(gpu, gpuOutputDLTensorsPair.first);
+    managed.insert(
+        managed.end(),
+        gpuOutputDLTensorsPair.second.begin(),
+        gpuOutputDLTensorsPair.second.end());
+  }
+  return tensors;
+}
+
 } // namespace
 
 llvm::Optional<CudaMappingOptions> GeneticAutotunerATen::tune(
@@ -74,51 +115,197 @@ llvm::Optional<CudaMappingOptions> GeneticAutotunerATen::tune(
     const std::vector<at::Tensor>& inputs,
     CudaMappingOptions baseMapping,
     std::vector<CudaMappingOptions> startingPoints,
-    const TuningParameterFixer& fixedParams) {
+    const TuningParameterFixer& fixedParams,
+    const CostModelOptions& costModel,
+    const TuningStopCriteria& stopCriteria) {
   // create instance of ATenCompilationUnit so that we can get the outputsInfo
   // and convert those outputs to DLTensors.
   tc::ATenCompilationUnit<CudaTcExecutor> atCompl;
   atCompl.define(tc_);
-  auto handle = atCompl.compile(tcName, inputs, baseMapping);
-  std::vector<at::Tensor> outputs;
-  atCompl.run(tcName, inputs, outputs, handle);
 
-  // first parse the gpus, clone the inputs on each gpu, pass that inputs to the
+  // clone the inputs on each gpu, pass that inputs to the
   // geneticAutotuner_->tune() call
-  auto gpus = tc::autotune::detail::parseGpus();
-  std::unordered_map<size_t, std::vector<const DLTensor*>> inputsPerGpu;
-  std::unordered_map<size_t, std::vector<DLManagedTensor*>> managedInputsPerGpu;
-  std::unordered_map<size_t, std::vector<DLTensor*>> outputsPerGpu;
-  std::unordered_map<size_t, std::vector<DLManagedTensor*>>
-      managedOutputsPerGpu;
-  for (auto gpu : gpus) {
-    WithDevice wd(gpu);
-    auto gpuInputs = cloneTensors(inputs);
-    auto gpuInputDLTensorsPair = tc::toConstDlpackTensors(gpuInputs);
-    inputsPerGpu.emplace(gpu, gpuInputDLTensorsPair.first);
-    managedInputsPerGpu.emplace(gpu, gpuInputDLTensorsPair.second);
+  std::unordered_map<size_t, std::vector<DLManagedTensor*>> managedTensors;
+  tc::ScopeGuard g([&]() { deleteGpuDlmTensors(managedTensors); });
+  auto tensors =
+      cloneOnGpus(atCompl, tcName, inputs, baseMapping, managedTensors);
 
-    auto gpuOutputs = cloneTensors(outputs);
-    auto gpuOutputDLTensorsPair = tc::toDlpackTensors(gpuOutputs);
-    outputsPerGpu.emplace(gpu, gpuOutputDLTensorsPair.first);
-    managedOutputsPerGpu.emplace(gpu, gpuOutputDLTensorsPair.second);
+  if (startingPoints.size() == 0) {
+    startingPoints.push_back(baseMapping);
   }
+  return geneticAutotuner_->tune(
+      cacheFileName,
+      tcName,
+      tensors.inputs,
+      tensors.outputs,
+      baseMapping,
+      startingPoints,
+      fixedParams,
+      costModel,
+      stopCriteria);
+}
+
+llvm::Optional<CudaMappingOptions> GeneticAutotunerATen::tuneJointly(
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::vector<std::vector<at::Tensor>>& inputSets,
+    const std::vector<double>& weights,
+    CudaMappingOptions baseMapping,
+    std::vector<CudaMappingOptions> startingPoints,
+    const TuningParameterFixer& fixedParams,
+    JointTuningReport* report) {
+  CHECK_EQ(inputSets.size(), weights.size())
+      << "Expected one weight per input set";
+  tc::ATenCompilationUnit<CudaTcExecutor> atCompl;
+  atCompl.define(tc_);
 
-  tc::ScopeGuard g1([&]() { deleteGpuDlmTensors(managedInputsPerGpu); });
-  tc::ScopeGuard g2([&]() { deleteGpuDlmTensors(managedOutputsPerGpu); });
+  std::unordered_map<size_t, std::vector<DLManagedTensor*>> managedTensors;
+  tc::ScopeGuard g([&]() { deleteGpuDlmTensors(managedTensors); });
+  std::vector<JointInputs> jointInputs;
+  for (size_t i = 0; i < inputSets.size(); ++i) {
+    jointInputs.push_back(cloneOnGpus(
+        atCompl, tcName, inputSets[i], baseMapping, managedTensors));
+    jointInputs.back().weight = weights[i];
+  }
 
   if (startingPoints.size() == 0) {
     startingPoints.push_back(baseMapping);
   }
-  return geneticAutotuner_->tune(
+  return geneticAutotuner_->tuneJointly(
       cacheFileName,
       tcName,
-      inputsPerGpu,
-      outputsPerGpu,
+      jointInputs,
       baseMapping,
       startingPoints,
+      fixedParams,
+      report);
+}
+
+llvm::Optional<CudaMappingOptions> GeneticAutotunerATen::retune(
+    const std::string& previousCacheFileName,
+    const std::string& cacheFileName,
+    const std::string& tcName,
+    const std::vector<at::Tensor>& inputs,
+    CudaMappingOptions baseMapping,
+    const TuningParameterFixer& fixedParams) {
+  tc::ATenCompilationUnit<CudaTcExecutor> atCompl;
+  atCompl.define(tc_);
+
+  std::unordered_map<size_t, std::vector<DLManagedTensor*>> managedTensors;
+  tc::ScopeGuard g([&]() { deleteGpuDlmTensors(managedTensors); });
+  auto tensors =
+      cloneOnGpus(atCompl, tcName, inputs, baseMapping, managedTensors);
+  return geneticAutotuner_->retune(
+      previousCacheFileName,
+      cacheFileName,
+      tcName,
+      tensors.inputs,
+      tensors.outputs,
+      baseMapping,
       fixedParams);
 }
 
+TuningProgress::Snapshot GeneticAutotunerATen::progress() const {
+  return geneticAutotuner_->progress();
+}
+
+namespace {
+lang::TreeRef jobDefinition(const TuningJob& job) {
+  lang::TreeRef def;
+  for (const auto& tree : lang::parseCached(job.tc)) {
+    if (lang::Def(tree).name().name() == job.tcName) {
+      def = tree;
+    }
+  }
+  CHECK(def) << "No definition " << job.tcName << " in the TC of the job";
+  return def;
+}
+
+// The options cache key of a job: its canonical TC and the metadata of its
+// inputs, which determine the ones of the outputs.
+std::string tuningJobKey(const TuningJob& job) {
+  std::stringstream ss;
+  ss << canonicalTc(jobDefinition(job));
+  for (const auto& input : job.inputs) {
+    ss << "|" << input.type().toString() << "(";
+    for (auto size : input.sizes()) {
+      ss << size << ",";
+    }
+    ss << ")(";
+    for (auto stride : input.strides()) {
+      ss << stride << ",";
+    }
+    ss << ")";
+  }
+  return ss.str();
+}
+} // namespace
+
+std::vector<llvm::Optional<CudaMappingOptions>> tuneBatch(
+    const std::string& cacheFileName,
+    const std::vector<TuningJob>& jobs,
+    const TuningJobCallback& onResult) {
+  std::vector<llvm::Optional<CudaMappingOptions>> results(jobs.size());
+  // index of the first job of each key
+  std::unordered_map<std::string, size_t> tuned;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    const auto& job = jobs[i];
+    auto key = tuningJobKey(job);
+    auto it = tuned.find(key);
+    if (it != tuned.end()) {
+      LOG(INFO) << "Job " << i << " (" << job.tcName << ") is the same as job "
+                << it->second << ", not tuning it again";
+      results[i] = results[it->second];
+    } else {
+      tuned.emplace(key, i);
+      GeneticAutotunerATen autotuner(job.tc);
+      results[i] = autotuner.tune(
+          cacheFileName, job.tcName, job.inputs, job.baseMapping);
+    }
+    if (onResult) {
+      onResult(i, results[i]);
+    }
+  }
+  return results;
+}
+
+llvm::Optional<size_t> tuneAlgorithmVariants(
+    const std::string& cacheFileName,
+    const std::vector<TuningJob>& variants) {
+  tuneBatch(cacheFileName, variants);
+  return selectAlgorithmVariant(variants);
+}
+
+llvm::Optional<size_t> selectAlgorithmVariant(
+    const std::vector<TuningJob>& variants) {
+  llvm::Optional<size_t> res;
+  auto best = Duration::max();
+  for (size_t i = 0; i < variants.size(); ++i) {
+    const auto& variant = variants[i];
+    tc::ATenCompilationUnit<CudaTcExecutor> atCompl;
+    atCompl.define(variant.tc);
+    auto outputs = atCompl.inferOutputTensorInfo(
+        variant.tcName, variant.inputs);
+    auto inputsPair = tc::toConstDlpackTensors(variant.inputs);
+    tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+    for (const auto& candidate : getOptionsAndMedianRuntimes(
+             canonicalTc(jobDefinition(variant)), inputsPair.first, outputs)) {
+      if (candidate.medianRuntime < best) {
+        best = candidate.medianRuntime;
+        res = i;
+      }
+    }
+  }
+  if (res) {
+    LOG(INFO) << "Selected " << variants[*res].tcName << " with a runtime of "
+              << std::chrono::duration_cast<std::chrono::microseconds>(best)
+                     .count()
+              << "us";
+  } else {
+    LOG(INFO) << "No variant in the options cache";
+  }
+  return res;
+}
+
 } // namespace autotune
 } // namespace tc
@@ -15,8 +15,10 @@
  */
 #pragma once
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "tc/aten/aten_compiler.h"
@@ -44,12 +46,80 @@ class GeneticAutotunerATen {
       const std::vector<at::Tensor>& inputs,
       CudaMappingOptions baseMapping,
       std::vector<CudaMappingOptions> startingPoints = {},
+      const TuningParameterFixer& fixedParams = {},
+      const CostModelOptions& costModel = CostModelOptions(),
+      const TuningStopCriteria& stopCriteria = TuningStopCriteria::fromFlags());
+
+  /// Tunes a single set of options for all the input sets, see
+  /// detail::GeneticAutotuner::tuneJointly. weights has one positive weight
+  /// per input set.
+  llvm::Optional<CudaMappingOptions> tuneJointly(
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::vector<std::vector<at::Tensor>>& inputSets,
+      const std::vector<double>& weights,
+      CudaMappingOptions baseMapping,
+      std::vector<CudaMappingOptions> startingPoints = {},
+      const TuningParameterFixer& fixedParams = {},
+      JointTuningReport* report = nullptr);
+
+  /// Re-tunes from the options of previousCacheFileName after a TC or
+  /// compiler upgrade, see detail::GeneticAutotuner::retune
+  llvm::Optional<CudaMappingOptions> retune(
+      const std::string& previousCacheFileName,
+      const std::string& cacheFileName,
+      const std::string& tcName,
+      const std::vector<at::Tensor>& inputs,
+      CudaMappingOptions baseMapping,
       const TuningParameterFixer& fixedParams = {});
 
+  /// See detail::GeneticAutotuner::progress
+  TuningProgress::Snapshot progress() const;
+
  private:
   std::string tc_;
   std::unique_ptr<detail::GeneticAutotuner> geneticAutotuner_;
 };
 
+/// A tuning job of tuneBatch: the definition tcName of tc, tuned for inputs
+/// starting from baseMapping.
+struct TuningJob {
+  std::string tc;
+  std::string tcName;
+  std::vector<at::Tensor> inputs;
+  CudaMappingOptions baseMapping;
+};
+
+using TuningJobCallback = std::function<
+    void(size_t, const llvm::Optional<CudaMappingOptions>&)>;
+
+/// Tunes the jobs one after the other, each one on all the GPUs of
+/// --tuner_gpus with the --tuner_threads compilation threads, and stores the
+/// results in the single options cache cacheFileName. The cache is written
+/// after each job, so the finished jobs survive an interruption. Jobs with
+/// the same options cache key, i.e., the same canonical TC and input
+/// metadata, are tuned once. If onResult is set, it is called with the index
+/// and the result of each job as soon as the job is tuned. Returns the
+/// results in the order of the jobs.
+std::vector<llvm::Optional<CudaMappingOptions>> tuneBatch(
+    const std::string& cacheFileName,
+    const std::vector<TuningJob>& jobs,
+    const TuningJobCallback& onResult = nullptr);
+
+/// Tunes the variants, e.g., the direct, implicit GEMM and Winograd TCs of
+/// a convolution, which compute the same outputs from the inputs of each
+/// variant, see tuneBatch, and returns the index of the fastest one, see
+/// selectAlgorithmVariant.  None if no variant has valid options.
+llvm::Optional<size_t> tuneAlgorithmVariants(
+    const std::string& cacheFileName,
+    const std::vector<TuningJob>& variants);
+
+/// The index of the variant with the best tuned runtime for its inputs in
+/// the options cache, without tuning: the choice of the algorithm for a
+/// shape is the one of tuneAlgorithmVariants as long as the tuned options of
+/// all the variants are in the cache.  None if no variant is in the cache.
+llvm::Optional<size_t> selectAlgorithmVariant(
+    const std::vector<TuningJob>& variants);
+
 } // namespace autotune
 } // namespace tc
@@ -16,8 +16,14 @@
 
 #include "tc/autotuner/genetic_search.h"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <random>
 #include <sstream>
+#include <unordered_set>
+
+#include "tc/core/flags.h"
 
 namespace tc {
 namespace autotune {
@@ -31,38 +37,122 @@ void randomizeParameter(Parameter& param, RNG& rng) {
   param.selectOption(paramIndex);
 }
 
+// Moves a numeric parameter to the option whose value is nearest to twice or
+// half the current one, in log scale, with 0 as the smallest value.  When
+// no option lies in the chosen direction, the nearest one is in the other.
+template <typename RNG>
+void stepParameter(ParameterView& param, RNG& rng) {
+  auto selected = param.selectedOption();
+  auto logValue = [&](size_t option) {
+    return std::log2(param.optionValue(option) + 1.0);
+  };
+  auto target =
+      logValue(selected) + (std::bernoulli_distribution()(rng) ? 1.0 : -1.0);
+  size_t nearest = selected;
+  double nearestDistance = 0;
+  for (size_t i = 0; i < param.numberOptions(); ++i) {
+    auto distance = std::abs(logValue(i) - target);
+    if (i != selected and (nearest == selected or distance < nearestDistance)) {
+      nearest = i;
+      nearestDistance = distance;
+    }
+  }
+  param.selectOption(nearest);
+}
+
+// Small steps of numeric parameters are more likely to preserve what made a
+// candidate fast than uniform draws, which still let the search escape.
+template <typename RNG>
+void mutateParameterValue(ParameterView& param, RNG& rng) {
+  if (param.isOrdinal() and param.numberOptions() > 1 and
+      not std::bernoulli_distribution(FLAGS_tuner_gen_uniform_mutation)(rng)) {
+    stepParameter(param, rng);
+  } else {
+    randomizeParameter(param, rng);
+  }
+}
+
+template <typename RNG>
+void randomizeCandidate(CandidateConfiguration& candidate, RNG& rng) {
+  auto& conf = candidate.configuration;
+  do {
+    conf.applyToParameters(
+        [&](ParameterView& p) { randomizeParameter(p, rng); });
+  } while (!conf.isValid());
+}
+
 template <typename RNG>
 void randomizePopulation(
     GeneticSearch::Population::iterator begin,
     GeneticSearch::Population::iterator end,
     RNG& rng) {
   for (auto candidate = begin; candidate != end; ++candidate) {
-    auto& conf = (*candidate)->configuration;
-    do {
-      conf.applyToParameters(
-          [&](ParameterView& p) { randomizeParameter(p, rng); });
-    } while (!conf.isValid());
+    randomizeCandidate(**candidate, rng);
   }
 }
 
+// Thresholds of the hardware counters beyond which a kernel is considered
+// limited by the corresponding resource.
+constexpr double kLowOccupancy = 0.3;
+constexpr double kHighSharedBankConflicts = 0.5;
+constexpr double kLowL2HitRate = 0.5;
+constexpr double kHighDramUtilization = 0.6;
+
+// Applies f to the parameters most likely to relieve the bottlenecks the
+// hardware counters point to, none if they are empty: the launch bounds,
+// register usage, batch packing and block linearization for a low
+// occupancy, the shared memory promotion for bank conflicts and the tiling
+// and the order of the blocks for a poor L2 reuse or a saturated DRAM.
+void applyToBottleneckParameters(
+    TuningConfiguration& conf,
+    const KernelMetrics& metrics,
+    const std::function<void(ParameterView&)>& f) {
+  if (metrics.achievedOccupancy >= 0 and
+      metrics.achievedOccupancy < kLowOccupancy) {
+    conf.blockParams.apply(f);
+    conf.gridParams.apply(f);
+    conf.maxRegisterCount.apply(f);
+    conf.minBlocksPerMultiprocessor.apply(f);
+    conf.batchPacking.apply(f);
+    conf.linearizeBlocks.apply(f);
+  }
+  if (metrics.sharedBankConflicts > kHighSharedBankConflicts) {
+    conf.useSharedMemory.apply(f);
+    conf.unrollCopyShared.apply(f);
+    conf.vectorizeWidth.apply(f);
+  }
+  if ((metrics.l2HitRate >= 0 and metrics.l2HitRate < kLowL2HitRate) or
+      metrics.dramUtilization > kHighDramUtilization) {
+    conf.tilingParams.apply(f);
+    conf.l2TileFactor.apply(f);
+    conf.usePrivateMemory.apply(f);
+    conf.blockSwizzle.apply(f);
+  }
+}
+
+// The parameters affecting the bottlenecks of metrics get a second chance to
+// mutate.
 template <typename RNG>
 void mutate(
     CandidateConfiguration& candidate,
     double rate,
     int iterations,
+    const KernelMetrics& metrics,
     RNG& rng) {
   auto shouldMutate = [&]() -> bool {
     return std::discrete_distribution<int>{static_cast<double>(100 - rate),
                                            static_cast<double>(rate)}(rng);
   };
+  auto mutateParameter = [&](ParameterView& p) {
+    if (not p.isForced() and shouldMutate()) {
+      mutateParameterValue(p, rng);
+    }
+  };
 
   CandidateConfiguration res(candidate);
   for (size_t i = 0; i < iterations; ++i) {
-    res.configuration.applyToParameters([&](ParameterView& p) {
-      if (not p.isForced() and shouldMutate()) {
-        randomizeParameter(p, rng);
-      }
-    });
+    res.configuration.applyToParameters(mutateParameter);
+    applyToBottleneckParameters(res.configuration, metrics, mutateParameter);
 
     if (res.configuration.isValid()) {
       candidate.configuration = res.configuration;
@@ -119,6 +209,27 @@ the new parameters can be computed."};
   }
 }
 
+// Fitness proportionate selection, accFitness is the accumulated fitness of
+// the population (see computeAccumulatedFitness)
+template <typename RNG>
+TuningConfiguration& selectByFitness(
+    GeneticSearch::Population& population,
+    const std::vector<double>& accFitness,
+    RNG& rng) {
+  auto limit = std::uniform_real_distribution<double>{}(rng);
+  auto lb = std::lower_bound(accFitness.begin(), accFitness.end(), limit);
+  return population.at(std::distance(accFitness.begin(), lb))->configuration;
+}
+
+// Crossover should occur with probability (crossOverRate)%
+template <typename RNG>
+bool shouldCrossOver(uint8_t crossOverRate, RNG& rng) {
+  auto dist = std::discrete_distribution<int>{
+      static_cast<double>(100 - crossOverRate),
+      static_cast<double>(crossOverRate)};
+  return dist(rng);
+}
+
 void dropInvalidConfigurations(GeneticSearch::Population& population) {
   population.erase(
       std::remove_if(
@@ -141,34 +252,16 @@ void dropInvalidConfigurations(GeneticSearch::Population& population) {
       << "the crossover (" << kCrossOverRate           \
       << ") rate should be in the [0,100] interval";
 
-namespace {
-
-template <typename RNG>
-void restoreRngState(RNG& rng) {
-  if (FLAGS_tuner_rng_restore.empty()) {
-    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG state " << rng;
-  } else {
-    std::istringstream ss(FLAGS_tuner_rng_restore);
-    ss >> rng;
-    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG restored state " << rng;
-  }
-}
-} // namespace
-
 GeneticSearch::GeneticSearch(
     const std::vector<TuningConfiguration>& confs,
     size_t n,
     uint8_t crossOverRate,
     uint8_t mutationRate,
     size_t numberElites)
-    : population(),
-      lastBestConf(confs[0]),
-      kMaxPopulationSize(n),
+    : SearchStrategy(confs[0], n),
       kCrossOverRate(crossOverRate),
       kMutationRate(mutationRate),
-      kNumberElites(numberElites),
-      rng{std::random_device{}()} {
-  restoreRngState(rng);
+      kNumberElites(numberElites) {
   VALIDATE();
   CHECK(not confs.empty()) << "empty set of predefined configurations";
   CHECK_LE(confs.size(), n) << "too many predefined configurations";
@@ -193,14 +286,10 @@ GeneticSearch::GeneticSearch(
     uint8_t crossOverRate,
     uint8_t mutationRate,
     size_t numberElites)
-    : population(),
-      lastBestConf(conf),
-      kMaxPopulationSize(n),
+    : SearchStrategy(conf, n),
       kCrossOverRate(crossOverRate),
       kMutationRate(mutationRate),
-      kNumberElites(numberElites),
-      rng{std::random_device{}()} {
-  restoreRngState(rng);
+      kNumberElites(numberElites) {
   VALIDATE();
   for (int i = 0; i < kMaxPopulationSize; ++i) {
     population.emplace_back(make_unique<CandidateConfiguration>(conf));
@@ -230,6 +319,19 @@ TuningConfiguration GeneticSearch::crossover(
     }
   };
 
+  // The sizes of the tiles, blocks, grid, thread and warp tiles only perform
+  // together, they are inherited from a single parent.
+  auto selectSizes = [&](TuningConfiguration& child) {
+    const TuningConfiguration* parents[] = {&a, &b, &c};
+    const auto& parent =
+        *parents[std::uniform_int_distribution<size_t>{0, 2}(rng)];
+    child.tilingParams = parent.tilingParams;
+    child.blockParams = parent.blockParams;
+    child.gridParams = parent.gridParams;
+    child.threadTileSize = parent.threadTileSize;
+    child.warpTileSize = parent.warpTileSize;
+  };
+
   for (size_t i = 0; i < kMutateIterations; ++i) {
     TuningConfiguration child{a};
     auto params = child.collectParameters();
@@ -237,6 +339,9 @@ TuningConfiguration GeneticSearch::crossover(
       params.at(i).overwrite(
           selectParam(aParams.at(i), bParams.at(i), cParams.at(i)));
     }
+    if (FLAGS_tuner_gen_grouped_crossover) {
+      selectSizes(child);
+    }
     if (child.isValid()) {
       return child;
     }
@@ -246,6 +351,18 @@ TuningConfiguration GeneticSearch::crossover(
   return a;
 }
 
+void GeneticSearch::updateBestMetrics(const Population& sorted) {
+  auto best = std::find_if(
+      sorted.begin(),
+      sorted.end(),
+      [](const std::unique_ptr<CandidateConfiguration>& c) {
+        return not c->metrics.empty();
+      });
+  if (best != sorted.end()) {
+    bestMetrics_ = (*best)->metrics;
+  }
+}
+
 void GeneticSearch::breed() {
   auto accFitness = computeAccumulatedFitness(population);
   Population new_population;
@@ -256,22 +373,18 @@ void GeneticSearch::breed() {
   }
 
   auto select = [&]() -> TuningConfiguration& {
-    auto limit = std::uniform_real_distribution<double>{}(rng);
-    auto lb = std::lower_bound(accFitness.begin(), accFitness.end(), limit);
-    return population.at(std::distance(accFitness.begin(), lb))->configuration;
-  };
-  auto shouldCrossOver = [&]() -> bool {
-    /*
-     *Crossover should occur with probability (kCrossOverRate)%
-     */
-    auto dist = std::discrete_distribution<int>{
-        static_cast<double>(100 - kCrossOverRate),
-        static_cast<double>(kCrossOverRate)};
-    return dist(rng);
+    return selectByFitness(population, accFitness, rng);
   };
 
-  while (new_population.size() < kMaxPopulationSize) {
-    if (shouldCrossOver()) {
+  // The non elite candidates are oversampled for screening
+  auto populationSize = kMaxPopulationSize;
+  if (screening()) {
+    auto numberElites = std::min(kNumberElites, new_population.size());
+    populationSize =
+        numberElites + (kMaxPopulationSize - numberElites) * oversampling_;
+  }
+  while (new_population.size() < populationSize) {
+    if (shouldCrossOver(kCrossOverRate, rng)) {
       auto parent1 = select();
       auto parent2 = select();
       auto parent3 = select();
@@ -302,12 +415,8 @@ void GeneticSearch::updateParameters() {
   // Update failsafe lastBestConf
   lastBestConf =
       population.size() > 0 ? population.front()->configuration : lastBestConf;
-  if (FLAGS_tuner_print_best) {
-    CudaMappingOptions options(
-        CudaMappingOptions::makeSingleThreadCudaMappingOptions());
-    lastBestConf.applyToCudaMappingOptions(options);
-    LOG(INFO) << "Best so far:\n" << options;
-  }
+  updateBestMetrics(population);
+  printBest();
 
   if (population.size() < kMinCandidatesForBreeding) {
     LOG_IF(ERROR, FLAGS_debug_tuner)
@@ -332,7 +441,136 @@ void GeneticSearch::updateParameters() {
 
   breed();
   for (int i = kNumberElites; i < population.size(); ++i) {
-    mutate(*population[i], kMutationRate, kMutateIterations, rng);
+    mutate(*population[i], kMutationRate, kMutateIterations, bestMetrics_, rng);
+  }
+  if (screening()) {
+    screenCandidates();
+  }
+}
+
+void GeneticSearch::screenCandidates() {
+  auto numberElites = std::min(kNumberElites, population.size());
+  struct ScoredCandidate {
+    double cost;
+    std::string key;
+    size_t index;
+  };
+  std::vector<ScoredCandidate> scored;
+  scored.reserve(population.size() - numberElites);
+  for (size_t i = numberElites; i < population.size(); ++i) {
+    std::stringstream ss;
+    ss << population[i]->configuration;
+    scored.push_back(
+        {predictedCost_(population[i]->configuration), ss.str(), i});
+  }
+  std::stable_sort(
+      scored.begin(),
+      scored.end(),
+      [](const ScoredCandidate& a, const ScoredCandidate& b) {
+        return a.cost < b.cost;
+      });
+
+  // Oversampling makes copies likely, only evaluate one of them unless there
+  // are not enough distinct candidates
+  Population screened;
+  screened.reserve(kMaxPopulationSize);
+  for (size_t i = 0; i < numberElites; ++i) {
+    screened.push_back(std::move(population[i]));
+  }
+  std::unordered_set<std::string> keys;
+  std::vector<size_t> copies;
+  for (const auto& s : scored) {
+    if (not keys.insert(s.key).second) {
+      copies.push_back(s.index);
+    } else if (screened.size() < kMaxPopulationSize) {
+      screened.push_back(std::move(population[s.index]));
+    }
+  }
+  for (auto i : copies) {
+    if (screened.size() >= kMaxPopulationSize) {
+      break;
+    }
+    screened.push_back(std::move(population[i]));
+  }
+  population = std::move(screened);
+}
+
+std::unique_ptr<CandidateConfiguration> GeneticSearch::nextCandidate() {
+  if (numIssued_ < population.size()) {
+    return make_unique<CandidateConfiguration>(
+        population.at(numIssued_++)->configuration);
+  }
+
+  auto candidate = makeCandidate();
+  if (not screening()) {
+    return candidate;
+  }
+  auto cost = predictedCost_(candidate->configuration);
+  for (size_t i = 1; i < oversampling_; ++i) {
+    auto other = makeCandidate();
+    auto otherCost = predictedCost_(other->configuration);
+    if (otherCost < cost) {
+      candidate = std::move(other);
+      cost = otherCost;
+    }
+  }
+  return candidate;
+}
+
+std::unique_ptr<CandidateConfiguration> GeneticSearch::makeCandidate() {
+  if (evaluated_.size() < kMinCandidatesForBreeding) {
+    auto candidate = make_unique<CandidateConfiguration>(lastBestConf);
+    randomizeCandidate(*candidate, rng);
+    return candidate;
+  }
+
+  auto accFitness = computeAccumulatedFitness(evaluated_);
+  auto select = [&]() -> TuningConfiguration& {
+    return selectByFitness(evaluated_, accFitness, rng);
+  };
+  std::unique_ptr<CandidateConfiguration> candidate;
+  if (shouldCrossOver(kCrossOverRate, rng)) {
+    auto parent1 = select();
+    auto parent2 = select();
+    auto parent3 = select();
+    candidate = make_unique<CandidateConfiguration>(
+        crossover(parent1, parent2, parent3));
+  } else {
+    candidate = make_unique<CandidateConfiguration>(select());
+  }
+  mutate(*candidate, kMutationRate, kMutateIterations, bestMetrics_, rng);
+  return candidate;
+}
+
+void GeneticSearch::recordEvaluatedCandidate(
+    std::unique_ptr<CandidateConfiguration> c) {
+  CHECK(c);
+  if (c->invalid) {
+    return;
+  }
+  checkRuntimeRecorded(c->runtime);
+  // The compilation handle refers to a kernel that is released once
+  // benchmarked, do not keep it around
+  c->optionalCompilationHandle = nullptr;
+
+  auto pos = std::upper_bound(
+      evaluated_.begin(),
+      evaluated_.end(),
+      c,
+      [](const std::unique_ptr<CandidateConfiguration>& a,
+         const std::unique_ptr<CandidateConfiguration>& b) {
+        return a->runtime < b->runtime;
+      });
+  auto newBest = pos == evaluated_.begin();
+  evaluated_.insert(pos, std::move(c));
+  if (evaluated_.size() > kMaxPopulationSize) {
+    evaluated_.pop_back();
+  }
+  updateBestMetrics(evaluated_);
+
+  if (newBest) {
+    lastBestConf = evaluated_.front()->configuration;
+    printBest();
   }
 }
 
@@ -15,9 +15,8 @@
  */
 #pragma once
 
-#include <random>
-
 #include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
 
 namespace tc {
 namespace autotune {
@@ -34,9 +33,12 @@ namespace autotune {
  *
  * crossover: 3 parent candidates are selected probabilistically (influenced by
  * their fitness, the higher it is the higher the chance of selection) and
- * merged into a new candidate
+ * merged into a new candidate, the tile, block, grid, thread and warp tile
+ * sizes coming from the same parent (see tuner_gen_grouped_crossover)
  *
- * mutation: parts of a candidate are randomly changed (mutated)
+ * mutation: parts of a candidate are randomly changed (mutated), numeric
+ * parameters mostly to the value nearest to twice or half the current one
+ * (see tuner_gen_uniform_mutation)
  *
  * The crossover rate controls how many candidates survive across generations
  * and how many new candidates are produced through crossover, e.g, 80%
@@ -46,9 +48,17 @@ namespace autotune {
  * are.
  *
  * The mutation rate controls the probability with which mutation occurs.
+ *
+ * Alternatively, the search can be driven in steady state (see nextCandidate
+ * and recordEvaluatedCandidate): candidates are handed out one at a time and
+ * their results are folded back as they arrive, without waiting for a whole
+ * generation to be evaluated.
+ *
+ * With a cost function (see setCostFunction), the bred and mutated candidates
+ * are screened, elites and the initial population are not.
  */
 
-class GeneticSearch {
+class GeneticSearch : public SearchStrategy {
  public:
   /**
    * conf is used to determine which are the tunable parameters, the selected
@@ -60,7 +70,9 @@ class GeneticSearch {
    * through reproduction
    *
    * mutationRate is the probability ([0,100]) that parameters are mutated
-   * (randomly changed) whenever a new generation is created
+   * (randomly changed) whenever a new generation is created, the parameters
+   * affecting the bottlenecks of the best candidate with hardware counters
+   * are mutated twice
    *
    * numberElites best candidates are preserved
    * across generations (elitism), number Elites must be less than n
@@ -94,10 +106,41 @@ class GeneticSearch {
       uint8_t mutationRate,
       size_t numberElites);
 
-  void updateParameters();
+  std::string name() const override {
+    return "genetic";
+  }
+
+  void updateParameters() override;
+
+  /**
+   * Steady-state interface, candidates can be requested and recorded in any
+   * interleaving (from a single thread).
+   *
+   * The initial population is handed out first. Afterwards, each new
+   * candidate is obtained through crossover and mutation of candidates
+   * selected from the pool of evaluated ones, which retains the
+   * kMaxPopulationSize fastest candidates recorded so far (and therefore
+   * subsumes elitism). While fewer than kMinCandidatesForBreeding candidates
+   * have been successfully evaluated, random candidates are produced.
+   */
+  std::unique_ptr<CandidateConfiguration> nextCandidate() override;
+
+  /**
+   * Fold an evaluated candidate into the steady-state pool. Invalid
+   * candidates are discarded, valid ones must have a recorded runtime.
+   */
+  void recordEvaluatedCandidate(
+      std::unique_ptr<CandidateConfiguration> c) override;
 
  private:
   void breed();
+  /// Keep the non elite candidates with the lowest predicted cost, up to the
+  /// population size
+  void screenCandidates();
+  /// Bred or random candidate of the steady-state search
+  std::unique_ptr<CandidateConfiguration> makeCandidate();
+  /// Keep the hardware counters of the fastest candidate that has some
+  void updateBestMetrics(const Population& sorted);
 
   TuningConfiguration crossover(
       TuningConfiguration&,
@@ -108,23 +151,20 @@ class GeneticSearch {
   static constexpr int kMutateIterations = 1000;
   static constexpr int kMinCandidatesForBreeding = 3;
 
-  using Population = std::vector<std::unique_ptr<CandidateConfiguration>>;
-
-  Population population;
-  TuningConfiguration lastBestConf;
-  const size_t kMaxPopulationSize;
   const uint8_t kCrossOverRate;
   const uint8_t kMutationRate;
   const size_t kNumberElites;
 
-  /*
-   * c++11 seeding is (apparently) not of the highest quality:
-   * http://www.pcg-random.org/posts/cpp-seeding-surprises.html
-   * pcg-cpp seems like a good alternative:
-   * https://www.johndcook.com/blog/2017/08/14/testing-rngs-with-practrand/
-   * http://www.pcg-random.org/posts/pcg-passes-practrand.html
-   */
-  mutable std::mt19937_64 rng;
+ private:
+  /// Evaluated candidates of the steady-state search, sorted by runtime
+  Population evaluated_;
+  /// Number of candidates of the initial population handed out by
+  /// nextCandidate
+  size_t numIssued_ = 0;
+  /// Hardware counters of the fastest candidate evaluated with them (see
+  /// --tuner_hardware_counters), the mutations favor the parameters that
+  /// affect its bottlenecks
+  KernelMetrics bestMetrics_;
 };
 
 } // namespace autotune
@@ -16,31 +16,87 @@
 
 #include "tc/autotuner/genetic_tuning_harness.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <fstream>
+#include <future>
+#include <limits>
 #include <numeric>
 #include <thread>
 
 #include <cuda_runtime_api.h>
 #include <glog/stl_logging.h>
 
+#include <tuning.pb.h>
+
+#include "tc/autotuner/distributed_tuning.h"
+#include "tc/autotuner/utils/concurrent_queue.h"
+#include "tc/autotuner/utils/memory_budget.h"
 #include "tc/autotuner/utils/printer.h"
 #include "tc/autotuner/utils/utils.h"
 #include "tc/core/cuda/cuda.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_kernel_metrics.h"
 #include "tc/core/cuda/cuda_mapping_options_cpp_printer.h"
+#include "tc/core/cuda/cuda_measurement.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
 #include "tc/core/execution_engine.h"
 #include "tc/core/flags.h"
 #include "tc/core/polyhedral/cuda/mapping_types.h"
+#include "tc/core/polyhedral/exceptions.h"
 #include "tc/core/scope_guard.h"
 #include "tc/core/utils/math.h"
+#include "tc/core/utils/time.h"
+#include "tc/external/isl.h"
+#include "tc/lang/canonicalize.h"
+#include "tc/lang/tree_views.h"
 
 namespace tc {
 namespace autotune {
+
+std::vector<double> JointTuningReport::penalties() const {
+  CHECK_EQ(runtimes.size(), specializedRuntimes.size());
+  std::vector<double> res;
+  for (size_t i = 0; i < runtimes.size(); ++i) {
+    res.push_back(
+        static_cast<double>(runtimes[i].count()) /
+        std::max<Duration::rep>(1, specializedRuntimes[i].count()));
+  }
+  return res;
+}
+
+std::ostream& operator<<(std::ostream& os, const JointTuningReport& report) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  auto penalties = report.penalties();
+  for (size_t i = 0; i < penalties.size(); ++i) {
+    os << "input set " << i << ": "
+       << duration_cast<microseconds>(report.runtimes[i]).count() << "us ("
+       << duration_cast<microseconds>(report.specializedRuntimes[i]).count()
+       << "us specialized, penalty " << penalties[i] << "x)";
+    if (i + 1 < penalties.size()) {
+      os << ", ";
+    }
+  }
+  return os;
+}
+
 namespace detail {
 
-GeneticTunerHarness::GeneticTunerHarness(
+template <typename Backend>
+constexpr double GeneticTunerHarness<Backend>::kRemeasureSlack;
+template <typename Backend>
+constexpr size_t GeneticTunerHarness<Backend>::kMaxMeasurementsPerOptions;
+template <typename Backend>
+constexpr size_t GeneticTunerHarness<Backend>::kGpuQueueCapacity;
+template <typename Backend>
+constexpr std::chrono::milliseconds
+    GeneticTunerHarness<Backend>::kPipelinePollInterval;
+
+template <typename Backend>
+GeneticTunerHarness<Backend>::GeneticTunerHarness(
     size_t n,
     uint8_t crossoverRate,
     uint8_t mutationRate,
@@ -49,65 +105,164 @@ GeneticTunerHarness::GeneticTunerHarness(
     std::string kernelName,
     const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
     std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
-    CudaMappingOptions baseMapping,
-    std::vector<CudaMappingOptions> startingPoints,
-    const TuningParameterFixer& fixedParams)
+    MappingOptionsType baseMapping,
+    std::vector<MappingOptionsType> startingPoints,
+    const TuningParameterFixer& fixedParams,
+    double weight,
+    std::vector<JointInputs> jointInputs,
+    int tunedKernel)
     : kMaxPopulationSize(n),
       kCrossOverRate(crossoverRate),
       kMutationRate(mutationRate),
       kNumberElites(numberElites),
-      bestCudaMappingOptions_(baseMapping),
+      bestMappingOptions_(baseMapping),
       kTc_(std::move(tc)),
       kKernelName_(std::move(kernelName)),
       currentCompilationJob_(0),
       readyToEvaluate_(),
       numEvaluations_(0),
+      racing_(
+          FLAGS_tuner_racing_rungs,
+          std::max<size_t>(2, FLAGS_tuner_racing_reduction)),
       kInputs_(std::move(inputs)),
       outputs_(std::move(outputs)),
+      kJointInputs_(std::move(jointInputs)),
+      weights_{weight},
       kBaseMapping_(std::move(baseMapping)),
       kStartingPoints_(std::move(startingPoints)) {
+  for (const auto& joint : kJointInputs_) {
+    CHECK(not joint.inputs.empty()) << "Joint tuning input set without inputs";
+    weights_.push_back(joint.weight);
+  }
+  for (auto w : weights_) {
+    CHECK_GT(w, 0) << "Joint tuning weights must be positive";
+  }
   setupTuningParameters();
+  configuration.tunedKernel = tunedKernel;
   configuration.fixParameters(fixedParams);
-  if (not kStartingPoints_.empty()) {
-    std::vector<TuningConfiguration> configs;
-    configs.reserve(kStartingPoints_.size());
-    std::transform(
-        kStartingPoints_.begin(),
-        kStartingPoints_.end(),
-        std::back_inserter(configs),
-        [this, &fixedParams](const CudaMappingOptions& options) {
-          auto config = makeTuningConfiguration(options);
-          config.fixParameters(fixedParams);
-          return config;
-        });
-    tuner_ = make_unique<GeneticSearch>(
-        configs,
-        kMaxPopulationSize,
-        kCrossOverRate,
-        kMutationRate,
-        kNumberElites);
-  } else {
-    tuner_ = make_unique<GeneticSearch>(
-        configuration,
-        kMaxPopulationSize,
-        kCrossOverRate,
-        kMutationRate,
-        kNumberElites);
-  }
+  startingConfigurations_.reserve(kStartingPoints_.size());
+  std::transform(
+      kStartingPoints_.begin(),
+      kStartingPoints_.end(),
+      std::back_inserter(startingConfigurations_),
+      [this, &fixedParams](const MappingOptionsType& options) {
+        auto config = makeTuningConfiguration(options);
+        config.fixParameters(fixedParams);
+        return config;
+      });
+  setSearchStrategy(FLAGS_tuner_search_strategy);
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::setSearchStrategy(
+    const std::string& strategy) {
+  tuner_ = makeSearchStrategy(
+      strategy,
+      configuration,
+      startingConfigurations_,
+      kMaxPopulationSize,
+      kCrossOverRate,
+      kMutationRate,
+      kNumberElites);
 }
 
-void GeneticTunerHarness::run(size_t numGenerations) {
-  for (size_t i = 0; i < numGenerations; ++i) {
-    if (not stopRequested_) {
-      runOneGeneration(i);
+template <typename Backend>
+void GeneticTunerHarness<Backend>::run(size_t numGenerations) {
+  tuningStart_ = std::chrono::steady_clock::now();
+  progress_->start(FLAGS_tuner_threads);
+  trainCostModel();
+  auto evaluators = makeEvaluators();
+  if (not evaluators.empty() and jointTuning()) {
+    throw std::invalid_argument(
+        "Joint tuning over several input sets is not supported with remote "
+        "or sandboxed tuning workers");
+  }
+  if (not evaluators.empty()) {
+    runDistributed(numGenerations, std::move(evaluators));
+    reportTuningCurve();
+    return;
+  }
+  if (FLAGS_tuner_gen_pipelined) {
+    runPipelined(numGenerations);
+  } else {
+    for (size_t i = 0; i < numGenerations; ++i) {
+      if (not stopRequested_) {
+        runOneGeneration(i);
+      }
     }
   }
+  reportTuningCurve();
+  remeasureLocally();
+  measureJointTuningReport();
 }
 
-void GeneticTunerHarness::stopAfterCurrentGeneration() {
+template <typename Backend>
+void GeneticTunerHarness<Backend>::stopAfterCurrentGeneration() {
   stopRequested_ = true;
 }
 
+template <typename Backend>
+void GeneticTunerHarness<Backend>::setCheckpointCallback(
+    std::function<void()> checkpoint) {
+  checkpoint_ = std::move(checkpoint);
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::checkpoint() {
+  if (checkpoint_) {
+    checkpoint_();
+  }
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::setCostModel(
+    const CostModelOptions& options) {
+  costModelOptions_ = options;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::setStopCriteria(
+    const TuningStopCriteria& criteria) {
+  stopCriteria_ = criteria;
+}
+
+template <typename Backend>
+bool GeneticTunerHarness<Backend>::timeBudgetExpired() {
+  return stopCriteria_.timeBudget.count() != 0 and
+      std::chrono::steady_clock::now() - tuningStart_ >=
+      stopCriteria_.timeBudget;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::checkStopCriteria() {
+  std::lock_guard<std::mutex> lock(bestTimeMtx_);
+  if (bestTime_ < bestTimeAtLastGeneration_) {
+    bestTimeAtLastGeneration_ = bestTime_;
+    numberStalledGenerations_ = 0;
+  } else {
+    ++numberStalledGenerations_;
+  }
+
+  if (timeBudgetExpired()) {
+    LOG(INFO) << "[TUNER] Stopping, the tuning time budget is spent";
+    stopRequested_ = true;
+  } else if (
+      stopCriteria_.maxStalledGenerations > 0 and
+      numberStalledGenerations_ >= stopCriteria_.maxStalledGenerations) {
+    LOG(INFO) << "[TUNER] Stopping, no improvement in "
+              << numberStalledGenerations_ << " generations";
+    stopRequested_ = true;
+  } else if (
+      stopCriteria_.targetSpeedup > 0 and
+      baselineTime_ != std::numeric_limits<size_t>::max() and
+      bestTime_ * stopCriteria_.targetSpeedup <= baselineTime_) {
+    LOG(INFO) << "[TUNER] Stopping, reached a speedup of "
+              << static_cast<double>(baselineTime_) / bestTime_
+              << " over the base mapping options";
+    stopRequested_ = true;
+  }
+}
+
 namespace {
 
 std::vector<size_t> filterHigherThan(
@@ -126,6 +281,25 @@ void removeDuplicates(std::vector<size_t>& v) {
   v.erase(std::unique(v.begin(), v.end()), v.end());
 }
 
+// Tile sizes are searched among the exact divisors of the input sizes up to
+// this value, the ceil divisors by powers of 2 of the sizes and the powers of
+// 2 up to this value.
+constexpr size_t kMaxSearchedDivisor = 256;
+
+// The fusion partitions are searched among the boundaries between the first
+// tensors of the TC, up to this number of boundaries.
+constexpr size_t kMaxFusionPartitionBits = 6;
+
+size_t largestSize(const std::vector<const DLTensor*>& inputs) {
+  size_t res = 1;
+  for (const auto& input : inputs) {
+    for (int i = 0; i < input->ndim; i++) {
+      res = std::max<size_t>(res, input->shape[i]);
+    }
+  }
+  return res;
+}
+
 std::vector<size_t> inputDivisorsAndPowers2(
     const std::vector<const DLTensor*>& inputs) {
   std::vector<size_t> sizes;
@@ -137,11 +311,17 @@ std::vector<size_t> inputDivisorsAndPowers2(
   removeDuplicates(sizes);
   std::vector<size_t> divsAndPows;
   for (auto size : sizes) {
-    divsAndPows =
-        mergeVectors(std::move(divsAndPows), powers2andCeilDivisors(size));
+    divsAndPows = mergeVectors(
+        std::move(divsAndPows),
+        powers2andCeilDivisors(size),
+        divisorsUpTo(size, kMaxSearchedDivisor));
   }
-  divsAndPows =
-      mergeVectors(std::move(divsAndPows), powers2andCeilDivisors(256));
+  // Powers of 2 beyond the first one that covers the largest size all tile
+  // like it does.
+  divsAndPows = mergeVectors(
+      std::move(divsAndPows),
+      powers2andCeilDivisors(
+          std::min(largestSize(inputs), kMaxSearchedDivisor)));
   return divsAndPows;
 }
 
@@ -156,52 +336,85 @@ size_t largestDim(const std::vector<const DLTensor*>& inputs) {
 
 } // namespace
 
-void GeneticTunerHarness::setupTuningParameters() {
+template <typename Backend>
+std::vector<const typename Backend::MappingOptionsType*>
+GeneticTunerHarness<Backend>::startingOptions() const {
+  std::vector<const MappingOptionsType*> res{&kBaseMapping_};
+  for (const auto& options : kStartingPoints_) {
+    res.push_back(&options);
+  }
+  return res;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::setupTuningParameters() {
   CHECK_GT(kInputs_.size(), 0);
   auto range = inputDivisorsAndPowers2(kInputs_.begin()->second);
-  auto rangeUpTo64 = filterHigherThan(range, 64);
-
   // 0 is a valid tiling annotation and signals no tiling of that dimension
-  // 0 is not a valid block / grid annotation
   auto nTilesDim =
       largestDim(kInputs_.begin()->second) + 1; // TODO [ntv]: change me
-  auto tileRange = range;
-  tileRange.push_back(0);
-  configuration.tilingParams.setRange(nTilesDim, range);
+  // Joint tuning searches the sizes suited to any of its input sets
+  for (const auto& joint : kJointInputs_) {
+    const auto& inputs = joint.inputs.begin()->second;
+    range = mergeVectors(std::move(range), inputDivisorsAndPowers2(inputs));
+    nTilesDim = std::max(nTilesDim, largestDim(inputs) + 1);
+  }
+  auto rangeUpTo64 = filterHigherThan(range, 64);
 
-  configuration.blockParams.setRange(range, "b");
-  configuration.gridParams.setRange(range, "g");
+  // The tile sizes of the base options and of the starting points are always
+  // part of the range, the sizes derived from the inputs may not cover them.
+  auto tileRange = range;
+  for (auto options : startingOptions()) {
+    auto tiles = options->generic.tiling.extractVector();
+    tileRange = mergeVectors(
+        std::move(tileRange), std::vector<size_t>(tiles.begin(), tiles.end()));
+  }
+  configuration.tilingParams.setRange(nTilesDim, tileRange);
 
   configuration.unrollFactor =
       RangeParameter({1, 2, 4, 8, 16, 32, 64, 128, 256}, "unroll");
-}
 
-CudaMappingOptions GeneticTunerHarness::makeOptions(
-    const CandidateConfiguration& c) {
-  auto options = kBaseMapping_;
-  c.configuration.applyToCudaMappingOptions(options);
-  return options;
-}
+  // The outer schedule searches the partitions of the first tensors of the
+  // TC into groups that are never fused.
+  auto& outer = configuration.outerScheduleOptions;
+  outer.tensors.clear();
+  for (const auto& c : lang::Def(kTc_).statements()) {
+    auto name = c.ident().name();
+    if (outer.tensors.empty() or outer.tensors.back() != name) {
+      outer.tensors.push_back(name);
+    }
+  }
+  size_t partitionBits =
+      std::min<size_t>(outer.tensors.size(), kMaxFusionPartitionBits + 1);
+  std::vector<size_t> partitions(size_t(1) << (partitionBits - 1));
+  std::iota(partitions.begin(), partitions.end(), 0);
+  outer.fusionPartition = RangeParameter(partitions, "fusion partition");
 
-TuningConfiguration GeneticTunerHarness::makeTuningConfiguration(
-    const CudaMappingOptions& options) {
-  TuningConfiguration conf = configuration;
-  conf.fromCudaMappingOptions(options);
-  return conf;
+  setupBackendTuningParameters(range);
 }
 
-std::vector<size_t> parseGpus() {
-  std::stringstream ss(FLAGS_tuner_gpus);
-  size_t gpu;
+namespace {
+std::vector<size_t> parseDeviceList(const std::string& list) {
+  std::stringstream ss(list);
+  size_t device;
   std::vector<size_t> res;
-  while (ss >> gpu) {
-    res.push_back(gpu);
+  while (ss >> device) {
+    res.push_back(device);
     if (ss.peek() == ',') {
       ss.ignore();
     }
   }
   return res;
 }
+} // namespace
+
+std::vector<size_t> parseGpus() {
+  return parseDeviceList(FLAGS_tuner_gpus);
+}
+
+std::vector<size_t> parseCpus() {
+  return parseDeviceList(FLAGS_tuner_cpus);
+}
 
 #define LOG_LINE_BY_LINE(GSTREAM, ISTREAM)               \
   for (std::string line; std::getline(ISTREAM, line);) { \
@@ -216,59 +429,27 @@ std::vector<size_t> parseGpus() {
 //
 // The function returns true if purning is possible and we can skip poorly
 // performing versions early.
+template <typename Backend>
 template <typename ExecutorType>
-bool GeneticTunerHarness::warmupOrPrune(
+bool GeneticTunerHarness<Backend>::warmupOrPrune(
     ExecutorType& engine,
     const std::vector<DLTensor*>& outputs,
     const std::vector<const DLTensor*>& inputs,
     size_t handle,
     size_t bestTimeSoFar) {
-  // Pruning based on number of threads: if you don't hit at least k warps
-  // (default k = 8; 256 total threads, controlled by
-  // FLAGS_tuner_min_launch_total_threads) then it's likely the kernel is not
-  // performing great.
-  // This may be completely off but is a good first initial rule of thumb
-  // for stress-testing autotuning.
-  //
-  // The launch bounds information is only available after compilation and is
+  // The launch information is only available after compilation and is
   // task-local. We pass a callback to determine whether to prune or not.
-  auto debugTuner = FLAGS_debug_tuner;
-  auto minThreads = FLAGS_tuner_min_launch_total_threads;
-  auto threadPruningFunction = std::function<bool(const TcExecutor*)>(
-      [debugTuner, minThreads](const TcExecutor* exec) {
-        CHECK(exec);
-        USING_MAPPING_SHORT_NAMES(BX, BY, BZ, TX, TY, TZ);
-        auto block = static_cast<const CudaTcExecutor*>(exec)->block;
-        auto nThreads = TX.mappingSize(block) * TY.mappingSize(block) *
-            TZ.mappingSize(block);
-        auto grid = static_cast<const CudaTcExecutor*>(exec)->grid;
-        auto nBlocks =
-            BX.mappingSize(grid) * BY.mappingSize(grid) * BZ.mappingSize(grid);
-        if (nBlocks * nThreads < minThreads) {
-          if (debugTuner) {
-            std::stringstream ssInfo;
-            ssInfo << "Skip configuration with too few threads: " << block
-                   << "\n"
-                   << CudaMappingOptionsAsCpp(
-                          CudaMappingOptions(exec->options));
-            LOG_LINE_BY_LINE(INFO, ssInfo);
-          }
-          return true;
-        } else {
-          LOG_IF(INFO, debugTuner)
-              << "Run configuration launch bounds blocks: " << grid
-              << " and threads: " << block << "\n";
-        }
-        return false;
-      });
+  auto launchPruningFunction = makeLaunchPruningFunction();
 
   // 1. Perform a first run which may have one of 3 behaviors:
   //   1.a. return Duration::max(), which means that pruning should occur,
-  //   1.b. return a very slow first execution time, we should stop
-  //     early. This is akin to pruning but in this case we have run once,
+  //   1.b. return a very slow first execution time, past
+  //     --tuner_kernel_timeout_ms or compared to the best so far, we should
+  //     stop early. This is akin to pruning but in this case we have run
+  //     once,
   //   1.c. return a reasonable execution time, in which case we proceed with
   //     warmup.
-  auto prof = engine.run(handle, inputs, outputs, true, threadPruningFunction);
+  auto prof = engine.run(handle, inputs, outputs, true, launchPruningFunction);
 
   // 1.a.
   if (prof == Duration::max()) {
@@ -276,6 +457,14 @@ bool GeneticTunerHarness::warmupOrPrune(
   }
 
   // 1.b.
+  if (FLAGS_tuner_kernel_timeout_ms > 0 and
+      prof >= std::chrono::milliseconds(FLAGS_tuner_kernel_timeout_ms)) {
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "[TUNER] Kernel timed out after "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(prof).count()
+        << "ms";
+    return true;
+  }
   constexpr size_t kCatastrophicPerfFactor = 100;
   if (bestTimeSoFar < std::numeric_limits<size_t>::max() and
       prof >= std::chrono::microseconds(
@@ -300,56 +489,355 @@ bool GeneticTunerHarness::warmupOrPrune(
   return false;
 }
 
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::compileCandidate(
+    ExecutorType& engine,
+    CandidateConfiguration& conf,
+    size_t current) {
+  auto start = std::chrono::high_resolution_clock::now();
+  ScopeGuard sgProgress([this, start]() {
+    progress_->recordCompilation(
+        std::chrono::high_resolution_clock::now() - start);
+  });
+  auto options = makeOptions(conf);
+  // The compilation holds its share of the memory budget until it is done,
+  // whether it succeeds or not.
+  auto admission = MemoryBudget::compilations().admit();
+  // The isl contexts of the compilations are local to this thread
+  isl::with_exceptions::ScopedMaxOperations maxOperations(
+      FLAGS_tuner_compile_max_isl_operations);
+  try {
+    if (FLAGS_debug_tuner) {
+      std::stringstream ssInfo(optionsString(options));
+      LOG(INFO) << "[COMPILE] Start compilation @:" << current;
+      LOG_LINE_BY_LINE(INFO, ssInfo);
+    }
+    auto handle = engine.compile(
+        kKernelName_,
+        kInputs_.begin()->second,
+        options.toProtobufSerializedString(),
+        makeCompilePruningFunction());
+    if (handle == InvalidHandle) {
+      LOG_IF(INFO, FLAGS_debug_tuner) << "[COMPILE] Pruned @:" << current;
+      conf.invalid = true;
+      return;
+    }
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "[COMPILE] Done compilation, got handle: " << handle;
+    conf.optionalCompilationHandle =
+        std::unique_ptr<size_t>(new size_t(handle));
+    // The options of joint tuning must be valid for all the input sets
+    conf.jointCompilationHandles.clear();
+    for (const auto& joint : kJointInputs_) {
+      auto jointHandle = engine.compile(
+          kKernelName_,
+          joint.inputs.begin()->second,
+          options.toProtobufSerializedString(),
+          makeCompilePruningFunction());
+      if (jointHandle == InvalidHandle) {
+        LOG_IF(INFO, FLAGS_debug_tuner)
+            << "[COMPILE] Pruned for a joint input set @:" << current;
+        clearCompilationHandles(engine, conf);
+        conf.invalid = true;
+        return;
+      }
+      conf.jointCompilationHandles.push_back(jointHandle);
+    }
+  } catch (const polyhedral::KernelTooLargeException& e) {
+    // Expected for large unroll values, rejected before NVRTC runs.
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "[COMPILE] Pruned @:" << current << ", " << e.what();
+    clearCompilationHandles(engine, conf);
+    conf.invalid = true;
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[TUNER][COMPILE] failed compilation: " << e.what();
+    std::stringstream ssWarning(optionsString(options));
+    LOG_LINE_BY_LINE(WARNING, ssWarning);
+    clearCompilationHandles(engine, conf);
+    conf.invalid = true;
+  }
+  CHECK(conf.invalid || conf.optionalCompilationHandle)
+      << "GPU kernel not compiled";
+}
+
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::clearCompilationHandles(
+    ExecutorType& engine,
+    CandidateConfiguration& conf) {
+  if (conf.optionalCompilationHandle) {
+    engine.clear(*conf.optionalCompilationHandle);
+    conf.optionalCompilationHandle = nullptr;
+  }
+  for (auto handle : conf.jointCompilationHandles) {
+    engine.clear(handle);
+  }
+  conf.jointCompilationHandles.clear();
+}
+
+template <typename Backend>
+template <typename ExecutorType>
+size_t GeneticTunerHarness<Backend>::calibrateDevices(
+    ExecutorType& engine,
+    const std::vector<size_t>& gpus) {
+  if (gpus.size() < 2 or not FLAGS_tuner_normalize_device_runtimes) {
+    return InvalidHandle;
+  }
+  size_t handle = InvalidHandle;
+  try {
+    handle = engine.compile(
+        kKernelName_,
+        kInputs_.begin()->second,
+        kBaseMapping_.toProtobufSerializedString());
+  } catch (std::exception& e) {
+    LOG(WARNING) << "[TUNER] Runtimes are not normalized across devices, "
+                 << "the base options fail to compile: " << e.what();
+    return InvalidHandle;
+  }
+  {
+    std::lock_guard<std::mutex> lock(deviceTimesMtx_);
+    referenceDevice_ = gpus.front();
+  }
+  for (auto gpu : gpus) {
+    calibrateDevice(gpu, engine, handle);
+  }
+  return handle;
+}
+
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::calibrateDevice(
+    size_t gpu,
+    ExecutorType& engine,
+    size_t handle) {
+  typename Backend::WithDevice wd(gpu);
+  CHECK_EQ(1, kInputs_.count(gpu));
+  auto& inputs = kInputs_.at(gpu);
+  CHECK_EQ(1, outputs_.count(gpu));
+  auto& outputs = outputs_.at(gpu);
+  Duration runtime;
+  try {
+    for (size_t i = 0; i < kReducedWarmupIterations; ++i) {
+      engine.run(handle, inputs, outputs);
+    }
+    runtime = median(measureUntilStable(
+        [&]() { return engine.run(handle, inputs, outputs, true); },
+        MeasurementBudget::fromFlags()));
+  } catch (std::exception& e) {
+    LOG(WARNING) << "[TUNER] Could not calibrate gpu " << gpu << ": "
+                 << e.what();
+    return;
+  }
+  std::lock_guard<std::mutex> lock(deviceTimesMtx_);
+  deviceTimes_[gpu] = runtime;
+  LOG_IF(INFO, FLAGS_debug_tuner)
+      << "[TUNER] Base options run in "
+      << std::chrono::duration_cast<std::chrono::microseconds>(runtime).count()
+      << "us on gpu " << gpu;
+}
+
+template <typename Backend>
+double GeneticTunerHarness<Backend>::deviceScale(size_t gpu) {
+  std::lock_guard<std::mutex> lock(deviceTimesMtx_);
+  auto reference = deviceTimes_.find(referenceDevice_);
+  auto own = deviceTimes_.find(gpu);
+  if (reference == deviceTimes_.end() or own == deviceTimes_.end() or
+      own->second == Duration::zero()) {
+    return 1.0;
+  }
+  return static_cast<double>(reference->second.count()) / own->second.count();
+}
+
+template <typename Backend>
 template <typename ExecutorType>
-void GeneticTunerHarness::doCompile(ExecutorType& engine) {
+void GeneticTunerHarness<Backend>::doCompile(ExecutorType& engine) {
   // Atomically fetch and add the next job until there are no jobs left
   while (true) {
     auto current = currentCompilationJob_.fetch_add(1);
     if (current >= tuner_->population.size()) {
       break;
     }
-    auto& pConf = tuner_->population.at(current);
-    auto options = makeOptions(*pConf);
-    try {
-      if (FLAGS_debug_tuner) {
-        std::stringstream ssInfo;
-        CudaMappingOptionsCppPrinter infoPrinter(ssInfo);
-        infoPrinter << options;
-        LOG(INFO) << "[COMPILE] Start compilation @:" << current;
-        LOG_LINE_BY_LINE(INFO, ssInfo);
-      }
-      auto handle = engine.compile(
-          kKernelName_,
-          kInputs_.begin()->second,
-          options.toProtobufSerializedString());
-      LOG_IF(INFO, FLAGS_debug_tuner)
-          << "[COMPILE] Done compilation, got handle: " << handle;
-      pConf->optionalCompilationHandle =
-          std::unique_ptr<size_t>(new size_t(handle));
-    } catch (const std::exception& e) {
-      LOG(WARNING) << "[TUNER][COMPILE] failed compilation: " << e.what();
-      std::stringstream ssWarning;
-      CudaMappingOptionsCppPrinter warningPrinter(ssWarning);
-      warningPrinter << options;
-      LOG_LINE_BY_LINE(WARNING, ssWarning);
-      pConf->invalid = true;
+    if (reusedEvaluations_[current]) {
+      readyToEvaluate_[current].store(true);
+      continue;
+    }
+    if (timeBudgetExpired()) {
+      // Out of time, the candidate is skipped
+      tuner_->population.at(current)->invalid = true;
+      readyToEvaluate_[current].store(true);
+      continue;
     }
-    CHECK(pConf->invalid || pConf->optionalCompilationHandle)
-        << "GPU kernel not compiled";
+    compileCandidate(engine, *tuner_->population.at(current), current);
     readyToEvaluate_[current].store(true);
   }
 }
 
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::benchmarkCandidate(
+    size_t gpu,
+    ExecutorType& engine,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    CandidateConfiguration& conf) {
+  CHECK(conf.optionalCompilationHandle) << "GPU kernel not compiled";
+  auto handle = *(conf.optionalCompilationHandle);
+  auto options = makeOptions(conf);
+  if (FLAGS_debug_tuner) {
+    // Always log option to INFO so we can correlate to timing offling
+    std::stringstream ssInfo;
+    ssInfo << "Launch GPU kernel on gpu: " << std::to_string(gpu)
+           << " handle: " << std::to_string(handle) << " options:\n"
+           << optionsString(options);
+    LOG_LINE_BY_LINE(INFO, ssInfo);
+  }
+
+  std::vector<Duration> runtimes;
+  std::vector<Duration> jointRuntimes;
+  auto scale = deviceScale(gpu);
+  ScopeGuard sgJointHandles([&]() {
+    for (auto jointHandle : conf.jointCompilationHandles) {
+      engine.clear(jointHandle);
+    }
+    conf.jointCompilationHandles.clear();
+  });
+  try {
+    // The best time of joint tuning aggregates all the input sets, it cannot
+    // be compared to the runtime on the main inputs to prune early
+    size_t bestTimeSoFar = std::numeric_limits<size_t>::max();
+    if (not jointTuning()) {
+      std::lock_guard<std::mutex> lock(bestTimeMtx_);
+      bestTimeSoFar = bestTime_;
+    }
+    // The best time is that of the reference device
+    if (bestTimeSoFar != std::numeric_limits<size_t>::max()) {
+      bestTimeSoFar = static_cast<size_t>(bestTimeSoFar / scale);
+    }
+    auto prune = warmupOrPrune(engine, outputs, inputs, handle, bestTimeSoFar);
+    if (prune) {
+      conf.invalid = true;
+      engine.clear(handle);
+      return;
+    } else {
+      // The candidates of joint tuning are ranked on all the input sets,
+      // they get the full budget
+      auto run = [&]() { return engine.run(handle, inputs, outputs, true); };
+      runtimes = jointTuning()
+          ? measureUntilStable(run, MeasurementBudget::fromFlags())
+          : racing_.measure(run, MeasurementBudget::fromFlags(), scale);
+      auto runtime = median(runtimes);
+      if (FLAGS_tuner_hardware_counters and
+          std::chrono::duration_cast<std::chrono::microseconds>(runtime)
+                  .count() <= bestTimeSoFar * kHardwareCountersSlack) {
+        collectHardwareCounters(engine, inputs, outputs, handle, runtime, conf);
+      }
+      engine.clear(handle);
+    }
+    CHECK_EQ(kJointInputs_.size(), conf.jointCompilationHandles.size());
+    for (size_t i = 0; i < kJointInputs_.size(); ++i) {
+      auto jointHandle = conf.jointCompilationHandles[i];
+      CHECK_EQ(1, kJointInputs_[i].inputs.count(gpu));
+      const auto& jointInputs = kJointInputs_[i].inputs.at(gpu);
+      CHECK_EQ(1, kJointInputs_[i].outputs.count(gpu));
+      const auto& jointOutputs = kJointInputs_[i].outputs.at(gpu);
+      if (warmupOrPrune(
+              engine,
+              jointOutputs,
+              jointInputs,
+              jointHandle,
+              std::numeric_limits<size_t>::max())) {
+        conf.invalid = true;
+        return;
+      }
+      jointRuntimes.push_back(median(measureUntilStable(
+          [&]() {
+            return engine.run(jointHandle, jointInputs, jointOutputs, true);
+          },
+          MeasurementBudget::fromFlags())));
+    }
+  } catch (std::exception& e) {
+    LOG(WARNING) << "Runtime error gpu " << gpu << ": " << e.what();
+    std::stringstream ssWarning(optionsString(options));
+    LOG(WARNING) << "Aborted execution on gpu " << gpu;
+    LOG_LINE_BY_LINE(WARNING, ssWarning);
+    recoverFromRuntimeError(gpu, options);
+    conf.invalid = true;
+    return;
+  }
+
+  auto prof = median(runtimes);
+  if (jointTuning()) {
+    jointRuntimes.insert(jointRuntimes.begin(), prof);
+    prof = weightedGeometricMean(jointRuntimes, weights_);
+  }
+  prof = std::chrono::duration_cast<Duration>(prof * scale);
+  auto prof_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(prof).count();
+
+  LOG_IF(INFO, tc::FLAGS_debug_tuner)
+      << "Run on gpu " << gpu << " took: " << prof_us << "us over "
+      << runtimes.size() << " runs"
+      << (jointTuning() ? " (weighted geometric mean of the input sets)" : "")
+      << (scale != 1.0 ? " scaled to the reference gpu" : "");
+  conf.runtime = prof;
+  updateBest(prof, options);
+
+  // Trailing sanity check: this looks like a spurious case, fail very hard
+  if (prof_us == 0) {
+    std::stringstream ss;
+    ss << "Runtimes: ";
+    for (auto r : runtimes) {
+      std::cout
+          << std::chrono::duration_cast<std::chrono::microseconds>(r).count()
+          << " ";
+    }
+    LOG(FATAL) << "The measured runtime is 0, marking as invalid: "
+               << ss.str() << "\n"
+               << optionsString(options);
+  }
+}
+
+template <typename Backend>
 template <typename ExecutorType>
-void GeneticTunerHarness::doGpuWork(
+void GeneticTunerHarness<Backend>::collectHardwareCounters(
+    ExecutorType& engine,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    size_t handle,
+    Duration runtime,
+    CandidateConfiguration& conf) {
+  conf.metrics = collectKernelMetrics(
+      [&]() { engine.run(handle, inputs, outputs); }, runtime);
+  if (conf.metrics.empty()) {
+    LOG_FIRST_N(WARNING, 1)
+        << "No hardware counter could be collected on gpu "
+        << CudaGPUInfo::GPUInfo().GetGPUName();
+    return;
+  }
+  LOG_IF(INFO, FLAGS_debug_tuner) << "Hardware counters: " << conf.metrics;
+  if (OptionsCacheType::cacheEnabled()) {
+    OptionsCacheType::getCache()->recordMetrics(
+        lang::canonicalTc(kTc_),
+        makeOptions(conf),
+        inputs,
+        dlutils::constPtrs(outputs),
+        conf.metrics);
+  }
+}
+
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::doGpuWork(
     size_t gpu,
     ExecutorType& engine,
     Printer& printer) {
-  WithDevice wd(gpu);
+  typename Backend::WithDevice wd(gpu);
   CHECK_EQ(1, kInputs_.count(gpu));
   auto& inputs = kInputs_.at(gpu);
   CHECK_EQ(1, outputs_.count(gpu));
   auto& outputs = outputs_.at(gpu);
+  auto& worker = progress_->worker("gpu " + std::to_string(gpu));
 
   while (true) {
     bool found = false;
@@ -369,130 +857,90 @@ void GeneticTunerHarness::doGpuWork(
     } else {
       if (numEvaluations_.load() >= tuner_->population.size()) {
         // No more work can arrive, exit
+        logClockState(gpu);
         return;
       }
       // More work will arrive, loop.
       // TODO: Prob need some delaying mechanism to reduce contention
+      printer.tick();
       continue;
     }
 
     auto& pConf = tuner_->population.at(current);
-    if (pConf->invalid) {
-      continue;
-    }
-    CHECK(pConf->optionalCompilationHandle) << "GPU kernel not compiled";
-    auto handle = *(pConf->optionalCompilationHandle);
-    auto options = makeOptions(*pConf);
-    if (FLAGS_debug_tuner) {
-      // Always log option to INFO so we can correlate to timing offling
-      std::stringstream ssInfo;
-      ssInfo << "Launch GPU kernel on gpu: " << std::to_string(gpu)
-             << " handle: " << std::to_string(handle) << " options:\n"
-             << CudaMappingOptionsAsCpp(options);
-      LOG_LINE_BY_LINE(INFO, ssInfo);
-    }
-
-    std::vector<Duration> runtimes;
-    try {
-      size_t bestTimeSoFar;
-      {
-        std::lock_guard<std::mutex> lock(bestTimeMtx_);
-        bestTimeSoFar = bestTime_;
-      }
-      auto prune =
-          warmupOrPrune(engine, outputs, inputs, handle, bestTimeSoFar);
-      if (prune) {
-        pConf->invalid = true;
-        continue;
-      } else {
-        runtimes.reserve(kReducedBenchmarkIterations);
-        for (size_t i = 0; i < kReducedBenchmarkIterations; ++i) {
-          runtimes.push_back(engine.run(handle, inputs, outputs, true));
-        }
-        engine.clear(handle);
-      }
-    } catch (std::exception& e) {
-      LOG(WARNING) << "Runtime error gpu " << gpu << ": " << e.what();
-      std::stringstream ssWarning;
-      CudaMappingOptionsCppPrinter warningPrinter(ssWarning);
-      warningPrinter << options;
-      LOG(WARNING) << "Aborted execution on gpu " << gpu;
-      LOG_LINE_BY_LINE(WARNING, ssWarning);
-      while (cudaGetLastError() != cudaSuccess) {
-        // In case of errors in the generated, we cannot rely on deviceReset to
-        // set the GPU in a clean state. So instead we just pop and discard all
-        // the errors accumulated on the GPU until we get to a clean slate
-        // (i.e. cudaSuccess).
-        ;
-      }
-      try {
-        // Some errors, such as illegal memory access, cannot be recovered from
-        // without a cudaDeviceReset (i.e. because user protection)
-        // In those cases we have no choice than to fail hard.
-        TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
-      } catch (const std::exception& e) {
-        LOG(FATAL) << "[CUDA][FATAL] cuda error on gpu " << gpu << ": "
-                   << e.what() << "\n"
-                   << CudaMappingOptionsAsCpp(options);
+    if (reusedEvaluations_[current]) {
+      if (not pConf->invalid) {
+        printer.record(pConf->runtime);
       }
-      pConf->invalid = true;
       continue;
     }
-
-    auto prof = median(runtimes);
-    auto prof_us =
-        std::chrono::duration_cast<std::chrono::microseconds>(prof).count();
-
-    LOG_IF(INFO, tc::FLAGS_debug_tuner)
-        << "Run on gpu " << gpu << " took: " << prof_us << "us";
-    printer.record(prof);
-    pConf->runtime = prof;
-
-    // Save best time under lock
-    {
-      std::lock_guard<std::mutex> lock(bestTimeMtx_);
-      if (prof_us < bestTime_) {
-        bestTime_ = prof_us;
-        bestCudaMappingOptions_ = options;
-      }
+    if (pConf->invalid) {
+      worker.recordEvaluation(Duration::zero(), false, Duration::zero());
+      recordEvaluatedOptions(*pConf);
+      continue;
     }
-
-    // Trailing sanity check: this looks like a spurious case, fail very hard
-    if (prof_us == 0) {
-      std::stringstream ss;
-      ss << "Runtimes: ";
-      for (auto r : runtimes) {
-        std::cout
-            << std::chrono::duration_cast<std::chrono::microseconds>(r).count()
-            << " ";
-      }
-      LOG(FATAL) << "The measured runtime is 0, marking as invalid: "
-                 << ss.str() << "\n"
-                 << CudaMappingOptionsAsCpp(options);
+    auto start = std::chrono::high_resolution_clock::now();
+    benchmarkCandidate(gpu, engine, inputs, outputs, *pConf);
+    worker.recordEvaluation(
+        std::chrono::high_resolution_clock::now() - start,
+        not pConf->invalid,
+        pConf->runtime);
+    recordEvaluatedOptions(*pConf);
+    if (not pConf->invalid) {
+      printer.record(pConf->runtime);
     }
   } // end while
 }
 
-void GeneticTunerHarness::runOneGeneration(size_t generation) {
+template <typename Backend>
+void GeneticTunerHarness<Backend>::runOneGeneration(size_t generation) {
+  ProfilerRange range(
+      ("tc tuner generation " + std::to_string(generation)).c_str());
+  progress_->setGeneration(generation);
   // Define tensors per GPU once globally
-  auto gpus = parseGpus();
-  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  auto gpus = devices();
+  tc::ExecutionEngine<typename Backend::ExecutorType> engine;
   engine.define({kTc_});
+  // Pairs of a candidate and the earlier identical one evaluated for it
+  std::vector<std::pair<size_t, size_t>> duplicates;
 
   {
     // Initialize for this round
     currentCompilationJob_.store(0);
     numEvaluations_.store(0);
+    staticPruningStats_.reset();
     readyToEvaluate_.resize(0);
     for (int i = 0; i < kMaxPopulationSize; ++i) {
       readyToEvaluate_.emplace_back();
       readyToEvaluate_[i].store(false);
     }
+
+    // Candidates evaluated before, e.g. the elites, or identical to an
+    // earlier candidate of the generation, e.g. children of crossover, are
+    // neither compiled nor benchmarked
+    auto& population = tuner_->population;
+    reusedEvaluations_.assign(population.size(), 0);
+    std::vector<MappingOptionsType> options;
+    options.reserve(population.size());
+    for (size_t i = 0; i < population.size(); ++i) {
+      options.push_back(makeOptions(*population[i]));
+      if (reuseEvaluation(*population[i])) {
+        reusedEvaluations_[i] = 1;
+        continue;
+      }
+      for (size_t j = 0; j < i; ++j) {
+        if (not reusedEvaluations_[j] and options[j] == options[i]) {
+          reusedEvaluations_[i] = 1;
+          duplicates.emplace_back(i, j);
+          break;
+        }
+      }
+    }
     Printer printer(
         generation,
         readyToEvaluate_.size(),
         currentCompilationJob_,
-        numEvaluations_);
+        numEvaluations_,
+        staticPruningStats_);
     auto logGenerations = FLAGS_tuner_gen_log_generations;
     ScopeGuard sgPrinter([logGenerations, &printer]() {
       printer.stop();
@@ -501,19 +949,24 @@ void GeneticTunerHarness::runOneGeneration(size_t generation) {
       }
     });
 
-    // Just spawn and join new threads for each generation
-    std::vector<std::thread> cpuCompilationThreads;
-    cpuCompilationThreads.reserve(FLAGS_tuner_threads);
-    ScopeGuard sgCompilationThreads([&cpuCompilationThreads]() {
-      for (auto& cpuCompilationThread : cpuCompilationThreads) {
-        cpuCompilationThread.join();
+    // Compile on the engine's pool, doCompile catches compilation errors
+    engine.setCompilationThreads(FLAGS_tuner_threads);
+    std::vector<std::future<void>> cpuCompilationJobs;
+    cpuCompilationJobs.reserve(FLAGS_tuner_threads);
+    ScopeGuard sgCompilationJobs([&cpuCompilationJobs]() {
+      for (auto& cpuCompilationJob : cpuCompilationJobs) {
+        cpuCompilationJob.wait();
       }
     });
     for (int i = 0; i < FLAGS_tuner_threads; ++i) {
-      cpuCompilationThreads.emplace_back(
-          [this, &engine]() { this->doCompile(engine); });
+      cpuCompilationJobs.push_back(engine.compilationPool().submit(
+          [this, &engine]() { this->doCompile(engine); }));
     }
 
+    // The devices are calibrated again at each generation, a device shared
+    // with other jobs may have become busier or idle
+    calibrateDevices(engine, gpus);
+
     // Just spawn and join new threads for each generation
     std::vector<std::thread> gpuWorkerThreads;
     gpuWorkerThreads.reserve(gpus.size());
@@ -530,17 +983,1256 @@ void GeneticTunerHarness::runOneGeneration(size_t generation) {
   }
 
   // At this point everything is synchronized because out of scope, done
+  for (const auto& d : duplicates) {
+    auto& population = tuner_->population;
+    population[d.first]->invalid = population[d.second]->invalid;
+    population[d.first]->runtime = population[d.second]->runtime;
+  }
+
+  logProgress();
+  checkStopCriteria();
+  trainCostModel();
+  tuner_->updateParameters();
+  checkpoint();
+}
+
+template <typename Backend>
+std::vector<typename GeneticTunerHarness<Backend>::TuningCurvePoint>
+GeneticTunerHarness<Backend>::tuningCurve() {
+  std::lock_guard<std::mutex> lock(bestTimeMtx_);
+  return tuningCurve_;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::reportTuningCurve() {
+  using namespace std::chrono;
+  auto curve = tuningCurve();
+  std::stringstream ss;
+  for (const auto& point : curve) {
+    ss << tuner_->name() << "," << kKernelName_ << ","
+       << duration_cast<milliseconds>(point.elapsed).count() << ","
+       << point.numberEvaluated << ","
+       << duration_cast<microseconds>(point.bestRuntime).count() << "\n";
+  }
+  LOG_IF(INFO, FLAGS_debug_tuner)
+      << "[TUNER] Tuning curve (strategy,kernel,elapsed ms,evaluated,best us):"
+      << "\n"
+      << ss.str();
+  if (not FLAGS_tuner_tuning_curve_file.empty()) {
+    std::ofstream out(FLAGS_tuner_tuning_curve_file, std::ios::app);
+    if (not out) {
+      LOG(ERROR) << "Could not open " << FLAGS_tuner_tuning_curve_file;
+      return;
+    }
+    out << ss.str();
+  }
+}
 
+template <typename Backend>
+void GeneticTunerHarness<Backend>::logProgress() {
   if (FLAGS_debug_tuner) {
+    logCompileTimings();
+    LOG(INFO) << "[TUNER][GENERATION LOG] measurements stopped per rung: "
+              << racing_.stoppedPerRung();
     LOG(INFO) << "[TUNER][GENERATION LOG] best option so far:";
-    std::stringstream ssInfo;
-    CudaMappingOptionsCppPrinter infoPrinter(ssInfo);
-    infoPrinter << bestMappingOption();
+    std::stringstream ssInfo(optionsString(bestMappingOption()));
     LOG_LINE_BY_LINE(INFO, ssInfo);
   }
-  tuner_->updateParameters();
 }
 
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::doPipelinedCompile(
+    ExecutorType& engine,
+    CandidateQueue& compileQueue,
+    std::vector<std::unique_ptr<CandidateQueue>>& gpuQueues,
+    const std::atomic_bool& done) {
+  while (true) {
+    auto pConf = compileQueue.dequeueWaitFor(kPipelinePollInterval);
+    if (not pConf) {
+      if (done.load()) {
+        return;
+      }
+      continue;
+    }
+    compileCandidate(engine, *pConf, currentCompilationJob_.fetch_add(1));
+    // Feed the GPU with the least pending work, invalid candidates are
+    // forwarded too so that their results reach the search in order of
+    // completion like the others
+    auto gpuQueue = std::min_element(
+        gpuQueues.begin(),
+        gpuQueues.end(),
+        [](const std::unique_ptr<CandidateQueue>& a,
+           const std::unique_ptr<CandidateQueue>& b) {
+          return a->size() < b->size();
+        });
+    (*gpuQueue)->enqueue(std::move(pConf));
+  }
+}
+
+template <typename Backend>
+template <typename ExecutorType>
+void GeneticTunerHarness<Backend>::doPipelinedGpuWork(
+    size_t gpu,
+    ExecutorType& engine,
+    std::vector<std::unique_ptr<CandidateQueue>>& gpuQueues,
+    size_t queue,
+    CandidateQueue& resultQueue,
+    size_t calibrationHandle,
+    const std::atomic_bool& done) {
+  typename Backend::WithDevice wd(gpu);
+  CHECK_EQ(1, kInputs_.count(gpu));
+  auto& inputs = kInputs_.at(gpu);
+  CHECK_EQ(1, outputs_.count(gpu));
+  auto& outputs = outputs_.at(gpu);
+  auto& worker = progress_->worker("gpu " + std::to_string(gpu));
+  auto& gpuQueue = *gpuQueues.at(queue);
+  // The queue of another GPU holding the most candidates, if any
+  auto steal = [&]() -> std::unique_ptr<CandidateConfiguration> {
+    size_t victim = queue;
+    size_t longest = 0;
+    for (size_t i = 0; i < gpuQueues.size(); ++i) {
+      auto size = gpuQueues[i]->size();
+      if (i != queue and size > longest) {
+        victim = i;
+        longest = size;
+      }
+    }
+    if (victim == queue) {
+      return nullptr;
+    }
+    return gpuQueues[victim]->dequeueWaitFor(
+        std::chrono::steady_clock::duration::zero());
+  };
+
+  size_t numberEvaluated = 0;
+  while (true) {
+    auto pConf =
+        gpuQueue.dequeueWaitFor(std::chrono::steady_clock::duration::zero());
+    if (not pConf) {
+      pConf = steal();
+    }
+    if (not pConf) {
+      pConf = gpuQueue.dequeueWaitFor(kPipelinePollInterval);
+    }
+    if (not pConf) {
+      if (done.load()) {
+        return;
+      }
+      continue;
+    }
+    numEvaluations_.fetch_add(1);
+    if (calibrationHandle != InvalidHandle and numberEvaluated > 0 and
+        numberEvaluated % kMaxPopulationSize == 0) {
+      calibrateDevice(gpu, engine, calibrationHandle);
+    }
+    ++numberEvaluated;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (not pConf->invalid) {
+      benchmarkCandidate(gpu, engine, inputs, outputs, *pConf);
+    }
+    worker.recordEvaluation(
+        std::chrono::high_resolution_clock::now() - start,
+        not pConf->invalid,
+        pConf->runtime);
+    recordEvaluatedOptions(*pConf);
+    resultQueue.enqueue(std::move(pConf));
+  }
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::runPipelined(size_t numGenerations) {
+  auto gpus = devices();
+  CHECK(not gpus.empty()) << "No GPU to autotune on";
+  tc::ExecutionEngine<typename Backend::ExecutorType> engine;
+  engine.define({kTc_});
+  engine.setCompilationThreads(FLAGS_tuner_threads);
+
+  currentCompilationJob_.store(0);
+  numEvaluations_.store(0);
+  staticPruningStats_.reset();
+
+  // The compile queue is bounded so that candidates are bred as late as
+  // possible, i.e. from the most recent results. The number of candidates in
+  // flight is bounded by the population size.
+  CandidateQueue compileQueue(FLAGS_tuner_threads);
+  std::vector<std::unique_ptr<CandidateQueue>> gpuQueues;
+  for (size_t i = 0; i < gpus.size(); ++i) {
+    gpuQueues.emplace_back(make_unique<CandidateQueue>(kGpuQueueCapacity));
+  }
+  CandidateQueue resultQueue;
+
+  // Compilation workers must be joined before the GPU workers are told to
+  // stop: they may still be feeding the GPU queues.
+  std::atomic_bool compilationDone{false};
+  std::atomic_bool gpuWorkDone{false};
+  std::vector<std::future<void>> cpuCompilationJobs;
+  std::vector<std::thread> gpuWorkerThreads;
+  ScopeGuard sgWorkers([&]() {
+    compilationDone = true;
+    for (auto& cpuCompilationJob : cpuCompilationJobs) {
+      cpuCompilationJob.wait();
+    }
+    gpuWorkDone = true;
+    for (auto& gpuWorkerThread : gpuWorkerThreads) {
+      gpuWorkerThread.join();
+    }
+  });
+  for (int i = 0; i < FLAGS_tuner_threads; ++i) {
+    cpuCompilationJobs.push_back(engine.compilationPool().submit([&]() {
+      this->doPipelinedCompile(
+          engine, compileQueue, gpuQueues, compilationDone);
+    }));
+  }
+  auto calibrationHandle = calibrateDevices(engine, gpus);
+  for (size_t i = 0; i < gpus.size(); ++i) {
+    auto gpu = gpus[i];
+    gpuWorkerThreads.emplace_back([this, gpu, i, calibrationHandle, &engine,
+                                   &gpuQueues, &resultQueue, &gpuWorkDone]() {
+      this->doPipelinedGpuWork(
+          gpu,
+          engine,
+          gpuQueues,
+          i,
+          resultQueue,
+          calibrationHandle,
+          gpuWorkDone);
+    });
+  }
+
+  std::atomic_size_t numGpuWorkers{gpus.size()};
+  streamCandidates(numGenerations, compileQueue, resultQueue, numGpuWorkers);
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::doRemoteWork(
+    TuningEvaluator& evaluator,
+    CandidateQueue& requestQueue,
+    CandidateQueue& resultQueue,
+    std::atomic_size_t& numRemoteWorkers,
+    const std::atomic_bool& done) {
+  ScopeGuard sgNumRemoteWorkers(
+      [&numRemoteWorkers]() { numRemoteWorkers.fetch_sub(1); });
+  auto request = makeTuningRequest();
+  auto& worker = progress_->worker(evaluator.name());
+  while (true) {
+    auto pConf = requestQueue.dequeueWaitFor(kPipelinePollInterval);
+    if (not pConf) {
+      if (done.load()) {
+        return;
+      }
+      continue;
+    }
+    auto current = currentCompilationJob_.fetch_add(1);
+    auto options = makeOptions(*pConf);
+    request.set_id(current);
+    setRequestOptions(request, options);
+    {
+      std::lock_guard<std::mutex> lock(bestTimeMtx_);
+      request.set_best_time_us(
+          bestTime_ == std::numeric_limits<size_t>::max() ? 0 : bestTime_);
+    }
+
+    TuningResultProto result;
+    auto start = std::chrono::high_resolution_clock::now();
+    auto received = evaluator.evaluate(request, result);
+    auto busy = std::chrono::high_resolution_clock::now() - start;
+    numEvaluations_.fetch_add(1);
+    if (not received) {
+      LOG(ERROR) << "[TUNER][REMOTE] giving up on " << evaluator.name();
+      worker.recordEvaluation(busy, false, Duration::zero());
+      pConf->invalid = true;
+      resultQueue.enqueue(std::move(pConf));
+      return;
+    }
+    CHECK_EQ(current, result.id())
+        << "Mismatched result from " << evaluator.name();
+
+    if (result.invalid()) {
+      pConf->invalid = true;
+      worker.recordEvaluation(busy, false, Duration::zero());
+    } else {
+      Duration runtime = std::chrono::microseconds(result.runtime_us());
+      worker.recordEvaluation(busy, true, runtime);
+      pConf->runtime = runtime;
+      LOG_IF(INFO, tc::FLAGS_debug_tuner)
+          << "Run on " << evaluator.name() << " took: " << result.runtime_us()
+          << "us over " << result.runtimes_us_size() << " runs";
+      updateBest(runtime, options);
+      recordRemoteRuntimes(result, options);
+    }
+    recordEvaluatedOptions(*pConf);
+    resultQueue.enqueue(std::move(pConf));
+  }
+}
+
+template <typename Backend>
+TuningRequestProto GeneticTunerHarness<Backend>::makeTuningRequest() const {
+  CHECK_GT(kInputs_.size(), 0);
+  TuningRequestProto request;
+  request.set_tc(kTc_->range().file());
+  request.set_kernel_name(kKernelName_);
+  for (auto input : kInputs_.begin()->second) {
+    *request.add_inputs() = tc::detail::TensorInfo(input).toProtobuf();
+  }
+  return request;
+}
+
+template <typename Backend>
+std::vector<Duration> GeneticTunerHarness<Backend>::recordRemoteRuntimes(
+    const TuningResultProto& result,
+    const MappingOptionsType& options) {
+  std::vector<Duration> runtimes;
+  for (auto runtime : result.runtimes_us()) {
+    runtimes.push_back(std::chrono::microseconds(runtime));
+  }
+  if (runtimes.empty() and result.has_runtime_us()) {
+    runtimes.push_back(std::chrono::microseconds(result.runtime_us()));
+  }
+  // Local runs record their runtimes when profiling, remote ones are
+  // recorded here so that the options cache checkpoints hold them
+  if (OptionsCacheType::cacheEnabled()) {
+    CHECK_GT(kInputs_.size(), 0);
+    auto cacheKeyId = lang::canonicalTc(kTc_);
+    auto outputs = dlutils::constPtrs(outputs_.begin()->second);
+    for (auto runtime : runtimes) {
+      OptionsCacheType::getCache()->recordRuntime(
+          cacheKeyId, options, kInputs_.begin()->second, outputs, runtime);
+    }
+  }
+  return runtimes;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::runDistributed(
+    size_t numGenerations,
+    std::vector<std::unique_ptr<TuningEvaluator>> evaluators) {
+  currentCompilationJob_.store(0);
+  numEvaluations_.store(0);
+
+  // Unbounded: the number of candidates in flight is bounded by the
+  // population size and the requests must not block the search when workers
+  // fail.
+  CandidateQueue requestQueue;
+  CandidateQueue resultQueue;
+  std::atomic_size_t numRemoteWorkers{evaluators.size()};
+  std::atomic_bool done{false};
+  std::vector<std::thread> remoteWorkerThreads;
+  auto joinRemoteWorkerThreads = [&]() {
+    done = true;
+    for (auto& remoteWorkerThread : remoteWorkerThreads) {
+      remoteWorkerThread.join();
+    }
+    remoteWorkerThreads.clear();
+  };
+  ScopeGuard sgRemoteWorkerThreads(joinRemoteWorkerThreads);
+  for (const auto& evaluator : evaluators) {
+    auto pEvaluator = evaluator.get();
+    remoteWorkerThreads.emplace_back([this,
+                                      pEvaluator,
+                                      &requestQueue,
+                                      &resultQueue,
+                                      &numRemoteWorkers,
+                                      &done]() {
+      this->doRemoteWork(
+          *pEvaluator, requestQueue, resultQueue, numRemoteWorkers, done);
+    });
+  }
+  streamCandidates(
+      numGenerations, requestQueue, resultQueue, numRemoteWorkers);
+  joinRemoteWorkerThreads();
+
+  if (FLAGS_tuner_final_remeasure_top_k == 0) {
+    return;
+  }
+  // The evaluators are idle by now, re-measure on the first one that is not
+  // lost
+  auto request = makeTuningRequest();
+  request.set_final_measurement(true);
+  size_t id = 0;
+  size_t current = 0;
+  remeasureTopCandidates([&](const MappingOptionsType& options)
+                             -> std::vector<Duration> {
+    request.set_id(id++);
+    setRequestOptions(request, options);
+    TuningResultProto result;
+    for (; current < evaluators.size(); ++current) {
+      if (evaluators[current]->evaluate(request, result)) {
+        break;
+      }
+      LOG(WARNING) << "[TUNER][REMOTE] cannot re-measure on "
+                   << evaluators[current]->name();
+    }
+    if (current == evaluators.size()) {
+      throw std::runtime_error("no worker left to re-measure on");
+    }
+    CHECK_EQ(request.id(), result.id()) << "Mismatched result";
+    if (result.invalid()) {
+      return std::vector<Duration>();
+    }
+    return recordRemoteRuntimes(result, options);
+  });
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::remeasureLocally() {
+  if (FLAGS_tuner_final_remeasure_top_k == 0) {
+    return;
+  }
+  auto gpus = devices();
+  CHECK(not gpus.empty()) << "No GPU to autotune on";
+  auto gpu = gpus.front();
+  typename Backend::WithDevice wd(gpu);
+  CHECK_EQ(1, kInputs_.count(gpu));
+  auto& inputs = kInputs_.at(gpu);
+  CHECK_EQ(1, outputs_.count(gpu));
+  auto& outputs = outputs_.at(gpu);
+
+  tc::ExecutionEngine<typename Backend::ExecutorType> engine;
+  engine.define({kTc_});
+  auto budget = MeasurementBudget::fromFlags(kFinalMeasurementBudgetFactor);
+  remeasureTopCandidates([&](const MappingOptionsType& options)
+                             -> std::vector<Duration> {
+    if (jointTuning()) {
+      return {weightedGeometricMean(
+          measureInputSets(engine, gpu, options, budget), weights_)};
+    }
+    auto handle = engine.compile(
+        kKernelName_, inputs, options.toProtobufSerializedString());
+    ScopeGuard sgHandle([&engine, handle]() { engine.clear(handle); });
+    for (size_t i = 0; i < kReducedWarmupIterations; ++i) {
+      engine.run(handle, inputs, outputs);
+    }
+    return measureUntilStable(
+        [&]() { return engine.run(handle, inputs, outputs, true); }, budget);
+  });
+}
+
+template <typename Backend>
+template <typename ExecutorType>
+std::vector<Duration> GeneticTunerHarness<Backend>::measureInputSets(
+    ExecutorType& engine,
+    size_t gpu,
+    const MappingOptionsType& options,
+    const MeasurementBudget& budget) {
+  auto measure = [&](const std::vector<const DLTensor*>& inputs,
+                     const std::vector<DLTensor*>& outputs) -> Duration {
+    auto handle = engine.compile(
+        kKernelName_, inputs, options.toProtobufSerializedString());
+    ScopeGuard sgHandle([&engine, handle]() { engine.clear(handle); });
+    for (size_t i = 0; i < kReducedWarmupIterations; ++i) {
+      engine.run(handle, inputs, outputs);
+    }
+    return median(measureUntilStable(
+        [&]() { return engine.run(handle, inputs, outputs, true); }, budget));
+  };
+  CHECK_EQ(1, kInputs_.count(gpu));
+  CHECK_EQ(1, outputs_.count(gpu));
+  std::vector<Duration> runtimes{measure(kInputs_.at(gpu), outputs_.at(gpu))};
+  for (const auto& joint : kJointInputs_) {
+    CHECK_EQ(1, joint.inputs.count(gpu));
+    CHECK_EQ(1, joint.outputs.count(gpu));
+    runtimes.push_back(measure(joint.inputs.at(gpu), joint.outputs.at(gpu)));
+  }
+  return runtimes;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::measureJointTuningReport() {
+  if (not jointTuning()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(bestTimeMtx_);
+    if (bestTime_ == std::numeric_limits<size_t>::max()) {
+      // No valid candidate
+      return;
+    }
+  }
+  auto gpus = devices();
+  CHECK(not gpus.empty()) << "No GPU to autotune on";
+  auto gpu = gpus.front();
+  typename Backend::WithDevice wd(gpu);
+
+  tc::ExecutionEngine<typename Backend::ExecutorType> engine;
+  engine.define({kTc_});
+  JointTuningReport report;
+  report.runtimes = measureInputSets(
+      engine,
+      gpu,
+      bestMappingOption(),
+      MeasurementBudget::fromFlags(kFinalMeasurementBudgetFactor));
+
+  // The runtimes recorded in the options cache include those of specialized
+  // tuning runs restored from a cache file
+  auto specialized = [this](
+                         const std::vector<const DLTensor*>& inputs,
+                         const std::vector<DLTensor*>& outputs,
+                         Duration runtime) -> Duration {
+    if (not OptionsCacheType::cacheEnabled()) {
+      return runtime;
+    }
+    auto candidates = OptionsCacheType::getCache()->retrieveOptionsAndRuntimes(
+        lang::canonicalTc(kTc_), inputs, dlutils::constPtrs(outputs));
+    for (const auto& c : candidates) {
+      if (not c.recordedRuntimes.empty()) {
+        runtime = std::min(runtime, median(c.recordedRuntimes));
+      }
+    }
+    return runtime;
+  };
+  report.specializedRuntimes.push_back(specialized(
+      kInputs_.at(gpu), outputs_.at(gpu), report.runtimes.front()));
+  for (size_t i = 0; i < kJointInputs_.size(); ++i) {
+    report.specializedRuntimes.push_back(specialized(
+        kJointInputs_[i].inputs.at(gpu),
+        kJointInputs_[i].outputs.at(gpu),
+        report.runtimes[i + 1]));
+  }
+  LOG(INFO) << "[TUNER][JOINT] " << report;
+  jointTuningReport_ = report;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::updateBest(
+    Duration runtime,
+    const MappingOptionsType& options) {
+  auto runtimeUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(runtime).count();
+  std::lock_guard<std::mutex> lock(bestTimeMtx_);
+  ++numberBenchmarked_;
+  if (options == kBaseMapping_) {
+    baselineTime_ = std::min<size_t>(baselineTime_, runtimeUs);
+  }
+  if (runtimeUs < bestTime_) {
+    bestTime_ = runtimeUs;
+    bestMappingOptions_ = options;
+    tuningCurve_.push_back(
+        {std::chrono::steady_clock::now() - tuningStart_,
+         numberBenchmarked_,
+         runtime});
+  }
+
+  // Keep the fastest FLAGS_tuner_final_remeasure_top_k distinct options
+  auto sameOptions = std::find_if(
+      topCandidates_.begin(),
+      topCandidates_.end(),
+      [&options](const std::pair<Duration, MappingOptionsType>& c) {
+        return c.second == options;
+      });
+  if (sameOptions != topCandidates_.end()) {
+    sameOptions->first = std::min(sameOptions->first, runtime);
+  } else {
+    topCandidates_.emplace_back(runtime, options);
+  }
+  std::sort(
+      topCandidates_.begin(),
+      topCandidates_.end(),
+      [](const std::pair<Duration, MappingOptionsType>& a,
+         const std::pair<Duration, MappingOptionsType>& b) {
+        return a.first < b.first;
+      });
+  if (topCandidates_.size() > FLAGS_tuner_final_remeasure_top_k) {
+    topCandidates_.erase(
+        topCandidates_.begin() + FLAGS_tuner_final_remeasure_top_k,
+        topCandidates_.end());
+  }
+}
+
+template <typename Backend>
+bool GeneticTunerHarness<Backend>::reuseEvaluation(
+    CandidateConfiguration& conf) {
+  auto options = makeOptions(conf);
+  size_t bestTime;
+  {
+    std::lock_guard<std::mutex> lock(bestTimeMtx_);
+    bestTime = bestTime_;
+  }
+  std::lock_guard<std::mutex> lock(evaluatedOptionsMtx_);
+  auto range = evaluatedOptions_.equal_range(options.hash());
+  for (auto it = range.first; it != range.second; ++it) {
+    const auto& evaluated = it->second;
+    if (not(evaluated.options == options)) {
+      continue;
+    }
+    if (evaluated.invalid) {
+      conf.invalid = true;
+      return true;
+    }
+    // Another measurement only matters if it may change the best options
+    auto runtime = median(evaluated.runtimes);
+    auto runtimeUs =
+        std::chrono::duration_cast<std::chrono::microseconds>(runtime).count();
+    if (evaluated.runtimes.size() < kMaxMeasurementsPerOptions and
+        runtimeUs <= bestTime * kRemeasureSlack) {
+      return false;
+    }
+    conf.invalid = false;
+    conf.runtime = runtime;
+    return true;
+  }
+  return false;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::recordEvaluatedOptions(
+    CandidateConfiguration& conf) {
+  auto options = makeOptions(conf);
+  std::lock_guard<std::mutex> lock(evaluatedOptionsMtx_);
+  auto range = evaluatedOptions_.equal_range(options.hash());
+  for (auto it = range.first; it != range.second; ++it) {
+    auto& evaluated = it->second;
+    if (not(evaluated.options == options)) {
+      continue;
+    }
+    // Measured again: a failure, e.g. early pruning against a better best
+    // time, does not invalidate the previous measurements
+    if (not conf.invalid) {
+      evaluated.runtimes.push_back(conf.runtime);
+    }
+    if (not evaluated.invalid) {
+      conf.invalid = false;
+      conf.runtime = median(evaluated.runtimes);
+    }
+    return;
+  }
+  EvaluatedOptions evaluated{options, conf.invalid, {}};
+  if (not conf.invalid) {
+    evaluated.runtimes.push_back(conf.runtime);
+  }
+  evaluatedOptions_.emplace(options.hash(), std::move(evaluated));
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::remeasureTopCandidates(
+    const std::function<std::vector<Duration>(const MappingOptionsType&)>&
+        measure) {
+  std::vector<std::pair<Duration, MappingOptionsType>> candidates;
+  {
+    std::lock_guard<std::mutex> lock(bestTimeMtx_);
+    candidates = topCandidates_;
+  }
+  if (candidates.empty()) {
+    return;
+  }
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  llvm::Optional<MappingOptionsType> best;
+  Duration bestTime = Duration::max();
+  for (const auto& candidate : candidates) {
+    std::vector<Duration> runtimes;
+    try {
+      runtimes = measure(candidate.second);
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "[TUNER][REMEASURE] failed: " << e.what();
+      continue;
+    }
+    if (runtimes.empty()) {
+      continue;
+    }
+    auto runtime = median(runtimes);
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "[TUNER][REMEASURE] "
+        << duration_cast<microseconds>(candidate.first).count()
+        << "us while tuning, " << duration_cast<microseconds>(runtime).count()
+        << "us over " << runtimes.size() << " runs on an idle GPU";
+    if (runtime < bestTime) {
+      bestTime = runtime;
+      best = candidate.second;
+    }
+  }
+  if (not best) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(bestTimeMtx_);
+  bestTime_ = duration_cast<microseconds>(bestTime).count();
+  bestMappingOptions_ = *best;
+  remeasuredBestOptions_ = best;
+}
+
+template <typename Backend>
+llvm::Optional<typename Backend::MappingOptionsType>
+GeneticTunerHarness<Backend>::remeasuredBestOptions() {
+  std::lock_guard<std::mutex> lock(bestTimeMtx_);
+  return remeasuredBestOptions_;
+}
+
+template <typename Backend>
+void GeneticTunerHarness<Backend>::streamCandidates(
+    size_t numGenerations,
+    CandidateQueue& candidateQueue,
+    CandidateQueue& resultQueue,
+    const std::atomic_size_t& numEvaluators) {
+  // Progress is reported every population size results, which plays the role
+  // of a generation for printing and logging purposes only.
+  auto logGenerations = FLAGS_tuner_gen_log_generations;
+  size_t generation = 0;
+  auto printer = make_unique<Printer>(
+      generation,
+      kMaxPopulationSize,
+      currentCompilationJob_,
+      numEvaluations_,
+      staticPruningStats_);
+  ScopeGuard sgPrinter([logGenerations, &printer]() {
+    if (printer) {
+      printer->stop();
+      if (logGenerations) {
+        printer->printAll();
+      }
+    }
+  });
+
+  const size_t numCandidates = numGenerations * kMaxPopulationSize;
+  size_t numIssued = 0;
+  size_t numReceived = 0;
+  auto issue = [&]() {
+    auto pConf = tuner_->nextCandidate();
+    ++numIssued;
+    if (reuseEvaluation(*pConf)) {
+      // Counted as compiled and evaluated for the progress of the generation
+      currentCompilationJob_.fetch_add(1);
+      numEvaluations_.fetch_add(1);
+      resultQueue.enqueue(std::move(pConf));
+      return;
+    }
+    candidateQueue.enqueue(std::move(pConf));
+  };
+  while (numIssued < std::min(numCandidates, kMaxPopulationSize)) {
+    issue();
+  }
+  while (numReceived < numIssued) {
+    auto pConf = resultQueue.dequeueWaitFor(kPipelinePollInterval);
+    if (not pConf) {
+      if (numEvaluators.load() == 0) {
+        throw std::runtime_error(
+            "No worker left to evaluate the autotuning candidates");
+      }
+      if (printer) {
+        printer->tick();
+      }
+      continue;
+    }
+    ++numReceived;
+    if (printer and not pConf->invalid) {
+      printer->record(pConf->runtime);
+    }
+    tuner_->recordEvaluatedCandidate(std::move(pConf));
+
+    if (printer and numReceived % kMaxPopulationSize == 0) {
+      printer->stop();
+      if (logGenerations) {
+        printer->printAll();
+      }
+      printer = nullptr;
+      logProgress();
+      checkStopCriteria();
+      checkpoint();
+      trainCostModel();
+      // The counters keep running for the candidates already in flight
+      currentCompilationJob_.fetch_sub(kMaxPopulationSize);
+      numEvaluations_.fetch_sub(kMaxPopulationSize);
+      staticPruningStats_.reset();
+      if (numReceived < numCandidates and not stopRequested_) {
+        progress_->setGeneration(generation + 1);
+        printer = make_unique<Printer>(
+            ++generation,
+            kMaxPopulationSize,
+            currentCompilationJob_,
+            numEvaluations_,
+            staticPruningStats_);
+      }
+    }
+    if (numIssued < numCandidates and not stopRequested_ and
+        not timeBudgetExpired()) {
+      issue();
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CUDA
+////////////////////////////////////////////////////////////////////////////////
+template <>
+std::vector<size_t> GeneticTunerHarness<CudaBackend>::devices() {
+  return parseGpus();
+}
+
+namespace {
+// Sets the range of each dimension of block or grid to its values in
+// dimValues and its values in the options.
+template <typename Options>
+void setCudaDimRanges(
+    CudaDimParameters& params,
+    std::vector<std::vector<size_t>> dimValues,
+    const std::string& dimBaseName,
+    const std::vector<const Options*>& startingOptions,
+    CudaDimView Options::*view) {
+  params.setRange(dimValues[0], dimBaseName);
+  CHECK_EQ(params.dims.size(), dimValues.size());
+  for (size_t i = 0; i < params.dims.size(); ++i) {
+    for (auto options : startingOptions) {
+      const auto& dims = options->*view;
+      if (i < dims.size()) {
+        dimValues[i].push_back(dims[i]);
+      }
+    }
+    params.dims[i] = RangeParameter(
+        mergeVectors(std::move(dimValues[i])), dimBaseName + std::to_string(i));
+  }
+}
+
+// Whether each block dimension fits a distinct tile dimension.  Threads
+// beyond the tile size are idle, the dimensions that are not tiled (0 or
+// beyond the tiled ones) do not bound the threads.
+bool blockFitsTiles(const TuningConfiguration& conf) {
+  std::vector<size_t> tiles;
+  for (size_t i = 0; i < conf.tilingParams.numberDims.value(); ++i) {
+    auto t = conf.tilingParams.dims[i].value();
+    tiles.push_back(t == 0 ? std::numeric_limits<size_t>::max() : t);
+  }
+  std::vector<size_t> threads;
+  for (size_t i = 0; i < conf.blockParams.numberDims.value(); ++i) {
+    threads.push_back(conf.blockParams.dims[i].value());
+  }
+  tiles.resize(
+      std::max(tiles.size(), threads.size()),
+      std::numeric_limits<size_t>::max());
+  // Largest first: the largest block dimension takes the largest tile
+  std::sort(tiles.rbegin(), tiles.rend());
+  std::sort(threads.rbegin(), threads.rend());
+  for (size_t i = 0; i < threads.size(); ++i) {
+    if (threads[i] > tiles[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+template <>
+void GeneticTunerHarness<CudaBackend>::setupBackendTuningParameters(
+    std::vector<size_t>& sizes) {
+  // 0 is not a valid block / grid annotation.  The block sizes are bounded
+  // by the device, 1024 threads without one.  In the first dimension, they
+  // are the sizes below a warp and the multiples of the warp size up to the
+  // largest size: the warps of the other values are partially idle.  The
+  // grid sizes are bounded by 65535 in the second and third dimensions.
+  // The sizes of the base options and of the starting points are always
+  // part of the ranges.
+  CHECK(!sizes.empty());
+  auto limits = CudaGPUInfo::GPUInfo().MultiprocessorLimits();
+  size_t warpSize = limits.warpSize > 0 ? limits.warpSize : 32;
+  size_t maxThreads =
+      limits.maxThreadsPerBlock > 0 ? limits.maxThreadsPerBlock : 1024;
+  auto threads = filterHigherThan(sizes, maxThreads);
+  auto warpThreads = filterHigherThan(sizes, warpSize - 1);
+  for (size_t t = warpSize; t < sizes.back() + warpSize && t <= maxThreads;
+       t += warpSize) {
+    warpThreads.push_back(t);
+  }
+  auto gridSizes = filterHigherThan(sizes, 65535);
+  auto bases = startingOptions();
+  setCudaDimRanges(
+      configuration.blockParams,
+      {warpThreads, threads, threads},
+      "b",
+      bases,
+      &CudaMappingOptions::block);
+  setCudaDimRanges(
+      configuration.gridParams,
+      {sizes, gridSizes, gridSizes},
+      "g",
+      bases,
+      &CudaMappingOptions::grid);
+  // Coupling of the block and tile sizes
+  configuration.addValidator(blockFitsTiles);
+
+  // Register pressure and launch bounds are searched, 0 registers or 0
+  // minimal blocks per multiprocessor lets the compiler decide.  Fast math
+  // changes the numerics, it is left as the base options set it.
+  const auto& compilerOptions = kBaseMapping_.proto().compiler_options();
+  configuration.maxRegisterCount = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{0, 32, 64, 128, 255},
+          std::vector<size_t>{compilerOptions.max_register_count()}),
+      "max register count");
+  configuration.minBlocksPerMultiprocessor = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{0, 1, 2, 4},
+          std::vector<size_t>{compilerOptions.min_blocks_per_multiprocessor()}),
+      "min blocks per multiprocessor");
+  configuration.useFastMath.fixValue(compilerOptions.use_fast_math());
+  configuration.blockSwizzle = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{1, 4, 8, 16},
+          std::vector<size_t>{kBaseMapping_.proto().block_swizzle()}),
+      "block swizzle");
+  configuration.batchPacking = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{1, 2, 4, 8, 16},
+          std::vector<size_t>{kBaseMapping_.proto().batch_packing()}),
+      "batch packing");
+  configuration.linearizeBlocks = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{1, 2, 3, 4},
+          std::vector<size_t>{kBaseMapping_.proto().linearize_blocks()}),
+      "linearize blocks");
+}
+
+template <>
+CudaMappingOptions GeneticTunerHarness<CudaBackend>::makeOptions(
+    const CandidateConfiguration& c) {
+  auto options = kBaseMapping_;
+  c.configuration.applyToCudaMappingOptions(options);
+  return options;
+}
+
+template <>
+TuningConfiguration GeneticTunerHarness<CudaBackend>::makeTuningConfiguration(
+    const CudaMappingOptions& options) {
+  TuningConfiguration conf = configuration;
+  conf.fromCudaMappingOptions(options);
+  return conf;
+}
+
+template <>
+void GeneticTunerHarness<CudaBackend>::trainCostModel() {
+  if (costModelOptions_.oversampling <= 1 or
+      not OptionsCache::cacheEnabled()) {
+    return;
+  }
+  auto samples = OptionsCache::getCache()->retrieveTuningSamples(
+      lang::canonicalTc(kTc_));
+  std::shared_ptr<const CostModel> model =
+      CostModel::train(samples, costModelOptions_);
+  if (not model) {
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "[TUNER] " << samples.size()
+        << " recorded runtimes are not enough to train the cost model";
+    tuner_->setCostFunction(nullptr, 1);
+    return;
+  }
+  LOG_IF(INFO, FLAGS_debug_tuner) << "[TUNER] Trained the cost model on "
+                                  << samples.size() << " recorded runtimes";
+  std::vector<tc::detail::TensorInfo> inputs;
+  for (auto input : kInputs_.begin()->second) {
+    inputs.emplace_back(input);
+  }
+  auto baseMapping = kBaseMapping_;
+  tuner_->setCostFunction(
+      [model, inputs, baseMapping](const TuningConfiguration& conf) -> double {
+        auto options = baseMapping;
+        conf.applyToCudaMappingOptions(options);
+        return model->predictLogRuntime(options, inputs);
+      },
+      costModelOptions_.oversampling);
+}
+
+template <>
+std::function<bool(const CudaTcExecutor*)>
+GeneticTunerHarness<CudaBackend>::makeCompilePruningFunction() {
+  return makeStaticPruningFunction(&staticPruningStats_);
+}
+
+template <>
+std::function<bool(const CudaTcExecutor*)>
+GeneticTunerHarness<CudaBackend>::makeLaunchPruningFunction() {
+  // Pruning based on number of threads: if you don't hit at least k warps
+  // (default k = 8; 256 total threads, controlled by
+  // FLAGS_tuner_min_launch_total_threads) then it's likely the kernel is not
+  // performing great.
+  // This may be completely off but is a good first initial rule of thumb
+  // for stress-testing autotuning.
+  //
+  // The kernels whose resources, as reported by the driver once compiled, do
+  // not let them be launched, make them spill or miss
+  // FLAGS_tuner_min_occupancy are pruned as well.
+  auto debugTuner = FLAGS_debug_tuner;
+  auto minThreads = FLAGS_tuner_min_launch_total_threads;
+  auto minOccupancy = FLAGS_tuner_min_occupancy;
+  auto pruneSpills = FLAGS_tuner_prune_spills;
+  return [debugTuner, minThreads, minOccupancy, pruneSpills](
+             const CudaTcExecutor* exec) -> bool {
+    CHECK(exec);
+    // Library calls choose their own launch bounds.
+    if (exec->isLibraryCall()) {
+      return false;
+    }
+    USING_MAPPING_SHORT_NAMES(BX, BY, BZ, TX, TY, TZ);
+    auto block = exec->block;
+    auto nThreads =
+        TX.mappingSize(block) * TY.mappingSize(block) * TZ.mappingSize(block);
+    auto grid = exec->grid;
+    auto nBlocks =
+        BX.mappingSize(grid) * BY.mappingSize(grid) * BZ.mappingSize(grid);
+    if (nBlocks * nThreads < minThreads) {
+      if (debugTuner) {
+        std::stringstream ssInfo;
+        ssInfo << "Skip configuration with too few threads: " << block << "\n"
+               << CudaMappingOptionsAsCpp(CudaMappingOptions(exec->options));
+        LOG_LINE_BY_LINE(INFO, ssInfo);
+      }
+      return true;
+    }
+    auto attributes = exec->kernelAttributes();
+    auto reason = pruneCompiled(
+        attributes,
+        nThreads,
+        exec->dynamicSharedMemory,
+        CudaGPUInfo::GPUInfo().MultiprocessorLimits(),
+        minOccupancy,
+        pruneSpills);
+    if (reason != PruningReason::None) {
+      if (debugTuner) {
+        std::stringstream ssInfo;
+        ssInfo << "Skip compiled configuration, " << attributes << "\n"
+               << CudaMappingOptionsAsCpp(CudaMappingOptions(exec->options));
+        LOG_LINE_BY_LINE(INFO, ssInfo);
+      }
+      return true;
+    }
+    LOG_IF(INFO, debugTuner)
+        << "Run configuration launch bounds blocks: " << grid
+        << " and threads: " << block << ", " << attributes << "\n";
+    return false;
+  };
+}
+
+template <>
+void GeneticTunerHarness<CudaBackend>::recoverFromRuntimeError(
+    size_t gpu,
+    const CudaMappingOptions& options) {
+  while (cudaGetLastError() != cudaSuccess) {
+    // In case of errors in the generated, we cannot rely on deviceReset to
+    // set the GPU in a clean state. So instead we just pop and discard all
+    // the errors accumulated on the GPU until we get to a clean slate
+    // (i.e. cudaSuccess).
+    ;
+  }
+  try {
+    // Some errors, such as illegal memory access, cannot be recovered from
+    // without a cudaDeviceReset (i.e. because user protection)
+    // In those cases we have no choice than to fail hard.
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  } catch (const std::exception& e) {
+    LOG(FATAL) << "[CUDA][FATAL] cuda error on gpu " << gpu << ": "
+               << e.what() << "\n"
+               << CudaMappingOptionsAsCpp(options);
+  }
+}
+
+template <>
+void GeneticTunerHarness<CudaBackend>::logCompileTimings() {
+  for (const auto& kvp : CudaRTCFunction::PerThreadCompileTimings()) {
+    using std::chrono::milliseconds;
+    const auto& timings = kvp.second;
+    LOG(INFO) << "[TUNER][GENERATION LOG] NVRTC thread " << kvp.first << ": "
+              << timings.numberCompilations << " compilations in "
+              << std::chrono::duration_cast<milliseconds>(timings.compileTime)
+                     .count()
+              << "ms, waited "
+              << std::chrono::duration_cast<milliseconds>(timings.waitTime)
+                     .count()
+              << "ms";
+  }
+  CudaRTCFunction::ResetCompileTimings();
+}
+
+template <>
+void GeneticTunerHarness<CudaBackend>::logClockState(size_t gpu) {
+  auto clocks = queryClockState();
+  LOG_IF(WARNING, clocks.throttled())
+      << "[TUNER] gpu " << gpu << " timed the candidates with " << clocks
+      << ", their runtimes may not compare to those of other generations";
+  LOG_IF(INFO, FLAGS_debug_tuner and not clocks.throttled())
+      << "[TUNER] gpu " << gpu << " clocks: " << clocks;
+}
+
+template <>
+std::string GeneticTunerHarness<CudaBackend>::optionsString(
+    const CudaMappingOptions& options) {
+  std::stringstream ss;
+  ss << CudaMappingOptionsAsCpp(options);
+  return ss.str();
+}
+
+template <>
+std::vector<std::unique_ptr<TuningEvaluator>>
+GeneticTunerHarness<CudaBackend>::makeEvaluators() {
+  std::vector<std::unique_ptr<TuningEvaluator>> evaluators;
+  for (const auto& endpoint : parseTuningWorkers()) {
+    evaluators.emplace_back(new RemoteTuningEvaluator(endpoint));
+  }
+  if (evaluators.empty() and not FLAGS_tuner_sandbox_worker.empty()) {
+    for (auto gpu : parseGpus()) {
+      evaluators.emplace_back(
+          new SandboxedTuningEvaluator(FLAGS_tuner_sandbox_worker, gpu));
+    }
+  }
+  return evaluators;
+}
+
+template <>
+void GeneticTunerHarness<CudaBackend>::setRequestOptions(
+    TuningRequestProto& request,
+    const CudaMappingOptions& options) {
+  *request.mutable_options() = options.proto();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CPU
+////////////////////////////////////////////////////////////////////////////////
+template <>
+std::vector<size_t> GeneticTunerHarness<CpuBackend>::devices() {
+  return parseCpus();
+}
+
+template <>
+void GeneticTunerHarness<CpuBackend>::setupBackendTuningParameters(
+    std::vector<size_t>& sizes) {
+  // Candidates must satisfy the validator of the block sizes, which the CPU
+  // ignores like the other GPU parameters: they are pinned to one value.
+  std::vector<size_t> blockSize{32};
+  configuration.blockParams.setRange(blockSize, "b");
+  configuration.blockParams.numberDims.fixValue(1);
+  std::vector<size_t> gridSize{1};
+  configuration.gridParams.setRange(gridSize, "g");
+  configuration.gridParams.numberDims.fixValue(1);
+  for (auto p : {&configuration.useSharedMemory,
+                 &configuration.usePrivateMemory,
+                 &configuration.unrollCopyShared,
+                 &configuration.warpShuffleReductions,
+                 &configuration.gridReductions,
+                 &configuration.useTensorCores,
+                 &configuration.splitKernels,
+                 &configuration.unrollPragma,
+                 &configuration.persistentBlocks,
+                 &configuration.separateFullTiles,
+                 &configuration.asyncCopies,
+                 &configuration.transposeShared,
+                 &configuration.cooperativeKernels,
+                 &configuration.warpAggregatedAtomics,
+                 &configuration.twoDimReductions,
+                 &configuration.useFastMath,
+                 &configuration.useLaunchBounds}) {
+    p->fixValue(false);
+  }
+  configuration.vectorizeWidth.fixValue(1);
+  configuration.blockSwizzle.fixValue(1);
+  configuration.batchPacking.fixValue(1);
+  configuration.linearizeBlocks.fixValue(1);
+  configuration.threadTileSize.fixValue(1);
+  configuration.warpTileSize.fixValue(1);
+  configuration.dp4aPacking.fixValue(Dp4aPacking::NoDp4a);
+
+  // The values of the base options are always part of the ranges.
+  const auto& proto = kBaseMapping_.proto();
+  configuration.l2TileFactor = RangeParameter({1, 2, 4, 8}, "l2 tile factor");
+  configuration.parallelDepth = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{0, 1, 2},
+          std::vector<size_t>{proto.parallel_depth()}),
+      "parallel depth");
+  configuration.cpuVectorizeWidth = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{0, 1, 4, 8, 16},
+          std::vector<size_t>{proto.vectorize_width()}),
+      "cpu vectorize width");
+  configuration.prefetchDistance = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{0, 1, 2, 4, 8},
+          std::vector<size_t>{proto.prefetch_distance()}),
+      "prefetch distance");
+  configuration.packingLevel = RangeParameter(
+      mergeVectors(
+          std::vector<size_t>{0, 1, 2},
+          std::vector<size_t>{proto.packing_level()}),
+      "packing level");
+}
+
+template <>
+CpuMappingOptions GeneticTunerHarness<CpuBackend>::makeOptions(
+    const CandidateConfiguration& c) {
+  auto options = kBaseMapping_;
+  c.configuration.applyToCpuMappingOptions(options);
+  return options;
+}
+
+template <>
+TuningConfiguration GeneticTunerHarness<CpuBackend>::makeTuningConfiguration(
+    const CpuMappingOptions& options) {
+  TuningConfiguration conf = configuration;
+  conf.fromCpuMappingOptions(options);
+  return conf;
+}
+
+template <>
+void GeneticTunerHarness<CpuBackend>::trainCostModel() {
+  // The cost model predicts the runtimes of CudaMappingOptions.
+  LOG_IF(WARNING, costModelOptions_.oversampling > 1)
+      << "[TUNER] The cost model is not supported on CPU, ignored";
+}
+
+template <>
+std::function<bool(const CpuTcExecutor*)>
+GeneticTunerHarness<CpuBackend>::makeCompilePruningFunction() {
+  return [](const CpuTcExecutor*) { return false; };
+}
+
+template <>
+std::function<bool(const CpuTcExecutor*)>
+GeneticTunerHarness<CpuBackend>::makeLaunchPruningFunction() {
+  return [](const CpuTcExecutor*) { return false; };
+}
+
+template <>
+void GeneticTunerHarness<CpuBackend>::recoverFromRuntimeError(
+    size_t cpu,
+    const CpuMappingOptions& options) {}
+
+template <>
+void GeneticTunerHarness<CpuBackend>::logCompileTimings() {}
+
+template <>
+void GeneticTunerHarness<CpuBackend>::logClockState(size_t cpu) {}
+
+template <>
+std::string GeneticTunerHarness<CpuBackend>::optionsString(
+    const CpuMappingOptions& options) {
+  return options.proto().DebugString();
+}
+
+template <>
+std::vector<std::unique_ptr<TuningEvaluator>>
+GeneticTunerHarness<CpuBackend>::makeEvaluators() {
+  if (not parseTuningWorkers().empty() or
+      not FLAGS_tuner_sandbox_worker.empty()) {
+    throw std::invalid_argument(
+        "Remote and sandboxed tuning workers only evaluate CUDA kernels");
+  }
+  return {};
+}
+
+template <>
+void GeneticTunerHarness<CpuBackend>::setRequestOptions(
+    TuningRequestProto& request,
+    const CpuMappingOptions& options) {
+  CHECK(false) << "Remote and sandboxed tuning workers only evaluate CUDA "
+               << "kernels";
+}
+
+template class GeneticTunerHarness<CudaBackend>;
+template class GeneticTunerHarness<CpuBackend>;
+
+template bool GeneticTunerHarness<CudaBackend>::warmupOrPrune(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::vector<DLTensor*>& outputs,
+    const std::vector<const DLTensor*>& inputs,
+    size_t handle,
+    size_t bestTimeSoFar);
+
 } // namespace detail
 } // namespace autotune
 } // namespace tc
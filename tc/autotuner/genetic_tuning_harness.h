@@ -16,24 +16,76 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <csignal>
 #include <deque>
+#include <functional>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "tc/aten/aten_compiler.h"
-#include "tc/autotuner/genetic_search.h"
+#include "tc/autotuner/cost_model.h"
+#include "tc/autotuner/distributed_tuning.h"
 #include "tc/autotuner/parameters.h"
+#include "tc/autotuner/search_strategy.h"
+#include "tc/autotuner/utils/concurrent_queue.h"
 #include "tc/autotuner/utils/printer.h"
+#include "tc/autotuner/utils/progress.h"
+#include "tc/autotuner/utils/resource_model.h"
+#include "tc/autotuner/utils/utils.h"
+#include "tc/core/cpu/cpu_backend.h"
+#include "tc/core/cuda/cuda_backend.h"
 #include "tc/lang/parser.h"
 
+#include <llvm/ADT/Optional.h>
+
 namespace tc {
+class TuningRequestProto;
+class TuningResultProto;
+
 namespace autotune {
+
+/// One of the input sets of joint tuning, which tunes a single set of
+/// options for all of them by minimizing the weighted geometric mean of
+/// their runtimes (e.g. for a range of batch sizes). Tensors are per GPU,
+/// like the inputs of the GeneticTunerHarness.
+struct JointInputs {
+  std::unordered_map<size_t, std::vector<const DLTensor*>> inputs;
+  std::unordered_map<size_t, std::vector<DLTensor*>> outputs;
+  double weight;
+};
+
+/// Runtimes of the options found by joint tuning on each input set, compared
+/// to the fastest runtime recorded in the OptionsCache for that input set,
+/// i.e. by specialized tuning or by another candidate of the joint run.
+struct JointTuningReport {
+  std::vector<Duration> runtimes;
+  std::vector<Duration> specializedRuntimes;
+
+  /// runtimes[i] / specializedRuntimes[i]
+  std::vector<double> penalties() const;
+  friend std::ostream& operator<<(
+      std::ostream& os,
+      const JointTuningReport& report);
+};
+
 namespace detail {
 
+/// Genetic search of the mapping options of a TC for the backend given by the
+/// traits Backend (CudaBackend or CpuBackend).  Candidates are compiled on
+/// the tuner threads and benchmarked on the devices of FLAGS_tuner_gpus, or on
+/// the cores of FLAGS_tuner_cpus for the CPU, which the benchmarking threads
+/// are pinned to.  The inputs and outputs are given per device.  With a
+/// tunedKernel other than -1, only the options of that kernel of the split
+/// kernels of CUDA options are searched (see TuningConfiguration::tunedKernel).
+template <typename Backend>
 class GeneticTunerHarness {
  public:
+  using MappingOptionsType = typename Backend::MappingOptionsType;
+  using OptionsCacheType = typename Backend::OptionsCacheType;
+
   GeneticTunerHarness(
       size_t n,
       uint8_t crossoverRate,
@@ -43,12 +95,68 @@ class GeneticTunerHarness {
       std::string kernelName,
       const std::unordered_map<size_t, std::vector<const DLTensor*>>& inputs,
       std::unordered_map<size_t, std::vector<DLTensor*>>& outputs,
-      CudaMappingOptions baseMapping,
-      std::vector<CudaMappingOptions> startingPoints,
-      const TuningParameterFixer& fixedParams);
+      MappingOptionsType baseMapping,
+      std::vector<MappingOptionsType> startingPoints,
+      const TuningParameterFixer& fixedParams,
+      double weight = 1.0,
+      std::vector<JointInputs> jointInputs = {},
+      int tunedKernel = -1);
   void run(size_t numGenerations);
   void stopAfterCurrentGeneration();
 
+  /// Called after each generation (or population size results in pipelined
+  /// and distributed modes) with the OptionsCache up to date, e.g. to save
+  /// the progress
+  void setCheckpointCallback(std::function<void()> checkpoint);
+
+  /// The fastest options once the best candidates were re-measured at the
+  /// end of run (see FLAGS_tuner_final_remeasure_top_k), none if they were
+  /// not
+  llvm::Optional<MappingOptionsType> remeasuredBestOptions();
+
+  /// Counters of the compilations and evaluations of run, which can be read
+  /// from any thread while it runs and after it returned
+  std::shared_ptr<const TuningProgress> progress() const {
+    return progress_;
+  }
+
+  /// Screen the bred candidates with a CostModel of the TC trained on the
+  /// runtimes recorded in the OptionsCache, retrained as new runtimes are
+  /// recorded.  Has no effect unless options.oversampling > 1.
+  void setCostModel(const CostModelOptions& options);
+
+  /// Stop tuning early when one of the criteria is met, none are by default
+  void setStopCriteria(const TuningStopCriteria& criteria);
+
+  /// Replace the search strategy chosen by FLAGS_tuner_search_strategy, must
+  /// be called before run
+  void setSearchStrategy(const std::string& strategy);
+
+  /// Point of the tuning-time-to-quality curve: the best runtime found after
+  /// elapsed wall time and numberEvaluated benchmarked candidates
+  struct TuningCurvePoint {
+    std::chrono::steady_clock::duration elapsed;
+    size_t numberEvaluated;
+    Duration bestRuntime;
+  };
+  /// One point per improvement of the best runtime during run, with the name
+  /// of the search strategy (see FLAGS_tuner_search_strategy)
+  std::vector<TuningCurvePoint> tuningCurve();
+  std::string searchStrategyName() const {
+    return tuner_->name();
+  }
+
+  /// The runtimes of the best options on each input set of joint tuning (the
+  /// main inputs first), measured at the end of run
+  const JointTuningReport& jointTuningReport() const {
+    return jointTuningReport_;
+  }
+
+  MappingOptionsType bestMappingOption() {
+    std::lock_guard<std::mutex> lock(bestTimeMtx_);
+    return bestMappingOptions_;
+  }
+
  private:
   void setupTuningParameters();
 
@@ -56,14 +164,98 @@ class GeneticTunerHarness {
   /// runtimes
   void runOneGeneration(size_t generation);
 
-  /// Helper function to get a kernel into benchmark-able state
+  /// Evaluate numGenerations * kMaxPopulationSize candidates without
+  /// generation barrier: candidates stream from the search through a bounded
+  /// compilation queue into per-GPU benchmark queues, and each result is fed
+  /// back to the search as soon as it arrives, which breeds a new candidate to
+  /// keep the pipeline full.
+  void runPipelined(size_t numGenerations);
+
+  /// Pipelined evaluation of the candidates on remote tuning workers or
+  /// sandboxed local ones (see distributed_tuning.h), one request at a time
+  /// per evaluator
+  void runDistributed(
+      size_t numGenerations,
+      std::vector<std::unique_ptr<TuningEvaluator>> evaluators);
+
+  TuningRequestProto makeTuningRequest() const;
+  /// Records the runtimes of a remote evaluation in the OptionsCache and
+  /// returns them
+  std::vector<Duration> recordRemoteRuntimes(
+      const TuningResultProto& result,
+      const MappingOptionsType& options);
+
+  /// Updates the best runtime and the candidates to re-measure
+  void updateBest(Duration runtime, const MappingOptionsType& options);
+  /// Sets the outcome of conf to that of the options of conf when they were
+  /// evaluated before during run and returns true.  Returns false if they
+  /// were not, or if measuring them again is useful: they are within
+  /// kRemeasureSlack of the best runtime and were measured fewer than
+  /// kMaxMeasurementsPerOptions times.
+  bool reuseEvaluation(CandidateConfiguration& conf);
+  /// Records the outcome of an evaluated candidate, the runtime of options
+  /// measured several times becomes the median of the measurements
+  void recordEvaluatedOptions(CandidateConfiguration& conf);
+  /// Measures each of the best candidates again, without other tuning work
+  /// going on, and keeps the fastest as the best options
+  void remeasureTopCandidates(
+      const std::function<std::vector<Duration>(const MappingOptionsType&)>&
+          measure);
+  void remeasureLocally();
+
+  /// Log compilation statistics and the best options found so far
+  void logProgress();
+  /// Log the tuning curve and append it to FLAGS_tuner_tuning_curve_file
+  void reportTuningCurve();
+  bool timeBudgetExpired();
+  /// Called after each generation (or population size results in pipelined
+  /// and distributed modes), requests to stop if a stop criterion is met
+  void checkStopCriteria();
+  void checkpoint();
+  void trainCostModel();
+
+  /// Compile the candidate, on failure it is marked invalid
   template <typename ExecutorType>
-  bool warmupOrPrune(
-      ExecutorType& executionEngine,
+  void compileCandidate(
+      ExecutorType& engine,
+      CandidateConfiguration& conf,
+      size_t current);
+
+  /// Warmup and benchmark a compiled candidate on the given gpu and record
+  /// its runtime, candidates that are pruned or fail are marked invalid
+  template <typename ExecutorType>
+  void benchmarkCandidate(
+      size_t gpu,
+      ExecutorType& engine,
+      const std::vector<const DLTensor*>& inputs,
       const std::vector<DLTensor*>& outputs,
+      CandidateConfiguration& conf);
+
+  /// Collect the hardware counters of a benchmarked candidate into
+  /// conf.metrics and record them in the OptionsCache
+  template <typename ExecutorType>
+  void collectHardwareCounters(
+      ExecutorType& engine,
       const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
       size_t handle,
-      size_t bestTimeSoFar);
+      Duration runtime,
+      CandidateConfiguration& conf);
+
+  /// Compiles the base options and measures them on each of gpus, the first
+  /// being the reference device of the runtimes (see deviceScale).  Returns
+  /// the handle of the base options, InvalidHandle if there is a single
+  /// device, if normalization is disabled or if the base options fail.
+  template <typename ExecutorType>
+  size_t calibrateDevices(
+      ExecutorType& engine,
+      const std::vector<size_t>& gpus);
+  template <typename ExecutorType>
+  void calibrateDevice(size_t gpu, ExecutorType& engine, size_t handle);
+  /// Factor scaling the runtimes measured on gpu to the reference device,
+  /// the ratio of the latest runtimes of the base options on both, 1 if
+  /// either is not calibrated.
+  double deviceScale(size_t gpu);
 
   /// Helper function to delegate compiling on the cpu to different threads
   template <typename ExecutorType>
@@ -73,19 +265,133 @@ class GeneticTunerHarness {
   template <typename ExecutorType>
   void doGpuWork(size_t gpu, ExecutorType& engine, Printer& printer);
 
+  using CandidateQueue =
+      ConcurrentQueue<std::unique_ptr<CandidateConfiguration>>;
+
+  /// Pipelined counterparts of doCompile and doGpuWork, they process queued
+  /// candidates until done is set and their input queue is drained
+  template <typename ExecutorType>
+  void doPipelinedCompile(
+      ExecutorType& engine,
+      CandidateQueue& compileQueue,
+      std::vector<std::unique_ptr<CandidateQueue>>& gpuQueues,
+      const std::atomic_bool& done);
+  /// The GPU worker of gpuQueues[queue] steals the candidates of the
+  /// longest other queue once its own is empty.  It calibrates its device
+  /// again every kMaxPopulationSize evaluations with calibrationHandle
+  /// unless it is InvalidHandle.
+  template <typename ExecutorType>
+  void doPipelinedGpuWork(
+      size_t gpu,
+      ExecutorType& engine,
+      std::vector<std::unique_ptr<CandidateQueue>>& gpuQueues,
+      size_t queue,
+      CandidateQueue& resultQueue,
+      size_t calibrationHandle,
+      const std::atomic_bool& done);
+  /// Sends the queued candidates to evaluator, gives up (and decrements
+  /// numRemoteWorkers) if the evaluator is lost
+  void doRemoteWork(
+      TuningEvaluator& evaluator,
+      CandidateQueue& requestQueue,
+      CandidateQueue& resultQueue,
+      std::atomic_size_t& numRemoteWorkers,
+      const std::atomic_bool& done);
+
+  /// Steady-state search shared by the pipelined and distributed modes:
+  /// candidates are pushed to candidateQueue and bred from the results
+  /// popped from resultQueue.  Throws if no evaluator is left.
+  void streamCandidates(
+      size_t numGenerations,
+      CandidateQueue& candidateQueue,
+      CandidateQueue& resultQueue,
+      const std::atomic_size_t& numEvaluators);
+
   /// Make options from conf
-  tc::CudaMappingOptions makeOptions(const CandidateConfiguration& conf);
+  MappingOptionsType makeOptions(const CandidateConfiguration& conf);
   TuningConfiguration makeTuningConfiguration(
-      const CudaMappingOptions& options);
-  CudaMappingOptions bestMappingOption() {
-    std::lock_guard<std::mutex> lock(bestTimeMtx_);
-    return bestCudaMappingOptions_;
+      const MappingOptionsType& options);
+
+  // What differs between the backends, specialized for each of them in
+  // genetic_tuning_harness.cc.
+  /// The devices to benchmark on, parseGpus or parseCpus
+  static std::vector<size_t> devices();
+  /// Sets the ranges of the parameters only the backend uses and pins those
+  /// it ignores, called by setupTuningParameters with the sizes it searches
+  /// for the tiles
+  void setupBackendTuningParameters(std::vector<size_t>& sizes);
+  /// The base options followed by the starting points, whose values the
+  /// ranges of the parameters must contain
+  std::vector<const MappingOptionsType*> startingOptions() const;
+  /// Pruning before the backend compilation, e.g. with the static resource
+  /// model on GPU
+  std::function<bool(const typename Backend::ExecutorType*)>
+  makeCompilePruningFunction();
+  /// Pruning before the first launch of a compiled kernel, e.g. of the
+  /// kernels launching too few threads on GPU
+  static std::function<bool(const typename Backend::ExecutorType*)>
+  makeLaunchPruningFunction();
+  /// Brings the device back to a usable state after a failed run, e.g. by
+  /// clearing the CUDA errors, dies if it cannot
+  static void recoverFromRuntimeError(
+      size_t device,
+      const MappingOptionsType& options);
+  static void logCompileTimings();
+  /// Reports the clocks of the device once it timed the candidates of a
+  /// generation, warning if they were throttled, e.g. by its temperature
+  static void logClockState(size_t device);
+  static std::string optionsString(const MappingOptionsType& options);
+  /// The remote or sandboxed evaluators (see distributed_tuning.h), none if
+  /// the candidates are evaluated on the devices of this process
+  std::vector<std::unique_ptr<TuningEvaluator>> makeEvaluators();
+  static void setRequestOptions(
+      TuningRequestProto& request,
+      const MappingOptionsType& options);
+
+  template <typename ExecutorType>
+  void clearCompilationHandles(
+      ExecutorType& engine,
+      CandidateConfiguration& conf);
+  bool jointTuning() const {
+    return not kJointInputs_.empty();
   }
+  /// Median runtime of options on each input set (the main inputs first) on
+  /// gpu, compiles and clears the kernels
+  template <typename ExecutorType>
+  std::vector<Duration> measureInputSets(
+      ExecutorType& engine,
+      size_t gpu,
+      const MappingOptionsType& options,
+      const MeasurementBudget& budget);
+  void measureJointTuningReport();
 
  public:
+  /// Helper function to get a kernel into benchmark-able state, returns true
+  /// if the kernel should be pruned (also used by distributed tuning workers)
+  template <typename ExecutorType>
+  static bool warmupOrPrune(
+      ExecutorType& executionEngine,
+      const std::vector<DLTensor*>& outputs,
+      const std::vector<const DLTensor*>& inputs,
+      size_t handle,
+      size_t bestTimeSoFar);
+
   static constexpr int kReducedWarmupIterations = 2;
-  static constexpr int kReducedBenchmarkIterations = 10;
+  /// Scales the benchmarking budget of the final re-measurements
+  static constexpr size_t kFinalMeasurementBudgetFactor = 10;
   static constexpr int kEarlyPruneFactor = 5;
+  /// Evaluated options whose runtime is within this factor of the best
+  /// runtime are measured again when bred again, up to
+  /// kMaxMeasurementsPerOptions times in total
+  static constexpr double kRemeasureSlack = 1.05;
+  static constexpr size_t kMaxMeasurementsPerOptions = 3;
+  /// With --tuner_hardware_counters, the counters of the candidates within
+  /// this factor of the best runtime so far are collected (of all the
+  /// candidates with joint tuning)
+  static constexpr double kHardwareCountersSlack = 1.1;
+  /// Compiled candidates waiting for each GPU in pipelined mode
+  static constexpr size_t kGpuQueueCapacity = 2;
+  static constexpr std::chrono::milliseconds kPipelinePollInterval{10};
 
   const size_t kMaxPopulationSize;
   const uint8_t kCrossOverRate;
@@ -97,23 +403,70 @@ class GeneticTunerHarness {
  private:
   std::mutex bestTimeMtx_;
   size_t bestTime_ = std::numeric_limits<size_t>::max();
-  CudaMappingOptions bestCudaMappingOptions_;
+  MappingOptionsType bestMappingOptions_;
+  /// Fastest distinct options with their best runtime, sorted
+  std::vector<std::pair<Duration, MappingOptionsType>> topCandidates_;
+  llvm::Optional<MappingOptionsType> remeasuredBestOptions_;
+  std::chrono::steady_clock::time_point tuningStart_;
+  size_t numberBenchmarked_ = 0;
+  std::vector<TuningCurvePoint> tuningCurve_;
+  /// Best runtime of the base mapping options, in us
+  size_t baselineTime_ = std::numeric_limits<size_t>::max();
+  size_t bestTimeAtLastGeneration_ = std::numeric_limits<size_t>::max();
+  size_t numberStalledGenerations_ = 0;
 
   const lang::TreeRef kTc_;
   const std::string kKernelName_;
-  std::unique_ptr<GeneticSearch> tuner_;
+  std::unique_ptr<SearchStrategy> tuner_;
+  std::vector<TuningConfiguration> startingConfigurations_;
   std::atomic_size_t currentCompilationJob_;
   std::deque<std::atomic_bool> readyToEvaluate_;
   std::atomic_size_t numEvaluations_;
+  /// Latest runtime of the base options on each device, kept across
+  /// generations (see calibrateDevices)
+  std::mutex deviceTimesMtx_;
+  std::unordered_map<size_t, Duration> deviceTimes_;
+  size_t referenceDevice_ = 0;
+  /// The candidates of the current generation whose outcome is known, they
+  /// are neither compiled nor benchmarked
+  std::vector<char> reusedEvaluations_;
+
+  /// The distinct options evaluated during run by hash, each is compiled
+  /// and benchmarked once unless measured again (see reuseEvaluation)
+  struct EvaluatedOptions {
+    MappingOptionsType options;
+    bool invalid;
+    std::vector<Duration> runtimes;
+  };
+  std::mutex evaluatedOptionsMtx_;
+  std::unordered_multimap<uint64_t, EvaluatedOptions> evaluatedOptions_;
+  std::shared_ptr<TuningProgress> progress_ =
+      std::make_shared<TuningProgress>();
+  /// Candidates pruned by the static resource model, per generation
+  StaticPruningStats staticPruningStats_;
+  /// Successive halving of the measurements of the candidates, over the
+  /// whole tuning run
+  SuccessiveHalving racing_;
   const std::unordered_map<size_t, std::vector<const DLTensor*>> kInputs_;
   std::unordered_map<size_t, std::vector<DLTensor*>> outputs_;
+  /// Other input sets of joint tuning and the weights of all input sets, the
+  /// main inputs first
+  const std::vector<JointInputs> kJointInputs_;
+  std::vector<double> weights_;
+  JointTuningReport jointTuningReport_;
 
-  const CudaMappingOptions kBaseMapping_;
-  const std::vector<CudaMappingOptions> kStartingPoints_;
+  const MappingOptionsType kBaseMapping_;
+  const std::vector<MappingOptionsType> kStartingPoints_;
   std::atomic_bool stopRequested_{false};
+  std::function<void()> checkpoint_;
+  CostModelOptions costModelOptions_;
+  TuningStopCriteria stopCriteria_ = TuningStopCriteria();
 };
 
+/// The GPUs of FLAGS_tuner_gpus
 std::vector<size_t> parseGpus();
+/// The CPU cores of FLAGS_tuner_cpus
+std::vector<size_t> parseCpus();
 
 } // namespace detail
 } // namespace autotune
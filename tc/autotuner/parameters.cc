@@ -26,6 +26,11 @@
 namespace tc {
 namespace autotune {
 
+namespace {
+// The driver's default, used by options that do not set one.
+constexpr size_t kDefaultJitOptimizationLevel = 4;
+} // namespace
+
 BoolParameter& BoolParameter::operator=(const BoolParameter& other) {
   value_ = other.value_;
   fixedValue_ = other.fixedValue_;
@@ -151,6 +156,15 @@ size_t ParameterView::numberOptions() const {
   }
 }
 
+size_t ParameterView::selectedOption() const {
+  CHECK((rangePtr == nullptr) xor (boolPtr == nullptr));
+  if (rangePtr) {
+    return rangePtr->selected_;
+  } else {
+    return boolPtr->value_ ? 1 : 0;
+  }
+}
+
 void ParameterView::selectOption(size_t idx) {
   CHECK((rangePtr == nullptr) xor (boolPtr == nullptr));
   if (rangePtr) {
@@ -160,6 +174,16 @@ void ParameterView::selectOption(size_t idx) {
   }
 }
 
+bool ParameterView::isOrdinal() const {
+  CHECK((rangePtr == nullptr) xor (boolPtr == nullptr));
+  return rangePtr != nullptr;
+}
+
+size_t ParameterView::optionValue(size_t idx) const {
+  CHECK(rangePtr) << "boolean parameters have no option values";
+  return rangePtr->values_.at(idx);
+}
+
 ParameterView::ParameterView(BoolParameter& p)
     : rangePtr(nullptr), boolPtr(&p) {}
 ParameterView::ParameterView(RangeParameter& p)
@@ -171,17 +195,26 @@ void TuningConfiguration::addValidator(
 }
 
 SchedulerOptionsParameters::SchedulerOptionsParameters()
-    : fusionStrategy({0, 1, 2}, "fusion strategy") {}
+    : fusionStrategy({0, 1, 2}, "fusion strategy"),
+      allowSkewing("allow skewing"),
+      positiveOrthant("positive orthant"),
+      fusionPartition({0}, "fusion partition") {}
 
 void SchedulerOptionsParameters::apply(
     const std::function<void(ParameterView&)>& f) {
   fusionStrategy.apply(f);
+  allowSkewing.apply(f);
+  positiveOrthant.apply(f);
+  fusionPartition.apply(f);
 }
 
 std::vector<ParameterView> SchedulerOptionsParameters::collectParameters() {
   std::vector<ParameterView> params;
-  params.reserve(1);
+  params.reserve(4);
   params.emplace_back(fusionStrategy);
+  params.emplace_back(allowSkewing);
+  params.emplace_back(positiveOrthant);
+  params.emplace_back(fusionPartition);
 
   return params;
 }
@@ -201,6 +234,27 @@ void SchedulerOptionsParameters::applyToMappingOptions(
     default:
       throw std::invalid_argument("Unknown fusion strategy.");
   }
+  options.proto.set_allow_skewing(allowSkewing.value());
+  options.proto.set_positive_orthant(positiveOrthant.value());
+  // Without tensors the pairs of the options are kept
+  if (tensors.empty()) {
+    return;
+  }
+  options.proto.clear_never_fused();
+  auto partition = fusionPartition.value();
+  std::vector<size_t> group(tensors.size(), 0);
+  for (size_t i = 1; i < tensors.size(); ++i) {
+    group[i] = group[i - 1] + ((partition >> (i - 1)) & 1);
+  }
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    for (size_t j = i + 1; j < tensors.size(); ++j) {
+      if (group[i] != group[j] and tensors[i] != tensors[j]) {
+        auto neverFused = options.proto.add_never_fused();
+        neverFused->set_first(tensors[i]);
+        neverFused->set_second(tensors[j]);
+      }
+    }
+  }
 }
 
 namespace {
@@ -221,6 +275,22 @@ size_t toInt(const FusionStrategy& fs) {
 void SchedulerOptionsParameters::fromMappingOptions(
     const SchedulerOptionsView& options) {
   fusionStrategy.selectOption(toInt(options.proto.fusion_strategy()));
+  allowSkewing.selectValue(options.proto.allow_skewing());
+  positiveOrthant.selectValue(options.proto.positive_orthant());
+  // Groups start at the tensors never fused with their predecessor
+  size_t partition = 0;
+  for (size_t i = 1; i < tensors.size(); ++i) {
+    for (const auto& pair : options.proto.never_fused()) {
+      if ((pair.first() == tensors[i - 1] and pair.second() == tensors[i]) or
+          (pair.first() == tensors[i] and pair.second() == tensors[i - 1])) {
+        partition |= size_t(1) << (i - 1);
+      }
+    }
+  }
+  // Partitions outside the range keep the selected one
+  if (partition < fusionPartition.numberOptions()) {
+    fusionPartition.selectFromValue(partition);
+  }
 }
 
 void TuningConfiguration::applyToParameters(
@@ -235,7 +305,37 @@ void TuningConfiguration::applyToParameters(
   useSharedMemory.apply(f);
   usePrivateMemory.apply(f);
   unrollCopyShared.apply(f);
+  vectorizeWidth.apply(f);
+  blockSwizzle.apply(f);
+  batchPacking.apply(f);
+  linearizeBlocks.apply(f);
+  threadTileSize.apply(f);
+  warpTileSize.apply(f);
+  warpShuffleReductions.apply(f);
+  gridReductions.apply(f);
+  useTensorCores.apply(f);
+  splitKernels.apply(f);
+  unrollPragma.apply(f);
+  persistentBlocks.apply(f);
+  separateFullTiles.apply(f);
+  asyncCopies.apply(f);
+  transposeShared.apply(f);
+  cooperativeKernels.apply(f);
+  warpAggregatedAtomics.apply(f);
+  twoDimReductions.apply(f);
+  dp4aPacking.apply(f);
   matchLibraryCalls.apply(f);
+  inlinePointwiseTemporaries.apply(f);
+  maxRegisterCount.apply(f);
+  useFastMath.apply(f);
+  jitOptimizationLevel.apply(f);
+  useLaunchBounds.apply(f);
+  minBlocksPerMultiprocessor.apply(f);
+  l2TileFactor.apply(f);
+  parallelDepth.apply(f);
+  cpuVectorizeWidth.apply(f);
+  prefetchDistance.apply(f);
+  packingLevel.apply(f);
 }
 
 bool TuningConfiguration::isValid() const {
@@ -249,7 +349,7 @@ bool TuningConfiguration::isValid() const {
 
 std::vector<ParameterView> TuningConfiguration::collectParameters() {
   std::vector<ParameterView> params;
-  params.reserve(26);
+  params.reserve(30);
   auto collect = [&](std::vector<ParameterView>&& newParams) {
     params.reserve(params.size() + newParams.size());
     std::move(
@@ -268,7 +368,37 @@ std::vector<ParameterView> TuningConfiguration::collectParameters() {
   params.emplace_back(useSharedMemory);
   params.emplace_back(usePrivateMemory);
   params.emplace_back(unrollCopyShared);
+  params.emplace_back(vectorizeWidth);
+  params.emplace_back(blockSwizzle);
+  params.emplace_back(batchPacking);
+  params.emplace_back(linearizeBlocks);
+  params.emplace_back(threadTileSize);
+  params.emplace_back(warpTileSize);
+  params.emplace_back(warpShuffleReductions);
+  params.emplace_back(gridReductions);
+  params.emplace_back(useTensorCores);
+  params.emplace_back(splitKernels);
+  params.emplace_back(unrollPragma);
+  params.emplace_back(persistentBlocks);
+  params.emplace_back(separateFullTiles);
+  params.emplace_back(asyncCopies);
+  params.emplace_back(transposeShared);
+  params.emplace_back(cooperativeKernels);
+  params.emplace_back(warpAggregatedAtomics);
+  params.emplace_back(twoDimReductions);
+  params.emplace_back(dp4aPacking);
   params.emplace_back(matchLibraryCalls);
+  params.emplace_back(inlinePointwiseTemporaries);
+  params.emplace_back(maxRegisterCount);
+  params.emplace_back(useFastMath);
+  params.emplace_back(jitOptimizationLevel);
+  params.emplace_back(useLaunchBounds);
+  params.emplace_back(minBlocksPerMultiprocessor);
+  params.emplace_back(l2TileFactor);
+  params.emplace_back(parallelDepth);
+  params.emplace_back(cpuVectorizeWidth);
+  params.emplace_back(prefetchDistance);
+  params.emplace_back(packingLevel);
 
   return params;
 }
@@ -284,16 +414,62 @@ void TuningConfiguration::fromMappingOptions(
       (options.proto.has_unroll() ? options.proto.unroll() : 1));
   tileImperfectlyNested.selectValue(options.proto.tile_imperfectly_nested());
   matchLibraryCalls.selectValue(options.proto.match_library_calls());
+  inlinePointwiseTemporaries.selectValue(
+      options.proto.inline_pointwise_temporaries());
 }
 
 void TuningConfiguration::fromCudaMappingOptions(
     const CudaMappingOptions& options) {
+  if (tunedKernel >= 0) {
+    fromKernelCudaMappingOptions(options.optionsOfKernel(tunedKernel));
+  } else {
+    fromKernelCudaMappingOptions(options);
+  }
+}
+
+void TuningConfiguration::fromKernelCudaMappingOptions(
+    const CudaMappingOptions& options) {
   fromMappingOptions(options.generic);
   blockParams.fromMappingOptions(options.block);
   gridParams.fromMappingOptions(options.grid);
   useSharedMemory.selectValue(options.proto().use_shared_memory());
   usePrivateMemory.selectValue(options.proto().use_private_memory());
   unrollCopyShared.selectValue(options.proto().unroll_copy_shared());
+  vectorizeWidth.selectFromValue(options.proto().vectorize_width());
+  blockSwizzle.selectFromValue(options.proto().block_swizzle());
+  batchPacking.selectFromValue(options.proto().batch_packing());
+  linearizeBlocks.selectFromValue(options.proto().linearize_blocks());
+  const auto& threadTiling = options.proto().thread_tiling();
+  threadTileSize.selectFromValue(
+      threadTiling.sizes_size() > 0 ? threadTiling.sizes(0) : 1);
+  const auto& warpTiling = options.proto().warp_tiling();
+  warpTileSize.selectFromValue(
+      warpTiling.sizes_size() > 0 ? warpTiling.sizes(0) : 1);
+  warpShuffleReductions.selectValue(
+      options.proto().warp_shuffle_reductions());
+  gridReductions.selectValue(options.proto().grid_reductions());
+  useTensorCores.selectValue(options.proto().use_tensor_cores());
+  splitKernels.selectValue(options.proto().split_kernels());
+  unrollPragma.selectValue(options.proto().unroll_pragma());
+  persistentBlocks.selectValue(options.proto().persistent_blocks());
+  separateFullTiles.selectValue(options.proto().separate_full_tiles());
+  asyncCopies.selectValue(options.proto().async_copies());
+  transposeShared.selectValue(options.proto().transpose_shared());
+  cooperativeKernels.selectValue(options.proto().cooperative_kernels());
+  warpAggregatedAtomics.selectValue(
+      options.proto().warp_aggregated_atomics());
+  twoDimReductions.selectValue(options.proto().two_dim_reductions());
+  dp4aPacking.selectFromValue(options.proto().dp4a_packing());
+  const auto& compilerOptions = options.proto().compiler_options();
+  maxRegisterCount.selectFromValue(compilerOptions.max_register_count());
+  useFastMath.selectValue(compilerOptions.use_fast_math());
+  jitOptimizationLevel.selectFromValue(
+      compilerOptions.has_jit_optimization_level()
+          ? compilerOptions.jit_optimization_level()
+          : kDefaultJitOptimizationLevel);
+  useLaunchBounds.selectValue(compilerOptions.use_launch_bounds());
+  minBlocksPerMultiprocessor.selectFromValue(
+      compilerOptions.min_blocks_per_multiprocessor());
 }
 
 void TuningConfiguration::applyToMappingOptions(
@@ -306,16 +482,154 @@ void TuningConfiguration::applyToMappingOptions(
   options.unroll(unrollFactor.value());
   options.tileImperfectlyNested(tileImperfectlyNested.value());
   options.matchLibraryCalls(matchLibraryCalls.value());
+  // Only set when used, the other options serialize as before.
+  if (inlinePointwiseTemporaries.value() or
+      options.proto.has_inline_pointwise_temporaries()) {
+    options.inlinePointwiseTemporaries(inlinePointwiseTemporaries.value());
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, const TuningConfiguration& conf) {
+  auto options = CudaMappingOptions::makeSingleThreadCudaMappingOptions();
+  conf.applyToCudaMappingOptions(options);
+  return os << options;
 }
 
 void TuningConfiguration::applyToCudaMappingOptions(
     CudaMappingOptions& options) const {
+  if (tunedKernel < 0) {
+    applyToKernelCudaMappingOptions(options);
+    return;
+  }
+  // The kernels before the tuned one keep the options they are mapped with
+  for (auto k = options.proto().kernel_options_size(); k < tunedKernel; ++k) {
+    options.kernelOptions(k, options.optionsOfKernel(k));
+  }
+  auto kernelOptions = options.optionsOfKernel(tunedKernel);
+  applyToKernelCudaMappingOptions(kernelOptions);
+  options.kernelOptions(tunedKernel, kernelOptions);
+}
+
+void TuningConfiguration::applyToKernelCudaMappingOptions(
+    CudaMappingOptions& options) const {
   applyToMappingOptions(options.generic);
   blockParams.applyToMappingOptions(options.block);
   gridParams.applyToMappingOptions(options.grid);
   options.useSharedMemory(useSharedMemory.value());
   options.usePrivateMemory(usePrivateMemory.value());
   options.unrollCopyShared(unrollCopyShared.value());
+  // Only set when it differs from the default, like the compiler options.
+  if (vectorizeWidth.value() != options.proto().vectorize_width()) {
+    options.vectorizeWidth(vectorizeWidth.value());
+  }
+  if (blockSwizzle.value() != options.proto().block_swizzle()) {
+    options.blockSwizzle(blockSwizzle.value());
+  }
+  if (batchPacking.value() != options.proto().batch_packing()) {
+    options.batchPacking(batchPacking.value());
+  }
+  if (linearizeBlocks.value() != options.proto().linearize_blocks()) {
+    options.linearizeBlocks(linearizeBlocks.value());
+  }
+  if (threadTileSize.value() > 1) {
+    options.threadTile({threadTileSize.value(), threadTileSize.value()});
+  } else {
+    options.threadTile({});
+  }
+  if (warpTileSize.value() > 1) {
+    options.warpTile({warpTileSize.value(), warpTileSize.value()});
+  } else {
+    options.warpTile({});
+  }
+  options.warpShuffleReductions(warpShuffleReductions.value());
+  options.gridReductions(gridReductions.value());
+  options.useTensorCores(useTensorCores.value());
+  options.splitKernels(splitKernels.value());
+  options.unrollPragma(unrollPragma.value());
+  options.persistentBlocks(persistentBlocks.value());
+  options.separateFullTiles(separateFullTiles.value());
+  options.dp4aPacking(static_cast<Dp4aPacking>(dp4aPacking.value()));
+  if (asyncCopies.value() != options.proto().async_copies()) {
+    options.asyncCopies(asyncCopies.value());
+  }
+  if (transposeShared.value() != options.proto().transpose_shared()) {
+    options.transposeShared(transposeShared.value());
+  }
+  if (cooperativeKernels.value() != options.proto().cooperative_kernels()) {
+    options.cooperativeKernels(cooperativeKernels.value());
+  }
+  if (warpAggregatedAtomics.value() !=
+      options.proto().warp_aggregated_atomics()) {
+    options.warpAggregatedAtomics(warpAggregatedAtomics.value());
+  }
+  if (twoDimReductions.value() != options.proto().two_dim_reductions()) {
+    options.twoDimReductions(twoDimReductions.value());
+  }
+  // Compiler options are only set when they differ, options using the
+  // defaults keep comparing equal to options that never set them.
+  const auto compilerOptions = options.proto().compiler_options();
+  if (maxRegisterCount.value() != compilerOptions.max_register_count()) {
+    options.maxRegisterCount(maxRegisterCount.value());
+  }
+  if (useFastMath.value() != compilerOptions.use_fast_math()) {
+    options.useFastMath(useFastMath.value());
+  }
+  if (jitOptimizationLevel.value() !=
+      (compilerOptions.has_jit_optimization_level()
+           ? compilerOptions.jit_optimization_level()
+           : kDefaultJitOptimizationLevel)) {
+    options.jitOptimizationLevel(jitOptimizationLevel.value());
+  }
+  auto minBlocks = useLaunchBounds.value()
+      ? minBlocksPerMultiprocessor.value()
+      : compilerOptions.min_blocks_per_multiprocessor();
+  if (useLaunchBounds.value() != compilerOptions.use_launch_bounds() or
+      minBlocks != compilerOptions.min_blocks_per_multiprocessor()) {
+    options.useLaunchBounds(useLaunchBounds.value(), minBlocks);
+  }
+}
+
+void TuningConfiguration::fromCpuMappingOptions(
+    const CpuMappingOptions& options) {
+  fromMappingOptions(options.generic);
+  const auto& l2Tiling = options.proto().l2_tiling();
+  const auto& tiling = options.generic.tiling;
+  l2TileFactor.selectFromValue(
+      l2Tiling.sizes_size() > 0 and tiling.size() > 0 and tiling[0] > 0
+          ? l2Tiling.sizes(0) / tiling[0]
+          : 1);
+  parallelDepth.selectFromValue(options.proto().parallel_depth());
+  cpuVectorizeWidth.selectFromValue(options.proto().vectorize_width());
+  prefetchDistance.selectFromValue(options.proto().prefetch_distance());
+  packingLevel.selectFromValue(options.proto().packing_level());
+}
+
+void TuningConfiguration::applyToCpuMappingOptions(
+    CpuMappingOptions& options) const {
+  applyToMappingOptions(options.generic);
+  std::vector<uint64_t> l2Sizes;
+  if (l2TileFactor.value() > 1) {
+    for (auto size : options.generic.tiling.extractVector()) {
+      l2Sizes.push_back(size * l2TileFactor.value());
+    }
+  }
+  // Only set when they differ, as for the CUDA compiler options.
+  const auto& proto = options.proto();
+  if (not l2Sizes.empty() or proto.l2_tiling().sizes_size() > 0) {
+    options.l2Tile(l2Sizes);
+  }
+  if (parallelDepth.value() != proto.parallel_depth()) {
+    options.parallelDepth(parallelDepth.value());
+  }
+  if (cpuVectorizeWidth.value() != proto.vectorize_width()) {
+    options.vectorizeWidth(cpuVectorizeWidth.value());
+  }
+  if (prefetchDistance.value() != proto.prefetch_distance()) {
+    options.prefetchDistance(prefetchDistance.value());
+  }
+  if (packingLevel.value() != proto.packing_level()) {
+    options.packingLevel(packingLevel.value());
+  }
 }
 
 TuningConfiguration::TuningConfiguration()
@@ -324,7 +638,43 @@ TuningConfiguration::TuningConfiguration()
       useSharedMemory("use shared memory"),
       usePrivateMemory("use private memory"),
       unrollCopyShared("unroll copy shared"),
-      matchLibraryCalls("match library calls") {
+      vectorizeWidth({1, 2, 4}, "vectorize width"),
+      blockSwizzle({1, 4, 8}, "block swizzle"),
+      batchPacking({1, 2, 4, 8}, "batch packing"),
+      linearizeBlocks({1, 2, 3}, "linearize blocks"),
+      threadTileSize({1, 2, 4}, "thread tile size"),
+      warpTileSize({1, 8, 16, 32}, "warp tile size"),
+      warpShuffleReductions("warp shuffle reductions"),
+      gridReductions("grid reductions"),
+      useTensorCores("use tensor cores"),
+      splitKernels("split kernels"),
+      unrollPragma("unroll pragma"),
+      persistentBlocks("persistent blocks"),
+      separateFullTiles("separate full tiles"),
+      asyncCopies("async copies"),
+      transposeShared("transpose shared"),
+      cooperativeKernels("cooperative kernels"),
+      warpAggregatedAtomics("warp aggregated atomics"),
+      twoDimReductions("two dim reductions"),
+      dp4aPacking(
+          {Dp4aPacking::NoDp4a,
+           Dp4aPacking::ContiguousDp4a,
+           Dp4aPacking::PackedDp4a},
+          "dp4a packing"),
+      matchLibraryCalls("match library calls"),
+      inlinePointwiseTemporaries("inline pointwise temporaries"),
+      maxRegisterCount({0}, "max register count"),
+      useFastMath("use fast math"),
+      jitOptimizationLevel(
+          {kDefaultJitOptimizationLevel},
+          "jit optimization level"),
+      useLaunchBounds("use launch bounds"),
+      minBlocksPerMultiprocessor({0}, "min blocks per multiprocessor"),
+      l2TileFactor({1}, "l2 tile factor"),
+      parallelDepth({0}, "parallel depth"),
+      cpuVectorizeWidth({0}, "cpu vectorize width"),
+      prefetchDistance({0}, "prefetch distance"),
+      packingLevel({0}, "packing level") {
   addValidator([](const TuningConfiguration& conf) {
     auto b0v = conf.blockParams.dims.at(0).value();
     auto b1v = conf.blockParams.dims.at(1).value();
@@ -395,6 +745,16 @@ void TuningConfiguration::fixParameters(
   maybeFixFusionStrategy(
       fixedParams.intraTileScheduleFusionStrategy,
       intraTileScheduleOptions.fusionStrategy);
+  maybeFixScalar(
+      fixedParams.outerScheduleFusionPartition,
+      outerScheduleOptions.fusionPartition);
+  maybeFixScalar(fixedParams.allowSkewing, outerScheduleOptions.allowSkewing);
+  maybeFixScalar(
+      fixedParams.allowSkewing, intraTileScheduleOptions.allowSkewing);
+  maybeFixScalar(
+      fixedParams.positiveOrthant, outerScheduleOptions.positiveOrthant);
+  maybeFixScalar(
+      fixedParams.positiveOrthant, intraTileScheduleOptions.positiveOrthant);
   maybeFixScalar(
       fixedParams.fixParametersBeforeScheduling, fixParametersBeforeScheduling);
   maybeFixScalar(fixedParams.unrollFactor, unrollFactor);
@@ -405,7 +765,39 @@ void TuningConfiguration::fixParameters(
   maybeFixScalar(fixedParams.useSharedMemory, useSharedMemory);
   maybeFixScalar(fixedParams.usePrivateMemory, usePrivateMemory);
   maybeFixScalar(fixedParams.unrollCopyShared, unrollCopyShared);
+  maybeFixScalar(fixedParams.vectorizeWidth, vectorizeWidth);
+  maybeFixScalar(fixedParams.blockSwizzle, blockSwizzle);
+  maybeFixScalar(fixedParams.batchPacking, batchPacking);
+  maybeFixScalar(fixedParams.linearizeBlocks, linearizeBlocks);
+  maybeFixScalar(fixedParams.threadTileSize, threadTileSize);
+  maybeFixScalar(fixedParams.warpTileSize, warpTileSize);
+  maybeFixScalar(fixedParams.warpShuffleReductions, warpShuffleReductions);
+  maybeFixScalar(fixedParams.gridReductions, gridReductions);
+  maybeFixScalar(fixedParams.useTensorCores, useTensorCores);
+  maybeFixScalar(fixedParams.splitKernels, splitKernels);
+  maybeFixScalar(fixedParams.unrollPragma, unrollPragma);
+  maybeFixScalar(fixedParams.persistentBlocks, persistentBlocks);
+  maybeFixScalar(fixedParams.separateFullTiles, separateFullTiles);
+  maybeFixScalar(fixedParams.asyncCopies, asyncCopies);
+  maybeFixScalar(fixedParams.transposeShared, transposeShared);
+  maybeFixScalar(fixedParams.cooperativeKernels, cooperativeKernels);
+  maybeFixScalar(fixedParams.warpAggregatedAtomics, warpAggregatedAtomics);
+  maybeFixScalar(fixedParams.twoDimReductions, twoDimReductions);
+  maybeFixScalar(fixedParams.dp4aPacking, dp4aPacking);
   maybeFixScalar(fixedParams.matchLibraryCalls, matchLibraryCalls);
+  maybeFixScalar(
+      fixedParams.inlinePointwiseTemporaries, inlinePointwiseTemporaries);
+  maybeFixScalar(fixedParams.maxRegisterCount, maxRegisterCount);
+  maybeFixScalar(fixedParams.useFastMath, useFastMath);
+  maybeFixScalar(fixedParams.jitOptimizationLevel, jitOptimizationLevel);
+  maybeFixScalar(fixedParams.useLaunchBounds, useLaunchBounds);
+  maybeFixScalar(
+      fixedParams.minBlocksPerMultiprocessor, minBlocksPerMultiprocessor);
+  maybeFixScalar(fixedParams.l2TileFactor, l2TileFactor);
+  maybeFixScalar(fixedParams.parallelDepth, parallelDepth);
+  maybeFixScalar(fixedParams.cpuVectorizeWidth, cpuVectorizeWidth);
+  maybeFixScalar(fixedParams.prefetchDistance, prefetchDistance);
+  maybeFixScalar(fixedParams.packingLevel, packingLevel);
 }
 
 void MultiRangeParams::setRange(
@@ -506,6 +898,22 @@ TuningParameterFixer& TuningParameterFixer::fixIntraTileScheduleFusionStrategy(
   return *this;
 }
 
+TuningParameterFixer& TuningParameterFixer::fixOuterScheduleFusionPartition(
+    size_t val) {
+  outerScheduleFusionPartition = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixAllowSkewing(bool val) {
+  allowSkewing = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixPositiveOrthant(bool val) {
+  positiveOrthant = val;
+  return *this;
+}
+
 TuningParameterFixer& TuningParameterFixer::fixFixParametersBeforeScheduling(
     bool val) {
   fixParametersBeforeScheduling = val;
@@ -554,10 +962,165 @@ TuningParameterFixer& TuningParameterFixer::fixUnrollCopyShared(bool val) {
   return *this;
 }
 
+TuningParameterFixer& TuningParameterFixer::fixVectorizeWidth(size_t val) {
+  vectorizeWidth = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixBlockSwizzle(size_t val) {
+  blockSwizzle = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixBatchPacking(size_t val) {
+  batchPacking = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixLinearizeBlocks(size_t val) {
+  linearizeBlocks = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixThreadTileSize(size_t val) {
+  threadTileSize = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixWarpTileSize(size_t val) {
+  warpTileSize = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixWarpShuffleReductions(
+    bool val) {
+  warpShuffleReductions = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixGridReductions(bool val) {
+  gridReductions = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixUseTensorCores(bool val) {
+  useTensorCores = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixSplitKernels(bool val) {
+  splitKernels = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixUnrollPragma(bool val) {
+  unrollPragma = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixPersistentBlocks(bool val) {
+  persistentBlocks = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixSeparateFullTiles(bool val) {
+  separateFullTiles = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixAsyncCopies(bool val) {
+  asyncCopies = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixTransposeShared(bool val) {
+  transposeShared = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixCooperativeKernels(bool val) {
+  cooperativeKernels = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixWarpAggregatedAtomics(
+    bool val) {
+  warpAggregatedAtomics = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixTwoDimReductions(bool val) {
+  twoDimReductions = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixDp4aPacking(Dp4aPacking val) {
+  dp4aPacking = val;
+  return *this;
+}
+
 TuningParameterFixer& TuningParameterFixer::fixMatchLibraryCalls(bool val) {
   matchLibraryCalls = val;
   return *this;
 }
 
+TuningParameterFixer& TuningParameterFixer::fixInlinePointwiseTemporaries(
+    bool val) {
+  inlinePointwiseTemporaries = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixMaxRegisterCount(size_t val) {
+  maxRegisterCount = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixUseFastMath(bool val) {
+  useFastMath = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixJitOptimizationLevel(
+    size_t val) {
+  jitOptimizationLevel = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixUseLaunchBounds(bool val) {
+  useLaunchBounds = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixMinBlocksPerMultiprocessor(
+    size_t val) {
+  minBlocksPerMultiprocessor = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixL2TileFactor(size_t val) {
+  l2TileFactor = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixParallelDepth(size_t val) {
+  parallelDepth = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixCpuVectorizeWidth(size_t val) {
+  cpuVectorizeWidth = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixPrefetchDistance(size_t val) {
+  prefetchDistance = val;
+  return *this;
+}
+
+TuningParameterFixer& TuningParameterFixer::fixPackingLevel(size_t val) {
+  packingLevel = val;
+  return *this;
+}
+
 } // namespace autotune
 } // namespace tc
@@ -19,6 +19,8 @@
 #include <memory>
 #include <vector>
 
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cuda/cuda_kernel_metrics.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/utils/memory.h"
 
@@ -83,9 +85,16 @@ class ParameterView {
   ParameterView(RangeParameter&);
 
   size_t numberOptions() const;
+  /// Index of the selected option, in [0, numberOptions())
+  size_t selectedOption() const;
   void selectOption(size_t idx);
   void overwrite(const ParameterView&);
   bool isForced() const;
+  /// Whether the options are numeric values, i.e. of a RangeParameter, for
+  /// which some options are closer to each other than others
+  bool isOrdinal() const;
+  /// The value of option idx of a RangeParameter
+  size_t optionValue(size_t idx) const;
 
  private:
   RangeParameter* rangePtr;
@@ -103,8 +112,15 @@ class SchedulerOptionsParameters {
   std::vector<ParameterView> collectParameters();
 
   RangeParameter fusionStrategy;
-  // BoolParameter allowSkewing;
-  // BoolParameter positiveOrthant;
+  // Skewed schedules expose the wavefront parallelism of stencils.
+  BoolParameter allowSkewing;
+  BoolParameter positiveOrthant;
+  // A partition of the tensors into consecutive groups whose statements the
+  // scheduler never fuses across, bit i set starting a new group at tensor
+  // i + 1.  0 leaves the fusion to the fusion strategy.
+  RangeParameter fusionPartition;
+  // The tensors written by the statements of the TC, in order.
+  std::vector<std::string> tensors;
 };
 
 class MultiRangeParams {
@@ -151,6 +167,8 @@ class TuningConfiguration {
  private:
   void fromMappingOptions(const MappingOptionsView& options);
   void applyToMappingOptions(MappingOptionsView& options) const;
+  void fromKernelCudaMappingOptions(const CudaMappingOptions& options);
+  void applyToKernelCudaMappingOptions(CudaMappingOptions& options) const;
 
  public:
   void applyToParameters(const std::function<void(ParameterView&)>& f);
@@ -164,6 +182,9 @@ class TuningConfiguration {
   void fromCudaMappingOptions(const CudaMappingOptions& options);
   void applyToCudaMappingOptions(CudaMappingOptions& options) const;
 
+  void fromCpuMappingOptions(const CpuMappingOptions& options);
+  void applyToCpuMappingOptions(CpuMappingOptions& options) const;
+
   void addValidator(std::function<bool(const TuningConfiguration&)> v);
   bool isValid() const;
 
@@ -184,7 +205,55 @@ class TuningConfiguration {
   BoolParameter useSharedMemory;
   BoolParameter usePrivateMemory;
   BoolParameter unrollCopyShared;
+  RangeParameter vectorizeWidth;
+  // 1 keeps the row-major order of the blocks.
+  RangeParameter blockSwizzle;
+  // Instances of the outermost loop per block, 1 disables it.
+  RangeParameter batchPacking;
+  // Outer parallel loops mapped together to the first block dimension, 1
+  // disables it.
+  RangeParameter linearizeBlocks;
+  // The same thread tile size for the first two loops, 1 disables it.
+  RangeParameter threadTileSize;
+  // The same warp tile size for the first two loops, 1 disables it.
+  RangeParameter warpTileSize;
+  BoolParameter warpShuffleReductions;
+  BoolParameter gridReductions;
+  BoolParameter useTensorCores;
+  BoolParameter splitKernels;
+  BoolParameter unrollPragma;
+  BoolParameter persistentBlocks;
+  BoolParameter separateFullTiles;
+  BoolParameter asyncCopies;
+  BoolParameter transposeShared;
+  BoolParameter cooperativeKernels;
+  BoolParameter warpAggregatedAtomics;
+  BoolParameter twoDimReductions;
+  // The value of a Dp4aPacking.
+  RangeParameter dp4aPacking;
   BoolParameter matchLibraryCalls;
+  // Recompute the pointwise temporaries rather than storing them.
+  BoolParameter inlinePointwiseTemporaries;
+  // Compiler options, 0 registers lets the compiler decide.
+  RangeParameter maxRegisterCount;
+  BoolParameter useFastMath;
+  RangeParameter jitOptimizationLevel;
+  BoolParameter useLaunchBounds;
+  // Only used with launch bounds, 0 leaves it to the compiler.
+  RangeParameter minBlocksPerMultiprocessor;
+  // CPU options.  The L2 tile sizes are the tile sizes times the factor, 1
+  // disables L2 tiling.
+  RangeParameter l2TileFactor;
+  RangeParameter parallelDepth;
+  // 0 lets LLVM decide.
+  RangeParameter cpuVectorizeWidth;
+  RangeParameter prefetchDistance;
+  RangeParameter packingLevel;
+
+  // The kernel of split kernels whose options (see
+  // CudaMappingOptions::kernelOptions) the CUDA options are read from and
+  // applied to, -1 for the options of the whole TC.  Not searched.
+  int tunedKernel = -1;
 
  private:
   std::vector<std::function<bool(const TuningConfiguration&)>> validators_;
@@ -196,6 +265,10 @@ class TuningParameterFixer {
       const FusionStrategy& fs);
   TuningParameterFixer& fixIntraTileScheduleFusionStrategy(
       const FusionStrategy& fs);
+  TuningParameterFixer& fixOuterScheduleFusionPartition(size_t val);
+  // Of both the outer and the intra-tile scheduling.
+  TuningParameterFixer& fixAllowSkewing(bool val);
+  TuningParameterFixer& fixPositiveOrthant(bool val);
   TuningParameterFixer& fixFixParametersBeforeScheduling(bool val);
   TuningParameterFixer& fixUnrollFactor(size_t val);
   TuningParameterFixer& fixTilingParameters(std::vector<size_t> vals);
@@ -205,11 +278,44 @@ class TuningParameterFixer {
   TuningParameterFixer& fixUseSharedMemory(bool val);
   TuningParameterFixer& fixUsePrivateMemory(bool val);
   TuningParameterFixer& fixUnrollCopyShared(bool val);
+  TuningParameterFixer& fixVectorizeWidth(size_t val);
+  TuningParameterFixer& fixBlockSwizzle(size_t val);
+  TuningParameterFixer& fixBatchPacking(size_t val);
+  TuningParameterFixer& fixLinearizeBlocks(size_t val);
+  TuningParameterFixer& fixThreadTileSize(size_t val);
+  TuningParameterFixer& fixWarpTileSize(size_t val);
+  TuningParameterFixer& fixWarpShuffleReductions(bool val);
+  TuningParameterFixer& fixGridReductions(bool val);
+  TuningParameterFixer& fixUseTensorCores(bool val);
+  TuningParameterFixer& fixSplitKernels(bool val);
+  TuningParameterFixer& fixUnrollPragma(bool val);
+  TuningParameterFixer& fixPersistentBlocks(bool val);
+  TuningParameterFixer& fixSeparateFullTiles(bool val);
+  TuningParameterFixer& fixAsyncCopies(bool val);
+  TuningParameterFixer& fixTransposeShared(bool val);
+  TuningParameterFixer& fixCooperativeKernels(bool val);
+  TuningParameterFixer& fixWarpAggregatedAtomics(bool val);
+  TuningParameterFixer& fixTwoDimReductions(bool val);
+  TuningParameterFixer& fixDp4aPacking(Dp4aPacking val);
   TuningParameterFixer& fixMatchLibraryCalls(bool val);
+  TuningParameterFixer& fixInlinePointwiseTemporaries(bool val);
+  TuningParameterFixer& fixMaxRegisterCount(size_t val);
+  TuningParameterFixer& fixUseFastMath(bool val);
+  TuningParameterFixer& fixJitOptimizationLevel(size_t val);
+  TuningParameterFixer& fixUseLaunchBounds(bool val);
+  TuningParameterFixer& fixMinBlocksPerMultiprocessor(size_t val);
+  TuningParameterFixer& fixL2TileFactor(size_t val);
+  TuningParameterFixer& fixParallelDepth(size_t val);
+  TuningParameterFixer& fixCpuVectorizeWidth(size_t val);
+  TuningParameterFixer& fixPrefetchDistance(size_t val);
+  TuningParameterFixer& fixPackingLevel(size_t val);
 
  private:
   llvm::Optional<FusionStrategy> outerScheduleFusionStrategy;
   llvm::Optional<FusionStrategy> intraTileScheduleFusionStrategy;
+  llvm::Optional<size_t> outerScheduleFusionPartition;
+  llvm::Optional<bool> allowSkewing;
+  llvm::Optional<bool> positiveOrthant;
   llvm::Optional<bool> fixParametersBeforeScheduling;
   llvm::Optional<size_t> unrollFactor;
   llvm::Optional<std::vector<size_t>> tilingParameters;
@@ -219,7 +325,37 @@ class TuningParameterFixer {
   llvm::Optional<bool> useSharedMemory;
   llvm::Optional<bool> usePrivateMemory;
   llvm::Optional<bool> unrollCopyShared;
+  llvm::Optional<size_t> vectorizeWidth;
+  llvm::Optional<size_t> blockSwizzle;
+  llvm::Optional<size_t> batchPacking;
+  llvm::Optional<size_t> linearizeBlocks;
+  llvm::Optional<size_t> threadTileSize;
+  llvm::Optional<size_t> warpTileSize;
+  llvm::Optional<bool> warpShuffleReductions;
+  llvm::Optional<bool> gridReductions;
+  llvm::Optional<bool> useTensorCores;
+  llvm::Optional<bool> splitKernels;
+  llvm::Optional<bool> unrollPragma;
+  llvm::Optional<bool> persistentBlocks;
+  llvm::Optional<bool> separateFullTiles;
+  llvm::Optional<bool> asyncCopies;
+  llvm::Optional<bool> transposeShared;
+  llvm::Optional<bool> cooperativeKernels;
+  llvm::Optional<bool> warpAggregatedAtomics;
+  llvm::Optional<bool> twoDimReductions;
+  llvm::Optional<size_t> dp4aPacking;
   llvm::Optional<bool> matchLibraryCalls;
+  llvm::Optional<bool> inlinePointwiseTemporaries;
+  llvm::Optional<size_t> maxRegisterCount;
+  llvm::Optional<bool> useFastMath;
+  llvm::Optional<size_t> jitOptimizationLevel;
+  llvm::Optional<bool> useLaunchBounds;
+  llvm::Optional<size_t> minBlocksPerMultiprocessor;
+  llvm::Optional<size_t> l2TileFactor;
+  llvm::Optional<size_t> parallelDepth;
+  llvm::Optional<size_t> cpuVectorizeWidth;
+  llvm::Optional<size_t> prefetchDistance;
+  llvm::Optional<size_t> packingLevel;
 
   friend class TuningConfiguration;
 };
@@ -246,7 +382,9 @@ class CandidateConfiguration {
             candidate.optionalCompilationHandle
                 ? std::unique_ptr<size_t>(
                       new size_t(*candidate.optionalCompilationHandle))
-                : nullptr) {}
+                : nullptr),
+        jointCompilationHandles(candidate.jointCompilationHandles),
+        metrics(candidate.metrics) {}
 
   CandidateConfiguration& operator=(const CandidateConfiguration& candidate) {
     CandidateConfiguration tmp(candidate);
@@ -264,6 +402,11 @@ class CandidateConfiguration {
   Duration runtime;
   bool invalid;
   std::unique_ptr<size_t> optionalCompilationHandle;
+  /// Kernels compiled for the other input sets of joint tuning, in order
+  std::vector<size_t> jointCompilationHandles;
+  /// Hardware counters of the kernel, only collected for the candidates
+  /// close to the best one with --tuner_hardware_counters
+  KernelMetrics metrics;
 };
 
 } // namespace autotune
@@ -0,0 +1,631 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/search_strategy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+#include <glog/logging.h>
+
+#include "tc/autotuner/genetic_search.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+namespace {
+
+template <typename RNG>
+void restoreRngState(RNG& rng) {
+  if (FLAGS_tuner_rng_restore.empty()) {
+    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG state " << rng;
+  } else {
+    std::istringstream ss(FLAGS_tuner_rng_restore);
+    ss >> rng;
+    LOG_IF(INFO, FLAGS_debug_tuner) << "RNG restored state " << rng;
+  }
+}
+
+/// Selected option of each parameter, cheaper to build than printing conf
+std::string configurationKey(const TuningConfiguration& conf) {
+  auto copy = conf;
+  std::stringstream ss;
+  for (const auto& p : copy.collectParameters()) {
+    ss << p.selectedOption() << ",";
+  }
+  return ss.str();
+}
+
+/// Parameters that can take more than one option
+std::vector<ParameterView> tunableParameters(TuningConfiguration& conf) {
+  auto params = conf.collectParameters();
+  params.erase(
+      std::remove_if(
+          params.begin(),
+          params.end(),
+          [](const ParameterView& p) {
+            return p.isForced() or p.numberOptions() < 2;
+          }),
+      params.end());
+  return params;
+}
+
+double logRuntimeUs(Duration runtime) {
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(runtime);
+  return std::log(std::max<double>(us.count(), 1.0));
+}
+
+/// Gaussian process regression with a squared exponential kernel of unit
+/// variance on standardized targets.
+class GaussianProcess {
+ public:
+  static constexpr double kNoiseVariance = 1e-2;
+
+  GaussianProcess(
+      std::vector<std::vector<double>> features,
+      const std::vector<double>& targets,
+      double lengthScale)
+      : features_(std::move(features)), lengthScale_(lengthScale) {
+    CHECK_EQ(features_.size(), targets.size());
+    CHECK(not features_.empty());
+    auto n = features_.size();
+    mean_ = std::accumulate(targets.begin(), targets.end(), 0.0) / n;
+    double variance = 0.0;
+    for (auto t : targets) {
+      variance += (t - mean_) * (t - mean_);
+    }
+    scale_ = std::max(std::sqrt(variance / n), 1e-6);
+
+    // Cholesky factorization of the covariance of the training set
+    chol_.assign(n * n, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j <= i; ++j) {
+        auto sum = kernel(features_[i], features_[j]);
+        if (i == j) {
+          sum += kNoiseVariance;
+        }
+        for (size_t k = 0; k < j; ++k) {
+          sum -= chol_[i * n + k] * chol_[j * n + k];
+        }
+        chol_[i * n + j] =
+            i == j ? std::sqrt(std::max(sum, 1e-12)) : sum / chol_[j * n + j];
+      }
+    }
+    std::vector<double> y(n);
+    for (size_t i = 0; i < n; ++i) {
+      y[i] = (targets[i] - mean_) / scale_;
+    }
+    alpha_ = solveTransposed(solve(y));
+
+    logLikelihood_ = -0.5 * n * std::log(2 * M_PI);
+    for (size_t i = 0; i < n; ++i) {
+      logLikelihood_ -= 0.5 * y[i] * alpha_[i] + std::log(chol_[i * n + i]);
+    }
+  }
+
+  /// Mean and standard deviation of the prediction at x
+  std::pair<double, double> predict(const std::vector<double>& x) const {
+    auto n = features_.size();
+    std::vector<double> k(n);
+    for (size_t i = 0; i < n; ++i) {
+      k[i] = kernel(x, features_[i]);
+    }
+    auto mean = std::inner_product(k.begin(), k.end(), alpha_.begin(), 0.0);
+    auto v = solve(k);
+    auto variance =
+        1.0 - std::inner_product(v.begin(), v.end(), v.begin(), 0.0);
+    return std::make_pair(
+        mean_ + mean * scale_, std::sqrt(std::max(variance, 1e-12)) * scale_);
+  }
+
+  /// Log marginal likelihood of the standardized targets
+  double logLikelihood() const {
+    return logLikelihood_;
+  }
+
+ private:
+  double kernel(const std::vector<double>& a, const std::vector<double>& b)
+      const {
+    double distance = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+      distance += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return std::exp(-0.5 * distance / (lengthScale_ * lengthScale_));
+  }
+
+  /// Solves L x = b
+  std::vector<double> solve(const std::vector<double>& b) const {
+    auto n = b.size();
+    std::vector<double> x(n);
+    for (size_t i = 0; i < n; ++i) {
+      auto sum = b[i];
+      for (size_t k = 0; k < i; ++k) {
+        sum -= chol_[i * n + k] * x[k];
+      }
+      x[i] = sum / chol_[i * n + i];
+    }
+    return x;
+  }
+
+  /// Solves L^T x = b
+  std::vector<double> solveTransposed(const std::vector<double>& b) const {
+    auto n = b.size();
+    std::vector<double> x(n);
+    for (size_t i = n; i-- > 0;) {
+      auto sum = b[i];
+      for (size_t k = i + 1; k < n; ++k) {
+        sum -= chol_[k * n + i] * x[k];
+      }
+      x[i] = sum / chol_[i * n + i];
+    }
+    return x;
+  }
+
+  std::vector<std::vector<double>> features_;
+  double lengthScale_;
+  double mean_;
+  double scale_;
+  /// Row major lower triangular factor
+  std::vector<double> chol_;
+  std::vector<double> alpha_;
+  double logLikelihood_;
+};
+
+constexpr double GaussianProcess::kNoiseVariance;
+
+/// Expected improvement over best of a prediction, for minimization
+double expectedImprovement(double mean, double stddev, double best) {
+  auto z = (best - mean) / stddev;
+  auto cdf = 0.5 * std::erfc(-z / std::sqrt(2.0));
+  auto pdf = std::exp(-0.5 * z * z) / std::sqrt(2 * M_PI);
+  return (best - mean) * cdf + stddev * pdf;
+}
+
+} // namespace
+
+SearchStrategy::SearchStrategy(const TuningConfiguration& conf, size_t n)
+    : population(),
+      lastBestConf(conf),
+      kMaxPopulationSize(n),
+      rng{std::random_device{}()} {
+  restoreRngState(rng);
+}
+
+void SearchStrategy::setCostFunction(
+    CostFunction predictedCost,
+    size_t oversampling) {
+  CHECK_GE(oversampling, 1);
+  predictedCost_ = std::move(predictedCost);
+  oversampling_ = oversampling;
+}
+
+bool SearchStrategy::screening() const {
+  return predictedCost_ and oversampling_ > 1;
+}
+
+void SearchStrategy::randomize(TuningConfiguration& conf) {
+  do {
+    conf.applyToParameters([&](ParameterView& p) {
+      p.selectOption(std::uniform_int_distribution<size_t>(
+          size_t(0), p.numberOptions() - 1)(rng));
+    });
+  } while (!conf.isValid());
+}
+
+void SearchStrategy::printBest() const {
+  if (FLAGS_tuner_print_best) {
+    CudaMappingOptions options(
+        CudaMappingOptions::makeSingleThreadCudaMappingOptions());
+    lastBestConf.applyToCudaMappingOptions(options);
+    LOG(INFO) << "Best so far:\n" << options;
+  }
+}
+
+ProposalSearch::ProposalSearch(
+    const TuningConfiguration& conf,
+    const std::vector<TuningConfiguration>& startingPoints,
+    size_t n)
+    : SearchStrategy(
+          startingPoints.empty() ? conf : startingPoints.front(),
+          n) {
+  CHECK_LE(startingPoints.size(), n) << "too many predefined configurations";
+  for (const auto& c : startingPoints) {
+    population.push_back(make_unique<CandidateConfiguration>(c));
+  }
+}
+
+void ProposalSearch::fillPopulation() {
+  while (population.size() < kMaxPopulationSize) {
+    population.push_back(screenedProposal());
+  }
+}
+
+std::unique_ptr<CandidateConfiguration> ProposalSearch::screenedProposal() {
+  auto candidate = propose();
+  if (screening()) {
+    auto cost = predictedCost_(candidate);
+    for (size_t i = 1; i < oversampling_; ++i) {
+      auto other = propose();
+      auto otherCost = predictedCost_(other);
+      if (otherCost < cost) {
+        candidate = std::move(other);
+        cost = otherCost;
+      }
+    }
+  }
+  proposed(candidate);
+  return make_unique<CandidateConfiguration>(candidate);
+}
+
+bool ProposalSearch::record(const CandidateConfiguration& c) {
+  auto newBest = false;
+  if (not c.invalid) {
+    CHECK(c.runtime != Duration::zero())
+        << "valid candidates must have a recorded runtime";
+    if (c.runtime < bestRuntime_) {
+      bestRuntime_ = c.runtime;
+      lastBestConf = c.configuration;
+      newBest = true;
+    }
+  }
+  observe(c);
+  return newBest;
+}
+
+void ProposalSearch::updateParameters() {
+  for (const auto& c : population) {
+    record(*c);
+  }
+  printBest();
+  population.clear();
+  numIssued_ = 0;
+  fillPopulation();
+}
+
+std::unique_ptr<CandidateConfiguration> ProposalSearch::nextCandidate() {
+  if (numIssued_ < population.size()) {
+    return make_unique<CandidateConfiguration>(
+        population.at(numIssued_++)->configuration);
+  }
+  return screenedProposal();
+}
+
+void ProposalSearch::recordEvaluatedCandidate(
+    std::unique_ptr<CandidateConfiguration> c) {
+  CHECK(c);
+  if (record(*c)) {
+    printBest();
+  }
+}
+
+RandomSearch::RandomSearch(
+    const TuningConfiguration& conf,
+    const std::vector<TuningConfiguration>& startingPoints,
+    size_t n)
+    : ProposalSearch(conf, startingPoints, n) {
+  fillPopulation();
+}
+
+TuningConfiguration RandomSearch::propose() {
+  auto conf = lastBestConf;
+  randomize(conf);
+  return conf;
+}
+
+constexpr size_t HillClimbing::kMaxMoves;
+constexpr size_t HillClimbing::kStallFactor;
+constexpr int HillClimbing::kNeighborIterations;
+
+HillClimbing::HillClimbing(
+    const TuningConfiguration& conf,
+    const std::vector<TuningConfiguration>& startingPoints,
+    size_t n)
+    : ProposalSearch(conf, startingPoints, n),
+      startingPoints_(startingPoints),
+      current_(lastBestConf) {
+  if (startingPoints_.empty()) {
+    randomize(current_);
+  } else {
+    nextStartingPoint_ = 1;
+  }
+  maxStalled_ = std::max<size_t>(
+      kStallFactor * tunableParameters(current_).size(), 1);
+  fillPopulation();
+}
+
+TuningConfiguration HillClimbing::propose() {
+  for (int i = 0; i < kNeighborIterations; ++i) {
+    auto neighbor = current_;
+    auto params = tunableParameters(neighbor);
+    if (params.empty()) {
+      return neighbor;
+    }
+    auto numberMoves =
+        std::uniform_int_distribution<size_t>(size_t(1), kMaxMoves)(rng);
+    for (size_t move = 0; move < numberMoves; ++move) {
+      auto& p = params.at(std::uniform_int_distribution<size_t>(
+          size_t(0), params.size() - 1)(rng));
+      auto option = p.selectedOption();
+      auto up = std::bernoulli_distribution()(rng);
+      if ((up and option + 1 < p.numberOptions()) or option == 0) {
+        p.selectOption(option + 1);
+      } else {
+        p.selectOption(option - 1);
+      }
+    }
+    if (neighbor.isValid()) {
+      return neighbor;
+    }
+  }
+
+  // Stuck in a corner of the valid configurations, try elsewhere
+  restart();
+  auto conf = current_;
+  randomize(conf);
+  return conf;
+}
+
+void HillClimbing::observe(const CandidateConfiguration& c) {
+  if (not c.invalid and c.runtime < currentRuntime_) {
+    current_ = c.configuration;
+    currentRuntime_ = c.runtime;
+    numberStalled_ = 0;
+  } else if (++numberStalled_ >= maxStalled_) {
+    LOG_IF(INFO, FLAGS_debug_tuner)
+        << "[TUNER] Hill climbing stalled after " << numberStalled_
+        << " proposals, restarting";
+    restart();
+  }
+}
+
+void HillClimbing::restart() {
+  if (nextStartingPoint_ < startingPoints_.size()) {
+    current_ = startingPoints_.at(nextStartingPoint_++);
+  } else {
+    randomize(current_);
+  }
+  currentRuntime_ = Duration::max();
+  numberStalled_ = 0;
+}
+
+constexpr size_t BayesianSearch::kMinObservations;
+constexpr size_t BayesianSearch::kMaxObservations;
+constexpr size_t BayesianSearch::kAcquisitionSamples;
+
+BayesianSearch::BayesianSearch(
+    const TuningConfiguration& conf,
+    const std::vector<TuningConfiguration>& startingPoints,
+    size_t n)
+    : ProposalSearch(conf, startingPoints, n) {
+  for (const auto& c : startingPoints) {
+    seen_.insert(configurationKey(c));
+  }
+  fillPopulation();
+}
+
+namespace {
+/// Normalized option index of each parameter
+std::vector<double> parameterFeatures(const TuningConfiguration& conf) {
+  auto copy = conf;
+  std::vector<double> res;
+  for (const auto& p : copy.collectParameters()) {
+    res.push_back(
+        p.numberOptions() > 1
+            ? static_cast<double>(p.selectedOption()) / (p.numberOptions() - 1)
+            : 0.0);
+  }
+  return res;
+}
+} // namespace
+
+std::vector<BayesianSearch::Observation> BayesianSearch::trainingSet() const {
+  auto res = observations_;
+  std::sort(
+      res.begin(), res.end(), [](const Observation& a, const Observation& b) {
+        if (a.invalid != b.invalid) {
+          return b.invalid;
+        }
+        return a.logRuntime < b.logRuntime;
+      });
+  if (res.size() > kMaxObservations) {
+    res.resize(kMaxObservations);
+  }
+
+  // Invalid candidates run slower than any valid one
+  double worst = 0.0;
+  for (const auto& o : res) {
+    worst = o.invalid ? worst : std::max(worst, o.logRuntime);
+  }
+  for (auto& o : res) {
+    if (o.invalid) {
+      o.logRuntime = worst + 1.0;
+    }
+  }
+  for (const auto& p : pending_) {
+    res.push_back(p.second);
+  }
+  return res;
+}
+
+void BayesianSearch::fitLengthScale() {
+  auto training = trainingSet();
+  std::vector<std::vector<double>> x;
+  std::vector<double> y;
+  for (const auto& o : training) {
+    x.push_back(o.features);
+    y.push_back(o.logRuntime);
+  }
+  auto dims = std::sqrt(static_cast<double>(x.front().size()));
+  auto bestLikelihood = -std::numeric_limits<double>::infinity();
+  for (auto scale : {0.05, 0.1, 0.2, 0.4, 0.8, 1.6}) {
+    GaussianProcess gp(x, y, scale * dims);
+    if (gp.logLikelihood() > bestLikelihood) {
+      bestLikelihood = gp.logLikelihood();
+      lengthScale_ = scale * dims;
+    }
+  }
+  lengthScaleStale_ = false;
+}
+
+TuningConfiguration BayesianSearch::propose() {
+  size_t numberValid = std::count_if(
+      observations_.begin(),
+      observations_.end(),
+      [](const Observation& o) { return not o.invalid; });
+  auto training = trainingSet();
+  std::unique_ptr<GaussianProcess> gp;
+  if (numberValid >= kMinObservations) {
+    if (lengthScaleStale_) {
+      fitLengthScale();
+    }
+    std::vector<std::vector<double>> x;
+    std::vector<double> y;
+    for (const auto& o : training) {
+      x.push_back(o.features);
+      y.push_back(o.logRuntime);
+    }
+    gp = make_unique<GaussianProcess>(std::move(x), y, lengthScale_);
+  }
+
+  // Half of the samples are random, the others mutate the fastest
+  // observations
+  auto bestLogRuntime = training.empty() ? 0.0 : training.front().logRuntime;
+  auto numberLocal = std::min<size_t>(numberValid, kMinObservations);
+  Observation best{lastBestConf, {}, bestLogRuntime, false};
+  auto found = false;
+  double bestScore = -std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < (gp ? kAcquisitionSamples : 1); ++i) {
+    auto conf = lastBestConf;
+    if (i % 2 == 0 or numberLocal == 0) {
+      randomize(conf);
+    } else {
+      // Change one parameter of one of the fastest
+      const auto& original = training.at(i / 2 % numberLocal).configuration;
+      auto mutated = false;
+      for (int j = 0; j < HillClimbing::kNeighborIterations and not mutated;
+           ++j) {
+        conf = original;
+        auto params = tunableParameters(conf);
+        if (params.empty()) {
+          break;
+        }
+        auto& p = params.at(std::uniform_int_distribution<size_t>(
+            size_t(0), params.size() - 1)(rng));
+        p.selectOption(std::uniform_int_distribution<size_t>(
+            size_t(0), p.numberOptions() - 1)(rng));
+        mutated = conf.isValid();
+      }
+      if (not mutated) {
+        continue;
+      }
+    }
+    auto key = configurationKey(conf);
+    if (gp and seen_.count(key) > 0) {
+      continue;
+    }
+    Observation o{conf, parameterFeatures(conf), 0.0, false};
+    double score = 0.0;
+    if (gp) {
+      auto prediction = gp->predict(o.features);
+      o.logRuntime = prediction.first;
+      score = expectedImprovement(
+          prediction.first, prediction.second, bestLogRuntime);
+    }
+    if (score > bestScore) {
+      bestScore = score;
+      best = o;
+      found = true;
+    }
+  }
+
+  if (not found) {
+    // Every sample was seen already
+    randomize(best.configuration);
+    best.features = parameterFeatures(best.configuration);
+  }
+  if (gp) {
+    proposals_.emplace_back(configurationKey(best.configuration), best);
+  }
+  return best.configuration;
+}
+
+void BayesianSearch::proposed(const TuningConfiguration& conf) {
+  auto key = configurationKey(conf);
+  seen_.insert(key);
+  for (auto& p : proposals_) {
+    if (p.first == key) {
+      // Believe the prediction until the result is in
+      pending_.push_back(std::move(p));
+      break;
+    }
+  }
+  proposals_.clear();
+}
+
+void BayesianSearch::observe(const CandidateConfiguration& c) {
+  auto key = configurationKey(c.configuration);
+  seen_.insert(key);
+  auto it = std::find_if(
+      pending_.begin(),
+      pending_.end(),
+      [&key](const std::pair<std::string, Observation>& p) {
+        return p.first == key;
+      });
+  if (it != pending_.end()) {
+    pending_.erase(it);
+  }
+  observations_.push_back(Observation{
+      c.configuration,
+      parameterFeatures(c.configuration),
+      c.invalid ? 0.0 : logRuntimeUs(c.runtime),
+      c.invalid});
+  // The length scale changes slowly, only fit it from time to time
+  lengthScaleStale_ = lengthScaleStale_ or
+      observations_.size() % kMinObservations == 0;
+}
+
+std::unique_ptr<SearchStrategy> makeSearchStrategy(
+    const std::string& strategy,
+    const TuningConfiguration& conf,
+    const std::vector<TuningConfiguration>& startingPoints,
+    size_t n,
+    uint8_t crossOverRate,
+    uint8_t mutationRate,
+    size_t numberElites) {
+  if (strategy == "genetic") {
+    if (startingPoints.empty()) {
+      return make_unique<GeneticSearch>(
+          conf, n, crossOverRate, mutationRate, numberElites);
+    }
+    return make_unique<GeneticSearch>(
+        startingPoints, n, crossOverRate, mutationRate, numberElites);
+  } else if (strategy == "random") {
+    return make_unique<RandomSearch>(conf, startingPoints, n);
+  } else if (strategy == "hill_climbing") {
+    return make_unique<HillClimbing>(conf, startingPoints, n);
+  } else if (strategy == "bayesian") {
+    return make_unique<BayesianSearch>(conf, startingPoints, n);
+  }
+  throw std::invalid_argument(
+      "Unknown search strategy " + strategy +
+      ", expected genetic, random, hill_climbing or bayesian");
+}
+
+} // namespace autotune
+} // namespace tc
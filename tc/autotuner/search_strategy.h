@@ -0,0 +1,273 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "tc/autotuner/parameters.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * Interface of the searches driven by the GeneticTunerHarness. A search can
+ * be driven by generations or in steady state (see the pipelined and
+ * distributed tuning modes):
+ *
+ * generations: all candidates of population are evaluated (their runtime is
+ * recorded or they are marked invalid) before updateParameters replaces them
+ * by the next generation
+ *
+ * steady state: candidates are requested with nextCandidate and their results
+ * folded back with recordEvaluatedCandidate in any interleaving (from a single
+ * thread)
+ */
+class SearchStrategy {
+ public:
+  using Population = std::vector<std::unique_ptr<CandidateConfiguration>>;
+
+  /// conf determines the tunable parameters, the population is left empty
+  SearchStrategy(const TuningConfiguration& conf, size_t n);
+  virtual ~SearchStrategy() = default;
+
+  virtual std::string name() const = 0;
+
+  virtual void updateParameters() = 0;
+  virtual std::unique_ptr<CandidateConfiguration> nextCandidate() = 0;
+  virtual void recordEvaluatedCandidate(
+      std::unique_ptr<CandidateConfiguration> c) = 0;
+
+  /**
+   * Cheap estimate of the runtime of a configuration, lower is better.
+   */
+  using CostFunction = std::function<double(const TuningConfiguration&)>;
+
+  /**
+   * Screen new candidates with a surrogate of their runtime: oversampling
+   * times as many candidates are produced as there are to evaluate, and only
+   * those with the lowest predicted cost are kept. A null function or an
+   * oversampling of 1 disables screening.
+   */
+  void setCostFunction(CostFunction predictedCost, size_t oversampling);
+
+ protected:
+  bool screening() const;
+  /// Selects random options for all parameters, until conf is valid
+  void randomize(TuningConfiguration& conf);
+  /// Log lastBestConf if FLAGS_tuner_print_best
+  void printBest() const;
+
+ public:
+  Population population;
+  TuningConfiguration lastBestConf;
+  const size_t kMaxPopulationSize;
+
+  /*
+   * c++11 seeding is (apparently) not of the highest quality:
+   * http://www.pcg-random.org/posts/cpp-seeding-surprises.html
+   * pcg-cpp seems like a good alternative:
+   * https://www.johndcook.com/blog/2017/08/14/testing-rngs-with-practrand/
+   * http://www.pcg-random.org/posts/pcg-passes-practrand.html
+   */
+  mutable std::mt19937_64 rng;
+
+ protected:
+  CostFunction predictedCost_;
+  size_t oversampling_ = 1;
+};
+
+/**
+ * Searches that produce one candidate at a time from the results observed so
+ * far. Generations are made of candidates proposed in a row (the results of a
+ * generation are observed all at once in updateParameters), the first one
+ * consists of the starting points followed by proposals.
+ */
+class ProposalSearch : public SearchStrategy {
+ public:
+  ProposalSearch(
+      const TuningConfiguration& conf,
+      const std::vector<TuningConfiguration>& startingPoints,
+      size_t n);
+
+  void updateParameters() override;
+  std::unique_ptr<CandidateConfiguration> nextCandidate() override;
+  void recordEvaluatedCandidate(
+      std::unique_ptr<CandidateConfiguration> c) override;
+
+ protected:
+  /// New valid candidate to evaluate
+  virtual TuningConfiguration propose() = 0;
+  /// Called with each proposal handed out, after screening
+  virtual void proposed(const TuningConfiguration&) {}
+  /// Called once with each evaluated candidate (valid or not) in the order
+  /// they are recorded
+  virtual void observe(const CandidateConfiguration& c) = 0;
+
+  /// Fills the population up to kMaxPopulationSize with proposals, must be
+  /// called by the constructors of the derived classes
+  void fillPopulation();
+
+ private:
+  /// Proposal with the lowest predicted cost out of oversampling_ if
+  /// screening
+  std::unique_ptr<CandidateConfiguration> screenedProposal();
+  /// Observes c, returns true if it is the fastest so far
+  bool record(const CandidateConfiguration& c);
+
+  /// Number of candidates of the current population handed out by
+  /// nextCandidate
+  size_t numIssued_ = 0;
+  Duration bestRuntime_ = Duration::max();
+};
+
+/// Uniformly random valid configurations
+class RandomSearch : public ProposalSearch {
+ public:
+  RandomSearch(
+      const TuningConfiguration& conf,
+      const std::vector<TuningConfiguration>& startingPoints,
+      size_t n);
+
+  std::string name() const override {
+    return "random";
+  }
+
+ protected:
+  TuningConfiguration propose() override;
+  void observe(const CandidateConfiguration&) override {}
+};
+
+/**
+ * Stochastic hill climbing: proposals are neighbors of the current
+ * configuration, which differ from it by one step in the options of up to
+ * kMaxMoves parameters. The current configuration moves to any faster
+ * neighbor. After kStallFactor proposals per tunable parameter without
+ * improvement, the search restarts from the next starting point or, once all
+ * were climbed from, from a random configuration.
+ */
+class HillClimbing : public ProposalSearch {
+ public:
+  HillClimbing(
+      const TuningConfiguration& conf,
+      const std::vector<TuningConfiguration>& startingPoints,
+      size_t n);
+
+  std::string name() const override {
+    return "hill_climbing";
+  }
+
+  static constexpr size_t kMaxMoves = 2;
+  static constexpr size_t kStallFactor = 2;
+  static constexpr int kNeighborIterations = 1000;
+
+ protected:
+  TuningConfiguration propose() override;
+  void observe(const CandidateConfiguration& c) override;
+
+ private:
+  void restart();
+
+  std::vector<TuningConfiguration> startingPoints_;
+  size_t nextStartingPoint_ = 0;
+  TuningConfiguration current_;
+  Duration currentRuntime_ = Duration::max();
+  size_t numberStalled_ = 0;
+  size_t maxStalled_;
+};
+
+/**
+ * Bayesian optimization: a Gaussian process with a squared exponential kernel
+ * models the logarithm of the runtime as a function of the normalized option
+ * indices of the parameters (invalid candidates count as slower than any
+ * valid one). Each proposal maximizes the expected improvement over the
+ * fastest runtime among kAcquisitionSamples random and mutated
+ * configurations. Candidates handed out but not observed yet are assumed to
+ * run as fast as predicted (kriging believer), which spreads out the
+ * proposals of a generation. Proposals are random until kMinObservations
+ * valid candidates were observed.
+ */
+class BayesianSearch : public ProposalSearch {
+ public:
+  BayesianSearch(
+      const TuningConfiguration& conf,
+      const std::vector<TuningConfiguration>& startingPoints,
+      size_t n);
+
+  std::string name() const override {
+    return "bayesian";
+  }
+
+  static constexpr size_t kMinObservations = 8;
+  /// The model is fit on the best observations only
+  static constexpr size_t kMaxObservations = 128;
+  static constexpr size_t kAcquisitionSamples = 256;
+
+ protected:
+  TuningConfiguration propose() override;
+  void proposed(const TuningConfiguration& conf) override;
+  void observe(const CandidateConfiguration& c) override;
+
+ private:
+  struct Observation {
+    TuningConfiguration configuration;
+    std::vector<double> features;
+    /// Logarithm of the runtime in us, unused for invalid candidates
+    double logRuntime;
+    bool invalid;
+  };
+
+  /// Chooses the kernel length scale of the observations by maximum
+  /// likelihood, every kMinObservations observations
+  void fitLengthScale();
+  /// Real observations, fastest first and invalid last, followed by the
+  /// believed pending ones
+  std::vector<Observation> trainingSet() const;
+
+  std::vector<Observation> observations_;
+  /// Handed out candidates waiting for their result, with their believed
+  /// log runtime
+  std::vector<std::pair<std::string, Observation>> pending_;
+  /// Proposals since the last one handed out
+  std::vector<std::pair<std::string, Observation>> proposals_;
+  /// Candidates proposed so far, not proposed again
+  std::unordered_set<std::string> seen_;
+  double lengthScale_ = 0.0;
+  bool lengthScaleStale_ = true;
+};
+
+/**
+ * Builds the search named by strategy (genetic, random, hill_climbing or
+ * bayesian), throws std::invalid_argument for other names. conf determines
+ * the tunable parameters, startingPoints (possibly empty) seed the first
+ * generation. The genetic parameters are ignored by the other searches.
+ */
+std::unique_ptr<SearchStrategy> makeSearchStrategy(
+    const std::string& strategy,
+    const TuningConfiguration& conf,
+    const std::vector<TuningConfiguration>& startingPoints,
+    size_t n,
+    uint8_t crossOverRate,
+    uint8_t mutationRate,
+    size_t numberElites);
+
+} // namespace autotune
+} // namespace tc
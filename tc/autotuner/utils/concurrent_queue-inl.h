@@ -15,14 +15,22 @@
  */
 #pragma once
 
+#include <glog/logging.h>
+
 namespace tc {
 namespace autotune {
 
+template <typename T>
+ConcurrentQueue<T>::ConcurrentQueue(size_t capacity) : capacity_(capacity) {
+  CHECK_GT(capacity_, 0) << "A ConcurrentQueue must be able to hold elements";
+}
+
 template <typename T>
 void ConcurrentQueue<T>::enqueue(T t) {
   {
-    std::lock_guard<std::mutex> lock(mtx_);
-    queue_.push(t);
+    std::unique_lock<std::mutex> lock(mtx_);
+    notFullCv_.wait(lock, [&]() { return queue_.size() < capacity_; });
+    queue_.push(std::move(t));
   }
   cv_.notify_one();
 }
@@ -33,10 +41,12 @@ T ConcurrentQueue<T>::dequeueWaitFor(std::chrono::steady_clock::duration d) {
   auto hasElements =
       cv_.wait_for(lock, d, [&]() { return not queue_.empty(); });
   if (not hasElements) {
-    return nullptr;
+    return T();
   }
-  auto t = queue_.front();
+  auto t = std::move(queue_.front());
   queue_.pop();
+  lock.unlock();
+  notFullCv_.notify_one();
   return t;
 }
 
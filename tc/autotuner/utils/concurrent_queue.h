@@ -15,7 +15,10 @@
  */
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <queue>
 #include <type_traits>
 
@@ -26,18 +29,33 @@ namespace autotune {
  * A basic concurrent queue synchronized with a lock.
  * We will never need a more intricate implementation for anything related to
  * compilation and autotuning.
+ *
+ * The queue can be bounded by a capacity, in which case enqueue blocks until
+ * a consumer makes room. This provides back pressure between the stages of
+ * the autotuning pipeline. Elements are moved in and out so that move-only
+ * types (e.g. std::unique_ptr) can be queued.
  */
 template <typename T>
 class ConcurrentQueue {
  public:
+  explicit ConcurrentQueue(
+      size_t capacity = std::numeric_limits<size_t>::max());
+
   void enqueue(T t);
+  /// Returns a default constructed T (nullptr for pointer types) if nothing
+  /// was enqueued within the given duration.
   T dequeueWaitFor(std::chrono::steady_clock::duration);
   bool empty() const;
   size_t size() const;
+  size_t capacity() const {
+    return capacity_;
+  }
 
  private:
+  const size_t capacity_;
   mutable std::mutex mtx_;
   std::condition_variable cv_;
+  std::condition_variable notFullCv_;
   std::queue<T> queue_;
 };
 
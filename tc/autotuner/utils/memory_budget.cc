@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/utils/memory_budget.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include <glog/logging.h>
+
+#include "tc/core/flags.h"
+
+namespace tc {
+namespace autotune {
+
+namespace {
+constexpr auto kSamplingPeriod = std::chrono::milliseconds(10);
+// The number of last compilations the estimate is the largest growth of.
+constexpr size_t kHistorySize = 16;
+
+size_t largest(const std::deque<size_t>& history) {
+  return history.empty() ? 0
+                         : *std::max_element(history.begin(), history.end());
+}
+} // namespace
+
+MemoryBudget::MemoryBudget(size_t budgetBytes) : budgetBytes_(budgetBytes) {
+  if (budgetBytes_ == 0) {
+    return;
+  }
+  if (residentBytes() == 0) {
+    LOG(WARNING) << "[TUNER] cannot read the resident memory, "
+                 << "compilations are not bounded by the memory budget";
+    return;
+  }
+  sampler_ = std::thread([this]() { sample(); });
+}
+
+MemoryBudget::~MemoryBudget() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (sampler_.joinable()) {
+    sampler_.join();
+  }
+}
+
+MemoryBudget& MemoryBudget::compilations() {
+  static MemoryBudget budget(FLAGS_tuner_compile_memory_budget_mb << 20);
+  return budget;
+}
+
+size_t MemoryBudget::residentBytes() {
+  // The second field of statm is the number of resident pages.
+  std::ifstream statm("/proc/self/statm");
+  size_t size, resident;
+  if (not(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+bool MemoryBudget::fits(size_t resident) const {
+  if (jobs_.empty()) {
+    return true;
+  }
+  if (history_.empty()) {
+    return false;
+  }
+  auto estimate = largest(history_);
+  // The running jobs may still grow up to the estimate.
+  size_t reserved = 0;
+  for (const auto& job : jobs_) {
+    auto growth = job.peakBytes - job.startBytes;
+    reserved += growth < estimate ? estimate - growth : 0;
+  }
+  return resident + reserved + estimate <= budgetBytes_;
+}
+
+std::unique_ptr<MemoryBudget::Admission> MemoryBudget::admit() {
+  if (not sampler_.joinable()) {
+    return std::unique_ptr<Admission>(new Admission(nullptr, 0));
+  }
+  std::unique_lock<std::mutex> lock(mtx_);
+  auto resident = residentBytes();
+  while (not fits(resident)) {
+    cv_.wait_for(lock, kSamplingPeriod);
+    resident = residentBytes();
+  }
+  auto id = nextId_++;
+  jobs_.push_back(Job{id, resident, resident, 0, 0});
+  return std::unique_ptr<Admission>(new Admission(this, id));
+}
+
+MemoryBudget::Admission::~Admission() {
+  if (budget_) {
+    budget_->release(id_);
+  }
+}
+
+void MemoryBudget::release(size_t id) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto job = std::find_if(jobs_.begin(), jobs_.end(), [id](const Job& j) {
+      return j.id == id;
+    });
+    CHECK(job != jobs_.end()) << "released an unknown compilation";
+    // Also a sample of the jobs shorter than the sampling period.
+    job->peakBytes = std::max(job->peakBytes, residentBytes());
+    job->concurrencySum += jobs_.size();
+    ++job->samples;
+    auto growth = job->peakBytes - job->startBytes;
+    // The growth of the process while the job ran is that of all the jobs
+    // running then, the job gets its share of it.
+    growth = growth * job->samples / job->concurrencySum;
+    history_.push_back(growth);
+    if (history_.size() > kHistorySize) {
+      history_.pop_front();
+    }
+    jobs_.erase(job);
+  }
+  cv_.notify_all();
+}
+
+size_t MemoryBudget::estimate() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return largest(history_);
+}
+
+size_t MemoryBudget::running() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return jobs_.size();
+}
+
+void MemoryBudget::sample() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (not stopping_) {
+    if (not jobs_.empty()) {
+      auto resident = residentBytes();
+      for (auto& job : jobs_) {
+        job.peakBytes = std::max(job.peakBytes, resident);
+        job.concurrencySum += jobs_.size();
+        ++job.samples;
+      }
+    }
+    cv_.wait_for(lock, kSamplingPeriod);
+  }
+}
+
+} // namespace autotune
+} // namespace tc
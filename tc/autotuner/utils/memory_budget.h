@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tc {
+namespace autotune {
+
+/**
+ * Admission of the compilations of a process under a bound on its resident
+ * memory, so that as many compilation threads as cores can run on hosts
+ * that do not have the memory for as many concurrent scheduling and
+ * promotion problems of a large TC.
+ * The peak memory of a compilation is estimated from the growth of the
+ * resident memory, sampled while the last compilations ran and shared
+ * between the compilations running at the same time.  A compilation starts
+ * when the current resident memory, the remaining growth expected from the
+ * running compilations and its own estimate fit in the budget.  Until a
+ * compilation has completed, or when the budget is exceeded anyway,
+ * compilations run one at a time: a single compilation is always admitted.
+ */
+class MemoryBudget {
+ public:
+  /// Admits everything if budgetBytes is 0.
+  explicit MemoryBudget(size_t budgetBytes);
+  ~MemoryBudget();
+
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  /// The budget of --tuner_compile_memory_budget_mb, shared by the
+  /// compilations of the tuning threads of the process.
+  static MemoryBudget& compilations();
+
+  /// Releases its admission on destruction.
+  class Admission {
+   public:
+    ~Admission();
+
+   private:
+    friend class MemoryBudget;
+    Admission(MemoryBudget* budget, size_t id) : budget_(budget), id_(id) {}
+
+    MemoryBudget* budget_;
+    size_t id_;
+  };
+
+  /// Blocks until a compilation fits in the budget.
+  std::unique_ptr<Admission> admit();
+
+  /// Estimated peak growth of the resident memory of a compilation, 0 until
+  /// a compilation has completed.
+  size_t estimate() const;
+
+  /// Number of compilations admitted and not yet released.
+  size_t running() const;
+
+  /// The resident memory of the process, 0 if unknown.
+  static size_t residentBytes();
+
+ private:
+  struct Job {
+    size_t id;
+    size_t startBytes;
+    size_t peakBytes;
+    // For the share of the growth while other jobs run.
+    size_t concurrencySum;
+    size_t samples;
+  };
+
+  // Must be called with mtx_ held.
+  bool fits(size_t resident) const;
+  void release(size_t id);
+  // Samples the resident memory into the running jobs until destruction.
+  void sample();
+
+  const size_t budgetBytes_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<Job> jobs_;
+  size_t nextId_ = 0;
+  // The growths of the last jobs, attributed to each by its share of the
+  // concurrency.
+  std::deque<size_t> history_;
+  bool stopping_ = false;
+  std::thread sampler_;
+};
+
+} // namespace autotune
+} // namespace tc
@@ -17,98 +17,121 @@
 
 #include <algorithm>
 #include <sstream>
+#include <vector>
 
 #include <glog/stl_logging.h>
 
+#include "tc/autotuner/utils/resource_model.h"
 #include "tc/core/flags.h"
+#include "tc/core/utils/time.h"
 
 using namespace tc;
 using namespace autotune;
 
-void Printer::record(Duration runtime) {
-  std::lock_guard<std::mutex> lock(runtimesMtx_);
-  runtimes_.push_back(runtime);
-}
-
 namespace {
-uint64_t toMicroseconds(const Duration& d) {
-  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+int64_t now() {
+  return std::chrono::steady_clock::now().time_since_epoch().count();
 }
 } // namespace
 
-void Printer::printLoop() {
-  while (true) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+void Printer::record(Duration runtime) {
+  auto pos = numRuntimes_.fetch_add(1);
+  if (pos < total_) {
+    // Measured runtimes are never 0, which marks the slots still empty
+    runtimes_[pos].store(
+        std::max<uint64_t>(1, toMicroseconds<uint64_t>(runtime)));
+  }
+  tick();
+}
 
-    std::stringstream ss;
-    ss << "Generation " << generation_;
-    ss << "\tJobs(Compiled, GPU)/total  ("
-       << std::min(total_, currentCompilationJob_.load()) << ", "
-       << std::min(total_, numEvaluations_.load()) << ")/" << total_;
+void Printer::tick() {
+  auto last = lastPrint_.load();
+  auto current = now();
+  auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::seconds(1))
+                    .count();
+  // A single thread wins the refresh.
+  if (current - last < period or stopped_.load() or
+      not lastPrint_.compare_exchange_strong(last, current)) {
+    return;
+  }
+  print(false);
+}
 
-    {
-      std::lock_guard<std::mutex> lock(runtimesMtx_);
-      if (not runtimes_.empty()) {
-        std::sort(runtimes_.begin(), runtimes_.end());
-        auto best = toMicroseconds(runtimes_.front());
-        auto median = toMicroseconds(runtimes_.at(runtimes_.size() / 2));
-        auto worst = toMicroseconds(runtimes_.back());
-        ss << "   (best/median/worst)us: " << best << '/' << median << '/'
-           << worst;
-      }
-    }
-    // XXX: platform specific erase current line and move cursor to begining
-    // of line. Currently works with python/C++ both.
-    std::cout << "\u001b[2K\r" << ss.str() << std::flush;
-    LOG_IF(INFO, FLAGS_debug_tuner) << "\u001b[2K\r" << ss.str() << std::endl;
+void Printer::print(bool last) {
+  std::stringstream ss;
+  ss << "Generation " << generation_;
+  ss << "\tJobs(Compiled, GPU)/total  ("
+     << std::min(total_, currentCompilationJob_.load()) << ", "
+     << std::min(total_, numEvaluations_.load()) << ")/" << total_;
+  auto numPruned = staticPruningStats_.total();
+  if (numPruned > 0) {
+    ss << "   pruned before compilation: " << numPruned;
+  }
 
-    if (stopPrinting_.load()) {
-      // Print one more time to flush
-      // XXX: platform specific erase current line and move cursor to begining
-      // of line. Currently works with python/C++ both.
-      std::cout << "\u001b[2K\r" << ss.str() << std::flush;
-      LOG_IF(INFO, FLAGS_debug_tuner) << "\u001b[2K\r" << ss.str() << std::endl;
-      // commit line so it does not get erased at the next iteration
-      std::cerr << std::endl;
-      return;
+  std::vector<uint64_t> runtimes;
+  auto n = std::min(total_, numRuntimes_.load());
+  runtimes.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto r = runtimes_[i].load();
+    if (r != 0) {
+      runtimes.push_back(r);
     }
   }
+  if (not runtimes.empty()) {
+    std::sort(runtimes.begin(), runtimes.end());
+    ss << "   (best/median/worst)us: " << runtimes.front() << '/'
+       << runtimes.at(runtimes.size() / 2) << '/' << runtimes.back();
+  }
+  // XXX: platform specific erase current line and move cursor to begining
+  // of line. Currently works with python/C++ both.
+  std::cout << "\u001b[2K\r" << ss.str() << std::flush;
+  LOG_IF(INFO, FLAGS_debug_tuner) << "\u001b[2K\r" << ss.str() << std::endl;
+  if (last) {
+    // commit line so it does not get erased at the next iteration
+    std::cerr << std::endl;
+  }
 }
 
 Printer::Printer(
     size_t generation,
     size_t total,
     const std::atomic_size_t& currentCompilationJob,
-    const std::atomic_size_t& numEvaluations)
+    const std::atomic_size_t& numEvaluations,
+    const StaticPruningStats& staticPruningStats)
     : generation_(generation),
-      printerThread_([this]() { printLoop(); }),
+      runtimes_(new std::atomic<uint64_t>[total]),
+      lastPrint_(now()),
       total_(total),
       currentCompilationJob_(currentCompilationJob),
-      numEvaluations_(numEvaluations) {}
+      numEvaluations_(numEvaluations),
+      staticPruningStats_(staticPruningStats) {
+  for (size_t i = 0; i < total_; ++i) {
+    runtimes_[i].store(0);
+  }
+}
 
 Printer::~Printer() {
   stop();
-  printerThread_.join();
 }
 
 void Printer::stop() {
-  stopPrinting_.store(true);
+  if (not stopped_.exchange(true)) {
+    print(true);
+  }
 }
 
 void Printer::printAll() {
-  auto runtimes = [this]() {
-    std::lock_guard<std::mutex> lock(runtimesMtx_);
-    std::sort(runtimes_.begin(), runtimes_.end());
-    std::vector<uint64_t> runtimes;
-    runtimes.reserve(runtimes_.size());
-    std::transform(
-        runtimes_.begin(),
-        runtimes_.end(),
-        std::back_inserter(runtimes),
-        toMicroseconds);
-    return runtimes;
-  }();
+  std::vector<uint64_t> runtimes;
+  auto n = std::min(total_, numRuntimes_.load());
+  for (size_t i = 0; i < n; ++i) {
+    runtimes.push_back(runtimes_[i].load());
+  }
+  std::sort(runtimes.begin(), runtimes.end());
   LOG_IF(INFO, FLAGS_debug_tuner)
       << "\n [TUNER][GENERATION LOG] median times of each candidate (in us) "
       << runtimes << std::endl;
+  LOG_IF(INFO, FLAGS_debug_tuner)
+      << "[TUNER][GENERATION LOG] candidates pruned before compilation "
+      << staticPruningStats_.toString() << std::endl;
 }
@@ -16,9 +16,10 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
-#include <mutex>
-#include <thread>
+#include <memory>
 
 #include <glog/logging.h>
 
@@ -27,36 +28,51 @@
 namespace tc {
 namespace autotune {
 
+struct StaticPruningStats;
+
 /**
- * Helper class to pretty print autotuning progress
+ * Helper class to pretty print autotuning progress.
+ *
+ * There is no printing thread: the progress line is refreshed at most once
+ * per second by the threads calling record or tick, whichever comes first,
+ * and a last time by stop. Recording does not lock.
  */
 class Printer {
  public:
+  /// total is the number of candidates of the generation, at most that many
+  /// runtimes are recorded
   Printer(
       size_t generation,
       size_t total,
       const std::atomic_size_t& currentCompilationJob,
-      const std::atomic_size_t& numEvaluations);
+      const std::atomic_size_t& numEvaluations,
+      const StaticPruningStats& staticPruningStats);
   ~Printer();
 
   void record(Duration runtime);
+  /// Refresh the progress line if the last refresh is older than a second
+  void tick();
   void stop();
 
+  /// Must not be called concurrently with record
   void printAll();
 
  private:
-  void printLoop();
+  void print(bool last);
 
   size_t generation_;
-  std::vector<Duration> runtimes_;
-  mutable std::mutex runtimesMtx_;
+  /// Microseconds, 0 for the slots not written yet
+  std::unique_ptr<std::atomic<uint64_t>[]> runtimes_;
+  std::atomic_size_t numRuntimes_{0};
 
-  std::atomic_bool stopPrinting_{false};
-  std::thread printerThread_;
+  std::atomic_bool stopped_{false};
+  /// steady_clock ticks of the last refresh
+  std::atomic<int64_t> lastPrint_;
 
   const size_t total_;
   const std::atomic_size_t& currentCompilationJob_;
   const std::atomic_size_t& numEvaluations_;
+  const StaticPruningStats& staticPruningStats_;
 };
 
 } // namespace autotune
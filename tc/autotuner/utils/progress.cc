@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/utils/progress.h"
+
+#include <algorithm>
+
+namespace tc {
+namespace autotune {
+
+constexpr size_t TuningProgress::kNumBuckets;
+
+namespace {
+int64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+void TuningProgress::Worker::recordEvaluation(
+    Duration busy,
+    bool valid,
+    Duration runtime) {
+  evaluated_.fetch_add(1, std::memory_order_relaxed);
+  busyUs_.fetch_add(toMicroseconds<uint64_t>(busy), std::memory_order_relaxed);
+  if (not valid) {
+    return;
+  }
+  valid_.fetch_add(1, std::memory_order_relaxed);
+  auto us = toMicroseconds<uint64_t>(runtime);
+  // Single writer, no need to loop
+  if (us < bestUs_.load(std::memory_order_relaxed)) {
+    bestUs_.store(us, std::memory_order_relaxed);
+  }
+  size_t bucket = 0;
+  while (us > 0 and bucket + 1 < kNumBuckets) {
+    us >>= 1;
+    ++bucket;
+  }
+  histogram_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void TuningProgress::start(size_t compilationThreads) {
+  std::lock_guard<std::mutex> lock(workersMutex_);
+  workers_.clear();
+  startUs_ = nowUs();
+  compilationThreads_ = std::max<size_t>(1, compilationThreads);
+  generation_ = 0;
+  compiled_ = 0;
+  compileBusyUs_ = 0;
+}
+
+void TuningProgress::setGeneration(size_t generation) {
+  generation_ = generation;
+}
+
+TuningProgress::Worker& TuningProgress::worker(const std::string& name) {
+  std::lock_guard<std::mutex> lock(workersMutex_);
+  for (auto& w : workers_) {
+    if (w.name == name) {
+      return w;
+    }
+  }
+  workers_.emplace_back(name);
+  return workers_.back();
+}
+
+void TuningProgress::recordCompilation(Duration busy) {
+  compiled_.fetch_add(1, std::memory_order_relaxed);
+  compileBusyUs_.fetch_add(
+      toMicroseconds<uint64_t>(busy), std::memory_order_relaxed);
+}
+
+TuningProgress::Snapshot TuningProgress::snapshot() const {
+  Snapshot res;
+  auto start = startUs_.load();
+  auto elapsedUs = start == 0 ? 0 : std::max<int64_t>(0, nowUs() - start);
+  res.generation = generation_;
+  res.elapsed = std::chrono::microseconds(elapsedUs);
+  res.compiled = compiled_;
+  if (elapsedUs > 0) {
+    res.compileUtilization = static_cast<double>(compileBusyUs_) /
+        (elapsedUs * compilationThreads_);
+  }
+
+  std::lock_guard<std::mutex> lock(workersMutex_);
+  uint64_t bestUs = UINT64_MAX;
+  for (const auto& w : workers_) {
+    WorkerProgress p;
+    p.name = w.name;
+    p.evaluated = w.evaluated_.load(std::memory_order_relaxed);
+    p.valid = w.valid_.load(std::memory_order_relaxed);
+    auto busyUs = w.busyUs_.load(std::memory_order_relaxed);
+    p.busy = std::chrono::microseconds(busyUs);
+    p.utilization =
+        elapsedUs > 0 ? static_cast<double>(busyUs) / elapsedUs : 0.0;
+    res.evaluated += p.evaluated;
+    res.valid += p.valid;
+    bestUs = std::min(bestUs, w.bestUs_.load(std::memory_order_relaxed));
+    for (size_t b = 0; b < kNumBuckets; ++b) {
+      res.histogram[b] += w.histogram_[b].load(std::memory_order_relaxed);
+    }
+    res.workers.push_back(std::move(p));
+  }
+  if (bestUs != UINT64_MAX) {
+    res.best = std::chrono::microseconds(bestUs);
+  }
+  if (elapsedUs > 0) {
+    res.candidatesPerSecond = res.evaluated * 1e6 / elapsedUs;
+  }
+  return res;
+}
+
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tc/core/utils/time.h"
+
+namespace tc {
+namespace autotune {
+
+/**
+ * Progress of a tuning run: the compilations and the evaluations of the
+ * candidates, counted without locks by the threads doing the work and
+ * aggregated on demand, e.g. by another thread while the tuning runs.
+ */
+class TuningProgress {
+ public:
+  /// Runtimes are counted in buckets of powers of 2 us: bucket 0 holds the
+  /// runtimes under 1us, bucket i those in [2^(i-1), 2^i)us and the last
+  /// bucket all the longer ones.
+  static constexpr size_t kNumBuckets = 24;
+
+  /// Counters of a thread evaluating candidates, e.g. on a GPU or on a
+  /// remote worker. Updated by that thread only.
+  class Worker {
+   public:
+    explicit Worker(std::string name) : name(std::move(name)) {}
+
+    /// busy is the time spent evaluating, runtime is ignored for invalid
+    /// candidates.
+    void recordEvaluation(Duration busy, bool valid, Duration runtime);
+
+    const std::string name;
+
+   private:
+    friend class TuningProgress;
+    std::atomic<uint64_t> evaluated_{0};
+    std::atomic<uint64_t> valid_{0};
+    std::atomic<uint64_t> busyUs_{0};
+    std::atomic<uint64_t> bestUs_{UINT64_MAX};
+    std::array<std::atomic<uint64_t>, kNumBuckets> histogram_{};
+  };
+
+  struct WorkerProgress {
+    std::string name;
+    size_t evaluated;
+    size_t valid;
+    Duration busy;
+    /// Fraction of the elapsed time spent evaluating candidates
+    double utilization;
+  };
+
+  struct Snapshot {
+    size_t generation = 0;
+    Duration elapsed = Duration::zero();
+    size_t compiled = 0;
+    /// Of all the workers, valid or not
+    size_t evaluated = 0;
+    size_t valid = 0;
+    double candidatesPerSecond = 0;
+    /// Fraction of the time of the compilation threads spent compiling
+    double compileUtilization = 0;
+    std::vector<WorkerProgress> workers;
+    /// Duration::max() before the first valid candidate
+    Duration best = Duration::max();
+    std::array<size_t, kNumBuckets> histogram{};
+  };
+
+  /// Resets the counters, the elapsed time counts from now on.
+  void start(size_t compilationThreads);
+  void setGeneration(size_t generation);
+
+  /// The worker of the given name, created on first use. The reference
+  /// stays valid as long as the progress.
+  Worker& worker(const std::string& name);
+
+  void recordCompilation(Duration busy);
+
+  Snapshot snapshot() const;
+
+ private:
+  std::atomic<int64_t> startUs_{0};
+  std::atomic<size_t> compilationThreads_{1};
+  std::atomic<size_t> generation_{0};
+  std::atomic<uint64_t> compiled_{0};
+  std::atomic<uint64_t> compileBusyUs_{0};
+
+  /// Only guards the creation and the traversal of the workers.
+  mutable std::mutex workersMutex_;
+  std::deque<Worker> workers_;
+};
+
+} // namespace autotune
+} // namespace tc
@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/autotuner/utils/resource_model.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include "tc/core/cuda/cuda_mapping_options_cpp_printer.h"
+#include "tc/core/flags.h"
+#include "tc/core/gpu.h"
+#include "tc/core/polyhedral/cuda/mapping_types.h"
+
+namespace tc {
+namespace autotune {
+
+constexpr size_t KernelResources::kBaseRegistersPerThread;
+
+namespace {
+// Architectural limit of the number of registers of a thread, kernels
+// needing more spill to local memory.
+constexpr size_t kMaxRegistersPerThread = 255;
+
+size_t roundUp(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+// Registers the compiler allocates to each thread, at most as many as let
+// the requested minimal number of blocks reside on a multiprocessor.
+size_t allocatedRegistersPerThread(
+    const KernelResources& resources,
+    const CudaMultiprocessorLimits& limits) {
+  if (resources.minBlocksPerMultiprocessor == 0 or
+      resources.threadsPerBlock == 0) {
+    return resources.registersPerThread;
+  }
+  auto threads = roundUp(resources.threadsPerBlock, limits.warpSize) *
+      resources.minBlocksPerMultiprocessor;
+  return std::min(
+      resources.registersPerThread,
+      std::max(limits.registers / threads, static_cast<size_t>(1)));
+}
+} // namespace
+
+KernelResources KernelResources::estimate(const CudaTcExecutor& executor) {
+  USING_MAPPING_SHORT_NAMES(BX, BY, BZ, TX, TY, TZ);
+  const auto& block = executor.block;
+  KernelResources resources;
+  resources.threadsPerBlock =
+      TX.mappingSize(block) * TY.mappingSize(block) * TZ.mappingSize(block);
+  resources.sharedMemoryPerBlock = executor.sharedMemoryFootprint;
+  resources.registersPerThread = kBaseRegistersPerThread +
+      (executor.privateMemoryFootprint + sizeof(uint32_t) - 1) /
+          sizeof(uint32_t);
+  // The compiler spills rather than exceeding the requested count.
+  const auto& compilerOptions =
+      CudaMappingOptions(executor.options).proto().compiler_options();
+  auto maxRegisterCount = compilerOptions.max_register_count();
+  if (maxRegisterCount > 0) {
+    resources.registersPerThread = std::min(
+        resources.registersPerThread, static_cast<size_t>(maxRegisterCount));
+  }
+  if (compilerOptions.use_launch_bounds()) {
+    resources.minBlocksPerMultiprocessor =
+        compilerOptions.min_blocks_per_multiprocessor();
+  }
+  return resources;
+}
+
+double estimateOccupancy(
+    const KernelResources& resources,
+    const CudaMultiprocessorLimits& limits) {
+  if (limits.maxThreads == 0 or resources.threadsPerBlock == 0) {
+    return 0.0;
+  }
+  // Resources are allocated per warp
+  auto threads = roundUp(resources.threadsPerBlock, limits.warpSize);
+  auto blocks = std::min(limits.maxBlocks, limits.maxThreads / threads);
+  auto registers = allocatedRegistersPerThread(resources, limits);
+  if (registers > 0) {
+    blocks = std::min(blocks, limits.registers / (registers * threads));
+  }
+  if (resources.sharedMemoryPerBlock > 0) {
+    blocks =
+        std::min(blocks, limits.sharedMemory / resources.sharedMemoryPerBlock);
+  }
+  return static_cast<double>(blocks * threads) / limits.maxThreads;
+}
+
+PruningReason staticallyPrune(
+    const KernelResources& resources,
+    const CudaMultiprocessorLimits& limits,
+    size_t sharedMemoryLimit,
+    double minOccupancy) {
+  if (limits.maxThreads == 0) {
+    return PruningReason::None;
+  }
+  if (resources.threadsPerBlock > limits.maxThreadsPerBlock) {
+    return PruningReason::Threads;
+  }
+  if (resources.sharedMemoryPerBlock > sharedMemoryLimit) {
+    return PruningReason::SharedMemory;
+  }
+  auto registers = allocatedRegistersPerThread(resources, limits);
+  if (registers > kMaxRegistersPerThread or
+      registers * roundUp(resources.threadsPerBlock, limits.warpSize) >
+          limits.registers) {
+    return PruningReason::Registers;
+  }
+  if (estimateOccupancy(resources, limits) < minOccupancy) {
+    return PruningReason::Occupancy;
+  }
+  return PruningReason::None;
+}
+
+PruningReason pruneCompiled(
+    const CudaKernelAttributes& attributes,
+    size_t threadsPerBlock,
+    size_t dynamicSharedMemory,
+    const CudaMultiprocessorLimits& limits,
+    double minOccupancy,
+    bool pruneSpills) {
+  if (threadsPerBlock > static_cast<size_t>(attributes.maxThreadsPerBlock)) {
+    return PruningReason::Threads;
+  }
+  if (pruneSpills and attributes.localBytes > 0) {
+    return PruningReason::Registers;
+  }
+  if (limits.maxThreads == 0) {
+    return PruningReason::None;
+  }
+  KernelResources resources;
+  resources.threadsPerBlock = threadsPerBlock;
+  resources.sharedMemoryPerBlock =
+      attributes.staticSharedBytes + dynamicSharedMemory;
+  resources.registersPerThread = attributes.numRegisters;
+  if (estimateOccupancy(resources, limits) < minOccupancy) {
+    return PruningReason::Occupancy;
+  }
+  return PruningReason::None;
+}
+
+void StaticPruningStats::record(PruningReason reason) {
+  switch (reason) {
+    case PruningReason::Threads:
+      ++threads;
+      break;
+    case PruningReason::SharedMemory:
+      ++sharedMemory;
+      break;
+    case PruningReason::Registers:
+      ++registers;
+      break;
+    case PruningReason::Occupancy:
+      ++occupancy;
+      break;
+    case PruningReason::None:
+      break;
+  }
+}
+
+size_t StaticPruningStats::total() const {
+  return threads.load() + sharedMemory.load() + registers.load() +
+      occupancy.load();
+}
+
+void StaticPruningStats::reset() {
+  threads.store(0);
+  sharedMemory.store(0);
+  registers.store(0);
+  occupancy.store(0);
+}
+
+std::string StaticPruningStats::toString() const {
+  std::stringstream ss;
+  ss << "(threads/shared/registers/occupancy): " << threads.load() << '/'
+     << sharedMemory.load() << '/' << registers.load() << '/'
+     << occupancy.load();
+  return ss.str();
+}
+
+std::function<bool(const CudaTcExecutor*)> makeStaticPruningFunction(
+    StaticPruningStats* stats) {
+  if (not FLAGS_tuner_static_pruning) {
+    return [](const CudaTcExecutor*) { return false; };
+  }
+  auto debugTuner = FLAGS_debug_tuner;
+  auto minOccupancy = FLAGS_tuner_min_occupancy;
+  return [stats, debugTuner, minOccupancy](
+             const CudaTcExecutor* exec) -> bool {
+    CHECK(exec);
+    auto resources = KernelResources::estimate(*exec);
+    auto sharedMemoryLimit =
+        CudaMappingOptions(exec->options).proto().use_dynamic_shared_memory()
+        ? queryOptinSharedMemorySize()
+        : querySharedMemorySize();
+    auto reason = staticallyPrune(
+        resources,
+        CudaGPUInfo::GPUInfo().MultiprocessorLimits(),
+        sharedMemoryLimit,
+        minOccupancy);
+    if (reason == PruningReason::None) {
+      return false;
+    }
+    if (stats) {
+      stats->record(reason);
+    }
+    LOG_IF(INFO, debugTuner)
+        << "Skip configuration before compilation, threads: "
+        << resources.threadsPerBlock
+        << " shared memory: " << resources.sharedMemoryPerBlock
+        << " registers: " << resources.registersPerThread << "\n"
+        << CudaMappingOptionsAsCpp(CudaMappingOptions(exec->options));
+    return true;
+  };
+}
+
+} // namespace autotune
+} // namespace tc
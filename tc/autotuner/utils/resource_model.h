@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+
+namespace tc {
+namespace autotune {
+
+/// Static estimate of the resources a mapped kernel uses, available before
+/// it is compiled.
+struct KernelResources {
+  size_t threadsPerBlock = 0;
+  size_t sharedMemoryPerBlock = 0;
+  size_t registersPerThread = 0;
+  /// Minimal number of resident blocks requested with __launch_bounds__, 0
+  /// if none.  The compiler then limits the registers of a thread so that
+  /// these many blocks fit on a multiprocessor, spilling the others.
+  size_t minBlocksPerMultiprocessor = 0;
+
+  /// Registers needed by each thread besides the promoted arrays, for
+  /// indexing and temporaries.  There is no way to know without compiling,
+  /// this is on the low side of what generated kernels use.
+  static constexpr size_t kBaseRegistersPerThread = 32;
+
+  /// Estimate from the launch bounds and the promoted footprints computed by
+  /// the mapper.
+  static KernelResources estimate(const CudaTcExecutor& executor);
+};
+
+enum class PruningReason { None, Threads, SharedMemory, Registers, Occupancy };
+
+/// Fraction of the maximal number of threads resident on a multiprocessor
+/// that kernels using the given resources achieve, 0 if a block does not fit
+/// on a multiprocessor.
+double estimateOccupancy(
+    const KernelResources& resources,
+    const CudaMultiprocessorLimits& limits);
+
+/// Why a kernel using the given resources should not be compiled,
+/// PruningReason::None if it should.  Nothing is pruned if the limits are
+/// unknown (all zero).
+PruningReason staticallyPrune(
+    const KernelResources& resources,
+    const CudaMultiprocessorLimits& limits,
+    size_t sharedMemoryLimit,
+    double minOccupancy);
+
+/// Why a compiled kernel, with the attributes the driver reports, should
+/// not be benchmarked with threadsPerBlock threads and dynamicSharedMemory
+/// bytes of dynamic shared memory per block: it cannot be launched with
+/// these many threads, it spills registers to local memory (if pruneSpills
+/// is set) or its occupancy is below minOccupancy.  Unlike staticallyPrune,
+/// this uses the register count the compiler allocated.
+PruningReason pruneCompiled(
+    const CudaKernelAttributes& attributes,
+    size_t threadsPerBlock,
+    size_t dynamicSharedMemory,
+    const CudaMultiprocessorLimits& limits,
+    double minOccupancy,
+    bool pruneSpills);
+
+/// Counts of the statically pruned kernels per reason, safe to update from
+/// several compilation threads.
+struct StaticPruningStats {
+  std::atomic_size_t threads{0};
+  std::atomic_size_t sharedMemory{0};
+  std::atomic_size_t registers{0};
+  std::atomic_size_t occupancy{0};
+
+  void record(PruningReason reason);
+  size_t total() const;
+  void reset();
+  std::string toString() const;
+};
+
+/// Pruning function for ExecutionEngine::compile rejecting the kernels that
+/// staticallyPrune rejects on the current device, recorded in stats unless
+/// it is null.  Never prunes if FLAGS_tuner_static_pruning is not set.
+std::function<bool(const CudaTcExecutor*)> makeStaticPruningFunction(
+    StaticPruningStats* stats);
+
+} // namespace autotune
+} // namespace tc
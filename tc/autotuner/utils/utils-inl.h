@@ -15,6 +15,7 @@
  */
 #pragma once
 #include <algorithm>
+#include <chrono>
 #include <iterator>
 #include <type_traits>
 #include <vector>
@@ -50,5 +51,44 @@ Vector mergeVectors(Vector&& v, Vectors&&... vs) {
   return merged;
 }
 
+template <typename RunFunction>
+std::vector<Duration> measureUntilStable(
+    RunFunction run,
+    const MeasurementBudget& budget) {
+  std::vector<Duration> runtimes;
+  auto start = std::chrono::steady_clock::now();
+  while (runtimes.size() < budget.maxIterations) {
+    runtimes.push_back(run());
+    if (runtimes.size() < budget.minIterations) {
+      continue;
+    }
+    if (isMeasurementStable(runtimes, budget.relativeConfidenceInterval) or
+        std::chrono::steady_clock::now() - start >= budget.timeBudget) {
+      break;
+    }
+  }
+  return runtimes;
+}
+
+template <typename RunFunction>
+std::vector<Duration> SuccessiveHalving::measure(
+    RunFunction run,
+    const MeasurementBudget& budget,
+    double scale) {
+  std::vector<Duration> runtimes;
+  for (size_t rung = 0; rung < numberRungs(); ++rung) {
+    auto more = measureUntilStable(run, rungBudget(rung, budget));
+    runtimes.insert(runtimes.end(), more.begin(), more.end());
+    auto last = rung + 1 == numberRungs() or
+        isMeasurementStable(runtimes, budget.relativeConfidenceInterval);
+    if (not promote(rung, runtimes, scale) or last) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stopped_[rung];
+      break;
+    }
+  }
+  return runtimes;
+}
+
 } // namespace autotune
 } // namespace tc
@@ -19,6 +19,7 @@
 #include "tc/aten/aten_compiler.h"
 #include "tc/autotuner/utils/utils.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/flags.h"
 #include "tc/core/utils/math.h"
 #include "tc/lang/canonicalize.h"
 
@@ -52,6 +53,16 @@ std::vector<std::size_t> powers2andCeilDivisors(std::size_t val) {
   return res;
 }
 
+std::vector<std::size_t> divisorsUpTo(std::size_t val, std::size_t limit) {
+  std::vector<std::size_t> res;
+  for (std::size_t d = 1; d <= std::min(val, limit); ++d) {
+    if (val % d == 0) {
+      res.push_back(d);
+    }
+  }
+  return res;
+}
+
 std::vector<OptionsWithMedianTime> getOptionsAndMedianRuntimes(
     const lang::CanonicalTcString& id,
     const std::vector<const DLTensor*>& inputs,
@@ -94,6 +105,25 @@ std::vector<CudaMappingOptions> restoreCandidates(
       candidates.begin() + restoreNumber,
       std::back_inserter(res),
       [](const OptionsWithMedianTime& rr) { return rr.options; });
+
+  if (res.size() < FLAGS_tuner_gen_restore_number and
+      FLAGS_tuner_gen_restore_nearest_shapes > 0) {
+    OptionsCache::NearestShapeQuery query;
+    query.numberEntries = FLAGS_tuner_gen_restore_nearest_shapes;
+    query.optionsPerEntry = FLAGS_tuner_gen_restore_number;
+    auto nearest = OptionsCache::getCache()->retrieveNearestShapeOptions(
+        tc, inputs, outputs, query);
+    for (const auto& n : nearest) {
+      if (res.size() >= FLAGS_tuner_gen_restore_number) {
+        break;
+      }
+      if (std::find(res.begin(), res.end(), n.options) == res.end()) {
+        res.push_back(n.options);
+      }
+    }
+    LOG(INFO) << "Restored " << res.size() - restoreNumber
+              << " candidates tuned for the nearest shapes.";
+  }
   return res;
 }
 
@@ -101,13 +131,146 @@ llvm::Optional<CudaMappingOptions> getBestOptions(
     const lang::CanonicalTcString& id,
     const std::vector<const DLTensor*>& inputs,
     const std::vector<const DLTensor*>& outputs) {
-  auto bestOptions =
-      OptionsCache::getCache()->retrieveBestOptions(id, inputs, outputs);
+  OptionsCache::DeviceMatch match;
+  auto bestOptions = OptionsCache::getCache()->retrieveBestOptions(
+      id, inputs, outputs, &match);
   if (bestOptions) {
+    LOG_IF(INFO, match == OptionsCache::DeviceMatch::SameArchitecture)
+        << "Using options tuned on another device with the same compute "
+        << "capability";
     return *bestOptions;
   }
   return llvm::Optional<CudaMappingOptions>{};
 }
 
+MeasurementBudget MeasurementBudget::fromFlags(size_t factor) {
+  MeasurementBudget budget;
+  budget.minIterations =
+      std::max<size_t>(1, FLAGS_tuner_benchmark_min_iterations);
+  budget.maxIterations = factor *
+      std::max<size_t>(
+          budget.minIterations, FLAGS_tuner_benchmark_max_iterations);
+  budget.timeBudget =
+      std::chrono::milliseconds(factor * FLAGS_tuner_benchmark_time_budget_ms);
+  budget.relativeConfidenceInterval = FLAGS_tuner_benchmark_relative_ci;
+  return budget;
+}
+
+Duration weightedGeometricMean(
+    const std::vector<Duration>& runtimes,
+    const std::vector<double>& weights) {
+  CHECK_EQ(runtimes.size(), weights.size());
+  CHECK_GT(runtimes.size(), 0);
+  double logSum = 0.0;
+  double weightSum = 0.0;
+  for (size_t i = 0; i < runtimes.size(); ++i) {
+    CHECK_GT(weights[i], 0) << "weights must be positive";
+    logSum += weights[i] *
+        std::log(std::max<double>(1.0, runtimes[i].count()));
+    weightSum += weights[i];
+  }
+  return Duration(
+      static_cast<Duration::rep>(std::round(std::exp(logSum / weightSum))));
+}
+
+TuningStopCriteria TuningStopCriteria::fromFlags() {
+  TuningStopCriteria criteria;
+  criteria.timeBudget = std::chrono::seconds(FLAGS_tuner_time_budget_s);
+  criteria.maxStalledGenerations = FLAGS_tuner_max_stalled_generations;
+  criteria.targetSpeedup = FLAGS_tuner_target_speedup;
+  return criteria;
+}
+
+namespace {
+// Two-sided 95% quantile of Student's t distribution with df degrees of
+// freedom, rounded up between the tabulated values
+double studentT95(size_t df) {
+  static const double kQuantiles[] = {12.71, 4.303, 3.182, 2.776, 2.571,
+                                      2.447, 2.365, 2.306, 2.262, 2.228};
+  if (df <= 10) {
+    return kQuantiles[df - 1];
+  }
+  if (df <= 20) {
+    return 2.228;
+  }
+  if (df <= 30) {
+    return 2.086;
+  }
+  if (df <= 60) {
+    return 2.042;
+  }
+  return 2.0;
+}
+} // namespace
+
+bool isMeasurementStable(
+    const std::vector<Duration>& runtimes,
+    double relativeConfidenceInterval) {
+  auto n = runtimes.size();
+  if (n < 2) {
+    return false;
+  }
+  double mean = 0.0;
+  for (auto r : runtimes) {
+    mean += std::chrono::duration<double>(r).count();
+  }
+  mean /= n;
+  double variance = 0.0;
+  for (auto r : runtimes) {
+    auto d = std::chrono::duration<double>(r).count() - mean;
+    variance += d * d;
+  }
+  variance /= n - 1;
+  auto halfWidth = studentT95(n - 1) * std::sqrt(variance / n);
+  return halfWidth <= relativeConfidenceInterval * mean;
+}
+
+SuccessiveHalving::SuccessiveHalving(
+    size_t numberRungs,
+    size_t reductionFactor)
+    : reductionFactor_(reductionFactor),
+      rankings_(std::max<size_t>(1, numberRungs)),
+      stopped_(rankings_.size(), 0) {
+  CHECK_GE(reductionFactor_, 2u) << "successive halving must drop candidates";
+}
+
+MeasurementBudget SuccessiveHalving::rungBudget(
+    size_t rung,
+    const MeasurementBudget& budget) const {
+  CHECK_LT(rung, numberRungs());
+  size_t divisor = 1;
+  for (size_t r = rung + 1; r < numberRungs(); ++r) {
+    divisor *= reductionFactor_;
+  }
+  auto res = budget;
+  res.maxIterations =
+      std::max(budget.minIterations, budget.maxIterations / divisor);
+  res.timeBudget = budget.timeBudget / divisor;
+  return res;
+}
+
+bool SuccessiveHalving::promote(
+    size_t rung,
+    const std::vector<Duration>& runtimes,
+    double scale) {
+  CHECK_LT(rung, numberRungs());
+  auto runtime =
+      std::chrono::duration_cast<Duration>(median(runtimes) * scale);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& ranking = rankings_[rung];
+  auto it = std::upper_bound(ranking.begin(), ranking.end(), runtime);
+  auto rank = static_cast<size_t>(std::distance(ranking.begin(), it));
+  ranking.insert(it, runtime);
+  // The first of any reductionFactor candidates goes on
+  auto promoted =
+      (ranking.size() + reductionFactor_ - 1) / reductionFactor_;
+  return rank < promoted;
+}
+
+std::vector<size_t> SuccessiveHalving::stoppedPerRung() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stopped_;
+}
+
 } // namespace autotune
 } // namespace tc
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 #pragma once
+#include <chrono>
+#include <mutex>
 #include <vector>
 
 #include <ATen/ATen.h>
@@ -34,6 +36,10 @@ namespace autotune {
 /// the larger one)
 std::vector<std::size_t> powers2andCeilDivisors(std::size_t val);
 
+/// Returns the divisors of val that are not larger than limit, in increasing
+/// order
+std::vector<std::size_t> divisorsUpTo(std::size_t val, std::size_t limit);
+
 template <typename Vector, typename... Vectors>
 Vector mergeVectors(Vector&& v, Vectors&&... vs);
 
@@ -58,7 +64,111 @@ struct OptionsWithMedianTime {
 
 std::vector<OptionsWithMedianTime> getOptionsAndMedianRuntimes(
     const lang::CanonicalTcString& id,
-    const std::vector<const DLTensor*>& inputs);
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs);
+
+/// exp(sum_i(weights[i] * log(runtimes[i])) / sum_i(weights[i])), the
+/// aggregate runtime of joint tuning
+Duration weightedGeometricMean(
+    const std::vector<Duration>& runtimes,
+    const std::vector<double>& weights);
+
+/// When to stop timing an autotuning candidate: after minIterations runs
+/// once the measurement is stable (see isMeasurementStable) or timeBudget
+/// was spent, and after maxIterations runs at the latest.
+struct MeasurementBudget {
+  size_t minIterations;
+  size_t maxIterations;
+  std::chrono::steady_clock::duration timeBudget;
+  double relativeConfidenceInterval;
+
+  /// The budget set by the tuner_benchmark_* flags, with iterations and time
+  /// scaled by factor
+  static MeasurementBudget fromFlags(size_t factor = 1);
+};
+
+/// When to end a tuning run before all its generations are evaluated, each
+/// criterion is checked after every generation (or population size results
+/// in pipelined and distributed modes) and disabled by a 0 value.
+/// Candidates are no longer compiled once timeBudget is spent.
+struct TuningStopCriteria {
+  std::chrono::steady_clock::duration timeBudget;
+  /// Stop after that many generations without improvement of the best
+  /// runtime
+  size_t maxStalledGenerations;
+  /// Stop once the best runtime is that many times faster than the runtime
+  /// of the base mapping options, which are then evaluated first
+  double targetSpeedup;
+
+  /// The criteria set by the tuner_time_budget_s,
+  /// tuner_max_stalled_generations and tuner_target_speedup flags
+  static TuningStopCriteria fromFlags();
+};
+
+/// Whether the half width of the 95% confidence interval (Student's t) of
+/// the mean of runtimes is within relativeConfidenceInterval of the mean
+bool isMeasurementStable(
+    const std::vector<Duration>& runtimes,
+    double relativeConfidenceInterval);
+
+/// Calls run, which returns the runtime of one execution, until budget is
+/// exhausted and returns the runtimes
+template <typename RunFunction>
+std::vector<Duration> measureUntilStable(
+    RunFunction run,
+    const MeasurementBudget& budget);
+
+/// Asynchronous successive halving of the measurements of the candidates.
+/// A candidate is timed with the budget of the first rung, the smallest,
+/// and timed further with the budget of each next rung as long as its
+/// median runtime ranks among the fastest 1 / reductionFactor of the
+/// medians recorded at its rung so far, and the measurement is not yet
+/// stable.  The budget of rung r is that of the flags divided by
+/// reductionFactor^(numberRungs - 1 - r), the last rung getting the budget
+/// of the flags, so that the GPU time goes to the contenders while the
+/// other candidates keep the runtime measured on the lower rungs.  The
+/// rankings are shared by the concurrent measurements of a tuning run.
+class SuccessiveHalving {
+ public:
+  /// A single rung measures each candidate with the full budget.
+  SuccessiveHalving(size_t numberRungs, size_t reductionFactor);
+
+  SuccessiveHalving(const SuccessiveHalving&) = delete;
+  SuccessiveHalving& operator=(const SuccessiveHalving&) = delete;
+
+  /// The share of budget of rung
+  MeasurementBudget rungBudget(size_t rung, const MeasurementBudget& budget)
+      const;
+
+  /// Records the median of runtimes, scaled by scale, at rung and returns
+  /// whether it ranks among the fastest 1 / reductionFactor recorded there.
+  bool promote(
+      size_t rung,
+      const std::vector<Duration>& runtimes,
+      double scale);
+
+  /// Calls run through the rungs until the candidate is not promoted, its
+  /// measurement is stable or the last rung is measured, and returns all
+  /// the runtimes.  The runtimes ranked are scaled by scale.
+  template <typename RunFunction>
+  std::vector<Duration> measure(
+      RunFunction run,
+      const MeasurementBudget& budget,
+      double scale = 1.0);
+
+  size_t numberRungs() const {
+    return rankings_.size();
+  }
+  /// The number of candidates whose measurement ended at each rung
+  std::vector<size_t> stoppedPerRung() const;
+
+ private:
+  const size_t reductionFactor_;
+  mutable std::mutex mutex_;
+  /// The sorted medians recorded at each rung
+  std::vector<std::vector<Duration>> rankings_;
+  std::vector<size_t> stopped_;
+};
 
 } // namespace autotune
 } // namespace tc
@@ -13,8 +13,11 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <gflags/gflags.h>
@@ -32,7 +35,9 @@
 
 #include "tc/c2/context.h"
 #include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
+#include "tc/core/scope_guard.h"
 
 using namespace caffe2;
 
@@ -54,6 +59,20 @@ DEFINE_uint32(O, 64, "W2_h == W3_w");
 DEFINE_uint32(P, 32, "W3_h == W4_w");
 DEFINE_uint32(Q, 2, "W4_h");
 
+// End to end model
+DEFINE_string(
+    e2e_batch_sizes,
+    "1,16,128",
+    "Comma-separated batch sizes the EndToEnd benchmark runs the model at");
+DEFINE_string(
+    e2e_threads,
+    "1,2,4",
+    "Comma-separated numbers of host threads the EndToEnd benchmark runs forwards from concurrently");
+DEFINE_bool(
+    e2e_streams,
+    true,
+    "Whether each host thread of the EndToEnd benchmark launches on its own stream instead of the default one");
+
 // ATen functions defined here:
 //   third-party-install/share/ATen/Declarations.yaml
 //   third-party-install/include/ATen/Functions.h
@@ -104,6 +123,14 @@ DEFINE_uint32(Q, 2, "W4_h");
 
 class ProductionModel : public Benchmark {
  public:
+  /// Runs the whole forward of the model (2LUT, C3, the concatenation and
+  /// the 4 FCRELU) at each batch size, from each number of host threads
+  /// concurrently, and reports the percentiles of the forward latency and
+  /// the throughput.  All threads share the compilation unit, as a server
+  /// would.
+  void runEndToEnd(
+      const std::vector<uint32_t>& batchSizes,
+      const std::vector<uint32_t>& numThreads);
   void run1LUT(
       uint32_t B,
       uint32_t D,
@@ -370,6 +397,8 @@ def _C3(float(B,WX) I, float(WY, WX) W) -> (C3) {
         checkFun);
   } else {
     std::vector<at::Tensor> outputs;
+    auto res = I.mm(W.t());
+    addBaseline("cuBLAS", [=]() mutable { at::mm_out(res, I, W.t()); });
     Check(tc, "_C3", options, inputs, outputs, checkFun);
     if (useFlags) {
       autotune(
@@ -427,6 +456,11 @@ def mlp1(float(B,M) I, float(M, N) W1, float(N) B1) -> (O1) {
         checkFun);
   } else {
     std::vector<at::Tensor> outputs;
+    auto O1 = I.mm(W1);
+    addBaseline("cuBLAS", [=]() mutable {
+      at::addmm_out(O1, B1.expand_as(O1), I, W1);
+      O1.clamp_(0);
+    });
     Check(tc, "mlp1", options, inputs, outputs, checkFun);
     if (useFlags) {
       autotune(
@@ -499,7 +533,17 @@ def mlp3(float(B,N) I, float(O,N) W2, float(O) B2, float(P,O) W3, float(P) B3, f
         checkFun);
   } else {
     std::vector<at::Tensor> outputs;
-
+    auto O2 = I.mm(W2.t());
+    auto O3 = O2.mm(W3.t());
+    auto O4 = O3.mm(W4.t());
+    addBaseline("cuBLAS", [=]() mutable {
+      at::addmm_out(O2, B2.expand_as(O2), I, W2.t());
+      O2.clamp_(0);
+      at::addmm_out(O3, B3.expand_as(O3), O2, W3.t());
+      O3.clamp_(0);
+      at::addmm_out(O4, B4.expand_as(O4), O3, W4.t());
+      O4.clamp_(0);
+    });
     Check(tc, "mlp3", options, inputs, outputs, checkFun);
     if (useFlags) {
       autotune(
@@ -515,6 +559,255 @@ def mlp3(float(B,N) I, float(O,N) W2, float(O) B2, float(P,O) W3, float(P) B3, f
   }
 }
 
+namespace {
+std::vector<uint32_t> parseList(const std::string& list) {
+  std::vector<uint32_t> res;
+  std::stringstream ss(list);
+  for (std::string item; std::getline(ss, item, ',');) {
+    res.push_back(std::stoul(item));
+  }
+  return res;
+}
+} // namespace
+
+// The concatenation I = (C1, C2, C3) is not expressible in TC, mlp1 is split
+// along M instead: I * W1 == C1 * W1a + C2 * W1b + C3 * W1c.
+void ProductionModel::runEndToEnd(
+    const std::vector<uint32_t>& batchSizes,
+    const std::vector<uint32_t>& numThreads) {
+  auto D = FLAGS_D;
+  auto L1 = FLAGS_L1;
+  auto E1 = FLAGS_E1;
+  auto L2 = FLAGS_L2;
+  auto E2 = FLAGS_E2;
+  auto WX = FLAGS_WX;
+  auto WY = FLAGS_WY;
+  auto N = FLAGS_N;
+  auto O = FLAGS_O;
+  auto P = FLAGS_P;
+  auto Q = FLAGS_Q;
+  CHECK_LT(0, E1);
+  CHECK_LT(0, E2);
+
+  // The weights are shared by all batch sizes and threads
+  at::Tensor LUT1 = at::CUDA(at::kFloat).rand({E1, D});
+  at::Tensor LUT2 = at::CUDA(at::kFloat).rand({E2, D});
+  at::Tensor W = at::CUDA(at::kFloat).rand({WY, WX});
+  at::Tensor W1a = at::CUDA(at::kFloat).rand({D, N});
+  at::Tensor W1b = at::CUDA(at::kFloat).rand({D, N});
+  at::Tensor W1c = at::CUDA(at::kFloat).rand({WY, N});
+  at::Tensor B1 = at::CUDA(at::kFloat).rand({N});
+  at::Tensor W2 = at::CUDA(at::kFloat).rand({O, N});
+  at::Tensor B2 = at::CUDA(at::kFloat).rand({O});
+  at::Tensor W3 = at::CUDA(at::kFloat).rand({P, O});
+  at::Tensor B3 = at::CUDA(at::kFloat).rand({P});
+  at::Tensor W4 = at::CUDA(at::kFloat).rand({Q, P});
+  at::Tensor B4 = at::CUDA(at::kFloat).rand({Q});
+
+  std::string tc = R"TC(
+def _2LUT(float(E1, D) LUT1, int32(B, L1) I1, float(E2, D) LUT2, int32(B, L2) I2) -> (O1, O2) {
+    O1(b, d) +=! LUT1(I1(b, r_l1), d)
+    O2(b, d) +=! LUT2(I2(b, r_l2), d)
+}
+def _C3(float(B,WX) I, float(WY, WX) W) -> (C3) {
+    C3(b, wy) +=! I(b, r_wx) * W(wy, r_wx)
+}
+def mlp1(float(B,D) C1, float(B,D) C2, float(B,WY) C3, float(D,N) W1a, float(D,N) W1b, float(WY,N) W1c, float(N) B1) -> (O1) {
+    O1(b, n) +=! C1(b, r_d) * W1a(r_d, n)
+    O1(b, n) +=  C2(b, r_d) * W1b(r_d, n)
+    O1(b, n) +=  C3(b, r_wy) * W1c(r_wy, n)
+    O1(b, n)  = O1(b, n) + B1(n)
+    O1(b, n)  = fmax(O1(b, n), 0)
+}
+def mlp3(float(B,N) I, float(O,N) W2, float(O) B2, float(P,O) W3, float(P) B3, float(Q,P) W4, float(Q) B4) -> (O2, O3, O4) {
+    O2(b, o) +=!  I(b, n) * W2(o, n)
+    O2(b, o)  =  O2(b, o) + B2(o)
+    O2(b, o)  = fmax(O2(b, o), 0)
+    O3(b, p) +=! O2(b, o) * W3(p, o)
+    O3(b, p)  =  O3(b, p) + B3(p)
+    O3(b, p)  = fmax(O3(b, p), 0)
+    O4(b, q) +=! O3(b, p) * W4(q, p)
+    O4(b, q)  =  O4(b, q) + B4(q)
+    O4(b, q)  = fmax(O4(b, q), 0)
+}
+)TC";
+  // The options of the per-layer benchmarks
+  auto lutOptions = tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+                        .tile(1, 32)
+                        .mapToThreads({1, 32})
+                        .mapToBlocks({128, 128})
+                        .unroll(256);
+  auto c3Options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+                       .fixParametersBeforeScheduling(true)
+                       .tile(32, 32, 32)
+                       .mapToThreads({4, 32})
+                       .mapToBlocks({128, 128})
+                       .useSharedMemory(true)
+                       .usePrivateMemory(true)
+                       .unroll(128);
+  auto mlpOptions = tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+                        .fixParametersBeforeScheduling(true)
+                        .tile(16, 16, 128)
+                        .mapToThreads({16, 16})
+                        .mapToBlocks({32, 32})
+                        .useSharedMemory(true)
+                        .usePrivateMemory(true)
+                        .unroll(1);
+
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(tc);
+  for (auto B : batchSizes) {
+    at::Tensor I1 = at::CUDA(at::kFloat)
+                        .rand({B, L1})
+                        .mul_(E1)
+                        .floor_()
+                        .toType(at::kInt);
+    at::Tensor I2 = at::CUDA(at::kFloat)
+                        .rand({B, L2})
+                        .mul_(E2)
+                        .floor_()
+                        .toType(at::kInt);
+    at::Tensor I3 = at::CUDA(at::kFloat).rand({B, WX});
+    std::vector<at::Tensor> lutInputs = {LUT1, I1, LUT2, I2};
+    std::vector<at::Tensor> c3Inputs = {I3, W};
+
+    // Compile layer by layer, the inputs of a layer are the outputs of the
+    // previous ones, and check each layer against ATen.
+    std::vector<at::Tensor> lutOutputs, c3Outputs, mlp1Outputs, mlp3Outputs;
+    auto lutHandle = atCompl.compile("_2LUT", lutInputs, lutOptions);
+    atCompl.run("_2LUT", lutInputs, lutOutputs, lutHandle);
+    auto c3Handle = atCompl.compile("_C3", c3Inputs, c3Options);
+    atCompl.run("_C3", c3Inputs, c3Outputs, c3Handle);
+    std::vector<at::Tensor> mlp1Inputs = {
+        lutOutputs[0], lutOutputs[1], c3Outputs[0], W1a, W1b, W1c, B1};
+    auto mlp1Handle = atCompl.compile("mlp1", mlp1Inputs, mlpOptions);
+    atCompl.run("mlp1", mlp1Inputs, mlp1Outputs, mlp1Handle);
+    std::vector<at::Tensor> mlp3Inputs = {
+        mlp1Outputs[0], W2, B2, W3, B3, W4, B4};
+    auto mlp3Handle = atCompl.compile("mlp3", mlp3Inputs, mlpOptions);
+    atCompl.run("mlp3", mlp3Inputs, mlp3Outputs, mlp3Handle);
+
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    double prec = 3e-7;
+    auto lookup = [&](const at::Tensor& LUT, const at::Tensor& I) {
+      return LUT.index_select(0, I.view({-1}).toType(at::kLong))
+          .view({B, I.size(1), D})
+          .sum(1);
+    };
+    checkRtol(lutOutputs[0].sub(lookup(LUT1, I1)), lutInputs, L1, prec);
+    checkRtol(lutOutputs[1].sub(lookup(LUT2, I2)), lutInputs, L2, prec);
+    checkRtol(c3Outputs[0].sub(I3.mm(W.t())), c3Inputs, WX + 1, prec);
+    auto concat = at::cat({lutOutputs[0], lutOutputs[1], c3Outputs[0]}, 1);
+    auto W1 = at::cat({W1a, W1b, W1c}, 0);
+    checkRtol(
+        mlp1Outputs[0].sub(concat.mm(W1).add(B1).clamp(0)),
+        mlp1Inputs,
+        2 * D + WY + 1,
+        prec);
+    auto O2 = mlp1Outputs[0].mm(W2.t()).add(B2).clamp(0);
+    auto O3 = O2.mm(W3.t()).add(B3).clamp(0);
+    auto O4 = O3.mm(W4.t()).add(B4).clamp(0);
+    checkRtol(mlp3Outputs[2].sub(O4), mlp3Inputs, N * O * P + 3, prec);
+
+    for (auto T : numThreads) {
+      CHECK_LT(0u, T);
+      std::vector<std::vector<tc::Duration>> latencies(T);
+      std::vector<std::chrono::high_resolution_clock::time_point> starts(T);
+      std::vector<std::chrono::high_resolution_clock::time_point> ends(T);
+      std::vector<std::thread> threads;
+      for (uint32_t t = 0; t < T; ++t) {
+        threads.emplace_back([&, t]() {
+          // Blocking streams: the ATen ops of the runs (e.g., allocating
+          // the outputs) on the default stream synchronize with them.
+          cudaStream_t stream = 0;
+          if (FLAGS_e2e_streams) {
+            TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamCreate(&stream));
+          }
+          tc::ScopeGuard g([&]() {
+            if (stream) {
+              TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamDestroy(stream));
+            }
+          });
+          tc::CudaRuntimeInformation info(stream);
+          std::vector<at::Tensor> o1, o2, o3, o4;
+          auto forward = [&]() {
+            atCompl.run("_2LUT", lutInputs, o1, lutHandle, false, info);
+            atCompl.run("_C3", c3Inputs, o2, c3Handle, false, info);
+            atCompl.run(
+                "mlp1",
+                {o1[0], o1[1], o2[0], W1a, W1b, W1c, B1},
+                o3,
+                mlp1Handle,
+                false,
+                info);
+            atCompl.run(
+                "mlp3",
+                {o3[0], W2, B2, W3, B3, W4, B4},
+                o4,
+                mlp3Handle,
+                false,
+                info);
+            TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream));
+          };
+          for (uint32_t i = 0; i < std::max(1u, tc::FLAGS_benchmark_warmup);
+               ++i) {
+            forward();
+          }
+          latencies[t].reserve(tc::FLAGS_benchmark_iterations);
+          starts[t] = std::chrono::high_resolution_clock::now();
+          for (uint32_t i = 0; i < tc::FLAGS_benchmark_iterations; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            forward();
+            latencies[t].push_back(
+                std::chrono::high_resolution_clock::now() - start);
+          }
+          ends[t] = std::chrono::high_resolution_clock::now();
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+
+      std::vector<tc::Duration> sorted;
+      for (const auto& l : latencies) {
+        sorted.insert(sorted.end(), l.begin(), l.end());
+      }
+      std::sort(sorted.begin(), sorted.end());
+      auto seconds = std::chrono::duration<double>(
+                         *std::max_element(ends.begin(), ends.end()) -
+                         *std::min_element(starts.begin(), starts.end()))
+                         .count();
+      auto us = [&](double q) -> int64_t {
+        auto idx = std::min(
+            static_cast<size_t>(std::ceil(q * sorted.size())),
+            sorted.size() - 1);
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   sorted.at(idx))
+            .count();
+      };
+      std::cout << "\n-----------------------------------------------------";
+      std::cout << "\n------------------ END TO END B=" << B << ", " << T
+                << " THREADS ----------------";
+      std::cout << "\n-----------------------------------------------------";
+      std::cout << "\n";
+      std::cout << "Latency min: " << us(0) << "us, p50: " << us(0.5)
+                << "us, p90: " << us(0.9) << "us, p99: " << us(0.99)
+                << "us, max: " << us(1) << "us\n";
+      std::cout << "Throughput: " << sorted.size() / seconds
+                << " forwards/s, " << sorted.size() * B / seconds
+                << " samples/s";
+      std::cout << "\n-----------------------------------------------------";
+      std::cout << "\n\n";
+      reportBenchmark(
+          "end to end " + std::to_string(T) + " threads",
+          "prod_model",
+          {I1, I2, I3},
+          "",
+          sorted);
+    }
+  }
+}
+
 TEST_F(ProductionModel, 1LUT) {
   auto B = FLAGS_B;
   auto D = FLAGS_D;
@@ -1002,6 +1295,10 @@ TEST_F(ProductionModel, C2MLP3Reference) {
       [&]() { return true; }, [&](bool flag) { reference->RunReference(); });
 }
 
+TEST_F(ProductionModel, EndToEnd) {
+  runEndToEnd(parseList(FLAGS_e2e_batch_sizes), parseList(FLAGS_e2e_threads));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -94,6 +94,8 @@ def batch_matmul(float(B, N, M) X, float(B, M, K) Y) -> (Z) {
         checkFun);
   } else {
     std::vector<at::Tensor> outputs;
+    auto res = bmm(X, Y);
+    addBaseline("cuBLAS", [=]() mutable { bmm_out(res, X, Y); });
     Check(tc, "batch_matmul", options, inputs, outputs, checkFun);
     if (useFlags) {
       autotune(
@@ -17,6 +17,9 @@
 
 #include <chrono>
 #include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include <gflags/gflags.h>
@@ -32,11 +35,15 @@
 #include "tc/core/cuda/cuda.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_measurement.h"
 #include "tc/core/cuda/cuda_rtc.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
+#include "tc/core/halide_utils.h"
 #include "tc/core/scope_guard.h"
+#include "tc/core/tc2halide.h"
 #include "tc/lang/canonicalize.h"
+#include "tc/lang/parse_cache.h"
 
 #include <cublas_v2.h> // Must be the same as Caffe2
 #include <cuda_runtime_api.h>
@@ -60,6 +67,10 @@ DEFINE_bool(
 DEFINE_bool(autotune, false, "Enable autotuning");
 DEFINE_string(save_tuner_proto_prefix, "/tmp", "Enable autotuning");
 DEFINE_bool(validate_proto, false, "whether to load options from proto");
+DEFINE_string(
+    benchmark_report,
+    "",
+    "If set, a JSON record of each measurement is appended to this file, one per line, see scripts/compare_benchmarks.py");
 
 std::vector<const DLTensor*> inferOutputTensorInfo(
     const std::string& tc,
@@ -70,7 +81,93 @@ std::vector<const DLTensor*> inferOutputTensorInfo(
   return atCompl.inferOutputTensorInfo(name, inputs);
 }
 
+namespace detail {
+inline std::string jsonString(const std::string& s) {
+  std::stringstream ss;
+  ss << '"';
+  for (auto c : s) {
+    if (c == '"' || c == '\\') {
+      ss << '\\';
+    }
+    ss << c;
+  }
+  ss << '"';
+  return ss.str();
+}
+} // namespace detail
+
+// Appends the record of a measurement to --benchmark_report, if set: the
+// current test, the kind of measurement (e.g., "kernel" or "reference"),
+// the TC and the sizes of its inputs, a hash of the options, the version of
+// TC, the device, whether the L2 cache was flushed before each run, the
+// clocks of the device after the runs and the percentiles of the sorted
+// times, in us.
+inline void reportBenchmark(
+    const std::string& kind,
+    const std::string& name,
+    const std::vector<at::Tensor>& inputs,
+    const std::string& options,
+    const std::vector<tc::Duration>& sortedTimes) {
+  if (FLAGS_benchmark_report.empty() || sortedTimes.empty()) {
+    return;
+  }
+  auto us = [&](double q) {
+    auto idx = std::min(
+        static_cast<size_t>(std::ceil(q * sortedTimes.size())),
+        sortedTimes.size() - 1);
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               sortedTimes.at(idx))
+        .count();
+  };
+  auto test = ::testing::UnitTest::GetInstance()->current_test_info();
+  std::stringstream record;
+  record << "{\"test\": "
+         << detail::jsonString(
+                test ? std::string(test->test_case_name()) + "." + test->name()
+                     : "")
+         << ", \"kind\": " << detail::jsonString(kind)
+         << ", \"name\": " << detail::jsonString(name) << ", \"sizes\": [";
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    record << (i > 0 ? ", " : "") << "[";
+    for (size_t d = 0; d < inputs[i].sizes().size(); ++d) {
+      record << (d > 0 ? ", " : "") << inputs[i].sizes()[d];
+    }
+    record << "]";
+  }
+  std::stringstream hash;
+  hash << std::hex << std::hash<std::string>()(options);
+  record << "], \"options_hash\": "
+         << detail::jsonString(options.empty() ? "" : hash.str())
+         << ", \"version\": " << detail::jsonString(tc::git_version)
+         << ", \"device\": "
+         << detail::jsonString(tc::CudaGPUInfo::GPUInfo().GetCudaDeviceStr())
+         << ", \"cold_cache\": "
+         << (tc::FLAGS_benchmark_cold_cache ? "true" : "false");
+  auto clocks = tc::queryClockState();
+  if (clocks.known) {
+    record << ", \"sm_clock_mhz\": " << clocks.smClockMHz
+           << ", \"throttled\": " << (clocks.throttled() ? "true" : "false");
+  }
+  record << ", \"iterations\": " << sortedTimes.size()
+         << ", \"min_us\": " << us(0) << ", \"p50_us\": " << us(0.5)
+         << ", \"p90_us\": " << us(0.9) << ", \"p99_us\": " << us(0.99)
+         << ", \"max_us\": " << us(1) << "}";
+  std::ofstream out(FLAGS_benchmark_report, std::ios::app);
+  CHECK(out) << "could not open " << FLAGS_benchmark_report;
+  out << record.str() << "\n";
+}
+
 struct Benchmark : public ::testing::Test {
+  // Flushes the L2 cache before a run timed on the host with
+  // --benchmark_cold_cache, the runs timed with events flush it themselves
+  // (see CudaTcExecutor::run).
+  static void ColdCache() {
+    if (tc::FLAGS_benchmark_cold_cache) {
+      tc::flushL2Cache();
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    }
+  }
+
   void SetUp() {
     if (!FLAGS_disable_version_checks) {
       auto cudnnVersion = cudnnGetVersion();
@@ -105,6 +202,48 @@ struct Benchmark : public ::testing::Test {
     }
   }
 
+  // Prints the throughputs achieved by the TC name in time, from the work
+  // estimated on its Halide translation, compared to the peak throughputs of
+  // the current GPU.
+  void Roofline(
+      const std::string& tc,
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      tc::Duration time) {
+    lang::TreeRef def;
+    for (const auto& tree : lang::parseCached(tc)) {
+      if (lang::Def(tree).name().name() == name) {
+        def = tree;
+      }
+    }
+    CHECK(def) << "No definition " << name;
+    auto halide = tc2halide::translateCached(
+        isl::with_exceptions::globalIslCtx(), def);
+    auto inputsPair = tc::toConstDlpackTensors(inputs);
+    tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+    auto work = tc::estimateWork(*halide, inputsPair.first);
+    auto peaks = tc::CudaGPUInfo::GPUInfo().PeakThroughputs();
+
+    auto seconds = std::chrono::duration<double>(time).count();
+    auto flops = work.flops / seconds;
+    auto bandwidth = work.bytes / seconds;
+    auto percent = [](double achieved, double peak) {
+      return peak > 0 ? 100.0 * achieved / peak : 0.0;
+    };
+    std::cout << "\n---------------------------------------------------------";
+    std::cout << "\n------------------ ROOFLINE (p50 kernel) ----------------";
+    std::cout << "\n---------------------------------------------------------";
+    std::cout << "\n";
+    std::cout << "GFLOP: " << work.flops / 1e9 << ", GB: " << work.bytes / 1e9
+              << ", FLOP/B: " << work.flops / work.bytes << "\n";
+    std::cout << "GFLOP/s: " << flops / 1e9 << " ("
+              << percent(flops, peaks.flops) << "% of peak), "
+              << "GB/s: " << bandwidth / 1e9 << " ("
+              << percent(bandwidth, peaks.memoryBandwidth) << "% of peak)";
+    std::cout << "\n---------------------------------------------------------";
+    std::cout << "\n\n";
+  }
+
   template <typename CheckFunction>
   void Check(
       const std::string& tc,
@@ -131,6 +270,7 @@ struct Benchmark : public ::testing::Test {
     for (int i = 0; i < tc::FLAGS_benchmark_iterations; ++i) {
       kernelTimes.push_back(atCompl.run(name, inputs, outputs, handle, true));
       TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+      ColdCache();
       auto time(std::chrono::system_clock::now());
       atCompl.uncheckedRun(inputs, outputs, handle);
       TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
@@ -165,12 +305,31 @@ struct Benchmark : public ::testing::Test {
         << GET_US(kernelTimes.at(std::min(p99idx, (int)kernelTimes.size() - 1)))
         << "us, "
         << "Max: " << GET_US(kernelTimes.back()) << "us";
+    std::cout << "\nGPU clocks: " << tc::queryClockState();
     std::cout << "\n---------------------------------------------------------";
     std::cout << "\n\n";
 
 #undef GET_US
 
+    reportBenchmark(
+        "kernel",
+        name,
+        inputs,
+        mappingOptions.toProtobufSerializedString(),
+        kernelTimes);
+    Roofline(
+        tc,
+        name,
+        inputs,
+        kernelTimes.at(std::min(p50idx, (int)kernelTimes.size() - 1)));
+
     std::sort(totalTimes.begin(), totalTimes.end());
+    reportBenchmark(
+        "total",
+        name,
+        inputs,
+        mappingOptions.toProtobufSerializedString(),
+        totalTimes);
 #define GET_US(X) \
   (std::chrono::duration_cast<std::chrono::microseconds>((X)).count())
 
@@ -195,6 +354,76 @@ struct Benchmark : public ::testing::Test {
     std::cout << "\n---------------------------------------------------------";
     std::cout << "\n\n";
 
+#undef GET_US
+
+    CompareToBaselines(
+        name,
+        inputs,
+        totalTimes.at(std::min(p50idx, (int)totalTimes.size() - 1)));
+  }
+
+  /// Registers a vendor implementation of the TC the next Check benchmarks,
+  /// e.g., cuBLAS or cuDNN, computing the same outputs from the same inputs.
+  /// Check times the baselines like the total time of the TC (wall clock,
+  /// synchronized after each run) and reports the speedup of the TC over
+  /// the fastest one.
+  void addBaseline(const std::string& library, std::function<void()> compute) {
+    baselines_.emplace_back(library, std::move(compute));
+  }
+
+  // Times the baselines registered since the last Check, the TC name ran
+  // in tcTime.
+  void CompareToBaselines(
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      tc::Duration tcTime) {
+    auto baselines = std::move(baselines_);
+    baselines_.clear();
+    if (baselines.empty()) {
+      std::cout << "No vendor baseline for " << name << "\n\n";
+      return;
+    }
+#define GET_US(X) \
+  (std::chrono::duration_cast<std::chrono::microseconds>((X)).count())
+
+    std::cout << "\n---------------------------------------------------------";
+    std::cout << "\n------------------ VENDOR BASELINES (p50) ---------------";
+    std::cout << "\n---------------------------------------------------------";
+    std::cout << "\n";
+    std::string bestLibrary;
+    tc::Duration best = tc::Duration::max();
+    for (auto& baseline : baselines) {
+      for (int i = 0; i < tc::FLAGS_benchmark_warmup; ++i) {
+        baseline.second();
+      }
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+      std::vector<tc::Duration> times;
+      times.reserve(tc::FLAGS_benchmark_iterations);
+      for (int i = 0; i < tc::FLAGS_benchmark_iterations; ++i) {
+        ColdCache();
+        auto time(std::chrono::system_clock::now());
+        baseline.second();
+        TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+        times.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now() - time));
+      }
+      std::sort(times.begin(), times.end());
+      reportBenchmark("baseline " + baseline.first, name, inputs, "", times);
+      auto p50idx = static_cast<int>(std::ceil(0.5 * times.size()));
+      auto p50 = times.at(std::min(p50idx, (int)times.size() - 1));
+      std::cout << baseline.first << ": " << GET_US(p50) << "us\n";
+      if (p50 < best) {
+        best = p50;
+        bestLibrary = baseline.first;
+      }
+    }
+    std::cout << "TC: " << GET_US(tcTime) << "us, "
+              << static_cast<double>(GET_US(best)) /
+            std::max<int64_t>(GET_US(tcTime), 1)
+              << "x the speed of " << bestLibrary;
+    std::cout << "\n---------------------------------------------------------";
+    std::cout << "\n\n";
+
 #undef GET_US
   }
 
@@ -207,6 +436,7 @@ struct Benchmark : public ::testing::Test {
     std::vector<tc::Duration> times;
     times.reserve(tc::FLAGS_benchmark_iterations);
     for (int i = 0; i < tc::FLAGS_benchmark_iterations; ++i) {
+      ColdCache();
       auto time(std::chrono::system_clock::now());
       compute(res);
       TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
@@ -214,6 +444,7 @@ struct Benchmark : public ::testing::Test {
           std::chrono::system_clock::now() - time));
     }
     std::sort(times.begin(), times.end());
+    reportBenchmark("reference", "", {}, "", times);
     auto p50idx = static_cast<int>(std::ceil(0.5 * times.size()));
     auto p90idx = static_cast<int>(std::ceil(0.9 * times.size()));
     auto p99idx = static_cast<int>(std::ceil(0.99 * times.size()));
@@ -288,6 +519,7 @@ struct Benchmark : public ::testing::Test {
     for (int i = 0; i < tc::FLAGS_benchmark_iterations; ++i) {
       kernelTimes.push_back(atCompl.run(name, inputs, outputs, handle, true));
       TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+      ColdCache();
       auto time(std::chrono::system_clock::now());
       atCompl.uncheckedRun(inputs, outputs, handle);
       TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
@@ -301,6 +533,12 @@ struct Benchmark : public ::testing::Test {
     auto p99idx = static_cast<int>(std::ceil(0.99 * kernelTimes.size()));
 
     std::sort(kernelTimes.begin(), kernelTimes.end());
+    reportBenchmark(
+        "validated kernel",
+        name,
+        inputs,
+        mappingOptions[0].toProtobufSerializedString(),
+        kernelTimes);
 #define GET_US(X) \
   (std::chrono::duration_cast<std::chrono::microseconds>((X)).count())
 
@@ -322,6 +560,7 @@ struct Benchmark : public ::testing::Test {
         << GET_US(kernelTimes.at(std::min(p99idx, (int)kernelTimes.size() - 1)))
         << "us, "
         << "Max: " << GET_US(kernelTimes.back()) << "us";
+    std::cout << "\nGPU clocks: " << tc::queryClockState();
     std::cout << "\n---------------------------------------------------------";
     std::cout << "\n\n";
 
@@ -400,6 +639,7 @@ struct Benchmark : public ::testing::Test {
         kernelTimes.push_back(
             atCompl.run(kernelName, inputs, outputs, handle, true));
         TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+        ColdCache();
         auto time(std::chrono::system_clock::now());
         atCompl.uncheckedRun(inputs, outputs, handle);
         TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
@@ -412,6 +652,12 @@ struct Benchmark : public ::testing::Test {
       auto p90idx = static_cast<int>(std::ceil(0.9 * kernelTimes.size()));
       auto p99idx = static_cast<int>(std::ceil(0.99 * kernelTimes.size()));
       std::sort(kernelTimes.begin(), kernelTimes.end());
+      reportBenchmark(
+          "autotuned kernel",
+          kernelName,
+          inputs,
+          bestOptions.toProtobufSerializedString(),
+          kernelTimes);
 
 #define GET_US(X) \
   (std::chrono::duration_cast<std::chrono::microseconds>((X)).count())
@@ -459,10 +705,14 @@ struct Benchmark : public ::testing::Test {
                        std::min(p99idx, (int)kernelTimes.size() - 1)))
                 << "us, "
                 << "Max: " << GET_US(kernelTimes.back()) << "us";
+      std::cout << "\nGPU clocks: " << tc::queryClockState();
       std::cout
           << "\n---------------------------------------------------------";
       std::cout << "\n\n";
 #undef GET_US
     }
   }
+
+ private:
+  std::vector<std::pair<std::string, std::function<void()>>> baselines_;
 };
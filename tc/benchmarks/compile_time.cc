@@ -0,0 +1,331 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <ATen/ATen.h>
+
+#include "tc/aten/utils.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/scope_guard.h"
+#include "tc/core/tc2halide.h"
+#include "tc/core/utils/time.h"
+#include "tc/lang/parse_cache.h"
+#include "tc/lang/parser.h"
+#include "tc/library/2fcrelu.h"
+#include "tc/library/2lut.h"
+#include "tc/library/3fcrelu.h"
+#include "tc/library/4fcrelu.h"
+#include "tc/library/batch_matmul.h"
+#include "tc/library/convolution.h"
+#include "tc/library/copy.h"
+#include "tc/library/dper_lut_concat.h"
+#include "tc/library/fcrelu.h"
+#include "tc/library/group_convolution.h"
+#include "tc/library/lut.h"
+#include "tc/library/matmul.h"
+
+#include "../test/test_harness_aten_cuda.h"
+#include "benchmark_fixture.h"
+
+// Compilation latency of the TCs of tc/library, phase by phase, from the TC
+// source to the CUDA module. Every iteration compiles from scratch: the
+// source is parsed again, so that Sema runs on a new tree, tc2halide is
+// timed without its translation cache and each compilation uses a new
+// ExecutionEngine. The compilation caches must not be loaded.
+DEFINE_uint32(
+    compile_iterations,
+    5,
+    "Number of compilations of each TC and options");
+
+namespace {
+const std::vector<std::string>& phaseNames() {
+  static const std::vector<std::string> names{"parse",
+                                              "sema",
+                                              "tc2halide",
+                                              "halide2isl",
+                                              "dependences",
+                                              "schedule",
+                                              "mapping",
+                                              "promotion",
+                                              "codegen",
+                                              "nvrtc"};
+  return names;
+}
+} // namespace
+
+class CompilationTime : public Benchmark {
+ public:
+  void runCompilation(
+      const std::string& tc,
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      const tc::CudaMappingOptions& options);
+};
+
+void CompilationTime::runCompilation(
+    const std::string& tc,
+    const std::string& name,
+    const std::vector<at::Tensor>& inputs,
+    const tc::CudaMappingOptions& options) {
+  CHECK(!tc::CudaCache::cacheEnabled() && !tc::ManualCudaCache::cacheEnabled())
+      << "cached kernels would not be compiled";
+  auto inputsPair = tc::toConstDlpackTensors(inputs);
+  tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+  auto serializedOptions = options.toProtobufSerializedString();
+
+  std::vector<std::vector<tc::Duration>> times(phaseNames().size());
+  std::vector<tc::Duration> totalTimes;
+  for (size_t i = 0; i < FLAGS_compile_iterations; ++i) {
+    std::vector<tc::Duration> phases(phaseNames().size(), tc::Duration::zero());
+    std::vector<lang::TreeRef> trees;
+    {
+      tc::ScopeTimer timer(phases[0]);
+      lang::Parser parser(tc);
+      while (parser.L.cur().kind != lang::TK_EOF) {
+        trees.push_back(parser.parseFunction());
+      }
+    }
+    lang::TreeRef def;
+    for (const auto& tree : trees) {
+      if (lang::Def(tree).name().name() == name) {
+        def = tree;
+      }
+    }
+    CHECK(def) << "No definition " << name;
+    {
+      // Cached for the new tree, tc2halide below does not check it again.
+      tc::ScopeTimer timer(phases[1]);
+      lang::checkCached(def);
+    }
+    {
+      tc::ScopeTimer timer(phases[2]);
+      tc2halide::translate(isl::with_exceptions::globalIslCtx(), def);
+    }
+
+    tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+    engine.define(trees);
+    auto handle = engine.compile(name, inputsPair.first, serializedOptions);
+    // The tc2halide phase of the executor may hit the translation cache,
+    // the uncached one is timed above.
+    auto timings = engine.timings(handle);
+    phases[3] = timings.halide2isl;
+    phases[4] = timings.dependences;
+    phases[5] = timings.schedule;
+    phases[6] = timings.mapping;
+    phases[7] = timings.promotion;
+    phases[8] = timings.codegen;
+    phases[9] = timings.nvrtc;
+
+    tc::Duration total = tc::Duration::zero();
+    for (size_t p = 0; p < phases.size(); ++p) {
+      times[p].push_back(phases[p]);
+      total += phases[p];
+    }
+    totalTimes.push_back(total);
+  }
+
+  auto p50 = [](std::vector<tc::Duration>& sortedTimes) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               sortedTimes.at(sortedTimes.size() / 2))
+        .count();
+  };
+  std::cout << "\n---------------------------------------------------------";
+  std::cout << "\n------------- COMPILATION TIME OF " << name << " (us)";
+  std::cout << "\n---------------------------------------------------------";
+  std::cout << "\n";
+  for (size_t p = 0; p < phaseNames().size(); ++p) {
+    std::sort(times[p].begin(), times[p].end());
+    std::cout << phaseNames()[p] << ": " << p50(times[p]) << "\n";
+    reportBenchmark(
+        "compile " + phaseNames()[p],
+        name,
+        inputs,
+        serializedOptions,
+        times[p]);
+  }
+  std::sort(totalTimes.begin(), totalTimes.end());
+  std::cout << "total: " << p50(totalTimes);
+  std::cout << "\n---------------------------------------------------------";
+  std::cout << "\n\n";
+  reportBenchmark("compile", name, inputs, serializedOptions, totalTimes);
+}
+
+TEST_F(CompilationTime, Matmul) {
+  for (auto sizes : std::vector<std::vector<int64_t>>{{128, 32, 256},
+                                                      {1024, 1024, 1024}}) {
+    at::Tensor A = at::CUDA(at::kFloat).rand({sizes[0], sizes[2]});
+    at::Tensor B = at::CUDA(at::kFloat).rand({sizes[2], sizes[1]});
+    for (auto options : {tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+                         tc::CudaMappingOptions::makeMlpCudaMappingOptions()}) {
+      runCompilation(tc::makeMatmulTc(), tc::TC_MATMUL_NAME, {A, B}, options);
+    }
+  }
+}
+
+TEST_F(CompilationTime, BatchMatmul) {
+  for (auto sizes : std::vector<std::vector<int64_t>>{{50, 26, 72, 26},
+                                                      {500, 26, 72, 26}}) {
+    at::Tensor X = at::CUDA(at::kFloat).rand({sizes[0], sizes[1], sizes[2]});
+    at::Tensor Y = at::CUDA(at::kFloat).rand({sizes[0], sizes[2], sizes[3]});
+    for (auto options : {tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+                         tc::CudaMappingOptions::makeMlpCudaMappingOptions()}) {
+      runCompilation(
+          tc::TC_BATCH_MATMUL, tc::TC_BATCH_MATMUL_NAME, {X, Y}, options);
+    }
+  }
+}
+
+TEST_F(CompilationTime, FullyConnected) {
+  // (B, M), then the output size of each of the 4 layers
+  for (auto sizes : std::vector<std::vector<int64_t>>{
+           {128, 1024, 1024, 1024, 1024, 1024}, {16, 128, 64, 32, 16, 8}}) {
+    std::vector<at::Tensor> inputs{
+        at::CUDA(at::kFloat).rand({sizes[0], sizes[1]})};
+    for (size_t l = 2; l < sizes.size(); ++l) {
+      inputs.push_back(at::CUDA(at::kFloat).rand({sizes[l], sizes[l - 1]}));
+      inputs.push_back(at::CUDA(at::kFloat).rand({sizes[l]}));
+    }
+    auto layers = [&](size_t n) {
+      return std::vector<at::Tensor>(
+          inputs.begin(), inputs.begin() + 1 + 2 * n);
+    };
+    for (auto options : {tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+                         tc::CudaMappingOptions::makeMlpCudaMappingOptions()}) {
+      runCompilation(tc::TC_FC, tc::TC_FC_NAME, layers(1), options);
+      runCompilation(tc::TC_FCRELU, tc::TC_FCRELU_NAME, layers(1), options);
+      runCompilation(tc::TC_2FCRELU, tc::TC_2FCRELU_NAME, layers(2), options);
+      runCompilation(tc::TC_3FCRELU, tc::TC_3FCRELU_NAME, layers(3), options);
+      runCompilation(tc::TC_4FCRELU, tc::TC_4FCRELU_NAME, layers(4), options);
+    }
+  }
+}
+
+TEST_F(CompilationTime, Convolution) {
+  // N, C, H, W, M, KH, KW
+  for (auto sizes : std::vector<std::vector<int64_t>>{
+           {32, 4, 56, 56, 16, 3, 3}, {32, 32, 7, 7, 32, 1, 1}}) {
+    at::Tensor I = at::CUDA(at::kFloat).rand(
+        {sizes[0], sizes[1], sizes[2], sizes[3]});
+    at::Tensor W = at::CUDA(at::kFloat).rand(
+        {sizes[4], sizes[1], sizes[5], sizes[6]});
+    at::Tensor B = at::CUDA(at::kFloat).rand({sizes[4]});
+    at::Tensor OGrad = at::CUDA(at::kFloat).rand(
+        {sizes[0], sizes[4], sizes[2], sizes[3]});
+    for (auto options :
+         {tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+          tc::CudaMappingOptions::makeConvolutionCudaMappingOptions()}) {
+      runCompilation(
+          tc::makeConvolution2DTc(1, 1),
+          tc::CONVOLUTION2D_TC_NAME,
+          {I, W, B},
+          options);
+      runCompilation(
+          tc::makeConvolution2DGradTc(1, 1),
+          tc::CONVOLUTION2D_GRAD_TC_NAME,
+          {I, W, OGrad},
+          options);
+    }
+  }
+}
+
+TEST_F(CompilationTime, GroupConvolution) {
+  // N, G, C, H, W, F, KH, KW
+  for (auto sizes : std::vector<std::vector<int64_t>>{
+           {32, 32, 4, 56, 56, 4, 3, 3}, {32, 32, 16, 14, 14, 16, 3, 3}}) {
+    at::Tensor I = at::CUDA(at::kFloat).rand(
+        {sizes[0], sizes[1], sizes[2], sizes[3], sizes[4]});
+    at::Tensor W = at::CUDA(at::kFloat).rand(
+        {sizes[1], sizes[5], sizes[2], sizes[6], sizes[7]});
+    at::Tensor B = at::CUDA(at::kFloat).rand({sizes[1], sizes[5]});
+    at::Tensor OGrad = at::CUDA(at::kFloat).rand(
+        {sizes[0], sizes[1], sizes[5], sizes[3], sizes[4]});
+    for (auto options :
+         {tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+          tc::CudaMappingOptions::makeGroupConvolutionCudaMappingOptions()}) {
+      runCompilation(
+          tc::makeGroupConvolution2DTc(1, 1),
+          tc::GROUP_CONVOLUTION2D_TC_NAME,
+          {I, W, B},
+          options);
+      runCompilation(
+          tc::makeGroupConvolution2DGradTc(1, 1),
+          tc::GROUP_CONVOLUTION2D_GRAD_TC_NAME,
+          {I, W, OGrad},
+          options);
+    }
+  }
+}
+
+TEST_F(CompilationTime, Copy) {
+  for (auto sizes : std::vector<std::vector<int64_t>>{
+           {1024}, {32, 32, 32}, {8, 16, 32, 64}}) {
+    at::Tensor I = at::CUDA(at::kFloat).rand(sizes);
+    for (auto options :
+         {tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+          tc::CudaMappingOptions::makePointwiseCudaMappingOptions()}) {
+      runCompilation(
+          tc::makeCopyTc(sizes.size()), tc::COPY_TC_NAME, {I}, options);
+      runCompilation(
+          tc::makeCopyGradTc(sizes.size()),
+          tc::COPY_GRAD_TC_NAME,
+          {I},
+          options);
+    }
+  }
+}
+
+TEST_F(CompilationTime, LookupTables) {
+  // B, L, E, D, M, N
+  for (auto sizes : std::vector<std::vector<int64_t>>{
+           {128, 50, 1000, 64, 128, 64}, {16, 5, 100, 16, 16, 16}}) {
+    auto B = sizes[0], L = sizes[1], E = sizes[2], D = sizes[3];
+    at::Tensor LUT1 = at::CUDA(at::kFloat).rand({E, D});
+    at::Tensor LUT2 = at::CUDA(at::kFloat).rand({E, D});
+    // Only the sizes matter, the kernels are not run.
+    at::Tensor I1 = at::CUDA(at::kInt).zeros({B, L});
+    at::Tensor I2 = at::CUDA(at::kInt).zeros({B, L});
+    at::Tensor I = at::CUDA(at::kFloat).rand({B, sizes[4]});
+    at::Tensor W = at::CUDA(at::kFloat).rand({sizes[5], sizes[4]});
+    at::Tensor Bias = at::CUDA(at::kFloat).rand({sizes[5]});
+    auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+    runCompilation(tc::TC_LUT, tc::TC_LUT_NAME, {LUT1, I1}, options);
+    runCompilation(
+        tc::TC_2LUT, tc::TC_2LUT_NAME, {LUT1, I1, LUT2, I2}, options);
+    runCompilation(
+        tc::TC_DPER_LUT_CONCAT,
+        tc::TC_DPER_LUT_CONCAT_NAME,
+        {I, I1, I2, W, Bias, LUT1, LUT2},
+        options);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  setAtenSeed(tc::initRandomSeed(), at::Backend::CUDA);
+  return RUN_ALL_TESTS();
+}
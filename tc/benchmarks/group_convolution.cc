@@ -147,6 +147,19 @@ def group_convolution(float(N,G,C,H,W) I, float(G,F,C,KH,KW) W1, float(G,F) B)
         checkFun);
   } else {
     std::vector<at::Tensor> outputs;
+    // the Caffe2 convolutions of the reference, with cuDNN grouped
+    // convolutions and with im2col and cuBLAS
+    OperatorDef cudnnDef = op_def;
+    cudnnDef.set_engine("CUDNN");
+    cudnnDef.set_output(0, "O_cudnn");
+    std::unique_ptr<OperatorBase> cudnnConv(CreateOperator(cudnnDef, &w));
+    ASSERT_TRUE(cudnnConv.get());
+    addBaseline("cuDNN", [&]() { cudnnConv->Run(); });
+    OperatorDef im2colDef = op_def;
+    im2colDef.set_output(0, "O_im2col");
+    std::unique_ptr<OperatorBase> im2colConv(CreateOperator(im2colDef, &w));
+    ASSERT_TRUE(im2colConv.get());
+    addBaseline("cuBLAS", [&]() { im2colConv->Run(); });
     Check(tc, "group_convolution", options, inputs, outputs, checkFun);
     if (useFlags) {
       autotune(
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+# Copyright (c) 2017-present, Facebook, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+##############################################################################
+
+# Compares the records the benchmarks append to --benchmark_report against
+# the ones of a baseline run, e.g., before a TC upgrade, and exits with
+# status 1 if a measurement regressed.
+#
+# Run with:
+# ./tc/benchmarks/scripts/compare_benchmarks.py baseline.json current.json
+
+import argparse
+import json
+import sys
+
+
+def load(filename):
+    # The last record of a measurement wins, reports are appended to.
+    records = {}
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            record = json.loads(line)
+            # Cold and warm cache measurements are not compared.
+            device = record["device"]
+            if record.get("cold_cache"):
+                device += " (cold L2)"
+            key = (record["test"], record["kind"], record["name"],
+                   json.dumps(record["sizes"]), device)
+            records[key] = record
+    return records
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Flags the benchmark regressions against a baseline")
+    parser.add_argument("baseline", help="report of the baseline run")
+    parser.add_argument("current", help="report of the run to check")
+    parser.add_argument(
+        "--metric", default="p50_us",
+        help="time compared, one of min_us, p50_us, p90_us, p99_us, max_us")
+    parser.add_argument(
+        "--threshold", type=float, default=0.05,
+        help="relative slowdown above which a measurement regressed")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+    for key in sorted(current):
+        test, kind, name, sizes, device = key
+        record = current[key]
+        line = "{} [{}] {} {} on {}: {}us".format(
+            test, kind, name, sizes, device, record[args.metric])
+        if key not in baseline:
+            print(line + " (new)")
+            continue
+        before = baseline[key][args.metric]
+        ratio = float(record[args.metric]) / before if before > 0 else 1.0
+        line += " vs {}us ({:+.1f}%)".format(before, 100 * (ratio - 1))
+        if baseline[key]["version"] != record["version"]:
+            line += " {} -> {}".format(
+                baseline[key]["version"], record["version"])
+        if record.get("throttled") or baseline[key].get("throttled"):
+            line += " (throttled clocks)"
+        if ratio > 1 + args.threshold:
+            regressions += 1
+            line += " REGRESSION"
+        print(line)
+    for key in sorted(set(baseline) - set(current)):
+        print("{} [{}] {} {} on {}: missing".format(*key))
+
+    # TC kernels compared to their reference implementation, per test
+    for key in sorted(current):
+        test, kind, name, sizes, device = key
+        reference = current.get((test, "reference", "", "[]", device))
+        if kind == "kernel" and reference and reference[args.metric] > 0:
+            print("{} {}: {:.2f}x the reference time".format(
+                test, name,
+                float(current[key][args.metric]) / reference[args.metric]))
+
+    if regressions:
+        print("{} regressions above {:.0f}%".format(
+            regressions, 100 * args.threshold))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
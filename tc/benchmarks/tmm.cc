@@ -90,6 +90,8 @@ def tmm(float(M,K) A, float(N,K) B) -> (C) {
         checkFun);
   } else {
     std::vector<at::Tensor> outputs;
+    auto res = at::mm(A, B.t());
+    addBaseline("cuBLAS", [=]() mutable { at::mm_out(res, A, B.t()); });
     Check(tc, "tmm", options, inputs, outputs, checkFun);
     if (useFlags) {
       autotune(
@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <ATen/ATen.h>
+
+#include "tc/autotuner/genetic_autotuner_aten.h"
+#include "tc/autotuner/utils/progress.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/time.h"
+#include "tc/library/2lut.h"
+#include "tc/library/convolution.h"
+#include "tc/library/fcrelu.h"
+#include "tc/library/matmul.h"
+
+#include "../test/test_harness_aten_cuda.h"
+#include "benchmark_fixture.h"
+
+// Efficiency of the autotuner on TCs of tc/library: each TC is tuned from
+// scratch once per seed of --tuner_efficiency_seeds, with the search RNG
+// restored from that seed, and the best runtime so far is sampled during
+// the tuning against the elapsed time and the number of evaluated
+// candidates.  The time and the candidates until the best runtime is within
+// 90% of the best of all seeds summarize a curve, changes to the search,
+// the pruning or the pipelining should lower them.  The tuning itself is
+// configured with the usual --tuner_* flags.
+DEFINE_string(
+    tuner_efficiency_seeds,
+    "1,2,3",
+    "Comma-separated seeds of the search RNG, one tuning of each TC per seed");
+DEFINE_string(
+    tuner_efficiency_curves,
+    "",
+    "If set, the best-so-far curve of each tuning is appended to this file as one JSON record per line");
+DEFINE_uint32(
+    tuner_efficiency_poll_ms,
+    50,
+    "Period of the sampling of the best runtime during a tuning");
+
+namespace {
+std::vector<uint64_t> parseSeeds(const std::string& list) {
+  std::vector<uint64_t> res;
+  std::stringstream ss(list);
+  for (std::string item; std::getline(ss, item, ',');) {
+    res.push_back(std::stoull(item));
+  }
+  return res;
+}
+
+// The state of the search RNG seeded with seed, in the format of
+// --tuner_rng_restore
+std::string rngState(uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::stringstream ss;
+  ss << rng;
+  return ss.str();
+}
+
+struct CurvePoint {
+  tc::Duration elapsed;
+  size_t evaluated;
+  tc::Duration best;
+};
+} // namespace
+
+class TunerEfficiency : public Benchmark {
+ public:
+  void runTuning(
+      const std::string& tc,
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      const tc::CudaMappingOptions& baseMapping);
+};
+
+void TunerEfficiency::runTuning(
+    const std::string& tc,
+    const std::string& name,
+    const std::vector<at::Tensor>& inputs,
+    const tc::CudaMappingOptions& baseMapping) {
+  auto seeds = parseSeeds(FLAGS_tuner_efficiency_seeds);
+  CHECK(!seeds.empty()) << "no seed in --tuner_efficiency_seeds";
+  auto savedRngState = tc::FLAGS_tuner_rng_restore;
+
+  std::vector<std::vector<CurvePoint>> curves;
+  for (auto seed : seeds) {
+    tc::FLAGS_tuner_rng_restore = rngState(seed);
+    tc::autotune::GeneticAutotunerATen tuner(tc);
+    std::vector<CurvePoint> curve;
+    auto sample = [&]() {
+      auto snapshot = tuner.progress();
+      if (snapshot.best == tc::Duration::max()) {
+        return;
+      }
+      if (curve.empty() or snapshot.best < curve.back().best) {
+        curve.push_back(
+            CurvePoint{snapshot.elapsed, snapshot.evaluated, snapshot.best});
+      }
+    };
+    // From another thread, progress does not wait for the tuning
+    std::atomic<bool> done{false};
+    std::thread poller([&]() {
+      while (not done) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(FLAGS_tuner_efficiency_poll_ms));
+        sample();
+      }
+    });
+    // No cache file: every seed tunes from an empty options cache
+    tuner.tune("", name, inputs, baseMapping, {baseMapping});
+    done = true;
+    poller.join();
+    sample();
+    curves.push_back(std::move(curve));
+  }
+  tc::FLAGS_tuner_rng_restore = savedRngState;
+
+  auto best = tc::Duration::max();
+  for (const auto& curve : curves) {
+    if (!curve.empty()) {
+      best = std::min(best, curve.back().best);
+    }
+  }
+  CHECK(best != tc::Duration::max()) << "no valid candidate for " << name;
+
+  std::cout << "\n---------------------------------------------------------";
+  std::cout << "\n------------- TUNER EFFICIENCY OF " << name;
+  std::cout << "\n---------------------------------------------------------";
+  std::cout << "\n";
+  std::cout << "best: " << tc::toMicroseconds(best) << "us\n";
+  std::vector<tc::Duration> timesTo90;
+  for (size_t s = 0; s < seeds.size(); ++s) {
+    const auto& curve = curves[s];
+    // Within 90% of the best performance: runtime <= best / 0.9
+    auto reached = std::find_if(
+        curve.begin(), curve.end(), [best](const CurvePoint& p) {
+          return p.best * 9 <= best * 10;
+        });
+    std::cout << "seed " << seeds[s] << ": best "
+              << (curve.empty() ? -1 : tc::toMicroseconds(curve.back().best))
+              << "us";
+    if (reached != curve.end()) {
+      timesTo90.push_back(reached->elapsed);
+      std::cout << ", 90% of best after "
+                << tc::toMicroseconds(reached->elapsed) / 1000 << "ms and "
+                << reached->evaluated << " candidates";
+    } else {
+      std::cout << ", never within 90% of best";
+    }
+    std::cout << "\n";
+
+    if (!FLAGS_tuner_efficiency_curves.empty()) {
+      std::ofstream out(FLAGS_tuner_efficiency_curves, std::ios::app);
+      CHECK(out) << "could not open " << FLAGS_tuner_efficiency_curves;
+      out << "{\"name\": " << detail::jsonString(name)
+          << ", \"seed\": " << seeds[s]
+          << ", \"version\": " << detail::jsonString(tc::git_version)
+          << ", \"device\": "
+          << detail::jsonString(
+                 tc::CudaGPUInfo::GPUInfo().GetCudaDeviceStr())
+          << ", \"best_us\": " << tc::toMicroseconds(best)
+          << ", \"points\": [";
+      for (size_t i = 0; i < curve.size(); ++i) {
+        out << (i > 0 ? ", " : "") << "{\"elapsed_us\": "
+            << tc::toMicroseconds(curve[i].elapsed)
+            << ", \"evaluated\": " << curve[i].evaluated
+            << ", \"best_us\": " << tc::toMicroseconds(curve[i].best) << "}";
+      }
+      out << "]}\n";
+    }
+  }
+  std::cout << "---------------------------------------------------------";
+  std::cout << "\n\n";
+
+  std::sort(timesTo90.begin(), timesTo90.end());
+  reportBenchmark("tuning time to 90% of best", name, inputs, "", timesTo90);
+}
+
+TEST_F(TunerEfficiency, Matmul) {
+  at::Tensor A = at::CUDA(at::kFloat).rand({128, 256});
+  at::Tensor B = at::CUDA(at::kFloat).rand({256, 32});
+  runTuning(
+      tc::makeMatmulTc(),
+      tc::TC_MATMUL_NAME,
+      {A, B},
+      tc::CudaMappingOptions::makeMlpCudaMappingOptions());
+}
+
+TEST_F(TunerEfficiency, FCRelu) {
+  at::Tensor I = at::CUDA(at::kFloat).rand({128, 1024});
+  at::Tensor W = at::CUDA(at::kFloat).rand({1024, 1024});
+  at::Tensor B = at::CUDA(at::kFloat).rand({1024});
+  runTuning(
+      tc::TC_FCRELU,
+      tc::TC_FCRELU_NAME,
+      {I, W, B},
+      tc::CudaMappingOptions::makeMlpCudaMappingOptions());
+}
+
+TEST_F(TunerEfficiency, Convolution) {
+  at::Tensor I = at::CUDA(at::kFloat).rand({32, 4, 56, 56});
+  at::Tensor W = at::CUDA(at::kFloat).rand({16, 4, 3, 3});
+  at::Tensor B = at::CUDA(at::kFloat).rand({16});
+  runTuning(
+      tc::makeConvolution2DTc(1, 1),
+      tc::CONVOLUTION2D_TC_NAME,
+      {I, W, B},
+      tc::CudaMappingOptions::makeConvolutionCudaMappingOptions());
+}
+
+TEST_F(TunerEfficiency, LookupTables) {
+  int64_t B = 128, L = 50, E = 1000, D = 64;
+  at::Tensor LUT1 = at::CUDA(at::kFloat).rand({E, D});
+  at::Tensor LUT2 = at::CUDA(at::kFloat).rand({E, D});
+  at::Tensor I1 =
+      at::CUDA(at::kFloat).rand({B, L}).mul_(E).floor_().toType(at::kInt);
+  at::Tensor I2 =
+      at::CUDA(at::kFloat).rand({B, L}).mul_(E).floor_().toType(at::kInt);
+  runTuning(
+      tc::TC_2LUT,
+      tc::TC_2LUT_NAME,
+      {LUT1, I1, LUT2, I2},
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  setAtenSeed(tc::initRandomSeed(), at::Backend::CUDA);
+  return RUN_ALL_TESTS();
+}
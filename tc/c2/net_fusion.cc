@@ -0,0 +1,263 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/c2/net_fusion.h"
+
+#include <functional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/proto_utils.h"
+
+#include "tc/lang/parser.h"
+#include "tc/lang/pipeline.h"
+#include "tc/lang/tc_format.h"
+#include "tc/lang/tree_views.h"
+#include "tc/library/fcrelu.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Blobs may be written several times, e.g., by in-place operators, so the
+// values the operators read and write are named by blob and version, in
+// the form blob#version.  The uses of each value are counted, the final
+// values of the external outputs count as used.
+struct Values {
+  explicit Values(const NetDef& net) {
+    std::unordered_map<std::string, int> versions;
+    auto value = [&](const std::string& blob) {
+      return blob + "#" + std::to_string(versions[blob]);
+    };
+    for (const auto& op : net.op()) {
+      std::vector<std::string> opReads;
+      for (const auto& blob : op.input()) {
+        opReads.push_back(value(blob));
+        ++uses[opReads.back()];
+      }
+      std::vector<std::string> opWrites;
+      for (const auto& blob : op.output()) {
+        ++versions[blob];
+        opWrites.push_back(value(blob));
+      }
+      reads.push_back(std::move(opReads));
+      writes.push_back(std::move(opWrites));
+    }
+    for (const auto& blob : net.external_output()) {
+      ++uses[value(blob)];
+    }
+  }
+
+  // Whether the value is only read by one operator input and is not an
+  // external output, i.e., whether it need not be computed if that
+  // operator is fused with the one writing it.
+  bool usedOnce(const std::string& value) const {
+    auto it = uses.find(value);
+    return it != uses.end() && it->second == 1;
+  }
+
+  static std::string blob(const std::string& value) {
+    return value.substr(0, value.rfind('#'));
+  }
+
+  std::vector<std::vector<std::string>> reads;
+  std::vector<std::vector<std::string>> writes;
+  std::unordered_map<std::string, int> uses;
+};
+
+// Consecutive operators mapped to a library TC, whose parameters are the
+// values "inputs" and whose single output is the value "output".
+struct FusibleUnit {
+  const char* tc;
+  std::vector<std::string> inputs;
+  std::string output;
+  int firstOp;
+  int lastOp;
+};
+
+bool isPlainFC(const OperatorDef& op) {
+  if (op.type() != "FC" || op.input_size() != 3 || op.output_size() != 1) {
+    return false;
+  }
+  // The library TCs multiply matrices, inputs of higher rank flattened
+  // along other axes are not supported.
+  for (const auto& arg : op.arg()) {
+    if ((arg.name() == "axis" || arg.name() == "axis_w") && arg.i() != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The unit starting at the operator "i" of net, if any.
+bool matchUnit(
+    const NetDef& net,
+    const Values& values,
+    int i,
+    FusibleUnit* unit) {
+  if (!isPlainFC(net.op(i))) {
+    return false;
+  }
+  unit->tc = tc::TC_FC;
+  unit->inputs = values.reads[i];
+  unit->output = values.writes[i][0];
+  unit->firstOp = unit->lastOp = i;
+  if (i + 1 < net.op_size()) {
+    const auto& next = net.op(i + 1);
+    if (next.type() == "Relu" && next.input_size() == 1 &&
+        next.output_size() == 1 && values.reads[i + 1][0] == unit->output &&
+        values.usedOnce(unit->output)) {
+      unit->tc = tc::TC_FCRELU;
+      unit->output = values.writes[i + 1][0];
+      unit->lastOp = i + 1;
+    }
+  }
+  return true;
+}
+
+// The definition of the library TC of "unit", whose parameters and output
+// are renamed after the identifiers of their values in "idents" and whose
+// other identifiers (sizes, indices and temporaries) are suffixed with
+// "suffix", so that the definitions of a chain can be inlined into one
+// another (see lang::inlinePipeline).
+lang::TreeRef instantiate(
+    const FusibleUnit& unit,
+    const std::string& suffix,
+    const std::function<std::string(const std::string&)>& ident) {
+  lang::Def def(lang::Parser(unit.tc).parseFunction());
+  CAFFE_ENFORCE_EQ(def.params().size(), unit.inputs.size());
+  CAFFE_ENFORCE_EQ(def.returns().size(), 1);
+  std::unordered_map<std::string, std::string> renames;
+  for (size_t i = 0; i < unit.inputs.size(); ++i) {
+    renames[def.params()[i].ident().name()] = ident(unit.inputs[i]);
+  }
+  renames[def.returns()[0].ident().name()] = ident(unit.output);
+  std::unordered_set<std::string> tensors;
+  for (const auto& stmt : def.statements()) {
+    tensors.insert(stmt.ident().name());
+  }
+
+  std::function<lang::TreeRef(lang::TreeRef)> rename =
+      [&](lang::TreeRef node) -> lang::TreeRef {
+    if (node->kind() == lang::TK_APPLY) {
+      // the callees of built-in functions keep their names
+      lang::Apply apply(node);
+      auto callee = apply.name().tree();
+      if (tensors.count(apply.name().name()) > 0 ||
+          renames.count(apply.name().name()) > 0) {
+        callee = rename(callee);
+      }
+      return lang::Apply::create(
+          node->range(), callee, rename(apply.arguments().tree()));
+    }
+    if (node->kind() == lang::TK_IDENT) {
+      auto name = lang::Ident(node).name();
+      auto it = renames.find(name);
+      return lang::Ident::create(
+          node->range(), it != renames.end() ? it->second : name + suffix);
+    }
+    return node->map(rename);
+  };
+  return rename(def.tree());
+}
+
+// The TcOp running the chain "units" as a single TC called "name".
+OperatorDef fuse(
+    const NetDef& net,
+    const std::vector<FusibleUnit>& units,
+    const std::string& name,
+    const std::vector<Argument>& extraArgs) {
+  // Blob names need not be valid TC identifiers, the values are named
+  // after their position instead.
+  std::unordered_map<std::string, std::string> idents;
+  std::unordered_map<std::string, std::string> valuesOfIdents;
+  auto ident = [&](const std::string& value) -> std::string {
+    auto it = idents.find(value);
+    if (it != idents.end()) {
+      return it->second;
+    }
+    auto id = "T" + std::to_string(idents.size());
+    valuesOfIdents[id] = value;
+    return idents.emplace(value, id).first->second;
+  };
+  std::vector<lang::TreeRef> defs;
+  for (size_t i = 0; i < units.size(); ++i) {
+    defs.push_back(instantiate(units[i], "_" + std::to_string(i), ident));
+  }
+  lang::Def pipeline(lang::inlinePipeline(name, defs));
+  std::stringstream source;
+  lang::tcFormat(source, pipeline.tree());
+
+  const auto& first = net.op(units.front().firstOp);
+  OperatorDef op;
+  op.set_type("TcOp");
+  op.set_name(name);
+  for (const auto& param : pipeline.params()) {
+    op.add_input(Values::blob(valuesOfIdents.at(param.ident().name())));
+  }
+  for (const auto& ret : pipeline.returns()) {
+    op.add_output(Values::blob(valuesOfIdents.at(ret.ident().name())));
+  }
+  if (first.has_device_option()) {
+    op.mutable_device_option()->CopyFrom(first.device_option());
+  }
+  *op.add_arg() = MakeArgument<std::string>("tcDef", source.str());
+  *op.add_arg() = MakeArgument<std::string>("tcName", name);
+  for (const auto& arg : extraArgs) {
+    *op.add_arg() = arg;
+  }
+  return op;
+}
+} // namespace
+
+NetDef fuseTcSubgraphs(
+    const NetDef& net,
+    const std::vector<Argument>& extraArgs) {
+  Values values(net);
+  NetDef fused(net);
+  fused.clear_op();
+  int numFused = 0;
+  int i = 0;
+  while (i < net.op_size()) {
+    std::vector<FusibleUnit> chain;
+    FusibleUnit unit;
+    int next = i;
+    while (next < net.op_size() && matchUnit(net, values, next, &unit)) {
+      if (!chain.empty() &&
+          (unit.inputs[0] != chain.back().output ||
+           !values.usedOnce(chain.back().output))) {
+        break;
+      }
+      chain.push_back(unit);
+      next = unit.lastOp + 1;
+    }
+    if (chain.empty() || chain.back().lastOp == chain.front().firstOp) {
+      fused.add_op()->CopyFrom(net.op(i));
+      ++i;
+      continue;
+    }
+    auto name = "fused_tc_" + std::to_string(numFused++);
+    fused.add_op()->CopyFrom(fuse(net, chain, name, extraArgs));
+    LOG(INFO) << "Fused operators " << chain.front().firstOp << " to "
+              << chain.back().lastOp << " into " << name;
+    i = chain.back().lastOp + 1;
+  }
+  return fused;
+}
+
+} // namespace caffe2
@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <vector>
+
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+/// Rewrite the chains of fusible operators of net into generic TcOp
+/// operators, each running a single TC built from the templates of
+/// tc/library, so that a chain is compiled (and cached) as a single kernel.
+/// The operators of a chain are consecutive in net, each one reads the
+/// output of the previous one as its first input and no other operator
+/// reads the intermediate results, which are not external outputs.
+/// The fusible operators are FC, optionally followed by a Relu of its
+/// output, on 2-D inputs as in the library TCs; chains of a single FC are
+/// left as is.  The arguments extraArgs (e.g., optionsCacheFile or
+/// autotune) are added to the TcOp operators.
+NetDef fuseTcSubgraphs(
+    const NetDef& net,
+    const std::vector<Argument>& extraArgs = {});
+
+} // namespace caffe2
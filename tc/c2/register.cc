@@ -27,6 +27,7 @@
 #include "tc/c2/lut_op.h"
 #include "tc/c2/matmul_op.h"
 #include "tc/c2/tc_op.h"
+#include "tc/c2/tc_subgraph_op.h"
 
 #include "tc/c2/operator_meta.h"
 
@@ -359,4 +360,13 @@ TC_REFERENCE_IMPLEMENTATION(
 REGISTER_CUDA_OPERATOR(TcOp, TcOp<float, CUDAContext>);
 REGISTER_GRADIENT(TcOp, GetTcOpGradient);
 OPERATOR_SCHEMA(TcOp).SetDoc(R"DOC(Generic Op using CudaExecutionEngine)DOC");
+
+REGISTER_CUDA_OPERATOR(TcSubgraph, TcSubgraphOp<float, CUDAContext>);
+REGISTER_GRADIENT(TcSubgraph, GetTcSubgraphGradient);
+OPERATOR_SCHEMA(TcSubgraph).SetDoc(R"DOC(
+Runs the chain of TC definitions tcNames of tcDef (all of them by default) as
+a single TC called tcName, the definitions are connected by the names of
+their parameters. The inputs are the inputs of the chain, in order of first
+appearance, the outputs are the outputs of the last definition.
+)DOC");
 }; // namespace caffe2
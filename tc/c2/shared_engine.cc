@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/c2/shared_engine.h"
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "caffe2/core/logging.h"
+
+#include "tc/autotuner/genetic_autotuner.h"
+#include "tc/autotuner/genetic_tuning_harness.h"
+#include "tc/autotuner/parameters.h"
+#include "tc/autotuner/utils/utils.h"
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/memory.h"
+#include "tc/lang/canonicalize.h"
+#include "tc/lang/parse_cache.h"
+#include "tc/lang/tree_views.h"
+
+namespace caffe2 {
+
+tc::ExecutionEngine<tc::CudaTcExecutor>& sharedCudaExecutionEngine() {
+  static auto& engine = *new tc::ExecutionEngine<tc::CudaTcExecutor>();
+  return engine;
+}
+
+std::string defineShared(const std::string& source, const std::string& name) {
+  static std::mutex mutex;
+  static auto& names =
+      *new std::map<std::pair<std::string, std::string>, std::string>();
+  static auto& canonicalNames = *new std::map<std::string, std::string>();
+  std::lock_guard<std::mutex> lock(mutex);
+  auto key = std::make_pair(source, name);
+  auto it = names.find(key);
+  if (it != names.end()) {
+    return it->second;
+  }
+
+  for (const auto& ref : lang::parseCached(source)) {
+    lang::Def def(ref);
+    if (def.name().name() != name) {
+      continue;
+    }
+    // The same TC in another source, or under another name, e.g. that of a
+    // shape manifest.
+    std::string canonical = lang::canonicalTc(ref);
+    auto defined = canonicalNames.find(canonical);
+    if (defined != canonicalNames.end()) {
+      return names.emplace(key, defined->second).first->second;
+    }
+    // The generated names are distinct since they end with distinct
+    // indices.
+    auto sharedName = name + "_" + std::to_string(names.size());
+    auto renamed = lang::Def::create(
+        def.range(),
+        lang::Ident::create(def.name().range(), sharedName),
+        def.params().tree(),
+        def.returns().tree(),
+        def.statements().tree());
+    sharedCudaExecutionEngine().define(std::vector<lang::TreeRef>{renamed});
+    canonicalNames.emplace(canonical, sharedName);
+    return names.emplace(key, sharedName).first->second;
+  }
+  CAFFE_THROW("TC ", name, " is not defined in ", source);
+}
+
+void replaySharedShapeManifest(const std::string& filename, uint64_t minRuns) {
+  auto& engine = sharedCudaExecutionEngine();
+  auto manifest = engine.readShapeManifest(filename);
+  // The shared names of a previous process may be those of other TCs here.
+  for (auto& entry : *manifest.mutable_entries()) {
+    entry.set_name(defineShared(entry.tc(), entry.name()));
+  }
+  auto handles = engine.replayShapeManifest(manifest, minRuns);
+  LOG(INFO) << "compiled " << handles.size() << " kernels of the shape "
+            << "manifest " << filename;
+}
+
+void loadSharedOptionsCache(const std::string& filename) {
+  static std::mutex mutex;
+  static auto& loaded = *new std::string();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (loaded.empty()) {
+    tc::OptionsCache::loadCacheFromProtobuf(tc::makeOptionsFilename(filename));
+    loaded = filename;
+  } else if (loaded != filename) {
+    LOG(WARNING) << "options cache " << loaded << " already loaded, "
+                 << filename << " ignored";
+  }
+}
+
+namespace {
+
+size_t sizeInBytes(const DLTensor& t) {
+  size_t size = t.dtype.bits / 8 * t.dtype.lanes;
+  for (int i = 0; i < t.ndim; ++i) {
+    size *= t.shape[i];
+  }
+  return size;
+}
+
+// Device buffers holding copies of the tensors a tuning job runs on, which
+// must outlive the operator run that started it.
+struct TuningTensors {
+  std::vector<tc::dlutils::DLTensorUPtr> inputs;
+  std::vector<tc::dlutils::DLTensorUPtr> outputs;
+
+  ~TuningTensors() {
+    for (const auto& t : inputs) {
+      cudaFree(t->data);
+    }
+    for (const auto& t : outputs) {
+      cudaFree(t->data);
+    }
+  }
+};
+
+std::unique_ptr<TuningTensors> makeTuningTensors(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputsInfo,
+    cudaStream_t stream) {
+  auto tensors = tc::make_unique<TuningTensors>();
+  for (auto input : inputs) {
+    tensors->inputs.push_back(tc::dlutils::makeDLTensor(input));
+    auto& copy = tensors->inputs.back();
+    copy->data = nullptr;
+    copy->byte_offset = 0;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&copy->data, sizeInBytes(*input)));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+        copy->data,
+        static_cast<const char*>(input->data) + input->byte_offset,
+        sizeInBytes(*input),
+        cudaMemcpyDeviceToDevice,
+        stream));
+  }
+  for (auto info : outputsInfo) {
+    tensors->outputs.push_back(tc::dlutils::makeDLTensor(info));
+    auto& output = tensors->outputs.back();
+    output->data = nullptr;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&output->data, sizeInBytes(*info)));
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream));
+  return tensors;
+}
+
+std::string tuningKey(
+    const std::string& sharedName,
+    const std::vector<const DLTensor*>& inputs) {
+  std::stringstream key;
+  key << sharedName;
+  for (auto input : inputs) {
+    key << " " << tc::dlutils::toString(input->dtype);
+    for (auto stride : tc::dlutils::getStrides(*input)) {
+      key << ":" << stride;
+    }
+    for (int i = 0; i < input->ndim; ++i) {
+      key << "," << input->shape[i];
+    }
+  }
+  return key.str();
+}
+} // namespace
+
+std::shared_ptr<const TuningResult> tuneInBackground(
+    const std::string& source,
+    const std::string& name,
+    const std::string& sharedName,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputsInfo,
+    const tc::CudaMappingOptions& baseOptions,
+    const std::string& cacheFile,
+    std::chrono::seconds timeBudget,
+    cudaStream_t stream) {
+  static std::mutex mutex;
+  static auto& jobs =
+      *new std::unordered_map<std::string, std::shared_ptr<TuningResult>>();
+  auto key = tuningKey(sharedName, inputs);
+  std::shared_ptr<TuningResult> result;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = jobs.find(key);
+    if (it != jobs.end()) {
+      return it->second;
+    }
+    result = std::make_shared<TuningResult>();
+    jobs.emplace(key, result);
+  }
+
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  std::shared_ptr<TuningTensors> tensors =
+      makeTuningTensors(inputs, outputsInfo, stream);
+  std::thread([=]() {
+    // the autotuner is not reentrant
+    static std::mutex tuningMutex;
+    std::lock_guard<std::mutex> lock(tuningMutex);
+    try {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaSetDevice(device));
+      auto gpus = tc::autotune::detail::parseGpus();
+      if (gpus.size() != 1 || gpus[0] != static_cast<size_t>(device)) {
+        LOG(WARNING) << "not tuning " << name << ": --tuner_gpus must only "
+                     << "name the device of the operator, " << device;
+      } else {
+        auto inputPtrs = tc::dlutils::extractRawPtrs(tensors->inputs);
+        std::vector<DLTensor*> outputPtrs;
+        for (const auto& t : tensors->outputs) {
+          outputPtrs.push_back(t.get());
+        }
+        std::unordered_map<size_t, std::vector<const DLTensor*>> in{
+            {gpus[0], inputPtrs}};
+        std::unordered_map<size_t, std::vector<DLTensor*>> out{
+            {gpus[0], outputPtrs}};
+        auto stopCriteria = tc::autotune::TuningStopCriteria::fromFlags();
+        stopCriteria.timeBudget = timeBudget;
+        tc::autotune::detail::GeneticAutotuner tuner(source);
+        auto best = tuner.tune(
+            cacheFile,
+            name,
+            in,
+            out,
+            baseOptions,
+            {},
+            tc::autotune::TuningParameterFixer(),
+            tc::autotune::CostModelOptions(),
+            stopCriteria);
+        if (best) {
+          result->handle = sharedCudaExecutionEngine().compile(
+              sharedName, inputPtrs, best->toProtobufSerializedString());
+          result->tuned = true;
+        }
+      }
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "tuning " << name << " failed: " << e.what();
+    }
+    result->done = true;
+  }).detach();
+  return result;
+}
+
+} // namespace caffe2
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime_api.h>
+#include <dlpack/dlpack.h>
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+
+namespace caffe2 {
+
+/// The ExecutionEngine shared by all the TcOp instances of the process, so
+/// that the operators running the same TC, across nets and threads, share
+/// its compiled kernels.  It is never destroyed, the kernels live as long
+/// as the process.
+tc::ExecutionEngine<tc::CudaTcExecutor>& sharedCudaExecutionEngine();
+
+/// Define the TC called name in source in the shared engine and return the
+/// name it is defined under there, which is the same for all the callers
+/// passing the same TC, up to the choice of its identifiers (see
+/// lang::canonicalTc).  Different TCs of the same name are defined under
+/// different names, they do not clash.
+std::string defineShared(const std::string& source, const std::string& name);
+
+/// Compile in the shared engine the kernels of the shape manifest in
+/// filename run at least minRuns times, e.g. one the shared engine wrote
+/// before a restart (see ExecutionEngine::recordShapeManifest and
+/// writeShapeManifest), so that the operators find them compiled on their
+/// first run.  The TCs of the manifest are defined with defineShared, the
+/// operators running them get the same shared names.
+void replaySharedShapeManifest(
+    const std::string& filename,
+    uint64_t minRuns = 1);
+
+/// Load the options cache of the process from filename, the prefix the
+/// autotuner stores its caches under (see tc::makeOptionsFilename), unless
+/// it was already loaded.  The cache is process-wide, the first file loaded
+/// wins and later calls with another file are ignored with a warning.
+void loadSharedOptionsCache(const std::string& filename);
+
+/// The outcome of a background tuning job, shared by the operators waiting
+/// for it.  handle and tuned are set before done.
+struct TuningResult {
+  std::atomic<bool> done{false};
+  /// Whether the autotuner found options, compiled into handle.
+  bool tuned = false;
+  size_t handle = 0;
+};
+
+/// Tune the TC called name in source, defined under sharedName in the shared
+/// engine, for the shapes of inputs on a background thread, starting from
+/// baseOptions and stopping after timeBudget.  The inputs are copied on
+/// stream first, so they may be modified as soon as this returns.  The
+/// tuned options are stored in cacheFile and compiled into the shared
+/// engine.  A single job runs at a time since the autotuner uses
+/// process-wide flags and caches; the callers passing the same TC and
+/// shapes share the job, and its result.
+std::shared_ptr<const TuningResult> tuneInBackground(
+    const std::string& source,
+    const std::string& name,
+    const std::string& sharedName,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputsInfo,
+    const tc::CudaMappingOptions& baseOptions,
+    const std::string& cacheFile,
+    std::chrono::seconds timeBudget,
+    cudaStream_t stream);
+
+} // namespace caffe2
@@ -15,18 +15,23 @@
  */
 #pragma once
 
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_compilation_cache.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/execution_engine.h"
 #include "tc/core/utils/dlpack.h"
+#include "tc/lang/canonicalize.h"
 
 #include "tc/c2/context.h"
 #include "tc/c2/dlpack_c2.h"
+#include "tc/c2/shared_engine.h"
 
 #include "caffe2/core/common.h"
 #include "caffe2/utils/math.h"
@@ -50,8 +55,14 @@ class TcOp : public Operator<Context> {
     gradTcName_ =
         OperatorBase::GetSingleArgument<std::string>("tcGradName", "ERROR");
     profile_ = OperatorBase::GetSingleArgument<bool>("profile", false);
+    optionsCacheFile_ =
+        OperatorBase::GetSingleArgument<std::string>("optionsCacheFile", "");
+    autotune_ = OperatorBase::GetSingleArgument<bool>("autotune", false);
+    tuningTimeBudget_ = std::chrono::seconds(
+        OperatorBase::GetSingleArgument<int>("tuningTimeBudgetS", 60));
     ArgumentHelper args(operator_def);
-    if (args.HasArgument("mappingOptions")) {
+    explicitMappingOptions_ = args.HasArgument("mappingOptions");
+    if (explicitMappingOptions_) {
       cudaMappingOptions_ = tc::CudaMappingOptions(
           args.GetSingleArgument<std::string>("mappingOptions", "ERROR"));
     } else {
@@ -65,8 +76,6 @@ class TcOp : public Operator<Context> {
     } else {
       setupDefaultGradCudaMappingOptions();
     }
-    executionEngine_ = std::unique_ptr<tc::ExecutionEngine<tc::CudaTcExecutor>>(
-        new tc::ExecutionEngine<tc::CudaTcExecutor>());
   }
 
   USE_OPERATOR_CONTEXT_FUNCTIONS;
@@ -84,49 +93,128 @@ class TcOp : public Operator<Context> {
   /// reimplement this to customize stategies.
   virtual void setupDefaultGradCudaMappingOptions() {}
 
-  void prepareOutputs(const std::vector<const DLTensor*> tensorInfo) {
-    for (int i = 0; i < tensorInfo.size(); ++i) {
-      auto info = tensorInfo[i];
-      std::vector<int64_t> shape(info->shape, info->shape + info->ndim);
-      Output(i)->Resize(shape);
+  void prepareOutputs() {
+    for (int i = 0; i < outputShapes_.size(); ++i) {
+      Output(i)->Resize(outputShapes_[i]);
       // Note: this mutable_data() call actually creates the data storage.
       Output(i)->template mutable_data<T>();
     }
   }
 
-  virtual bool RunOnDevice() override {
-    // first, given the TC, define it in the executionEngine_
-    executionEngine_->define(tc_);
+  // Compile the TC for the shapes of the inputs, only done when they differ
+  // from the ones of the previous run: the handle and the output shapes are
+  // kept for the next runs.
+  void bind(std::vector<std::vector<int64_t>> inputDims) {
+    if (sharedName_.empty()) {
+      sharedName_ = defineShared(tc_, tcName_);
+    }
 
-    // now, given the input tensors, convert them to dlpack tensors so that
+    // given the input tensors, convert them to dlpack tensors so that
     // we can call the compile command
     std::vector<::tc::dlutils::DLTensorUPtr> inTensorUPtrs;
     std::vector<const DLTensor*> inputDLTensors;
     for (int idx = 0; idx < this->InputSize(); ++idx) {
-      auto dims = this->Input(idx).dims();
       inTensorUPtrs.emplace_back(
-          dlpack::makeConstDLTensor(this->Input(idx), dims));
+          dlpack::makeConstDLTensor(this->Input(idx), inputDims[idx]));
       inputDLTensors.push_back(inTensorUPtrs.back().get());
     }
 
     auto outTensorInfo =
-        executionEngine_->inferOutputTensorInfo(tcName_, inputDLTensors);
-    prepareOutputs(outTensorInfo);
+        executionEngine_.inferOutputTensorInfo(sharedName_, inputDLTensors);
+    outputShapes_.clear();
+    for (auto info : outTensorInfo) {
+      outputShapes_.emplace_back(info->shape, info->shape + info->ndim);
+    }
 
-    // now create the outputDLTensors
-    std::vector<::tc::dlutils::DLTensorUPtr> outTensorUPtrs;
-    std::vector<DLTensor*> outputDLTensors;
-    for (int i = 0; i < OutputSize(); ++i) {
-      outTensorUPtrs.emplace_back(dlpack::makeDLTensor(Output(i)));
-      outputDLTensors.push_back(outTensorUPtrs.back().get());
+    // Options given to the operator win over the cached ones.
+    auto options = cudaMappingOptions_;
+    bool cached = false;
+    if (!explicitMappingOptions_ && !optionsCacheFile_.empty()) {
+      loadSharedOptionsCache(optionsCacheFile_);
+      auto best = tc::OptionsCache::getCache()->retrieveBestOptions(
+          lang::canonicalTc(executionEngine_.treeForFunction(sharedName_)),
+          inputDLTensors,
+          outTensorInfo);
+      if (best) {
+        options = *best;
+        cached = true;
+      }
+    }
+    handle_ = executionEngine_.compile(
+        sharedName_, inputDLTensors, options.toProtobufSerializedString());
+    boundInputDims_ = std::move(inputDims);
+
+    // On a miss, run with these options until the tuned kernel is ready.
+    tuning_.reset();
+    if (!explicitMappingOptions_ && !cached && autotune_ &&
+        !optionsCacheFile_.empty()) {
+      tuning_ = tuneInBackground(
+          tc_,
+          tcName_,
+          sharedName_,
+          inputDLTensors,
+          outTensorInfo,
+          options,
+          optionsCacheFile_,
+          tuningTimeBudget_,
+          context_.cuda_stream());
     }
+  }
 
-    // compile and run
-    auto handle = executionEngine_->compile(
-        tcName_,
-        inputDLTensors,
-        cudaMappingOptions_.toProtobufSerializedString());
-    executionEngine_->run(handle, inputDLTensors, outputDLTensors, profile_);
+  virtual bool RunOnDevice() override {
+    std::vector<std::vector<int64_t>> inputDims;
+    for (int idx = 0; idx < this->InputSize(); ++idx) {
+      inputDims.push_back(this->Input(idx).dims());
+    }
+    if (inputDims != boundInputDims_) {
+      bind(std::move(inputDims));
+    }
+    // hot-swap to the tuned kernel once the background tuning is done
+    if (tuning_ && tuning_->done) {
+      if (tuning_->tuned) {
+        handle_ = tuning_->handle;
+      }
+      tuning_.reset();
+    }
+    prepareOutputs();
+
+    // Launch on the operator's stream so that TC kernels are ordered with
+    // the rest of the net instead of serializing on the default stream.
+    tc::CudaRuntimeInformation info(context_.cuda_stream());
+    if (profile_) {
+      std::vector<::tc::dlutils::DLTensorUPtr> inTensorUPtrs;
+      std::vector<const DLTensor*> inputDLTensors;
+      for (int idx = 0; idx < this->InputSize(); ++idx) {
+        inTensorUPtrs.emplace_back(dlpack::makeConstDLTensor(
+            this->Input(idx), boundInputDims_[idx]));
+        inputDLTensors.push_back(inTensorUPtrs.back().get());
+      }
+      std::vector<::tc::dlutils::DLTensorUPtr> outTensorUPtrs;
+      std::vector<DLTensor*> outputDLTensors;
+      for (int i = 0; i < OutputSize(); ++i) {
+        outTensorUPtrs.emplace_back(dlpack::makeDLTensor(Output(i)));
+        outputDLTensors.push_back(outTensorUPtrs.back().get());
+      }
+      executionEngine_.run(
+          handle_,
+          inputDLTensors,
+          outputDLTensors,
+          profile_,
+          [](const tc::CudaTcExecutor*) { return false; },
+          info);
+      return true;
+    }
+
+    // the shapes match the compiled kernel, only the data pointers change
+    std::vector<const void*> inputs;
+    for (int idx = 0; idx < this->InputSize(); ++idx) {
+      inputs.push_back(this->Input(idx).raw_data());
+    }
+    std::vector<void*> outputs;
+    for (int i = 0; i < OutputSize(); ++i) {
+      outputs.push_back(Output(i)->raw_mutable_data());
+    }
+    executionEngine_.uncheckedRun(handle_, inputs, outputs, info);
     return true;
   }
 
@@ -136,11 +224,27 @@ class TcOp : public Operator<Context> {
   std::string tcName_;
   std::string gradTcName_;
   bool profile_;
+  // Looked up for the options of the input shapes when the mappingOptions
+  // are not given, see loadSharedOptionsCache.
+  std::string optionsCacheFile_;
+  // Whether misses in the options cache start a background tuning job of at
+  // most tuningTimeBudget_.
+  bool autotune_;
+  std::chrono::seconds tuningTimeBudget_;
+  bool explicitMappingOptions_;
   tc::CudaMappingOptions cudaMappingOptions_;
   tc::CudaMappingOptions gradCudaMappingOptions_;
 
  private:
-  std::unique_ptr<tc::ExecutionEngine<tc::CudaTcExecutor>> executionEngine_;
+  // Shared by all the instances, see sharedCudaExecutionEngine.
+  tc::ExecutionEngine<tc::CudaTcExecutor>& executionEngine_ =
+      sharedCudaExecutionEngine();
+  // The name of the TC in the shared engine.
+  std::string sharedName_;
+  size_t handle_;
+  std::vector<std::vector<int64_t>> boundInputDims_;
+  std::vector<std::vector<int64_t>> outputShapes_;
+  std::shared_ptr<const TuningResult> tuning_;
 };
 
 class GetTcOpGradient : public GradientMakerBase {
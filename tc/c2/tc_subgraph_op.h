@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tc/c2/tc_op.h"
+#include "tc/lang/gradient.h"
+#include "tc/lang/parse_cache.h"
+#include "tc/lang/pipeline.h"
+#include "tc/lang/tc_format.h"
+#include "tc/lang/tree_views.h"
+
+#include "caffe2/utils/proto_utils.h"
+
+namespace caffe2 {
+
+namespace detail {
+// The names of the definitions of a TcSubgraph operator, in order: the
+// tcNames argument or, by default, all the definitions of tcDef.
+inline std::vector<std::string> subgraphNames(const OperatorDef& def) {
+  ArgumentHelper args(def);
+  auto names = args.GetRepeatedArgument<std::string>("tcNames");
+  if (names.empty()) {
+    for (const auto& tree : lang::parseCached(
+             args.GetSingleArgument<std::string>("tcDef", ""))) {
+      names.push_back(lang::Def(tree).name().name());
+    }
+  }
+  CAFFE_ENFORCE(!names.empty(), "TcSubgraph requires TC definitions");
+  return names;
+}
+
+// The name of the fused definition: the tcName argument or, by default,
+// the names of the definitions joined by underscores.
+inline std::string subgraphName(const OperatorDef& def) {
+  ArgumentHelper args(def);
+  if (args.HasArgument("tcName")) {
+    return args.GetSingleArgument<std::string>("tcName", "ERROR");
+  }
+  std::string name;
+  for (const auto& n : subgraphNames(def)) {
+    name += (name.empty() ? "" : "_") + n;
+  }
+  return name;
+}
+
+// The definitions of a TcSubgraph operator inlined into a single one, see
+// lang::inlinePipeline.
+inline lang::TreeRef subgraphTree(const OperatorDef& def) {
+  ArgumentHelper args(def);
+  auto trees =
+      lang::parseCached(args.GetSingleArgument<std::string>("tcDef", ""));
+  std::vector<lang::TreeRef> pipeline;
+  for (const auto& name : subgraphNames(def)) {
+    bool found = false;
+    for (const auto& tree : trees) {
+      if (lang::Def(tree).name().name() == name) {
+        pipeline.push_back(tree);
+        found = true;
+        break;
+      }
+    }
+    CAFFE_ENFORCE(found, "TcSubgraph: no definition ", name, " in tcDef");
+  }
+  return lang::inlinePipeline(subgraphName(def), pipeline);
+}
+
+inline std::string formatTc(const lang::TreeRef& tree) {
+  std::stringstream ss;
+  lang::tcFormat(ss, tree);
+  return ss.str();
+}
+} // namespace detail
+
+/// Runs a chain of TC definitions as a single TC: the definitions, named by
+/// the repeated argument tcNames (all the definitions of tcDef by default),
+/// are connected by the names of their parameters and inlined by
+/// lang::inlinePipeline, so that the intermediate tensors become temporaries
+/// of a single kernel instead of blobs written and read back by one
+/// operator per definition. The inputs of the operator are the inputs of
+/// the chain in order of first appearance, its outputs are the outputs of
+/// the last definition. The fused TC is compiled, cached and tuned like the
+/// one of a TcOp.
+template <typename T, class Context, class Engine = caffe2::DefaultEngine>
+class TcSubgraphOp : public TcOp<T, Context, Engine> {
+ public:
+  TcSubgraphOp(const caffe2::OperatorDef& operator_def, caffe2::Workspace* ws)
+      : TcOp<T, Context, Engine>(operator_def, ws) {
+    auto tree = detail::subgraphTree(operator_def);
+    lang::Def def(tree);
+    CAFFE_ENFORCE_EQ(def.params().size(), this->InputSize());
+    CAFFE_ENFORCE_EQ(def.returns().size(), this->OutputSize());
+    this->tc_ = detail::formatTc(tree);
+    this->tcName_ = def.name().name();
+  }
+
+  ~TcSubgraphOp() override {}
+};
+
+/// The gradient of a TcSubgraph operator is a single TcOp running the
+/// backward TC of the fused definition, see lang::gradient. It reads the
+/// inputs of the operator followed by the gradients of its outputs and
+/// writes the gradients of its floating-point inputs. The
+/// gradCudaMappingOptions of the forward operator, if any, become its
+/// mappingOptions.
+class GetTcSubgraphGradient : public GradientMakerBase {
+ public:
+  using GradientMakerBase::GradientMakerBase;
+
+  std::vector<OperatorDef> GetGradientDefs() override {
+    auto tree = detail::subgraphTree(Def());
+    lang::Def def(tree);
+    auto gradName = def.name().name() + "_grad";
+    lang::Def grad(lang::gradient(tree, gradName));
+
+    std::vector<std::string> inputs;
+    for (int i = 0; i < def.params().size(); ++i) {
+      inputs.push_back(I(i));
+    }
+    for (int i = 0; i < def.returns().size(); ++i) {
+      inputs.push_back(GO(i));
+    }
+    std::vector<std::string> outputs;
+    for (const auto& ret : grad.returns()) {
+      for (int i = 0; i < def.params().size(); ++i) {
+        if (def.params()[i].ident().name() + "_grad" == ret.ident().name()) {
+          outputs.push_back(GI(i));
+          break;
+        }
+      }
+    }
+    CAFFE_ENFORCE_EQ(outputs.size(), grad.returns().size());
+
+    std::vector<Argument> args{
+        MakeArgument<std::string>("tcDef", detail::formatTc(grad.tree())),
+        MakeArgument<std::string>("tcName", gradName)};
+    ArgumentHelper forwardArgs(Def());
+    if (forwardArgs.HasArgument("gradCudaMappingOptions")) {
+      args.push_back(MakeArgument<std::string>(
+          "mappingOptions",
+          forwardArgs.GetSingleArgument<std::string>(
+              "gradCudaMappingOptions", "ERROR")));
+    }
+    for (const auto& arg : Def().arg()) {
+      if (arg.name() == "optionsCacheFile" || arg.name() == "autotune" ||
+          arg.name() == "tuningTimeBudgetS" || arg.name() == "profile") {
+        args.push_back(arg);
+      }
+    }
+    return SingleGradientDef("TcOp", "", inputs, outputs, args);
+  }
+};
+} // namespace caffe2
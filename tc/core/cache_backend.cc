@@ -0,0 +1,258 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cache_backend.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "tc/core/scope_guard.h"
+
+namespace tc {
+
+namespace {
+[[noreturn]] void throwSystemError(
+    const std::string& what,
+    const std::string& name) {
+  throw std::runtime_error(
+      what + " " + name + ": " + std::string(std::strerror(errno)));
+}
+
+bool startsWith(const std::string& s, const std::string& prefix) {
+  return s.compare(0, prefix.size(), prefix) == 0;
+}
+} // namespace
+
+std::string CacheBackend::objectName(
+    const std::string& cacheName,
+    size_t keyHash) {
+  char hex[17];
+  std::snprintf(
+      hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(keyHash));
+  return cacheName + "-" + hex;
+}
+
+DirectoryCacheBackend::DirectoryCacheBackend(const std::string& directory)
+    : directory_(directory) {
+  if (::mkdir(directory_.c_str(), 0777) != 0 and errno != EEXIST) {
+    throwSystemError("Failed to create", directory_);
+  }
+}
+
+bool DirectoryCacheBackend::fetch(const std::string& name, std::string& data) {
+  auto filename = directory_ + "/" + name;
+  struct stat buffer;
+  if (::stat(filename.c_str(), &buffer) != 0) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throwSystemError("Failed to stat", filename);
+  }
+  std::ifstream file(filename, std::ios::binary);
+  if (not file) {
+    throwSystemError("Failed to open", filename);
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  if (file.bad()) {
+    throwSystemError("Failed to read", filename);
+  }
+  data = contents.str();
+  return true;
+}
+
+void DirectoryCacheBackend::store(
+    const std::string& name,
+    const std::string& data) {
+  auto filename = directory_ + "/" + name;
+  // Unique among the processes sharing the directory.
+  char host[256] = {0};
+  ::gethostname(host, sizeof(host) - 1);
+  auto tmp = filename + ".tmp." + host + "." + std::to_string(::getpid());
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    file.close();
+    if (not file) {
+      std::remove(tmp.c_str());
+      throwSystemError("Failed to write", tmp);
+    }
+  }
+  if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+    auto err = errno;
+    std::remove(tmp.c_str());
+    errno = err;
+    throwSystemError("Failed to rename to", filename);
+  }
+}
+
+HttpCacheBackend::HttpCacheBackend(const std::string& url, int timeoutMs)
+    : port_("80"), timeoutMs_(timeoutMs) {
+  const std::string scheme = "http://";
+  if (not startsWith(url, scheme)) {
+    throw std::invalid_argument("Expected an http:// URL, got " + url);
+  }
+  auto authority = url.substr(scheme.size());
+  auto slash = authority.find('/');
+  if (slash != std::string::npos) {
+    path_ = authority.substr(slash);
+    authority = authority.substr(0, slash);
+  }
+  while (not path_.empty() and path_.back() == '/') {
+    path_.pop_back();
+  }
+  auto colon = authority.rfind(':');
+  if (colon != std::string::npos) {
+    port_ = authority.substr(colon + 1);
+    authority = authority.substr(0, colon);
+  }
+  host_ = authority;
+  if (host_.empty()) {
+    throw std::invalid_argument("Missing host in " + url);
+  }
+}
+
+int HttpCacheBackend::request(
+    const std::string& method,
+    const std::string& name,
+    const std::string& payload,
+    std::string& body) {
+  auto target = "http://" + host_ + ":" + port_ + path_ + "/" + name;
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addresses = nullptr;
+  auto res = ::getaddrinfo(host_.c_str(), port_.c_str(), &hints, &addresses);
+  if (res != 0) {
+    throw std::runtime_error(
+        "Failed to resolve " + host_ + ": " + ::gai_strerror(res));
+  }
+  ScopeGuard freeAddresses([&]() { ::freeaddrinfo(addresses); });
+
+  int fd = -1;
+  for (auto address = addresses; address; address = address->ai_next) {
+    fd = ::socket(
+        address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    // Bounds the connection too, as well as each read and write.
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs_ / 1000;
+    timeout.tv_usec = (timeoutMs_ % 1000) * 1000;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd);
+    fd = -1;
+  }
+  if (fd < 0) {
+    throwSystemError("Failed to connect to", target);
+  }
+  ScopeGuard closeSocket([fd]() { ::close(fd); });
+
+  // HTTP/1.0 responses are never chunked and end with the connection.
+  std::ostringstream header;
+  header << method << " " << path_ << "/" << name << " HTTP/1.0\r\n"
+         << "Host: " << host_ << "\r\n"
+         << "Content-Length: " << payload.size() << "\r\n"
+         << "Connection: close\r\n\r\n";
+  auto message = header.str() + payload;
+  for (size_t sent = 0; sent < message.size();) {
+    auto n = ::send(fd, message.data() + sent, message.size() - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwSystemError("Failed to send to", target);
+    }
+    sent += n;
+  }
+
+  std::string response;
+  char buffer[1 << 16];
+  while (true) {
+    auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwSystemError("Failed to receive from", target);
+    }
+    if (n == 0) {
+      break;
+    }
+    response.append(buffer, n);
+  }
+
+  int status = 0;
+  if (std::sscanf(response.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+    throw std::runtime_error("Malformed HTTP response from " + target);
+  }
+  auto end = response.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    throw std::runtime_error("Truncated HTTP response from " + target);
+  }
+  body = response.substr(end + 4);
+  return status;
+}
+
+bool HttpCacheBackend::fetch(const std::string& name, std::string& data) {
+  std::string body;
+  auto status = request("GET", name, "", body);
+  if (status == 404) {
+    return false;
+  }
+  if (status != 200) {
+    throw std::runtime_error(
+        "GET " + name + " failed with HTTP status " + std::to_string(status));
+  }
+  data = std::move(body);
+  return true;
+}
+
+void HttpCacheBackend::store(const std::string& name, const std::string& data) {
+  std::string body;
+  auto status = request("PUT", name, data, body);
+  if (status < 200 or status >= 300) {
+    throw std::runtime_error(
+        "PUT " + name + " failed with HTTP status " + std::to_string(status));
+  }
+}
+
+std::shared_ptr<CacheBackend> makeCacheBackend(const std::string& url) {
+  if (startsWith(url, "http://")) {
+    return std::make_shared<HttpCacheBackend>(url);
+  }
+  const std::string scheme = "file://";
+  return std::make_shared<DirectoryCacheBackend>(
+      startsWith(url, scheme) ? url.substr(scheme.size()) : url);
+}
+
+} // namespace tc
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace tc {
+
+//
+// Remote store of cache entries, shared between the machines that tune and
+// those that serve.  A cache with a backend (see Cache::setBackend) fetches
+// the entries of a key the first time a lookup misses, and stores the
+// entries it modified when asked to (see Cache::storeToBackend).
+// An object holds all the entries whose keys have the same hash, serialized
+// as the protobuf of their cache.  Storing an object replaces it: the last
+// machine to store the entries of a key wins, it holds what it fetched
+// before modifying them.
+//
+class CacheBackend {
+ public:
+  virtual ~CacheBackend() = default;
+
+  // Reads the object named name into data, returns false if there is none.
+  // Throws std::runtime_error if the store cannot be reached.
+  virtual bool fetch(const std::string& name, std::string& data) = 0;
+  // Stores data as the object named name, replacing it.  Throws
+  // std::runtime_error on failure.
+  virtual void store(const std::string& name, const std::string& data) = 0;
+
+  // The name of the object holding the entries of cacheName whose keys hash
+  // to keyHash.
+  static std::string objectName(const std::string& cacheName, size_t keyHash);
+};
+
+//
+// Stores the objects as files of a directory, e.g. of a mounted network
+// file system or object store bucket.  Files are written aside and renamed
+// so that readers never see partial objects.
+//
+class DirectoryCacheBackend : public CacheBackend {
+ public:
+  // Creates directory if it does not exist.
+  explicit DirectoryCacheBackend(const std::string& directory);
+
+  bool fetch(const std::string& name, std::string& data) override;
+  void store(const std::string& name, const std::string& data) override;
+
+ private:
+  std::string directory_;
+};
+
+//
+// Stores the objects on an HTTP server, e.g. an object store or a caching
+// proxy, with a GET and a PUT of url/name.  A 404 response is a miss.
+// Only plain http:// URLs are supported, without authentication, each
+// request opens a connection of its own.
+//
+class HttpCacheBackend : public CacheBackend {
+ public:
+  // Throws std::invalid_argument if url is not an http:// URL.
+  explicit HttpCacheBackend(const std::string& url, int timeoutMs = 10000);
+
+  bool fetch(const std::string& name, std::string& data) override;
+  void store(const std::string& name, const std::string& data) override;
+
+ private:
+  // Sends a request for name and returns the status code of the response,
+  // whose body is stored in body.
+  int request(
+      const std::string& method,
+      const std::string& name,
+      const std::string& payload,
+      std::string& body);
+
+  std::string host_;
+  std::string port_;
+  // Path prefix of the objects, without a trailing slash.
+  std::string path_;
+  int timeoutMs_;
+};
+
+// An HttpCacheBackend for http:// URLs, a DirectoryCacheBackend otherwise,
+// with an optional file:// prefix stripped.
+std::shared_ptr<CacheBackend> makeCacheBackend(const std::string& url);
+
+} // namespace tc
@@ -0,0 +1,396 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cache_file.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "tc/core/scope_guard.h"
+
+namespace tc {
+
+namespace {
+
+constexpr char kFileMagic[8] = {'T', 'C', 'C', 'A', 'C', 'H', 'E', '\0'};
+constexpr uint32_t kFileVersion = 1;
+constexpr uint64_t kSegmentMagic = 0x544353454731ULL; // "TCSEG1"
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct SegmentHeader {
+  uint64_t magic;
+  uint64_t numRecords;
+  // Size of the whole segment, header and index included.
+  uint64_t size;
+};
+
+struct IndexEntry {
+  uint64_t keyHash;
+  // Offset of the record from the start of the file.
+  uint64_t offset;
+  uint64_t size;
+};
+
+[[noreturn]] void throwSystemError(
+    const std::string& what,
+    const std::string& filename) {
+  throw std::runtime_error(
+      what + " " + filename + ": " + std::string(std::strerror(errno)));
+}
+
+template <typename T>
+T readAt(const char* data, size_t offset) {
+  T t;
+  std::memcpy(&t, data + offset, sizeof(T));
+  return t;
+}
+
+template <typename T>
+void appendBytes(std::string& buffer, const T& t) {
+  buffer.append(reinterpret_cast<const char*>(&t), sizeof(T));
+}
+
+// Reads the segments of a cache file and appends their records to records
+// (unless it is null).  Returns the size of the prefix made of the file header
+// and the complete segments, 0 if data is too short to hold a file header.
+size_t parseSegments(
+    const std::string& filename,
+    const char* data,
+    size_t size,
+    std::vector<CacheFile::Record>* records) {
+  if (std::memcmp(data, kFileMagic, std::min(size, sizeof(kFileMagic))) != 0) {
+    throw std::runtime_error(filename + " is not a TC cache file");
+  }
+  if (size < sizeof(FileHeader)) {
+    return 0;
+  }
+  auto header = readAt<FileHeader>(data, 0);
+  if (header.version != kFileVersion) {
+    throw std::runtime_error(
+        filename + " has unsupported cache file version " +
+        std::to_string(header.version));
+  }
+
+  size_t offset = sizeof(FileHeader);
+  while (size - offset >= sizeof(SegmentHeader)) {
+    auto segment = readAt<SegmentHeader>(data, offset);
+    if (segment.magic != kSegmentMagic ||
+        segment.size < sizeof(SegmentHeader) || segment.size > size - offset ||
+        segment.numRecords >
+            (segment.size - sizeof(SegmentHeader)) / sizeof(IndexEntry)) {
+      break;
+    }
+    auto end = offset + segment.size;
+    std::vector<CacheFile::Record> segmentRecords;
+    segmentRecords.reserve(segment.numRecords);
+    auto indexOffset = offset + sizeof(SegmentHeader);
+    for (size_t i = 0; i < segment.numRecords; ++i) {
+      auto entry =
+          readAt<IndexEntry>(data, indexOffset + i * sizeof(IndexEntry));
+      if (entry.offset < indexOffset || entry.offset > end ||
+          entry.size > end - entry.offset) {
+        break;
+      }
+      segmentRecords.push_back(CacheFile::Record{
+          entry.keyHash, data + entry.offset, entry.size, entry.offset});
+    }
+    if (segmentRecords.size() != segment.numRecords) {
+      break;
+    }
+    if (records) {
+      records->insert(
+          records->end(), segmentRecords.begin(), segmentRecords.end());
+    }
+    offset = end;
+  }
+  return offset;
+}
+
+// Serializes a segment that starts at offset in the file.
+std::string makeSegment(const CacheFile::Records& records, size_t offset) {
+  SegmentHeader segment{kSegmentMagic, records.size(), sizeof(SegmentHeader)};
+  segment.size += records.size() * sizeof(IndexEntry);
+  size_t recordOffset = offset + segment.size;
+  for (const auto& r : records) {
+    segment.size += r.second.size();
+  }
+
+  std::string buffer;
+  buffer.reserve(segment.size);
+  appendBytes(buffer, segment);
+  for (const auto& r : records) {
+    appendBytes(buffer, IndexEntry{r.first, recordOffset, r.second.size()});
+    recordOffset += r.second.size();
+  }
+  for (const auto& r : records) {
+    buffer += r.second;
+  }
+  return buffer;
+}
+
+std::string makeFileHeader() {
+  FileHeader header;
+  std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+  header.version = kFileVersion;
+  header.reserved = 0;
+  std::string buffer;
+  appendBytes(buffer, header);
+  return buffer;
+}
+
+void writeAt(
+    int fd,
+    const std::string& buffer,
+    size_t offset,
+    const std::string& filename) {
+  size_t written = 0;
+  while (written < buffer.size()) {
+    auto res = pwrite(
+        fd,
+        buffer.data() + written,
+        buffer.size() - written,
+        offset + written);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwSystemError("Failed to write", filename);
+    }
+    written += res;
+  }
+}
+} // namespace
+
+CacheFile::CacheFile(const std::string& filename) : filename_(filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return;
+    }
+    throwSystemError("Failed to open", filename);
+  }
+  ScopeGuard closeFd([fd]() { close(fd); });
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    throwSystemError("Failed to stat", filename);
+  }
+  device_ = st.st_dev;
+  inode_ = st.st_ino;
+  if (st.st_size == 0) {
+    return;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    throwSystemError("Failed to map", filename);
+  }
+  data_ = data;
+  size_ = st.st_size;
+  try {
+    parseSegments(filename_, static_cast<const char*>(data_), size_, &records_);
+  } catch (...) {
+    munmap(data_, size_);
+    throw;
+  }
+}
+
+CacheFile::~CacheFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+bool CacheFile::isCurrent() const {
+  struct stat st;
+  if (stat(filename_.c_str(), &st) != 0) {
+    return inode_ == 0;
+  }
+  return static_cast<uint64_t>(st.st_dev) == device_ &&
+      static_cast<uint64_t>(st.st_ino) == inode_ &&
+      static_cast<size_t>(st.st_size) == size_;
+}
+
+bool CacheFile::isSameFile(const CacheFile& other) const {
+  return inode_ != 0 && device_ == other.device_ && inode_ == other.inode_;
+}
+
+CacheFile::Writer::Writer(const std::string& filename)
+    : filename_(filename), fd_(-1) {
+  // The file may be replaced by another Writer while waiting for the lock,
+  // in which case the lock must be taken again on the new file.
+  while (true) {
+    fd_ = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throwSystemError("Failed to open", filename);
+    }
+    int res;
+    do {
+      res = flock(fd_, LOCK_EX);
+    } while (res != 0 && errno == EINTR);
+    struct stat locked, current;
+    if (res != 0 || fstat(fd_, &locked) != 0) {
+      auto err = errno;
+      close(fd_);
+      errno = err;
+      throwSystemError("Failed to lock", filename);
+    }
+    if (stat(filename.c_str(), &current) == 0 &&
+        current.st_dev == locked.st_dev && current.st_ino == locked.st_ino) {
+      return;
+    }
+    close(fd_);
+  }
+}
+
+CacheFile::Writer::~Writer() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+std::pair<size_t, size_t> CacheFile::Writer::append(const Records& records) {
+  CHECK_GE(fd_, 0) << "Writer used after replace";
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    throwSystemError("Failed to stat", filename_);
+  }
+
+  // Find where the last complete segment ends, anything after it is the
+  // remainder of an interrupted append.
+  size_t end = 0;
+  if (st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      throwSystemError("Failed to map", filename_);
+    }
+    ScopeGuard unmap([data, &st]() { munmap(data, st.st_size); });
+    end = parseSegments(
+        filename_, static_cast<const char*>(data), st.st_size, nullptr);
+  }
+  if (records.empty()) {
+    return std::make_pair(end, end);
+  }
+
+  std::string buffer;
+  if (end == 0) {
+    buffer = makeFileHeader();
+  }
+  auto begin = end + buffer.size();
+  buffer += makeSegment(records, begin);
+  if (end < static_cast<size_t>(st.st_size) && ftruncate(fd_, end) != 0) {
+    throwSystemError("Failed to truncate", filename_);
+  }
+  writeAt(fd_, buffer, end, filename_);
+  return std::make_pair(begin, end + buffer.size());
+}
+
+void CacheFile::Writer::replace(const Records& records) {
+  CHECK_GE(fd_, 0) << "Writer used after replace";
+  auto tmpFilename = filename_ + ".tmp." + std::to_string(getpid());
+  int fd = open(tmpFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throwSystemError("Failed to open", tmpFilename);
+  }
+  try {
+    auto buffer = makeFileHeader();
+    buffer += makeSegment(records, buffer.size());
+    writeAt(fd, buffer, 0, tmpFilename);
+    if (close(fd) != 0) {
+      fd = -1;
+      throwSystemError("Failed to close", tmpFilename);
+    }
+    fd = -1;
+    if (rename(tmpFilename.c_str(), filename_.c_str()) != 0) {
+      throwSystemError("Failed to rename " + tmpFilename + " to", filename_);
+    }
+  } catch (...) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    unlink(tmpFilename.c_str());
+    throw;
+  }
+  // Writers waiting on the replaced file notice it was replaced once they
+  // get the lock.
+  close(fd_);
+  fd_ = -1;
+}
+
+void CacheFile::append(const std::string& filename, const Records& records) {
+  Writer(filename).append(records);
+}
+
+void CacheFile::write(const std::string& filename, const Records& records) {
+  Writer(filename).replace(records);
+}
+
+void BackgroundFlusher::Trigger::notify() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    notified_ = true;
+  }
+  cv_.notify_one();
+}
+
+BackgroundFlusher::BackgroundFlusher(
+    std::function<bool()> flush,
+    std::chrono::milliseconds interval)
+    : flush_(std::move(flush)),
+      interval_(interval),
+      trigger_(std::make_shared<Trigger>()),
+      thread_([this]() { run(); }) {}
+
+BackgroundFlusher::~BackgroundFlusher() {
+  {
+    std::lock_guard<std::mutex> lock(trigger_->mtx_);
+    trigger_->stopped_ = true;
+  }
+  trigger_->cv_.notify_one();
+  thread_.join();
+}
+
+void BackgroundFlusher::run() {
+  while (true) {
+    bool stopped;
+    {
+      std::unique_lock<std::mutex> lock(trigger_->mtx_);
+      trigger_->cv_.wait_for(lock, interval_, [this]() {
+        return trigger_->notified_ or trigger_->stopped_;
+      });
+      trigger_->notified_ = false;
+      stopped = trigger_->stopped_;
+    }
+    if (not flush_() or stopped) {
+      return;
+    }
+  }
+}
+
+} // namespace tc
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tc {
+
+//
+// Read-only, memory-mapped view of an append-only cache file.
+// A cache file is a small header followed by segments, each segment being a
+// segment header, an index of (key hash, offset, size) triples and the
+// serialized records the index points to.  Opening a file only reads the
+// segment headers and indices, the records themselves are only paged in when
+// they are accessed.
+// Appending writes a new segment after the existing ones and never touches
+// them, so a key may have several records, in the order they were appended.
+// A segment left incomplete by an interrupted append is ignored when reading
+// and overwritten by the next append.
+// Several processes may share a file: writes go through a Writer, which holds
+// an exclusive lock on the file, while readers need no lock since they only
+// ever see complete segments.
+// Integers are stored in native byte order, cache files are meant to be
+// shared between processes of the same build on the same kind of machine.
+//
+class CacheFile {
+ public:
+  struct Record {
+    size_t keyHash;
+    // Points into the mapping, valid as long as the CacheFile is alive.
+    const char* data;
+    size_t size;
+    // Offset of the record from the start of the file.
+    size_t offset;
+  };
+
+  // (key hash, serialized record) pairs to write.
+  using Records = std::vector<std::pair<size_t, std::string>>;
+
+  // Maps filename.  A missing or empty file is an empty cache file.  Throws
+  // std::runtime_error if the file cannot be read or is not a cache file.
+  explicit CacheFile(const std::string& filename);
+  ~CacheFile();
+
+  CacheFile(const CacheFile&) = delete;
+  CacheFile& operator=(const CacheFile&) = delete;
+
+  const std::string& filename() const {
+    return filename_;
+  }
+
+  // The records of all complete segments in file order.
+  const std::vector<Record>& records() const {
+    return records_;
+  }
+
+  // True if filename still names the mapped file and the file did not grow
+  // since it was mapped.
+  bool isCurrent() const;
+
+  // True if both objects map the same file, the records of the smaller
+  // mapping then are a prefix of those of the larger one.
+  bool isSameFile(const CacheFile& other) const;
+
+  //
+  // Holds an exclusive lock on a cache file, shared between processes, for
+  // as long as it is alive.  Creates the file if it does not exist.
+  //
+  class Writer {
+   public:
+    // Blocks until the lock is acquired.
+    explicit Writer(const std::string& filename);
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Appends a segment holding records and returns the range of file
+    // offsets it occupies.
+    std::pair<size_t, size_t> append(const Records& records);
+
+    // Replaces the file with one holding a single segment made of records.
+    // The new file is written next to the file and renamed over it, readers
+    // that mapped the previous file keep seeing its contents.  Releases the
+    // lock, the Writer must not be used afterwards.
+    void replace(const Records& records);
+
+   private:
+    std::string filename_;
+    int fd_;
+  };
+
+  // Appends a segment holding records to filename.
+  static void append(const std::string& filename, const Records& records);
+
+  // Replaces filename with a file holding a single segment made of records.
+  static void write(const std::string& filename, const Records& records);
+
+ private:
+  std::string filename_;
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  // Identify the mapped file, zero if the file did not exist.
+  uint64_t device_ = 0;
+  uint64_t inode_ = 0;
+  std::vector<Record> records_;
+};
+
+//
+// Runs flush on a thread of its own every interval, and as soon as its
+// Trigger is notified, until flush returns false or the flusher is destroyed,
+// which runs flush one last time.
+//
+class BackgroundFlusher {
+ public:
+  // Wakes up the flusher early.  Holders of the Trigger may outlive the
+  // flusher, notifying it then has no effect.
+  class Trigger {
+   public:
+    void notify();
+
+   private:
+    friend class BackgroundFlusher;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool notified_ = false;
+    bool stopped_ = false;
+  };
+
+  BackgroundFlusher(
+      std::function<bool()> flush,
+      std::chrono::milliseconds interval);
+  ~BackgroundFlusher();
+
+  BackgroundFlusher(const BackgroundFlusher&) = delete;
+  BackgroundFlusher& operator=(const BackgroundFlusher&) = delete;
+
+  const std::shared_ptr<Trigger>& trigger() const {
+    return trigger_;
+  }
+
+ private:
+  void run();
+
+  std::function<bool()> flush_;
+  std::chrono::milliseconds interval_;
+  std::shared_ptr<Trigger> trigger_;
+  std::thread thread_;
+};
+
+} // namespace tc
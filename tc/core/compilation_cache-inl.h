@@ -0,0 +1,665 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+
+#include <glog/logging.h>
+#include <version.h>
+
+#include "tc/core/utils/hash.h"
+#include "tc/core/utils/math.h"
+#include "tc/core/utils/memory.h"
+
+namespace tc {
+
+namespace detail {
+template <typename TensorTy>
+size_t hashCacheKey(
+    const std::string& id,
+    const std::vector<TensorTy>& inputs,
+    const std::vector<TensorTy>& outputs,
+    const std::string& deviceStr) {
+  size_t seed = hashCombineValue(0, id);
+  seed = hashCombineValue(seed, deviceStr);
+  for (const auto& t : inputs) {
+    seed = hashCombine(seed, hashTensorMetadata(t));
+  }
+  seed = hashCombine(seed, inputs.size());
+  for (const auto& t : outputs) {
+    seed = hashCombine(seed, hashTensorMetadata(t));
+  }
+  return hashCombine(seed, outputs.size());
+}
+
+template <typename MappingOptionsType, typename EntryProto>
+MappingOptionsType bestOptions(const EntryProto& entry) {
+  CHECK_GT(entry.values_size(), 0);
+  const auto* best = &entry.values(0);
+  auto bestRuntime = std::numeric_limits<uint64_t>::max();
+  for (const auto& values : entry.values()) {
+    if (values.recorded_runtimes_size() == 0) {
+      continue;
+    }
+    auto runtime = median(std::vector<uint64_t>(
+        values.recorded_runtimes().begin(), values.recorded_runtimes().end()));
+    if (runtime < bestRuntime) {
+      bestRuntime = runtime;
+      best = &values;
+    }
+  }
+  return MappingOptionsType(best->kernel_options().SerializeAsString());
+}
+} // namespace detail
+
+template <typename CC>
+void Cache<CC>::enableCache() {
+  CC::getGlobalSharedCache() = std::make_shared<CC>();
+}
+
+template <typename CC>
+void Cache<CC>::disableCache() {
+  CC::getGlobalSharedCache() = nullptr;
+}
+
+template <typename CC>
+std::shared_ptr<CC> Cache<CC>::getCache() {
+  if (not cacheEnabled()) {
+    throw std::runtime_error(
+        "EnableCache or LoadCacheFromProtobuf must be called before using the cache.");
+  }
+  return CC::getGlobalSharedCache();
+}
+
+template <typename CC>
+void Cache<CC>::dumpCacheToProtobuf(const std::string& filename) {
+  std::fstream serialized(
+      filename, std::ios::binary | std::ios::trunc | std::ios::out);
+  if (!serialized) {
+    LOG(ERROR) << "Failed to open the output stream for dumping protobuf: "
+               << filename;
+  } else {
+    getCache()->toProtobuf().SerializePartialToOstream(&serialized);
+  }
+}
+
+template <typename CC>
+void Cache<CC>::loadCacheFromProtobuf(const std::string& filename) {
+  typename CC::Protobuf buf;
+  struct stat buffer = {0};
+  if (stat(filename.c_str(), &buffer) == 0) {
+    std::ifstream serialized(filename, std::ios::binary);
+    buf.ParseFromIstream(&serialized);
+  }
+  loadCacheFromProtobuf(buf);
+}
+
+template <typename CC>
+template <typename Protobuf>
+void Cache<CC>::loadCacheFromProtobuf(const Protobuf& buf) {
+  static_assert(
+      std::is_same<Protobuf, typename CC::Protobuf>::value,
+      "LoadCacheFromProtobuf called with invalide protobuf type.");
+  CC::getGlobalSharedCache() = std::make_shared<CC>(buf);
+}
+
+template <typename CC>
+void Cache<CC>::loadCacheFromFile(const std::string& filename) {
+  auto cache = std::make_shared<CC>();
+  cache->attachFile(std::make_shared<CacheFile>(filename));
+  CC::getGlobalSharedCache() = cache;
+}
+
+template <typename CC>
+void Cache<CC>::loadSharedCacheFromFile(const std::string& filename) {
+  auto cache = std::make_shared<CC>();
+  cache->attachFile(std::make_shared<CacheFile>(filename));
+  cache->shared_ = true;
+  CC::getGlobalSharedCache() = cache;
+}
+
+template <typename CC>
+void Cache<CC>::appendCacheToFile(const std::string& filename) {
+  auto cache = getCache();
+  std::lock_guard<std::mutex> fileLock(cache->fileMtx_);
+  std::lock_guard<std::mutex> lock(cache->mtx_);
+  if (not cache->file_ or cache->file_->filename() != filename or
+      (cache->rewriteFile_ and not cache->shared_)) {
+    cache->writeFile(filename);
+    return;
+  }
+  cache->appendDirty();
+}
+
+template <typename CC>
+void Cache<CC>::writeCacheToFile(const std::string& filename) {
+  auto cache = getCache();
+  std::lock_guard<std::mutex> fileLock(cache->fileMtx_);
+  std::lock_guard<std::mutex> lock(cache->mtx_);
+  cache->writeFile(filename);
+}
+
+template <typename CC>
+std::unique_ptr<BackgroundFlusher>& Cache<CC>::backgroundFlusher() {
+  static std::unique_ptr<BackgroundFlusher> flusher;
+  return flusher;
+}
+
+template <typename CC>
+void Cache<CC>::startBackgroundFlush(
+    const std::string& filename,
+    std::chrono::milliseconds interval,
+    size_t maxDirty) {
+  stopBackgroundFlush();
+  auto cache = getCache();
+  // The flusher must not keep the cache alive.
+  std::weak_ptr<CC> weakCache = cache;
+  backgroundFlusher() = tc::make_unique<BackgroundFlusher>(
+      [weakCache, filename]() {
+        auto cache = weakCache.lock();
+        if (not cache) {
+          return false;
+        }
+        try {
+          cache->flushToFile(filename);
+        } catch (const std::exception& e) {
+          LOG(WARNING) << "Failed to flush the cache to " << filename << ": "
+                       << e.what();
+        }
+        return true;
+      },
+      interval);
+  std::lock_guard<std::mutex> lock(cache->mtx_);
+  cache->flushTrigger_ = backgroundFlusher()->trigger();
+  cache->flushThreshold_ = maxDirty;
+}
+
+template <typename CC>
+void Cache<CC>::stopBackgroundFlush() {
+  backgroundFlusher() = nullptr;
+}
+
+template <typename CC>
+typename Cache<CC>::BackendConfig& Cache<CC>::backendConfig() {
+  static BackendConfig config;
+  return config;
+}
+
+template <typename CC>
+void Cache<CC>::setBackend(
+    std::shared_ptr<CacheBackend> backend,
+    const std::string& name) {
+  backendConfig() = BackendConfig{std::move(backend), name};
+}
+
+template <typename CC>
+bool Cache<CC>::hasBackend() {
+  return backendConfig().backend != nullptr;
+}
+
+template <typename CC>
+void Cache<CC>::storeToBackend() {
+  auto config = backendConfig();
+  if (not config.backend) {
+    return;
+  }
+  auto cache = getCache();
+  std::vector<std::pair<size_t, std::string>> objects;
+  {
+    std::lock_guard<std::mutex> lock(cache->mtx_);
+    const auto& entries = cache->entries_;
+    for (auto hash : cache->backendDirty_) {
+      typename CC::Protobuf buf;
+      auto range = cache->index_.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it) {
+        *buf.add_entries() = entries[it->second].toProtobuf();
+      }
+      // All the entries of the key may have been removed since.
+      if (buf.entries_size() > 0) {
+        objects.emplace_back(hash, buf.SerializeAsString());
+      }
+    }
+    cache->backendDirty_.clear();
+  }
+  // Stored without holding the lock, entries modified meanwhile are dirty
+  // again.
+  for (size_t i = 0; i < objects.size(); ++i) {
+    try {
+      config.backend->store(
+          CacheBackend::objectName(config.name, objects[i].first),
+          objects[i].second);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(cache->mtx_);
+      for (size_t j = i; j < objects.size(); ++j) {
+        cache->backendDirty_.insert(objects[j].first);
+      }
+      throw;
+    }
+  }
+}
+
+template <typename CC>
+void Cache<CC>::writeFile(const std::string& filename) {
+  CacheFile::Writer writer(filename);
+  if (file_ and file_->filename() == filename) {
+    refresh();
+  }
+  materializeAll();
+  auto& entries = static_cast<CC*>(this)->entries_;
+  CacheFile::Records records;
+  records.reserve(entries.size());
+  for (const auto& entry : entries) {
+    records.emplace_back(
+        CC::hashKey(entry.key), entry.toProtobuf().SerializeAsString());
+  }
+  writer.replace(records);
+  for (auto& entry : entries) {
+    CC::markSaved(entry);
+  }
+
+  // The first records of the new file are already in entries_, any other
+  // record was appended by another process after the file was replaced.
+  file_ = std::make_shared<CacheFile>(filename);
+  const auto& fileRecords = file_->records();
+  for (size_t i = records.size(), e = fileRecords.size(); i < e; ++i) {
+    pending_.emplace(fileRecords[i].keyHash, i);
+  }
+  dirty_.clear();
+  ownSegments_.clear();
+  rewriteFile_ = false;
+}
+
+template <typename CC>
+CacheFile::Records Cache<CC>::dirtyRecords(
+    std::vector<size_t>& positions) const {
+  const auto& entries = static_cast<const CC*>(this)->entries_;
+  positions.assign(dirty_.begin(), dirty_.end());
+  std::sort(positions.begin(), positions.end());
+  CacheFile::Records records;
+  records.reserve(positions.size());
+  for (auto pos : positions) {
+    typename CC::EntryProtobuf buf;
+    if (CC::unsavedProtobuf(entries[pos], buf)) {
+      records.emplace_back(
+          CC::hashKey(entries[pos].key), buf.SerializeAsString());
+    }
+  }
+  return records;
+}
+
+template <typename CC>
+void Cache<CC>::markDirtySaved(const std::vector<size_t>& positions) {
+  auto& entries = static_cast<CC*>(this)->entries_;
+  for (auto pos : positions) {
+    CC::markSaved(entries[pos]);
+    dirty_.erase(pos);
+  }
+}
+
+template <typename CC>
+void Cache<CC>::appendDirty() {
+  std::vector<size_t> positions;
+  auto records = dirtyRecords(positions);
+  if (not records.empty()) {
+    ownSegments_.push_back(
+        CacheFile::Writer(file_->filename()).append(records));
+  }
+  markDirtySaved(positions);
+}
+
+template <typename CC>
+void Cache<CC>::flushToFile(const std::string& filename) {
+  std::lock_guard<std::mutex> fileLock(fileMtx_);
+  CacheFile::Records records;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (not file_ or file_->filename() != filename or
+        (rewriteFile_ and not shared_)) {
+      writeFile(filename);
+      return;
+    }
+    std::vector<size_t> positions;
+    records = dirtyRecords(positions);
+    // Entries modified during the write below are dirty again.
+    markDirtySaved(positions);
+  }
+  if (records.empty()) {
+    return;
+  }
+  std::pair<size_t, size_t> segment;
+  try {
+    segment = CacheFile::Writer(filename).append(records);
+  } catch (...) {
+    // What the records held is lost for appends, the next flush rewrites the
+    // file from the entries.
+    std::lock_guard<std::mutex> lock(mtx_);
+    markRewrite();
+    throw;
+  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (shared_) {
+    ownSegments_.push_back(segment);
+  }
+}
+
+template <typename CC>
+void Cache<CC>::syncSharedFile() {
+  if (flushTrigger_ and flushThreshold_ != 0 and
+      dirty_.size() >= flushThreshold_) {
+    flushTrigger_->notify();
+  }
+  if (not shared_ or dirty_.empty()) {
+    return;
+  }
+  try {
+    appendDirty();
+  } catch (const std::exception& e) {
+    // Entries stay dirty and are appended by the next modification.
+    LOG(WARNING) << "Failed to append to the shared cache file: " << e.what();
+  }
+}
+
+template <typename CC>
+void Cache<CC>::refresh() const {
+  if (file_->isCurrent()) {
+    return;
+  }
+  std::shared_ptr<const CacheFile> file;
+  try {
+    file = std::make_shared<CacheFile>(file_->filename());
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Failed to refresh the cache file: " << e.what();
+    return;
+  }
+
+  size_t first = 0;
+  if (file->isSameFile(*file_)) {
+    // Records are only ever appended, the first ones are known already.
+    first = file_->records().size();
+  } else {
+    // The file was replaced and may hold what entries_ already holds.
+    dropSavedEntries();
+    ownSegments_.clear();
+  }
+  const auto& records = file->records();
+  for (size_t i = first, e = records.size(); i < e; ++i) {
+    auto own = std::any_of(
+        ownSegments_.begin(),
+        ownSegments_.end(),
+        [&](const std::pair<size_t, size_t>& segment) {
+          return records[i].offset >= segment.first and
+              records[i].offset < segment.second;
+        });
+    if (not own) {
+      pending_.emplace(records[i].keyHash, i);
+    }
+  }
+  file_ = file;
+}
+
+template <typename CC>
+void Cache<CC>::dropSavedEntries() const {
+  auto& entries = static_cast<const CC*>(this)->entries_;
+  std::vector<typename CC::CachedEntry> kept;
+  std::vector<size_t> positions(dirty_.begin(), dirty_.end());
+  std::sort(positions.begin(), positions.end());
+  dirty_.clear();
+  for (auto pos : positions) {
+    if (CC::dropSaved(entries[pos])) {
+      dirty_.insert(kept.size());
+      kept.push_back(std::move(entries[pos]));
+    }
+  }
+  entries = std::move(kept);
+  fetched_.clear();
+  index_.clear();
+  for (size_t i = 0, e = entries.size(); i < e; ++i) {
+    index_.emplace(CC::hashKey(entries[i].key), i);
+  }
+  pending_.clear();
+}
+
+template <typename CC>
+void Cache<CC>::attachFile(std::shared_ptr<const CacheFile> file) {
+  file_ = std::move(file);
+  pending_.clear();
+  const auto& records = file_->records();
+  pending_.reserve(records.size());
+  for (size_t i = 0, e = records.size(); i < e; ++i) {
+    pending_.emplace(records[i].keyHash, i);
+  }
+  dirty_.clear();
+  ownSegments_.clear();
+  rewriteFile_ = false;
+}
+
+template <typename CC>
+void Cache<CC>::materialize(size_t hash) const {
+  if (shared_ and pending_.count(hash) == 0 and index_.count(hash) == 0) {
+    refresh();
+  }
+  auto range = pending_.equal_range(hash);
+  if (range.first != range.second) {
+    std::vector<size_t> positions;
+    for (auto it = range.first; it != range.second; ++it) {
+      positions.push_back(it->second);
+    }
+    pending_.erase(range.first, range.second);
+    materializeRecords(std::move(positions));
+  }
+  if (index_.count(hash) == 0) {
+    fetchFromBackend(hash);
+  }
+}
+
+template <typename CC>
+void Cache<CC>::materializeAll() const {
+  if (pending_.empty()) {
+    return;
+  }
+  std::vector<size_t> positions;
+  positions.reserve(pending_.size());
+  for (const auto& kv : pending_) {
+    positions.push_back(kv.second);
+  }
+  pending_.clear();
+  materializeRecords(std::move(positions));
+}
+
+template <typename CC>
+void Cache<CC>::materializeRecords(std::vector<size_t> positions) const {
+  // Records are merged in the order they were appended.
+  std::sort(positions.begin(), positions.end());
+  auto& entries = static_cast<const CC*>(this)->entries_;
+  for (auto pos : positions) {
+    const auto& record = file_->records()[pos];
+    typename CC::EntryProtobuf buf;
+    if (not buf.ParseFromArray(record.data, record.size)) {
+      LOG(WARNING) << "Skipping corrupt record in cache file "
+                   << file_->filename();
+      continue;
+    }
+    typename CC::CachedEntry entry(buf);
+    CC::markSaved(entry);
+    mergeEntry(std::move(entry));
+  }
+}
+
+template <typename CC>
+template <typename Entry>
+size_t Cache<CC>::mergeEntry(Entry&& entry) const {
+  auto& entries = static_cast<const CC*>(this)->entries_;
+  auto hash = CC::hashKey(entry.key);
+  auto range = index_.equal_range(hash);
+  auto it = std::find_if(
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
+        return entries[kv.second].key == entry.key;
+      });
+  if (it != range.second) {
+    CC::mergeRecord(entries[it->second], std::move(entry));
+    return it->second;
+  }
+  entries.push_back(std::move(entry));
+  index_.emplace(hash, entries.size() - 1);
+  return entries.size() - 1;
+}
+
+template <typename CC>
+void Cache<CC>::fetchFromBackend(size_t hash) const {
+  const auto& config = backendConfig();
+  if (not config.backend or not fetched_.insert(hash).second) {
+    return;
+  }
+  auto name = CacheBackend::objectName(config.name, hash);
+  std::string data;
+  try {
+    if (not config.backend->fetch(name, data)) {
+      return;
+    }
+  } catch (const std::exception& e) {
+    // The next miss tries again.
+    fetched_.erase(hash);
+    LOG(WARNING) << "Failed to fetch " << name
+                 << " from the cache backend: " << e.what();
+    return;
+  }
+  typename CC::Protobuf buf;
+  if (not buf.ParseFromString(data)) {
+    LOG(WARNING) << "Skipping corrupt object " << name
+                 << " of the cache backend";
+    return;
+  }
+  for (const auto& entryBuf : buf.entries()) {
+    typename CC::CachedEntry entry(entryBuf);
+    if (CC::hashKey(entry.key) != hash) {
+      continue;
+    }
+    // The backing file does not hold the entry yet.
+    dirty_.insert(mergeEntry(std::move(entry)));
+  }
+}
+
+template <typename CC>
+void Cache<CC>::markBackendDirty(size_t hash) {
+  if (backendConfig().backend) {
+    backendDirty_.insert(hash);
+  }
+}
+
+template <typename CC>
+bool Cache<CC>::cacheEnabled() {
+  return CC::getGlobalSharedCache() != nullptr;
+}
+
+template <typename CC>
+size_t Cache<CC>::size() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  materializeAll();
+  return static_cast<const CC*>(this)->entries_.size();
+}
+
+template <typename CC>
+void Cache<CC>::clear() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  numberAttemptedRetrievals = numberSuccessfulRetrievals = numberCacheAttemps =
+      numberEvictions = 0;
+  static_cast<CC*>(this)->entries_.clear();
+  index_.clear();
+  pending_.clear();
+  fetched_.clear();
+  backendDirty_.clear();
+  markRewrite();
+}
+
+template <typename CC>
+void Cache<CC>::indexLastEntry() {
+  const auto& entries = static_cast<CC*>(this)->entries_;
+  CHECK(!entries.empty());
+  auto hash = CC::hashKey(entries.back().key);
+  index_.emplace(hash, entries.size() - 1);
+  dirty_.insert(entries.size() - 1);
+  markBackendDirty(hash);
+}
+
+template <typename CC>
+void Cache<CC>::rebuildIndex() {
+  const auto& entries = static_cast<CC*>(this)->entries_;
+  index_.clear();
+  index_.reserve(entries.size());
+  for (size_t i = 0, e = entries.size(); i < e; ++i) {
+    index_.emplace(CC::hashKey(entries[i].key), i);
+  }
+}
+
+template <typename CC>
+template <typename Entry>
+void Cache<CC>::markDirty(const Entry* entry) {
+  dirty_.insert(entry - static_cast<CC*>(this)->entries_.data());
+  markBackendDirty(CC::hashKey(entry->key));
+}
+
+template <typename CC>
+void Cache<CC>::evictEntries(const std::vector<bool>& remove) {
+  auto& entries = static_cast<CC*>(this)->entries_;
+  CHECK_EQ(remove.size(), entries.size());
+  std::unordered_set<size_t> dirty;
+  size_t kept = 0;
+  for (size_t i = 0, e = entries.size(); i < e; ++i) {
+    if (remove[i]) {
+      ++numberEvictions;
+      // Fetched again by the next lookup.
+      fetched_.erase(CC::hashKey(entries[i].key));
+      continue;
+    }
+    if (dirty_.count(i) != 0) {
+      dirty.insert(kept);
+    }
+    if (kept != i) {
+      entries[kept] = std::move(entries[i]);
+    }
+    ++kept;
+  }
+  entries.erase(entries.begin() + kept, entries.end());
+  dirty_ = std::move(dirty);
+  rebuildIndex();
+}
+
+template <typename CC>
+bool Cache<CC>::isUnsaved(size_t pos) const {
+  return file_ and dirty_.count(pos) != 0;
+}
+
+template <typename CC>
+void Cache<CC>::markRewrite() {
+  if (not shared_) {
+    rewriteFile_ = true;
+    return;
+  }
+  // Removals are not persisted to shared files, but positions changed.
+  dirty_.clear();
+  const auto& entries = static_cast<CC*>(this)->entries_;
+  for (size_t i = 0, e = entries.size(); i < e; ++i) {
+    dirty_.insert(i);
+  }
+}
+
+} // namespace tc
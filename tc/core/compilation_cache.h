@@ -0,0 +1,330 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+
+#include <compcache.pb.h>
+
+#include "tc/core/cache_backend.h"
+#include "tc/core/cache_file.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+namespace detail {
+/**
+ * TensorInfo wraps the necessary bits of DLTensor that are used as part of the
+ * CompilationCache's entry keys.
+ *
+ * It is serializable to protobuf and stored directly in the cache.
+ */
+struct TensorInfo {
+  std::vector<int64_t> shape;
+  std::vector<int64_t> strides;
+  uint64_t alignment;
+  DLDataType dType;
+
+  TensorInfo(const DLTensor* t);
+  TensorInfo(const TensorInfoProto& buf);
+
+  bool operator==(const DLTensor* t) const;
+  bool operator==(const TensorInfo& t) const;
+  bool operator<(const TensorInfo& t) const;
+  TensorInfoProto toProtobuf() const;
+};
+
+/**
+ * Hash of the tensor metadata that TensorInfo::operator==(const DLTensor*)
+ * compares: shape, strides and data type.  The alignment, which it also
+ * compares, is left out so that a DLTensor and a TensorInfo comparing equal
+ * always hash to the same value.
+ */
+size_t hashTensorMetadata(const DLTensor* t);
+size_t hashTensorMetadata(const TensorInfo& t);
+
+/**
+ * Hash of a cache key, computed either from DLTensors or from stored
+ * TensorInfos.  Used to index cache entries, equal hashes still require a
+ * full key comparison.
+ */
+template <typename TensorTy>
+size_t hashCacheKey(
+    const std::string& id,
+    const std::vector<TensorTy>& inputs,
+    const std::vector<TensorTy>& outputs,
+    const std::string& deviceStr);
+
+std::vector<TensorInfo> DLTensorToTensorInfoVector(
+    const std::vector<const DLTensor*>& ts);
+std::vector<TensorInfo> ProtoToTensorInfoVector(
+    const google::protobuf::RepeatedPtrField<TensorInfoProto>& buf);
+
+/**
+ * Tensor metadata without data on the device of context, as the executors
+ * expect it, e.g. to compile the kernels of cache entries ahead of time.
+ */
+dlutils::DLTensorUPtr makeTensorMetadata(
+    const TensorInfoProto& buf,
+    DLContext context);
+
+/**
+ * The options of an options cache entry with the lowest median runtime, the
+ * first ones if none was recorded.
+ */
+template <typename MappingOptionsType, typename EntryProto>
+MappingOptionsType bestOptions(const EntryProto& entry);
+} // namespace detail
+
+template <typename CC>
+class Cache {
+ public:
+  static void enableCache();
+  static void disableCache();
+  static void dumpCacheToProtobuf(const std::string& filename);
+  static void loadCacheFromProtobuf(const std::string& filename);
+  template <typename Protobuf>
+  static void loadCacheFromProtobuf(const Protobuf& buf);
+  static std::shared_ptr<CC> getCache();
+  static bool cacheEnabled();
+
+  /**
+   * Loads the cache from a CacheFile.  Only the file's index is read, an
+   * entry is parsed the first time its key is looked up.
+   */
+  static void loadCacheFromFile(const std::string& filename);
+  /**
+   * Like loadCacheFromFile for a file that several processes use at the same
+   * time.  Entries added or modified are appended to the file right away and
+   * a lookup that misses first picks up the records that other processes
+   * appended since.  Records of the same key are merged and never replace
+   * what another process recorded, e.g. OptionsCache appends the runtimes
+   * recorded since the last append only.  Entries removed from the cache are
+   * not removed from the file.
+   */
+  static void loadSharedCacheFromFile(const std::string& filename);
+  /**
+   * Appends the entries added or modified since the cache was loaded from,
+   * or last written to, filename.  Existing records are left untouched.
+   * Falls back to writeCacheToFile if the cache is not backed by filename or,
+   * unless it is shared, if entries were removed since it was loaded.
+   */
+  static void appendCacheToFile(const std::string& filename);
+  /**
+   * Replaces filename with a CacheFile holding exactly the entries of the
+   * cache, once merged with the records appended by other processes, which
+   * compacts the records of each key into one.
+   */
+  static void writeCacheToFile(const std::string& filename);
+  /**
+   * Starts a thread that appends the entries of the current cache modified
+   * since the last append to filename, as appendCacheToFile does, every
+   * interval and as soon as maxDirty entries are modified if maxDirty is not
+   * 0.  Replaces the thread previously started for this cache type, if any.
+   * Modifications do not wait for the file: the records are serialized under
+   * the cache lock and written without holding it.  The thread stops once
+   * the cache is replaced or disabled and dropped by its users.
+   */
+  static void startBackgroundFlush(
+      const std::string& filename,
+      std::chrono::milliseconds interval,
+      size_t maxDirty = 0);
+  /// Stops the thread started by startBackgroundFlush after a last append.
+  static void stopBackgroundFlush();
+
+  /**
+   * Sets the remote store of the entries, whose objects are named after
+   * name (see CacheBackend::objectName).  The first time a lookup of a key
+   * misses, the entries of the key are fetched from backend, while holding
+   * the cache lock, and the next append to the backing file, if any, saves
+   * them locally.  The backend applies to the current cache and to those
+   * enabled or loaded later, until it is reset to null.  Must not be called
+   * concurrently with the other operations of the cache.
+   */
+  static void setBackend(
+      std::shared_ptr<CacheBackend> backend,
+      const std::string& name);
+  static bool hasBackend();
+  /**
+   * Stores the entries of the keys added or modified since the cache was
+   * created or last stored to the backend, replacing their objects.  Noop
+   * without backend.  The keys not stored are stored by the next call if it
+   * throws.
+   */
+  static void storeToBackend();
+
+  size_t size() const;
+  void clear();
+
+  mutable int numberAttemptedRetrievals = 0;
+  mutable int numberSuccessfulRetrievals = 0;
+  mutable int numberCacheAttemps = 0;
+  mutable int numberEvictions = 0;
+
+ protected:
+  /// Add the last element of entries_ to the index.
+  void indexLastEntry();
+  /// Recompute the index after entries_ was reordered or filtered.
+  void rebuildIndex();
+  /// Record that entry was modified in place and must be appended again.
+  template <typename Entry>
+  void markDirty(const Entry* entry);
+  /// Record that entries were removed or reordered, the next append must
+  /// rewrite the whole file, or append all the entries if it is shared.
+  void markRewrite();
+  /// Remove the entries whose position is set in remove without recording
+  /// it for the backing file, which keeps them.
+  void evictEntries(const std::vector<bool>& remove);
+  /// True if the entry at pos would be lost if evicted, because the backing
+  /// file does not hold it yet.
+  bool isUnsaved(size_t pos) const;
+  /// Append the modified entries to the backing file if it is shared, must be
+  /// called by the operations that modify entries once they are done.
+  void syncSharedFile();
+
+  /// Parse the records of the backing file whose key hashes to hash and add
+  /// them to entries_.  Must be called before looking up hash in index_.
+  void materialize(size_t hash) const;
+  /// Parse all the records of the backing file not parsed yet.  Must be
+  /// called before iterating over entries_.  The backend is not listed, its
+  /// entries are only fetched by materialize.
+  void materializeAll() const;
+
+  // How the entries of the backing file are persisted and merged.  Caches
+  // whose records are not complete entries or cannot simply replace each
+  // other hide these defaults.
+  /// Merge record, read from the backing file, into entry with the same key.
+  template <typename Entry>
+  static void mergeRecord(Entry& entry, Entry&& record) {
+    entry = std::move(record);
+  }
+  /// Store in buf what the backing file does not hold yet of entry, return
+  /// false if it holds everything.
+  template <typename Entry, typename EntryProtobuf>
+  static bool unsavedProtobuf(const Entry& entry, EntryProtobuf& buf) {
+    buf = entry.toProtobuf();
+    return true;
+  }
+  /// Record that the backing file now holds everything of entry.
+  template <typename Entry>
+  static void markSaved(Entry& entry) {}
+  /// Remove from entry what the backing file holds, return false if nothing
+  /// is left.
+  template <typename Entry>
+  static bool dropSaved(Entry& entry) {
+    return true;
+  }
+
+  // XXX:this should be a std or boost shared_mutex
+  mutable std::mutex mtx_;
+
+  /// Maps the hash of an entry's key (CC::hashKey) to its position in
+  /// entries_.  Entries are only ever appended, except when the whole vector
+  /// is replaced, in which case the index is rebuilt.
+  mutable std::unordered_multimap<size_t, size_t> index_;
+
+ private:
+  static std::unique_ptr<BackgroundFlusher>& backgroundFlusher();
+
+  struct BackendConfig {
+    std::shared_ptr<CacheBackend> backend;
+    std::string name;
+  };
+  static BackendConfig& backendConfig();
+
+  void attachFile(std::shared_ptr<const CacheFile> file);
+  void materializeRecords(std::vector<size_t> positions) const;
+  /// Merge entry into the entry with the same key or append it, return its
+  /// position in entries_.
+  template <typename Entry>
+  size_t mergeEntry(Entry&& entry) const;
+  /// Fetch the entries whose key hashes to hash from the backend, unless
+  /// they were fetched already.
+  void fetchFromBackend(size_t hash) const;
+  /// Record that the entries whose key hashes to hash must be stored to the
+  /// backend.
+  void markBackendDirty(size_t hash);
+  void writeFile(const std::string& filename);
+  void appendDirty();
+  /// Serialize what the backing file does not hold of the dirty entries,
+  /// their positions are stored in positions.
+  CacheFile::Records dirtyRecords(std::vector<size_t>& positions) const;
+  /// Record that the backing file now holds the entries at positions.
+  void markDirtySaved(const std::vector<size_t>& positions);
+  /// appendCacheToFile for the background flusher, only holds mtx_ while
+  /// collecting the records unless the whole file must be written.
+  void flushToFile(const std::string& filename);
+  /// Map the backing file again if it changed, to see the records other
+  /// processes appended.
+  void refresh() const;
+  /// Keep only the entries, or parts of entries, the backing file does not
+  /// hold, called when it was replaced by another process.
+  void dropSavedEntries() const;
+
+  /// The file the cache was loaded from or last written to, if any.
+  mutable std::shared_ptr<const CacheFile> file_;
+  /// Maps the key hash of the records of file_ that were not parsed yet to
+  /// their position in file_->records().
+  mutable std::unordered_multimap<size_t, size_t> pending_;
+  /// Positions in entries_ of the entries that file_ does not hold yet.
+  mutable std::unordered_set<size_t> dirty_;
+  /// Ranges of file offsets of the segments this process appended to the
+  /// file, skipped when refreshing.
+  mutable std::vector<std::pair<size_t, size_t>> ownSegments_;
+  /// True if file_ holds entries that were since removed.
+  bool rewriteFile_ = false;
+  /// True if other processes use file_ at the same time.
+  bool shared_ = false;
+  /// Key hashes already fetched from the backend.
+  mutable std::unordered_set<size_t> fetched_;
+  /// Key hashes of the entries the backend does not hold yet.
+  std::unordered_set<size_t> backendDirty_;
+
+  /// Serializes the writes to the backing file, taken before mtx_.
+  std::mutex fileMtx_;
+  /// Wakes up the background flusher once flushThreshold_ entries are dirty.
+  std::shared_ptr<BackgroundFlusher::Trigger> flushTrigger_;
+  size_t flushThreshold_ = 0;
+};
+
+class CacheEntrySameKeyDifferentValue : public std::invalid_argument {
+ public:
+  explicit CacheEntrySameKeyDifferentValue(const std::string& what_arg)
+      : invalid_argument(what_arg) {}
+  explicit CacheEntrySameKeyDifferentValue(const char* what_arg)
+      : invalid_argument(what_arg) {}
+};
+
+bool operator==(const DLDataType& a, const DLDataType& b);
+bool operator<(const DLDataType& a, const DLDataType& b);
+bool operator==(
+    const std::vector<const DLTensor*>& inputsTensor,
+    const std::vector<detail::TensorInfo>& inputsInfo);
+
+} // namespace tc
+
+#include "tc/core/compilation_cache-inl.h"
@@ -29,6 +29,8 @@ constexpr auto kAstNodeIdPrefix = "__node_";
 constexpr auto kReadIdName = "read";
 constexpr auto kWriteIdName = "write";
 constexpr auto kSyncIdPrefix = "_sync_";
+constexpr auto kWarpSyncIdPrefix = "_warpSync_";
+constexpr auto kBufferSwapIdPrefix = "_swap_";
 
 } // namespace polyhedral
 } // namespace tc
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <sstream>
+#include <stdexcept>
+
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+
+namespace tc {
+
+/// Pins the calling thread to a CPU core for the lifetime of the object, the
+/// CPU counterpart of WithDevice.  The threads of cpuThreadPool are not
+/// pinned, except those it spawns while pinned, which inherit the core.
+struct WithCpu {
+  WithCpu(size_t cpu) : newCpu(cpu) {
+    if (pthread_getaffinity_np(pthread_self(), sizeof(oldCpus), &oldCpus)) {
+      throw std::runtime_error("Could not get the CPU affinity");
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(newCpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+      std::stringstream ss;
+      ss << "Could not pin the thread to CPU " << newCpu;
+      throw std::runtime_error(ss.str());
+    }
+  }
+  ~WithCpu() noexcept(false) {
+    if (pthread_setaffinity_np(pthread_self(), sizeof(oldCpus), &oldCpus)) {
+      throw std::runtime_error("Could not restore the CPU affinity");
+    }
+  }
+  cpu_set_t oldCpus;
+  size_t newCpu;
+};
+
+/// The types the backend-independent code, e.g. the autotuner, is templated
+/// on to run on CPUs.
+struct CpuBackend {
+  using ExecutorType = CpuTcExecutor;
+  using MappingOptionsType = CpuMappingOptions;
+  using OptionsCacheType = CpuOptionsCache;
+  using WithDevice = WithCpu;
+};
+
+} // namespace tc
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include <version.h>
+
+namespace tc {
+
+template <typename C>
+auto CpuOptionsCache::searchKernelImpl(
+    C& c,
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs)
+    -> decltype(c.searchKernel(id, inputs, outputs)) {
+  auto cpuStr = cpuDeviceStr();
+  auto hash = detail::hashCacheKey(id, inputs, outputs, cpuStr);
+  c.materialize(hash);
+  auto range = c.index_.equal_range(hash);
+  auto it = std::find_if(
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
+        using tc::operator==;
+        const auto& e = c.entries_[kv.second];
+        return id == e.key.id && inputs == e.key.inputs &&
+            outputs == e.key.outputs && cpuStr == e.key.deviceStr;
+      });
+  if (it != range.second) {
+    auto& entry = c.entries_[it->second];
+    if (entry.key.gitVersion != tc::git_version) {
+      std::cerr << "[WARNING] Proto version doesn't match. TC git version is: "
+                << tc::git_version
+                << " and Proto version is: " << entry.key.gitVersion
+                << " .This proto might be incompatible"
+                << " with your TC binary and can break. Please autotune"
+                << " against the correct TC version." << std::endl;
+    }
+    return &entry;
+  }
+  return nullptr;
+}
+
+} // namespace tc
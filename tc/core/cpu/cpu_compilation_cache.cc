@@ -0,0 +1,523 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_compilation_cache.h"
+
+#include <version.h>
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+
+#include "tc/core/cpu/cpu_parallel.h"
+#include "tc/core/polyhedral/llvm_jit.h"
+#include "tc/core/utils/hash.h"
+#include "tc/core/utils/math.h"
+
+namespace tc {
+
+std::string cpuDeviceStr() {
+  std::stringstream ss;
+  ss << JitTarget::fromFlags().str() << "_" << cpuNumThreads() << "threads";
+  return ss.str();
+}
+
+namespace {
+std::shared_ptr<CpuOptionsCache> cpuOptionsCache_;
+} // namespace
+
+std::shared_ptr<CpuOptionsCache>& CpuOptionsCache::getGlobalSharedCache() {
+  return cpuOptionsCache_;
+}
+
+size_t CpuOptionsCache::totalSize() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  materializeAll();
+  return std::accumulate(
+      entries_.begin(),
+      entries_.end(),
+      size_t(0),
+      [](size_t sum, const CachedEntry& e) { return sum + e.values.size(); });
+}
+
+std::unique_ptr<CpuMappingOptions> CpuOptionsCache::retrieveBestOptions(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) const {
+  auto ret = retrieveTopKOptions(id, inputs, outputs, 1);
+  if (ret.empty()) {
+    return nullptr;
+  }
+  return std::unique_ptr<CpuMappingOptions>(
+      new CpuMappingOptions(ret.front()));
+}
+
+std::vector<CpuOptionsCache::RetrievalResult>
+CpuOptionsCache::retrieveOptionsAndRuntimes(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberAttemptedRetrievals;
+  auto ret = searchKernel(id, inputs, outputs);
+  if (not ret) {
+    return {};
+  }
+  ++numberSuccessfulRetrievals;
+  std::vector<RetrievalResult> res;
+  res.reserve(ret->values.size());
+  std::transform(
+      ret->values.begin(),
+      ret->values.end(),
+      std::back_inserter(res),
+      [](const CachedEntry::Values& v) -> RetrievalResult {
+        return {v.mappingOptions, v.recordedRuntimes};
+      });
+  return res;
+}
+
+std::vector<CpuMappingOptions> CpuOptionsCache::retrieveTopKOptions(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    size_t k) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto candidates = searchKernel(id, inputs, outputs);
+  ++numberAttemptedRetrievals;
+  if (not candidates) {
+    return {};
+  }
+
+  struct OptionsWithMedian {
+    const CpuMappingOptions* options;
+    Duration medianRuntime;
+  };
+
+  std::vector<OptionsWithMedian> candidatesMedian;
+  candidatesMedian.reserve(candidates->values.size());
+  std::transform(
+      candidates->values.begin(),
+      candidates->values.end(),
+      std::back_inserter(candidatesMedian),
+      [](const CachedEntry::Values& v) {
+        if (v.recordedRuntimes.empty()) {
+          throw std::runtime_error(
+              "CpuOptionsCache invariant violated: each cached option should have at least one associated recorded runtime.");
+        }
+        return OptionsWithMedian{&v.mappingOptions, median(v.recordedRuntimes)};
+      });
+  std::sort(
+      candidatesMedian.begin(),
+      candidatesMedian.end(),
+      [](const OptionsWithMedian& a, const OptionsWithMedian& b) {
+        return a.medianRuntime < b.medianRuntime;
+      });
+  if (k > candidatesMedian.size()) {
+    k = candidatesMedian.size();
+  }
+
+  std::vector<CpuMappingOptions> res;
+  res.reserve(k);
+  std::transform(
+      candidatesMedian.begin(),
+      candidatesMedian.begin() + k,
+      std::back_inserter(res),
+      [](const OptionsWithMedian& c) { return *c.options; });
+
+  ++numberSuccessfulRetrievals;
+  return res;
+}
+
+void CpuOptionsCache::keepOnlyBestCandidates(size_t numberToKeep) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  materializeAll();
+  markRewrite();
+
+  for (auto& entry : entries_) {
+    std::sort(
+        entry.values.begin(),
+        entry.values.end(),
+        [](const CachedEntry::Values& a, const CachedEntry::Values& b) {
+          return median(a.recordedRuntimes) < median(b.recordedRuntimes);
+        });
+    if (entry.values.size() > numberToKeep) {
+      entry.values.erase(
+          entry.values.begin() + numberToKeep, entry.values.end());
+    }
+  }
+}
+
+void CpuOptionsCache::recordRuntime(
+    const std::string& id,
+    const CpuMappingOptions& options,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    Duration runtime) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberCacheAttemps;
+
+  auto kernel = searchKernel(id, inputs, outputs);
+  if (not kernel) {
+    entries_.emplace_back(
+        id, inputs, outputs, cpuDeviceStr(), options, runtime);
+    indexLastEntry();
+    syncSharedFile();
+    return;
+  }
+  auto v = std::find_if(
+      kernel->values.begin(),
+      kernel->values.end(),
+      [&options](const CachedEntry::Values& v) {
+        return v.mappingOptions == options;
+      });
+  if (v == kernel->values.end()) {
+    kernel->values.emplace_back(options, runtime);
+  } else {
+    v->recordedRuntimes.push_back(runtime);
+  }
+  markDirty(kernel);
+  syncSharedFile();
+}
+
+CpuOptionsCache::CachedEntry* CpuOptionsCache::searchKernel(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) {
+  return searchKernelImpl(*this, id, inputs, outputs);
+}
+
+const CpuOptionsCache::CachedEntry* CpuOptionsCache::searchKernel(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) const {
+  return searchKernelImpl(*this, id, inputs, outputs);
+}
+
+CpuOptionsCache::CachedEntry::CachedEntry(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const std::string& deviceStr,
+    const CpuMappingOptions& options,
+    Duration runtime)
+    : key(id,
+          detail::DLTensorToTensorInfoVector(inputs),
+          detail::DLTensorToTensorInfoVector(outputs),
+          deviceStr,
+          git_version) {
+  values.emplace_back(options, runtime);
+}
+
+CpuOptionsCache::CachedEntry::Key::Key(
+    const std::string& id,
+    std::vector<detail::TensorInfo>&& inputs_,
+    std::vector<detail::TensorInfo>&& outputs_,
+    const std::string& deviceStr,
+    const std::string& gitVersion)
+    : id(id),
+      inputs(std::move(inputs_)),
+      outputs(std::move(outputs_)),
+      deviceStr(deviceStr),
+      gitVersion(gitVersion) {}
+
+CpuOptionsCache::CachedEntry::Values::Values(
+    const CpuMappingOptions& options,
+    Duration runtime)
+    : mappingOptions(options), recordedRuntimes{runtime}, savedRuntimes(0) {}
+
+CpuOptionsCache::CachedEntry::Values::Values(
+    const CpuMappingOptions& options,
+    std::vector<Duration>&& runtimes)
+    : mappingOptions(options),
+      recordedRuntimes(std::move(runtimes)),
+      savedRuntimes(0) {}
+
+CpuOptionsCache::CpuOptionsCache(const CpuOptionsCacheProto& buf) {
+  entries_.reserve(buf.entries_size());
+  for (const auto& entry_buf : buf.entries())
+    entries_.emplace_back(entry_buf);
+  rebuildIndex();
+}
+
+size_t CpuOptionsCache::hashKey(const CachedEntry::Key& key) {
+  return detail::hashCacheKey(key.id, key.inputs, key.outputs, key.deviceStr);
+}
+
+bool CpuOptionsCache::CachedEntry::Key::operator==(const Key& other) const {
+  return id == other.id && inputs == other.inputs &&
+      outputs == other.outputs && deviceStr == other.deviceStr;
+}
+
+void CpuOptionsCache::mergeRecord(CachedEntry& entry, CachedEntry&& record) {
+  for (auto& recorded : record.values) {
+    auto v = std::find_if(
+        entry.values.begin(),
+        entry.values.end(),
+        [&recorded](const CachedEntry::Values& v) {
+          return v.mappingOptions == recorded.mappingOptions;
+        });
+    if (v == entry.values.end()) {
+      entry.values.push_back(std::move(recorded));
+      continue;
+    }
+    // Runtimes not saved yet stay last.
+    v->recordedRuntimes.insert(
+        v->recordedRuntimes.begin() + v->savedRuntimes,
+        recorded.recordedRuntimes.begin(),
+        recorded.recordedRuntimes.end());
+    v->savedRuntimes += recorded.recordedRuntimes.size();
+  }
+}
+
+bool CpuOptionsCache::unsavedProtobuf(
+    const CachedEntry& entry,
+    CpuOptionsCacheEntryProto& buf) {
+  auto unsaved = entry;
+  unsaved.values.clear();
+  for (const auto& v : entry.values) {
+    if (v.savedRuntimes < v.recordedRuntimes.size()) {
+      unsaved.values.emplace_back(
+          v.mappingOptions,
+          std::vector<Duration>(
+              v.recordedRuntimes.begin() + v.savedRuntimes,
+              v.recordedRuntimes.end()));
+    }
+  }
+  if (unsaved.values.empty()) {
+    return false;
+  }
+  buf = unsaved.toProtobuf();
+  return true;
+}
+
+void CpuOptionsCache::markSaved(CachedEntry& entry) {
+  for (auto& v : entry.values) {
+    v.savedRuntimes = v.recordedRuntimes.size();
+  }
+}
+
+bool CpuOptionsCache::dropSaved(CachedEntry& entry) {
+  for (auto& v : entry.values) {
+    v.recordedRuntimes.erase(
+        v.recordedRuntimes.begin(),
+        v.recordedRuntimes.begin() + v.savedRuntimes);
+    v.savedRuntimes = 0;
+  }
+  entry.values.erase(
+      std::remove_if(
+          entry.values.begin(),
+          entry.values.end(),
+          [](const CachedEntry::Values& v) {
+            return v.recordedRuntimes.empty();
+          }),
+      entry.values.end());
+  return not entry.values.empty();
+}
+
+decltype(CpuOptionsCache::entries_)::const_iterator CpuOptionsCache::begin()
+    const {
+  materializeAll();
+  return entries_.begin();
+}
+
+decltype(CpuOptionsCache::entries_)::const_iterator CpuOptionsCache::end()
+    const {
+  materializeAll();
+  return entries_.end();
+}
+
+CpuOptionsCache::CachedEntry::CachedEntry(const CpuOptionsCacheEntryProto& buf)
+    : key(buf.id(),
+          detail::ProtoToTensorInfoVector(buf.inputs()),
+          detail::ProtoToTensorInfoVector(buf.outputs()),
+          buf.device_str(),
+          buf.git_version()) {
+  if (buf.values_size() == 0) {
+    throw std::invalid_argument(
+        "CpuOptionsCache::CachedEntry invalid protobuf: each entry should have at least one value field.");
+  }
+
+  for (const auto& value : buf.values()) {
+    if (value.recorded_runtimes_size() == 0) {
+      throw std::invalid_argument(
+          "CpuOptionsCache::CachedEntry invalid protobuf: each entry value should have at least one recorded runtime.");
+    }
+    std::vector<Duration> runtimes;
+    runtimes.reserve(value.recorded_runtimes_size());
+    std::transform(
+        value.recorded_runtimes().begin(),
+        value.recorded_runtimes().end(),
+        std::back_inserter(runtimes),
+        [](int64_t us) { return std::chrono::microseconds(us); });
+    values.emplace_back(
+        CpuMappingOptions(value.kernel_options().SerializeAsString()),
+        std::move(runtimes));
+  }
+}
+
+CpuOptionsCacheProto CpuOptionsCache::toProtobuf() const {
+  materializeAll();
+  CpuOptionsCacheProto buf;
+  auto* entriesBuf = buf.mutable_entries();
+  entriesBuf->Reserve(entries_.size());
+  std::transform(
+      entries_.begin(),
+      entries_.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(entriesBuf),
+      [](const CachedEntry& entry) { return entry.toProtobuf(); });
+  return buf;
+}
+
+CpuOptionsCacheEntryProto CpuOptionsCache::CachedEntry::toProtobuf() const {
+  CpuOptionsCacheEntryProto buf;
+  buf.set_id(key.id);
+  std::transform(
+      key.inputs.begin(),
+      key.inputs.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(buf.mutable_inputs()),
+      [](const detail::TensorInfo& input) { return input.toProtobuf(); });
+  std::transform(
+      key.outputs.begin(),
+      key.outputs.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(buf.mutable_outputs()),
+      [](const detail::TensorInfo& output) { return output.toProtobuf(); });
+
+  buf.set_device_str(key.deviceStr);
+  buf.set_git_version(key.gitVersion);
+
+  std::transform(
+      values.begin(),
+      values.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(buf.mutable_values()),
+      [](const Values& v) {
+        CpuOptionsCacheValuesProto buf;
+        *buf.mutable_kernel_options() = v.mappingOptions.proto();
+        for (const auto& r : v.recordedRuntimes) {
+          buf.add_recorded_runtimes(
+              std::chrono::duration_cast<std::chrono::microseconds>(r).count());
+        }
+        return buf;
+      });
+  return buf;
+}
+
+namespace {
+std::shared_ptr<CpuObjectCache> cpuObjectCache_;
+} // namespace
+
+std::shared_ptr<CpuObjectCache>& CpuObjectCache::getGlobalSharedCache() {
+  return cpuObjectCache_;
+}
+
+CpuObjectCache::CachedEntry::CachedEntry(
+    const std::string& module,
+    const std::string& deviceStr,
+    const std::string& object)
+    : key{module, deviceStr, git_version}, object(object) {}
+
+CpuObjectCache::CachedEntry::CachedEntry(const CpuObjectCacheEntryProto& buf)
+    : key{buf.module(), buf.device_str(), buf.git_version()},
+      object(buf.object()) {}
+
+CpuObjectCacheEntryProto CpuObjectCache::CachedEntry::toProtobuf() const {
+  CpuObjectCacheEntryProto buf;
+  buf.set_module(key.module);
+  buf.set_device_str(key.deviceStr);
+  buf.set_git_version(key.gitVersion);
+  buf.set_object(object);
+  return buf;
+}
+
+bool CpuObjectCache::CachedEntry::Key::operator==(const Key& other) const {
+  return module == other.module && deviceStr == other.deviceStr;
+}
+
+size_t CpuObjectCache::hashKey(const CachedEntry::Key& key) {
+  return hashCombineValue(hashCombineValue(0, key.module), key.deviceStr);
+}
+
+CpuObjectCache::CpuObjectCache(const CpuObjectCacheProto& buf) {
+  entries_.reserve(buf.entries_size());
+  for (const auto& entry_buf : buf.entries())
+    entries_.emplace_back(entry_buf);
+  rebuildIndex();
+}
+
+CpuObjectCacheProto CpuObjectCache::toProtobuf() const {
+  materializeAll();
+  CpuObjectCacheProto buf;
+  auto* entriesBuf = buf.mutable_entries();
+  entriesBuf->Reserve(entries_.size());
+  std::transform(
+      entries_.begin(),
+      entries_.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(entriesBuf),
+      [](const CachedEntry& entry) { return entry.toProtobuf(); });
+  return buf;
+}
+
+const CpuObjectCache::CachedEntry* CpuObjectCache::searchObject(
+    const std::string& module,
+    const std::string& deviceStr) const {
+  CachedEntry::Key key{module, deviceStr, git_version};
+  auto hash = hashKey(key);
+  materialize(hash);
+  auto range = index_.equal_range(hash);
+  auto it = std::find_if(
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
+        return entries_[kv.second].key == key;
+      });
+  return it == range.second ? nullptr : &entries_[it->second];
+}
+
+void CpuObjectCache::cacheObject(
+    const std::string& module,
+    const std::string& deviceStr,
+    const std::string& object) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberCacheAttemps;
+  if (searchObject(module, deviceStr)) {
+    return;
+  }
+  entries_.emplace_back(module, deviceStr, object);
+  indexLastEntry();
+  syncSharedFile();
+}
+
+std::unique_ptr<std::string> CpuObjectCache::retrieveObject(
+    const std::string& module,
+    const std::string& deviceStr) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberAttemptedRetrievals;
+  auto entry = searchObject(module, deviceStr);
+  if (not entry) {
+    return nullptr;
+  }
+  ++numberSuccessfulRetrievals;
+  return std::unique_ptr<std::string>(new std::string(entry->object));
+}
+
+std::string makeCpuObjectsFilename(const std::string& filename) {
+  return filename + ".cpu_objects";
+}
+
+std::string makeCpuOptionsFilename(const std::string& filename) {
+  return filename + ".cpu_options";
+}
+
+} // namespace tc
@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+
+#include <compcache.pb.h>
+
+#include "tc/core/compilation_cache.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+/// Identifies the CPU the kernels run on: the CPU and the target features
+/// the kernels are compiled for (see JitTarget::fromFlags) and the number of
+/// threads running parallel loops, which all change the best options.
+std::string cpuDeviceStr();
+
+/**
+ * CpuOptionsCache is the OptionsCache of the CPU backend: it stores the
+ * CpuMappingOptions tried for a kernel and their runtimes, e.g. as recorded
+ * by the autotuner.
+ */
+class CpuOptionsCache : public Cache<CpuOptionsCache> {
+  friend class Cache<CpuOptionsCache>;
+  using Protobuf = CpuOptionsCacheProto;
+  using EntryProtobuf = CpuOptionsCacheEntryProto;
+  static std::shared_ptr<CpuOptionsCache>& getGlobalSharedCache();
+
+ public:
+  /**
+   * A CpuOptionsCache holds multiple CachedEntry's.
+   * Each CachedEntry is split to two conceptual parts the key and the values.
+   * The key is:
+   *                  the kernel/op's unique id (string),
+   *                  the specialized input dimensions,
+   *                  the target CPU (cpuDeviceStr),
+   *                  tc's version (string),
+   * The values are a vector of:
+   *                  the options used when the kernel was optimized,
+   *                  profiling information
+   */
+  struct CachedEntry {
+    CachedEntry(
+        const std::string& id,
+        const std::vector<const DLTensor*>& inputs,
+        const std::vector<const DLTensor*>& outputs,
+        const std::string& deviceStr,
+        const CpuMappingOptions& options,
+        Duration runtime);
+    CachedEntry(const CpuOptionsCacheEntryProto& buf);
+    CpuOptionsCacheEntryProto toProtobuf() const;
+
+    struct Key {
+      Key(const std::string& id,
+          std::vector<detail::TensorInfo>&& inputs,
+          std::vector<detail::TensorInfo>&& outputs,
+          const std::string& deviceStr,
+          const std::string& gitVersion);
+
+      std::string id;
+      std::vector<detail::TensorInfo> inputs;
+      std::vector<detail::TensorInfo> outputs;
+      std::string deviceStr;
+      std::string gitVersion;
+
+      // Compares the fields that lookups compare, the git version is left
+      // out.
+      bool operator==(const Key& other) const;
+    };
+
+    struct Values {
+      Values(const CpuMappingOptions& options, Duration runtime);
+      Values(
+          const CpuMappingOptions& options,
+          std::vector<Duration>&& runtimes);
+      CpuMappingOptions mappingOptions;
+      std::vector<Duration> recordedRuntimes;
+      // The first savedRuntimes recorded runtimes were loaded from, or
+      // written to, the backing file.
+      size_t savedRuntimes;
+    };
+    Key key;
+    std::vector<Values> values;
+  };
+
+ private:
+  // mutable because lookups parse the entries of the backing file lazily
+  mutable std::vector<CachedEntry> entries_;
+
+  static size_t hashKey(const CachedEntry::Key& key);
+  // Same merging as OptionsCache: records hold the runtimes recorded since
+  // the previous record of the same key, they add up.
+  static void mergeRecord(CachedEntry& entry, CachedEntry&& record);
+  static bool unsavedProtobuf(
+      const CachedEntry& entry,
+      CpuOptionsCacheEntryProto& buf);
+  static void markSaved(CachedEntry& entry);
+  static bool dropSaved(CachedEntry& entry);
+
+  CachedEntry* searchKernel(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs);
+  const CachedEntry* searchKernel(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs) const;
+
+  // deduces whether C is const or non-const
+  template <typename C>
+  static auto searchKernelImpl(
+      C& c,
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs)
+      -> decltype(c.searchKernel(id, inputs, outputs));
+
+ public:
+  CpuOptionsCache() = default;
+  CpuOptionsCache(const CpuOptionsCacheProto& buf);
+
+  decltype(entries_)::const_iterator begin() const;
+  decltype(entries_)::const_iterator end() const;
+
+  CpuOptionsCacheProto toProtobuf() const;
+  struct RetrievalResult {
+    CpuMappingOptions options;
+    std::vector<Duration> recordedRuntimes;
+  };
+
+  // returns the sum of cache entry sizes (that is a single cache entry can have
+  // multiple options and profiling information associated with it)
+  size_t totalSize() const;
+
+  void recordRuntime(
+      const std::string& id,
+      const CpuMappingOptions& options,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      Duration runtime);
+
+  std::vector<RetrievalResult> retrieveOptionsAndRuntimes(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs) const;
+
+  std::unique_ptr<CpuMappingOptions> retrieveBestOptions(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs) const;
+
+  std::vector<CpuMappingOptions> retrieveTopKOptions(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      size_t k) const;
+
+  // Only (up to) numberToKeep entries per operation (combination of id and
+  // input info) are kept in the cache. The best performing versions are kept
+  void keepOnlyBestCandidates(size_t numberToKeep);
+};
+
+/**
+ * CpuObjectCache holds the object code LLVM compiled for the kernel modules,
+ * so that jit-compiling a module it holds skips both the optimization
+ * pipeline and the instruction selection (see JitObjectCache).
+ * Modules are looked up by their IR before optimization, which only depends
+ * on the TC, the input sizes and the options, and by the target machine the
+ * object was compiled for.
+ */
+class CpuObjectCache : public Cache<CpuObjectCache> {
+  friend class Cache<CpuObjectCache>;
+  using Protobuf = CpuObjectCacheProto;
+  using EntryProtobuf = CpuObjectCacheEntryProto;
+  static std::shared_ptr<CpuObjectCache>& getGlobalSharedCache();
+
+ public:
+  struct CachedEntry {
+    CachedEntry(
+        const std::string& module,
+        const std::string& deviceStr,
+        const std::string& object);
+    CachedEntry(const CpuObjectCacheEntryProto& buf);
+    CpuObjectCacheEntryProto toProtobuf() const;
+
+    struct Key {
+      std::string module;
+      std::string deviceStr;
+      std::string gitVersion;
+
+      // Compares the fields that lookups compare, the git version is left
+      // out.
+      bool operator==(const Key& other) const;
+    };
+
+    Key key;
+    std::string object;
+  };
+
+ private:
+  // mutable because lookups parse the entries of the backing file lazily
+  mutable std::vector<CachedEntry> entries_;
+
+  static size_t hashKey(const CachedEntry::Key& key);
+
+  const CachedEntry* searchObject(
+      const std::string& module,
+      const std::string& deviceStr) const;
+
+ public:
+  CpuObjectCache() = default;
+  CpuObjectCache(const CpuObjectCacheProto& buf);
+  CpuObjectCacheProto toProtobuf() const;
+
+  /// Stores the object compiled for module, keeps the object already cached
+  /// if any.
+  void cacheObject(
+      const std::string& module,
+      const std::string& deviceStr,
+      const std::string& object);
+
+  /// \returns a copy of the object compiled for module, nullptr if none.
+  std::unique_ptr<std::string> retrieveObject(
+      const std::string& module,
+      const std::string& deviceStr) const;
+};
+
+std::string makeCpuObjectsFilename(const std::string& filename);
+
+std::string makeCpuOptionsFilename(const std::string& filename);
+
+} // namespace tc
+
+#include "tc/core/cpu/cpu_compilation_cache-inl.h"
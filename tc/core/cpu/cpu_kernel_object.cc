@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_kernel_object.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+#include "llvm/IR/Module.h"
+
+#include "tc/core/compilation_cache.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/polyhedral/llvm_jit.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/lang/canonicalize.h"
+#include "tc/lang/parse_cache.h"
+
+namespace tc {
+
+CpuKernelObject compileCpuKernelObject(
+    const std::string& tc,
+    const CpuOptionsCacheProto& optionsCache,
+    bool positionIndependent) {
+  // The caches are keyed by the canonical form of the definitions.
+  std::unordered_map<std::string, lang::TreeRef> defs;
+  for (const auto& def : lang::parseCached(tc)) {
+    defs.emplace(lang::canonicalTc(def), def);
+  }
+
+  llvm::Optional<llvm::Reloc::Model> relocationModel;
+  if (positionIndependent) {
+    relocationModel = llvm::Reloc::PIC_;
+  }
+  Jit jit(relocationModel);
+
+  CpuKernelObject res;
+  // The definitions and input shapes already compiled.
+  std::unordered_set<std::string> compiled;
+  std::vector<std::unique_ptr<llvm::Module>> modules;
+  for (const auto& entry : optionsCache.entries()) {
+    auto def = defs.find(entry.id());
+    if (def == defs.end() or entry.values_size() == 0) {
+      continue;
+    }
+    auto kernelKey = entry.id();
+    std::vector<dlutils::DLTensorUPtr> inputs;
+    for (const auto& input : entry.inputs()) {
+      kernelKey += input.SerializeAsString();
+      inputs.push_back(
+          detail::makeTensorMetadata(input, dlutils::getCPUDLContext()));
+    }
+    if (not compiled.insert(kernelKey).second) {
+      LOG(INFO) << "Skipping options recorded on " << entry.device_str()
+                << " for " << lang::Def(def->second).name().name()
+                << ", the object already holds this kernel";
+      continue;
+    }
+    auto options = detail::bestOptions<CpuMappingOptions>(entry);
+    CpuTcExecutor executor(
+        lang::Def(def->second).name().name(),
+        dlutils::extractRawPtrs(inputs),
+        options.toProtobufSerializedString(),
+        def->second);
+    modules.push_back(executor.generateModule(options, jit));
+    res.kernels.push_back(executor.kernelSpecializedName);
+  }
+  if (not modules.empty()) {
+    res.object = jit.emitObject(std::move(modules));
+  }
+  return res;
+}
+
+} // namespace tc
@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <compcache.pb.h>
+
+namespace tc {
+
+/// Ahead-of-time compiled CPU kernels: a relocatable object file and the
+/// specialized names of the kernels it defines.
+struct CpuKernelObject {
+  std::string object;
+  /// Each kernel is defined with C linkage, with one pointer argument per
+  /// input then output, and so is its packed entry point, the kernel name
+  /// followed by kPackedKernelSuffix, which takes them as an array of
+  /// pointers.
+  std::vector<std::string> kernels;
+};
+
+/**
+ * Compiles the definitions of tc with the best options recorded in
+ * optionsCache for each input shape into a single object file for the host
+ * CPU, which can be linked without LLVM: the parallel loops only need the
+ * tc_cpu_parallel_for and tc_cpu_num_threads runtime of the
+ * tc_core_cpu_runtime library.  If
+ * positionIndependent is set, the object can be linked into a shared
+ * library.  Entries of optionsCache whose id is not a definition of tc are
+ * skipped, so are entries for a kernel already compiled (e.g. options
+ * recorded with another number of threads).
+ */
+CpuKernelObject compileCpuKernelObject(
+    const std::string& tc,
+    const CpuOptionsCacheProto& optionsCache,
+    bool positionIndependent);
+
+} // namespace tc
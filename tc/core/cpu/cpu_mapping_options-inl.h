@@ -22,6 +22,16 @@ namespace tc {
 CpuMappingOptions::CpuMappingOptions()
     : ownedProto_(), generic(*ownedProto_.mutable_generic_mapping_options()) {}
 
+CpuMappingOptions::CpuMappingOptions(const CpuMappingOptions& options)
+    : ownedProto_(options.ownedProto_),
+      generic(*ownedProto_.mutable_generic_mapping_options()) {}
+
+CpuMappingOptions& CpuMappingOptions::operator=(
+    const CpuMappingOptions& options) {
+  ownedProto_ = options.ownedProto_; // views already point to the proper place
+  return modified();
+}
+
 /// Construct from a serialized protocol buffer message.
 CpuMappingOptions::CpuMappingOptions(const std::string& str)
     : CpuMappingOptions() {
@@ -29,12 +39,76 @@ CpuMappingOptions::CpuMappingOptions(const std::string& str)
   CHECK(parsed) << "could not parse protobuf string";
 }
 
-bool CpuMappingOptions::operator==(const CpuMappingOptions& options) {
-  return generic == options.generic;
+bool CpuMappingOptions::operator==(const CpuMappingOptions& options) const {
+  // Different hashes are different options, equal hashes may still collide
+  return hash() == options.hash() &&
+      ownedProto_.SerializeAsString() ==
+      options.ownedProto_.SerializeAsString();
+}
+
+uint64_t CpuMappingOptions::hash() const {
+  auto h = hash_.load(std::memory_order_relaxed);
+  if (h == 0) {
+    h = stableHash(ownedProto_.SerializeAsString());
+    hash_.store(h, std::memory_order_relaxed);
+  }
+  return h;
+}
+
+CpuMappingOptions& CpuMappingOptions::modified() {
+  hash_.store(0, std::memory_order_relaxed);
+  return *this;
 }
 
 std::string CpuMappingOptions::toProtobufSerializedString() const {
   return ownedProto_.SerializeAsString();
 }
 
+CpuMappingOptions& CpuMappingOptions::genericMappingOptions(
+    const MappingOptions& options) {
+  *(ownedProto_.mutable_generic_mapping_options()) = options.view.proto;
+  return modified();
+}
+
+CpuMappingOptions& CpuMappingOptions::l2Tile(
+    const std::vector<uint64_t>& sizes) {
+  auto tiling = ownedProto_.mutable_l2_tiling();
+  tiling->clear_sizes();
+  for (auto size : sizes) {
+    tiling->add_sizes(size);
+  }
+  return modified();
+}
+
+CpuMappingOptions& CpuMappingOptions::parallelDepth(uint32_t depth) {
+  ownedProto_.set_parallel_depth(depth);
+  return modified();
+}
+
+CpuMappingOptions& CpuMappingOptions::vectorizeWidth(uint32_t width) {
+  ownedProto_.set_vectorize_width(width);
+  return modified();
+}
+
+CpuMappingOptions& CpuMappingOptions::prefetchDistance(uint32_t distance) {
+  ownedProto_.set_prefetch_distance(distance);
+  return modified();
+}
+
+CpuMappingOptions& CpuMappingOptions::packingLevel(uint32_t level) {
+  ownedProto_.set_packing_level(level);
+  return modified();
+}
+
+CpuMappingOptions& CpuMappingOptions::maxPackingBytes(uint64_t bytes) {
+  ownedProto_.set_max_packing_bytes(bytes);
+  return modified();
+}
+
+CpuMappingOptions CpuMappingOptions::makeNaiveCpuMappingOptions() {
+  CpuMappingOptions mo;
+  mo.genericMappingOptions(MappingOptions::makeUnmappedMappingOptions());
+  return mo;
+}
+
 } // namespace tc
@@ -17,23 +17,89 @@
 
 #include <mapping_options.pb.h>
 
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "tc/core/mapping_options.h"
+#include "tc/core/utils/hash.h"
 
 namespace tc {
 
 class CpuMappingOptions {
  public:
-  CpuMappingOptions();
+  inline CpuMappingOptions();
+  /// Construct a deep copy of the options.
+  inline CpuMappingOptions(const CpuMappingOptions& options);
+  inline CpuMappingOptions& operator=(const CpuMappingOptions& options);
 
   /// Construct from a serialized protocol buffer message.
   inline explicit CpuMappingOptions(const std::string& str);
 
-  inline bool operator==(const CpuMappingOptions& options);
+  /// Options of different hashes compare unequal without serializing them.
+  inline bool operator==(const CpuMappingOptions& options) const;
+
+  /// Stable 64-bit hash of the serialized options, computed on first use
+  /// and kept until the next modifier.  Changes made directly through
+  /// generic after the hash was computed are not seen: make them before
+  /// comparing or hashing the options, or through the modifiers.
+  inline uint64_t hash() const;
 
   inline std::string toProtobufSerializedString() const;
 
+  /**
+   * @name Chainable Modifiers specific to CpuMappingOptions
+   * See protobuf for documentation on each option.
+   * @{
+   */
+  inline CpuMappingOptions& genericMappingOptions(
+      const MappingOptions& options);
+  inline CpuMappingOptions& l2Tile(const std::vector<uint64_t>& sizes);
+  inline CpuMappingOptions& parallelDepth(uint32_t depth);
+  inline CpuMappingOptions& vectorizeWidth(uint32_t width);
+  inline CpuMappingOptions& prefetchDistance(uint32_t distance);
+  inline CpuMappingOptions& packingLevel(uint32_t level);
+  inline CpuMappingOptions& maxPackingBytes(uint64_t bytes);
+  ///@}
+
+  /// Static constructors for predefined strategies.
+  ///@{
+  inline static CpuMappingOptions makeNaiveCpuMappingOptions();
+  ///@}
+
+  const CpuMappingOptionsProto& proto() const {
+    return ownedProto_;
+  }
+
+#define FORWARD_FUN(FUN_NAME)                        \
+  template <typename... Args>                        \
+  inline CpuMappingOptions& FUN_NAME(Args... args) { \
+    generic.FUN_NAME(args...);                       \
+    return modified();                               \
+  }
+
+  FORWARD_FUN(tile);
+  FORWARD_FUN(unroll);
+  FORWARD_FUN(fixParametersBeforeScheduling);
+  FORWARD_FUN(tileImperfectlyNested);
+  FORWARD_FUN(inlinePointwiseTemporaries);
+  FORWARD_FUN(scheduleFusionStrategy);
+  FORWARD_FUN(outerScheduleFusionStrategy);
+  FORWARD_FUN(outerScheduleAllowSkewing);
+  FORWARD_FUN(outerSchedulePositiveOrthant);
+  FORWARD_FUN(outerScheduleNeverFuse);
+
+#undef FORWARD_FUN
+
  private:
+  /// Drops the cached hash, returns *this for the modifiers.
+  inline CpuMappingOptions& modified();
+
   CpuMappingOptionsProto ownedProto_;
+  /// Cached result of hash(), 0 until computed.  Atomic so that const
+  /// options can be hashed from several threads.
+  mutable std::atomic<uint64_t> hash_{0};
 
  public:
   MappingOptionsView generic;
@@ -0,0 +1,387 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/cpu_parallel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <glog/logging.h>
+
+#include "tc/core/flags.h"
+
+namespace tc {
+
+// Defined here rather than in flags.cc so that precompiled kernels only
+// need this runtime, see compileCpuKernelObject.
+DEFINE_uint32(
+    llvm_num_threads,
+    0,
+    "Number of threads running the parallel loops of CPU kernels, 0 for one per hardware thread");
+
+DEFINE_bool(
+    llvm_numa,
+    false,
+    "Pin the threads running the parallel loops of CPU kernels to the NUMA nodes and split the iterations of the loops by node");
+
+namespace {
+// Parses a list of CPUs or of nodes as in sysfs, e.g. "0-3,8-11".
+std::vector<int> parseList(const std::string& list) {
+  std::vector<int> res;
+  std::istringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || !std::isdigit(range[0])) {
+      continue;
+    }
+    auto dash = range.find('-');
+    auto first = std::stoi(range.substr(0, dash));
+    auto last = dash == std::string::npos ? first
+                                          : std::stoi(range.substr(dash + 1));
+    for (auto i = first; i <= last; ++i) {
+      res.push_back(i);
+    }
+  }
+  return res;
+}
+
+std::string readLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string res;
+  std::getline(file, res);
+  return res;
+}
+
+std::vector<std::vector<int>> readNumaNodes() {
+  std::vector<std::vector<int>> res;
+  for (auto node :
+       parseList(readLine("/sys/devices/system/node/online"))) {
+    auto cpus = parseList(readLine(
+        "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    // Nodes of memory only.
+    if (!cpus.empty()) {
+      res.push_back(cpus);
+    }
+  }
+  if (res.empty()) {
+    res.push_back({});
+  }
+  return res;
+}
+
+#ifdef __linux__
+std::vector<int> getAffinity() {
+  std::vector<int> res;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        res.push_back(cpu);
+      }
+    }
+  }
+  return res;
+}
+
+// Pins the calling thread to cpus, leaves it as it is if cpus is empty.
+void setAffinity(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    LOG(WARNING) << "could not set the CPU affinity of a thread";
+  }
+}
+#else
+std::vector<int> getAffinity() {
+  return {};
+}
+
+void setAffinity(const std::vector<int>&) {}
+#endif
+
+const std::vector<int>& nodeCpus(int node) {
+  const auto& nodes = cpuNumaNodes();
+  CHECK_LT(static_cast<size_t>(node), nodes.size())
+      << "the host has " << nodes.size() << " NUMA nodes";
+  return nodes[node];
+}
+
+thread_local int boundNode = -1;
+} // namespace
+
+const std::vector<std::vector<int>>& cpuNumaNodes() {
+  static const auto nodes = readNumaNodes();
+  return nodes;
+}
+
+size_t currentNumaNode() {
+#ifdef __linux__
+  static const auto nodeOfCpu = []() {
+    std::unordered_map<int, size_t> res;
+    const auto& nodes = cpuNumaNodes();
+    for (size_t node = 0; node < nodes.size(); ++node) {
+      for (auto cpu : nodes[node]) {
+        res[cpu] = node;
+      }
+    }
+    return res;
+  }();
+  auto it = nodeOfCpu.find(sched_getcpu());
+  if (it != nodeOfCpu.end()) {
+    return it->second;
+  }
+#endif
+  return 0;
+}
+
+int boundNumaNode() {
+  return boundNode;
+}
+
+WithNumaNode::WithNumaNode(int node) : previous_(boundNode) {
+  if (node < 0) {
+    return;
+  }
+  previousCpus_ = getAffinity();
+  setAffinity(nodeCpus(node));
+  boundNode = node;
+}
+
+WithNumaNode::~WithNumaNode() {
+  if (boundNode != previous_) {
+    setAffinity(previousCpus_);
+    boundNode = previous_;
+  }
+}
+
+struct ThreadPool::Job {
+  // The iterations are split into nParts contiguous ranges.
+  Job(int64_t n_,
+      size_t maxHelpers_,
+      const std::function<void(int64_t)>* body_,
+      int node_,
+      size_t nParts_)
+      : n(n_),
+        maxHelpers(maxHelpers_),
+        body(body_),
+        node(node_),
+        nParts(nParts_),
+        next(new std::atomic<int64_t>[nParts_]) {
+    for (size_t p = 0; p < nParts; ++p) {
+      next[p] = bound(p);
+    }
+  }
+
+  int64_t bound(size_t part) const {
+    return n * static_cast<int64_t>(part) / static_cast<int64_t>(nParts);
+  }
+
+  // Run iterations until there are none left, those of range home first.
+  void run(size_t home) {
+    for (size_t k = 0; k < nParts; ++k) {
+      auto p = (home + k) % nParts;
+      auto end = bound(p + 1);
+      for (auto i = next[p]++; i < end; i = next[p]++) {
+        (*body)(i);
+        if (++finished == n) {
+          std::lock_guard<std::mutex> lock(mutex);
+          done.notify_all();
+        }
+      }
+    }
+  }
+
+  const int64_t n;
+  // Number of workers that may join the thread that submitted the job.
+  const size_t maxHelpers;
+  // Only called for iterations that are not finished, so it outlives the
+  // calls even though the job itself may outlive the submitting call.
+  const std::function<void(int64_t)>* body;
+  // Only the workers of node run the job, all of them if it is negative.
+  const int node;
+  const size_t nParts;
+  std::unique_ptr<std::atomic<int64_t>[]> next;
+  std::atomic<int64_t> finished{0};
+  // Only accessed under the lock of the pool.
+  size_t helpers = 0;
+  std::mutex mutex;
+  std::condition_variable done;
+};
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wakeUp_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::work(int node) {
+  if (node >= 0) {
+    setAffinity(nodeCpus(node));
+  }
+  auto home = node >= 0 ? static_cast<size_t>(node) : 0;
+  auto runs = [node](const std::shared_ptr<Job>& job) {
+    return job->node < 0 or job->node == node;
+  };
+  while (true) {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      std::deque<std::shared_ptr<Job>>::iterator it;
+      wakeUp_.wait(lock, [this, &it, &runs]() {
+        it = std::find_if(jobs_.begin(), jobs_.end(), runs);
+        return stop_ or it != jobs_.end();
+      });
+      if (stop_) {
+        return;
+      }
+      job = *it;
+      if (++job->helpers == job->maxHelpers) {
+        jobs_.erase(it);
+      }
+    }
+    job->run(home % job->nParts);
+  }
+}
+
+// Under the lock of the pool.
+void ThreadPool::spawn(int node) {
+  workerNodes_.push_back(node);
+  workers_.emplace_back([this, node]() { work(node); });
+}
+
+void ThreadPool::parallelFor(
+    int64_t n,
+    size_t nThreads,
+    const std::function<void(int64_t)>& body) {
+  if (n <= 0) {
+    return;
+  }
+  auto node = boundNode;
+  const auto& nodes = cpuNumaNodes();
+  if (node >= 0 and not nodes[node].empty()) {
+    nThreads = std::min(nThreads, nodes[node].size());
+  }
+  auto maxHelpers = std::min<int64_t>(nThreads, n) - 1;
+  if (maxHelpers <= 0) {
+    for (int64_t i = 0; i < n; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  auto numa = FLAGS_llvm_numa and node < 0 and nodes.size() > 1;
+  auto job = std::make_shared<Job>(
+      n, maxHelpers, &body, node, numa ? nodes.size() : 1);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node >= 0) {
+      while (static_cast<size_t>(std::count(
+                 workerNodes_.begin(), workerNodes_.end(), node)) <
+             job->maxHelpers) {
+        spawn(node);
+      }
+    } else {
+      // Workers of the bound jobs help the others as well.
+      while (workers_.size() < job->maxHelpers) {
+        spawn(
+            FLAGS_llvm_numa and nodes.size() > 1
+                ? static_cast<int>(workers_.size() % nodes.size())
+                : -1);
+      }
+    }
+    jobs_.push_back(job);
+  }
+  wakeUp_.notify_all();
+
+  job->run(numa ? currentNumaNode() % job->nParts : 0);
+  {
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&job]() { return job->finished == job->n; });
+  }
+  // Do not leave the job for workers that would only find it completed.
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find(jobs_.begin(), jobs_.end(), job);
+  if (it != jobs_.end()) {
+    jobs_.erase(it);
+  }
+}
+
+ThreadPool& cpuThreadPool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void cpuFirstTouch(void* data, size_t bytes) {
+  constexpr int64_t kPageSize = 4096;
+  auto bytesPerThread = (bytes + cpuNumThreads() - 1) / cpuNumThreads();
+  auto chunk = std::max<int64_t>(
+      kPageSize, (bytesPerThread + kPageSize - 1) / kPageSize * kPageSize);
+  auto n = (static_cast<int64_t>(bytes) + chunk - 1) / chunk;
+  auto begin = static_cast<char*>(data);
+  cpuThreadPool().parallelFor(n, cpuNumThreads(), [=](int64_t i) {
+    auto size = std::min<int64_t>(chunk, bytes - i * chunk);
+    std::memset(begin + i * chunk, 0, size);
+  });
+}
+
+size_t cpuNumThreads() {
+  if (FLAGS_llvm_num_threads > 0) {
+    return FLAGS_llvm_num_threads;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+} // namespace tc
+
+extern "C" void tc_cpu_parallel_for(
+    int64_t begin,
+    int64_t end,
+    int64_t step,
+    void (*body)(int64_t, void*),
+    void* closure) {
+  CHECK_GT(step, 0);
+  if (end <= begin) {
+    return;
+  }
+  auto n = (end - begin + step - 1) / step;
+  tc::cpuThreadPool().parallelFor(n, tc::cpuNumThreads(), [=](int64_t i) {
+    body(begin + i * step, closure);
+  });
+}
+
+extern "C" int64_t tc_cpu_num_threads() {
+  return tc::cpuNumThreads();
+}
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tc {
+
+/// Name of the runtime function that the LLVM codegen calls to run the
+/// iterations of a parallel loop outlined into a function.
+constexpr auto kParallelForName = "tc_cpu_parallel_for";
+
+/// Name of the runtime function returning the number of threads, which the
+/// LLVM codegen splits parallel reductions into.
+constexpr auto kNumThreadsName = "tc_cpu_num_threads";
+
+/// The CPUs of each NUMA node of the host, as listed in sysfs on Linux.  A
+/// single node without CPUs, i.e., all of them, if the topology is unknown.
+const std::vector<std::vector<int>>& cpuNumaNodes();
+
+/// Node of the CPU the calling thread runs on, 0 if unknown.
+size_t currentNumaNode();
+
+/// A pool of threads running the iterations of parallel loops.  The thread
+/// calling parallelFor runs iterations as well, idle workers join it and all
+/// participating threads grab the next iteration from a shared counter, so
+/// imbalanced iterations do not leave threads waiting.  Workers are spawned
+/// lazily, up to the largest number of threads requested so far.
+/// With --llvm_numa, the workers are pinned to the NUMA nodes in turn and
+/// the iterations are split into contiguous ranges, one per node, that the
+/// threads of the node run first before helping the other nodes, so that
+/// the rows of the outermost parallel loop, and the pages they first touch,
+/// stay on a node from one run to the next.  The loops started by a thread
+/// bound to a node (see WithNumaNode) only run on the workers of that node.
+class ThreadPool {
+ public:
+  ThreadPool() = default;
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Call body(i) for each i in [0, n) on at most nThreads threads, including
+  /// the calling one, and return once all calls are done.
+  void parallelFor(
+      int64_t n,
+      size_t nThreads,
+      const std::function<void(int64_t)>& body);
+
+ private:
+  struct Job;
+
+  // Runs the jobs of node, or those of any node if it is negative.
+  void work(int node);
+  void spawn(int node);
+
+  std::mutex mutex_;
+  std::condition_variable wakeUp_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+  std::vector<std::thread> workers_;
+  // The node each worker is pinned to, -1 if it is not.
+  std::vector<int> workerNodes_;
+  bool stop_ = false;
+};
+
+/// Binds the calling thread, and the parallel loops it starts, to the CPUs
+/// of a NUMA node while in scope, so that the memory it first touches is
+/// allocated on the node.  A negative node leaves the thread unbound.
+class WithNumaNode {
+ public:
+  explicit WithNumaNode(int node);
+  ~WithNumaNode();
+
+  WithNumaNode(const WithNumaNode&) = delete;
+  WithNumaNode& operator=(const WithNumaNode&) = delete;
+
+ private:
+  int previous_;
+  std::vector<int> previousCpus_;
+};
+
+/// The node the calling thread is bound to, -1 if none.
+int boundNumaNode();
+
+/// Zeroes bytes at data in pages spread over the threads of the pool the
+/// way parallelFor splits iterations, so that newly allocated memory, e.g.
+/// the rows of a tensor that parallel loops then write, is placed on the
+/// nodes that use it rather than on the node of the allocating thread.
+void cpuFirstTouch(void* data, size_t bytes);
+
+/// The pool shared by all CPU kernels.
+ThreadPool& cpuThreadPool();
+
+/// Number of threads running parallel loops, as set by --llvm_num_threads.
+size_t cpuNumThreads();
+
+} // namespace tc
+
+/// Entry point of the CPU kernels into the thread pool: call
+/// body(i, closure) for i = begin, begin + step, ... below end in parallel.
+extern "C" void tc_cpu_parallel_for(
+    int64_t begin,
+    int64_t end,
+    int64_t step,
+    void (*body)(int64_t, void*),
+    void* closure);
+
+/// Number of threads running parallel loops, see cpuNumThreads.  Parallel
+/// reductions accumulate one partial result per thread.
+extern "C" int64_t tc_cpu_num_threads();
@@ -15,9 +15,14 @@
  */
 #include "tc/core/cpu/cpu_tc_executor.h"
 
+#include "tc/core/cpu/cpu_compilation_cache.h"
 #include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/flags.h"
 #include "tc/core/halide_utils.h"
-#include "tc/core/polyhedral/cuda/mapped_scop.h"
+#include "tc/core/polyhedral/codegen_llvm.h"
+#include "tc/core/polyhedral/llvm_jit.h"
+#include "tc/core/polyhedral/memory_promotion.h"
+#include "tc/core/polyhedral/schedule_transforms.h"
 #include "tc/core/tc2halide.h"
 #include "tc/core/utils/dlpack.h"
 
@@ -25,15 +30,241 @@
 #include "tc/lang/sema.h"
 
 #include <version.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
 #include <utility>
 
 namespace tc {
 
 using namespace dlutils;
 
-void CpuTcExecutor::compile(const tc::CpuMappingOptions& options) {}
+namespace {
+// Tile the outermost band with the L2 tile sizes, if any, and the resulting
+// point band, or the outermost band if there are no L2 tile sizes, with the
+// generic (L1) tile sizes, if any.  Return the tile bands for the L1 and the
+// L2 caches, in this order, null if not tiled for that cache.
+std::pair<polyhedral::detail::ScheduleTree*, polyhedral::detail::ScheduleTree*>
+tileForCaches(polyhedral::Scop& scop, const CpuMappingOptions& options) {
+  using namespace polyhedral::detail;
 
-void CpuTcExecutor::compileWithTcMapper() {}
+  auto l1Sizes = options.generic.tiling.extractVector();
+  Tiling l2Tiling(options.proto().l2_tiling());
+  if (l2Tiling.view.size() == 0) {
+    if (l1Sizes.empty()) {
+      return {nullptr, nullptr};
+    }
+    return {scop.tileOuterBand(options.generic.tiling), nullptr};
+  }
+  auto tileBand = scop.tileOuterBand(l2Tiling.view);
+  if (l1Sizes.empty()) {
+    return {nullptr, tileBand};
+  }
+  auto l1Band = bandTile(
+      tileBand->child({0}),
+      std::vector<size_t>(l1Sizes.begin(), l1Sizes.end()),
+      polyhedral::TileOptions::ShiftPointLoops);
+  return {l1Band, tileBand};
+}
+
+// Whether two instances of the same tile of "group", whose tiles are the
+// iterations of "schedule", access the same element.
+bool hasReuse(
+    const polyhedral::TensorReferenceGroup& group,
+    isl::union_map schedule) {
+  if (group.references.size() > 1) {
+    return true;
+  }
+  auto access = isl::union_map(group.references[0]->originalAccess);
+  return !schedule.range_product(access).is_injective();
+}
+
+// Packing, by analogy with GEMM libraries: copy the tensors reused in each
+// tile below "band" into packed buffers at the start of the tile, and read
+// the buffers in the tile.  The buffers are the private promoted arrays of
+// the scop.  Only the read-only groups with affine accesses of the tensors
+// that are not aliased are promoted, in order of the tensor names, as long
+// as the buffers of the tile fit in "maxBytes".
+void packTiles(
+    polyhedral::Scop& scop,
+    polyhedral::detail::ScheduleTree* band,
+    size_t maxBytes) {
+  using namespace polyhedral;
+
+  auto root = scop.scheduleRoot();
+  auto schedule = detail::partialSchedule(root, band);
+  auto groupMap = TensorReferenceGroup::accessedBySubtree(band, scop);
+  std::map<std::string, isl::id> tensorIds;
+  for (const auto& kvp : groupMap) {
+    tensorIds.emplace(kvp.first.get_name(), kvp.first);
+  }
+  std::unordered_set<std::string> aliased;
+  for (const auto& alias : scop.halide.aliases) {
+    aliased.insert(alias.first);
+    aliased.insert(alias.second);
+  }
+  auto elementBytes = [&scop](const std::string& name) -> size_t {
+    for (const auto& input : scop.halide.inputs) {
+      if (input.name() == name) {
+        return input.type().bytes();
+      }
+    }
+    for (const auto& output : scop.halide.outputs) {
+      if (output.name() == name) {
+        return output.type().bytes();
+      }
+    }
+    return 0;
+  };
+
+  size_t bytes = 0;
+  for (const auto& kvp : tensorIds) {
+    auto tensorBytes = elementBytes(kvp.first);
+    if (tensorBytes == 0 or aliased.count(kvp.first) > 0) {
+      continue;
+    }
+    for (auto& group : groupMap.at(kvp.second)) {
+      auto sizes = group->approximationSizes();
+      if (!group->isReadOnly() or sizes.empty() or
+          !hasReuse(*group, schedule)) {
+        continue;
+      }
+      auto affine = std::all_of(
+          group->references.begin(),
+          group->references.end(),
+          [](const std::unique_ptr<TensorReference>& ref) {
+            return ref->originalAccess.is_single_valued();
+          });
+      if (!affine) {
+        continue;
+      }
+      auto groupBytes = tensorBytes;
+      for (auto size : sizes) {
+        groupBytes *= size;
+      }
+      if (bytes + groupBytes > maxBytes) {
+        continue;
+      }
+      bytes += groupBytes;
+      scop.promoteGroup(
+          Scop::PromotedDecl::Kind::Register,
+          kvp.second,
+          std::move(group),
+          band,
+          schedule);
+    }
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "Packed " << bytes << " bytes per tile" << std::endl
+      << *root;
+}
+} // namespace
+
+void CpuTcExecutor::compile(const tc::CpuMappingOptions& options) {
+  if (rtcFunction && rtcFunction->kernel) {
+    throw std::runtime_error{
+        "CpuTcExecutor::compile cannot be called multiple times."};
+  }
+  if (!executionInfo_.temporariesInfo.empty()) {
+    throw std::invalid_argument{
+        "CpuTcExecutor does not support kernels with temporaries."};
+  }
+  executionInfo_.options = options.toProtobufSerializedString();
+  compileWithTcMapper();
+}
+
+bool CpuTcExecutor::compile(
+    const tc::CpuMappingOptions& options,
+    const std::function<bool(const CpuTcExecutor*)>& pruningFunction) {
+  compile(options);
+  if (pruningFunction(this)) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "[COMPILE] Pruned kernel";
+    rtcFunction = nullptr;
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<polyhedral::Scop> CpuTcExecutor::makeScheduledScop(
+    const tc::CpuMappingOptions& options) {
+  // A bit chicken-and-eggy, need scop from TC to have the space to build the
+  // context to specialize the scop..
+  auto scopTmp = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), *halideComponents_);
+  auto globalParameterContext =
+      scopTmp->makeContextFromInputs(extractRawPtrs(executionInfo_.inputsInfo));
+  scopTmp = polyhedral::Scop::makeSpecializedScop(
+      *scopTmp,
+      globalParameterContext.intersect(scopTmp->globalParameterContext));
+  scopTmp->specializeStridesToInputs(
+      extractRawPtrs(executionInfo_.inputsInfo));
+  scopTmp->specializeStridesToOutputs(
+      extractRawPtrs(executionInfo_.outputsInfo));
+  scopTmp = polyhedral::Scop::makeScheduled(
+      *scopTmp, options.generic.outerScheduleOptions);
+  auto tileBands = tileForCaches(*scopTmp, options);
+  auto packingLevel = options.proto().packing_level();
+  if (packingLevel > 2) {
+    throw std::invalid_argument("packing level must be 0, 1 or 2");
+  }
+  auto packedBand = packingLevel == 1
+      ? tileBands.first
+      : packingLevel == 2 ? tileBands.second : nullptr;
+  if (packedBand) {
+    packTiles(*scopTmp, packedBand, options.proto().max_packing_bytes());
+  } else if (packingLevel > 0) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "No tiles to pack at level " << packingLevel;
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << *(scopTmp->scheduleRoot());
+
+  // All sizes are fixed, distinguish the kernels by their parameter values
+  // and the strides they are specialized for.
+  std::stringstream ss;
+  ss << executionInfo_.kernelName;
+  for (auto v : scopTmp->getParameterValues(globalParameterContext)) {
+    ss << "_" << v;
+  }
+  ss << specializedStridesSuffix();
+  kernelSpecializedName = ss.str();
+  return scopTmp;
+}
+
+void CpuTcExecutor::compileWithTcMapper() {
+  // The job owns its isl context, concurrent compilations share no isl
+  // state.
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto options = CpuMappingOptions(executionInfo_.options);
+  auto scop = makeScheduledScop(options);
+
+  auto jit = std::make_shared<Jit>();
+  auto module = jit->codegenScop(kernelSpecializedName, *scop, options);
+  cpuSource = toString(module.get());
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "generatedLLVM: " << cpuSource;
+
+  rtcFunction = std::make_shared<CpuRTCFunction>();
+  rtcFunction->kernel = reinterpret_cast<void (*)(void**)>(
+      jit->getSymbolAddress(kernelSpecializedName + kPackedKernelSuffix));
+  rtcFunction->jit = std::move(jit);
+}
+
+std::unique_ptr<llvm::Module> CpuTcExecutor::generateModule(
+    const tc::CpuMappingOptions& options,
+    Jit& jit) {
+  if (!executionInfo_.temporariesInfo.empty()) {
+    throw std::invalid_argument{
+        "CpuTcExecutor does not support kernels with temporaries."};
+  }
+  executionInfo_.options = options.toProtobufSerializedString();
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto scop = makeScheduledScop(options);
+  auto module = jit.emitModule(kernelSpecializedName, *scop, options);
+  cpuSource = toString(module.get());
+  return module;
+}
 
 Duration CpuTcExecutor::run(
     const std::vector<const DLTensor*>& inputs,
@@ -43,17 +274,55 @@ Duration CpuTcExecutor::run(
                      << executionInfo_.kernelName;
   CHECK_NE(executionInfo_.options, "");
   checkSizesAndStridesAreCompliant(
-      inputs, executionInfo_.inputsInfo, halideComponents_.getDef().params());
+      inputs, executionInfo_.inputsInfo, halideComponents_->getDef().params());
   checkSizesAndStridesAreCompliant(
       outputs,
       executionInfo_.outputsInfo,
-      halideComponents_.getDef().returns());
+      halideComponents_->getDef().returns());
 
-  return Duration();
+  std::vector<const void*> I;
+  std::vector<void*> O;
+  for (auto input : inputs) {
+    I.push_back(input->data);
+  }
+  for (auto output : outputs) {
+    O.push_back(output->data);
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+  uncheckedRun(I, O);
+  if (!profile) {
+    return Duration();
+  }
+  Duration res = std::chrono::high_resolution_clock::now() - start;
+  if (CpuOptionsCache::cacheEnabled()) {
+    CpuOptionsCache::getCache()->recordRuntime(
+        cacheKeyId_,
+        CpuMappingOptions(executionInfo_.options),
+        inputs,
+        constPtrs(outputs),
+        res);
+  }
+  return res;
 }
 
 void CpuTcExecutor::uncheckedRun(
     const std::vector<const void*>& inputs,
-    const std::vector<void*>& outputs) const {}
+    const std::vector<void*>& outputs) const {
+  CHECK(rtcFunction && rtcFunction->kernel)
+      << "Can't launch uncompiled: " << executionInfo_.kernelName;
+  CHECK_EQ(inputs.size(), executionInfo_.inputsInfo.size());
+  CHECK_EQ(outputs.size(), executionInfo_.outputsInfo.size());
+
+  // The packed entry point takes the inputs, then the outputs.
+  std::vector<void*> args;
+  args.reserve(inputs.size() + outputs.size());
+  for (auto input : inputs) {
+    args.push_back(const_cast<void*>(input));
+  }
+  for (auto output : outputs) {
+    args.push_back(output);
+  }
+  rtcFunction->kernel(args.data());
+}
 
 } // namespace tc
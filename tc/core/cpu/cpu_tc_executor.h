@@ -15,34 +15,72 @@
  */
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <dlpack/dlpack.h>
 
 #include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_parallel.h"
 #include "tc/core/halide_utils.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/tc_executor.h"
 #include "tc/core/utils/dlpack.h"
 #include "tc/lang/parser.h"
 
+namespace llvm {
+class Module;
+}
+
 namespace tc {
 
+class Jit;
+
+/// A kernel jit-compiled by LLVM.  The kernel is called through its packed
+/// entry point, which takes the inputs, then the outputs, as an array of
+/// pointers.
 struct CpuRTCFunction {
-  void clear() {}
+  void clear() {
+    kernel = nullptr;
+    jit = nullptr;
+  }
+
+  std::shared_ptr<Jit> jit;
+  void (*kernel)(void**) = nullptr;
+};
+
+/// Launch-time information that is not part of the compiled kernel: the
+/// NUMA node the run and its parallel loops are bound to (see WithNumaNode),
+/// none if negative.  Runs through an ExecutionEngine<CpuTcExecutor> that
+/// pass the same node keep their threads and the memory they first touch on
+/// that node.  Halide-compiled kernels only bind the calling thread.
+struct CpuRuntimeInformation {
+  CpuRuntimeInformation() : numaNode(-1) {}
+  explicit CpuRuntimeInformation(int node) : numaNode(node) {}
+
+  int numaNode;
 };
 
 class CpuTcExecutor : public ::tc::TcExecutor {
  public:
   using MappingOptionsType = CpuMappingOptions;
+  using RuntimeInformation = CpuRuntimeInformation;
 
   CpuTcExecutor(
       std::string id,
       const std::vector<const DLTensor*>& inputsInfo,
       const std::string& options,
       lang::TreeRef tcDefinition)
-      : TcExecutor(id, inputsInfo, options, tcDefinition) {}
+      : TcExecutor(
+            id,
+            inputsInfo,
+            options,
+            tcDefinition,
+            !options.empty() &&
+                CpuMappingOptions(options)
+                    .generic.proto.inline_pointwise_temporaries()) {}
 
   ~CpuTcExecutor() {}
 
@@ -65,6 +103,22 @@ class CpuTcExecutor : public ::tc::TcExecutor {
   void compile(const tc::CpuMappingOptions& options);
   // @}
 
+  // Same as compile but calls pruningFunction once the kernel is compiled,
+  // e.g. for the autotuner to discard kernels before benchmarking them.
+  // Mapping and jit-compilation are not separate steps on CPU, so unlike on
+  // GPU pruning saves no compilation time.  Returns false, leaving the
+  // executor uncompiled, if the kernel is pruned.
+  // @{
+  bool compile(
+      const std::string& options,
+      const std::function<bool(const CpuTcExecutor*)>& pruningFunction) {
+    return compile(CpuMappingOptions(options), pruningFunction);
+  }
+  bool compile(
+      const tc::CpuMappingOptions& options,
+      const std::function<bool(const CpuTcExecutor*)>& pruningFunction);
+  // @}
+
   // Run can be called multiple times given a compilation, inputs are allowed
   // to change in that their data pointer is allowed to change.
   // Sizes and strides must remain constant otherwise this is an error
@@ -73,19 +127,38 @@ class CpuTcExecutor : public ::tc::TcExecutor {
   // It is the caller's responsibility to ensure proper non-aliasing (or
   // advanced aliasing) properties of the input and output tensors.
   // if profile is set the kernel runtime (nanoseconds) is returned
+  // @{
   Duration run(
       const std::vector<const DLTensor*>& inputs,
       const std::vector<DLTensor*>& outputs,
       bool profile = false) const override;
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      bool profile,
+      const RuntimeInformation& info) const {
+    WithNumaNode withNumaNode(info.numaNode);
+    return run(inputs, outputs, profile);
+  }
+  // @}
 
   // This is the "low-latency" mode in which we just propagate raw pointers to
   // data in GPU address space.
   // No tensor-related information can be checked so it is the user's
   // responsibility to ensure that shapes and strides match. If the user
   // doesn't then segfault will likely occur.
+  // @{
   void uncheckedRun(
       const std::vector<const void*>& inputs,
       const std::vector<void*>& outputs) const override;
+  void uncheckedRun(
+      const std::vector<const void*>& inputs,
+      const std::vector<void*>& outputs,
+      const RuntimeInformation& info) const {
+    WithNumaNode withNumaNode(info.numaNode);
+    uncheckedRun(inputs, outputs);
+  }
+  // @}
 
   bool hasRuntimeCompiledFunction() override {
     return rtcFunction.get() != nullptr;
@@ -104,7 +177,20 @@ class CpuTcExecutor : public ::tc::TcExecutor {
     return executionInfo_.kernelName;
   }
 
+  // Only runs the mapper and emits the optimized kernel for the target
+  // machine of jit without jit-compiling it, e.g. to compile it ahead of
+  // time (see compileCpuKernelObject).  Sets kernelSpecializedName and
+  // cpuSource.
+  std::unique_ptr<llvm::Module> generateModule(
+      const tc::CpuMappingOptions& options,
+      Jit& jit);
+
  private:
+  // Specializes the scop to the input sizes, schedules and tiles it, sets
+  // kernelSpecializedName.  The scop belongs to the isl context of the
+  // caller, see isl::with_exceptions::ScopedCtx.
+  std::unique_ptr<polyhedral::Scop> makeScheduledScop(
+      const tc::CpuMappingOptions& options);
   void compileWithTcMapper();
 
  public:
@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cpu/halide_cpu_tc_executor.h"
+
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/flags.h"
+#include "tc/core/halide_utils.h"
+#include "tc/core/tc2halide.h"
+#include "tc/core/utils/dlpack.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+namespace tc {
+
+using namespace dlutils;
+
+namespace {
+// A buffer of the data of a tensor of the sizes and strides of info.  The
+// dimensions of the Halide Funcs are those of the TC, in the same order.
+Halide::Buffer<> makeBuffer(
+    const Halide::Type& type,
+    const DLTensor& info,
+    void* data) {
+  auto strides = getStrides(info);
+  std::vector<halide_dimension_t> dims(info.ndim);
+  for (int i = 0; i < info.ndim; ++i) {
+    dims[i].min = 0;
+    dims[i].extent = static_cast<int32_t>(info.shape[i]);
+    dims[i].stride = static_cast<int32_t>(strides[i]);
+  }
+  return Halide::Buffer<>(type, data, info.ndim, dims.data());
+}
+} // namespace
+
+void HalideCpuTcExecutor::compile(const tc::CpuMappingOptions& options) {
+  if (rtcFunction && rtcFunction->pipeline.defined()) {
+    throw std::runtime_error{
+        "HalideCpuTcExecutor::compile cannot be called multiple times."};
+  }
+  executionInfo_.options = options.toProtobufSerializedString();
+  compileWithHalide();
+}
+
+bool HalideCpuTcExecutor::compile(
+    const tc::CpuMappingOptions& options,
+    const std::function<bool(const HalideCpuTcExecutor*)>& pruningFunction) {
+  compile(options);
+  if (pruningFunction(this)) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "[COMPILE] Pruned kernel";
+    rtcFunction = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void HalideCpuTcExecutor::compileWithHalide() {
+  // New Funcs, the shared HalideComponents are already lowered.
+  auto pipeline = tc2halide::translatePipeline(tcTree_);
+
+  // All sizes are fixed, they are the values of the size parameters of
+  // every run and the estimates of the auto-scheduler.
+  auto pvm = computeParamValueMap(
+      *halideComponents_, extractRawPtrs(executionInfo_.inputsInfo));
+  for (auto& kvp : pipeline.params) {
+    auto it = pvm.find(kvp.first);
+    // The parameters of the inputs are in params too.
+    if (it == pvm.end()) {
+      continue;
+    }
+    kvp.second.set_scalar<int32_t>(it->second);
+    kvp.second.set_estimate(Halide::Expr(it->second));
+  }
+  // The strides are fixed too, constant strides let Halide vectorize along
+  // the innermost dimension of the tensors, the last one.
+  CHECK_EQ(pipeline.inputs.size(), executionInfo_.inputsInfo.size());
+  for (size_t i = 0; i < pipeline.inputs.size(); ++i) {
+    auto& input = pipeline.inputs[i];
+    const auto& info = *executionInfo_.inputsInfo[i];
+    auto strides = getStrides(info);
+    for (int d = 0; d < info.ndim; ++d) {
+      auto extent = static_cast<int>(info.shape[d]);
+      input.dim(d).set_stride(static_cast<int>(strides[d]));
+      input.dim(d).set_bounds_estimate(0, extent);
+    }
+  }
+  CHECK_EQ(pipeline.outputs.size(), executionInfo_.outputsInfo.size());
+  for (size_t i = 0; i < pipeline.outputs.size(); ++i) {
+    auto& output = pipeline.outputs[i];
+    const auto& info = *executionInfo_.outputsInfo[i];
+    auto strides = getStrides(info);
+    auto args = output.args();
+    for (int d = 0; d < info.ndim; ++d) {
+      auto extent = static_cast<int>(info.shape[d]);
+      output.output_buffer().dim(d).set_bounds(0, extent);
+      output.output_buffer().dim(d).set_stride(static_cast<int>(strides[d]));
+      output.estimate(args[d], 0, extent);
+    }
+  }
+
+  auto target = Halide::get_jit_target_from_environment();
+  auto res = std::make_shared<HalideRTCFunction>();
+  res->pipeline = Halide::Pipeline(pipeline.outputs);
+  auto schedule = res->pipeline.auto_schedule(target);
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Halide schedule: " << schedule;
+  res->pipeline.compile_jit(target);
+  res->inputs = pipeline.inputs;
+  rtcFunction = std::move(res);
+}
+
+Duration HalideCpuTcExecutor::run(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    bool profile) const {
+  CHECK(rtcFunction) << "Can't launch uncompiled: "
+                     << executionInfo_.kernelName;
+  CHECK_NE(executionInfo_.options, "");
+  checkSizesAndStridesAreCompliant(
+      inputs, executionInfo_.inputsInfo, halideComponents_->getDef().params());
+  checkSizesAndStridesAreCompliant(
+      outputs,
+      executionInfo_.outputsInfo,
+      halideComponents_->getDef().returns());
+
+  std::vector<const void*> I;
+  std::vector<void*> O;
+  for (auto input : inputs) {
+    I.push_back(input->data);
+  }
+  for (auto output : outputs) {
+    O.push_back(output->data);
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+  uncheckedRun(I, O);
+  if (!profile) {
+    return Duration();
+  }
+  Duration res = std::chrono::high_resolution_clock::now() - start;
+  if (CpuOptionsCache::cacheEnabled()) {
+    CpuOptionsCache::getCache()->recordRuntime(
+        cacheKeyId_,
+        CpuMappingOptions(executionInfo_.options),
+        inputs,
+        constPtrs(outputs),
+        res);
+  }
+  return res;
+}
+
+void HalideCpuTcExecutor::uncheckedRun(
+    const std::vector<const void*>& inputs,
+    const std::vector<void*>& outputs) const {
+  CHECK(rtcFunction && rtcFunction->pipeline.defined())
+      << "Can't launch uncompiled: " << executionInfo_.kernelName;
+  CHECK_EQ(inputs.size(), executionInfo_.inputsInfo.size());
+  CHECK_EQ(outputs.size(), executionInfo_.outputsInfo.size());
+
+  std::vector<Halide::Buffer<>> outputBuffers;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    outputBuffers.push_back(makeBuffer(
+        halideComponents_->outputs[i].type(),
+        *executionInfo_.outputsInfo[i],
+        outputs[i]));
+  }
+  Halide::Realization realization(outputBuffers);
+  std::lock_guard<std::mutex> lock(rtcFunction->mutex);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    auto& input = rtcFunction->inputs[i];
+    input.set(makeBuffer(
+        input.type(),
+        *executionInfo_.inputsInfo[i],
+        const_cast<void*>(inputs[i])));
+  }
+  rtcFunction->pipeline.realize(realization);
+}
+
+} // namespace tc
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+
+#include <Halide.h>
+
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/tc_executor.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/lang/parser.h"
+
+namespace tc {
+
+/// A pipeline jit-compiled by Halide.  The inputs and the size parameters
+/// of the pipeline are global to it, the runs setting them are serialized.
+struct HalideRTCFunction {
+  void clear() {
+    pipeline = Halide::Pipeline();
+    inputs.clear();
+  }
+
+  Halide::Pipeline pipeline;
+  std::vector<Halide::ImageParam> inputs;
+  std::mutex mutex;
+};
+
+/// Runs a TC on CPUs with the Halide pipeline of tc2halide, scheduled by the
+/// Halide auto-scheduler and compiled by Halide's own LLVM backend, rather
+/// than with the polyhedral mapper.  It is a reference for the kernels of
+/// CpuTcExecutor and a multicore fallback for the TCs it does not support
+/// yet, e.g. the TCs with temporaries.  The mapping options are only
+/// recorded, not used.  Unlike CpuTcExecutor, in-place reductions of the
+/// outputs (see tc2halide::translatePipeline) are not supported.
+class HalideCpuTcExecutor : public ::tc::TcExecutor {
+ public:
+  using MappingOptionsType = CpuMappingOptions;
+  using RuntimeInformation = CpuRuntimeInformation;
+
+  HalideCpuTcExecutor(
+      std::string id,
+      const std::vector<const DLTensor*>& inputsInfo,
+      const std::string& options,
+      lang::TreeRef tcDefinition)
+      : TcExecutor(id, inputsInfo, options, tcDefinition) {}
+
+  ~HalideCpuTcExecutor() {}
+
+  HalideCpuTcExecutor(HalideCpuTcExecutor&&) = delete;
+  HalideCpuTcExecutor& operator=(HalideCpuTcExecutor&&) = delete;
+  HalideCpuTcExecutor(const HalideCpuTcExecutor&) = delete;
+  HalideCpuTcExecutor& operator=(const HalideCpuTcExecutor&) = delete;
+
+  // Can only be called once.  The pipeline is scheduled for the sizes of
+  // the inputs of the constructor and of the inferred outputs.
+  // @{
+  void compile(const std::string& options) override {
+    compile(MappingOptionsType(options));
+  }
+  void compile(const tc::CpuMappingOptions& options);
+  // @}
+
+  // Same as compile but calls pruningFunction once the pipeline is
+  // compiled.  Returns false, leaving the executor uncompiled, if the
+  // pipeline is pruned.
+  // @{
+  bool compile(
+      const std::string& options,
+      const std::function<bool(const HalideCpuTcExecutor*)>& pruningFunction) {
+    return compile(CpuMappingOptions(options), pruningFunction);
+  }
+  bool compile(
+      const tc::CpuMappingOptions& options,
+      const std::function<bool(const HalideCpuTcExecutor*)>& pruningFunction);
+  // @}
+
+  // Same as CpuTcExecutor::run.  Runs may be concurrent, they are
+  // serialized.
+  // @{
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      bool profile = false) const override;
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      bool profile,
+      const RuntimeInformation& info) const {
+    WithNumaNode withNumaNode(info.numaNode);
+    return run(inputs, outputs, profile);
+  }
+  // @}
+
+  // Same as CpuTcExecutor::uncheckedRun, the tensors have the sizes and
+  // strides of the compilation.
+  // @{
+  void uncheckedRun(
+      const std::vector<const void*>& inputs,
+      const std::vector<void*>& outputs) const override;
+  void uncheckedRun(
+      const std::vector<const void*>& inputs,
+      const std::vector<void*>& outputs,
+      const RuntimeInformation& info) const {
+    WithNumaNode withNumaNode(info.numaNode);
+    uncheckedRun(inputs, outputs);
+  }
+  // @}
+
+  bool hasRuntimeCompiledFunction() override {
+    return rtcFunction.get() != nullptr;
+  }
+
+  void clearRuntimeCompiledFunction() override {
+    if (!hasRuntimeCompiledFunction()) {
+      return;
+    }
+    rtcFunction->clear();
+  }
+
+  std::string kernelName() const {
+    return executionInfo_.kernelName;
+  }
+
+ private:
+  void compileWithHalide();
+
+ protected:
+  std::shared_ptr<HalideRTCFunction> rtcFunction;
+};
+
+} // namespace tc
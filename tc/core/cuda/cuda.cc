@@ -16,9 +16,8 @@
 
 #include "tc/core/cuda/cuda.h"
 
-#include <memory>
 #include <stdexcept>
-#include <tuple>
+#include <string>
 #include <vector>
 
 #include <cuda_runtime_api.h>
@@ -30,7 +29,26 @@ DEFINE_bool(use_nvprof, false, "Start / stop nvprof");
 
 namespace {
 
-std::tuple<std::vector<std::string>, std::vector<size_t>> init() {
+// Single precision cores per multiprocessor, from the compute capability
+// tables of the CUDA programming guide.
+size_t coresPerMultiprocessor(int major, int minor) {
+  switch (major) {
+    case 3:
+      return 192;
+    case 5:
+      return 128;
+    case 6:
+      return minor == 0 ? 64 : 128;
+    case 7:
+      return 64;
+    case 8:
+      return minor == 0 ? 64 : 128;
+    default:
+      return major > 8 ? 128 : 0;
+  }
+}
+
+std::vector<CudaDeviceProperties> init() {
   int deviceCount = 0;
   auto err_id = cudaGetDeviceCount(&deviceCount);
   if (err_id == 35 or err_id == 30) {
@@ -39,44 +57,63 @@ std::tuple<std::vector<std::string>, std::vector<size_t>> init() {
     return {};
   }
   TC_CUDA_RUNTIMEAPI_ENFORCE(err_id);
-  if (deviceCount == 0) {
-    return {};
-  }
-  std::vector<std::string> gpuNames;
-  std::vector<size_t> sharedMemSizes;
-  gpuNames.reserve(deviceCount);
+  std::vector<CudaDeviceProperties> devices;
+  devices.reserve(deviceCount);
   for (int i = 0; i < deviceCount; ++i) {
     cudaDeviceProp deviceProp;
     TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDeviceProperties(&deviceProp, i));
-    gpuNames.emplace_back(deviceProp.name);
-    sharedMemSizes.emplace_back(deviceProp.sharedMemPerBlock);
+    CudaDeviceProperties device;
+    device.name = deviceProp.name;
+    device.major = deviceProp.major;
+    device.minor = deviceProp.minor;
+    device.architecture = "compute_" + std::to_string(deviceProp.major) +
+        std::to_string(deviceProp.minor);
+    device.sharedMemory = deviceProp.sharedMemPerBlock;
+#if CUDART_VERSION >= 9000
+    device.optinSharedMemory = deviceProp.sharedMemPerBlockOptin;
+#else
+    device.optinSharedMemory = deviceProp.sharedMemPerBlock;
+#endif
+    device.l2CacheSize = deviceProp.l2CacheSize;
+    auto& limits = device.multiprocessorLimits;
+    limits.multiprocessorCount = deviceProp.multiProcessorCount;
+    limits.warpSize = deviceProp.warpSize;
+    limits.maxThreadsPerBlock = deviceProp.maxThreadsPerBlock;
+    limits.maxThreads = deviceProp.maxThreadsPerMultiProcessor;
+#if CUDART_VERSION >= 11000
+    limits.maxBlocks = deviceProp.maxBlocksPerMultiProcessor;
+#else
+    // Not exposed before CUDA 11, from the compute capability tables.
+    limits.maxBlocks = deviceProp.major >= 5 ? 32 : 16;
+#endif
+    limits.registers = deviceProp.regsPerMultiprocessor;
+    limits.sharedMemory = deviceProp.sharedMemPerMultiprocessor;
+    auto& peaks = device.peakThroughputs;
+    // the clock rates are in kHz, the memory transfers twice per cycle
+    peaks.memoryBandwidth = 2.0 * deviceProp.memoryClockRate * 1e3 *
+        (deviceProp.memoryBusWidth / 8);
+    peaks.flops = 2.0 * deviceProp.clockRate * 1e3 *
+        deviceProp.multiProcessorCount *
+        coresPerMultiprocessor(deviceProp.major, deviceProp.minor);
+    devices.push_back(std::move(device));
   }
-  return std::make_tuple(gpuNames, sharedMemSizes);
+  return devices;
 }
 
 } // namespace
 
-CudaGPUInfo& CudaGPUInfo::GPUInfo() {
-  static thread_local std::unique_ptr<CudaGPUInfo> pInfo;
-  static thread_local bool inited = false;
-  if (!inited) {
-    auto infos = init();
-    pInfo = std::unique_ptr<CudaGPUInfo>(
-        new CudaGPUInfo(std::get<0>(infos), std::get<1>(infos)));
-    inited = true;
-  }
-  return *pInfo;
+const CudaGPUInfo& CudaGPUInfo::GPUInfo() {
+  // Initialized once, the initialization of function statics is thread-safe
+  static const CudaGPUInfo info(init());
+  return info;
 }
 
 int CudaGPUInfo::NumberGPUs() const {
-  return gpuNames_.size();
+  return devices_.size();
 }
 
-std::string CudaGPUInfo::GetGPUName(int id) const {
-  if (id < 0) {
-    return gpuNames_.at(CurrentGPUId());
-  }
-  return gpuNames_.at(id);
+const std::string& CudaGPUInfo::GetGPUName(int id) const {
+  return DeviceProperties(id).name;
 }
 
 int CudaGPUInfo::CurrentGPUId() const {
@@ -89,17 +126,57 @@ void CudaGPUInfo::SynchronizeCurrentGPU() const {
   TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
 }
 
-std::string CudaGPUInfo::GetCudaDeviceStr() const {
+const std::string& CudaGPUInfo::GetCudaDeviceStr() const {
+  if (NumberGPUs() == 0) {
+    throw std::runtime_error("No GPUs found.");
+  }
+  return DeviceProperties().name;
+}
+
+const std::string& CudaGPUInfo::GetCudaDeviceArch() const {
   if (NumberGPUs() == 0) {
     throw std::runtime_error("No GPUs found.");
   }
-  return GetGPUName(CurrentGPUId());
+  return DeviceProperties().architecture;
+}
+
+const CudaDeviceProperties& CudaGPUInfo::DeviceProperties(int id) const {
+  return devices_.at(id < 0 ? CurrentGPUId() : id);
 }
 
 size_t CudaGPUInfo::SharedMemorySize() const {
   if (NumberGPUs() == 0) {
     return 0; // no shared memory if no GPUs
   }
-  return sharedMemSizes_.at(CurrentGPUId());
+  return DeviceProperties().sharedMemory;
+}
+
+size_t CudaGPUInfo::OptinSharedMemorySize() const {
+  if (NumberGPUs() == 0) {
+    return 0; // no shared memory if no GPUs
+  }
+  return DeviceProperties().optinSharedMemory;
+}
+
+CudaMultiprocessorLimits CudaGPUInfo::MultiprocessorLimits() const {
+  if (NumberGPUs() == 0) {
+    return CudaMultiprocessorLimits();
+  }
+  return DeviceProperties().multiprocessorLimits;
+}
+
+CudaPeakThroughputs CudaGPUInfo::PeakThroughputs() const {
+  if (NumberGPUs() == 0) {
+    return CudaPeakThroughputs();
+  }
+  return DeviceProperties().peakThroughputs;
+}
+
+int CudaGPUInfo::ComputeCapability() const {
+  if (NumberGPUs() == 0) {
+    return 0;
+  }
+  const auto& device = DeviceProperties();
+  return 10 * device.major + device.minor;
 }
 } // namespace tc
@@ -25,6 +25,8 @@
 
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <cuda.h>
 #include <cuda_profiler_api.h>
@@ -87,31 +89,82 @@ struct WithDevice {
   size_t newGpu;
 };
 
+// Resources of a multiprocessor shared by the blocks resident on it, they
+// bound the occupancy of a kernel.
+struct CudaMultiprocessorLimits {
+  size_t multiprocessorCount = 0;
+  size_t warpSize = 0;
+  size_t maxThreadsPerBlock = 0;
+  size_t maxThreads = 0;
+  size_t maxBlocks = 0;
+  size_t registers = 0;
+  size_t sharedMemory = 0;
+};
+
+// Theoretical peak throughputs of a GPU, from its clocks, memory bus and
+// compute capability, the roofline measured kernels are compared to.
+struct CudaPeakThroughputs {
+  // bytes per second to and from the device memory
+  double memoryBandwidth = 0;
+  // single precision operations per second, a fused multiply-add counts as 2
+  double flops = 0;
+};
+
+// The properties of a device the mapper, the cost models and the caches
+// use, queried once per process.
+struct CudaDeviceProperties {
+  std::string name;
+  // "compute_XY" for compute capability X.Y
+  std::string architecture;
+  int major = 0;
+  int minor = 0;
+  size_t sharedMemory = 0;
+  size_t optinSharedMemory = 0;
+  size_t l2CacheSize = 0;
+  CudaMultiprocessorLimits multiprocessorLimits;
+  CudaPeakThroughputs peakThroughputs;
+};
+
 //
 // This functionality in this type of class has been rewritten over and over
 // again. Here we just provide a static singleton and basic properties.
 // Consider lifting stuff up from fbcuda rather than reinventing the wheel
 //
+// The singleton is process-wide and immutable: the properties of all the
+// devices are queried once, by the first thread calling GPUInfo, and the
+// other threads read them without synchronization.
 class CudaGPUInfo {
-  CudaGPUInfo(
-      const std::vector<std::string>& gpuNames,
-      const std::vector<size_t>& sharedMemSizes)
-      : gpuNames_(gpuNames), sharedMemSizes_(sharedMemSizes) {}
+  explicit CudaGPUInfo(std::vector<CudaDeviceProperties> devices)
+      : devices_(std::move(devices)) {}
 
  public:
-  static CudaGPUInfo& GPUInfo();
+  static const CudaGPUInfo& GPUInfo();
 
   // These functions require init to have been run, they are thus members of
   // the singleton object and not static functions.
   int NumberGPUs() const;
   int CurrentGPUId() const;
   void SynchronizeCurrentGPU() const;
-  std::string GetGPUName(int id = -1) const;
-  std::string GetCudaDeviceStr() const;
+  const std::string& GetGPUName(int id = -1) const;
+  // The device part of the cache keys, not rebuilt on each lookup.
+  const std::string& GetCudaDeviceStr() const;
+  // The "compute_XY" architecture of the current GPU.
+  const std::string& GetCudaDeviceArch() const;
+  // Of the GPU id, the current one if negative.
+  const CudaDeviceProperties& DeviceProperties(int id = -1) const;
   size_t SharedMemorySize() const;
-
-  std::vector<std::string> gpuNames_;
-  std::vector<size_t> sharedMemSizes_;
+  // Shared memory per block available to kernels opting in to more than the
+  // static limit, equal to SharedMemorySize() before Volta.
+  size_t OptinSharedMemorySize() const;
+  // All zero if there are no GPUs.
+  CudaMultiprocessorLimits MultiprocessorLimits() const;
+  // All zero if there are no GPUs.
+  CudaPeakThroughputs PeakThroughputs() const;
+  // 10 * major + minor of the current GPU, 0 if there are no GPUs.
+  int ComputeCapability() const;
+
+ private:
+  const std::vector<CudaDeviceProperties> devices_;
 };
 
 struct CudaProfiler {
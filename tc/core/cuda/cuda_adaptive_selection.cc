@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_adaptive_selection.h"
+
+#include <chrono>
+#include <exception>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/time.h"
+#include "tc/lang/canonicalize.h"
+
+namespace tc {
+
+namespace {
+// Weight of a new sample in the average runtime of a candidate, once it
+// has minSamples samples.
+constexpr double kSampleWeight = 0.1;
+} // namespace
+
+std::unique_ptr<CudaAdaptiveSelection> CudaAdaptiveSelection::compile(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    size_t k,
+    size_t samplePeriod,
+    size_t minSamples) {
+  CHECK_GT(k, 0u);
+  CHECK_GT(samplePeriod, 0u);
+  CHECK_GT(minSamples, 0u);
+  if (not OptionsCache::cacheEnabled()) {
+    return nullptr;
+  }
+  // The key of the executors' records
+  auto id = lang::canonicalTc(engine.treeForFunction(name));
+  auto outputs = engine.inferOutputTensorInfo(name, inputs);
+  auto topK =
+      OptionsCache::getCache()->retrieveTopKOptions(id, inputs, outputs, k);
+
+  std::unique_ptr<CudaAdaptiveSelection> res(
+      new CudaAdaptiveSelection(engine, samplePeriod, minSamples));
+  for (const auto& options : topK) {
+    try {
+      auto handle =
+          engine.compile(name, inputs, options.toProtobufSerializedString());
+      res->candidates_.emplace_back(options, handle);
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "skipping options of " << name
+                   << " that failed to compile: " << e.what();
+    }
+  }
+  if (res->candidates_.empty()) {
+    return nullptr;
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "selecting among " << res->candidates_.size() << " options of "
+      << name;
+  return res;
+}
+
+size_t CudaAdaptiveSelection::select(bool& sample) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++runs_;
+  sample = false;
+  if (candidates_.size() == 1) {
+    return 0;
+  }
+  // Candidates short of samples run first, in turn
+  size_t fewest = 0;
+  for (size_t i = 1; i < candidates_.size(); ++i) {
+    if (candidates_[i].samples < candidates_[fewest].samples) {
+      fewest = i;
+    }
+  }
+  if (candidates_[fewest].samples < minSamples_) {
+    sample = true;
+    return fewest;
+  }
+  if (runs_ % samplePeriod_ != 0) {
+    return best_;
+  }
+  // The best candidate is sampled too, its average must follow its
+  // runtime as the others' do.
+  sample = true;
+  return sampled_++ % candidates_.size();
+}
+
+void CudaAdaptiveSelection::recordSample(size_t candidate, Duration runtime) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& c = candidates_[candidate];
+  auto us = toMicroseconds<double>(runtime);
+  ++c.samples;
+  if (c.samples <= minSamples_) {
+    c.averageUs += (us - c.averageUs) / c.samples;
+  } else {
+    c.averageUs += kSampleWeight * (us - c.averageUs);
+  }
+  auto best = bestCandidate();
+  LOG_IF(INFO, FLAGS_debug_tc_mapper and best != best_)
+      << "switching to candidate " << best << " of average "
+      << candidates_[best].averageUs << "us";
+  best_ = best;
+}
+
+size_t CudaAdaptiveSelection::bestCandidate() const {
+  size_t res = best_;
+  for (size_t i = 0; i < candidates_.size(); ++i) {
+    const auto& c = candidates_[i];
+    if (c.samples >= minSamples_ and
+        (candidates_[res].samples < minSamples_ or
+         c.averageUs < candidates_[res].averageUs)) {
+      res = i;
+    }
+  }
+  return res;
+}
+
+Duration CudaAdaptiveSelection::run(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream,
+    bool profile) {
+  bool sample;
+  auto candidate = select(sample);
+  // Outside of the lock, profiling synchronizes with the stream
+  auto res = engine_.run(
+      candidates_[candidate].handle,
+      inputs,
+      outputs,
+      profile or sample,
+      [](const CudaTcExecutor*) { return false; },
+      CudaRuntimeInformation(stream));
+  if (profile or sample) {
+    recordSample(candidate, res);
+  }
+  return res;
+}
+
+CudaMappingOptions CudaAdaptiveSelection::bestOptions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return candidates_[best_].options;
+}
+
+} // namespace tc
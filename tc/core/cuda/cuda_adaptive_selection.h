@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+//
+// A TC run with the fastest of the top-k options of the OptionsCache for
+// the sizes of its inputs, as measured on the live runs.  The runtimes
+// recorded by the tuning may not rank the options as the production runs
+// do, e.g. when other kernels share the device or when the inputs are not
+// in the cache.  Each candidate is first profiled on minSamples runs, then
+// the candidate of the lowest average runtime serves the runs and one run
+// in samplePeriod is profiled with the other candidates in turn, so that
+// the selection follows changes of their runtimes.
+// The profiled runs are recorded to the OptionsCache by the executor, as
+// tuning runs are, the other runs are not synchronized.
+//
+class CudaAdaptiveSelection {
+ public:
+  // Compiles the top-k options of the OptionsCache for the TC name and the
+  // sizes of inputs.  Options that fail to compile are skipped.  Returns
+  // null if the cache is disabled or no option compiles.
+  static std::unique_ptr<CudaAdaptiveSelection> compile(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      size_t k = 3,
+      size_t samplePeriod = 100,
+      size_t minSamples = 5);
+
+  CudaAdaptiveSelection(const CudaAdaptiveSelection&) = delete;
+  CudaAdaptiveSelection& operator=(const CudaAdaptiveSelection&) = delete;
+
+  // Inputs and outputs must have the sizes of the compilation.  If profile
+  // is set, or if the run is sampled, the run is synchronized with and its
+  // kernel runtime returned, Duration::max() otherwise.  Runs may be
+  // concurrent.
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream = 0,
+      bool profile = false);
+
+  // The options of the candidate currently serving the runs.
+  CudaMappingOptions bestOptions() const;
+
+  size_t numberCandidates() const {
+    return candidates_.size();
+  }
+
+ private:
+  struct Candidate {
+    Candidate(const CudaMappingOptions& options, size_t handle)
+        : options(options), handle(handle) {}
+
+    CudaMappingOptions options;
+    size_t handle;
+    size_t samples = 0;
+    // Mean of the first minSamples runtimes, exponentially weighted
+    // afterwards.
+    double averageUs = 0;
+  };
+
+  CudaAdaptiveSelection(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      size_t samplePeriod,
+      size_t minSamples)
+      : engine_(engine), samplePeriod_(samplePeriod), minSamples_(minSamples) {}
+
+  // The candidate running next and whether it is profiled.
+  size_t select(bool& sample);
+  void recordSample(size_t candidate, Duration runtime);
+  size_t bestCandidate() const;
+
+  ExecutionEngine<CudaTcExecutor>& engine_;
+  const size_t samplePeriod_;
+  const size_t minSamples_;
+  std::vector<Candidate> candidates_;
+
+  // Guards the statistics of candidates_ and the counters.
+  mutable std::mutex mutex_;
+  size_t runs_ = 0;
+  size_t sampled_ = 0;
+  size_t best_ = 0;
+};
+
+} // namespace tc
@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+
+namespace tc {
+
+/// The types the backend-independent code, e.g. the autotuner, is templated
+/// on to run on GPUs.
+struct CudaBackend {
+  using ExecutorType = CudaTcExecutor;
+  using MappingOptionsType = CudaMappingOptions;
+  using OptionsCacheType = OptionsCache;
+  /// Makes a device current for the lifetime of the object.
+  using WithDevice = ::tc::WithDevice;
+};
+
+} // namespace tc
@@ -0,0 +1,336 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_batching_execution.h"
+
+#include <algorithm>
+
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_data_parallel.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/dlpack.h"
+
+namespace tc {
+
+namespace {
+// Do t1 and t2 have the same metadata except for the size of dimension 0?
+bool sameRows(const DLTensor* t1, const DLTensor* t2) {
+  if (t1->ndim != t2->ndim or t1->ctx.device_id != t2->ctx.device_id or
+      t1->dtype.code != t2->dtype.code or t1->dtype.bits != t2->dtype.bits or
+      t1->dtype.lanes != t2->dtype.lanes) {
+    return false;
+  }
+  return std::equal(t1->shape + 1, t1->shape + t1->ndim, t2->shape + 1);
+}
+
+// The smallest power of two not below rows, at most maxBatch.
+int64_t paddedRows(int64_t rows, int64_t maxBatch) {
+  int64_t res = 1;
+  while (res < rows) {
+    res *= 2;
+  }
+  return std::min(res, maxBatch);
+}
+} // namespace
+
+std::unique_ptr<CudaBatchingExecution> CudaBatchingExecution::make(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const CudaMappingOptions& options,
+    int64_t maxBatch,
+    std::chrono::microseconds window) {
+  CHECK_GT(maxBatch, 0) << "batches must have at least one row";
+  auto split = findDataParallelSplit(engine, name, options);
+  if (!split or
+      std::none_of(
+          split->splitInputs.begin(), split->splitInputs.end(), [](bool b) {
+            return b;
+          })) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << name << " cannot be batched along the first dimension";
+    return nullptr;
+  }
+  std::unique_ptr<CudaBatchingExecution> res(
+      new CudaBatchingExecution(engine, name, options, maxBatch, window));
+  res->splitInputs_ = split->splitInputs;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&res->device_));
+  // A blocking stream, ordered with the legacy default stream.
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamCreate(&res->stream_));
+  return res;
+}
+
+CudaBatchingExecution::~CudaBatchingExecution() {
+  // Errors are ignored, the destructor must not throw.
+  int device;
+  if (cudaGetDevice(&device) != cudaSuccess) {
+    return;
+  }
+  cudaSetDevice(device_);
+  for (auto& bucket : buckets_) {
+    for (auto buffer : bucket.second.buffers) {
+      cudaFree(buffer);
+    }
+  }
+  if (stream_) {
+    cudaStreamDestroy(stream_);
+  }
+  cudaSetDevice(device);
+}
+
+int64_t CudaBatchingExecution::batchRows(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs) const {
+  if (inputs.size() != splitInputs_.size()) {
+    return -1;
+  }
+  int64_t rows = -1;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs[i]->ctx.device_id != device_) {
+      return -1;
+    }
+    if (not splitInputs_[i]) {
+      continue;
+    }
+    if (inputs[i]->ndim == 0 or not dlutils::isPacked(*inputs[i]) or
+        (rows >= 0 and inputs[i]->shape[0] != rows)) {
+      return -1;
+    }
+    rows = inputs[i]->shape[0];
+  }
+  for (auto output : outputs) {
+    if (output->ndim == 0 or not dlutils::isPacked(*output) or
+        output->shape[0] != rows) {
+      return -1;
+    }
+  }
+  return rows > 0 and rows < maxBatch_ ? rows : -1;
+}
+
+bool CudaBatchingExecution::matches(
+    const Request& first,
+    const Request& request) const {
+  for (size_t i = 0; i < splitInputs_.size(); ++i) {
+    auto t1 = (*first.inputs)[i];
+    auto t2 = (*request.inputs)[i];
+    if (splitInputs_[i] and not sameRows(t1, t2)) {
+      return false;
+    }
+    // The inputs that are not split are read by the whole batch.
+    if (not splitInputs_[i] and
+        (not compareDLTensorMetadata(*t1, *t2) or
+         dlutils::dataPtr(*t1) != dlutils::dataPtr(*t2))) {
+      return false;
+    }
+  }
+  if (first.outputs->size() != request.outputs->size()) {
+    return false;
+  }
+  for (size_t i = 0; i < first.outputs->size(); ++i) {
+    if (not sameRows((*first.outputs)[i], (*request.outputs)[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CudaBatchingExecution::run(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs) {
+  Request request{&inputs, &outputs, batchRows(inputs, outputs)};
+  if (request.rows < 0) {
+    runAlone(request);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (open_ and
+      (open_->rows + request.rows > maxBatch_ or
+       not matches(open_->requests.front(), request))) {
+    // Launch the open batch early, its first caller is woken up.
+    open_ = nullptr;
+    cv_.notify_all();
+  }
+  bool first = not open_;
+  if (first) {
+    open_ = std::make_shared<Batch>();
+  }
+  auto batch = open_;
+  batch->requests.push_back(request);
+  batch->rows += request.rows;
+  if (batch->rows == maxBatch_) {
+    open_ = nullptr;
+    cv_.notify_all();
+  }
+
+  if (not first) {
+    cv_.wait(lock, [&batch]() { return batch->done; });
+    if (batch->error) {
+      std::rethrow_exception(batch->error);
+    }
+    return;
+  }
+  cv_.wait_for(lock, window_, [this, &batch]() { return open_ != batch; });
+  if (open_ == batch) {
+    open_ = nullptr;
+  }
+  if (batch->requests.size() > 1) {
+    ++numberBatches_;
+  }
+  lock.unlock();
+  try {
+    execute(*batch);
+  } catch (...) {
+    batch->error = std::current_exception();
+  }
+  lock.lock();
+  batch->done = true;
+  cv_.notify_all();
+  if (batch->error) {
+    std::rethrow_exception(batch->error);
+  }
+}
+
+size_t CudaBatchingExecution::numberBatches() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numberBatches_;
+}
+
+void CudaBatchingExecution::runAlone(const Request& request) {
+  engine_.run(name_, *request.inputs, *request.outputs, options_);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(0));
+}
+
+CudaBatchingExecution::Bucket& CudaBatchingExecution::bucket(
+    int64_t rows,
+    const Request& first) {
+  auto it = buckets_.find(rows);
+  if (it != buckets_.end()) {
+    bool same = true;
+    for (size_t i = 0; i < splitInputs_.size(); ++i) {
+      auto t1 = it->second.inputs[i].get();
+      auto t2 = (*first.inputs)[i];
+      same = same and
+          (splitInputs_[i] ? sameRows(t1, t2)
+                           : compareDLTensorMetadata(*t1, *t2));
+    }
+    if (same) {
+      return it->second;
+    }
+    // The other sizes changed, e.g. the sequence length of the batch.
+    WithDevice withDevice(device_);
+    for (auto buffer : it->second.buffers) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaFree(buffer));
+    }
+    buckets_.erase(it);
+  }
+  Bucket res;
+  for (size_t i = 0; i < splitInputs_.size(); ++i) {
+    auto info = (*first.inputs)[i];
+    std::vector<int64_t> sizes(info->shape, info->shape + info->ndim);
+    if (splitInputs_[i]) {
+      sizes[0] = rows;
+    }
+    res.inputs.push_back(
+        dlutils::makeDLTensorWithSizes(info->ctx, info->dtype, sizes));
+  }
+  // Batches of the same rows share their kernel.
+  res.handle = engine_.compile(
+      name_, dlutils::extractRawPtrs(res.inputs), options_);
+  for (auto output : engine_.inferOutputTensorInfo(
+           name_, dlutils::extractRawPtrs(res.inputs))) {
+    CHECK_EQ(output->shape[0], rows);
+    res.outputs.push_back(dlutils::makeDLTensor(output));
+  }
+  WithDevice withDevice(device_);
+  for (size_t i = 0; i < res.inputs.size(); ++i) {
+    if (not splitInputs_[i]) {
+      continue;
+    }
+    void* buffer;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaMalloc(&buffer, dlutils::numberBytes(*res.inputs[i])));
+    res.inputs[i]->data = buffer;
+    res.buffers.push_back(buffer);
+  }
+  for (const auto& t : res.outputs) {
+    void* buffer;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&buffer, dlutils::numberBytes(*t)));
+    t->data = buffer;
+    res.buffers.push_back(buffer);
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << name_ << " compiled for batches of " << rows << " rows";
+  return buckets_.emplace(rows, std::move(res)).first->second;
+}
+
+void CudaBatchingExecution::execute(const Batch& batch) {
+  const auto& first = batch.requests.front();
+  if (batch.requests.size() == 1) {
+    runAlone(first);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(executionMutex_);
+  auto& b = bucket(paddedRows(batch.rows, maxBatch_), first);
+  WithDevice withDevice(device_);
+  // The rows of the padding are left as they are, the rows of a batch are
+  // computed independently.
+  for (size_t i = 0; i < splitInputs_.size(); ++i) {
+    if (not splitInputs_[i]) {
+      b.inputs[i]->data = dlutils::dataPtr(*(*first.inputs)[i]);
+      continue;
+    }
+    auto bytes = dlutils::rowBytes(*b.inputs[i]);
+    auto destination = static_cast<char*>(b.inputs[i]->data);
+    for (const auto& request : batch.requests) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+          destination,
+          dlutils::dataPtr(*(*request.inputs)[i]),
+          request.rows * bytes,
+          cudaMemcpyDeviceToDevice,
+          stream_));
+      destination += request.rows * bytes;
+    }
+  }
+  std::vector<DLTensor*> outputs;
+  for (const auto& t : b.outputs) {
+    outputs.push_back(t.get());
+  }
+  engine_.run(
+      b.handle,
+      dlutils::extractRawPtrs(b.inputs),
+      outputs,
+      false,
+      [](const CudaTcExecutor*) { return false; },
+      CudaRuntimeInformation(stream_));
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    auto bytes = dlutils::rowBytes(*outputs[i]);
+    auto source = static_cast<const char*>(outputs[i]->data);
+    for (const auto& request : batch.requests) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+          dlutils::dataPtr(*(*request.outputs)[i]),
+          source,
+          request.rows * bytes,
+          cudaMemcpyDeviceToDevice,
+          stream_));
+      source += request.rows * bytes;
+    }
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream_));
+}
+
+} // namespace tc
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/utils/dlpack.h"
+
+namespace tc {
+
+//
+// Runs of a TC by concurrent callers, e.g. the threads of a server each
+// computing a batch of one, gathered into batched runs along the first
+// dimension.  The first caller of a batch waits up to the window for
+// others, the rows of the inputs indexed along their first dimension are
+// gathered into a batch, the kernel runs once on it and the rows of the
+// outputs are scattered back to each caller (see findDataParallelSplit for
+// when this is legal).  The batches are padded to the next power of two
+// rows, up to the largest batch, so that a few kernels, compiled on first
+// use, serve all the batch sizes.
+// The callers of a batch must pass the same inputs that are not split,
+// e.g. the weights of a layer, and the same sizes otherwise.  Other runs,
+// and those of more rows than the largest batch, run alone.
+// Batches run one at a time on a stream of the device current at
+// creation, which the tensors must be on.
+//
+class CudaBatchingExecution {
+ public:
+  // Returns null if the TC cannot be split along the first dimension.
+  static std::unique_ptr<CudaBatchingExecution> make(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      const std::string& name,
+      const CudaMappingOptions& options,
+      int64_t maxBatch = 64,
+      std::chrono::microseconds window = std::chrono::microseconds(200));
+
+  // Frees the buffers and the stream, ignoring errors.
+  ~CudaBatchingExecution();
+
+  CudaBatchingExecution(const CudaBatchingExecution&) = delete;
+  CudaBatchingExecution& operator=(const CudaBatchingExecution&) = delete;
+
+  // Same as ExecutionEngine::run of the TC, but returns once the outputs
+  // are written.  The inputs must be ready, e.g. written by work on the
+  // legacy default stream, with which the runs are ordered.  Exceptions of
+  // a batched run are rethrown to all its callers.
+  void run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs);
+
+  // Number of batched runs that gathered several callers.
+  size_t numberBatches() const;
+
+ private:
+  struct Request {
+    const std::vector<const DLTensor*>* inputs;
+    const std::vector<DLTensor*>* outputs;
+    int64_t rows;
+  };
+
+  struct Batch {
+    std::vector<Request> requests;
+    int64_t rows = 0;
+    bool done = false;
+    std::exception_ptr error;
+  };
+
+  // The kernel and the buffers of the batches of a number of rows.
+  struct Bucket {
+    size_t handle;
+    std::vector<DLTensorUPtr> inputs;
+    std::vector<DLTensorUPtr> outputs;
+    std::vector<void*> buffers;
+  };
+
+  CudaBatchingExecution(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      const std::string& name,
+      const CudaMappingOptions& options,
+      int64_t maxBatch,
+      std::chrono::microseconds window)
+      : engine_(engine),
+        name_(name),
+        options_(options.toProtobufSerializedString()),
+        maxBatch_(maxBatch),
+        window_(window) {}
+
+  // The rows of the first dimension of the split inputs of a request, -1 if
+  // they differ or if the request is not batched.
+  int64_t batchRows(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs) const;
+  // Can request join the batch of first?
+  bool matches(const Request& first, const Request& request) const;
+  void runAlone(const Request& request);
+  // Gathers, runs and scatters batch, under executionMutex_.
+  void execute(const Batch& batch);
+  Bucket& bucket(int64_t rows, const Request& first);
+
+  ExecutionEngine<CudaTcExecutor>& engine_;
+  const std::string name_;
+  const std::string options_;
+  const int64_t maxBatch_;
+  const std::chrono::microseconds window_;
+  int device_;
+  std::vector<bool> splitInputs_;
+  cudaStream_t stream_ = nullptr;
+
+  // The batch callers join, null if there is none.
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::shared_ptr<Batch> open_;
+  size_t numberBatches_ = 0;
+
+  std::mutex executionMutex_;
+  std::map<int64_t, Bucket> buckets_;
+};
+
+} // namespace tc
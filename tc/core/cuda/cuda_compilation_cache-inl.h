@@ -23,77 +23,23 @@
 #include <glog/logging.h>
 #include <version.h>
 
-namespace tc {
-
-template <typename CC>
-void Cache<CC>::enableCache() {
-  CC::getGlobalSharedCache() = std::make_shared<CC>();
-}
-
-template <typename CC>
-void Cache<CC>::disableCache() {
-  CC::getGlobalSharedCache() = nullptr;
-}
-
-template <typename CC>
-std::shared_ptr<CC> Cache<CC>::getCache() {
-  if (not cacheEnabled()) {
-    throw std::runtime_error(
-        "EnableCache or LoadCacheFromProtobuf must be called before using the cache.");
-  }
-  return CC::getGlobalSharedCache();
-}
-
-template <typename CC>
-void Cache<CC>::dumpCacheToProtobuf(const std::string& filename) {
-  std::fstream serialized(
-      filename, std::ios::binary | std::ios::trunc | std::ios::out);
-  if (!serialized) {
-    LOG(ERROR) << "Failed to open the output stream for dumping protobuf: "
-               << filename;
-  } else {
-    getCache()->toProtobuf().SerializePartialToOstream(&serialized);
-  }
-}
-
-template <typename CC>
-void Cache<CC>::loadCacheFromProtobuf(const std::string& filename) {
-  typename CC::Protobuf buf;
-  struct stat buffer = {0};
-  if (stat(filename.c_str(), &buffer) == 0) {
-    std::ifstream serialized(filename, std::ios::binary);
-    buf.ParseFromIstream(&serialized);
-  }
-  loadCacheFromProtobuf(buf);
-}
-
-template <typename CC>
-template <typename Protobuf>
-void Cache<CC>::loadCacheFromProtobuf(const Protobuf& buf) {
-  static_assert(
-      std::is_same<Protobuf, typename CC::Protobuf>::value,
-      "LoadCacheFromProtobuf called with invalide protobuf type.");
-  CC::getGlobalSharedCache() = std::make_shared<CC>(buf);
-}
-
-template <typename CC>
-bool Cache<CC>::cacheEnabled() {
-  return CC::getGlobalSharedCache() != nullptr;
-}
+#include "tc/core/utils/hash.h"
+#include "tc/core/utils/memory.h"
 
-template <typename CC>
-size_t Cache<CC>::size() const {
-  std::lock_guard<std::mutex> lock(mtx_);
-  return static_cast<const CC*>(this)->entries_.size();
-}
+namespace tc {
 
-template <typename CC>
-void Cache<CC>::clear() {
-  std::lock_guard<std::mutex> lock(mtx_);
-  numberAttemptedRetrievals = numberSuccessfulRetrievals = numberCacheAttemps =
-      0;
-  static_cast<CC*>(this)->entries_.clear();
+namespace detail {
+template <typename TensorTy>
+size_t hashCacheKey(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::vector<TensorTy>& inputs,
+    const std::vector<TensorTy>& outputs,
+    const std::string& deviceStr) {
+  return hashCombine(
+      hashCacheKey(id, inputs, outputs, deviceStr), options.hash());
 }
+} // namespace detail
 
 template <typename C, typename InputTy> // deduces whether C is const or
 // non-const
@@ -104,24 +50,31 @@ auto CudaCache::searchKernelImpl(
     const std::vector<InputTy>& inputs,
     const std::vector<InputTy>& outputs)
     -> decltype(c.searchKernel(id, options, inputs, outputs)) {
-  auto gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  const auto& gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  auto hash = detail::hashCacheKey(id, options, inputs, outputs, gpuStr);
+  c.materialize(hash);
+  auto range = c.index_.equal_range(hash);
   auto it = std::find_if(
-      c.entries_.begin(), c.entries_.end(), [&](const CachedEntry& c) {
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
         using tc::operator==;
-        return id == c.key.id && options == c.key.mappingOptions &&
-            inputs == c.key.inputs && outputs == c.key.outputs &&
-            gpuStr == c.key.deviceStr;
+        const auto& e = c.entries_[kv.second];
+        return id == e.key.id && options == e.key.mappingOptions &&
+            inputs == e.key.inputs && outputs == e.key.outputs &&
+            gpuStr == e.key.deviceStr;
       });
-  if (it != c.entries_.end()) {
-    if (it->key.gitVersion != tc::git_version) {
+  if (it != range.second) {
+    auto& entry = c.entries_[it->second];
+    if (entry.key.gitVersion != tc::git_version) {
       std::cerr << "[WARNING] Proto version doesn't match. TC git version is: "
                 << tc::git_version
-                << " and Proto version is: " << it->key.gitVersion
+                << " and Proto version is: " << entry.key.gitVersion
                 << " .This proto might be incompatible"
                 << " with your TC binary and can break. Please autotune"
                 << " against the correct TC version." << std::endl;
     }
-    return &*it;
+    return &entry;
   }
   return nullptr;
 }
@@ -134,24 +87,31 @@ auto OptionsCache::searchKernelImpl(
     const std::vector<const DLTensor*>& inputs,
     const std::vector<const DLTensor*>& outputs)
     -> decltype(c.searchKernel(id, inputs, outputs)) {
-  auto gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  const auto& gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  auto hash = detail::hashCacheKey(id, inputs, outputs, gpuStr);
+  c.materialize(hash);
+  auto range = c.index_.equal_range(hash);
   auto it = std::find_if(
-      c.entries_.begin(), c.entries_.end(), [&](const CachedEntry& c) {
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
         using tc::operator==;
-        return id == c.key.id && inputs == c.key.inputs &&
-            outputs == c.key.outputs && gpuStr == c.key.deviceStr;
+        const auto& e = c.entries_[kv.second];
+        return id == e.key.id && inputs == e.key.inputs &&
+            outputs == e.key.outputs && gpuStr == e.key.deviceStr;
       });
-  if (it != c.entries_.end()) {
-    if (it->key.gitVersion != tc::git_version) {
+  if (it != range.second) {
+    auto& entry = c.entries_[it->second];
+    if (entry.key.gitVersion != tc::git_version) {
       std::cerr << "[WARNING] Proto version doesn't match. TC git version is: "
                 << tc::git_version
-                << " and Proto version is: " << it->key.gitVersion
+                << " and Proto version is: " << entry.key.gitVersion
                 << " .This proto might be incompatible"
                 << " with your TC binary and can break. Please autotune"
-                << " against the correct TC version." << std::endl;
-      ;
+                << " against the correct TC version, or re-tune from this"
+                << " cache (see GeneticAutotuner::retune)." << std::endl;
     }
-    return &*it;
+    return &entry;
   }
   return nullptr;
 }
@@ -164,27 +124,63 @@ auto ManualCudaCache::searchKernelImpl(
     const std::vector<TensorTy>& inputs,
     const std::vector<TensorTy>& outputs)
     -> decltype(c.searchKernel(id, inputs, outputs)) {
-  auto gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  const auto& gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  auto hash = detail::hashCacheKey(id, inputs, outputs, gpuStr);
+  c.materialize(hash);
+  auto range = c.index_.equal_range(hash);
   auto it = std::find_if(
-      c.entries_.begin(), c.entries_.end(), [&](const CachedEntry& c) {
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
         using tc::operator==;
-        return id == c.key.id && inputs == c.key.inputs &&
-            outputs == c.key.outputs && gpuStr == c.key.deviceStr;
+        const auto& e = c.entries_[kv.second];
+        return id == e.key.id && inputs == e.key.inputs &&
+            outputs == e.key.outputs && gpuStr == e.key.deviceStr;
       });
-  if (it != c.entries_.end()) {
-    std::cout << "RETURNING IT: " << it->key.gitVersion << std::endl;
-    if (it->key.gitVersion != tc::git_version) {
+  if (it != range.second) {
+    auto& entry = c.entries_[it->second];
+    std::cout << "RETURNING IT: " << entry.key.gitVersion << std::endl;
+    if (entry.key.gitVersion != tc::git_version) {
       std::cerr << "[WARNING] Proto version doesn't match. TC git version is: "
                 << tc::git_version
-                << " and Proto version is: " << it->key.gitVersion
+                << " and Proto version is: " << entry.key.gitVersion
                 << " .This proto might be incompatible"
                 << " with your TC binary and can break. Please autotune"
                 << " against the correct TC version." << std::endl;
-      ;
     }
-    return &*it;
+    return &entry;
   }
   return nullptr;
 }
 
+template <typename C, typename TensorTy>
+auto CudaKernelBundle::searchKernelImpl(
+    C& c,
+    const std::string& id,
+    const std::vector<TensorTy>& inputs,
+    const std::vector<TensorTy>& outputs)
+    -> decltype(c.searchKernel(id, inputs, outputs)) {
+  // Bundles are built for several devices, the key holds no device.
+  auto hash = detail::hashCacheKey(id, inputs, outputs, std::string());
+  c.materialize(hash);
+  auto range = c.index_.equal_range(hash);
+  auto it = std::find_if(
+      range.first,
+      range.second,
+      [&](const std::pair<const size_t, size_t>& kv) {
+        using tc::operator==;
+        const auto& e = c.entries_[kv.second];
+        return id == e.key.id && inputs == e.key.inputs &&
+            outputs == e.key.outputs;
+      });
+  if (it == range.second) {
+    return nullptr;
+  }
+  auto& entry = c.entries_[it->second];
+  LOG_IF(WARNING, entry.key.gitVersion != tc::git_version)
+      << "Kernel bundle built with TC version " << entry.key.gitVersion
+      << " used with TC version " << tc::git_version;
+  return &entry;
+}
+
 } // namespace tc
@@ -17,139 +17,19 @@
 
 #include <version.h>
 
+#include <cmath>
 #include <cstdint>
 #include <fstream>
 #include <numeric>
 #include <tuple>
 
 #include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/hash.h"
 #include "tc/core/utils/math.h"
 
 namespace tc {
 
-namespace {
-uint64_t GetDLTensorAlignment(const DLTensor* t) {
-  return (reinterpret_cast<std::uintptr_t>(t->data) + t->byte_offset) % 256;
-}
-} // namespace
-
-detail::TensorInfo::TensorInfo(const DLTensor* t)
-    : alignment{GetDLTensorAlignment(t)}, dType(t->dtype) {
-  shape.reserve(t->ndim);
-  std::copy(t->shape, t->shape + t->ndim, std::back_inserter(shape));
-  if (not t->strides) {
-    return;
-  }
-  strides.reserve(t->ndim);
-  std::copy(t->strides, t->strides + t->ndim, std::back_inserter(strides));
-}
-
-detail::TensorInfo::TensorInfo(const TensorInfoProto& buf)
-    : shape{buf.shape().begin(), buf.shape().end()},
-      strides{buf.strides().begin(), buf.strides().end()},
-      alignment{buf.alignment()},
-      dType{static_cast<uint8_t>(buf.dtype().code()),
-            static_cast<uint8_t>(buf.dtype().bits()),
-            static_cast<uint16_t>(buf.dtype().lanes())} {}
-
-TensorInfoProto detail::TensorInfo::toProtobuf() const {
-  TensorInfoProto buf;
-  buf.mutable_shape()->Reserve(shape.size());
-  std::copy(
-      shape.begin(),
-      shape.end(),
-      google::protobuf::RepeatedFieldBackInserter(buf.mutable_shape()));
-  buf.mutable_strides()->Reserve(strides.size());
-  std::copy(
-      strides.begin(),
-      strides.end(),
-      google::protobuf::RepeatedFieldBackInserter(buf.mutable_strides()));
-  buf.set_alignment(alignment);
-  buf.mutable_dtype()->set_code(dType.code);
-  buf.mutable_dtype()->set_bits(dType.bits);
-  buf.mutable_dtype()->set_lanes(dType.lanes);
-  return buf;
-}
-
-bool detail::TensorInfo::operator==(const DLTensor* t) const {
-  if (t->ndim != static_cast<int>(shape.size())) {
-    return false;
-  }
-
-  auto res = std::mismatch(shape.begin(), shape.end(), t->shape);
-  if (res.first != shape.end() || res.second != t->shape + t->ndim) {
-    return false;
-  }
-
-  if (t->strides == nullptr) {
-    if (strides.size() > 0) {
-      return false;
-    }
-  } else {
-    if (t->ndim != static_cast<int>(strides.size())) {
-      return false;
-    }
-
-    res = std::mismatch(strides.begin(), strides.end(), t->strides);
-    if (res.first != strides.end() || res.second != t->strides + t->ndim) {
-      return false;
-    }
-  }
-
-  /*This should be enabled when/if tc starts using alignment information
-   *if (GetDLTensorAlignment(t) != alignment) {
-   *  return false;
-   *}
-   */
-  return std::tie(t->dtype.code, t->dtype.bits, t->dtype.lanes) ==
-      std::tie(dType.code, dType.bits, dType.lanes);
-}
-
-bool operator==(const DLDataType& a, const DLDataType& b) {
-  return a.code == b.code and a.bits == b.bits and a.lanes == b.lanes;
-}
-
-bool operator<(const DLDataType& a, const DLDataType& b) {
-  return a.code < b.code and a.bits < b.bits and a.lanes < b.lanes;
-}
-
-bool detail::TensorInfo::operator==(const TensorInfo& t) const {
-  return alignment == t.alignment and dType == t.dType and shape == t.shape and
-      strides == t.strides;
-}
-
-bool detail::TensorInfo::operator<(const TensorInfo& t) const {
-  return alignment < t.alignment and dType < t.dType and shape < t.shape and
-      strides < t.strides;
-}
-
-namespace {
-std::vector<detail::TensorInfo> DLTensorToTensorInfoVector(
-    const std::vector<const DLTensor*>& ts) {
-  std::vector<detail::TensorInfo> iis;
-  iis.reserve(ts.size());
-  std::transform(
-      ts.begin(), ts.end(), std::back_inserter(iis), [](const DLTensor* t) {
-        return detail::TensorInfo{t};
-      });
-  return iis;
-}
-} // namespace
-
-namespace {
-std::vector<detail::TensorInfo> ProtoToTensorInfoVector(
-    const google::protobuf::RepeatedPtrField<TensorInfoProto>& buf) {
-  std::vector<detail::TensorInfo> iis;
-  iis.reserve(buf.size());
-  std::transform(
-      buf.begin(),
-      buf.end(),
-      std::back_inserter(iis),
-      [](const TensorInfoProto& iip) { return detail::TensorInfo{iip}; });
-  return iis;
-}
-} // namespace
-
 namespace {
 template <typename Array, typename Buf>
 void WriteProtobufArray(const Array& arr, Buf* buf) {
@@ -159,25 +39,11 @@ void WriteProtobufArray(const Array& arr, Buf* buf) {
 }
 } // namespace
 
-bool operator==(
-    const std::vector<const DLTensor*>& inputsTensor,
-    const std::vector<detail::TensorInfo>& inputsInfo) {
-  if (inputsTensor.size() != inputsInfo.size()) {
-    return false;
-  }
-  CHECK(inputsTensor.size() == inputsInfo.size());
-  for (size_t i = 0, n = inputsInfo.size(); i < n; ++i) {
-    if (!(inputsInfo[i] == inputsTensor[i])) {
-      return false;
-    }
-  }
-  return true;
-}
-
 namespace {
 std::shared_ptr<CudaCache> cudaCache_;
 std::shared_ptr<OptionsCache> optionsCache_;
 std::shared_ptr<ManualCudaCache> manualCudaCache_;
+std::shared_ptr<CudaKernelBundle> cudaKernelBundle_;
 } // namespace
 
 std::shared_ptr<CudaCache>& CudaCache::getGlobalSharedCache() {
@@ -192,10 +58,33 @@ std::shared_ptr<ManualCudaCache>& ManualCudaCache::getGlobalSharedCache() {
   return manualCudaCache_;
 }
 
+std::shared_ptr<CudaKernelBundle>& CudaKernelBundle::getGlobalSharedCache() {
+  return cudaKernelBundle_;
+}
+
 CudaCache::CudaCache(const CudaCacheProto& buf) {
   entries_.reserve(buf.entries_size());
   for (const auto& entry_buf : buf.entries())
     entries_.emplace_back(entry_buf);
+  rebuildIndex();
+}
+
+size_t CudaCache::hashKey(const CachedEntry::Key& key) {
+  return detail::hashCacheKey(
+      key.id, key.mappingOptions, key.inputs, key.outputs, key.deviceStr);
+}
+
+void CudaCache::mergeRecord(CachedEntry& entry, CachedEntry&& record) {
+  record.values.ptx.insert(entry.values.ptx.begin(), entry.values.ptx.end());
+  record.values.attributes.insert(
+      entry.values.attributes.begin(), entry.values.attributes.end());
+  entry = std::move(record);
+}
+
+bool CudaCache::CachedEntry::Key::operator==(const Key& other) const {
+  return id == other.id && mappingOptions == other.mappingOptions &&
+      inputs == other.inputs && outputs == other.outputs &&
+      deviceStr == other.deviceStr;
 }
 
 CudaCache::CachedEntry::CachedEntry(
@@ -208,28 +97,47 @@ CudaCache::CachedEntry::CachedEntry(
     const std::vector<const DLTensor*>& inputs,
     const std::vector<const DLTensor*>& outputs,
     const std::string& cudaSource,
-    const std::string& deviceStr)
+    const std::string& deviceStr,
+    size_t dynamicSharedMemory)
     : key{id,
           mappingOptions,
-          DLTensorToTensorInfoVector(inputs),
-          DLTensorToTensorInfoVector(outputs),
+          detail::DLTensorToTensorInfoVector(inputs),
+          detail::DLTensorToTensorInfoVector(outputs),
           deviceStr,
           git_version},
-      values{cudaSource, kernelSpecializedName, kernelParameters, grid, block} {
-}
+      values{cudaSource,
+             kernelSpecializedName,
+             kernelParameters,
+             grid,
+             block,
+             {},
+             dynamicSharedMemory} {}
 
 CudaCache::CachedEntry::CachedEntry(const CudaCacheEntryProto& buf)
     : key{buf.id(),
           CudaMappingOptions{buf.kernel_options()},
-          ProtoToTensorInfoVector(buf.inputs()),
-          ProtoToTensorInfoVector(buf.outputs()),
+          detail::ProtoToTensorInfoVector(buf.inputs()),
+          detail::ProtoToTensorInfoVector(buf.outputs()),
           buf.device_str(),
           buf.git_version()},
       values{buf.cuda_source(),
              buf.specialized_name(),
              std::vector<int>{buf.parameters().begin(), buf.parameters().end()},
              Grid(buf.grid_dims()),
-             Block(buf.block_dims())} {}
+             Block(buf.block_dims()),
+             {},
+             buf.dynamic_shared_memory()} {
+  for (const auto& ptx : buf.ptx()) {
+    values.ptx[ptx.architecture()] = ptx.ptx();
+  }
+  for (const auto& a : buf.attributes()) {
+    auto& attributes = values.attributes[a.architecture()];
+    attributes.numRegisters = a.num_registers();
+    attributes.localBytes = a.local_bytes();
+    attributes.staticSharedBytes = a.static_shared_bytes();
+    attributes.maxThreadsPerBlock = a.max_threads_per_block();
+  }
+}
 
 void CudaCache::cacheKernel(
     const std::string& id,
@@ -240,7 +148,8 @@ void CudaCache::cacheKernel(
     const std::vector<int>& kernelParameters,
     const std::string& cudaSource,
     const Grid& grid,
-    const Block& block) {
+    const Block& block,
+    size_t dynamicSharedMemory) {
   std::lock_guard<std::mutex> lock(mtx_);
   ++numberCacheAttemps;
   auto entry = searchKernel(id, options, inputs, outputs);
@@ -263,7 +172,12 @@ void CudaCache::cacheKernel(
       inputs,
       outputs,
       cudaSource,
-      CudaGPUInfo::GPUInfo().GetCudaDeviceStr());
+      CudaGPUInfo::GPUInfo().GetCudaDeviceStr(),
+      dynamicSharedMemory);
+  entries_.back().lastUsed = ++useCounter_;
+  indexLastEntry();
+  syncSharedFile();
+  evictIfNeeded();
 }
 
 CudaCache::CachedEntry* CudaCache::searchKernel(
@@ -302,15 +216,114 @@ std::unique_ptr<CudaCache::RetrievalResult> CudaCache::retrieveKernel(
     return nullptr;
   }
   ++numberSuccessfulRetrievals;
+  entry->lastUsed = ++useCounter_;
+  auto ptx =
+      entry->values.ptx.find(CudaRTCFunction::CurrentDeviceArchitecture());
+  auto attributes = entry->values.attributes.find(
+      CudaRTCFunction::CurrentDeviceRealArchitecture());
+  auto hasAttributes = attributes != entry->values.attributes.end();
   return std::unique_ptr<CudaCache::RetrievalResult>(
-      new CudaCache::RetrievalResult{entry->values.cudaSource,
-                                     entry->values.kernelSpecializedName,
-                                     entry->values.kernelParameters,
-                                     entry->values.grid,
-                                     entry->values.block});
+      new CudaCache::RetrievalResult{
+          entry->values.cudaSource,
+          entry->values.kernelSpecializedName,
+          entry->values.kernelParameters,
+          entry->values.grid,
+          entry->values.block,
+          ptx != entry->values.ptx.end() ? ptx->second : std::string(),
+          entry->values.dynamicSharedMemory,
+          std::string(),
+          hasAttributes,
+          hasAttributes ? attributes->second : CudaKernelAttributes()});
+}
+
+void CudaCache::cacheKernelPtx(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const std::string& architecture,
+    const std::string& ptx) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto entry = searchKernel(id, options, inputs, outputs);
+  if (not entry) {
+    return;
+  }
+  entry->values.ptx[architecture] = ptx;
+  entry->lastUsed = ++useCounter_;
+  markDirty(entry);
+  syncSharedFile();
+  evictIfNeeded();
+}
+
+void CudaCache::cacheKernelAttributes(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const std::string& architecture,
+    const CudaKernelAttributes& attributes) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto entry = searchKernel(id, options, inputs, outputs);
+  if (not entry or entry->values.attributes.count(architecture) > 0) {
+    return;
+  }
+  entry->values.attributes[architecture] = attributes;
+  markDirty(entry);
+  syncSharedFile();
+}
+
+size_t CudaCache::entryBytes(const CachedEntry& entry) {
+  auto bytes = sizeof(CachedEntry) + entry.key.id.size() +
+      entry.values.cudaSource.size() +
+      entry.values.kernelSpecializedName.size() +
+      entry.values.kernelParameters.size() * sizeof(int);
+  for (const auto& ptx : entry.values.ptx) {
+    bytes += ptx.first.size() + ptx.second.size();
+  }
+  return bytes;
+}
+
+void CudaCache::evictIfNeeded() {
+  auto maxEntries = FLAGS_cuda_cache_max_entries;
+  auto maxBytes = FLAGS_cuda_cache_max_bytes;
+  if (maxEntries == 0 and maxBytes == 0) {
+    return;
+  }
+  size_t bytes = 0;
+  for (const auto& entry : entries_) {
+    bytes += entryBytes(entry);
+  }
+  auto fits = [&](size_t numEntries) {
+    return (maxEntries == 0 or numEntries <= maxEntries) and
+        (maxBytes == 0 or bytes <= maxBytes);
+  };
+  auto numEntries = entries_.size();
+  if (fits(numEntries)) {
+    return;
+  }
+
+  std::vector<size_t> positions(entries_.size());
+  std::iota(positions.begin(), positions.end(), 0);
+  std::sort(positions.begin(), positions.end(), [this](size_t a, size_t b) {
+    return entries_[a].lastUsed < entries_[b].lastUsed;
+  });
+  std::vector<bool> remove(entries_.size(), false);
+  for (auto pos : positions) {
+    if (fits(numEntries)) {
+      break;
+    }
+    if (isUnsaved(pos)) {
+      continue;
+    }
+    remove[pos] = true;
+    bytes -= entryBytes(entries_[pos]);
+    --numEntries;
+  }
+  evictEntries(remove);
 }
 
 void CudaCache::removeEntriesNotInOptionsCache(const OptionsCache& oc) {
+  materializeAll();
   std::vector<CachedEntry> newEntries;
   for (const auto& entry : oc) {
     for (const auto& options : entry.values) {
@@ -325,10 +338,13 @@ void CudaCache::removeEntriesNotInOptionsCache(const OptionsCache& oc) {
     }
   }
   entries_ = std::move(newEntries);
+  rebuildIndex();
+  markRewrite();
 }
 
 size_t OptionsCache::totalSize() const {
   std::lock_guard<std::mutex> lock(mtx_);
+  materializeAll();
   return std::accumulate(
       entries_.begin(),
       entries_.end(),
@@ -339,8 +355,9 @@ size_t OptionsCache::totalSize() const {
 std::unique_ptr<CudaMappingOptions> OptionsCache::retrieveBestOptions(
     const std::string& id,
     const std::vector<const DLTensor*>& inputs,
-    const std::vector<const DLTensor*>& outputs) const {
-  auto ret = retrieveTopKOptions(id, inputs, outputs, 1);
+    const std::vector<const DLTensor*>& outputs,
+    DeviceMatch* match) const {
+  auto ret = retrieveTopKOptions(id, inputs, outputs, 1, match);
   if (ret.empty()) {
     return nullptr;
   }
@@ -355,7 +372,8 @@ OptionsCache::retrieveOptionsAndRuntimes(
     const std::vector<const DLTensor*>& outputs) const {
   std::lock_guard<std::mutex> lock(mtx_);
   ++numberAttemptedRetrievals;
-  auto ret = searchKernel(id, inputs, outputs);
+  DeviceMatch match;
+  auto ret = searchKernelOnAnyDevice(id, inputs, outputs, &match);
   if (not ret) {
     return {};
   }
@@ -366,8 +384,8 @@ OptionsCache::retrieveOptionsAndRuntimes(
       ret->values.begin(),
       ret->values.end(),
       std::back_inserter(res),
-      [](const CachedEntry::Values& v) -> RetrievalResult {
-        return {v.mappingOptions, v.recordedRuntimes};
+      [match](const CachedEntry::Values& v) -> RetrievalResult {
+        return {v.mappingOptions, v.recordedRuntimes, match};
       });
   return res;
 }
@@ -376,13 +394,19 @@ std::vector<CudaMappingOptions> OptionsCache::retrieveTopKOptions(
     const std::string& id,
     const std::vector<const DLTensor*>& inputs,
     const std::vector<const DLTensor*>& outputs,
-    size_t k) const {
-  auto candidates = searchKernel(id, inputs, outputs);
+    size_t k,
+    DeviceMatch* match) const {
   std::lock_guard<std::mutex> lock(mtx_);
+  DeviceMatch candidatesMatch;
+  auto candidates =
+      searchKernelOnAnyDevice(id, inputs, outputs, &candidatesMatch);
   ++numberAttemptedRetrievals;
   if (not candidates) {
     return {};
   }
+  if (match) {
+    *match = candidatesMatch;
+  }
 
   struct OptionsWithMedian {
     const CudaMappingOptions* options;
@@ -426,6 +450,8 @@ std::vector<CudaMappingOptions> OptionsCache::retrieveTopKOptions(
 
 void OptionsCache::keepOnlyBestCandidates(size_t numberToKeep) {
   std::lock_guard<std::mutex> lock(mtx_);
+  materializeAll();
+  markRewrite();
 
   for (auto& entry : entries_) {
     std::sort(
@@ -442,6 +468,198 @@ void OptionsCache::keepOnlyBestCandidates(size_t numberToKeep) {
   }
 }
 
+size_t OptionsCache::merge(
+    const OptionsCacheProto& buf,
+    const std::string& gitVersion) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  materializeAll();
+  size_t merged = 0;
+  for (const auto& entryBuf : buf.entries()) {
+    if (not gitVersion.empty() and entryBuf.git_version() != gitVersion) {
+      continue;
+    }
+    CachedEntry entry(entryBuf);
+    auto values = std::move(entry.values);
+    entry.values.clear();
+    auto hash = hashKey(entry.key);
+    auto range = index_.equal_range(hash);
+    auto it = std::find_if(
+        range.first,
+        range.second,
+        [&](const std::pair<const size_t, size_t>& kv) {
+          return entries_[kv.second].key == entry.key;
+        });
+    CachedEntry* target;
+    if (it == range.second) {
+      entries_.push_back(std::move(entry));
+      indexLastEntry();
+      target = &entries_.back();
+    } else {
+      target = &entries_[it->second];
+      markDirty(target);
+      if (target->key.deviceArch.empty()) {
+        target->key.deviceArch = entry.key.deviceArch;
+      }
+    }
+    // Unlike mergeRecord, the runtimes are new to the backing file.
+    for (auto& recorded : values) {
+      auto v = std::find_if(
+          target->values.begin(),
+          target->values.end(),
+          [&recorded](const CachedEntry::Values& v) {
+            return v.mappingOptions == recorded.mappingOptions;
+          });
+      if (v == target->values.end()) {
+        target->values.push_back(std::move(recorded));
+        continue;
+      }
+      if (not recorded.metrics.empty()) {
+        v->metrics = recorded.metrics;
+      }
+      v->recordedRuntimes.insert(
+          v->recordedRuntimes.end(),
+          recorded.recordedRuntimes.begin(),
+          recorded.recordedRuntimes.end());
+    }
+    ++merged;
+  }
+  syncSharedFile();
+  return merged;
+}
+
+namespace {
+// Adds the distance between the shapes of tensors and infos (see
+// OptionsCache::retrieveNearestShapeOptions) to distance, returns false if
+// the tensors are not comparable.
+bool addShapeDistance(
+    const std::vector<const DLTensor*>& tensors,
+    const std::vector<detail::TensorInfo>& infos,
+    double& distance) {
+  if (tensors.size() != infos.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    const auto& t = *tensors[i];
+    const auto& info = infos[i];
+    if (not(t.dtype == info.dType) or
+        static_cast<size_t>(t.ndim) != info.shape.size()) {
+      return false;
+    }
+    for (int d = 0; d < t.ndim; ++d) {
+      if (t.shape[d] == info.shape[d]) {
+        continue;
+      }
+      if (t.shape[d] <= 0 or info.shape[d] <= 0) {
+        return false;
+      }
+      distance += std::abs(
+          std::log2(static_cast<double>(info.shape[d]) / t.shape[d]));
+    }
+  }
+  return true;
+}
+} // namespace
+
+std::vector<OptionsCache::NearestShapeResult>
+OptionsCache::retrieveNearestShapeOptions(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const NearestShapeQuery& query) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberAttemptedRetrievals;
+  materializeAll();
+  const auto& gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  auto arch = query.sameArchitecture
+      ? CudaRTCFunction::CurrentDeviceArchitecture()
+      : std::string();
+
+  struct EntryWithDistance {
+    const CachedEntry* entry;
+    double distance;
+  };
+  std::vector<EntryWithDistance> nearest;
+  for (const auto& entry : entries_) {
+    if (entry.key.id != id) {
+      continue;
+    }
+    if (entry.key.deviceStr != gpuStr and
+        (arch.empty() or entry.key.deviceArch != arch)) {
+      continue;
+    }
+    double distance = 0;
+    if (not addShapeDistance(inputs, entry.key.inputs, distance) or
+        not addShapeDistance(outputs, entry.key.outputs, distance) or
+        distance > query.maxDistance) {
+      continue;
+    }
+    nearest.push_back({&entry, distance});
+  }
+  std::stable_sort(
+      nearest.begin(),
+      nearest.end(),
+      [](const EntryWithDistance& a, const EntryWithDistance& b) {
+        return a.distance < b.distance;
+      });
+  if (nearest.size() > query.numberEntries) {
+    nearest.resize(query.numberEntries);
+  }
+
+  std::vector<NearestShapeResult> res;
+  for (const auto& n : nearest) {
+    std::vector<NearestShapeResult> entryRes;
+    entryRes.reserve(n.entry->values.size());
+    for (const auto& v : n.entry->values) {
+      entryRes.push_back(
+          {v.mappingOptions, median(v.recordedRuntimes), n.distance});
+    }
+    std::sort(
+        entryRes.begin(),
+        entryRes.end(),
+        [](const NearestShapeResult& a, const NearestShapeResult& b) {
+          return a.medianRuntime < b.medianRuntime;
+        });
+    if (entryRes.size() > query.optionsPerEntry) {
+      entryRes.erase(entryRes.begin() + query.optionsPerEntry, entryRes.end());
+    }
+    std::move(entryRes.begin(), entryRes.end(), std::back_inserter(res));
+  }
+  if (not res.empty()) {
+    ++numberSuccessfulRetrievals;
+  }
+  return res;
+}
+
+std::vector<OptionsCache::TuningSample> OptionsCache::retrieveTuningSamples(
+    const std::string& id) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberAttemptedRetrievals;
+  materializeAll();
+  const auto& gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  auto arch = CudaRTCFunction::CurrentDeviceArchitecture();
+
+  std::vector<TuningSample> res;
+  for (const auto& entry : entries_) {
+    if (entry.key.id != id or
+        (entry.key.deviceStr != gpuStr and entry.key.deviceArch != arch)) {
+      continue;
+    }
+    for (const auto& v : entry.values) {
+      if (v.recordedRuntimes.empty()) {
+        continue;
+      }
+      res.push_back({entry.key.inputs,
+                     v.mappingOptions,
+                     median(v.recordedRuntimes),
+                     v.metrics});
+    }
+  }
+  if (not res.empty()) {
+    ++numberSuccessfulRetrievals;
+  }
+  return res;
+}
+
 void OptionsCache::recordRuntime(
     const std::string& id,
     const CudaMappingOptions& options,
@@ -450,11 +668,20 @@ void OptionsCache::recordRuntime(
     Duration runtime) {
   std::lock_guard<std::mutex> lock(mtx_);
   ++numberCacheAttemps;
-  auto gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
+  const auto& gpuStr = CudaGPUInfo::GPUInfo().GetCudaDeviceStr();
 
   auto kernel = searchKernel(id, inputs, outputs);
   if (not kernel) {
-    entries_.emplace_back(id, inputs, outputs, gpuStr, options, runtime);
+    entries_.emplace_back(
+        id,
+        inputs,
+        outputs,
+        gpuStr,
+        CudaRTCFunction::CurrentDeviceArchitecture(),
+        options,
+        runtime);
+    indexLastEntry();
+    syncSharedFile();
     return;
   }
   auto v = std::find_if(
@@ -465,10 +692,34 @@ void OptionsCache::recordRuntime(
       });
   if (v == kernel->values.end()) {
     kernel->values.emplace_back(options, runtime);
-    return;
+  } else {
+    v->recordedRuntimes.push_back(runtime);
   }
+  markDirty(kernel);
+  syncSharedFile();
+}
 
-  v->recordedRuntimes.push_back(runtime);
+void OptionsCache::recordMetrics(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const KernelMetrics& metrics) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto kernel = searchKernel(id, inputs, outputs);
+  if (not kernel) {
+    return;
+  }
+  auto v = std::find_if(
+      kernel->values.begin(),
+      kernel->values.end(),
+      [&options](const CachedEntry::Values& v) {
+        return v.mappingOptions == options;
+      });
+  if (v == kernel->values.end()) {
+    return;
+  }
+  v->metrics = metrics;
 }
 
 OptionsCache::CachedEntry* OptionsCache::searchKernel(
@@ -485,14 +736,51 @@ const OptionsCache::CachedEntry* OptionsCache::searchKernel(
   return searchKernelImpl(*this, id, inputs, outputs);
 }
 
+const OptionsCache::CachedEntry* OptionsCache::searchKernelOnAnyDevice(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    DeviceMatch* match) const {
+  if (auto entry = searchKernel(id, inputs, outputs)) {
+    *match = DeviceMatch::Exact;
+    return entry;
+  }
+
+  // The other devices' entries may still sit unparsed in the backing file.
+  materializeAll();
+  auto arch = CudaRTCFunction::CurrentDeviceArchitecture();
+  const CachedEntry* best = nullptr;
+  size_t bestRuntimes = 0;
+  for (const auto& entry : entries_) {
+    if (entry.key.deviceArch != arch or entry.key.id != id or
+        not(inputs == entry.key.inputs) or not(outputs == entry.key.outputs)) {
+      continue;
+    }
+    size_t runtimes = 0;
+    for (const auto& v : entry.values) {
+      runtimes += v.recordedRuntimes.size();
+    }
+    if (not best or runtimes > bestRuntimes) {
+      best = &entry;
+      bestRuntimes = runtimes;
+    }
+  }
+  if (best) {
+    *match = DeviceMatch::SameArchitecture;
+  }
+  return best;
+}
+
 OptionsCache::CachedEntry::CachedEntry(
     const std::string& id,
     const std::vector<const DLTensor*>& inputs,
     const std::vector<const DLTensor*>& outputs,
     const std::string& deviceStr,
+    const std::string& deviceArch,
     const CudaMappingOptions& options,
     Duration runtime)
     : key(id, inputs, outputs, deviceStr, git_version) {
+  key.deviceArch = deviceArch;
   values.emplace_back(options, runtime);
 }
 
@@ -503,8 +791,8 @@ OptionsCache::CachedEntry::Key::Key(
     const std::string& deviceStr,
     const std::string& gitVersion)
     : Key(id,
-          DLTensorToTensorInfoVector(inputs_),
-          DLTensorToTensorInfoVector(outputs_),
+          detail::DLTensorToTensorInfoVector(inputs_),
+          detail::DLTensorToTensorInfoVector(outputs_),
           deviceStr,
           gitVersion) {}
 
@@ -523,33 +811,121 @@ OptionsCache::CachedEntry::Key::Key(
 OptionsCache::CachedEntry::Values::Values(
     const CudaMappingOptions& options,
     Duration runtime)
-    : mappingOptions(options), recordedRuntimes{runtime} {}
+    : mappingOptions(options), recordedRuntimes{runtime}, savedRuntimes(0) {}
 
 OptionsCache::CachedEntry::Values::Values(
     const CudaMappingOptions& options,
     std::vector<Duration>&& runtimes)
-    : mappingOptions(options), recordedRuntimes(std::move(runtimes)) {}
+    : mappingOptions(options),
+      recordedRuntimes(std::move(runtimes)),
+      savedRuntimes(0) {}
 
 OptionsCache::OptionsCache(const OptionsCacheProto& buf) {
   entries_.reserve(buf.entries_size());
   for (const auto& entry_buf : buf.entries())
     entries_.emplace_back(entry_buf);
+  rebuildIndex();
+}
+
+size_t OptionsCache::hashKey(const CachedEntry::Key& key) {
+  return detail::hashCacheKey(key.id, key.inputs, key.outputs, key.deviceStr);
+}
+
+bool OptionsCache::CachedEntry::Key::operator==(const Key& other) const {
+  return id == other.id && inputs == other.inputs &&
+      outputs == other.outputs && deviceStr == other.deviceStr;
+}
+
+void OptionsCache::mergeRecord(CachedEntry& entry, CachedEntry&& record) {
+  if (entry.key.deviceArch.empty()) {
+    entry.key.deviceArch = record.key.deviceArch;
+  }
+  for (auto& recorded : record.values) {
+    auto v = std::find_if(
+        entry.values.begin(),
+        entry.values.end(),
+        [&recorded](const CachedEntry::Values& v) {
+          return v.mappingOptions == recorded.mappingOptions;
+        });
+    if (v == entry.values.end()) {
+      entry.values.push_back(std::move(recorded));
+      continue;
+    }
+    if (not recorded.metrics.empty()) {
+      v->metrics = recorded.metrics;
+    }
+    // Runtimes not saved yet stay last.
+    v->recordedRuntimes.insert(
+        v->recordedRuntimes.begin() + v->savedRuntimes,
+        recorded.recordedRuntimes.begin(),
+        recorded.recordedRuntimes.end());
+    v->savedRuntimes += recorded.recordedRuntimes.size();
+  }
+}
+
+bool OptionsCache::unsavedProtobuf(
+    const CachedEntry& entry,
+    OptionsCacheEntryProto& buf) {
+  auto unsaved = entry;
+  unsaved.values.clear();
+  for (const auto& v : entry.values) {
+    if (v.savedRuntimes < v.recordedRuntimes.size()) {
+      unsaved.values.emplace_back(
+          v.mappingOptions,
+          std::vector<Duration>(
+              v.recordedRuntimes.begin() + v.savedRuntimes,
+              v.recordedRuntimes.end()));
+      unsaved.values.back().metrics = v.metrics;
+    }
+  }
+  if (unsaved.values.empty()) {
+    return false;
+  }
+  buf = unsaved.toProtobuf();
+  return true;
+}
+
+void OptionsCache::markSaved(CachedEntry& entry) {
+  for (auto& v : entry.values) {
+    v.savedRuntimes = v.recordedRuntimes.size();
+  }
+}
+
+bool OptionsCache::dropSaved(CachedEntry& entry) {
+  for (auto& v : entry.values) {
+    v.recordedRuntimes.erase(
+        v.recordedRuntimes.begin(),
+        v.recordedRuntimes.begin() + v.savedRuntimes);
+    v.savedRuntimes = 0;
+  }
+  entry.values.erase(
+      std::remove_if(
+          entry.values.begin(),
+          entry.values.end(),
+          [](const CachedEntry::Values& v) {
+            return v.recordedRuntimes.empty();
+          }),
+      entry.values.end());
+  return not entry.values.empty();
 }
 
 decltype(OptionsCache::entries_)::const_iterator OptionsCache::begin() const {
+  materializeAll();
   return entries_.begin();
 }
 
 decltype(OptionsCache::entries_)::const_iterator OptionsCache::end() const {
+  materializeAll();
   return entries_.end();
 }
 
 OptionsCache::CachedEntry::CachedEntry(const OptionsCacheEntryProto& buf)
     : key(buf.id(),
-          ProtoToTensorInfoVector(buf.inputs()),
-          ProtoToTensorInfoVector(buf.outputs()),
+          detail::ProtoToTensorInfoVector(buf.inputs()),
+          detail::ProtoToTensorInfoVector(buf.outputs()),
           buf.device_str(),
           buf.git_version()) {
+  key.deviceArch = buf.device_arch();
   if (buf.values_size() == 0) {
     throw std::invalid_argument(
         "OptionsCache::CachedEntry invalid protobuf: each entry should have at least one value field.");
@@ -569,10 +945,14 @@ OptionsCache::CachedEntry::CachedEntry(const OptionsCacheEntryProto& buf)
         [](int64_t us) { return std::chrono::microseconds(us); });
     values.emplace_back(
         CudaMappingOptions(value.kernel_options()), std::move(runtimes));
+    if (value.has_metrics()) {
+      values.back().metrics = KernelMetrics::fromProtobuf(value.metrics());
+    }
   }
 }
 
 OptionsCacheProto OptionsCache::toProtobuf() const {
+  materializeAll();
   OptionsCacheProto buf;
   auto* entriesBuf = buf.mutable_entries();
   entriesBuf->Reserve(entries_.size());
@@ -600,6 +980,9 @@ OptionsCacheEntryProto OptionsCache::CachedEntry::toProtobuf() const {
 
   buf.set_device_str(key.deviceStr);
   buf.set_git_version(key.gitVersion);
+  if (not key.deviceArch.empty()) {
+    buf.set_device_arch(key.deviceArch);
+  }
 
   std::transform(
       values.begin(),
@@ -612,12 +995,16 @@ OptionsCacheEntryProto OptionsCache::CachedEntry::toProtobuf() const {
           buf.add_recorded_runtimes(
               std::chrono::duration_cast<std::chrono::microseconds>(r).count());
         }
+        if (not v.metrics.empty()) {
+          *buf.mutable_metrics() = v.metrics.toProtobuf();
+        }
         return buf;
       });
   return buf;
 }
 
 CudaCacheProto CudaCache::toProtobuf() const {
+  materializeAll();
   CudaCacheProto buf;
   auto* entriesBuf = buf.mutable_entries();
   entriesBuf->Reserve(entries_.size());
@@ -651,6 +1038,20 @@ CudaCacheEntryProto CudaCache::CachedEntry::toProtobuf() const {
   *buf.mutable_block_dims() = values.block.view.proto;
   buf.set_specialized_name(values.kernelSpecializedName);
   WriteProtobufArray(values.kernelParameters, buf.mutable_parameters());
+  buf.set_dynamic_shared_memory(values.dynamicSharedMemory);
+  for (const auto& kvp : values.ptx) {
+    auto ptxBuf = buf.add_ptx();
+    ptxBuf->set_architecture(kvp.first);
+    ptxBuf->set_ptx(kvp.second);
+  }
+  for (const auto& kvp : values.attributes) {
+    auto attributesBuf = buf.add_attributes();
+    attributesBuf->set_architecture(kvp.first);
+    attributesBuf->set_num_registers(kvp.second.numRegisters);
+    attributesBuf->set_local_bytes(kvp.second.localBytes);
+    attributesBuf->set_static_shared_bytes(kvp.second.staticSharedBytes);
+    attributesBuf->set_max_threads_per_block(kvp.second.maxThreadsPerBlock);
+  }
 
   return buf;
 }
@@ -685,7 +1086,105 @@ std::unique_ptr<CudaCache::RetrievalResult> ManualCudaCache::retrieveKernel(
                                      entry->values.kernelSpecializedName,
                                      entry->values.kernelParameters,
                                      entry->values.grid,
-                                     entry->values.block});
+                                     entry->values.block,
+                                     std::string(),
+                                     0,
+                                     std::string()});
+}
+
+CudaKernelTemplate::Values CudaKernelTemplate::makeValues(
+    const CudaMappingOptions& options,
+    const std::map<std::string, int>& sizeParameters) {
+  Values res(sizeParameters.begin(), sizeParameters.end());
+  auto tiles = options.generic.tiling.extractVector();
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    res["tile" + std::to_string(i)] = tiles[i];
+  }
+  const auto& generic = options.generic.proto;
+  res["unroll"] = generic.has_unroll() ? generic.unroll() : 1;
+  auto block = options.block.extractDefaultedArray();
+  auto grid = options.grid.extractDefaultedArray();
+  for (size_t i = 0; i < block.size(); ++i) {
+    res["block" + std::to_string(i)] = block[i];
+    res["grid" + std::to_string(i)] = grid[i];
+  }
+  return res;
+}
+
+std::string CudaKernelTemplate::instantiate(
+    const std::string& text,
+    const Values& values) {
+  std::string res;
+  size_t pos = 0;
+  while (true) {
+    auto start = text.find("${", pos);
+    if (start == std::string::npos) {
+      return res + text.substr(pos);
+    }
+    auto end = text.find('}', start);
+    if (end == std::string::npos) {
+      throw std::invalid_argument("unterminated ${ in kernel template");
+    }
+    auto name = text.substr(start + 2, end - start - 2);
+    auto it = values.find(name);
+    if (it == values.end()) {
+      throw std::invalid_argument(
+          "no value for ${" + name + "} in kernel template");
+    }
+    res += text.substr(pos, start - pos) + std::to_string(it->second);
+    pos = end + 1;
+  }
+}
+
+void ManualCudaCache::registerTemplate(
+    const std::string& id,
+    const CudaKernelTemplate& kernelTemplate) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  templates_[id] = kernelTemplate;
+}
+
+bool ManualCudaCache::hasTemplate(const std::string& id) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return templates_.count(id) > 0;
+}
+
+void ManualCudaCache::clearTemplates() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  templates_.clear();
+}
+
+std::unique_ptr<CudaCache::RetrievalResult>
+ManualCudaCache::retrieveTemplateKernel(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::map<std::string, int>& sizeParameters,
+    bool& valid) const {
+  CudaKernelTemplate kernelTemplate;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = templates_.find(id);
+    if (it == templates_.end()) {
+      return nullptr;
+    }
+    kernelTemplate = it->second;
+  }
+  auto values = CudaKernelTemplate::makeValues(options, sizeParameters);
+  valid = not kernelTemplate.isValid or kernelTemplate.isValid(values);
+  if (not valid) {
+    return std::unique_ptr<CudaCache::RetrievalResult>(
+        new CudaCache::RetrievalResult());
+  }
+  return std::unique_ptr<CudaCache::RetrievalResult>(
+      new CudaCache::RetrievalResult{
+          CudaKernelTemplate::instantiate(kernelTemplate.source, values),
+          CudaKernelTemplate::instantiate(kernelTemplate.kernelName, values),
+          {},
+          kernelTemplate.grid ? kernelTemplate.grid(values)
+                              : Grid(options.grid),
+          Block(options.block),
+          std::string(),
+          0,
+          std::string()});
 }
 
 ManualCudaCache::CachedEntry* ManualCudaCache::searchKernel(
@@ -720,6 +1219,8 @@ void ManualCudaCache::cacheKernel(
     entry->values.cudaSource = cudaSource;
     entry->values.kernelSpecializedName = kernelSpecializedName;
     entry->values.kernelParameters = kernelParameters;
+    markDirty(entry);
+    syncSharedFile();
     return;
   }
 
@@ -733,7 +1234,19 @@ void ManualCudaCache::cacheKernel(
       outputs,
       cudaSource,
       CudaGPUInfo::GPUInfo().GetCudaDeviceStr());
+  indexLastEntry();
+  syncSharedFile();
+}
+
+size_t ManualCudaCache::hashKey(const CachedEntry::Key& key) {
+  return detail::hashCacheKey(key.id, key.inputs, key.outputs, key.deviceStr);
+}
+
+bool ManualCudaCache::CachedEntry::Key::operator==(const Key& other) const {
+  return id == other.id && inputs == other.inputs &&
+      outputs == other.outputs && deviceStr == other.deviceStr;
 }
+
 ManualCudaCache::CachedEntry::CachedEntry(
     const std::string& id,
     const std::string& kernelSpecializedName,
@@ -745,11 +1258,198 @@ ManualCudaCache::CachedEntry::CachedEntry(
     const std::string& cudaSource,
     const std::string& deviceStr)
     : key{id,
-          DLTensorToTensorInfoVector(inputs),
-          DLTensorToTensorInfoVector(outputs),
+          detail::DLTensorToTensorInfoVector(inputs),
+          detail::DLTensorToTensorInfoVector(outputs),
           deviceStr,
           git_version},
       values{cudaSource, kernelSpecializedName, kernelParameters, grid, block} {
 }
 
+CudaKernelBundle::CudaKernelBundle(const CudaKernelBundleProto& buf) {
+  entries_.reserve(buf.entries_size());
+  for (const auto& entry_buf : buf.entries())
+    entries_.emplace_back(entry_buf);
+  rebuildIndex();
+}
+
+CudaKernelBundleProto CudaKernelBundle::toProtobuf() const {
+  materializeAll();
+  CudaKernelBundleProto buf;
+  auto* entriesBuf = buf.mutable_entries();
+  entriesBuf->Reserve(entries_.size());
+  std::transform(
+      entries_.begin(),
+      entries_.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(entriesBuf),
+      [](const CachedEntry& entry) { return entry.toProtobuf(); });
+  return buf;
+}
+
+std::unique_ptr<CudaCache::RetrievalResult> CudaKernelBundle::retrieveKernel(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberAttemptedRetrievals;
+  auto entry = searchKernel(id, inputs, outputs);
+  if (not entry) {
+    return nullptr;
+  }
+  ++numberSuccessfulRetrievals;
+  auto cubin = entry->values.cubins.find(
+      CudaRTCFunction::CurrentDeviceRealArchitecture());
+  return std::unique_ptr<CudaCache::RetrievalResult>(
+      new CudaCache::RetrievalResult{
+          entry->values.cudaSource,
+          entry->values.kernelSpecializedName,
+          entry->values.kernelParameters,
+          entry->values.grid,
+          entry->values.block,
+          std::string(),
+          entry->values.dynamicSharedMemory,
+          cubin != entry->values.cubins.end() ? cubin->second
+                                              : std::string()});
+}
+
+CudaKernelBundle::CachedEntry* CudaKernelBundle::searchKernel(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) {
+  return searchKernelImpl(*this, id, inputs, outputs);
+}
+
+const CudaKernelBundle::CachedEntry* CudaKernelBundle::searchKernel(
+    const std::string& id,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) const {
+  return searchKernelImpl(*this, id, inputs, outputs);
+}
+
+void CudaKernelBundle::cacheKernel(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const std::string& kernelSpecializedName,
+    const std::vector<int>& kernelParameters,
+    const std::string& cudaSource,
+    const Grid& grid,
+    const Block& block,
+    size_t dynamicSharedMemory,
+    const std::map<std::string, std::string>& cubins) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++numberCacheAttemps;
+  auto entry = searchKernel(id, inputs, outputs);
+  if (entry) {
+    entry->values = CachedEntry::Values{options,
+                                        cudaSource,
+                                        kernelSpecializedName,
+                                        kernelParameters,
+                                        grid,
+                                        block,
+                                        dynamicSharedMemory,
+                                        cubins};
+    markDirty(entry);
+    syncSharedFile();
+    return;
+  }
+
+  entries_.emplace_back(
+      id,
+      kernelSpecializedName,
+      kernelParameters,
+      grid,
+      block,
+      options,
+      inputs,
+      outputs,
+      cudaSource,
+      dynamicSharedMemory,
+      cubins);
+  indexLastEntry();
+  syncSharedFile();
+}
+
+size_t CudaKernelBundle::hashKey(const CachedEntry::Key& key) {
+  return detail::hashCacheKey(key.id, key.inputs, key.outputs, std::string());
+}
+
+bool CudaKernelBundle::CachedEntry::Key::operator==(const Key& other) const {
+  return id == other.id && inputs == other.inputs && outputs == other.outputs;
+}
+
+CudaKernelBundle::CachedEntry::CachedEntry(
+    const std::string& id,
+    const std::string& kernelSpecializedName,
+    const std::vector<int>& kernelParameters,
+    const Grid& grid,
+    const Block& block,
+    const CudaMappingOptions& mappingOptions,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const std::string& cudaSource,
+    size_t dynamicSharedMemory,
+    const std::map<std::string, std::string>& cubins)
+    : key{id,
+          detail::DLTensorToTensorInfoVector(inputs),
+          detail::DLTensorToTensorInfoVector(outputs),
+          git_version},
+      values{mappingOptions,
+             cudaSource,
+             kernelSpecializedName,
+             kernelParameters,
+             grid,
+             block,
+             dynamicSharedMemory,
+             cubins} {}
+
+CudaKernelBundle::CachedEntry::CachedEntry(
+    const CudaKernelBundleEntryProto& buf)
+    : key{buf.id(),
+          detail::ProtoToTensorInfoVector(buf.inputs()),
+          detail::ProtoToTensorInfoVector(buf.outputs()),
+          buf.git_version()},
+      values{CudaMappingOptions{buf.kernel_options()},
+             buf.cuda_source(),
+             buf.specialized_name(),
+             std::vector<int>{buf.parameters().begin(), buf.parameters().end()},
+             Grid(buf.grid_dims()),
+             Block(buf.block_dims()),
+             buf.dynamic_shared_memory(),
+             {}} {
+  for (const auto& cubin : buf.cubins()) {
+    values.cubins[cubin.architecture()] = cubin.cubin();
+  }
+}
+
+CudaKernelBundleEntryProto CudaKernelBundle::CachedEntry::toProtobuf() const {
+  CudaKernelBundleEntryProto buf;
+  buf.set_id(key.id);
+  *buf.mutable_kernel_options() = values.mappingOptions.proto();
+  std::transform(
+      key.inputs.begin(),
+      key.inputs.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(buf.mutable_inputs()),
+      [](const detail::TensorInfo& input) { return input.toProtobuf(); });
+  std::transform(
+      key.outputs.begin(),
+      key.outputs.end(),
+      google::protobuf::RepeatedPtrFieldBackInserter(buf.mutable_outputs()),
+      [](const detail::TensorInfo& output) { return output.toProtobuf(); });
+  buf.set_git_version(key.gitVersion);
+
+  buf.set_cuda_source(values.cudaSource);
+  buf.set_specialized_name(values.kernelSpecializedName);
+  WriteProtobufArray(values.kernelParameters, buf.mutable_parameters());
+  *buf.mutable_grid_dims() = values.grid.view.proto;
+  *buf.mutable_block_dims() = values.block.view.proto;
+  buf.set_dynamic_shared_memory(values.dynamicSharedMemory);
+  for (const auto& kvp : values.cubins) {
+    auto cubinBuf = buf.add_cubins();
+    cubinBuf->set_architecture(kvp.first);
+    cubinBuf->set_cubin(kvp.second);
+  }
+  return buf;
+}
+
 } // namespace tc
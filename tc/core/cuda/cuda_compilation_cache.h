@@ -15,18 +15,26 @@
  */
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <dlpack/dlpack.h>
 
 #include <compcache.pb.h>
 
+#include "tc/core/compilation_cache.h"
 #include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_kernel_metrics.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/cuda/cuda_rtc.h"
 #include "tc/core/utils/time.h"
@@ -34,60 +42,15 @@
 namespace tc {
 
 namespace detail {
-/**
- * TensorInfo wraps the necessary bits of DLTensor that are used as part of the
- * CompilationCache's entry keys.
- *
- * It is serializable to protobuf and stored directly in the cache.
- */
-struct TensorInfo {
-  std::vector<int64_t> shape;
-  std::vector<int64_t> strides;
-  uint64_t alignment;
-  DLDataType dType;
-
-  TensorInfo(const DLTensor* t);
-  TensorInfo(const TensorInfoProto& buf);
-
-  bool operator==(const DLTensor* t) const;
-  bool operator==(const TensorInfo& t) const;
-  bool operator<(const TensorInfo& t) const;
-  TensorInfoProto toProtobuf() const;
-};
+template <typename TensorTy>
+size_t hashCacheKey(
+    const std::string& id,
+    const CudaMappingOptions& options,
+    const std::vector<TensorTy>& inputs,
+    const std::vector<TensorTy>& outputs,
+    const std::string& deviceStr);
 } // namespace detail
 
-template <typename CC>
-class Cache {
- public:
-  static void enableCache();
-  static void disableCache();
-  static void dumpCacheToProtobuf(const std::string& filename);
-  static void loadCacheFromProtobuf(const std::string& filename);
-  template <typename Protobuf>
-  static void loadCacheFromProtobuf(const Protobuf& buf);
-  static std::shared_ptr<CC> getCache();
-  static bool cacheEnabled();
-
-  size_t size() const;
-  void clear();
-
-  mutable int numberAttemptedRetrievals = 0;
-  mutable int numberSuccessfulRetrievals = 0;
-  mutable int numberCacheAttemps = 0;
-
- protected:
-  // XXX:this should be a std or boost shared_mutex
-  mutable std::mutex mtx_;
-};
-
-class CacheEntrySameKeyDifferentValue : public std::invalid_argument {
- public:
-  explicit CacheEntrySameKeyDifferentValue(const std::string& what_arg)
-      : invalid_argument(what_arg) {}
-  explicit CacheEntrySameKeyDifferentValue(const char* what_arg)
-      : invalid_argument(what_arg) {}
-};
-
 class OptionsCache;
 /**
  * CudaCache stores the Cuda source of optimized kernels
@@ -96,6 +59,7 @@ class CudaCache : public Cache<CudaCache> {
  private:
   friend class Cache<CudaCache>;
   using Protobuf = CudaCacheProto;
+  using EntryProtobuf = CudaCacheEntryProto;
   static std::shared_ptr<CudaCache>& getGlobalSharedCache();
 
  public:
@@ -105,6 +69,16 @@ class CudaCache : public Cache<CudaCache> {
     std::vector<int> parameters;
     Grid grid;
     Block block;
+    // PTX for the current device's architecture, empty if none was cached.
+    std::string ptx;
+    size_t dynamicSharedMemory;
+    // Cubin for the current device's real architecture, only set by
+    // CudaKernelBundle.
+    std::string cubin;
+    // Whether attributes were cached for the current device's real
+    // architecture.
+    bool hasAttributes;
+    CudaKernelAttributes attributes;
   };
 
   /**
@@ -114,7 +88,11 @@ class CudaCache : public Cache<CudaCache> {
    *                  the specialized (wrt inputs) Cuda source code,
    *                  the kernel's specialized name,
    *                  the kernel parameters,
-   *                  the Cuda block and grid dimensions
+   *                  the Cuda block and grid dimensions,
+   *                  the dynamic shared memory size,
+   *                  optionally, the PTX per virtual architecture
+   *                  optionally, the kernel attributes per real
+   *                  architecture
    * The key is:
    *                  the kernel/op's unique id (string),
    *                  the specialized input dimensions,
@@ -133,7 +111,8 @@ class CudaCache : public Cache<CudaCache> {
         const std::vector<const DLTensor*>& inputs,
         const std::vector<const DLTensor*>& outputs,
         const std::string& cudaSource,
-        const std::string& deviceStr);
+        const std::string& deviceStr,
+        size_t dynamicSharedMemory);
 
     CachedEntry(const CudaCacheEntryProto& buf);
     CudaCacheEntryProto toProtobuf() const;
@@ -145,6 +124,10 @@ class CudaCache : public Cache<CudaCache> {
       std::vector<detail::TensorInfo> outputs;
       std::string deviceStr;
       std::string gitVersion;
+
+      // Compares the fields that lookups compare, the git version is left
+      // out.
+      bool operator==(const Key& other) const;
     };
 
     struct Values {
@@ -153,13 +136,40 @@ class CudaCache : public Cache<CudaCache> {
       std::vector<int> kernelParameters;
       Grid grid;
       Block block;
+      // architecture (e.g. compute_70) -> PTX
+      std::map<std::string, std::string> ptx;
+      size_t dynamicSharedMemory;
+      // architecture (e.g. sm_70) -> attributes
+      std::map<std::string, CudaKernelAttributes> attributes;
     };
     Key key;
     Values values;
+    // Value of CudaCache::useCounter_ when the entry was last stored or
+    // retrieved.
+    mutable uint64_t lastUsed = 0;
   };
 
  private:
-  std::vector<CachedEntry> entries_;
+  // mutable because lookups parse the entries of the backing file lazily
+  mutable std::vector<CachedEntry> entries_;
+
+  static size_t hashKey(const CachedEntry::Key& key);
+  // Kernels with the same key may only differ by the PTX and the attributes
+  // they hold.
+  static void mergeRecord(CachedEntry& entry, CachedEntry&& record);
+
+  // Bytes of source, PTX and launch information held by entry.
+  static size_t entryBytes(const CachedEntry& entry);
+  /**
+   * Evicts the least recently used entries while the cache holds more than
+   * FLAGS_cuda_cache_max_entries entries or FLAGS_cuda_cache_max_bytes
+   * bytes.  Entries not saved to the backing file yet are never evicted,
+   * the others stay in the file but are only found again once the cache is
+   * reloaded, or fetched again from the backend if any.
+   */
+  void evictIfNeeded();
+
+  mutable uint64_t useCounter_ = 0;
 
   /**
    * SearchKernel (through SearchKernelImpl) searches op in the cache
@@ -202,7 +212,8 @@ class CudaCache : public Cache<CudaCache> {
   /**
    * If op was previously cached and the inputs' shape, isl options, and the
    * target device are the same then this is a noop
-   * Else (cudaSource, grid, block) is stored in the cache
+   * Else (cudaSource, grid, block, dynamicSharedMemory) is stored in the
+   * cache
    */
   void cacheKernel(
       const std::string& id,
@@ -213,7 +224,34 @@ class CudaCache : public Cache<CudaCache> {
       const std::vector<int>& kernelParameters,
       const std::string& cudaSource,
       const Grid& grid,
-      const Block& block);
+      const Block& block,
+      size_t dynamicSharedMemory = 0);
+
+  /**
+   * Stores the PTX generated for architecture alongside a previously cached
+   * kernel so that later processes can skip NVRTC.  Replaces PTX previously
+   * stored for the same architecture.  Noop if no kernel matches.
+   */
+  void cacheKernelPtx(
+      const std::string& id,
+      const CudaMappingOptions& options,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      const std::string& architecture,
+      const std::string& ptx);
+
+  /**
+   * Stores the attributes the driver reported for a previously cached
+   * kernel loaded on a device of the real architecture, so that later
+   * processes know them without loading it.  Noop if no kernel matches.
+   */
+  void cacheKernelAttributes(
+      const std::string& id,
+      const CudaMappingOptions& options,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      const std::string& architecture,
+      const CudaKernelAttributes& attributes);
 
   /**
    * Returns the cache entry that matches op (id, isl options, target device)
@@ -231,6 +269,7 @@ class CudaCache : public Cache<CudaCache> {
 class OptionsCache : public Cache<OptionsCache> {
   friend class Cache<OptionsCache>;
   using Protobuf = OptionsCacheProto;
+  using EntryProtobuf = OptionsCacheEntryProto;
   static std::shared_ptr<OptionsCache>& getGlobalSharedCache();
 
  public:
@@ -242,6 +281,9 @@ class OptionsCache : public Cache<OptionsCache> {
    *                  the specialized input dimensions,
    *                  the target architecture (string),
    *                  tc's version (string),
+   * The compute capability of the device is stored alongside the key but is
+   * not part of it, retrievals fall back to entries of other devices with
+   * the same compute capability when the device itself has none.
    * The values are a vector of:
    *                  the isl options used when the kernel was optimized,
    *                  profiling information
@@ -252,6 +294,7 @@ class OptionsCache : public Cache<OptionsCache> {
         const std::vector<const DLTensor*>& inputs,
         const std::vector<const DLTensor*>& outputs,
         const std::string& deviceStr,
+        const std::string& deviceArch,
         const CudaMappingOptions& options,
         Duration runtime);
     CachedEntry(const OptionsCacheEntryProto& buf);
@@ -275,6 +318,13 @@ class OptionsCache : public Cache<OptionsCache> {
       std::vector<detail::TensorInfo> outputs;
       std::string deviceStr;
       std::string gitVersion;
+      // CudaRTCFunction::CurrentDeviceArchitecture() of deviceStr, empty for
+      // entries written by older versions. Not compared by lookups.
+      std::string deviceArch;
+
+      // Compares the fields that lookups compare, the git version is left
+      // out.
+      bool operator==(const Key& other) const;
     };
 
     struct Values {
@@ -284,13 +334,30 @@ class OptionsCache : public Cache<OptionsCache> {
           std::vector<Duration>&& runtimes);
       CudaMappingOptions mappingOptions;
       std::vector<Duration> recordedRuntimes;
+      // The first savedRuntimes recorded runtimes were loaded from, or
+      // written to, the backing file.
+      size_t savedRuntimes;
+      // The last ones recorded, written to the backing file along with the
+      // runtimes.
+      KernelMetrics metrics;
     };
     Key key;
     std::vector<Values> values;
   };
 
  private:
-  std::vector<CachedEntry> entries_;
+  // mutable because lookups parse the entries of the backing file lazily
+  mutable std::vector<CachedEntry> entries_;
+
+  static size_t hashKey(const CachedEntry::Key& key);
+  // Records hold the runtimes recorded since the previous record of the same
+  // key, they add up.
+  static void mergeRecord(CachedEntry& entry, CachedEntry&& record);
+  static bool unsavedProtobuf(
+      const CachedEntry& entry,
+      OptionsCacheEntryProto& buf);
+  static void markSaved(CachedEntry& entry);
+  static bool dropSaved(CachedEntry& entry);
 
   /**
    * SearchKernel (through SearchKernelImpl) searches op in the cache
@@ -317,6 +384,26 @@ class OptionsCache : public Cache<OptionsCache> {
       const std::vector<const DLTensor*>& outputs)
       -> decltype(c.searchKernel(id, inputs, outputs));
 
+ public:
+  // Which device the options returned by a retrieval were tuned on.
+  enum class DeviceMatch {
+    // the current device
+    Exact,
+    // another device with the same compute capability
+    SameArchitecture,
+  };
+
+ private:
+  // Searches the entry of the current device first, then the entries of
+  // other devices with the same compute capability (the one with the most
+  // recorded runtimes wins). The second tier parses the whole backing file
+  // and scans all entries, it only runs when the first misses.
+  const CachedEntry* searchKernelOnAnyDevice(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      DeviceMatch* match) const;
+
  public:
   OptionsCache() = default;
   OptionsCache(const OptionsCacheProto& buf);
@@ -328,6 +415,7 @@ class OptionsCache : public Cache<OptionsCache> {
   struct RetrievalResult {
     CudaMappingOptions options;
     std::vector<Duration> recordedRuntimes;
+    DeviceMatch deviceMatch;
   };
 
   // returns the sum of cache entry sizes (that is a single cache entry can have
@@ -341,25 +429,125 @@ class OptionsCache : public Cache<OptionsCache> {
       const std::vector<const DLTensor*>& outputs,
       Duration runtime);
 
+  // Attaches the hardware counters to options whose runtimes are recorded,
+  // replacing the previous ones; dropped if no runtime is recorded.  When
+  // the cache is shared through a file, they are appended with the next
+  // runtimes of the options or written when the file is rewritten.
+  void recordMetrics(
+      const std::string& id,
+      const CudaMappingOptions& options,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      const KernelMetrics& metrics);
+
   std::vector<RetrievalResult> retrieveOptionsAndRuntimes(
       const std::string& id,
       const std::vector<const DLTensor*>& inputs,
       const std::vector<const DLTensor*>& outputs) const;
 
+  // If match is not null it is set to the tier that matched when options are
+  // returned.
   std::unique_ptr<CudaMappingOptions> retrieveBestOptions(
       const std::string& id,
       const std::vector<const DLTensor*>& inputs,
-      const std::vector<const DLTensor*>& outputs) const;
+      const std::vector<const DLTensor*>& outputs,
+      DeviceMatch* match = nullptr) const;
 
   std::vector<CudaMappingOptions> retrieveTopKOptions(
       const std::string& id,
       const std::vector<const DLTensor*>& inputs,
       const std::vector<const DLTensor*>& outputs,
-      size_t k) const;
+      size_t k,
+      DeviceMatch* match = nullptr) const;
+
+  /**
+   * Similarity-based retrieval for shapes that were never tuned: considers
+   * the entries with the same id, number of tensors, data types and ranks,
+   * recorded on the current device or (if sameArchitecture) on a device with
+   * the same compute capability. Their distance to the query is the sum over
+   * all dimensions of |log2(size / querySize)|, 0 for an exact match.
+   * Returns the optionsPerEntry best options of each of the numberEntries
+   * nearest entries, nearest first and then fastest first.
+   */
+  struct NearestShapeQuery {
+    size_t numberEntries = 1;
+    size_t optionsPerEntry = 1;
+    // entries further away are ignored
+    double maxDistance = std::numeric_limits<double>::infinity();
+    bool sameArchitecture = true;
+  };
+  struct NearestShapeResult {
+    CudaMappingOptions options;
+    Duration medianRuntime;
+    double distance;
+  };
+  std::vector<NearestShapeResult> retrieveNearestShapeOptions(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      const NearestShapeQuery& query) const;
+
+  /**
+   * All the options recorded for id on the current device or on devices with
+   * the same compute capability, whatever the shapes, along with the input
+   * shapes they ran on, e.g. to fit a cost model.  Options without recorded
+   * runtimes are left out.
+   */
+  struct TuningSample {
+    std::vector<detail::TensorInfo> inputs;
+    CudaMappingOptions options;
+    Duration medianRuntime;
+    // Empty unless recorded by recordMetrics.
+    KernelMetrics metrics;
+  };
+  std::vector<TuningSample> retrieveTuningSamples(const std::string& id) const;
 
   // Only (up to) numberToKeep entries per operation (combination of id and
   // input info) are kept in the cache. The best performing versions are kept
   void keepOnlyBestCandidates(size_t numberToKeep);
+
+  /**
+   * Merges the entries of buf, e.g. a cache tuned by another process, into
+   * the cache.  The values of the same options of entries with the same key
+   * are merged, their runtimes add up and the last metrics recorded win.
+   * If gitVersion is not empty, the entries of buf recorded by another
+   * version are skipped.  Returns the number of entries merged.
+   */
+  size_t merge(
+      const OptionsCacheProto& buf,
+      const std::string& gitVersion = std::string());
+};
+
+/*
+ * A hand-written Cuda kernel instantiated for the values of the mapping
+ * options, see ManualCudaCache::registerTemplate.  Each "${name}" of the
+ * source and of the kernel name is replaced by the value of name:
+ *   a size parameter of the TC (e.g. "N" for "float(N) A"),
+ *   "tile<i>" for the i-th tile size of the options,
+ *   "unroll" for the unroll factor (1 if the options do not unroll),
+ *   "block<i>" and "grid<i>" for the i-th block and grid sizes (1 if unset).
+ * The kernel takes the outputs and then the inputs of the TC, like a kernel
+ * of the ManualCudaCache, and is launched with the block of the options.
+ * The tuner searches these values like for the mapper, the options that
+ * the template does not read only add duplicate kernels to the search.
+ */
+struct CudaKernelTemplate {
+  using Values = std::map<std::string, int64_t>;
+
+  std::string kernelName;
+  std::string source;
+  // Whether the values make a valid kernel, compilations with invalid
+  // values are pruned.  All values are valid if unset.
+  std::function<bool(const Values&)> isValid;
+  // The grid of the kernel, that of the options if unset.
+  std::function<Grid(const Values&)> grid;
+
+  static Values makeValues(
+      const CudaMappingOptions& options,
+      const std::map<std::string, int>& sizeParameters);
+  // Replaces the "${name}" of text, throws std::invalid_argument if a name
+  // has no value.
+  static std::string instantiate(const std::string& text, const Values&);
 };
 
 /*
@@ -369,6 +557,7 @@ class ManualCudaCache : public Cache<ManualCudaCache> {
  private:
   friend class Cache<ManualCudaCache>;
   using Protobuf = ManualCudaCacheProto;
+  using EntryProtobuf = ManualCudaCacheEntryProto;
   static std::shared_ptr<ManualCudaCache>& getGlobalSharedCache();
 
  public:
@@ -405,6 +594,10 @@ class ManualCudaCache : public Cache<ManualCudaCache> {
       std::vector<detail::TensorInfo> outputs;
       std::string deviceStr;
       std::string gitVersion;
+
+      // Compares the fields that lookups compare, the git version is left
+      // out.
+      bool operator==(const Key& other) const;
     };
 
     struct Values {
@@ -419,7 +612,10 @@ class ManualCudaCache : public Cache<ManualCudaCache> {
   };
 
  private:
-  std::vector<CachedEntry> entries_;
+  // mutable because lookups parse the entries of the backing file lazily
+  mutable std::vector<CachedEntry> entries_;
+
+  static size_t hashKey(const CachedEntry::Key& key);
 
   /*
    *SearchKernel (through SearchKernelImpl) searches op in the cache
@@ -477,16 +673,167 @@ class ManualCudaCache : public Cache<ManualCudaCache> {
       const std::string& id,
       const std::vector<const DLTensor*>& inputs,
       const std::vector<const DLTensor*>& outputs) const;
+
+  /*
+   *Registers kernelTemplate for the TC named id, replacing the previous
+   *one.  It serves the sizes that have no entry of their own.  Templates
+   *hold code, they are kept in memory only and neither serialized nor
+   *cleared with the entries.
+   */
+  void registerTemplate(
+      const std::string& id,
+      const CudaKernelTemplate& kernelTemplate);
+  bool hasTemplate(const std::string& id) const;
+  void clearTemplates();
+
+  /*
+   *Instantiates the template of the TC named id for options and the
+   *values of the size parameters of the TC.  Returns nullptr if id has no
+   *template, sets valid to whether the template accepts the values.
+   */
+  std::unique_ptr<CudaCache::RetrievalResult> retrieveTemplateKernel(
+      const std::string& id,
+      const CudaMappingOptions& options,
+      const std::map<std::string, int>& sizeParameters,
+      bool& valid) const;
+
+ private:
+  std::unordered_map<std::string, CudaKernelTemplate> templates_;
+};
+
+/*
+ * CudaKernelBundle stores kernels compiled ahead of time, see
+ * compileKernelBundle: the Cuda source, launch information and cubins for a
+ * list of real architectures.  CudaTcExecutor::compile uses a kernel of the
+ * bundle before any other cache and, if it holds a cubin for the current
+ * device, neither runs the mapper nor NVRTC.
+ */
+class CudaKernelBundle : public Cache<CudaKernelBundle> {
+ private:
+  friend class Cache<CudaKernelBundle>;
+  using Protobuf = CudaKernelBundleProto;
+  using EntryProtobuf = CudaKernelBundleEntryProto;
+  static std::shared_ptr<CudaKernelBundle>& getGlobalSharedCache();
+
+ public:
+  /*
+   * The values are:
+   *                  the specialized (wrt inputs) Cuda source code,
+   *                  the kernel's specialized name,
+   *                  the kernel parameters,
+   *                  the Cuda block and grid dimensions,
+   *                  the dynamic shared memory size,
+   *                  the cubin per real architecture
+   * The key is:
+   *                  the kernel/op's unique id (string),
+   *                  the specialized input and output dimensions,
+   *                  tc's version (string),
+   * The options the kernel was mapped with are kept for reference only.
+   */
+  struct CachedEntry {
+    CachedEntry(
+        const std::string& id,
+        const std::string& kernelSpecializedName,
+        const std::vector<int>& kernelParameters,
+        const Grid& grid,
+        const Block& block,
+        const CudaMappingOptions& mappingOptions,
+        const std::vector<const DLTensor*>& inputs,
+        const std::vector<const DLTensor*>& outputs,
+        const std::string& cudaSource,
+        size_t dynamicSharedMemory,
+        const std::map<std::string, std::string>& cubins);
+
+    CachedEntry(const CudaKernelBundleEntryProto& buf);
+    CudaKernelBundleEntryProto toProtobuf() const;
+
+    struct Key {
+      std::string id;
+      std::vector<detail::TensorInfo> inputs;
+      std::vector<detail::TensorInfo> outputs;
+      std::string gitVersion;
+
+      // Compares the fields that lookups compare, the git version is left
+      // out.
+      bool operator==(const Key& other) const;
+    };
+
+    struct Values {
+      CudaMappingOptions mappingOptions;
+      std::string cudaSource;
+      std::string kernelSpecializedName;
+      std::vector<int> kernelParameters;
+      Grid grid;
+      Block block;
+      size_t dynamicSharedMemory;
+      // real architecture (e.g. sm_70) -> cubin
+      std::map<std::string, std::string> cubins;
+    };
+    Key key;
+    Values values;
+  };
+
+ private:
+  // mutable because lookups parse the entries of the backing file lazily
+  mutable std::vector<CachedEntry> entries_;
+
+  static size_t hashKey(const CachedEntry::Key& key);
+
+  CachedEntry* searchKernel(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs);
+  const CachedEntry* searchKernel(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs) const;
+
+  // deduces whether C is const or non-const
+  template <typename C, typename TensorTy>
+  static auto searchKernelImpl(
+      C& c,
+      const std::string& id,
+      const std::vector<TensorTy>& inputs,
+      const std::vector<TensorTy>& outputs)
+      -> decltype(c.searchKernel(id, inputs, outputs));
+
+ public:
+  CudaKernelBundle() = default;
+  CudaKernelBundle(const CudaKernelBundleProto& buf);
+  CudaKernelBundleProto toProtobuf() const;
+
+  /*
+   * Stores the kernel with key (id, input shapes, output shapes).  If the
+   * key already exists in the bundle, the values are replaced.
+   */
+  void cacheKernel(
+      const std::string& id,
+      const CudaMappingOptions& options,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      const std::string& kernelSpecializedName,
+      const std::vector<int>& kernelParameters,
+      const std::string& cudaSource,
+      const Grid& grid,
+      const Block& block,
+      size_t dynamicSharedMemory,
+      const std::map<std::string, std::string>& cubins);
+
+  /*
+   * Returns the kernel that matches id and the inputs' and outputs' shapes,
+   * with the cubin for CudaRTCFunction::CurrentDeviceRealArchitecture() if
+   * the bundle holds one.
+   */
+  std::unique_ptr<CudaCache::RetrievalResult> retrieveKernel(
+      const std::string& id,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs) const;
 };
 
 void removeFromCudaCacheEntriesNotInOptionsCache(
     CudaCache& cc,
     const OptionsCache& oc);
 
-bool operator==(
-    const std::vector<const DLTensor*>& inputsTensor,
-    const std::vector<detail::TensorInfo>& inputsInfo);
-
 std::string makeOptionsFilename(const std::string& filename);
 
 std::string makeCudaFilename(const std::string& filename);
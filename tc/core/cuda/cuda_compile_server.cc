@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_compile_server.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "tc/core/compilation_cache.h"
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_rtc.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/socket.h"
+#include "tc/core/utils/thread_pool.h"
+#include "tc/lang/parse_cache.h"
+
+namespace tc {
+
+namespace {
+
+using socketutils::receiveMessage;
+using socketutils::sendMessage;
+using socketutils::throwErrno;
+
+// Replies hold the source, the PTX and the cubin of a kernel, anything
+// larger is a protocol error.
+constexpr uint32_t kMaxMessageSize = 256 << 20;
+
+// Closes the socket on destruction.
+class Socket {
+ public:
+  explicit Socket(int fd) : fd_(fd) {}
+  ~Socket() {
+    close(fd_);
+  }
+  Socket(const Socket&) = delete;
+  Socket& operator=(const Socket&) = delete;
+
+  int fd() const {
+    return fd_;
+  }
+
+ private:
+  const int fd_;
+};
+
+sockaddr_un unixAddress(const std::string& path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() or path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("invalid Unix socket path " + path);
+  }
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+// A device of the real architecture, e.g. sm_70.
+int deviceOfArchitecture(const std::string& architecture) {
+  const auto& info = CudaGPUInfo::GPUInfo();
+  for (int i = 0; i < info.NumberGPUs(); ++i) {
+    const auto& arch = info.DeviceProperties(i).architecture;
+    if ("sm_" + arch.substr(arch.find('_') + 1) == architecture) {
+      return i;
+    }
+  }
+  throw std::invalid_argument(
+      "the compile server has no device of architecture " + architecture);
+}
+
+void serveConnection(int fd, ThreadPool& pool) {
+  Socket socket(fd);
+  CudaCompileRequestProto request;
+  try {
+    while (receiveMessage(fd, request, kMaxMessageSize)) {
+      auto reply =
+          pool.submit([request]() { return compileKernelRequest(request); })
+              .get();
+      sendMessage(fd, reply, kMaxMessageSize);
+    }
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[COMPILE][SERVER] connection lost: " << e.what();
+  }
+}
+
+} // namespace
+
+CudaCompileReplyProto compileKernelRequest(
+    const CudaCompileRequestProto& request) {
+  CudaCompileReplyProto reply;
+  try {
+    auto defs = lang::parseCached(request.tc());
+    if (defs.size() != 1) {
+      throw std::invalid_argument("expected a single TC definition");
+    }
+    CudaMappingOptions options(request.options());
+    if (options.proto().split_kernels()) {
+      throw std::invalid_argument("split kernels are compiled by the client");
+    }
+    auto device = deviceOfArchitecture(request.architecture());
+    WithDevice wd(device);
+
+    std::vector<dlutils::DLTensorUPtr> inputs;
+    for (const auto& input : request.inputs()) {
+      inputs.push_back(detail::makeTensorMetadata(
+          input, dlutils::getGPUDLContext(device)));
+    }
+    CudaTcExecutor executor(
+        lang::Def(defs.front()).name().name(),
+        dlutils::extractRawPtrs(inputs),
+        options.toProtobufSerializedString(),
+        defs.front());
+    if (request.outputs_size() > 0) {
+      std::vector<dlutils::DLTensorUPtr> outputs;
+      for (const auto& output : request.outputs()) {
+        outputs.push_back(detail::makeTensorMetadata(
+            output, dlutils::getGPUDLContext(device)));
+      }
+      executor.specializeOutputStrides(dlutils::extractRawPtrs(outputs));
+    }
+    executor.compile(options);
+    if (executor.isLibraryCall()) {
+      throw std::invalid_argument("library calls are made by the client");
+    }
+    auto ptx = executor.ptx();
+    auto cubin = CudaRTCFunction::LinkCubin(
+        ptx, request.architecture(), makeCudaCompilerOptions(options));
+
+    reply.set_cuda_source(executor.cudaSource);
+    reply.set_specialized_name(executor.kernelSpecializedName);
+    for (auto p : executor.kernelParameters()) {
+      reply.add_parameters(p);
+    }
+    *reply.mutable_grid_dims() = executor.grid.view.proto;
+    *reply.mutable_block_dims() = executor.block.view.proto;
+    reply.set_dynamic_shared_memory(executor.dynamicSharedMemory);
+    reply.set_ptx(ptx);
+    reply.set_cubin(cubin);
+    executor.clearRuntimeCompiledFunction();
+  } catch (const std::exception& e) {
+    reply.Clear();
+    reply.set_error(e.what());
+  }
+  return reply;
+}
+
+std::unique_ptr<CudaCache::RetrievalResult> requestKernel(
+    const std::string& path,
+    const CudaCompileRequestProto& request) {
+  CudaCompileReplyProto reply;
+  try {
+    auto address = unixAddress(path);
+    Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (socket.fd() < 0) {
+      throwErrno("socket");
+    }
+    if (::connect(
+            socket.fd(),
+            reinterpret_cast<sockaddr*>(&address),
+            sizeof(address)) != 0) {
+      throwErrno("cannot connect to " + path);
+    }
+    sendMessage(socket.fd(), request, kMaxMessageSize);
+    if (not receiveMessage(socket.fd(), reply, kMaxMessageSize)) {
+      throw std::runtime_error("the server closed the connection");
+    }
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "[COMPILE] compile server " << path << ": " << e.what()
+                 << ", compiling in process";
+    return nullptr;
+  }
+  if (reply.has_error()) {
+    throw std::runtime_error("compile server: " + reply.error());
+  }
+  std::vector<int> parameters(
+      reply.parameters().begin(), reply.parameters().end());
+  return std::unique_ptr<CudaCache::RetrievalResult>(
+      new CudaCache::RetrievalResult{
+          reply.cuda_source(),
+          reply.specialized_name(),
+          parameters,
+          Grid(reply.grid_dims()),
+          Block(reply.block_dims()),
+          reply.ptx(),
+          reply.dynamic_shared_memory(),
+          reply.cubin(),
+          false,
+          CudaKernelAttributes()});
+}
+
+void runCudaCompileServer(const std::string& path, size_t numThreads) {
+  CHECK_GT(numThreads, 0u) << "A compile server needs compilation threads";
+  auto address = unixAddress(path);
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    throwErrno("socket");
+  }
+  // The socket of a previous server, nothing listens on it anymore.
+  unlink(path.c_str());
+  if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    throwErrno("bind to " + path);
+  }
+  if (listen(listenFd, SOMAXCONN) != 0) {
+    throwErrno("listen");
+  }
+  LOG(INFO) << "[COMPILE][SERVER] listening on " << path << " with "
+            << numThreads << " compilation thread(s)";
+
+  ThreadPool pool(numThreads);
+  for (;;) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR or errno == ECONNABORTED) {
+        continue;
+      }
+      throwErrno("accept");
+    }
+    std::thread([fd, &pool]() { serveConnection(fd, pool); }).detach();
+  }
+}
+
+} // namespace tc
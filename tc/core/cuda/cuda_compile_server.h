@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <compile_server.pb.h>
+
+#include "tc/core/cuda/cuda_compilation_cache.h"
+
+namespace tc {
+
+/**
+ * Out-of-process compilation for serving hosts: the serving processes of a
+ * host send the kernels they miss in their caches, as
+ * CudaCompileRequestProto, to a compile server listening on a Unix socket
+ * (see --cuda_compile_server and the tc_compile_server tool).  The server
+ * maps and compiles them with its own threads and caches and returns the
+ * source, the launch configuration, the PTX and a cubin for the device of
+ * the serving process, which only loads the cubin.  The mapper, NVRTC and
+ * their memory stay out of the serving processes, and the kernels compiled
+ * for one of them are in the server caches for the others.
+ */
+
+/// Compiles the kernel of request on a device of the requested architecture,
+/// through the caches of the process.  The errors are returned in the reply.
+CudaCompileReplyProto compileKernelRequest(
+    const CudaCompileRequestProto& request);
+
+/// The kernel of request compiled by the server listening on the Unix
+/// socket at path, as if retrieved from a cache for the current device.
+/// Null if the server cannot be reached, the errors of the compilation on
+/// the server throw std::runtime_error.
+std::unique_ptr<CudaCache::RetrievalResult> requestKernel(
+    const std::string& path,
+    const CudaCompileRequestProto& request);
+
+/// Serves the compile requests received on the Unix socket at path, this
+/// never returns.  A stale socket at path is removed.  Each connection is
+/// read by its own thread and the kernels are compiled by numThreads
+/// threads, in the order they were received.
+void runCudaCompileServer(const std::string& path, size_t numThreads);
+
+} // namespace tc
@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_cpu_dispatch.h"
+
+#include <chrono>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/dlpack.h"
+
+namespace tc {
+
+namespace {
+size_t numberElements(const DLTensor* t) {
+  size_t res = 1;
+  for (int i = 0; i < t->ndim; ++i) {
+    res *= t->shape[i];
+  }
+  return res;
+}
+
+std::vector<std::vector<int64_t>> sizesOf(
+    const std::vector<const DLTensor*>& tensors) {
+  std::vector<std::vector<int64_t>> res;
+  for (auto t : tensors) {
+    res.emplace_back(t->shape, t->shape + t->ndim);
+  }
+  return res;
+}
+
+// A host tensor of the sizes and type of t, holding its data in storage.
+DLTensorUPtr makeHostTensor(const DLTensor* t, std::vector<char>& storage) {
+  CHECK(dlutils::isPacked(*t)) << "expected packed tensors";
+  storage.resize(dlutils::numberBytes(*t));
+  auto res = dlutils::makeDLTensorWithSizes(
+      dlutils::getCPUDLContext(),
+      t->dtype,
+      std::vector<int64_t>(t->shape, t->shape + t->ndim));
+  res->data = storage.data();
+  return res;
+}
+} // namespace
+
+std::unique_ptr<CudaCpuDispatch> CudaCpuDispatch::make(
+    ExecutionEngine<CudaTcExecutor>& cudaEngine,
+    ExecutionEngine<CpuTcExecutor>& cpuEngine,
+    const std::string& name,
+    const CudaMappingOptions& cudaOptions,
+    const CpuMappingOptions& cpuOptions,
+    size_t cpuMaxElements,
+    size_t gpuMinElements,
+    size_t calibrationRuns) {
+  CHECK_LT(cpuMaxElements, gpuMinElements);
+  CHECK_GT(calibrationRuns, 0u);
+  return std::unique_ptr<CudaCpuDispatch>(new CudaCpuDispatch(
+      cudaEngine,
+      cpuEngine,
+      name,
+      cudaOptions,
+      cpuOptions,
+      cpuMaxElements,
+      gpuMinElements,
+      calibrationRuns));
+}
+
+size_t CudaCpuDispatch::cpuMaxElements() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cpuMaxElements_;
+}
+
+size_t CudaCpuDispatch::gpuMinElements() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return gpuMinElements_;
+}
+
+Duration CudaCpuDispatch::run(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream,
+    bool profile) {
+  size_t n = 0;
+  for (auto t : inputs) {
+    n += numberElements(t);
+  }
+  bool onCpu;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (n > cpuMaxElements_ and n < gpuMinElements_) {
+      onCpu = calibrate(inputs, outputs, stream);
+      if (onCpu) {
+        cpuMaxElements_ = n;
+      } else {
+        gpuMinElements_ = n;
+      }
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << name_ << " on " << n << " elements is faster on the "
+          << (onCpu ? "CPU" : "GPU") << ", running up to " << cpuMaxElements_
+          << " elements on the CPU and from " << gpuMinElements_
+          << " on the GPU";
+    } else {
+      onCpu = n <= cpuMaxElements_;
+    }
+  }
+  if (not onCpu) {
+    return runOnGpu(inputs, outputs, stream, profile);
+  }
+  auto res = runOnCpu(inputs, outputs, stream);
+  return profile ? res : Duration::max();
+}
+
+bool CudaCpuDispatch::calibrate(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream) {
+  // The first runs compile the kernels
+  runOnCpu(inputs, outputs, stream);
+  runOnGpu(inputs, outputs, stream, true);
+  auto cpuTime = Duration::zero();
+  auto gpuTime = Duration::zero();
+  for (size_t i = 0; i < calibrationRuns_; ++i) {
+    cpuTime += runOnCpu(inputs, outputs, stream);
+    auto start = std::chrono::high_resolution_clock::now();
+    runOnGpu(inputs, outputs, stream, false);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream));
+    gpuTime += std::chrono::duration_cast<Duration>(
+        std::chrono::high_resolution_clock::now() - start);
+  }
+  return cpuTime < gpuTime;
+}
+
+Duration CudaCpuDispatch::runOnCpu(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream) {
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::vector<char>> storage(inputs.size() + outputs.size());
+  std::vector<DLTensorUPtr> hostInputs, hostOutputs;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    hostInputs.push_back(makeHostTensor(inputs[i], storage[i]));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+        storage[i].data(),
+        dlutils::dataPtr(*inputs[i]),
+        storage[i].size(),
+        cudaMemcpyDeviceToHost,
+        stream));
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    hostOutputs.push_back(
+        makeHostTensor(outputs[i], storage[inputs.size() + i]));
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream));
+
+  std::vector<DLTensor*> hostOutputPtrs;
+  for (const auto& t : hostOutputs) {
+    hostOutputPtrs.push_back(t.get());
+  }
+  cpuEngine_.run(
+      name_, dlutils::extractRawPtrs(hostInputs), hostOutputPtrs, cpuOptions_);
+
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    const auto& data = storage[inputs.size() + i];
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+        dlutils::dataPtr(*outputs[i]),
+        data.data(),
+        data.size(),
+        cudaMemcpyHostToDevice,
+        stream));
+  }
+  // The host copies are released on return
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream));
+  return std::chrono::duration_cast<Duration>(
+      std::chrono::high_resolution_clock::now() - start);
+}
+
+Duration CudaCpuDispatch::runOnGpu(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream,
+    bool profile) {
+  size_t handle;
+  {
+    std::lock_guard<std::mutex> lock(handlesMutex_);
+    auto sizes = sizesOf(inputs);
+    auto it = cudaHandles_.find(sizes);
+    if (it == cudaHandles_.end()) {
+      it = cudaHandles_
+               .emplace(sizes, cudaEngine_.compile(name_, inputs, cudaOptions_))
+               .first;
+    }
+    handle = it->second;
+  }
+  auto res = cudaEngine_.run(
+      handle,
+      inputs,
+      outputs,
+      profile,
+      [](const CudaTcExecutor*) { return false; },
+      CudaRuntimeInformation(stream));
+  return profile ? res : Duration::max();
+}
+
+} // namespace tc
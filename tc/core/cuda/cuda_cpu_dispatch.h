@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+//
+// A TC on device tensors run either by a CUDA kernel or, for small sizes,
+// by a CPU kernel on host copies of the tensors.  On tiny sizes the launch
+// of a kernel and the synchronization with it take longer than copying the
+// tensors to the host and back around a CPU kernel.
+// The runs are routed by the total number of elements of the inputs: up
+// to cpuMaxElements they run on the CPU, from gpuMinElements on they run
+// on the GPU.  Sizes in between are calibrated on their first run, which
+// times both routes until the end of their copies or of their kernel, and
+// moves the bound on their side to their number of elements.  The bounds
+// are expected to be learned once per TC and device, they are passed to
+// make and read back with cpuMaxElements and gpuMinElements so that the
+// caller can keep them, e.g. along with its options cache files.
+//
+class CudaCpuDispatch {
+ public:
+  // The kernels are compiled on the first run of each size, by the engines
+  // of each route with the options of their backend.
+  static std::unique_ptr<CudaCpuDispatch> make(
+      ExecutionEngine<CudaTcExecutor>& cudaEngine,
+      ExecutionEngine<CpuTcExecutor>& cpuEngine,
+      const std::string& name,
+      const CudaMappingOptions& cudaOptions,
+      const CpuMappingOptions& cpuOptions,
+      size_t cpuMaxElements = 0,
+      size_t gpuMinElements = std::numeric_limits<size_t>::max(),
+      size_t calibrationRuns = 10);
+
+  CudaCpuDispatch(const CudaCpuDispatch&) = delete;
+  CudaCpuDispatch& operator=(const CudaCpuDispatch&) = delete;
+
+  // Inputs and outputs are packed device tensors.  The CPU route
+  // synchronizes with stream, the GPU route only does if profile is set.
+  // If profile is set the runtime of the route is returned, including the
+  // copies of the CPU route, Duration::max() otherwise.  Runs may be
+  // concurrent.
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream = 0,
+      bool profile = false);
+
+  size_t cpuMaxElements() const;
+  size_t gpuMinElements() const;
+
+ private:
+  CudaCpuDispatch(
+      ExecutionEngine<CudaTcExecutor>& cudaEngine,
+      ExecutionEngine<CpuTcExecutor>& cpuEngine,
+      const std::string& name,
+      const CudaMappingOptions& cudaOptions,
+      const CpuMappingOptions& cpuOptions,
+      size_t cpuMaxElements,
+      size_t gpuMinElements,
+      size_t calibrationRuns)
+      : cudaEngine_(cudaEngine),
+        cpuEngine_(cpuEngine),
+        name_(name),
+        cudaOptions_(cudaOptions.toProtobufSerializedString()),
+        cpuOptions_(cpuOptions.toProtobufSerializedString()),
+        calibrationRuns_(calibrationRuns),
+        cpuMaxElements_(cpuMaxElements),
+        gpuMinElements_(gpuMinElements) {}
+
+  Duration runOnCpu(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream);
+  Duration runOnGpu(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream,
+      bool profile);
+  // Whether the CPU route is faster for the sizes of inputs, timed over
+  // calibrationRuns_ runs of each route.
+  bool calibrate(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream);
+
+  ExecutionEngine<CudaTcExecutor>& cudaEngine_;
+  ExecutionEngine<CpuTcExecutor>& cpuEngine_;
+  const std::string name_;
+  const std::string cudaOptions_;
+  const std::string cpuOptions_;
+  const size_t calibrationRuns_;
+
+  // Guards the bounds, held by the calibration runs.
+  mutable std::mutex mutex_;
+  size_t cpuMaxElements_;
+  size_t gpuMinElements_;
+  // The CUDA kernels by sizes of the inputs.
+  std::mutex handlesMutex_;
+  std::map<std::vector<std::vector<int64_t>>, size_t> cudaHandles_;
+};
+
+} // namespace tc
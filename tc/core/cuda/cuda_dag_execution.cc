@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_dag_execution.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/flags.h"
+
+namespace tc {
+
+namespace {
+// The bytes [first, second) spanned by the elements of t, whatever the signs
+// of its strides.
+std::pair<std::uintptr_t, std::uintptr_t> byteRange(const DLTensor* t) {
+  auto begin = reinterpret_cast<std::uintptr_t>(t->data) + t->byte_offset;
+  int64_t elementBytes = t->dtype.bits / 8 * t->dtype.lanes;
+  int64_t low = 0, high = elementBytes;
+  auto strides = dlutils::getStrides(*t);
+  for (int i = 0; i < t->ndim; ++i) {
+    if (t->shape[i] == 0) {
+      return std::make_pair(begin, begin);
+    }
+    auto extent = (t->shape[i] - 1) * strides[i] * elementBytes;
+    if (extent < 0) {
+      low += extent;
+    } else {
+      high += extent;
+    }
+  }
+  return std::make_pair(begin + low, begin + high);
+}
+
+template <typename T, typename U>
+bool overlap(const std::vector<T*>& tensors1, const std::vector<U*>& tensors2) {
+  for (auto t1 : tensors1) {
+    auto r1 = byteRange(t1);
+    for (auto t2 : tensors2) {
+      auto r2 = byteRange(t2);
+      if (r1.first < r2.second and r2.first < r1.second) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<const void*> inputPointers(
+    const std::vector<const DLTensor*>& tensors) {
+  std::vector<const void*> res;
+  for (auto t : tensors) {
+    res.push_back(t->data);
+  }
+  return res;
+}
+
+std::vector<void*> outputPointers(const std::vector<DLTensor*>& tensors) {
+  std::vector<void*> res;
+  for (auto t : tensors) {
+    res.push_back(t->data);
+  }
+  return res;
+}
+} // namespace
+
+CudaDagExecution::CudaDagExecution(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    size_t numberStreams)
+    : engine_(engine) {
+  CHECK_GT(numberStreams, 0u);
+  for (size_t i = 0; i < numberStreams; ++i) {
+    cudaStream_t stream;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+    streams_.push_back(stream);
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaEventCreateWithFlags(&start_, cudaEventDisableTiming));
+}
+
+CudaDagExecution::~CudaDagExecution() {
+  // Errors are ignored, the destructor must not throw.
+  for (auto event : events_) {
+    cudaEventDestroy(event);
+  }
+  if (start_) {
+    cudaEventDestroy(start_);
+  }
+  for (auto stream : streams_) {
+    cudaStreamDestroy(stream);
+  }
+}
+
+size_t CudaDagExecution::add(
+    size_t handle,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs) {
+  Node node;
+  node.handle = handle;
+  node.inputs = inputs;
+  node.outputs = outputs;
+  // Read after write, write after read and write after write.
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    auto& other = nodes_[i];
+    if (overlap(inputs, other.outputs) or overlap(outputs, other.inputs) or
+        overlap(outputs, other.outputs)) {
+      node.dependences.push_back(i);
+      other.used = true;
+    }
+  }
+  nodes_.push_back(node);
+
+  cudaEvent_t event;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+  events_.push_back(event);
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "node " << nodes_.size() - 1 << " depends on "
+      << node.dependences.size() << " earlier nodes";
+  return nodes_.size() - 1;
+}
+
+const std::vector<size_t>& CudaDagExecution::dependences(size_t pos) const {
+  CHECK_LT(pos, nodes_.size());
+  return nodes_[pos].dependences;
+}
+
+void CudaDagExecution::run(cudaStream_t stream) {
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(start_, stream));
+  // Where each node was launched.
+  std::vector<size_t> streamOf(nodes_.size());
+  size_t nextStream = 0;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const auto& node = nodes_[i];
+    // A node follows its last dependence on the same stream, which saves
+    // waiting for its event, independent nodes are spread over the pool.
+    size_t s;
+    if (node.dependences.empty()) {
+      s = nextStream;
+      nextStream = (nextStream + 1) % streams_.size();
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamWaitEvent(streams_[s], start_, 0));
+    } else {
+      s = streamOf[node.dependences.back()];
+      for (auto d : node.dependences) {
+        if (streamOf[d] != s) {
+          TC_CUDA_RUNTIMEAPI_ENFORCE(
+              cudaStreamWaitEvent(streams_[s], events_[d], 0));
+        }
+      }
+    }
+    streamOf[i] = s;
+    engine_.run(
+        node.handle,
+        node.inputs,
+        node.outputs,
+        false,
+        [](const CudaTcExecutor*) { return false; },
+        CudaRuntimeInformation(streams_[s]));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(events_[i], streams_[s]));
+  }
+  // Every node completes before the nodes nothing depends on.
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    if (!nodes_[i].used) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamWaitEvent(stream, events_[i], 0));
+    }
+  }
+}
+
+void CudaDagExecution::record(CudaLaunchGraph& graph) {
+  // The last launches of each node, or of its dependences if it recorded
+  // none.
+  std::vector<std::vector<size_t>> exits(nodes_.size());
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const auto& node = nodes_[i];
+    std::vector<size_t> entries;
+    for (auto d : node.dependences) {
+      entries.insert(entries.end(), exits[d].begin(), exits[d].end());
+    }
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    auto first = graph.size();
+    engine_.uncheckedRun(
+        node.handle,
+        inputPointers(node.inputs),
+        outputPointers(node.outputs),
+        CudaRuntimeInformation(&graph));
+    if (graph.size() == first) {
+      exits[i] = entries;
+      continue;
+    }
+    // The launches of a node stay ordered among themselves.
+    graph.setDependences(first, entries);
+    exits[i] = {graph.size() - 1};
+  }
+}
+
+} // namespace tc
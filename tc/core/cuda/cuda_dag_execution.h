@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_launch_graph.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/utils/dlpack.h"
+
+namespace tc {
+
+//
+// A graph of runs of compiled TCs launched together: the runs that neither
+// read what another one writes nor write what another one reads or writes
+// are launched concurrently on a pool of streams, instead of one after the
+// other, so that small independent kernels fill the GPU together.
+// The dependences are inferred, in the order the nodes were added, from the
+// overlap of the bytes spanned by their tensors, and each node waits for
+// the events of the earlier nodes it depends on.
+// The nodes can also be recorded into a CudaLaunchGraph with the same
+// dependences and replayed with a single launch.
+// The tensors of the nodes must stay allocated while the graph is in use,
+// the streams belong to the device current at construction.
+//
+class CudaDagExecution {
+ public:
+  explicit CudaDagExecution(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      size_t numberStreams = 4);
+  // Destroys the streams and events, ignoring errors.
+  ~CudaDagExecution();
+
+  CudaDagExecution(const CudaDagExecution&) = delete;
+  CudaDagExecution& operator=(const CudaDagExecution&) = delete;
+
+  // Adds a run of the TC compiled under handle and returns its position.
+  size_t add(
+      size_t handle,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs);
+
+  // The positions of the earlier nodes the node at position pos waits for.
+  const std::vector<size_t>& dependences(size_t pos) const;
+
+  // Launches the nodes after the work submitted to stream so far, and
+  // makes the work submitted to it afterwards wait for all of them.
+  void run(cudaStream_t stream = 0);
+
+  // Records the launches of the nodes into graph, each node depending on
+  // the last launches of its dependences, instead of running them.  The
+  // handles must be recordable, see CudaRuntimeInformation::graph.
+  void record(CudaLaunchGraph& graph);
+
+  size_t size() const {
+    return nodes_.size();
+  }
+
+ private:
+  struct Node {
+    size_t handle;
+    std::vector<const DLTensor*> inputs;
+    std::vector<DLTensor*> outputs;
+    std::vector<size_t> dependences;
+    // Are there later nodes depending on this one?
+    bool used = false;
+  };
+
+  ExecutionEngine<CudaTcExecutor>& engine_;
+  std::vector<Node> nodes_;
+  std::vector<cudaStream_t> streams_;
+  // The completion of each node, and the start of the run.
+  std::vector<cudaEvent_t> events_;
+  cudaEvent_t start_ = nullptr;
+};
+
+} // namespace tc
@@ -0,0 +1,278 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_data_parallel.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/flags.h"
+#include "tc/core/polyhedral/scop.h"
+#include "tc/core/tc2halide.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/external/isl.h"
+#include "tc/lang/tree_views.h"
+
+namespace tc {
+
+namespace {
+// The metadata of the packed tensor of the sizes of info, with "rows" rows
+// if split.
+DLTensorUPtr makeSlice(const DLTensor* info, bool split, int64_t rows) {
+  std::vector<int64_t> sizes(info->shape, info->shape + info->ndim);
+  if (split) {
+    sizes[0] = rows;
+  }
+  return dlutils::makeDLTensorWithSizes(info->ctx, info->dtype, sizes);
+}
+
+} // namespace
+
+llvm::Optional<polyhedral::DataParallelSplit> findDataParallelSplit(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const CudaMappingOptions& options) {
+  auto tree = engine.treeForFunction(name);
+  // Where clauses may bound the loops independently of the input sizes.
+  for (auto statement : lang::Def(tree).statements()) {
+    if (statement.whereClauses().size() > 0) {
+      return llvm::None;
+    }
+  }
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto halide =
+      tc2halide::translateCached(isl::with_exceptions::globalIslCtx(), tree);
+  auto scop =
+      polyhedral::Scop::makeScop(isl::with_exceptions::globalIslCtx(), *halide);
+  // Scheduling computes the dependences, the schedule is cached for the
+  // compilation of the slices.
+  auto scheduled = polyhedral::Scop::makeScheduled(
+      *scop, options.generic.outerScheduleOptions);
+  return polyhedral::findDataParallelSplit(*scheduled);
+}
+
+std::unique_ptr<CudaDataParallelExecution> CudaDataParallelExecution::compile(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const CudaMappingOptions& options,
+    const std::vector<int>& devices) {
+  CHECK(!devices.empty()) << "no device to run " << name << " on";
+  auto split = findDataParallelSplit(engine, name, options);
+  if (!split) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << name << " cannot be split along the first dimension";
+    return nullptr;
+  }
+  CHECK_EQ(inputs.size(), split->splitInputs.size());
+
+  // The split dimensions must all have the same size and the slices must be
+  // contiguous.
+  int64_t rows = -1;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (!dlutils::isPacked(*inputs[i])) {
+      return nullptr;
+    }
+    if (split->splitInputs[i]) {
+      if (rows >= 0 and inputs[i]->shape[0] != rows) {
+        return nullptr;
+      }
+      rows = inputs[i]->shape[0];
+    }
+  }
+  auto outputs = engine.inferOutputTensorInfo(name, inputs);
+  for (auto output : outputs) {
+    if (output->ndim == 0 or output->shape[0] != rows) {
+      return nullptr;
+    }
+  }
+  if (rows <= 0) {
+    return nullptr;
+  }
+
+  std::unique_ptr<CudaDataParallelExecution> res(
+      new CudaDataParallelExecution(engine));
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&res->device_));
+  res->splitInputs_ = split->splitInputs;
+  res->inputsInfo_ = dlutils::makeDLTensorVector(inputs);
+  res->outputsInfo_ = dlutils::makeDLTensorVector(outputs);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaEventCreateWithFlags(&res->ready_, cudaEventDisableTiming));
+
+  auto serializedOptions = options.toProtobufSerializedString();
+  auto numberParts = std::min<int64_t>(devices.size(), rows);
+  auto partRows = (rows + numberParts - 1) / numberParts;
+  for (int64_t p = 0; p < numberParts and p * partRows < rows; ++p) {
+    res->parts_.emplace_back();
+    auto& part = res->parts_.back();
+    part.device = devices[p];
+    part.begin = p * partRows;
+    part.rows = std::min(partRows, rows - part.begin);
+    WithDevice withDevice(part.device);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaStreamCreateWithFlags(&part.stream, cudaStreamNonBlocking));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaEventCreateWithFlags(&part.done, cudaEventDisableTiming));
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      part.inputs.push_back(
+          makeSlice(inputs[i], split->splitInputs[i], part.rows));
+      part.inputs.back()->ctx.device_id = part.device;
+    }
+    // Slices of the same sizes share their kernel.
+    part.handle = engine.compile(
+        name, dlutils::extractRawPtrs(part.inputs), serializedOptions);
+    for (auto output : engine.inferOutputTensorInfo(
+             name, dlutils::extractRawPtrs(part.inputs))) {
+      CHECK_EQ(output->shape[0], part.rows);
+      part.outputs.push_back(makeSlice(output, false, part.rows));
+      part.outputs.back()->ctx.device_id = part.device;
+    }
+
+    if (part.device == res->device_) {
+      continue;
+    }
+    for (const auto& t : part.inputs) {
+      void* buffer;
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&buffer, dlutils::numberBytes(*t)));
+      part.inputBuffers.push_back(buffer);
+    }
+    for (const auto& t : part.outputs) {
+      void* buffer;
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&buffer, dlutils::numberBytes(*t)));
+      part.outputBuffers.push_back(buffer);
+    }
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << name << " split into " << res->parts_.size() << " parts of "
+      << partRows << " rows";
+  return res;
+}
+
+CudaDataParallelExecution::~CudaDataParallelExecution() {
+  // Errors are ignored, the destructor must not throw.
+  int device;
+  if (cudaGetDevice(&device) != cudaSuccess) {
+    return;
+  }
+  for (auto& part : parts_) {
+    cudaSetDevice(part.device);
+    for (auto buffer : part.inputBuffers) {
+      cudaFree(buffer);
+    }
+    for (auto buffer : part.outputBuffers) {
+      cudaFree(buffer);
+    }
+    if (part.done) {
+      cudaEventDestroy(part.done);
+    }
+    if (part.stream) {
+      cudaStreamDestroy(part.stream);
+    }
+  }
+  cudaSetDevice(device_);
+  if (ready_) {
+    cudaEventDestroy(ready_);
+  }
+  cudaSetDevice(device);
+}
+
+Duration CudaDataParallelExecution::run(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream,
+    bool profile) const {
+  CHECK_EQ(inputs.size(), inputsInfo_.size());
+  CHECK_EQ(outputs.size(), outputsInfo_.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    CHECK(compareDLTensorMetadata(*inputs[i], *inputsInfo_[i]))
+        << "input " << i << " differs from the compilation";
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    CHECK(compareDLTensorMetadata(*outputs[i], *outputsInfo_[i]))
+        << "output " << i << " differs from the compilation";
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  WithDevice withDevice(device_);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(ready_, stream));
+  for (const auto& part : parts_) {
+    WithDevice withPartDevice(part.device);
+    bool local = part.device == device_;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamWaitEvent(part.stream, ready_, 0));
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      auto offset =
+          splitInputs_[i] ? part.begin * dlutils::rowBytes(*inputs[i]) : 0;
+      auto source = dlutils::dataPtr(*inputs[i]) + offset;
+      auto& slice = part.inputs[i];
+      if (local) {
+        slice->data = source;
+        continue;
+      }
+      slice->data = part.inputBuffers[i];
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyPeerAsync(
+          slice->data,
+          part.device,
+          source,
+          device_,
+          dlutils::numberBytes(*slice),
+          part.stream));
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      part.outputs[i]->data = local ? dlutils::dataPtr(*outputs[i]) +
+              part.begin * dlutils::rowBytes(*outputs[i])
+                                    : part.outputBuffers[i];
+    }
+
+    std::vector<DLTensor*> partOutputs;
+    for (const auto& t : part.outputs) {
+      partOutputs.push_back(t.get());
+    }
+    engine_.run(
+        part.handle,
+        dlutils::extractRawPtrs(part.inputs),
+        partOutputs,
+        false,
+        [](const CudaTcExecutor*) { return false; },
+        CudaRuntimeInformation(part.stream));
+
+    if (not local) {
+      for (size_t i = 0; i < outputs.size(); ++i) {
+        TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyPeerAsync(
+            dlutils::dataPtr(*outputs[i]) +
+                part.begin * dlutils::rowBytes(*outputs[i]),
+            device_,
+            part.outputBuffers[i],
+            part.device,
+            dlutils::numberBytes(*part.outputs[i]),
+            part.stream));
+      }
+    }
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(part.done, part.stream));
+  }
+  for (const auto& part : parts_) {
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamWaitEvent(stream, part.done, 0));
+  }
+  if (not profile) {
+    return Duration::max();
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaStreamSynchronize(stream));
+  return std::chrono::high_resolution_clock::now() - start;
+}
+
+} // namespace tc
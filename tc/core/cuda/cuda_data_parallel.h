@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/polyhedral/data_parallel.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+// The split of the TC name of engine along the first dimension, scheduled
+// with options, llvm::None if there is none.
+llvm::Optional<polyhedral::DataParallelSplit> findDataParallelSplit(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const CudaMappingOptions& options);
+
+//
+// A TC run data-parallel on several devices.  The outputs and the inputs
+// indexed along their first dimension are split into one slice of rows per
+// device, the other inputs are read whole by every device (see
+// polyhedral::findDataParallelSplit for when the split is legal).  Each
+// slice is computed by the kernel of an ExecutionEngine compiled for the
+// sizes of the slice, on a stream of its device.
+// The inputs and the outputs live on the first device.  The other devices
+// receive copies of their slices and of the whole inputs before their
+// kernels and their slices of the outputs are gathered after them, with
+// peer copies on their streams.
+//
+class CudaDataParallelExecution {
+ public:
+  // Compiles the kernels of the slices of inputs with options, one slice per
+  // device.  Devices may repeat, e.g. to split a TC across streams of the
+  // same device.  Returns null if the TC cannot be split.
+  static std::unique_ptr<CudaDataParallelExecution> compile(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const CudaMappingOptions& options,
+      const std::vector<int>& devices);
+
+  // Frees the buffers, streams and events, ignoring errors.
+  ~CudaDataParallelExecution();
+
+  CudaDataParallelExecution(const CudaDataParallelExecution&) = delete;
+  CudaDataParallelExecution& operator=(const CudaDataParallelExecution&) =
+      delete;
+
+  // Inputs and outputs must have the sizes of the compilation and be on the
+  // first device.  The run waits for the work queued before on stream, of
+  // the first device, and the work queued after on stream waits for the
+  // gathered outputs.  If profile is set the run is synchronized with and
+  // its wall-clock time returned, Duration::max() otherwise.  Runs of the
+  // same execution must not be concurrent, they share the device buffers.
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream = 0,
+      bool profile = false) const;
+
+  size_t numberParts() const {
+    return parts_.size();
+  }
+
+ private:
+  struct Part {
+    int device;
+    int64_t begin;
+    int64_t rows;
+    size_t handle;
+    cudaStream_t stream = nullptr;
+    cudaEvent_t done = nullptr;
+    // The metadata of the slices for the kernel, its data set by each run.
+    std::vector<DLTensorUPtr> inputs;
+    std::vector<DLTensorUPtr> outputs;
+    // Device buffers holding the copies of the slices, empty on the first
+    // device, whose kernels use the slices in place.
+    std::vector<void*> inputBuffers;
+    std::vector<void*> outputBuffers;
+  };
+
+  explicit CudaDataParallelExecution(ExecutionEngine<CudaTcExecutor>& engine)
+      : engine_(engine) {}
+
+  ExecutionEngine<CudaTcExecutor>& engine_;
+  int device_;
+  std::vector<bool> splitInputs_;
+  std::vector<DLTensorUPtr> inputsInfo_;
+  std::vector<DLTensorUPtr> outputsInfo_;
+  std::vector<Part> parts_;
+  cudaEvent_t ready_ = nullptr;
+};
+
+} // namespace tc
@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_heuristic_options.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/flags.h"
+#include "tc/core/halide_utils.h"
+#include "tc/core/polyhedral/schedule_transforms.h"
+#include "tc/core/polyhedral/scop.h"
+#include "tc/core/tc2halide.h"
+#include "tc/external/isl.h"
+
+namespace tc {
+
+namespace {
+// Assumed for the loops whose extent is not bounded.
+constexpr size_t kUnknownExtent = 1024;
+constexpr size_t kWarpSize = 32;
+constexpr size_t kMaxThreads = 256;
+// Of the tiles of the parallel loops computed in thread tiles.
+constexpr size_t kLargeTile = 64;
+constexpr size_t kThreadTile = 4;
+constexpr size_t kReductionTile = 32;
+// Largest grid dimension accepted along y and z.
+constexpr size_t kMaxGridDim = 65535;
+
+size_t nextPowerOfTwo(size_t n) {
+  size_t res = 1;
+  while (res < n) {
+    res *= 2;
+  }
+  return res;
+}
+
+// Number of values taken by "upa" on "domain", kUnknownExtent if it is not
+// bounded.
+size_t extent(isl::union_set domain, isl::union_pw_aff upa) {
+  auto values = isl::union_map::from(isl::multi_union_pw_aff(upa))
+                    .intersect_domain(domain)
+                    .range();
+  if (values.is_empty()) {
+    return 1;
+  }
+  auto set = isl::set::from_union_set(values);
+  auto aff = isl::aff(isl::local_space(set.get_space()), isl::dim_type::set, 0);
+  auto min = set.min_val(aff);
+  auto max = set.max_val(aff);
+  if (!min.is_int() || !max.is_int()) {
+    return kUnknownExtent;
+  }
+  return static_cast<size_t>(max.get_num_si() - min.get_num_si()) + 1;
+}
+
+// Is an element read by the statements of "band" read at several values of
+// its "n" outer members, i.e., by several threads of a block?
+bool hasReuseAcross(
+    const polyhedral::Scop& scop,
+    const polyhedral::detail::ScheduleTreeElemBand* band,
+    isl::union_set domain,
+    size_t n) {
+  if (n == 0) {
+    return false;
+  }
+  auto schedule = isl::multi_union_pw_aff(band->mupa_.get_union_pw_aff(0));
+  for (size_t i = 1; i < n; ++i) {
+    schedule = schedule.flat_range_product(
+        isl::multi_union_pw_aff(band->mupa_.get_union_pw_aff(i)));
+  }
+  auto reads = scop.reads.intersect_domain(domain);
+  return !reads.apply_domain(isl::union_map::from(schedule)).is_injective();
+}
+
+size_t numberTiles(size_t extent, size_t tile) {
+  return (extent + tile - 1) / tile;
+}
+} // namespace
+
+CudaMappingOptions makeHeuristicCudaMappingOptions(
+    const lang::TreeRef& tc,
+    const std::vector<const DLTensor*>& inputs) {
+  using namespace polyhedral;
+
+  auto options = CudaMappingOptions::makeNaiveCudaMappingOptions();
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  auto halide = tc2halide::translateCached(ctx, tc);
+  auto scop = Scop::makeScop(ctx, *halide);
+  auto pvm = computeParamValueMap(*halide, inputs);
+  scop->fixParameters(
+      std::unordered_map<std::string, int>(pvm.begin(), pvm.end()));
+  // Scheduled as the mapper does, the first band stands for the others.
+  auto scheduled = scop->isPointwise()
+      ? Scop::makePointwiseScheduled(*scop)
+      : Scop::makeScheduled(*scop, options.generic.outerScheduleOptions);
+  auto root = scheduled->scheduleRoot();
+  auto bands =
+      detail::ScheduleTree::collect(root, detail::ScheduleTreeType::Band);
+  if (bands.empty()) {
+    return options;
+  }
+  auto band = bands.front()->elemAs<detail::ScheduleTreeElemBand>();
+  auto nMember = band->nMember();
+  auto nCoincident = band->nOuterCoincident();
+  if (!band->permutable_ || nCoincident == 0) {
+    return options;
+  }
+  auto domain = activeDomainPoints(root, bands.front());
+  std::vector<size_t> extents;
+  for (size_t i = 0; i < nMember; ++i) {
+    extents.push_back(extent(domain, band->mupa_.get_union_pw_aff(i)));
+  }
+  bool reduction = nMember > nCoincident;
+
+  auto limits = CudaGPUInfo::GPUInfo().MultiprocessorLimits();
+  auto maxThreads = limits.maxThreadsPerBlock > 0
+      ? std::min(kMaxThreads, limits.maxThreadsPerBlock)
+      : kMaxThreads;
+  auto minBlocks = 2 * limits.multiprocessorCount;
+
+  // The innermost coincident members are mapped to threads, innermost to x.
+  auto nThreadDims = std::min<size_t>(nCoincident, 3);
+  auto memberOfThread = [&](size_t d) { return nCoincident - 1 - d; };
+  std::vector<size_t> threads(nThreadDims, 1);
+  std::vector<size_t> tiles(nMember, 1);
+  bool threadTiling = false;
+  if (reduction && nCoincident >= 2 &&
+      extents[memberOfThread(0)] >= kLargeTile &&
+      extents[memberOfThread(1)] >= kLargeTile &&
+      numberTiles(extents[memberOfThread(0)], kLargeTile) *
+              numberTiles(extents[memberOfThread(1)], kLargeTile) >=
+          minBlocks / 2) {
+    // Reductions over large parallel loops, e.g. matmuls: each thread keeps
+    // a tile of the output in registers.
+    threadTiling = true;
+    threads[0] = threads[1] = kLargeTile / kThreadTile;
+    tiles[memberOfThread(0)] = tiles[memberOfThread(1)] = kLargeTile;
+  } else {
+    auto available = maxThreads;
+    for (size_t d = 0; d < nThreadDims; ++d) {
+      auto e = nextPowerOfTwo(extents[memberOfThread(d)]);
+      // A warp along x unless there is no other member to map.
+      auto bound = d == 0 && nThreadDims > 1 ? kWarpSize : available;
+      threads[d] = std::max<size_t>(1, std::min({e, bound, available}));
+      available /= threads[d];
+    }
+    // More blocks for the multiprocessors, fewer threads in each.
+    auto numberBlocks = [&]() {
+      size_t res = 1;
+      for (size_t d = 0; d < nThreadDims; ++d) {
+        res *= numberTiles(extents[memberOfThread(d)], threads[d]);
+      }
+      for (size_t i = 0; i + nThreadDims < nCoincident; ++i) {
+        res *= extents[i];
+      }
+      return res;
+    };
+    auto blockThreads = [&]() {
+      size_t res = 1;
+      for (auto t : threads) {
+        res *= t;
+      }
+      return res;
+    };
+    while (numberBlocks() < minBlocks && blockThreads() > 2 * kWarpSize) {
+      auto largest = std::max_element(threads.begin(), threads.end());
+      *largest /= 2;
+    }
+    for (size_t d = 0; d < nThreadDims; ++d) {
+      tiles[memberOfThread(d)] = threads[d];
+    }
+  }
+  for (size_t i = nCoincident; i < nMember; ++i) {
+    tiles[i] = std::min(nextPowerOfTwo(extents[i]), kReductionTile);
+  }
+
+  // The grid covers the tiles of the outer coincident members.
+  std::vector<size_t> grid;
+  for (size_t i = 0; i < std::min<size_t>(nCoincident, 3); ++i) {
+    auto n = numberTiles(extents[i], tiles[i]);
+    grid.push_back(i == 0 ? n : std::min(n, kMaxGridDim));
+  }
+
+  options.tile(std::vector<uint64_t>(tiles.begin(), tiles.end()))
+      .mapToThreads(std::vector<uint64_t>(threads.begin(), threads.end()))
+      .mapToBlocks(std::vector<uint64_t>(grid.begin(), grid.end()))
+      .usePrivateMemory(reduction)
+      .useSharedMemory(
+          reduction && hasReuseAcross(*scheduled, band, domain, nCoincident))
+      .unroll(threadTiling ? 16 : reduction ? 4 : 1);
+  if (threadTiling) {
+    options.threadTile({kThreadTile, kThreadTile});
+  }
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Heuristic options: " << options;
+  return options;
+}
+
+} // namespace tc
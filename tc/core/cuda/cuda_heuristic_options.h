@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <vector>
+
+#include <dlpack/dlpack.h>
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/lang/tree.h"
+
+namespace tc {
+
+/// Mapping options for the TC tc and the sizes of inputs, chosen without
+/// tuning from the outer band of its schedule and from the device current
+/// in the calling thread, instead of the fixed sizes of
+/// makeNaiveCudaMappingOptions.
+/// The innermost parallel loops get a block of up to 256 threads, a warp
+/// along the innermost one, and their tiles are the extents of the block,
+/// or 64 x 64 computed in 4 x 4 thread tiles for the reductions over large
+/// parallel loops, e.g. matmuls.  The grid covers the tiles, the tiles are
+/// shrunk while they give fewer than two blocks per multiprocessor.  The
+/// reduction loops are tiled by up to 32, their accumulators kept in
+/// registers, and the inputs read at several points of the parallel loops
+/// are promoted to shared memory.  The naive options are returned if the
+/// outer band has no parallel loop.
+CudaMappingOptions makeHeuristicCudaMappingOptions(
+    const lang::TreeRef& tc,
+    const std::vector<const DLTensor*>& inputs);
+
+} // namespace tc
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_kernel_bundle.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+#include "tc/core/compilation_cache.h"
+#include "tc/core/cuda/cuda_rtc.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/lang/canonicalize.h"
+#include "tc/lang/parse_cache.h"
+
+namespace tc {
+
+size_t compileKernelBundle(
+    CudaKernelBundle& bundle,
+    const std::string& tc,
+    const OptionsCacheProto& optionsCache,
+    const std::vector<std::string>& architectures) {
+  // The caches are keyed by the canonical form of the definitions.
+  std::unordered_map<std::string, lang::TreeRef> defs;
+  for (const auto& def : lang::parseCached(tc)) {
+    defs.emplace(lang::canonicalTc(def), def);
+  }
+
+  size_t numberKernels = 0;
+  for (const auto& entry : optionsCache.entries()) {
+    auto def = defs.find(entry.id());
+    if (def == defs.end() or entry.values_size() == 0) {
+      continue;
+    }
+    std::vector<dlutils::DLTensorUPtr> inputs;
+    for (const auto& input : entry.inputs()) {
+      inputs.push_back(
+          detail::makeTensorMetadata(input, dlutils::getGPUDLContext()));
+    }
+    auto inputsInfo = dlutils::extractRawPtrs(inputs);
+    auto options = detail::bestOptions<CudaMappingOptions>(entry);
+    CudaTcExecutor executor(
+        lang::Def(def->second).name().name(),
+        inputsInfo,
+        options.toProtobufSerializedString(),
+        def->second);
+    auto outputsInfo = executor.inferOutputTensorInfo();
+    if (bundle.retrieveKernel(entry.id(), inputsInfo, outputsInfo)) {
+      LOG(INFO) << "Skipping options recorded on " << entry.device_str()
+                << " for " << executor.kernelName()
+                << ", the bundle already holds this kernel";
+      continue;
+    }
+
+    executor.generateCuda(options);
+    if (!executor.splitKernels.empty()) {
+      LOG(WARNING) << "Skipping options recorded on " << entry.device_str()
+                   << " for " << executor.kernelName()
+                   << ", bundles do not hold split kernels";
+      continue;
+    }
+    auto compilerOptions = makeCudaCompilerOptions(options);
+    std::map<std::string, std::string> cubins;
+    for (const auto& arch : architectures) {
+      CHECK_EQ(arch.compare(0, 3, "sm_"), 0)
+          << "expected a real architecture (e.g. sm_70), got " << arch;
+      compilerOptions.architecture = "compute_" + arch.substr(3);
+      auto rtcFun = CudaRTCFunction::Compile(
+          executor.kernelSpecializedName, executor.cudaSource, compilerOptions);
+      const auto& ptx = rtcFun->ptx();
+      cubins[arch] = CudaRTCFunction::LinkCubin(
+          std::string(ptx.begin(), ptx.end()), arch, compilerOptions);
+    }
+    bundle.cacheKernel(
+        entry.id(),
+        options,
+        inputsInfo,
+        outputsInfo,
+        executor.kernelSpecializedName,
+        executor.kernelParameters(),
+        executor.cudaSource,
+        executor.grid,
+        executor.block,
+        executor.dynamicSharedMemory,
+        cubins);
+    ++numberKernels;
+  }
+  return numberKernels;
+}
+
+} // namespace tc
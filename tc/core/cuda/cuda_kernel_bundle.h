@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <compcache.pb.h>
+
+#include "tc/core/cuda/cuda_compilation_cache.h"
+
+namespace tc {
+
+/**
+ * Builds an ahead-of-time bundle: maps the definitions of tc with the best
+ * options recorded in optionsCache for each input shape and compiles the
+ * generated source to a cubin for each real architecture of architectures
+ * (e.g. sm_70), which need not be the current device's.  Entries of
+ * optionsCache whose id is not a definition of tc are skipped, so are
+ * entries with the same key as a kernel already in bundle (e.g. options
+ * recorded on another device).  Returns the number of kernels added.
+ */
+size_t compileKernelBundle(
+    CudaKernelBundle& bundle,
+    const std::string& tc,
+    const OptionsCacheProto& optionsCache,
+    const std::vector<std::string>& architectures);
+
+} // namespace tc
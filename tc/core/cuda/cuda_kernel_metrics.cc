@@ -0,0 +1,385 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_kernel_metrics.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+#include <cupti.h>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+
+namespace tc {
+
+bool KernelMetrics::empty() const {
+  return achievedOccupancy < 0 && dramUtilization < 0 &&
+      sharedBankConflicts < 0 && l2HitRate < 0;
+}
+
+KernelMetricsProto KernelMetrics::toProtobuf() const {
+  KernelMetricsProto buf;
+  if (achievedOccupancy >= 0) {
+    buf.set_achieved_occupancy(achievedOccupancy);
+  }
+  if (dramUtilization >= 0) {
+    buf.set_dram_utilization(dramUtilization);
+  }
+  if (sharedBankConflicts >= 0) {
+    buf.set_shared_bank_conflicts(sharedBankConflicts);
+  }
+  if (l2HitRate >= 0) {
+    buf.set_l2_hit_rate(l2HitRate);
+  }
+  return buf;
+}
+
+KernelMetrics KernelMetrics::fromProtobuf(const KernelMetricsProto& buf) {
+  KernelMetrics metrics;
+  if (buf.has_achieved_occupancy()) {
+    metrics.achievedOccupancy = buf.achieved_occupancy();
+  }
+  if (buf.has_dram_utilization()) {
+    metrics.dramUtilization = buf.dram_utilization();
+  }
+  if (buf.has_shared_bank_conflicts()) {
+    metrics.sharedBankConflicts = buf.shared_bank_conflicts();
+  }
+  if (buf.has_l2_hit_rate()) {
+    metrics.l2HitRate = buf.l2_hit_rate();
+  }
+  return metrics;
+}
+
+std::ostream& operator<<(std::ostream& os, const KernelMetrics& metrics) {
+  auto print = [&os](const char* name, double value) {
+    os << name << ": ";
+    if (value < 0) {
+      os << "n/a";
+    } else {
+      os << value;
+    }
+  };
+  print("achieved occupancy", metrics.achievedOccupancy);
+  print(", DRAM utilization", metrics.dramUtilization);
+  print(", shared bank conflicts", metrics.sharedBankConflicts);
+  print(", L2 hit rate", metrics.l2HitRate);
+  return os;
+}
+
+namespace {
+
+bool cuptiOk(CUptiResult result, const char* call) {
+  if (result == CUPTI_SUCCESS) {
+    return true;
+  }
+  const char* msg = nullptr;
+  cuptiGetResultString(result, &msg);
+  LOG(WARNING) << call << " failed: " << (msg ? msg : "unknown CUPTI error");
+  return false;
+}
+
+template <typename T>
+bool groupAttribute(
+    CUpti_EventGroup group,
+    CUpti_EventGroupAttribute attribute,
+    T* value,
+    size_t size = sizeof(T)) {
+  return cuptiOk(
+      cuptiEventGroupGetAttribute(group, attribute, &size, value),
+      "cuptiEventGroupGetAttribute");
+}
+
+// Reads the events of the groups of an enabled set after a launch. The
+// counts of each domain are extrapolated from the instances that were
+// counted to all the instances of the device.
+bool readEventGroupSet(
+    CUdevice device,
+    const CUpti_EventGroupSet& set,
+    std::map<CUpti_EventID, uint64_t>& values) {
+  for (uint32_t g = 0; g < set.numEventGroups; ++g) {
+    auto group = set.eventGroups[g];
+    CUpti_EventDomainID domain;
+    uint32_t numEvents = 0;
+    uint32_t numInstances = 0;
+    if (!groupAttribute(
+            group, CUPTI_EVENT_GROUP_ATTR_EVENT_DOMAIN_ID, &domain) ||
+        !groupAttribute(
+            group, CUPTI_EVENT_GROUP_ATTR_NUM_EVENTS, &numEvents) ||
+        !groupAttribute(
+            group, CUPTI_EVENT_GROUP_ATTR_INSTANCE_COUNT, &numInstances)) {
+      return false;
+    }
+    uint32_t totalInstances = 0;
+    size_t size = sizeof(totalInstances);
+    if (!cuptiOk(
+            cuptiDeviceGetEventDomainAttribute(
+                device,
+                domain,
+                CUPTI_EVENT_DOMAIN_ATTR_TOTAL_INSTANCE_COUNT,
+                &size,
+                &totalInstances),
+            "cuptiDeviceGetEventDomainAttribute")) {
+      return false;
+    }
+    std::vector<CUpti_EventID> events(numEvents);
+    if (!groupAttribute(
+            group,
+            CUPTI_EVENT_GROUP_ATTR_EVENTS,
+            events.data(),
+            numEvents * sizeof(CUpti_EventID))) {
+      return false;
+    }
+    std::vector<uint64_t> counts(numInstances);
+    for (auto event : events) {
+      size = numInstances * sizeof(uint64_t);
+      if (!cuptiOk(
+              cuptiEventGroupReadEvent(
+                  group,
+                  CUPTI_EVENT_READ_FLAG_NONE,
+                  event,
+                  &size,
+                  counts.data()),
+              "cuptiEventGroupReadEvent")) {
+        return false;
+      }
+      uint64_t sum = 0;
+      for (auto c : counts) {
+        sum += c;
+      }
+      values[event] =
+          numInstances == 0 ? 0 : sum * totalInstances / numInstances;
+    }
+  }
+  return true;
+}
+
+// Counts the events over one launch per pass.
+bool collectEvents(
+    CUcontext context,
+    CUdevice device,
+    std::vector<CUpti_EventID> events,
+    const std::function<void()>& launch,
+    std::map<CUpti_EventID, uint64_t>& values) {
+  CUpti_EventGroupSets* passes = nullptr;
+  if (!cuptiOk(
+          cuptiEventGroupSetsCreate(
+              context,
+              events.size() * sizeof(CUpti_EventID),
+              events.data(),
+              &passes),
+          "cuptiEventGroupSetsCreate")) {
+    return false;
+  }
+  bool ok = true;
+  for (uint32_t p = 0; ok && p < passes->numSets; ++p) {
+    auto& set = passes->sets[p];
+    ok = cuptiOk(cuptiEventGroupSetEnable(&set), "cuptiEventGroupSetEnable");
+    if (!ok) {
+      break;
+    }
+    launch();
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    ok = readEventGroupSet(device, set, values);
+    cuptiEventGroupSetDisable(&set);
+  }
+  cuptiEventGroupSetsDestroy(passes);
+  return ok;
+}
+
+struct Metric {
+  CUpti_MetricID id;
+  std::vector<CUpti_EventID> events;
+};
+
+// Looks the metrics up in order and returns the first the device knows.
+bool findMetric(
+    CUdevice device,
+    const std::vector<const char*>& names,
+    Metric& metric) {
+  for (auto name : names) {
+    if (cuptiMetricGetIdFromName(device, name, &metric.id) != CUPTI_SUCCESS) {
+      continue;
+    }
+    uint32_t numEvents = 0;
+    if (!cuptiOk(
+            cuptiMetricGetNumEvents(metric.id, &numEvents),
+            "cuptiMetricGetNumEvents")) {
+      return false;
+    }
+    metric.events.resize(numEvents);
+    size_t size = numEvents * sizeof(CUpti_EventID);
+    return cuptiOk(
+        cuptiMetricEnumEvents(metric.id, &size, metric.events.data()),
+        "cuptiMetricEnumEvents");
+  }
+  return false;
+}
+
+// The value of the metric as a double, percentages and throughputs as
+// they are, negative if it cannot be computed.
+double metricValue(
+    CUdevice device,
+    Metric& metric,
+    const std::map<CUpti_EventID, uint64_t>& values,
+    uint64_t durationNs) {
+  std::vector<uint64_t> counts;
+  counts.reserve(metric.events.size());
+  for (auto event : metric.events) {
+    auto it = values.find(event);
+    if (it == values.end()) {
+      return -1;
+    }
+    counts.push_back(it->second);
+  }
+  CUpti_MetricValue value;
+  if (!cuptiOk(
+          cuptiMetricGetValue(
+              device,
+              metric.id,
+              metric.events.size() * sizeof(CUpti_EventID),
+              metric.events.data(),
+              counts.size() * sizeof(uint64_t),
+              counts.data(),
+              durationNs,
+              &value),
+          "cuptiMetricGetValue")) {
+    return -1;
+  }
+  CUpti_MetricValueKind kind;
+  size_t size = sizeof(kind);
+  if (!cuptiOk(
+          cuptiMetricGetAttribute(
+              metric.id, CUPTI_METRIC_ATTR_VALUE_KIND, &size, &kind),
+          "cuptiMetricGetAttribute")) {
+    return -1;
+  }
+  switch (kind) {
+    case CUPTI_METRIC_VALUE_KIND_DOUBLE:
+      return value.metricValueDouble;
+    case CUPTI_METRIC_VALUE_KIND_UINT64:
+      return static_cast<double>(value.metricValueUint64);
+    case CUPTI_METRIC_VALUE_KIND_INT64:
+      return static_cast<double>(value.metricValueInt64);
+    case CUPTI_METRIC_VALUE_KIND_PERCENT:
+      return value.metricValuePercent;
+    case CUPTI_METRIC_VALUE_KIND_THROUGHPUT:
+      return static_cast<double>(value.metricValueThroughput);
+    default:
+      return -1;
+  }
+}
+
+bool findEvent(CUdevice device, const char* name, CUpti_EventID& event) {
+  return cuptiEventGetIdFromName(device, name, &event) == CUPTI_SUCCESS;
+}
+
+} // namespace
+
+KernelMetrics collectKernelMetrics(
+    const std::function<void()>& launch,
+    Duration kernelTime) {
+  // Event groups are per context but CUPTI itself is not reentrant.
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  KernelMetrics res;
+  CUcontext context;
+  CUdevice device;
+  TC_CUDA_DRIVERAPI_ENFORCE(cuCtxGetCurrent(&context));
+  CHECK(context) << "Collecting kernel metrics requires a current context";
+  TC_CUDA_DRIVERAPI_ENFORCE(cuCtxGetDevice(&device));
+  if (!cuptiOk(
+          cuptiSetEventCollectionMode(
+              context, CUPTI_EVENT_COLLECTION_MODE_KERNEL),
+          "cuptiSetEventCollectionMode")) {
+    return res;
+  }
+
+  Metric occupancy, dramRead, dramWrite, l2Hit;
+  bool hasOccupancy = findMetric(device, {"achieved_occupancy"}, occupancy);
+  bool hasDram = findMetric(device, {"dram_read_throughput"}, dramRead) &&
+      findMetric(device, {"dram_write_throughput"}, dramWrite);
+  bool hasL2 =
+      findMetric(device, {"l2_tex_hit_rate", "l2_l1_read_hit_rate"}, l2Hit);
+  CUpti_EventID ldConflicts, stConflicts, loads, stores;
+  bool hasConflicts =
+      findEvent(device, "shared_ld_bank_conflict", ldConflicts) &&
+      findEvent(device, "shared_st_bank_conflict", stConflicts) &&
+      findEvent(device, "shared_load", loads) &&
+      findEvent(device, "shared_store", stores);
+
+  std::vector<CUpti_EventID> events;
+  auto add = [&events](const std::vector<CUpti_EventID>& e) {
+    events.insert(events.end(), e.begin(), e.end());
+  };
+  if (hasOccupancy) {
+    add(occupancy.events);
+  }
+  if (hasDram) {
+    add(dramRead.events);
+    add(dramWrite.events);
+  }
+  if (hasL2) {
+    add(l2Hit.events);
+  }
+  if (hasConflicts) {
+    add({ldConflicts, stConflicts, loads, stores});
+  }
+  std::sort(events.begin(), events.end());
+  events.erase(std::unique(events.begin(), events.end()), events.end());
+  std::map<CUpti_EventID, uint64_t> values;
+  if (events.empty() ||
+      !collectEvents(context, device, events, launch, values)) {
+    return res;
+  }
+
+  auto durationNs = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(kernelTime)
+          .count());
+  if (hasOccupancy) {
+    res.achievedOccupancy = metricValue(device, occupancy, values, durationNs);
+  }
+  auto peak = CudaGPUInfo::GPUInfo().PeakThroughputs().memoryBandwidth;
+  if (hasDram && peak > 0 && durationNs > 0) {
+    auto read = metricValue(device, dramRead, values, durationNs);
+    auto write = metricValue(device, dramWrite, values, durationNs);
+    if (read >= 0 && write >= 0) {
+      res.dramUtilization = (read + write) / peak;
+    }
+  }
+  if (hasL2) {
+    auto percent = metricValue(device, l2Hit, values, durationNs);
+    if (percent >= 0) {
+      res.l2HitRate = percent / 100;
+    }
+  }
+  if (hasConflicts) {
+    auto instructions = values[loads] + values[stores];
+    res.sharedBankConflicts = instructions == 0
+        ? 0
+        : static_cast<double>(values[ldConflicts] + values[stConflicts]) /
+            instructions;
+  }
+  return res;
+}
+
+} // namespace tc
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <ostream>
+
+#include <compcache.pb.h>
+
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+//
+// Hardware counters of a kernel launch, collected with CUPTI.  They tell why
+// a kernel is slow where its runtime only tells how slow it is.
+// Counters that could not be collected, e.g. because the device does not
+// expose them, are negative.
+//
+struct KernelMetrics {
+  // Average active warps per active cycle over the maximum, in [0, 1].
+  double achievedOccupancy = -1;
+  // DRAM read and write throughput over the peak bandwidth of the device.
+  double dramUtilization = -1;
+  // Shared memory bank conflicts per shared memory load or store
+  // instruction, 0 without conflicts.
+  double sharedBankConflicts = -1;
+  // Fraction of the L2 requests that hit, in [0, 1].
+  double l2HitRate = -1;
+
+  // Whether no counter was collected.
+  bool empty() const;
+
+  KernelMetricsProto toProtobuf() const;
+  static KernelMetrics fromProtobuf(const KernelMetricsProto& buf);
+};
+
+std::ostream& operator<<(std::ostream& os, const KernelMetrics& metrics);
+
+//
+// Replays launch on the current device, once per pass of counters CUPTI
+// needs, and returns the counters of the last launch of each pass.  launch
+// must launch the same kernels every time and must not synchronize with
+// other streams than the default one.  kernelTime is the runtime of a
+// launch, measured beforehand, that the throughputs are computed from.
+// Only the CUPTI event and metric API is used, which devices of compute
+// capability 7.5 and up do not support: all counters are negative on them.
+// Profiling with CUPTI serializes the kernels and must not happen while
+// nvprof or another CUPTI client profiles the process.
+//
+KernelMetrics collectKernelMetrics(
+    const std::function<void()>& launch,
+    Duration kernelTime);
+
+} // namespace tc
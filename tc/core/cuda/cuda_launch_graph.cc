@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_launch_graph.h"
+
+#include <cuda_runtime.h>
+
+#include "tc/core/cuda/cuda.h"
+
+namespace tc {
+
+size_t CudaLaunchGraph::record(
+    std::shared_ptr<CudaRTCFunction> function,
+    const std::array<size_t, 3>& grid,
+    const std::array<size_t, 3>& block,
+    unsigned int shared_mem,
+    const std::vector<int>& params,
+    const std::vector<void*>& outputs,
+    const std::vector<const void*>& inputs) {
+  CHECK(function) << "Can't record an uncompiled kernel";
+  CHECK(!function->Cooperative())
+      << "cooperative kernels cannot be recorded in a graph";
+  // The graph keeps the kernel's CUfunction.
+  function->Pin();
+  std::vector<size_t> dependences;
+  if (!launches_.empty()) {
+    dependences.push_back(launches_.size() - 1);
+  }
+  launches_.push_back(RecordedLaunch{
+      function, grid, block, shared_mem, params, outputs, inputs, dependences});
+#if CUDA_VERSION >= 10000
+  needsBuild_ = true;
+#endif
+  return launches_.size() - 1;
+}
+
+void CudaLaunchGraph::setPointers(
+    size_t pos,
+    const std::vector<void*>& outputs,
+    const std::vector<const void*>& inputs) {
+  CHECK_LT(pos, launches_.size());
+  auto& launch = launches_[pos];
+  CHECK_EQ(launch.outputs.size(), outputs.size());
+  CHECK_EQ(launch.inputs.size(), inputs.size());
+  launch.outputs = outputs;
+  launch.inputs = inputs;
+  dirty_.push_back(pos);
+}
+
+void CudaLaunchGraph::setDependences(
+    size_t pos,
+    const std::vector<size_t>& dependences) {
+  CHECK_LT(pos, launches_.size());
+  for (auto d : dependences) {
+    CHECK_LT(d, pos) << "launches can only depend on earlier ones";
+  }
+  launches_[pos].dependences = dependences;
+#if CUDA_VERSION >= 10000
+  needsBuild_ = true;
+#endif
+}
+
+#if CUDA_VERSION < 10000
+
+CudaLaunchGraph::~CudaLaunchGraph() {}
+
+void CudaLaunchGraph::launch(cudaStream_t stream) {
+  for (const auto& l : launches_) {
+    l.function->Launch(
+        l.grid, l.block, l.shared_mem, stream, l.params, l.outputs, l.inputs);
+  }
+  dirty_.clear();
+}
+
+#else
+
+namespace {
+// The driver copies the argument values when the node parameters are set,
+// the returned pointers only need to live until then.
+std::vector<void*> kernelArguments(
+    std::vector<int>& params,
+    std::vector<void*>& outputs,
+    std::vector<const void*>& inputs) {
+  std::vector<void*> args;
+  args.reserve(params.size() + outputs.size() + inputs.size());
+  for (auto& p : params) {
+    args.push_back(&p);
+  }
+  for (auto& o : outputs) {
+    args.push_back(&o);
+  }
+  for (auto& i : inputs) {
+    args.push_back(static_cast<void*>(&i));
+  }
+  return args;
+}
+
+CUDA_KERNEL_NODE_PARAMS kernelNodeParams(
+    CUfunction function,
+    const std::array<size_t, 3>& grid,
+    const std::array<size_t, 3>& block,
+    unsigned int shared_mem,
+    std::vector<void*>& args) {
+  CUDA_KERNEL_NODE_PARAMS res = {};
+  res.func = function;
+  res.gridDimX = grid[0];
+  res.gridDimY = grid[1];
+  res.gridDimZ = grid[2];
+  res.blockDimX = block[0];
+  res.blockDimY = block[1];
+  res.blockDimZ = block[2];
+  res.sharedMemBytes = shared_mem;
+  res.kernelParams = args.data();
+  res.extra = nullptr;
+  return res;
+}
+} // namespace
+
+CudaLaunchGraph::~CudaLaunchGraph() {
+  // Errors are ignored, the destructor must not throw.
+  if (exec_) {
+    cuGraphExecDestroy(exec_);
+  }
+  if (graph_) {
+    cuGraphDestroy(graph_);
+  }
+}
+
+void CudaLaunchGraph::destroy() {
+  if (exec_) {
+    TC_CUDA_DRIVERAPI_ENFORCE(cuGraphExecDestroy(exec_));
+    exec_ = nullptr;
+  }
+  if (graph_) {
+    TC_CUDA_DRIVERAPI_ENFORCE(cuGraphDestroy(graph_));
+    graph_ = nullptr;
+  }
+  nodes_.clear();
+}
+
+void CudaLaunchGraph::build() {
+  destroy();
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device_));
+  TC_CUDA_DRIVERAPI_ENFORCE(cuGraphCreate(&graph_, 0));
+  nodes_.reserve(launches_.size());
+  for (auto& l : launches_) {
+    auto args = kernelArguments(l.params, l.outputs, l.inputs);
+    auto nodeParams = kernelNodeParams(
+        l.function->DeviceFunction(), l.grid, l.block, l.shared_mem, args);
+    CUgraphNode node;
+    // By default, each kernel depends on the previous one, as on a stream.
+    std::vector<CUgraphNode> dependences;
+    for (auto d : l.dependences) {
+      dependences.push_back(nodes_[d]);
+    }
+    TC_CUDA_DRIVERAPI_ENFORCE(cuGraphAddKernelNode(
+        &node,
+        graph_,
+        dependences.empty() ? nullptr : dependences.data(),
+        dependences.size(),
+        &nodeParams));
+    nodes_.push_back(node);
+  }
+#if CUDA_VERSION >= 12000
+  TC_CUDA_DRIVERAPI_ENFORCE(cuGraphInstantiateWithFlags(&exec_, graph_, 0));
+#else
+  TC_CUDA_DRIVERAPI_ENFORCE(
+      cuGraphInstantiate(&exec_, graph_, nullptr, nullptr, 0));
+#endif
+  needsBuild_ = false;
+}
+
+void CudaLaunchGraph::launch(cudaStream_t stream) {
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  if (device != device_) {
+    needsBuild_ = true;
+  }
+#if CUDA_VERSION >= 10010
+  // Patch the instantiated graph in place rather than rebuilding it.
+  if (!needsBuild_) {
+    for (auto pos : dirty_) {
+      auto& l = launches_[pos];
+      auto args = kernelArguments(l.params, l.outputs, l.inputs);
+      auto nodeParams = kernelNodeParams(
+          l.function->DeviceFunction(), l.grid, l.block, l.shared_mem, args);
+      TC_CUDA_DRIVERAPI_ENFORCE(
+          cuGraphExecKernelNodeSetParams(exec_, nodes_[pos], &nodeParams));
+    }
+  }
+#else
+  needsBuild_ = needsBuild_ || !dirty_.empty();
+#endif
+  dirty_.clear();
+  if (needsBuild_) {
+    build();
+  }
+  TC_CUDA_DRIVERAPI_ENFORCE(cuGraphLaunch(exec_, stream));
+}
+
+#endif
+
+} // namespace tc
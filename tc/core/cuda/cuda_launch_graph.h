@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <cuda.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_rtc.h"
+
+namespace tc {
+
+//
+// A sequence of kernel launches recorded once and replayed with a single
+// CUDA graph launch, which removes the per-kernel host launch overhead of
+// pipelines made of many small kernels.
+// Launches are recorded by passing the graph as part of the
+// CudaRuntimeInformation given to uncheckedRun, in which case nothing is
+// launched.  On replay the kernels execute in recording order, each one after
+// the previous one has completed, unless given other dependences with
+// setDependences.
+// The data pointers of a recorded launch may be changed between replays.
+// The executors whose kernels are recorded must not be cleared while the
+// graph is in use.
+// CUDA graphs require CUDA 10, with older toolkits launch() falls back to
+// replaying the recorded launches one by one.
+//
+class CudaLaunchGraph {
+ public:
+  CudaLaunchGraph() = default;
+  ~CudaLaunchGraph();
+
+  CudaLaunchGraph(const CudaLaunchGraph&) = delete;
+  CudaLaunchGraph& operator=(const CudaLaunchGraph&) = delete;
+
+  // Appends a launch and returns its position in the sequence.
+  size_t record(
+      std::shared_ptr<CudaRTCFunction> function,
+      const std::array<size_t, 3>& grid,
+      const std::array<size_t, 3>& block,
+      unsigned int shared_mem,
+      const std::vector<int>& params,
+      const std::vector<void*>& outputs,
+      const std::vector<const void*>& inputs);
+
+  // Replaces the data pointers of the launch at position pos, the number of
+  // tensors must not change.  Takes effect on the next launch().
+  void setPointers(
+      size_t pos,
+      const std::vector<void*>& outputs,
+      const std::vector<const void*>& inputs);
+
+  // Makes the launch at position pos wait for the launches at the given
+  // earlier positions, instead of the previous one, so that launches that do
+  // not depend on each other may run concurrently.  Takes effect on the next
+  // build of the graph.
+  void setDependences(size_t pos, const std::vector<size_t>& dependences);
+
+  // Launches the recorded sequence on the stream of the current device.  The
+  // graph is built on first use and rebuilt after new launches are recorded
+  // or the current device changes.
+  void launch(cudaStream_t stream);
+
+  size_t size() const {
+    return launches_.size();
+  }
+
+ private:
+  struct RecordedLaunch {
+    std::shared_ptr<CudaRTCFunction> function;
+    std::array<size_t, 3> grid;
+    std::array<size_t, 3> block;
+    unsigned int shared_mem;
+    std::vector<int> params;
+    std::vector<void*> outputs;
+    std::vector<const void*> inputs;
+    // The positions of the launches this one waits for.
+    std::vector<size_t> dependences;
+  };
+
+  std::vector<RecordedLaunch> launches_;
+  // Positions whose pointers changed since the last launch().
+  std::vector<size_t> dirty_;
+
+#if CUDA_VERSION >= 10000
+  void build();
+  void destroy();
+
+  bool needsBuild_ = true;
+  int device_ = -1;
+  CUgraph graph_ = nullptr;
+  CUgraphExec exec_ = nullptr;
+  std::vector<CUgraphNode> nodes_;
+#endif
+};
+
+} // namespace tc
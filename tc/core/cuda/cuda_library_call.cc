@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_library_call.h"
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <cublas_v2.h>
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_rtc.h"
+#include "tc/core/utils/dlpack.h"
+
+#define TC_CUBLAS_ENFORCE(condition)                                   \
+  do {                                                                 \
+    cublasStatus_t status = condition;                                 \
+    if (status != CUBLAS_STATUS_SUCCESS) {                             \
+      std::stringstream ss;                                            \
+      ss << "Error at: " << __FILE__ << ":" << __LINE__                \
+         << ": cuBLAS status " << static_cast<int>(status);            \
+      LOG(WARNING) << ss.str();                                        \
+      throw std::runtime_error(ss.str().c_str());                      \
+    }                                                                  \
+  } while (0)
+
+namespace tc {
+
+namespace {
+
+// The cuBLAS handles of a thread, one per device, created on first use.
+// cuBLAS handles are not meant to be shared across threads.
+class CublasHandles {
+ public:
+  ~CublasHandles() {
+    // Errors are ignored, the context may be gone at thread exit.
+    for (auto& kvp : handles_) {
+      cublasDestroy(kvp.second);
+    }
+  }
+
+  cublasHandle_t get(int device) {
+    auto it = handles_.find(device);
+    if (it != handles_.end()) {
+      return it->second;
+    }
+    cublasHandle_t handle;
+    TC_CUBLAS_ENFORCE(cublasCreate(&handle));
+    handles_.emplace(device, handle);
+    return handle;
+  }
+
+ private:
+  std::unordered_map<int, cublasHandle_t> handles_;
+};
+
+cublasHandle_t currentHandle(cudaStream_t stream) {
+  thread_local CublasHandles handles;
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  auto handle = handles.get(device);
+  TC_CUBLAS_ENFORCE(cublasSetStream(handle, stream));
+  return handle;
+}
+
+bool fitsInt(int64_t v) {
+  return v > 0 and v <= std::numeric_limits<int>::max();
+}
+
+cublasOperation_t operation(bool transpose) {
+  return transpose ? CUBLAS_OP_T : CUBLAS_OP_N;
+}
+} // namespace
+
+std::unique_ptr<CudaLibraryCall> CudaLibraryCall::makeGemm(
+    const polyhedral::GemmCall& gemm,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs) {
+  const auto* O = outputs.at(gemm.output);
+  const auto* A = inputs.at(gemm.a);
+  const auto* B = inputs.at(gemm.b);
+  auto dims = static_cast<int>(gemm.batchDims + 2);
+  for (const auto* t : {O, A, B}) {
+    if (t->ndim != dims or t->dtype.code != kDLFloat or
+        t->dtype.bits != O->dtype.bits or t->dtype.lanes != 1 or
+        !dlutils::isPacked(*t)) {
+      return nullptr;
+    }
+  }
+  if (O->dtype.bits != 32 and O->dtype.bits != 64) {
+    return nullptr;
+  }
+
+  int64_t batch = 1;
+  for (int i = 0; i < dims - 2; ++i) {
+    if (A->shape[i] != O->shape[i] or B->shape[i] != O->shape[i]) {
+      return nullptr;
+    }
+    batch *= O->shape[i];
+  }
+  int64_t m = O->shape[dims - 2];
+  int64_t n = O->shape[dims - 1];
+  int64_t k = A->shape[gemm.transposeA ? dims - 2 : dims - 1];
+  // The strides between matrices must fit in an int as well
+  if (!fitsInt(batch) or !fitsInt(m * n) or !fitsInt(m * k) or
+      !fitsInt(k * n)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<CudaLibraryCall> res(new CudaLibraryCall());
+  res->gemm_ = gemm;
+  res->isDouble_ = O->dtype.bits == 64;
+  res->batch_ = batch;
+  res->m_ = m;
+  res->n_ = n;
+  res->k_ = k;
+  return res;
+}
+
+Duration CudaLibraryCall::launch(
+    const std::vector<void*>& outputs,
+    const std::vector<const void*>& inputs,
+    cudaStream_t stream,
+    bool profile) const {
+  auto handle = currentHandle(stream);
+  CudaTimingToken token;
+  if (profile) {
+    int device;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+    token = CudaTimingToken(device, stream);
+  }
+
+  // cuBLAS matrices are column-major: the row-major O = A * B is computed
+  // as the column-major O^T = B^T * A^T, with B first.
+  auto opB = operation(gemm_.transposeB);
+  auto opA = operation(gemm_.transposeA);
+  int ldb = gemm_.transposeB ? k_ : n_;
+  int lda = gemm_.transposeA ? m_ : k_;
+  auto strideB = static_cast<long long>(k_) * n_;
+  auto strideA = static_cast<long long>(m_) * k_;
+  auto strideO = static_cast<long long>(m_) * n_;
+  auto O = outputs.at(gemm_.output);
+  auto A = inputs.at(gemm_.a);
+  auto B = inputs.at(gemm_.b);
+  if (isDouble_) {
+    double alpha = 1, beta = 0;
+    TC_CUBLAS_ENFORCE(cublasDgemmStridedBatched(
+        handle,
+        opB,
+        opA,
+        n_,
+        m_,
+        k_,
+        &alpha,
+        static_cast<const double*>(B),
+        ldb,
+        strideB,
+        static_cast<const double*>(A),
+        lda,
+        strideA,
+        &beta,
+        static_cast<double*>(O),
+        n_,
+        strideO,
+        batch_));
+  } else {
+    float alpha = 1, beta = 0;
+    TC_CUBLAS_ENFORCE(cublasSgemmStridedBatched(
+        handle,
+        opB,
+        opA,
+        n_,
+        m_,
+        k_,
+        &alpha,
+        static_cast<const float*>(B),
+        ldb,
+        strideB,
+        static_cast<const float*>(A),
+        lda,
+        strideA,
+        &beta,
+        static_cast<float*>(O),
+        n_,
+        strideO,
+        batch_));
+  }
+
+  if (not profile) {
+    return Duration::max();
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(token.stop_, stream));
+  return token.resolve();
+}
+
+std::string CudaLibraryCall::describe() const {
+  std::stringstream ss;
+  ss << (isDouble_ ? "cublasD" : "cublasS") << "gemmStridedBatched("
+     << (gemm_.transposeB ? "T" : "N") << ", "
+     << (gemm_.transposeA ? "T" : "N") << ", " << n_ << ", " << m_ << ", "
+     << k_ << ", batch " << batch_ << ")";
+  return ss.str();
+}
+
+} // namespace tc
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/polyhedral/schedule_tree_matcher.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+//
+// A TC computed by a vendor library instead of a generated kernel, for the
+// executors of options with match_library_calls.  Only (batched) matrix
+// multiplications of packed float or double tensors are supported, they are
+// computed by cuBLAS.  The sizes are fixed when the call is made, like those
+// of the generated kernels.
+//
+class CudaLibraryCall {
+ public:
+  // A cuBLAS call for the GEMM of a TC with the given inputs and outputs,
+  // null if cuBLAS does not support them.
+  static std::unique_ptr<CudaLibraryCall> makeGemm(
+      const polyhedral::GemmCall& gemm,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs);
+
+  // Launches the call on stream, with the cuBLAS handle of the current
+  // thread and device.  If profile is set it returns the runtime of the
+  // call, Duration::max() otherwise.
+  Duration launch(
+      const std::vector<void*>& outputs,
+      const std::vector<const void*>& inputs,
+      cudaStream_t stream,
+      bool profile) const;
+
+  // E.g. "cublasSgemmStridedBatched(N, T, 64, 32, 128, batch 16)".
+  std::string describe() const;
+
+ private:
+  CudaLibraryCall() = default;
+
+  polyhedral::GemmCall gemm_;
+  bool isDouble_ = false;
+  int batch_ = 1;
+  int m_ = 0;
+  int n_ = 0;
+  int k_ = 0;
+};
+
+} // namespace tc
@@ -165,29 +165,44 @@ CudaMappingOptions::CudaMappingOptions(const std::string& str)
 CudaMappingOptions& CudaMappingOptions::operator=(
     const CudaMappingOptions& options) {
   ownedProto_ = options.ownedProto_; // views already point to the proper place
-  return *this;
+  return modified();
 }
 
 bool CudaMappingOptions::operator==(const CudaMappingOptions& options) const {
-  return ownedProto_.SerializeAsString() ==
+  // Different hashes are different options, equal hashes may still collide
+  return hash() == options.hash() &&
+      ownedProto_.SerializeAsString() ==
       options.ownedProto_.SerializeAsString();
 }
 
 bool CudaMappingOptions::operator!=(const CudaMappingOptions& options) const {
-  return ownedProto_.SerializeAsString() !=
-      options.ownedProto_.SerializeAsString();
+  return !(*this == options);
+}
+
+uint64_t CudaMappingOptions::hash() const {
+  auto h = hash_.load(std::memory_order_relaxed);
+  if (h == 0) {
+    h = stableHash(ownedProto_.SerializeAsString());
+    hash_.store(h, std::memory_order_relaxed);
+  }
+  return h;
+}
+
+CudaMappingOptions& CudaMappingOptions::modified() {
+  hash_.store(0, std::memory_order_relaxed);
+  return *this;
 }
 
 CudaMappingOptions& CudaMappingOptions::mapToThreads(
     std::initializer_list<uint64_t> threads) {
   block = CudaDim(threads).view; // tmp CudaDim, copy, delete
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions&
 CudaMappingOptions::mapToThreads(uint64_t x, uint64_t y, uint64_t z) {
   block = CudaDim(x, y, z).view; // tmp CudaDim, copy, delete
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::mapToThreads(
@@ -199,19 +214,19 @@ CudaMappingOptions& CudaMappingOptions::mapToThreads(
   uint64_t y = threads.size() > 1 ? threads[1] : CudaDimView::defaultDim;
   uint64_t z = threads.size() > 2 ? threads[2] : CudaDimView::defaultDim;
   block = CudaDim(x, y, z).view; // tmp CudaDim, copy, delete
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::mapToBlocks(
     std::initializer_list<uint64_t> blocks) {
   grid = CudaDim(blocks).view; // tmp CudaDim, copy, delete
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions&
 CudaMappingOptions::mapToBlocks(uint64_t x, uint64_t y, uint64_t z) {
   grid = CudaDim(x, y, z).view; // tmp CudaDim, copy, delete
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::mapToBlocks(
@@ -223,33 +238,140 @@ CudaMappingOptions& CudaMappingOptions::mapToBlocks(
   uint64_t y = blocks.size() > 1 ? blocks[1] : CudaDimView::defaultDim;
   uint64_t z = blocks.size() > 2 ? blocks[2] : CudaDimView::defaultDim;
   grid = CudaDim(x, y, z).view; // tmp CudaDim, copy, delete
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::genericMappingOptions(
     const MappingOptions& options) {
   *(ownedProto_.mutable_generic_mapping_options()) = options.view.proto;
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::useSharedMemory(bool b) {
   ownedProto_.set_use_shared_memory(b);
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::usePrivateMemory(bool b) {
   ownedProto_.set_use_private_memory(b);
-  return *this;
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::maxSharedMemory(uint64_t size) {
   ownedProto_.set_max_shared_memory(size);
-  return *this;
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::useDynamicSharedMemory(bool b) {
+  ownedProto_.set_use_dynamic_shared_memory(b);
+  return modified();
 }
 
 CudaMappingOptions& CudaMappingOptions::unrollCopyShared(bool b) {
   ownedProto_.set_unroll_copy_shared(b);
-  return *this;
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::doubleBufferShared(bool b) {
+  ownedProto_.set_double_buffer_shared(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::warpShuffleReductions(bool b) {
+  ownedProto_.set_warp_shuffle_reductions(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::gridReductions(bool b) {
+  ownedProto_.set_grid_reductions(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::useTensorCores(bool b) {
+  ownedProto_.set_use_tensor_cores(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::splitKernels(bool b) {
+  ownedProto_.set_split_kernels(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::unrollPragma(bool b) {
+  ownedProto_.set_unroll_pragma(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::persistentBlocks(bool b) {
+  ownedProto_.set_persistent_blocks(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::separateFullTiles(bool b) {
+  ownedProto_.set_separate_full_tiles(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::asyncCopies(bool b) {
+  ownedProto_.set_async_copies(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::transposeShared(bool b) {
+  ownedProto_.set_transpose_shared(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::cooperativeKernels(bool b) {
+  ownedProto_.set_cooperative_kernels(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::warpAggregatedAtomics(bool b) {
+  ownedProto_.set_warp_aggregated_atomics(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::twoDimReductions(bool b) {
+  ownedProto_.set_two_dim_reductions(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::dp4aPacking(Dp4aPacking packing) {
+  ownedProto_.set_dp4a_packing(packing);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::mathPrecision(
+    MathPrecision precision) {
+  ownedProto_.set_math_precision(precision);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::maxRegisterCount(uint32_t count) {
+  ownedProto_.mutable_compiler_options()->set_max_register_count(count);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::useFastMath(bool b) {
+  ownedProto_.mutable_compiler_options()->set_use_fast_math(b);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::jitOptimizationLevel(uint32_t level) {
+  CHECK_LE(level, 4u) << "JIT optimization levels range from 0 to 4";
+  ownedProto_.mutable_compiler_options()->set_jit_optimization_level(level);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::useLaunchBounds(
+    bool b,
+    uint32_t minBlocksPerMultiprocessor) {
+  auto compilerOptions = ownedProto_.mutable_compiler_options();
+  compilerOptions->set_use_launch_bounds(b);
+  compilerOptions->set_min_blocks_per_multiprocessor(
+      minBlocksPerMultiprocessor);
+  return modified();
 }
 
 } // namespace tc
@@ -98,6 +98,179 @@ CudaMappingOptions& CudaMappingOptions::mapToBlocks(
   return mapToBlocks(sizes[0], sizes[1], sizes[2]);
 }
 
+CudaMappingOptions& CudaMappingOptions::parametricSize(
+    const std::string& name,
+    int64_t min,
+    int64_t max) {
+  CHECK(!name.empty()) << "expected a size parameter name";
+  CHECK_LE(min, max) << "empty range for size parameter " << name;
+  for (auto& range : *ownedProto_.mutable_parametric_sizes()) {
+    if (range.name() == name) {
+      range.set_min(min);
+      range.set_max(max);
+      return modified();
+    }
+  }
+  auto range = ownedProto_.add_parametric_sizes();
+  range->set_name(name);
+  range->set_min(min);
+  range->set_max(max);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::vectorizeWidth(uint32_t width) {
+  CHECK(width == 1 || width == 2 || width == 4)
+      << "unsupported vector width " << width << ", expected 1, 2 or 4";
+  ownedProto_.set_vectorize_width(width);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::blockSwizzle(uint32_t group) {
+  CHECK_GE(group, 1u) << "block swizzle groups must not be empty";
+  ownedProto_.set_block_swizzle(group);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::batchPacking(uint32_t instances) {
+  CHECK_GE(instances, 1u) << "batch packing must pack at least one instance";
+  ownedProto_.set_batch_packing(instances);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::linearizeBlocks(uint32_t members) {
+  CHECK_GE(members, 1u) << "block linearization must map at least one loop";
+  ownedProto_.set_linearize_blocks(members);
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::threadTile(
+    const std::vector<uint64_t>& sizes) {
+  if (sizes.empty()) {
+    ownedProto_.clear_thread_tiling();
+    return modified();
+  }
+  auto tiling = ownedProto_.mutable_thread_tiling();
+  tiling->clear_sizes();
+  for (auto size : sizes) {
+    CHECK_GT(size, 0u) << "thread tile sizes must be positive";
+    tiling->add_sizes(size);
+  }
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::warpTile(
+    const std::vector<uint64_t>& sizes) {
+  if (sizes.empty()) {
+    ownedProto_.clear_warp_tiling();
+    return modified();
+  }
+  auto tiling = ownedProto_.mutable_warp_tiling();
+  tiling->clear_sizes();
+  for (auto size : sizes) {
+    CHECK_GT(size, 0u) << "warp tile sizes must be positive";
+    tiling->add_sizes(size);
+  }
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::kernelOptions(
+    size_t kernel,
+    const CudaMappingOptions& options) {
+  auto size = static_cast<size_t>(ownedProto_.kernel_options_size());
+  CHECK_LE(kernel, size) << "the options of kernel " << size
+                         << " must be set before those of kernel " << kernel;
+  auto proto = options.proto();
+  proto.clear_kernel_options();
+  if (kernel == size) {
+    *ownedProto_.add_kernel_options() = proto;
+  } else {
+    *ownedProto_.mutable_kernel_options(kernel) = proto;
+  }
+  return modified();
+}
+
+CudaMappingOptions CudaMappingOptions::optionsOfKernel(size_t kernel) const {
+  auto res = *this;
+  res.ownedProto_.clear_kernel_options();
+  if (not ownedProto_.split_kernels() or ownedProto_.cooperative_kernels() or
+      kernel >= static_cast<size_t>(ownedProto_.kernel_options_size())) {
+    return res.modified();
+  }
+  res.ownedProto_ = ownedProto_.kernel_options(kernel);
+  // The settings of the whole TC
+  auto generic = res.ownedProto_.mutable_generic_mapping_options();
+  *generic->mutable_outer_schedule_options() =
+      ownedProto_.generic_mapping_options().outer_schedule_options();
+  generic->set_fix_parameters_before_scheduling(
+      ownedProto_.generic_mapping_options().fix_parameters_before_scheduling());
+  generic->set_match_library_calls(
+      ownedProto_.generic_mapping_options().match_library_calls());
+  generic->set_inline_pointwise_temporaries(
+      ownedProto_.generic_mapping_options().inline_pointwise_temporaries());
+  res.ownedProto_.set_split_kernels(true);
+  res.ownedProto_.set_cooperative_kernels(false);
+  res.ownedProto_.set_vectorize_width(ownedProto_.vectorize_width());
+  res.ownedProto_.set_dp4a_packing(ownedProto_.dp4a_packing());
+  res.ownedProto_.set_math_precision(ownedProto_.math_precision());
+  *res.ownedProto_.mutable_precise_tensors() = ownedProto_.precise_tensors();
+  *res.ownedProto_.mutable_parametric_sizes() = ownedProto_.parametric_sizes();
+  *res.ownedProto_.mutable_size_buckets() = ownedProto_.size_buckets();
+  *res.ownedProto_.mutable_constant_inputs() = ownedProto_.constant_inputs();
+  if (ownedProto_.has_compiler_options()) {
+    *res.ownedProto_.mutable_compiler_options() =
+        ownedProto_.compiler_options();
+  } else {
+    res.ownedProto_.clear_compiler_options();
+  }
+  return res.modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::sizeBuckets(
+    const std::string& name,
+    const std::vector<int64_t>& upperBounds) {
+  CHECK(!name.empty()) << "expected a size parameter name";
+  CHECK_GT(upperBounds.size(), 0) << "expected at least one bucket for "
+                                  << name;
+  CHECK_GE(upperBounds.front(), 1) << "empty first bucket for " << name;
+  for (size_t i = 1; i < upperBounds.size(); ++i) {
+    CHECK_LT(upperBounds[i - 1], upperBounds[i])
+        << "expected increasing bucket bounds for " << name;
+  }
+  SizeBucketsProto* buckets = nullptr;
+  for (auto& b : *ownedProto_.mutable_size_buckets()) {
+    if (b.name() == name) {
+      buckets = &b;
+    }
+  }
+  if (!buckets) {
+    buckets = ownedProto_.add_size_buckets();
+    buckets->set_name(name);
+  }
+  buckets->clear_upper_bounds();
+  for (auto bound : upperBounds) {
+    buckets->add_upper_bounds(bound);
+  }
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::constantInputs(
+    const std::vector<uint32_t>& positions) {
+  ownedProto_.clear_constant_inputs();
+  for (auto pos : positions) {
+    ownedProto_.add_constant_inputs(pos);
+  }
+  return modified();
+}
+
+CudaMappingOptions& CudaMappingOptions::preciseTensors(
+    const std::vector<std::string>& names) {
+  ownedProto_.clear_precise_tensors();
+  for (const auto& name : names) {
+    ownedProto_.add_precise_tensors(name);
+  }
+  return modified();
+}
+
 //
 // Predefined strategies
 //
@@ -160,4 +333,15 @@ CudaMappingOptions::makeGroupConvolutionCudaMappingOptions() {
       .unroll(1);
 }
 
+CudaMappingOptions
+CudaMappingOptions::makeImplicitGemmConvolutionCudaMappingOptions() {
+  return makeUnmappedCudaMappingOptions()
+      .tile(1, 32, 4, 8, 16)
+      .mapToThreads(8, 4, 4)
+      .mapToBlocks(256, 256, 256)
+      .useSharedMemory(true)
+      .usePrivateMemory(true)
+      .unroll(8);
+}
+
 } // namespace tc
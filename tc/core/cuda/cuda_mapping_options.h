@@ -18,6 +18,8 @@
 #include <mapping_options.pb.h>
 
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -26,6 +28,7 @@
 
 #include "tc/core/flags.h"
 #include "tc/core/mapping_options.h"
+#include "tc/core/utils/hash.h"
 
 namespace tc {
 
@@ -147,10 +150,17 @@ class CudaMappingOptions {
   inline explicit CudaMappingOptions(const CudaMappingOptionsProto& buf);
   inline CudaMappingOptions& operator=(const CudaMappingOptions& options);
 
-  /// Compare with another message.
+  /// Compare with another message.  Options of different hashes compare
+  /// unequal without serializing them.
   inline bool operator==(const CudaMappingOptions& options) const;
   inline bool operator!=(const CudaMappingOptions& options) const;
 
+  /// Stable 64-bit hash of the serialized options, computed on first use
+  /// and kept until the next modifier.  Changes made directly through
+  /// generic, block or grid after the hash was computed are not seen: make
+  /// them before comparing or hashing the options, or through the modifiers.
+  inline uint64_t hash() const;
+
   /// Construct from a serialized protocol buffer message.
   inline explicit CudaMappingOptions(const std::string& str);
 
@@ -190,7 +200,91 @@ class CudaMappingOptions {
   inline CudaMappingOptions& useSharedMemory(bool b);
   inline CudaMappingOptions& usePrivateMemory(bool b);
   inline CudaMappingOptions& maxSharedMemory(uint64_t size);
+  inline CudaMappingOptions& useDynamicSharedMemory(bool b);
   inline CudaMappingOptions& unrollCopyShared(bool b);
+  inline CudaMappingOptions& doubleBufferShared(bool b);
+  inline CudaMappingOptions& warpShuffleReductions(bool b);
+  inline CudaMappingOptions& gridReductions(bool b);
+  inline CudaMappingOptions& useTensorCores(bool b);
+  inline CudaMappingOptions& splitKernels(bool b);
+  inline CudaMappingOptions& unrollPragma(bool b);
+  inline CudaMappingOptions& persistentBlocks(bool b);
+  inline CudaMappingOptions& separateFullTiles(bool b);
+  /// Copy to shared memory with cp.async on sm_80 and up
+  /// (see CudaMappingOptionsProto::async_copies)
+  inline CudaMappingOptions& asyncCopies(bool b);
+  /// Transpose the non-coalesced tensors promoted to shared memory
+  /// (see CudaMappingOptionsProto::transpose_shared)
+  inline CudaMappingOptions& transposeShared(bool b);
+  /// Run the stages of split kernels in one cooperative kernel
+  /// (see CudaMappingOptionsProto::cooperative_kernels)
+  inline CudaMappingOptions& cooperativeKernels(bool b);
+  /// Add the sums of the lanes of a warp updating the same element with a
+  /// single atomic addition
+  /// (see CudaMappingOptionsProto::warp_aggregated_atomics)
+  inline CudaMappingOptions& warpAggregatedAtomics(bool b);
+  /// Compute the sums of int8 products 4 terms at a time with __dp4a
+  /// (see CudaMappingOptionsProto::dp4a_packing)
+  inline CudaMappingOptions& dp4aPacking(Dp4aPacking packing);
+  /// Lower the float builtins and divisions to library calls or to fast
+  /// approximations (see CudaMappingOptionsProto::math_precision)
+  inline CudaMappingOptions& mathPrecision(MathPrecision precision);
+  /// Copy inputs to shared memory with float2 (width 2) or float4 (width 4)
+  /// vector accesses where safe (see CudaMappingOptionsProto::vectorize_width)
+  CudaMappingOptions& vectorizeWidth(uint32_t width);
+  /// Launch the blocks in groups of this many values of the second block
+  /// index for L2 locality (see CudaMappingOptionsProto::block_swizzle)
+  CudaMappingOptions& blockSwizzle(uint32_t group);
+  /// Compute this many instances of the outermost loop per block, along an
+  /// additional block dimension (see CudaMappingOptionsProto::batch_packing)
+  CudaMappingOptions& batchPacking(uint32_t instances);
+  /// Map this many outer parallel loops, linearized, to the first block
+  /// dimension (see CudaMappingOptionsProto::linearize_blocks)
+  CudaMappingOptions& linearizeBlocks(uint32_t members);
+  /// Map reductions over two loops to threadIdx.y and threadIdx.x together
+  /// (see CudaMappingOptionsProto::two_dim_reductions)
+  inline CudaMappingOptions& twoDimReductions(bool b);
+  /// Compute a tile of these sizes of the outer parallel loops of the point
+  /// band per thread (see CudaMappingOptionsProto::thread_tiling)
+  CudaMappingOptions& threadTile(const std::vector<uint64_t>& sizes);
+  /// Compute a sub-tile of these sizes of the block tile per warp, the
+  /// sub-tiles mapped to the last block dimension (see
+  /// CudaMappingOptionsProto::warp_tiling)
+  CudaMappingOptions& warpTile(const std::vector<uint64_t>& sizes);
+  /// Map the kernel-th kernel of split kernels with options instead of
+  /// these options, the kernels before it must have theirs (see
+  /// CudaMappingOptionsProto::kernel_options)
+  CudaMappingOptions& kernelOptions(
+      size_t kernel,
+      const CudaMappingOptions& options);
+  /// Keep the size parameter name symbolic over [min, max] instead of
+  /// specializing the kernel for its value (see
+  /// CudaMappingOptionsProto::parametric_sizes)
+  CudaMappingOptions&
+  parametricSize(const std::string& name, int64_t min, int64_t max);
+  /// Compile one kernel per bucket of values of the size parameter name,
+  /// given by their increasing inclusive upper bounds, e.g. powers of two
+  /// (see CudaMappingOptionsProto::size_buckets)
+  CudaMappingOptions& sizeBuckets(
+      const std::string& name,
+      const std::vector<int64_t>& upperBounds);
+  /// Bake the values at compilation of the inputs at these positions into
+  /// the kernels (see CudaMappingOptionsProto::constant_inputs)
+  CudaMappingOptions& constantInputs(const std::vector<uint32_t>& positions);
+  /// Keep the library calls and IEEE divisions in the statements writing
+  /// these tensors whatever the math precision (see
+  /// CudaMappingOptionsProto::precise_tensors)
+  CudaMappingOptions& preciseTensors(const std::vector<std::string>& names);
+  ///@}
+
+  /// Set compiler options
+  ///@{
+  inline CudaMappingOptions& maxRegisterCount(uint32_t count);
+  inline CudaMappingOptions& useFastMath(bool b);
+  inline CudaMappingOptions& jitOptimizationLevel(uint32_t level);
+  inline CudaMappingOptions& useLaunchBounds(
+      bool b,
+      uint32_t minBlocksPerMultiprocessor = 0);
   ///@}
 
   /// Static constructors for predefined strategies.
@@ -201,17 +295,25 @@ class CudaMappingOptions {
   static CudaMappingOptions makeMlpCudaMappingOptions();
   static CudaMappingOptions makeConvolutionCudaMappingOptions();
   static CudaMappingOptions makeGroupConvolutionCudaMappingOptions();
+  /// For makeConvolution2DImplicitGemmTc: tiles of filters and output
+  /// pixels, with the flattened reduction tiled like that of a matmul.
+  static CudaMappingOptions makeImplicitGemmConvolutionCudaMappingOptions();
   ///@}
 
   const CudaMappingOptionsProto& proto() const {
     return ownedProto_;
   }
 
+  /// The options the kernel-th kernel of split kernels is mapped with: its
+  /// kernel options if any, with the settings of the whole TC taken from
+  /// these options, these options otherwise.
+  CudaMappingOptions optionsOfKernel(size_t kernel) const;
+
 #define FORWARD_FUN(FUN_NAME)                         \
   template <typename... Args>                         \
   inline CudaMappingOptions& FUN_NAME(Args... args) { \
     generic.FUN_NAME(args...);                        \
-    return *this;                                     \
+    return modified();                                \
   }
 
   FORWARD_FUN(tile);
@@ -219,18 +321,27 @@ class CudaMappingOptions {
   FORWARD_FUN(fixParametersBeforeScheduling);
   FORWARD_FUN(tileImperfectlyNested);
   FORWARD_FUN(matchLibraryCalls);
+  FORWARD_FUN(inlinePointwiseTemporaries);
   FORWARD_FUN(scheduleFusionStrategy);
   FORWARD_FUN(outerScheduleFusionStrategy);
   FORWARD_FUN(outerScheduleAllowSkewing);
   FORWARD_FUN(outerSchedulePositiveOrthant);
+  FORWARD_FUN(outerScheduleNeverFuse);
   FORWARD_FUN(intraTileScheduleFusionStrategy);
   FORWARD_FUN(intraTileScheduleAllowSkewing);
   FORWARD_FUN(intraTileSchedulePositiveOrthant);
+  FORWARD_FUN(intraTileScheduleNeverFuse);
 
 #undef FORWARD_FUN
 
  private:
+  /// Drops the cached hash, returns *this for the modifiers.
+  inline CudaMappingOptions& modified();
+
   CudaMappingOptionsProto ownedProto_;
+  /// Cached result of hash(), 0 until computed.  Atomic so that const
+  /// options can be hashed from several threads.
+  mutable std::atomic<uint64_t> hash_{0};
 
  public:
   MappingOptionsView generic;
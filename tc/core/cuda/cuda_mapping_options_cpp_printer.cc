@@ -37,6 +37,144 @@ CudaMappingOptionsCppPrinter& operator<<(
     prn.printValueOption(
         "maxSharedMemory", cudaOptions.proto().max_shared_memory());
   }
+  if (cudaOptions.proto().use_dynamic_shared_memory()) {
+    prn.printBooleanOption("useDynamicSharedMemory", true);
+  }
+  if (cudaOptions.proto().double_buffer_shared()) {
+    prn.printBooleanOption("doubleBufferShared", true);
+  }
+  if (cudaOptions.proto().warp_shuffle_reductions()) {
+    prn.printBooleanOption("warpShuffleReductions", true);
+  }
+  if (cudaOptions.proto().grid_reductions()) {
+    prn.printBooleanOption("gridReductions", true);
+  }
+  if (cudaOptions.proto().use_tensor_cores()) {
+    prn.printBooleanOption("useTensorCores", true);
+  }
+  if (cudaOptions.proto().split_kernels()) {
+    prn.printBooleanOption("splitKernels", true);
+  }
+  if (cudaOptions.proto().unroll_pragma()) {
+    prn.printBooleanOption("unrollPragma", true);
+  }
+  if (cudaOptions.proto().persistent_blocks()) {
+    prn.printBooleanOption("persistentBlocks", true);
+  }
+  if (cudaOptions.proto().separate_full_tiles()) {
+    prn.printBooleanOption("separateFullTiles", true);
+  }
+  if (cudaOptions.proto().async_copies()) {
+    prn.printBooleanOption("asyncCopies", true);
+  }
+  if (cudaOptions.proto().transpose_shared()) {
+    prn.printBooleanOption("transposeShared", true);
+  }
+  if (cudaOptions.proto().cooperative_kernels()) {
+    prn.printBooleanOption("cooperativeKernels", true);
+  }
+  if (cudaOptions.proto().warp_aggregated_atomics()) {
+    prn.printBooleanOption("warpAggregatedAtomics", true);
+  }
+  if (cudaOptions.proto().dp4a_packing() != Dp4aPacking::NoDp4a) {
+    prn.printValueOption(
+        "dp4aPacking",
+        "tc::Dp4aPacking::" +
+            Dp4aPacking_Name(cudaOptions.proto().dp4a_packing()));
+  }
+  if (cudaOptions.proto().math_precision() != MathPrecision::CompilerMath) {
+    prn.printValueOption(
+        "mathPrecision",
+        "tc::MathPrecision::" +
+            MathPrecision_Name(cudaOptions.proto().math_precision()));
+  }
+  if (cudaOptions.proto().vectorize_width() != 1) {
+    prn.printValueOption(
+        "vectorizeWidth", cudaOptions.proto().vectorize_width());
+  }
+  if (cudaOptions.proto().block_swizzle() != 1) {
+    prn.printValueOption("blockSwizzle", cudaOptions.proto().block_swizzle());
+  }
+  if (cudaOptions.proto().batch_packing() != 1) {
+    prn.printValueOption("batchPacking", cudaOptions.proto().batch_packing());
+  }
+  if (cudaOptions.proto().linearize_blocks() != 1) {
+    prn.printValueOption(
+        "linearizeBlocks", cudaOptions.proto().linearize_blocks());
+  }
+  if (cudaOptions.proto().two_dim_reductions()) {
+    prn.printBooleanOption("twoDimReductions", true);
+  }
+  if (cudaOptions.proto().thread_tiling().sizes_size() > 0) {
+    const auto& sizes = cudaOptions.proto().thread_tiling().sizes();
+    prn.printListOption(
+        "threadTile", std::vector<uint64_t>(sizes.begin(), sizes.end()));
+  }
+  if (cudaOptions.proto().warp_tiling().sizes_size() > 0) {
+    const auto& sizes = cudaOptions.proto().warp_tiling().sizes();
+    prn.printListOption(
+        "warpTile", std::vector<uint64_t>(sizes.begin(), sizes.end()));
+  }
+  for (const auto& range : cudaOptions.proto().parametric_sizes()) {
+    std::stringstream ssRange;
+    ssRange << "\"" << range.name() << "\", " << range.min() << ", "
+            << range.max();
+    prn.printValueOption("parametricSize", ssRange.str());
+  }
+  for (const auto& buckets : cudaOptions.proto().size_buckets()) {
+    std::stringstream ssBuckets;
+    ssBuckets << "\"" << buckets.name() << "\", {";
+    for (int i = 0; i < buckets.upper_bounds_size(); ++i) {
+      ssBuckets << (i > 0 ? ", " : "") << buckets.upper_bounds(i);
+    }
+    ssBuckets << "}";
+    prn.printValueOption("sizeBuckets", ssBuckets.str());
+  }
+  if (cudaOptions.proto().constant_inputs_size() > 0) {
+    const auto& positions = cudaOptions.proto().constant_inputs();
+    prn.printListOption(
+        "constantInputs",
+        std::vector<uint32_t>(positions.begin(), positions.end()));
+  }
+  if (cudaOptions.proto().precise_tensors_size() > 0) {
+    std::stringstream ssNames;
+    ssNames << "{";
+    for (int i = 0; i < cudaOptions.proto().precise_tensors_size(); ++i) {
+      ssNames << (i > 0 ? ", " : "") << "\""
+              << cudaOptions.proto().precise_tensors(i) << "\"";
+    }
+    ssNames << "}";
+    prn.printValueOption("preciseTensors", ssNames.str());
+  }
+  for (int i = 0; i < cudaOptions.proto().kernel_options_size(); ++i) {
+    std::stringstream ssKernel;
+    ssKernel << i << ", "
+             << CudaMappingOptionsAsCpp(
+                    CudaMappingOptions(cudaOptions.proto().kernel_options(i)));
+    // The nested options are an argument, not a statement
+    auto kernel = ssKernel.str();
+    prn.printValueOption("kernelOptions", kernel.substr(0, kernel.rfind(';')));
+  }
+  if (cudaOptions.proto().has_compiler_options()) {
+    const auto& compilerOptions = cudaOptions.proto().compiler_options();
+    if (compilerOptions.max_register_count() != 0) {
+      prn.printValueOption(
+          "maxRegisterCount", compilerOptions.max_register_count());
+    }
+    if (not compilerOptions.use_fast_math()) {
+      prn.printBooleanOption("useFastMath", false);
+    }
+    if (compilerOptions.has_jit_optimization_level()) {
+      prn.printValueOption(
+          "jitOptimizationLevel", compilerOptions.jit_optimization_level());
+    }
+    if (compilerOptions.use_launch_bounds()) {
+      std::stringstream ssLaunchBounds;
+      ssLaunchBounds << "true, "
+                     << compilerOptions.min_blocks_per_multiprocessor();
+      prn.printValueOption("useLaunchBounds", ssLaunchBounds.str());
+    }
+  }
   prn.endStmt();
   return prn;
 }
@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_measurement.h"
+
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+#include <nvml.h>
+
+#include "tc/core/cuda/cuda.h"
+
+namespace tc {
+
+namespace {
+// The flush buffers are allocated once per device and never freed, like the
+// event pool of the timed launches.
+std::mutex flushBuffersMutex;
+std::unordered_map<int, std::pair<void*, size_t>> flushBuffers;
+
+std::pair<void*, size_t> flushBuffer(int device) {
+  std::lock_guard<std::mutex> lock(flushBuffersMutex);
+  auto it = flushBuffers.find(device);
+  if (it != flushBuffers.end()) {
+    return it->second;
+  }
+  auto size = CudaGPUInfo::GPUInfo().DeviceProperties(device).l2CacheSize;
+  void* buffer = nullptr;
+  if (size > 0) {
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&buffer, size));
+  }
+  return flushBuffers[device] = std::make_pair(buffer, size);
+}
+
+bool initNvml() {
+  static std::once_flag once;
+  static bool initialized = false;
+  std::call_once(once, []() {
+    auto status = nvmlInit_v2();
+    initialized = status == NVML_SUCCESS;
+    LOG_IF(WARNING, not initialized)
+        << "cannot query the GPU clocks: " << nvmlErrorString(status);
+  });
+  return initialized;
+}
+
+// The reasons of NVML, except idleness, which is the normal state of a
+// device between measurements.
+std::vector<std::string> throttleReasons(unsigned long long reasons) {
+  static const std::vector<std::pair<unsigned long long, const char*>> names{
+      {nvmlClocksThrottleReasonApplicationsClocksSetting,
+       "applications clocks setting"},
+      {nvmlClocksThrottleReasonSwPowerCap, "power cap"},
+      {nvmlClocksThrottleReasonHwSlowdown, "hardware slowdown"},
+      {nvmlClocksThrottleReasonSyncBoost, "sync boost"},
+      {nvmlClocksThrottleReasonSwThermalSlowdown, "software thermal slowdown"},
+      {nvmlClocksThrottleReasonHwThermalSlowdown, "hardware thermal slowdown"},
+      {nvmlClocksThrottleReasonHwPowerBrakeSlowdown, "power brake slowdown"},
+  };
+  std::vector<std::string> res;
+  for (const auto& name : names) {
+    if (reasons & name.first) {
+      res.push_back(name.second);
+    }
+  }
+  return res;
+}
+} // namespace
+
+void flushL2Cache(cudaStream_t stream) {
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  auto buffer = flushBuffer(device);
+  if (buffer.first) {
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaMemsetAsync(buffer.first, 0, buffer.second, stream));
+  }
+}
+
+CudaClockState queryClockState(int device) {
+  CudaClockState state;
+  if (device < 0) {
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  }
+  if (not initNvml()) {
+    return state;
+  }
+  // NVML numbers the devices by PCI bus, which need not be the order of
+  // CUDA_VISIBLE_DEVICES.
+  char busId[32];
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaDeviceGetPCIBusId(busId, sizeof(busId), device));
+  nvmlDevice_t handle;
+  if (nvmlDeviceGetHandleByPciBusId_v2(busId, &handle) != NVML_SUCCESS) {
+    return state;
+  }
+  unsigned long long reasons = 0;
+  if (nvmlDeviceGetClockInfo(handle, NVML_CLOCK_SM, &state.smClockMHz) !=
+          NVML_SUCCESS or
+      nvmlDeviceGetMaxClockInfo(handle, NVML_CLOCK_SM, &state.maxSmClockMHz) !=
+          NVML_SUCCESS or
+      nvmlDeviceGetClockInfo(handle, NVML_CLOCK_MEM, &state.memoryClockMHz) !=
+          NVML_SUCCESS or
+      nvmlDeviceGetMaxClockInfo(
+          handle, NVML_CLOCK_MEM, &state.maxMemoryClockMHz) != NVML_SUCCESS) {
+    return CudaClockState();
+  }
+  // Not every device reports its temperature and throttle reasons.
+  nvmlDeviceGetTemperature(handle, NVML_TEMPERATURE_GPU, &state.temperatureC);
+  nvmlDeviceGetCurrentClocksThrottleReasons(handle, &reasons);
+  state.throttleReasons = throttleReasons(reasons);
+  state.known = true;
+  return state;
+}
+
+std::ostream& operator<<(std::ostream& out, const CudaClockState& state) {
+  if (not state.known) {
+    return out << "unknown clocks";
+  }
+  out << "sm " << state.smClockMHz << "/" << state.maxSmClockMHz
+      << "MHz, memory " << state.memoryClockMHz << "/"
+      << state.maxMemoryClockMHz << "MHz, " << state.temperatureC << "C";
+  if (state.throttled()) {
+    out << ", throttled by";
+    for (size_t i = 0; i < state.throttleReasons.size(); ++i) {
+      out << (i > 0 ? "," : "") << " " << state.throttleReasons[i];
+    }
+  }
+  return out;
+}
+
+} // namespace tc
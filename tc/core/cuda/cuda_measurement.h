@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <driver_types.h> // cuda driver types
+
+namespace tc {
+
+// Evicts the data of the previous runs from the L2 cache of the current
+// device by writing, on stream, a buffer of the size of the cache allocated
+// on first use, so that the next run reads its inputs from the device
+// memory, as a kernel of a serving pipeline does after the other layers
+// went through the cache.  See --benchmark_cold_cache.
+void flushL2Cache(cudaStream_t stream = 0);
+
+// The clocks of a device and why they are below their maximum, as reported
+// by NVML when the measurements are taken, so that the measurements of a
+// throttled device can be told apart.
+struct CudaClockState {
+  // Whether NVML could query the device, the other fields are 0 otherwise.
+  bool known = false;
+  unsigned smClockMHz = 0;
+  unsigned maxSmClockMHz = 0;
+  unsigned memoryClockMHz = 0;
+  unsigned maxMemoryClockMHz = 0;
+  unsigned temperatureC = 0;
+  // The reasons for running below the maximal clocks other than idleness,
+  // e.g. "power cap" or "hardware thermal slowdown".
+  std::vector<std::string> throttleReasons;
+
+  bool throttled() const {
+    return not throttleReasons.empty();
+  }
+};
+
+// The clock state of device, the current one if negative.
+CudaClockState queryClockState(int device = -1);
+
+std::ostream& operator<<(std::ostream& out, const CudaClockState& state);
+
+} // namespace tc
@@ -0,0 +1,341 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_out_of_core_execution.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_data_parallel.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/dlpack.h"
+
+namespace tc {
+
+namespace {
+// The metadata of the packed device tensor of the sizes of info, with "rows"
+// rows if split.
+DLTensorUPtr makeChunk(const DLTensor* info, bool split, int64_t rows) {
+  std::vector<int64_t> sizes(info->shape, info->shape + info->ndim);
+  if (split) {
+    sizes[0] = rows;
+  }
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  return dlutils::makeDLTensorWithSizes(
+      dlutils::getGPUDLContext(device), info->dtype, sizes);
+}
+
+template <typename T>
+T* deviceAlloc(size_t bytes) {
+  void* res;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMalloc(&res, bytes));
+  return static_cast<T*>(res);
+}
+
+template <typename T>
+T* pinnedAlloc(size_t bytes) {
+  void* res;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMallocHost(&res, bytes));
+  return static_cast<T*>(res);
+}
+} // namespace
+
+std::unique_ptr<CudaOutOfCoreExecution> CudaOutOfCoreExecution::compile(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const CudaMappingOptions& options,
+    size_t deviceMemoryBudget) {
+  auto split = findDataParallelSplit(engine, name, options);
+  if (!split) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << name << " cannot be split along the first dimension";
+    return nullptr;
+  }
+  CHECK_EQ(inputs.size(), split->splitInputs.size());
+
+  // The split dimensions must all have the same size and the chunks must be
+  // contiguous.
+  int64_t rows = -1;
+  size_t wholeBytes = 0;
+  size_t bytesPerRow = 0;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (!dlutils::isPacked(*inputs[i])) {
+      return nullptr;
+    }
+    if (not split->splitInputs[i]) {
+      wholeBytes += dlutils::numberBytes(*inputs[i]);
+      continue;
+    }
+    if (rows >= 0 and inputs[i]->shape[0] != rows) {
+      return nullptr;
+    }
+    rows = inputs[i]->shape[0];
+    bytesPerRow += dlutils::rowBytes(*inputs[i]);
+  }
+  auto outputs = engine.inferOutputTensorInfo(name, inputs);
+  for (auto output : outputs) {
+    if (output->ndim == 0 or output->shape[0] != rows) {
+      return nullptr;
+    }
+    bytesPerRow += dlutils::rowBytes(*output);
+  }
+  if (rows <= 0) {
+    return nullptr;
+  }
+  // Double buffered rows next to the whole inputs
+  if (wholeBytes + 2 * bytesPerRow > deviceMemoryBudget) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "a row of " << name << " does not fit " << deviceMemoryBudget
+        << " bytes";
+    return nullptr;
+  }
+  auto chunkRows = std::min<int64_t>(
+      rows, (deviceMemoryBudget - wholeBytes) / (2 * bytesPerRow));
+
+  std::unique_ptr<CudaOutOfCoreExecution> res(
+      new CudaOutOfCoreExecution(engine));
+  res->splitInputs_ = split->splitInputs;
+  res->inputsInfo_ = dlutils::makeDLTensorVector(inputs);
+  res->outputsInfo_ = dlutils::makeDLTensorVector(outputs);
+  res->rows_ = rows;
+  res->chunkRows_ = chunkRows;
+
+  auto serializedOptions = options.toProtobufSerializedString();
+  auto makeKernel = [&](Kernel& kernel, int64_t kernelRows) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      kernel.inputs.push_back(
+          makeChunk(inputs[i], split->splitInputs[i], kernelRows));
+    }
+    kernel.handle = engine.compile(
+        name, dlutils::extractRawPtrs(kernel.inputs), serializedOptions);
+    for (auto output : engine.inferOutputTensorInfo(
+             name, dlutils::extractRawPtrs(kernel.inputs))) {
+      CHECK_EQ(output->shape[0], kernelRows);
+      kernel.outputs.push_back(makeChunk(output, false, kernelRows));
+    }
+  };
+  makeKernel(res->full_, chunkRows);
+  // The last chunk holds the remaining rows.
+  makeKernel(res->last_, rows - (res->numberChunks() - 1) * chunkRows);
+
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    res->wholeInputs_.push_back(
+        split->splitInputs[i]
+            ? nullptr
+            : deviceAlloc<char>(dlutils::numberBytes(*inputs[i])));
+  }
+  for (auto& buffers : res->buffers_) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      bool isSplit = split->splitInputs[i];
+      auto bytes = chunkRows * dlutils::rowBytes(*inputs[i]);
+      buffers.hostInputs.push_back(
+          isSplit ? pinnedAlloc<char>(bytes) : nullptr);
+      buffers.inputs.push_back(isSplit ? deviceAlloc<char>(bytes) : nullptr);
+    }
+    for (auto output : outputs) {
+      auto bytes = chunkRows * dlutils::rowBytes(*output);
+      buffers.hostOutputs.push_back(pinnedAlloc<char>(bytes));
+      buffers.outputs.push_back(deviceAlloc<char>(bytes));
+    }
+    for (auto event :
+         {&buffers.copiedIn, &buffers.copiedOut, &buffers.computed}) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(
+          cudaEventCreateWithFlags(event, cudaEventDisableTiming));
+    }
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaStreamCreateWithFlags(&res->copyStream_, cudaStreamNonBlocking));
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaStreamCreateWithFlags(&res->computeStream_, cudaStreamNonBlocking));
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << name << " run out of core in " << res->numberChunks()
+      << " chunks of " << chunkRows << " rows";
+  return res;
+}
+
+CudaOutOfCoreExecution::~CudaOutOfCoreExecution() {
+  // Errors are ignored, the destructor must not throw.
+  for (auto buffer : wholeInputs_) {
+    cudaFree(buffer);
+  }
+  for (auto& buffers : buffers_) {
+    for (auto buffer : buffers.hostInputs) {
+      cudaFreeHost(buffer);
+    }
+    for (auto buffer : buffers.hostOutputs) {
+      cudaFreeHost(buffer);
+    }
+    for (auto buffer : buffers.inputs) {
+      cudaFree(buffer);
+    }
+    for (auto buffer : buffers.outputs) {
+      cudaFree(buffer);
+    }
+    for (auto event : {buffers.copiedIn, buffers.copiedOut, buffers.computed}) {
+      if (event) {
+        cudaEventDestroy(event);
+      }
+    }
+  }
+  if (copyStream_) {
+    cudaStreamDestroy(copyStream_);
+  }
+  if (computeStream_) {
+    cudaStreamDestroy(computeStream_);
+  }
+}
+
+void CudaOutOfCoreExecution::copyIn(
+    const std::vector<const DLTensor*>& inputs,
+    int64_t chunk,
+    Buffers& buffers) {
+  auto begin = chunk * chunkRows_;
+  auto rows = std::min(chunkRows_, rows_ - begin);
+  // The previous copy from the staging buffers is done and the kernel
+  // reading the device buffers as well.
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventSynchronize(buffers.copiedIn));
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaStreamWaitEvent(copyStream_, buffers.computed, 0));
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (not splitInputs_[i]) {
+      continue;
+    }
+    auto bytes = rows * dlutils::rowBytes(*inputs[i]);
+    std::memcpy(
+        buffers.hostInputs[i],
+        dlutils::dataPtr(*inputs[i]) + begin * dlutils::rowBytes(*inputs[i]),
+        bytes);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+        buffers.inputs[i],
+        buffers.hostInputs[i],
+        bytes,
+        cudaMemcpyHostToDevice,
+        copyStream_));
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(buffers.copiedIn, copyStream_));
+}
+
+void CudaOutOfCoreExecution::drain(
+    const std::vector<DLTensor*>& outputs,
+    Buffers& buffers) {
+  if (buffers.pendingChunk < 0) {
+    return;
+  }
+  auto begin = buffers.pendingChunk * chunkRows_;
+  auto rows = std::min(chunkRows_, rows_ - begin);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventSynchronize(buffers.copiedOut));
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    std::memcpy(
+        dlutils::dataPtr(*outputs[i]) + begin * dlutils::rowBytes(*outputs[i]),
+        buffers.hostOutputs[i],
+        rows * dlutils::rowBytes(*outputs[i]));
+  }
+  buffers.pendingChunk = -1;
+}
+
+Duration CudaOutOfCoreExecution::run(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    bool profile) {
+  CHECK_EQ(inputs.size(), inputsInfo_.size());
+  CHECK_EQ(outputs.size(), outputsInfo_.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    CHECK(compareDLTensorMetadata(*inputs[i], *inputsInfo_[i]))
+        << "input " << i << " differs from the compilation";
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    CHECK(compareDLTensorMetadata(*outputs[i], *outputsInfo_[i]))
+        << "output " << i << " differs from the compilation";
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (splitInputs_[i]) {
+      continue;
+    }
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+        wholeInputs_[i],
+        dlutils::dataPtr(*inputs[i]),
+        dlutils::numberBytes(*inputs[i]),
+        cudaMemcpyHostToDevice,
+        copyStream_));
+  }
+
+  auto n = static_cast<int64_t>(numberChunks());
+  copyIn(inputs, 0, buffers_[0]);
+  for (int64_t c = 0; c < n; ++c) {
+    auto& buffers = buffers_[c % 2];
+    // The next chunk is copied in while this one is computed.
+    if (c + 1 < n) {
+      copyIn(inputs, c + 1, buffers_[(c + 1) % 2]);
+    }
+
+    auto& kernel = c + 1 < n ? full_ : last_;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      kernel.inputs[i]->data =
+          splitInputs_[i] ? buffers.inputs[i] : wholeInputs_[i];
+    }
+    std::vector<DLTensor*> kernelOutputs;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      kernel.outputs[i]->data = buffers.outputs[i];
+      kernelOutputs.push_back(kernel.outputs[i].get());
+    }
+    // The outputs of the chunk before last are copied out of the buffers.
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaStreamWaitEvent(computeStream_, buffers.copiedIn, 0));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaStreamWaitEvent(computeStream_, buffers.copiedOut, 0));
+    engine_.run(
+        kernel.handle,
+        dlutils::extractRawPtrs(kernel.inputs),
+        kernelOutputs,
+        false,
+        [](const CudaTcExecutor*) { return false; },
+        CudaRuntimeInformation(computeStream_));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaEventRecord(buffers.computed, computeStream_));
+
+    drain(outputs, buffers);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaStreamWaitEvent(copyStream_, buffers.computed, 0));
+    auto rows = std::min(chunkRows_, rows_ - c * chunkRows_);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpyAsync(
+          buffers.hostOutputs[i],
+          buffers.outputs[i],
+          rows * dlutils::rowBytes(*outputs[i]),
+          cudaMemcpyDeviceToHost,
+          copyStream_));
+    }
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaEventRecord(buffers.copiedOut, copyStream_));
+    buffers.pendingChunk = c;
+  }
+  // In the order of the chunks
+  drain(outputs, buffers_[n % 2]);
+  drain(outputs, buffers_[(n + 1) % 2]);
+  if (not profile) {
+    return Duration::max();
+  }
+  return std::chrono::high_resolution_clock::now() - start;
+}
+
+} // namespace tc
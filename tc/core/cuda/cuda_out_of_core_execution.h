@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+//
+// A TC on host tensors too large for the device memory, run on chunks of
+// rows that fit a budget of device memory.  The chunks are the slices of
+// the data-parallel split of the TC along the first dimension (see
+// polyhedral::findDataParallelSplit): a chunk of rows of the outputs only
+// reads the same rows of the split inputs, the other inputs are copied to
+// the device whole, once per run.
+// The chunks are double buffered: the rows of the next chunk are copied to
+// the device, through pinned staging buffers, on a copy stream while the
+// kernel computes the current chunk on a compute stream, and the rows of
+// the outputs are copied back on the copy stream.
+//
+class CudaOutOfCoreExecution {
+ public:
+  // Compiles the kernels of the chunks of inputs with options, the largest
+  // chunks whose double buffers and whole inputs fit deviceMemoryBudget
+  // bytes.  Returns null if the TC cannot be split or if a single row does
+  // not fit.
+  static std::unique_ptr<CudaOutOfCoreExecution> compile(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const CudaMappingOptions& options,
+      size_t deviceMemoryBudget);
+
+  // Frees the buffers, streams and events, ignoring errors.
+  ~CudaOutOfCoreExecution();
+
+  CudaOutOfCoreExecution(const CudaOutOfCoreExecution&) = delete;
+  CudaOutOfCoreExecution& operator=(const CudaOutOfCoreExecution&) = delete;
+
+  // Inputs and outputs are packed host tensors of the sizes of the
+  // compilation.  The run returns once the outputs are written, with its
+  // wall-clock time if profile is set, Duration::max() otherwise.  Runs of
+  // the same execution must not be concurrent, they share the buffers.
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      bool profile = false);
+
+  size_t numberChunks() const {
+    return (rows_ + chunkRows_ - 1) / chunkRows_;
+  }
+
+  int64_t chunkRows() const {
+    return chunkRows_;
+  }
+
+ private:
+  // One of the two sets of buffers the chunks alternate between.
+  struct Buffers {
+    // Pinned host copies of the rows of the split inputs and of the outputs
+    std::vector<char*> hostInputs;
+    std::vector<char*> hostOutputs;
+    // Device rows of the split inputs and of the outputs
+    std::vector<char*> inputs;
+    std::vector<char*> outputs;
+    // Recorded on the copy stream once the inputs are copied in and the
+    // outputs copied out, on the compute stream once the kernel is done.
+    cudaEvent_t copiedIn = nullptr;
+    cudaEvent_t copiedOut = nullptr;
+    cudaEvent_t computed = nullptr;
+    // The chunk whose outputs are pending in hostOutputs, -1 if none.
+    int64_t pendingChunk = -1;
+  };
+
+  explicit CudaOutOfCoreExecution(ExecutionEngine<CudaTcExecutor>& engine)
+      : engine_(engine) {}
+
+  // The kernel of a number of rows and the metadata of its chunks, their
+  // data set by each run.
+  struct Kernel {
+    size_t handle;
+    std::vector<DLTensorUPtr> inputs;
+    std::vector<DLTensorUPtr> outputs;
+  };
+
+  // Queue the copy of the rows of chunk to buffers.
+  void copyIn(
+      const std::vector<const DLTensor*>& inputs,
+      int64_t chunk,
+      Buffers& buffers);
+  // Wait for the outputs pending in buffers and write them to outputs.
+  void drain(const std::vector<DLTensor*>& outputs, Buffers& buffers);
+
+  ExecutionEngine<CudaTcExecutor>& engine_;
+  std::vector<bool> splitInputs_;
+  std::vector<DLTensorUPtr> inputsInfo_;
+  std::vector<DLTensorUPtr> outputsInfo_;
+  int64_t rows_;
+  int64_t chunkRows_;
+  // The kernels of the full chunks and of the last one, which may be
+  // shorter
+  Kernel full_;
+  Kernel last_;
+  // Device copies of the inputs that are not split
+  std::vector<char*> wholeInputs_;
+  Buffers buffers_[2];
+  cudaStream_t copyStream_ = nullptr;
+  cudaStream_t computeStream_ = nullptr;
+};
+
+} // namespace tc
@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -24,11 +25,38 @@
 #include "tc/core/cuda/cuda_rtc.h"
 #include "tc/core/flags.h"
 #include "tc/core/scope_guard.h"
+#include "tc/core/utils/time.h"
 
 namespace tc {
-std::mutex nvrtc_mutex;
 
-CudaRTCFunction::CudaRTCFunction() {}
+namespace {
+// NVRTC programs are independent of each other, the driver calls made while
+// compiling (querying the device) are thread-safe.  Only taken with
+// FLAGS_nvrtc_serialize_compilation.
+std::mutex nvrtcMutex;
+
+std::mutex compileTimingsMutex;
+std::unordered_map<std::thread::id, CudaRTCFunction::CompileTimings>
+    compileTimings;
+
+// The modules loaded by all the functions, as (function, device) pairs.
+std::mutex loadedModulesMutex;
+std::vector<std::pair<const CudaRTCFunction*, size_t>> loadedModules;
+std::atomic<size_t> numberEvictedModules{0};
+} // namespace
+
+CudaRTCFunction::CudaRTCFunction()
+    : activeLaunches_(0),
+      lastLaunch_(0),
+      pinned_(false),
+      hasAttributes_(false),
+      maxDynamicSharedMemory_(0),
+      cooperative_(false),
+      jitOptimizationLevel_(-1) {
+  for (auto& kernel : perGpuKernel_) {
+    kernel.store(nullptr);
+  }
+}
 
 CudaRTCFunction::~CudaRTCFunction() {
   if (!cleared_) {
@@ -38,63 +66,250 @@ CudaRTCFunction::~CudaRTCFunction() {
 }
 
 void CudaRTCFunction::clear() {
+  std::lock_guard<std::mutex> lg(moduleMutex_);
   if (!cleared_) {
+    {
+      std::lock_guard<std::mutex> lock(loadedModulesMutex);
+      loadedModules.erase(
+          std::remove_if(
+              loadedModules.begin(),
+              loadedModules.end(),
+              [this](const std::pair<const CudaRTCFunction*, size_t>& m) {
+                return m.first == this;
+              }),
+          loadedModules.end());
+    }
     for (auto kvp : perGpuModule_) {
-      WithDevice(kvp.first);
+      WithDevice wd(kvp.first);
+      perGpuKernel_[kvp.first].store(nullptr);
       TC_CUDA_DRIVERAPI_ENFORCE(cuModuleUnload(kvp.second));
     }
+    perGpuModule_.clear();
     cleared_ = true;
   }
 }
 
+size_t CudaRTCFunction::NumberLoadedModules() {
+  std::lock_guard<std::mutex> lock(loadedModulesMutex);
+  return loadedModules.size();
+}
+
+size_t CudaRTCFunction::NumberEvictedModules() {
+  return numberEvictedModules.load();
+}
+
+bool CudaRTCFunction::unloadIfIdle(size_t dev) const {
+  // Pairs with launchKernel, which counts itself as active before reading
+  // the kernel: either the launch sees no kernel and reloads the module, or
+  // it is seen as active here.
+  auto kernel = perGpuKernel_[dev].exchange(nullptr);
+  if (activeLaunches_.load() != 0) {
+    perGpuKernel_[dev].store(kernel);
+    return false;
+  }
+  WithDevice wd(dev);
+  // Kernels launched earlier may still be running.
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  TC_CUDA_DRIVERAPI_ENFORCE(cuModuleUnload(perGpuModule_.at(dev)));
+  perGpuModule_.erase(dev);
+  return true;
+}
+
+void CudaRTCFunction::evictModules(const CudaRTCFunction* loading) {
+  std::lock_guard<std::mutex> lock(loadedModulesMutex);
+  auto max = FLAGS_cuda_max_loaded_modules;
+  if (max == 0 || loadedModules.size() <= max) {
+    return;
+  }
+  auto candidates = loadedModules;
+  std::sort(
+      candidates.begin(),
+      candidates.end(),
+      [](const std::pair<const CudaRTCFunction*, size_t>& a,
+         const std::pair<const CudaRTCFunction*, size_t>& b) {
+        return a.first->lastLaunch_.load(std::memory_order_relaxed) <
+            b.first->lastLaunch_.load(std::memory_order_relaxed);
+      });
+  for (const auto& m : candidates) {
+    if (loadedModules.size() <= max) {
+      break;
+    }
+    const auto* function = m.first;
+    if (function == loading || function->pinned_.load()) {
+      continue;
+    }
+    // Never wait for a function that is loading a module or being cleared,
+    // it may be waiting for loadedModulesMutex.
+    std::unique_lock<std::mutex> functionLock(
+        function->moduleMutex_, std::try_to_lock);
+    if (!functionLock.owns_lock() || !function->unloadIfIdle(m.second)) {
+      continue;
+    }
+    loadedModules.erase(
+        std::find(loadedModules.begin(), loadedModules.end(), m));
+    ++numberEvictedModules;
+  }
+}
+
+std::string CudaRTCFunction::CurrentDeviceArchitecture() {
+  return CudaGPUInfo::GPUInfo().GetCudaDeviceArch();
+}
+
+std::string CudaRTCFunction::CurrentDeviceRealArchitecture() {
+  auto arch = CurrentDeviceArchitecture();
+  return "sm_" + arch.substr(arch.find('_') + 1);
+}
+
+std::string CudaRTCFunction::LinkCubin(
+    const std::string& ptx,
+    const std::string& arch,
+    const CudaCompilerOptions& options) {
+  CHECK_EQ(arch.compare(0, 3, "sm_"), 0)
+      << "expected a real architecture (e.g. sm_70), got " << arch;
+  // The CUjit_target values are the compute capabilities, e.g. 70 for sm_70.
+  auto target = std::stoul(arch.substr(3));
+  std::vector<CUjit_option> jitOptions{CU_JIT_TARGET};
+  std::vector<void*> jitValues{
+      reinterpret_cast<void*>(static_cast<uintptr_t>(target))};
+  if (options.jitOptimizationLevel >= 0) {
+    jitOptions.push_back(CU_JIT_OPTIMIZATION_LEVEL);
+    jitValues.push_back(reinterpret_cast<void*>(
+        static_cast<uintptr_t>(options.jitOptimizationLevel)));
+  }
+
+  // The linker needs a context, make sure the primary one exists.
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaFree(0));
+  CUlinkState state;
+  TC_CUDA_DRIVERAPI_ENFORCE(cuLinkCreate(
+      jitOptions.size(), jitOptions.data(), jitValues.data(), &state));
+  ScopeGuard destroyState([&]() { cuLinkDestroy(state); });
+  // cuLinkAddData expects the PTX string with its terminating NUL.
+  std::vector<char> image(ptx.begin(), ptx.end());
+  if (image.empty() || image.back() != '\0') {
+    image.push_back('\0');
+  }
+  TC_CUDA_DRIVERAPI_ENFORCE(cuLinkAddData(
+      state,
+      CU_JIT_INPUT_PTX,
+      image.data(),
+      image.size(),
+      "tc_kernel",
+      0,
+      nullptr,
+      nullptr));
+  void* cubin;
+  size_t cubinSize;
+  TC_CUDA_DRIVERAPI_ENFORCE(cuLinkComplete(state, &cubin, &cubinSize));
+  // The cubin belongs to the link state.
+  return std::string(static_cast<const char*>(cubin), cubinSize);
+}
+
+std::shared_ptr<CudaRTCFunction> CudaRTCFunction::Load(
+    const std::string& name,
+    const std::string& ptx,
+    const CudaCompilerOptions& options) {
+  std::shared_ptr<CudaRTCFunction> res(new CudaRTCFunction());
+  res->specializedName = name;
+  res->jitOptimizationLevel_ = options.jitOptimizationLevel;
+  res->cleared_ = false;
+  res->nvrtc_ptx = std::vector<char>(ptx.begin(), ptx.end());
+  // cuModuleLoadDataEx expects a NUL terminated PTX string.
+  if (res->nvrtc_ptx.empty() || res->nvrtc_ptx.back() != '\0') {
+    res->nvrtc_ptx.push_back('\0');
+  }
+  return res;
+}
+
+std::unordered_map<std::thread::id, CudaRTCFunction::CompileTimings>
+CudaRTCFunction::PerThreadCompileTimings() {
+  std::lock_guard<std::mutex> lock(compileTimingsMutex);
+  return compileTimings;
+}
+
+void CudaRTCFunction::ResetCompileTimings() {
+  std::lock_guard<std::mutex> lock(compileTimingsMutex);
+  compileTimings.clear();
+}
+
 std::shared_ptr<CudaRTCFunction> CudaRTCFunction::Compile(
     const std::string& name,
-    const std::string& source) {
+    const std::string& source,
+    const CudaCompilerOptions& options) {
+  auto start = std::chrono::high_resolution_clock::now();
+  auto waited = Duration::zero();
+  ScopeGuard recordTimings([&]() {
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::lock_guard<std::mutex> lock(compileTimingsMutex);
+    auto& timings = compileTimings[std::this_thread::get_id()];
+    ++timings.numberCompilations;
+    timings.compileTime += elapsed;
+    timings.waitTime += waited;
+  });
+
   std::shared_ptr<CudaRTCFunction> res(new CudaRTCFunction());
   res->specializedName = name;
+  res->jitOptimizationLevel_ = options.jitOptimizationLevel;
   res->cleared_ = false;
 
   if (FLAGS_debug_tc_mapper) {
     LOG(INFO) << "NVRTC function source:\n" << source;
   }
   // Actually do the compiling.
+  // The profilers report the lines of the source under the program name.
   nvrtcProgram prog;
-  TC_NVRTC_CHECK(
-      nvrtcCreateProgram(&prog, source.c_str(), nullptr, 0, nullptr, nullptr));
-
-  // Get the architecture of the current device.
-  int device, minor, major;
-  CUdevice deviceHandle;
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
-  TC_CUDA_DRIVERAPI_ENFORCE(cuDeviceGet(&deviceHandle, device));
-  TC_CUDA_DRIVERAPI_ENFORCE(cuDeviceGetAttribute(
-      &major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, deviceHandle));
-  TC_CUDA_DRIVERAPI_ENFORCE(cuDeviceGetAttribute(
-      &minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, deviceHandle));
-
-  std::stringstream arch_param;
-  arch_param << "--gpu-architecture=compute_" << major << minor;
-  std::string arch = arch_param.str();
+  std::string programName = name + ".cu";
+  TC_NVRTC_CHECK(nvrtcCreateProgram(
+      &prog,
+      source.c_str(),
+      FLAGS_cuda_line_info ? programName.c_str() : nullptr,
+      0,
+      nullptr,
+      nullptr));
+
+  // Get the architecture of the current device unless one is requested.
+  std::string arch = std::string("--gpu-architecture=") +
+      (options.architecture.empty() ? CurrentDeviceArchitecture()
+                                    : options.architecture);
 
   // Compile the program.
   const char* nvrtc_debug_opts[] = {"-G", "-lineinfo"};
   std::string cudaHome = std::string("-I ") + std::string(CUDA_HOME);
   std::string cubHome = std::string("-I ") + std::string(CUB_HOME);
-  std::vector<const char*> nvrtcts = {arch.c_str(),
-                                      "--use_fast_math",
-                                      "-std=c++11",
-                                      "-default-device",
-                                      "-DNVRTC_CUB=1",
-                                      cudaHome.c_str(),
-                                      cubHome.c_str()};
+  std::vector<const char*> nvrtcts = {
+      arch.c_str(), "-std=c++11", "-default-device", cudaHome.c_str()};
+  // Only the sources including CUB, e.g. for block reductions, are compiled
+  // with its include path and configuration
+  if (source.find("cub/nvrtc_cub.cuh") != std::string::npos) {
+    nvrtcts.push_back("-DNVRTC_CUB=1");
+    nvrtcts.push_back(cubHome.c_str());
+  }
+  if (options.useFastMath) {
+    nvrtcts.push_back("--use_fast_math");
+  }
+  std::string maxRegisterCount;
+  if (options.maxRegisterCount > 0) {
+    maxRegisterCount =
+        "--maxrregcount=" + std::to_string(options.maxRegisterCount);
+    nvrtcts.push_back(maxRegisterCount.c_str());
+  }
   if (FLAGS_debug_cuda) {
     nvrtcts.push_back(nvrtc_debug_opts[0]);
     nvrtcts.push_back(nvrtc_debug_opts[1]);
+  } else if (FLAGS_cuda_line_info) {
+    // Line information only, the code is optimized as usual.
+    nvrtcts.push_back(nvrtc_debug_opts[1]);
+  }
+  std::unique_lock<std::mutex> serialize(nvrtcMutex, std::defer_lock);
+  if (FLAGS_nvrtc_serialize_compilation) {
+    auto beforeLock = std::chrono::high_resolution_clock::now();
+    serialize.lock();
+    waited = std::chrono::high_resolution_clock::now() - beforeLock;
   }
-  // TODO: Use me
-  // const char* nvrtc_tune_options = {"--maxregcount=32"};
   nvrtcResult compile_result =
       nvrtcCompileProgram(prog, nvrtcts.size(), nvrtcts.data());
+  if (serialize.owns_lock()) {
+    serialize.unlock();
+  }
   if (compile_result != NVRTC_SUCCESS) {
     size_t log_size;
     TC_NVRTC_CHECK(nvrtcGetProgramLogSize(prog, &log_size));
@@ -126,27 +341,125 @@ std::ostream& operator<<(std::ostream& os, const std::array<T, 3>& a) {
 
 } // namespace
 
-Duration CudaRTCFunction::Launch(
+CUfunction CudaRTCFunction::DeviceFunction() const {
+  int dev;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&dev));
+  CHECK(dev < kMaxGpus) << "device " << dev << " out of range";
+  auto kernel = perGpuKernel_[dev].load();
+  if (kernel) {
+    return kernel;
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(moduleMutex_);
+    kernel = perGpuKernel_[dev].load(std::memory_order_relaxed);
+    if (kernel) {
+      return kernel;
+    }
+    kernel = loadModule(dev);
+  }
+  evictModules(this);
+  return kernel;
+}
+
+std::ostream& operator<<(std::ostream& os, const CudaKernelAttributes& a) {
+  os << "registers: " << a.numRegisters << " local memory: " << a.localBytes
+     << " static shared memory: " << a.staticSharedBytes
+     << " max threads per block: " << a.maxThreadsPerBlock;
+  return os;
+}
+
+CudaKernelAttributes CudaRTCFunction::Attributes() const {
+  {
+    std::lock_guard<std::mutex> lg(moduleMutex_);
+    if (hasAttributes_) {
+      return attributes_;
+    }
+  }
+  DeviceFunction();
+  std::lock_guard<std::mutex> lg(moduleMutex_);
+  CHECK(hasAttributes_) << "no attributes after loading " << specializedName;
+  return attributes_;
+}
+
+void CudaRTCFunction::SetAttributes(const CudaKernelAttributes& attributes) {
+  std::lock_guard<std::mutex> lg(moduleMutex_);
+  attributes_ = attributes;
+  hasAttributes_ = true;
+}
+
+void CudaRTCFunction::Warmup(const std::vector<int>& devices) const {
+  for (auto device : devices) {
+    WithDevice wd(device);
+    DeviceFunction();
+  }
+}
+
+CUfunction CudaRTCFunction::loadModule(size_t dev) const {
+  CUfunction kernel;
+  CUmodule module;
+  if (jitOptimizationLevel_ >= 0) {
+    CUjit_option option = CU_JIT_OPTIMIZATION_LEVEL;
+    void* value = reinterpret_cast<void*>(
+        static_cast<uintptr_t>(jitOptimizationLevel_));
+    TC_CUDA_DRIVERAPI_ENFORCE(
+        cuModuleLoadDataEx(&module, nvrtc_ptx.data(), 1, &option, &value));
+  } else {
+    TC_CUDA_DRIVERAPI_ENFORCE(
+        cuModuleLoadDataEx(&module, nvrtc_ptx.data(), 0, 0, 0));
+  }
+  perGpuModule_.emplace(dev, module);
+  TC_CUDA_DRIVERAPI_ENFORCE(
+      cuModuleGetFunction(&kernel, module, specializedName.c_str()));
+  int value;
+  TC_CUDA_DRIVERAPI_ENFORCE(
+      cuFuncGetAttribute(&value, CU_FUNC_ATTRIBUTE_NUM_REGS, kernel));
+  attributes_.numRegisters = value;
+  TC_CUDA_DRIVERAPI_ENFORCE(cuFuncGetAttribute(
+      &value, CU_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES, kernel));
+  attributes_.localBytes = value;
+  TC_CUDA_DRIVERAPI_ENFORCE(cuFuncGetAttribute(
+      &value, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, kernel));
+  attributes_.staticSharedBytes = value;
+  TC_CUDA_DRIVERAPI_ENFORCE(cuFuncGetAttribute(
+      &value, CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK, kernel));
+  attributes_.maxThreadsPerBlock = value;
+  hasAttributes_ = true;
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "[COMPILE] Loaded " << specializedName << " on gpu " << dev << ", "
+      << attributes_;
+  if (maxDynamicSharedMemory_ > 0) {
+#if CUDA_VERSION >= 9000
+    TC_CUDA_DRIVERAPI_ENFORCE(cuFuncSetAttribute(
+        kernel,
+        CU_FUNC_ATTRIBUTE_MAX_DYNAMIC_SHARED_SIZE_BYTES,
+        maxDynamicSharedMemory_));
+#endif
+  }
+  perGpuKernel_[dev].store(kernel);
+  lastLaunch_.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(loadedModulesMutex);
+  loadedModules.emplace_back(this, dev);
+  return kernel;
+}
+
+void CudaRTCFunction::launchKernel(
     const std::array<size_t, 3>& grid,
     const std::array<size_t, 3>& block,
     unsigned int shared_mem,
     cudaStream_t stream,
-    std::vector<int> params,
-    std::vector<void*> outputs,
-    std::vector<const void*> inputs,
-    bool profile) const {
-  int dev;
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&dev));
-  if (perGpuModule_.count(dev) == 0) {
-    perGpuModule_.emplace(dev, CUmodule());
-    perGpuKernel_.emplace(dev, CUfunction());
-    TC_CUDA_DRIVERAPI_ENFORCE(cuModuleLoadDataEx(
-        &(perGpuModule_.at(dev)), nvrtc_ptx.data(), 0, 0, 0));
-    TC_CUDA_DRIVERAPI_ENFORCE(cuModuleGetFunction(
-        &(perGpuKernel_.at(dev)),
-        perGpuModule_.at(dev),
-        specializedName.c_str()));
-  }
+    std::vector<int>& params,
+    std::vector<void*>& outputs,
+    std::vector<const void*>& inputs) const {
+  ProfilerRange range(specializedName.c_str());
+  ++activeLaunches_;
+  ScopeGuard launched([this]() { --activeLaunches_; });
+  lastLaunch_.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+  auto function = DeviceFunction();
 
   constexpr int kNumMaxParameters = 100;
   std::array<void*, kNumMaxParameters> args_voidp{0};
@@ -169,9 +482,9 @@ Duration CudaRTCFunction::Launch(
   unsigned int bx = block[0];
   unsigned int by = block[1];
   unsigned int bz = block[2];
-  auto launch = [&]() {
-    TC_CUDA_DRIVERAPI_ENFORCE(cuLaunchKernel(
-        perGpuKernel_.at(dev),
+  if (cooperative_) {
+    TC_CUDA_DRIVERAPI_ENFORCE(cuLaunchCooperativeKernel(
+        function,
         gx,
         gy,
         gz,
@@ -180,28 +493,208 @@ Duration CudaRTCFunction::Launch(
         bz,
         shared_mem,
         stream,
-        args_voidp.data(),
-        0));
-  };
+        args_voidp.data()));
+    return;
+  }
+  TC_CUDA_DRIVERAPI_ENFORCE(cuLaunchKernel(
+      function,
+      gx,
+      gy,
+      gz,
+      bx,
+      by,
+      bz,
+      shared_mem,
+      stream,
+      args_voidp.data(),
+      0));
+}
 
+Duration CudaRTCFunction::Launch(
+    const std::array<size_t, 3>& grid,
+    const std::array<size_t, 3>& block,
+    unsigned int shared_mem,
+    cudaStream_t stream,
+    std::vector<int> params,
+    std::vector<void*> outputs,
+    std::vector<const void*> inputs,
+    bool profile) const {
   if (not profile) {
-    launch();
+    launchKernel(grid, block, shared_mem, stream, params, outputs, inputs);
     return Duration::max();
   }
+  return LaunchTimed(
+             grid, block, shared_mem, stream, params, outputs, inputs)
+      .resolve();
+}
+
+CudaTimingToken CudaRTCFunction::LaunchTimed(
+    const std::array<size_t, 3>& grid,
+    const std::array<size_t, 3>& block,
+    unsigned int shared_mem,
+    cudaStream_t stream,
+    std::vector<int> params,
+    std::vector<void*> outputs,
+    std::vector<const void*> inputs) const {
+  int dev;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&dev));
+  CudaTimingToken token(dev, stream);
+  launchKernel(grid, block, shared_mem, stream, params, outputs, inputs);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(token.stop_, stream));
+  return token;
+}
 
-  cudaEvent_t start, stop;
+namespace {
+// The launch keeps the kernel's CUfunction.
+CUfunction pinnedDeviceFunction(const CudaRTCFunction& function) {
+  function.Pin();
+  return function.DeviceFunction();
+}
+} // namespace
 
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventCreate(&start));
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventCreate(&stop));
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(start, stream));
-  launch();
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(stop, stream));
+CudaPreparedLaunch::CudaPreparedLaunch(
+    std::shared_ptr<CudaRTCFunction> function,
+    const std::array<size_t, 3>& grid,
+    const std::array<size_t, 3>& block,
+    unsigned int shared_mem,
+    const std::vector<int>& params,
+    size_t numOutputs,
+    size_t numInputs)
+    : function_(function),
+      kernel_(pinnedDeviceFunction(*function)),
+      grid_{{static_cast<unsigned int>(grid[0]),
+             static_cast<unsigned int>(grid[1]),
+             static_cast<unsigned int>(grid[2])}},
+      block_{{static_cast<unsigned int>(block[0]),
+              static_cast<unsigned int>(block[1]),
+              static_cast<unsigned int>(block[2])}},
+      shared_mem_(shared_mem),
+      params_(params),
+      outputs_(numOutputs, nullptr),
+      inputs_(numInputs, nullptr) {
+  args_.reserve(params_.size() + outputs_.size() + inputs_.size());
+  for (auto& p : params_) {
+    args_.push_back(&p);
+  }
+  for (auto& o : outputs_) {
+    args_.push_back(&o);
+  }
+  for (auto& i : inputs_) {
+    args_.push_back(static_cast<void*>(&i));
+  }
+}
+
+void CudaPreparedLaunch::launch(cudaStream_t stream) const {
+  if (function_->Cooperative()) {
+    TC_CUDA_DRIVERAPI_ENFORCE(cuLaunchCooperativeKernel(
+        kernel_,
+        grid_[0],
+        grid_[1],
+        grid_[2],
+        block_[0],
+        block_[1],
+        block_[2],
+        shared_mem_,
+        stream,
+        const_cast<void**>(args_.data())));
+    return;
+  }
+  TC_CUDA_DRIVERAPI_ENFORCE(cuLaunchKernel(
+      kernel_,
+      grid_[0],
+      grid_[1],
+      grid_[2],
+      block_[0],
+      block_[1],
+      block_[2],
+      shared_mem_,
+      stream,
+      const_cast<void**>(args_.data()),
+      0));
+}
+
+namespace {
+// Events are created lazily and recycled, never destroyed: the pool lives
+// until the process exits, at which point the CUDA context goes away anyway.
+std::mutex eventPoolMutex;
+std::unordered_map<int, std::vector<cudaEvent_t>> eventPool;
+
+cudaEvent_t acquireEvent(int device) {
+  {
+    std::lock_guard<std::mutex> lg(eventPoolMutex);
+    auto& events = eventPool[device];
+    if (!events.empty()) {
+      auto e = events.back();
+      events.pop_back();
+      return e;
+    }
+  }
+  WithDevice wd(device);
+  cudaEvent_t e;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventCreate(&e));
+  return e;
+}
+
+void releaseEvent(int device, cudaEvent_t e) {
+  std::lock_guard<std::mutex> lg(eventPoolMutex);
+  eventPool[device].push_back(e);
+}
+} // namespace
+
+CudaTimingToken::CudaTimingToken(int device, cudaStream_t stream)
+    : device_(device) {
+  start_ = acquireEvent(device);
+  stop_ = acquireEvent(device);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventRecord(start_, stream));
+}
+
+CudaTimingToken::CudaTimingToken(CudaTimingToken&& other)
+    : device_(other.device_), start_(other.start_), stop_(other.stop_) {
+  other.start_ = nullptr;
+  other.stop_ = nullptr;
+}
+
+CudaTimingToken& CudaTimingToken::operator=(CudaTimingToken&& other) {
+  if (this != &other) {
+    release();
+    std::swap(device_, other.device_);
+    std::swap(start_, other.start_);
+    std::swap(stop_, other.stop_);
+  }
+  return *this;
+}
+
+CudaTimingToken::~CudaTimingToken() {
+  release();
+}
+
+void CudaTimingToken::release() {
+  if (valid()) {
+    // Recording an event again is legal even if it has not completed yet.
+    releaseEvent(device_, start_);
+    releaseEvent(device_, stop_);
+    start_ = nullptr;
+    stop_ = nullptr;
+  }
+}
+
+bool CudaTimingToken::ready() const {
+  CHECK(valid()) << "querying an invalid CudaTimingToken";
+  auto res = cudaEventQuery(stop_);
+  if (res == cudaErrorNotReady) {
+    return false;
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(res);
+  return true;
+}
 
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventSynchronize(stop));
+Duration CudaTimingToken::resolve() {
+  CHECK(valid()) << "resolving an invalid CudaTimingToken";
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventSynchronize(stop_));
   float milliseconds = 0;
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventElapsedTime(&milliseconds, start, stop));
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventDestroy(start));
-  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaEventDestroy(stop));
+  TC_CUDA_RUNTIMEAPI_ENFORCE(
+      cudaEventElapsedTime(&milliseconds, start_, stop_));
+  release();
   return std::chrono::microseconds(static_cast<int64_t>(milliseconds * 1000));
 }
 } // namespace tc
@@ -15,10 +15,14 @@
  */
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <ostream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -29,7 +33,73 @@
 
 namespace tc {
 
-extern std::mutex nvrtc_mutex;
+//
+// Pair of events bracketing a kernel launch, returned by
+// CudaRTCFunction::LaunchTimed.  The events come from a per-device pool and
+// return to it when the token is resolved or destroyed, so profiled launches
+// neither allocate events nor block the host.
+//
+class CudaTimingToken {
+ public:
+  CudaTimingToken() = default;
+  CudaTimingToken(CudaTimingToken&& other);
+  CudaTimingToken& operator=(CudaTimingToken&& other);
+  CudaTimingToken(const CudaTimingToken&) = delete;
+  CudaTimingToken& operator=(const CudaTimingToken&) = delete;
+  ~CudaTimingToken();
+
+  bool valid() const {
+    return start_ != nullptr;
+  }
+
+  // Non-blocking, true once the timed kernel has completed.
+  bool ready() const;
+
+  // Blocks until the timed kernel has completed and returns its runtime.
+  // The token is invalid afterwards.
+  Duration resolve();
+
+ private:
+  friend class CudaRTCFunction;
+  friend class CudaLibraryCall;
+  CudaTimingToken(int device, cudaStream_t stream);
+  void release();
+
+  int device_ = -1;
+  cudaEvent_t start_ = nullptr;
+  cudaEvent_t stop_ = nullptr;
+};
+
+//
+// How NVRTC compiles the source to PTX and how the driver compiles the PTX
+// when loading it, see CudaCompilerOptionsProto.
+//
+struct CudaCompilerOptions {
+  // 0 lets the compiler decide.
+  uint32_t maxRegisterCount = 0;
+  bool useFastMath = true;
+  // Negative for the driver default.
+  int jitOptimizationLevel = -1;
+  // The virtual architecture NVRTC targets, e.g. compute_70, empty for the
+  // current device's.
+  std::string architecture;
+};
+
+//
+// Resources of a compiled kernel as reported by the driver once its module
+// is loaded, see cuFuncGetAttribute.
+//
+struct CudaKernelAttributes {
+  int numRegisters = 0;
+  // Bytes of local memory of a thread, non-zero when the kernel spills
+  // registers.
+  size_t localBytes = 0;
+  size_t staticSharedBytes = 0;
+  // The most threads a block of the kernel can be launched with.
+  int maxThreadsPerBlock = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const CudaKernelAttributes& a);
 
 //
 // Basic interface to expose NVRTC JIT compilation and module
@@ -41,9 +111,52 @@ class CudaRTCFunction {
  public:
   ~CudaRTCFunction();
 
+  // Thread-safe, independent programs compile concurrently unless
+  // FLAGS_nvrtc_serialize_compilation is set.
   static std::shared_ptr<CudaRTCFunction> Compile(
       const std::string& name,
-      const std::string& source);
+      const std::string& source,
+      const CudaCompilerOptions& options = CudaCompilerOptions());
+
+  // The Compile calls of one thread.  waitTime is the part of compileTime
+  // spent waiting for other threads' compilations, only non-zero with
+  // FLAGS_nvrtc_serialize_compilation.
+  struct CompileTimings {
+    size_t numberCompilations = 0;
+    Duration compileTime = Duration::zero();
+    Duration waitTime = Duration::zero();
+  };
+  static std::unordered_map<std::thread::id, CompileTimings>
+  PerThreadCompileTimings();
+  static void ResetCompileTimings();
+
+  // Skips NVRTC and uses PTX previously obtained from Compile (e.g. stored
+  // in the CudaCache).  The PTX must have been generated for
+  // CurrentDeviceArchitecture().  A cubin obtained from LinkCubin for
+  // CurrentDeviceRealArchitecture() can be given instead of PTX.
+  static std::shared_ptr<CudaRTCFunction> Load(
+      const std::string& name,
+      const std::string& ptx,
+      const CudaCompilerOptions& options = CudaCompilerOptions());
+
+  // Compiles PTX to a cubin for the real architecture arch, e.g. sm_70, with
+  // the driver's JIT linker.  The device does not need to match but a CUDA
+  // context must be available.
+  static std::string LinkCubin(
+      const std::string& ptx,
+      const std::string& arch,
+      const CudaCompilerOptions& options = CudaCompilerOptions());
+
+  // The virtual architecture NVRTC targets for the current device, e.g.
+  // compute_70.
+  static std::string CurrentDeviceArchitecture();
+  // The real architecture of the current device, e.g. sm_70.
+  static std::string CurrentDeviceRealArchitecture();
+
+  // The PTX produced by Compile or the image given to Load, NUL terminated.
+  const std::vector<char>& ptx() const {
+    return nvrtc_ptx;
+  }
 
   // if profile is set it returns the kernel runtime
   Duration Launch(
@@ -59,14 +172,168 @@ class CudaRTCFunction {
       std::vector<const void*> inputs,
       bool profile = false) const;
 
+  // Launches without blocking, the kernel runtime is obtained later from the
+  // returned token.
+  CudaTimingToken LaunchTimed(
+      const std::array<size_t, 3>& grid,
+      const std::array<size_t, 3>& block,
+      unsigned int shared_mem,
+      cudaStream_t stream,
+      std::vector<int> params,
+      std::vector<void*> outputs,
+      std::vector<const void*> inputs) const;
+
+  // Must be called before the first launch for kernels using more dynamic
+  // shared memory than the default per-block limit.
+  void SetMaxDynamicSharedMemory(size_t bytes) {
+    maxDynamicSharedMemory_ = bytes;
+  }
+
+  // Launch with cuLaunchCooperativeKernel, which guarantees that all the
+  // blocks are resident at once and fails otherwise, as needed by kernels
+  // synchronizing their grid.  Must be called before the first launch.
+  void SetCooperative(bool cooperative) {
+    cooperative_ = cooperative;
+  }
+  bool Cooperative() const {
+    return cooperative_;
+  }
+
+  // The kernel for the current device, loading the module on first use.
+  // Thread-safe.
+  CUfunction DeviceFunction() const;
+
+  // The attributes of the kernel, those of the last module loaded or given
+  // to SetAttributes.  Loads the module on the current device if neither
+  // happened yet.  Thread-safe.
+  CudaKernelAttributes Attributes() const;
+  // Attributes known before any module is loaded, e.g. from the CudaCache.
+  void SetAttributes(const CudaKernelAttributes& attributes);
+
+  // Bytes of the PTX kept to load the module on other devices.
+  size_t PtxBytes() const {
+    return nvrtc_ptx.size();
+  }
+
+  // Loads the module on each of devices ahead of the first launch there,
+  // which otherwise pays for the driver JIT compiling the PTX.  Thread-safe,
+  // the current device is unchanged.
+  void Warmup(const std::vector<int>& devices) const;
+
+  // Excludes the modules of this function from eviction, required before
+  // keeping the CUfunction returned by DeviceFunction beyond a launch.
+  void Pin() const {
+    pinned_.store(true);
+  }
+
+  // The modules loaded by all the functions are bounded by
+  // FLAGS_cuda_max_loaded_modules.  Loading a module beyond the bound unloads
+  // the least recently launched module of another function that is neither
+  // pinned nor being launched, it is loaded again on its next launch.
+  static size_t NumberLoadedModules();
+  static size_t NumberEvictedModules();
+
   void clear();
 
  private:
+  void launchKernel(
+      const std::array<size_t, 3>& grid,
+      const std::array<size_t, 3>& block,
+      unsigned int shared_mem,
+      cudaStream_t stream,
+      std::vector<int>& params,
+      std::vector<void*>& outputs,
+      std::vector<const void*>& inputs) const;
+
+  // Loads the module for dev, must be called with moduleMutex_ held.
+  CUfunction loadModule(size_t dev) const;
+  // Unloads this function's module on dev if it is not being launched, must
+  // be called with moduleMutex_ held.
+  bool unloadIfIdle(size_t dev) const;
+  // Evicts modules of functions other than loading until at most
+  // FLAGS_cuda_max_loaded_modules are loaded.
+  static void evictModules(const CudaRTCFunction* loading);
+
+  static constexpr int kMaxGpus = 64;
+
+  // Modules are loaded lazily under moduleMutex_, launches only read the
+  // per-device kernel so that concurrent launches do not contend.
+  mutable std::mutex moduleMutex_;
   mutable std::unordered_map<size_t, CUmodule> perGpuModule_;
-  mutable std::unordered_map<size_t, CUfunction> perGpuKernel_;
+  mutable std::array<std::atomic<CUfunction>, kMaxGpus> perGpuKernel_;
+  // Launches in progress, an idle module can be unloaded.
+  mutable std::atomic<int> activeLaunches_;
+  // steady_clock time of the last launch, used to pick modules to evict.
+  mutable std::atomic<int64_t> lastLaunch_;
+  mutable std::atomic<bool> pinned_;
+  // Guarded by moduleMutex_.
+  mutable bool hasAttributes_;
+  mutable CudaKernelAttributes attributes_;
   std::string specializedName;
   std::vector<char> nvrtc_ptx;
+  size_t maxDynamicSharedMemory_;
+  bool cooperative_;
+  int jitOptimizationLevel_;
   bool cleared_;
 };
 
+//
+// A launch of a CudaRTCFunction whose kernel arguments are marshalled once.
+// Only the data pointers change between calls, they are written in place in
+// preallocated storage so that launch() neither allocates nor locks.
+// The kernel is resolved for the device current at construction, launch()
+// must be called with the same current device.
+//
+class CudaPreparedLaunch {
+ public:
+  CudaPreparedLaunch(
+      std::shared_ptr<CudaRTCFunction> function,
+      const std::array<size_t, 3>& grid,
+      const std::array<size_t, 3>& block,
+      unsigned int shared_mem,
+      const std::vector<int>& params,
+      size_t numOutputs,
+      size_t numInputs);
+
+  // args_ points into the members, copies would point into the original.
+  CudaPreparedLaunch(const CudaPreparedLaunch&) = delete;
+  CudaPreparedLaunch& operator=(const CudaPreparedLaunch&) = delete;
+
+  void setOutput(size_t i, void* ptr) {
+    outputs_[i] = ptr;
+  }
+  void setInput(size_t i, const void* ptr) {
+    inputs_[i] = ptr;
+  }
+
+  void launch(cudaStream_t stream) const;
+
+  // Sets all the pointers then launches, the arrays must hold as many
+  // pointers as given at construction.
+  void launch(
+      const void* const* inputs,
+      void* const* outputs,
+      cudaStream_t stream) {
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+      inputs_[i] = inputs[i];
+    }
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+      outputs_[i] = outputs[i];
+    }
+    launch(stream);
+  }
+
+ private:
+  // Keeps the module loaded.
+  std::shared_ptr<CudaRTCFunction> function_;
+  CUfunction kernel_;
+  std::array<unsigned int, 3> grid_;
+  std::array<unsigned int, 3> block_;
+  unsigned int shared_mem_;
+  std::vector<int> params_;
+  std::vector<void*> outputs_;
+  std::vector<const void*> inputs_;
+  std::vector<void*> args_;
+};
+
 } // namespace tc
@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_source_profile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+namespace tc {
+
+std::string makeTcStatementMarker(const lang::SourceRange& range) {
+  const auto& file = range.file();
+  auto line = 1 + std::count(file.begin(), file.begin() + range.start(), '\n');
+  // The ranges of the comprehensions may extend to the token after them,
+  // the text ends with the line or at a comment.
+  auto end = std::min(file.find('\n', range.start()), file.size());
+  end = std::min(end, file.find('#', range.start()));
+  std::stringstream ss;
+  ss << kTcStatementMarker << line << ": ";
+  // Its spaces collapsed.
+  bool space = false;
+  for (auto c : file.substr(range.start(), end - range.start())) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      space = true;
+      continue;
+    }
+    if (space) {
+      ss << ' ';
+      space = false;
+    }
+    ss << c;
+  }
+  return ss.str();
+}
+
+namespace {
+// Parses the statement of a marker line into line and statement.
+bool parseMarker(const std::string& s, size_t& line, std::string& statement) {
+  auto begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos ||
+      s.compare(begin, std::strlen(kTcStatementMarker), kTcStatementMarker) !=
+          0) {
+    return false;
+  }
+  begin += std::strlen(kTcStatementMarker);
+  auto colon = s.find(": ", begin);
+  if (colon == std::string::npos || colon == begin ||
+      !std::all_of(s.begin() + begin, s.begin() + colon, ::isdigit)) {
+    return false;
+  }
+  line = std::stoul(s.substr(begin, colon - begin));
+  statement = s.substr(colon + 2);
+  return true;
+}
+} // namespace
+
+std::vector<TcStatementSamples> attributeToTcStatements(
+    const std::string& cudaSource,
+    const std::map<size_t, double>& lineSamples) {
+  // The statement of each line of the source, by line, from 1.
+  std::vector<std::pair<size_t, std::string>> statements;
+  std::pair<size_t, std::string> none(0, "");
+  std::istringstream source(cudaSource);
+  std::string s;
+  bool marked = false;
+  while (std::getline(source, s)) {
+    std::pair<size_t, std::string> marker;
+    if (parseMarker(s, marker.first, marker.second)) {
+      statements.push_back(marker);
+      marked = true;
+      continue;
+    }
+    // A marker is followed by the line it marks.
+    statements.push_back(marked ? statements.back() : none);
+    marked = false;
+  }
+
+  std::map<std::pair<size_t, std::string>, double> samples;
+  for (const auto& kvp : lineSamples) {
+    if (kvp.first == 0 || kvp.first > statements.size()) {
+      samples[none] += kvp.second;
+    } else {
+      samples[statements[kvp.first - 1]] += kvp.second;
+    }
+  }
+  std::vector<TcStatementSamples> res;
+  for (const auto& kvp : samples) {
+    if (kvp.second > 0) {
+      res.push_back({kvp.first.first, kvp.first.second, kvp.second});
+    }
+  }
+  std::stable_sort(
+      res.begin(),
+      res.end(),
+      [](const TcStatementSamples& a, const TcStatementSamples& b) {
+        return a.samples > b.samples;
+      });
+  return res;
+}
+
+} // namespace tc
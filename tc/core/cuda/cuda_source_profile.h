@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tc/lang/lexer.h"
+
+namespace tc {
+
+/// The comment that marks the line of CUDA source that follows it with the
+/// TC statement the line computes, when the kernels are generated with
+/// --cuda_line_info, e.g.
+///   // tc: 3: O(i) +=! A(i, r_k)
+constexpr auto kTcStatementMarker = "// tc: ";
+
+/// The marker of the TC comprehension at range: its line in the TC source,
+/// from 1, and its text on that line.
+std::string makeTcStatementMarker(const lang::SourceRange& range);
+
+/// The samples of a source-level profile of a kernel that fall on the lines
+/// computing a TC statement.
+struct TcStatementSamples {
+  /// Line of the statement in the TC source, 0 for the lines that compute
+  /// none, e.g. the loops, the copies to shared memory and the
+  /// synchronizations.
+  size_t line;
+  std::string statement;
+  double samples;
+};
+
+/// Attributes the samples of the lines of cudaSource, numbered from 1 as in
+/// the source-level views of the profilers, to the TC statements they
+/// compute, according to the markers of the source.  The statements come in
+/// decreasing order of samples, those without any are omitted.
+std::vector<TcStatementSamples> attributeToTcStatements(
+    const std::string& cudaSource,
+    const std::map<size_t, double>& lineSamples);
+
+} // namespace tc
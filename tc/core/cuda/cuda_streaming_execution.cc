@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_streaming_execution.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/flags.h"
+#include "tc/core/utils/dlpack.h"
+
+namespace tc {
+
+namespace {
+// Slots start at multiples of the alignment of cudaMalloc, the vector
+// copies of the kernel are valid for all of them.
+constexpr size_t kSlotAlignment = 256;
+
+bool sameSizesAndType(const DLTensor* t1, const DLTensor* t2) {
+  return t1->dtype == t2->dtype and
+      std::vector<int64_t>(t1->shape, t1->shape + t1->ndim) ==
+      std::vector<int64_t>(t2->shape, t2->shape + t2->ndim);
+}
+} // namespace
+
+std::unique_ptr<CudaStreamingExecution> CudaStreamingExecution::compile(
+    ExecutionEngine<CudaTcExecutor>& engine,
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const CudaMappingOptions& options,
+    const std::vector<Delay>& delays) {
+  auto outputs = engine.inferOutputTensorInfo(name, inputs);
+  std::vector<bool> fed(inputs.size(), false);
+  for (const auto& delay : delays) {
+    CHECK_LT(delay.input, inputs.size());
+    CHECK_LT(delay.output, outputs.size());
+    CHECK_GT(delay.steps, 0u) << "input " << delay.input << " of " << name
+                              << " cannot be fed by the current step";
+    CHECK(!fed[delay.input]) << "input " << delay.input << " of " << name
+                             << " is fed by several delays";
+    fed[delay.input] = true;
+    CHECK(sameSizesAndType(inputs[delay.input], outputs[delay.output]))
+        << "input " << delay.input << " of " << name
+        << " differs from output " << delay.output;
+    CHECK(dlutils::isPacked(*inputs[delay.input]));
+  }
+
+  std::unique_ptr<CudaStreamingExecution> res(
+      new CudaStreamingExecution(engine));
+  res->delays_ = delays;
+  for (const auto& delay : delays) {
+    auto ring = std::find_if(
+        res->rings_.begin(), res->rings_.end(), [&](const Ring& r) {
+          return r.output == delay.output;
+        });
+    if (ring != res->rings_.end()) {
+      ring->numberSlots = std::max(ring->numberSlots, delay.steps + 1);
+      continue;
+    }
+    res->rings_.emplace_back();
+    auto& r = res->rings_.back();
+    r.output = delay.output;
+    r.numberSlots = delay.steps + 1;
+    auto bytes =
+        dlutils::numberBytes(*outputs[delay.output]) + kSlotAlignment - 1;
+    r.slotBytes = bytes / kSlotAlignment * kSlotAlignment;
+  }
+  for (auto& r : res->rings_) {
+    auto bytes = r.numberSlots * r.slotBytes;
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaMalloc(reinterpret_cast<void**>(&r.buffer), bytes));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemset(r.buffer, 0, bytes));
+    const auto* info = outputs[r.output];
+    r.slot = dlutils::makeDLTensorWithSizes(
+        info->ctx,
+        info->dtype,
+        std::vector<int64_t>(info->shape, info->shape + info->ndim));
+    r.slot->data = r.slotData(0);
+  }
+
+  // The kernel is compiled for the alignment of the slots
+  auto kernelInputs = inputs;
+  for (const auto& delay : delays) {
+    res->delayed_.push_back(dlutils::makeDLTensor(inputs[delay.input]));
+    auto& delayed = res->delayed_.back();
+    delayed->data = res->ringOf(delay.output).slotData(0);
+    delayed->byte_offset = 0;
+    kernelInputs[delay.input] = delayed.get();
+  }
+  res->handle_ =
+      engine.compile(name, kernelInputs, options.toProtobufSerializedString());
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << name << " streamed with " << res->rings_.size() << " ring buffers";
+  return res;
+}
+
+CudaStreamingExecution::~CudaStreamingExecution() {
+  // Errors are ignored, the destructor must not throw.
+  for (auto& r : rings_) {
+    if (r.buffer) {
+      cudaFree(r.buffer);
+    }
+  }
+}
+
+const CudaStreamingExecution::Ring& CudaStreamingExecution::ringOf(
+    size_t output) const {
+  for (const auto& r : rings_) {
+    if (r.output == output) {
+      return r;
+    }
+  }
+  LOG(FATAL) << "output " << output << " is not delayed";
+  return rings_.front();
+}
+
+Duration CudaStreamingExecution::step(
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    cudaStream_t stream,
+    bool profile) {
+  auto kernelInputs = inputs;
+  for (size_t i = 0; i < delays_.size(); ++i) {
+    const auto& delay = delays_[i];
+    const auto& ring = ringOf(delay.output);
+    // The slot written delay.steps steps before this one
+    delayed_[i]->data =
+        ring.slotData(steps_ + ring.numberSlots - delay.steps);
+    kernelInputs[delay.input] = delayed_[i].get();
+  }
+  auto kernelOutputs = outputs;
+  for (auto& r : rings_) {
+    r.slot->data = r.slotData(steps_);
+    kernelOutputs[r.output] = r.slot.get();
+  }
+  auto res = engine_.run(
+      handle_,
+      kernelInputs,
+      kernelOutputs,
+      profile,
+      [](const CudaTcExecutor*) { return false; },
+      CudaRuntimeInformation(stream));
+  ++steps_;
+  return res;
+}
+
+const DLTensor* CudaStreamingExecution::latest(size_t output) const {
+  return ringOf(output).slot.get();
+}
+
+void CudaStreamingExecution::reset(cudaStream_t stream) {
+  for (const auto& r : rings_) {
+    TC_CUDA_RUNTIMEAPI_ENFORCE(
+        cudaMemsetAsync(r.buffer, 0, r.numberSlots * r.slotBytes, stream));
+  }
+  steps_ = 0;
+}
+
+} // namespace tc
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dlpack/dlpack.h>
+#include <driver_types.h> // cuda driver types
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+//
+// A TC computing one time step of a causal recurrence, e.g. of the dilated
+// layers of a WaveNet, run once per step with one kernel launch.  The
+// values of previous steps the TC reads are inputs fed by the execution
+// from its outputs: a Delay routes the value an output had "steps" steps
+// before to an input of the same sizes.  The execution keeps the history
+// of each delayed output in a ring buffer of device memory, whose slots
+// are written by the kernel in place of the output and read in place as
+// the delayed inputs, so that a step copies nothing.  Before the first
+// "steps" steps the delayed inputs are zero, as with causal padding.
+//
+class CudaStreamingExecution {
+ public:
+  struct Delay {
+    size_t output;
+    size_t input;
+    size_t steps;
+  };
+
+  // Compiles the TC name for the sizes of inputs with options.  The
+  // entries of inputs fed by delays only provide the metadata, they must
+  // have the sizes and type of their outputs.
+  static std::unique_ptr<CudaStreamingExecution> compile(
+      ExecutionEngine<CudaTcExecutor>& engine,
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const CudaMappingOptions& options,
+      const std::vector<Delay>& delays);
+
+  // Frees the ring buffers, ignoring errors.
+  ~CudaStreamingExecution();
+
+  CudaStreamingExecution(const CudaStreamingExecution&) = delete;
+  CudaStreamingExecution& operator=(const CudaStreamingExecution&) = delete;
+
+  // Computes the next step.  The entries of inputs fed by delays and of
+  // outputs kept in ring buffers are ignored and may be null, the others
+  // must have the sizes of the compilation.  The values of the outputs
+  // kept are read with latest.  If profile is set the step is synchronized
+  // with and its kernel runtime returned, Duration::max() otherwise.
+  // Steps of the same execution must not be concurrent.
+  Duration step(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      cudaStream_t stream = 0,
+      bool profile = false);
+
+  // The value of the delayed output at the last step, valid until the next
+  // step.
+  const DLTensor* latest(size_t output) const;
+
+  // Zeroes the history on stream to start a new sequence.
+  void reset(cudaStream_t stream = 0);
+
+  size_t numberSteps() const {
+    return steps_;
+  }
+
+ private:
+  // The history of an output, one slot per step of its longest delay plus
+  // the one written by the current step.
+  struct Ring {
+    size_t output;
+    size_t numberSlots;
+    size_t slotBytes;
+    char* buffer = nullptr;
+    // The metadata of the output, pointing to the slot of the step.
+    DLTensorUPtr slot;
+
+    char* slotData(size_t step) const {
+      return buffer + (step % numberSlots) * slotBytes;
+    }
+  };
+
+  explicit CudaStreamingExecution(ExecutionEngine<CudaTcExecutor>& engine)
+      : engine_(engine) {}
+
+  const Ring& ringOf(size_t output) const;
+
+  ExecutionEngine<CudaTcExecutor>& engine_;
+  size_t handle_;
+  std::vector<Delay> delays_;
+  std::vector<Ring> rings_;
+  // The metadata of the delayed inputs, pointing to a slot of their ring at
+  // each step.
+  std::vector<DLTensorUPtr> delayed_;
+  size_t steps_ = 0;
+};
+
+} // namespace tc
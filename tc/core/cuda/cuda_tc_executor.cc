@@ -16,16 +16,32 @@
 #include "tc/core/cuda/cuda_tc_executor.h"
 
 #include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_compile_server.h"
 #include "tc/core/cuda/cuda_mapping_options_cpp_printer.h"
+#include "tc/core/cuda/cuda_measurement.h"
 #include "tc/core/halide_utils.h"
+#include "tc/core/polyhedral/cuda/codegen.h"
 #include "tc/core/polyhedral/cuda/mapped_scop.h"
 #include "tc/core/tc2halide.h"
 #include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/hash.h"
+#include "tc/core/utils/memory.h"
+#include "tc/core/utils/time.h"
 
 #include "tc/lang/parser.h"
 #include "tc/lang/sema.h"
+#include "tc/lang/tc_format.h"
 
 #include <version.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 
 namespace tc {
@@ -34,6 +50,16 @@ using namespace dlutils;
 
 namespace {
 
+// The comma separated devices of FLAGS_cuda_warmup_devices
+std::vector<int> parseWarmupDevices(const std::string& list) {
+  std::vector<int> res;
+  std::stringstream ss(list);
+  for (std::string item; std::getline(ss, item, ',');) {
+    res.push_back(std::stoi(item));
+  }
+  return res;
+}
+
 std::string appendOptionsAndGitHash(
     const std::string& source,
     const CudaMappingOptions& options) {
@@ -44,22 +70,492 @@ std::string appendOptionsAndGitHash(
   return ss.str();
 }
 
+using ParametricRanges =
+    std::unordered_map<std::string, std::pair<long, long>>;
+
+// Ranges of the parametric sizes of options, including the buckets of the
+// sizes in context, which fixes all parameters.  Throws if they do not name
+// parameters of scop or if the values of parametric sizes are out of range.
+ParametricRanges parametricRanges(
+    const polyhedral::Scop& scop,
+    const CudaMappingOptions& options,
+    isl::set context) {
+  const auto& params = scop.halide.params;
+  auto values = scop.getParameterValues(context);
+  auto valueOf = [&params, &values](const std::string& name) -> long {
+    auto it = std::find_if(
+        params.begin(),
+        params.end(),
+        [&name](const Halide::Internal::Parameter& p) {
+          return p.name() == name;
+        });
+    if (it == params.end()) {
+      throw std::invalid_argument(
+          "parametric size " + name + " is not a size parameter");
+    }
+    return values.at(it - params.begin());
+  };
+  ParametricRanges ranges;
+  for (const auto& range : options.proto().parametric_sizes()) {
+    auto value = valueOf(range.name());
+    if (value < range.min() or value > range.max()) {
+      std::stringstream ss;
+      ss << "size parameter " << range.name() << " = " << value
+         << " is outside of its parametric range [" << range.min() << ", "
+         << range.max() << "]";
+      throw std::invalid_argument(ss.str());
+    }
+    ranges.emplace(range.name(), std::make_pair(range.min(), range.max()));
+  }
+  for (const auto& buckets : options.proto().size_buckets()) {
+    auto value = valueOf(buckets.name());
+    if (ranges.count(buckets.name()) > 0) {
+      throw std::invalid_argument(
+          "size parameter " + buckets.name() +
+          " is both parametric and bucketed");
+    }
+    long lower = 1;
+    for (auto upper : buckets.upper_bounds()) {
+      if (value <= upper) {
+        if (value >= lower) {
+          ranges.emplace(buckets.name(), std::make_pair(lower, upper));
+        }
+        break;
+      }
+      lower = upper + 1;
+    }
+  }
+  return ranges;
+}
+
+// Values of the parameters that are not in ranges, in signature order.  The
+// kernel is specialized for these.
+std::vector<int> fixedParameterValues(
+    const polyhedral::Scop& scop,
+    const ParametricRanges& ranges,
+    const std::vector<int>& values) {
+  std::vector<int> fixed;
+  for (size_t i = 0; i < scop.halide.params.size(); ++i) {
+    if (ranges.count(scop.halide.params[i].name()) == 0) {
+      fixed.push_back(values.at(i));
+    }
+  }
+  return fixed;
+}
+
+// A kernel compiled with parametric sizes, shared by the executors of all
+// the sizes in range.  The last executor holding it unloads it.
+struct ParametricKernel {
+  std::weak_ptr<CudaRTCFunction> rtcFun;
+  std::string specializedName;
+  std::string source;
+  Grid grid{{0, 0, 0}};
+  Block block{{0, 0, 0}};
+  size_t dynamicSharedMemory{0};
+  size_t sharedMemoryFootprint{0};
+  size_t privateMemoryFootprint{0};
+};
+
+std::mutex parametricKernelsMutex;
+std::unordered_map<std::string, ParametricKernel> parametricKernels;
+
+// Largest vector width not exceeding "width" for which "t" is aligned, the
+// width counting float elements as only float inputs are vectorized.
+uint32_t alignedVectorWidth(uint32_t width, const DLTensor* t) {
+  auto address = reinterpret_cast<std::uintptr_t>(t->data) + t->byte_offset;
+  while (width > 1 && address % (width * sizeof(float)) != 0) {
+    width /= 2;
+  }
+  return width;
+}
+
+// Vector width of the copies of the inputs, reduced from the one requested
+// by options until all inputs are aligned for it.
+uint32_t alignedVectorWidth(
+    const CudaMappingOptions& options,
+    const std::vector<DLTensorUPtr>& inputs) {
+  auto width = options.proto().vectorize_width();
+  for (const auto& input : inputs) {
+    width = alignedVectorWidth(width, input.get());
+    // Vector copies read consecutive elements of rows that start at
+    // multiples of the width.
+    auto strides = getStrides(*input);
+    for (int i = 0; i < input->ndim && width > 1; ++i) {
+      if (input->shape[i] == 1) {
+        continue;
+      }
+      if (i == input->ndim - 1 ? strides[i] != 1 : strides[i] % width != 0) {
+        width = 1;
+      }
+    }
+  }
+  return width;
+}
+
+// Outputs reduced across blocks are zeroed by a memset of the bytes they
+// span, which would also zero the elements between the rows of the strided
+// ones.
+void checkZeroedOutputsArePacked(
+    const std::vector<size_t>& zeroed,
+    const std::vector<DLTensorUPtr>& outputs) {
+  for (auto i : zeroed) {
+    if (i < outputs.size() and !isPacked(*outputs[i])) {
+      throw std::invalid_argument(
+          "grid reductions cannot write to outputs that are not packed");
+    }
+  }
+}
+
+// Positions of the outputs that kernels mapped with options may reduce across
+// blocks among the outputs and temporaries, which the caller must zero before
+// every launch.
+std::vector<size_t> zeroedOutputs(
+    const tc2halide::HalideComponents& components,
+    const CudaMappingOptions& options) {
+  if (!options.proto().grid_reductions()) {
+    return {};
+  }
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), components);
+  const auto& kernelOutputs = scop->halide.outputs;
+  std::vector<size_t> positions;
+  for (const auto& name : polyhedral::gridReductionOutputs(*scop)) {
+    for (size_t i = 0; i < kernelOutputs.size(); ++i) {
+      if (kernelOutputs[i].name() == name) {
+        positions.push_back(i);
+      }
+    }
+  }
+  return positions;
+}
+
+// Number of bytes from the first to past the last element of t.
+size_t spannedBytes(const DLTensor* t) {
+  int64_t last = 0;
+  int64_t compactStride = 1;
+  for (int i = t->ndim - 1; i >= 0; --i) {
+    auto stride = t->strides ? t->strides[i] : compactStride;
+    last += (t->shape[i] - 1) * stride;
+    compactStride *= t->shape[i];
+  }
+  return (last + 1) * (t->dtype.bits / 8);
+}
+
+// The buffers of the temporaries of size temporariesInfo, null if there are
+// none.
+std::unique_ptr<CudaWorkspacePool> makeWorkspacePool(
+    const std::vector<DLTensorUPtr>& temporariesInfo) {
+  if (temporariesInfo.empty()) {
+    return nullptr;
+  }
+  std::vector<size_t> bytes;
+  for (const auto& info : temporariesInfo) {
+    bytes.push_back(spannedBytes(info.get()));
+  }
+  return tc::make_unique<CudaWorkspacePool>(bytes);
+}
+
+// Bytes of constant memory the inputs baked into the kernels take at most in
+// total, that of a module.
+constexpr size_t kMaxConstantInputBytes = 64 << 10;
+
+// The values in "bytes" as the initializer of an array of T, empty if one of
+// them is not finite.  Floating point values are printed with the digits
+// that read back to the same value.
+template <typename T>
+std::string arrayInitializer(const std::vector<char>& bytes) {
+  auto values = reinterpret_cast<const T*>(bytes.data());
+  std::stringstream ss;
+  ss << std::showpoint
+     << std::setprecision(std::numeric_limits<T>::max_digits10);
+  for (size_t i = 0; i < bytes.size() / sizeof(T); ++i) {
+    if (!std::isfinite(static_cast<double>(values[i]))) {
+      return "";
+    }
+    // The unary + prints the 8-bit integers as numbers.
+    ss << (i > 0 ? ", " : "") << +values[i];
+    if (std::is_same<T, float>::value) {
+      ss << "f";
+    }
+  }
+  return ss.str();
+}
+
+// The values of a tensor of type "type" in "bytes" as an array initializer,
+// empty if the type is not supported or if one of them is not finite.
+std::string arrayInitializer(DLDataType type, const std::vector<char>& bytes) {
+  if (type.lanes != 1) {
+    return "";
+  }
+  if (type.code == kDLFloat) {
+    switch (type.bits) {
+      case 32:
+        return arrayInitializer<float>(bytes);
+      case 64:
+        return arrayInitializer<double>(bytes);
+    }
+  } else if (type.code == kDLInt) {
+    switch (type.bits) {
+      case 8:
+        return arrayInitializer<int8_t>(bytes);
+      case 16:
+        return arrayInitializer<int16_t>(bytes);
+      case 32:
+        return arrayInitializer<int32_t>(bytes);
+    }
+  } else if (type.code == kDLUInt) {
+    switch (type.bits) {
+      case 8:
+        return arrayInitializer<uint8_t>(bytes);
+      case 16:
+        return arrayInitializer<uint16_t>(bytes);
+      case 32:
+        return arrayInitializer<uint32_t>(bytes);
+    }
+  }
+  return "";
+}
+
 } // namespace
 
+std::string kernelOptionsHash(const std::string& serializedOptions) {
+  std::stringstream ss;
+  ss << std::hex << std::setw(8) << std::setfill('0')
+     << static_cast<uint32_t>(stableHash(serializedOptions));
+  return ss.str();
+}
+
+CudaCompilerOptions makeCudaCompilerOptions(const CudaMappingOptions& options) {
+  const auto& proto = options.proto().compiler_options();
+  CudaCompilerOptions compilerOptions;
+  compilerOptions.maxRegisterCount = proto.max_register_count();
+  // The other precisions choose between precise and fast math per
+  // statement, which the compiler must not override.
+  compilerOptions.useFastMath = proto.use_fast_math() and
+      options.proto().math_precision() == MathPrecision::CompilerMath;
+  if (proto.has_jit_optimization_level()) {
+    compilerOptions.jitOptimizationLevel = proto.jit_optimization_level();
+  }
+  return compilerOptions;
+}
+
 void CudaTcExecutor::compile(const tc::CudaMappingOptions& options) {
+  compile(options, [](const CudaTcExecutor*) { return false; });
+}
+
+bool CudaTcExecutor::compile(
+    const tc::CudaMappingOptions& options,
+    const std::function<bool(const CudaTcExecutor*)>& pruningFunction) {
+  if (not compileKernels(options, pruningFunction)) {
+    return false;
+  }
+  if (not FLAGS_cuda_warmup_devices.empty()) {
+    warmup(parseWarmupDevices(FLAGS_cuda_warmup_devices));
+  }
+  return true;
+}
+
+void CudaTcExecutor::warmup(const std::vector<int>& devices) const {
+  if (libraryCall_) {
+    return;
+  }
+  CHECK(rtcFun) << "warmup of the uncompiled " << executionInfo_.kernelName;
+  ProfilerRange range(("tc warmup " + executionInfo_.kernelName).c_str());
+  rtcFun->Warmup(devices);
+  for (const auto& kernel : splitKernels) {
+    kernel.rtcFun->Warmup(devices);
+  }
+}
+
+CudaKernelAttributes CudaTcExecutor::kernelAttributes() const {
+  CHECK(rtcFun) << "attributes of the uncompiled "
+                << executionInfo_.kernelName;
+  auto attributes = rtcFun->Attributes();
+  if (CudaCache::cacheEnabled() and splitKernels.empty() and
+      kernelSource != KernelSource::KernelBundle and
+      kernelSource != KernelSource::ManualCache) {
+    CudaCache::getCache()->cacheKernelAttributes(
+        kernelCacheId(),
+        CudaMappingOptions(executionInfo_.options),
+        extractRawPtrs(executionInfo_.inputsInfo),
+        extractRawPtrs(executionInfo_.outputsInfo),
+        CudaRTCFunction::CurrentDeviceRealArchitecture(),
+        attributes);
+  }
+  return attributes;
+}
+
+std::string CudaTcExecutor::ptx() const {
+  if (not rtcFun) {
+    return std::string();
+  }
+  const auto& ptx = rtcFun->ptx();
+  return std::string(ptx.begin(), ptx.end());
+}
+
+size_t CudaTcExecutor::memoryFootprint() const {
+  auto res = TcExecutor::memoryFootprint() + sizeof(*this) -
+      sizeof(TcExecutor) + kernelSpecializedName.size() + cudaSource.size();
+  if (sharesKernel_) {
+    return res;
+  }
   if (rtcFun) {
+    res += rtcFun->PtxBytes();
+  }
+  for (const auto& kernel : splitKernels) {
+    res += kernel.specializedName.size() + kernel.source.size();
+    if (kernel.rtcFun) {
+      res += kernel.rtcFun->PtxBytes();
+    }
+  }
+  return res;
+}
+
+void CudaTcExecutor::readConstantInputs(
+    const tc::CudaMappingOptions& options) {
+  constantInputs_.clear();
+  constantInputsKey_.clear();
+  const auto& inputs = halideComponents_->inputs;
+  const auto& aliases = halideComponents_->aliases;
+  std::stringstream values;
+  size_t totalBytes = 0;
+  for (auto pos : options.proto().constant_inputs()) {
+    if (pos >= executionInfo_.inputsInfo.size()) {
+      throw std::invalid_argument(
+          "constant input " + std::to_string(pos) + " is not an input");
+    }
+    const auto& name = inputs.at(pos).name();
+    const auto* t = executionInfo_.inputsInfo[pos].get();
+    auto skip = [&name](const std::string& reason) {
+      LOG(WARNING) << "input " << name
+                   << " is not baked into the kernels: " << reason;
+    };
+    if (constantInputs_.count(name) > 0) {
+      continue;
+    }
+    if (!isPacked(*t)) {
+      skip("it is not packed");
+      continue;
+    }
+    if (std::any_of(
+            aliases.begin(),
+            aliases.end(),
+            [&name](const std::pair<const std::string, std::string>& alias) {
+              return alias.second == name;
+            })) {
+      skip("an output aliases it");
+      continue;
+    }
+    if (std::find(t->shape, t->shape + t->ndim, 0) != t->shape + t->ndim) {
+      skip("it is empty");
+      continue;
+    }
+    auto bytes = spannedBytes(t);
+    if (totalBytes + bytes > kMaxConstantInputBytes) {
+      skip("the constant inputs exceed 64KB");
+      continue;
+    }
+    std::vector<char> host(bytes);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemcpy(
+        host.data(),
+        static_cast<const char*>(t->data) + t->byte_offset,
+        bytes,
+        cudaMemcpyDefault));
+    auto initializer = arrayInitializer(t->dtype, host);
+    if (initializer.empty()) {
+      skip("its type is not supported or it has values that are not finite");
+      continue;
+    }
+    totalBytes += bytes;
+    values << ' ' << pos << ':' << initializer;
+    constantInputs_.emplace(name, std::move(initializer));
+  }
+  if (!constantInputs_.empty()) {
+    std::stringstream ss;
+    ss << "_c" << std::hex << std::setw(16) << std::setfill('0')
+       << stableHash(values.str());
+    constantInputsKey_ = ss.str();
+  }
+}
+
+bool CudaTcExecutor::compileKernels(
+    const tc::CudaMappingOptions& options,
+    const std::function<bool(const CudaTcExecutor*)>& pruningFunction) {
+  if (rtcFun or libraryCall_) {
     throw std::runtime_error{
         "CudaTcExecutor::compile cannot be called multiple tines."};
   }
+  ProfilerRange range(("tc compile " + executionInfo_.kernelName).c_str());
   executionInfo_.options = options.toProtobufSerializedString();
+  vectorWidth_ = alignedVectorWidth(options, executionInfo_.inputsInfo);
+  readConstantInputs(options);
+  zeroedOutputs_ = zeroedOutputs(*halideComponents_, options);
+  checkZeroedOutputsArePacked(zeroedOutputs_, executionInfo_.outputsInfo);
+  workspaces_ = makeWorkspacePool(executionInfo_.temporariesInfo);
+
+  // Library calls are neither compiled, cached nor pruned.
+  if (options.proto().match_library_calls()) {
+    libraryCall_ = matchLibraryCall();
+    if (libraryCall_) {
+      kernelSource = KernelSource::LibraryCall;
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << "[COMPILE] Calling " << libraryCall_->describe();
+      return true;
+    }
+  }
 
+  std::string parametricKey;
+  if (options.proto().parametric_sizes_size() > 0 or
+      options.proto().size_buckets_size() > 0) {
+    parametricKey = parametricKernelKey(options);
+    if (retrieveParametricKernel(parametricKey)) {
+      kernelSource = KernelSource::SharedParametric;
+      if (pruningFunction(this)) {
+        LOG_IF(INFO, FLAGS_debug_tc_mapper) << "[COMPILE] Pruned shared kernel";
+        rtcFun = nullptr;
+        return false;
+      }
+      return true;
+    }
+  }
+
+  // Kernels of the bundle are handled like manually injected ones, they are
+  // not stored in the CudaCache.
+  bool fromManualCache = false;
+  bool validTemplate = true;
   auto cachedOp = [&]() -> std::unique_ptr<CudaCache::RetrievalResult> {
+    if (CudaKernelBundle::cacheEnabled()) {
+      auto rr = CudaKernelBundle::getCache()->retrieveKernel(
+          kernelCacheId(),
+          extractRawPtrs(executionInfo_.inputsInfo),
+          extractRawPtrs(executionInfo_.outputsInfo));
+      if (rr) {
+        fromManualCache = true;
+        kernelSource = KernelSource::KernelBundle;
+        return rr;
+      }
+    }
     if (ManualCudaCache::cacheEnabled()) {
       auto rr = ManualCudaCache::getCache()->retrieveKernel(
           cacheKeyId_,
           extractRawPtrs(executionInfo_.inputsInfo),
           extractRawPtrs(executionInfo_.outputsInfo));
       if (rr) {
+        fromManualCache = true;
+        kernelSource = KernelSource::ManualCache;
+        return rr;
+      }
+      // Templates are registered by the name of the TC
+      rr = ManualCudaCache::getCache()->retrieveTemplateKernel(
+          halideComponents_->getDef().name().name(),
+          options,
+          computeParamValueMap(
+              *halideComponents_, extractRawPtrs(executionInfo_.inputsInfo)),
+          validTemplate);
+      if (rr) {
+        fromManualCache = true;
+        kernelSource = KernelSource::ManualCache;
         return rr;
       }
     }
@@ -71,49 +567,152 @@ void CudaTcExecutor::compile(const tc::CudaMappingOptions& options) {
         << "options string is empty, are you trying compile "
         << "a dummy CudaTcExecutor?";
     return CudaCache::getCache()->retrieveKernel(
-        cacheKeyId_,
+        kernelCacheId(),
         options,
         extractRawPtrs(executionInfo_.inputsInfo),
         extractRawPtrs(executionInfo_.outputsInfo));
   }();
 
+  if (not validTemplate) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "[COMPILE] Pruned invalid values of the kernel template";
+    rtcFun = nullptr;
+    return false;
+  }
+  // The kernels missing from the caches are compiled by the compile server,
+  // if any, the process only loads them.  Split kernels, and the kernels of
+  // constant inputs, whose values the server cannot read, are compiled in
+  // process.
+  bool fromServer = false;
+  if (not cachedOp and not FLAGS_cuda_compile_server.empty() and
+      not options.proto().split_kernels() and constantInputs_.empty()) {
+    cachedOp =
+        requestKernel(FLAGS_cuda_compile_server, compileRequest(options));
+    fromServer = cachedOp != nullptr;
+  }
   if (cachedOp) {
+    if (fromServer) {
+      kernelSource = KernelSource::CompileServer;
+    } else if (!fromManualCache) {
+      kernelSource = KernelSource::CudaCache;
+    }
     cudaSource = cachedOp->source;
     grid = cachedOp->grid;
     block = cachedOp->block;
     executionInfo_.kernelParams = cachedOp->parameters;
     kernelSpecializedName = cachedOp->specializedName;
+    dynamicSharedMemory = cachedOp->dynamicSharedMemory;
+    sharedMemoryFootprint = dynamicSharedMemory;
     LOG_IF(INFO, FLAGS_debug_tc_mapper) << "generatedCuda: " << cudaSource;
     LOG_IF(INFO, FLAGS_debug_tc_mapper) << "retrieved grid: " << grid;
     LOG_IF(INFO, FLAGS_debug_tc_mapper) << "retrieved block: " << block;
   } else {
     compileWithTcMapper();
     cudaSource = appendOptionsAndGitHash(cudaSource, options);
-    if (CudaCache::cacheEnabled()) {
-      LOG_IF(INFO, FLAGS_debug_tc_mapper) << "original grid: " << grid;
-      LOG_IF(INFO, FLAGS_debug_tc_mapper) << "original block: " << block;
-      CudaCache::getCache()->cacheKernel(
-          cacheKeyId_,
+  }
+
+  if (pruningFunction(this)) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "[COMPILE] Pruned before NVRTC";
+    return false;
+  }
+
+  if ((not cachedOp or fromServer) and CudaCache::cacheEnabled() and
+      splitKernels.empty()) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "original grid: " << grid;
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "original block: " << block;
+    CudaCache::getCache()->cacheKernel(
+        kernelCacheId(),
+        options,
+        extractRawPtrs(executionInfo_.inputsInfo),
+        extractRawPtrs(executionInfo_.outputsInfo),
+        kernelSpecializedName,
+        executionInfo_.kernelParams,
+        cudaSource,
+        grid,
+        block,
+        dynamicSharedMemory);
+  }
+
+  rtcFun = nullptr; // force unloading in case we
+  // NVRTC the same name / input with different options.
+  if (cachedOp and not cachedOp->cubin.empty()) {
+    // The bundle or the server hold a binary for this device, no need to run
+    // NVRTC.
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "[COMPILE] Loading " << (fromServer ? "served" : "bundled")
+        << " cubin";
+    rtcFun = CudaRTCFunction::Load(
+        kernelSpecializedName,
+        cachedOp->cubin,
+        makeCudaCompilerOptions(options));
+    rtcFun->SetMaxDynamicSharedMemory(dynamicSharedMemory);
+    rtcFun->SetCooperative(options.proto().cooperative_kernels());
+    if (cachedOp->hasAttributes) {
+      rtcFun->SetAttributes(cachedOp->attributes);
+    }
+    if (fromServer and CudaCache::cacheEnabled()) {
+      CudaCache::getCache()->cacheKernelPtx(
+          kernelCacheId(),
           options,
           extractRawPtrs(executionInfo_.inputsInfo),
           extractRawPtrs(executionInfo_.outputsInfo),
-          kernelSpecializedName,
-          executionInfo_.kernelParams,
-          cudaSource,
-          grid,
-          block);
+          CudaRTCFunction::CurrentDeviceArchitecture(),
+          cachedOp->ptx);
+    }
+    shareParametricKernel(parametricKey);
+    return true;
+  }
+  if (cachedOp and not cachedOp->ptx.empty()) {
+    // PTX was cached for this architecture, no need to run NVRTC.
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "[COMPILE] Loading cached PTX";
+    rtcFun = CudaRTCFunction::Load(
+        kernelSpecializedName, cachedOp->ptx, makeCudaCompilerOptions(options));
+    rtcFun->SetMaxDynamicSharedMemory(dynamicSharedMemory);
+    rtcFun->SetCooperative(options.proto().cooperative_kernels());
+    if (cachedOp->hasAttributes) {
+      rtcFun->SetAttributes(cachedOp->attributes);
     }
+    shareParametricKernel(parametricKey);
+    return true;
   }
 
-  rtcFun = nullptr; // force unloading in case we
-  // NVRTC the same name / input with different options.
+  ProfilerRange nvrtcRange("tc nvrtc");
   auto t0 = std::chrono::high_resolution_clock::now();
-  rtcFun = CudaRTCFunction::Compile(kernelSpecializedName, cudaSource);
+  rtcFun = CudaRTCFunction::Compile(
+      kernelSpecializedName, cudaSource, makeCudaCompilerOptions(options));
+  rtcFun->SetMaxDynamicSharedMemory(dynamicSharedMemory);
+  rtcFun->SetCooperative(options.proto().cooperative_kernels());
+  if (cachedOp and cachedOp->hasAttributes) {
+    rtcFun->SetAttributes(cachedOp->attributes);
+  }
+  for (auto& kernel : splitKernels) {
+    kernel.rtcFun = CudaRTCFunction::Compile(
+        kernel.specializedName,
+        kernel.source,
+        makeCudaCompilerOptions(options));
+    kernel.rtcFun->SetMaxDynamicSharedMemory(kernel.dynamicSharedMemory);
+  }
   auto t1 = std::chrono::high_resolution_clock::now();
+  nvrtcRange.end();
+  timings.nvrtc = t1 - t0;
   LOG_IF(INFO, FLAGS_debug_tc_mapper)
       << "[COMPILE] Compiling with nvrtc took: "
       << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
       << "ms" << std::endl;
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "[COMPILE] Timings: " << timings;
+  if (CudaCache::cacheEnabled() and not fromManualCache and
+      splitKernels.empty()) {
+    const auto& ptx = rtcFun->ptx();
+    CudaCache::getCache()->cacheKernelPtx(
+        kernelCacheId(),
+        options,
+        extractRawPtrs(executionInfo_.inputsInfo),
+        extractRawPtrs(executionInfo_.outputsInfo),
+        CudaRTCFunction::CurrentDeviceArchitecture(),
+        std::string(ptx.begin(), ptx.end()));
+  }
+  shareParametricKernel(parametricKey);
+  return true;
 }
 
 namespace {
@@ -142,53 +741,295 @@ std::vector<int> narrowParamsVector(const std::vector<long>& params) {
 }
 } // namespace
 
+CudaCompileRequestProto CudaTcExecutor::compileRequest(
+    const tc::CudaMappingOptions& options) const {
+  CudaCompileRequestProto request;
+  std::stringstream tc;
+  lang::tcFormat(tc, tcTree_);
+  request.set_tc(tc.str());
+  for (const auto& input : executionInfo_.inputsInfo) {
+    *request.add_inputs() = detail::TensorInfo(input.get()).toProtobuf();
+  }
+  for (const auto& output : executionInfo_.outputsInfo) {
+    *request.add_outputs() = detail::TensorInfo(output.get()).toProtobuf();
+  }
+  // The server has no data, the vector width is the one of the inputs here.
+  auto served = options;
+  served.vectorizeWidth(vectorWidth_).constantInputs({});
+  *request.mutable_options() = served.proto();
+  request.set_architecture(CudaRTCFunction::CurrentDeviceRealArchitecture());
+  return request;
+}
+
+std::unique_ptr<CudaLibraryCall> CudaTcExecutor::matchLibraryCall() const {
+  // Where clauses may restrict the computation to parts of the tensors.
+  for (auto statement : halideComponents_->getDef().statements()) {
+    if (statement.whereClauses().size() > 0) {
+      return nullptr;
+    }
+  }
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), *halideComponents_);
+  auto gemm = polyhedral::matchGemmCall(*scop);
+  if (!gemm) {
+    return nullptr;
+  }
+  return CudaLibraryCall::makeGemm(
+      *gemm,
+      extractRawPtrs(executionInfo_.inputsInfo),
+      extractRawPtrs(executionInfo_.outputsInfo));
+}
+
+std::string CudaTcExecutor::parametricKernelKey(
+    const tc::CudaMappingOptions& options) {
+  isl::with_exceptions::ScopedCtx islCtx;
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), *halideComponents_);
+  auto context =
+      scop->makeContextFromInputs(extractRawPtrs(executionInfo_.inputsInfo));
+  auto ranges = parametricRanges(*scop, options, context);
+  executionInfo_.kernelParams =
+      narrowParamsVector(scop->getParameterValues(context));
+
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  std::stringstream ss;
+  ss << kernelCacheId() << '\0' << executionInfo_.options << '\0' << device
+     << " v" << vectorWidth_;
+  for (const auto& input : executionInfo_.inputsInfo) {
+    ss << ' ' << static_cast<int>(input->dtype.code) << ':'
+       << static_cast<int>(input->dtype.bits) << ':' << input->ndim;
+  }
+  for (auto value : fixedParameterValues(
+           *scop, ranges, executionInfo_.kernelParams)) {
+    ss << ' ' << value;
+  }
+  // Kernels for inputs that are not packed are specialized for their strides.
+  ss << specializedStridesSuffix();
+  // Kernels of different buckets differ by their ranges.
+  for (const auto& kvp : std::map<std::string, std::pair<long, long>>(
+           ranges.begin(), ranges.end())) {
+    ss << ' ' << kvp.first << '=' << kvp.second.first << ':'
+       << kvp.second.second;
+  }
+  return ss.str();
+}
+
+bool CudaTcExecutor::retrieveParametricKernel(const std::string& key) {
+  std::lock_guard<std::mutex> lock(parametricKernelsMutex);
+  auto it = parametricKernels.find(key);
+  if (it == parametricKernels.end()) {
+    return false;
+  }
+  rtcFun = it->second.rtcFun.lock();
+  if (!rtcFun) {
+    parametricKernels.erase(it);
+    return false;
+  }
+  sharesKernel_ = true;
+  kernelSpecializedName = it->second.specializedName;
+  cudaSource = it->second.source;
+  grid = it->second.grid;
+  block = it->second.block;
+  dynamicSharedMemory = it->second.dynamicSharedMemory;
+  sharedMemoryFootprint = it->second.sharedMemoryFootprint;
+  privateMemoryFootprint = it->second.privateMemoryFootprint;
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "[COMPILE] Sharing parametric kernel " << kernelSpecializedName;
+  return true;
+}
+
+void CudaTcExecutor::shareParametricKernel(const std::string& key) {
+  if (key.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(parametricKernelsMutex);
+  auto& kernel = parametricKernels[key];
+  kernel.rtcFun = rtcFun;
+  kernel.specializedName = kernelSpecializedName;
+  kernel.source = cudaSource;
+  kernel.grid = grid;
+  kernel.block = block;
+  kernel.dynamicSharedMemory = dynamicSharedMemory;
+  kernel.sharedMemoryFootprint = sharedMemoryFootprint;
+  kernel.privateMemoryFootprint = privateMemoryFootprint;
+  sharesKernel_ = true;
+}
+
+void CudaTcExecutor::generateCuda(const tc::CudaMappingOptions& options) {
+  executionInfo_.options = options.toProtobufSerializedString();
+  vectorWidth_ = alignedVectorWidth(options, executionInfo_.inputsInfo);
+  readConstantInputs(options);
+  zeroedOutputs_ = zeroedOutputs(*halideComponents_, options);
+  checkZeroedOutputsArePacked(zeroedOutputs_, executionInfo_.outputsInfo);
+  compileWithTcMapper();
+  cudaSource = appendOptionsAndGitHash(cudaSource, options);
+}
+
 void CudaTcExecutor::compileWithTcMapper() {
+  // The job owns its isl context, concurrent compilations share no isl
+  // state.
+  isl::with_exceptions::ScopedCtx islCtx;
+  // The polyhedral phases accumulate their timings in the thread-local ones.
+  auto& phases = compilationTimings();
+  phases = CompilationTimings();
+  auto start = std::chrono::high_resolution_clock::now();
+  ProfilerRange halide2islRange("tc halide2isl");
+
+  auto options = CudaMappingOptions(executionInfo_.options);
+  if (options.proto().vectorize_width() != vectorWidth_) {
+    options.vectorizeWidth(vectorWidth_);
+  }
+  // The reductions over words of 4 bytes need the sizes of the loops, they
+  // are only packed in kernels specialized to the input sizes.
+  auto packing = options.proto().dp4a_packing();
+  auto scopHalide = halideComponents_;
+  if (packing != Dp4aPacking::NoDp4a and
+      options.proto().parametric_sizes_size() == 0 and
+      options.proto().size_buckets_size() == 0) {
+    scopHalide = std::make_shared<const tc2halide::HalideComponents>(
+        packDp4aReductions(
+            *halideComponents_,
+            extractRawPtrs(executionInfo_.inputsInfo),
+            packing == Dp4aPacking::PackedDp4a));
+  }
+
   // A bit chicken-and-eggy, need scop from TC to have the space to build the
   // context to specialize the scop..
   auto scopTmp = polyhedral::Scop::makeScop(
-      isl::with_exceptions::globalIslCtx(), halideComponents_);
+      isl::with_exceptions::globalIslCtx(), *scopHalide);
   auto globalParameterContext =
       scopTmp->makeContextFromInputs(extractRawPtrs(executionInfo_.inputsInfo));
+  // Parametric sizes stay symbolic over their range, the kernel takes them
+  // as arguments and the grid covers the largest sizes in range.
+  auto ranges = parametricRanges(*scopTmp, options, globalParameterContext);
+  if (!ranges.empty() and
+      (options.proto().split_kernels() or
+       options.proto().cooperative_kernels())) {
+    throw std::invalid_argument(
+        "split kernels cannot have parametric sizes or size buckets");
+  }
+  auto specializationContext = ranges.empty()
+      ? globalParameterContext
+      : scopTmp->makeParametricContext(globalParameterContext, ranges);
   scopTmp = polyhedral::Scop::makeSpecializedScop(
       *scopTmp,
-      globalParameterContext.intersect(scopTmp->globalParameterContext));
-  LOG_IF(INFO, FLAGS_debug_tc_mapper)
-      << CudaMappingOptions(executionInfo_.options);
+      specializationContext.intersect(scopTmp->globalParameterContext));
+  scopTmp->specializeStridesToInputs(
+      extractRawPtrs(executionInfo_.inputsInfo));
+  scopTmp->specializeStridesToOutputs(
+      extractRawPtrs(executionInfo_.outputsInfo));
+  scopTmp->constantInputs = constantInputs_;
+  phases.halide2isl += std::chrono::high_resolution_clock::now() - start;
+  halide2islRange.end();
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << options;
   LOG_IF(INFO, FLAGS_debug_tc_mapper) << *(scopTmp->scheduleRoot());
 
   // Now we can build stuff
-  auto mappedScop =
-      polyhedral::MappedScop::makeWithOuterBlockInnerThreadStrategy(
-          std::move(scopTmp), CudaMappingOptions(executionInfo_.options));
+  start = std::chrono::high_resolution_clock::now();
+  // Includes the dependences, schedule and promotion ranges.
+  ProfilerRange mappingRange("tc mapping");
+  std::vector<std::unique_ptr<polyhedral::MappedScop>> mappedScops;
+  if (options.proto().cooperative_kernels()) {
+    mappedScops = polyhedral::MappedScop::
+        makeCooperativeWithOuterBlockInnerThreadStrategy(
+            std::move(scopTmp), options);
+  } else if (options.proto().split_kernels()) {
+    mappedScops =
+        polyhedral::MappedScop::makeSplitWithOuterBlockInnerThreadStrategy(
+            std::move(scopTmp), options);
+  } else {
+    mappedScops.push_back(
+        polyhedral::MappedScop::makeWithOuterBlockInnerThreadStrategy(
+            std::move(scopTmp), options));
+  }
+  const auto& mappedScop = mappedScops.front();
+  phases.mapping += std::chrono::high_resolution_clock::now() - start -
+      phases.dependences - phases.schedule - phases.promotion;
+  mappingRange.end();
   LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Mapped schedule:" << std::endl
                                       << *(mappedScop->schedule());
 
   executionInfo_.kernelParams = narrowParamsVector(
       mappedScop->scop().getParameterValues(globalParameterContext));
   kernelSpecializedName = specializeKernelName(
-      executionInfo_.kernelName, executionInfo_.kernelParams);
+                              executionInfo_.kernelName,
+                              fixedParameterValues(
+                                  mappedScop->scop(),
+                                  ranges,
+                                  executionInfo_.kernelParams)) +
+      specializedStridesSuffix() + constantInputsKey_ + "_o" +
+      kernelOptionsHash(executionInfo_.options);
 
   // This updates the launch bounds with the actual result from compilation
   // with tightening of launch_bounds.
   // What you get is not what you asked for, the autotuner should adapt to
   // that.
-  std::tie(cudaSource, grid, block) =
-      mappedScop->codegen(kernelSpecializedName);
+  splitKernels.clear();
+  {
+    ScopeTimer timer(phases.codegen, "tc codegen");
+    // The stages of a cooperative kernel are all in the first one.
+    auto nKernels = mappedScops.size();
+    if (options.proto().cooperative_kernels()) {
+      std::tie(cudaSource, grid, block, dynamicSharedMemory) =
+          polyhedral::MappedScop::codegenCooperative(
+              kernelSpecializedName, mappedScops);
+      nKernels = 1;
+    } else {
+      std::tie(cudaSource, grid, block, dynamicSharedMemory) =
+          mappedScop->codegen(kernelSpecializedName);
+    }
+    for (size_t i = 1; i < nKernels; ++i) {
+      CudaSplitKernel kernel;
+      kernel.specializedName =
+          kernelSpecializedName + "_split" + std::to_string(i);
+      std::tie(
+          kernel.source,
+          kernel.grid,
+          kernel.block,
+          kernel.dynamicSharedMemory) =
+          mappedScops[i]->codegen(kernel.specializedName);
+      splitKernels.push_back(std::move(kernel));
+    }
+  }
+  phases.tc2halide = timings.tc2halide;
+  timings = phases;
+  sharedMemoryFootprint = 0;
+  privateMemoryFootprint = 0;
+  for (const auto& kernelScop : mappedScops) {
+    const auto& scop = kernelScop->scop();
+    sharedMemoryFootprint = std::max(
+        sharedMemoryFootprint, polyhedral::dynamicSharedMemorySize(scop));
+    privateMemoryFootprint =
+        std::max(privateMemoryFootprint, polyhedral::privateMemorySize(scop));
+  }
   LOG_IF(INFO, FLAGS_dump_cuda) << "generatedCuda: " << cudaSource;
+  for (const auto& kernel : splitKernels) {
+    LOG_IF(INFO, FLAGS_dump_cuda) << "generatedCuda: " << kernel.source;
+  }
 }
 
 Duration CudaTcExecutor::run(
     const std::vector<const DLTensor*>& inputs,
     const std::vector<DLTensor*>& outputs,
-    bool profile) const {
-  CHECK(rtcFun) << "Can't launch uncompiled: " << executionInfo_.kernelName;
+    bool profile,
+    const RuntimeInformation& info) const {
+  CHECK(rtcFun or libraryCall_)
+      << "Can't launch uncompiled: " << executionInfo_.kernelName;
   CHECK_NE(executionInfo_.options, "");
+  CHECK(!info.graph) << "Only uncheckedRun can be recorded in a graph";
   checkSizesAndStridesAreCompliant(
-      inputs, executionInfo_.inputsInfo, halideComponents_.getDef().params());
+      inputs, executionInfo_.inputsInfo, halideComponents_->getDef().params());
   checkSizesAndStridesAreCompliant(
       outputs,
       executionInfo_.outputsInfo,
-      halideComponents_.getDef().returns());
+      halideComponents_->getDef().returns());
+  for (auto input : inputs) {
+    CHECK_EQ(alignedVectorWidth(vectorWidth_, input), vectorWidth_)
+        << "input at " << input->data << " is not aligned for the vector "
+        << "copies of " << kernelSpecializedName;
+  }
 
   std::vector<const void*> I;
   std::vector<void*> O;
@@ -198,18 +1039,46 @@ Duration CudaTcExecutor::run(
   for (int i = 0; i < outputs.size(); ++i) {
     O.push_back(outputs[i]->data);
   }
-  cudaStream_t stream = 0;
+  // Enqueued before the timing starts, see --benchmark_cold_cache.
+  if (profile and FLAGS_benchmark_cold_cache) {
+    flushL2Cache(info.stream);
+  }
+  if (libraryCall_) {
+    auto res = libraryCall_->launch(O, I, info.stream, profile);
+    if (profile and OptionsCache::cacheEnabled()) {
+      OptionsCache::getCache()->recordRuntime(
+          cacheKeyId_,
+          CudaMappingOptions(executionInfo_.options),
+          inputs,
+          constPtrs(outputs),
+          res);
+    }
+    return res;
+  }
   CHECK_NE(grid.view[0], 0) << "Grid dims are not set up";
   CHECK_NE(block.view[0], 0) << "Block dims are not set up";
+  appendTemporaries(info.stream, &O);
+  zeroGridReductionOutputs(O, info.stream);
   auto res = rtcFun->Launch(
       grid.view.extractDefaultedArray(),
       block.view.extractDefaultedArray(),
-      0,
-      stream,
+      dynamicSharedMemory,
+      info.stream,
       executionInfo_.kernelParams,
       O,
       I,
       profile);
+  for (const auto& kernel : splitKernels) {
+    res += kernel.rtcFun->Launch(
+        kernel.grid.view.extractDefaultedArray(),
+        kernel.block.view.extractDefaultedArray(),
+        kernel.dynamicSharedMemory,
+        info.stream,
+        executionInfo_.kernelParams,
+        O,
+        I,
+        profile);
+  }
   if (profile and OptionsCache::cacheEnabled()) {
     OptionsCache::getCache()->recordRuntime(
         cacheKeyId_,
@@ -223,20 +1092,104 @@ Duration CudaTcExecutor::run(
 
 void CudaTcExecutor::uncheckedRun(
     const std::vector<const void*>& inputs,
-    const std::vector<void*>& outputs) const {
-  cudaStream_t stream = 0;
+    const std::vector<void*>& outputs,
+    const RuntimeInformation& info) const {
+  if (libraryCall_) {
+    CHECK(!info.graph) << "library calls cannot be recorded in a graph";
+    libraryCall_->launch(outputs, inputs, info.stream, false);
+    return;
+  }
   CHECK_NE(grid.view[0], 0) << "Grid dims are not set up";
   CHECK_NE(block.view[0], 0) << "Block dims are not set up";
+  if (info.graph) {
+    CHECK(zeroedOutputs_.empty())
+        << "launches with grid reductions cannot be recorded in a graph";
+    CHECK(!workspaces_)
+        << "launches with temporaries cannot be recorded in a graph";
+    info.graph->record(
+        rtcFun,
+        grid.view.extractDefaultedArray(),
+        block.view.extractDefaultedArray(),
+        dynamicSharedMemory,
+        executionInfo_.kernelParams,
+        outputs,
+        inputs);
+    for (const auto& kernel : splitKernels) {
+      info.graph->record(
+          kernel.rtcFun,
+          kernel.grid.view.extractDefaultedArray(),
+          kernel.block.view.extractDefaultedArray(),
+          kernel.dynamicSharedMemory,
+          executionInfo_.kernelParams,
+          outputs,
+          inputs);
+    }
+    return;
+  }
   bool profile = false;
+  std::vector<void*> O(outputs);
+  appendTemporaries(info.stream, &O);
+  zeroGridReductionOutputs(O, info.stream);
   rtcFun->Launch(
       grid.view.extractDefaultedArray(),
       block.view.extractDefaultedArray(),
-      0,
-      stream,
+      dynamicSharedMemory,
+      info.stream,
       executionInfo_.kernelParams,
-      outputs,
+      O,
       inputs,
       profile);
+  for (const auto& kernel : splitKernels) {
+    kernel.rtcFun->Launch(
+        kernel.grid.view.extractDefaultedArray(),
+        kernel.block.view.extractDefaultedArray(),
+        kernel.dynamicSharedMemory,
+        info.stream,
+        executionInfo_.kernelParams,
+        O,
+        inputs,
+        profile);
+  }
+}
+
+void CudaTcExecutor::zeroGridReductionOutputs(
+    const std::vector<void*>& outputs,
+    cudaStream_t stream) const {
+  const auto& outputsInfo = executionInfo_.outputsInfo;
+  for (auto i : zeroedOutputs_) {
+    const auto& info = i < outputsInfo.size()
+        ? outputsInfo[i]
+        : executionInfo_.temporariesInfo.at(i - outputsInfo.size());
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaMemsetAsync(
+        outputs.at(i), 0, spannedBytes(info.get()), stream));
+  }
+}
+
+void CudaTcExecutor::appendTemporaries(
+    cudaStream_t stream,
+    std::vector<void*>* outputs) const {
+  if (workspaces_) {
+    workspaces_->appendBuffers(stream, outputs);
+  }
+}
+
+std::unique_ptr<CudaPreparedLaunch> CudaTcExecutor::prepareLaunch() const {
+  CHECK(!libraryCall_) << "library calls cannot be prepared";
+  CHECK(rtcFun) << "Can't launch uncompiled: " << executionInfo_.kernelName;
+  CHECK_NE(grid.view[0], 0) << "Grid dims are not set up";
+  CHECK_NE(block.view[0], 0) << "Block dims are not set up";
+  CHECK(zeroedOutputs_.empty())
+      << "launches with grid reductions cannot be prepared";
+  CHECK(splitKernels.empty()) << "launches of split kernels cannot be prepared";
+  CHECK(!workspaces_) << "launches with temporaries cannot be prepared";
+  return tc::make_unique<CudaPreparedLaunch>(
+      rtcFun,
+      grid.view.extractDefaultedArray(),
+      block.view.extractDefaultedArray(),
+      dynamicSharedMemory,
+      executionInfo_.kernelParams,
+      executionInfo_.outputsInfo.size(),
+      executionInfo_.inputsInfo.size());
 }
 
 } // namespace tc
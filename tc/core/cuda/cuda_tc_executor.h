@@ -15,13 +15,18 @@
  */
 #pragma once
 
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <dlpack/dlpack.h>
 
+#include "tc/core/cuda/cuda_launch_graph.h"
+#include "tc/core/cuda/cuda_library_call.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/cuda/cuda_rtc.h"
+#include "tc/core/cuda/cuda_workspace.h"
 #include "tc/core/halide_utils.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/tc_executor.h"
@@ -29,17 +34,64 @@
 #include "tc/lang/parser.h"
 
 namespace tc {
+class CudaCompileRequestProto;
+
+/// Launch-time information that is not part of the compiled kernel.
+struct CudaRuntimeInformation {
+  CudaRuntimeInformation() : stream(0), graph(nullptr) {}
+  explicit CudaRuntimeInformation(cudaStream_t s) : stream(s), graph(nullptr) {}
+  explicit CudaRuntimeInformation(CudaLaunchGraph* g) : stream(0), graph(g) {}
+
+  /// Stream on which the kernel is launched (and timed when profiling).
+  /// Defaults to the legacy default stream.
+  cudaStream_t stream;
+
+  /// If set, uncheckedRun records the launch into the graph instead of
+  /// launching the kernel.
+  CudaLaunchGraph* graph;
+};
+
+/// A kernel launched after the first one by the executors of options that
+/// split the schedule into several kernels (see
+/// CudaMappingOptionsProto::split_kernels).  All the kernels of an executor
+/// take the same arguments.
+struct CudaSplitKernel {
+  std::string specializedName;
+  std::string source;
+  Grid grid{{0, 0, 0}};
+  Block block{{0, 0, 0}};
+  size_t dynamicSharedMemory{0};
+  std::shared_ptr<CudaRTCFunction> rtcFun;
+};
+
+/// The short hash of the serialized options that ends the specialized names
+/// of the kernels compiled with them, after "_o".  It is stable across
+/// processes, so that the kernels of profiler traces can be mapped back to
+/// the OptionsCache entries of the same hash.
+std::string kernelOptionsHash(const std::string& serializedOptions);
+
+/// How NVRTC and the driver compile the kernels mapped with options.
+CudaCompilerOptions makeCudaCompilerOptions(const CudaMappingOptions& options);
 
 class CudaTcExecutor : public ::tc::TcExecutor {
  public:
   using MappingOptionsType = CudaMappingOptions;
+  using RuntimeInformation = CudaRuntimeInformation;
+  using PreparedLaunch = CudaPreparedLaunch;
 
   CudaTcExecutor(
       std::string id,
       const std::vector<const DLTensor*>& inputsInfo,
       const std::string& options,
       lang::TreeRef tcDefinition)
-      : TcExecutor(id, inputsInfo, options, tcDefinition) {}
+      : TcExecutor(
+            id,
+            inputsInfo,
+            options,
+            tcDefinition,
+            !options.empty() &&
+                CudaMappingOptions(options)
+                    .generic.proto.inline_pointwise_temporaries()) {}
 
   ~CudaTcExecutor() {}
 
@@ -54,7 +106,7 @@ class CudaTcExecutor : public ::tc::TcExecutor {
   // If you need another kernel for another Tc or another inputs, outputs,
   // options then just instantiate another CudaTcExecutor.
   // This is because for the time being we fully specialize all the sizes and
-  // strides at runtime.
+  // strides at runtime, except for the parametric sizes of the options.
   // @{
   void compile(const std::string& options) override {
     compile(CudaMappingOptions(options));
@@ -62,6 +114,36 @@ class CudaTcExecutor : public ::tc::TcExecutor {
   void compile(const tc::CudaMappingOptions& options);
   // @}
 
+  // Same as compile but calls pruningFunction once the kernel is mapped (or
+  // retrieved from a cache) and before it is compiled by NVRTC, e.g. to
+  // discard kernels exceeding the resources of the device without paying for
+  // their compilation.  Returns false, leaving the executor uncompiled, if
+  // the kernel is pruned.
+  // @{
+  bool compile(
+      const std::string& options,
+      const std::function<bool(const CudaTcExecutor*)>& pruningFunction) {
+    return compile(CudaMappingOptions(options), pruningFunction);
+  }
+  bool compile(
+      const tc::CudaMappingOptions& options,
+      const std::function<bool(const CudaTcExecutor*)>& pruningFunction);
+  // @}
+
+  // Loads the kernels on each of devices ahead of their first launch there
+  // (see CudaRTCFunction::Warmup), e.g. to keep the first requests after a
+  // deployment from paying for the driver JIT.  compile loads them on the
+  // devices of FLAGS_cuda_warmup_devices.  Library calls load nothing.
+  void warmup(const std::vector<int>& devices) const;
+
+  // Only runs the mapper, bypassing the caches, and sets cudaSource, grid,
+  // block, dynamicSharedMemory and the kernel parameters without compiling
+  // the source, e.g. to compile it for other devices.
+  void generateCuda(const tc::CudaMappingOptions& options);
+  const std::vector<int>& kernelParameters() const {
+    return executionInfo_.kernelParams;
+  }
+
   // Run can be called multiple times given a compilation, inputs are allowed
   // to change in that their data pointer is allowed to change.
   // Sizes and strides must remain constant otherwise this is an error
@@ -70,48 +152,191 @@ class CudaTcExecutor : public ::tc::TcExecutor {
   // It is the caller's responsibility to ensure proper non-aliasing (or
   // advanced aliasing) properties of the input and output tensors.
   // if profile is set the kernel runtime (nanoseconds) is returned
+  // The kernel is launched on info.stream, which defaults to stream 0.
+  // @{
   Duration run(
       const std::vector<const DLTensor*>& inputs,
       const std::vector<DLTensor*>& outputs,
-      bool profile = false) const;
+      bool profile = false) const override {
+    return run(inputs, outputs, profile, RuntimeInformation());
+  }
+  Duration run(
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      bool profile,
+      const RuntimeInformation& info) const;
+  // @}
 
   // This is the "low-latency" mode in which we just propagate raw pointers to
   // data in GPU address space.
   // No tensor-related information can be checked so it is the user's
   // responsibility to ensure that shapes and strides match. If the user
   // doesn't then segfault will likely occur.
+  // If info.graph is set the launch is recorded into it for later replay.
+  // @{
   void uncheckedRun(
       const std::vector<const void*>& inputs,
-      const std::vector<void*>& outputs) const;
+      const std::vector<void*>& outputs) const override {
+    uncheckedRun(inputs, outputs, RuntimeInformation());
+  }
+  void uncheckedRun(
+      const std::vector<const void*>& inputs,
+      const std::vector<void*>& outputs,
+      const RuntimeInformation& info) const;
+  // @}
+
+  // Low-latency launch path for repeated uncheckedRun calls: the returned
+  // descriptor holds the marshalled kernel arguments for the current device
+  // and launching it performs no allocation and takes no lock.  Only the
+  // data pointers may be changed between launches.
+  std::unique_ptr<CudaPreparedLaunch> prepareLaunch() const;
 
   bool hasRuntimeCompiledFunction() override {
-    return rtcFun.get() != nullptr;
+    return rtcFun.get() != nullptr or libraryCall_ != nullptr;
+  }
+
+  // Whether the options match library calls and the TC is computed by a
+  // library call instead of a generated kernel.  There is no source, grid
+  // or block then.
+  bool isLibraryCall() const {
+    return libraryCall_ != nullptr;
   }
 
   // It is necessary to clear the RTC manually because it can throw and we
   // can't have that in the destructor.
+  // A kernel shared with the executors of other parametric sizes is only
+  // released, the last executor holding it unloads it.
   void clearRuntimeCompiledFunction() override {
+    if (workspaces_) {
+      workspaces_->clear();
+    }
+    libraryCall_ = nullptr;
     if (!hasRuntimeCompiledFunction()) {
       return;
     }
+    if (sharesKernel_) {
+      rtcFun = nullptr;
+      return;
+    }
     rtcFun->clear();
+    for (auto& kernel : splitKernels) {
+      if (kernel.rtcFun) {
+        kernel.rtcFun->clear();
+      }
+    }
   }
 
+  // The attributes of the kernel, of the first one if split, loading its
+  // module on the current device unless they are known, e.g. from the
+  // CudaCache.  They are stored in the CudaCache when it is enabled.
+  CudaKernelAttributes kernelAttributes() const;
+
+  // The PTX of the kernel, of the first one if split, or the cubin it was
+  // loaded from.  Empty for library calls.
+  std::string ptx() const;
+
+  // Adds the CUDA sources and the PTX of the kernels, unless shared with
+  // other executors.
+  size_t memoryFootprint() const override;
+
   std::string kernelName() const {
     return executionInfo_.kernelName;
   }
 
+  std::array<uint64_t, 3> launchGrid() const override {
+    return grid.view.extractDefaultedArray();
+  }
+  std::array<uint64_t, 3> launchBlock() const override {
+    return block.view.extractDefaultedArray();
+  }
+
  private:
   void compileWithTcMapper();
+  // compile without the warmup.
+  bool compileKernels(
+      const tc::CudaMappingOptions& options,
+      const std::function<bool(const CudaTcExecutor*)>& pruningFunction);
+
+  // Reads the values of the inputs listed by options.constantInputs that
+  // can be baked into the kernels and sets their fingerprint.
+  void readConstantInputs(const tc::CudaMappingOptions& options);
+
+  // The id of the kernels in the CudaCache and KernelBundle: the TC followed
+  // by the fingerprint of the values of the inputs baked into them.
+  std::string kernelCacheId() const {
+    return cacheKeyId_ + constantInputsKey_;
+  }
+
+  // The request compiling the kernel of options on the compile server, for
+  // the current device and with the vector width of the inputs.
+  CudaCompileRequestProto compileRequest(
+      const tc::CudaMappingOptions& options) const;
+
+  // The library call computing the TC with the sizes of the executor, if
+  // any.
+  std::unique_ptr<CudaLibraryCall> matchLibraryCall() const;
+
+  // Parametric kernels (see CudaMappingOptions::parametricSize and
+  // sizeBuckets) are shared by all the executors with sizes in range.
+  // parametricKernelKey checks the sizes against the ranges, sets the kernel
+  // parameters and returns the key under which the kernel is shared.
+  // @{
+  std::string parametricKernelKey(const tc::CudaMappingOptions& options);
+  bool retrieveParametricKernel(const std::string& key);
+  void shareParametricKernel(const std::string& key);
+  // @}
+
+  // Zero the outputs that kernels mapped with grid reductions do not
+  // initialize, on the launch stream.  outputs are the kernel outputs, i.e.
+  // including the temporaries.
+  void zeroGridReductionOutputs(
+      const std::vector<void*>& outputs,
+      cudaStream_t stream) const;
+
+  // Append the buffers of the temporaries for the current device and the
+  // launch stream to outputs, which become the outputs of the kernels.
+  void appendTemporaries(cudaStream_t stream, std::vector<void*>* outputs)
+      const;
 
  public:
   std::string kernelSpecializedName;
   std::string cudaSource;
   Grid grid{{0, 0, 0}};
   Block block{{0, 0, 0}};
+  // Bytes of dynamic shared memory each launch requests.
+  size_t dynamicSharedMemory{0};
+  // Bytes promoted to shared memory per block and to private memory per
+  // thread by the mapper, the largest ones of all the kernels if split.
+  // Only the dynamic shared memory is known for kernels retrieved from a
+  // cache, the rest is 0.
+  size_t sharedMemoryFootprint{0};
+  size_t privateMemoryFootprint{0};
+  // The kernels launched after the one above, in order, if the options
+  // split the schedule.  Split kernels are neither cached nor shared.
+  std::vector<CudaSplitKernel> splitKernels;
 
  protected:
   std::shared_ptr<CudaRTCFunction> rtcFun;
+  bool sharesKernel_{false};
+  // Width of the vector copies of the inputs, the requested one reduced
+  // until the inputs at compilation are aligned for it.  Later runs must
+  // keep inputs aligned for it.
+  uint32_t vectorWidth_{1};
+  // The values at compilation of the inputs baked into the kernels by name,
+  // as array initializers (see polyhedral::Scop::constantInputs), and their
+  // fingerprint.  Later runs must pass the same values.
+  std::unordered_map<std::string, std::string> constantInputs_;
+  std::string constantInputsKey_;
+  // Positions of the outputs in gridReductionOutputs of the scop among the
+  // kernel outputs if the options enable grid reductions, zeroed before
+  // every launch.  The kernel may not update them atomically, zeroing them
+  // is then redundant.
+  std::vector<size_t> zeroedOutputs_;
+  // The buffers of the temporaries of the TC, if any, owned by the executor
+  // and reused by all its launches on a device and stream.
+  std::unique_ptr<CudaWorkspacePool> workspaces_;
+  // Set instead of rtcFun if the TC is computed by a library call.
+  std::unique_ptr<CudaLibraryCall> libraryCall_;
 };
 
 } // namespace tc
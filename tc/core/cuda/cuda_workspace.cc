@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/cuda/cuda_workspace.h"
+
+#include <cuda_runtime.h>
+
+#include "tc/core/cuda/cuda.h"
+
+namespace tc {
+
+namespace {
+// Buffers are aligned like the allocations of cudaMalloc, which is enough
+// for any vector access of the kernels.
+constexpr size_t kBufferAlignment = 256;
+} // namespace
+
+CudaWorkspacePool::CudaWorkspacePool(const std::vector<size_t>& bytes)
+    : size_(0) {
+  for (auto b : bytes) {
+    offsets_.push_back(size_);
+    size_ += (b + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+  }
+}
+
+CudaWorkspacePool::~CudaWorkspacePool() {
+  // Errors are ignored, the destructor must not throw.
+  int device;
+  if (cudaGetDevice(&device) != cudaSuccess) {
+    return;
+  }
+  for (const auto& kvp : workspaces_) {
+    cudaSetDevice(kvp.first.first);
+    cudaFree(kvp.second);
+  }
+  cudaSetDevice(device);
+}
+
+void CudaWorkspacePool::appendBuffers(
+    cudaStream_t stream,
+    std::vector<void*>* buffers) {
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  char* base;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& workspace = workspaces_[std::make_pair(device, stream)];
+    if (!workspace) {
+      TC_CUDA_RUNTIMEAPI_ENFORCE(
+          cudaMalloc(reinterpret_cast<void**>(&workspace), size_));
+    }
+    base = workspace;
+  }
+  for (auto offset : offsets_) {
+    buffers->push_back(base + offset);
+  }
+}
+
+size_t CudaWorkspacePool::numberWorkspaces() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return workspaces_.size();
+}
+
+void CudaWorkspacePool::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int device;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDevice(&device));
+  for (const auto& kvp : workspaces_) {
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaSetDevice(kvp.first.first));
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaFree(kvp.second));
+  }
+  workspaces_.clear();
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaSetDevice(device));
+}
+
+} // namespace tc
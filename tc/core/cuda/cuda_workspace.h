@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <driver_types.h> // cuda driver types
+
+namespace tc {
+
+//
+// Device buffers for the temporary tensors of an executor, i.e. the tensors
+// of a TC that are neither inputs nor outputs.  There is one workspace per
+// device and stream so that the launches on different streams do not share
+// their temporaries, launches on the same stream are ordered anyway.
+// A workspace is allocated by the first launch on its device and stream and
+// reused by the following ones, which only take a lock.
+//
+class CudaWorkspacePool {
+ public:
+  // Workspaces hold one buffer of each of the given sizes.
+  explicit CudaWorkspacePool(const std::vector<size_t>& bytes);
+  // Frees the workspaces, ignoring errors.
+  ~CudaWorkspacePool();
+
+  CudaWorkspacePool(const CudaWorkspacePool&) = delete;
+  CudaWorkspacePool& operator=(const CudaWorkspacePool&) = delete;
+
+  // Appends the buffers of the workspace of the current device and stream
+  // to buffers, allocating it on first use.
+  void appendBuffers(cudaStream_t stream, std::vector<void*>* buffers);
+
+  // Bytes of device memory of each workspace.
+  size_t workspaceSize() const {
+    return size_;
+  }
+  size_t numberWorkspaces() const;
+
+  // Frees the workspaces, the next launches allocate them again.  Unlike the
+  // destructor, this throws on errors.
+  void clear();
+
+ private:
+  std::vector<size_t> offsets_;
+  size_t size_;
+
+  mutable std::mutex mutex_;
+  // The base pointer of the workspace of each device and stream.
+  std::map<std::pair<int, cudaStream_t>, char*> workspaces_;
+};
+
+} // namespace tc
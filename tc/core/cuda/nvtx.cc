@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <nvToolsExt.h>
+
+#include "tc/core/flags.h"
+#include "tc/core/utils/time.h"
+
+namespace tc {
+namespace {
+// The profiler ranges of tc_core and of the CUDA library become NVTX
+// ranges, shown by nvprof and Nsight, if --nvtx_ranges is set when they
+// are opened.
+bool pushNvtxRange(const char* name) {
+  if (!FLAGS_nvtx_ranges) {
+    return false;
+  }
+  nvtxRangePushA(name);
+  return true;
+}
+
+void popNvtxRange() {
+  nvtxRangePop();
+}
+
+// Installed when the library is loaded, before any range is opened.
+const bool nvtxHooksInstalled = []() {
+  auto& hooks = profilerRangeHooks();
+  hooks.push = pushNvtxRange;
+  hooks.pop = popNvtxRange;
+  return true;
+}();
+} // namespace
+} // namespace tc
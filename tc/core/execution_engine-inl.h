@@ -15,33 +15,39 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "tc/core/compilation_cache.h"
+#include "tc/core/flags.h"
 #include "tc/core/polyhedral/cuda/mapping_types.h"
+#include "tc/core/telemetry.h"
 #include "tc/core/utils/memory.h"
 
-#include "tc/lang/parser.h"
+#include "tc/lang/contraction.h"
+#include "tc/lang/gradient.h"
+#include "tc/lang/parse_cache.h"
+#include "tc/lang/pipeline.h"
+#include "tc/lang/tc_format.h"
 
 namespace tc {
 
 namespace {
 const size_t InvalidHandle = std::numeric_limits<size_t>::max();
-
-std::vector<lang::TreeRef> parseDefs(const std::string& language) {
-  lang::Parser parser(language);
-  std::vector<lang::TreeRef> res;
-  while (parser.L.cur().kind != lang::TK_EOF) {
-    res.push_back(parser.parseFunction());
-  }
-  return res;
-}
 } // namespace
 
 // Under object lock, fill parse the language and fill the underlying map
 template <typename ExecutorType>
 void ExecutionEngine<ExecutorType>::define(const std::string& language) {
-  define(parseDefs(language));
+  define(lang::parseCached(language));
 }
 
 // support define if we pass the parsed TreeRefs.
@@ -55,6 +61,46 @@ void ExecutionEngine<ExecutorType>::define(
   }
 }
 
+// Under object lock, inline the TreeRefs of the pipeline into a new one
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::definePipeline(
+    const std::string& name,
+    const std::vector<std::string>& defNames) {
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  std::vector<lang::TreeRef> defs;
+  for (const auto& defName : defNames) {
+    CHECK_EQ(1, tcNameMap_.count(defName))
+        << "pipeline " << name << " uses undefined function " << defName;
+    defs.push_back(tcNameMap_.at(defName));
+  }
+  tcNameMap_.emplace(std::make_pair(name, lang::inlinePipeline(name, defs)));
+}
+
+// Under object lock, differentiate the TreeRef at name
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::defineGradient(
+    const std::string& name,
+    const std::string& gradName) {
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  CHECK_EQ(1, tcNameMap_.count(name))
+      << "attempting to differentiate undefined function " << name;
+  auto grad = lang::gradient(tcNameMap_.at(name), gradName);
+  tcNameMap_.emplace(std::make_pair(lang::Def(grad).name().name(), grad));
+}
+
+// Under object lock, factor the contractions of the TreeRef at name
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::defineFactoredContractions(
+    const std::string& name,
+    const std::string& newName,
+    const std::unordered_map<std::string, int64_t>& sizes) {
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  CHECK_EQ(1, tcNameMap_.count(name))
+      << "attempting to factor undefined function " << name;
+  tcNameMap_.emplace(std::make_pair(
+      newName, lang::factorContractions(tcNameMap_.at(name), newName, sizes)));
+}
+
 // Under object lock, retrieve the TreeRef at name and infer the output
 // tensors informations
 template <typename ExecutorType>
@@ -68,38 +114,73 @@ ExecutionEngine<ExecutorType>::inferOutputTensorInfo(
         << "attempting to access undefined function " << name;
     // If we have already compiled for the given inputs, regardless of
     // the options, we can get sizes from a corresponding ExecutorType.
-    auto e = std::find_if(
-        executors_.begin(),
-        executors_.end(),
-        [&](const std::unique_ptr<ExecutorType>& e) {
-          return e && name == e->identifier &&
-              compareDLTensorVectorMetadata(
-                     extractRawPtrs(e->inputsInfo), inputs);
-        });
-    if (e != executors_.end()) {
-      return (*e)->inferOutputTensorInfo();
+    auto range = shapeIndex_.equal_range(hashKey(name, inputs));
+    for (auto it = range.first; it != range.second; ++it) {
+      const auto& e = (*executors_)[slotOf(it->second)].executor;
+      // Executors of strided outputs do not infer the packed ones
+      if (e && name == e->identifier &&
+          compareDLTensorVectorMetadata(
+              extractRawPtrs(e->inputsInfo), inputs) &&
+          e->hasOutputStrides({})) {
+        return e->inferOutputTensorInfo();
+      }
+    }
+    auto inferred = inferredOutputs_.equal_range(hashKey(name, inputs));
+    for (auto it = inferred.first; it != inferred.second; ++it) {
+      if (name == it->second->name &&
+          compareDLTensorVectorMetadata(
+              extractRawPtrs(it->second->inputsInfo), inputs)) {
+        return extractRawPtrs(it->second->outputsInfo);
+      }
     }
   }
 
-  // Otherwise, create a new executor and add it to executor_ with
-  // null options. It will be used for further size queries but
-  // will fail if somebody attempts to run it.
-  auto executor =
-      tc::make_unique<ExecutorType>(name, inputs, "", tcNameMap_.at(name));
-  auto outputsInfo = executor->inferOutputTensorInfo();
-  emplaceExecutor(std::move(executor));
+  // Otherwise, evaluate the output sizes of the Halide translation of the
+  // TC, which is only built once per TC, for these inputs.  This neither
+  // creates an executor nor touches executors_.
+  auto halide = halideComponents(name);
+  tc::checkInputsCompliant(*halide, inputs);
+  auto entry = tc::make_unique<InferredOutputs>();
+  entry->name = name;
+  entry->inputsInfo = makeDLTensorVector(inputs);
+  entry->outputsInfo = tc::inferOutputTensorInfo(*halide, inputs);
+  auto outputsInfo = extractRawPtrs(entry->outputsInfo);
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  inferredOutputs_.emplace(hashKey(name, inputs), std::move(entry));
   return outputsInfo;
 }
 
+template <typename ExecutorType>
+std::shared_ptr<const tc2halide::HalideComponents>
+ExecutionEngine<ExecutorType>::halideComponents(const std::string& name) {
+  lang::TreeRef tree;
+  {
+    std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+    auto it = halideComponents_.find(name);
+    if (it != halideComponents_.end()) {
+      return it->second;
+    }
+    tree = tcNameMap_.at(name);
+  }
+  auto halide = tc2halide::translateCached(
+      isl::with_exceptions::globalIslCtx(), tree);
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  halideComponents_.emplace(name, halide);
+  return halide;
+}
+
 template <typename ExecutorType>
 size_t ExecutionEngine<ExecutorType>::compile(
     const std::string& name,
     const std::vector<const DLTensor*>& inputs,
     const std::string& options) {
+  auto start = std::chrono::high_resolution_clock::now();
   // Check if we already have a handle for this name+size+options combination.
   // If so, return it.
   size_t handle = getHandle(name, inputs, options);
   if (handle != InvalidHandle) {
+    detail::reportCompile(
+        name, handle, KernelSource::EngineHandle, start, CompilationTimings());
     return handle;
   }
 
@@ -110,128 +191,587 @@ size_t ExecutionEngine<ExecutorType>::compile(
   executorUPtr->compile(options);
   CHECK(executorUPtr->hasRuntimeCompiledFunction());
 
+  auto source = executorUPtr->kernelSource;
+  auto timings = executorUPtr->timings;
+  handle = emplaceExecutor(std::move(executorUPtr));
+  detail::reportCompile(name, handle, source, start, timings);
+  return handle;
+}
+
+template <typename ExecutorType>
+size_t ExecutionEngine<ExecutorType>::compile(
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<const DLTensor*>& outputs,
+    const std::string& options) {
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t handle = getHandle(name, inputs, options, outputs);
+  if (handle != InvalidHandle) {
+    detail::reportCompile(
+        name, handle, KernelSource::EngineHandle, start, CompilationTimings());
+    return handle;
+  }
+
+  std::unique_ptr<ExecutorType> executorUPtr(
+      new ExecutorType(name, inputs, options, tcNameMap_.at(name)));
+  CHECK(executorUPtr);
+  executorUPtr->specializeOutputStrides(outputs);
+  executorUPtr->compile(options);
+  CHECK(executorUPtr->hasRuntimeCompiledFunction());
+
+  auto source = executorUPtr->kernelSource;
+  auto timings = executorUPtr->timings;
   handle = emplaceExecutor(std::move(executorUPtr));
+  detail::reportCompile(name, handle, source, start, timings);
   return handle;
 }
 
-// Steal the executor instance and give it back under lock.
-// Run outside of lock on owning ExecutorType.
+template <typename ExecutorType>
+size_t ExecutionEngine<ExecutorType>::compile(
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const std::string& options,
+    std::function<bool(const ExecutorType*)> pruningFunction) {
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t handle = getHandle(name, inputs, options);
+  if (handle != InvalidHandle) {
+    detail::reportCompile(
+        name, handle, KernelSource::EngineHandle, start, CompilationTimings());
+    return handle;
+  }
+
+  std::unique_ptr<ExecutorType> executorUPtr(
+      new ExecutorType(name, inputs, options, tcNameMap_.at(name)));
+  CHECK(executorUPtr);
+  // Pruned kernels are not reported, they are not compiled to binary.
+  if (!executorUPtr->compile(options, pruningFunction)) {
+    return InvalidHandle;
+  }
+  CHECK(executorUPtr->hasRuntimeCompiledFunction());
+  auto source = executorUPtr->kernelSource;
+  auto timings = executorUPtr->timings;
+  handle = emplaceExecutor(std::move(executorUPtr));
+  detail::reportCompile(name, handle, source, start, timings);
+  return handle;
+}
+
+template <typename ExecutorType>
+std::future<size_t> ExecutionEngine<ExecutorType>::compileAsync(
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const std::string& options) {
+  // Deep copy, the job may start after the caller's tensors are gone.
+  std::shared_ptr<std::vector<dlutils::DLTensorUPtr>> inputsCopy(
+      new std::vector<dlutils::DLTensorUPtr>(
+          dlutils::makeDLTensorVector(inputs)));
+  return compilationPool().submit([this, name, inputsCopy, options]() {
+    return this->compile(name, dlutils::extractRawPtrs(*inputsCopy), options);
+  });
+}
+
+template <typename ExecutorType>
+ThreadPool& ExecutionEngine<ExecutorType>::compilationPool() {
+  std::lock_guard<std::mutex> lg(compilationPoolMutex_);
+  if (!compilationPool_) {
+    size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    compilationPool_ = tc::make_unique<ThreadPool>(numThreads);
+  }
+  return *compilationPool_;
+}
+
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::setCompilationThreads(size_t numThreads) {
+  std::unique_ptr<ThreadPool> previous(tc::make_unique<ThreadPool>(numThreads));
+  {
+    std::lock_guard<std::mutex> lg(compilationPoolMutex_);
+    std::swap(previous, compilationPool_);
+  }
+  // Drain and join outside of the lock, pending jobs may call
+  // compilationPool().
+  previous.reset();
+}
+
+// Runs share ownership of the executor, the table snapshot is loaded without
+// taking tcExecutorMutex_.
 template <typename ExecutorType>
 Duration ExecutionEngine<ExecutorType>::run(
     size_t handle,
     const std::vector<const DLTensor*>& inputs,
     const std::vector<DLTensor*>& outputs,
     bool profile,
-    std::function<bool(const ExecutorType*)> pruningFunction) {
-  std::unique_ptr<ExecutorType> executorUPtr(nullptr);
-  {
-    std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-    std::swap(executorUPtr, executors_[handle]);
+    std::function<bool(const ExecutorType*)> pruningFunction,
+    const typename ExecutorType::RuntimeInformation& info) {
+  auto executor = getExecutor(handle);
+  // The handle may have been cleared concurrently, nothing to run then.
+  if (!executor) {
+    return Duration::max();
+  }
+  if (pruningFunction(executor.get())) {
+    return Duration::max();
   }
+  CHECK(executor->hasRuntimeCompiledFunction());
+  if (memoryLimit_.load(std::memory_order_relaxed) > 0) {
+    executor->lastRun.store(
+        runClock_.fetch_add(1, std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+  if (executor->manifestRuns) {
+    executor->manifestRuns->fetch_add(1, std::memory_order_relaxed);
+  }
+  auto sink = telemetrySink();
+  if (!sink) {
+    return executor->run(inputs, outputs, profile, info);
+  }
+  // Sampled runs are profiled, i.e., synchronize with the kernels.
+  bool sampled = sampleRun();
+  auto time = executor->run(inputs, outputs, profile || sampled, info);
+  sink->onRun(RunEvent{executor->identifier,
+                       handle,
+                       executor->launchGrid(),
+                       executor->launchBlock(),
+                       profile || sampled ? time : Duration::max()});
+  return profile ? time : Duration::max();
+}
 
-  // It turns out someone else may already be running this configuration in
-  // some unexpected cases: there is no guarantee of no-redundancy in
-  // compilation options. In that case, we swapped 2 nullptrs and we just
-  // exit.
-  Duration res(Duration::max());
-  if (executorUPtr) {
-    if (pruningFunction(static_cast<ExecutorType*>(executorUPtr.get()))) {
-      return Duration::max();
-    }
-    CHECK(executorUPtr->hasRuntimeCompiledFunction());
-    try {
-      // Must catch and swap to avoid exception in destructor!
-      res = executorUPtr->run(inputs, outputs, profile);
-    } catch (std::exception& e) {
-      std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-      std::swap(executorUPtr, executors_[handle]);
-      throw;
-    }
-    {
-      std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-      std::swap(executorUPtr, executors_[handle]);
-    }
+template <typename ExecutorType>
+Duration ExecutionEngine<ExecutorType>::run(
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputs,
+    const std::vector<DLTensor*>& outputs,
+    const std::string& options,
+    bool profile) {
+  // Known shapes only cost the handle lookup, new shapes in a bucket reuse its
+  // kernel.  Handle hits are not reported to the telemetry sink as
+  // compilations, only new shapes are.
+  size_t handle = getHandle(name, inputs, options);
+  if (handle == InvalidHandle) {
+    handle = compile(name, inputs, options);
   }
-  return res;
+  return run(handle, inputs, outputs, profile);
 }
 
-// Steal ExecutorType and give it back under lock
-// Run outside of lock on owning ExecutorType.
 template <typename ExecutorType>
 void ExecutionEngine<ExecutorType>::uncheckedRun(
     size_t handle,
     const std::vector<const void*>& inputs,
-    const std::vector<void*>& outputs) {
-  std::unique_ptr<ExecutorType> executorUPtr(nullptr);
-  {
-    std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-    std::swap(executorUPtr, executors_[handle]);
+    const std::vector<void*>& outputs,
+    const typename ExecutorType::RuntimeInformation& info) {
+  auto executor = getExecutor(handle);
+  if (!executor) {
+    return;
+  }
+  CHECK(executor->hasRuntimeCompiledFunction());
+  if (memoryLimit_.load(std::memory_order_relaxed) > 0) {
+    executor->lastRun.store(
+        runClock_.fetch_add(1, std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+  if (executor->manifestRuns) {
+    executor->manifestRuns->fetch_add(1, std::memory_order_relaxed);
   }
+  executor->uncheckedRun(inputs, outputs, info);
+  // Not timed, the low-latency path does not synchronize.
+  if (auto sink = telemetrySink()) {
+    sink->onRun(RunEvent{executor->identifier,
+                         handle,
+                         executor->launchGrid(),
+                         executor->launchBlock(),
+                         Duration::max()});
+  }
+}
 
-  // It turns out someone else may already be running this configuration in
-  // some unexpected cases: there is no guarantee of no-redundancy in
-  // compilation options. In that case, we swapped 2 nullptrs and we just
-  // exit.
-  if (executorUPtr) {
-    CHECK(executorUPtr->hasRuntimeCompiledFunction());
-    try {
-      // Must catch and swap to avoid exception in destructor!
-      executorUPtr->uncheckedRun(inputs, outputs);
-    } catch (std::exception& e) {
-      std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-      std::swap(executorUPtr, executors_[handle]);
-      throw;
+template <typename ExecutorType>
+template <typename E>
+std::unique_ptr<typename E::PreparedLaunch>
+ExecutionEngine<ExecutorType>::prepareLaunch(size_t handle) {
+  auto executor = getExecutor(handle);
+  CHECK(executor) << "handle " << handle << " was cleared";
+  CHECK(executor->hasRuntimeCompiledFunction());
+  return executor->prepareLaunch();
+}
+
+template <typename ExecutorType>
+template <typename E>
+void ExecutionEngine<ExecutorType>::warmup(
+    size_t handle,
+    const std::vector<int>& devices) {
+  auto executor = getExecutor(handle);
+  CHECK(executor) << "handle " << handle << " was cleared";
+  CHECK(executor->hasRuntimeCompiledFunction());
+  executor->warmup(devices);
+}
+
+template <typename ExecutorType>
+CompilationTimings ExecutionEngine<ExecutorType>::timings(size_t handle) const {
+  auto executor = getExecutor(handle);
+  CHECK(executor) << "handle " << handle << " was cleared";
+  return executor->timings;
+}
+
+// Clear the underlying RTC object and executor under lock, concurrent runs
+// keep the executor alive.
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::clear(size_t handle) {
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  clearLocked(handle);
+}
+
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::clearLocked(size_t handle) {
+  auto eraseHandle = [handle](
+                         std::unordered_multimap<size_t, size_t>& index,
+                         size_t hash) {
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == handle) {
+        index.erase(it);
+        return;
+      }
     }
-    {
-      std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-      std::swap(executorUPtr, executors_[handle]);
+  };
+  auto slot = slotOf(handle);
+  const auto& entry = executors_->at(slot);
+  // Cleared already, possibly reused since
+  if (!entry.executor || entry.handle != handle) {
+    return;
+  }
+  auto e = entry.executor;
+  auto inputs = extractRawPtrs(e->inputsInfo);
+  eraseHandle(shapeIndex_, hashKey(e->identifier, inputs));
+  eraseHandle(handleIndex_, hashKey(e->identifier, inputs, e->options));
+  executorBytes_ -= entry.bytes;
+  auto held = heldHalideComponents_.find(e->halideComponents().get());
+  if (held != heldHalideComponents_.end() && --held->second.executors == 0) {
+    halideBytes_ -= held->second.bytes;
+    heldHalideComponents_.erase(held);
+  }
+  std::shared_ptr<ExecutorTable> table(new ExecutorTable(*executors_));
+  (*table)[slot].executor = nullptr;
+  (*table)[slot].bytes = 0;
+  std::atomic_store(
+      &executors_, std::shared_ptr<const ExecutorTable>(std::move(table)));
+  freeSlots_.push_back(slot);
+  // No snapshot refers to the executor anymore.  If nobody else is running
+  // it, clear it here, otherwise the last run releases it on destruction.
+  if (e.use_count() == 1) {
+    e->clearRuntimeCompiledFunction();
+  }
+}
+
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::evictLocked(size_t keep) {
+  auto limit = memoryLimit_.load();
+  while (limit > 0 && executorBytes_ > limit) {
+    // The table is small after reuse, evictions follow compilations.
+    size_t victim = InvalidHandle;
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto& entry : *executors_) {
+      if (entry.executor && entry.handle != keep &&
+          entry.executor->lastRun.load(std::memory_order_relaxed) < oldest) {
+        victim = entry.handle;
+        oldest = entry.executor->lastRun.load(std::memory_order_relaxed);
+      }
     }
+    if (victim == InvalidHandle) {
+      return;
+    }
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "evicting handle " << victim << ", executors use "
+        << executorBytes_ << " bytes for a limit of " << limit;
+    clearLocked(victim);
   }
 }
 
-// Clear the underlying RTC object and executor under lock.
 template <typename ExecutorType>
-void ExecutionEngine<ExecutorType>::clear(size_t handle) {
+typename ExecutionEngine<ExecutorType>::MemoryUsage
+ExecutionEngine<ExecutorType>::memoryUsage() const {
   std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-  executors_[handle]->clearRuntimeCompiledFunction();
-  executors_[handle] = std::unique_ptr<ExecutorType>(nullptr);
+  MemoryUsage res;
+  res.executors = executors_->size() - freeSlots_.size();
+  res.freeSlots = freeSlots_.size();
+  res.executorBytes = executorBytes_;
+  res.halideComponents = heldHalideComponents_.size();
+  res.halideBytes = halideBytes_;
+  return res;
+}
+
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::setMemoryLimit(size_t bytes) {
+  std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+  memoryLimit_ = bytes;
+  evictLocked(InvalidHandle);
+}
+
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::recordShapeManifest(bool record) {
+  recordShapeManifest_ = record;
+}
+
+template <typename ExecutorType>
+ShapeManifestProto ExecutionEngine<ExecutorType>::shapeManifest() const {
+  std::vector<ShapeManifestEntryProto> entries;
+  std::map<std::string, lang::TreeRef> trees;
+  {
+    std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+    for (const auto& kvp : shapeManifest_) {
+      const auto& entry = kvp.second;
+      ShapeManifestEntryProto buf;
+      buf.set_name(entry.name);
+      for (const auto& t : entry.inputsInfo) {
+        *buf.add_inputs() = detail::TensorInfo(t.get()).toProtobuf();
+      }
+      buf.set_device_type(
+          entry.inputsInfo.empty() ? kDLCPU
+                                   : entry.inputsInfo[0]->ctx.device_type);
+      buf.set_options(entry.options);
+      buf.set_runs(entry.runs->load(std::memory_order_relaxed));
+      entries.push_back(buf);
+      trees.emplace(entry.name, tcNameMap_.at(entry.name));
+    }
+  }
+  // Printed outside of the lock, canonicalTc runs Sema.
+  std::map<std::string, std::pair<std::string, std::string>> sources;
+  for (const auto& kvp : trees) {
+    std::stringstream ss;
+    lang::tcFormat(ss, kvp.second);
+    sources.emplace(
+        kvp.first, std::make_pair(ss.str(), lang::canonicalTc(kvp.second)));
+  }
+  std::stable_sort(
+      entries.begin(),
+      entries.end(),
+      [](const ShapeManifestEntryProto& a, const ShapeManifestEntryProto& b) {
+        return a.runs() > b.runs();
+      });
+  ShapeManifestProto res;
+  for (auto& buf : entries) {
+    const auto& source = sources.at(buf.name());
+    buf.set_tc(source.first);
+    buf.set_canonical_tc(source.second);
+    *res.add_entries() = buf;
+  }
+  return res;
+}
+
+template <typename ExecutorType>
+void ExecutionEngine<ExecutorType>::writeShapeManifest(
+    const std::string& filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  CHECK(file) << "could not open " << filename;
+  CHECK(shapeManifest().SerializeToOstream(&file))
+      << "could not write " << filename;
+}
+
+template <typename ExecutorType>
+ShapeManifestProto ExecutionEngine<ExecutorType>::readShapeManifest(
+    const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  CHECK(file) << "could not open " << filename;
+  ShapeManifestProto res;
+  CHECK(res.ParseFromIstream(&file)) << "could not parse " << filename;
+  return res;
+}
+
+template <typename ExecutorType>
+std::vector<size_t> ExecutionEngine<ExecutorType>::replayShapeManifest(
+    const ShapeManifestProto& manifest,
+    uint64_t minRuns) {
+  std::vector<const ShapeManifestEntryProto*> entries;
+  for (const auto& entry : manifest.entries()) {
+    if (entry.runs() >= minRuns) {
+      entries.push_back(&entry);
+    }
+  }
+  std::stable_sort(
+      entries.begin(),
+      entries.end(),
+      [](const ShapeManifestEntryProto* a, const ShapeManifestEntryProto* b) {
+        return a->runs() > b->runs();
+      });
+
+  // Whether the TC defined under each name is the one of the manifest.
+  std::map<std::string, bool> sameTc;
+  std::vector<std::pair<std::string, std::future<size_t>>> compilations;
+  for (auto entry : entries) {
+    const auto& name = entry->name();
+    if (sameTc.count(name) == 0) {
+      lang::TreeRef tree;
+      {
+        std::lock_guard<std::mutex> lg(tcExecutorMutex_);
+        auto it = tcNameMap_.find(name);
+        if (it != tcNameMap_.end()) {
+          tree = it->second;
+        }
+      }
+      if (!tree) {
+        for (const auto& ref : lang::parseCached(entry->tc())) {
+          if (lang::Def(ref).name().name() == name) {
+            define(std::vector<lang::TreeRef>{ref});
+            tree = treeForFunction(name);
+          }
+        }
+      }
+      sameTc[name] =
+          tree && lang::canonicalTc(tree) == entry->canonical_tc();
+      LOG_IF(WARNING, !sameTc.at(name))
+          << "skipping the shape manifest entries of " << name
+          << ", which is defined as another TC";
+    }
+    if (!sameTc.at(name)) {
+      continue;
+    }
+    // Metadata without data, with strides if the recorded inputs had some.
+    std::vector<dlutils::DLTensorUPtr> inputs;
+    DLContext ctx{static_cast<DLDeviceType>(entry->device_type()), 0};
+    for (const auto& buf : entry->inputs()) {
+      detail::TensorInfo info(buf);
+      DLTensor t{nullptr,
+                 ctx,
+                 static_cast<int>(info.shape.size()),
+                 info.dType,
+                 info.shape.data(),
+                 info.strides.empty() ? nullptr : info.strides.data(),
+                 0};
+      inputs.push_back(dlutils::makeDLTensor(&t));
+    }
+    compilations.emplace_back(
+        name,
+        compileAsync(name, dlutils::extractRawPtrs(inputs), entry->options()));
+  }
+
+  std::vector<size_t> handles;
+  for (auto& compilation : compilations) {
+    try {
+      handles.push_back(compilation.second.get());
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "could not compile " << compilation.first
+                   << " from the shape manifest: " << e.what();
+    }
+  }
+  return handles;
 }
 
 template <typename ExecutorType>
 size_t ExecutionEngine<ExecutorType>::emplaceExecutor(
     std::unique_ptr<ExecutorType> executorUPtr) {
+  // Estimated outside of the lock, the Halide IR is walked on first use.
+  auto bytes = executorUPtr->memoryFootprint();
+  auto halide = executorUPtr->halideComponents();
+  auto halideBytes = halide ? tc2halide::memoryFootprint(*halide) : 0;
+  executorUPtr->lastRun = runClock_.fetch_add(1) + 1;
+
   // Insert in vector under lock
   std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-  size_t handle = uidCounter++;
-  // This may trigger reallocs and moves of the underlying vector, fun!
-  executors_.emplace_back(std::move(executorUPtr));
-  // This is really the invariant we enforce
-  CHECK_EQ(executors_.size(), uidCounter);
+  // Copy on write, readers may still be using the current snapshot.
+  std::shared_ptr<ExecutorTable> table(new ExecutorTable(*executors_));
+  size_t handle;
+  if (freeSlots_.empty()) {
+    handle = table->size();
+    CHECK_LT(handle, size_t(1) << kSlotBits) << "too many executors";
+    table->push_back(ExecutorSlot{nullptr, handle, 0});
+  } else {
+    auto slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    // The generation wraps before a handle can be InvalidHandle.
+    auto generation = (((*table)[slot].handle >> kSlotBits) + 1) &
+        ((size_t(1) << (kSlotBits - 1)) - 1);
+    handle = (generation << kSlotBits) | slot;
+  }
+  auto inputs = extractRawPtrs(executorUPtr->inputsInfo);
+  shapeIndex_.emplace(hashKey(executorUPtr->identifier, inputs), handle);
+  // Executors with empty options are only used for size queries, they
+  // cannot be returned by getHandle.
+  if (executorUPtr->options != "") {
+    handleIndex_.emplace(
+        hashKey(executorUPtr->identifier, inputs, executorUPtr->options),
+        handle);
+  }
+  if (recordShapeManifest_ && executorUPtr->options != "" &&
+      executorUPtr->hasOutputStrides({})) {
+    const auto& name = executorUPtr->identifier;
+    const auto& options = executorUPtr->options;
+    auto hash = hashKey(name, inputs, options);
+    auto range = shapeManifest_.equal_range(hash);
+    auto it = std::find_if(
+        range.first,
+        range.second,
+        [&](const std::pair<const size_t, ManifestEntry>& kvp) {
+          return kvp.second.name == name && kvp.second.options == options &&
+              compareDLTensorVectorMetadata(
+                     extractRawPtrs(kvp.second.inputsInfo), inputs);
+        });
+    if (it == range.second) {
+      it = shapeManifest_.emplace(
+          hash,
+          ManifestEntry{name,
+                        makeDLTensorVector(inputs),
+                        options,
+                        std::make_shared<std::atomic<uint64_t>>(0)});
+    }
+    executorUPtr->manifestRuns = it->second.runs;
+  }
+  auto& entry = (*table)[slotOf(handle)];
+  CHECK(!entry.executor) << "slot of handle " << handle << " is in use";
+  entry.executor = std::move(executorUPtr);
+  entry.handle = handle;
+  entry.bytes = bytes;
+  executorBytes_ += bytes;
+  if (halide) {
+    auto& held = heldHalideComponents_[halide.get()];
+    if (held.executors++ == 0) {
+      held.bytes = halideBytes;
+      halideBytes_ += halideBytes;
+    }
+  }
+  std::atomic_store(
+      &executors_, std::shared_ptr<const ExecutorTable>(std::move(table)));
+  evictLocked(handle);
   return handle;
 }
 
+template <typename ExecutorType>
+std::shared_ptr<ExecutorType> ExecutionEngine<ExecutorType>::getExecutor(
+    size_t handle) const {
+  auto table = std::atomic_load(&executors_);
+  const auto& entry = table->at(slotOf(handle));
+  return entry.handle == handle ? entry.executor : nullptr;
+}
+
 template <typename ExecutorType>
 size_t ExecutionEngine<ExecutorType>::getHandle(
     const std::string& name,
     const std::vector<const DLTensor*>& inputsInfo,
-    const std::string& optionsStr) {
+    const std::string& optionsStr,
+    const std::vector<const DLTensor*>& outputsInfo) {
   std::lock_guard<std::mutex> lg(tcExecutorMutex_);
-  typename ExecutorType::MappingOptionsType options(optionsStr);
-  auto it = std::find_if(
-      executors_.begin(),
-      executors_.end(),
-      [&](const std::unique_ptr<ExecutorType>& e) {
-        return e && // UPtrs get stolen by run to avoid underlying vector
-                    // realloc issues, guard against that
-            name == e->identifier &&
-            compareDLTensorVectorMetadata(
-                   extractRawPtrs(e->inputsInfo), inputsInfo) &&
-            e->options != "" &&
-            typename ExecutorType::MappingOptionsType(e->options) == options;
-      });
-  if (it != executors_.end()) {
-    return it - executors_.begin();
+  // Options are compared in their serialized form, which is what the
+  // MappingOptionsType comparison operators do after parsing.
+  auto range = handleIndex_.equal_range(hashKey(name, inputsInfo, optionsStr));
+  for (auto it = range.first; it != range.second; ++it) {
+    const auto& e = (*executors_)[slotOf(it->second)].executor;
+    if (e && name == e->identifier && e->options == optionsStr &&
+        compareDLTensorVectorMetadata(
+            extractRawPtrs(e->inputsInfo), inputsInfo) &&
+        e->hasOutputStrides(outputsInfo)) {
+      return it->second;
+    }
   }
   return InvalidHandle;
 }
+
+template <typename ExecutorType>
+size_t ExecutionEngine<ExecutorType>::hashKey(
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputsInfo) {
+  return hashCombine(
+      std::hash<std::string>()(name), hashDLTensorVectorMetadata(inputsInfo));
+}
+
+template <typename ExecutorType>
+size_t ExecutionEngine<ExecutorType>::hashKey(
+    const std::string& name,
+    const std::vector<const DLTensor*>& inputsInfo,
+    const std::string& optionsStr) {
+  return hashCombineValue(hashKey(name, inputsInfo), optionsStr);
+}
 } // namespace tc
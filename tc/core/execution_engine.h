@@ -15,14 +15,24 @@
  */
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <dlpack/dlpack.h>
 
+#include <compcache.pb.h>
+
 #include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/tc2halide.h"
 #include "tc/core/tc_executor.h"
 #include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/thread_pool.h"
 #include "tc/core/utils/time.h"
 #include "tc/lang/tree.h"
 
@@ -42,10 +52,37 @@ class ExecutionEngine {
   /// Store the provided parsed trees internally.
   void define(const std::vector<lang::TreeRef>& treeRefs);
 
+  /// Define name as the pipeline of the TC definitions defNames, which must
+  /// have been defined previously.  The definitions are inlined into a
+  /// single definition (see lang::inlinePipeline) so that the pipeline is
+  /// compiled to a single kernel, in which the outputs of a definition that
+  /// feed the next ones are temporaries the mapper may fuse away.  The
+  /// pipeline is then compiled and run like any other TC.
+  void definePipeline(
+      const std::string& name,
+      const std::vector<std::string>& defNames);
+
+  /// Define gradName as the backward TC of the previously defined TC name,
+  /// derived by lang::gradient, name + "_grad" if gradName is empty.  The
+  /// backward TC takes the inputs of name followed by the gradients of its
+  /// outputs and returns the gradients of its floating-point inputs.
+  void defineGradient(const std::string& name, const std::string& gradName);
+
+  /// Define newName as the previously defined TC name with its contractions
+  /// of three or more tensors factored into pairwise contractions (see
+  /// lang::factorContractions).  sizes, the values of the size parameters
+  /// of name if known, guide the order of the pairs.
+  void defineFactoredContractions(
+      const std::string& name,
+      const std::string& newName,
+      const std::unordered_map<std::string, int64_t>& sizes = {});
+
   /// For a given TC kernel name, compute the shapes of the output tensors
   /// provided the shapes of the input TC tensors.  The caller can use the
   /// computed shapes to allocate memory for outputs.  Values inside tensors
-  /// are left unmodified.
+  /// are left unmodified.  No executor is created: the shapes are evaluated
+  /// from the Halide translation of the TC and kept by the engine, which
+  /// owns the returned tensors.
   std::vector<const DLTensor*> inferOutputTensorInfo(
       const std::string& name,
       const std::vector<const DLTensor*>& inTensorPtrs);
@@ -59,10 +96,55 @@ class ExecutionEngine {
       const std::vector<const DLTensor*>& inputs,
       const std::string& options);
 
+  /// Same as compile but the kernel writes outputs of the sizes inferred
+  /// and the strides of outputs instead of packed ones, e.g. views of the
+  /// slices of a concatenation that several TCs write in place instead of
+  /// copying their results (see TcExecutor::specializeOutputStrides).  The
+  /// runs of the handle take outputs of these strides.
+  /// \returns opaque handle of a compiled kernel.
+  size_t compile(
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<const DLTensor*>& outputs,
+      const std::string& options);
+
+  /// Same as compile but the executor calls pruningFunction once the kernel
+  /// is mapped and before it is compiled to binary, which saves the backend
+  /// compilation of kernels known to perform poorly (see
+  /// CudaTcExecutor::compile).
+  /// \returns opaque handle of a compiled kernel, InvalidHandle if it was
+  /// pruned.
+  size_t compile(
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const std::string& options,
+      std::function<bool(const ExecutorType*)> pruningFunction);
+
+  /// Same as compile but performed on the compilation pool, the caller is not
+  /// blocked.  The tensor metadata is copied so inputs need not outlive the
+  /// call.  Exceptions thrown by the compilation are rethrown by
+  /// std::future::get.
+  /// \returns future of the opaque handle of a compiled kernel.
+  std::future<size_t> compileAsync(
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const std::string& options);
+
+  /// Pool running compileAsync jobs, created on first use with one thread
+  /// per hardware thread.  Callers may also submit their own compilation
+  /// work to it.
+  ThreadPool& compilationPool();
+
+  /// Replace the compilation pool with one of numThreads threads.  Jobs
+  /// already submitted to the previous pool are completed first.
+  void setCompilationThreads(size_t numThreads);
+
   /// Run a compiled TC kernel given its handle, on the given input tensors and
   /// fill in the outputs.  All tensors must be allocated and have appropriate
   /// shapes (inputs same as for copmilation, outputs same as returned by
   /// inferOutputTensorInfo).
+  /// The runtime information (e.g. the CUDA stream) is forwarded to the
+  /// executor.
   /// \returns The kernel runtime if profile is set, Duration::max() otherwise.
   Duration run(
       size_t handle,
@@ -70,7 +152,21 @@ class ExecutionEngine {
       const std::vector<DLTensor*>& outputs,
       bool profile = false,
       std::function<bool(const ExecutorType*)> pruningFunction =
-          [](const ExecutorType*) { return false; });
+          [](const ExecutorType*) { return false; },
+      const typename ExecutorType::RuntimeInformation& info =
+          typename ExecutorType::RuntimeInformation());
+
+  /// Run the TC kernel name compiled with options for the shapes of inputs,
+  /// compiling it on first use of these shapes.  With size buckets (see
+  /// CudaMappingOptions::sizeBuckets) this dispatches each run to the kernel
+  /// of the buckets of its shapes, which is only compiled once.
+  /// \returns The kernel runtime if profile is set, Duration::max() otherwise.
+  Duration run(
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputs,
+      const std::vector<DLTensor*>& outputs,
+      const std::string& options,
+      bool profile = false);
 
   /// "Low-latency" execution mode in which we just propagate raw pointers to
   /// data in GPU address space.
@@ -79,30 +175,214 @@ class ExecutionEngine {
   void uncheckedRun(
       size_t handle,
       const std::vector<const void*>& inputs,
-      const std::vector<void*>& outputs);
+      const std::vector<void*>& outputs,
+      const typename ExecutorType::RuntimeInformation& info =
+          typename ExecutorType::RuntimeInformation());
+
+  /// Prepare a descriptor for the allocation-free and lock-free launch path
+  /// of executors providing one (e.g. CudaTcExecutor::prepareLaunch).
+  /// Launching it bypasses the engine, the handle must not be cleared while
+  /// the descriptor is in use.
+  template <typename E = ExecutorType>
+  std::unique_ptr<typename E::PreparedLaunch> prepareLaunch(size_t handle);
 
-  /// Clear the compilation result for the given handle.
+  /// Load the kernels of handle on devices ahead of their first launch there,
+  /// for executors providing it (e.g. CudaTcExecutor::warmup).
+  template <typename E = ExecutorType>
+  void warmup(size_t handle, const std::vector<int>& devices);
+
+  /// Compilations and launches are reported to the telemetry sink, if one is
+  /// installed (see setTelemetrySink), with the source of the kernel for the
+  /// former and the launch bounds and sampled kernel time for the latter.
+  /// Launches of prepareLaunch descriptors bypass the engine and are not
+  /// reported.
+
+  /// Time spent in each phase of the compilation for the given handle.
+  CompilationTimings timings(size_t handle) const;
+
+  /// Clear the compilation result for the given handle.  The slot of the
+  /// executor is reused by a later compilation under a new handle: handles
+  /// carry the generation of their slot, so that a cleared handle never
+  /// refers to another executor and runs nothing, as if cleared
+  /// concurrently.
   void clear(size_t handle);
 
+  /// Memory held by the executors of the engine, as estimated by
+  /// TcExecutor::memoryFootprint and tc2halide::memoryFootprint.
+  struct MemoryUsage {
+    size_t executors;
+    /// Slots of cleared executors, reused by the next compilations.
+    size_t freeSlots;
+    size_t executorBytes;
+    /// Of the distinct HalideComponents held by the executors.  They are
+    /// shared with tc2halide::translateCached, which keeps them after the
+    /// last executor of their TC is cleared.
+    size_t halideComponents;
+    size_t halideBytes;
+  };
+  MemoryUsage memoryUsage() const;
+
+  /// Bound the executorBytes of memoryUsage, 0 for no bound.  Exceeding
+  /// it, each compilation clears the executors run the longest ago, other
+  /// than its own, until the bound is met again.  The HalideComponents are
+  /// not counted, clearing executors does not release them.  With a bound
+  /// set, a handle may be cleared unless refreshed by runs.
+  void setMemoryLimit(size_t bytes);
+
+  /// Record the kernels compiled from now on in the shape manifest of the
+  /// engine, with their number of runs (see shapeManifest), or stop if
+  /// record is false.  Runs then count an atomic of their executor.
+  void recordShapeManifest(bool record);
+
+  /// The TCs, input shapes and options of the kernels compiled while
+  /// recording, the most run first, with their runs.  The runs of
+  /// recompilations of a kernel, e.g. after it was cleared, add up.  The
+  /// kernels of other output strides than packed ones (see compile) and the
+  /// launches of prepareLaunch descriptors are left out.
+  ShapeManifestProto shapeManifest() const;
+
+  /// Write shapeManifest to filename, as a serialized ShapeManifestProto.
+  void writeShapeManifest(const std::string& filename) const;
+  static ShapeManifestProto readShapeManifest(const std::string& filename);
+
+  /// Compile the kernels of manifest run at least minRuns times, the most
+  /// run first, as compileAsync jobs, and wait for them, e.g. at the start
+  /// of a service so that the shapes it served before are compiled before
+  /// requests arrive.  The TCs the engine does not define are defined from
+  /// the manifest; the entries of a name defined as another TC, and those
+  /// whose compilation throws, are skipped with a warning.  The
+  /// compilations go through the caches of the executors, e.g. the CUDA
+  /// cache, whose PTX saves NVRTC, and load the kernels on the devices
+  /// executors warm up on (e.g. --cuda_warmup_devices).
+  /// \returns the handles of the compiled kernels.
+  std::vector<size_t> replayShapeManifest(
+      const ShapeManifestProto& manifest,
+      uint64_t minRuns = 1);
+
  protected:
   size_t emplaceExecutor(std::unique_ptr<ExecutorType> p);
 
+  /// clear and evict under tcExecutorMutex_.
+  ///@{
+  void clearLocked(size_t handle);
+  void evictLocked(size_t keep);
+  ///@}
+
+  /// A handle is the index of its slot in executors_ in the low kSlotBits,
+  /// the generation of the slot above.
+  static constexpr size_t kSlotBits = 32;
+  static size_t slotOf(size_t handle) {
+    return handle & ((size_t(1) << kSlotBits) - 1);
+  }
+
+  /// Lock-free lookup in the current snapshot of executors_.
+  std::shared_ptr<ExecutorType> getExecutor(size_t handle) const;
+
+  /// The Halide translation of the TC name, built on first use.
+  std::shared_ptr<const tc2halide::HalideComponents> halideComponents(
+      const std::string& name);
+
+  /// The handle of the executor of outputs of the strides of outputsInfo,
+  /// packed ones if it is empty.
   size_t getHandle(
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputsInfo,
+      const std::string& optionsStr,
+      const std::vector<const DLTensor*>& outputsInfo = {});
+
+  /// Hashes used to index executors_.  Equal hashes do not imply equal keys,
+  /// the executor itself must still be compared.
+  ///@{
+  static size_t hashKey(
+      const std::string& name,
+      const std::vector<const DLTensor*>& inputsInfo);
+  static size_t hashKey(
       const std::string& name,
       const std::vector<const DLTensor*>& inputsInfo,
       const std::string& optionsStr);
+  ///@}
 
   /// For thread-safety perform all cheap operations under lock.
-  std::mutex tcExecutorMutex_;
+  mutable std::mutex tcExecutorMutex_;
 
   /// Parsed TC trees.
   std::map<std::string, lang::TreeRef> tcNameMap_;
 
-  /// List of executors, indexed by handle.  Derived ExecutionEngines can also
-  /// derive TcExecutor.
-  std::vector<std::unique_ptr<ExecutorType>> executors_;
+  /// The executor of a slot, nullptr once cleared, and the handle it was
+  /// last emplaced under.
+  struct ExecutorSlot {
+    std::shared_ptr<ExecutorType> executor;
+    size_t handle;
+    size_t bytes;
+  };
+
+  /// Executors indexed by slot.  The table is copied on write under
+  /// tcExecutorMutex_ and published atomically: runs only load the current
+  /// snapshot and share ownership of the executor, so concurrent runs (of
+  /// the same handle or not) do not take tcExecutorMutex_.  Writes are
+  /// O(#slots) but follow a compilation, which dominates, and cleared slots
+  /// are reused so the table does not grow beyond the live executors.
+  /// Derived ExecutionEngines can also derive TcExecutor.
+  using ExecutorTable = std::vector<ExecutorSlot>;
+  std::shared_ptr<const ExecutorTable> executors_{
+      std::make_shared<ExecutorTable>()};
+
+  /// Cleared slots, the last cleared is reused first.
+  std::vector<size_t> freeSlots_;
+
+  /// Handles of compiled executors indexed by hashKey(name, inputs, options).
+  std::unordered_multimap<size_t, size_t> handleIndex_;
+
+  /// Handles of all executors indexed by hashKey(name, inputs).
+  std::unordered_multimap<size_t, size_t> shapeIndex_;
+
+  /// Output shapes computed by inferOutputTensorInfo for inputs no executor
+  /// was created for, indexed by hashKey(name, inputs).
+  struct InferredOutputs {
+    std::string name;
+    std::vector<dlutils::DLTensorUPtr> inputsInfo;
+    std::vector<dlutils::DLTensorUPtr> outputsInfo;
+  };
+  std::unordered_multimap<size_t, std::unique_ptr<InferredOutputs>>
+      inferredOutputs_;
+
+  /// Halide translations of the TCs, see halideComponents.
+  std::map<std::string, std::shared_ptr<const tc2halide::HalideComponents>>
+      halideComponents_;
+
+  /// Totals of memoryUsage, the HalideComponents by number of executors
+  /// holding them.
+  size_t executorBytes_ = 0;
+  struct HeldHalideComponents {
+    size_t executors;
+    size_t bytes;
+  };
+  std::unordered_map<const tc2halide::HalideComponents*, HeldHalideComponents>
+      heldHalideComponents_;
+  size_t halideBytes_ = 0;
+
+  /// See setMemoryLimit.  Runs only stamp the executors with runClock_ when
+  /// there is a limit.
+  std::atomic<size_t> memoryLimit_{0};
+  std::atomic<uint64_t> runClock_{0};
+
+  /// See recordShapeManifest.  The entries are indexed by
+  /// hashKey(name, inputs, options), under tcExecutorMutex_.
+  struct ManifestEntry {
+    std::string name;
+    std::vector<dlutils::DLTensorUPtr> inputsInfo;
+    std::string options;
+    std::shared_ptr<std::atomic<uint64_t>> runs;
+  };
+  std::atomic<bool> recordShapeManifest_{false};
+  std::unordered_multimap<size_t, ManifestEntry> shapeManifest_;
+
+  /// Guards compilationPool_ only, compilation jobs take tcExecutorMutex_.
+  std::mutex compilationPoolMutex_;
 
-  size_t uidCounter = 0;
+  /// Declared last so it is destroyed first: pending jobs still reference
+  /// the members above.
+  std::unique_ptr<ThreadPool> compilationPool_;
 };
 } // namespace tc
 
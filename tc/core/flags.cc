@@ -36,10 +36,57 @@ DEFINE_bool(
     false,
     "Print debug spew for the tc_mapper like cuda code, mapping options etc");
 DEFINE_bool(dump_cuda, false, "Print the generated cudaSource");
+DEFINE_bool(
+    nvtx_ranges,
+    false,
+    "Mark the compilation phases, the tuner generations and the kernel launches as NVTX ranges in profiler timelines");
+DEFINE_bool(
+    cuda_line_info,
+    false,
+    "Compile the CUDA kernels with line information and mark the statements of their source with the TC statements they compute, so that tc_source_profile attributes the samples of a source-level profile to the TC statements");
+
+// Memory bounds for long running processes, 0 means unbounded
+DEFINE_uint64(
+    cuda_cache_max_entries,
+    0,
+    "Maximal number of kernels the CudaCache holds, least recently used first evicted");
+DEFINE_uint64(
+    cuda_cache_max_bytes,
+    0,
+    "Maximal bytes of source and PTX the CudaCache holds, least recently used first evicted");
+DEFINE_uint64(
+    cuda_max_loaded_modules,
+    0,
+    "Maximal number of CUDA modules loaded at once, least recently launched first unloaded");
+DEFINE_string(
+    cuda_warmup_devices,
+    "",
+    "Comma separated list of GPUs the kernels are loaded on when compiled, so that their first launch there does not pay for the driver JIT");
+DEFINE_bool(
+    nvrtc_serialize_compilation,
+    false,
+    "Run one NVRTC compilation at a time, for NVRTC versions that are not thread-safe");
+DEFINE_uint64(
+    cuda_max_kernel_statements,
+    65536,
+    "Maximal number of statements of a CUDA kernel, unrolled copies included: unrolling backs off to fit and larger kernels fail before NVRTC runs, 0 means unbounded");
+DEFINE_string(
+    cuda_compile_server,
+    "",
+    "Unix socket of a compile server (see tc_compile_server): the kernels missing from the caches are mapped and compiled by the server and the process only loads the returned binaries");
 
 // CPU codegen options
 DEFINE_bool(llvm_dump_before_opt, false, "Print IR before optimization");
 DEFINE_bool(llvm_dump_after_opt, false, "Print IR after optimization");
+// llvm_num_threads is defined by the CPU runtime, see cpu_parallel.cc
+DEFINE_string(
+    llvm_target_cpu,
+    "",
+    "CPU the CPU kernels are compiled and tuned for (e.g. skylake-avx512), defaults to the host CPU");
+DEFINE_string(
+    llvm_target_features,
+    "",
+    "Comma separated LLVM target features of the CPU kernels (e.g. -avx512f), which override those of the host CPU, or those implied by --llvm_target_cpu if it is set");
 
 DEFINE_uint32(
     benchmark_warmup,
@@ -49,10 +96,22 @@ DEFINE_uint32(
     benchmark_iterations,
     100,
     "Number of runs to use for collecting benchmarks (also for autotuning)");
+DEFINE_bool(
+    benchmark_cold_cache,
+    false,
+    "Flush the L2 cache of the GPU before each timed run of the benchmarks and of the autotuner, outside of the timed region, so that kernels are measured and ranked on inputs read from the device memory as in a serving pipeline instead of on the inputs left in L2 by the previous run, and report the GPU clocks with the measurements");
+DEFINE_uint32(
+    telemetry_sampling_period,
+    100,
+    "When a telemetry sink is installed, one kernel launch out of this many is timed and reported with its GPU time, 0 disables the timing");
 DEFINE_bool(
     schedule_tree_verbose_validation,
     false,
     "Print debug spew for experimental schedule_tree");
+DEFINE_uint64(
+    schedule_cache_max_entries,
+    256,
+    "Maximal number of schedules kept to map other options with the same scheduler options, and of dependences kept to schedule the same TC and sizes, least recently used first evicted, 0 disables the caches");
 
 // Autotuner flags
 DEFINE_uint32(
@@ -80,6 +139,30 @@ DEFINE_string(
     tuner_gpus,
     "0",
     "Comma separated list of GPUs to use for autotuning");
+DEFINE_string(
+    tuner_cpus,
+    "0",
+    "Comma separated list of CPU cores to benchmark on when autotuning for the CPU, one benchmarking thread is pinned to each");
+DEFINE_string(
+    tuner_workers,
+    "",
+    "Comma separated host:port list of distributed tuning workers (see tc_tuning_worker) that compile and benchmark the candidates instead of the local GPUs, list a worker once per GPU it serves");
+DEFINE_string(
+    tuner_sandbox_worker,
+    "",
+    "Path to the tc_tuning_worker binary: when set (and tuner_workers is not), the candidates are evaluated in one worker subprocess per GPU of tuner_gpus, restarted when a candidate crashes it (e.g. with an illegal memory access), so that the tuning run carries on");
+DEFINE_uint64(
+    tuner_compile_max_isl_operations,
+    100000000,
+    "Bound on the number of isl operations of the compilation of a candidate, past which the candidate is marked invalid so that e.g. a pathological scheduling problem does not block a compilation thread (0 for no bound)");
+DEFINE_uint64(
+    tuner_compile_memory_budget_mb,
+    0,
+    "Bound in MB on the resident memory of the process while compiling candidates: a compilation only starts when its peak memory, estimated from the resident memory sampled during the previous ones, fits in the budget alongside the running ones, and a single compilation always runs (0 for no bound). Lets tuner_threads match the cores of hosts that lack the memory for as many concurrent compilations of a large TC");
+DEFINE_uint32(
+    tuner_kernel_timeout_ms,
+    10000,
+    "Candidates whose kernel runs longer than this are marked invalid (0 for no timeout). Kernels are only interrupted in sandboxed workers (see tuner_sandbox_worker), which exit and are restarted, in-process a kernel that never ends still blocks its GPU thread");
 DEFINE_bool(
     tuner_print_best,
     false,
@@ -93,6 +176,10 @@ DEFINE_uint32(
     tuner_gen_restore_number,
     10,
     "The number of best candidates to restore from the proto cache");
+DEFINE_uint32(
+    tuner_gen_restore_nearest_shapes,
+    0,
+    "When the proto cache holds fewer than tuner_gen_restore_number candidates for the tuned shapes, top up with the best options of up to this many entries of the same TC with the nearest shapes (0 disables)");
 DEFINE_bool(
     tuner_gen_log_generations,
     false,
@@ -101,6 +188,110 @@ DEFINE_uint64(
     tuner_min_launch_total_threads,
     64,
     "Prune out kernels mapped to fewer than this many threads and block");
+DEFINE_bool(
+    tuner_seed_heuristic_options,
+    true,
+    "Add the options of makeHeuristicCudaMappingOptions for the tuned shapes to the first generation of the tuner, when there is room left");
+DEFINE_bool(
+    tuner_static_pruning,
+    true,
+    "Estimate the shared memory, registers and occupancy of each mapped autotuning candidate and prune those exceeding the device limits or below tuner_min_occupancy before compiling them with NVRTC");
+DEFINE_bool(
+    tuner_skip_pointwise,
+    true,
+    "Do not tune pointwise TCs, whose statements have no dependences, and return the base mapping options");
+DEFINE_double(
+    tuner_min_occupancy,
+    0.05,
+    "Prune out kernels whose estimated occupancy (fraction of the maximal number of resident threads of a multiprocessor) is below this");
+DEFINE_bool(
+    tuner_prune_spills,
+    true,
+    "Prune out the compiled autotuning candidates that spill registers to local memory, as reported by the driver, before benchmarking them");
+DEFINE_uint32(
+    tuner_benchmark_min_iterations,
+    5,
+    "Minimum number of timed runs of each autotuning candidate");
+DEFINE_uint32(
+    tuner_benchmark_max_iterations,
+    200,
+    "Maximum number of timed runs of each autotuning candidate");
+DEFINE_uint32(
+    tuner_benchmark_time_budget_ms,
+    100,
+    "Stop timing an autotuning candidate once this much wall time was spent on it (after tuner_benchmark_min_iterations runs)");
+DEFINE_double(
+    tuner_benchmark_relative_ci,
+    0.02,
+    "Stop timing an autotuning candidate once the half width of the 95% confidence interval of its mean runtime is below this fraction of the mean");
+DEFINE_uint32(
+    tuner_racing_rungs,
+    3,
+    "Measure the autotuning candidates by successive halving over this many rungs of growing benchmarking budgets, the last one being that of the tuner_benchmark_* flags: a candidate goes on to the next rung only if it ranks among the fastest of its rung so far (1 gives every candidate the full budget)");
+DEFINE_uint32(
+    tuner_racing_reduction,
+    3,
+    "Ratio of the budgets of consecutive rungs of tuner_racing_rungs, a candidate goes on to the next rung if it ranks among the fastest 1 / tuner_racing_reduction of its rung (at least 2)");
+DEFINE_uint32(
+    tuner_final_remeasure_top_k,
+    3,
+    "Re-measure the best k distinct candidates with a larger benchmarking budget on an otherwise idle GPU once tuning is over and keep the fastest (0 disables)");
+DEFINE_bool(
+    tuner_gen_pipelined,
+    false,
+    "Stream candidates through compilation and benchmarking without a generation barrier: the search breeds a new candidate from the evaluated ones each time a result arrives (runs tuner_gen_generations * tuner_gen_pop_size evaluations)");
+DEFINE_bool(
+    tuner_normalize_device_runtimes,
+    true,
+    "When tuning on several GPUs, scale the runtimes measured on each GPU to the first of tuning_devices by the ratio of the runtimes of the base options on both, measured again at each generation (and regularly when pipelined), so that candidates timed on different or partially busy GPUs compare");
+DEFINE_string(
+    tuner_search_strategy,
+    "genetic",
+    "Search driven by the autotuner: genetic, random, hill_climbing (from the starting points, restarting when stalled) or bayesian (Gaussian process with expected improvement); the generation size and count keep their meaning, the crossover, mutation and elite settings only apply to genetic");
+DEFINE_uint32(
+    tuner_time_budget_s,
+    0,
+    "Stop autotuning after this many seconds: candidates are no longer compiled and the ones already compiled are evaluated (0 disables)");
+DEFINE_uint32(
+    tuner_max_stalled_generations,
+    0,
+    "Stop autotuning after this many generations (or tuner_gen_pop_size results in pipelined mode) without improvement of the best runtime (0 disables)");
+DEFINE_double(
+    tuner_target_speedup,
+    0,
+    "Stop autotuning once the best runtime is this many times faster than the runtime of the base mapping options, which are evaluated first (0 disables)");
+DEFINE_string(
+    tuner_tuning_curve_file,
+    "",
+    "Append the tuning-time-to-quality curve of each tuning run to this file, one CSV line (strategy,kernel,elapsed ms,evaluated candidates,best us) per improvement of the best runtime");
+DEFINE_string(
+    tuner_cache_backend,
+    "",
+    "Remote store of the options and kernels caches (http://host[:port]/path or a directory, see makeCacheBackend): the autotuner fetches the entries it misses from it and stores its results there");
+DEFINE_uint32(
+    tuner_retune_top_k,
+    8,
+    "Number of best options of the previous cache re-benchmarked when re-tuning after a TC or compiler upgrade");
+DEFINE_uint32(
+    tuner_retune_generations,
+    2,
+    "Number of generations of the local search around the re-benchmarked options when re-tuning");
+DEFINE_string(
+    tuner_retune_search_strategy,
+    "hill_climbing",
+    "Search strategy of the local search when re-tuning, see tuner_search_strategy");
+DEFINE_bool(
+    tuner_hardware_counters,
+    false,
+    "Collect the achieved occupancy, DRAM utilization, shared memory bank conflicts and L2 hit rate of the autotuning candidates within 10% of the best runtime with CUPTI, record them in the options cache and bias the mutations of the genetic search towards the parameters that affect the bottleneck of the best kernel (requires a device of compute capability below 7.5)");
+DEFINE_double(
+    tuner_gen_uniform_mutation,
+    0.2,
+    "Fraction of the mutations of numeric parameters (tile, block and grid sizes, unroll factor, ...) in the genetic search that draw a value uniformly from the range, the others move to the value nearest to twice or half the current one (1 draws all of them uniformly)");
+DEFINE_bool(
+    tuner_gen_grouped_crossover,
+    true,
+    "Take the tile, block, grid and thread tile sizes of a child of the genetic search together from one of its parents instead of each size independently");
 DEFINE_int64(
     random_seed,
     -1,
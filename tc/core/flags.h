@@ -29,14 +29,29 @@ DECLARE_bool(debug_tc_mapper);
 DECLARE_bool(debug_cuda);
 DECLARE_bool(debug_tuner);
 DECLARE_bool(dump_cuda);
+DECLARE_bool(nvtx_ranges);
+DECLARE_bool(cuda_line_info);
+DECLARE_uint64(cuda_cache_max_entries);
+DECLARE_uint64(cuda_cache_max_bytes);
+DECLARE_uint64(cuda_max_loaded_modules);
+DECLARE_string(cuda_warmup_devices);
+DECLARE_bool(nvrtc_serialize_compilation);
+DECLARE_uint64(cuda_max_kernel_statements);
+DECLARE_string(cuda_compile_server);
 
 // llvm codegen
 DECLARE_bool(llvm_dump_before_opt);
 DECLARE_bool(llvm_dump_after_opt);
+DECLARE_uint32(llvm_num_threads);
+DECLARE_bool(llvm_numa);
+DECLARE_string(llvm_target_cpu);
+DECLARE_string(llvm_target_features);
 
 // Used in benchmarking and autotuning
 DECLARE_uint32(benchmark_warmup);
 DECLARE_uint32(benchmark_iterations);
+DECLARE_bool(benchmark_cold_cache);
+DECLARE_uint32(telemetry_sampling_period);
 
 // Used in autotuning
 DECLARE_uint32(tuner_gen_pop_size);
@@ -46,16 +61,50 @@ DECLARE_uint32(tuner_gen_generations);
 DECLARE_uint32(tuner_gen_number_elites);
 DECLARE_uint32(tuner_threads);
 DECLARE_string(tuner_gpus);
+DECLARE_string(tuner_cpus);
+DECLARE_string(tuner_workers);
+DECLARE_string(tuner_sandbox_worker);
+DECLARE_uint64(tuner_compile_max_isl_operations);
+DECLARE_uint64(tuner_compile_memory_budget_mb);
+DECLARE_uint32(tuner_kernel_timeout_ms);
 DECLARE_bool(tuner_print_best);
 DECLARE_string(tuner_rng_restore);
 DECLARE_bool(tuner_gen_restore_from_proto);
 DECLARE_uint32(tuner_gen_restore_number);
+DECLARE_uint32(tuner_gen_restore_nearest_shapes);
+DECLARE_bool(tuner_seed_heuristic_options);
 DECLARE_bool(tuner_gen_log_generations);
 DECLARE_uint64(tuner_min_launch_total_threads);
+DECLARE_bool(tuner_static_pruning);
+DECLARE_bool(tuner_skip_pointwise);
+DECLARE_double(tuner_min_occupancy);
+DECLARE_bool(tuner_prune_spills);
+DECLARE_uint32(tuner_benchmark_min_iterations);
+DECLARE_uint32(tuner_benchmark_max_iterations);
+DECLARE_uint32(tuner_benchmark_time_budget_ms);
+DECLARE_double(tuner_benchmark_relative_ci);
+DECLARE_uint32(tuner_racing_rungs);
+DECLARE_uint32(tuner_racing_reduction);
+DECLARE_uint32(tuner_final_remeasure_top_k);
+DECLARE_bool(tuner_gen_pipelined);
+DECLARE_bool(tuner_normalize_device_runtimes);
+DECLARE_string(tuner_search_strategy);
+DECLARE_uint32(tuner_time_budget_s);
+DECLARE_uint32(tuner_max_stalled_generations);
+DECLARE_double(tuner_target_speedup);
+DECLARE_string(tuner_tuning_curve_file);
+DECLARE_string(tuner_cache_backend);
+DECLARE_uint32(tuner_retune_top_k);
+DECLARE_uint32(tuner_retune_generations);
+DECLARE_string(tuner_retune_search_strategy);
+DECLARE_bool(tuner_hardware_counters);
+DECLARE_double(tuner_gen_uniform_mutation);
+DECLARE_bool(tuner_gen_grouped_crossover);
 
 // Misc
 DECLARE_int64(random_seed);
 DECLARE_bool(schedule_tree_verbose_validation);
+DECLARE_uint64(schedule_cache_max_entries);
 
 // random seed setting for reproducibility and debugging purposes
 uint64_t initRandomSeed();
@@ -15,6 +15,8 @@
  */
 #pragma once
 
+#include <algorithm>
+
 // Conditionally include CUDA-specific headers.  This file should compile even
 // without them.
 #ifdef CUDA_HOME
@@ -34,4 +36,44 @@ inline size_t querySharedMemorySize() {
 #endif
 }
 
+inline size_t queryOptinSharedMemorySize() {
+#ifdef CUDA_HOME
+  return CudaGPUInfo::GPUInfo().OptinSharedMemorySize();
+#else
+  return 0;
+#endif
+}
+
+/// Get the compute capability, as 10 * major + minor, of the GPU device active
+/// in the current thread.
+/// If a thread has no associated GPU device, return 0.
+inline int queryComputeCapability() {
+#ifdef CUDA_HOME
+  return CudaGPUInfo::GPUInfo().ComputeCapability();
+#else
+  return 0;
+#endif
+}
+
+/// Get the number of blocks of "threadsPerBlock" threads that can be resident
+/// at once on the GPU device active in the current thread, as bounded by the
+/// number of threads and blocks of its multiprocessors.  Register and shared
+/// memory usage are not taken into account.
+/// If a thread has no associated GPU device, return 0.
+inline size_t queryMaxResidentBlocks(size_t threadsPerBlock) {
+#ifdef CUDA_HOME
+  auto limits = CudaGPUInfo::GPUInfo().MultiprocessorLimits();
+  if (limits.maxThreads == 0 || threadsPerBlock == 0) {
+    return 0;
+  }
+  // Threads are allocated per warp.
+  auto threads = (threadsPerBlock + limits.warpSize - 1) / limits.warpSize *
+      limits.warpSize;
+  auto blocks = std::min(limits.maxBlocks, limits.maxThreads / threads);
+  return limits.multiprocessorCount * blocks;
+#else
+  return 0;
+#endif
+}
+
 } // namespace tc
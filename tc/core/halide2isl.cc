@@ -53,6 +53,11 @@ SymbolTable makeSymbolTable(const tc2halide::HalideComponents& components) {
         included.insert(op->name);
       }
     }
+    // Variables bound by Let expressions are not loop iterators.
+    void visit(const Let* op) {
+      included.insert(op->name);
+      IRVisitor::visit(op);
+    }
 
    public:
     halide2isl::SymbolTable table;
@@ -189,12 +194,15 @@ std::vector<isl::aff> makeIslAffBoundsFromExpr(
   } else if (const Mul* op = e.as<Mul>()) {
     return {combineSingleAffs(space, op, &isl::aff::mul)};
   } else if (const Div* op = e.as<Div>()) {
-    return {combineSingleAffs(space, op, &isl::aff::div)};
+    // Halide rounds integer divisions down, e.g., the subscripts of the
+    // flattened reductions of the implicit GEMM convolutions.
+    auto quotient = combineSingleAffs(space, op, &isl::aff::div);
+    return {op->type.is_float() ? quotient : quotient.floor()};
   } else if (const Mod* op = e.as<Mod>()) {
     std::vector<isl::aff> result;
     // We cannot span multiple constraints if a modulo operation is involved.
     // x > max(a,b) % C is not equivalent to (x > a % C && x > b % C).
-    auto lhs = makeIslAffBoundsFromExpr(space, e, false, false);
+    auto lhs = makeIslAffBoundsFromExpr(space, op->a, false, false);
     CHECK_EQ(lhs.size(), 1);
     if (const int64_t* b = as_const_int(op->b)) {
       return {lhs[0].mod(isl::val(space.get_ctx(), *b))};
@@ -311,6 +319,63 @@ extractAccesses(isl::set domain, const Stmt& s, AccessMap* accesses) {
   return {finder.reads, finder.writes};
 }
 
+/*
+ * Return the subset of the set space "space" where the condition "e" holds.
+ * "e" is a conjunction of (possibly negated) comparisons of affine
+ * expressions, as the predicates of the TC where clauses lower to.
+ */
+isl::set makeIslSetFromCondition(isl::space space, const Expr& e) {
+  auto affs = [&space, &e](const Expr& a, const Expr& b)
+      -> std::pair<isl::aff, isl::aff> {
+    auto lhs = makeIslAffFromExpr(space, a);
+    auto rhs = makeIslAffFromExpr(space, b);
+    CHECK(lhs && rhs) << "non-affine condition " << e;
+    return std::make_pair(lhs, rhs);
+  };
+  auto one = makeIslAffFromInt(space, 1);
+  std::pair<isl::aff, isl::aff> p;
+  if (auto op = e.as<Call>()) {
+    if (op->is_intrinsic(Call::likely)) {
+      return makeIslSetFromCondition(space, op->args[0]);
+    }
+  } else if (auto op = e.as<And>()) {
+    return makeIslSetFromCondition(space, op->a)
+        .intersect(makeIslSetFromCondition(space, op->b));
+  } else if (auto op = e.as<LE>()) {
+    p = affs(op->a, op->b);
+    return p.second.ge_set(p.first);
+  } else if (auto op = e.as<GE>()) {
+    p = affs(op->a, op->b);
+    return p.first.ge_set(p.second);
+  } else if (auto op = e.as<LT>()) {
+    p = affs(op->a, op->b);
+    return p.second.ge_set(p.first.add(one));
+  } else if (auto op = e.as<GT>()) {
+    p = affs(op->a, op->b);
+    return p.first.ge_set(p.second.add(one));
+  } else if (auto op = e.as<EQ>()) {
+    p = affs(op->a, op->b);
+    return p.first.ge_set(p.second).intersect(p.second.ge_set(p.first));
+  } else if (auto op = e.as<Not>()) {
+    if (auto lt = op->a.as<LT>()) {
+      return makeIslSetFromCondition(space, lt->a >= lt->b);
+    } else if (auto le = op->a.as<LE>()) {
+      return makeIslSetFromCondition(space, le->a > le->b);
+    } else if (auto gt = op->a.as<GT>()) {
+      return makeIslSetFromCondition(space, gt->a <= gt->b);
+    } else if (auto ge = op->a.as<GE>()) {
+      return makeIslSetFromCondition(space, ge->a < ge->b);
+    } else if (auto disjunction = op->a.as<Or>()) {
+      return makeIslSetFromCondition(space, !disjunction->a)
+          .intersect(makeIslSetFromCondition(space, !disjunction->b));
+    } else if (auto negation = op->a.as<Not>()) {
+      return makeIslSetFromCondition(space, negation->a);
+    }
+  }
+  LOG(FATAL) << "unsupported condition " << e;
+  return isl::set();
+}
+
 /*
  * Helper function for extracting a schedule from a Halide Stmt,
  * recursively descending over the Stmt.
@@ -416,6 +481,20 @@ isl::schedule makeScheduleTreeHelper(
     }
     schedule = schedules[0].sequence(schedules[1]);
 
+  } else if (auto op = s.as<IfThenElse>()) {
+    // The predicates of the where clauses restrict the iteration domain.
+    CHECK(!op->else_case.defined())
+        << "Unhandled Halide stmt with an else branch: " << s;
+    auto condition = makeIslSetFromCondition(set.get_space(), op->condition);
+    schedule = makeScheduleTreeHelper(
+        op->then_case,
+        set.intersect(condition),
+        outer,
+        reads,
+        writes,
+        accesses,
+        statements,
+        iterators);
   } else if (auto op = s.as<Provide>()) {
     // Make an ID for this leaf statement. This *is* semantically
     // meaningful - it is used as a key to identify the provide
@@ -489,26 +568,46 @@ std::vector<Reduction> findReductions(const Stmt& s) {
       }
     }
 
+    // Is the given update node a scatter, i.e., are some of its subscripts
+    // not variables?
+    static bool isScatter(const Provide* op) {
+      return std::any_of(op->args.begin(), op->args.end(), [](const Expr& e) {
+        return !e.as<Variable>();
+      });
+    }
+
     // Check that the given update node, together with the corresponding
-    // init node form a proper reduction pair.
+    // init node form a proper reduction pair and return the number of
+    // outer For nodes that are not reduction loops, -1 if they do not.
     // In particular, check that they share some outer For nodes and
     // that the variables of the additional For nodes surrounding
-    // the update node are all reduction variables.
-    bool isValidReductionUpdate(const Provide* op) {
+    // the update node are all reduction variables.  The update of a
+    // scatter does not share the For nodes of its init, its outer For
+    // nodes that are not reduction loops are those of the subscripts that
+    // are variables.
+    int nonReductionLoops(const Provide* op) {
       const auto& opInitVars = initVars[op->name];
-      auto n = opInitVars.size();
+      auto scatter = isScatter(op);
+      size_t n = opInitVars.size();
+      if (scatter) {
+        n = 0;
+        while (n < vars.size() && reductionVars.count(vars[n]) == 0) {
+          ++n;
+        }
+      }
       if (vars.size() <= n) {
-        return false;
+        return -1;
       }
-      if (!std::equal(opInitVars.begin(), opInitVars.end(), vars.begin())) {
-        return false;
+      if (!scatter &&
+          !std::equal(opInitVars.begin(), opInitVars.end(), vars.begin())) {
+        return -1;
       }
       for (auto i = vars.begin() + n; i != vars.end(); ++i) {
         if (reductionVars.count(*i) == 0) {
-          return false;
+          return -1;
         }
       }
-      return true;
+      return n;
     }
 
     // Keep track of the names of the outer For nodes.
@@ -532,16 +631,17 @@ std::vector<Reduction> findReductions(const Stmt& s) {
         reductions[op->name].init = op;
         initVars[op->name] = vars;
       } else if (isReductionUpdate(op)) {
-        if (isValidReductionUpdate(op)) {
+        auto n = nonReductionLoops(op);
+        if (n >= 0) {
           auto& p = reductions[op->name];
           CHECK(p.init.defined())
               << "Missing reduction init or (unsupported) multiple updates";
           CHECK(!p.update.defined())
               << "Multiple reduction updates not yet implemented";
           p.update = op;
-          auto n = initVars[op->name].size();
           p.dims.resize(vars.size() - n);
           std::iota(p.dims.begin(), p.dims.end(), n);
+          p.scatter = isScatter(op);
         } else {
           reductions.erase(op->name);
         }
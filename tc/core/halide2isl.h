@@ -94,9 +94,12 @@ ScheduleTreeAndAccesses makeScheduleTree(
 /// the update statement, although the init statement is probably
 /// not strictly needed, and a list of reduction dimensions
 /// in the domain of the update statement.
+/// The update of a scatter writes the elements selected by data-dependent
+/// subscripts, it does not share the loops of its init statement.
 struct Reduction {
   Halide::Internal::Stmt init, update;
   std::vector<size_t> dims;
+  bool scatter = false;
 };
 std::vector<Reduction> findReductions(const Halide::Internal::Stmt& s);
 
@@ -15,6 +15,7 @@
  */
 #include "tc/core/halide_utils.h"
 
+#include <algorithm>
 #include <map>
 #include <vector>
 
@@ -81,9 +82,50 @@ std::map<std::string, int> computeParamValueMap(
   return pvm;
 }
 
-std::vector<DLTensorUPtr> inferOutputTensorInfo(
+void checkInputsCompliant(
     const tc2halide::HalideComponents& halide,
-    const std::vector<const DLTensor*>& inputsDLT) {
+    const std::vector<const DLTensor*>& inputsInfo) {
+  if (inputsInfo.size() != halide.inputs.size()) {
+    throw lang::ErrorReport(halide.getDef())
+        << "expected " << halide.inputs.size() << " inputs but found "
+        << inputsInfo.size();
+  }
+  for (size_t i = 0; i < inputsInfo.size(); ++i) {
+    auto dltype_ = inputsInfo[i]->dtype;
+    auto htype_ = halide.inputs[i].type();
+    // we have three type representations here: (1) halide Type (2) DLTensor
+    // type, and (3) the token representing the type in the frontend (e.g.
+    // TK_FLOAT) we need to translate to (3) to report user facing errors
+    auto dltype =
+        lang::TypeInfo(lang::TypeInfo::Code(dltype_.code), dltype_.bits)
+            .toScalarToken();
+    auto htype =
+        lang::TypeInfo(lang::TypeInfo::Code(htype_.code()), htype_.bits())
+            .toScalarToken();
+    if (dltype != htype) {
+      throw lang::ErrorReport(halide.getDef().params()[i])
+          << "expected type " << lang::kindToString(htype) << " but found "
+          << lang::kindToString(dltype);
+    }
+    int edim = halide.inputs[i].dimensions();
+    int adim = inputsInfo[i]->ndim;
+    if (adim != edim) {
+      throw lang::ErrorReport(halide.getDef().params()[i])
+          << "expected a tensor with " << edim << " dimensions but found "
+          << adim << " dimensions.";
+    }
+  }
+}
+
+namespace {
+// Metadata of "tensors", either the outputs or the temporaries of "halide",
+// with the sizes for the inputs "inputsDLT".  Errors are reported at the
+// return of the i-th output or at the definition for temporaries.
+std::vector<DLTensorUPtr> inferTensorInfo(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<Halide::OutputImageParam>& tensors,
+    const std::vector<const DLTensor*>& inputsDLT,
+    bool areOutputs) {
   auto pvm = computeParamValueMap(halide, inputsDLT);
 
   // instantiate parameters with runtime values and build output DLpack metadata
@@ -95,10 +137,11 @@ std::vector<DLTensorUPtr> inferOutputTensorInfo(
   if (inputsDLT.size() > 0)
     ctx = inputsDLT[0]->ctx;
   std::vector<DLTensorUPtr> outputsDLT;
-  for (size_t i = 0; i < halide.outputs.size(); ++i) {
+  for (size_t i = 0; i < tensors.size(); ++i) {
     std::vector<long> sizes;
-    auto& out = halide.outputs[i];
-    auto tree = halide.getDef().returns()[i];
+    auto& out = tensors[i];
+    lang::TreeRef tree =
+        areOutputs ? lang::TreeRef(halide.getDef().returns()[i]) : halide.def;
     for (int d = 0; d < out.dimensions(); d++) {
       Expr extent = out.parameter().extent_constraint(d);
       extent = simplify(substitute(substitutions, extent));
@@ -116,6 +159,311 @@ std::vector<DLTensorUPtr> inferOutputTensorInfo(
 
   return outputsDLT;
 }
+} // namespace
+
+std::vector<DLTensorUPtr> inferOutputTensorInfo(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT) {
+  return inferTensorInfo(halide, halide.outputs, inputsDLT, true);
+}
+
+std::vector<DLTensorUPtr> inferTemporaryTensorInfo(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT) {
+  return inferTensorInfo(halide, halide.temporaries, inputsDLT, false);
+}
+
+namespace {
+// Counts the arithmetic operations of an expression, outside of the indices
+// of tensor accesses.
+class ArithmeticCounter : public IRVisitor {
+  using IRVisitor::visit;
+
+  void count(const Expr& a, const Expr& b) {
+    ++operations;
+    a.accept(this);
+    b.accept(this);
+  }
+  void visit(const Add* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Sub* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Mul* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Div* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Mod* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Min* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Max* op) override {
+    count(op->a, op->b);
+  }
+  void visit(const Call* op) override {
+    if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+      return;
+    }
+    if (op->call_type == Call::PureExtern) {
+      ++operations;
+    }
+    IRVisitor::visit(op);
+  }
+
+ public:
+  size_t operations = 0;
+};
+
+// Sums the operations of the Provide nodes times the iterations of their
+// enclosing loops.
+class WorkCounter : public IRVisitor {
+  using IRVisitor::visit;
+
+  void visit(const For* op) override {
+    auto extent = simplify(substitute(substitutions_, op->extent));
+    const int64_t* c = as_const_int(extent);
+    auto outer = iterations_;
+    iterations_ *= c ? std::max<int64_t>(*c, 0) : 1;
+    op->body.accept(this);
+    iterations_ = outer;
+  }
+  void visit(const Provide* op) override {
+    ArithmeticCounter counter;
+    for (const auto& value : op->values) {
+      value.accept(&counter);
+    }
+    flops += iterations_ * counter.operations;
+  }
+
+ public:
+  explicit WorkCounter(const std::map<std::string, Expr>& substitutions)
+      : substitutions_(substitutions) {}
+
+  double flops = 0;
+
+ private:
+  const std::map<std::string, Expr>& substitutions_;
+  double iterations_ = 1;
+};
+} // namespace
+
+TcWork estimateWork(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT) {
+  std::map<std::string, Expr> substitutions;
+  for (auto p : computeParamValueMap(halide, inputsDLT)) {
+    substitutions[p.first] = p.second;
+  }
+  WorkCounter counter(substitutions);
+  halide.stmt.accept(&counter);
+
+  TcWork work;
+  work.flops = counter.flops;
+  auto bytes = [](const DLTensor* t) -> double {
+    double size = t->dtype.bits * t->dtype.lanes / 8;
+    for (int d = 0; d < t->ndim; ++d) {
+      size *= t->shape[d];
+    }
+    return size;
+  };
+  for (auto input : inputsDLT) {
+    work.bytes += bytes(input);
+  }
+  for (const auto& output : inferOutputTensorInfo(halide, inputsDLT)) {
+    work.bytes += bytes(output.get());
+  }
+  return work;
+}
+
+namespace {
+// The 8-bit integer tensor access that "e" converts to accType, the
+// accumulator type of the same signedness.
+const Call* dp4aOperand(const Expr& e, const Type& accType) {
+  auto cast = e.as<Cast>();
+  if (!cast || cast->type != accType) {
+    return nullptr;
+  }
+  auto call = cast->value.as<Call>();
+  if (!call ||
+      (call->call_type != Call::Halide && call->call_type != Call::Image)) {
+    return nullptr;
+  }
+  auto type = call->type;
+  if (type.bits() != 8 || type.lanes() != 1 ||
+      type.code() != accType.code()) {
+    return nullptr;
+  }
+  return call;
+}
+
+// The iterator of the loop as it is used in its body, with its reduction
+// domain.
+class FindIterator : public IRVisitor {
+  using IRVisitor::visit;
+
+  void visit(const Variable* op) override {
+    if (op->name == name) {
+      iterator = op;
+    }
+  }
+
+ public:
+  explicit FindIterator(const std::string& name) : name(name) {}
+
+  const std::string& name;
+  Expr iterator;
+};
+
+class PackDp4a : public IRMutator2 {
+  using IRMutator2::visit;
+
+  Stmt visit(const For* op) override {
+    auto provide = op->body.as<Provide>();
+    auto packed = provide ? pack(op, provide) : Stmt();
+    return packed.defined() ? packed : IRMutator2::visit(op);
+  }
+
+  // Whether consecutive iterations read consecutive elements of an input:
+  // only its innermost subscript depends on the iterator, with a unit
+  // coefficient, and the input is contiguous in that dimension.
+  bool isContiguous(const Call* access, const Expr& iterator) const {
+    auto name = iterator.as<Variable>()->name;
+    auto it = strides_.find(access->name);
+    if (access->call_type != Call::Image || access->args.empty() ||
+        it == strides_.end() || it->second.back() != 1) {
+      return false;
+    }
+    for (size_t i = 0; i + 1 < access->args.size(); ++i) {
+      if (expr_uses_var(access->args[i], name)) {
+        return false;
+      }
+    }
+    return !expr_uses_var(simplify(access->args.back() - iterator), name);
+  }
+
+  // The loop op over the words of its sum reduction provide, if it is a
+  // sum of products of 8-bit integers that can be packed.
+  Stmt pack(const For* op, const Provide* provide) {
+    auto update = provide->values.size() == 1
+        ? provide->values[0].as<Call>()
+        : nullptr;
+    if (!update || !update->is_intrinsic(tc2halide::kReductionUpdate)) {
+      return Stmt();
+    }
+    auto type = update->type;
+    auto add = update->args[0].as<Add>();
+    if ((type != Int(32) && type != UInt(32)) || !add) {
+      return Stmt();
+    }
+    auto isRecursive = [provide](const Expr& e) {
+      auto call = e.as<Call>();
+      return call && call->name == provide->name;
+    };
+    auto recursive = isRecursive(add->a) ? add->a : add->b;
+    auto mul = (isRecursive(add->a) ? add->b : add->a).as<Mul>();
+    if (!isRecursive(recursive) || !mul) {
+      return Stmt();
+    }
+    auto a = dp4aOperand(mul->a, type);
+    auto b = dp4aOperand(mul->b, type);
+    if (!a || !b) {
+      return Stmt();
+    }
+    for (const auto& arg : provide->args) {
+      if (expr_uses_var(arg, op->name)) {
+        return Stmt();
+      }
+    }
+    auto min = simplify(substitute(substitutions_, op->min));
+    auto extent = simplify(substitute(substitutions_, op->extent));
+    auto minValue = as_const_int(min);
+    auto extentValue = as_const_int(extent);
+    if (!minValue || !extentValue || *extentValue <= 0 ||
+        *extentValue % 4 != 0) {
+      return Stmt();
+    }
+    FindIterator finder(op->name);
+    provide->accept(&finder);
+    auto iterator = finder.iterator;
+    if (!iterator.defined()) {
+      return Stmt();
+    }
+
+    // Iteration w of the new loop covers the elements min + 4 * w + c,
+    // for c in [0, 4).
+    auto first = min + 4 * iterator;
+    bool strided = false;
+    auto word = [&](const Call* access) -> Expr {
+      auto contiguous = isContiguous(access, iterator);
+      strided = strided || !contiguous;
+      std::vector<Expr> elements;
+      for (int c = 0; c < 4; ++c) {
+        elements.push_back(
+            simplify(substitute(op->name, first + c, Expr(access))));
+      }
+      return Call::make(
+          type,
+          contiguous ? tc2halide::kLoad4 : tc2halide::kPack4,
+          elements,
+          Call::PureIntrinsic);
+    };
+    auto dp4a = Call::make(
+        type, tc2halide::kDp4a, {word(a), word(b)}, Call::PureIntrinsic);
+    if (strided && !packStrided_) {
+      return Stmt();
+    }
+    auto value = Call::make(
+        type,
+        tc2halide::kReductionUpdate,
+        {recursive + dp4a},
+        Call::Intrinsic);
+    return For::make(
+        op->name,
+        0,
+        static_cast<int>(*extentValue / 4),
+        op->for_type,
+        op->device_api,
+        Provide::make(provide->name, {value}, provide->args));
+  }
+
+ public:
+  PackDp4a(
+      const std::map<std::string, Expr>& substitutions,
+      const std::map<std::string, std::vector<int64_t>>& strides,
+      bool packStrided)
+      : substitutions_(substitutions),
+        strides_(strides),
+        packStrided_(packStrided) {}
+
+ private:
+  const std::map<std::string, Expr>& substitutions_;
+  // Of the inputs, by name
+  const std::map<std::string, std::vector<int64_t>>& strides_;
+  bool packStrided_;
+};
+} // namespace
+
+tc2halide::HalideComponents packDp4aReductions(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT,
+    bool packStrided) {
+  std::map<std::string, Expr> substitutions;
+  for (auto p : computeParamValueMap(halide, inputsDLT)) {
+    substitutions[p.first] = p.second;
+  }
+  std::map<std::string, std::vector<int64_t>> strides;
+  for (size_t i = 0; i < inputsDLT.size(); ++i) {
+    strides[halide.inputs[i].name()] = getStrides(*inputsDLT[i]);
+  }
+  auto res = halide;
+  res.stmt = PackDp4a(substitutions, strides, packStrided).mutate(halide.stmt);
+  return res;
+}
 
 std::string halideCodegenC(const Stmt& stmt) {
   // build C string from Halide stmt
@@ -141,6 +489,10 @@ std::string halideCodegenC(const Stmt& stmt) {
       }
     }
 
+    void visit(const Let* op) override {
+      substitute(op->name, op->value, op->body).accept(this);
+    }
+
     void visit(const Provide* op) override {
       do_indent();
       stream << op->name;
@@ -33,6 +33,12 @@ std::map<std::string, int> computeParamValueMap(
     const tc2halide::HalideComponents& components,
     const std::vector<const DLTensor*>& inputsDLT);
 
+/// Throws a lang::ErrorReport unless the (metadata of) input tensors have
+/// the number, types and ranks of the inputs of the TC.
+void checkInputsCompliant(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsInfo);
+
 /// Infer the numerical sizes of the output tensors in the TC definition
 /// translated into Halide using the provided map between symbolic parameter
 /// names and their values ("pvm").
@@ -42,6 +48,42 @@ std::vector<dlutils::DLTensorUPtr> inferOutputTensorInfo(
     const tc2halide::HalideComponents& halide,
     const std::vector<const DLTensor*>& inputsDLT);
 
+/// Same as inferOutputTensorInfo for the temporary tensors, which the
+/// executors allocate.
+std::vector<dlutils::DLTensorUPtr> inferTemporaryTensorInfo(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT);
+
+/// Estimate of the work of a TC for given input sizes, e.g., to compare
+/// the measured runtime of its kernels to the roofline of the device.
+struct TcWork {
+  /// Arithmetic operations of the right-hand sides of the statements times
+  /// the number of points of their iteration domains, index computations
+  /// are not counted.  Where clauses restricting the domains are ignored,
+  /// ragged ranges count as a single iteration.
+  double flops = 0;
+  /// Bytes of the inputs and outputs, each one read or written once, the
+  /// minimal traffic to the device memory.
+  double bytes = 0;
+};
+
+TcWork estimateWork(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT);
+
+/// Rewrite the innermost loops of sum reductions of products of 8-bit
+/// integers into 32-bit integers, e.g. int8 matmuls accumulated in int32, as
+/// loops over words of 4 bytes reduced with the kDp4a intrinsic.  A loop is
+/// rewritten if its bounds, for the input sizes, are constant and its extent
+/// is a multiple of 4.  Operands of consecutive elements of an input, in its
+/// innermost dimension, are loaded as words (kLoad4), the others are packed
+/// (kPack4), which only pays off if packStrided is set: the loops with such
+/// operands are left alone otherwise.
+tc2halide::HalideComponents packDp4aReductions(
+    const tc2halide::HalideComponents& halide,
+    const std::vector<const DLTensor*>& inputsDLT,
+    bool packStrided);
+
 /// Just generates a C function body from a Halide stmt. Exposed for testing.
 std::string halideCodegenC(const Halide::Internal::Stmt& s);
 
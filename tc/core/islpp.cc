@@ -19,15 +19,48 @@
 namespace isl {
 namespace with_exceptions {
 
+namespace {
+// The context of the innermost ScopedCtx alive on this thread, if any.
+thread_local ctx* scopedCtx = nullptr;
+// The bound of the innermost ScopedMaxOperations alive on this thread.
+thread_local unsigned long scopedMaxOperations = 0;
+} // namespace
+
 isl::ctx globalIslCtx(IslCtxOption options) {
+  if (scopedCtx && options == IslCtxOption::Default) {
+    return *scopedCtx;
+  }
   static thread_local bool inited = false;
   static thread_local std::vector<CtxUPtr> ctxtUptrs;
   if (!inited) {
     // Default
     ctxtUptrs.push_back(CtxUPtr(new ctx(isl_ctx_alloc())));
+    inited = true;
   }
   return *ctxtUptrs.at(static_cast<int>(options));
 }
 
+ScopedCtx::ScopedCtx()
+    : ctx_(new ctx(isl_ctx_alloc())), previous_(scopedCtx) {
+  scopedCtx = ctx_.get();
+  if (scopedMaxOperations > 0) {
+    isl_ctx_set_max_operations(ctx_->get(), scopedMaxOperations);
+  }
+}
+
+ScopedCtx::~ScopedCtx() {
+  CHECK_EQ(scopedCtx, ctx_.get()) << "ScopedCtx destroyed out of order";
+  scopedCtx = previous_;
+}
+
+ScopedMaxOperations::ScopedMaxOperations(unsigned long maxOperations)
+    : previous_(scopedMaxOperations) {
+  scopedMaxOperations = maxOperations;
+}
+
+ScopedMaxOperations::~ScopedMaxOperations() {
+  scopedMaxOperations = previous_;
+}
+
 } // namespace with_exceptions
 } // namespace isl
@@ -32,8 +32,14 @@ namespace c {
 
 constexpr auto types = R"C(
 // Halide type handling
+typedef signed char int8;
+typedef short int16;
 typedef int int32;
 typedef long int64;
+typedef unsigned char uint8;
+typedef unsigned short uint16;
+typedef unsigned int uint32;
+typedef unsigned long uint64;
 typedef float float32;
 typedef double float64;
 )C";
@@ -149,10 +155,300 @@ template<typename T> inline __device__ T floord(T n, T d) {
 } // namespace cpp
 
 namespace cuda {
+// The helpers of any kernel, the others below are only emitted for the
+// kernels that use them.
 constexpr auto common = R"CUDA(
 
 namespace __tc {
 
+// Load an element that is not written during the kernel execution through
+// the read-only data cache, where available.
+template <typename T>
+inline __device__ T ldg(const T* p) {
+#if __CUDA_ARCH__ >= 350
+  return __ldg(p);
+#else
+  return *p;
+#endif
+}
+
+// Synchronize the threads of the warp and order their accesses to memory.
+// The warps no longer execute in lockstep since Volta.
+inline __device__ void syncWarp() {
+#if __CUDACC_VER_MAJOR__ >= 9
+  __syncwarp();
+#else
+  __threadfence_block();
+#endif
+}
+
+} // namespace __tc
+)CUDA";
+
+constexpr auto views = R"CUDA(
+
+namespace __tc {
+
+// Multi-dimensional view of a tensor whose inner sizes are only known at
+// launch, i.e. kernel parameters of a parametric kernel.  Indexed like the
+// array pointers emitted for specialized sizes.  sizes holds the D - 1
+// innermost sizes.
+template <typename T, int D>
+struct ParametricView {
+  T* data;
+  const int* sizes;
+  inline __device__ ParametricView<T, D - 1> operator[](int i) const {
+    int stride = 1;
+    for (int k = 0; k < D - 1; ++k) {
+      stride *= sizes[k];
+    }
+    return ParametricView<T, D - 1>{data + i * stride, sizes + 1};
+  }
+};
+
+template <typename T>
+struct ParametricView<T, 1> {
+  T* data;
+  const int* sizes;
+  inline __device__ T& operator[](int i) const {
+    return data[i];
+  }
+};
+
+// Multi-dimensional view of a tensor that is not packed, e.g. a view of a
+// larger tensor, whose strides (in elements) are fixed at compilation.
+// Indexed like the array pointers emitted for packed tensors.  strides holds
+// the D strides, outermost first.
+template <typename T, int D>
+struct StridedView {
+  T* data;
+  const int* strides;
+  inline __device__ StridedView<T, D - 1> operator[](int i) const {
+    return StridedView<T, D - 1>{data + i * strides[0], strides + 1};
+  }
+};
+
+template <typename T>
+struct StridedView<T, 1> {
+  T* data;
+  const int* strides;
+  inline __device__ T& operator[](int i) const {
+    return data[i * strides[0]];
+  }
+};
+
+} // namespace __tc
+)CUDA";
+
+// Helpers of the kernels computing on packed 8-bit integers.
+constexpr auto bytes = R"CUDA(
+
+namespace __tc {
+
+// Dot product of the 4 bytes packed in the words a and b, accumulated in c,
+// the bytes holding 8-bit integers of the signedness of the result.
+inline __device__ int dp4a(int a, int b, int c) {
+#if __CUDA_ARCH__ >= 610
+  return __dp4a(a, b, c);
+#else
+  for (int i = 0; i < 32; i += 8) {
+    c += static_cast<int8>(a >> i) * static_cast<int8>(b >> i);
+  }
+  return c;
+#endif
+}
+
+inline __device__ unsigned dp4a(unsigned a, unsigned b, unsigned c) {
+#if __CUDA_ARCH__ >= 610
+  return __dp4a(a, b, c);
+#else
+  for (int i = 0; i < 32; i += 8) {
+    c += static_cast<uint8>(a >> i) * static_cast<uint8>(b >> i);
+  }
+  return c;
+#endif
+}
+
+// The word of the bytes a0, a1, a2 and a3, from the least significant one.
+inline __device__ unsigned pack4(uint8 a0, uint8 a1, uint8 a2, uint8 a3) {
+  return static_cast<unsigned>(a0) | static_cast<unsigned>(a1) << 8 |
+      static_cast<unsigned>(a2) << 16 | static_cast<unsigned>(a3) << 24;
+}
+
+inline __device__ int pack4(int8 a0, int8 a1, int8 a2, int8 a3) {
+  return static_cast<int>(pack4(
+      static_cast<uint8>(a0),
+      static_cast<uint8>(a1),
+      static_cast<uint8>(a2),
+      static_cast<uint8>(a3)));
+}
+
+// The word of the 4 consecutive bytes at p, through the read-only data cache
+// if ReadOnly.  The rows of the tensors usually start on a multiple of 4
+// bytes, the bytes are packed one by one otherwise.
+template <bool ReadOnly, typename W, typename T>
+inline __device__ W loadWord(const T* p) {
+  if (reinterpret_cast<unsigned long long>(p) % 4 != 0) {
+    return ReadOnly ? pack4(ldg(p), ldg(p + 1), ldg(p + 2), ldg(p + 3))
+                    : pack4(p[0], p[1], p[2], p[3]);
+  }
+  auto w = reinterpret_cast<const W*>(p);
+  return ReadOnly ? ldg(w) : *w;
+}
+
+inline __device__ int load4(const int8* p) {
+  return loadWord<false, int>(p);
+}
+
+inline __device__ unsigned load4(const uint8* p) {
+  return loadWord<false, unsigned>(p);
+}
+
+inline __device__ int ldg4(const int8* p) {
+  return loadWord<true, int>(p);
+}
+
+inline __device__ unsigned ldg4(const uint8* p) {
+  return loadWord<true, unsigned>(p);
+}
+
+} // namespace __tc
+)CUDA";
+
+// The activations of CudaMappingOptionsProto::math_precision FastActivations,
+// each computed from a single ex2.approx and an approximate division.
+constexpr auto fastActivations = R"CUDA(
+
+namespace __tc {
+
+inline __device__ float fastExp2(float x) {
+  float y;
+  asm("ex2.approx.ftz.f32 %0, %1;" : "=f"(y) : "f"(x));
+  return y;
+}
+
+// tanh(x) = 1 - 2 / (exp(2 x) + 1), with exp(2 x) = exp2(2 log2(e) x).
+// The division by an infinite exp yields 0, hence 1 for large x.
+inline __device__ float fastTanh(float x) {
+  return 1.0f - __fdividef(2.0f, fastExp2(2.88539008f * x) + 1.0f);
+}
+
+// 1 / (1 + exp(-x)), with exp(-x) = exp2(-log2(e) x).
+inline __device__ float fastSigmoid(float x) {
+  return __fdividef(1.0f, 1.0f + fastExp2(-1.44269504f * x));
+}
+
+} // namespace __tc
+)CUDA";
+
+// The synchronization of all the threads of the grid between the stages of a
+// cooperative kernel, see CudaMappingOptionsProto::cooperative_kernels.
+constexpr auto gridSync = R"CUDA(
+#include <cooperative_groups.h>
+
+namespace __tc {
+
+inline __device__ void gridSync() {
+  cooperative_groups::this_grid().sync();
+}
+
+} // namespace __tc
+)CUDA";
+
+// The atomic additions of the lanes of a warp to the same element combined,
+// see CudaMappingOptionsProto::warp_aggregated_atomics.
+constexpr auto aggregatedAtomics = R"CUDA(
+
+namespace __tc {
+
+// Add v to *p, with a single atomicAdd of the sum of the values of the
+// active lanes that add to the same element, issued by the lowest of them.
+// Each lane reads the values of the active lanes of the warp in turn.
+// Before Volta, which lacks __match_any_sync, every lane adds its own value.
+template <typename T>
+inline __device__ void atomicAddAggregated(T* p, T v) {
+#if __CUDA_ARCH__ >= 700
+  unsigned active = __activemask();
+  unsigned peers =
+      __match_any_sync(active, reinterpret_cast<unsigned long long>(p));
+  unsigned lane;
+  asm("mov.u32 %0, %%laneid;" : "=r"(lane));
+  T sum = 0;
+  for (unsigned lanes = active; lanes != 0; lanes &= lanes - 1) {
+    int source = __ffs(lanes) - 1;
+    T w = __shfl_sync(active, v, source);
+    if (peers & (1u << source)) {
+      sum += w;
+    }
+  }
+  if (lane == __ffs(peers) - 1) {
+    atomicAdd(p, sum);
+  }
+#else
+  atomicAdd(p, v);
+#endif
+}
+
+} // namespace __tc
+)CUDA";
+
+// Copies from global to shared memory that bypass the registers, see
+// CudaMappingOptionsProto::async_copies.
+constexpr auto asyncCopies = R"CUDA(
+
+namespace __tc {
+
+template <int Bytes>
+struct CopyWord;
+template <>
+struct CopyWord<4> {
+  typedef int type;
+};
+template <>
+struct CopyWord<8> {
+  typedef int2 type;
+};
+template <>
+struct CopyWord<16> {
+  typedef int4 type;
+};
+
+// Start copying Bytes (4, 8 or 16) bytes from global memory at src to shared
+// memory at dst, both aligned on Bytes.  The copy is only complete after
+// cpAsyncWait.  Synchronous before compute capability 8.0.
+template <int Bytes>
+inline __device__ void cpAsync(void* dst, const void* src) {
+#if __CUDA_ARCH__ >= 800
+  unsigned shared;
+  asm("{ .reg .u64 a; cvta.to.shared.u64 a, %1; cvt.u32.u64 %0, a; }"
+      : "=r"(shared)
+      : "l"(dst));
+  asm volatile("cp.async.ca.shared.global [%0], [%1], %2;" ::"r"(shared),
+               "l"(src),
+               "n"(Bytes)
+               : "memory");
+#else
+  typedef typename CopyWord<Bytes>::type W;
+  *static_cast<W*>(dst) = *static_cast<const W*>(src);
+#endif
+}
+
+// Wait for the completion of the copies started by the thread.
+inline __device__ void cpAsyncWait() {
+#if __CUDA_ARCH__ >= 800
+  asm volatile("cp.async.wait_all;" ::: "memory");
+#endif
+}
+
+} // namespace __tc
+)CUDA";
+
+// Helpers of the block reductions, emitted before cubBlockReduce or
+// warpShuffleBlockReduce.
+constexpr auto reductions = R"CUDA(
+
+namespace __tc {
+
 // Re-implementing bits of type_traits because nvrtc no likes std includes
 template <typename T, typename TT>
 struct is_same {
@@ -342,7 +638,144 @@ inline __device__ void CubReduceAlongX(T* dest, T val) {
 } // namespace __tc
 )CUDA";
 
+constexpr auto warpShuffleBlockReduce = R"CUDA(
+
+namespace __tc {
+
+// Same as CubReduceAlongX without CUB: each row of ROW_SIZE consecutive
+// threads of the NUM_ROWS * ROW_SIZE threads of the block is reduced within
+// warps with shuffles, then across the warps it spans through one shared
+// memory value per warp.  Rows of a size dividing the warp size need neither
+// shared memory nor __syncthreads.  "tid" is the linear index of the thread
+// in the block and "pos" its position in its row.
+template <int ROW_SIZE, int NUM_ROWS, ReductionOp R, typename T>
+inline __device__ void WarpReduceRows(T* dest, T val, int tid, int pos) {
+  constexpr int kWarpSize = 32;
+  constexpr int kNumThreads = ROW_SIZE * NUM_ROWS;
+  constexpr int kNumWarps = (kNumThreads + kWarpSize - 1) / kWarpSize;
+
+  int lane = tid % kWarpSize;
+  int warpEnd = min(tid - lane + kWarpSize, kNumThreads) - 1;
+  int rowEnd = tid - pos + ROW_SIZE - 1;
+  int end = min(rowEnd, warpEnd);
+  unsigned mask = warpEnd - tid + lane == kWarpSize - 1
+      ? 0xffffffffu
+      : (1u << (warpEnd - tid + lane + 1)) - 1;
+
+  // After the step with a given offset, val reduces the values of the
+  // threads in [tid, min(tid + 2 * offset - 1, end)].
+  for (int offset = 1; offset < ROW_SIZE && offset < kWarpSize;
+       offset *= 2) {
+    T other = __shfl_down_sync(mask, val, offset);
+    if (tid + offset <= end) {
+      val = Reducer<T, R>::reduce(val, other);
+    }
+  }
+
+  if (kWarpSize % ROW_SIZE == 0) {
+    if (pos == 0) {
+      *dest = Reducer<T, R>::reduce(*dest, val);
+    }
+    __syncwarp(mask);
+    return;
+  }
+
+  // Rows spanning several warps: the first thread of the row adds the values
+  // reduced by the first lanes of the following warps of the row.
+  __shared__ T warpValues[kNumWarps];
+  __syncthreads();
+  if (lane == 0) {
+    warpValues[tid / kWarpSize] = val;
+  }
+  __syncthreads();
+  if (pos == 0) {
+    for (int w = tid / kWarpSize + 1; w * kWarpSize <= rowEnd; ++w) {
+      val = Reducer<T, R>::reduce(val, warpValues[w]);
+    }
+    *dest = Reducer<T, R>::reduce(*dest, val);
+  }
+}
+
+// Reduces the REDUCTION_SIZE == blockDim.x values of each row along x.
+template <int REDUCTION_SIZE, int BLOCKDIMY, int BLOCKDIMZ, ReductionOp R, typename T>
+inline __device__ void WarpReduceAlongX(T* dest, T val) {
+  int tid = threadIdx.x +
+      REDUCTION_SIZE * (threadIdx.y + BLOCKDIMY * threadIdx.z);
+  WarpReduceRows<REDUCTION_SIZE, BLOCKDIMY * BLOCKDIMZ, R>(
+      dest, val, tid, threadIdx.x);
+}
+
+// Reduces the SIZE_X * SIZE_Y values of each plane of the block along x and
+// y together, the reduction of two loops mapped to threadIdx.x and
+// threadIdx.y.
+template <int SIZE_X, int SIZE_Y, int BLOCKDIMZ, ReductionOp R, typename T>
+inline __device__ void WarpReduceAlongXY(T* dest, T val) {
+  int pos = threadIdx.x + SIZE_X * threadIdx.y;
+  WarpReduceRows<SIZE_X * SIZE_Y, BLOCKDIMZ, R>(
+      dest, val, pos + SIZE_X * SIZE_Y * threadIdx.z, pos);
+}
+
+} // namespace __tc
+)CUDA";
+
+constexpr auto fp16 = R"CUDA(
+#include <cuda_fp16.h>
+typedef half float16;
+
+// float16 values promoted to registers are accumulated in float.  Mixed
+// operands would otherwise be ambiguous between the float and half operators.
+#define TC_MIXED_FP16_OP(OP)                                          \
+  inline __device__ float operator OP(float a, half b) {              \
+    return a OP __half2float(b);                                      \
+  }                                                                   \
+  inline __device__ float operator OP(half a, float b) {              \
+    return __half2float(a) OP b;                                      \
+  }
+TC_MIXED_FP16_OP(+)
+TC_MIXED_FP16_OP(-)
+TC_MIXED_FP16_OP(*)
+TC_MIXED_FP16_OP(/)
+#undef TC_MIXED_FP16_OP
+)CUDA";
+
+constexpr auto wmmaMatmul = R"CUDA(
+
+#include <mma.h>
+
+namespace __tc {
+
+// C = A * B on tensor cores for row-major M x K and K x N float16 matrices A
+// and B, with M, N and K multiples of 16.  Each warp computes a 16 x 16 tile
+// of C, each block a TILE_M x TILE_N tile with one warp per threadIdx.y.
+template <int M, int N, int K, int TILE_M, int TILE_N, typename T>
+inline __device__ void WmmaMatmul(T* C, const half* A, const half* B) {
+  using namespace nvcuda;
+  constexpr int kWarpsN = TILE_N / 16;
+  int row = blockIdx.y * TILE_M + threadIdx.y / kWarpsN * 16;
+  int col = blockIdx.x * TILE_N + threadIdx.y % kWarpsN * 16;
+  if (row >= M || col >= N) {
+    return;
+  }
+
+  wmma::fragment<wmma::matrix_a, 16, 16, 16, half, wmma::row_major> a;
+  wmma::fragment<wmma::matrix_b, 16, 16, 16, half, wmma::row_major> b;
+  wmma::fragment<wmma::accumulator, 16, 16, 16, T> c;
+  wmma::fill_fragment(c, T(0.0f));
+  for (int k = 0; k < K; k += 16) {
+    wmma::load_matrix_sync(a, A + row * K + k, K);
+    wmma::load_matrix_sync(b, B + k * N + col, N);
+    wmma::mma_sync(c, a, b, c);
+  }
+  wmma::store_matrix_sync(C + row * N + col, c, N, wmma::mem_row_major);
+}
+
+} // namespace __tc
+)CUDA";
+
 const static std::string kCUBReductionName = "__tc::CubReduceAlongX";
+const static std::string kWarpReductionName = "__tc::WarpReduceAlongX";
+const static std::string kWarpReductionAlongXYName = "__tc::WarpReduceAlongXY";
+const static std::string kWmmaMatmulName = "__tc::WmmaMatmul";
 
 } // namespace cuda
 } // namespace code
@@ -152,6 +152,11 @@ MappingOptionsView& MappingOptionsView::matchLibraryCalls(bool b) {
   return *this;
 }
 
+MappingOptionsView& MappingOptionsView::inlinePointwiseTemporaries(bool b) {
+  proto.set_inline_pointwise_temporaries(b);
+  return *this;
+}
+
 MappingOptionsView& MappingOptionsView::scheduleFusionStrategy(
     FusionStrategy fs) {
   outerScheduleFusionStrategy(fs);
@@ -191,6 +196,32 @@ MappingOptionsView& MappingOptionsView::outerSchedulePositiveOrthant(bool b) {
   return *this;
 }
 
+namespace detail {
+inline void addNeverFused(
+    SchedulerOptionsProto& proto,
+    const std::string& first,
+    const std::string& second) {
+  CHECK_NE(first, second) << "the statements of " << first
+                          << " cannot be kept apart from themselves";
+  for (const auto& pair : proto.never_fused()) {
+    if ((pair.first() == first and pair.second() == second) or
+        (pair.first() == second and pair.second() == first)) {
+      return;
+    }
+  }
+  auto pair = proto.add_never_fused();
+  pair->set_first(first);
+  pair->set_second(second);
+}
+} // namespace detail
+
+MappingOptionsView& MappingOptionsView::outerScheduleNeverFuse(
+    const std::string& first,
+    const std::string& second) {
+  detail::addNeverFused(outerScheduleOptions.proto, first, second);
+  return *this;
+}
+
 MappingOptionsView& MappingOptionsView::intraTileScheduleFusionStrategy(
     FusionStrategy fs) {
   intraTileScheduleOptions.proto.set_fusion_strategy(fs);
@@ -216,6 +247,13 @@ MappingOptionsView& MappingOptionsView::intraTileSchedulePositiveOrthant(
   return *this;
 }
 
+MappingOptionsView& MappingOptionsView::intraTileScheduleNeverFuse(
+    const std::string& first,
+    const std::string& second) {
+  detail::addNeverFused(intraTileScheduleOptions.proto, first, second);
+  return *this;
+}
+
 //
 // Predefined strategies
 //
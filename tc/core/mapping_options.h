@@ -263,6 +263,7 @@ class MappingOptionsView {
   inline MappingOptionsView& fixParametersBeforeScheduling(bool b);
   inline MappingOptionsView& tileImperfectlyNested(bool b);
   inline MappingOptionsView& matchLibraryCalls(bool b);
+  inline MappingOptionsView& inlinePointwiseTemporaries(bool b);
   ///@}
 
   /// Set single fusion strategy.
@@ -278,6 +279,11 @@ class MappingOptionsView {
       const std::string& str);
   inline MappingOptionsView& outerScheduleAllowSkewing(bool b);
   inline MappingOptionsView& outerSchedulePositiveOrthant(bool b);
+  /// Never fuse the statements writing the tensors first and second
+  /// (see SchedulerOptionsProto::never_fused)
+  inline MappingOptionsView& outerScheduleNeverFuse(
+      const std::string& first,
+      const std::string& second);
   ///@}
 
   /// Set fusion strategy for intra-tile scheduling.
@@ -287,6 +293,9 @@ class MappingOptionsView {
       const std::string& str);
   inline MappingOptionsView& intraTileScheduleAllowSkewing(bool b);
   inline MappingOptionsView& intraTileSchedulePositiveOrthant(bool b);
+  inline MappingOptionsView& intraTileScheduleNeverFuse(
+      const std::string& first,
+      const std::string& second);
   ///@}
 
   /// Output operator.
@@ -332,13 +341,16 @@ class MappingOptions {
   FORWARD_FUN(fixParametersBeforeScheduling);
   FORWARD_FUN(tileImperfectlyNested);
   FORWARD_FUN(matchLibraryCalls);
+  FORWARD_FUN(inlinePointwiseTemporaries);
   FORWARD_FUN(scheduleFusionStrategy);
   FORWARD_FUN(outerScheduleFusionStrategy);
   FORWARD_FUN(outerScheduleAllowSkewing);
   FORWARD_FUN(outerSchedulePositiveOrthant);
+  FORWARD_FUN(outerScheduleNeverFuse);
   FORWARD_FUN(intraTileScheduleFusionStrategy);
   FORWARD_FUN(intraTileScheduleAllowSkewing);
   FORWARD_FUN(intraTileSchedulePositiveOrthant);
+  FORWARD_FUN(intraTileScheduleNeverFuse);
 
 #undef FORWARD_FUN
 
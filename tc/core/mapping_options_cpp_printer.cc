@@ -28,6 +28,11 @@ MappingOptionsCppPrinter& MappingOptionsCppPrinter::printSchedulerOptions(
       "tc::FusionStrategy::" + FusionStrategy_Name(proto.fusion_strategy()));
   printBooleanOption(prefix + "AllowSkewing", proto.allow_skewing());
   printBooleanOption(prefix + "PositiveOrthant", proto.positive_orthant());
+  for (const auto& pair : proto.never_fused()) {
+    printValueOption(
+        prefix + "NeverFuse",
+        "\"" + pair.first() + "\", \"" + pair.second() + "\"");
+  }
 
   return *this;
 }
@@ -59,6 +64,9 @@ MappingOptionsCppPrinter& operator<<(
       "tileImperfectlyNested", options.view.proto.tile_imperfectly_nested());
   prn.printBooleanOption(
       "matchLibraryCalls", options.view.proto.match_library_calls());
+  if (options.view.proto.inline_pointwise_temporaries()) {
+    prn.printBooleanOption("inlinePointwiseTemporaries", true);
+  }
   prn.endStmt();
   return prn;
 }
@@ -15,14 +15,18 @@
  */
 #include "tc/core/polyhedral/codegen_llvm.h"
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Config/llvm-config.h"
-#include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Verifier.h"
@@ -36,9 +40,11 @@
 #include "isl/ast.h"
 
 #include "tc/core/constants.h"
+#include "tc/core/cpu/cpu_parallel.h"
 #include "tc/core/flags.h"
 #include "tc/core/halide2isl.h"
 #include "tc/core/polyhedral/codegen.h"
+#include "tc/core/polyhedral/memory_promotion.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/scope_guard.h"
@@ -68,6 +74,33 @@ using IteratorLLVMValueMapType =
 using StmtSubscriptExprMapType =
     std::unordered_map<isl::id, std::vector<isl::ast_expr>, isl::IslIdIslHash>;
 
+// The element of the promoted array "groupId" accessed by a reference
+// instead of its tensor, see Scop::promoteGroup.
+struct PromotedAccess {
+  isl::id groupId;
+  std::vector<isl::ast_expr> subscripts;
+};
+
+// The promoted accesses of each statement, by reference identifier.
+using PromotedAccessMapType =
+    std::unordered_map<isl::id, PromotedAccess, isl::IslIdIslHash>;
+using PromotedAccessesType =
+    std::unordered_map<isl::id, PromotedAccessMapType, isl::IslIdIslHash>;
+
+// A statement copying an element of the tensor "tensorId" into its promoted
+// array "groupId", or back if it is not a read.
+struct CopyStmt {
+  isl::id groupId;
+  isl::id tensorId;
+  bool isRead;
+  std::vector<isl::ast_expr> original;
+  std::vector<isl::ast_expr> promoted;
+};
+
+// The copy statements, by the annotation of their AST nodes.
+using CopyStmtMapType =
+    std::unordered_map<isl::id, CopyStmt, isl::IslIdIslHash>;
+
 namespace {
 
 thread_local llvm::LLVMContext llvmCtx;
@@ -188,6 +221,7 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
 
   using CodeGen_X86::codegen;
   using CodeGen_X86::llvm_type_of;
+  using CodeGen_X86::sym_exists;
   using CodeGen_X86::sym_get;
   using CodeGen_X86::sym_pop;
   using CodeGen_X86::sym_push;
@@ -221,22 +255,100 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
     return std::move(module);
   }
 
-  // Convert an isl AST expression into an llvm::Value.
-  // Only expressions that consist of a pure identifier or
-  // a pure integer constant are currently supported.
+  // Convert an isl AST expression on 64-bit integers, or a comparison, into
+  // an llvm::Value.  Identifiers are iterators, or parameters whose values
+  // are fixed by parameterContext_.
   llvm::Value* getValue(isl::ast_expr expr);
 
+  // Evaluate "e" on a vector of "lanes" consecutive values of the loop
+  // iterator "iterator", starting from its current value.  "e" should be
+  // vectorizable along "iterator", see isVectorizable.
+  llvm::Value* codegenVector(
+      const Halide::Expr& e,
+      const std::string& iterator,
+      int lanes);
+
+  // Address of the element of the tensor "name" at "subscripts".  Tensors
+  // that are not packed are addressed through a pointer to their elements
+  // and their strides, the others through a pointer to an array of their
+  // inner sizes.  The address may be out of the tensor unless "inBounds" is
+  // set.
+  llvm::Value* tensorAddress(
+      const std::string& name,
+      llvm::ArrayRef<llvm::Value*> subscripts,
+      bool inBounds = true) {
+    auto baseAddr = sym_get(name);
+    auto strides = tensorStrides_->find(name);
+    if (strides == tensorStrides_->end()) {
+      return inBounds ? builder->CreateInBoundsGEP(baseAddr, subscripts)
+                      : builder->CreateGEP(baseAddr, subscripts);
+    }
+    CHECK_EQ(strides->second.size(), subscripts.size());
+    llvm::Value* offset = getLLVMConstantSignedInt64(0);
+    for (size_t i = 0; i < subscripts.size(); ++i) {
+      auto subscript = builder->CreateSExtOrTrunc(
+          subscripts[i], llvm::Type::getInt64Ty(*context));
+      offset = builder->CreateAdd(
+          offset,
+          builder->CreateMul(
+              subscript, getLLVMConstantSignedInt64(strides->second[i])));
+    }
+    return inBounds ? builder->CreateInBoundsGEP(baseAddr, offset)
+                    : builder->CreateGEP(baseAddr, offset);
+  }
+
+  // Address of the element of the promoted array accessed by the reference
+  // "node" of the current statement instead of its tensor, null if the
+  // reference is not promoted.
+  llvm::Value* promotedAddress(const Halide::Internal::IRNode* node) {
+    if (not promotedAccesses_) {
+      return nullptr;
+    }
+    auto refId = accesses_->find(node);
+    if (refId == accesses_->end()) {
+      return nullptr;
+    }
+    auto access = promotedAccesses_->find(refId->second);
+    if (access == promotedAccesses_->end()) {
+      return nullptr;
+    }
+    std::vector<llvm::Value*> subscripts;
+    for (const auto& subscript : access->second.subscripts) {
+      subscripts.push_back(getValue(subscript));
+    }
+    return tensorAddress(access->second.groupId.get_name(), subscripts);
+  }
+
+  isl::set parameterContext_;
+  // Strides of the tensors that are not packed, see Scop::tensorStrides.
+  const std::unordered_map<std::string, std::vector<int64_t>>* tensorStrides_;
+  // The references of the Halide statements, see Scop::halide.
+  const halide2isl::AccessMap* accesses_;
+  // The promoted accesses of the current statement, if any.
+  const PromotedAccessMapType* promotedAccesses_ = nullptr;
+
  protected:
   using CodeGen_X86::visit;
   void visit(const Halide::Internal::Call* call) override {
     if (call->call_type == Halide::Internal::Call::CallType::Image ||
         call->call_type == Halide::Internal::Call::CallType::Halide) {
-      auto baseAddr = sym_get(call->name);
+      if (accumulator_ and call->name == accumulatedTensor_) {
+        value = builder->CreateLoad(accumulator_);
+        return;
+      }
+      // The promoted arrays are not prefetched, they were just copied.
+      if (auto addr = promotedAddress(call)) {
+        value = builder->CreateLoad(addr);
+        return;
+      }
       std::vector<llvm::Value*> args(call->args.size());
       for (size_t i = 0; i < call->args.size(); i++) {
         args[i] = codegen(call->args[i]);
       }
-      auto addr = builder->CreateInBoundsGEP(baseAddr, args);
+      auto addr = tensorAddress(call->name, args);
+      if (not prefetchIterator_.empty()) {
+        prefetch(call);
+      }
       value = builder->CreateLoad(addr);
       return;
     } else if (
@@ -249,76 +361,478 @@ class CodeGen_TC : public Halide::Internal::CodeGen_X86 {
     }
   }
   void visit(const Halide::Internal::Variable* op) override {
+    // The variables of Let expressions are bound by CodeGen_LLVM.
+    if (iteratorMap_->count(op->name) == 0) {
+      value = sym_get(op->name);
+      return;
+    }
     value = getValue(iteratorMap_->at(op->name));
   }
 
+  // Prefetch the element read by "call" prefetchDistance_ iterations of
+  // prefetchIterator_ ahead.  The address may be out of the tensor, which
+  // is harmless for a prefetch but rules out an inbounds GEP.
+  void prefetch(const Halide::Internal::Call* call) {
+    auto current = sym_get(prefetchIterator_);
+    sym_push(
+        prefetchIterator_,
+        builder->CreateAdd(
+            current, getLLVMConstantSignedInt64(prefetchDistance_)));
+    std::vector<llvm::Value*> args(call->args.size());
+    for (size_t i = 0; i < call->args.size(); i++) {
+      args[i] = codegen(call->args[i]);
+    }
+    sym_pop(prefetchIterator_);
+    auto addr = builder->CreatePointerCast(
+        tensorAddress(call->name, args, false),
+        llvm::Type::getInt8PtrTy(*context));
+    // Read access, high temporal locality, data cache.
+    auto int32Type = llvm::Type::getInt32Ty(*context);
+    builder->CreateCall(
+        llvm::Intrinsic::getDeclaration(
+            module.get(), llvm::Intrinsic::prefetch),
+        {addr,
+         llvm::ConstantInt::get(int32Type, 0),
+         llvm::ConstantInt::get(int32Type, 3),
+         llvm::ConstantInt::get(int32Type, 1)});
+  }
+
  public:
-  void optimize_module() {
-    LOG_IF(INFO, FLAGS_llvm_dump_before_opt)
-        << "[LLVM-IR] Before optimization:\n"
-        << toString(module.get());
-
-    llvm::legacy::FunctionPassManager functionPassManager(module.get());
-    llvm::legacy::PassManager modulePassManager;
-
-    std::unique_ptr<llvm::TargetMachine> targetMachine =
-        Halide::Internal::make_target_machine(*module);
-    modulePassManager.add(llvm::createTargetTransformInfoWrapperPass(
-        targetMachine ? targetMachine->getTargetIRAnalysis()
-                      : llvm::TargetIRAnalysis()));
-    functionPassManager.add(llvm::createTargetTransformInfoWrapperPass(
-        targetMachine ? targetMachine->getTargetIRAnalysis()
-                      : llvm::TargetIRAnalysis()));
-
-    llvm::PassManagerBuilder b;
-    b.OptLevel = kOptLevel;
-#ifdef TAPIR_VERSION_MAJOR
-    b.tapirTarget = new llvm::CilkABI();
-#endif
-    b.Inliner = llvm::createFunctionInliningPass(b.OptLevel, 0, false);
-    b.LoopVectorize = true;
-    b.SLPVectorize = true;
+  // Iterator of the innermost loop whose reads are prefetched, empty if
+  // none, and the prefetch distance in values of that iterator.
+  std::string prefetchIterator_;
+  int64_t prefetchDistance_ = 0;
+  // While accumulator_ is set, the reads of the tensor accumulatedTensor_
+  // load the private accumulator of a chunk of a parallel reduction
+  // instead.
+  std::string accumulatedTensor_;
+  llvm::Value* accumulator_ = nullptr;
+};
 
-    if (targetMachine) {
-      targetMachine->adjustPassManager(b);
+llvm::Value* CodeGen_TC::getValue(isl::ast_expr expr) {
+  switch (isl_ast_expr_get_type(expr.get())) {
+    case isl_ast_expr_type::isl_ast_expr_int:
+      return getLLVMConstantSignedInt64(IslExprToSInt(expr));
+    case isl_ast_expr_type::isl_ast_expr_id: {
+      auto name = expr.get_id().get_name();
+      if (sym_exists(name)) {
+        return sym_get(name);
+      }
+      return getLLVMConstantSignedInt64(islIdToInt(expr, parameterContext_));
     }
+    case isl_ast_expr_type::isl_ast_expr_op:
+      break;
+    default:
+      LOG(FATAL) << "NYI " << expr;
+      return nullptr;
+  }
 
-    b.populateFunctionPassManager(functionPassManager);
-    b.populateModulePassManager(modulePassManager);
+  std::vector<llvm::Value*> args;
+  for (int i = 0; i < expr.get_op_n_arg(); ++i) {
+    args.push_back(getValue(expr.get_op_arg(i)));
+  }
+  auto type = isl_ast_expr_get_op_type(expr.get());
+  if (type == isl_ast_op_minus) {
+    return builder->CreateNeg(args[0]);
+  }
+  if (type == isl_ast_op_cond or type == isl_ast_op_select) {
+    return builder->CreateSelect(args[0], args[1], args[2]);
+  }
+  if (type == isl_ast_op_min or type == isl_ast_op_max) {
+    auto result = args[0];
+    for (size_t i = 1; i < args.size(); ++i) {
+      auto cmp = type == isl_ast_op_min
+          ? builder->CreateICmpSLT(args[i], result)
+          : builder->CreateICmpSGT(args[i], result);
+      result = builder->CreateSelect(cmp, args[i], result);
+    }
+    return result;
+  }
+  CHECK_EQ(args.size(), 2u) << "NYI " << expr;
+  auto lhs = args[0];
+  auto rhs = args[1];
+  switch (type) {
+    case isl_ast_op_and:
+    case isl_ast_op_and_then:
+      return builder->CreateAnd(lhs, rhs);
+    case isl_ast_op_or:
+    case isl_ast_op_or_else:
+      return builder->CreateOr(lhs, rhs);
+    case isl_ast_op_add:
+      return builder->CreateAdd(lhs, rhs);
+    case isl_ast_op_sub:
+      return builder->CreateSub(lhs, rhs);
+    case isl_ast_op_mul:
+      return builder->CreateMul(lhs, rhs);
+    // The result of div is exact and the dividend of pdiv_q is
+    // non-negative, truncating division is correct for both.
+    case isl_ast_op_div:
+    case isl_ast_op_pdiv_q:
+      return builder->CreateSDiv(lhs, rhs);
+    case isl_ast_op_fdiv_q: {
+      // Round towards negative infinity, the divisor is positive.
+      auto zero = getLLVMConstantSignedInt64(0);
+      auto one = getLLVMConstantSignedInt64(1);
+      auto shifted = builder->CreateSub(builder->CreateAdd(lhs, one), rhs);
+      return builder->CreateSDiv(
+          builder->CreateSelect(
+              builder->CreateICmpSLT(lhs, zero), shifted, lhs),
+          rhs);
+    }
+    case isl_ast_op_pdiv_r:
+    case isl_ast_op_zdiv_r:
+      return builder->CreateSRem(lhs, rhs);
+    case isl_ast_op_eq:
+      return builder->CreateICmpEQ(lhs, rhs);
+    case isl_ast_op_le:
+      return builder->CreateICmpSLE(lhs, rhs);
+    case isl_ast_op_lt:
+      return builder->CreateICmpSLT(lhs, rhs);
+    case isl_ast_op_ge:
+      return builder->CreateICmpSGE(lhs, rhs);
+    case isl_ast_op_gt:
+      return builder->CreateICmpSGT(lhs, rhs);
+    default:
+      LOG(FATAL) << "NYI " << expr;
+      return nullptr;
+  }
+}
+
+// Whether the AST expression "expr" refers to the identifier "name".
+bool astExprUses(isl::ast_expr expr, const std::string& name) {
+  switch (isl_ast_expr_get_type(expr.get())) {
+    case isl_ast_expr_type::isl_ast_expr_id:
+      return expr.get_id().get_name() == name;
+    case isl_ast_expr_type::isl_ast_expr_op:
+      for (int i = 0; i < expr.get_op_n_arg(); ++i) {
+        if (astExprUses(expr.get_op_arg(i), name)) {
+          return true;
+        }
+      }
+      return false;
+    default:
+      return false;
+  }
+}
 
-    // Run optimization passes
-    functionPassManager.doInitialization();
-    for (llvm::Module::iterator i = module->begin(); i != module->end(); i++) {
-      functionPassManager.run(*i);
+// Whether the value of the Halide expression "e" depends on the loop
+// iterator "iterator", given the values of the Halide variables in
+// "iteratorMap".
+bool usesIterator(
+    const Halide::Expr& e,
+    const IteratorMapType& iteratorMap,
+    const std::string& iterator) {
+  class Finder : public Halide::Internal::IRVisitor {
+   public:
+    Finder(const IteratorMapType& iteratorMap, const std::string& iterator)
+        : iteratorMap_(iteratorMap), iterator_(iterator) {}
+
+    using Halide::Internal::IRVisitor::visit;
+    void visit(const Halide::Internal::Variable* op) override {
+      auto it = iteratorMap_.find(op->name);
+      found = found or
+          (it != iteratorMap_.end() and astExprUses(it->second, iterator_));
     }
 
-    functionPassManager.doFinalization();
-    modulePassManager.run(*module);
+    bool found = false;
 
-    LOG_IF(INFO, FLAGS_llvm_dump_after_opt) << "[LLVM-IR] After optimization:\n"
-                                            << toString(module.get());
+   private:
+    const IteratorMapType& iteratorMap_;
+    const std::string& iterator_;
+  } finder(iteratorMap, iterator);
+  e.accept(&finder);
+  return finder.found;
+}
+
+// Whether the Halide variable "op" is the loop iterator "iterator".
+bool isIterator(
+    const Halide::Internal::Variable* op,
+    const IteratorMapType& iteratorMap,
+    const std::string& iterator) {
+  auto it = iteratorMap.find(op->name);
+  return it != iteratorMap.end() and
+      isl_ast_expr_get_type(it->second.get()) ==
+      isl_ast_expr_type::isl_ast_expr_id and
+      it->second.get_id().get_name() == iterator;
+}
+
+// Whether the subscript "e" is the loop iterator "iterator" plus or minus
+// a value that does not depend on it.
+bool isUnitStride(
+    const Halide::Expr& e,
+    const IteratorMapType& iteratorMap,
+    const std::string& iterator) {
+  if (auto op = e.as<Halide::Internal::Variable>()) {
+    return isIterator(op, iteratorMap, iterator);
   }
-};
+  if (auto op = e.as<Halide::Internal::Add>()) {
+    return (isUnitStride(op->a, iteratorMap, iterator) and
+            not usesIterator(op->b, iteratorMap, iterator)) or
+        (isUnitStride(op->b, iteratorMap, iterator) and
+         not usesIterator(op->a, iteratorMap, iterator));
+  }
+  if (auto op = e.as<Halide::Internal::Sub>()) {
+    return isUnitStride(op->a, iteratorMap, iterator) and
+        not usesIterator(op->b, iteratorMap, iterator);
+  }
+  return false;
+}
 
-llvm::Value* CodeGen_TC::getValue(isl::ast_expr expr) {
-  switch (isl_ast_expr_get_type(expr.get())) {
-    case isl_ast_expr_type::isl_ast_expr_id:
-      return sym_get(expr.get_id().get_name());
-    case isl_ast_expr_type::isl_ast_expr_int: {
-      auto val = isl::manage(isl_ast_expr_get_val(expr.get()));
-      return getLLVMConstantSignedInt64(toSInt(val));
+// Whether the Halide expression "e" of a statement can be evaluated on
+// vectors of consecutive values of the loop iterator "iterator", see
+// CodeGen_TC::codegenVector.  The parts of "e" that depend on "iterator"
+// may only consist of arithmetic, casts and tensor reads that are
+// contiguous along "iterator", i.e., "iterator" only appears in the last
+// subscript with a unit coefficient.  The other parts are evaluated once
+// and broadcast.
+bool isVectorizable(
+    const Halide::Expr& e,
+    const IteratorMapType& iteratorMap,
+    const std::string& iterator) {
+  if (not usesIterator(e, iteratorMap, iterator)) {
+    return true;
+  }
+  if (e.type().is_bool() or e.type().is_handle()) {
+    return false;
+  }
+  auto vectorizable = [&iteratorMap, &iterator](const Halide::Expr& e) {
+    return isVectorizable(e, iteratorMap, iterator);
+  };
+  if (auto op = e.as<Halide::Internal::Variable>()) {
+    return isIterator(op, iteratorMap, iterator);
+  }
+  if (auto op = e.as<Halide::Internal::Add>()) {
+    return vectorizable(op->a) and vectorizable(op->b);
+  }
+  if (auto op = e.as<Halide::Internal::Sub>()) {
+    return vectorizable(op->a) and vectorizable(op->b);
+  }
+  if (auto op = e.as<Halide::Internal::Mul>()) {
+    return vectorizable(op->a) and vectorizable(op->b);
+  }
+  if (auto op = e.as<Halide::Internal::Div>()) {
+    // Halide rounds integer divisions towards negative infinity.
+    return op->type.is_float() and vectorizable(op->a) and
+        vectorizable(op->b);
+  }
+  if (auto op = e.as<Halide::Internal::Cast>()) {
+    return vectorizable(op->value);
+  }
+  if (auto op = e.as<Halide::Internal::Call>()) {
+    if (op->is_intrinsic(tc2halide::kReductionInit) or
+        op->is_intrinsic(tc2halide::kReductionUpdate)) {
+      return vectorizable(op->args[0]);
     }
-    default:
-      LOG(FATAL) << "NYI";
-      return nullptr;
+    if (op->call_type != Halide::Internal::Call::CallType::Image and
+        op->call_type != Halide::Internal::Call::CallType::Halide) {
+      return false;
+    }
+    for (size_t i = 0; i + 1 < op->args.size(); ++i) {
+      if (usesIterator(op->args[i], iteratorMap, iterator)) {
+        return false;
+      }
+    }
+    return isUnitStride(op->args.back(), iteratorMap, iterator);
+  }
+  return false;
+}
+
+llvm::Value* CodeGen_TC::codegenVector(
+    const Halide::Expr& e,
+    const std::string& iterator,
+    int lanes) {
+  if (not usesIterator(e, *iteratorMap_, iterator)) {
+    return builder->CreateVectorSplat(lanes, codegen(e));
+  }
+  auto vectorType = llvm::VectorType::get(llvm_type_of(e.type()), lanes);
+  auto vector = [this, &iterator, lanes](const Halide::Expr& e) {
+    return codegenVector(e, iterator, lanes);
+  };
+  if (auto op = e.as<Halide::Internal::Variable>()) {
+    std::vector<llvm::Constant*> offsets;
+    for (int i = 0; i < lanes; ++i) {
+      offsets.push_back(llvm::ConstantInt::get(builder->getInt64Ty(), i));
+    }
+    auto ramp = builder->CreateAdd(
+        builder->CreateVectorSplat(
+            lanes, getValue(iteratorMap_->at(op->name))),
+        llvm::ConstantVector::get(offsets));
+    return builder->CreateIntCast(ramp, vectorType, true);
+  }
+  if (auto op = e.as<Halide::Internal::Add>()) {
+    return op->type.is_float()
+        ? builder->CreateFAdd(vector(op->a), vector(op->b))
+        : builder->CreateAdd(vector(op->a), vector(op->b));
+  }
+  if (auto op = e.as<Halide::Internal::Sub>()) {
+    return op->type.is_float()
+        ? builder->CreateFSub(vector(op->a), vector(op->b))
+        : builder->CreateSub(vector(op->a), vector(op->b));
+  }
+  if (auto op = e.as<Halide::Internal::Mul>()) {
+    return op->type.is_float()
+        ? builder->CreateFMul(vector(op->a), vector(op->b))
+        : builder->CreateMul(vector(op->a), vector(op->b));
+  }
+  if (auto op = e.as<Halide::Internal::Div>()) {
+    return builder->CreateFDiv(vector(op->a), vector(op->b));
   }
+  if (auto op = e.as<Halide::Internal::Cast>()) {
+    auto value = vector(op->value);
+    auto opcode = llvm::CastInst::getCastOpcode(
+        value, not op->value.type().is_uint(), vectorType, op->type.is_int());
+    return builder->CreateCast(opcode, value, vectorType);
+  }
+  auto call = e.as<Halide::Internal::Call>();
+  CHECK(call) << "Cannot vectorize " << e;
+  if (call->is_intrinsic(tc2halide::kReductionInit) or
+      call->is_intrinsic(tc2halide::kReductionUpdate)) {
+    return vector(call->args[0]);
+  }
+  // A contiguous read, the subscripts are those of the first lane.  The
+  // promotion shifts the subscripts, the promoted elements are contiguous
+  // as well.
+  auto addr = promotedAddress(call);
+  if (not addr) {
+    std::vector<llvm::Value*> args(call->args.size());
+    for (size_t i = 0; i < call->args.size(); i++) {
+      args[i] = codegen(call->args[i]);
+    }
+    addr = tensorAddress(call->name, args);
+    if (not prefetchIterator_.empty()) {
+      prefetch(call);
+    }
+  }
+  auto elementType = addr->getType()->getPointerElementType();
+  return builder->CreateAlignedLoad(
+      builder->CreatePointerCast(
+          addr, llvm::VectorType::get(elementType, lanes)->getPointerTo()),
+      module->getDataLayout().getABITypeAlignment(elementType));
+}
+
+// Whether the AST contains a loop.
+bool containsLoop(isl::ast_node node) {
+  if (node.as<isl::ast_node_for>()) {
+    return true;
+  } else if (auto blockNode = node.as<isl::ast_node_block>()) {
+    for (auto child : blockNode.get_children()) {
+      if (containsLoop(child)) {
+        return true;
+      }
+    }
+  } else if (auto ifNode = node.as<isl::ast_node_if>()) {
+    return containsLoop(ifNode.get_then()) or
+        (ifNode.has_else() and containsLoop(ifNode.get_else()));
+  }
+  return false;
+}
+
+// Append the statements of the AST "node" to "stmts" and the iterators of
+// its loops to "iterators".
+void collectStmtsAndIterators(
+    isl::ast_node node,
+    std::vector<isl::ast_node_user>& stmts,
+    std::vector<std::string>& iterators) {
+  if (auto forNode = node.as<isl::ast_node_for>()) {
+    iterators.push_back(forNode.get_iterator().get_id().get_name());
+    collectStmtsAndIterators(forNode.get_body(), stmts, iterators);
+  } else if (auto userNode = node.as<isl::ast_node_user>()) {
+    stmts.push_back(userNode);
+  } else if (auto blockNode = node.as<isl::ast_node_block>()) {
+    for (auto child : blockNode.get_children()) {
+      collectStmtsAndIterators(child, stmts, iterators);
+    }
+  } else if (auto ifNode = node.as<isl::ast_node_if>()) {
+    collectStmtsAndIterators(ifNode.get_then(), stmts, iterators);
+    if (ifNode.has_else()) {
+      collectStmtsAndIterators(ifNode.get_else(), stmts, iterators);
+    }
+  }
+}
+
+// Whether the Halide expression "e" reads the tensor "name".
+bool readsTensor(const Halide::Expr& e, const std::string& name) {
+  class Finder : public Halide::Internal::IRVisitor {
+   public:
+    Finder(const std::string& name) : name_(name) {}
+
+    using Halide::Internal::IRVisitor::visit;
+    void visit(const Halide::Internal::Call* op) override {
+      found = found or op->name == name_;
+      Halide::Internal::IRVisitor::visit(op);
+    }
+
+    bool found = false;
+
+   private:
+    const std::string& name_;
+  } finder(name);
+  e.accept(&finder);
+  return finder.found;
+}
+
+// The reductions that run in parallel, named after __tc::ReductionOp of the
+// CUDA library.
+enum class ReductionOp { Sum, Prod, Min, Max };
+
+// Whether "value" is the update of a reduction of the tensor "tensor", see
+// tc2halide::kReductionUpdate, i.e., op(tensor(...), rhs) where op is a
+// ReductionOp and rhs does not read "tensor".  If so, set "op".
+bool isReductionUpdateOf(
+    const Halide::Expr& value,
+    const std::string& tensor,
+    ReductionOp& op) {
+  auto call = value.as<Halide::Internal::Call>();
+  if (not call or not call->is_intrinsic(tc2halide::kReductionUpdate)) {
+    return false;
+  }
+  const auto& update = call->args[0];
+  Halide::Expr accumulator, rhs;
+  if (auto add = update.as<Halide::Internal::Add>()) {
+    op = ReductionOp::Sum;
+    accumulator = add->a;
+    rhs = add->b;
+  } else if (auto mul = update.as<Halide::Internal::Mul>()) {
+    op = ReductionOp::Prod;
+    accumulator = mul->a;
+    rhs = mul->b;
+  } else if (auto min = update.as<Halide::Internal::Min>()) {
+    op = ReductionOp::Min;
+    accumulator = min->a;
+    rhs = min->b;
+  } else if (auto max = update.as<Halide::Internal::Max>()) {
+    op = ReductionOp::Max;
+    accumulator = max->a;
+    rhs = max->b;
+  } else {
+    return false;
+  }
+  auto read = accumulator.as<Halide::Internal::Call>();
+  return read and read->name == tensor and not readsTensor(rhs, tensor);
+}
+
+// The identity of the reduction "op" on values of type "type", which
+// tc2halide also initializes the reduced tensors with.
+Halide::Expr reductionIdentity(ReductionOp op, Halide::Type type) {
+  switch (op) {
+    case ReductionOp::Sum:
+      return Halide::Internal::make_zero(type);
+    case ReductionOp::Prod:
+      return Halide::Internal::make_one(type);
+    case ReductionOp::Min:
+      return type.max();
+    case ReductionOp::Max:
+      return type.min();
+  }
+  LOG(FATAL) << "unknown reduction";
+  return Halide::Expr();
 }
 
 class LLVMCodegen {
   void collectTensor(const Halide::OutputImageParam& t) {
     auto sizes =
         getTensorSizesWithoutLeadingDim(t, scop_.globalParameterContext);
-    if (not sizes.empty()) {
+    if (not sizes.empty() and scop_.tensorStrides.count(t.name()) == 0) {
       args_.emplace_back(
           makePtrToArrayType(halide_cg.llvm_type_of(t.type()), sizes));
     } else {
@@ -327,6 +841,14 @@ class LLVMCodegen {
     argNames_.emplace_back(t.name());
   }
 
+  // Compile "function" for the CPU and the features of the target machine,
+  // rather than for the generic CPU of its triple.
+  void setTargetAttributes(llvm::Function* function) {
+    function->addFnAttr("target-cpu", targetMachine_.getTargetCPU());
+    function->addFnAttr(
+        "target-features", targetMachine_.getTargetFeatureString());
+  }
+
   void collectInputs(const std::vector<Halide::ImageParam>& inputs) {
     for (const auto& t : inputs) {
       collectTensor(t);
@@ -343,15 +865,26 @@ class LLVMCodegen {
   LLVMCodegen(
       const Scop& scop,
       const IteratorMapsType& iteratorMaps,
-      const StmtSubscriptExprMapType& stmtSubscripts)
+      const StmtSubscriptExprMapType& stmtSubscripts,
+      const PromotedAccessesType& promotedAccesses,
+      const CopyStmtMapType& copyStmts,
+      const CpuMappingOptions& options,
+      llvm::TargetMachine& targetMachine)
       : scop_(scop),
         iteratorMaps_(iteratorMaps),
         stmtSubscripts_(stmtSubscripts),
+        promotedAccesses_(promotedAccesses),
+        copyStmts_(copyStmts),
+        options_(options.proto()),
+        targetMachine_(targetMachine),
         halide_cg(Halide::Target(
             Halide::Target::OSUnknown,
             Halide::Target::X86,
             64)) {
     halide_cg.set_context(llvmCtx);
+    halide_cg.parameterContext_ = scop.globalParameterContext;
+    halide_cg.tensorStrides_ = &scop.tensorStrides;
+    halide_cg.accesses_ = &scop.halide.accesses;
 
     halide_cg.init_module();
   }
@@ -376,6 +909,9 @@ class LLVMCodegen {
         fname,
         halide_cg.get_module());
     halide_cg.set_function(function);
+    setTargetAttributes(function);
+    vectorBits_ = targetMachine_.getTargetTransformInfo(*function)
+                      .getRegisterBitWidth(true);
 
     size_t idx = 0;
     for (auto& arg : function->args()) {
@@ -383,14 +919,25 @@ class LLVMCodegen {
       arg.setName(argNames_.at(idx++));
     }
 
+    // An output and the input it aliases may point to the same elements,
+    // the input is then written through the output.
+    std::unordered_set<std::string> aliased;
+    for (const auto& alias : scop_.halide.aliases) {
+      aliased.insert(alias.first);
+      aliased.insert(alias.second);
+    }
     for (auto it = function->arg_begin(), end = function->arg_end(); it != end;
          ++it) {
-      it->addAttr(llvm::Attribute::NoAlias);
+      if (aliased.count(it->getName().str()) == 0) {
+        it->addAttr(llvm::Attribute::NoAlias);
+      }
       it->addAttr(llvm::Attribute::NonNull);
     }
     for (auto it = function->arg_begin(), end = it + inputs.size(); it != end;
          ++it) {
-      it->addAttr(llvm::Attribute::ReadOnly);
+      if (aliased.count(it->getName().str()) == 0) {
+        it->addAttr(llvm::Attribute::ReadOnly);
+      }
     }
 
     auto entryBB_ = llvm::BasicBlock::Create(llvmCtx, "entry", function);
@@ -415,12 +962,10 @@ class LLVMCodegen {
       return emitStmt(userNode);
     } else if (auto blockNode = node.as<isl::ast_node_block>()) {
       return emitBlock(blockNode);
+    } else if (auto ifNode = node.as<isl::ast_node_if>()) {
+      return emitIf(ifNode);
     } else {
-      if (node.as<isl::ast_node_if>()) {
-        LOG(FATAL) << "NYI if node: " << node << std::endl;
-      } else {
-        LOG(FATAL) << "NYI " << node << std::endl;
-      }
+      LOG(FATAL) << "NYI " << node << std::endl;
       return static_cast<llvm::BasicBlock*>(nullptr); // avoid warning
     }
   }
@@ -444,6 +989,50 @@ class LLVMCodegen {
     return exit;
   }
 
+  llvm::BasicBlock* emitIf(isl::ast_node_if node) {
+    auto& builder = halide_cg.get_builder();
+    auto* function = builder.GetInsertBlock()->getParent();
+    auto* thenBB = llvm::BasicBlock::Create(llvmCtx, "if_then", function);
+    auto* elseBB = llvm::BasicBlock::Create(llvmCtx, "if_else", function);
+    auto* exitBB = llvm::BasicBlock::Create(llvmCtx, "if_exit", function);
+    builder.CreateCondBr(halide_cg.getValue(node.get_cond()), thenBB, elseBB);
+
+    builder.SetInsertPoint(thenBB);
+    builder.SetInsertPoint(emitAst(node.get_then()));
+    builder.CreateBr(exitBB);
+    builder.SetInsertPoint(elseBB);
+    if (node.has_else()) {
+      builder.SetInsertPoint(emitAst(node.get_else()));
+    }
+    builder.CreateBr(exitBB);
+    builder.SetInsertPoint(exitBB);
+    return exitBB;
+  }
+
+  // Loop metadata setting the vectorization factor, width 1 disables
+  // vectorization and width 0 lets LLVM pick the factor.
+  llvm::MDNode* makeVectorizeMetadata(uint32_t width) {
+    auto int32Type = llvm::Type::getInt32Ty(llvmCtx);
+    llvm::SmallVector<llvm::Metadata*, 3> ops;
+    // Placeholder for the self-reference identifying the loop.
+    ops.push_back(nullptr);
+    if (width > 0) {
+      ops.push_back(llvm::MDNode::get(
+          llvmCtx,
+          {llvm::MDString::get(llvmCtx, "llvm.loop.vectorize.width"),
+           llvm::ConstantAsMetadata::get(
+               llvm::ConstantInt::get(int32Type, width))}));
+    }
+    ops.push_back(llvm::MDNode::get(
+        llvmCtx,
+        {llvm::MDString::get(llvmCtx, "llvm.loop.vectorize.enable"),
+         llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(
+             llvm::Type::getInt1Ty(llvmCtx), width > 1))}));
+    auto loopID = llvm::MDNode::getDistinct(llvmCtx, ops);
+    loopID->replaceOperandWith(0, loopID);
+    return loopID;
+  }
+
   llvm::Type* makePtrToArrayType(
       llvm::Type* baseTy,
       const std::vector<int64_t>& sizes) {
@@ -457,8 +1046,29 @@ class LLVMCodegen {
   }
 
   llvm::BasicBlock* emitFor(isl::ast_node_for node) {
+#ifndef TAPIR_VERSION_MAJOR
+    if (not inParallelLoop_ and
+        enclosingIterators_.size() >= options_.parallel_depth()) {
+      if (node.is_coincident()) {
+        return emitParallelFor(node);
+      }
+      isl::id stmtId;
+      ReductionOp op;
+      if (isParallelReduction(node, stmtId, op)) {
+        return emitParallelReduction(node, stmtId, op);
+      }
+    }
+#endif
+    auto innermost = not containsLoop(node.get_body());
+    if (innermost) {
+      auto lanes = vectorLanes(node);
+      if (lanes > 1) {
+        return emitVectorFor(node, lanes);
+      }
+    }
     IteratorLLVMValueMapType iterPHIs;
 
+    auto* initVal = halide_cg.getValue(node.get_init());
     auto* incoming = halide_cg.get_builder().GetInsertBlock();
     auto* function = incoming->getParent();
     auto* headerBB = llvm::BasicBlock::Create(llvmCtx, "loop_header", function);
@@ -467,7 +1077,12 @@ class LLVMCodegen {
         llvm::BasicBlock::Create(llvmCtx, "loop_latch", function);
     auto* loopExitBB = llvm::BasicBlock::Create(llvmCtx, "loop_exit", function);
 
+#ifdef TAPIR_VERSION_MAJOR
     bool parallel = node.is_coincident();
+#else
+    // The outermost parallel loops were outlined, the others run sequentially.
+    bool parallel = false;
+#endif
     llvm::Value* SyncRegion = nullptr;
 
 #ifdef TAPIR_VERSION_MAJOR
@@ -485,44 +1100,28 @@ class LLVMCodegen {
     llvm::PHINode* phi = nullptr;
     auto iterator = node.get_iterator().get_id();
 
-    // Loop Header
+    // Loop Header, the bounds may depend on the outer iterators, e.g., in
+    // tiled loops.
     {
-      auto initVal = IslExprToSInt(node.get_init());
       halide_cg.get_builder().SetInsertPoint(headerBB);
       phi = halide_cg.get_builder().CreatePHI(
           llvm::Type::getInt64Ty(llvmCtx), 2, iterator.get_name());
       halide_cg.sym_push(iterator.get_name(), phi);
-      phi->addIncoming(getLLVMConstantSignedInt64(initVal), incoming);
-
-      auto cond_expr = node.get_cond();
-      CHECK(
-          cond_expr.get_op_type() == isl::ast_op_type::lt or
-          cond_expr.get_op_type() == isl::ast_op_type::le)
-          << "I only know how to codegen lt and le";
-      auto condLHS = cond_expr.get_op_arg(0);
-      CHECK(
-          isl_ast_expr_get_type(condLHS.get()) ==
-          isl_ast_expr_type::isl_ast_expr_id);
-      CHECK_EQ(condLHS.get_id(), iterator);
-
-      IslAstExprInterpeter i(scop_.globalParameterContext);
-      auto condRHSVal = i.interpret(cond_expr.get_op_arg(1));
-
-      auto cond = [&]() {
-        auto constant = getLLVMConstantSignedInt64(condRHSVal);
-        switch (cond_expr.get_op_type()) {
-          case isl::ast_op_type::lt:
-            return halide_cg.get_builder().CreateICmpSLT(phi, constant);
-          case isl::ast_op_type::le:
-            return halide_cg.get_builder().CreateICmpSLE(phi, constant);
-          default:
-            CHECK(false) << "NYI";
-            return static_cast<llvm::Value*>(nullptr); // avoid warning
-        }
-      }();
+      enclosingIterators_.push_back(iterator.get_name());
+      phi->addIncoming(initVal, incoming);
+
+      auto cond = halide_cg.getValue(node.get_cond());
       halide_cg.get_builder().CreateCondBr(cond, loopBodyBB, loopExitBB);
     }
 
+    // Prefetch the reads of innermost loops.
+    auto prefetchIterator = halide_cg.prefetchIterator_;
+    if (innermost and options_.prefetch_distance() > 0) {
+      halide_cg.prefetchIterator_ = iterator.get_name();
+      halide_cg.prefetchDistance_ =
+          options_.prefetch_distance() * IslExprToSInt(node.get_inc());
+    }
+
     // Create Body
     {
       halide_cg.get_builder().SetInsertPoint(loopBodyBB);
@@ -538,6 +1137,7 @@ class LLVMCodegen {
 #endif
       auto* currentBB = emitAst(node.get_body());
       halide_cg.get_builder().SetInsertPoint(currentBB);
+      halide_cg.prefetchIterator_ = prefetchIterator;
 
       if (parallel) {
 #ifdef TAPIR_VERSION_MAJOR
@@ -556,11 +1156,20 @@ class LLVMCodegen {
           halide_cg.get_builder().CreateAdd(
               phi, getLLVMConstantSignedInt64(incVal)),
           loopLatchBB);
-      halide_cg.get_builder().CreateBr(headerBB);
+      auto* backEdge = halide_cg.get_builder().CreateBr(headerBB);
+      // Leave the vectorization of the parallel innermost loops that were
+      // not emitted with explicit vectors to LLVM.
+      if (innermost and
+          (options_.vectorize_width() > 0 or node.is_coincident())) {
+        backEdge->setMetadata(
+            llvm::LLVMContext::MD_loop,
+            makeVectorizeMetadata(options_.vectorize_width()));
+      }
     }
 
     halide_cg.get_builder().SetInsertPoint(loopExitBB);
     halide_cg.sym_pop(iterator.get_name());
+    enclosingIterators_.pop_back();
 #ifdef TAPIR_VERSION_MAJOR
     if (parallel) {
       auto* syncBB = llvm::BasicBlock::Create(llvmCtx, "synced", function);
@@ -571,9 +1180,569 @@ class LLVMCodegen {
     return halide_cg.get_builder().GetInsertBlock();
   }
 
+  // Number of lanes of the explicit vector code of the innermost loop
+  // "node", or 0 if it is emitted as scalar code.  The loop should be
+  // parallel, with a unit step, and its body should be a sequence of
+  // statements that write contiguous elements along the loop and whose
+  // values are vectorizable, see isVectorizable, and the innermost stride of
+  // all tensors should be 1.  Unless set by the vectorize width option, the
+  // vectors fill the widest vector registers of the target machine, e.g. 512
+  // bits with AVX-512.
+  int vectorLanes(isl::ast_node_for node) {
+    if (options_.vectorize_width() == 1 or not node.is_coincident() or
+        IslExprToSInt(node.get_inc()) != 1) {
+      return 0;
+    }
+    // Consecutive values of the last subscript are only contiguous in
+    // tensors whose innermost stride is 1.
+    for (const auto& kvp : scop_.tensorStrides) {
+      if (kvp.second.back() != 1) {
+        return 0;
+      }
+    }
+    auto iterator = node.get_iterator().get_id().get_name();
+    auto cond = node.get_cond();
+    if ((cond.get_op_type() != isl::ast_op_type::lt and
+         cond.get_op_type() != isl::ast_op_type::le) or
+        isl_ast_expr_get_type(cond.get_op_arg(0).get()) !=
+            isl_ast_expr_type::isl_ast_expr_id or
+        cond.get_op_arg(0).get_id().get_name() != iterator or
+        astExprUses(cond.get_op_arg(1), iterator)) {
+      return 0;
+    }
+
+    std::vector<isl::ast_node> stmts;
+    if (auto blockNode = node.get_body().as<isl::ast_node_block>()) {
+      for (auto child : blockNode.get_children()) {
+        stmts.push_back(child);
+      }
+    } else {
+      stmts.push_back(node.get_body());
+    }
+    int maxBits = 0;
+    for (auto stmt : stmts) {
+      auto userNode = stmt.as<isl::ast_node_user>();
+      if (not userNode) {
+        return 0;
+      }
+      auto id = userNode.get_expr().get_op_arg(0).get_id();
+      if (scop_.halide.statements.count(id) == 0) {
+        return 0;
+      }
+      auto op = scop_.halide.statements.at(id).as<Halide::Internal::Provide>();
+      if (not op or op->values.size() != 1) {
+        return 0;
+      }
+      auto type = op->values[0].type();
+      if (type.is_bool() or type.is_handle()) {
+        return 0;
+      }
+      const auto& subscripts = stmtSubscripts_.at(id);
+      if (subscripts.empty() or
+          isl_ast_expr_get_type(subscripts.back().get()) !=
+              isl_ast_expr_type::isl_ast_expr_id or
+          subscripts.back().get_id().get_name() != iterator) {
+        return 0;
+      }
+      for (size_t i = 0; i + 1 < subscripts.size(); ++i) {
+        if (astExprUses(subscripts[i], iterator)) {
+          return 0;
+        }
+      }
+      if (not isVectorizable(op->values[0], iteratorMaps_.at(id), iterator)) {
+        return 0;
+      }
+      maxBits = std::max(maxBits, type.bits());
+    }
+    int lanes = options_.vectorize_width() > 1
+        ? static_cast<int>(options_.vectorize_width())
+        : vectorBits_ / maxBits;
+    return lanes > 1 ? lanes : 0;
+  }
+
+  // Emit a loop "for (name = begin; name < end; name += step)" whose body
+  // is emitted by "body", with "loopID" as loop metadata.  Return the value
+  // of the iterator after the loop.
+  llvm::Value* emitCountedLoop(
+      const std::string& name,
+      llvm::Value* begin,
+      llvm::Value* end,
+      int64_t step,
+      const std::function<void()>& body,
+      llvm::MDNode* loopID) {
+    auto& builder = halide_cg.get_builder();
+    auto* incoming = builder.GetInsertBlock();
+    auto* function = incoming->getParent();
+    auto* headerBB = llvm::BasicBlock::Create(llvmCtx, "loop_header", function);
+    auto* loopBodyBB = llvm::BasicBlock::Create(llvmCtx, "loop_body", function);
+    auto* loopExitBB = llvm::BasicBlock::Create(llvmCtx, "loop_exit", function);
+    builder.CreateBr(headerBB);
+
+    builder.SetInsertPoint(headerBB);
+    auto* phi = builder.CreatePHI(llvm::Type::getInt64Ty(llvmCtx), 2, name);
+    phi->addIncoming(begin, incoming);
+    builder.CreateCondBr(
+        builder.CreateICmpSLT(phi, end), loopBodyBB, loopExitBB);
+
+    builder.SetInsertPoint(loopBodyBB);
+    halide_cg.sym_push(name, phi);
+    body();
+    halide_cg.sym_pop(name);
+    phi->addIncoming(
+        builder.CreateAdd(phi, getLLVMConstantSignedInt64(step)),
+        builder.GetInsertBlock());
+    builder.CreateBr(headerBB)->setMetadata(
+        llvm::LLVMContext::MD_loop, loopID);
+
+    builder.SetInsertPoint(loopExitBB);
+    return phi;
+  }
+
+  // Emit the innermost loop "node" as a loop over vectors of "lanes"
+  // consecutive iterations followed by a scalar remainder loop.  Neither
+  // loop is vectorized again by LLVM.
+  llvm::BasicBlock* emitVectorFor(isl::ast_node_for node, int lanes) {
+    auto& builder = halide_cg.get_builder();
+    auto iterator = node.get_iterator().get_id().get_name();
+    auto* begin = halide_cg.getValue(node.get_init());
+    auto condExpr = node.get_cond();
+    auto* end = halide_cg.getValue(condExpr.get_op_arg(1));
+    if (condExpr.get_op_type() == isl::ast_op_type::le) {
+      end = builder.CreateAdd(end, getLLVMConstantSignedInt64(1));
+    }
+
+    auto prefetchIterator = halide_cg.prefetchIterator_;
+    if (options_.prefetch_distance() > 0) {
+      halide_cg.prefetchIterator_ = iterator;
+      halide_cg.prefetchDistance_ = options_.prefetch_distance();
+    }
+    enclosingIterators_.push_back(iterator);
+    auto emitBody = [this, node]() {
+      halide_cg.get_builder().SetInsertPoint(emitAst(node.get_body()));
+    };
+    vectorIterator_ = iterator;
+    vectorLanes_ = lanes;
+    auto* remainderBegin = emitCountedLoop(
+        iterator,
+        begin,
+        builder.CreateSub(end, getLLVMConstantSignedInt64(lanes - 1)),
+        lanes,
+        emitBody,
+        makeVectorizeMetadata(1));
+    vectorLanes_ = 1;
+    emitCountedLoop(
+        iterator,
+        remainderBegin,
+        end,
+        1,
+        emitBody,
+        makeVectorizeMetadata(1));
+    enclosingIterators_.pop_back();
+    halide_cg.prefetchIterator_ = prefetchIterator;
+    return builder.GetInsertBlock();
+  }
+
+  // The values of the iterator of the loop "node" at its first iteration
+  // and the bound it stays below.
+  std::pair<llvm::Value*, llvm::Value*> emitLoopBounds(
+      isl::ast_node_for node) {
+    auto& builder = halide_cg.get_builder();
+    auto* begin = halide_cg.getValue(node.get_init());
+    auto condExpr = node.get_cond();
+    auto condType = condExpr.get_op_type();
+    CHECK(
+        condType == isl::ast_op_type::lt or condType == isl::ast_op_type::le)
+        << "I only know how to codegen lt and le";
+    CHECK_EQ(condExpr.get_op_arg(0).get_id(), node.get_iterator().get_id());
+    auto* end = halide_cg.getValue(condExpr.get_op_arg(1));
+    if (condType == isl::ast_op_type::le) {
+      end = builder.CreateAdd(end, getLLVMConstantSignedInt64(1));
+    }
+    return std::make_pair(begin, end);
+  }
+
+  // Outline the code emitted by "emitBody" into a task, a function of an
+  // iterator and of a closure holding the values the code uses, i.e., the
+  // tensor arguments, the iterators of the enclosing loops and "extra".
+  // The thread pool of the runtime runs the task for the values begin,
+  // begin + step, ... of the iterator below end, see cpu_parallel.h.
+  // "emitBody" is called in the outlined function on the iterator and on
+  // the values of "extra" there, the captured values shadow the ones of
+  // the kernel.
+  void emitParallelTasks(
+      const std::string& iterator,
+      llvm::Value* begin,
+      llvm::Value* end,
+      int64_t step,
+      const std::vector<llvm::Value*>& extra,
+      const std::function<void(llvm::Value*, llvm::ArrayRef<llvm::Value*>)>&
+          emitBody) {
+    auto& builder = halide_cg.get_builder();
+    auto* function = builder.GetInsertBlock()->getParent();
+
+    std::vector<std::string> captured(argNames_);
+    captured.insert(
+        captured.end(), enclosingIterators_.begin(), enclosingIterators_.end());
+    captured.insert(captured.end(), buffers_.begin(), buffers_.end());
+    std::vector<llvm::Value*> capturedValues;
+    for (const auto& name : captured) {
+      capturedValues.push_back(halide_cg.sym_get(name));
+    }
+    capturedValues.insert(capturedValues.end(), extra.begin(), extra.end());
+    std::vector<llvm::Type*> capturedTypes;
+    for (auto* value : capturedValues) {
+      capturedTypes.push_back(value->getType());
+    }
+    auto* closureType = llvm::StructType::create(
+        llvmCtx, capturedTypes, function->getName().str() + "_closure");
+    llvm::IRBuilder<> entryBuilder(
+        &function->getEntryBlock(), function->getEntryBlock().begin());
+    auto* closure = entryBuilder.CreateAlloca(closureType, nullptr, "closure");
+    for (size_t i = 0; i < capturedValues.size(); ++i) {
+      builder.CreateStore(
+          capturedValues[i], builder.CreateStructGEP(closureType, closure, i));
+    }
+
+    // The body takes the captured values as arguments so that the tensors
+    // keep the attributes of the kernel arguments, noalias in particular,
+    // which survive the inlining of the body into the task.
+    auto* int64Type = llvm::Type::getInt64Ty(llvmCtx);
+    auto* voidPtrType = llvm::Type::getInt8PtrTy(llvmCtx);
+    std::vector<llvm::Type*> bodyArgTypes{int64Type};
+    bodyArgTypes.insert(
+        bodyArgTypes.end(), capturedTypes.begin(), capturedTypes.end());
+    auto* body = llvm::Function::Create(
+        llvm::FunctionType::get(
+            llvm::Type::getVoidTy(llvmCtx), bodyArgTypes, false),
+        llvm::Function::InternalLinkage,
+        function->getName() + "_parallel_body",
+        halide_cg.get_module());
+    setTargetAttributes(body);
+    auto* iteratorArg = &*body->arg_begin();
+    iteratorArg->setName(iterator);
+    for (size_t i = 0; i < captured.size(); ++i) {
+      auto* arg = &*(body->arg_begin() + 1 + i);
+      arg->setName(captured[i]);
+      if (i < argNames_.size()) {
+        auto* kernelArg = &*(function->arg_begin() + i);
+        if (kernelArg->hasNoAliasAttr()) {
+          arg->addAttr(llvm::Attribute::NoAlias);
+        }
+        arg->addAttr(llvm::Attribute::NonNull);
+        if (kernelArg->onlyReadsMemory()) {
+          arg->addAttr(llvm::Attribute::ReadOnly);
+        }
+      }
+    }
+
+    // The task run by the thread pool unpacks the closure and calls the
+    // body.
+    auto* taskType = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(llvmCtx), {int64Type, voidPtrType}, false);
+    auto* task = llvm::Function::Create(
+        taskType,
+        llvm::Function::InternalLinkage,
+        function->getName() + "_parallel_loop",
+        halide_cg.get_module());
+    setTargetAttributes(task);
+    {
+      auto* taskIterator = &*task->arg_begin();
+      auto* closureArg = &*(task->arg_begin() + 1);
+      taskIterator->setName(iterator);
+      closureArg->setName("closure");
+      llvm::IRBuilder<> taskBuilder(
+          llvm::BasicBlock::Create(llvmCtx, "entry", task));
+      auto* taskClosure = taskBuilder.CreatePointerCast(
+          closureArg, closureType->getPointerTo());
+      std::vector<llvm::Value*> bodyArgs{taskIterator};
+      for (size_t i = 0; i < capturedValues.size(); ++i) {
+        bodyArgs.push_back(taskBuilder.CreateLoad(
+            taskBuilder.CreateStructGEP(closureType, taskClosure, i),
+            i < captured.size() ? captured[i] : ""));
+      }
+      taskBuilder.CreateCall(body, bodyArgs);
+      taskBuilder.CreateRetVoid();
+    }
+
+    auto* callBB = builder.GetInsertBlock();
+    halide_cg.set_function(body);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(llvmCtx, "entry", body));
+    for (size_t i = 0; i < captured.size(); ++i) {
+      halide_cg.sym_push(captured[i], &*(body->arg_begin() + 1 + i));
+    }
+    std::vector<llvm::Value*> extraArgs;
+    for (size_t i = 0; i < extra.size(); ++i) {
+      extraArgs.push_back(&*(body->arg_begin() + 1 + captured.size() + i));
+    }
+    // The buffers allocated by the body are private to its task.
+    auto outerBuffers = buffers_.size();
+    emitBody(iteratorArg, extraArgs);
+    builder.CreateRetVoid();
+    while (buffers_.size() > outerBuffers) {
+      halide_cg.sym_pop(buffers_.back());
+      buffers_.pop_back();
+    }
+    for (auto it = captured.rbegin(); it != captured.rend(); ++it) {
+      halide_cg.sym_pop(*it);
+    }
+    halide_cg.set_function(function);
+    builder.SetInsertPoint(callBB);
+
+    auto* parallelForType = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(llvmCtx),
+        {int64Type,
+         int64Type,
+         int64Type,
+         taskType->getPointerTo(),
+         voidPtrType},
+        false);
+    auto* parallelFor = halide_cg.get_module()->getOrInsertFunction(
+        kParallelForName, parallelForType);
+    builder.CreateCall(
+        parallelFor,
+        {begin,
+         end,
+         getLLVMConstantSignedInt64(step),
+         task,
+         builder.CreatePointerCast(closure, voidPtrType)});
+  }
+
+  // Outline the body of the parallel loop "node" into a task run by the
+  // thread pool for each iteration, see emitParallelTasks.
+  llvm::BasicBlock* emitParallelFor(isl::ast_node_for node) {
+    auto iterator = node.get_iterator().get_id().get_name();
+    llvm::Value* begin;
+    llvm::Value* end;
+    std::tie(begin, end) = emitLoopBounds(node);
+    allocateSharedBuffers(node.get_body());
+    emitParallelTasks(
+        iterator,
+        begin,
+        end,
+        IslExprToSInt(node.get_inc()),
+        {},
+        [this, node, &iterator](
+            llvm::Value* value, llvm::ArrayRef<llvm::Value*>) {
+          halide_cg.sym_push(iterator, value);
+          inParallelLoop_ = true;
+          halide_cg.get_builder().SetInsertPoint(emitAst(node.get_body()));
+          inParallelLoop_ = false;
+          halide_cg.sym_pop(iterator);
+        });
+    return halide_cg.get_builder().GetInsertBlock();
+  }
+
+  // Whether the loop "node" is a reduction loop that can run in parallel,
+  // i.e., its body only consists of a statement "stmtId" that updates a
+  // single tensor element with the reduction "op", see
+  // isReductionUpdateOf, whose subscripts do not depend on the iterators of
+  // "node" and of the loops inside it.
+  bool isParallelReduction(
+      isl::ast_node_for node,
+      isl::id& stmtId,
+      ReductionOp& op) {
+    // The partial results would bypass the promoted arrays.
+    if (not scop_.promotedDecls().empty()) {
+      return false;
+    }
+    auto iterator = node.get_iterator().get_id().get_name();
+    auto cond = node.get_cond();
+    if ((cond.get_op_type() != isl::ast_op_type::lt and
+         cond.get_op_type() != isl::ast_op_type::le) or
+        isl_ast_expr_get_type(cond.get_op_arg(0).get()) !=
+            isl_ast_expr_type::isl_ast_expr_id or
+        cond.get_op_arg(0).get_id().get_name() != iterator) {
+      return false;
+    }
+    std::vector<isl::ast_node_user> stmts;
+    std::vector<std::string> iterators{iterator};
+    collectStmtsAndIterators(node.get_body(), stmts, iterators);
+    if (stmts.size() != 1) {
+      return false;
+    }
+    stmtId = stmts[0].get_expr().get_op_arg(0).get_id();
+    auto provide =
+        scop_.halide.statements.at(stmtId).as<Halide::Internal::Provide>();
+    if (not provide or provide->values.size() != 1) {
+      return false;
+    }
+    auto type = provide->values[0].type();
+    if (type.is_bool() or type.is_handle() or
+        not isReductionUpdateOf(provide->values[0], provide->name, op)) {
+      return false;
+    }
+    for (const auto& subscript : stmtSubscripts_.at(stmtId)) {
+      for (const auto& name : iterators) {
+        if (astExprUses(subscript, name)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Combine the values "a" and "b" of type "type" with the reduction "op".
+  llvm::Value* emitReductionOp(
+      ReductionOp op,
+      Halide::Type type,
+      llvm::Value* a,
+      llvm::Value* b) {
+    auto& builder = halide_cg.get_builder();
+    switch (op) {
+      case ReductionOp::Sum:
+        return type.is_float() ? builder.CreateFAdd(a, b)
+                               : builder.CreateAdd(a, b);
+      case ReductionOp::Prod:
+        return type.is_float() ? builder.CreateFMul(a, b)
+                               : builder.CreateMul(a, b);
+      case ReductionOp::Min:
+      case ReductionOp::Max: {
+        auto* less = type.is_float()
+            ? builder.CreateFCmpOLT(a, b)
+            : type.is_int() ? builder.CreateICmpSLT(a, b)
+                            : builder.CreateICmpULT(a, b);
+        return op == ReductionOp::Min ? builder.CreateSelect(less, a, b)
+                                      : builder.CreateSelect(less, b, a);
+      }
+    }
+    LOG(FATAL) << "unknown reduction";
+    return nullptr;
+  }
+
+  // Run the reduction loop "node" in parallel, see isParallelReduction.
+  // Its iterations are split into one chunk per thread of the runtime, each
+  // chunk is run by a task, see emitParallelTasks, that accumulates the
+  // updates of the statement "stmtId" into a private accumulator starting
+  // from the identity of "op".  The calling thread then combines the
+  // partial results of the chunks into the tensor element, in the order of
+  // the chunks.  Floating point reductions are reassociated, which may
+  // change their rounding.
+  llvm::BasicBlock* emitParallelReduction(
+      isl::ast_node_for node,
+      isl::id stmtId,
+      ReductionOp op) {
+    auto& builder = halide_cg.get_builder();
+    auto* function = builder.GetInsertBlock()->getParent();
+    auto iterator = node.get_iterator().get_id().get_name();
+    auto step = IslExprToSInt(node.get_inc());
+    llvm::Value* begin;
+    llvm::Value* end;
+    std::tie(begin, end) = emitLoopBounds(node);
+    auto provide =
+        scop_.halide.statements.at(stmtId).as<Halide::Internal::Provide>();
+    auto type = provide->values[0].type();
+    auto* elementType = halide_cg.llvm_type_of(type);
+
+    // The partial results live in the frame of the kernel.
+    auto* int64Type = llvm::Type::getInt64Ty(llvmCtx);
+    llvm::IRBuilder<> entryBuilder(
+        &function->getEntryBlock(), function->getEntryBlock().begin());
+    auto* numChunks = entryBuilder.CreateCall(
+        halide_cg.get_module()->getOrInsertFunction(
+            kNumThreadsName, llvm::FunctionType::get(int64Type, false)),
+        {},
+        "num_chunks");
+    auto* partials =
+        entryBuilder.CreateAlloca(elementType, numChunks, "partials");
+
+    emitParallelTasks(
+        "chunk",
+        getLLVMConstantSignedInt64(0),
+        numChunks,
+        1,
+        {begin, end, numChunks, partials},
+        [this, node, op, step, &iterator, type, elementType, provide](
+            llvm::Value* chunk, llvm::ArrayRef<llvm::Value*> values) {
+          auto& builder = halide_cg.get_builder();
+          auto* begin = values[0];
+          auto* end = values[1];
+          auto* numChunks = values[2];
+          auto* partials = values[3];
+
+          // Chunk c runs the iterations c * n / numChunks up to
+          // (c + 1) * n / numChunks of the n iterations of the loop.
+          auto* stepValue = getLLVMConstantSignedInt64(step);
+          auto* n = builder.CreateSDiv(
+              builder.CreateAdd(
+                  builder.CreateSub(end, begin),
+                  getLLVMConstantSignedInt64(step - 1)),
+              stepValue);
+          n = builder.CreateSelect(
+              builder.CreateICmpSGT(n, getLLVMConstantSignedInt64(0)),
+              n,
+              getLLVMConstantSignedInt64(0));
+          auto chunkBegin = [&](llvm::Value* c) -> llvm::Value* {
+            return builder.CreateAdd(
+                begin,
+                builder.CreateMul(
+                    builder.CreateSDiv(builder.CreateMul(c, n), numChunks),
+                    stepValue));
+          };
+          auto* chunkEnd = chunkBegin(
+              builder.CreateAdd(chunk, getLLVMConstantSignedInt64(1)));
+
+          auto* accumulator =
+              builder.CreateAlloca(elementType, nullptr, "accumulator");
+          builder.CreateStore(
+              halide_cg.codegen(reductionIdentity(op, type)), accumulator);
+          halide_cg.accumulatedTensor_ = provide->name;
+          halide_cg.accumulator_ = accumulator;
+          auto prefetchIterator = halide_cg.prefetchIterator_;
+          if (not containsLoop(node.get_body()) and
+              options_.prefetch_distance() > 0) {
+            halide_cg.prefetchIterator_ = iterator;
+            halide_cg.prefetchDistance_ = options_.prefetch_distance() * step;
+          }
+          inParallelLoop_ = true;
+          enclosingIterators_.push_back(iterator);
+          emitCountedLoop(
+              iterator,
+              chunkBegin(chunk),
+              chunkEnd,
+              step,
+              [this, node]() {
+                halide_cg.get_builder().SetInsertPoint(
+                    emitAst(node.get_body()));
+              },
+              nullptr);
+          enclosingIterators_.pop_back();
+          inParallelLoop_ = false;
+          halide_cg.prefetchIterator_ = prefetchIterator;
+          halide_cg.accumulator_ = nullptr;
+          builder.CreateStore(
+              builder.CreateLoad(accumulator),
+              builder.CreateInBoundsGEP(partials, chunk));
+        });
+
+    // The subscripts only depend on the iterators of the enclosing loops.
+    llvm::SmallVector<llvm::Value*, 5> subscriptValues;
+    for (const auto& subscript : stmtSubscripts_.at(stmtId)) {
+      subscriptValues.push_back(halide_cg.getValue(subscript));
+    }
+    auto* destAddr = halide_cg.tensorAddress(provide->name, subscriptValues);
+    emitCountedLoop(
+        "chunk",
+        getLLVMConstantSignedInt64(0),
+        numChunks,
+        1,
+        [this, op, type, destAddr, partials]() {
+          auto& builder = halide_cg.get_builder();
+          auto* partial = builder.CreateLoad(builder.CreateInBoundsGEP(
+              partials, halide_cg.sym_get("chunk")));
+          builder.CreateStore(
+              emitReductionOp(op, type, builder.CreateLoad(destAddr), partial),
+              destAddr);
+        },
+        makeVectorizeMetadata(1));
+    return builder.GetInsertBlock();
+  }
+
   llvm::BasicBlock* emitStmt(isl::ast_node_user node) {
     isl::ast_expr usrExp = node.get_expr();
     auto id = usrExp.get_op_arg(0).get_id();
+    if (id.get_name() == kReadIdName or id.get_name() == kWriteIdName) {
+      return emitCopyStmt(copyStmts_.at(node.get_annotation()));
+    }
     auto provide = scop_.halide.statements.at(id);
     auto op = provide.as<Halide::Internal::Provide>();
     CHECK(op) << "Expected a Provide node: " << provide << '\n';
@@ -587,15 +1756,135 @@ class LLVMCodegen {
       subscriptValues.push_back(halide_cg.getValue(subscript));
     }
 
-    auto destAddr = halide_cg.get_builder().CreateInBoundsGEP(
-        halide_cg.sym_get(arrayName), subscriptValues);
+    auto promoted = promotedAccesses_.find(id);
+    halide_cg.promotedAccesses_ = nullptr;
+    if (promoted != promotedAccesses_.end()) {
+      for (const auto& kvp : promoted->second) {
+        allocateBuffer(kvp.second.groupId);
+      }
+      halide_cg.promotedAccesses_ = &promoted->second;
+    }
+    auto destAddr = halide_cg.promotedAddress(op);
+    if (not destAddr) {
+      destAddr =
+          halide_cg.accumulator_ and arrayName == halide_cg.accumulatedTensor_
+          ? halide_cg.accumulator_
+          : halide_cg.tensorAddress(arrayName, subscriptValues);
+    }
 
     halide_cg.iteratorMap_ = &iteratorMaps_.at(id);
-    llvm::Value* rhs = halide_cg.codegen(op->values[0]);
-    halide_cg.get_builder().CreateStore(rhs, destAddr);
+    if (vectorLanes_ > 1) {
+      // The subscripts are those of the first lane.
+      auto elementType = destAddr->getType()->getPointerElementType();
+      auto rhs = halide_cg.codegenVector(
+          op->values[0], vectorIterator_, vectorLanes_);
+      halide_cg.get_builder().CreateAlignedStore(
+          rhs,
+          halide_cg.get_builder().CreatePointerCast(
+              destAddr,
+              llvm::VectorType::get(elementType, vectorLanes_)
+                  ->getPointerTo()),
+          halide_cg.get_module()->getDataLayout().getABITypeAlignment(
+              elementType));
+    } else {
+      llvm::Value* rhs = halide_cg.codegen(op->values[0]);
+      halide_cg.get_builder().CreateStore(rhs, destAddr);
+    }
+    halide_cg.promotedAccesses_ = nullptr;
     return halide_cg.get_builder().GetInsertBlock();
   }
 
+  // Copy an element between a tensor and its promoted array.
+  llvm::BasicBlock* emitCopyStmt(const CopyStmt& copy) {
+    auto& builder = halide_cg.get_builder();
+    allocateBuffer(copy.groupId);
+    auto address = [this](
+                       const std::string& name,
+                       const std::vector<isl::ast_expr>& subscripts) {
+      std::vector<llvm::Value*> values;
+      for (const auto& subscript : subscripts) {
+        values.push_back(halide_cg.getValue(subscript));
+      }
+      return halide_cg.tensorAddress(name, values);
+    };
+    auto original = address(copy.tensorId.get_name(), copy.original);
+    auto promoted = address(copy.groupId.get_name(), copy.promoted);
+    if (copy.isRead) {
+      builder.CreateStore(builder.CreateLoad(original), promoted);
+    } else {
+      builder.CreateStore(builder.CreateLoad(promoted), original);
+    }
+    return builder.GetInsertBlock();
+  }
+
+  // Allocate the promoted array "groupId" in the entry block of the function
+  // being emitted, unless it is already visible there, and bind its name to
+  // a pointer to its rows, as for the packed tensors.  The arrays allocated
+  // in the body of a parallel loop are private to each of its tasks.
+  void allocateBuffer(isl::id groupId) {
+    auto name = groupId.get_name();
+    if (std::find(buffers_.begin(), buffers_.end(), name) != buffers_.end()) {
+      return;
+    }
+    const auto& decl = scop_.promotedDecls().at(groupId);
+    auto tensorName = decl.tensorId.get_name();
+    llvm::Type* elementType = nullptr;
+    for (const auto& t : scop_.halide.inputs) {
+      if (t.name() == tensorName) {
+        elementType = halide_cg.llvm_type_of(t.type());
+      }
+    }
+    for (const auto& t : scop_.halide.outputs) {
+      if (t.name() == tensorName) {
+        elementType = halide_cg.llvm_type_of(t.type());
+      }
+    }
+    CHECK(elementType) << "promoted array of unknown tensor " << tensorName;
+    CHECK(not decl.sizes.empty()) << "scalars are not promoted";
+    llvm::Type* arrayType = elementType;
+    for (auto size = decl.sizes.rbegin(); size != decl.sizes.rend(); ++size) {
+      arrayType = llvm::ArrayType::get(arrayType, *size);
+    }
+    auto* function = halide_cg.get_builder().GetInsertBlock()->getParent();
+    llvm::IRBuilder<> entryBuilder(
+        &function->getEntryBlock(), function->getEntryBlock().begin());
+    auto* buffer = entryBuilder.CreateAlloca(arrayType, nullptr, name);
+    // The rows are addressed like those of the packed tensors.
+    std::vector<int64_t> innerSizes(decl.sizes.begin() + 1, decl.sizes.end());
+    auto* rowsType = innerSizes.empty()
+        ? elementType->getPointerTo()
+        : makePtrToArrayType(elementType, innerSizes);
+    halide_cg.sym_push(name, entryBuilder.CreatePointerCast(buffer, rowsType));
+    buffers_.push_back(name);
+  }
+
+  // Allocate the promoted arrays that the AST "body" of a parallel loop
+  // accesses without copying them, which are shared by its tasks.
+  void allocateSharedBuffers(isl::ast_node body) {
+    std::vector<isl::ast_node_user> stmts;
+    std::vector<std::string> iterators;
+    collectStmtsAndIterators(body, stmts, iterators);
+    std::unordered_set<isl::id, isl::IslIdIslHash> copied;
+    for (auto stmt : stmts) {
+      auto copy = copyStmts_.find(stmt.get_annotation());
+      if (copy != copyStmts_.end()) {
+        copied.insert(copy->second.groupId);
+      }
+    }
+    for (auto stmt : stmts) {
+      auto id = stmt.get_expr().get_op_arg(0).get_id();
+      auto promoted = promotedAccesses_.find(id);
+      if (promoted == promotedAccesses_.end()) {
+        continue;
+      }
+      for (const auto& kvp : promoted->second) {
+        if (copied.count(kvp.second.groupId) == 0) {
+          allocateBuffer(kvp.second.groupId);
+        }
+      }
+    }
+  }
+
  public:
   std::string str() const {
     return toString(halide_cg.get_module());
@@ -605,10 +1894,29 @@ class LLVMCodegen {
   const Scop& scop_;
   const IteratorMapsType& iteratorMaps_;
   const StmtSubscriptExprMapType& stmtSubscripts_;
+  const PromotedAccessesType& promotedAccesses_;
+  const CopyStmtMapType& copyStmts_;
+  const CpuMappingOptionsProto options_;
+  llvm::TargetMachine& targetMachine_;
+  // Width of the widest vector registers of the target machine.
+  int vectorBits_ = 0;
 
   std::vector<llvm::Type*> args_;
   std::vector<std::string> argNames_;
 
+  // Iterators of the loops around the one being emitted, outermost first.
+  std::vector<std::string> enclosingIterators_;
+  // Whether the loop being emitted is nested inside an outlined parallel
+  // loop, only the outermost parallel loops are outlined.
+  bool inParallelLoop_ = false;
+  // Iterator of the loop being emitted with explicit vectors of
+  // vectorLanes_ lanes, if vectorLanes_ is greater than 1.
+  std::string vectorIterator_;
+  int vectorLanes_ = 1;
+  // Names of the promoted arrays visible in the function being emitted, in
+  // order of allocation, see allocateBuffer.
+  std::vector<std::string> buffers_;
+
  public:
   CodeGen_TC halide_cg;
 };
@@ -616,16 +1924,90 @@ class LLVMCodegen {
 struct IslCodegenRes {
   IteratorMapsType iteratorMaps;
   StmtSubscriptExprMapType stmtSubscripts;
+  PromotedAccessesType promotedAccesses;
+  CopyStmtMapType copyStmts;
   isl::ast_node astNode;
 };
 
+// The subscripts of the elements of the promoted arrays accessed by the
+// references of the statement "stmtId" in terms of the AST iterators, given
+// the map "iteratorMap" from the AST iterators to its instances.  The
+// promotion of a group shifts the subscripts of its references by offsets
+// that depend on the partial schedule of its scope, see
+// TensorReferenceGroup::promotion.
+PromotedAccessMapType promotedAccesses(
+    const Scop& scop,
+    isl::id stmtId,
+    isl::pw_multi_aff iteratorMap,
+    isl::ast_build build) {
+  PromotedAccessMapType res;
+  auto domain = isl::union_set(iteratorMap.range());
+  for (const auto& kvp : scop.activePromotions()) {
+    if (kvp.first.intersect(domain).is_empty()) {
+      continue;
+    }
+    const auto& info = kvp.second;
+    auto schedule = isl::map::from_union_map(
+        info.outerSchedule.intersect_domain(domain)); // D -> S
+    auto astToSchedule = isl::pw_multi_aff(schedule).pullback(iteratorMap);
+    auto promotion = info.group->promotion().set_tuple_id(
+        isl::dim_type::out, info.groupId); // [S -> O] -> P
+    for (const auto& ref : info.group->references) {
+      if (ref->originalAccess.get_tuple_id(isl::dim_type::in) != stmtId) {
+        continue;
+      }
+      auto astToOriginal =
+          isl::pw_multi_aff(ref->originalAccess).pullback(iteratorMap);
+      auto astToPromoted = isl::pw_multi_aff(promotion).pullback(
+          astToSchedule.range_product(astToOriginal));
+      auto& access = res[ref->refId];
+      access.groupId = info.groupId;
+      for (int i = 0; i < astToPromoted.dim(isl::dim_type::out); ++i) {
+        access.subscripts.push_back(
+            build.expr_from(astToPromoted.get_pw_aff(i)));
+      }
+    }
+  }
+  return res;
+}
+
 IslCodegenRes codegenISL(const Scop& scop) {
   IteratorMapsType iteratorMaps;
   StmtSubscriptExprMapType stmtSubscripts;
-  auto collect = [&iteratorMaps, &scop, &stmtSubscripts](
+  PromotedAccessesType promoted;
+  CopyStmtMapType copyStmts;
+  auto collect = [&iteratorMaps, &scop, &stmtSubscripts, &promoted, &copyStmts](
                      isl::ast_node n, isl::ast_build b) -> isl::ast_node {
+    // The copy statements of all the promoted arrays share their
+    // identifiers, their nodes are annotated with their own.
+    auto collectCopy = [&scop, &copyStmts](
+                           isl::ast_node node,
+                           isl::ast_build build) -> isl::ast_node {
+      auto user = node.as<isl::ast_node_user>();
+      auto stmtId = user.get_expr().get_op_arg(0).get_id();
+      auto scheduleMap = isl::map::from_union_map(build.get_schedule());
+      // PMA :: A -> [[S -> O] -> P]
+      auto iteratorMap = isl::pw_multi_aff(scheduleMap.reverse());
+      auto promoted = iteratorMap.range_factor_range();
+      auto original = iteratorMap.range_factor_domain().range_factor_range();
+      CopyStmt copy;
+      copy.groupId = promoted.get_tuple_id(isl::dim_type::out);
+      copy.tensorId = original.get_tuple_id(isl::dim_type::out);
+      copy.isRead = stmtId.get_name() == kReadIdName;
+      for (int i = 0; i < original.dim(isl::dim_type::out); ++i) {
+        copy.original.push_back(build.expr_from(original.get_pw_aff(i)));
+      }
+      for (int i = 0; i < promoted.dim(isl::dim_type::out); ++i) {
+        copy.promoted.push_back(build.expr_from(promoted.get_pw_aff(i)));
+      }
+      auto annotation = isl::id(
+          stmtId.get_ctx(), "copy_" + std::to_string(copyStmts.size()));
+      copyStmts.emplace(annotation, std::move(copy));
+      return node.set_annotation(annotation);
+    };
     auto collectIteratorMaps =
-        [](isl::ast_node node,
+        [&promoted](
+            isl::ast_node node,
            isl::ast_build build,
            IteratorMapsType& iteratorMaps,
            const Scop& scop,
@@ -656,9 +2038,17 @@ IslCodegenRes codegenISL(const Scop& scop) {
         CHECK_EQ(pulled.n_piece(), 1);
         subscripts.push_back(build.expr_from(pulled));
       }
+      auto accesses = promotedAccesses(scop, stmtId, iteratorMap, build);
+      if (not accesses.empty()) {
+        promoted.emplace(stmtId, std::move(accesses));
+      }
       return node.set_annotation(stmtId);
     };
 
+    auto name = n.as<isl::ast_node_user>().get_expr().get_op_arg(0).get_id();
+    if (name.get_name() == kReadIdName or name.get_name() == kWriteIdName) {
+      return collectCopy(n, b);
+    }
     auto& uv = iteratorMaps;
     return collectIteratorMaps(n, b, uv, scop, stmtSubscripts);
   };
@@ -682,8 +2072,37 @@ IslCodegenRes codegenISL(const Scop& scop) {
   astBuild = astBuild.set_at_each_domain(collect);
   astBuild = astBuild.set_iterators(Codegen::makeLoopIterators(ctx, maxDepth));
   auto astNode = astBuild.node_from(schedule);
-  return {
-      std::move(iteratorMaps), std::move(stmtSubscripts), std::move(astNode)};
+  return {std::move(iteratorMaps),
+          std::move(stmtSubscripts),
+          std::move(promoted),
+          std::move(copyStmts),
+          std::move(astNode)};
+}
+
+// Emit "void <kernel>_packed(i8** args)", which loads each argument of the
+// kernel from the array and calls it.  This gives callers a uniform entry
+// point that does not depend on the kernel signature.
+void emitPackedWrapper(llvm::Module* module, llvm::Function* kernel) {
+  auto argsType = llvm::Type::getInt8PtrTy(llvmCtx)->getPointerTo();
+  auto wrapperType = llvm::FunctionType::get(
+      llvm::Type::getVoidTy(llvmCtx), {argsType}, false);
+  auto wrapper = llvm::Function::Create(
+      wrapperType,
+      llvm::Function::ExternalLinkage,
+      kernel->getName().str() + kPackedKernelSuffix,
+      module);
+  llvm::IRBuilder<> builder(
+      llvm::BasicBlock::Create(llvmCtx, "entry", wrapper));
+  auto args = &*wrapper->arg_begin();
+  args->setName("args");
+  std::vector<llvm::Value*> callArgs;
+  for (auto& arg : kernel->args()) {
+    auto addr = builder.CreateConstGEP1_32(args, arg.getArgNo());
+    callArgs.push_back(
+        builder.CreatePointerCast(builder.CreateLoad(addr), arg.getType()));
+  }
+  builder.CreateCall(kernel, callArgs);
+  builder.CreateRetVoid();
 }
 
 } // namespace
@@ -691,17 +2110,69 @@ IslCodegenRes codegenISL(const Scop& scop) {
 std::unique_ptr<llvm::Module> emitLLVMKernel(
     const std::string& specializedName,
     const Scop& scop,
-    const llvm::DataLayout& dataLayout) {
+    llvm::TargetMachine& targetMachine,
+    const CpuMappingOptions& options) {
   auto islCg = codegenISL(scop);
-  LLVMCodegen cg(scop, islCg.iteratorMaps, islCg.stmtSubscripts);
-  cg.halide_cg.get_module()->setDataLayout(dataLayout);
+  LLVMCodegen cg(
+      scop,
+      islCg.iteratorMaps,
+      islCg.stmtSubscripts,
+      islCg.promotedAccesses,
+      islCg.copyStmts,
+      options,
+      targetMachine);
+  cg.halide_cg.get_module()->setDataLayout(targetMachine.createDataLayout());
   cg.halide_cg.get_module()->setTargetTriple(
-      llvm::EngineBuilder().selectTarget()->getTargetTriple().str());
+      targetMachine.getTargetTriple().str());
   cg.createSignature(scop.halide.inputs, scop.halide.outputs, specializedName);
   cg.CodeGen(islCg.astNode);
-  cg.halide_cg.optimize_module();
+  emitPackedWrapper(
+      cg.halide_cg.get_module(),
+      cg.halide_cg.get_module()->getFunction(specializedName));
   return cg.halide_cg.move_module();
 }
 
+void optimizeLLVMKernel(
+    llvm::Module* module,
+    llvm::TargetMachine& targetMachine) {
+  LOG_IF(INFO, FLAGS_llvm_dump_before_opt)
+      << "[LLVM-IR] Before optimization:\n"
+      << toString(module);
+
+  llvm::legacy::FunctionPassManager functionPassManager(module);
+  llvm::legacy::PassManager modulePassManager;
+
+  modulePassManager.add(llvm::createTargetTransformInfoWrapperPass(
+      targetMachine.getTargetIRAnalysis()));
+  functionPassManager.add(llvm::createTargetTransformInfoWrapperPass(
+      targetMachine.getTargetIRAnalysis()));
+
+  llvm::PassManagerBuilder b;
+  b.OptLevel = kOptLevel;
+#ifdef TAPIR_VERSION_MAJOR
+  b.tapirTarget = new llvm::CilkABI();
+#endif
+  b.Inliner = llvm::createFunctionInliningPass(b.OptLevel, 0, false);
+  b.LoopVectorize = true;
+  b.SLPVectorize = true;
+
+  targetMachine.adjustPassManager(b);
+
+  b.populateFunctionPassManager(functionPassManager);
+  b.populateModulePassManager(modulePassManager);
+
+  // Run optimization passes
+  functionPassManager.doInitialization();
+  for (llvm::Module::iterator i = module->begin(); i != module->end(); i++) {
+    functionPassManager.run(*i);
+  }
+
+  functionPassManager.doFinalization();
+  modulePassManager.run(*module);
+
+  LOG_IF(INFO, FLAGS_llvm_dump_after_opt) << "[LLVM-IR] After optimization:\n"
+                                          << toString(module);
+}
+
 } // namespace polyhedral
 } // namespace tc
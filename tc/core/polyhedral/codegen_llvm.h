@@ -25,6 +25,8 @@
 
 #include "Halide.h"
 
+#include "tc/core/cpu/cpu_mapping_options.h"
+
 namespace tc {
 
 static inline std::string toString(llvm::Value* llvmObject) {
@@ -46,10 +48,27 @@ static inline std::string toString(llvm::Module* llvmObject) {
 namespace polyhedral {
 struct Scop;
 
+/// Suffix of the entry point emitted next to each kernel, which takes all the
+/// kernel arguments as a single array of pointers.
+constexpr auto kPackedKernelSuffix = "_packed";
+
+/// Emit the kernel of a scheduled scop, with the parallel loops,
+/// vectorization and prefetching set by the options.  The tiling set by the
+/// options must already be applied to the schedule.  The kernel is compiled
+/// for the CPU and features of targetMachine, its vectors fill the widest
+/// vector registers these provide.  The module is not optimized yet, see
+/// optimizeLLVMKernel.
 std::unique_ptr<llvm::Module> emitLLVMKernel(
     const std::string& specializedName,
     const Scop& scop,
-    const llvm::DataLayout& dataLayout);
+    llvm::TargetMachine& targetMachine,
+    const CpuMappingOptions& options = CpuMappingOptions());
+
+/// Run the LLVM optimization pipeline, tuned for targetMachine, on a module
+/// emitted by emitLLVMKernel for the same target machine.
+void optimizeLLVMKernel(
+    llvm::Module* module,
+    llvm::TargetMachine& targetMachine);
 
 // TODO: I want to do something like the following, but compilation was unhappy
 //  using initialize_llvm = Halide::Internal::CodeGen_LLVM::initialize_llvm;
@@ -20,12 +20,14 @@
 #include <unordered_map>
 #include <utility>
 
+#include "tc/core/cuda/cuda_source_profile.h"
 #include "tc/core/flags.h"
 #include "tc/core/islpp_wrap.h"
 #include "tc/core/libraries.h"
 #include "tc/core/polyhedral/codegen.h"
 #include "tc/core/polyhedral/cuda/codegen.h"
 #include "tc/core/polyhedral/cuda/mapping_types.h"
+#include "tc/core/polyhedral/exceptions.h"
 #include "tc/core/polyhedral/memory_promotion.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/schedule_transforms.h"
@@ -55,15 +57,59 @@ struct WS {
 };
 thread_local int WS::n = 0;
 
+// Suffix of the pair of buffers a double-buffered promoted array points to.
+constexpr auto kDoubleBufferSuffix = "_buffers";
+
+// Strides of the tensors that are not packed, by name, see
+// Scop::tensorStrides.
+using TensorStrides = decltype(Scop::tensorStrides);
+
 std::string makePointerName(std::string n) {
   return string("p") + n;
 }
 
+// The array in constant memory holding the values of the input "name"
+// baked into the kernel "specializedName", see Scop::constantInputs.  The
+// stages of a cooperative kernel share a module, hence the kernel name.
+std::string makeConstantInputName(
+    const std::string& name,
+    const std::string& specializedName) {
+  return "_" + name + "_constant_" + specializedName;
+}
+
 std::string makeReductionTmpName(isl::id updateId, const Scop& scop) {
   int pos = scop.reductionUpdatePos(updateId);
   return "acc_" + std::to_string(pos);
 }
 
+// Is the input called "name" aliased by an output, i.e., possibly written
+// by the kernel through the pointer of that output?
+bool isAliasedInput(const Scop& scop, const std::string& name) {
+  for (const auto& alias : scop.halide.aliases) {
+    if (alias.second == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Is the tensor called "name" only read by the kernel?  This is the case for
+// the inputs, but also for the tensors that are not written by any statement
+// of the scop, e.g. a temporary in the kernels following the one that
+// computes it.  The inputs aliased by an output are not, their values may
+// change while the kernel runs.
+bool isReadOnlyInKernel(const Scop& scop, const std::string& name) {
+  if (isAliasedInput(scop, name)) {
+    return false;
+  }
+  for (auto write : isl::UnionAsVector<isl::union_map>(scop.writes)) {
+    if (write.get_tuple_id(isl::dim_type::out).get_name() == name) {
+      return false;
+    }
+  }
+  return true;
+}
+
 template <typename T>
 inline vector<T> operator+(vector<T> a, const vector<T>& b) {
   vector<T> res{a};
@@ -109,9 +155,15 @@ vector<string> emitParams(const Scop& scop) {
 // Returns number of names printed, i.e. tensors.size().
 string emitTypedTensorName(
     Halide::OutputImageParam t,
-    bool constInput = false) {
+    bool constInput = false,
+    bool restrictInput = true) {
   stringstream ss;
+  // Inputs are never written, so they are not aliased by another argument
+  // through which the kernel writes, unless an output aliases them.  Do not
+  // mark the outputs __restrict__: they are accessed through intentionally
+  // aliasing array views (see the Restrict test in test_basic_gpu.cc).
   ss << (constInput ? "const " : "") << t.type() << "* "
+     << (constInput && restrictInput ? "__restrict__ " : "")
      << makePointerName(t.name());
   return ss.str();
 }
@@ -126,11 +178,14 @@ vector<string> emitTypedTensorNames(
   return res;
 }
 
-vector<string> emitTypedTensorNames(const vector<Halide::ImageParam>& tensors) {
+vector<string> emitTypedTensorNames(
+    const vector<Halide::ImageParam>& tensors,
+    const Scop& scop) {
   vector<string> res;
   res.reserve(tensors.size());
   for (auto t : tensors) {
-    res.push_back(emitTypedTensorName(t, true));
+    res.push_back(
+        emitTypedTensorName(t, true, !isAliasedInput(scop, t.name())));
   }
   return res;
 }
@@ -139,7 +194,7 @@ void emitArgs(stringstream& ss, const Scop& scop) {
   // Order is: params, outs, ins
   auto sigVec = emitParams(scop);
   sigVec = sigVec + emitTypedTensorNames(scop.halide.outputs);
-  sigVec = sigVec + emitTypedTensorNames(scop.halide.inputs);
+  sigVec = sigVec + emitTypedTensorNames(scop.halide.inputs, scop);
   for (auto& s : sigVec) {
     ss << s;
     if (s != sigVec.back()) {
@@ -148,49 +203,105 @@ void emitArgs(stringstream& ss, const Scop& scop) {
   }
 }
 
+// The arguments in the order of emitArgs, as passed to a call.
+void emitCallArgs(stringstream& ss, const Scop& scop) {
+  vector<string> names;
+  for (auto p : scop.halide.params) {
+    names.push_back(p.name());
+  }
+  for (auto t : scop.halide.outputs) {
+    names.push_back(makePointerName(t.name()));
+  }
+  for (auto t : scop.halide.inputs) {
+    names.push_back(makePointerName(t.name()));
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    ss << (i > 0 ? ", " : "") << names[i];
+  }
+}
+
+// Emit the signature of the kernel, or of a device function called by a
+// kernel if "global" is not set.
 void emitKernelSignature(
     stringstream& ss,
     const std::string& specializedName,
-    const Scop& scop) {
+    const MappedScop& mscop,
+    bool global = true) {
   CHECK_NE(specializedName, "") << "name not provided";
-  ss << "__global__ void " << specializedName << "(";
-  emitArgs(ss, scop);
+  if (!global) {
+    ss << "inline __device__ void " << specializedName << "(";
+    emitArgs(ss, mscop.scop());
+    ss << ") {" << endl;
+    return;
+  }
+  ss << "__global__ void ";
+  if (mscop.useLaunchBounds) {
+    auto block = mscop.numThreads.view.extractDefaultedArray();
+    ss << "__launch_bounds__(" << block[0] * block[1] * block[2];
+    if (mscop.minBlocksPerMultiprocessor > 0) {
+      ss << ", " << mscop.minBlocksPerMultiprocessor;
+    }
+    ss << ") ";
+  }
+  ss << specializedName << "(";
+  emitArgs(ss, mscop.scop());
   ss << ") {" << endl;
 }
 
 // This is similar to the pass unpack_buffers in
 // Halide, which unpacks strides, grabs alignment constraints,
 // etc.
-// TODO: this is still incorrect because at this point we only use the
-// DLTensor shape (i.e. sizes) of the computations.
-// To be correct we need the strides.
-// Unfortunately, strides are related to memory allocation and are ML
-// framework specific.
-// Halide has its own facilities to allocate memory and handles concrete
-// allocated memory at the (linearized) Buffer level.
-// We don't want that, and we are even at a higher level of IR where Buffer to
-// not exist.
-// So we must pass an additional structure to save strides that we collect at
-// runtime from the actual tensors that are passed to TcOp.
-// We could go parametric but then we need to pass all the strides as
-// parameters to the kernel call. This is doable, we've been doing it since
-// day 1 with fbcuda's DeviceTensor but it loses runtime alignment information
-// (or we need to jump through hoops to make proper use of it).
-// So the better path here is probably to JIT everything, except people want
-// as parametric code as possible, **sigh**.
+// Strides are related to memory allocation and are ML framework specific, the
+// kernels assume packed tensors except for those listed in "tensorStrides",
+// which are addressed through the strides collected from the actual tensors
+// passed to the executor.  Like the sizes, these strides are fixed at
+// compilation time, which keeps the address computations constant.
 void emitTensorView(
     stringstream& ss,
     Halide::OutputImageParam p,
+    const string& pointer,
     const map<string, Halide::Expr>& paramValues,
+    const TensorStrides& tensorStrides,
     bool constInput = false) {
   WS ws;
+  auto strides = tensorStrides.find(p.name());
+  if (strides != tensorStrides.end()) {
+    auto stridesName = "_" + p.name() + "_strides";
+    ss << ws.tab() << "const int " << stridesName << "[] = {";
+    for (size_t i = 0; i < strides->second.size(); ++i) {
+      ss << (i > 0 ? ", " : "") << strides->second[i];
+    }
+    ss << "};" << endl;
+    ss << ws.tab() << "__tc::StridedView<" << (constInput ? "const " : "")
+       << p.type() << ", " << p.dimensions() << "> " << p.name() << "{"
+       << pointer << ", " << stridesName << "};" << endl;
+    return;
+  }
   stringstream ssViewType;
+  vector<Halide::Expr> extents;
+  bool parametric = false;
   for (int i = 1; i < p.dimensions(); ++i) { // Skip the outermost dimension
     Halide::Expr extent = p.parameter().extent_constraint(i);
     extent = Halide::Internal::substitute(paramValues, extent);
     CHECK(extent.defined())
         << "Undefined extent on input/output tensor. Forward bounds inference should have set these\n";
     ssViewType << "[" << extent << "]";
+    extents.push_back(extent);
+    parametric = parametric || !extent.as<Halide::Internal::IntImm>();
+  }
+  if (parametric) {
+    // Array pointer types cannot have sizes that are kernel parameters, go
+    // through a view computing the strides at runtime instead.
+    auto sizesName = "_" + p.name() + "_sizes";
+    ss << ws.tab() << "const int " << sizesName << "[] = {";
+    for (size_t i = 0; i < extents.size(); ++i) {
+      ss << (i > 0 ? ", " : "") << extents[i];
+    }
+    ss << "};" << endl;
+    ss << ws.tab() << "__tc::ParametricView<" << (constInput ? "const " : "")
+       << p.type() << ", " << p.dimensions() << "> " << p.name() << "{"
+       << pointer << ", " << sizesName << "};" << endl;
+    return;
   }
   ss << ws.tab();
   ss << (constInput ? "const " : "") << p.type() << " (*" << p.name() << ")"
@@ -198,7 +309,7 @@ void emitTensorView(
   ss << " = ";
   ss << "reinterpret_cast<" << (constInput ? "const " : "") << p.type()
      << " (*)" << ssViewType.str() << ">";
-  ss << "(" << makePointerName(p.name()) << ")";
+  ss << "(" << pointer << ")";
   ss << ";";
   ss << endl;
 }
@@ -206,23 +317,86 @@ void emitTensorView(
 void emitTensorViews(
     stringstream& ss,
     const vector<Halide::OutputImageParam>& params,
-    const map<string, Halide::Expr>& paramValues) {
+    const map<string, Halide::Expr>& paramValues,
+    const TensorStrides& tensorStrides) {
   for (auto p : params) {
-    emitTensorView(ss, p, paramValues);
+    emitTensorView(
+        ss, p, makePointerName(p.name()), paramValues, tensorStrides);
   }
 }
 
+// The views of the inputs baked into the kernel "specializedName" point to
+// their arrays in constant memory instead of their arguments.
 void emitTensorViews(
     stringstream& ss,
     const vector<Halide::ImageParam>& params,
-    const map<string, Halide::Expr>& paramValues) {
+    const map<string, Halide::Expr>& paramValues,
+    const Scop& scop,
+    const std::string& specializedName) {
   for (auto p : params) {
-    emitTensorView(ss, p, paramValues, true);
+    auto pointer = scop.constantInputs.count(p.name()) != 0
+        ? makeConstantInputName(p.name(), specializedName)
+        : makePointerName(p.name());
+    emitTensorView(ss, p, pointer, paramValues, scop.tensorStrides, true);
+  }
+}
+
+// Declare the arrays in constant memory holding the values of the inputs
+// baked into the kernel "specializedName", aligned for vector loads.
+void emitConstantInputs(
+    stringstream& ss,
+    const std::string& specializedName,
+    const Scop& scop) {
+  for (auto p : scop.halide.inputs) {
+    auto values = scop.constantInputs.find(p.name());
+    if (values == scop.constantInputs.end()) {
+      continue;
+    }
+    ss << "__constant__ __align__(16) const " << p.type() << " "
+       << makeConstantInputName(p.name(), specializedName) << "[] = {"
+       << values->second << "};" << endl;
+  }
+}
+
+// Number of statement instances executed by one pass through the AST "node",
+// counting both branches of conditionals, or 0 if "node" contains a loop.
+size_t countLoopFreeStatements(isl::ast_node node) {
+  if (node.as<isl::ast_node_for>()) {
+    return 0;
+  } else if (auto ifNode = node.as<isl::ast_node_if>()) {
+    auto nThen = countLoopFreeStatements(ifNode.get_then());
+    if (nThen == 0 || !ifNode.has_else()) {
+      return nThen;
+    }
+    auto nElse = countLoopFreeStatements(ifNode.get_else());
+    return nElse == 0 ? 0 : nThen + nElse;
+  } else if (auto blockNode = node.as<isl::ast_node_block>()) {
+    size_t n = 0;
+    for (auto child : blockNode.get_children()) {
+      auto nChild = countLoopFreeStatements(child);
+      if (nChild == 0) {
+        return 0;
+      }
+      n += nChild;
+    }
+    return n;
   }
+  return 1;
 }
 
 void AstPrinter::emitFor(isl::ast_node_for node) {
   WS ws;
+  // Innermost loops that were not fully unrolled are left to the CUDA
+  // compiler to unroll partially, remainder included, by the largest factor
+  // that keeps the unrolled body within "unroll" statement instances.
+  if (context_.mappedScop.useUnrollPragma) {
+    auto nStatements = countLoopFreeStatements(node.get_body());
+    auto factor =
+        nStatements == 0 ? 0 : context_.mappedScop.unroll / nStatements;
+    if (factor > 1) {
+      context_.ss << ws.tab() << "#pragma unroll " << factor << endl;
+    }
+  }
   context_.ss << ws.tab();
   string iter = node.get_iterator().to_C_str();
   context_.ss << "for (int " << iter << " = " << node.get_init().to_C_str()
@@ -264,8 +438,8 @@ void emitReductionOpName(const Halide::Expr& e, const CodegenContext& context) {
   }
 }
 
-// Emit a cross-thread tree reduce.
-// For now this is only expected to work with threadIdx.x.
+// Emit a cross-thread tree reduce along threadIdx.x, or along threadIdx.x
+// and threadIdx.y together for the reductions of two loops.
 void emitTreeSyncCall(
     isl::id id,
     isl::id reductionUpdateNodeId,
@@ -283,7 +457,14 @@ void emitTreeSyncCall(
                                 TY.mappingSize(context.mappedScop.numThreads),
                                 TZ.mappingSize(context.mappedScop.numThreads)};
 
-  context.ss << tc::code::cuda::kCUBReductionName;
+  // There is no CUB counterpart of the reductions along x and y.
+  if (context.scop().treeSyncsAlongXY.count(id) == 1) {
+    context.ss << tc::code::cuda::kWarpReductionAlongXYName;
+  } else {
+    context.ss << (context.mappedScop.useWarpShuffleReductions
+                       ? tc::code::cuda::kWarpReductionName
+                       : tc::code::cuda::kCUBReductionName);
+  }
 
   // Template mapping dimension
   context.ss << "<";
@@ -310,18 +491,54 @@ void emitTreeSyncCall(
   context.ss << ");" << endl;
 }
 
+// Declare the variables bound by the Let expressions of "e", the common
+// subexpressions tc2halide factored out, in a new scope.
+// Return true if a scope was opened, the caller closes it after emitting the
+// statement.
+bool emitLetDeclarations(
+    const Halide::Expr& e,
+    const CodegenStatementContext& context,
+    const map<string, string>& substitutions) {
+  class CollectLets : public Halide::Internal::IRVisitor {
+    using Halide::Internal::IRVisitor::visit;
+    void visit(const Halide::Internal::Let* op) {
+      op->value.accept(this);
+      lets.push_back(op);
+      op->body.accept(this);
+    }
+
+   public:
+    vector<const Halide::Internal::Let*> lets;
+  } collector;
+  e.accept(&collector);
+  if (collector.lets.empty()) {
+    return false;
+  }
+  context.ss << "{" << endl;
+  for (auto let : collector.lets) {
+    WS ws;
+    context.ss << ws.tab() << let->value.type() << " " << let->name << " = ";
+    detail::emitHalideExpr(let->value, context, substitutions);
+    context.ss << ";" << endl;
+  }
+  WS ws;
+  context.ss << ws.tab();
+  return true;
+}
+
 void emitUserStmt(isl::id stmtId, const CodegenStatementContext& context) {
   CHECK(context.scop().halide.statements.count(stmtId))
       << "No stmt with id " << stmtId << "\n";
   auto provide = context.scop().halide.statements.at(stmtId);
   auto op = provide.as<Halide::Internal::Provide>();
   CHECK(op) << "Expected a Provide node: " << provide << '\n';
-  detail::emitMappedTensorAccess(op->name, op, op->args, context);
-  context.ss << " = ";
   CHECK(op->values.size() == 1)
       << "Multi-valued Provide: " << Halide::Internal::Stmt(provide) << "\n";
+  auto scoped = emitLetDeclarations(op->values[0], context, {});
+  detail::emitMappedTensorAccess(op->name, op, op->args, context);
+  context.ss << " = ";
   detail::emitHalideExpr(op->values[0], context);
-  context.ss << ";" << endl;
+  context.ss << ";" << (scoped ? " }" : "") << endl;
 }
 
 void emitReductionUpdate(
@@ -334,15 +551,42 @@ void emitReductionUpdate(
   // but it's easy enough to be generic here to accommodate more
   // complex reductions in the future.
   string tmp = makeReductionTmpName(stmtId, context.scop());
-  context.ss << tmp << " = ";
   auto provide = context.scop()
                      .halide.statements.at(stmtId)
                      .as<Halide::Internal::Provide>();
   Halide::Expr rhs = provide->values[0];
   map<string, string> substitutions;
   substitutions[provide->name] = tmp;
+  auto scoped = emitLetDeclarations(rhs, context, substitutions);
+  context.ss << tmp << " = ";
   detail::emitHalideExpr(rhs, context, substitutions);
-  context.ss << ";" << endl;
+  context.ss << ";" << (scoped ? " }" : "") << endl;
+}
+
+// Emit the update f(x) = f(x) + foo of a reduction split across blocks
+// as atomicAdd(&f(x), foo), or as its warp-aggregated variant.
+void emitAtomicUpdate(isl::id stmtId, const CodegenStatementContext& context) {
+  auto provide = context.scop().halide.statements.at(stmtId);
+  auto op = provide.as<Halide::Internal::Provide>();
+  auto call = op->values[0].as<Halide::Internal::Call>();
+  CHECK(call && call->is_intrinsic(tc2halide::kReductionUpdate));
+  auto add = call->args[0].as<Halide::Internal::Add>();
+  CHECK(add) << "only sums can be split across blocks: " << provide;
+  auto isRecursive = [op](const Halide::Expr& e) {
+    auto c = e.as<Halide::Internal::Call>();
+    return c && c->name == op->name;
+  };
+  CHECK(isRecursive(add->a) || isRecursive(add->b))
+      << "no recursive call in reduction update: " << provide;
+  auto value = isRecursive(add->a) ? add->b : add->a;
+  auto scoped = emitLetDeclarations(value, context, {});
+  context.ss << (context.mappedScop.useWarpAggregatedAtomics
+                     ? "__tc::atomicAddAggregated(&"
+                     : "atomicAdd(&");
+  detail::emitMappedTensorAccess(op->name, op, op->args, context);
+  context.ss << ", ";
+  detail::emitHalideExpr(value, context);
+  context.ss << ");" << (scoped ? " }" : "") << endl;
 }
 
 void emitReductionInit(
@@ -364,11 +608,40 @@ void emitReductionInit(
   context.ss << ";" << endl;
 }
 
+// Point the double-buffered promoted arrays of the swap statement to their
+// other buffer, e.g.
+//   _A_0 = _A_0 == _A_0_buffers[0] ? _A_0_buffers[1] : _A_0_buffers[0];
+void emitBufferSwap(isl::id stmtId, const CodegenContext& context) {
+  for (auto groupId : context.scop().bufferSwapGroups(stmtId)) {
+    auto name = groupId.get_name();
+    auto buffers = name + kDoubleBufferSuffix;
+    context.ss << name << " = " << name << " == " << buffers << "[0] ? "
+               << buffers << "[1] : " << buffers << "[0]; ";
+  }
+  context.ss << ";" << endl;
+}
+
 namespace {
 template <typename AFF>
 void emitAccess(AFF access, const CodegenStatementContext& context) {
   context.ss << context.build().access_from(access).to_C_str();
 }
+
+// Bytes of an element of the input or output tensorId, 0 for other tensors.
+size_t elementBytes(const Scop& scop, isl::id tensorId) {
+  auto name = tensorId.get_name();
+  for (auto o : scop.halide.outputs) {
+    if (o.name() == name) {
+      return o.type().bytes();
+    }
+  }
+  for (auto i : scop.halide.inputs) {
+    if (i.name() == name) {
+      return i.type().bytes();
+    }
+  }
+  return 0;
+}
 } // namespace
 
 void emitCopyStmt(const CodegenStatementContext& context) {
@@ -378,8 +651,34 @@ void emitCopyStmt(const CodegenStatementContext& context) {
   auto promoted = iteratorMap.range_factor_range();
   auto original = iteratorMap.range_factor_domain().range_factor_range();
   auto isRead = stmtId.get_name() == kReadIdName;
-
-  if (isRead) {
+  auto groupId = promoted.get_tuple_id(isl::dim_type::out);
+  const auto& decl = context.scop().promotedDecls().at(groupId);
+  auto vectorWidth = decl.readVectorWidth;
+  auto copyBytes = vectorWidth * elementBytes(context.scop(), decl.tensorId);
+
+  if (isRead && context.mappedScop.useAsyncCopies &&
+      decl.kind == Scop::PromotedDecl::Kind::SharedMem &&
+      (copyBytes == 4 || copyBytes == 8 || copyBytes == 16)) {
+    // Reads into shared memory of words of 4, 8 or 16 bytes may bypass the
+    // registers, e.g.
+    //   __tc::cpAsync<16>(&_A_0[c2][c3], &A[c0 + c2][c1 + c3]);
+    // The synchronizations wait for them, see emitStmt.
+    context.ss << "__tc::cpAsync<" << copyBytes << ">(&";
+    emitAccess(isl::multi_pw_aff(promoted), context);
+    context.ss << ", &";
+    emitAccess(isl::multi_pw_aff(original), context);
+    context.ss << ")";
+  } else if (isRead && vectorWidth > 1) {
+    // Vectorized reads copy vectorWidth consecutive float elements, e.g.
+    //   *reinterpret_cast<float4*>(&_A_0[c2][c3]) =
+    //       *reinterpret_cast<const float4*>(&A[c0 + c2][c1 + c3]);
+    auto vectorType = "float" + std::to_string(vectorWidth);
+    context.ss << "*reinterpret_cast<" << vectorType << "*>(&";
+    emitAccess(isl::multi_pw_aff(promoted), context);
+    context.ss << ") = *reinterpret_cast<const " << vectorType << "*>(&";
+    emitAccess(isl::multi_pw_aff(original), context);
+    context.ss << ")";
+  } else if (isRead) {
     emitAccess(isl::multi_pw_aff(promoted), context);
     context.ss << " = ";
     emitAccess(isl::multi_pw_aff(original), context);
@@ -400,6 +699,17 @@ void AstPrinter::emitStmt(isl::ast_node_user node) {
       << "no info for node " << nodeId;
 
   WS ws;
+  if (FLAGS_cuda_line_info) {
+    // The initializations of the reductions compute their statement.
+    auto sourceId = context_.scop().isDefaultReductionInitId(stmtId)
+        ? context_.scop().getReductionUpdateForDefaultInit(stmtId)
+        : stmtId;
+    const auto& ranges = context_.scop().halide.sourceRanges;
+    if (ranges.count(sourceId) == 1) {
+      context_.ss << ws.tab() << makeTcStatementMarker(ranges.at(sourceId))
+                  << std::endl;
+    }
+  }
   context_.ss << ws.tab();
 
   if (context_.scop().isTreeSyncId(stmtId)) {
@@ -414,7 +724,16 @@ void AstPrinter::emitStmt(isl::ast_node_user node) {
     emitReductionUpdate(stmtId, statementContext);
     reductionUpdateNodeId_ = nodeId;
   } else if (context_.scop().isSyncId(stmtId)) {
+    // The copies to shared memory that precede the synchronization are
+    // complete when it returns.
+    if (context_.mappedScop.useAsyncCopies) {
+      context_.ss << "__tc::cpAsyncWait(); ";
+    }
     context_.ss << "__syncthreads();" << std::endl;
+  } else if (context_.scop().isWarpSyncId(stmtId)) {
+    context_.ss << "__tc::syncWarp();" << std::endl;
+  } else if (context_.scop().isBufferSwapId(stmtId)) {
+    emitBufferSwap(stmtId, context_);
   } else if (
       stmtId.get_name() == kReadIdName || stmtId.get_name() == kWriteIdName) {
     emitCopyStmt(statementContext);
@@ -423,7 +742,11 @@ void AstPrinter::emitStmt(isl::ast_node_user node) {
     CHECK_EQ(stmtId, mappedStmtId)
         << "statement ids in expr (" << stmtId << ") and in iteratorMaps ("
         << mappedStmtId << ") do not match";
-    emitUserStmt(stmtId, statementContext);
+    if (context_.scop().atomicUpdates.count(stmtId) == 1) {
+      emitAtomicUpdate(stmtId, statementContext);
+    } else {
+      emitUserStmt(stmtId, statementContext);
+    }
   }
 }
 
@@ -499,6 +822,68 @@ bool is_identifier_or_nonnegative_integer(isl::ast_expr expr) {
     return false;
   return isl::manage(isl_ast_expr_get_val(expr.get())).is_nonneg();
 }
+
+// Whether the tensor access belongs to one of the active promotions.
+bool isPromoted(
+    const Halide::Internal::Call* access,
+    const CodegenStatementContext& context) {
+  auto refId = context.scop().halide.accesses.at(access);
+  for (const auto& pi : context.activePromotions()) {
+    if (pi.group->referenceIds().count(refId)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The precision of the float builtins and divisions of the statement of
+// the context, see CudaMappingOptionsProto::precise_tensors.
+MathPrecision statementMathPrecision(const CodegenStatementContext& context) {
+  const auto& mscop = context.mappedScop;
+  if (mscop.preciseTensors.empty()) {
+    return mscop.mathPrecision;
+  }
+  const auto& statements = context.scop().halide.statements;
+  auto stmt = statements.find(context.statementId());
+  auto provide = stmt == statements.end()
+      ? nullptr
+      : stmt->second.as<Halide::Internal::Provide>();
+  if (provide && mscop.preciseTensors.count(provide->name)) {
+    return MathPrecision::PreciseMath;
+  }
+  return mscop.mathPrecision;
+}
+
+// The hardware approximations of the float builtins, by builtin name.
+const std::unordered_map<std::string, std::string>& fastIntrinsics() {
+  static const std::unordered_map<std::string, std::string> intrinsics{
+      {"exp", "__expf"},
+      {"exp10", "__exp10f"},
+      {"log", "__logf"},
+      {"log2", "__log2f"},
+      {"log10", "__log10f"},
+      {"sin", "__sinf"},
+      {"cos", "__cosf"},
+      {"tan", "__tanf"},
+      {"pow", "__powf"},
+      {"fdivide", "__fdividef"},
+  };
+  return intrinsics;
+}
+
+// Is e the constant v, possibly converted to another type?
+bool isConstant(const Halide::Expr& e, double v) {
+  if (auto cast = e.as<Halide::Internal::Cast>()) {
+    return isConstant(cast->value, v);
+  }
+  if (auto f = e.as<Halide::Internal::FloatImm>()) {
+    return f->value == v;
+  }
+  if (auto i = e.as<Halide::Internal::IntImm>()) {
+    return i->value == v;
+  }
+  return false;
+}
 } // namespace
 
 void emitHalideExpr(
@@ -508,12 +893,21 @@ void emitHalideExpr(
   class EmitHalide : public Halide::Internal::IRPrinter {
     using Halide::Internal::IRPrinter::visit;
     void visit(const Halide::Internal::Variable* op) {
-      auto pwAff = tc::polyhedral::detail::makeAffFromMappedExpr(
-          Halide::Expr(op), context);
-      auto expr = context.build().expr_from(pwAff);
-      auto s = expr.to_C_str();
-      if (!is_identifier_or_nonnegative_integer(expr)) {
-        s = "(" + s + ")";
+      // Only the variables of Let expressions have floating point types,
+      // they are declared by emitLetDeclarations.
+      if (op->type.is_float()) {
+        context.ss << op->name;
+        return;
+      }
+      auto& s = context.mappedVariables[op->name];
+      if (s.empty()) {
+        auto pwAff = tc::polyhedral::detail::makeAffFromMappedExpr(
+            Halide::Expr(op), context);
+        auto expr = context.build().expr_from(pwAff);
+        s = expr.to_C_str();
+        if (!is_identifier_or_nonnegative_integer(expr)) {
+          s = "(" + s + ")";
+        }
       }
       context.ss << s;
     }
@@ -529,19 +923,154 @@ void emitHalideExpr(
           op->is_intrinsic(tc2halide::kReductionInit) ||
           op->is_intrinsic(tc2halide::kReductionUpdate)) {
         op->args[0].accept(this);
+      } else if (op->is_intrinsic(tc2halide::kDp4a)) {
+        emitDp4a(op, Halide::Internal::make_zero(op->type));
+      } else if (op->is_intrinsic(tc2halide::kLoad4) && !anyPromoted(op)) {
+        // The 4 elements are consecutive, load them from the first one.
+        auto first = op->args[0].as<Halide::Internal::Call>();
+        context.ss << (isReadOnlyInKernel(context.scop(), first->name)
+                           ? "__tc::ldg4(&"
+                           : "__tc::load4(&")
+                   << first->name;
+        for (const auto& e : first->args) {
+          context.ss << "[";
+          emitHalideExpr(e, context);
+          context.ss << "]";
+        }
+        context.ss << ")";
+      } else if (
+          op->is_intrinsic(tc2halide::kLoad4) ||
+          op->is_intrinsic(tc2halide::kPack4)) {
+        context.ss << "__tc::pack4(";
+        for (size_t i = 0; i < op->args.size(); ++i) {
+          context.ss << (i > 0 ? ", " : "");
+          op->args[i].accept(this);
+        }
+        context.ss << ")";
+      } else if (
+          fastMath(op->type) &&
+          op->call_type == Halide::Internal::Call::PureExtern &&
+          fastIntrinsics().count(op->name)) {
+        emitCall(fastIntrinsics().at(op->name), op->args);
+      } else if (
+          fastActivations(op->type) &&
+          op->call_type == Halide::Internal::Call::PureExtern &&
+          op->name == "tanh") {
+        emitCall("__tc::fastTanh", op->args);
+      } else {
+        IRPrinter::visit(op);
+      }
+    }
+    // Approximate the float divisions, and the sigmoids 1 / (1 + exp(x))
+    // with FastActivations.
+    void visit(const Halide::Internal::Div* op) {
+      if (!fastMath(op->type)) {
+        IRPrinter::visit(op);
+        return;
+      }
+      auto exponent = sigmoidExponent(op);
+      if (fastActivations(op->type) && exponent.defined()) {
+        // 1 / (1 + exp(0 - x)) is emitted as fastSigmoid(x).
+        auto negation = exponent.as<Halide::Internal::Sub>();
+        context.ss << "__tc::fastSigmoid(";
+        if (negation && isConstant(negation->a, 0)) {
+          negation->b.accept(this);
+        } else {
+          context.ss << "-(";
+          exponent.accept(this);
+          context.ss << ")";
+        }
+        context.ss << ")";
+        return;
+      }
+      emitCall("__fdividef", {op->a, op->b});
+    }
+    // Accumulate in the dot products of 4 bytes, i.e. emit acc + Dp4a(a, b)
+    // as __tc::dp4a(a, b, acc).
+    void visit(const Halide::Internal::Add* op) {
+      if (isDp4a(op->b)) {
+        emitDp4a(op->b.as<Halide::Internal::Call>(), op->a);
+      } else if (isDp4a(op->a)) {
+        emitDp4a(op->a.as<Halide::Internal::Call>(), op->b);
       } else {
         IRPrinter::visit(op);
       }
     }
+    void visit(const Halide::Internal::Let* op) {
+      op->body.accept(this);
+    }
+    // The argument of exp if op is 1 / (1 + exp(x)) or 1 / (exp(x) + 1),
+    // an undefined expression otherwise.
+    static Halide::Expr sigmoidExponent(const Halide::Internal::Div* op) {
+      auto add = op->b.as<Halide::Internal::Add>();
+      if (!isConstant(op->a, 1) || !add) {
+        return Halide::Expr();
+      }
+      const Halide::Internal::Call* call = nullptr;
+      if (isConstant(add->a, 1)) {
+        call = add->b.as<Halide::Internal::Call>();
+      } else if (isConstant(add->b, 1)) {
+        call = add->a.as<Halide::Internal::Call>();
+      }
+      if (!call || call->call_type != Halide::Internal::Call::PureExtern ||
+          call->name != "exp") {
+        return Halide::Expr();
+      }
+      return call->args[0];
+    }
+    // Only the operations on 32-bit floats have approximations.
+    bool fastMath(const Halide::Type& t) const {
+      return (precision == MathPrecision::FastIntrinsics ||
+              precision == MathPrecision::FastActivations) &&
+          t == Halide::Float(32);
+    }
+    bool fastActivations(const Halide::Type& t) const {
+      return precision == MathPrecision::FastActivations &&
+          t == Halide::Float(32);
+    }
+    void emitCall(const std::string& name, const vector<Halide::Expr>& args) {
+      context.ss << name << "(";
+      for (size_t i = 0; i < args.size(); ++i) {
+        context.ss << (i > 0 ? ", " : "");
+        args[i].accept(this);
+      }
+      context.ss << ")";
+    }
+    static bool isDp4a(const Halide::Expr& e) {
+      auto call = e.as<Halide::Internal::Call>();
+      return call && call->is_intrinsic(tc2halide::kDp4a);
+    }
+    void emitDp4a(const Halide::Internal::Call* op, const Halide::Expr& acc) {
+      context.ss << "__tc::dp4a(";
+      op->args[0].accept(this);
+      context.ss << ", ";
+      op->args[1].accept(this);
+      context.ss << ", ";
+      acc.accept(this);
+      context.ss << ")";
+    }
+    // Promoted elements of a word are not necessarily consecutive.
+    bool anyPromoted(const Halide::Internal::Call* op) const {
+      for (const auto& e : op->args) {
+        if (isPromoted(e.as<Halide::Internal::Call>(), context)) {
+          return true;
+        }
+      }
+      return false;
+    }
     // TODO: handle casts
     const CodegenStatementContext& context;
     const map<string, string>& substitutions;
+    const MathPrecision precision;
 
    public:
     EmitHalide(
         const CodegenStatementContext& ctx,
         const map<string, string>& substitutions)
-        : IRPrinter(ctx.ss), context(ctx), substitutions(substitutions) {}
+        : IRPrinter(ctx.ss),
+          context(ctx),
+          substitutions(substitutions),
+          precision(statementMathPrecision(ctx)) {}
   } printer(context, substitutions);
 
   e.accept(&printer);
@@ -571,7 +1100,7 @@ void emitMappedTensorAccess(
   auto refId = context.scop().halide.accesses.at(node);
 
   Scop::PromotionInfo promotionInfo;
-  for (auto pi : context.activePromotions()) {
+  for (const auto& pi : context.activePromotions()) {
     if (pi.group->referenceIds().count(refId)) {
       CHECK(!promotionInfo.groupId)
           << "reference " << refId
@@ -581,25 +1110,46 @@ void emitMappedTensorAccess(
     }
   }
 
-  // Not promoted, emitting just the mapped subscript.
+  // Not promoted, emitting just the mapped subscript.  Load the elements of
+  // tensors that the kernel does not write through the read-only data cache.
   if (!promotionInfo.groupId) {
+    auto readOnly = isReadOnlyInKernel(context.scop(), name);
+    if (readOnly) {
+      context.ss << "__tc::ldg(&";
+    }
     context.ss << name;
     for (auto e : subscripts) {
       context.ss << "[";
       emitHalideExpr(e, context);
       context.ss << "]";
     }
+    if (readOnly) {
+      context.ss << ")";
+    }
     return;
   }
 
   auto tensorId =
       context.scop().promotedDecls().at(promotionInfo.groupId).tensorId;
 
+  // The promotion only shifts each subscript by an offset that depends on
+  // the outer schedule, see TensorReferenceGroup::promotion.  Data-dependent
+  // subscripts, e.g., the indices of a gather, are emitted as they are and
+  // shifted by the offset, computed from a zero subscript.
+  std::vector<bool> indirect;
+  auto affineSubscripts = subscripts;
+  for (auto& e : affineSubscripts) {
+    indirect.push_back(context.makeIslAffFromExpr(e).is_null());
+    if (indirect.back()) {
+      e = Halide::Internal::make_zero(e.type());
+    }
+  }
+
   // Here and below in comments: D = domain, O = original tensor, P = promoted
   // tensor, S = partial schedule, A = AST loops;
   // MA = multi_aff, PMA = pw_multi_aff
-  auto access =
-      makeMultiAffAccess(tensorId, subscripts, context); // MA :: D -> O
+  auto access = makeMultiAffAccess(
+      tensorId, affineSubscripts, context); // MA :: D -> O
   auto promotion = promotionInfo.group->promotion(); // MA :: [S -> O] -> P
   promotion = promotion.set_tuple_id(isl::dim_type::out, promotionInfo.groupId);
   auto iteratorMap = context.iteratorMap(); // PMA :: A -> D
@@ -619,7 +1169,24 @@ void emitMappedTensorAccess(
   auto astToPromoted =
       isl::pw_multi_aff(promotion).pullback(astToScheduledOriginal);
 
-  emitAccess(astToPromoted, context);
+  if (std::find(indirect.begin(), indirect.end(), true) == indirect.end()) {
+    emitAccess(astToPromoted, context);
+    return;
+  }
+  // The subscripts of the promoted array follow its layout.
+  const auto& layout = promotionInfo.group->layout;
+  context.ss << promotionInfo.groupId.get_name();
+  for (size_t i = 0; i < subscripts.size(); ++i) {
+    auto dim = layout.empty() ? i : layout[i];
+    context.ss << "[";
+    if (indirect[dim]) {
+      context.ss << "(";
+      emitHalideExpr(subscripts[dim], context);
+      context.ss << ") + ";
+    }
+    auto offset = context.build().expr_from(astToPromoted.get_pw_aff(i));
+    context.ss << offset.to_C_str() << "]";
+  }
 }
 
 } // namespace detail
@@ -631,7 +1198,22 @@ void emitMappedTensorAccess(
 void emitThreadIdInit(stringstream& ss, const MappedScop& scop) {
   WS ws;
   ss << ws.tab();
-  ss << "int b0 = blockIdx.x; int b1 = blockIdx.y; int b2 = blockIdx.z;\n";
+  if (scop.blockSwizzle > 1 and scop.numBlocks.view.size() > 1) {
+    // The blocks are launched in the order of their linear index, in which
+    // each group of blockSwizzle rows (values of b1) is walked column by
+    // column.  The last group may have fewer rows.
+    auto group = std::to_string(scop.blockSwizzle);
+    ss << "int _tc_id = blockIdx.x + blockIdx.y * gridDim.x; "
+       << "int _tc_group = " << group << " * gridDim.x; "
+       << "int _tc_row = _tc_id / _tc_group * " << group << "; "
+       << "int _tc_rows = min((int)gridDim.y - _tc_row, " << group << ");\n";
+    ss << ws.tab();
+    ss << "int b0 = _tc_id % _tc_group / _tc_rows; "
+       << "int b1 = _tc_row + _tc_id % _tc_group % _tc_rows; "
+       << "int b2 = blockIdx.z;\n";
+  } else {
+    ss << "int b0 = blockIdx.x; int b1 = blockIdx.y; int b2 = blockIdx.z;\n";
+  }
   ss << ws.tab();
   ss << "int t0 = threadIdx.x; int t1 = threadIdx.y; int t2 = threadIdx.z;\n";
 }
@@ -648,31 +1230,144 @@ void emitTmpDecl(stringstream& ss, const Scop& scop) {
   }
 }
 
-void emitPromotedArrayViewsHalide(stringstream& ss, const Scop& scop) {
+namespace {
+// Each promoted array is padded to this alignment in the dynamic shared
+// memory buffer, which makes the total size independent of the order of the
+// declarations.
+constexpr size_t kDynamicSharedMemoryAlignment = 16;
+constexpr auto kDynamicSharedMemoryName = "_tc_dynamic_shared";
+
+// Element type of the promoted copy "decl".  Register copies of float16
+// tensors are kept in float so that reductions accumulate in full precision.
+Halide::Type promotedElementType(
+    const Scop& scop,
+    const Scop::PromotedDecl& decl) {
+  auto name = decl.tensorId.get_name();
+  Halide::Type t;
+  for (auto o : scop.halide.outputs) {
+    if (o.name() == name) {
+      t = o.type();
+    }
+  }
+  for (auto i : scop.halide.inputs) {
+    if (i.name() == name) {
+      t = i.type();
+    }
+  }
+  if (decl.kind == Scop::PromotedDecl::Kind::Register &&
+      t == Halide::Float(16)) {
+    return Halide::Float(32);
+  }
+  return t;
+}
+
+size_t paddedSharedMemoryBytes(
+    const Scop::PromotedDecl& decl,
+    const Halide::Type& t) {
+  size_t size = t.bytes() * (decl.doubleBuffered ? 2 : 1);
+  for (auto s : decl.sizes) {
+    size *= s;
+  }
+  return (size + kDynamicSharedMemoryAlignment - 1) /
+      kDynamicSharedMemoryAlignment * kDynamicSharedMemoryAlignment;
+}
+} // namespace
+
+size_t dynamicSharedMemorySize(const Scop& scop) {
+  size_t size = 0;
+  for (const auto& p : scop.promotedDecls()) {
+    if (p.second.kind == Scop::PromotedDecl::Kind::SharedMem) {
+      auto t = promotedElementType(scop, p.second);
+      size += paddedSharedMemoryBytes(p.second, t);
+    }
+  }
+  return size;
+}
+
+size_t privateMemorySize(const Scop& scop) {
+  size_t size = 0;
+  for (const auto& p : scop.promotedDecls()) {
+    if (p.second.kind == Scop::PromotedDecl::Kind::Register) {
+      size_t bytes = promotedElementType(scop, p.second).bytes();
+      for (auto s : p.second.sizes) {
+        bytes *= s;
+      }
+      size += bytes;
+    }
+  }
+  return size;
+}
+
+// With dynamic shared memory, promoted arrays are pointers to arrays
+// carved from a single extern buffer, e.g.
+//   float (*_A_0)[33] = reinterpret_cast<float (*)[33]>(buffer + offset);
+// and are indexed exactly like the statically sized arrays.
+// Double-buffered arrays point to one of a pair of buffers, e.g.
+//   __shared__ float _A_0_buffers[2][32][33];
+//   float (*_A_0)[33] = _A_0_buffers[0];
+void emitPromotedArrayViewsHalide(
+    stringstream& ss,
+    const Scop& scop,
+    bool useDynamicSharedMemory) {
+  bool emittedBuffer = false;
+  size_t offset = 0;
   for (const auto& p : scop.promotedDecls()) {
     WS ws;
-    ss << ws.tab();
     auto viewName = p.first.get_name();
-    auto tensorName = p.second.tensorId.get_name();
-    Halide::Type t;
-    for (auto o : scop.halide.outputs) {
-      if (o.name() == tensorName) {
-        t = o.type();
+    auto t = promotedElementType(scop, p.second);
+    bool isShared = p.second.kind == Scop::PromotedDecl::Kind::SharedMem;
+    if (isShared && useDynamicSharedMemory) {
+      if (!emittedBuffer) {
+        ss << ws.tab() << "extern __shared__ __align__("
+           << kDynamicSharedMemoryAlignment << ") char "
+           << kDynamicSharedMemoryName << "[];" << endl;
+        emittedBuffer = true;
       }
-    }
-    for (auto i : scop.halide.inputs) {
-      if (i.name() == tensorName) {
-        t = i.type();
+      stringstream innerSizes;
+      for (size_t i = 1; i < p.second.sizes.size(); ++i) {
+        innerSizes << "[" << p.second.sizes[i] << "]";
       }
+      if (p.second.doubleBuffered) {
+        auto buffersSizes = "[" + std::to_string(p.second.sizes[0]) + "]" +
+            innerSizes.str();
+        ss << ws.tab() << t << " (*" << viewName << kDoubleBufferSuffix
+           << ")" << buffersSizes << " = reinterpret_cast<" << t << " (*)"
+           << buffersSizes << ">(" << kDynamicSharedMemoryName << " + "
+           << offset << ");" << endl;
+        ss << ws.tab() << t << " (*" << viewName << ")" << innerSizes.str()
+           << " = " << viewName << kDoubleBufferSuffix << "[0];" << endl;
+      } else {
+        ss << ws.tab() << t << " (*" << viewName << ")" << innerSizes.str()
+           << " = reinterpret_cast<" << t << " (*)" << innerSizes.str()
+           << ">(" << kDynamicSharedMemoryName << " + " << offset << ");"
+           << endl;
+      }
+      offset += paddedSharedMemoryBytes(p.second, t);
+      continue;
     }
-    if (p.second.kind == Scop::PromotedDecl::Kind::SharedMem) {
+    ss << ws.tab();
+    if (isShared) {
       ss << "__shared__ ";
     }
-    ss << t << " " << viewName;
+    if (p.second.readVectorWidth > 1) {
+      ss << "__align__(" << p.second.readVectorWidth * t.bytes() << ") ";
+    }
+    if (p.second.doubleBuffered) {
+      ss << t << " " << viewName << kDoubleBufferSuffix << "[2]";
+    } else {
+      ss << t << " " << viewName;
+    }
     for (auto s : p.second.sizes) {
       ss << "[" << s << "]";
     }
     ss << ";" << endl;
+    if (p.second.doubleBuffered) {
+      ss << ws.tab() << t << " (*" << viewName << ")";
+      for (size_t i = 1; i < p.second.sizes.size(); ++i) {
+        ss << "[" << p.second.sizes[i] << "]";
+      }
+      ss << " = " << viewName << kDoubleBufferSuffix << "[0];" << endl;
+    }
   }
 }
 
@@ -681,9 +1376,29 @@ size_t& nAstNodes() {
   return n;
 }
 
-string emitCudaKernel(
+string emitTensorCoreMatmulKernel(
     const std::string& specializedName,
     const MappedScop& mscop) {
+  CHECK(mscop.tensorCoreMatmul) << "not a tensor core matmul";
+  const auto& matmul = *mscop.tensorCoreMatmul;
+  stringstream ss;
+  emitKernelSignature(ss, specializedName, mscop);
+  ss << "  " << code::cuda::kWmmaMatmulName << "<" << matmul.m << ", "
+     << matmul.n << ", " << matmul.k << ", " << matmul.tileM << ", "
+     << matmul.tileN << ">(" << makePointerName(matmul.c) << ", "
+     << makePointerName(matmul.a) << ", " << makePointerName(matmul.b)
+     << ");" << endl;
+  ss << "}" << endl;
+  return ss.str();
+}
+
+namespace {
+// Emit the code of "mscop" as a kernel, or as a device function called by a
+// kernel if "global" is not set.
+string emitCudaFunction(
+    const std::string& specializedName,
+    const MappedScop& mscop,
+    bool global) {
   // Expecting a schedule with domain root and context first child.
   CHECK(mscop.schedule()->elemAs<detail::ScheduleTreeElemDomain>());
   CHECK(
@@ -704,12 +1419,13 @@ string emitCudaKernel(
   }
 
   stringstream ss;
-  emitKernelSignature(ss, specializedName, scop);
+  emitConstantInputs(ss, specializedName, scop);
+  emitKernelSignature(ss, specializedName, mscop, global);
   emitThreadIdInit(ss, mscop);
-  emitTensorViews(ss, scop.halide.outputs, paramValues);
-  emitTensorViews(ss, scop.halide.inputs, paramValues);
+  emitTensorViews(ss, scop.halide.outputs, paramValues, scop.tensorStrides);
+  emitTensorViews(ss, scop.halide.inputs, paramValues, scop, specializedName);
   emitTmpDecl(ss, scop);
-  emitPromotedArrayViewsHalide(ss, scop);
+  emitPromotedArrayViewsHalide(ss, scop, mscop.useDynamicSharedMemory);
   NodeInfoMapType nodeInfoMap;
   auto collect = [&nodeInfoMap](
                      isl::ast_node n, isl::ast_build b) -> isl::ast_node {
@@ -757,11 +1473,61 @@ string emitCudaKernel(
   astBuild = astBuild.set_at_each_domain(collect);
   astBuild = astBuild.set_iterators(Codegen::makeLoopIterators(ctx, maxDepth));
   auto astNode = astBuild.node_from(schedule);
+  // Each statement of the AST, unrolled copies included, was annotated.
+  auto maxStatements = FLAGS_cuda_max_kernel_statements;
+  if (maxStatements != 0 && nodeInfoMap.size() > maxStatements) {
+    throw KernelTooLargeException(
+        specializedName + " has " + std::to_string(nodeInfoMap.size()) +
+        " statements, more than --cuda_max_kernel_statements=" +
+        std::to_string(maxStatements));
+  }
   AstPrinter(CodegenContext(ss, mscop, nodeInfoMap)).emit(astNode);
   ss << "}" << endl;
 
   return ss.str();
 }
+} // namespace
+
+string emitCudaKernel(
+    const std::string& specializedName,
+    const MappedScop& mscop) {
+  return emitCudaFunction(specializedName, mscop, true);
+}
+
+string emitCooperativeKernel(
+    const std::string& specializedName,
+    const std::vector<const MappedScop*>& stages) {
+  CHECK(!stages.empty());
+  stringstream ss;
+  for (size_t i = 0; i < stages.size(); ++i) {
+    ss << emitCudaFunction(
+              specializedName + "_stage" + std::to_string(i), *stages[i], false)
+       << endl;
+  }
+  emitKernelSignature(ss, specializedName, *stages.front());
+  for (size_t i = 0; i < stages.size(); ++i) {
+    WS ws;
+    CHECK(stages[i]->numThreads == stages.front()->numThreads)
+        << "stages mapped to different blocks";
+    if (i > 0) {
+      ss << ws.tab() << "__tc::gridSync();" << endl;
+    }
+    // The blocks beyond the grid of the stage would repeat its tiles.
+    auto grid = stages[i]->numBlocks.view.extractDefaultedArray();
+    ss << ws.tab() << "if (blockIdx.x < " << grid[0]
+       << " && blockIdx.y < " << grid[1] << " && blockIdx.z < " << grid[2]
+       << ") {" << endl;
+    {
+      WS inner;
+      ss << inner.tab() << specializedName << "_stage" << i << "(";
+      emitCallArgs(ss, stages[i]->scop());
+      ss << ");" << endl;
+    }
+    ss << ws.tab() << "}" << endl;
+  }
+  ss << "}" << endl;
+  return ss.str();
+}
 
 } // namespace polyhedral
 } // namespace tc
@@ -15,9 +15,11 @@
  */
 #pragma once
 
+#include <memory>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "tc/core/halide2isl.h"
 #include "tc/core/polyhedral/cuda/mapped_scop.h"
@@ -114,15 +116,19 @@ struct CodegenStatementContext : CodegenContext {
   isl::set domain() const {
     return isl::map::from(this->iteratorMap()).range();
   }
-  std::vector<Scop::PromotionInfo> activePromotions() const {
-    std::vector<Scop::PromotionInfo> result;
-    auto dom = isl::union_set(this->domain());
-    for (const auto& kvp : this->scop().activePromotions()) {
-      if (!kvp.first.intersect(dom).is_empty()) {
-        result.emplace_back(kvp.second);
+  // The promotions active at the AST node, computed on first use as they
+  // are looked up for every tensor access of the statement.
+  const std::vector<Scop::PromotionInfo>& activePromotions() const {
+    if (!activePromotions_) {
+      activePromotions_ = std::make_shared<std::vector<Scop::PromotionInfo>>();
+      auto dom = isl::union_set(this->domain());
+      for (const auto& kvp : this->scop().activePromotions()) {
+        if (!kvp.first.intersect(dom).is_empty()) {
+          activePromotions_->emplace_back(kvp.second);
+        }
       }
     }
-    return result;
+    return *activePromotions_;
   }
   // Make an affine function from a Halide Expr that is defined
   // over the instance set of the statement corresponding to
@@ -136,11 +142,43 @@ struct CodegenStatementContext : CodegenContext {
   }
 
   isl::id astNodeId;
+
+  // The AST expressions of the Halide variables of the statement, indexed by
+  // variable name.  A variable is mapped to the same expression in all
+  // subscripts and operands emitted for the AST node, so it is only
+  // converted once per statement instead of once per occurrence.
+  mutable std::unordered_map<std::string, std::string> mappedVariables;
+
+ private:
+  mutable std::shared_ptr<std::vector<Scop::PromotionInfo>> activePromotions_;
 };
 
 std::string emitCudaKernel(
     const std::string& specializedName,
     const MappedScop& scop);
 
+// Emit the kernel running the code of "stages" one after the other, each
+// in a device function called by the blocks of its grid, and synchronizing
+// the whole grid in between with code::cuda::gridSync.  The stages take the
+// same arguments and are mapped to the same block.  The kernel must be
+// launched cooperatively with the largest of their grids.
+std::string emitCooperativeKernel(
+    const std::string& specializedName,
+    const std::vector<const MappedScop*>& stages);
+
+// Emit the kernel computing mscop.tensorCoreMatmul, which must be set,
+// with a call to code::cuda::kWmmaMatmulName.
+std::string emitTensorCoreMatmulKernel(
+    const std::string& specializedName,
+    const MappedScop& mscop);
+
+// Number of bytes of dynamic shared memory needed by the kernel emitted for
+// a MappedScop with useDynamicSharedMemory set.
+size_t dynamicSharedMemorySize(const Scop& scop);
+
+// Number of bytes of the arrays promoted to private memory (registers) by
+// each thread.
+size_t privateMemorySize(const Scop& scop);
+
 } // namespace polyhedral
 } // namespace tc
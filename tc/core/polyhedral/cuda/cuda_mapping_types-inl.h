@@ -18,6 +18,10 @@
 namespace tc {
 namespace polyhedral {
 namespace mapping {
+// The mapping ids belong to the isl context of the calling thread, see
+// globalIslCtx.  isl returns the same id for the same name in a context, so
+// they are created on each call rather than cached, which would tie them to
+// a single context.
 ThreadId ThreadId::makeId(size_t dim) {
   CHECK(dim < 3);
   if (dim == 0) {
@@ -34,19 +38,16 @@ ThreadId ThreadId::makeId(isl::id id) {
   return ThreadId(id, Dim);
 }
 ThreadId ThreadId::x() {
-  static thread_local isl::id x(
-      isl::with_exceptions::globalIslCtx(), std::string("t0"));
-  return makeId<0>(x);
+  return makeId<0>(
+      isl::id(isl::with_exceptions::globalIslCtx(), std::string("t0")));
 }
 ThreadId ThreadId::y() {
-  static thread_local isl::id y(
-      isl::with_exceptions::globalIslCtx(), std::string("t1"));
-  return makeId<1>(y);
+  return makeId<1>(
+      isl::id(isl::with_exceptions::globalIslCtx(), std::string("t1")));
 }
 ThreadId ThreadId::z() {
-  static thread_local isl::id z(
-      isl::with_exceptions::globalIslCtx(), std::string("t2"));
-  return makeId<2>(z);
+  return makeId<2>(
+      isl::id(isl::with_exceptions::globalIslCtx(), std::string("t2")));
 }
 
 BlockId BlockId::makeId(size_t dim) {
@@ -65,19 +66,16 @@ BlockId BlockId::makeId(isl::id id) {
   return BlockId(id, Dim);
 }
 BlockId BlockId::x() {
-  static thread_local isl::id x(
-      isl::with_exceptions::globalIslCtx(), std::string("b0"));
-  return makeId<0>(x);
+  return makeId<0>(
+      isl::id(isl::with_exceptions::globalIslCtx(), std::string("b0")));
 }
 BlockId BlockId::y() {
-  static thread_local isl::id y(
-      isl::with_exceptions::globalIslCtx(), std::string("b1"));
-  return makeId<1>(y);
+  return makeId<1>(
+      isl::id(isl::with_exceptions::globalIslCtx(), std::string("b1")));
 }
 BlockId BlockId::z() {
-  static thread_local isl::id z(
-      isl::with_exceptions::globalIslCtx(), std::string("b2"));
-  return makeId<2>(z);
+  return makeId<2>(
+      isl::id(isl::with_exceptions::globalIslCtx(), std::string("b2")));
 }
 } // namespace mapping
 } // namespace polyhedral
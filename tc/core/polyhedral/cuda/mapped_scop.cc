@@ -17,6 +17,7 @@
 
 #include <algorithm>
 #include <array>
+#include <functional>
 #include <iostream>
 #include <numeric>
 #include <sstream>
@@ -29,15 +30,18 @@
 #include "tc/core/polyhedral/cuda/codegen.h"
 #include "tc/core/polyhedral/cuda/mapping_types.h"
 #include "tc/core/polyhedral/cuda/memory_promotion_heuristic.h"
+#include "tc/core/polyhedral/cuda/sync_minimization.h"
 #include "tc/core/polyhedral/cuda/tighten_launch_bounds.h"
 #include "tc/core/polyhedral/exceptions.h"
 #include "tc/core/polyhedral/functional.h"
 #include "tc/core/polyhedral/schedule_transforms.h"
+#include "tc/core/polyhedral/schedule_tree_proto.h"
 #include "tc/core/polyhedral/schedule_tree_matcher.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/polyhedral/separation.h"
 #include "tc/core/polyhedral/unroll.h"
 #include "tc/core/scope_guard.h"
+#include "tc/core/utils/time.h"
 
 #include <glog/logging.h>
 
@@ -91,6 +95,369 @@ isl::union_set makeFixRemainingZeroFilter(
 bool anyNonCoincidentMember(const detail::ScheduleTreeElemBand* band) {
   return band->nOuterCoincident() < band->nMember();
 }
+
+// Extent of dimension "pos" of "tensor" for the parameter values fixed by
+// "context", or -1 if it is not fixed.
+long fixedExtent(
+    const Halide::OutputImageParam& tensor,
+    int pos,
+    isl::set context) {
+  auto extent = tensor.dim(pos).extent();
+  if (auto value = Halide::Internal::as_const_int(extent)) {
+    return *value;
+  }
+  auto var = extent.as<Halide::Internal::Variable>();
+  for (int i = 0; var && i < context.n_param(); ++i) {
+    if (context.get_space().get_dim_name(isl::dim_type::param, i) ==
+        var->name) {
+      auto val = context.plain_get_val_if_fixed(isl::dim_type::param, i);
+      return val.is_nan() ? -1 : val.get_num_si();
+    }
+  }
+  return -1;
+}
+
+// Name of "e" if it is a variable, an empty string otherwise.
+std::string variableName(const Halide::Expr& e) {
+  auto var = e.as<Halide::Internal::Variable>();
+  return var ? var->name : "";
+}
+
+// Does the band member "member" of "band" only depend on the loop iterator
+// "name" of statement "stmtId" for the instances of that statement?
+bool memberOnlyInvolves(
+    const Scop& scop,
+    const detail::ScheduleTreeElemBand* band,
+    size_t member,
+    isl::id stmtId,
+    const std::string& name) {
+  const auto& iterators = scop.halide.iterators.at(stmtId);
+  int pos = std::find(iterators.begin(), iterators.end(), name) -
+      iterators.begin();
+  for (const auto& pa : isl::UPA(band->mupa_.get_union_pw_aff(member))) {
+    auto space = pa.pa.get_space();
+    if (space.get_tuple_id(isl::dim_type::in) != stmtId) {
+      continue;
+    }
+    for (int i = 0; i < space.dim(isl::dim_type::in); ++i) {
+      if (pa.pa.involves_dims(isl::dim_type::in, i, 1) != (i == pos)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// Match a scop made up of c(m, n) +=! a(m, k) * b(k, n) on float16 inputs a
+// and b (possibly converted to the float16 or float32 type of c) with sizes
+// multiple of 16, tiled by "tileSizes" along m and n in the outermost band
+// "band" with tile sizes that are multiples of 16 as well.
+std::unique_ptr<TensorCoreMatmul> matchTensorCoreMatmul(
+    const Scop& scop,
+    const detail::ScheduleTree* band,
+    const std::vector<size_t>& tileSizes) {
+  using namespace Halide::Internal;
+
+  auto initsUpdates = reductionInitsUpdates(scop.domain(), scop);
+  if (initsUpdates.second.size() != 1 || initsUpdates.first.is_empty()) {
+    return nullptr;
+  }
+  auto updateId = initsUpdates.second[0];
+  auto op = scop.halide.statements.at(updateId).as<Provide>();
+  auto call = op->values[0].as<Call>();
+  auto type = op->values[0].type();
+  if (op->args.size() != 2 || !call || isScatterUpdate(updateId, scop) ||
+      !call->is_intrinsic(tc2halide::kReductionUpdate) ||
+      (type != Halide::Float(32) && type != Halide::Float(16))) {
+    return nullptr;
+  }
+  auto add = call->args[0].as<Add>();
+  if (!add) {
+    return nullptr;
+  }
+  auto isRecursive = [op](const Halide::Expr& e) {
+    auto c = e.as<Call>();
+    return c && c->name == op->name;
+  };
+  auto other = isRecursive(add->a) ? add->b : add->a;
+  auto mul = other.as<Mul>();
+  if (!(isRecursive(add->a) || isRecursive(add->b)) || !mul) {
+    return nullptr;
+  }
+  auto stripCast = [](const Halide::Expr& e) {
+    auto cast = e.as<Cast>();
+    return cast ? cast->value : e;
+  };
+  auto lhs = stripCast(mul->a).as<Call>();
+  auto rhs = stripCast(mul->b).as<Call>();
+  if (!lhs || !rhs || lhs->args.size() != 2 || rhs->args.size() != 2) {
+    return nullptr;
+  }
+  auto m = variableName(op->args[0]);
+  auto n = variableName(op->args[1]);
+  if (variableName(lhs->args[0]) != m) {
+    std::swap(lhs, rhs);
+  }
+  auto k = variableName(lhs->args[1]);
+  if (m.empty() || n.empty() || k.empty() || m == n || k == m || k == n ||
+      variableName(lhs->args[0]) != m || variableName(rhs->args[0]) != k ||
+      variableName(rhs->args[1]) != n) {
+    return nullptr;
+  }
+  const Halide::ImageParam* a = nullptr;
+  const Halide::ImageParam* b = nullptr;
+  for (const auto& input : scop.halide.inputs) {
+    if (input.name() == lhs->name) {
+      a = &input;
+    }
+    if (input.name() == rhs->name) {
+      b = &input;
+    }
+  }
+  if (!a || !b || a->type() != Halide::Float(16) ||
+      b->type() != Halide::Float(16)) {
+    return nullptr;
+  }
+
+  auto context = scop.globalParameterContext;
+  auto sizeM = fixedExtent(*a, 0, context);
+  auto sizeK = fixedExtent(*a, 1, context);
+  auto sizeN = fixedExtent(*b, 1, context);
+  for (auto size : {sizeM, sizeN, sizeK}) {
+    if (size <= 0 || size % 16 != 0) {
+      return nullptr;
+    }
+  }
+  if (fixedExtent(*b, 0, context) != sizeK) {
+    return nullptr;
+  }
+
+  auto bandNode = band->elemAs<detail::ScheduleTreeElemBand>();
+  if (!bandNode || bandNode->nMember() < 2 || tileSizes.size() < 2 ||
+      !memberOnlyInvolves(scop, bandNode, 0, updateId, m) ||
+      !memberOnlyInvolves(scop, bandNode, 1, updateId, n)) {
+    return nullptr;
+  }
+  auto tileM = tileSizes[0];
+  auto tileN = tileSizes[1];
+  // One warp per 16 x 16 tile, at most 1024 threads per block.
+  if (tileM == 0 || tileN == 0 || tileM % 16 != 0 || tileN % 16 != 0 ||
+      (tileM / 16) * (tileN / 16) > 32) {
+    return nullptr;
+  }
+  return std::unique_ptr<TensorCoreMatmul>(new TensorCoreMatmul{
+      op->name, a->name(), b->name(), sizeM, sizeN, sizeK, tileM, tileN});
+}
+
+// Does "scop" have any float16 input or output?
+bool hasFloat16Tensors(const Scop& scop) {
+  for (const auto& input : scop.halide.inputs) {
+    if (input.type() == Halide::Float(16)) {
+      return true;
+    }
+  }
+  for (const auto& output : scop.halide.outputs) {
+    if (output.type() == Halide::Float(16)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Remove the filter nodes, along with their subtrees, that no longer let any
+// point of the domain of "root" through.
+void removeEmptyFilters(detail::ScheduleTree* root) {
+  bool removed = true;
+  while (removed) {
+    removed = false;
+    for (auto tree : detail::ScheduleTree::collect(
+             root, detail::ScheduleTreeType::Filter)) {
+      auto filter = tree->elemAs<detail::ScheduleTreeElemFilter>();
+      auto points = activeDomainPoints(root, tree).intersect(filter->filter_);
+      if (!points.is_empty()) {
+        continue;
+      }
+      auto parent = tree->ancestor(root, 1);
+      parent->detachChild(tree->positionInParent(parent));
+      removed = true;
+      break;
+    }
+  }
+}
+
+// Bounds of the values taken by "upa" on "domain", returns false if it is
+// empty or not bounded.
+bool valueBounds(
+    isl::union_set domain,
+    isl::union_pw_aff upa,
+    long* min,
+    long* max) {
+  auto values = isl::union_map::from(isl::multi_union_pw_aff(upa))
+                    .intersect_domain(domain)
+                    .range();
+  if (values.is_empty()) {
+    return false;
+  }
+  auto set = isl::set::from_union_set(values);
+  auto aff = isl::aff(isl::local_space(set.get_space()), isl::dim_type::set, 0);
+  auto minVal = set.min_val(aff);
+  auto maxVal = set.max_val(aff);
+  if (!minVal.is_int() || !maxVal.is_int()) {
+    return false;
+  }
+  *min = minVal.get_num_si();
+  *max = maxVal.get_num_si();
+  return true;
+}
+
+// Number of values taken by "upa" on "domain", or 0 if it is not bounded.
+size_t nValues(isl::union_set domain, isl::union_pw_aff upa) {
+  long min, max;
+  if (!valueBounds(domain, upa, &min, &max)) {
+    return 0;
+  }
+  return static_cast<size_t>(max - min) + 1;
+}
+
+// Linearize the "n" outermost members of "band" on "domain" in row-major
+// order into "linear", e.g., i * E_j + j for two members with j taking
+// values in [0, E_j), and return the number of values it may take.
+// Return 0 and leave "linear" untouched if one of the members is not
+// bounded or takes negative values.
+size_t linearizeMembers(
+    isl::union_set domain,
+    const detail::ScheduleTreeElemBand* band,
+    size_t n,
+    isl::union_pw_aff& linear) {
+  CHECK_LE(n, band->nMember());
+  size_t total = 1;
+  isl::union_pw_aff res;
+  for (size_t i = 0; i < n; ++i) {
+    auto upa = band->mupa_.get_union_pw_aff(i);
+    long min, max;
+    if (!valueBounds(domain, upa, &min, &max) || min < 0) {
+      return 0;
+    }
+    auto extent = static_cast<size_t>(max) + 1;
+    res = i == 0 ? upa
+                 : res.scale_val(isl::val(upa.get_ctx(), extent)).add(upa);
+    total *= extent;
+  }
+  linear = res;
+  return total;
+}
+
+// Limit "grid" to the number of blocks of "block" threads that the device
+// keeps resident at once, given that the members of the tile band
+// "outerBand" are mapped to the grid dimensions in order, the first
+// "nLinearized" of them together to the first dimension (see
+// MappedScop::linearizeBlocks).  Each block then iterates over several tiles.
+// The grid dimensions are first reduced to the number of tiles along the
+// corresponding members, where it is bounded, and the largest dimension is
+// then halved (rounding up) until the grid fits.
+// "grid" is returned unchanged if there is no device.
+::tc::Grid persistentGrid(
+    const Scop& scop,
+    const detail::ScheduleTree* outerBand,
+    const ::tc::Grid& grid,
+    const ::tc::Block& block,
+    size_t nLinearized) {
+  auto threads = block.view.extractDefaultedArray();
+  auto maxBlocks = queryMaxResidentBlocks(threads[0] * threads[1] * threads[2]);
+  if (maxBlocks == 0) {
+    return grid;
+  }
+  auto sizes = grid.view.extractVector();
+  auto band = outerBand->elemAs<detail::ScheduleTreeElemBand>();
+  auto domain = activeDomainPoints(scop.scheduleRoot(), outerBand)
+                    .intersect_params(scop.globalParameterContext);
+  nLinearized = std::min(nLinearized, band->nOuterCoincident());
+  isl::union_pw_aff linear;
+  size_t nTiles0 = 0;
+  if (nLinearized > 1) {
+    nTiles0 = linearizeMembers(domain, band, nLinearized, linear);
+  }
+  if (nTiles0 == 0) {
+    nLinearized = 1;
+  }
+  for (size_t i = 0; i < sizes.size() && i + nLinearized <= band->nMember();
+       ++i) {
+    auto nTiles = i == 0 && nLinearized > 1
+        ? nTiles0
+        : nValues(domain, band->mupa_.get_union_pw_aff(i + nLinearized - 1));
+    if (nTiles > 0) {
+      sizes[i] = std::min<uint64_t>(sizes[i], nTiles);
+    }
+  }
+  auto nBlocks = [&sizes]() {
+    return std::accumulate(
+        sizes.begin(), sizes.end(), 1ul, std::multiplies<size_t>());
+  };
+  while (nBlocks() > maxBlocks) {
+    auto largest = std::max_element(sizes.begin(), sizes.end());
+    *largest = (*largest + 1) / 2;
+  }
+  return ::tc::Grid(sizes);
+}
+
+// Separate the full tiles of sizes "tileSizes" of the point band below the
+// tile band "outerBand" from the partial tiles at the boundaries of the
+// iteration domain, by executing the points of the partial tiles after those
+// of the full tiles in a copy of the point band subtree.  The code generated
+// for the full tiles then has constant loop bounds and no conditions.
+// Return true if the tiles were separated, i.e., if there are both full and
+// partial tiles and the full tiles of each statement form a convex set.
+bool separateFullTiles(
+    detail::ScheduleTree* root,
+    detail::ScheduleTree* outerBand,
+    const std::vector<size_t>& tileSizes) {
+  if (outerBand->numChildren() != 1) {
+    return false;
+  }
+  auto child = outerBand->child({0});
+  auto band = child->elemAs<detail::ScheduleTreeElemBand>();
+  if (!band) {
+    return false;
+  }
+  // Members with tile size 0 are not tiled, they cannot have partial tiles.
+  isl::multi_union_pw_aff pointSchedule;
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < std::min(band->nMember(), tileSizes.size()); ++i) {
+    if (tileSizes[i] == 0) {
+      continue;
+    }
+    auto member = isl::multi_union_pw_aff(band->mupa_.get_union_pw_aff(i));
+    pointSchedule = sizes.empty() ? member
+                                  : pointSchedule.flat_range_product(member);
+    sizes.push_back(tileSizes[i]);
+  }
+  if (sizes.empty()) {
+    return false;
+  }
+  auto size = isl::multi_val::zero(pointSchedule.get_space());
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    size = size.set_val(i, isl::val(child->ctx_, sizes[i]));
+  }
+  auto domain = activeDomainPoints(root, child);
+  auto prefix = prefixScheduleMupa(root, child);
+  auto partial = partialTargetTiles(domain, prefix, pointSchedule, size);
+  if (partial.is_empty()) {
+    return false;
+  }
+  partial = partial.gist(domain).gist(domain);
+  auto full = domain.subtract(partial);
+  if (full.is_empty()) {
+    return false;
+  }
+  for (auto set : isl::UnionAsVector<isl::union_set>(full)) {
+    if (set.n_basic_set() != 1) {
+      return false;
+    }
+  }
+  orderAfter(root, child, partial);
+  return true;
+}
 } // namespace
 
 template <typename MappingTypeId>
@@ -120,8 +487,184 @@ void MappedScop::mapRemaining(
   }
 }
 
+std::vector<std::string> gridReductionOutputs(const Scop& scop) {
+  auto updates = reductionInitsUpdates(scop.domain(), scop).second;
+  if (updates.size() != 1) {
+    return {};
+  }
+  auto provide = scop.halide.statements.at(updates[0])
+                     .as<Halide::Internal::Provide>();
+  auto isOutput = std::any_of(
+      scop.halide.outputs.begin(),
+      scop.halide.outputs.end(),
+      [provide](const Halide::OutputImageParam& output) {
+        return output.name() == provide->name;
+      });
+  // Types for which CUDA provides an atomicAdd.
+  auto type = provide->values[0].type();
+  auto isAtomicType = type == Halide::Float(32) || type == Halide::Float(64) ||
+      type == Halide::Int(32) || type == Halide::UInt(32);
+  if (!isOutput || !isAtomicType) {
+    return {};
+  }
+  return {provide->name};
+}
+
+namespace {
+// Drop the initialization of the single reduction of "scop", which the
+// caller performs by zeroing its output (see gridReductionOutputs), and
+// add its update to the output atomically instead.
+void makeAtomicReduction(Scop& scop) {
+  auto initsUpdates = reductionInitsUpdates(scop.domain(), scop);
+  scop.domain() = scop.domain().subtract(initsUpdates.first);
+  scop.reads = scop.reads.intersect_domain(scop.domain());
+  scop.writes = scop.writes.intersect_domain(scop.domain());
+  // Branches of the inits would otherwise get empty mapping filters.
+  removeEmptyFilters(scop.scheduleRoot());
+  scop.atomicUpdates.insert(initsUpdates.second[0]);
+}
+
+// If "scop" is a scatter reduction that may be computed atomically (see
+// gridReductionOutputs), compute it with atomic additions before
+// scheduling.  Any order of the additions gives the same sums, so the
+// instances of the update are then independent and its loops are mapped
+// like parallel loops, instead of having each thread iterate over all the
+// instances that may reduce into its elements.
+bool makeAtomicScatter(Scop& scop) {
+  if (gridReductionOutputs(scop).empty()) {
+    return false;
+  }
+  auto updateId = reductionInitsUpdates(scop.domain(), scop).second[0];
+  if (!isScatterUpdate(updateId, scop)) {
+    return false;
+  }
+  makeAtomicReduction(scop);
+  scop.dependences = isl::union_map::empty(scop.domain().get_space());
+  return true;
+}
+} // namespace
+
+bool MappedScop::splitReductionAcrossBlocks(detail::ScheduleTree* band) {
+  auto bandNode = band->elemAs<detail::ScheduleTreeElemBand>();
+  // Atomic scatters are already updated atomically, see makeAtomicScatter.
+  if (!bandNode || !bandNode->permutable_ ||
+      !scop_->atomicUpdates.empty() || gridReductionOutputs(scop()).empty()) {
+    return false;
+  }
+  // The reduction member is mapped to the block identifier following those
+  // of the outer coincident members.
+  auto nCoincident = bandNode->nOuterCoincident();
+  if (nCoincident >= std::min(numBlocks.view.size(), 3ul)) {
+    return false;
+  }
+  if (findFirstReductionDim(bandNode->mupa_, scop()) != nCoincident) {
+    return false;
+  }
+
+  // Blocks cannot wait for an initialization in the kernel.  The caller
+  // zeroes the output instead and the blocks add their partial results
+  // atomically.
+  makeAtomicReduction(*scop_);
+  gridReduction_ = true;
+  return true;
+}
+
 // Uses as many blockSizes elements as outer coincident dimensions in the
-// outermost band
+// outermost band, and one more for the reduction member split across blocks
+// by splitReductionAcrossBlocks (if any).
+bool MappedScop::tileForThreads(
+    detail::ScheduleTree* band,
+    const std::vector<size_t>& threadTileSizes) {
+  using namespace tc::polyhedral::detail;
+
+  auto bandNode = band->elemAs<ScheduleTreeElemBand>();
+  // Reductions mapped to library calls expect one point per thread.
+  if (!bandNode || !bandNode->permutable_ || !reductionBandUpdates_.empty()) {
+    return false;
+  }
+  // The other members are kept outside the tile with tile size 1, e.g.,
+  // the reduction loop of a matmul iterates over the tile of the output.
+  auto nCoincident = bandNode->nOuterCoincident();
+  std::vector<size_t> sizes(bandNode->nMember(), 1);
+  bool tiled = false;
+  for (size_t i = 0; i < std::min(nCoincident, threadTileSizes.size()); ++i) {
+    sizes[i] = threadTileSizes[i];
+    tiled = tiled || sizes[i] > 1;
+  }
+  if (!tiled) {
+    return false;
+  }
+  bandTile(band, sizes, TileOptions::ShiftPointLoops);
+  auto tile = band->child({0});
+  auto tileNode = tile->elemAs<ScheduleTreeElemBand>();
+  std::fill(tileNode->unroll_.begin(), tileNode->unroll_.end(), true);
+  threadTileBands_.insert(tile);
+  return true;
+}
+
+detail::ScheduleTree* MappedScop::tileForWarps(
+    detail::ScheduleTree* band,
+    const std::vector<size_t>& warpTileSizes) {
+  using namespace tc::polyhedral::detail;
+
+  auto bandNode = band->elemAs<ScheduleTreeElemBand>();
+  // The points of a tile need thread identifiers besides the last one.
+  if (!bandNode || !bandNode->permutable_ || !reductionBandUpdates_.empty() ||
+      numThreads.view.size() < 2) {
+    return nullptr;
+  }
+  auto nTiled = std::min(bandNode->nOuterCoincident(), warpTileSizes.size());
+  std::vector<size_t> sizes(bandNode->nMember(), 1);
+  bool tiled = false;
+  for (size_t i = 0; i < nTiled; ++i) {
+    sizes[i] = warpTileSizes[i];
+    tiled = tiled || sizes[i] > 1;
+  }
+  if (!tiled) {
+    return nullptr;
+  }
+  bandTile(band, sizes, TileOptions::ShiftPointLoops);
+  // The other members, e.g. the reduction loop, stay between the tile loops
+  // and the points, with tile size 1.
+  if (bandNode->nMember() > nTiled) {
+    bandSplit(scop_->scheduleRoot(), band, nTiled);
+  }
+  warpBand_ = band;
+  auto points = band->child({0});
+  if (nTiled < sizes.size()) {
+    points = points->child({0});
+  }
+  return points;
+}
+
+bool MappedScop::wavefrontForThreads(detail::ScheduleTree* band) {
+  using namespace tc::polyhedral::detail;
+
+  auto bandNode = band->elemAs<ScheduleTreeElemBand>();
+  // Reduction members are detected before and mapped as they are.
+  if (!bandNode || !bandNode->permutable_ || bandNode->nMember() < 2 ||
+      bandNode->nOuterCoincident() > 0 || !reductionBandUpdates_.empty()) {
+    return false;
+  }
+  bandWavefront(band);
+  bandSplit(scop_->scheduleRoot(), band, 1);
+  return true;
+}
+
+bool MappedScop::packBatchForThreads(detail::ScheduleTree* band) {
+  using namespace tc::polyhedral::detail;
+
+  auto bandNode = band->elemAs<ScheduleTreeElemBand>();
+  if (!bandNode || !bandNode->permutable_ || bandNode->nOuterCoincident() < 1) {
+    return false;
+  }
+  if (bandNode->nMember() > 1) {
+    bandSplit(scop_->scheduleRoot(), band, 1);
+  }
+  batchBand_ = band;
+  return true;
+}
+
 void MappedScop::mapToBlocksAndScaleBand(
     detail::ScheduleTree* band,
     std::vector<size_t> tileSizes) {
@@ -130,14 +673,38 @@ void MappedScop::mapToBlocksAndScaleBand(
   auto bandNode = band->elemAs<ScheduleTreeElemBand>();
   CHECK(bandNode->permutable_) << "cannot map non-permutable band to blocks";
 
-  auto nBlocksToMap = bandNode->nOuterCoincident();
+  // Optionally map the outermost coincident members together to the first
+  // block identifier, if they are bounded.
+  auto nCoincident = bandNode->nOuterCoincident();
+  size_t nLinearized = std::min<size_t>(linearizeBlocks, nCoincident);
+  isl::union_pw_aff linear;
+  if (nLinearized > 1 && numBlocks.view.size() > 0) {
+    auto domain = activeDomainPoints(scop_->scheduleRoot(), band)
+                      .intersect_params(scop_->globalParameterContext);
+    if (linearizeMembers(domain, bandNode, nLinearized, linear) == 0) {
+      LOG(WARNING) << "cannot linearize unbounded loops mapped to blocks";
+      nLinearized = 1;
+    }
+  } else {
+    nLinearized = 1;
+  }
+  nLinearizedBlockMembers_ = nLinearized;
+
+  auto nBlocksToMap =
+      nCoincident + (gridReduction_ ? 1 : 0) - (nLinearized - 1);
   // Can map at most 3 dimensions
   nBlocksToMap = std::min(nBlocksToMap, 3ul);
   // and no more than block dimensions to be mapped
   nBlocksToMap = std::min(nBlocksToMap, numBlocks.view.size());
 
   for (size_t i = 0; i < nBlocksToMap; ++i) {
-    band = map(band, i, mapping::BlockId::makeId(i));
+    auto id = mapping::BlockId::makeId(i);
+    if (i == 0 && nLinearized > 1) {
+      band = mapAffineToParameterWithExtent(
+          scop_->scheduleRoot(), band, linear, id, id.mappingSize(numBlocks));
+    } else {
+      band = map(band, i + nLinearized - 1, id);
+    }
   }
   mapRemaining<mapping::BlockId>(band, nBlocksToMap, numBlocks.view.size());
   bandScale(band, tileSizes);
@@ -198,9 +765,12 @@ bool MappedScop::detectReductions(detail::ScheduleTree* tree) {
   }
 
   // For now, only support reductions with a sufficient number
-  // of coincident outer band members for the remaining thread identifiers.
+  // of coincident outer band members for the remaining thread identifiers,
+  // one fewer if two reduction members get mapped together.
+  auto nThreads = numThreads.view.size();
   auto nCoincident = band->nOuterCoincident();
-  if (nCoincident < numThreads.view.size() - 1) {
+  auto twoDim = useTwoDimReductions && nThreads >= 2;
+  if (nCoincident + (twoDim ? 2 : 1) < nThreads) {
     return found;
   }
 
@@ -214,13 +784,32 @@ bool MappedScop::detectReductions(detail::ScheduleTree* tree) {
   if (updates.size() != 1) {
     return false;
   }
+  // The instances of a scatter reduce into different elements, which a
+  // block reduction would combine.
+  if (isScatterUpdate(updates[0], scop())) {
+    return false;
+  }
   // The reduction member needs to appear right underneath
   // the coincident members.
   auto reductionDim = findFirstReductionDim(band->mupa_, scop());
   if (reductionDim != nCoincident) {
     return false;
   }
-  auto reductionTree = bandSplitOut(scop_->scheduleRoot(), tree, reductionDim);
+  // Map the next member along with it if it is a reduction member as well.
+  // A single reduction member needs the coincident members
+  // for all other thread identifiers.
+  size_t nDims = 1;
+  if (twoDim && nCoincident + 1 < band->nMember()) {
+    auto inner = band->mupa_.drop_dims(isl::dim_type::set, 0, nCoincident + 1);
+    if (findFirstReductionDim(inner, scop()) == 0) {
+      nDims = 2;
+    }
+  }
+  if (nCoincident + nDims < nThreads) {
+    return false;
+  }
+  auto reductionTree =
+      bandSplitOut(scop_->scheduleRoot(), tree, reductionDim, nDims);
   // Order the init statements (if any) before the update statements
   // to ensure the band from which the reduction band has been split off
   // only contains update statements.
@@ -229,7 +818,7 @@ bool MappedScop::detectReductions(detail::ScheduleTree* tree) {
     orderBefore(scop_->scheduleRoot(), tree, inits);
   }
   reductionFromParent_.emplace(tree, reductionTree);
-  reductionBandUpdates_.emplace(reductionTree, updates);
+  reductionBandUpdates_.emplace(reductionTree, Reduction(updates, nDims));
   return true;
 }
 
@@ -258,18 +847,19 @@ isl::multi_union_pw_aff MappedScop::reductionMapSchedule(
 
   // Total size of returned schedule needs to be equal
   // to the number of thread identifiers.
-  if (numThreads.view.size() > 1) {
+  auto nParent = numThreads.view.size() - reductionBand->nMember();
+  if (nParent > 0) {
     CHECK(parent != st);
   }
   // Prepend last members of parent band (if any).
-  if (parent != st) {
+  if (nParent > 0) {
     auto parentBand = parent->elemAs<detail::ScheduleTreeElemBand>();
     CHECK(parentBand);
     auto parentSchedule = parentBand->mupa_;
     auto nMember = parentBand->nMember();
-    CHECK_GE(nMember, numThreads.view.size() - 1);
-    parentSchedule = parentSchedule.drop_dims(
-        isl::dim_type::set, 0, nMember - (numThreads.view.size() - 1));
+    CHECK_GE(nMember, nParent);
+    parentSchedule =
+        parentSchedule.drop_dims(isl::dim_type::set, 0, nMember - nParent);
     reductionSchedule = parentSchedule.flat_range_product(reductionSchedule);
   }
 
@@ -329,22 +919,54 @@ detail::ScheduleTree* MappedScop::separateReduction(detail::ScheduleTree* st) {
 size_t MappedScop::mapToThreads(detail::ScheduleTree* band, size_t nInner) {
   using namespace tc::polyhedral::detail;
 
-  if (nInner >= numThreads.view.size()) {
+  // The last thread identifier is left to the batch band or to the warp
+  // tile band, if any.
+  auto nThreads =
+      numThreads.view.size() - (batchBand_ || warpBand_ ? 1 : 0);
+  if (band == batchBand_) {
+    mapRemaining<mapping::ThreadId>(band, nInner, nThreads);
+    map(band, 0, mapping::ThreadId::makeId(nThreads));
+    return numThreads.view.size();
+  }
+  if (band == warpBand_) {
+    mapRemaining<mapping::ThreadId>(band, nInner, nThreads);
+    auto id = mapping::ThreadId::makeId(nThreads);
+    auto bandNode = band->elemAs<ScheduleTreeElemBand>();
+    auto domain = activeDomainPoints(schedule(), band)
+                      .intersect_params(scop_->globalParameterContext);
+    isl::union_pw_aff linear;
+    if (linearizeMembers(domain, bandNode, bandNode->nMember(), linear) == 0) {
+      LOG(WARNING) << "cannot linearize unbounded warp tiles, "
+                   << "only the first member is mapped to threads";
+      map(band, 0, id);
+    } else {
+      mapAffineToParameterWithExtent(
+          scop_->scheduleRoot(), band, linear, id, id.mappingSize(numThreads));
+    }
+    return numThreads.view.size();
+  }
+  if (nInner >= nThreads || threadTileBands_.count(band) == 1) {
     return nInner;
   }
   if (reductionBandUpdates_.count(band) == 1) {
-    // A reduction is assumed to get mapped to threadIdx.x
+    // A reduction is assumed to get mapped to threadIdx.x,
+    // with its outer member to threadIdx.y if it has two.
     if (nInner != 0) {
       reductionBandUpdates_.erase(band);
       return nInner;
     }
     CHECK(reductionBandUpdates_.at(band).separated);
+    auto nDims = reductionBandUpdates_.at(band).nDims;
     threadIdxXScheduleDepthState.emplace_back(std::make_pair(
         activeDomainPoints(schedule(), band),
-        band->scheduleDepth(schedule()) + 0));
-    band = map(band, 0, mapping::ThreadId::x());
-    markUnroll(scop_->scheduleRoot(), band, unroll);
-    return 1;
+        band->scheduleDepth(schedule()) + nDims - 1));
+    band = map(band, nDims - 1, mapping::ThreadId::x());
+    if (nDims == 2) {
+      band = map(band, 0, mapping::ThreadId::y());
+    }
+    markUnroll(
+        scop_->scheduleRoot(), band, unroll, FLAGS_cuda_max_kernel_statements);
+    return nDims;
   }
   auto bandNode = band->elemAs<ScheduleTreeElemBand>();
   // If any inner node was mapped to threads and
@@ -355,10 +977,16 @@ size_t MappedScop::mapToThreads(detail::ScheduleTree* band, size_t nInner) {
     // Since some thread identifiers were mapped already (nInner > 0),
     // the band should have descendants.  Double check.
     CHECK_EQ(band->numChildren(), 1);
-    mapRemaining<mapping::ThreadId>(
-        band->child({0}), nInner, numThreads.view.size());
-    scop_->insertSyncAfter(band->child({0}));
-    return numThreads.view.size();
+    mapRemaining<mapping::ThreadId>(band->child({0}), nInner, nThreads);
+    // The synchronization is only needed if the next iterations access
+    // elements accessed by other threads.
+    auto level = loopCarriedSyncLevel(*scop_, band, numThreads);
+    if (level == SyncLevel::Block) {
+      scop_->insertSyncAfter(band->child({0}));
+    } else if (level == SyncLevel::Warp) {
+      scop_->insertWarpSyncAfter(band->child({0}));
+    }
+    return nThreads;
   }
   // With current isl scheduler, if coincident dimensions exist in a band,
   // they are outermost.
@@ -369,8 +997,8 @@ size_t MappedScop::mapToThreads(detail::ScheduleTree* band, size_t nInner) {
     return nInner;
   }
 
-  auto nMappedThreads = std::min(
-      numThreads.view.size() - nInner, static_cast<size_t>(nOuterCoincident));
+  auto nMappedThreads =
+      std::min(nThreads - nInner, static_cast<size_t>(nOuterCoincident));
   CHECK_GT(nMappedThreads, 0) << "not mapping to threads";
   CHECK_LE(nMappedThreads, 3 - nInner) << "mapping to too many threads";
 
@@ -388,7 +1016,8 @@ size_t MappedScop::mapToThreads(detail::ScheduleTree* band, size_t nInner) {
   }
 
   if (nInner == 0) {
-    markUnroll(scop_->scheduleRoot(), band, unroll);
+    markUnroll(
+        scop_->scheduleRoot(), band, unroll, FLAGS_cuda_max_kernel_statements);
   }
 
   return nInner + nMappedThreads;
@@ -456,7 +1085,9 @@ size_t MappedScop::mapInnermostBandsToThreads(detail::ScheduleTree* st) {
   if (nChildren > 1) {
     auto needSync = st->elemAs<detail::ScheduleTreeElemSequence>() && n > 0;
     if (needSync) {
-      n = numThreads.view.size();
+      // All thread identifiers but the one of the batch or warp tile band,
+      // if any, which is mapped above.
+      n = numThreads.view.size() - (batchBand_ || warpBand_ ? 1 : 0);
     }
     for (size_t i = 0; i < nChildren; ++i) {
       fixThreadsBelowFilter(*this, children[i], nInner[i], n);
@@ -527,8 +1158,12 @@ namespace {
 //   3. we want to allow more threads for copies to/from shared memory than
 //      for compute, so we want to take copies into account when tightening
 //      launch bounds.
+// The block is only tightened if "tightenBlock" is set, the code is then
+// valid for the block of "mappedScop", as needed when several mapped scops
+// run in the same kernel.
 std::unique_ptr<MappedScop> makeSpecializedMappedScop(
-    const MappedScop& mappedScop) {
+    const MappedScop& mappedScop,
+    bool tightenBlock = true) {
   auto scop = Scop::makeScop(mappedScop.scop());
 
   // In this particular specialized Scop, we can add a context just below root.
@@ -543,8 +1178,21 @@ std::unique_ptr<MappedScop> makeSpecializedMappedScop(
   tc::Grid grid = mappedScop.numBlocks;
   tc::Block block = mappedScop.numThreads;
   std::tie(grid, block) = tightenLaunchBounds(*scop, grid, block);
+  if (!tightenBlock) {
+    block = mappedScop.numThreads;
+  }
   auto res = MappedScop::makeMappedScop(
       std::move(scop), grid, block, mappedScop.unroll);
+  res->useDynamicSharedMemory = mappedScop.useDynamicSharedMemory;
+  res->useWarpShuffleReductions = mappedScop.useWarpShuffleReductions;
+  res->useWarpAggregatedAtomics = mappedScop.useWarpAggregatedAtomics;
+  res->useLaunchBounds = mappedScop.useLaunchBounds;
+  res->useUnrollPragma = mappedScop.useUnrollPragma;
+  res->minBlocksPerMultiprocessor = mappedScop.minBlocksPerMultiprocessor;
+  res->blockSwizzle = mappedScop.blockSwizzle;
+  res->useAsyncCopies = mappedScop.useAsyncCopies;
+  res->mathPrecision = mappedScop.mathPrecision;
+  res->preciseTensors = mappedScop.preciseTensors;
   res->insertMappingContext();
 
   LOG_IF(INFO, FLAGS_debug_tc_mapper)
@@ -556,57 +1204,317 @@ std::unique_ptr<MappedScop> makeSpecializedMappedScop(
 }
 } // namespace
 
+namespace {
+// The source of "kernels", the code of mapped scops, preceded by the helpers
+// they call.  "scop" is the scop the kernels are generated for and
+// "reductions" is set if they perform block reductions.
+std::string withHelpers(
+    const std::string& kernels,
+    const Scop& scop,
+    bool reductions,
+    bool useWarpShuffleReductions) {
+  std::stringstream code;
+  code << code::cpp::boundsAsTemplate << code::c::types << code::c::defines
+       << std::endl;
+  if (hasFloat16Tensors(scop)) {
+    code << code::cuda::fp16;
+  }
+  // NVRTC parses the whole source of every candidate, only the helpers the
+  // kernel calls are emitted.  The loads of any kernel rely on the common
+  // helpers.
+  auto calls = [&kernels](const char* helper) {
+    return kernels.find(helper) != std::string::npos;
+  };
+  code << code::cuda::common;
+  if (calls("__tc::StridedView") or calls("__tc::ParametricView")) {
+    code << code::cuda::views;
+  }
+  if (calls("__tc::dp4a") or calls("__tc::pack4") or calls("__tc::load4") or
+      calls("__tc::ldg4")) {
+    code << code::cuda::bytes;
+  }
+  if (calls("__tc::fastTanh") or calls("__tc::fastSigmoid")) {
+    code << code::cuda::fastActivations;
+  }
+  if (calls("__tc::cpAsync")) {
+    code << code::cuda::asyncCopies;
+  }
+  if (calls("__tc::gridSync")) {
+    code << code::cuda::gridSync;
+  }
+  if (calls("__tc::atomicAddAggregated")) {
+    code << code::cuda::aggregatedAtomics;
+  }
+  if (reductions) {
+    // Only the CUB reductions include CUB, see CudaRTCFunction::Compile.
+    // The reductions along x and y are always warp shuffle reductions.
+    code << code::cuda::reductions;
+    if (useWarpShuffleReductions or
+        calls(code::cuda::kWarpReductionAlongXYName.c_str())) {
+      code << code::cuda::warpShuffleBlockReduce;
+    }
+    if (not useWarpShuffleReductions and
+        calls(code::cuda::kCUBReductionName.c_str())) {
+      code << code::cuda::cubBlockReduce;
+    }
+  }
+  code << "extern \"C\" {" << std::endl << kernels << "}" << std::endl;
+  return code.str();
+}
+} // namespace
+
 // Before generating code, make a copy of the scop and insert
 // the globalParameterContext of the original scop as top-level
 // context node in schedule tree.
-std::tuple<std::string, tc::Grid, tc::Block> MappedScop::codegen(
+std::tuple<std::string, tc::Grid, tc::Block, size_t> MappedScop::codegen(
     const std::string& specializedName) const {
+  if (tensorCoreMatmul) {
+    std::stringstream code;
+    code << code::cpp::boundsAsTemplate << code::c::types << code::c::defines
+         << code::cuda::fp16 << code::cuda::wmmaMatmul << std::endl;
+    code << "extern \"C\" {" << std::endl
+         << emitTensorCoreMatmulKernel(specializedName, *this) << "}"
+         << std::endl;
+    return std::make_tuple(code.str(), numBlocks, numThreads, 0ul);
+  }
+
   validate(schedule());
 
   auto mappedScopForCodegen = makeSpecializedMappedScop(*this);
 
-  std::stringstream code;
-  code << code::cpp::boundsAsTemplate << code::c::types << code::c::defines
-       << std::endl;
-  if (mappedScopForCodegen->scop().treeSyncUpdateMap.size() != 0) {
-    code << code::cuda::common;
-    code << code::cuda::cubBlockReduce;
-  }
-  code << "extern \"C\" {" << std::endl
-       << emitCudaKernel(specializedName, *mappedScopForCodegen) << "}"
-       << std::endl;
+  auto kernel = emitCudaKernel(specializedName, *mappedScopForCodegen);
+  auto code = withHelpers(
+      kernel,
+      scop(),
+      mappedScopForCodegen->scop().treeSyncUpdateMap.size() != 0,
+      useWarpShuffleReductions);
 
+  size_t dynamicSharedMemory = useDynamicSharedMemory
+      ? dynamicSharedMemorySize(mappedScopForCodegen->scop())
+      : 0;
   return std::make_tuple(
-      code.str(),
+      code,
       mappedScopForCodegen->numBlocks,
-      mappedScopForCodegen->numThreads);
+      mappedScopForCodegen->numThreads,
+      dynamicSharedMemory);
 }
 
-std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
-    std::unique_ptr<Scop>&& scopUPtr,
-    const CudaMappingOptions& cudaOptions) {
-  using namespace polyhedral::detail;
+std::tuple<std::string, tc::Grid, tc::Block, size_t>
+MappedScop::codegenCooperative(
+    const std::string& specializedName,
+    const std::vector<std::unique_ptr<MappedScop>>& stages) {
+  CHECK(!stages.empty());
+  std::vector<std::unique_ptr<MappedScop>> specialized;
+  std::vector<const MappedScop*> stagePtrs;
+  bool reductions = false;
+  size_t dynamicSharedMemory = 0;
+  std::vector<uint64_t> grid;
+  for (const auto& stage : stages) {
+    if (stage->tensorCoreMatmul) {
+      throw std::invalid_argument(
+          "tensor core matmuls cannot be stages of a cooperative kernel");
+    }
+    validate(stage->schedule());
+    specialized.push_back(makeSpecializedMappedScop(*stage, false));
+    const auto& s = *specialized.back();
+    stagePtrs.push_back(&s);
+    reductions = reductions || s.scop().treeSyncUpdateMap.size() != 0;
+    if (s.useDynamicSharedMemory) {
+      // The stages run one after the other, they share the buffer.
+      dynamicSharedMemory =
+          std::max(dynamicSharedMemory, dynamicSharedMemorySize(s.scop()));
+    }
+    auto stageGrid = s.numBlocks.view.extractDefaultedArray();
+    grid.resize(std::max(grid.size(), s.numBlocks.view.size()), 1);
+    for (size_t i = 0; i < grid.size(); ++i) {
+      grid[i] = std::max<uint64_t>(grid[i], stageGrid[i]);
+    }
+  }
+
+  auto kernel = emitCooperativeKernel(specializedName, stagePtrs);
+  auto code = withHelpers(
+      kernel,
+      stages.front()->scop(),
+      reductions,
+      stages.front()->useWarpShuffleReductions);
+  return std::make_tuple(
+      code, tc::Grid(grid), stages.front()->numThreads, dynamicSharedMemory);
+}
 
+namespace {
+// Steps 1a and 2 of the OuterBlockInnerThread strategy, which precede the
+// construction of the mapped scop(s).
+std::unique_ptr<Scop> scheduleWithOuterBlockInnerThreadStrategy(
+    std::unique_ptr<Scop>&& scop,
+    const CudaMappingOptions& cudaOptions) {
   const auto& generic = cudaOptions.generic;
-  auto mappedScop = std::unique_ptr<MappedScop>(new MappedScop(
-      std::move(scopUPtr),
-      ::tc::Grid(cudaOptions.grid),
-      ::tc::Block(cudaOptions.block),
-      generic.proto.unroll()));
-  auto& scop = mappedScop->scop_;
 
   // 1a. Optionally specialize before scheduling...
   if (generic.proto.fix_parameters_before_scheduling()) {
     scop->specializeToContext();
   }
 
-  // 2. Schedule
-  scop = Scop::makeScheduled(*scop, generic.outerScheduleOptions);
+  // 1c. Optionally compute a scatter reduction atomically
+  if (cudaOptions.proto().grid_reductions() && makeAtomicScatter(*scop)) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Atomic scatter reduction";
+  }
 
-  // 3. Tile
-  CHECK_LT(0, generic.tiling.size())
+  // 2. Schedule, trivially if there are no dependences
+  if (scop->isPointwise()) {
+    return Scop::makePointwiseScheduled(*scop);
+  }
+  return Scop::makeScheduled(*scop, generic.outerScheduleOptions);
+}
+
+// The options with the block of a single instance of the outermost loop of
+// the outer band extended by CudaMappingOptionsProto::batch_packing, the
+// number of instances per block, and this loop tiled by it.  The options
+// without batch packing if it does not apply to "scop".
+CudaMappingOptions withBatchPacking(
+    const Scop& scop,
+    const CudaMappingOptions& cudaOptions) {
+  using namespace polyhedral::detail;
+
+  auto packing = cudaOptions.proto().batch_packing();
+  if (packing <= 1) {
+    return cudaOptions;
+  }
+  auto res = cudaOptions;
+  res.batchPacking(1);
+  auto block = cudaOptions.block.extractVector();
+  if (block.size() >= 3 ||
+      cudaOptions.proto().thread_tiling().sizes_size() > 0 ||
+      cudaOptions.proto().warp_tiling().sizes_size() > 0) {
+    LOG(WARNING) << "ignoring batch packing with a block of " << block.size()
+                 << " dimensions or with thread or warp tiling";
+    return res;
+  }
+  auto tree = scop.scheduleRoot();
+  while (!tree->elemAs<ScheduleTreeElemBand>() && tree->numChildren() == 1) {
+    tree = tree->child({0});
+  }
+  auto band = tree->elemAs<ScheduleTreeElemBand>();
+  if (!band || !band->permutable_ || band->nOuterCoincident() < 1) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "no parallel outermost loop to pack in blocks";
+    return res;
+  }
+  auto tiling = cudaOptions.generic.tiling.extractVector();
+  tiling[0] = packing;
+  block.push_back(packing);
+  res.batchPacking(packing).tile(tiling).mapToThreads(block);
+  return res;
+}
+} // namespace
+
+std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
+    std::unique_ptr<Scop>&& scopUPtr,
+    const CudaMappingOptions& cudaOptions) {
+  return mapScheduledWithOuterBlockInnerThreadStrategy(
+      scheduleWithOuterBlockInnerThreadStrategy(
+          std::move(scopUPtr), cudaOptions),
+      cudaOptions);
+}
+
+std::vector<std::unique_ptr<MappedScop>>
+MappedScop::makeSplitWithOuterBlockInnerThreadStrategy(
+    std::unique_ptr<Scop>&& scopUPtr,
+    const CudaMappingOptions& cudaOptions) {
+  auto scheduled = scheduleWithOuterBlockInnerThreadStrategy(
+      std::move(scopUPtr), cudaOptions);
+  auto parts = Scop::makeSplitAtOuterSequence(*scheduled);
+  std::vector<std::unique_ptr<MappedScop>> res;
+  for (auto& part : parts) {
+    // Each part may have its own options.  The caller only zeroes the
+    // outputs of grid reductions of the whole scop, there are none if it is
+    // split.
+    auto partOptions = cudaOptions.optionsOfKernel(res.size());
+    if (parts.size() > 1) {
+      partOptions.gridReductions(false);
+    }
+    res.push_back(mapScheduledWithOuterBlockInnerThreadStrategy(
+        std::move(part), partOptions));
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "Kernel " << res.size() - 1 << " of " << parts.size()
+        << " with grid " << res.back()->numBlocks << " and block "
+        << res.back()->numThreads;
+  }
+  return res;
+}
+
+std::vector<std::unique_ptr<MappedScop>>
+MappedScop::makeCooperativeWithOuterBlockInnerThreadStrategy(
+    std::unique_ptr<Scop>&& scopUPtr,
+    const CudaMappingOptions& cudaOptions) {
+  // All the blocks of a cooperative launch are resident at once and each
+  // stage guards its blocks on the hardware block indices.
+  auto stageOptions = cudaOptions;
+  stageOptions.persistentBlocks(true).blockSwizzle(1);
+  return makeSplitWithOuterBlockInnerThreadStrategy(
+      std::move(scopUPtr), stageOptions);
+}
+
+std::unique_ptr<MappedScop>
+MappedScop::mapScheduledWithOuterBlockInnerThreadStrategy(
+    std::unique_ptr<Scop>&& scopUPtr,
+    const CudaMappingOptions& options) {
+  using namespace polyhedral::detail;
+
+  CHECK_LT(0, options.generic.tiling.size())
       << "Must pass tile vector with >= 1 tile sizes";
-  auto outerBand = scop->tileOuterBand(generic.tiling);
+  // 2b. Optionally pack several instances of the outermost loop per block,
+  // which changes the tile sizes and the block.
+  auto cudaOptions = withBatchPacking(*scopUPtr, options);
+  bool batchPacking = cudaOptions.proto().batch_packing() > 1;
+  size_t linearizeBlocks =
+      batchPacking ? 1 : cudaOptions.proto().linearize_blocks();
+  const auto& generic = cudaOptions.generic;
+
+  // 3. Tile
+  auto outerBand = scopUPtr->tileOuterBand(generic.tiling);
+
+  // 3b. Optionally only launch as many blocks as can be resident at once,
+  // which the tiles are distributed over.
+  ::tc::Grid grid(cudaOptions.grid);
+  ::tc::Block block(cudaOptions.block);
+  if (cudaOptions.proto().persistent_blocks()) {
+    grid = persistentGrid(*scopUPtr, outerBand, grid, block, linearizeBlocks);
+    LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Persistent grid " << grid;
+  }
+
+  auto mappedScop = std::unique_ptr<MappedScop>(
+      new MappedScop(std::move(scopUPtr), grid, block, generic.proto.unroll()));
+  auto& scop = mappedScop->scop_;
+  mappedScop->useDynamicSharedMemory =
+      cudaOptions.proto().use_dynamic_shared_memory();
+  mappedScop->useWarpShuffleReductions =
+      cudaOptions.proto().warp_shuffle_reductions();
+  mappedScop->useGridReductions = cudaOptions.proto().grid_reductions();
+  mappedScop->useWarpAggregatedAtomics =
+      cudaOptions.proto().warp_aggregated_atomics();
+  mappedScop->useLaunchBounds =
+      cudaOptions.proto().compiler_options().use_launch_bounds();
+  mappedScop->minBlocksPerMultiprocessor =
+      cudaOptions.proto().compiler_options().min_blocks_per_multiprocessor();
+  mappedScop->useUnrollPragma = cudaOptions.proto().unroll_pragma();
+  mappedScop->blockSwizzle = cudaOptions.proto().block_swizzle();
+  mappedScop->linearizeBlocks = linearizeBlocks;
+  mappedScop->useTwoDimReductions = cudaOptions.proto().two_dim_reductions();
+  mappedScop->mathPrecision = cudaOptions.proto().math_precision();
+  mappedScop->preciseTensors.insert(
+      cudaOptions.proto().precise_tensors().begin(),
+      cudaOptions.proto().precise_tensors().end());
+  if (cudaOptions.proto().async_copies()) {
+    // Without a device, e.g. when only generating code, the copies are
+    // emitted and only asynchronous when compiled for sm_80 and up.
+    auto capability = queryComputeCapability();
+    mappedScop->useAsyncCopies = capability == 0 || capability >= 80;
+    LOG_IF(WARNING, !mappedScop->useAsyncCopies)
+        << "ignoring async copies on a device of compute capability "
+        << capability;
+  }
+  LOG_IF(WARNING, mappedScop->useUnrollPragma && !generic.proto.has_unroll())
+      << "requested unroll pragmas without providing the unroll size";
 
   // 4. Optionally reschedule if point loops need a different strategy than
   // tile loops
@@ -622,14 +1530,100 @@ std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
     scop->specializeToContext();
   }
 
+  // 4b. Optionally compute a matmul on tensor cores instead, one warp per
+  // 16 x 16 tile of the tiles of the outer band.
+  if (cudaOptions.proto().use_tensor_cores()) {
+    auto matmul =
+        matchTensorCoreMatmul(*scop, outerBand, generic.tiling.extractVector());
+    if (matmul) {
+      auto grid = ::tc::Grid(std::vector<uint64_t>{
+          (matmul->n + matmul->tileN - 1) / matmul->tileN,
+          (matmul->m + matmul->tileM - 1) / matmul->tileM});
+      auto block = ::tc::Block(std::vector<uint64_t>{
+          32, (matmul->tileM / 16) * (matmul->tileN / 16)});
+      auto res = MappedScop::makeMappedScop(
+          std::move(scop), grid, block, generic.proto.unroll());
+      res->useLaunchBounds = mappedScop->useLaunchBounds;
+      res->minBlocksPerMultiprocessor = mappedScop->minBlocksPerMultiprocessor;
+      res->tensorCoreMatmul = std::move(matmul);
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << "Matmul on tensor cores with grid " << grid << " and block "
+          << block;
+      return res;
+    }
+  }
+
+  // 4c. Optionally split a reduction across blocks
+  bool gridReduction = mappedScop->useGridReductions &&
+      mappedScop->splitReductionAcrossBlocks(outerBand);
+  LOG_IF(INFO, FLAGS_debug_tc_mapper && gridReduction)
+      << "Split reduction across blocks:" << std::endl
+      << *mappedScop->schedule();
+
+  // 4d. Optionally separate full tiles from partial tiles, which leaves no
+  // band to tile for threads below the outer band.
+  const auto& threadTiling = cudaOptions.proto().thread_tiling().sizes();
+  const auto& warpTiling = cudaOptions.proto().warp_tiling().sizes();
+  if (cudaOptions.proto().separate_full_tiles() && threadTiling.empty() &&
+      warpTiling.empty() &&
+      separateFullTiles(
+          scop->scheduleRoot(), outerBand, generic.tiling.extractVector())) {
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "After separating full tiles:" << std::endl
+        << *mappedScop->schedule();
+  }
+
   // 5. Map to threads
   if (outerBand->numChildren() > 0) {
     CHECK_EQ(1, outerBand->numChildren());
-    // 5.1. Optionally detect reductions while mapping to threads
-    if (generic.proto.match_library_calls()) {
+    // 5.1. Optionally detect reductions while mapping to threads.
+    // The library calls do not combine the results of several blocks.
+    if (generic.proto.match_library_calls() && !gridReduction &&
+        !batchPacking) {
       mappedScop->detectReductions(outerBand->child({0}));
     }
     auto child = outerBand->child({0});
+    // 5.2. Map the wavefronts of point bands without parallel member to
+    // threads, e.g. after skewing (see SchedulerOptionsProto::allow_skewing).
+    if (mappedScop->wavefrontForThreads(child)) {
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << "After wavefront skewing:" << std::endl
+          << *mappedScop->schedule();
+    }
+    // 5.3. Optionally give each warp a tile of the point band, whose points
+    // are then tiled for threads.
+    auto threadBand = child;
+    if (!warpTiling.empty()) {
+      auto points = mappedScop->tileForWarps(
+          child, std::vector<size_t>(warpTiling.begin(), warpTiling.end()));
+      if (points) {
+        threadBand = points;
+        LOG_IF(INFO, FLAGS_debug_tc_mapper)
+            << "After tiling for warps:" << std::endl
+            << *mappedScop->schedule();
+      } else {
+        LOG(WARNING) << "no parallel point loop to tile for warps";
+      }
+    }
+    // 5.4. Optionally give each thread a tile of the point band.
+    if (mappedScop->tileForThreads(
+            threadBand,
+            std::vector<size_t>(threadTiling.begin(), threadTiling.end()))) {
+      LOG_IF(INFO, FLAGS_debug_tc_mapper)
+          << "After tiling for threads:" << std::endl
+          << *mappedScop->schedule();
+    }
+    // 5.5. Optionally map the instances of the batch packed in the block to
+    // the last thread identifier.
+    if (batchPacking) {
+      if (mappedScop->packBatchForThreads(child)) {
+        LOG_IF(INFO, FLAGS_debug_tc_mapper)
+            << "After packing the batch:" << std::endl
+            << *mappedScop->schedule();
+      } else {
+        LOG(WARNING) << "no parallel point loop to pack in blocks";
+      }
+    }
     size_t numMappedInnerThreads =
         mappedScop->mapInnermostBandsToThreads(child);
     mappedScop->mapRemaining<mapping::ThreadId>(
@@ -648,9 +1642,12 @@ std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
   // 7. Promote to shared memory below the loops mapped to blocks.
   // This may split the outer band, so find the new outer band after promotion.
   if (cudaOptions.proto().use_shared_memory()) {
+    ScopeTimer timer(compilationTimings().promotion, "tc promotion");
+    // Only dynamic shared memory can go beyond the static per-block limit.
     size_t sharedMemorySize = cudaOptions.proto().has_max_shared_memory()
         ? cudaOptions.proto().max_shared_memory()
-        : querySharedMemorySize();
+        : mappedScop->useDynamicSharedMemory ? queryOptinSharedMemorySize()
+                                             : querySharedMemorySize();
     // If reductions found, their synchronization requires an opaque cache in
     // shared memory.  Subtract 4k from available shared memory for each
     // reduction found, this is hack based on each thread of max 1024 in the
@@ -675,13 +1672,25 @@ std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
               !generic.proto.has_unroll())
           << "requested to unroll copies to shared memory without providing the unroll size";
 
-      promoteGreedilyAtDepth(
+      // Consider promoting below any member of the outer band that is not
+      // mapped to blocks.
+      auto blockDepth = std::min(
+          band->nOuterCoincident() + (gridReduction ? 1 : 0),
+          mappedScop->numBlocks.view.size() +
+              mappedScop->nLinearizedBlockMembers_ - 1);
+      auto outerBandDepth =
+          outerBand->scheduleDepth(scop->scheduleRoot()) + band->nMember();
+      promoteToShared(
           *mappedScop,
           mappedScop->threadIdxXScheduleDepthState,
-          std::min(band->nOuterCoincident(), mappedScop->numBlocks.view.size()),
+          blockDepth,
+          std::max(blockDepth, outerBandDepth),
           sharedMemorySize,
           cudaOptions.proto().unroll_copy_shared() &&
-              generic.proto.has_unroll());
+              generic.proto.has_unroll(),
+          cudaOptions.proto().double_buffer_shared(),
+          cudaOptions.proto().vectorize_width(),
+          cudaOptions.proto().transpose_shared());
 
       auto bands = ScheduleTree::collectDFSPreorder(
           scop->scheduleRoot(), ScheduleTreeType::Band);
@@ -694,6 +1703,7 @@ std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
 
   // 8. Promote to registers below the loops mapped to threads.
   if (cudaOptions.proto().use_private_memory()) {
+    ScopeTimer timer(compilationTimings().promotion, "tc promotion");
     promoteToRegistersBelowThreads(
         mappedScop->scop(), mappedScop->threadIdxXScheduleDepthState, -1ull);
   }
@@ -704,16 +1714,162 @@ std::unique_ptr<MappedScop> MappedScop::makeWithOuterBlockInnerThreadStrategy(
   // 10. Optionally insert reduction synchronizations
   for (auto bandUpdate : mappedScop->reductionBandUpdates_) {
     for (auto updateId : bandUpdate.second.ids) {
-      scop->insertReductionSync1D(
+      auto treeSyncId = scop->insertReductionSync1D(
           const_cast<ScheduleTree*>(bandUpdate.first), updateId);
+      if (bandUpdate.second.nDims == 2) {
+        scop->treeSyncsAlongXY.insert(treeSyncId);
+      }
     }
   }
   LOG_IF(INFO, FLAGS_debug_tc_mapper)
       << "After inserting reduction synchronization:" << std::endl
       << *mappedScop->schedule();
 
+  // 11. Remove the synchronizations that do not order accesses of
+  // different threads
+  minimizeSyncs(*scop, mappedScop->numThreads);
+  LOG_IF(INFO, FLAGS_debug_tc_mapper)
+      << "After minimizing synchronizations:" << std::endl
+      << *mappedScop->schedule();
+
   return mappedScop;
 }
 
+namespace {
+std::string islToString(char* str) {
+  CHECK(str) << "could not print isl object";
+  std::string res(str);
+  free(str);
+  return res;
+}
+
+template <typename Map>
+void addIdPairs(
+    const Map& map,
+    google::protobuf::RepeatedPtrField<IslIdPairProto>* pairs) {
+  for (const auto& kvp : map) {
+    auto pair = pairs->Add();
+    pair->set_key(kvp.first.get_name());
+    pair->set_value(kvp.second.get_name());
+  }
+}
+
+template <typename Map>
+void readIdPairs(
+    isl::ctx ctx,
+    const google::protobuf::RepeatedPtrField<IslIdPairProto>& pairs,
+    Map* map) {
+  map->clear();
+  for (const auto& pair : pairs) {
+    map->emplace(isl::id(ctx, pair.key()), isl::id(ctx, pair.value()));
+  }
+}
+} // namespace
+
+MappedScopProto MappedScop::toProtobuf() const {
+  if (!scop_->promotedDecls().empty()) {
+    throw std::invalid_argument(
+        "cannot serialize a MappedScop with promoted tensors");
+  }
+  if (tensorCoreMatmul) {
+    throw std::invalid_argument(
+        "cannot serialize a MappedScop computed with tensor cores");
+  }
+  MappedScopProto res;
+  *res.mutable_schedule() = detail::toProtobuf(*schedule());
+  res.set_global_parameter_context(
+      islToString(isl_set_to_str(scop_->globalParameterContext.get())));
+  *res.mutable_grid() = numBlocks.view.proto;
+  *res.mutable_block() = numThreads.view.proto;
+  res.set_unroll(unroll);
+  res.set_use_dynamic_shared_memory(useDynamicSharedMemory);
+  res.set_use_warp_shuffle_reductions(useWarpShuffleReductions);
+  res.set_use_grid_reductions(useGridReductions);
+  res.set_use_launch_bounds(useLaunchBounds);
+  res.set_min_blocks_per_multiprocessor(minBlocksPerMultiprocessor);
+  res.set_use_unroll_pragma(useUnrollPragma);
+  res.set_block_swizzle(blockSwizzle);
+  res.set_use_async_copies(useAsyncCopies);
+  res.set_use_warp_aggregated_atomics(useWarpAggregatedAtomics);
+  res.set_math_precision(mathPrecision);
+  for (const auto& name : preciseTensors) {
+    res.add_precise_tensors(name);
+  }
+  addIdPairs(scop_->treeSyncUpdateMap, res.mutable_tree_sync_updates());
+  addIdPairs(
+      scop_->defaultReductionInitMap, res.mutable_default_reduction_inits());
+  for (const auto& id : scop_->atomicUpdates) {
+    res.add_atomic_updates(id.get_name());
+  }
+  for (const auto& id : scop_->treeSyncsAlongXY) {
+    res.add_tree_syncs_along_xy(id.get_name());
+  }
+  for (const auto& kvp : scop_->tensorStrides) {
+    auto strides = res.add_tensor_strides();
+    strides->set_name(kvp.first);
+    for (auto stride : kvp.second) {
+      strides->add_strides(stride);
+    }
+  }
+  for (const auto& kvp : scop_->constantInputs) {
+    auto constant = res.add_constant_inputs();
+    constant->set_name(kvp.first);
+    constant->set_values(kvp.second);
+  }
+  return res;
+}
+
+std::unique_ptr<MappedScop> MappedScop::makeFromProtobuf(
+    std::unique_ptr<Scop>&& scop,
+    const MappedScopProto& proto) {
+  auto ctx = scop->domain().get_ctx();
+  const auto& contextString = proto.global_parameter_context();
+  auto context =
+      isl::manage(isl_set_read_from_str(ctx.get(), contextString.c_str()));
+  if (!context) {
+    throw std::invalid_argument(
+        "could not parse context " + contextString);
+  }
+  scop->globalParameterContext = context;
+  scop->setScheduleTree(detail::fromProtobuf(ctx, proto.schedule()));
+  readIdPairs(ctx, proto.tree_sync_updates(), &scop->treeSyncUpdateMap);
+  readIdPairs(
+      ctx, proto.default_reduction_inits(), &scop->defaultReductionInitMap);
+  scop->atomicUpdates.clear();
+  for (const auto& name : proto.atomic_updates()) {
+    scop->atomicUpdates.insert(isl::id(ctx, name));
+  }
+  scop->treeSyncsAlongXY.clear();
+  for (const auto& name : proto.tree_syncs_along_xy()) {
+    scop->treeSyncsAlongXY.insert(isl::id(ctx, name));
+  }
+  for (const auto& strides : proto.tensor_strides()) {
+    scop->tensorStrides[strides.name()] = std::vector<int64_t>(
+        strides.strides().begin(), strides.strides().end());
+  }
+  for (const auto& constant : proto.constant_inputs()) {
+    scop->constantInputs[constant.name()] = constant.values();
+  }
+
+  auto res = makeMappedScop(
+      std::move(scop),
+      ::tc::Grid(proto.grid()),
+      ::tc::Block(proto.block()),
+      proto.unroll());
+  res->useDynamicSharedMemory = proto.use_dynamic_shared_memory();
+  res->useWarpShuffleReductions = proto.use_warp_shuffle_reductions();
+  res->useGridReductions = proto.use_grid_reductions();
+  res->useLaunchBounds = proto.use_launch_bounds();
+  res->minBlocksPerMultiprocessor = proto.min_blocks_per_multiprocessor();
+  res->useUnrollPragma = proto.use_unroll_pragma();
+  res->blockSwizzle = proto.block_swizzle();
+  res->useAsyncCopies = proto.use_async_copies();
+  res->useWarpAggregatedAtomics = proto.use_warp_aggregated_atomics();
+  res->mathPrecision = proto.math_precision();
+  res->preciseTensors.insert(
+      proto.precise_tensors().begin(), proto.precise_tensors().end());
+  return res;
+}
+
 } // namespace polyhedral
 } // namespace tc
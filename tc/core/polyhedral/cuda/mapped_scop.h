@@ -18,9 +18,12 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <unordered_map>
 #include <vector>
 
+#include <compcache.pb.h>
+
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/polyhedral/cuda/mapping_types.h"
 #include "tc/core/polyhedral/cuda/memory_promotion_heuristic.h"
@@ -31,6 +34,16 @@
 namespace tc {
 namespace polyhedral {
 
+// A scop that only computes c(m, n) +=! a(m, k) * b(k, n) for row-major
+// float16 matrices a and b, with sizes m, n and k multiples of 16, which is
+// computed on tensor cores by code::cuda::wmmaMatmul, each block computing a
+// tileM x tileN tile of c.
+struct TensorCoreMatmul {
+  std::string c, a, b;
+  long m, n, k;
+  size_t tileM, tileN;
+};
+
 // Scop associated with fixed block and grid dimensions.
 //
 // Different branches of the schedule tree may be mapped to GPU blocks or
@@ -87,6 +100,39 @@ class MappedScop {
       std::unique_ptr<Scop>&& scopUPtr,
       const CudaMappingOptions& mappingOptions);
 
+  // Apply the OuterBlockInnerThread mapping strategy to each part of the
+  // schedule split by Scop::makeSplitAtOuterSequence, which results in one
+  // mapped scop per kernel, to be launched in order.  Each part is mapped
+  // with the options of its kernel (see CudaMappingOptions::optionsOfKernel).
+  // Grid reductions are only performed if the schedule is not split.
+  static std::vector<std::unique_ptr<MappedScop>>
+  makeSplitWithOuterBlockInnerThreadStrategy(
+      std::unique_ptr<Scop>&& scopUPtr,
+      const CudaMappingOptions& mappingOptions);
+
+  // Same as makeSplitWithOuterBlockInnerThreadStrategy for the stages of a
+  // cooperative kernel, see codegenCooperative and
+  // CudaMappingOptionsProto::cooperative_kernels.  The blocks of each stage
+  // are persistent.
+  static std::vector<std::unique_ptr<MappedScop>>
+  makeCooperativeWithOuterBlockInnerThreadStrategy(
+      std::unique_ptr<Scop>&& scopUPtr,
+      const CudaMappingOptions& mappingOptions);
+
+  // The mapped schedule and the state code generation reads, to restore the
+  // MappedScop with makeFromProtobuf, e.g. in another process, without
+  // scheduling and mapping again.  Throws std::invalid_argument if code
+  // generation reads more, i.e. for promotions and tensor core matmuls.
+  MappedScopProto toProtobuf() const;
+
+  // Rebuild the MappedScop of proto on scop, which must be built from the
+  // same TC and inputs as the serialized one, e.g. with Scop::makeScop.  The
+  // schedule tree and the global parameter context of scop are replaced.
+  // Throws std::invalid_argument if proto is not that of a MappedScop.
+  static std::unique_ptr<MappedScop> makeFromProtobuf(
+      std::unique_ptr<Scop>&& scop,
+      const MappedScopProto& proto);
+
   // Map a particular "pos"-th dimension in a _band_ node identified by "tree"
   // to the block or thread dimension.  Ancestors or descendants of "tree" must
   // not have a dimension already mapped to the same block or thread.
@@ -118,10 +164,22 @@ class MappedScop {
   void insertMappingContext();
 
   // Generate CUDA code at the current state of transformation provided a
-  // name for the generated function.
-  std::tuple<std::string, tc::Grid, tc::Block> codegen(
+  // name for the generated function.  Also returns the launch bounds and the
+  // number of bytes of dynamic shared memory to launch the kernel with.
+  std::tuple<std::string, tc::Grid, tc::Block, size_t> codegen(
       const std::string& specializedName) const;
 
+  // Generate the CUDA code of a single kernel running "stages", built by
+  // makeCooperativeWithOuterBlockInnerThreadStrategy, one after the other
+  // with a synchronization of the grid in between.  Also returns the launch
+  // bounds, the largest grid of the stages, and the number of bytes of
+  // dynamic shared memory, which the stages share.  The kernel must be
+  // launched cooperatively.
+  static std::tuple<std::string, tc::Grid, tc::Block, size_t>
+  codegenCooperative(
+      const std::string& specializedName,
+      const std::vector<std::unique_ptr<MappedScop>>& stages);
+
   // Accessors..
   // Const accessor to schedule of underlying Scop.
   inline const detail::ScheduleTree* schedule() const {
@@ -136,12 +194,53 @@ class MappedScop {
   }
 
  private:
-  // Map "band" to block identifiers and then scale
+  // The steps of the OuterBlockInnerThread mapping strategy that follow
+  // scheduling, applied to the scheduled "scopUPtr".
+  static std::unique_ptr<MappedScop>
+  mapScheduledWithOuterBlockInnerThreadStrategy(
+      std::unique_ptr<Scop>&& scopUPtr,
+      const CudaMappingOptions& mappingOptions);
+  // If "band", the outer band, has a reduction member right after its outer
+  // coincident members and a block identifier is left for it, prepare the
+  // reduction for the mapping of that member to blocks by
+  // mapToBlocksAndScaleBand: the init statements are dropped and the update
+  // statement is marked as an atomic update.  Return true if it did.
+  bool splitReductionAcrossBlocks(detail::ScheduleTree* band);
+  // Tile the outer coincident members of "band", a point band, by
+  // "threadTileSizes" and mark the resulting intra-tile band for unrolling,
+  // so that the tiles are mapped to threads by mapInnermostBandsToThreads
+  // and each thread executes the points of a tile.  Return true if it did.
+  bool tileForThreads(
+      detail::ScheduleTree* band,
+      const std::vector<size_t>& threadTileSizes);
+  // Tile the outer coincident members of "band", a point band, by
+  // "warpTileSizes" and split the tile loops of these members off, so that
+  // mapInnermostBandsToThreads maps them, linearized, to the last thread
+  // identifier and the points of the tiles to the previous ones.  Return
+  // the band of the points of the tiles, or nullptr if it did not tile.
+  detail::ScheduleTree* tileForWarps(
+      detail::ScheduleTree* band,
+      const std::vector<size_t>& warpTileSizes);
+  // If "band", a point band, is permutable without coincident member, as
+  // skewed schedules of stencils are, skew its first member into a wavefront
+  // and split it off, so that mapInnermostBandsToThreads maps the points of
+  // each wavefront to threads and synchronizes between wavefronts.  Return
+  // true if it did.
+  bool wavefrontForThreads(detail::ScheduleTree* band);
+  // If "band", a point band, is permutable with a coincident first member,
+  // split off this member, the instances of the batch packed in the block,
+  // so that mapInnermostBandsToThreads maps it to the last thread
+  // identifier and the other members to the previous ones.  Return true if
+  // it did.
+  bool packBatchForThreads(detail::ScheduleTree* band);
+  // Map "band" to block identifiers, its linearizeBlocks outermost
+  // coincident members together to the first one, and then scale
   // the band members by "tileSizes".
   void mapToBlocksAndScaleBand(
       detail::ScheduleTree* band,
       std::vector<size_t> tileSizes);
-  // Look for innermost reduction band members.
+  // Look for innermost reduction band members, two of them with
+  // useTwoDimReductions.
   // Store them in reductionBandUpdates_ and their parents
   // in reductionFromParent_.  Return true if any were found.
   bool detectReductions(detail::ScheduleTree* band);
@@ -174,6 +273,62 @@ class MappedScop {
   const ::tc::Block numThreads;
   const uint64_t unroll;
 
+  // Declare the arrays promoted to shared memory in a dynamically sized
+  // buffer instead of statically, which allows using more than the static
+  // 48KB limit on devices that support it.
+  bool useDynamicSharedMemory = false;
+
+  // Emit the reductions detected by detectReductions as warp shuffle
+  // reductions instead of CUB block reductions.
+  bool useWarpShuffleReductions = false;
+
+  // Split the reduction making up the whole kernel across blocks if
+  // possible (see gridReductionOutputs).
+  bool useGridReductions = false;
+
+  // Add to the outputs of the atomic reductions with one atomic addition
+  // per element updated by the lanes of a warp (see
+  // CudaMappingOptionsProto::warp_aggregated_atomics).
+  bool useWarpAggregatedAtomics = false;
+
+  // If set, the kernel computes this matmul with tensor cores and the
+  // schedule tree is ignored by codegen.
+  std::unique_ptr<TensorCoreMatmul> tensorCoreMatmul;
+
+  // Declare the kernel with __launch_bounds__(number of threads,
+  // minBlocksPerMultiprocessor), the latter omitted if 0.
+  bool useLaunchBounds = false;
+  uint32_t minBlocksPerMultiprocessor = 0;
+
+  // Precede the innermost loops that are not fully unrolled with
+  // "#pragma unroll" (see CudaMappingOptionsProto::unroll_pragma).
+  bool useUnrollPragma = false;
+
+  // Remap the block indices of the two first dimensions of the grid so that
+  // blocks are launched in groups of blockSwizzle values of the second one
+  // (see CudaMappingOptionsProto::block_swizzle), 1 keeps the order.
+  uint32_t blockSwizzle = 1;
+
+  // Map this many outermost coincident members of the band mapped to blocks
+  // together to the first block identifier (see
+  // CudaMappingOptionsProto::linearize_blocks), 1 disables it.
+  uint32_t linearizeBlocks = 1;
+
+  // Map reductions over two members to threadIdx.y and threadIdx.x together
+  // (see CudaMappingOptionsProto::two_dim_reductions).
+  bool useTwoDimReductions = false;
+
+  // Copy the arrays promoted to shared memory from global memory with
+  // cp.async, waiting for the copies at each synchronization (see
+  // CudaMappingOptionsProto::async_copies).
+  bool useAsyncCopies = false;
+
+  // Lower the float builtins and divisions to library calls or to fast
+  // approximations, except in the statements writing preciseTensors (see
+  // CudaMappingOptionsProto::math_precision).
+  MathPrecision mathPrecision = MathPrecision::CompilerMath;
+  std::unordered_set<std::string> preciseTensors;
+
   // The schedule depth that was mapped to Thread::x for specific parts of the
   // domain.
   // XXX: this is a partially redundant state as this information can
@@ -185,9 +340,13 @@ class MappedScop {
   // Information about a detected reduction that can potentially
   // be mapped to a library call.
   struct Reduction {
-    Reduction(std::vector<isl::id> ids) : ids(ids), separated(false) {}
+    Reduction(std::vector<isl::id> ids, size_t nDims)
+        : ids(ids), nDims(nDims), separated(false) {}
     // The statement identifiers of the reduction update statements.
     std::vector<isl::id> ids;
+    // The number of members of the reduction band, 1 or 2,
+    // mapped to threadIdx.x and, for the outer one, threadIdx.y.
+    size_t nDims;
     // Has the reduction been separated out as a full block?
     bool separated;
   };
@@ -199,6 +358,29 @@ class MappedScop {
   // Map isolated innermost reduction band members to information
   // about the detected reduction.
   std::map<const detail::ScheduleTree*, Reduction> reductionBandUpdates_;
+  // Has splitReductionAcrossBlocks prepared the reduction member of the
+  // outer band for mapping to blocks?
+  bool gridReduction_ = false;
+  // Intra-tile bands created by tileForThreads, which are executed
+  // sequentially by each thread and not mapped to threads.
+  std::unordered_set<const detail::ScheduleTree*> threadTileBands_;
+  // Band split off by packBatchForThreads, mapped to the last thread
+  // identifier, which the other bands do not use.
+  const detail::ScheduleTree* batchBand_ = nullptr;
+  // Band split off by tileForWarps, mapped to the last thread identifier
+  // like batchBand_, with which it is not combined.
+  const detail::ScheduleTree* warpBand_ = nullptr;
+  // Number of members mapped together to the first block identifier by
+  // mapToBlocksAndScaleBand, 1 if they were not linearized.
+  size_t nLinearizedBlockMembers_ = 1;
 };
+
+// Names of the outputs of "scop" that a mapping with grid reductions may
+// split across blocks.  These are the outputs of a scop made up of a single
+// sum reduction of a type supported by atomicAdd (and its initialization),
+// which is computed entirely atomically if it is a scatter.
+// Kernels mapped with grid reductions do not initialize these outputs, the
+// caller must zero them before every launch.
+std::vector<std::string> gridReductionOutputs(const Scop& scop);
 } // namespace polyhedral
 } // namespace tc
@@ -17,6 +17,7 @@
 
 #include <glog/logging.h>
 
+#include "tc/core/flags.h"
 #include "tc/core/polyhedral/cuda/mapped_scop.h"
 #include "tc/core/polyhedral/exceptions.h"
 #include "tc/core/polyhedral/memory_promotion.h"
@@ -26,14 +27,147 @@
 
 #include <algorithm>
 #include <numeric>
+#include <ostream>
 #include <sstream>
 
 namespace tc {
 namespace polyhedral {
 namespace {
+// Inputs are the tensors the kernel never writes.
+bool isInput(const Scop& scop, isl::id tensorId) {
+  for (const auto& input : scop.halide.inputs) {
+    if (input.name() == tensorId.get_name()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Is the length of the rows of tensor "tensorId", i.e. its extent along the
+// last dimension, a multiple of "width" for all parameter values in the
+// context of "scop"?  If the tensor is not packed, its rows must also be
+// contiguous and start at multiples of "width".
+bool hasRowsMultipleOf(const Scop& scop, isl::id tensorId, int width) {
+  auto strides = scop.tensorStrides.find(tensorId.get_name());
+  if (strides != scop.tensorStrides.end()) {
+    const auto& s = strides->second;
+    if (s.back() != 1) {
+      return false;
+    }
+    for (size_t i = 0; i + 1 < s.size(); ++i) {
+      if (s[i] % width != 0) {
+        return false;
+      }
+    }
+  }
+  auto parameter = scop.findArgument(tensorId).parameter();
+  auto space = scop.domain().get_space().params().set_from_params();
+  auto extent = halide2isl::makeIslAffFromExpr(
+      space, parameter.extent_constraint(parameter.dimensions() - 1));
+  auto multiple = isl::aff_set(extent) == width * (extent / width).floor();
+  return scop.globalParameterContext.is_subset(multiple.params());
+}
+
+// The elements of "space" whose coordinate "pos" is a multiple of "width".
+isl::set multiplesOf(isl::space space, int pos, int width) {
+  auto aff = isl::aff(isl::local_space(space), isl::dim_type::set, pos);
+  return isl::aff_set(aff) == width * (aff / width).floor();
+}
+
+// Restrict the read copies of the single promoted group of the copy filter
+// "node" to every "width"-th element along the last dimension, each copy
+// statement instance then reading "width" consecutive elements with a single
+// vector access.  Return false, leaving the tree untouched, unless this is
+// safe, i.e.
+// - the promoted tensor is a float input laid out as the tensor;
+// - the promoted and the global rows hold a multiple of "width" elements;
+// - the elements copied to the same promoted row come from the same
+//   offsets modulo "width" in the global row.
+// Since the copied elements are a box clipped to the tensor, they then form
+// complete groups of "width" elements, aligned in both the promoted and the
+// global array.  The alignment of the global array itself is checked by the
+// caller of the mapper.
+bool vectorizeReadCopies(
+    Scop& scop,
+    detail::ScheduleTree* node,
+    detail::ScheduleTree* bandNode,
+    int width) {
+  using namespace detail;
+
+  auto root = scop.scheduleRoot();
+  auto& filter = node->elemAs<ScheduleTreeElemFilter>()->filter_;
+  auto filterSets = isl::UnionAsVector<isl::union_set>(filter);
+  if (filterSets.size() != 1 || filterSets[0].get_tuple_name() != kReadIdName) {
+    return false;
+  }
+  auto space = filterSets[0].get_space();
+  auto groupId = space.unwrap().get_tuple_id(isl::dim_type::out);
+  const auto& decl = scop.promotedDecls().at(groupId);
+  if (decl.kind != Scop::PromotedDecl::Kind::SharedMem ||
+      !decl.layout.empty() || !isInput(scop, decl.tensorId) ||
+      scop.findArgument(decl.tensorId).type() != Halide::Float(32) ||
+      decl.sizes.back() % width != 0 ||
+      !hasRowsMultipleOf(scop, decl.tensorId, width)) {
+    return false;
+  }
+
+  // The copied elements are introduced by the closest extension node.
+  isl::union_set copied;
+  auto ancestors = node->ancestors(root);
+  for (auto it = ancestors.rbegin(); it != ancestors.rend(); ++it) {
+    if (auto extension = (*it)->elemAs<ScheduleTreeElemExtension>()) {
+      copied = extension->extension_.range().intersect(filter);
+      break;
+    }
+  }
+  if (copied.is_null()) {
+    return false;
+  }
+  // In the space [[S -> O] -> P], the last subscripts of the original and
+  // the promoted arrays must differ by a multiple of "width".
+  auto nDim = static_cast<int>(decl.sizes.size());
+  auto last = static_cast<int>(space.dim(isl::dim_type::set)) - 1;
+  auto local = isl::local_space(space);
+  auto offset = isl::aff(local, isl::dim_type::set, last - nDim) -
+      isl::aff(local, isl::dim_type::set, last);
+  auto aligned = isl::aff_set(offset) == width * (offset / width).floor();
+  if (!copied.is_subset(isl::union_set(aligned))) {
+    return false;
+  }
+
+  filter = filter.intersect(isl::union_set(multiplesOf(space, last, width)));
+  auto band = bandNode->elemAs<ScheduleTreeElemBand>();
+  auto lastMember = band->nMember() - 1;
+  auto upa = band->mupa_.get_union_pw_aff(lastMember);
+  upa = upa.scale_down(isl::val(node->ctx_, width)).floor();
+  band->mupa_ = band->mupa_.set_union_pw_aff(lastMember, upa);
+  scop.vectorizeReads(groupId, width);
+  return true;
+}
+
+/*
+ * Check if "node" is located below a mapping to threads.
+ */
+bool isBelowThreadMapping(
+    const detail::ScheduleTree* root,
+    const detail::ScheduleTree* node) {
+  for (auto n : node->ancestors(root)) {
+    if (auto filterNode = n->elemAs<detail::ScheduleTreeElemMappingFilter>()) {
+      for (auto id : filterNode->mappingIds) {
+        if (id.isThreadId()) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
 // Map global<->shared copy bands to threads, starting from the innermost
 // loop as it iterates over the last subscript and will result in coalescing.
-void mapCopiesToThreads(MappedScop& mscop, bool unroll) {
+// If "vectorWidth" is greater than one, vectorize the read copies where
+// possible so that each thread copies "vectorWidth" consecutive elements.
+void mapCopiesToThreads(MappedScop& mscop, bool unroll, size_t vectorWidth) {
   using namespace detail;
 
   // Find all filters with reads from or writes to global memory.
@@ -66,17 +200,14 @@ void mapCopiesToThreads(MappedScop& mscop, bool unroll) {
     }
 
     // Check that we are not mapping to threads below other thread mappings.
-    std::unordered_set<mapping::ThreadId, mapping::ThreadId::Hash> usedThreads;
-    for (auto n : node->ancestors(root)) {
-      if (auto filterNode = n->elemAs<ScheduleTreeElemMappingFilter>()) {
-        for (auto id : filterNode->mappingIds) {
-          if (id.isThreadId()) {
-            throw promotion::PromotionBelowThreadsException(
-                "attempted to map memory copies to threads below "
-                "another thread mapping");
-          }
-        }
-      }
+    if (isBelowThreadMapping(root, node)) {
+      throw promotion::PromotionBelowThreadsException(
+          "attempted to map memory copies to threads below "
+          "another thread mapping");
+    }
+
+    if (vectorWidth > 1) {
+      vectorizeReadCopies(mscop.scop(), node, bandNode, vectorWidth);
     }
 
     // Map band dimensions to threads, in inverse order since the last member
@@ -119,7 +250,8 @@ void mapCopiesToThreads(MappedScop& mscop, bool unroll) {
 
     // Unroll if requested.
     if (unroll) {
-      markUnroll(root, bandNode, mscop.unroll);
+      markUnroll(
+          root, bandNode, mscop.unroll, FLAGS_cuda_max_kernel_statements);
     }
   }
 }
@@ -272,29 +404,24 @@ size_t computeThreadIdxXScheduleDepth(
 }
 
 /*
- * Check if a reference group is accessed in a coalesced way.
- *
- * In particular, check if incrementing the schedule dimension mapped to
- * Thread::x results in the last tensor index being incremented as well.
- * Since accesses in the group may belong to different statements, which are
- * have different loops mapped to Thread::x, perform the check for each basic
- * map in the union of access maps taking into account which dimension is
- * mapped for a particular statement (domain of the basic map).  The group is
- * accessed in a coalesced way if all references in this group are accessed in
- * a coalesced way.
+ * Compute, for each basic map in the original accesses of the reference
+ * group, the relation between the tensor elements accessed by adjacent
+ * threads along Thread::x, i.e. by incrementing the schedule dimension mapped
+ * to Thread::x.  Since accesses in the group may belong to different
+ * statements, which are have different loops mapped to Thread::x, take into
+ * account which dimension is mapped for a particular statement (domain of the
+ * basic map).
  */
-bool isCoalesced(
+std::vector<isl::map> accessedByAdjacentThreadX(
     const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
     const TensorReferenceGroup& group,
     isl::union_map schedule,
     isl::union_set activePoints) {
+  std::vector<isl::map> result;
   auto originalAccesses = group.originalAccesses();
 
   for (auto accessMap : isl::UnionAsVector<isl::union_map>(originalAccesses)) {
     for (auto access : accessMap.get_basic_map_list()) {
-      auto tensorSpace = access.get_space().range();
-      auto elementToNext = makeNextElementMap(
-          tensorSpace, tensorSpace.dim(isl::dim_type::set) - 1);
       auto domainUMap = isl::union_set(isl::set(access.domain()));
       int threadIdxXDepth = computeThreadIdxXScheduleDepth(
           threadIdxXScheduleDepthState, domainUMap.intersect(activePoints));
@@ -307,41 +434,143 @@ bool isCoalesced(
       auto scheduleToNextX = makeNextElementMap(
           partialSchedule.get_space().range(), threadIdxXDepth);
       auto scheduledAccess = isl::map(access).apply_domain(partialSchedule);
-      auto accessedByAdjacentX = scheduleToNextX.apply_domain(scheduledAccess)
-                                     .apply_range(scheduledAccess);
+      result.push_back(scheduleToNextX.apply_domain(scheduledAccess)
+                           .apply_range(scheduledAccess));
+    }
+  }
+  return result;
+}
 
-      if (not accessedByAdjacentX.is_subset(elementToNext)) {
-        return false;
-      }
+/*
+ * Check if a reference group is accessed in a coalesced way.
+ *
+ * In particular, check if incrementing the schedule dimension mapped to
+ * Thread::x results in the last tensor index being incremented as well.
+ * The group is accessed in a coalesced way if all references in this group
+ * are accessed in a coalesced way.
+ */
+bool isCoalesced(
+    const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
+    const TensorReferenceGroup& group,
+    isl::union_map schedule,
+    isl::union_set activePoints) {
+  for (auto adjacent : accessedByAdjacentThreadX(
+           threadIdxXScheduleDepthState, group, schedule, activePoints)) {
+    auto tensorSpace = adjacent.get_space().domain();
+    auto elementToNext = makeNextElementMap(
+        tensorSpace, tensorSpace.dim(isl::dim_type::set) - 1);
+    if (not adjacent.is_subset(elementToNext)) {
+      return false;
     }
   }
   return true;
 }
 
+/*
+ * Find the dimension of the tensor of a reference group, other than the last
+ * one, that is incremented when incrementing the schedule dimension mapped to
+ * Thread::x, for all references in the group, as is the case for transposed
+ * accesses.  Return -1 if there is no such dimension.
+ */
+int threadXIncrementedDim(
+    const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
+    const TensorReferenceGroup& group,
+    isl::union_map schedule,
+    isl::union_set activePoints) {
+  auto adjacents = accessedByAdjacentThreadX(
+      threadIdxXScheduleDepthState, group, schedule, activePoints);
+  if (adjacents.empty()) {
+    return -1;
+  }
+  auto tensorSpace = adjacents.front().get_space().domain();
+  int nDim = tensorSpace.dim(isl::dim_type::set);
+  for (int dim = 0; dim < nDim - 1; ++dim) {
+    auto elementToNext = makeNextElementMap(tensorSpace, dim);
+    auto incremented = std::all_of(
+        adjacents.begin(), adjacents.end(), [&](const isl::map& adjacent) {
+          return adjacent.is_subset(elementToNext);
+        });
+    if (incremented) {
+      return dim;
+    }
+  }
+  return -1;
+}
+
+/*
+ * The layout of a promoted array of "nDim" dimensions with tensor dimension
+ * "dim" moved innermost.
+ */
+std::vector<size_t> innermostLayout(size_t nDim, size_t dim) {
+  std::vector<size_t> layout;
+  for (size_t i = 0; i < nDim; ++i) {
+    if (i != dim) {
+      layout.push_back(i);
+    }
+  }
+  layout.push_back(dim);
+  return layout;
+}
+
+/*
+ * Check if adjacent threads along Thread::x access elements of a reference
+ * group that lie in different rows, i.e. that differ in an index other than
+ * the last one, as is the case for transposed accesses.  Once the group is
+ * promoted to shared memory, the rows of the promoted array have the same
+ * extent, so such accesses are likely to hit the same memory bank unless the
+ * rows are padded.  Accesses along a row and accesses to the same element by
+ * all threads (broadcasts) are conflict-free.
+ */
+bool hasStridedThreadXAccess(
+    const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
+    const TensorReferenceGroup& group,
+    isl::union_map schedule,
+    isl::union_set activePoints) {
+  for (auto adjacent : accessedByAdjacentThreadX(
+           threadIdxXScheduleDepthState, group, schedule, activePoints)) {
+    auto tensorSpace = adjacent.get_space().domain();
+    auto nDim = tensorSpace.dim(isl::dim_type::set);
+    auto elementToRow = isl::map(isl::multi_aff::identity(
+                                     tensorSpace.map_from_set()))
+                            .project_out(isl::dim_type::out, nDim - 1, 1);
+    auto rowSpace = elementToRow.get_space().range();
+    auto sameRow = isl::map(isl::multi_aff::identity(rowSpace.map_from_set()));
+    auto adjacentRows =
+        adjacent.apply_domain(elementToRow).apply_range(elementToRow);
+    if (not adjacentRows.is_subset(sameRow)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /*
  * Check if the given "group" can be promoted to registers for the given active
  * domain points under full "schedule" where "nThreads" consecutive dimensions
  * are mapped to threads (the innermost of them being mapped to thread x) and
  * the depth of this mapping can be obtained from threadIdxXScheduleDepthState.
  *
- * In parciular, the group's footprint must contain only one element and the
- * same tensor element should never be accessed by two different threads.
+ * In parciular, the group's footprint must contain at most "maxElements"
+ * elements and the same tensor element should never be accessed by two
+ * different threads.
  */
 bool isPromotableToRegisterBelowThreads(
     const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
     const TensorReferenceGroup& group,
     isl::union_map schedule,
     size_t nThreads,
-    isl::union_set activePoints) {
+    isl::union_set activePoints,
+    size_t maxElements = 1) {
   auto originalAccesses = group.originalAccesses();
 
-  // Return early if more than one element needs to be stored in registers.
+  // Return early if more than maxElements elements need to be stored in
+  // registers.
   // TODO: support arrays in registers if they are only accessed with constant
   // subscripts, e.g. if the inner loops are fully unrolled.
   auto sizes = group.approximationSizes();
   auto nElements =
       std::accumulate(sizes.begin(), sizes.end(), 1, std::multiplies<size_t>());
-  if (nElements != 1) {
+  if (nElements > maxElements) {
     return false;
   }
 
@@ -419,48 +648,213 @@ std::vector<detail::ScheduleTree*> bandsSplitAfterDepth(
 }
 
 /*
- * For every place in the schedule tree where schedule depth (i.e., the number
- * of preceding band members) is "depth", promote tensor reference groups to
- * shared memory.  Split bands if necessary to insert promotions.
+ * A reference group that may be promoted to shared memory below the band
+ * node "bandNode", along with the amount of shared memory it requires and the
+ * estimated number of global memory transactions per block its promotion
+ * saves.
+ */
+struct PromotionCandidate {
+  detail::ScheduleTree* bandNode;
+  isl::id tensorId;
+  std::unique_ptr<TensorReferenceGroup> group;
+  size_t padWidth;
+  size_t memory;
+  double saving;
+};
+
+/*
+ * The reference groups selected for promotion to shared memory below the
+ * bands that end at schedule depth "depth".
+ */
+struct PromotionPlan {
+  size_t depth;
+  std::vector<detail::ScheduleTree*> bands;
+  std::vector<PromotionCandidate> candidates;
+  std::vector<bool> selected;
+  double saving;
+};
+
+// Number of threads whose accesses to consecutive elements are coalesced
+// into a single global memory transaction.
+constexpr size_t kCoalescedAccessesPerTransaction = 32;
+
+/*
+ * Estimate the number of global memory transactions per block saved by
+ * promoting "group" below a band node with partial schedule "schedule", of
+ * "depth" dimensions, leaving the first "blockDepth" ones outside the block.
+ * Without promotion, each reference costs one transaction per statement
+ * instance executed by the block, divided by the number of accesses coalesced
+ * into one transaction if the group is accessed in a coalesced way.  After
+ * promotion, the copies of the footprint to shared memory if "copiesIn" is
+ * set and from shared memory if the group is written are coalesced and
+ * executed once per iteration of the schedule dimensions between
+ * "blockDepth" and "depth".  The numbers of statement instances are
+ * overapproximated by boxes, like the footprints.
+ * Return zero if the saving cannot be estimated.
+ */
+double estimateSaving(
+    const TensorReferenceGroup& group,
+    isl::union_map schedule,
+    isl::union_set activePoints,
+    size_t depth,
+    size_t blockDepth,
+    bool coalesced,
+    bool copiesIn) {
+  auto sizes = group.approximationSizes();
+  auto footprintSize = std::accumulate(
+      sizes.begin(), sizes.end(), 1, std::multiplies<size_t>());
+  auto accessCost = coalesced ? 1.0 / kCoalescedAccessesPerTransaction : 1.0;
+
+  double unpromotedCost = 0.0;
+  size_t nTiles = 1;
+  for (const auto& ref : group.references) {
+    auto domain =
+        isl::union_set(ref->originalAccess.domain()).intersect(activePoints);
+    auto scheduleUMap = schedule.intersect_domain(domain);
+    if (scheduleUMap.is_empty()) {
+      continue;
+    }
+    auto scheduleMap = isl::map::from_union_map(scheduleUMap);
+    auto blockScheduleMap = scheduleMap.project_out(
+        isl::dim_type::out, blockDepth, depth - blockDepth);
+    auto instancesPerTile = approximateRangeSize(scheduleMap.reverse());
+    auto instancesPerBlock = approximateRangeSize(blockScheduleMap.reverse());
+    if (depth == blockDepth && instancesPerBlock == 0) {
+      // Assume every element of the footprint is accessed once.
+      instancesPerTile = instancesPerBlock = footprintSize;
+    }
+    if (instancesPerTile == 0 || instancesPerBlock == 0) {
+      return 0.0;
+    }
+    unpromotedCost += accessCost * instancesPerBlock;
+    nTiles = std::max(
+        nTiles, (instancesPerBlock + instancesPerTile - 1) / instancesPerTile);
+  }
+  auto nCopies = (copiesIn ? 1 : 0) + (group.isReadOnly() ? 0 : 1);
+  auto promotedCost = static_cast<double>(nCopies * footprintSize * nTiles) /
+      kCoalescedAccessesPerTransaction;
+  return unpromotedCost - promotedCost;
+}
+
+/*
+ * Select the candidates of "plan" to promote so as to maximize the total
+ * saving without using more than "maxMemory" bytes, i.e. solve the 0-1
+ * knapsack problem by dynamic programming over the memory.  The memory
+ * requirements are counted in units of at least 1/kMemoryUnits of
+ * "maxMemory", rounding them up so that the selection always fits.
+ */
+void selectCandidates(PromotionPlan& plan, size_t maxMemory) {
+  constexpr size_t kMemoryUnits = 8192;
+  auto unit =
+      std::max<size_t>(1, (maxMemory + kMemoryUnits - 1) / kMemoryUnits);
+  auto capacity = maxMemory / unit;
+  auto n = plan.candidates.size();
+
+  // best[i][c] is the largest saving using the first "i" candidates and at
+  // most "c" units of memory.
+  std::vector<std::vector<double>> best(
+      n + 1, std::vector<double>(capacity + 1, 0.0));
+  for (size_t i = 0; i < n; ++i) {
+    const auto& candidate = plan.candidates[i];
+    auto weight = (candidate.memory + unit - 1) / unit;
+    for (size_t c = 0; c <= capacity; ++c) {
+      best[i + 1][c] = best[i][c];
+      if (candidate.saving > 0 && weight <= c &&
+          best[i][c - weight] + candidate.saving > best[i + 1][c]) {
+        best[i + 1][c] = best[i][c - weight] + candidate.saving;
+      }
+    }
+  }
+
+  plan.selected.assign(n, false);
+  plan.saving = best[n][capacity];
+  for (size_t i = n, c = capacity; i > 0; --i) {
+    if (best[i][c] != best[i - 1][c]) {
+      plan.selected[i - 1] = true;
+      c -= (plan.candidates[i - 1].memory + unit - 1) / unit;
+    }
+  }
+}
+
+/*
+ * Plan the promotion of tensor reference groups to shared memory for every
+ * place in the schedule tree where schedule depth (i.e., the number of
+ * preceding band members) is "depth".  Split bands if necessary to insert
+ * promotions.  The first "blockDepth" schedule dimensions are those the
+ * blocks iterate over, the saving of the plan is expressed per block.
  *
- * Use at most "maxMemory" bytes.  If a groups does not fit the remaining
- * memory, do not promote it and keep looking for a smaller group.
+ * Use at most "maxMemory" bytes.  Collect the groups as candidates and select
+ * the subset that maximizes the total saving and fits in "maxMemory".
  *
- * Only promote if the tensor elements referenced by the group are reused or
- * accessed in a non-coalesced way.
+ * Only consider groups for which the tensor elements are reused or accessed
+ * in a non-coalesced way.  Written groups, e.g. output tiles, are only
+ * copied in if some of their elements are read before being written in the
+ * tile (see TensorReferenceGroup::exposedReads) and are written back once
+ * after the tile.
+ *
+ * If "doubleBuffer" is set, only consider groups of input tensors, and
+ * allocate two buffers for each of them.  The copies of the next tile
+ * can then proceed while other threads compute on the current one, because
+ * inputs are never written by the kernel.  The buffers count twice towards
+ * "maxMemory".  The written tensors are left to promotion to registers.
+ *
+ * The last extent of the groups whose elements adjacent threads access in
+ * different rows is padded against bank conflicts, to a multiple of
+ * "vectorWidth" for the inputs so that their copies can still be vectorized.
+ *
+ * If "transpose" is set, the groups accessed in a non-coalesced way because
+ * adjacent threads increment another tensor dimension than the last one are
+ * promoted to an array with that dimension innermost.  The copies still
+ * access the tensor in a coalesced way and the computation now accesses
+ * the promoted array along its rows.  The copies write the promoted array
+ * across its rows, so that its last extent is padded.
+ *
+ * Return a plan without candidates if some band at "depth" is located below
+ * a mapping to threads.
  */
-void promoteToSharedGreedy(
+PromotionPlan planSharedPromotion(
     Scop& scop,
     const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
-    const Block& block,
     size_t depth,
-    size_t maxMemory) {
+    size_t blockDepth,
+    size_t maxMemory,
+    bool doubleBuffer,
+    size_t vectorWidth,
+    bool transpose) {
   using namespace tc::polyhedral::detail;
 
   if (depth == 0) {
     throw promotion::PromotionNYI("promotion before any band");
   }
 
+  PromotionPlan plan;
+  plan.depth = depth;
+  plan.saving = 0.0;
   auto root = scop.scheduleRoot();
 
   // 1. Collect all bands with a member located at the given depth in the
   // overall schedule.  Make sure this is the last member of the band by
   // splitting off the subsequent members into a different band.
   auto bands = bandsContainingScheduleDepth(root, depth);
-  bands = bandsSplitAfterDepth(bands, root, depth);
+  if (depth > blockDepth) {
+    for (auto band : bands) {
+      if (isBelowThreadMapping(root, band)) {
+        return plan;
+      }
+    }
+  }
+  plan.bands = bandsSplitAfterDepth(bands, root, depth);
 
   // 2. Compute full schedule without mapping filters.  The filters would make
   // it impossible to test for coalescing by incrementing a member of a band as
   // only the values divisible by grid or block size pass through the filter.
   auto fullSched = fullSchedule(root);
 
-  // 3. For each band that ends at "depth", take decisions about promotion
-  // immediately below it in the tree.  In particular, promote if the
-  // approximated footprint fits into the remaining memory, and the reference
-  // group either features reuse or is accessed in a non-coalesced way, or
-  // both.
-  size_t remainingMemory = maxMemory;
-  for (auto bandNode : bands) {
+  // 3. For each band that ends at "depth", collect the candidates for
+  // promotion immediately below it in the tree.  In particular, consider the
+  // reference groups that either feature reuse or are accessed in a
+  // non-coalesced way, or both.
+  for (auto bandNode : plan.bands) {
     auto groupMap = TensorReferenceGroup::accessedBySubtree(bandNode, scop);
     auto partialSched = partialSchedule(root, bandNode);
     auto activePoints = activeDomainPoints(root, bandNode);
@@ -493,6 +887,17 @@ void promoteToSharedGreedy(
         });
     for (auto& tensorGroups : groupLists) {
       auto tensorId = tensorGroups.first;
+      if (doubleBuffer && !isInput(scop, tensorId)) {
+        continue;
+      }
+      // Other blocks update the same elements.
+      if (scop.isAtomicallyUpdated(tensorId)) {
+        continue;
+      }
+      // Vectorized copies require the last extent to remain a multiple of
+      // the vector width.
+      size_t rowPadWidth =
+          vectorWidth > 1 && isInput(scop, tensorId) ? vectorWidth : 1;
       // Sort the reference groups to prioritize groups with more references as
       // they are more likely to benefit from promotion.
       std::sort(
@@ -510,59 +915,334 @@ void promoteToSharedGreedy(
         if (sizes.size() == 0) {
           throw promotion::PromotionLogicError("cannot promote a scalar");
         }
-        if (sizes.back() % 2 == 0) {
-          sizes.back() += 1;
-        }
-        auto nApproximationElements = std::accumulate(
-            sizes.begin(), sizes.end(), 1, std::multiplies<size_t>());
-        auto memoryRequirement =
-            nApproximationElements * scop.findArgument(tensorId).type().bytes();
-        if (memoryRequirement > remainingMemory) {
-          continue;
-        }
         // Do not promote if the group features no reuse and is accessed in a
         // coalesced way.
-        if (!hasReuse(*group, fullSched, depth) &&
-            isCoalesced(
-                threadIdxXScheduleDepthState,
-                *group,
-                fullSched,
-                activePoints)) {
+        auto coalesced = isCoalesced(
+            threadIdxXScheduleDepthState, *group, fullSched, activePoints);
+        if (!hasReuse(*group, fullSched, depth) && coalesced) {
           continue;
         }
-
-        scop.promoteGroup(
-            Scop::PromotedDecl::Kind::SharedMem,
-            tensorId,
-            std::move(group),
-            bandNode,
+        // Pad the rows of the promoted array if adjacent threads access
+        // different rows, to reduce shared memory bank conflicts.
+        size_t padWidth =
+            hasStridedThreadXAccess(
+                threadIdxXScheduleDepthState, *group, fullSched, activePoints)
+            ? rowPadWidth
+            : 0;
+        auto transposedDim = transpose && !coalesced
+            ? threadXIncrementedDim(
+                  threadIdxXScheduleDepthState, *group, fullSched, activePoints)
+            : -1;
+        if (transposedDim >= 0) {
+          group->layout = innermostLayout(sizes.size(), transposedDim);
+          sizes = group->approximationSizes();
+          padWidth = 1;
+        }
+        sizes.back() = paddedExtent(sizes.back(), padWidth);
+        auto nApproximationElements = std::accumulate(
+            sizes.begin(), sizes.end(), 1, std::multiplies<size_t>());
+        auto memoryRequirement = nApproximationElements *
+            scop.findArgument(tensorId).type().bytes() *
+            (doubleBuffer ? 2 : 1);
+        auto copiesIn = group->isReadOnly() ||
+            !group->exposedReads(bandNode, scop).is_empty();
+        auto saving = estimateSaving(
+            *group,
             partialSched,
-            true);
-        remainingMemory -= memoryRequirement;
+            activePoints,
+            depth,
+            blockDepth,
+            coalesced,
+            copiesIn);
+
+        plan.candidates.emplace_back(PromotionCandidate{bandNode,
+                                                        tensorId,
+                                                        std::move(group),
+                                                        padWidth,
+                                                        memoryRequirement,
+                                                        saving});
       }
     }
-    scop.insertSyncsAroundCopies(bandNode);
+  }
+
+  selectCandidates(plan, maxMemory);
+  return plan;
+}
+
+std::ostream& operator<<(std::ostream& os, const PromotionPlan& plan) {
+  os << "shared memory promotion at depth " << plan.depth << " saving "
+     << plan.saving << " transactions per block:";
+  for (size_t i = 0; i < plan.candidates.size(); ++i) {
+    const auto& candidate = plan.candidates[i];
+    os << std::endl
+       << "  " << (plan.selected[i] ? "promote " : "skip ")
+       << candidate.tensorId.get_name() << " with "
+       << candidate.group->referenceIds().size() << " reference(s): "
+       << candidate.memory << " bytes, saving " << candidate.saving;
+  }
+  return os;
+}
+
+/*
+ * Promote the selected candidates of "plan" and insert the synchronizations
+ * around the copies under each band of "plan".
+ */
+void applyPromotionPlan(Scop& scop, PromotionPlan& plan, bool doubleBuffer) {
+  auto root = scop.scheduleRoot();
+  for (auto bandNode : plan.bands) {
+    auto partialSched = partialSchedule(root, bandNode);
+    auto nPromotionsBefore = scop.activePromotions().size();
+    for (size_t i = 0; i < plan.candidates.size(); ++i) {
+      auto& candidate = plan.candidates[i];
+      if (candidate.bandNode != bandNode || !plan.selected[i]) {
+        continue;
+      }
+      scop.promoteGroup(
+          Scop::PromotedDecl::Kind::SharedMem,
+          candidate.tensorId,
+          std::move(candidate.group),
+          bandNode,
+          partialSched,
+          candidate.padWidth);
+    }
+    if (doubleBuffer) {
+      std::vector<isl::id> groupIds;
+      const auto& promotions = scop.activePromotions();
+      for (auto i = nPromotionsBefore; i < promotions.size(); ++i) {
+        groupIds.push_back(promotions[i].second.groupId);
+      }
+      scop.insertDoubleBufferedSyncs(bandNode, groupIds);
+    } else {
+      scop.insertSyncsAroundCopies(bandNode);
+    }
   }
 }
 } // namespace
 
-void promoteGreedilyAtDepth(
+size_t promoteToShared(
+    MappedScop& mscop,
+    const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
+    size_t minDepth,
+    size_t maxDepth,
+    size_t sharedMemorySize,
+    bool unrollCopies,
+    bool doubleBuffer,
+    size_t vectorWidth,
+    bool transpose) {
+  // 1. Evaluate the plans at the deeper depths on copies of the scop, since
+  // planning splits bands, and keep the one with the largest saving.
+  auto& scop = mscop.scop();
+  auto depth = minDepth;
+  if (maxDepth > minDepth) {
+    auto bestSaving = 0.0;
+    for (auto d = minDepth; d <= maxDepth; ++d) {
+      auto copy = Scop::makeScop(scop);
+      auto plan = planSharedPromotion(
+          *copy,
+          threadIdxXScheduleDepthState,
+          d,
+          minDepth,
+          sharedMemorySize,
+          doubleBuffer,
+          vectorWidth,
+          transpose);
+      LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Candidate " << plan;
+      if (d == minDepth || plan.saving > bestSaving) {
+        depth = d;
+        bestSaving = plan.saving;
+      }
+    }
+  }
+
+  // 2. Promote according to the plan at the selected depth.
+  auto plan = planSharedPromotion(
+      scop,
+      threadIdxXScheduleDepthState,
+      depth,
+      minDepth,
+      sharedMemorySize,
+      doubleBuffer,
+      vectorWidth,
+      transpose);
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Selected " << plan;
+  applyPromotionPlan(scop, plan, doubleBuffer);
+
+  // 3. Map copies to shared, state by copy
+  mapCopiesToThreads(mscop, unrollCopies, vectorWidth);
+  return depth;
+}
+
+void promoteToSharedAtDepth(
     MappedScop& mscop,
     const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
     size_t depth,
     size_t sharedMemorySize,
-    bool unrollCopies) {
-  // 1. Promote using heuristic.
-  promoteToSharedGreedy(
-      mscop.scop(),
+    bool unrollCopies,
+    bool doubleBuffer,
+    size_t vectorWidth,
+    bool transpose) {
+  promoteToShared(
+      mscop,
       threadIdxXScheduleDepthState,
-      mscop.numThreads,
       depth,
-      sharedMemorySize);
+      depth,
+      sharedMemorySize,
+      unrollCopies,
+      doubleBuffer,
+      vectorWidth,
+      transpose);
+}
 
-  // 2. Map copies to shared, state by copy
-  mapCopiesToThreads(mscop, unrollCopies);
+namespace {
+// Upper bound on the number of registers holding the accumulators of a
+// reduction in each thread.
+constexpr size_t kMaxAccumulatorRegisters = 64;
+
+// Count the thread identifiers involved in the active domain "points",
+// skipping those obviously mapped to 0.
+size_t countMappedThreads(isl::union_set points) {
+  size_t nMappedThreads = 0;
+  for (int j = 0; j < points.dim(isl::dim_type::param); ++j) {
+    auto id = points.get_space().get_dim_id(isl::dim_type::param, j);
+    for (size_t i = 0; i < mapping::ThreadId::kMaxDim; ++i) {
+      if (id != mapping::ThreadId::makeId(i)) {
+        continue;
+      }
+      if (isl::getParamValIfFixed(points, j) ==
+          isl::val::zero(points.get_ctx())) {
+        continue;
+      }
+      ++nMappedThreads;
+      break;
+    }
+  }
+  return nMappedThreads;
+}
+
+/*
+ * Promote the accumulator of each reduction to registers above its reduction
+ * loops, so that it is read once before them and written once after them.
+ * The accumulators of a thread may span several elements, e.g. with thread
+ * tiling the reduction loop iterates over the tile of each thread, in which
+ * case they are promoted to a private array of at most "nRegisters"
+ * elements, indexed by the unrolled loops of the tile.
+ * The promotion is placed at the outermost depth from thread x on where the
+ * accesses to the reduced tensor have reuse, i.e. where the inner loops
+ * iterate over a reduction.  The initialization is included in the promoted
+ * group when it is scheduled below that depth.
+ * Accumulators already promoted, e.g. at thread x depth by the general
+ * case, are left unchanged.
+ */
+void promoteReductionAccumulatorsToRegisters(
+    Scop& scop,
+    const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
+    isl::union_map fullSched,
+    size_t nRegisters) {
+  using namespace tc::polyhedral::detail;
+
+  auto root = scop.scheduleRoot();
+  auto nMaxElements = std::min(nRegisters, kMaxAccumulatorRegisters);
+  for (const auto& reduction : scop.halide.reductions) {
+    auto provide = reduction.update.as<Halide::Internal::Provide>();
+    if (!provide) {
+      continue;
+    }
+    isl::id updateId;
+    for (const auto& kvp : scop.halide.statements) {
+      if (kvp.second.same_as(reduction.update)) {
+        updateId = kvp.first;
+      }
+    }
+    if (updateId.is_null()) {
+      continue;
+    }
+    auto updateDomain = isl::union_set::empty(scop.domain().get_space());
+    for (auto set : isl::UnionAsVector<isl::union_set>(scop.domain())) {
+      if (set.get_tuple_id() == updateId) {
+        updateDomain = updateDomain.unite(isl::union_set(set));
+      }
+    }
+    auto scheduledUpdate = fullSched.intersect_domain(updateDomain);
+    if (updateDomain.is_empty() || scheduledUpdate.n_map() != 1) {
+      continue;
+    }
+    size_t nDims =
+        isl::map::from_union_map(scheduledUpdate).dim(isl::dim_type::out);
+
+    size_t threadDepth;
+    try {
+      threadDepth = 1 +
+          computeThreadIdxXScheduleDepth(
+                        threadIdxXScheduleDepthState, updateDomain);
+    } catch (const promotion::PromotionLogicError&) {
+      continue;
+    }
+
+    auto isPromoted = [&scop, &updateDomain, provide]() -> bool {
+      for (const auto& kvp : scop.activePromotions()) {
+        const auto& decl = scop.promotedDecls().at(kvp.second.groupId);
+        if (decl.tensorId.get_name() == provide->name &&
+            !kvp.first.intersect(updateDomain).is_empty()) {
+          return true;
+        }
+      }
+      return false;
+    };
+    if (isPromoted()) {
+      continue;
+    }
+
+    for (auto depth = threadDepth; depth < nDims && !isPromoted(); ++depth) {
+      auto bands = bandsContainingScheduleDepth(root, depth);
+      std::function<bool(ScheduleTree*)> keepUpdate =
+          [root, updateDomain](const ScheduleTree* tree) {
+            isl::union_set active = activeDomainPoints(root, tree);
+            return !active.intersect(updateDomain).is_empty();
+          };
+      bands = functional::Filter(keepUpdate, bands);
+      bands = bandsSplitAfterDepth(bands, root, depth);
+
+      for (auto band : bands) {
+        auto points = activeDomainPoints(root, band);
+        auto nMappedThreads = countMappedThreads(points);
+        auto groupMap = TensorReferenceGroup::accessedBySubtree(band, scop);
+        for (auto& tensorGroups : groupMap) {
+          auto tensorId = tensorGroups.first;
+          if (tensorId.get_name() != provide->name ||
+              scop.isAtomicallyUpdated(tensorId)) {
+            continue;
+          }
+          for (auto& group : tensorGroups.second) {
+            auto updates =
+                group->originalWrites().intersect_domain(updateDomain);
+            if (updates.is_empty() || group->approximationSizes().empty()) {
+              continue;
+            }
+            if (!hasReuse(*group, fullSched, depth)) {
+              continue;
+            }
+            if (!isPromotableToRegisterBelowThreads(
+                    threadIdxXScheduleDepthState,
+                    *group,
+                    fullSched,
+                    nMappedThreads,
+                    points,
+                    nMaxElements)) {
+              continue;
+            }
+            scop.promoteGroup(
+                Scop::PromotedDecl::Kind::Register,
+                tensorId,
+                std::move(group),
+                band,
+                partialSchedule(root, band));
+          }
+        }
+      }
+    }
+  }
 }
+} // namespace
 
 // Assuming the mapping to threads happens in inverse order, i.e. the innermost
 // loop is mapped to thread x, promote below that depth.
@@ -607,25 +1287,14 @@ void promoteToRegistersBelowThreads(
       auto points = activeDomainPoints(root, band);
       auto partialSched = partialSchedule(root, band);
 
-      size_t nMappedThreads = 0;
-      for (int j = 0; j < points.dim(isl::dim_type::param); ++j) {
-        auto id = points.get_space().get_dim_id(isl::dim_type::param, j);
-        for (size_t i = 0; i < mapping::ThreadId::kMaxDim; ++i) {
-          if (id != mapping::ThreadId::makeId(i)) {
-            continue;
-          }
-          if (isl::getParamValIfFixed(points, j) ==
-              isl::val::zero(points.get_ctx())) {
-            continue;
-          }
-          ++nMappedThreads;
-          break;
-        }
-      }
+      auto nMappedThreads = countMappedThreads(points);
 
       auto groupMap = TensorReferenceGroup::accessedBySubtree(band, scop);
       for (auto& tensorGroups : groupMap) {
         auto tensorId = tensorGroups.first;
+        if (scop.isAtomicallyUpdated(tensorId)) {
+          continue;
+        }
 
         // TODO: sorting of groups and counting the number of promoted elements
 
@@ -659,6 +1328,9 @@ void promoteToRegistersBelowThreads(
       }
     }
   }
+
+  promoteReductionAccumulatorsToRegisters(
+      scop, threadIdxXScheduleDepthState, fullSched, nRegisters);
 }
 
 } // namespace polyhedral
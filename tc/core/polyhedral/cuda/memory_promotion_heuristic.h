@@ -28,19 +28,46 @@ using ThreadIdxXScheduleDepthState =
 class MappedScop;
 class Scop;
 
-// In the given mapped scop "mscop",
-// promote to shared memory at "depth" until "sharedMemorySize" is used.
+// In the given mapped scop "mscop", promote to shared memory at one of the
+// schedule depths between "minDepth", below the loops mapped to blocks, and
+// "maxDepth", using at most "sharedMemorySize" bytes.  At each depth, plan
+// the promotion by estimating, for every candidate reference group, the
+// number of global memory transactions its promotion saves per block and by
+// selecting the candidates that maximize the total saving within
+// "sharedMemorySize" bytes.  Promote according to the plan with the largest
+// saving, preferring shallower depths, and return its depth.
 // Map copies between global and shared memory to threads and unroll those
-// copies if "unrollCopies" is set, using the options in "mscop".
+// copies if "unrollCopies" is set, using the options in "mscop".  Allocate
+// two alternating buffers for promoted read-only inputs if "doubleBuffer" is
+// set.  Copy "vectorWidth" consecutive elements of the promoted inputs per
+// thread and copy statement where this is safe.  If "transpose" is set,
+// promote the groups that adjacent threads access along another dimension
+// than the last one to arrays with that dimension innermost.
 // "threadIdxXScheduleDepthState" contains the schedule depth at which the
 // computation was mapped to thread x and is used to check whether the global
 // memory is accessed in a coalesced way.
-void promoteGreedilyAtDepth(
+// The plans are reported in the debug output of the mapper.
+std::size_t promoteToShared(
+    MappedScop& scop,
+    const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
+    std::size_t minDepth,
+    std::size_t maxDepth,
+    std::size_t sharedMemorySize,
+    bool unrollCopies,
+    bool doubleBuffer = false,
+    std::size_t vectorWidth = 1,
+    bool transpose = false);
+
+// Same as promoteToShared with the depth fixed to "depth".
+void promoteToSharedAtDepth(
     MappedScop& scop,
     const ThreadIdxXScheduleDepthState& threadIdxXScheduleDepthState,
     std::size_t depth,
     std::size_t sharedMemorySize,
-    bool unrollCopies);
+    bool unrollCopies,
+    bool doubleBuffer = false,
+    std::size_t vectorWidth = 1,
+    bool transpose = false);
 
 void promoteToRegistersBelowThreads(
     Scop& scop,
@@ -0,0 +1,417 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/polyhedral/cuda/sync_minimization.h"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tc/core/constants.h"
+#include "tc/core/polyhedral/cuda/mapping_types.h"
+#include "tc/core/polyhedral/schedule_transforms.h"
+#include "tc/external/isl.h"
+
+namespace tc {
+namespace polyhedral {
+
+using detail::ScheduleTree;
+
+namespace {
+
+constexpr size_t kWarpSize = 32;
+
+// The accesses to tensor elements of some statement instances together
+// with the thread that executes each instance.
+struct Accesses {
+  isl::union_map reads;
+  isl::union_map writes;
+  // Maps each instance to the outer schedule dimensions followed by the
+  // three thread identifiers.
+  isl::union_map threadSchedule;
+};
+
+Accesses unite(const Accesses& a, const Accesses& b) {
+  return Accesses{a.reads.unite(b.reads),
+                  a.writes.unite(b.writes),
+                  a.threadSchedule.unite(b.threadSchedule)};
+}
+
+// "prefix0, ..., prefix(n-1)"
+std::string dimNames(const std::string& prefix, size_t n) {
+  std::stringstream ss;
+  for (size_t i = 0; i < n; ++i) {
+    ss << (i > 0 ? ", " : "") << prefix << i;
+  }
+  return ss.str();
+}
+
+// "[dims0, dims1, ...]" skipping empty dimension lists
+std::string tuple(const std::vector<std::string>& dims) {
+  std::stringstream ss;
+  ss << "[";
+  bool first = true;
+  for (const auto& d : dims) {
+    if (!d.empty()) {
+      ss << (first ? "" : ", ") << d;
+      first = false;
+    }
+  }
+  ss << "]";
+  return ss.str();
+}
+
+isl::union_map parseMap(isl::ctx ctx, const std::string& str) {
+  return isl::union_map(isl::map(ctx, str));
+}
+
+// Attach to the instances scheduled by "schedule" the thread of "block"
+// that executes them, given by the values of the thread identifier
+// parameters set by the mapping filters.
+isl::map addThreads(isl::map schedule, const std::array<uint64_t, 3>& block) {
+  std::stringstream ss;
+  ss << "{ " << tuple({dimNames("t", 3)}) << " : ";
+  for (size_t i = 0; i < 3; ++i) {
+    ss << (i > 0 ? " and " : "") << "0 <= t" << i << " < " << block[i];
+  }
+  ss << " }";
+  auto threads = isl::set(schedule.get_ctx(), ss.str());
+  auto nIn = schedule.dim(isl::dim_type::in);
+  auto nOut = schedule.dim(isl::dim_type::out);
+  auto wrapped =
+      schedule.flat_range_product(isl::map(schedule.domain(), threads))
+          .reset_tuple_id(isl::dim_type::out)
+          .wrap();
+  for (size_t i = 0; i < 3; ++i) {
+    auto id = mapping::ThreadId::makeId(i);
+    auto pos = wrapped.find_dim_by_id(isl::dim_type::param, id);
+    if (pos < 0) {
+      continue;
+    }
+    auto ls = isl::local_space(wrapped.get_space());
+    auto param = isl::aff(ls, isl::dim_type::param, pos);
+    auto dim = isl::aff(ls, isl::dim_type::set, nIn + nOut + i);
+    wrapped = wrapped & (isl::aff_set(param) == dim);
+    wrapped = wrapped.project_out(isl::dim_type::param, pos, 1);
+  }
+  return wrapped.unwrap();
+}
+
+// Collect the accesses of the statement instances below "tree" and their
+// threads, with the "depth" outer schedule dimensions.
+// Return false if some statement has effects that are not described by
+// accesses to tensor elements, e.g., a reduction across threads.
+bool collectAccesses(
+    const Scop& scop,
+    const ScheduleTree* tree,
+    size_t depth,
+    const tc::Block& block,
+    Accesses& accesses) {
+  auto root = scop.scheduleRoot();
+  auto sizes = block.view.extractDefaultedArray();
+  auto reads = scop.reads.domain_factor_domain();
+  auto writes = scop.writes.domain_factor_domain();
+  for (auto leaf : ScheduleTree::collect(tree)) {
+    if (leaf->numChildren() != 0) {
+      continue;
+    }
+    auto schedule = partialSchedule(root, leaf);
+    for (auto map : isl::UnionAsVector<isl::union_map>(schedule)) {
+      auto id = map.get_tuple_id(isl::dim_type::in);
+      if (Scop::isSyncId(id) || Scop::isWarpSyncId(id)) {
+        continue;
+      }
+      if (scop.isTreeSyncId(id) || scop.isDefaultReductionInitId(id) ||
+          scop.isBufferSwapId(id)) {
+        return false;
+      }
+      auto nOut = map.dim(isl::dim_type::out);
+      if (nOut < depth) {
+        return false;
+      }
+      map = map.project_out(isl::dim_type::out, depth, nOut - depth)
+                .reset_tuple_id(isl::dim_type::out);
+      // The thread identifiers are attached to the instances and no longer
+      // appear as parameters, which would otherwise force conflicting
+      // instances onto the same thread.
+      map = addThreads(map, sizes);
+      auto instances = isl::union_set(map.domain());
+      if (id.get_name() == kReadIdName || id.get_name() == kWriteIdName) {
+        // Copies between a tensor and its promoted version count as
+        // accesses to the tensor elements, reads and writes for shared
+        // memory since all threads may access the promoted copy.
+        auto identity = map.domain().identity();
+        auto elements = isl::union_map(
+            identity.range_factor_domain().range_factor_range());
+        auto groupId =
+            identity.range_factor_range().get_tuple_id(isl::dim_type::out);
+        auto isRead = id.get_name() == kReadIdName;
+        auto isShared = scop.promotedDecls().at(groupId).kind ==
+            Scop::PromotedDecl::Kind::SharedMem;
+        if (isRead || isShared) {
+          accesses.reads = accesses.reads.unite(elements);
+        }
+        if (!isRead || isShared) {
+          accesses.writes = accesses.writes.unite(elements);
+        }
+      } else {
+        accesses.reads =
+            accesses.reads.unite(reads.intersect_domain(instances));
+        accesses.writes =
+            accesses.writes.unite(writes.intersect_domain(instances));
+      }
+      accesses.threadSchedule =
+          accesses.threadSchedule.unite(isl::union_map(map));
+    }
+  }
+  return true;
+}
+
+Accesses emptyAccesses(const Scop& scop) {
+  auto empty = isl::union_map::empty(scop.domain().get_space());
+  return Accesses{empty, empty, empty};
+}
+
+// The synchronization needed between the instances in "before" and those
+// in "after" for the pairs of instances related by "order", which relates
+// the outer schedule dimensions followed by the thread identifiers.
+SyncLevel syncLevel(
+    const Scop& scop,
+    const Accesses& before,
+    const Accesses& after,
+    isl::union_map order,
+    size_t depth,
+    const tc::Block& block) {
+  auto ctx = scop.domain().get_ctx();
+  auto conflicts = before.writes.apply_range(after.reads.reverse())
+                       .unite(before.writes.apply_range(after.writes.reverse()))
+                       .unite(before.reads.apply_range(after.writes.reverse()));
+  auto threadPairs = conflicts.apply_domain(before.threadSchedule)
+                         .apply_range(after.threadSchedule)
+                         .intersect(order)
+                         .intersect_params(scop.globalParameterContext);
+
+  auto p = dimNames("p", depth);
+  auto q = dimNames("q", depth);
+  auto t = dimNames("t", 3);
+  auto sameThread =
+      parseMap(ctx, "{ " + tuple({p, t}) + " -> " + tuple({q, t}) + " }");
+  if (threadPairs.is_subset(sameThread)) {
+    return SyncLevel::None;
+  }
+
+  auto sizes = block.view.extractDefaultedArray();
+  if ((sizes[0] * sizes[1] * sizes[2]) % kWarpSize != 0) {
+    return SyncLevel::Block;
+  }
+  // Warps are formed by consecutive linearized thread identifiers.
+  std::stringstream ss;
+  ss << "{ " << tuple({p, t}) << " -> " << tuple({p, "w"}) << " : "
+     << kWarpSize << "w <= t0 + " << sizes[0] << "t1 + "
+     << sizes[0] * sizes[1] << "t2 <= " << kWarpSize << "w + "
+     << kWarpSize - 1 << " }";
+  auto warp = parseMap(ctx, ss.str());
+  auto sameWarp = parseMap(
+      ctx, "{ " + tuple({p, "w"}) + " -> " + tuple({q, "w"}) + " }");
+  auto warpPairs = threadPairs.apply_domain(warp).apply_range(warp);
+  if (warpPairs.is_subset(sameWarp)) {
+    return SyncLevel::Warp;
+  }
+  return SyncLevel::Block;
+}
+
+// Is "tree" the filter of a synchronization of the given kind?
+bool isSync(const ScheduleTree* tree, bool warp) {
+  auto filterElem = tree->elemAs<detail::ScheduleTreeElemFilter>();
+  if (!filterElem || tree->numChildren() != 0) {
+    return false;
+  }
+  auto filters = isl::UnionAsVector<isl::union_set>(filterElem->filter_);
+  if (filters.size() != 1 || !filters[0].has_tuple_name()) {
+    return false;
+  }
+  auto id = filters[0].get_tuple_id();
+  return warp ? Scop::isWarpSyncId(id) : Scop::isSyncId(id);
+}
+
+void minimizeSyncsInSequence(
+    Scop& scop,
+    ScheduleTree* seq,
+    const tc::Block& block) {
+  auto root = scop.scheduleRoot();
+  auto n = seq->numChildren();
+  auto depth = seq->scheduleDepth(root);
+
+  std::vector<SyncLevel> levels(n, SyncLevel::None);
+  std::vector<bool> isSyncChild(n, false);
+  std::vector<bool> analyzable(n, true);
+  std::vector<Accesses> accesses(n, emptyAccesses(scop));
+  for (size_t i = 0; i < n; ++i) {
+    auto child = seq->child({i});
+    if (isSync(child, false)) {
+      isSyncChild[i] = true;
+      levels[i] = SyncLevel::Block;
+    } else if (isSync(child, true)) {
+      isSyncChild[i] = true;
+      levels[i] = SyncLevel::Warp;
+    } else {
+      analyzable[i] = collectAccesses(scop, child, depth, block, accesses[i]);
+    }
+  }
+  if (std::find(isSyncChild.begin(), isSyncChild.end(), true) ==
+      isSyncChild.end()) {
+    return;
+  }
+  auto original = levels;
+
+  // Without a synchronization at either end of the sequence, the accesses
+  // of the next iterations of outer sequential loops, if any, are ordered
+  // by the synchronizations inside the sequence, at least one of which is
+  // kept.  Coincident loops do not carry any dependence and copies to
+  // shared memory are always surrounded by synchronizations.
+  auto hasBoundarySync = isSyncChild[0] || isSyncChild[n - 1];
+  auto insideSequentialLoop = false;
+  for (auto a : seq->ancestors(root)) {
+    auto band = a->elemAs<detail::ScheduleTreeElemBand>();
+    if (band && band->nOuterCoincident() < band->nMember()) {
+      insideSequentialLoop = true;
+    }
+  }
+  auto p = dimNames("p", depth);
+  auto sameIteration = parseMap(
+      scop.domain().get_ctx(),
+      "{ " + tuple({p, dimNames("t", 3)}) + " -> " +
+          tuple({p, dimNames("u", 3)}) + " }");
+
+  // Since the instances after a synchronization are checked up to the next
+  // one, only the block synchronizations that are kept delimit the
+  // instances before a synchronization.
+  size_t begin = 0;
+  int lastAnalyzed = -1;
+  for (size_t i = 1; i + 1 < n; ++i) {
+    if (original[i] != SyncLevel::Block) {
+      continue;
+    }
+    auto end = i + 1;
+    while (end < n && !isSyncChild[end]) {
+      ++end;
+    }
+    auto before = emptyAccesses(scop);
+    auto after = emptyAccesses(scop);
+    auto ok = true;
+    for (size_t j = begin; j < end; ++j) {
+      if (isSyncChild[j]) {
+        continue;
+      }
+      ok = ok && analyzable[j];
+      if (j < i) {
+        before = unite(before, accesses[j]);
+      } else {
+        after = unite(after, accesses[j]);
+      }
+    }
+    levels[i] = ok
+        ? syncLevel(scop, before, after, sameIteration, depth, block)
+        : SyncLevel::Block;
+    lastAnalyzed = i;
+    if (levels[i] == SyncLevel::Block) {
+      begin = i + 1;
+    }
+  }
+  if (lastAnalyzed >= 0 && !hasBoundarySync && insideSequentialLoop &&
+      std::find(levels.begin(), levels.end(), SyncLevel::Block) ==
+          levels.end()) {
+    levels[lastAnalyzed] = SyncLevel::Block;
+  }
+
+  // A synchronization directly following another one is redundant, the
+  // weaker of the two is removed.
+  int previous = -1;
+  for (size_t i = 0; i < n; ++i) {
+    if (!isSyncChild[i] || levels[i] == SyncLevel::None) {
+      previous = isSyncChild[i] ? previous : -1;
+      continue;
+    }
+    if (previous >= 0) {
+      if (levels[previous] == SyncLevel::Block) {
+        levels[i] = SyncLevel::None;
+        continue;
+      }
+      levels[previous] = SyncLevel::None;
+    }
+    previous = i;
+  }
+
+  for (size_t i = n; i-- > 0;) {
+    if (!isSyncChild[i] || levels[i] == original[i]) {
+      continue;
+    }
+    scop.removeSync(seq, i);
+    if (levels[i] == SyncLevel::Warp) {
+      scop.insertWarpSync(seq, i);
+    }
+  }
+}
+} // namespace
+
+SyncLevel loopCarriedSyncLevel(
+    const Scop& scop,
+    const ScheduleTree* band,
+    const tc::Block& block) {
+  auto root = scop.scheduleRoot();
+  auto bandElem = band->elemAs<detail::ScheduleTreeElemBand>();
+  CHECK(bandElem) << "expected a band";
+  auto nOuter = band->scheduleDepth(root);
+  auto nMember = bandElem->nMember();
+  auto accesses = emptyAccesses(scop);
+  if (!collectAccesses(scop, band, nOuter + nMember, block, accesses)) {
+    return SyncLevel::Block;
+  }
+
+  // Pairs of an iteration of the band and a later one within the same
+  // iteration of the outer loops.
+  std::stringstream ss;
+  auto p = dimNames("p", nOuter);
+  ss << "{ " << tuple({p, dimNames("a", nMember), dimNames("t", 3)}) << " -> "
+     << tuple({p, dimNames("b", nMember), dimNames("u", 3)}) << " : ";
+  for (size_t i = 0; i < nMember; ++i) {
+    ss << (i > 0 ? " or (" : "(");
+    for (size_t j = 0; j < i; ++j) {
+      ss << "a" << j << " = b" << j << " and ";
+    }
+    ss << "a" << i << " < b" << i << ")";
+  }
+  ss << " }";
+  return syncLevel(
+      scop,
+      accesses,
+      accesses,
+      parseMap(scop.domain().get_ctx(), ss.str()),
+      nOuter + nMember,
+      block);
+}
+
+void minimizeSyncs(Scop& scop, const tc::Block& block) {
+  auto sequences = ScheduleTree::collect(
+      scop.scheduleRoot(), detail::ScheduleTreeType::Sequence);
+  for (auto seq : sequences) {
+    minimizeSyncsInSequence(scop, seq, block);
+  }
+}
+
+} // namespace polyhedral
+} // namespace tc
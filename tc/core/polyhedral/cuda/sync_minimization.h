@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/polyhedral/schedule_tree.h"
+#include "tc/core/polyhedral/scop.h"
+
+namespace tc {
+namespace polyhedral {
+
+// The synchronization needed to order accesses of the threads of a block.
+enum class SyncLevel { None, Warp, Block };
+
+// Which synchronization is needed at the end of each iteration of "band",
+// whose descendants are completely mapped to the threads of "block", to
+// order the accesses to tensor elements in an iteration w.r.t. conflicting
+// accesses in the next iterations.
+SyncLevel loopCarriedSyncLevel(
+    const Scop& scop,
+    const detail::ScheduleTree* band,
+    const tc::Block& block);
+
+// Remove the synchronizations between children of the sequence nodes in
+// the schedule of "scop" that only order conflicting accesses of the same
+// thread, replace by warp synchronizations those that only order
+// conflicting accesses of the same warp and remove the synchronizations
+// that directly follow another one.
+// Synchronizations that are the first or the last child of a sequence
+// protect the accesses from those outside the sequence and are kept.
+void minimizeSyncs(Scop& scop, const tc::Block& block);
+
+} // namespace polyhedral
+} // namespace tc
@@ -87,12 +87,12 @@ std::pair<tc::Grid, tc::Block> tightenLaunchBounds(
   auto root = scop.scheduleRoot();
   auto params = scop.globalParameterContext;
 
-  auto max = [root, params](const mapping::MappingId& id) -> size_t {
+  auto max = [&scop, root, params](const mapping::MappingId& id) -> size_t {
     size_t sizetMax = std::numeric_limits<size_t>::max();
     size_t max = 0;
     size_t min = sizetMax;
     auto nonSyncLeaves = functional::Filter(
-        [root, params](const detail::ScheduleTree* node) {
+        [&scop, root](const detail::ScheduleTree* node) {
           auto f = node->elemAsBase<detail::ScheduleTreeElemFilter>();
           if (!f) {
             return true;
@@ -104,7 +104,9 @@ std::pair<tc::Grid, tc::Block> tightenLaunchBounds(
             throw tightening::TighteningException(ss.str());
           }
           auto single = isl::set::from_union_set(f->filter_);
-          return !Scop::isSyncId(single.get_tuple_id());
+          return !Scop::isSyncId(single.get_tuple_id()) &&
+              !Scop::isWarpSyncId(single.get_tuple_id()) &&
+              !scop.isBufferSwapId(single.get_tuple_id());
         },
         leaves(root));
     for (auto p : nonSyncLeaves) {
@@ -0,0 +1,216 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/polyhedral/data_parallel.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+#include "tc/external/isl.h"
+
+namespace tc {
+namespace polyhedral {
+
+namespace {
+
+using namespace Halide::Internal;
+
+// How the accesses of a statement to an input use the first index of the
+// statement.
+enum class Access { None, Split, Whole, Invalid };
+
+Access combine(Access a, Access b) {
+  if (a == Access::None) {
+    return b;
+  }
+  if (b == Access::None or a == b) {
+    return a;
+  }
+  return Access::Invalid;
+}
+
+// Whether "e" uses the variable "name", not counting the arguments of the
+// calls it contains, e.g. the indices of indirect accesses.
+bool usesVariableOutsideCalls(const Halide::Expr& e, const std::string& name) {
+  class Finder : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Variable* op) {
+      found = found or op->name == name;
+    }
+    void visit(const Call* op) {}
+
+   public:
+    explicit Finder(const std::string& name) : name(name) {}
+    const std::string& name;
+    bool found = false;
+  } finder(name);
+  e.accept(&finder);
+  return finder.found;
+}
+
+// Collect how the calls of a statement use its first index "index": the
+// accesses to each input, and whether any call or expression uses "index"
+// or one of "sizes" elsewhere than as first call argument.
+class CollectAccesses : public IRVisitor {
+  using IRVisitor::visit;
+
+  void visit(const Variable* op) {
+    if (op->name == index or sizes.count(op->name) > 0) {
+      invalid = true;
+    }
+  }
+
+  void visit(const Call* op) {
+    if (op->call_type != Call::Image and op->call_type != Call::Halide) {
+      IRVisitor::visit(op);
+      return;
+    }
+    auto access = Access::Whole;
+    for (size_t i = 0; i < op->args.size(); ++i) {
+      auto var = op->args[i].as<Variable>();
+      if (i == 0 and var and var->name == index) {
+        access = Access::Split;
+        continue;
+      }
+      if (usesVariableOutsideCalls(op->args[i], index)) {
+        invalid = true;
+      }
+      op->args[i].accept(this);
+    }
+    if (op->call_type == Call::Image) {
+      auto& a = accesses[op->name];
+      a = combine(a, access);
+    }
+  }
+
+ public:
+  CollectAccesses(
+      const std::string& index,
+      const std::unordered_set<std::string>& sizes)
+      : index(index), sizes(sizes) {}
+
+  const std::string& index;
+  const std::unordered_set<std::string>& sizes;
+  std::unordered_map<std::string, Access> accesses;
+  bool invalid = false;
+};
+
+// The name of the variable of the size of dimension "dim" of "input", empty
+// if it is not a variable.
+std::string sizeName(const Halide::ImageParam& input, int dim) {
+  auto var = input.parameter().extent_constraint(dim).as<Variable>();
+  return var ? var->name : std::string();
+}
+} // namespace
+
+llvm::Optional<DataParallelSplit> findDataParallelSplit(const Scop& scop) {
+  CHECK(scop.dependences) << "the dependences of the scop are not computed";
+  const auto& inputs = scop.halide.inputs;
+  auto domain = scop.domain();
+
+  // First pass, the accesses to the inputs
+  std::unordered_map<std::string, Access> accesses;
+  for (const auto& kvp : scop.halide.statements) {
+    auto provide = kvp.second.as<Provide>();
+    if (!provide or provide->args.empty() or !provide->args[0].as<Variable>()) {
+      return llvm::None;
+    }
+    CollectAccesses collect(
+        provide->args[0].as<Variable>()->name,
+        std::unordered_set<std::string>());
+    for (const auto& v : provide->values) {
+      v.accept(&collect);
+    }
+    if (collect.invalid) {
+      return llvm::None;
+    }
+    for (const auto& a : collect.accesses) {
+      auto& access = accesses[a.first];
+      access = combine(access, a.second);
+    }
+  }
+
+  DataParallelSplit split;
+  std::unordered_set<std::string> splitSizes;
+  for (const auto& input : inputs) {
+    auto it = accesses.find(input.name());
+    auto access = it == accesses.end() ? Access::None : it->second;
+    if (access == Access::Invalid) {
+      return llvm::None;
+    }
+    split.splitInputs.push_back(access == Access::Split);
+    if (access == Access::Split) {
+      auto size = sizeName(input, 0);
+      if (size.empty()) {
+        return llvm::None;
+      }
+      splitSizes.insert(size);
+    }
+  }
+  if (splitSizes.empty()) {
+    return llvm::None;
+  }
+  // The sizes of the split dimensions change with the parts, they must not
+  // size other dimensions.
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    for (int d = 0; d < inputs[i].dimensions(); ++d) {
+      if ((d > 0 or !split.splitInputs[i]) and
+          splitSizes.count(sizeName(inputs[i], d)) > 0) {
+        return llvm::None;
+      }
+    }
+  }
+
+  // Second pass, the values and the other indices must not use the sizes of
+  // the split dimensions either.  Build the first index of each statement.
+  auto paramSpace = domain.get_space();
+  isl::union_map firstIndex;
+  for (const auto& kvp : scop.halide.statements) {
+    auto provide = kvp.second.as<Provide>();
+    const auto& index = provide->args[0].as<Variable>()->name;
+    CollectAccesses collect(index, splitSizes);
+    for (size_t i = 1; i < provide->args.size(); ++i) {
+      provide->args[i].accept(&collect);
+    }
+    for (const auto& v : provide->values) {
+      v.accept(&collect);
+    }
+    if (collect.invalid) {
+      return llvm::None;
+    }
+    auto aff =
+        scop.makeIslAffFromStmtExpr(kvp.first, paramSpace, provide->args[0]);
+    auto map = isl::union_map::from(
+        isl::multi_union_pw_aff(isl::union_pw_aff(isl::pw_aff(aff))));
+    firstIndex = firstIndex ? firstIndex.unite(map) : map;
+  }
+  firstIndex = firstIndex.intersect_domain(domain);
+
+  // Pairs of instances of the same first index
+  auto samePart = firstIndex.apply_range(firstIndex.reverse());
+  auto dependences =
+      scop.dependences.intersect_domain(domain).intersect_range(domain);
+  if (!dependences.is_subset(samePart)) {
+    return llvm::None;
+  }
+  return split;
+}
+
+} // namespace polyhedral
+} // namespace tc
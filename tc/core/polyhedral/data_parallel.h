@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <vector>
+
+#include <llvm/ADT/Optional.h>
+
+#include "tc/core/polyhedral/scop.h"
+
+namespace tc {
+namespace polyhedral {
+
+// A split of the statement instances of a scop along the first index of the
+// tensors they write, into parts that can run independently, e.g. on
+// different devices.  The part of a range of first indices writes the same
+// range of rows of the outputs and reads the same range of rows of the split
+// inputs, the other inputs are read whole by every part.
+struct DataParallelSplit {
+  // For each input, whether it is split along its first dimension.
+  std::vector<bool> splitInputs;
+};
+
+// Find a DataParallelSplit of "scop", which must have been scheduled (see
+// Scop::makeScheduled) so that its dependences are known.
+// The split is legal if the first index of the written tensors is
+// coincident, i.e. no dependence relates instances of different first
+// indices.  Besides, for the parts to be the same TC on smaller tensors, the
+// first index of every statement must be a loop variable that only appears
+// as the first index of the calls, the split inputs must be indexed by it
+// and their first size must not appear elsewhere.
+// Return llvm::None if there is no such split or no input is split.
+llvm::Optional<DataParallelSplit> findDataParallelSplit(const Scop& scop);
+
+} // namespace polyhedral
+} // namespace tc
@@ -34,6 +34,13 @@ struct NoBandsException : public std::runtime_error {
   explicit NoBandsException(const std::string& s) : std::runtime_error(s) {}
 };
 
+// The generated code exceeds the limit on its size, see
+// --cuda_max_kernel_statements.
+struct KernelTooLargeException : public std::runtime_error {
+  explicit KernelTooLargeException(const std::string& s)
+      : std::runtime_error(s) {}
+};
+
 namespace tightening {
 struct TighteningException : public std::logic_error {
   explicit TighteningException(const std::string& s)
@@ -13,19 +13,28 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
+#include <sstream>
 #include <stdexcept>
 
 #include "tc/core/polyhedral/llvm_jit.h"
 
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
 
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_parallel.h"
 #include "tc/core/flags.h"
 #include "tc/core/polyhedral/codegen_llvm.h"
 
@@ -68,11 +77,120 @@ std::string find_library_path(std::string library) {
 
 namespace tc {
 
-Jit::Jit()
-    : TM_(EngineBuilder().selectTarget()),
+JitTarget JitTarget::host() {
+  JitTarget target;
+  target.cpu = sys::getHostCPUName().str();
+  StringMap<bool> hostFeatures;
+  if (sys::getHostCPUFeatures(hostFeatures)) {
+    for (const auto& feature : hostFeatures) {
+      target.features.push_back(
+          (feature.getValue() ? "+" : "-") + feature.getKey().str());
+    }
+    // The order of a StringMap is unspecified, the string of the target must
+    // not depend on it.
+    std::sort(target.features.begin(), target.features.end());
+  }
+  return target;
+}
+
+JitTarget JitTarget::fromFlags() {
+  JitTarget target;
+  if (FLAGS_llvm_target_cpu.empty()) {
+    target = host();
+  } else {
+    target.cpu = FLAGS_llvm_target_cpu;
+  }
+  std::stringstream ss(FLAGS_llvm_target_features);
+  std::string feature;
+  while (std::getline(ss, feature, ',')) {
+    if (!feature.empty()) {
+      target.features.push_back(feature);
+    }
+  }
+  return target;
+}
+
+std::string JitTarget::str() const {
+  std::stringstream ss;
+  ss << cpu;
+  for (size_t i = 0; i < features.size(); ++i) {
+    ss << (i == 0 ? "_" : ",") << features[i];
+  }
+  return ss.str();
+}
+
+JitObjectCache::JitObjectCache(const TargetMachine& TM)
+    : deviceStr_(
+          TM.getTargetTriple().str() + "_" + TM.getTargetCPU().str() + "_" +
+          TM.getTargetFeatureString().str()) {}
+
+bool JitObjectCache::lookup(Module* module) {
+  if (not CpuObjectCache::cacheEnabled()) {
+    return false;
+  }
+  auto& lookup = lookups_[module];
+  lookup.module = toString(module);
+  lookup.object =
+      CpuObjectCache::getCache()->retrieveObject(lookup.module, deviceStr_);
+  return lookup.object != nullptr;
+}
+
+void JitObjectCache::notifyObjectCompiled(
+    const Module* M,
+    MemoryBufferRef Obj) {
+  auto it = lookups_.find(M);
+  if (it == lookups_.end()) {
+    return;
+  }
+  if (CpuObjectCache::cacheEnabled()) {
+    CpuObjectCache::getCache()->cacheObject(
+        it->second.module,
+        deviceStr_,
+        std::string(Obj.getBufferStart(), Obj.getBufferSize()));
+  }
+  lookups_.erase(it);
+}
+
+std::unique_ptr<MemoryBuffer> JitObjectCache::getObject(const Module* M) {
+  auto it = lookups_.find(M);
+  if (it == lookups_.end() or not it->second.object) {
+    return nullptr;
+  }
+  auto res =
+      MemoryBuffer::getMemBufferCopy(*it->second.object, M->getName());
+  lookups_.erase(it);
+  return res;
+}
+
+namespace {
+TargetMachine* selectTarget(
+    Optional<Reloc::Model> relocationModel,
+    const JitTarget& target) {
+  EngineBuilder builder;
+  if (relocationModel) {
+    builder.setRelocationModel(*relocationModel);
+  }
+  builder.setMCPU(target.cpu);
+  builder.setMAttrs(target.features);
+  auto TM = builder.selectTarget();
+  CHECK(TM) << "Cannot compile for the CPU " << target.str();
+  return TM;
+}
+} // namespace
+
+Jit::Jit(Optional<Reloc::Model> relocationModel, const JitTarget& target)
+    : TM_(selectTarget(relocationModel, target)),
       DL_(TM_->createDataLayout()),
+      objectCache_(*TM_),
       objectLayer_([]() { return std::make_shared<SectionMemoryManager>(); }),
-      compileLayer_(objectLayer_, orc::SimpleCompiler(*TM_)) {
+      compileLayer_(objectLayer_, orc::SimpleCompiler(*TM_, &objectCache_)) {
+  // Parallel loops call into the thread pool of this library.
+  sys::DynamicLibrary::AddSymbol(
+      kParallelForName, reinterpret_cast<void*>(&tc_cpu_parallel_for));
+  sys::DynamicLibrary::AddSymbol(
+      kNumThreadsName, reinterpret_cast<void*>(&tc_cpu_num_threads));
+
+#ifdef TAPIR_VERSION_MAJOR
   std::string err;
 
   auto path = find_library_path("libcilkrts.so");
@@ -80,17 +198,51 @@ Jit::Jit()
   if (err != "") {
     throw std::runtime_error("Failed to find cilkrts: " + err);
   }
+#endif
 }
 
 std::shared_ptr<Module> Jit::codegenScop(
     const std::string& specializedName,
-    const polyhedral::Scop& scop) {
-  std::shared_ptr<Module> mod = emitLLVMKernel(
-      specializedName, scop, getTargetMachine().createDataLayout());
+    const polyhedral::Scop& scop,
+    const CpuMappingOptions& options) {
+  std::shared_ptr<Module> mod =
+      emitLLVMKernel(specializedName, scop, *TM_, options);
+  // On restart, cached kernels skip the optimization and only get linked.
+  if (not objectCache_.lookup(mod.get())) {
+    optimizeLLVMKernel(mod.get(), *TM_);
+  }
   addModule(mod);
   return mod;
 }
 
+std::unique_ptr<Module> Jit::emitModule(
+    const std::string& specializedName,
+    const polyhedral::Scop& scop,
+    const CpuMappingOptions& options) {
+  auto mod = emitLLVMKernel(specializedName, scop, *TM_, options);
+  optimizeLLVMKernel(mod.get(), *TM_);
+  return mod;
+}
+
+std::string Jit::emitObject(std::vector<std::unique_ptr<Module>> modules) {
+  CHECK(not modules.empty()) << "No module to compile.";
+  auto mod = std::move(modules.front());
+  for (size_t i = 1; i < modules.size(); ++i) {
+    CHECK(not Linker::linkModules(*mod, std::move(modules[i])))
+        << "Failed to link the kernel modules.";
+  }
+  mod->setTargetTriple(TM_->getTargetTriple().str());
+
+  SmallVector<char, 0> buffer;
+  raw_svector_ostream os(buffer);
+  legacy::PassManager passManager;
+  CHECK(not TM_->addPassesToEmitFile(
+      passManager, os, TargetMachine::CGFT_ObjectFile))
+      << "The target machine cannot emit object files.";
+  passManager.run(*mod);
+  return std::string(buffer.begin(), buffer.end());
+}
+
 TargetMachine& Jit::getTargetMachine() {
   return *TM_;
 }
@@ -15,33 +15,105 @@
  */
 #pragma once
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/Target/TargetMachine.h"
 
+#include "tc/core/cpu/cpu_mapping_options.h"
+
 namespace tc {
 
 namespace polyhedral {
 class Scop;
 }
 
+/// The CPU and target features the kernels are compiled for.
+struct JitTarget {
+  std::string cpu;
+  /// LLVM target features, e.g. "+avx512f", later ones override earlier
+  /// ones.
+  std::vector<std::string> features;
+
+  /// The host CPU with all the features it supports, e.g. AVX-512 on Skylake
+  /// servers, so that the kernels use the widest ISA available.
+  static JitTarget host();
+  /// The target set by --llvm_target_cpu and --llvm_target_features, based
+  /// on the host unless --llvm_target_cpu is set.
+  static JitTarget fromFlags();
+
+  /// Identifies the target, e.g. in cache keys.
+  std::string str() const;
+};
+
+/// The ObjectCache of a Jit, backed by the CpuObjectCache if it is enabled:
+/// serves the objects it holds and stores there those compiled for other
+/// modules.
+class JitObjectCache : public llvm::ObjectCache {
+ public:
+  explicit JitObjectCache(const llvm::TargetMachine& TM);
+
+  /// Looks up the object of module, unoptimized, which must be compiled
+  /// next.  \returns true if it is cached, the module then need not be
+  /// optimized and compiling it only loads the object.
+  bool lookup(llvm::Module* module);
+
+  void notifyObjectCompiled(const llvm::Module* M, llvm::MemoryBufferRef Obj)
+      override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* M) override;
+
+ private:
+  struct Lookup {
+    // The IR before optimization, which identifies the object.
+    std::string module;
+    std::unique_ptr<std::string> object;
+  };
+  const std::string deviceStr_;
+  std::unordered_map<const llvm::Module*, Lookup> lookups_;
+};
+
 class Jit {
  private:
   std::unique_ptr<llvm::TargetMachine> TM_;
   const llvm::DataLayout DL_;
+  JitObjectCache objectCache_;
   llvm::orc::RTDyldObjectLinkingLayer objectLayer_;
   llvm::orc::IRCompileLayer<decltype(objectLayer_), llvm::orc::SimpleCompiler>
       compileLayer_;
 
  public:
-  Jit();
+  // The target machine compiles for target, with the default relocation
+  // model of the host unless relocationModel is set, e.g. to PIC_ to link the
+  // objects of emitObject into shared libraries.
+  explicit Jit(
+      llvm::Optional<llvm::Reloc::Model> relocationModel = llvm::None,
+      const JitTarget& target = JitTarget::fromFlags());
 
   using ModuleHandle = decltype(compileLayer_)::ModuleHandleT;
   std::shared_ptr<llvm::Module> codegenScop(
       const std::string& specializedName,
-      const polyhedral::Scop& scop);
+      const polyhedral::Scop& scop,
+      const CpuMappingOptions& options = CpuMappingOptions());
+  // Emits and optimizes the kernel of the scop as codegenScop does, without
+  // jit-compiling it.
+  std::unique_ptr<llvm::Module> emitModule(
+      const std::string& specializedName,
+      const polyhedral::Scop& scop,
+      const CpuMappingOptions& options = CpuMappingOptions());
+  // Links modules, e.g. from emitModule, into one and compiles it to a
+  // relocatable object file for the target machine, to link the kernels
+  // ahead of time instead of jit-compiling them.  The kernels and their
+  // packed entry points have C linkage, the parallel loops call
+  // tc_cpu_parallel_for and tc_cpu_num_threads (see cpu_parallel.h).
+  std::string emitObject(std::vector<std::unique_ptr<llvm::Module>> modules);
   ModuleHandle addModule(std::shared_ptr<llvm::Module> M);
   void removeModule(ModuleHandle H);
 
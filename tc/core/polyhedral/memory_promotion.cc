@@ -100,6 +100,18 @@ ScopedFootprint outputRanges(isl::map access) {
 }
 } // namespace
 
+size_t approximateRangeSize(isl::map map) {
+  auto ranges = outputRanges(map);
+  if (ranges.size() != map.dim(isl::dim_type::out)) {
+    return 0;
+  }
+  size_t size = 1;
+  for (const auto& dim : ranges) {
+    size *= dim.size.get_num_si();
+  }
+  return size;
+}
+
 // Access has the shape :: [D -> ref] -> O
 // Extract the reference ID, store it separatly and simplify the access.
 std::unique_ptr<TensorReferenceGroup> TensorReferenceGroup::makeSingleton(
@@ -190,7 +202,14 @@ std::vector<size_t> TensorReferenceGroup::approximationSizes() const {
   for (const auto& dim : approximation) {
     result.push_back(dim.size.get_num_si());
   }
-  return result;
+  if (layout.empty()) {
+    return result;
+  }
+  std::vector<size_t> permuted;
+  for (auto dim : layout) {
+    permuted.push_back(result.at(dim));
+  }
+  return permuted;
 }
 
 namespace {
@@ -378,7 +397,115 @@ isl::multi_aff TensorReferenceGroup::promotion() const {
   auto promotion = isl::multi_aff::range_map(accessSpace)
                        .reset_tuple_id(isl::dim_type::out) -
       lowerBounds;
-  return promotion;
+  if (layout.empty()) {
+    return promotion;
+  }
+  auto permuted = promotion;
+  for (size_t i = 0; i < layout.size(); ++i) {
+    permuted = permuted.set_aff(i, promotion.get_aff(layout[i]));
+  }
+  return permuted;
+}
+
+namespace {
+// The pairs of "n"-dimensional integer tuples with the first one
+// lexicographically smaller than the second one.
+isl::union_map lexLessThan(isl::ctx ctx, size_t n) {
+  std::stringstream ss;
+  ss << "{ [";
+  for (size_t i = 0; i < n; ++i) {
+    ss << (i > 0 ? ", " : "") << "s" << i;
+  }
+  ss << "] -> [";
+  for (size_t i = 0; i < n; ++i) {
+    ss << (i > 0 ? ", " : "") << "t" << i;
+  }
+  ss << "] : ";
+  for (size_t i = 0; i < n; ++i) {
+    ss << (i > 0 ? " or (" : "(");
+    for (size_t j = 0; j < i; ++j) {
+      ss << "s" << j << " = t" << j << " and ";
+    }
+    ss << "s" << i << " < t" << i << ")";
+  }
+  ss << " }";
+  return isl::union_map(isl::map(ctx, ss.str()));
+}
+
+// The pairs of statement instances of "domain" scheduled by "tree" such
+// that the first one is executed before the second one inside the same
+// iteration of the outer schedule of "tree".  The pairs may belong to
+// different iterations of the outer schedule, which the caller restricts.
+// Set nodes do not order their children.
+isl::union_map orderedPairs(const ScheduleTree* tree, isl::union_set domain) {
+  auto empty = isl::union_map::empty(domain.get_space());
+  if (auto band = tree->elemAs<detail::ScheduleTreeElemBand>()) {
+    auto inner = tree->numChildren() > 0
+        ? orderedPairs(tree->child({0}), domain)
+        : empty;
+    if (band->nMember() == 0) {
+      return inner;
+    }
+    auto schedule =
+        isl::union_map::from(band->mupa_).intersect_domain(domain);
+    auto equal = schedule.apply_range(schedule.reverse());
+    auto less = schedule.apply_range(lexLessThan(tree->ctx_, band->nMember()))
+                    .apply_range(schedule.reverse());
+    return less.unite(inner.intersect(equal));
+  }
+  if (tree->elemAs<detail::ScheduleTreeElemSequence>()) {
+    auto res = empty;
+    std::vector<isl::union_set> filters;
+    for (auto child : tree->children()) {
+      auto filterNode = child->elemAs<detail::ScheduleTreeElemFilter>();
+      CHECK(filterNode) << "expected filters below sequence";
+      auto filter = filterNode->filter_.intersect(domain);
+      for (const auto& earlier : filters) {
+        for (auto a : isl::UnionAsVector<isl::union_set>(earlier)) {
+          for (auto b : isl::UnionAsVector<isl::union_set>(filter)) {
+            res = res.unite(isl::union_map(isl::map(a, b)));
+          }
+        }
+      }
+      filters.push_back(filter);
+      res = res.unite(orderedPairs(child, filter));
+    }
+    return res;
+  }
+  auto res = empty;
+  for (auto child : tree->children()) {
+    res = res.unite(orderedPairs(child, domain));
+  }
+  return res;
+}
+} // namespace
+
+isl::map TensorReferenceGroup::exposedReads(
+    const ScheduleTree* tree,
+    const Scop& scop) const {
+  auto scoped = scopedReads();
+  auto reads = originalReads();
+  auto writes = originalWrites();
+  if (reads.is_empty() || writes.is_empty() || tree->numChildren() == 0) {
+    return scoped;
+  }
+
+  // Elements read by a statement instance after an instance of the same
+  // iteration of the scoping point wrote them.
+  auto root = scop.scheduleRoot();
+  auto schedule = partialSchedule(root, tree);
+  auto sameIteration = schedule.apply_range(schedule.reverse());
+  auto domain = activeDomainPoints(root, tree);
+  auto before =
+      orderedPairs(tree->child({0}), domain).intersect(sameIteration);
+  auto overwritten = before.reverse().apply_range(writes).intersect(reads);
+
+  auto exposed = reads.subtract(overwritten).apply_domain(schedule);
+  auto res = isl::map::empty(scoped.get_space());
+  for (auto map : isl::UnionAsVector<isl::union_map>(exposed)) {
+    res = res.unite(map);
+  }
+  return res.intersect(scoped);
 }
 
 std::unordered_set<isl::id, isl::IslIdIslHash>
@@ -419,37 +546,6 @@ bool hasCopyExtensionSingleChild(const ScheduleTree* tree) {
   return true;
 }
 
-// Construct the set containing all tensor elements.
-//
-// Find the Halide image corresponding to the given tensorId.  Transform its
-// min() and extent() into parametric isl affs and construct a set where the
-// each dimension of the tensor is contrained by the min_aff on the left and
-// by the min_aff + extent_aff on the right.  Intersect this set with the
-// context of the scop.
-isl::set tensorElementsSet(const Scop& scop, isl::id tensorId) {
-  auto halideParameter = scop.findArgument(tensorId).parameter();
-  auto space = scop.domain().get_space().params();
-  auto nDim = halideParameter.dimensions();
-  space = space.add_dims(isl::dim_type::set, nDim)
-              .set_tuple_id(isl::dim_type::set, tensorId);
-
-  auto tensorElements = isl::set::universe(space);
-  for (int i = 0; i < nDim; ++i) {
-    auto minAff = halide2isl::makeIslAffFromExpr(
-        space, halideParameter.min_constraint(i));
-    auto extentAff = halide2isl::makeIslAffFromExpr(
-        space, halideParameter.extent_constraint(i));
-    auto aff = isl::aff(isl::local_space(space), isl::dim_type::set, i);
-    tensorElements = tensorElements & (minAff <= isl::aff_set(aff)) &
-        (isl::aff_set(aff) < (minAff + extentAff));
-  }
-
-  if (scop.globalParameterContext) {
-    tensorElements =
-        tensorElements.intersect_params(scop.globalParameterContext);
-  }
-  return tensorElements;
-}
 } // namespace
 
 ScheduleTree* insertCopiesUnder(
@@ -464,7 +560,7 @@ ScheduleTree* insertCopiesUnder(
   isl::id writeId = isl::id(ctx, std::string(kWriteIdName));
 
   // Take the set of all tensor elements.
-  auto tensorElements = tensorElementsSet(scop, tensorId);
+  auto tensorElements = scop.tensorElements(tensorId);
 
   if (groupId.is_null()) {
     throw promotion::GroupingError("expected group id");
@@ -475,6 +571,17 @@ ScheduleTree* insertCopiesUnder(
 
   auto identityCopySchedule =
       isl::multi_aff::identity(promotionSpace.range().map_from_set());
+  // The copies iterate over the promoted array in the order of the tensor
+  // dimensions, whatever its layout, so that the copies mapped to threads
+  // access consecutive elements of the tensor.
+  if (!group.layout.empty()) {
+    auto tensorOrder = identityCopySchedule;
+    for (size_t i = 0; i < group.layout.size(); ++i) {
+      tensorOrder =
+          tensorOrder.set_aff(group.layout[i], identityCopySchedule.get_aff(i));
+    }
+    identityCopySchedule = tensorOrder;
+  }
   identityCopySchedule =
       identityCopySchedule.pullback(isl::multi_aff::range_map(promotionSpace));
   auto readSchedule = isl::multi_union_pw_aff(
@@ -488,21 +595,27 @@ ScheduleTree* insertCopiesUnder(
   auto extension =
       promotion.wrap().identity().domain_factor_domain().domain_factor_domain();
 
-  // It's safe to read the overapproximated footprint, and it gives simpler
-  // control flow, but we should only write back elements that are actually
-  // written to.  In any case, intersect the footprint with the set of existing
-  // tensor elements.
+  // It's safe to read the overapproximated footprint of a read-only group,
+  // and it gives simpler control flow, but we should only write back
+  // elements that are actually written to.  A written group only reads the
+  // elements whose values come from outside the tile, none if they are all
+  // written before being read, e.g. the partial sums of a reduction
+  // initialized in the tile.  In any case, intersect the footprint with the
+  // set of existing tensor elements.
   auto promotedFootprint = group.promotedFootprint().set_tuple_id(groupId);
   auto scheduleUniverse =
       isl::set::universe(promotionSpace.domain().unwrap().domain());
   auto arrayId =
       promotionSpace.domain().unwrap().get_tuple_id(isl::dim_type::out);
-  auto approximattedRead =
-      isl::map(
-          scheduleUniverse,
-          group.approximateFootprint().set_tuple_id(arrayId).intersect(
-              tensorElements))
-          .wrap();
+  auto exposedReads = group.isReadOnly() ? group.scopedReads()
+                                         : group.exposedReads(tree, scop);
+  auto approximattedRead = group.isReadOnly()
+      ? isl::map(
+            scheduleUniverse,
+            group.approximateFootprint().set_tuple_id(arrayId).intersect(
+                tensorElements))
+            .wrap()
+      : exposedReads.intersect_range(tensorElements).wrap();
   approximattedRead = isl::map(approximattedRead, promotedFootprint).wrap();
   auto readExtension = extension.intersect_range(approximattedRead)
                            .set_tuple_id(isl::dim_type::out, readId);
@@ -521,7 +634,7 @@ ScheduleTree* insertCopiesUnder(
       isl::set::universe(writeExtension.get_space().range()),
       std::move(writeBandNode));
 
-  bool reads = !group.scopedReads().is_empty();
+  bool reads = !exposedReads.is_empty();
   bool writes = !group.scopedWrites().is_empty();
 
   if (hasCopyExtensionSingleChild(tree)) {
@@ -56,6 +56,12 @@ struct ScopedFootprint : std::vector<ScopedFootprintDim> {
   isl::multi_aff lowerBounds() const;
 };
 
+// Number of elements in a rectangular overapproximation of the range of "map"
+// for fixed values of its input dimensions, computed in the same way as the
+// footprint of a reference group.  Return 0 if no such overapproximation
+// could be computed, e.g. if the range is bounded by parameters.
+size_t approximateRangeSize(isl::map map);
+
 // Descriptor of tensor reference in a Scop.
 // May be scoped to a specific position in a schedule tree, the user is
 // responsible for maintaining the correspondance between schedule tree
@@ -132,6 +138,15 @@ class TensorReferenceGroup {
     return originalWrites().unite(originalReads());
   }
 
+  // Scoped reads of the elements whose values come from outside the
+  // scoping point "tree" of "scop", i.e., that no earlier statement
+  // instance of the same iteration of the partial schedule of "tree"
+  // writes.  Only these elements need to be copied in when the group is
+  // promoted below "tree".  Set nodes are assumed not to order their
+  // children.
+  isl::map exposedReads(const detail::ScheduleTree* tree, const Scop& scop)
+      const;
+
   // Rectangular overapproximation of the set of tensor elements accessed below
   // the scoping point.
   isl::set approximateFootprint() const {
@@ -156,6 +171,11 @@ class TensorReferenceGroup {
  public:
   std::vector<std::unique_ptr<TensorReference>> references;
   ScopedFootprint approximation;
+  // Order of the tensor dimensions in the promoted array: dimension i of the
+  // promoted array is dimension layout[i] of the tensor.  The identity if
+  // empty.  The promotion, the sizes and the promoted footprint are laid out
+  // in this order.
+  std::vector<size_t> layout;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const ScopedFootprint& fp) {
@@ -15,7 +15,9 @@
  */
 #include "tc/core/polyhedral/schedule_tree_matcher.h"
 
+#include <algorithm>
 #include <unordered_set>
+#include <utility>
 
 #include "tc/core/polyhedral/cuda/mapped_scop.h"
 #include "tc/core/polyhedral/schedule_tree.h"
@@ -167,6 +169,166 @@ std::pair<isl::union_set, std::vector<isl::id>> reductionInitsUpdates(
   return std::pair<isl::union_set, std::vector<isl::id>>(initUnion, update);
 }
 
+namespace {
+
+// The value of the Provide node "stmt", without its reduction marker.
+Halide::Expr providedValue(const Halide::Internal::Stmt& stmt) {
+  auto value = stmt.as<Halide::Internal::Provide>()->values[0];
+  auto call = value.as<Halide::Internal::Call>();
+  if (call and
+      (call->is_intrinsic(tc2halide::kReductionInit) or
+       call->is_intrinsic(tc2halide::kReductionUpdate))) {
+    return call->args[0];
+  }
+  return value;
+}
+
+// The names of the variables indexing "call", empty if any index is not a
+// variable.
+std::vector<std::string> indexNames(const Halide::Internal::Call* call) {
+  std::vector<std::string> names;
+  for (const auto& arg : call->args) {
+    auto var = arg.as<Halide::Internal::Variable>();
+    if (!var) {
+      return {};
+    }
+    names.push_back(var->name);
+  }
+  return names;
+}
+
+// The position of the input "name" in "scop", -1 if there is none.
+int inputPosition(const Scop& scop, const std::string& name) {
+  for (size_t i = 0; i < scop.halide.inputs.size(); ++i) {
+    if (scop.halide.inputs[i].name() == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Whether "operand", indexed by "batch" followed by (x, y) or (y, x), is an
+// input.  Sets "position" and "transposed" if so, the latter when the
+// operand is indexed (y, x).
+bool matchGemmOperand(
+    const Halide::Internal::Call* operand,
+    const Scop& scop,
+    const std::vector<std::string>& batch,
+    const std::string& x,
+    const std::string& y,
+    size_t* position,
+    bool* transposed) {
+  if (!operand or operand->call_type != Halide::Internal::Call::Image) {
+    return false;
+  }
+  auto input = inputPosition(scop, operand->name);
+  auto names = indexNames(operand);
+  if (input < 0 or names.size() != batch.size() + 2 or
+      !std::equal(batch.begin(), batch.end(), names.begin())) {
+    return false;
+  }
+  auto inner = std::make_pair(names[batch.size()], names[batch.size() + 1]);
+  if (inner != std::make_pair(x, y) and inner != std::make_pair(y, x)) {
+    return false;
+  }
+  *position = input;
+  *transposed = inner.first == y;
+  return true;
+}
+} // namespace
+
+llvm::Optional<GemmCall> matchGemmCall(const Scop& scop) {
+  if (scop.halide.outputs.size() != 1 or scop.halide.reductions.size() != 1) {
+    return llvm::None;
+  }
+  // The domain only holds the init and the single update statements.
+  auto initsUpdates = reductionInitsUpdates(scop.domain(), scop);
+  if (initsUpdates.second.size() != 1 or initsUpdates.first.is_empty()) {
+    return llvm::None;
+  }
+  const auto& reduction = scop.halide.reductions[0];
+  if (!Halide::Internal::is_zero(providedValue(reduction.init))) {
+    return llvm::None;
+  }
+  auto update = reduction.update.as<Halide::Internal::Provide>();
+  auto add = providedValue(reduction.update).as<Halide::Internal::Add>();
+  if (!add) {
+    return llvm::None;
+  }
+  auto isRecursive = [update](const Halide::Expr& e) {
+    auto call = e.as<Halide::Internal::Call>();
+    return call and call->name == update->name;
+  };
+  auto product = isRecursive(add->a) ? add->b : add->a;
+  if (!isRecursive(add->a) and !isRecursive(add->b)) {
+    return llvm::None;
+  }
+  auto mul = product.as<Halide::Internal::Mul>();
+  if (!mul) {
+    return llvm::None;
+  }
+
+  std::vector<std::string> outputNames;
+  for (const auto& arg : update->args) {
+    auto var = arg.as<Halide::Internal::Variable>();
+    if (!var) {
+      return llvm::None;
+    }
+    outputNames.push_back(var->name);
+  }
+  if (outputNames.size() < 2) {
+    return llvm::None;
+  }
+  std::vector<std::string> batch(outputNames.begin(), outputNames.end() - 2);
+  auto i = outputNames[batch.size()];
+  auto j = outputNames[batch.size() + 1];
+  auto lhs = mul->a.as<Halide::Internal::Call>();
+  auto rhs = mul->b.as<Halide::Internal::Call>();
+  if (!lhs or !rhs) {
+    return llvm::None;
+  }
+  // The reduction index k is the one of the left operand that is not i.
+  auto lhsNames = indexNames(lhs);
+  if (lhsNames.size() != batch.size() + 2) {
+    return llvm::None;
+  }
+  // A is the operand indexed by i, swap the operands if needed.
+  if (std::find(lhsNames.begin(), lhsNames.end(), i) == lhsNames.end()) {
+    std::swap(lhs, rhs);
+    lhsNames = indexNames(lhs);
+    if (lhsNames.size() != batch.size() + 2) {
+      return llvm::None;
+    }
+  }
+  auto k = lhsNames[batch.size()] == i ? lhsNames[batch.size() + 1]
+                                        : lhsNames[batch.size()];
+  std::unordered_set<std::string> distinct(
+      outputNames.begin(), outputNames.end());
+  distinct.insert(k);
+  if (distinct.size() != outputNames.size() + 1) {
+    return llvm::None;
+  }
+
+  GemmCall call;
+  call.batchDims = batch.size();
+  if (!matchGemmOperand(
+          lhs, scop, batch, i, k, &call.a, &call.transposeA) or
+      !matchGemmOperand(rhs, scop, batch, k, j, &call.b, &call.transposeB)) {
+    return llvm::None;
+  }
+  return call;
+}
+
+bool isScatterUpdate(isl::id updateId, const Scop& scop) {
+  const auto& update = scop.halide.statements.at(updateId);
+  for (const auto& reduction : scop.halide.reductions) {
+    if (reduction.update.same_as(update)) {
+      return reduction.scatter;
+    }
+  }
+  return false;
+}
+
 int findFirstReductionDim(isl::multi_union_pw_aff islMupa, const Scop& scop) {
   auto mupa = isl::MUPA(islMupa);
   int reductionDim = -1;
@@ -56,9 +56,6 @@ inline detail::ScheduleTree* mapToParameterWithExtent(
   CHECK(band) << "expected a band, got " << *tree;
   CHECK_GE(pos, 0) << "dimension underflow";
   CHECK_LT(pos, band->nMember()) << "dimension overflow";
-  CHECK_NE(extent, 0) << "NYI: mapping to 0";
-
-  auto domain = activeDomainPoints(root, tree).universe();
 
   // Introduce the "mapping" parameter after checking it is not already present
   // in the schedule space.
@@ -72,10 +69,23 @@ inline detail::ScheduleTree* mapToParameterWithExtent(
     }
   }
 
+  return mapAffineToParameterWithExtent(
+      root, tree, band->mupa_.get_union_pw_aff(pos), id, extent);
+}
+
+template <typename MappingIdType>
+inline detail::ScheduleTree* mapAffineToParameterWithExtent(
+    detail::ScheduleTree* root,
+    detail::ScheduleTree* tree,
+    isl::union_pw_aff upa,
+    MappingIdType id,
+    size_t extent) {
+  CHECK_NE(extent, 0) << "NYI: mapping to 0";
+  auto domain = activeDomainPoints(root, tree).universe();
+
   // Create mapping filter by equating the newly introduced
-  // parameter "id" to the "pos"-th schedule dimension modulo its extent.
-  auto upa =
-      band->mupa_.get_union_pw_aff(pos).mod_val(isl::val(tree->ctx_, extent));
+  // parameter "id" to "upa" modulo its extent.
+  upa = upa.mod_val(isl::val(tree->ctx_, extent));
   upa = upa.sub(isl::union_pw_aff::param_on_domain(domain, id));
   auto filter = upa.zero_union_set();
   return insertMappingFilterAbove<MappingIdType>(root, tree, filter, {id})
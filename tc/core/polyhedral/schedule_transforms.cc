@@ -281,13 +281,17 @@ bandSplit(ScheduleTree* relativeRoot, ScheduleTree* tree, size_t pos) {
   return tree;
 }
 
-ScheduleTree*
-bandSplitOut(ScheduleTree* relativeRoot, ScheduleTree* tree, size_t pos) {
+ScheduleTree* bandSplitOut(
+    ScheduleTree* relativeRoot,
+    ScheduleTree* tree,
+    size_t pos,
+    size_t n) {
   auto band = tree->elemAs<ScheduleTreeElemBand>();
   CHECK(band);
   auto schedule = band->mupa_;
-  if (pos != schedule.dim(isl::dim_type::set) - 1) {
-    tree = bandSplit(relativeRoot, tree, pos + 1);
+  CHECK_LE(pos + n, schedule.dim(isl::dim_type::set));
+  if (pos + n != schedule.dim(isl::dim_type::set)) {
+    tree = bandSplit(relativeRoot, tree, pos + n);
   }
   if (pos != 0) {
     tree = bandSplit(relativeRoot, tree, pos);
@@ -390,6 +394,20 @@ ScheduleTree* bandScale(ScheduleTree* tree, const vector<size_t>& scales) {
   return tree;
 }
 
+ScheduleTree* bandWavefront(ScheduleTree* tree) {
+  auto eb = tree->elemAs<ScheduleTreeElemBand>();
+  CHECK(eb) << "Not a band: " << *tree;
+  auto& band = *eb;
+  CHECK(band.permutable_) << "Can't skew a non-permutable band" << band;
+  CHECK_LE(2u, band.nMember()) << "No member to skew by" << band;
+
+  auto& mupa = band.mupa_;
+  mupa = mupa.set_union_pw_aff(
+      0, mupa.get_union_pw_aff(0).add(mupa.get_union_pw_aff(1)));
+  band.coincident_[1] = true;
+  return tree;
+}
+
 namespace {
 
 template <typename T>
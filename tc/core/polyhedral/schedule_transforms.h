@@ -74,15 +74,16 @@ detail::ScheduleTree* bandSplit(
     detail::ScheduleTree* tree,
     size_t pos);
 // Split band rooted under relativeRoot into at most three nested band
-// such that the band member at position "pos" is isolated
-// into a single-member band.
+// such that the "n" band members starting at position "pos" are isolated
+// into a band of their own.
 // The schedules of the split bands live in anonymous spaces.
 // Update the current ScheduleTree and return
-// a pointer to band containing the isolated member.
+// a pointer to band containing the isolated members.
 detail::ScheduleTree* bandSplitOut(
     detail::ScheduleTree* relativeRoot,
     detail::ScheduleTree* tree,
-    size_t pos);
+    size_t pos,
+    size_t n = 1);
 
 // The semantics for this function is somewhat richer than the ISL C semantics.
 // Since tiling is implemented as a simple band.mupa_ tranformation we can
@@ -114,6 +115,16 @@ detail::ScheduleTree* bandScale(
     detail::ScheduleTree* tree,
     const std::vector<size_t>& scales);
 
+// Skew the first member of the permutable band "tree" by the second one,
+// i.e. replace (i0, i1, ...) by (i0 + i1, i1, ...), and mark the second
+// member coincident.  The dependences within a permutable band have
+// non-negative distances (d0, d1, ...), those with d0 + d1 = 0 have d1 = 0:
+// the first member is a wavefront whose points are independent along the
+// second member.  The coincidence of the other members is unchanged.
+//
+// Modifies tree in place and returns it for call chaining purposes
+detail::ScheduleTree* bandWavefront(detail::ScheduleTree* tree);
+
 // Map "pos"-th schedule dimension of the band node identified by "tree" to a
 // _new_ parameter identified by "id" and limited by 0 <= id < extent.  The
 // parameter must not be present in the space of partial schedule of "tree" and
@@ -131,6 +142,19 @@ detail::ScheduleTree* mapToParameterWithExtent(
     MappingIdType id,
     size_t extent);
 
+// Like mapToParameterWithExtent, for an affine function "upa" of the
+// statement instances active at "tree" instead of a schedule dimension, e.g.
+// several dimensions linearized into one.  The filter has condition
+// 'upa % extent = id', from which code generation recovers the values of
+// the dimensions by division and modulo.
+template <typename MappingIdType>
+detail::ScheduleTree* mapAffineToParameterWithExtent(
+    detail::ScheduleTree* root,
+    detail::ScheduleTree* tree,
+    isl::union_pw_aff upa,
+    MappingIdType id,
+    size_t extent);
+
 // In a tree starting at a (relative) "root", insert a band node with the
 // given partial schedule above the node identified by "tree".
 //
@@ -132,7 +132,7 @@ ScheduleTree::ScheduleTree(const ScheduleTree& st)
       type_(st.type_),
       elem_(ScheduleTreeElemBase::make(st)) {
   children_.reserve(st.children_.size());
-  for (const auto& child : st.children()) {
+  for (const auto& child : st.children_) {
     children_.push_back(ScheduleTree::makeScheduleTree(*child));
   }
 }
@@ -158,6 +158,14 @@ struct ScheduleTree {
  public:
   explicit ScheduleTree(isl::ctx ctx);
 
+  // Nodes are allocated from the pools of allocateScheduleTreeNode.
+  static void* operator new(size_t size) {
+    return allocateScheduleTreeNode(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    deallocateScheduleTreeNode(ptr, size);
+  }
+
   bool operator==(const ScheduleTree& other) const;
   bool operator!=(const ScheduleTree& other) const {
     return !(*this == other);
@@ -416,6 +424,8 @@ struct ScheduleTree {
     return res;
   }
 
+  // Copy of tree.  The isl objects of the elements are reference counted,
+  // they are shared with tree rather than copied.
   static ScheduleTreeUPtr makeScheduleTree(const ScheduleTree& tree) {
     return ScheduleTreeUPtr(new ScheduleTree(tree));
   }
@@ -16,6 +16,7 @@
 #include "tc/core/polyhedral/schedule_tree_elem.h"
 
 #include <algorithm>
+#include <array>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -38,6 +39,45 @@ namespace detail {
 
 namespace {
 
+// Blocks are pooled by multiples of kNodeGranularity bytes, up to
+// kMaxPooledSize.  Each pool keeps at most kMaxPooledBlocks blocks of every
+// size, enough for the trees of a mapping, and returns the others to the
+// heap.  The blocks a pool keeps are only released when its thread exits,
+// at most kMaxPooledBlocks x (16 + 32 + ... + 256) bytes, about 2 MB, per
+// thread.
+constexpr size_t kNodeGranularity = 16;
+constexpr size_t kMaxPooledSize = 256;
+constexpr size_t kMaxPooledBlocks = 1 << 10;
+
+struct NodePool {
+  ~NodePool() {
+    destroyed = true;
+    for (const auto& blocks : freeBlocks) {
+      for (auto block : blocks) {
+        ::operator delete(block);
+      }
+    }
+  }
+
+  std::array<std::vector<void*>, kMaxPooledSize / kNodeGranularity>
+      freeBlocks;
+  // Nodes destroyed after the pool of their thread, e.g. by static objects,
+  // return to the heap.  Trivially destructible, it is valid until the
+  // thread exits.
+  static thread_local bool destroyed;
+};
+
+thread_local bool NodePool::destroyed = false;
+
+NodePool* nodePool() {
+  thread_local NodePool pool;
+  return NodePool::destroyed ? nullptr : &pool;
+}
+
+size_t sizeClass(size_t size) {
+  return (size + kNodeGranularity - 1) / kNodeGranularity - 1;
+}
+
 std::unique_ptr<ScheduleTreeElemBand> fromIslScheduleNodeBand(
     isl::schedule_node_band b) {
   auto res =
@@ -51,6 +91,31 @@ std::unique_ptr<ScheduleTreeElemBand> fromIslScheduleNodeBand(
 
 } // namespace
 
+void* allocateScheduleTreeNode(size_t size) {
+  if (size > kMaxPooledSize) {
+    return ::operator new(size);
+  }
+  // Blocks allocated without a pool may still be pooled when freed, e.g. on
+  // another thread, so they always have the size of their class.
+  auto pool = nodePool();
+  if (!pool or pool->freeBlocks[sizeClass(size)].empty()) {
+    return ::operator new((sizeClass(size) + 1) * kNodeGranularity);
+  }
+  auto& blocks = pool->freeBlocks[sizeClass(size)];
+  auto block = blocks.back();
+  blocks.pop_back();
+  return block;
+}
+
+void deallocateScheduleTreeNode(void* ptr, size_t size) {
+  auto pool = size <= kMaxPooledSize ? nodePool() : nullptr;
+  if (!pool or pool->freeBlocks[sizeClass(size)].size() >= kMaxPooledBlocks) {
+    ::operator delete(ptr);
+    return;
+  }
+  pool->freeBlocks[sizeClass(size)].push_back(ptr);
+}
+
 std::unique_ptr<ScheduleTreeElemBase> ScheduleTreeElemBase::make(
     isl::schedule_node node) {
   if (auto band = node.as<isl::schedule_node_band>()) {
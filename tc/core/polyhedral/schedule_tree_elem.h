@@ -43,12 +43,30 @@ enum class ScheduleTreeType {
 
 struct ScheduleTree;
 
+// Schedule tree nodes and their elements are small and the transformations
+// and the mapping allocate and free them in large numbers.  They are
+// allocated from per-thread pools of blocks of a few sizes, which keep the
+// freed blocks for the next allocations of the same size instead of
+// returning them to the heap.  A block may be freed on another thread than
+// the one it was allocated on, it then joins the pool of that thread.  The
+// freed blocks a thread keeps are bounded and released when it exits.
+void* allocateScheduleTreeNode(size_t size);
+void deallocateScheduleTreeNode(void* ptr, size_t size);
+
 struct ScheduleTreeElemBase {
   static constexpr detail::ScheduleTreeType NodeType =
       detail::ScheduleTreeType::None;
   static std::unique_ptr<ScheduleTreeElemBase> make(isl::schedule_node node);
   static std::unique_ptr<ScheduleTreeElemBase> make(const ScheduleTree& st);
   virtual ~ScheduleTreeElemBase() {}
+
+  // The destructor is virtual, size is that of the most derived element.
+  static void* operator new(size_t size) {
+    return allocateScheduleTreeNode(size);
+  }
+  static void operator delete(void* ptr, size_t size) {
+    deallocateScheduleTreeNode(ptr, size);
+  }
   virtual std::ostream& write(std::ostream& os) const = 0;
   virtual detail::ScheduleTreeType type() const = 0;
 };
@@ -19,6 +19,8 @@
 #include <utility>
 #include <vector>
 
+#include <llvm/ADT/Optional.h>
+
 #include "tc/core/polyhedral/schedule_tree.h"
 #include "tc/core/polyhedral/scop.h"
 
@@ -35,11 +37,37 @@ std::pair<isl::union_set, std::vector<isl::id>> reductionInitsUpdates(
     isl::union_set domain,
     const Scop& scop);
 
+// Is "updateId" the update statement of a scatter reduction of "scop", whose
+// instances reduce into elements selected by data-dependent subscripts
+// (see halide2isl::Reduction)?
+bool isScatterUpdate(isl::id updateId, const Scop& scop);
+
 // Find the first band member that corresponds to a reduction.
 // TODO: heuristic to choose the "best" band member in presence of multiple
 // reductions.
 int findFirstReductionDim(isl::multi_union_pw_aff islMupa, const Scop& scop);
 
+// A scop that is a single (batched) matrix multiplication, in a form vendor
+// libraries compute, e.g. cuBLAS:
+//   O(b..., i, j) +=! A(b..., i, k) * B(b..., k, j)
+// where A may be indexed (b..., k, i) and B (b..., j, k) instead, and the
+// leading batch indices b... are the same for all three tensors.
+struct GemmCall {
+  // Positions of O among the outputs and of A and B among the inputs.
+  size_t output = 0;
+  size_t a = 0;
+  size_t b = 0;
+  size_t batchDims = 0;
+  // Whether A is indexed (b..., k, i) and B (b..., j, k).
+  bool transposeA = false;
+  bool transposeB = false;
+};
+
+// Match the statements of "scop" for the zero init and the update of a
+// GemmCall, and nothing else.  The loops are assumed to span the tensors,
+// i.e. that the TC has no where clause restricting them.
+llvm::Optional<GemmCall> matchGemmCall(const Scop& scop);
+
 } // namespace polyhedral
 } // namespace tc
 
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/polyhedral/schedule_tree_proto.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "tc/core/polyhedral/cuda/mapping_types.h"
+#include "tc/core/polyhedral/schedule_tree_elem.h"
+
+namespace tc {
+namespace polyhedral {
+namespace detail {
+
+namespace {
+
+std::string toString(char* str) {
+  CHECK(str) << "could not print isl object";
+  std::string res(str);
+  free(str);
+  return res;
+}
+
+// Parse the isl object of "proto" with "read", an isl_*_read_from_str.
+template <typename T, typename Read>
+T readIslObject(isl::ctx ctx, const ScheduleTreeProto& proto, Read read) {
+  if (!proto.has_isl_object()) {
+    throw std::invalid_argument(
+        "missing isl object in ScheduleTreeProto of type " +
+        ScheduleTreeProto::Type_Name(proto.type()));
+  }
+  auto res = isl::manage(read(ctx.get(), proto.isl_object().c_str()));
+  if (!res) {
+    throw std::invalid_argument(
+        "could not parse isl object " + proto.isl_object());
+  }
+  return res;
+}
+
+mapping::MappingId makeMappingId(isl::ctx ctx, const std::string& name) {
+  isl::id id(ctx, name);
+  if (name == "b0") {
+    return mapping::BlockId::makeId<0>(id);
+  } else if (name == "b1") {
+    return mapping::BlockId::makeId<1>(id);
+  } else if (name == "b2") {
+    return mapping::BlockId::makeId<2>(id);
+  } else if (name == "t0") {
+    return mapping::ThreadId::makeId<0>(id);
+  } else if (name == "t1") {
+    return mapping::ThreadId::makeId<1>(id);
+  } else if (name == "t2") {
+    return mapping::ThreadId::makeId<2>(id);
+  }
+  throw std::invalid_argument("unknown mapping id " + name);
+}
+
+ScheduleTreeUPtr makeTree(
+    isl::ctx ctx,
+    const ScheduleTreeProto& proto,
+    std::vector<ScheduleTreeUPtr>&& children) {
+  switch (proto.type()) {
+    case ScheduleTreeProto::NODE_BAND: {
+      auto mupa = readIslObject<isl::multi_union_pw_aff>(
+          ctx, proto, isl_multi_union_pw_aff_read_from_str);
+      auto res = ScheduleTree::makeBand(mupa, std::move(children));
+      auto band = res->elemAs<ScheduleTreeElemBand>();
+      auto nMember = band->nMember();
+      if (static_cast<size_t>(proto.coincident_size()) != nMember or
+          static_cast<size_t>(proto.unroll_size()) != nMember) {
+        throw std::invalid_argument(
+            "band members mismatch in " + proto.isl_object());
+      }
+      band->permutable_ = proto.permutable();
+      for (size_t i = 0; i < nMember; ++i) {
+        band->coincident_[i] = proto.coincident(i);
+        band->unroll_[i] = proto.unroll(i);
+      }
+      return res;
+    }
+    case ScheduleTreeProto::NODE_CONTEXT:
+      return ScheduleTree::makeContext(
+          readIslObject<isl::set>(ctx, proto, isl_set_read_from_str),
+          std::move(children));
+    case ScheduleTreeProto::NODE_DOMAIN:
+      return ScheduleTree::makeDomain(
+          readIslObject<isl::union_set>(
+              ctx, proto, isl_union_set_read_from_str),
+          std::move(children));
+    case ScheduleTreeProto::NODE_EXTENSION:
+      return ScheduleTree::makeExtension(
+          readIslObject<isl::union_map>(
+              ctx, proto, isl_union_map_read_from_str),
+          std::move(children));
+    case ScheduleTreeProto::NODE_FILTER:
+      return ScheduleTree::makeFilter(
+          readIslObject<isl::union_set>(
+              ctx, proto, isl_union_set_read_from_str),
+          std::move(children));
+    case ScheduleTreeProto::NODE_MAPPING_FILTER: {
+      std::unordered_set<mapping::MappingId, mapping::MappingId::Hash> ids;
+      for (const auto& name : proto.mapping_ids()) {
+        ids.insert(makeMappingId(ctx, name));
+      }
+      return ScheduleTree::makeMappingFilter(
+          readIslObject<isl::union_set>(
+              ctx, proto, isl_union_set_read_from_str),
+          ids,
+          std::move(children));
+    }
+    case ScheduleTreeProto::NODE_SEQUENCE:
+    case ScheduleTreeProto::NODE_SET: {
+      if (children.empty()) {
+        throw std::invalid_argument(
+            "ScheduleTreeProto of type " +
+            ScheduleTreeProto::Type_Name(proto.type()) + " without children");
+      }
+      // Only the first child is given to the factory, which would flatten
+      // it, so that the structure is restored as it was serialized.
+      auto first = std::move(children.front());
+      children.erase(children.begin());
+      auto res = proto.type() == ScheduleTreeProto::NODE_SEQUENCE
+          ? ScheduleTree::makeSequence(std::move(first))
+          : ScheduleTree::makeSet(std::move(first));
+      res->appendChildren(std::move(children));
+      return res;
+    }
+  }
+  throw std::invalid_argument(
+      "unknown ScheduleTreeProto type " + std::to_string(proto.type()));
+}
+} // namespace
+
+ScheduleTreeProto toProtobuf(const ScheduleTree& tree) {
+  ScheduleTreeProto res;
+  switch (tree.type_) {
+    case ScheduleTreeType::Band: {
+      auto band = tree.elemAs<ScheduleTreeElemBand>();
+      res.set_type(ScheduleTreeProto::NODE_BAND);
+      res.set_isl_object(
+          toString(isl_multi_union_pw_aff_to_str(band->mupa_.get())));
+      res.set_permutable(band->permutable_);
+      for (size_t i = 0; i < band->nMember(); ++i) {
+        res.add_coincident(band->coincident_[i]);
+        res.add_unroll(band->unroll_[i]);
+      }
+      break;
+    }
+    case ScheduleTreeType::Context:
+      res.set_type(ScheduleTreeProto::NODE_CONTEXT);
+      res.set_isl_object(toString(isl_set_to_str(
+          tree.elemAs<ScheduleTreeElemContext>()->context_.get())));
+      break;
+    case ScheduleTreeType::Domain:
+      res.set_type(ScheduleTreeProto::NODE_DOMAIN);
+      res.set_isl_object(toString(isl_union_set_to_str(
+          tree.elemAs<ScheduleTreeElemDomain>()->domain_.get())));
+      break;
+    case ScheduleTreeType::Extension:
+      res.set_type(ScheduleTreeProto::NODE_EXTENSION);
+      res.set_isl_object(toString(isl_union_map_to_str(
+          tree.elemAs<ScheduleTreeElemExtension>()->extension_.get())));
+      break;
+    case ScheduleTreeType::Filter:
+      res.set_type(ScheduleTreeProto::NODE_FILTER);
+      res.set_isl_object(toString(isl_union_set_to_str(
+          tree.elemAs<ScheduleTreeElemFilter>()->filter_.get())));
+      break;
+    case ScheduleTreeType::MappingFilter: {
+      auto filter = tree.elemAs<ScheduleTreeElemMappingFilter>();
+      res.set_type(ScheduleTreeProto::NODE_MAPPING_FILTER);
+      res.set_isl_object(toString(isl_union_set_to_str(filter->filter_.get())));
+      for (const auto& id : filter->mappingIds) {
+        res.add_mapping_ids(id.get_name());
+      }
+      break;
+    }
+    case ScheduleTreeType::Sequence:
+      res.set_type(ScheduleTreeProto::NODE_SEQUENCE);
+      break;
+    case ScheduleTreeType::Set:
+      res.set_type(ScheduleTreeProto::NODE_SET);
+      break;
+    default:
+      LOG(FATAL) << "cannot serialize schedule tree node of type "
+                 << tree.type_;
+  }
+  for (auto child : tree.children()) {
+    *res.add_children() = toProtobuf(*child);
+  }
+  return res;
+}
+
+ScheduleTreeUPtr fromProtobuf(isl::ctx ctx, const ScheduleTreeProto& proto) {
+  std::vector<ScheduleTreeUPtr> children;
+  for (const auto& child : proto.children()) {
+    children.push_back(fromProtobuf(ctx, child));
+  }
+  return makeTree(ctx, proto, std::move(children));
+}
+
+} // namespace detail
+} // namespace polyhedral
+} // namespace tc
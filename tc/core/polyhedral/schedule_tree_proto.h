@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <compcache.pb.h>
+
+#include "tc/core/polyhedral/schedule_tree.h"
+#include "tc/external/isl.h"
+
+namespace tc {
+namespace polyhedral {
+namespace detail {
+
+// Serialization of schedule trees of any kind of nodes, e.g. mapped trees
+// with their mapping filters and the extensions of their synchronizations.
+// The isl objects are printed, a tree restored in another isl context, e.g.
+// in another process, is equal to the serialized one if it involves the
+// same statement and parameter identifiers, as the trees of a TC do.
+ScheduleTreeProto toProtobuf(const ScheduleTree& tree);
+// Throws std::invalid_argument if the proto is not that of a tree.
+ScheduleTreeUPtr fromProtobuf(isl::ctx ctx, const ScheduleTreeProto& proto);
+
+} // namespace detail
+} // namespace polyhedral
+} // namespace tc
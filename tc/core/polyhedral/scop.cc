@@ -15,14 +15,19 @@
  */
 #include "tc/core/polyhedral/scop.h"
 
+#include <cstdlib>
 #include <functional>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "tc/core/flags.h"
 #include "tc/core/halide2isl.h"
 #include "tc/core/polyhedral/functional.h"
 #include "tc/core/polyhedral/memory_promotion.h"
@@ -31,6 +36,8 @@
 #include "tc/core/polyhedral/schedule_tree_matcher.h"
 #include "tc/core/scope_guard.h"
 #include "tc/core/tc2halide.h"
+#include "tc/core/utils/dlpack.h"
+#include "tc/core/utils/time.h"
 
 using namespace std;
 
@@ -62,15 +69,34 @@ ScopUPtr Scop::makeScop(
   scop->halide.reductionIdx = sym.reductionVars;
   scop->halide.inputs = components.inputs;
   scop->halide.outputs = components.outputs;
+  scop->halide.outputs.insert(
+      scop->halide.outputs.end(),
+      components.temporaries.begin(),
+      components.temporaries.end());
+  scop->halide.aliases = components.aliases;
 
   auto tree = halide2isl::makeScheduleTree(paramSpace, components.stmt);
   scop->scheduleTreeUPtr = std::move(tree.tree);
   scop->reads = tree.reads;
   scop->writes = tree.writes;
   scop->halide.statements = std::move(tree.statements);
+  // The statements are numbered in order of the Provide nodes.
+  std::map<std::string, size_t> numberProvides;
+  for (size_t i = 0; i < scop->halide.statements.size(); ++i) {
+    isl::id id(ctx, kStatementLabel + std::to_string(i));
+    auto provide =
+        scop->halide.statements.at(id).as<Halide::Internal::Provide>();
+    auto ranges = components.provideRanges.find(provide->name);
+    auto index = numberProvides[provide->name]++;
+    if (ranges != components.provideRanges.end() &&
+        index < ranges->second.size()) {
+      scop->halide.sourceRanges.emplace(id, ranges->second[index]);
+    }
+  }
   scop->halide.accesses = std::move(tree.accesses);
   scop->halide.reductions = halide2isl::findReductions(components.stmt);
   scop->halide.iterators = std::move(tree.iterators);
+  scop->boundIndirectAccesses();
 
   // Set partial schedule tuples for proper comparison with ISL
   // schedules (needs DFSPreorder numbering). Just for testing.
@@ -86,6 +112,43 @@ ScopUPtr Scop::makeScop(
   return scop;
 }
 
+namespace {
+// Intersect the ranges of the accesses in "accesses" to the tensors in
+// "elements", by tensor identifier, with the corresponding sets.
+isl::union_map boundAccesses(
+    isl::union_map accesses,
+    const std::unordered_map<isl::id, isl::set, isl::IslIdIslHash>& elements) {
+  auto result = isl::union_map::empty(accesses.get_space());
+  for (auto a : isl::UnionAsVector<isl::union_map>(accesses)) {
+    auto it = elements.find(a.get_tuple_id(isl::dim_type::out));
+    if (it != elements.end()) {
+      a = a.intersect_range(it->second);
+    }
+    result = result.unite(isl::union_map(a));
+  }
+  return result;
+}
+} // namespace
+
+void Scop::boundIndirectAccesses() {
+  // halide2isl leaves the data-dependent subscripts of gathers and scatters
+  // unconstrained.  Accessing elements outside a tensor is undefined,
+  // so the accessed elements are those of the tensor.  This makes the
+  // footprints of these accesses bounded, hence approximatable.
+  std::unordered_map<isl::id, isl::set, isl::IslIdIslHash> elements;
+  for (auto a : isl::UnionAsVector<isl::union_map>(reads.unite(writes))) {
+    if (!a.is_single_valued()) {
+      auto tensorId = a.get_tuple_id(isl::dim_type::out);
+      elements.emplace(tensorId, tensorElements(tensorId));
+    }
+  }
+  if (elements.empty()) {
+    return;
+  }
+  reads = boundAccesses(reads, elements);
+  writes = boundAccesses(writes, elements);
+}
+
 ScopUPtr Scop::makeScop(isl::ctx ctx, const string& tc) {
   return makeScop(ctx, tc2halide::translate(ctx, tc));
 }
@@ -153,6 +216,36 @@ void Scop::insertSync(detail::ScheduleTree* seqNode, size_t i) {
   insertExtensionLabelAt(scheduleRoot(), seqNode, i, makeSyncId());
 }
 
+void Scop::insertWarpSync(detail::ScheduleTree* seqNode, size_t i) {
+  insertExtensionLabelAt(scheduleRoot(), seqNode, i, makeWarpSyncId());
+}
+
+void Scop::removeSync(detail::ScheduleTree* seqNode, size_t i) {
+  auto filterNode =
+      seqNode->child({i})->elemAs<detail::ScheduleTreeElemFilter>();
+  CHECK(filterNode) << "expected a filter below the sequence";
+  auto syncSet = isl::set::from_union_set(filterNode->filter_);
+  auto syncId = syncSet.get_tuple_id();
+  CHECK(isSyncId(syncId) || isWarpSyncId(syncId))
+      << "not a synchronization: " << syncSet;
+  seqNode->detachChild(i);
+
+  // Drop the statement from the extension that introduced it.
+  auto extensionNode = seqNode->ancestor(scheduleRoot(), 1)
+                           ->elemAs<detail::ScheduleTreeElemExtension>();
+  CHECK(extensionNode) << "expected an extension above the sequence";
+  auto extension = extensionNode->extension_;
+  auto remaining = isl::union_map::empty(extension.get_space());
+  for (auto map : isl::UnionAsVector<isl::union_map>(extension)) {
+    auto range = map.range();
+    if (!range.has_tuple_name() ||
+        range.get_tuple_name() != syncId.get_name()) {
+      remaining = remaining.unite(isl::union_map(map));
+    }
+  }
+  extensionNode->extension_ = remaining;
+}
+
 namespace {
 
 void checkFiltersDisjointStatements(const ScheduleTree* root) {
@@ -180,13 +273,24 @@ void checkFiltersDisjointStatements(const ScheduleTree* root) {
 }
 } // namespace
 
+size_t paddedExtent(size_t extent, size_t padWidth) {
+  if (padWidth == 0) {
+    return extent;
+  }
+  auto nWords = (extent + padWidth - 1) / padWidth;
+  if (nWords % 2 == 0) {
+    nWords += 1;
+  }
+  return nWords * padWidth;
+}
+
 void Scop::promoteGroup(
     PromotedDecl::Kind kind,
     isl::id tensorId,
     std::unique_ptr<TensorReferenceGroup>&& gr,
     ScheduleTree* tree,
     isl::union_map schedule,
-    bool forceLastExtentOdd) {
+    size_t padWidth) {
   auto activePoints = activeDomainPoints(scheduleRoot(), tree);
 
   for (const auto& kvp : activePromotions_) {
@@ -208,10 +312,11 @@ void Scop::promoteGroup(
   auto groupId = nextGroupIdForTensor(tensorId);
   insertCopiesUnder(*this, tree, *gr, tensorId, groupId);
   auto sizes = gr->approximationSizes();
-  if (sizes.size() > 0 && forceLastExtentOdd && (sizes.back() % 2) == 0) {
-    sizes.back() += 1;
+  if (sizes.size() > 0) {
+    sizes.back() = paddedExtent(sizes.back(), padWidth);
   }
-  promotedDecls_[groupId] = PromotedDecl{tensorId, sizes, kind};
+  promotedDecls_[groupId] =
+      PromotedDecl{tensorId, sizes, kind, false, 1, gr->layout};
 
   // FIXME: we can now store a unique pointer...
   auto group = std::shared_ptr<TensorReferenceGroup>(std::move(gr));
@@ -227,12 +332,16 @@ void Scop::insertSyncsAroundCopies(ScheduleTree* tree) {
     return;
   }
 
-  // Insert syncs before and after copies (FIXME: this is excessive)
+  // Insert syncs before and after copies, only once between the read copies
+  // and the computation and between the computation and the write copies,
+  // which are absent for written groups without exposed reads and for
+  // read-only groups respectively.
   auto seqNode = tree->child({0, 0});
   CHECK(seqNode->elemAs<detail::ScheduleTreeElemSequence>())
       << "unexpected tree structure";
 
   int foundMainComputations = 0;
+  bool foundWriteCopies = false;
   for (size_t i = 0; i < seqNode->numChildren(); ++i) {
     auto filterNode =
         seqNode->child({i})->elemAs<detail::ScheduleTreeElemFilter>();
@@ -249,6 +358,15 @@ void Scop::insertSyncsAroundCopies(ScheduleTree* tree) {
     }
     CHECK_LT(foundMainComputations, 2)
         << "copies are interleaved with computation" << *seqNode;
+    if (isCopyFilter) {
+      if (foundWriteCopies) {
+        continue;
+      }
+      foundWriteCopies = true;
+    } else if (i == 0) {
+      // No read copies, the leading sync follows.
+      continue;
+    }
     insertSync(seqNode, i);
     ++i;
   }
@@ -256,6 +374,46 @@ void Scop::insertSyncsAroundCopies(ScheduleTree* tree) {
   insertSync(seqNode, seqNode->numChildren());
 }
 
+void Scop::insertDoubleBufferedSyncs(
+    ScheduleTree* tree,
+    const std::vector<isl::id>& groupIds) {
+  // Return immediately if nothing was inserted
+  auto extensionNode =
+      tree->child({0})->elemAs<detail::ScheduleTreeElemExtension>();
+  if (!extensionNode) {
+    return;
+  }
+
+  auto seqNode = tree->child({0, 0});
+  CHECK(seqNode->elemAs<detail::ScheduleTreeElemSequence>())
+      << "unexpected tree structure";
+
+  size_t firstComputation = 0;
+  for (; firstComputation < seqNode->numChildren(); ++firstComputation) {
+    auto filterNode = seqNode->child({firstComputation})
+                          ->elemAs<detail::ScheduleTreeElemFilter>();
+    CHECK(filterNode) << "expected filters below sequence";
+    auto filters = isl::UnionAsVector<isl::union_set>(filterNode->filter_);
+    bool isCopyFilter = filters.size() == 1 && filters[0].has_tuple_name() &&
+        (filters[0].get_tuple_name() == kReadIdName ||
+         filters[0].get_tuple_name() == kWriteIdName);
+    if (!isCopyFilter) {
+      break;
+    }
+    CHECK_EQ(filters[0].get_tuple_name(), kReadIdName)
+        << "cannot double-buffer copies to global memory" << *seqNode;
+  }
+  insertSync(seqNode, firstComputation);
+
+  auto swapId = makeBufferSwapId();
+  bufferSwaps_.emplace(swapId, groupIds);
+  insertExtensionLabelAt(
+      scheduleRoot(), seqNode, seqNode->numChildren(), swapId);
+  for (auto groupId : groupIds) {
+    promotedDecls_.at(groupId).doubleBuffered = true;
+  }
+}
+
 void Scop::promoteEverythingAt(std::vector<size_t> pos) {
   auto root = scheduleRoot();
   auto tree = scheduleRoot()->child(pos);
@@ -329,6 +487,28 @@ isl::set Scop::makeContextFromInputs(
   return paramSet;
 }
 
+void Scop::specializeStridesToInputs(
+    const std::vector<const DLTensor*>& inputs) {
+  CHECK_EQ(halide.inputs.size(), inputs.size());
+  for (size_t i = 0, ei = inputs.size(); i < ei; ++i) {
+    if (!dlutils::isPacked(*inputs[i])) {
+      tensorStrides[halide.inputs[i].name()] = dlutils::getStrides(*inputs[i]);
+    }
+  }
+}
+
+void Scop::specializeStridesToOutputs(
+    const std::vector<const DLTensor*>& outputs) {
+  // The temporaries follow the outputs
+  CHECK_LE(outputs.size(), halide.outputs.size());
+  for (size_t i = 0, ei = outputs.size(); i < ei; ++i) {
+    if (!dlutils::isPacked(*outputs[i])) {
+      tensorStrides[halide.outputs[i].name()] =
+          dlutils::getStrides(*outputs[i]);
+    }
+  }
+}
+
 std::vector<long> Scop::getParameterValues(isl::set context) const {
   IslParamValueMap pvm = extractParamValueMap(context);
 
@@ -352,10 +532,116 @@ std::vector<long> Scop::getParameterValues(isl::set context) const {
   return paramValues;
 }
 
+isl::set Scop::makeParametricContext(
+    isl::set context,
+    const std::unordered_map<std::string, std::pair<long, long>>& ranges)
+    const {
+  std::unordered_map<std::string, long> fixed;
+  for (const auto& kvp : extractParamValueMap(context)) {
+    if (ranges.count(kvp.first.get_name()) == 0) {
+      fixed.emplace(kvp.first.get_name(), kvp.second);
+    }
+  }
+  auto paramSet = makeContext(fixed);
+  auto space = paramSet.get_space();
+  for (const auto& kvp : ranges) {
+    CHECK_GE(kvp.second.first, std::numeric_limits<int>::min())
+        << "range of " << kvp.first << " underflows int";
+    CHECK_LE(kvp.second.second, std::numeric_limits<int>::max())
+        << "range of " << kvp.first << " overflows int";
+    auto id = isl::id(space.get_ctx(), kvp.first);
+    isl::aff affParam(isl::aff::param_on_domain_space(space, id));
+    paramSet = paramSet &
+        (isl::aff_set(affParam) >= static_cast<int>(kvp.second.first)) &
+        (isl::aff_set(affParam) <= static_cast<int>(kvp.second.second));
+  }
+  return paramSet;
+}
+
 namespace {
 
 using namespace tc::polyhedral;
 
+// Printed isl objects, least recently used first.
+// The isl contexts are thread-local, so the objects are stored as strings
+// and parsed again in the context of the thread looking them up.
+// At most FLAGS_schedule_cache_max_entries objects are kept.
+struct IslStringCache {
+  std::mutex mutex;
+  std::list<std::pair<std::string, std::string>> entries;
+  std::unordered_map<
+      std::string,
+      std::list<std::pair<std::string, std::string>>::iterator>
+      index;
+  size_t hits = 0;
+  size_t misses = 0;
+
+  // Copy the string stored under "key" to "value" and return true if there
+  // is one.
+  bool lookup(const std::string& key, std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end()) {
+      ++misses;
+      return false;
+    }
+    ++hits;
+    entries.splice(entries.begin(), entries, it->second);
+    value = it->second->second;
+    return true;
+  }
+
+  void store(const std::string& key, std::string&& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.count(key) > 0) {
+      // Computed concurrently by another thread.
+      return;
+    }
+    entries.emplace_front(key, std::move(value));
+    index.emplace(key, entries.begin());
+    while (entries.size() > FLAGS_schedule_cache_max_entries) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+  Scop::CacheStatistics statistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Scop::CacheStatistics statistics;
+    statistics.size = entries.size();
+    statistics.hits = hits;
+    statistics.misses = misses;
+    return statistics;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    hits = 0;
+    misses = 0;
+  }
+};
+
+// Schedules computed by Scop::makeScheduled.
+IslStringCache& scheduleCache() {
+  static IslStringCache cache;
+  return cache;
+}
+
+// Dependences computed by Scop::makeScheduled and Scop::reschedule.
+IslStringCache& dependenceCache() {
+  static IslStringCache cache;
+  return cache;
+}
+
+std::string toString(char* str) {
+  CHECK(str) << "could not print isl object";
+  std::string res(str);
+  free(str);
+  return res;
+}
+
 isl::union_map computeDependences(
     isl::union_map sources,
     isl::union_map sinks,
@@ -369,25 +655,144 @@ isl::union_map computeDependences(
 
 // Do the simplest possible dependence analysis.
 // Live-range reordering needs tagged access relations to be available.
-// The domain of the constraints is intersected with "restrictDomain" if it is
-// provided.
-isl::schedule_constraints makeScheduleConstraints(
-    const Scop& scop,
-    const SchedulerOptionsView& schedulerOptions,
-    isl::union_set restrictDomain = isl::union_set()) {
+// Any schedule respecting these dependences orders the same pairs of
+// accesses, so they are computed once for the initial schedule and reused
+// by later schedules.  They are looked up in the dependence cache keyed by
+// the printed schedule, which includes the statement instances, and the
+// access relations, so tuning candidates of the same TC and sizes share them.
+isl::union_map computeAllDependences(const Scop& scop) {
+  ScopeTimer timer(compilationTimings().dependences, "tc dependences");
   auto schedule = toIslSchedule(scop.scheduleRoot());
-  auto firstChildNode = scop.scheduleRoot()->child({0});
   auto reads = scop.reads.domain_factor_domain();
   auto writes = scop.writes.domain_factor_domain();
 
+  std::string key;
+  if (FLAGS_schedule_cache_max_entries > 0) {
+    key = toString(isl_schedule_to_str(schedule.get())) + " reads " +
+        toString(isl_union_map_to_str(reads.get())) + " writes " +
+        toString(isl_union_map_to_str(writes.get()));
+    std::string deps;
+    if (dependenceCache().lookup(key, deps)) {
+      return isl::manage(
+          isl_union_map_read_from_str(schedule.get_ctx().get(), deps.c_str()));
+    }
+  }
+
   // RAW
   auto flowDeps = computeDependences(writes, reads, schedule);
   // WAR and WAW
   auto falseDeps = computeDependences(writes.unite(reads), writes, schedule);
 
   auto allDeps = flowDeps.unite(falseDeps).coalesce();
+  if (!key.empty()) {
+    dependenceCache().store(
+        key, toString(isl_union_map_to_str(allDeps.get())));
+  }
+  return allDeps;
+}
+
+using MergeCallback =
+    isl_bool (*)(isl_union_map*, isl_union_map*, int, int, int, void*);
+
+MergeCallback mergeCallback(FusionStrategy fusionStrategy) {
+  if (fusionStrategy == FusionStrategy::Max) {
+    return callbacks::FuseAll;
+  } else if (fusionStrategy == FusionStrategy::Preserve3Coincident) {
+    return callbacks::FuseAllPreserve3Coincident;
+  } else if (fusionStrategy == FusionStrategy::Min) {
+    return callbacks::FuseNone;
+  }
+  throw std::runtime_error{"NYI: unknown fusion strategy requested"};
+}
+
+// The fusion decisions of the scheduler options, the user data of
+// FuseUnlessNeverFused: the pairs of statements that are never merged in
+// the same cluster, by name, and the callback of the fusion strategy, which
+// decides for the other merges.
+struct FusionDecisions {
+  std::vector<std::pair<std::string, std::string>> neverFused;
+  MergeCallback strategy;
+};
+
+FusionDecisions makeFusionDecisions(
+    const Scop& scop,
+    const SchedulerOptionsView& schedulerOptions) {
+  FusionDecisions res;
+  res.strategy = mergeCallback(schedulerOptions.proto.fusion_strategy());
+  std::unordered_map<std::string, std::vector<std::string>> statementsOf;
+  for (const auto& kvp : scop.halide.statements) {
+    if (auto provide = kvp.second.as<Halide::Internal::Provide>()) {
+      statementsOf[provide->name].push_back(kvp.first.get_name());
+    }
+  }
+  for (const auto& pair : schedulerOptions.proto.never_fused()) {
+    LOG_IF(WARNING, !statementsOf.count(pair.first()))
+        << "no statement writes " << pair.first() << " to keep apart";
+    LOG_IF(WARNING, !statementsOf.count(pair.second()))
+        << "no statement writes " << pair.second() << " to keep apart";
+    for (const auto& first : statementsOf[pair.first()]) {
+      for (const auto& second : statementsOf[pair.second()]) {
+        res.neverFused.emplace_back(first, second);
+      }
+    }
+  }
+  return res;
+}
+
+// Merge callback refusing to merge clusters holding a pair of statements
+// that are never fused, user being the FusionDecisions.
+isl_bool FuseUnlessNeverFused(
+    __isl_take isl_union_map* original_schedule,
+    __isl_take isl_union_map* updated_schedule,
+    int n_updated_coincident,
+    int n_original_coincident,
+    int is_along_edge,
+    void* user) {
+  const auto& decisions = *static_cast<const FusionDecisions*>(user);
+  auto domain = isl::manage(
+      isl_union_map_domain(isl_union_map_copy(original_schedule)));
+  std::unordered_set<std::string> statements;
+  for (auto set : isl::UnionAsVector<isl::union_set>(domain)) {
+    statements.insert(set.get_tuple_id().get_name());
+  }
+  for (const auto& pair : decisions.neverFused) {
+    if (statements.count(pair.first) && statements.count(pair.second)) {
+      isl_union_map_free(original_schedule);
+      isl_union_map_free(updated_schedule);
+      return isl_bool_false;
+    }
+  }
+  return decisions.strategy(
+      original_schedule,
+      updated_schedule,
+      n_updated_coincident,
+      n_original_coincident,
+      is_along_edge,
+      nullptr);
+}
+
+// Build the schedule constraints of "scop" from its dependences,
+// which are computed first if needed.
+// The merge callback follows "decisions", which must outlive the
+// computation of the schedule.
+// The domain of the constraints is intersected with "restrictDomain" if it is
+// provided.
+isl::schedule_constraints makeScheduleConstraints(
+    Scop& scop,
+    const SchedulerOptionsView& schedulerOptions,
+    const FusionDecisions& decisions,
+    isl::union_set restrictDomain = isl::union_set()) {
+  if (!scop.dependences) {
+    scop.dependences = computeAllDependences(scop);
+  }
+  auto firstChildNode = scop.scheduleRoot()->child({0});
+  // The statement instances may have been restricted since the dependences
+  // were computed.
+  auto domain = scop.domain();
+  auto allDeps =
+      scop.dependences.intersect_domain(domain).intersect_range(domain);
 
-  auto constraints = isl::schedule_constraints::on_domain(scop.domain())
+  auto constraints = isl::schedule_constraints::on_domain(domain)
                          .set_validity(allDeps)
                          .set_proximity(allDeps)
                          .set_coincidence(allDeps);
@@ -408,30 +813,68 @@ isl::schedule_constraints makeScheduleConstraints(
           sc, callbacks::AddPositiveCoefficientConstraints, nullptr);
     }
   }
-  {
-    auto fusionStrategy = schedulerOptions.proto.fusion_strategy();
-    if (fusionStrategy == FusionStrategy::Max) {
-      sc = isl_schedule_constraints_set_merge_callback(
-          sc, callbacks::FuseAll, nullptr);
-    } else if (fusionStrategy == FusionStrategy::Preserve3Coincident) {
-      sc = isl_schedule_constraints_set_merge_callback(
-          sc, callbacks::FuseAllPreserve3Coincident, nullptr);
-    } else if (fusionStrategy == FusionStrategy::Min) {
-      sc = isl_schedule_constraints_set_merge_callback(
-          sc, callbacks::FuseNone, nullptr);
-    } else {
-      throw std::runtime_error{"NYI: unknown fusion strategy requested"};
-    }
+  if (decisions.neverFused.empty()) {
+    sc = isl_schedule_constraints_set_merge_callback(
+        sc, decisions.strategy, nullptr);
+  } else {
+    sc = isl_schedule_constraints_set_merge_callback(
+        sc, FuseUnlessNeverFused, const_cast<FusionDecisions*>(&decisions));
   }
   constraints = isl::manage(sc);
 
   return constraints;
 }
+
+// The merge callbacks and other isl options are derived from the scheduler
+// options, which complete the printed constraints.
+std::string scheduleCacheKey(
+    isl::schedule_constraints constraints,
+    const SchedulerOptionsView& schedulerOptions) {
+  return schedulerOptions.proto.SerializeAsString() +
+      toString(isl_schedule_constraints_to_str(constraints.get()));
+}
+
+isl::schedule lookupSchedule(isl::ctx ctx, const std::string& key) {
+  std::string schedule;
+  if (!scheduleCache().lookup(key, schedule)) {
+    return isl::schedule();
+  }
+  return isl::manage(isl_schedule_read_from_str(ctx.get(), schedule.c_str()));
+}
+
+void storeSchedule(const std::string& key, isl::schedule schedule) {
+  scheduleCache().store(key, toString(isl_schedule_to_str(schedule.get())));
+}
+
 } // namespace
 
+Scop::CacheStatistics Scop::scheduleCacheStatistics() {
+  return scheduleCache().statistics();
+}
+
+Scop::CacheStatistics Scop::dependenceCacheStatistics() {
+  return dependenceCache().statistics();
+}
+
+void Scop::clearScheduleCache() {
+  scheduleCache().clear();
+  dependenceCache().clear();
+}
+
 std::unique_ptr<detail::ScheduleTree> Scop::computeSchedule(
     isl::schedule_constraints constraints,
-    const SchedulerOptionsView& schedulerOptions) {
+    const SchedulerOptionsView& schedulerOptions,
+    bool useCache) {
+  ScopeTimer timer(compilationTimings().schedule, "tc schedule");
+  std::string key;
+  if (useCache && FLAGS_schedule_cache_max_entries > 0) {
+    key = scheduleCacheKey(constraints, schedulerOptions);
+    auto schedule = lookupSchedule(constraints.get_ctx(), key);
+    if (schedule) {
+      return detail::fromIslSchedule(schedule);
+    }
+  }
+
   auto ctx = constraints.get_ctx();
   auto usedWholeComponent = isl_options_get_schedule_whole_component(ctx.get());
   auto wasSerializingSccs = isl_options_get_schedule_serialize_sccs(ctx.get());
@@ -450,20 +893,110 @@ std::unique_ptr<detail::ScheduleTree> Scop::computeSchedule(
     isl_options_set_schedule_unit_max_var_coefficient_sum(ctx.get(), wasUnit);
   });
 
-  return detail::fromIslSchedule(constraints.compute_schedule());
+  auto schedule = constraints.compute_schedule();
+  if (!key.empty()) {
+    storeSchedule(key, schedule);
+  }
+  return detail::fromIslSchedule(schedule);
 }
 
 std::unique_ptr<Scop> Scop::makeScheduled(
     const Scop& scop,
     const SchedulerOptionsView& schedulerOptions) {
   auto s = makeScop(scop);
-  auto constraints = makeScheduleConstraints(*s, schedulerOptions);
-  s->scheduleTreeUPtr = computeSchedule(constraints, schedulerOptions);
+  auto decisions = makeFusionDecisions(*s, schedulerOptions);
+  auto constraints = makeScheduleConstraints(*s, schedulerOptions, decisions);
+  s->scheduleTreeUPtr = computeSchedule(constraints, schedulerOptions, true);
   LOG_IF(INFO, FLAGS_debug_tc_mapper) << "After scheduling:" << std::endl
                                       << *s->scheduleTreeUPtr;
   return s;
 }
 
+bool Scop::isPointwise() const {
+  if (!halide.reductions.empty()) {
+    return false;
+  }
+  for (auto set : isl::UnionAsVector<isl::union_set>(domain())) {
+    if (set.dim(isl::dim_type::set) == 0) {
+      return false;
+    }
+  }
+  std::unordered_set<isl::id, isl::IslIdIslHash> written;
+  for (auto w : isl::UnionAsVector<isl::union_map>(
+           writes.domain_factor_domain())) {
+    auto tensorId = w.get_tuple_id(isl::dim_type::out);
+    if (written.count(tensorId) != 0 || !w.is_injective()) {
+      return false;
+    }
+    written.insert(tensorId);
+  }
+  for (auto r : isl::UnionAsVector<isl::union_map>(reads)) {
+    if (written.count(r.get_tuple_id(isl::dim_type::out)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<Scop> Scop::makePointwiseScheduled(const Scop& scop) {
+  CHECK(scop.isPointwise()) << "expected a pointwise scop";
+  ScopeTimer timer(compilationTimings().schedule, "tc schedule");
+  auto s = makeScop(scop);
+  isl::schedule schedule;
+  for (auto set : isl::UnionAsVector<isl::union_set>(s->domain())) {
+    auto identity = isl::multi_aff::identity(set.get_space().map_from_set());
+    auto statement = isl::schedule::from_domain(isl::union_set(set))
+                         .insert_partial_schedule(
+                             isl::multi_union_pw_aff(identity));
+    schedule = schedule ? schedule.sequence(statement) : statement;
+  }
+  s->scheduleTreeUPtr = detail::fromIslSchedule(schedule);
+  for (auto tree : detail::ScheduleTree::collect(
+           s->scheduleRoot(), detail::ScheduleTreeType::Band)) {
+    auto band = tree->elemAs<detail::ScheduleTreeElemBand>();
+    band->permutable_ = true;
+    band->coincident_ = std::vector<bool>(band->nMember(), true);
+  }
+  s->dependences = isl::union_map::empty(s->domain().get_space());
+  LOG_IF(INFO, FLAGS_debug_tc_mapper) << "Pointwise schedule:" << std::endl
+                                      << *s->scheduleTreeUPtr;
+  return s;
+}
+
+std::vector<std::unique_ptr<Scop>> Scop::makeSplitAtOuterSequence(
+    const Scop& scop) {
+  using namespace tc::polyhedral::detail;
+  auto root = scop.scheduleRoot();
+  auto tree = root;
+  while (tree->numChildren() == 1 && !tree->elemAs<ScheduleTreeElemBand>()) {
+    tree = tree->child({0});
+  }
+  std::vector<std::unique_ptr<Scop>> res;
+  if (!tree->elemAs<ScheduleTreeElemSequence>() &&
+      !tree->elemAs<ScheduleTreeElemSet>()) {
+    res.push_back(makeScop(scop));
+    return res;
+  }
+
+  auto pos = tree->positionRelativeTo(root);
+  for (size_t i = 0; i < tree->numChildren(); ++i) {
+    auto filter = tree->child({i})->elemAs<ScheduleTreeElemFilter>();
+    CHECK(filter) << "expected filter children of " << *tree;
+    auto part = makeScop(scop);
+    auto sequence = part->scheduleRoot()->child(pos);
+    for (size_t j = sequence->numChildren(); j > 0; --j) {
+      if (j - 1 != i) {
+        sequence->detachChild(j - 1);
+      }
+    }
+    part->domain() = part->domain().intersect(filter->filter_);
+    part->reads = part->reads.intersect_domain(part->domain());
+    part->writes = part->writes.intersect_domain(part->domain());
+    res.push_back(std::move(part));
+  }
+  return res;
+}
+
 namespace {
 
 /*
@@ -532,8 +1065,10 @@ void Scop::reschedule(
 
   // Restrict the constraints to domain points reachable from point loops
   // and update the current prefix.
-  auto constraints = makeScheduleConstraints(*this, schedulerOptions, domain)
-                         .set_prefix(prefix);
+  auto decisions = makeFusionDecisions(*this, schedulerOptions);
+  auto constraints =
+      makeScheduleConstraints(*this, schedulerOptions, decisions, domain)
+          .set_prefix(prefix);
   auto newTree = computeSchedule(constraints, schedulerOptions);
   parentTree->detachChild(treePos);
   parentTree->insertChildren(treePos, newTree->detachChildren());
@@ -559,6 +1094,35 @@ const Halide::OutputImageParam& Scop::findArgument(isl::id id) const {
   return *halide.inputs.begin();
 }
 
+// Find the Halide image corresponding to the given tensorId.  Transform its
+// min() and extent() into parametric isl affs and construct a set where the
+// each dimension of the tensor is contrained by the min_aff on the left and
+// by the min_aff + extent_aff on the right.  Intersect this set with the
+// context of the scop.
+isl::set Scop::tensorElements(isl::id tensorId) const {
+  auto halideParameter = findArgument(tensorId).parameter();
+  auto space = domain().get_space().params();
+  auto nDim = halideParameter.dimensions();
+  space = space.add_dims(isl::dim_type::set, nDim)
+              .set_tuple_id(isl::dim_type::set, tensorId);
+
+  auto tensorElements = isl::set::universe(space);
+  for (int i = 0; i < nDim; ++i) {
+    auto minAff = halide2isl::makeIslAffFromExpr(
+        space, halideParameter.min_constraint(i));
+    auto extentAff = halide2isl::makeIslAffFromExpr(
+        space, halideParameter.extent_constraint(i));
+    auto aff = isl::aff(isl::local_space(space), isl::dim_type::set, i);
+    tensorElements = tensorElements & (minAff <= isl::aff_set(aff)) &
+        (isl::aff_set(aff) < (minAff + extentAff));
+  }
+
+  if (globalParameterContext) {
+    tensorElements = tensorElements.intersect_params(globalParameterContext);
+  }
+  return tensorElements;
+}
+
 isl::aff Scop::makeIslAffFromStmtExpr(
     isl::id stmtId,
     isl::space paramSpace,
@@ -16,9 +16,11 @@
 #pragma once
 
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <dlpack/dlpack.h>
@@ -40,6 +42,12 @@ class TensorReferenceGroup;
 
 class MappedScop;
 
+// Return "extent" rounded up to an odd multiple of "padWidth", or "extent"
+// itself if "padWidth" is zero.  Padding the rows of a shared memory array to
+// an odd number of "padWidth"-element words shifts consecutive rows to
+// different memory banks.
+size_t paddedExtent(size_t extent, size_t padWidth);
+
 struct Scop {
  private:
   Scop() {}
@@ -67,13 +75,19 @@ struct Scop {
     res->halide = scop.halide;
     res->reads = scop.reads;
     res->writes = scop.writes;
+    res->dependences = scop.dependences;
+    res->tensorStrides = scop.tensorStrides;
+    res->constantInputs = scop.constantInputs;
     res->scheduleTreeUPtr =
         detail::ScheduleTree::makeScheduleTree(*scop.scheduleTreeUPtr);
     res->treeSyncUpdateMap = scop.treeSyncUpdateMap;
     res->defaultReductionInitMap = scop.defaultReductionInitMap;
+    res->atomicUpdates = scop.atomicUpdates;
+    res->treeSyncsAlongXY = scop.treeSyncsAlongXY;
     res->groupCounts_ = scop.groupCounts_;
     res->promotedDecls_ = scop.promotedDecls_;
     res->activePromotions_ = scop.activePromotions_;
+    res->bufferSwaps_ = scop.bufferSwaps_;
     return res;
   }
 
@@ -144,6 +158,13 @@ struct Scop {
   isl::set makeContextFromInputs(
       const std::vector<const DLTensor*>& inputs) const;
 
+  // Record the strides of the inputs that are not packed in tensorStrides,
+  // specializing the generated code for them.
+  void specializeStridesToInputs(const std::vector<const DLTensor*>& inputs);
+  // Same for the outputs, e.g. views of the slices of a larger tensor the
+  // kernels write in place.
+  void specializeStridesToOutputs(const std::vector<const DLTensor*>& outputs);
+
   // Fix the values of the specified parameters in the context
   // to the corresponding specified values.
   template <typename T>
@@ -156,6 +177,15 @@ struct Scop {
   // order of scop.params.
   std::vector<long> getParameterValues(isl::set context) const;
 
+  // Given a context fixing all parameters, e.g. built by
+  // makeContextFromInputs, return a context in which the parameters named in
+  // ranges take any value in their (inclusive) range while the other ones
+  // keep their value.
+  isl::set makeParametricContext(
+      isl::set context,
+      const std::unordered_map<std::string, std::pair<long, long>>& ranges)
+      const;
+
   isl::id nextGroupIdForTensor(isl::id tensorId) {
     auto ctx = domain().get_ctx();
     std::stringstream ss;
@@ -201,6 +231,17 @@ struct Scop {
     insertExtensionLabelAfter(scheduleRoot(), tree, makeSyncId());
   }
 
+  // Same as insertSync for a synchronization of the threads of each warp
+  // only.
+  void insertWarpSync(detail::ScheduleTree* seqNode, size_t pos);
+  void insertWarpSyncAfter(detail::ScheduleTree* tree) {
+    insertExtensionLabelAfter(scheduleRoot(), tree, makeWarpSyncId());
+  }
+
+  // Remove the synchronization (of either kind) at position "pos" of the
+  // given sequence node.
+  void removeSync(detail::ScheduleTree* seqNode, size_t pos);
+
   size_t reductionUID() const {
     static size_t count = 0;
     return count++;
@@ -215,18 +256,34 @@ struct Scop {
     return isl::id(ctx, std::string(kSyncIdPrefix) + std::to_string(syncUID()));
   }
 
+  isl::id makeWarpSyncId() const {
+    auto ctx = domain().get_ctx();
+    return isl::id(
+        ctx, std::string(kWarpSyncIdPrefix) + std::to_string(syncUID()));
+  }
+
+  isl::id makeBufferSwapId() const {
+    static size_t count = 0;
+    auto ctx = domain().get_ctx();
+    return isl::id(
+        ctx, std::string(kBufferSwapIdPrefix) + std::to_string(count++));
+  }
+
+  bool isBufferSwapId(isl::id id) const {
+    return bufferSwaps_.count(id) == 1;
+  }
+
+  // Double-buffered promoted arrays swapped by a buffer swap statement.
+  const std::vector<isl::id>& bufferSwapGroups(isl::id swapId) const {
+    return bufferSwaps_.at(swapId);
+  }
+
   static bool isSyncId(isl::id id) {
-    auto name = id.get_name();
-    if (name.find(kSyncIdPrefix) != 0) {
-      return false;
-    }
-    name = name.substr(std::string(kSyncIdPrefix).size());
-    char* end;
-    std::strtol(name.c_str(), &end, 10);
-    if (end - name.c_str() != name.size()) {
-      return false;
-    }
-    return true;
+    return isNumberedId(id, kSyncIdPrefix);
+  }
+
+  static bool isWarpSyncId(isl::id id) {
+    return isNumberedId(id, kWarpSyncIdPrefix);
   }
 
   static isl::id makeRefId(isl::ctx ctx) {
@@ -280,6 +337,18 @@ struct Scop {
     return false;
   }
 
+  // Is tensor "tensorId" written by any of the atomicUpdates statements?
+  // Such tensors must stay in global memory.
+  bool isAtomicallyUpdated(isl::id tensorId) const {
+    for (const auto& id : atomicUpdates) {
+      auto provide = halide.statements.at(id).as<Halide::Internal::Provide>();
+      if (provide->name == tensorId.get_name()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   size_t reductionUpdatePos(isl::id id) const {
     size_t pos = 0;
     CHECK(isReductionUpdate(id));
@@ -300,6 +369,15 @@ struct Scop {
     isl::id tensorId;
     std::vector<size_t> sizes;
     Kind kind;
+    // Two buffers of the given sizes are allocated, the promoted array
+    // alternates between them at each buffer swap statement of its group.
+    bool doubleBuffered;
+    // Each instance of the read copy statement of the group copies this many
+    // consecutive elements along the last dimension with a single vector
+    // access.
+    size_t readVectorWidth;
+    // See TensorReferenceGroup::layout.
+    std::vector<size_t> layout;
   };
 
   struct PromotionInfo {
@@ -326,10 +404,59 @@ struct Scop {
     return scheduleTreeUPtr.get();
   }
 
+  // Replace the schedule tree, e.g. by one restored with
+  // detail::fromProtobuf, which must schedule the statements of the Scop.
+  void setScheduleTree(std::unique_ptr<detail::ScheduleTree>&& tree) {
+    CHECK(tree->elemAs<detail::ScheduleTreeElemDomain>())
+        << "the root of a schedule tree must be a domain";
+    scheduleTreeUPtr = std::move(tree);
+  }
+
   // Create a Scop scheduled with a given scheduling strategy.
+  // The schedules are cached, keyed by the schedule constraints, which
+  // capture the statements, their dependences and the sizes fixed before
+  // scheduling, and by the scheduler options.  Mapping options that only
+  // differ in tiling, mapping or promotion therefore call the isl scheduler
+  // once.  At most FLAGS_schedule_cache_max_entries schedules are kept, least
+  // recently used first evicted, 0 disables the cache.
   static std::unique_ptr<Scop> makeScheduled(
       const Scop& scop,
       const SchedulerOptionsView& schedulerOptions);
+
+  // Is every statement an elementwise, e.g. activation, bias add or copy,
+  // computation?  That is, no statement is a reduction, each tensor is
+  // written by a single statement at distinct elements for distinct
+  // instances and only tensors that are not written are read.  There are
+  // therefore no dependences between the statement instances.
+  bool isPointwise() const;
+
+  // Create a Scop scheduled without calling the isl scheduler nor computing
+  // the dependences, for Scops that are pointwise.  Each statement gets a
+  // permutable band of coincident members iterating over its domain, in the
+  // order of the loops of the TC, and the statements are in a sequence.
+  static std::unique_ptr<Scop> makePointwiseScheduled(const Scop& scop);
+
+  // Split a scheduled Scop at the outermost sequence or set node, reached
+  // from the root through nodes that are not bands and have a single child.
+  // Return one Scop per child of that node, in order, restricted to the
+  // statement instances the child filters, e.g. to generate one kernel per
+  // group of statements that scheduling did not fuse.  Return a single clone
+  // of "scop" if there is no such node.
+  static std::vector<std::unique_ptr<Scop>> makeSplitAtOuterSequence(
+      const Scop& scop);
+
+  struct CacheStatistics {
+    size_t size = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+  };
+  static CacheStatistics scheduleCacheStatistics();
+  // The dependences are cached as well, keyed by the statements, their
+  // accesses and their initial schedule, with the same maximal number of
+  // entries.
+  static CacheStatistics dependenceCacheStatistics();
+  // Clear both the schedule and the dependence caches.
+  static void clearScheduleCache();
   // Tile the outermost band.
   // Splits the band into tile loop band and point loop band where point loops
   // have fixed trip counts specified in "tiling", and returns a pointer to the
@@ -346,6 +473,11 @@ struct Scop {
   // Assumes such argument exists.
   const Halide::OutputImageParam& findArgument(isl::id id) const;
 
+  // The set of all elements of the input or output argument "tensorId",
+  // as bounded by the min() and extent() of its Halide parameter and by
+  // the global parameter context.
+  isl::set tensorElements(isl::id tensorId) const;
+
   // Make an affine function from a Halide Expr that is defined
   // over the instance set of the statement with identifier "stmtId" and
   // with parameters specified by "paramSpace".  Return a
@@ -367,16 +499,16 @@ struct Scop {
   // charge of inserting the synchronization nodes.
   //
   // Creates the promoted array declaration in the internal list.
-  // If "forceLastExtentOdd" is set, the last extent in the declaration is
-  // incremented if it is even.  This serves as a simple heuristic to reduce
-  // shared memory bank conflicts.
+  // If "padWidth" is non-zero, the last extent in the declaration is padded
+  // to an odd multiple of "padWidth" (see paddedExtent).  This serves as a
+  // simple heuristic to reduce shared memory bank conflicts.
   void promoteGroup(
       PromotedDecl::Kind kind,
       isl::id tensorId,
       std::unique_ptr<TensorReferenceGroup>&& gr,
       detail::ScheduleTree* tree,
       isl::union_map schedule,
-      bool forceLastExtentOdd = false);
+      size_t padWidth = 0);
 
   // Given a tree node under which the promotion copy statements were
   // introduced, insert syncthread statements before and after the copies.
@@ -398,14 +530,64 @@ struct Scop {
   //
   void insertSyncsAroundCopies(detail::ScheduleTree* tree);
 
+  // Same as insertSyncsAroundCopies for a tree under which only copies to
+  // the double-buffered groups "groupIds" were introduced.  Each execution of
+  // the copies fills the other buffer of these groups, so only the sync
+  // between the copies and the computation is needed, and a buffer swap
+  // statement is appended instead of the other syncs:
+  //   any(
+  //     extension(
+  //       sequence(
+  //         filter(any()), // filters that refer to read
+  //         ...
+  //         // <-- sync will be inserted here
+  //         filter(any()), // filters that do not refer to read/write
+  //         ...
+  //         // <-- buffer swap will be inserted here
+  //         )))
+  void insertDoubleBufferedSyncs(
+      detail::ScheduleTree* tree,
+      const std::vector<isl::id>& groupIds);
+
+  // Record that the read copies of the promoted group "groupId" were
+  // restricted to every "width"-th element along the last dimension, each
+  // instance copying "width" elements at once.
+  void vectorizeReads(isl::id groupId, size_t width) {
+    promotedDecls_.at(groupId).readVectorWidth = width;
+  }
+
  private:
+  // Whether the name of "id" is "prefix" followed by a number.
+  static bool isNumberedId(isl::id id, const std::string& prefix) {
+    auto name = id.get_name();
+    if (name.find(prefix) != 0) {
+      return false;
+    }
+    name = name.substr(prefix.size());
+    char* end;
+    std::strtol(name.c_str(), &end, 10);
+    if (end - name.c_str() != name.size()) {
+      return false;
+    }
+    return true;
+  }
+
   // Compute a schedule satisfying the given schedule constraints and
   // taking into account the scheduler options.
   // Note that some of the scheduler options have already been
   // taken into account during the construction of the schedule constraints.
+  // If useCache is set, the schedule is looked up in and stored into the
+  // schedule cache.  The constraints must then be fully described by their
+  // isl string representation and the scheduler options.
   static std::unique_ptr<detail::ScheduleTree> computeSchedule(
       isl::schedule_constraints constraints,
-      const SchedulerOptionsView& schedulerOptions);
+      const SchedulerOptionsView& schedulerOptions,
+      bool useCache = false);
+
+  // Restrict the accesses with data-dependent subscripts, which halide2isl
+  // leaves unconstrained along those subscripts, to the elements of
+  // the accessed tensors.
+  void boundIndirectAccesses();
 
  public:
   // Halide stuff
@@ -413,10 +595,19 @@ struct Scop {
     std::vector<Halide::Internal::Parameter> params;
     std::vector<std::string> idx, reductionIdx;
     std::vector<Halide::ImageParam> inputs;
+    // The outputs followed by the temporaries, which are outputs of the
+    // kernels.
     std::vector<Halide::OutputImageParam> outputs;
+    // The inputs the outputs may share their storage with, by name of the
+    // output.  The kernels must not assume the arguments of such a pair do
+    // not alias.
+    std::map<std::string, std::string> aliases;
     std::vector<halide2isl::Reduction> reductions;
     std::unordered_map<isl::id, Halide::Internal::Stmt, isl::IslIdIslHash>
         statements;
+    // The source ranges of the TC comprehensions the statements compute.
+    std::unordered_map<isl::id, lang::SourceRange, isl::IslIdIslHash>
+        sourceRanges;
     std::unordered_map<const Halide::Internal::IRNode*, isl::id> accesses;
     halide2isl::IteratorMap iterators;
   } halide;
@@ -444,6 +635,23 @@ struct Scop {
 
   isl::union_map reads;
   isl::union_map writes;
+  // Flow, anti and output dependences between the statement instances,
+  // computed when first scheduling the Scop and kept by its copies, so that
+  // rescheduling reuses them.  They may cover instances that are no longer
+  // part of the domain.
+  isl::union_map dependences;
+
+  // Strides, in elements, of the tensors that are not laid out row-major
+  // packed, e.g. views of larger tensors, by tensor name.  Code generation
+  // addresses these tensors through their strides, the others through their
+  // sizes.
+  std::unordered_map<std::string, std::vector<int64_t>> tensorStrides;
+
+  // The values of the inputs baked into the generated code, by input name,
+  // as the initializer of an array of their elements in row-major order
+  // (see CudaMappingOptionsProto::constant_inputs).  The kernels read these
+  // inputs from arrays in constant memory instead of their arguments.
+  std::unordered_map<std::string, std::string> constantInputs;
 
  private:
   // By analogy with generalized functions, a ScheduleTree is a (piecewise
@@ -459,6 +667,12 @@ struct Scop {
   std::unordered_map<isl::id, isl::id, isl::IslIdIslHash> treeSyncUpdateMap;
   std::unordered_map<isl::id, isl::id, isl::IslIdIslHash>
       defaultReductionInitMap; // treeSyncId -> defaultInitId
+  // Update statements of the reductions split across blocks, emitted as
+  // atomic additions to an output that is zeroed before the launch.
+  std::unordered_set<isl::id, isl::IslIdIslHash> atomicUpdates;
+  // Tree synchronizations of the reductions of two loops mapped to
+  // threadIdx.x and threadIdx.y, which reduce along both.
+  std::unordered_set<isl::id, isl::IslIdIslHash> treeSyncsAlongXY;
 
  private:
   // Memory promotion stuff
@@ -470,6 +684,9 @@ struct Scop {
   // Note that domain is a non-unique key, i.e. multiple groups can be listed
   // for the same domain, or for partially intersecting domains.
   std::vector<std::pair<isl::union_set, PromotionInfo>> activePromotions_;
+  // buffer swap statement id -> groupIds of the arrays it swaps
+  std::unordered_map<isl::id, std::vector<isl::id>, isl::IslIdIslHash>
+      bufferSwaps_;
 };
 
 std::ostream& operator<<(std::ostream& os, const Scop&);
@@ -16,6 +16,11 @@
 
 #include "tc/core/polyhedral/unroll.h"
 
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "tc/core/flags.h"
 #include "tc/core/polyhedral/schedule_transforms.h"
 #include "tc/core/polyhedral/schedule_tree.h"
 
@@ -169,19 +174,84 @@ isl::val boundInstancesAndMarkUnroll(
 
   return bound;
 }
+
+/*
+ * Compute the number of statements emitted for "st" given the marks
+ * of the band members in its subtree.
+ * "prefix" is the schedule defined by the ancestors.
+ *
+ * A leaf is emitted once.  The children of "st" are emitted one after
+ * the other and, if "st" is a band node, the code of its children is copied
+ * once for each value of every unrolled member, the number of values
+ * being bounded as in boundInstancesAndMarkUnroll.
+ */
+isl::val emittedStatements(detail::ScheduleTree* st, isl::union_map prefix) {
+  auto ctx = st->ctx_;
+  auto count = isl::val::one(ctx);
+  if (st->children().size() != 0) {
+    auto childPrefix = extendSchedule(st, prefix);
+    count = isl::val::zero(ctx);
+    for (const auto& c : st->children()) {
+      count = count.add(emittedStatements(c, childPrefix));
+    }
+  }
+
+  auto band = st->elemAs<detail::ScheduleTreeElemBand>();
+  if (!band) {
+    return count;
+  }
+  auto partial = band->mupa_;
+  auto n = band->nMember();
+  for (size_t i = 0; i < n; ++i) {
+    if (!band->unroll_[i]) {
+      continue;
+    }
+    auto outerMap = prefix;
+    if (i > 0) {
+      auto outer = partial.drop_dims(isl::dim_type::set, i, n - i);
+      outerMap = outerMap.flat_range_product(isl::union_map::from(outer));
+    }
+    count = count.mul(relativeRange(outerMap, partial.get_union_pw_aff(i)));
+  }
+  return count;
+}
 } // namespace
 
 void markUnroll(
     detail::ScheduleTree* root,
     detail::ScheduleTree* st,
-    uint64_t unroll) {
+    uint64_t unroll,
+    uint64_t maxStatements) {
   if (unroll <= 1) {
     return;
   }
 
-  auto unrollVal = isl::val(st->ctx_, unroll);
   auto prefix = prefixSchedule(root, st);
-  boundInstancesAndMarkUnroll(st, prefix, unrollVal);
+  // The marks left by previous calls, restored before backing off.
+  auto bands =
+      detail::ScheduleTree::collect(st, detail::ScheduleTreeType::Band);
+  std::vector<std::vector<bool>> marks;
+  for (auto b : bands) {
+    marks.push_back(b->elemAs<detail::ScheduleTreeElemBand>()->unroll_);
+  }
+  auto maxVal = isl::val(st->ctx_, maxStatements);
+
+  while (true) {
+    boundInstancesAndMarkUnroll(st, prefix, isl::val(st->ctx_, unroll));
+    if (maxStatements == 0 || emittedStatements(st, prefix).le(maxVal)) {
+      return;
+    }
+    for (size_t i = 0; i < bands.size(); ++i) {
+      bands[i]->elemAs<detail::ScheduleTreeElemBand>()->unroll_ = marks[i];
+    }
+    unroll /= 2;
+    LOG_IF(INFO, FLAGS_debug_tc_mapper)
+        << "more than " << maxStatements
+        << " statements, unrolling by at most " << unroll;
+    if (unroll <= 1) {
+      return;
+    }
+  }
 }
 } // namespace polyhedral
 } // namespace tc
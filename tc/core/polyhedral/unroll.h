@@ -33,11 +33,17 @@ namespace polyhedral {
  * The prefix schedule is therefore computed first,
  * taking into account the actual set of statement instances and
  * the filters along the path from "root" to "st".
+ *
+ * If "maxStatements" is not zero, the unroll value is halved, and
+ * the marking redone, as long as the number of statements emitted
+ * for "st", each leaf being copied once for every combination
+ * of values of the unrolled members above it, exceeds "maxStatements".
  */
 void markUnroll(
     detail::ScheduleTree* root,
     detail::ScheduleTree* st,
-    uint64_t unroll);
+    uint64_t unroll,
+    uint64_t maxStatements = 0);
 
 } // namespace polyhedral
 } // namespace tc
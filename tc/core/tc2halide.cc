@@ -13,10 +13,18 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
 #include <glog/logging.h>
 
 #include "tc/core/flags.h"
 #include "tc/core/tc2halide.h"
+#include "tc/lang/parse_cache.h"
 #include "tc/lang/parser.h"
 #include "tc/lang/sema.h"
 
@@ -56,6 +64,8 @@ Type translateScalarType(int tcType) {
       return Float(32);
     case lang::TK_DOUBLE:
       return Float(64);
+    case lang::TK_FLOAT16:
+      return Float(16);
     default:
       LOG(FATAL) << "Unhandled TC scalar type: " << tcType << '\n';
       return Type();
@@ -496,6 +506,7 @@ void translateComprehension(
     const lang::Comprehension& c,
     const map<string, Parameter>& params,
     bool throwWarnings,
+    bool naiveSchedule,
     map<string, Function>* funcs,
     FunctionBounds* bounds,
     vector<Function>* reductions) {
@@ -532,6 +543,21 @@ void translateComprehension(
 
   Expr rhs = translateExpr(c.rhs(), params, *funcs, lets);
 
+  // The indices of the lhs bound by a let are the indices of a scatter: the
+  // update reduces into the elements selected by their bindings, over the
+  // other indices, while the initialization covers their whole range.
+  vector<Var> pureLhs;
+  bool scatter = false;
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    auto let = lets.find(lhs[i].name());
+    if (let != lets.end()) {
+      lhs_as_exprs[i] = let->second;
+      scatter = true;
+    } else {
+      pureLhs.push_back(lhs[i]);
+    }
+  }
+
   std::vector<Expr> all_exprs;
   for (auto wc : c.whereClauses()) {
     if (wc->kind() == lang::TK_EXISTS) {
@@ -540,6 +566,62 @@ void translateComprehension(
     }
   }
 
+  // The constraints between indices, e.g., j <= i, are the predicate of
+  // the reduction domain.  Halide lowers it to a condition around the
+  // update, which halide2isl turns into constraints of the iteration domain,
+  // so the polyhedral layer only schedules the instances that satisfy it.
+  Expr constraints;
+  for (auto wc : c.whereClauses()) {
+    if (wc->kind() == lang::TK_CONSTRAINT) {
+      auto e = translateExpr(lang::Constraint(wc).exp(), params, *funcs, lets);
+      constraints = constraints.defined() ? (constraints && e) : e;
+    }
+  }
+
+  // A ragged range "k in l:r:m" iterates over k in 0:m, the polyhedral
+  // layer only sees this rectangular range, and k is replaced by l + k in
+  // the instances where k < r - l.  The others contribute the identity of
+  // the reduction and read nothing: the guard is an if_then_else, which
+  // the backends only evaluate on one side.
+  Expr raggedGuard;
+  for (auto wc : c.whereClauses()) {
+    if (wc->kind() != lang::TK_RANGE_CONSTRAINT ||
+        !lang::RangeConstraint(wc).ragged()) {
+      continue;
+    }
+    auto constraint = lang::RangeConstraint(wc);
+    auto name = constraint.ident().name();
+    if (constraints.defined() && expr_uses_var(constraints, name)) {
+      throw lang::ErrorReport(wc)
+          << "ragged index " << name << " cannot be used in a constraint";
+    }
+    Expr start =
+        cast<int>(translateExpr(constraint.start(), params, *funcs, lets));
+    Expr end = cast<int>(translateExpr(constraint.end(), params, *funcs, lets));
+    Expr k = Var(name);
+    Expr inRange = k < end - start;
+    Expr shifted = Call::make(
+        Int(32), Call::if_then_else, {inRange, start + k, 0}, Call::Intrinsic);
+    rhs = substitute(name, shifted, rhs);
+    for (auto& exp : all_exprs) {
+      exp = substitute(name, shifted, exp);
+    }
+    for (auto& exp : lhs_as_exprs) {
+      exp = substitute(name, shifted, exp);
+    }
+    raggedGuard = raggedGuard.defined() ? (raggedGuard && inRange) : inRange;
+  }
+  auto guarded = [&](const Expr& identity) -> Expr {
+    if (!raggedGuard.defined()) {
+      return rhs;
+    }
+    return Call::make(
+        rhs.type(),
+        Call::if_then_else,
+        {raggedGuard, rhs, identity},
+        Call::Intrinsic);
+  };
+
   // Halide doesn't have first-class reductions. We map reductions to recursion.
   bool added_implicit_initialization = false;
 
@@ -562,28 +644,28 @@ void translateComprehension(
       should_zero = true; // fallthrough
     case lang::TK_PLUS_EQ:
       setupIdentity(make_zero(rhs.type()), should_zero);
-      rhs = func(lhs) + rhs;
+      rhs = func(lhs_as_exprs) + guarded(make_zero(rhs.type()));
       break;
 
     case lang::TK_TIMES_EQ_B:
       should_zero = true; // fallthrough
     case lang::TK_TIMES_EQ:
       setupIdentity(make_one(rhs.type()), should_zero);
-      rhs = func(lhs) * rhs;
+      rhs = func(lhs_as_exprs) * guarded(make_one(rhs.type()));
       break;
 
     case lang::TK_MIN_EQ_B:
       should_zero = true; // fallthrough
     case lang::TK_MIN_EQ:
       setupIdentity(rhs.type().max(), should_zero);
-      rhs = min(func(lhs), rhs);
+      rhs = min(func(lhs_as_exprs), guarded(rhs.type().max()));
       break;
 
     case lang::TK_MAX_EQ_B:
       should_zero = true; // fallthrough
     case lang::TK_MAX_EQ:
       setupIdentity(rhs.type().min(), should_zero);
-      rhs = max(func(lhs), rhs);
+      rhs = max(func(lhs_as_exprs), guarded(rhs.type().min()));
       break;
 
     case '=':
@@ -618,9 +700,9 @@ void translateComprehension(
   for (auto& exp : all_exprs) {
     exp = bindParams.mutate(exp);
   }
-
-  // TODO: When the LHS incorporates general expressions we'll need to
-  // bind params there too.
+  for (auto& exp : lhs_as_exprs) {
+    exp = bindParams.mutate(exp);
+  }
 
   // Do forward bounds inference -- construct an expression that says
   // this expression never reads out of bounds on its inputs, and
@@ -638,8 +720,14 @@ void translateComprehension(
       continue;
     auto constraint = lang::RangeConstraint(constraint_);
     Interval i;
-    i.min = translateExpr(constraint.start(), params, *funcs, lets);
-    i.max = translateExpr(constraint.end(), params, *funcs, lets) - 1;
+    if (constraint.ragged()) {
+      i.min = 0;
+      auto maxLength = constraint.maxLength().get();
+      i.max = translateExpr(maxLength, params, *funcs, lets) - 1;
+    } else {
+      i.min = translateExpr(constraint.start(), params, *funcs, lets);
+      i.max = translateExpr(constraint.end(), params, *funcs, lets) - 1;
+    }
 
     // TODO: In the future we'll want to make any non-trivial bounds
     // into hidden scalar parameters, and just pass variables to the
@@ -682,7 +770,15 @@ void translateComprehension(
   // is currently in the order found, from left to right. This means
   // reordering the expression can change the result for
   // non-commutative reductions.
-  vector<const Variable*> unbound = unboundVariables(lhs, rhs);
+  vector<const Variable*> unbound = unboundVariables(pureLhs, rhs);
+  if (constraints.defined()) {
+    for (auto v : unboundVariables(pureLhs, constraints)) {
+      auto sameName = [v](const Variable* u) { return u->name == v->name; };
+      if (std::none_of(unbound.begin(), unbound.end(), sameName)) {
+        unbound.push_back(v);
+      }
+    }
+  }
   RDom rdom;
   if (!unbound.empty()) {
     vector<ReductionVariable> rVars;
@@ -703,11 +799,23 @@ void translateComprehension(
     for (auto v : unbound) {
       Expr rv = Variable::make(Int(32), v->name, domain);
       rhs = substitute(v->name, rv, rhs);
+      for (auto& exp : lhs_as_exprs) {
+        exp = substitute(v->name, rv, exp);
+      }
+      if (constraints.defined()) {
+        constraints = substitute(v->name, rv, constraints);
+      }
     }
     rdom = RDom(domain);
+    if (constraints.defined()) {
+      rdom.where(constraints);
+    }
   }
 
-  Stage stage{func(lhs) = rhs};
+  Stage stage{scatter ? (func(lhs_as_exprs) = rhs) : (func(lhs) = rhs)};
+  if (!naiveSchedule) {
+    return;
+  }
 
   // Use the simplest possible Halide schedule, but reorder the loop
   // indices to match TC convention.
@@ -717,9 +825,9 @@ void translateComprehension(
       loop_nest.push_back(rdom[i]);
     }
   }
-  while (!lhs.empty()) {
-    loop_nest.push_back(lhs.back());
-    lhs.pop_back();
+  while (!pureLhs.empty()) {
+    loop_nest.push_back(pureLhs.back());
+    pureLhs.pop_back();
   }
 
   if (added_implicit_initialization) {
@@ -737,7 +845,127 @@ void translateComprehension(
   stage.reorder(loop_nest);
 }
 
-HalideComponents translateDef(const lang::Def& def, bool throwWarnings) {
+// Rewrites the idioms the simplifier leaves to the backend compilers:
+// floating-point divisions by (moderate) powers of two are multiplications
+// by their inverse, which are exact.  Neither log(exp(x)) nor exp(log(x)) is
+// rewritten to x, they differ from x when exp overflows or x is negative.
+class RewriteIdioms : public IRMutator2 {
+  using IRMutator2::visit;
+
+  Expr visit(const Div* op) {
+    auto b = op->b.as<FloatImm>();
+    int exponent;
+    if (op->type.is_float() && b && b->value != 0 &&
+        std::fabs(std::frexp(b->value, &exponent)) == 0.5 &&
+        std::abs(exponent) < 64) {
+      return mutate(op->a) * make_const(op->type, 1.0 / b->value);
+    }
+    return IRMutator2::visit(op);
+  }
+};
+
+// Binds the common floating-point subexpressions of "e", e.g., repeated
+// reads of the same tensor element, to Let expressions so that they are
+// evaluated once.  Other common subexpressions are substituted back: the
+// polyhedral layer needs the subscripts and conditions as they are.
+// Conditional expressions, i.e., Select nodes and the if_then_else calls of
+// TC ternaries, are left alone, a Let would evaluate the reads of both
+// branches.
+Expr eliminateCommonSubexpressions(const Expr& e) {
+  class FindSelect : public IRVisitor {
+    using IRVisitor::visit;
+    void visit(const Select* op) {
+      found = true;
+    }
+    void visit(const Call* op) {
+      found = found || op->is_intrinsic(Call::if_then_else);
+      IRVisitor::visit(op);
+    }
+
+   public:
+    bool found = false;
+  } finder;
+  e.accept(&finder);
+  if (finder.found) {
+    return e;
+  }
+
+  class Lets : public IRMutator2 {
+    using IRMutator2::visit;
+    Expr visit(const Let* op) {
+      auto value = mutate(op->value);
+      if (!value.type().is_float()) {
+        return mutate(substitute(op->name, value, op->body));
+      }
+      // Halide's names may clash with the ones the backends emit.
+      auto name = "_tc_cse" + std::to_string(count++);
+      auto body = substitute(
+          op->name, Variable::make(value.type(), name), op->body);
+      return Let::make(name, value, mutate(body));
+    }
+    size_t count = 0;
+  } lets;
+  return lets.mutate(common_subexpression_elimination(e));
+}
+
+// Simplifies the values of the Provide nodes and eliminates their common
+// subexpressions.  The reduction markers and the recursive call of
+// a reduction update are kept at the root, where the reduction detection
+// expects them.
+class SimplifyValues : public IRMutator2 {
+  using IRMutator2::visit;
+
+  template <typename T>
+  static Expr simplifyOperands(const T* op, const string& tensor) {
+    auto isRecursive = [&tensor](const Expr& e) {
+      auto call = e.as<Call>();
+      return call && call->name == tensor;
+    };
+    if (isRecursive(op->a)) {
+      return T::make(op->a, eliminateCommonSubexpressions(op->b));
+    }
+    if (isRecursive(op->b)) {
+      return T::make(eliminateCommonSubexpressions(op->a), op->b);
+    }
+    return Expr();
+  }
+
+  static Expr simplifyValue(Expr e, const string& tensor) {
+    if (auto call = e.as<Call>()) {
+      if (call->is_intrinsic(kReductionInit)) {
+        return reductionInit(simplifyValue(call->args[0], tensor));
+      }
+      if (call->is_intrinsic(kReductionUpdate)) {
+        return reductionUpdate(simplifyValue(call->args[0], tensor));
+      }
+    }
+    e = simplify(RewriteIdioms().mutate(e));
+    Expr result;
+    if (auto op = e.as<Add>()) {
+      result = simplifyOperands(op, tensor);
+    } else if (auto op = e.as<Mul>()) {
+      result = simplifyOperands(op, tensor);
+    } else if (auto op = e.as<Min>()) {
+      result = simplifyOperands(op, tensor);
+    } else if (auto op = e.as<Max>()) {
+      result = simplifyOperands(op, tensor);
+    }
+    return result.defined() ? result : eliminateCommonSubexpressions(e);
+  }
+
+  Stmt visit(const Provide* op) {
+    vector<Expr> values;
+    for (const auto& value : op->values) {
+      values.push_back(simplifyValue(value, op->name));
+    }
+    return Provide::make(op->name, values, op->args);
+  }
+};
+
+HalideComponents translateDef(
+    const lang::Def& def,
+    bool throwWarnings,
+    bool inlinePointwiseTemporaries) {
   map<string, Function> funcs;
   HalideComponents components;
   components.def = def;
@@ -747,20 +975,75 @@ HalideComponents translateDef(const lang::Def& def, bool throwWarnings) {
   for (auto p : def.params()) {
     translateParam(p, &components.params, &components.inputs);
   }
+  // The definitions of the Funcs are lowered into a Provide node each, in
+  // order, except the undefined initializations of the reductions without
+  // one ("+=" of a new tensor), which remove_undef drops.
+  auto numberDefinitions = [&funcs](const string& name) -> size_t {
+    auto it = funcs.find(name);
+    if (it == funcs.end()) {
+      return 0;
+    }
+    return it->second.updates().size() +
+        (it->second.has_pure_definition() ? 1 : 0);
+  };
   for (auto c : def.statements()) {
+    auto name = c.ident().name();
+    auto before = numberDefinitions(name);
     translateComprehension(
-        c, components.params, throwWarnings, &funcs, &bounds, &reductions);
+        c,
+        components.params,
+        throwWarnings,
+        true,
+        &funcs,
+        &bounds,
+        &reductions);
+    auto provides = numberDefinitions(name) - before;
+    auto kind = c.assignment()->kind();
+    if (provides > 1 && kind != lang::TK_PLUS_EQ_B &&
+        kind != lang::TK_TIMES_EQ_B && kind != lang::TK_MIN_EQ_B &&
+        kind != lang::TK_MAX_EQ_B) {
+      --provides;
+    }
+    auto& ranges = components.provideRanges[name];
+    ranges.insert(ranges.end(), provides, c.range());
   }
   vector<Function> outputs;
   for (auto p : def.returns()) {
     translateOutput(p, funcs, &outputs);
+    if (p.alias().present()) {
+      components.aliases.emplace(p.ident().name(), p.alias().get().name());
+    }
+  }
+  // The tensors that are not returned are temporaries, in order of
+  // definition.  They are realized like the outputs, so that the kernels
+  // take them as additional outputs.  The temporaries defined by a single
+  // statement without reduction may instead be inlined into the statements
+  // that read them, which recompute their values.
+  set<string> returned;
+  for (auto p : def.returns()) {
+    returned.insert(p.ident().name());
   }
+  vector<Function> temporaries;
+  for (auto c : def.statements()) {
+    auto name = c.ident().name();
+    if (returned.insert(name).second) {
+      auto f = funcs.at(name);
+      if (inlinePointwiseTemporaries && f.is_pure()) {
+        Func(f).compute_inline();
+        components.provideRanges.erase(name);
+        continue;
+      }
+      temporaries.push_back(f);
+    }
+  }
+  vector<Function> realized = outputs;
+  realized.insert(realized.end(), temporaries.begin(), temporaries.end());
 
   // Now apply an extremely simplified version of Halide lowering
 
   // Compute an environment
   map<string, Function> env;
-  for (auto f : outputs) {
+  for (auto f : realized) {
     populate_environment(f, env);
   }
 
@@ -776,14 +1059,15 @@ HalideComponents translateDef(const lang::Def& def, bool throwWarnings) {
   // Funcs in it, but we don't use it here.
   vector<string> order;
   vector<vector<string>> fused_groups;
-  std::tie(order, fused_groups) = realization_order(outputs, env);
+  std::tie(order, fused_groups) = realization_order(realized, env);
 
   // Create loop nests
   bool any_memoized = false;
   // This part of lowering requires a target, but it will never be
   // used in the pipelines we construct here, so just make a host target.
   Target target("host");
-  Stmt s = schedule_functions(outputs, fused_groups, env, target, any_memoized);
+  Stmt s =
+      schedule_functions(realized, fused_groups, env, target, any_memoized);
   // we insert these to allow for inplace mutation of in/out tensors
   s = remove_undef(s);
   // Apply forward bounds inference results. This replaces the usual Halide
@@ -911,7 +1195,8 @@ HalideComponents translateDef(const lang::Def& def, bool throwWarnings) {
 
   s = renameVariables.mutate(s);
 
-  // We don't handle Let nodes after this point
+  // We don't handle Let nodes after this point, except for the ones
+  // SimplifyValues introduces
   class SubstituteAllLets : public IRMutator2 {
     Scope<Expr> scope;
     Stmt visit(const LetStmt* op) override {
@@ -931,10 +1216,11 @@ HalideComponents translateDef(const lang::Def& def, bool throwWarnings) {
     }
   };
   s = SubstituteAllLets().mutate(s);
+  s = SimplifyValues().mutate(s);
 
   components.stmt = s;
 
-  for (Function f : outputs) {
+  for (Function f : realized) {
     OutputImageParam o = Func(f).output_buffers()[0];
     // Apply forward bounds inference results to the output buffers.
     const auto& b = bounds[f];
@@ -942,24 +1228,135 @@ HalideComponents translateDef(const lang::Def& def, bool throwWarnings) {
       const Interval& bound = b.at(f.args()[i]);
       o.dim(i).set_bounds(bound.min, simplify(bound.max - bound.min + 1));
     }
-    components.outputs.push_back(o);
+    if (components.outputs.size() < outputs.size()) {
+      components.outputs.push_back(o);
+    } else {
+      components.temporaries.push_back(o);
+    }
   }
 
   return components;
 }
 } // namespace
 
-HalideComponents
-translate(isl::ctx ctx, const lang::TreeRef& treeRef, bool throwWarnings) {
+HalideComponents translate(
+    isl::ctx ctx,
+    const lang::TreeRef& treeRef,
+    bool throwWarnings,
+    bool inlinePointwiseTemporaries) {
   LOG_IF(INFO, tc::FLAGS_debug_halide) << treeRef;
   return translateDef(
-      lang::Def(lang::Sema().checkFunction(treeRef)), throwWarnings);
+      lang::Def(lang::checkCached(treeRef)),
+      throwWarnings,
+      inlinePointwiseTemporaries);
+}
+
+HalidePipeline translatePipeline(
+    const lang::TreeRef& treeRef,
+    bool throwWarnings) {
+  lang::Def def(lang::checkCached(treeRef));
+  HalidePipeline pipeline;
+  for (auto p : def.params()) {
+    translateParam(p, &pipeline.params, &pipeline.inputs);
+  }
+  // Halide only updates the values of a Func it defined, the in-place
+  // reductions of the outputs read values it does not know.
+  set<string> defined;
+  for (auto c : def.statements()) {
+    auto kind = c.assignment()->kind();
+    bool inPlace = kind == lang::TK_PLUS_EQ || kind == lang::TK_TIMES_EQ ||
+        kind == lang::TK_MIN_EQ || kind == lang::TK_MAX_EQ;
+    if (inPlace && !defined.count(c.ident().name())) {
+      throw lang::ErrorReport(c)
+          << "in-place reduction of " << c.ident().name()
+          << " is not supported by the Halide pipeline";
+    }
+    defined.insert(c.ident().name());
+  }
+
+  map<string, Function> funcs;
+  FunctionBounds bounds;
+  vector<Function> reductions;
+  for (auto c : def.statements()) {
+    translateComprehension(
+        c, pipeline.params, throwWarnings, false, &funcs, &bounds, &reductions);
+  }
+  for (auto p : def.returns()) {
+    pipeline.outputs.push_back(Func(funcs.at(p.ident().name())));
+  }
+  return pipeline;
 }
 
-HalideComponents
-translate(isl::ctx ctx, const std::string& tc, bool throwWarnings) {
+std::shared_ptr<const HalideComponents> translateCached(
+    isl::ctx ctx,
+    const lang::TreeRef& treeRef,
+    bool throwWarnings,
+    bool inlinePointwiseTemporaries) {
+  // Trees that print the same translate to the same components.
+  std::stringstream key;
+  key << throwWarnings << inlinePointwiseTemporaries << treeRef;
+  static std::mutex mutex;
+  // Never freed, the Halide IR is not destroyed at exit.
+  static auto& cache = *new std::unordered_map<
+      std::string,
+      std::shared_ptr<const HalideComponents>>();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(key.str());
+    if (it != cache.end()) {
+      return it->second;
+    }
+  }
+  // Translate outside the lock, concurrent translations of the same tree
+  // are harmless, the first one is kept.
+  auto components = std::make_shared<const HalideComponents>(
+      translate(ctx, treeRef, throwWarnings, inlinePointwiseTemporaries));
+  std::lock_guard<std::mutex> lock(mutex);
+  return cache.emplace(key.str(), components).first->second;
+}
+
+size_t memoryFootprint(const HalideComponents& components) {
+  // Rough size of an IR node with its reference count and operands.
+  constexpr size_t kBytesPerNode = 64;
+  class CountNodes : public IRGraphVisitor {
+   public:
+    void include(const Expr& e) override {
+      if (e.defined() and not visited.count(e.get())) {
+        ++count;
+      }
+      IRGraphVisitor::include(e);
+    }
+    void include(const Stmt& s) override {
+      if (s.defined() and not visited.count(s.get())) {
+        ++count;
+      }
+      IRGraphVisitor::include(s);
+    }
+    size_t count = 0;
+  };
+  CountNodes counter;
+  if (components.stmt.defined()) {
+    counter.include(components.stmt);
+  }
+  return sizeof(components) + counter.count * kBytesPerNode +
+      (components.inputs.size() + components.outputs.size() +
+       components.temporaries.size() + components.params.size()) *
+      kBytesPerNode;
+}
+
+HalideComponents translate(
+    isl::ctx ctx,
+    const std::string& tc,
+    bool throwWarnings,
+    bool inlinePointwiseTemporaries) {
   LOG_IF(INFO, tc::FLAGS_debug_halide) << tc;
-  return translate(ctx, lang::Parser(tc).parseFunction(), throwWarnings);
+  auto defs = lang::parseCached(tc);
+  if (defs.empty()) {
+    // Let the parser report the missing definition.
+    lang::Parser(tc).parseFunction();
+  }
+  return translate(
+      ctx, defs.front(), throwWarnings, inlinePointwiseTemporaries);
 }
 
 } // namespace tc2halide
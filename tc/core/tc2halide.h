@@ -15,6 +15,9 @@
  */
 #pragma once
 
+#include <map>
+#include <memory>
+
 #include <Halide.h>
 
 #include "tc/external/isl.h"
@@ -33,6 +36,17 @@ struct HalideComponents {
   std::vector<Halide::ImageParam> inputs;
   std::map<std::string, Halide::Internal::Parameter> params;
   std::vector<Halide::OutputImageParam> outputs;
+  // The tensors defined by the TC that are neither inputs nor outputs, in
+  // order of definition.  The kernels take them as outputs following the
+  // actual ones, the executors allocate them.
+  std::vector<Halide::OutputImageParam> temporaries;
+  // The inputs the outputs may share their storage with (see
+  // lang::Param::alias), by name of the output.
+  std::map<std::string, std::string> aliases;
+  // The source ranges of the comprehensions computing each tensor, one per
+  // Provide node of the tensor in stmt, in order, e.g. twice the range of
+  // a reduction with initialization ("+=!").
+  std::map<std::string, std::vector<lang::SourceRange>> provideRanges;
   lang::Def getDef() const {
     return lang::Def(def); // Def is not default constructable, so we don't
                            // put it in the struct directly
@@ -44,16 +58,65 @@ struct HalideComponents {
 Halide::Internal::Call::ConstString kReductionInit = "ReductionInit";
 Halide::Internal::Call::ConstString kReductionUpdate = "ReductionUpdate";
 
+// Reductions of products of 8-bit integers rewritten for the dot products
+// of 4 bytes of CUDA (see packDp4aReductions) use these intrinsics.  Dp4a
+// takes two words of 4 packed bytes, Load4 and Pack4 make such a word of 4
+// element accesses: Load4 from 4 consecutive elements, aligned on 4 bytes,
+// Pack4 from any 4 elements.
+Halide::Internal::Call::ConstString kDp4a = "Dp4a";
+Halide::Internal::Call::ConstString kLoad4 = "Load4";
+Halide::Internal::Call::ConstString kPack4 = "Pack4";
+
 // Translate a TC parse tree into equivalent Halide imperative IR with
-// a naive schedule.
+// a naive schedule.  With inlinePointwiseTemporaries, the temporaries
+// defined by a single statement without reduction are not stored but
+// recomputed by the statements reading them, see
+// MappingOptionsView::inlinePointwiseTemporaries.
 HalideComponents translate(
     isl::ctx ctx,
+    const lang::TreeRef& treeRef,
+    bool throwWarnings = false,
+    bool inlinePointwiseTemporaries = false);
+
+// Same as translate, memoized per TC tree and values of the flags: the
+// Halide IR of a TC is only built once per process, e.g., rather than for
+// every executor the autotuner creates for its candidates.  The components
+// are shared between the callers and must not be modified.
+std::shared_ptr<const HalideComponents> translateCached(
+    isl::ctx ctx,
+    const lang::TreeRef& treeRef,
+    bool throwWarnings = false,
+    bool inlinePointwiseTemporaries = false);
+
+// The Funcs of a TC, unscheduled, for Halide to schedule and compile
+// itself rather than for the polyhedral layer.  The size parameters and the
+// inputs are those of HalideComponents, the outputs are the Funcs of the
+// returned tensors, in order, which call the Funcs of the temporaries.
+struct HalidePipeline {
+  std::vector<Halide::ImageParam> inputs;
+  std::map<std::string, Halide::Internal::Parameter> params;
+  std::vector<Halide::Func> outputs;
+};
+
+// Translate a TC parse tree into Halide Funcs without a schedule.  Each call
+// builds new Funcs, which the caller may schedule.  Throws a
+// lang::ErrorReport for the in-place reductions of outputs (e.g. "+=" on an
+// output with no previous definition), whose initial values the Funcs do not
+// have.
+HalidePipeline translatePipeline(
     const lang::TreeRef& treeRef,
     bool throwWarnings = false);
 
+// Estimate of the bytes of the Halide IR of components, counting the nodes
+// shared within the IR once.
+size_t memoryFootprint(const HalideComponents& components);
+
 // Translate TC source into equivalent Halide imperative IR with a
 // naive schedule.
-HalideComponents
-translate(isl::ctx ctx, const std::string& tc, bool throwWarnings = false);
+HalideComponents translate(
+    isl::ctx ctx,
+    const std::string& tc,
+    bool throwWarnings = false,
+    bool inlinePointwiseTemporaries = false);
 
 } // namespace tc2halide
@@ -15,6 +15,7 @@
  */
 #include "tc/core/tc_executor.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 
@@ -36,26 +37,55 @@ TcExecutor::TcExecutor(
     std::string id,
     const std::vector<const DLTensor*>& inputsInfo,
     const std::string& options,
-    lang::TreeRef tcDefinition)
+    lang::TreeRef tcDefinition,
+    bool inlinePointwiseTemporaries)
     : identifier(id),
       inputsInfo(dlutils::makeDLTensorVector(inputsInfo)),
       options(options),
       tcTree_(tcDefinition),
       cacheKeyId_(lang::canonicalTc(tcDefinition)) {
   executionInfo_.kernelName = lang::Def(tcTree_).name().name();
-  halideComponents_ =
-      tc2halide::translate(isl::with_exceptions::globalIslCtx(), tcTree_);
+  {
+    ScopeTimer timer(timings.tc2halide, "tc tc2halide");
+    halideComponents_ = tc2halide::translateCached(
+        isl::with_exceptions::globalIslCtx(),
+        tcTree_,
+        false,
+        inlinePointwiseTemporaries);
+  }
   checkInputsCompliant(inputsInfo);
   executionInfo_.inputsInfo = makeDLTensorVector(inputsInfo);
   // TODO: check if this is wrong, packed tensors may  have 0 strides stored
   executionInfo_.outputsInfo =
-      tc::inferOutputTensorInfo(halideComponents_, inputsInfo);
+      tc::inferOutputTensorInfo(*halideComponents_, inputsInfo);
+  executionInfo_.temporariesInfo =
+      tc::inferTemporaryTensorInfo(*halideComponents_, inputsInfo);
 }
 
 TcExecutor::~TcExecutor() {}
 
-// TODO: make sure that the empty stride arrays (in DLTensor) are not a problem
-void TcExecutor::checkSizesAndStridesAreCompliant(
+namespace {
+size_t tensorsFootprint(const std::vector<DLTensorUPtr>& tensors) {
+  size_t res = 0;
+  for (const auto& t : tensors) {
+    // The shape and the strides
+    res += sizeof(DLTensor) + 2 * t->ndim * sizeof(int64_t);
+  }
+  return res;
+}
+} // namespace
+
+size_t TcExecutor::memoryFootprint() const {
+  return sizeof(*this) + identifier.size() + options.size() +
+      executionInfo_.kernelName.size() + executionInfo_.options.size() +
+      executionInfo_.kernelParams.size() * sizeof(int) +
+      tensorsFootprint(inputsInfo) +
+      tensorsFootprint(executionInfo_.inputsInfo) +
+      tensorsFootprint(executionInfo_.outputsInfo) +
+      tensorsFootprint(executionInfo_.temporariesInfo);
+}
+
+void TcExecutor::checkSizesAreCompliant(
     const DLTensor* actual,
     const DLTensor* expected,
     const lang::Param& dbg) const {
@@ -82,42 +112,97 @@ void TcExecutor::checkSizesAndStridesAreCompliant(
   }
 }
 
+void TcExecutor::checkSizesAndStridesAreCompliant(
+    const DLTensor* actual,
+    const DLTensor* expected,
+    const lang::Param& dbg) const {
+  checkSizesAreCompliant(actual, expected, dbg);
+  // The kernels are specialized for the strides of the tensors, see
+  // specializeOutputStrides for the outputs.
+  if (isPacked(*actual) && isPacked(*expected)) {
+    return;
+  }
+  auto stridesA = getStrides(*actual);
+  auto stridesE = getStrides(*expected);
+  for (int i = 0; i < stridesA.size(); ++i) {
+    if (actual->shape[i] != 1 && stridesA[i] != stridesE[i]) {
+      throw lang::ErrorReport(dbg)
+          << "expected stride " << stridesE[i] << " for dim " << i
+          << " but found " << stridesA[i];
+    }
+  }
+}
+
 void TcExecutor::checkInputsCompliant(
     const std::vector<const DLTensor*>& inputsInfo) const {
-  if (inputsInfo.size() != halideComponents_.inputs.size()) {
-    throw lang::ErrorReport(halideComponents_.getDef())
-        << "expected " << halideComponents_.inputs.size()
-        << " inputs but found " << inputsInfo.size();
+  tc::checkInputsCompliant(*halideComponents_, inputsInfo);
+}
+
+std::string TcExecutor::specializedStridesSuffix() const {
+  std::stringstream ss;
+  for (size_t i = 0; i < executionInfo_.inputsInfo.size(); ++i) {
+    const auto& input = *executionInfo_.inputsInfo[i];
+    if (isPacked(input)) {
+      continue;
+    }
+    ss << "_s" << i;
+    for (auto stride : getStrides(input)) {
+      ss << "_" << stride;
+    }
   }
-  for (size_t i = 0; i < inputsInfo.size(); ++i) {
-    auto dltype_ = inputsInfo[i]->dtype;
-    auto htype_ = halideComponents_.inputs[i].type();
-    // we have three type representations here: (1) halide Type (2) DLTensor
-    // type, and (3) the token representing the type in the frontend (e.g.
-    // TK_FLOAT) we need to translate to (3) to report user facing errors
-    auto dltype =
-        lang::TypeInfo(lang::TypeInfo::Code(dltype_.code), dltype_.bits)
-            .toScalarToken();
-    auto htype =
-        lang::TypeInfo(lang::TypeInfo::Code(htype_.code()), htype_.bits())
-            .toScalarToken();
-    if (dltype != htype) {
-      throw lang::ErrorReport(halideComponents_.getDef().params()[i])
-          << "expected type " << lang::kindToString(htype) << " but found "
-          << lang::kindToString(dltype);
+  for (size_t i = 0; i < executionInfo_.outputsInfo.size(); ++i) {
+    const auto& output = *executionInfo_.outputsInfo[i];
+    if (isPacked(output)) {
+      continue;
     }
-    int edim = halideComponents_.inputs[i].dimensions();
-    int adim = inputsInfo[i]->ndim;
-    if (adim != edim) {
-      throw lang::ErrorReport(halideComponents_.getDef().params()[i])
-          << "expected a tensor with " << edim << " dimensions but found "
-          << adim << " dimensions.";
+    ss << "_so" << i;
+    for (auto stride : getStrides(output)) {
+      ss << "_" << stride;
     }
   }
+  return ss.str();
 }
 
 std::vector<const DLTensor*> TcExecutor::inferOutputTensorInfo() {
   return extractRawPtrs(executionInfo_.outputsInfo);
 }
 
+void TcExecutor::specializeOutputStrides(
+    const std::vector<const DLTensor*>& outputs) {
+  const auto& returns = halideComponents_->getDef().returns();
+  if (outputs.size() != executionInfo_.outputsInfo.size()) {
+    throw lang::ErrorReport(returns)
+        << "expected " << executionInfo_.outputsInfo.size()
+        << " values but found " << outputs.size();
+  }
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    checkSizesAreCompliant(
+        outputs[i], executionInfo_.outputsInfo[i].get(), returns[i]);
+  }
+  executionInfo_.outputsInfo = makeDLTensorVector(outputs);
+}
+
+bool TcExecutor::hasOutputStrides(
+    const std::vector<const DLTensor*>& outputs) const {
+  const auto& infos = executionInfo_.outputsInfo;
+  if (outputs.empty()) {
+    return std::all_of(
+        infos.begin(), infos.end(), [](const DLTensorUPtr& info) {
+          return isPacked(*info);
+        });
+  }
+  if (outputs.size() != infos.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < infos.size(); ++i) {
+    if (isPacked(*outputs[i]) && isPacked(*infos[i])) {
+      continue;
+    }
+    if (getStrides(*outputs[i]) != getStrides(*infos[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
 } // namespace tc
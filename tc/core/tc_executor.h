@@ -15,13 +15,17 @@
  */
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <limits>
+#include <memory>
 #include <string>
 
 #include <dlpack/dlpack.h>
 
 #include "tc/core/halide_utils.h"
 #include "tc/core/tc2halide.h"
+#include "tc/core/telemetry.h"
 #include "tc/core/utils/dlpack.h"
 #include "tc/core/utils/time.h"
 
@@ -33,11 +37,15 @@ using namespace dlutils;
 
 class TcExecutor {
  public:
+  // The TC is translated with its pointwise temporaries inlined if
+  // inlinePointwiseTemporaries is set by the backend from the generic part of
+  // options (see MappingOptionsView::inlinePointwiseTemporaries).
   TcExecutor(
       std::string id,
       const std::vector<const DLTensor*>& inputsInfo,
       const std::string& options,
-      lang::TreeRef tcDefinition);
+      lang::TreeRef tcDefinition,
+      bool inlinePointwiseTemporaries = false);
 
   virtual ~TcExecutor();
 
@@ -53,6 +61,16 @@ class TcExecutor {
   // you favorite ML framework / tensor library and then call compile.
   std::vector<const DLTensor*> inferOutputTensorInfo();
 
+  // Specializes the kernels to write outputs of the strides of "outputs"
+  // instead of packed ones, e.g. views of the slices of a larger tensor
+  // that several TCs write in place.  The sizes and types must be the
+  // inferred ones.  Must be called before compile.
+  void specializeOutputStrides(const std::vector<const DLTensor*>& outputs);
+
+  // Whether the kernels write outputs of the strides of "outputs", packed
+  // ones if "outputs" is empty.
+  bool hasOutputStrides(const std::vector<const DLTensor*>& outputs) const;
+
   // Can only be called once with specific kernel options.  Input sizes are
   // set up as constructor argument and output sizes are inferred.
   //
@@ -88,11 +106,44 @@ class TcExecutor {
   virtual bool hasRuntimeCompiledFunction() = 0;
   virtual void clearRuntimeCompiledFunction() = 0;
 
+  // Grid and block of the (first) kernel launched by run, reported to the
+  // telemetry sink.  Zeros for executors that do not launch GPU kernels.
+  virtual std::array<uint64_t, 3> launchGrid() const {
+    return {{0, 0, 0}};
+  }
+  virtual std::array<uint64_t, 3> launchBlock() const {
+    return {{0, 0, 0}};
+  }
+
+  // Estimate of the bytes owned by the executor: the tensor metadata, the
+  // generated code and the binaries, but not the shared HalideComponents.
+  virtual size_t memoryFootprint() const;
+
+  std::shared_ptr<const tc2halide::HalideComponents> halideComponents() const {
+    return halideComponents_;
+  }
+
   std::string identifier;
   std::vector<dlutils::DLTensorUPtr> inputsInfo;
   std::string options;
+  // Time spent in each phase of the compilation, 0 for the phases that were
+  // skipped, e.g. when retrieving the kernel from a cache.
+  CompilationTimings timings;
+  // Where compile found the kernel, set by the derived executors.
+  KernelSource kernelSource{KernelSource::Mapper};
+  // Logical time of the last run through an ExecutionEngine with a memory
+  // limit, which evicts the executors run the longest ago first.
+  std::atomic<uint64_t> lastRun{0};
+  // Runs of the kernel through an ExecutionEngine recording its shape
+  // manifest, shared by the executors of the same entry, null otherwise.
+  std::shared_ptr<std::atomic<uint64_t>> manifestRuns;
 
  protected:
+  void checkSizesAreCompliant(
+      const DLTensor* actual,
+      const DLTensor* expected,
+      const lang::Param& dbg) const;
+
   void checkSizesAndStridesAreCompliant(
       const DLTensor* actual,
       const DLTensor* expected,
@@ -107,6 +158,11 @@ class TcExecutor {
   void checkInputsCompliant(
       const std::vector<const DLTensor*>& inputsInfo) const;
 
+  // Suffix of the names of kernels specialized for the strides of the inputs
+  // and outputs that are not packed, which tells them apart from the kernels
+  // for other strides.  Empty if all of them are packed.
+  std::string specializedStridesSuffix() const;
+
   // This data structure contains the basic information that a TcExecutor
   // needs to run a compiled kernel.
   // This information corresponds to information required to:
@@ -118,11 +174,14 @@ class TcExecutor {
     std::string kernelName;
     std::vector<dlutils::DLTensorUPtr> inputsInfo;
     std::vector<dlutils::DLTensorUPtr> outputsInfo;
+    // The temporaries, which the kernels take as outputs after outputsInfo.
+    std::vector<dlutils::DLTensorUPtr> temporariesInfo;
     std::vector<int> kernelParams;
     std::string options;
   } executionInfo_;
 
-  tc2halide::HalideComponents halideComponents_;
+  // Shared with the executors of the same TC, see tc2halide::translateCached.
+  std::shared_ptr<const tc2halide::HalideComponents> halideComponents_;
   lang::TreeRef tcTree_;
   lang::CanonicalTcString cacheKeyId_;
 };
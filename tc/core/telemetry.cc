@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/telemetry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "tc/core/flags.h"
+
+namespace tc {
+
+const char* kernelSourceName(KernelSource source) {
+  switch (source) {
+    case KernelSource::Mapper:
+      return "mapper";
+    case KernelSource::EngineHandle:
+      return "engine handle";
+    case KernelSource::SharedParametric:
+      return "shared parametric";
+    case KernelSource::KernelBundle:
+      return "kernel bundle";
+    case KernelSource::ManualCache:
+      return "manual cache";
+    case KernelSource::CudaCache:
+      return "cuda cache";
+    case KernelSource::CompileServer:
+      return "compile server";
+    case KernelSource::LibraryCall:
+      return "library call";
+  }
+  LOG(FATAL) << "unknown kernel source " << static_cast<int>(source);
+  return "";
+}
+
+namespace {
+std::atomic<TelemetrySink*> currentSink{nullptr};
+
+// Never freed, sinks may be used by launches in flight at exit.
+std::mutex& sinksMutex() {
+  static auto& mutex = *new std::mutex();
+  return mutex;
+}
+std::vector<std::shared_ptr<TelemetrySink>>& installedSinks() {
+  static auto& sinks = *new std::vector<std::shared_ptr<TelemetrySink>>();
+  return sinks;
+}
+} // namespace
+
+void setTelemetrySink(std::shared_ptr<TelemetrySink> sink) {
+  std::lock_guard<std::mutex> lock(sinksMutex());
+  currentSink.store(sink.get());
+  if (sink) {
+    installedSinks().push_back(std::move(sink));
+  }
+}
+
+TelemetrySink* telemetrySink() {
+  return currentSink.load(std::memory_order_acquire);
+}
+
+bool sampleRun() {
+  static std::atomic<uint64_t> launches{0};
+  uint64_t period = FLAGS_telemetry_sampling_period;
+  return period > 0 && launches.fetch_add(1) % period == 0;
+}
+
+namespace detail {
+void reportCompile(
+    const std::string& kernel,
+    size_t handle,
+    KernelSource source,
+    std::chrono::high_resolution_clock::time_point start,
+    const CompilationTimings& timings) {
+  auto sink = telemetrySink();
+  if (!sink) {
+    return;
+  }
+  sink->onCompile(CompileEvent{kernel,
+                               handle,
+                               source,
+                               std::chrono::high_resolution_clock::now() -
+                                   start,
+                               timings});
+}
+} // namespace detail
+
+constexpr size_t KernelHistogramSink::kNumBuckets;
+
+Duration KernelHistogramSink::KernelStats::estimatedGpuTime() const {
+  if (sampledRuns == 0) {
+    return Duration::zero();
+  }
+  return sampledTime / sampledRuns * runs;
+}
+
+void KernelHistogramSink::onCompile(const CompileEvent& event) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& stats = stats_[event.kernel];
+  stats.compilations[event.source]++;
+  stats.compileTime += event.time;
+}
+
+void KernelHistogramSink::onRun(const RunEvent& event) {
+  size_t bucket = 0;
+  bool sampled = event.kernelTime != Duration::max();
+  if (sampled) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  event.kernelTime)
+                  .count();
+    while (us > 0 && bucket + 1 < kNumBuckets) {
+      us >>= 1;
+      ++bucket;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& stats = stats_[event.kernel];
+  stats.runs++;
+  stats.grid = event.grid;
+  stats.block = event.block;
+  if (sampled) {
+    stats.sampledRuns++;
+    stats.sampledTime += event.kernelTime;
+    stats.histogram[bucket]++;
+  }
+}
+
+std::map<std::string, KernelHistogramSink::KernelStats>
+KernelHistogramSink::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void KernelHistogramSink::dump(std::ostream& os) const {
+  auto all = stats();
+  std::vector<std::pair<std::string, KernelStats>> sorted(
+      all.begin(), all.end());
+  std::stable_sort(
+      sorted.begin(),
+      sorted.end(),
+      [](const std::pair<std::string, KernelStats>& a,
+         const std::pair<std::string, KernelStats>& b) {
+        return a.second.estimatedGpuTime() > b.second.estimatedGpuTime();
+      });
+  auto us = [](Duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+  for (const auto& kvp : sorted) {
+    const auto& s = kvp.second;
+    os << kvp.first << ": compilations:";
+    for (const auto& c : s.compilations) {
+      os << " " << kernelSourceName(c.first) << " " << c.second;
+    }
+    os << " (" << us(s.compileTime) << "us), runs: " << s.runs
+       << ", sampled: " << s.sampledRuns << " (" << us(s.sampledTime)
+       << "us), estimated GPU time: " << us(s.estimatedGpuTime())
+       << "us, grid: " << s.grid[0] << "x" << s.grid[1] << "x" << s.grid[2]
+       << ", block: " << s.block[0] << "x" << s.block[1] << "x"
+       << s.block[2] << ", histogram:";
+    for (size_t b = 0; b < kNumBuckets; ++b) {
+      if (s.histogram[b] == 0) {
+        continue;
+      }
+      if (b == 0) {
+        os << " <1us: ";
+      } else if (b + 1 == kNumBuckets) {
+        os << " >=" << (1ull << (b - 1)) << "us: ";
+      } else {
+        os << " <" << (1ull << b) << "us: ";
+      }
+      os << s.histogram[b];
+    }
+    os << "\n";
+  }
+}
+
+void KernelHistogramSink::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.clear();
+}
+} // namespace tc
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "tc/core/utils/time.h"
+
+namespace tc {
+
+/// Where the kernel returned by a compilation comes from.
+enum class KernelSource {
+  /// Mapped by the polyhedral mapper and compiled.
+  Mapper,
+  /// Compiled before by the same ExecutionEngine, for the same TC, sizes and
+  /// options.
+  EngineHandle,
+  /// Shared with an executor of other parametric sizes or of the same size
+  /// bucket.
+  SharedParametric,
+  /// Retrieved from the kernel bundle, the manual cache or the CudaCache.
+  KernelBundle,
+  ManualCache,
+  CudaCache,
+  /// Compiled by the compile server of --cuda_compile_server.
+  CompileServer,
+  /// Computed by a vendor library, see CudaMappingOptions::matchLibraryCalls.
+  LibraryCall,
+};
+
+const char* kernelSourceName(KernelSource source);
+
+/// Reported by ExecutionEngine::compile, once per call.
+struct CompileEvent {
+  std::string kernel;
+  size_t handle;
+  KernelSource source;
+  /// Wall-clock time of the call.
+  Duration time;
+  /// Time spent in each phase, zeros for the phases that did not run.
+  CompilationTimings timings;
+};
+
+/// Reported by ExecutionEngine::run and uncheckedRun, once per launch.
+struct RunEvent {
+  std::string kernel;
+  size_t handle;
+  std::array<uint64_t, 3> grid;
+  std::array<uint64_t, 3> block;
+  /// Time of the kernels of the launch if it was profiled or sampled (see
+  /// --telemetry_sampling_period), Duration::max() otherwise.
+  Duration kernelTime;
+};
+
+/// Receives the events of all the ExecutionEngines of the process once
+/// installed by setTelemetrySink.  The callbacks are invoked by the
+/// compiling and launching threads, concurrently, and must be thread-safe.
+class TelemetrySink {
+ public:
+  virtual ~TelemetrySink() {}
+  virtual void onCompile(const CompileEvent& event) = 0;
+  virtual void onRun(const RunEvent& event) = 0;
+};
+
+/// Install sink, nullptr uninstalls the current one.  Without a sink, the
+/// engines only pay for the check that there is none.  Replaced sinks are
+/// kept alive until exit since launches in flight may still use them.
+void setTelemetrySink(std::shared_ptr<TelemetrySink> sink);
+
+/// The installed sink, nullptr if none.
+TelemetrySink* telemetrySink();
+
+/// Whether the current launch is timed: one launch every
+/// --telemetry_sampling_period ones, counted over the process, none if the
+/// period is 0.  Only called when a sink is installed.
+bool sampleRun();
+
+namespace detail {
+/// Report the compilation of kernel to the installed sink, if any.
+void reportCompile(
+    const std::string& kernel,
+    size_t handle,
+    KernelSource source,
+    std::chrono::high_resolution_clock::time_point start,
+    const CompilationTimings& timings);
+} // namespace detail
+
+/// Default sink: aggregates the events per TC and dumps them on demand,
+/// kernels ordered by their estimated GPU time.
+class KernelHistogramSink : public TelemetrySink {
+ public:
+  /// Sampled kernel times are counted in buckets of powers of 2 us: bucket 0
+  /// holds the times under 1us, bucket i those in [2^(i-1), 2^i)us and the
+  /// last bucket all the longer ones.
+  static constexpr size_t kNumBuckets = 24;
+
+  struct KernelStats {
+    std::map<KernelSource, size_t> compilations;
+    Duration compileTime{Duration::zero()};
+    size_t runs{0};
+    size_t sampledRuns{0};
+    Duration sampledTime{Duration::zero()};
+    /// Of the last launch.
+    std::array<uint64_t, 3> grid{{0, 0, 0}};
+    std::array<uint64_t, 3> block{{0, 0, 0}};
+    std::array<size_t, kNumBuckets> histogram{};
+
+    /// The mean sampled time times the number of runs, zero if no run was
+    /// sampled.
+    Duration estimatedGpuTime() const;
+  };
+
+  void onCompile(const CompileEvent& event) override;
+  void onRun(const RunEvent& event) override;
+
+  /// A copy of the statistics, indexed by TC name.
+  std::map<std::string, KernelStats> stats() const;
+
+  /// Print one line per TC: the compilations per source, the runs, the sampled
+  /// and estimated GPU time, the launch bounds and the nonempty buckets of the
+  /// histogram.
+  void dump(std::ostream& os) const;
+
+  void clear();
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, KernelStats> stats_;
+};
+} // namespace tc
@@ -15,6 +15,8 @@
  */
 #pragma once
 
+#include "tc/core/utils/hash.h"
+
 namespace tc {
 namespace dlutils {
 
@@ -156,6 +158,51 @@ inline std::vector<const DLTensor*> constPtrs(
   return res;
 }
 
+inline std::vector<int64_t> getStrides(const DLTensor& t) {
+  if (t.strides) {
+    return std::vector<int64_t>(t.strides, t.strides + t.ndim);
+  }
+  std::vector<int64_t> strides(t.ndim, 1);
+  for (int i = t.ndim - 2; i >= 0; --i) {
+    strides[i] = strides[i + 1] * t.shape[i + 1];
+  }
+  return strides;
+}
+
+inline bool isPacked(const DLTensor& t) {
+  if (!t.strides) {
+    return true;
+  }
+  int64_t packedStride = 1;
+  for (int i = t.ndim - 1; i >= 0; --i) {
+    if (t.shape[i] != 1 && t.strides[i] != packedStride) {
+      return false;
+    }
+    packedStride *= t.shape[i];
+  }
+  return true;
+}
+
+inline size_t numberBytes(const DLTensor& t) {
+  size_t res = t.dtype.bits / 8 * t.dtype.lanes;
+  for (int i = 0; i < t.ndim; ++i) {
+    res *= t.shape[i];
+  }
+  return res;
+}
+
+inline size_t rowBytes(const DLTensor& t) {
+  size_t res = t.dtype.bits / 8 * t.dtype.lanes;
+  for (int i = 1; i < t.ndim; ++i) {
+    res *= t.shape[i];
+  }
+  return res;
+}
+
+inline char* dataPtr(const DLTensor& t) {
+  return static_cast<char*>(t.data) + t.byte_offset;
+}
+
 inline DLTensorUPtr makeDLTensor(const DLTensor* ptr) {
   auto res = DLTensorUPtr(new DLTensor);
   // DLTensor is not owning, so just copy the pointer
@@ -255,5 +302,26 @@ bool compareDLTensorVectorMetadata(
   }
   return true;
 }
+
+inline size_t hashDLTensorMetadata(const DLTensor& t) {
+  size_t seed = hashCombineValue(0, t.ndim);
+  seed = hashCombineValue(seed, t.dtype.code);
+  seed = hashCombineValue(seed, t.dtype.bits);
+  seed = hashCombineValue(seed, t.dtype.lanes);
+  seed = hashRange(seed, t.shape, t.shape + t.ndim);
+  if (t.strides) {
+    seed = hashRange(seed, t.strides, t.strides + t.ndim);
+  }
+  return hashCombineValue(seed, t.strides == NULL);
+}
+
+template <typename T>
+size_t hashDLTensorVectorMetadata(const std::vector<T*>& v) {
+  size_t seed = hashCombineValue(0, v.size());
+  for (auto t : v) {
+    seed = hashCombine(seed, hashDLTensorMetadata(*t));
+  }
+  return seed;
+}
 } // namespace dlutils
 } // namespace tc
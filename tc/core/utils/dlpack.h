@@ -63,6 +63,19 @@ std::vector<const DLTensor*> extractRawPtrs(
     const std::vector<DLTensorUPtr>& uptrs);
 std::vector<const DLTensor*> constPtrs(const std::vector<DLTensor*>& ptrs);
 
+// Strides of t in elements, those of the row-major packed layout of its
+// sizes if t has none.
+std::vector<int64_t> getStrides(const DLTensor& t);
+// Whether t is laid out row-major packed.  The strides of the dimensions of
+// size 1, which never address another element, are ignored.
+bool isPacked(const DLTensor& t);
+// Bytes of the elements of t, of those of a row of its dimension 0, as laid
+// out packed.
+size_t numberBytes(const DLTensor& t);
+size_t rowBytes(const DLTensor& t);
+// Address of the first element of t.
+char* dataPtr(const DLTensor& t);
+
 // Deep copies
 DLTensorUPtr makeDLTensor(const DLTensor* ptr);
 
@@ -80,6 +93,12 @@ template <typename T, typename TT>
 bool compareDLTensorVectorMetadata(
     const std::vector<T*>& v1,
     const std::vector<TT*>& v2);
+
+// Hashes consistent with the comparisons above: tensors whose metadata
+// compare equal have equal hashes.
+size_t hashDLTensorMetadata(const DLTensor& t);
+template <typename T>
+size_t hashDLTensorVectorMetadata(const std::vector<T*>& v);
 } // namespace dlutils
 } // namespace tc
 
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace tc {
+
+// Mix the hash of v into seed (same mixing function as boost::hash_combine).
+inline size_t hashCombine(size_t seed, size_t v) {
+  return seed ^ (v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+template <typename T>
+size_t hashCombineValue(size_t seed, const T& v) {
+  return hashCombine(seed, std::hash<T>()(v));
+}
+
+// Hash a range of hashable values, including its length so that prefixes do
+// not collide trivially.
+template <typename It>
+size_t hashRange(size_t seed, It begin, It end) {
+  size_t n = 0;
+  for (auto it = begin; it != end; ++it, ++n) {
+    seed = hashCombineValue(seed, *it);
+  }
+  return hashCombine(seed, n);
+}
+
+// 64-bit FNV-1a hash of s.  Unlike std::hash, stable across processes,
+// builds and platforms, e.g., for names that outlive the process.
+inline uint64_t stableHash(const std::string& s) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : s) {
+    hash = (hash ^ c) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+} // namespace tc
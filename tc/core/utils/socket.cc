@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tc/core/utils/socket.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace tc {
+namespace socketutils {
+
+void throwErrno(const std::string& what) {
+  throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwErrno("send");
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+bool readAll(int fd, char* data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    auto n = ::recv(fd, data + done, size - done, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwErrno("recv");
+    }
+    if (n == 0) {
+      if (done == 0) {
+        return false;
+      }
+      throw std::runtime_error("connection closed in the middle of a message");
+    }
+    done += n;
+  }
+  return true;
+}
+
+void sendMessage(
+    int fd,
+    const google::protobuf::MessageLite& message,
+    uint32_t maxSize) {
+  std::string buffer;
+  if (not message.SerializeToString(&buffer)) {
+    throw std::runtime_error("cannot serialize " + message.GetTypeName());
+  }
+  if (buffer.size() > maxSize) {
+    throw std::runtime_error(
+        "message of " + std::to_string(buffer.size()) + " bytes is too large");
+  }
+  uint32_t size = htonl(static_cast<uint32_t>(buffer.size()));
+  writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size));
+  writeAll(fd, buffer.data(), buffer.size());
+}
+
+bool receiveMessage(
+    int fd,
+    google::protobuf::MessageLite& message,
+    uint32_t maxSize) {
+  uint32_t size;
+  if (not readAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  size = ntohl(size);
+  if (size > maxSize) {
+    throw std::runtime_error(
+        "invalid message size " + std::to_string(size) + " for " +
+        message.GetTypeName());
+  }
+  std::string buffer(size, '\0');
+  if (size > 0 and not readAll(fd, &buffer[0], size)) {
+    throw std::runtime_error("connection closed in the middle of a message");
+  }
+  if (not message.ParseFromString(buffer)) {
+    throw std::runtime_error("cannot parse " + message.GetTypeName());
+  }
+  return true;
+}
+
+} // namespace socketutils
+} // namespace tc
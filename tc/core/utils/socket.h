@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <google/protobuf/message_lite.h>
+
+namespace tc {
+namespace socketutils {
+
+// Throws a std::runtime_error describing errno after "what" failed.
+[[noreturn]] void throwErrno(const std::string& what);
+
+// Sends the "size" bytes of "data" on the connected socket "fd", retrying
+// interrupted and partial sends.
+void writeAll(int fd, const char* data, size_t size);
+
+// Receives exactly "size" bytes into "data".  Returns false if the connection
+// is closed before anything is read, throws if it is closed in the middle.
+bool readAll(int fd, char* data, size_t size);
+
+// Messages are framed by their size as a 32-bit integer in network byte
+// order, followed by their serialization.  Messages larger than "maxSize"
+// bytes are protocol errors on both sides.
+void sendMessage(
+    int fd,
+    const google::protobuf::MessageLite& message,
+    uint32_t maxSize);
+
+// Returns false if the peer closed the connection instead of sending a new
+// message.
+bool receiveMessage(
+    int fd,
+    google::protobuf::MessageLite& message,
+    uint32_t maxSize);
+
+} // namespace socketutils
+} // namespace tc
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+
+#include <glog/logging.h>
+
+namespace tc {
+
+inline ThreadPool::ThreadPool(size_t numThreads) {
+  CHECK_LT(0u, numThreads) << "ThreadPool needs at least one thread";
+  workers_.reserve(numThreads);
+  for (size_t i = 0; i < numThreads; ++i) {
+    workers_.emplace_back([this]() { this->work(); });
+  }
+}
+
+inline ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lg(mtx_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+template <typename F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F f) {
+  using ReturnType = typename std::result_of<F()>::type;
+  // std::function requires copyable callables, packaged_task is move-only.
+  auto task = std::make_shared<std::packaged_task<ReturnType()>>(std::move(f));
+  auto res = task->get_future();
+  {
+    std::lock_guard<std::mutex> lg(mtx_);
+    CHECK(!stopping_) << "submitting to a ThreadPool being destroyed";
+    tasks_.emplace([task]() { (*task)(); });
+  }
+  cv_.notify_one();
+  return res;
+}
+
+inline void ThreadPool::work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        // stopping_ and nothing left to drain
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+} // namespace tc
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tc {
+
+/**
+ * A fixed-size pool of worker threads consuming a FIFO of tasks.
+ * Tasks are submitted as nullary callables and their result (or exception)
+ * is delivered through a std::future.
+ * The destructor lets the workers drain the pending tasks before joining
+ * them, so every future handed out is eventually satisfied.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t numThreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> submit(F f);
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+ private:
+  void work();
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::queue<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+} // namespace tc
+
+#include "tc/core/utils/thread_pool-inl.h"
@@ -16,7 +16,110 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <ostream>
 
 namespace tc {
 using Duration = std::chrono::high_resolution_clock::duration;
+
+// Microseconds in d, truncated unless Rep is a floating point type.
+template <typename Rep = int64_t>
+inline Rep toMicroseconds(Duration d) {
+  return std::chrono::duration_cast<std::chrono::duration<Rep, std::micro>>(d)
+      .count();
+}
+
+// Wall-clock time spent in each phase of the compilation of a TC to a
+// kernel.  The phases are disjoint: mapping does not include the
+// dependences, schedule and promotion phases it runs.
+struct CompilationTimings {
+  Duration tc2halide{Duration::zero()};
+  Duration halide2isl{Duration::zero()};
+  Duration dependences{Duration::zero()};
+  Duration schedule{Duration::zero()};
+  Duration mapping{Duration::zero()};
+  Duration promotion{Duration::zero()};
+  Duration codegen{Duration::zero()};
+  Duration nvrtc{Duration::zero()};
+};
+
+// Timings accumulated by the phases run by the current thread, reset by the
+// executors before mapping a kernel.
+inline CompilationTimings& compilationTimings() {
+  static thread_local CompilationTimings timings;
+  return timings;
+}
+
+// Hooks marking named ranges of the execution in profiler timelines, e.g.,
+// as NVTX ranges (see tc/core/cuda/nvtx.cc), unset unless installed.  push
+// returns whether it pushed a range, which pop then closes.
+struct ProfilerRangeHooks {
+  bool (*push)(const char* name){nullptr};
+  void (*pop)(){nullptr};
+};
+
+inline ProfilerRangeHooks& profilerRangeHooks() {
+  static ProfilerRangeHooks hooks;
+  return hooks;
+}
+
+// Mark its lifetime, or until end is called, as the range "name".
+class ProfilerRange {
+ public:
+  explicit ProfilerRange(const char* name) {
+    auto& hooks = profilerRangeHooks();
+    pushed_ = name && hooks.push && hooks.push(name);
+  }
+  ~ProfilerRange() {
+    end();
+  }
+  ProfilerRange(const ProfilerRange&) = delete;
+  ProfilerRange& operator=(const ProfilerRange&) = delete;
+
+  void end() {
+    if (pushed_) {
+      profilerRangeHooks().pop();
+      pushed_ = false;
+    }
+  }
+
+ private:
+  bool pushed_{false};
+};
+
+// Add the wall-clock time of its lifetime to "duration", marked as the
+// profiler range "name" if set.
+class ScopeTimer {
+ public:
+  explicit ScopeTimer(Duration& duration, const char* name = nullptr)
+      : duration_(duration),
+        range_(name),
+        start_(std::chrono::high_resolution_clock::now()) {}
+  ~ScopeTimer() {
+    duration_ += std::chrono::high_resolution_clock::now() - start_;
+  }
+  ScopeTimer(const ScopeTimer&) = delete;
+  ScopeTimer& operator=(const ScopeTimer&) = delete;
+
+ private:
+  Duration& duration_;
+  ProfilerRange range_;
+  std::chrono::high_resolution_clock::time_point start_;
+};
+
+inline std::ostream& operator<<(
+    std::ostream& os,
+    const CompilationTimings& timings) {
+  auto us = [](Duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+  return os << "tc2halide: " << us(timings.tc2halide)
+            << "us, halide2isl: " << us(timings.halide2isl)
+            << "us, dependences: " << us(timings.dependences)
+            << "us, schedule: " << us(timings.schedule)
+            << "us, mapping: " << us(timings.mapping)
+            << "us, promotion: " << us(timings.promotion)
+            << "us, codegen: " << us(timings.codegen)
+            << "us, nvrtc: " << us(timings.nvrtc) << "us";
+}
 } // namespace tc
@@ -425,9 +425,43 @@ struct CtxUPtrDeleter {
 };
 typedef std::unique_ptr<ctx, CtxUPtrDeleter> CtxUPtr;
 
-// C++11 thread-safe init
+// The isl context of the calling thread, that of the innermost ScopedCtx
+// alive on the thread if any.  Each thread has its own context: isl
+// contexts are not thread-safe, so isl objects must not be shared between
+// threads.
 isl::ctx globalIslCtx(IslCtxOption options = IslCtxOption::Default);
 
+// Makes a fresh isl context the one globalIslCtx returns on the calling
+// thread while it is alive, so that e.g. a compilation job owns its context
+// and frees it, together with everything isl allocated for the job, when it
+// ends.  The isl objects created in its scope must not outlive it.
+class ScopedCtx {
+ public:
+  ScopedCtx();
+  ~ScopedCtx();
+  ScopedCtx(const ScopedCtx&) = delete;
+  ScopedCtx& operator=(const ScopedCtx&) = delete;
+
+ private:
+  CtxUPtr ctx_;
+  ctx* previous_;
+};
+
+// Bounds the number of isl operations of each ScopedCtx created on the
+// calling thread while it is alive, 0 lifting the bound.  Past the bound,
+// isl operations fail and their bindings throw, which turns e.g. a
+// pathological scheduling problem into a failed compilation.
+class ScopedMaxOperations {
+ public:
+  explicit ScopedMaxOperations(unsigned long maxOperations);
+  ~ScopedMaxOperations();
+  ScopedMaxOperations(const ScopedMaxOperations&) = delete;
+  ScopedMaxOperations& operator=(const ScopedMaxOperations&) = delete;
+
+ private:
+  unsigned long previous_;
+};
+
 } // namespace with_exceptions
 } // namespace isl
 
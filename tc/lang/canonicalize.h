@@ -17,6 +17,7 @@
 
 #include <string>
 
+#include "tc/lang/parse_cache.h"
 #include "tc/lang/parser.h"
 #include "tc/lang/sema.h"
 #include "tc/lang/tree.h"
@@ -63,7 +64,7 @@ struct CanonicalTcString : public std::string {
 inline CanonicalTcString canonicalTc(const lang::TreeRef& tc) {
   std::stringstream ss;
   // TODO: use tcFormat when more robust
-  ss << lang::canonicalize(lang::Sema().checkFunction(tc));
+  ss << lang::canonicalize(lang::checkCached(tc));
   return CanonicalTcString(ss.str());
 }
 
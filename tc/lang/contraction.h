@@ -0,0 +1,368 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tc/lang/error_report.h"
+#include "tc/lang/lexer.h"
+#include "tc/lang/tree.h"
+#include "tc/lang/tree_views.h"
+
+namespace lang {
+
+namespace detail {
+
+// Assumed for the indices of sizes not given, or of temporaries.
+constexpr double kUnknownContractionSize = 64;
+
+// Factoring of the contractions of a TC definition, see
+// lang::factorContractions.
+class ContractionPlanner {
+ public:
+  ContractionPlanner(
+      const TreeRef& def,
+      const std::unordered_map<std::string, int64_t>& sizes)
+      : def_(def), range_(def->range()), sizes_(sizes) {}
+
+  TreeRef run(const std::string& name) {
+    collectNames(def_);
+    for (const auto& param : def_.params()) {
+      dims_[param.ident().name()] = param.tensorType().dims().tree()->trees();
+      for (const auto& dim : dims_.at(param.ident().name())) {
+        if (dim->kind() == TK_IDENT) {
+          sizeNames_.insert(Ident(dim).name());
+        }
+      }
+    }
+    TreeList statements;
+    for (const auto& stmt : def_.statements()) {
+      factor(stmt, statements);
+    }
+    return Def::create(
+        range_,
+        ident(name),
+        def_.params().tree(),
+        def_.returns().tree(),
+        List::create(range_, std::move(statements)));
+  }
+
+ private:
+  // A tensor read with distinct index variables.
+  struct Operand {
+    TreeRef read;
+    std::vector<std::string> indices;
+  };
+
+  void collectNames(const TreeRef& tree) {
+    if (tree->kind() == TK_IDENT) {
+      used_.insert(Ident(tree).name());
+    }
+    for (const auto& t : tree->trees()) {
+      collectNames(t);
+    }
+  }
+
+  std::string fresh(const std::string& base) {
+    auto name = base;
+    for (size_t i = 1; used_.count(name) > 0; ++i) {
+      name = base + "_" + std::to_string(i);
+    }
+    used_.insert(name);
+    return name;
+  }
+
+  static void factors(const TreeRef& tree, TreeList& res) {
+    if (tree->kind() == '*') {
+      factors(tree->trees()[0], res);
+      factors(tree->trees()[1], res);
+      return;
+    }
+    res.push_back(tree);
+  }
+
+  static bool isOperand(const TreeRef& tree, Operand& res) {
+    if (tree->kind() != TK_APPLY) {
+      return false;
+    }
+    std::unordered_set<std::string> seen;
+    for (const auto& arg : Apply(tree).arguments()) {
+      if (arg->kind() != TK_IDENT || !seen.insert(Ident(arg).name()).second) {
+        return false;
+      }
+      res.indices.push_back(Ident(arg).name());
+    }
+    res.read = tree;
+    return true;
+  }
+
+  // Records the sizes of the indices of a read of a parameter.
+  void recordSizes(const Operand& operand) {
+    auto name = Apply(operand.read).name().name();
+    if (dims_.count(name) == 0) {
+      return;
+    }
+    const auto& dims = dims_.at(name);
+    for (size_t i = 0; i < operand.indices.size() && i < dims.size(); ++i) {
+      int64_t size = -1;
+      if (dims[i]->kind() == TK_IDENT &&
+          sizes_.count(Ident(dims[i]).name()) > 0) {
+        size = sizes_.at(Ident(dims[i]).name());
+      } else if (dims[i]->kind() == TK_CONST) {
+        size = static_cast<int64_t>(Const(dims[i]).value());
+      }
+      if (size > 0 && indexSizes_.count(operand.indices[i]) == 0) {
+        indexSizes_[operand.indices[i]] = size;
+      }
+    }
+  }
+
+  double size(const std::string& index) const {
+    auto it = indexSizes_.find(index);
+    if (it == indexSizes_.end()) {
+      return kUnknownContractionSize;
+    }
+    return it->second;
+  }
+
+  double volume(const std::unordered_set<std::string>& indices) const {
+    double res = 1;
+    for (const auto& index : indices) {
+      res *= size(index);
+    }
+    return res;
+  }
+
+  // Splits products of three or more tensor reads summed into a tensor into
+  // pairwise contractions, others are kept as they are.
+  void factor(const Comprehension& stmt, TreeList& statements) {
+    auto assignment = stmt.assignment()->kind();
+    TreeList terms;
+    factors(stmt.rhs(), terms);
+    std::vector<Operand> operands;
+    TreeList scalars;
+    for (const auto& term : terms) {
+      Operand operand;
+      if (isOperand(term, operand)) {
+        recordSizes(operand);
+        operands.push_back(operand);
+      } else {
+        scalars.push_back(term);
+      }
+    }
+    // Other factors may read the reduced indices.
+    bool scalarsOnly = true;
+    for (const auto& s : scalars) {
+      scalarsOnly = scalarsOnly && !readsIndex(s);
+    }
+    if ((assignment != TK_PLUS_EQ && assignment != TK_PLUS_EQ_B) ||
+        operands.size() < 3 || !scalarsOnly ||
+        !stmt.whereClauses().empty() || stmt.equivalent().present()) {
+      statements.push_back(stmt.tree());
+      return;
+    }
+
+    std::vector<std::string> outputIndices;
+    for (const auto& index : stmt.indices()) {
+      outputIndices.push_back(index.name());
+    }
+    auto tensor = stmt.ident().name();
+    while (operands.size() > 2) {
+      // The pair of least volume of iterations, then of fewest values.
+      size_t best1 = 0, best2 = 1;
+      double bestCost = std::numeric_limits<double>::infinity();
+      double bestSize = bestCost;
+      std::vector<std::string> bestKept;
+      for (size_t i = 0; i < operands.size(); ++i) {
+        for (size_t j = i + 1; j < operands.size(); ++j) {
+          auto kept = keptIndices(operands, i, j, outputIndices);
+          std::unordered_set<std::string> all(
+              operands[i].indices.begin(), operands[i].indices.end());
+          all.insert(operands[j].indices.begin(), operands[j].indices.end());
+          auto cost = volume(all);
+          auto size = volume(
+              std::unordered_set<std::string>(kept.begin(), kept.end()));
+          if (cost < bestCost || (cost == bestCost && size < bestSize)) {
+            best1 = i;
+            best2 = j;
+            bestCost = cost;
+            bestSize = size;
+            bestKept = kept;
+          }
+        }
+      }
+      auto temporary = fresh(tensor + "_" + std::to_string(++nTemporaries_));
+      auto reduces =
+          bestKept.size() <
+          unionSize(operands[best1].indices, operands[best2].indices);
+      statements.push_back(comprehension(
+          temporary,
+          bestKept,
+          reduces ? TK_PLUS_EQ_B : '=',
+          c('*', range_, {operands[best1].read, operands[best2].read})));
+      Operand product{apply(temporary, bestKept), bestKept};
+      operands.erase(operands.begin() + best2);
+      operands[best1] = product;
+    }
+
+    auto rhs = c('*', range_, {operands[0].read, operands[1].read});
+    for (const auto& s : scalars) {
+      rhs = c('*', range_, {rhs, s});
+    }
+    statements.push_back(
+        comprehension(tensor, outputIndices, assignment, rhs));
+  }
+
+  // The indices of operands i and j that the other operands or the output
+  // read, in the order of batched matrix multiplications: those of both,
+  // then those of i only, then those of j only.
+  static std::vector<std::string> keptIndices(
+      const std::vector<Operand>& operands,
+      size_t i,
+      size_t j,
+      const std::vector<std::string>& outputIndices) {
+    std::unordered_set<std::string> needed(
+        outputIndices.begin(), outputIndices.end());
+    for (size_t k = 0; k < operands.size(); ++k) {
+      if (k != i && k != j) {
+        needed.insert(operands[k].indices.begin(), operands[k].indices.end());
+      }
+    }
+    std::unordered_set<std::string> inI(
+        operands[i].indices.begin(), operands[i].indices.end());
+    std::unordered_set<std::string> inJ(
+        operands[j].indices.begin(), operands[j].indices.end());
+    std::vector<std::string> batch, left, right;
+    for (const auto& index : operands[i].indices) {
+      if (needed.count(index) > 0) {
+        (inJ.count(index) > 0 ? batch : left).push_back(index);
+      }
+    }
+    for (const auto& index : operands[j].indices) {
+      if (needed.count(index) > 0 && inI.count(index) == 0) {
+        right.push_back(index);
+      }
+    }
+    batch.insert(batch.end(), left.begin(), left.end());
+    batch.insert(batch.end(), right.begin(), right.end());
+    return batch;
+  }
+
+  static size_t unionSize(
+      const std::vector<std::string>& a,
+      const std::vector<std::string>& b) {
+    std::unordered_set<std::string> res(a.begin(), a.end());
+    res.insert(b.begin(), b.end());
+    return res.size();
+  }
+
+  // Does tree read an index variable, i.e., an identifier that is neither a
+  // size nor a parameter read without indices?
+  bool readsIndex(const TreeRef& tree) const {
+    if (tree->kind() == TK_IDENT) {
+      auto name = Ident(tree).name();
+      return dims_.count(name) == 0 && sizeNames_.count(name) == 0;
+    }
+    if (tree->kind() == TK_APPLY) {
+      return true;
+    }
+    for (const auto& t : tree->trees()) {
+      if (readsIndex(t)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  TreeRef comprehension(
+      const std::string& tensor,
+      const std::vector<std::string>& indices,
+      int assignment,
+      const TreeRef& rhs) {
+    TreeList idents;
+    for (const auto& index : indices) {
+      idents.push_back(ident(index));
+    }
+    return Comprehension::create(
+        range_,
+        ident(tensor),
+        List::create(range_, std::move(idents)),
+        c(assignment, range_, {}),
+        rhs,
+        List::create(range_, {}),
+        c(TK_OPTION, range_, {}),
+        List::create(range_, {}));
+  }
+
+  TreeRef ident(const std::string& name) {
+    return Ident::create(range_, name);
+  }
+  TreeRef apply(const std::string& name, const std::vector<std::string>& args) {
+    if (args.empty()) {
+      return ident(name);
+    }
+    TreeList idents;
+    for (const auto& arg : args) {
+      idents.push_back(ident(arg));
+    }
+    return Apply::create(
+        range_, ident(name), List::create(range_, std::move(idents)));
+  }
+  TreeRef c(int kind, const SourceRange& range, TreeList&& trees) {
+    return Compound::create(kind, range, std::move(trees));
+  }
+
+  Def def_;
+  SourceRange range_;
+  const std::unordered_map<std::string, int64_t>& sizes_;
+  std::unordered_set<std::string> used_;
+  std::unordered_map<std::string, TreeList> dims_;
+  std::unordered_set<std::string> sizeNames_;
+  std::unordered_map<std::string, int64_t> indexSizes_;
+  size_t nTemporaries_ = 0;
+};
+} // namespace detail
+
+// Factors the multi-operand contractions of a parsed TC definition into
+// sequences of pairwise contractions, in a definition called name.  A
+// statement that sums a product of three or more tensor reads, e.g.
+//   O(i, l) +=! A(i, r_j) * B(r_j, r_k) * C(r_k, l)
+// becomes contractions of two operands at a time, each into a temporary
+// that keeps only the indices the remaining operands or the output read:
+//   O_1(i, r_k) +=! A(i, r_j) * B(r_j, r_k)
+//   O(i, l) +=! O_1(i, r_k) * C(r_k, l)
+// The pairs are chosen greedily, the pair of fewest iterations first, where
+// the index sizes are taken from the dimensions of the parameters the
+// indices read and from sizes, the values of the size parameters, if given.
+// The temporaries are laid out as the outputs of batched matrix
+// multiplications, batch indices first, then those of the left operand,
+// then those of the right one.
+// Statements are kept as they are if their reads do not use distinct index
+// variables, if other factors read the indices or if they have where
+// clauses.  The result is a tree before Sema, like the ones the parser
+// returns.
+inline TreeRef factorContractions(
+    const TreeRef& def,
+    const std::string& name,
+    const std::unordered_map<std::string, int64_t>& sizes = {}) {
+  return detail::ContractionPlanner(def, sizes).run(name);
+}
+} // namespace lang
@@ -0,0 +1,706 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tc/lang/error_report.h"
+#include "tc/lang/lexer.h"
+#include "tc/lang/tree.h"
+#include "tc/lang/tree_views.h"
+
+namespace lang {
+
+namespace detail {
+
+// Reverse-mode differentiation of a TC definition, see lang::gradient.
+class Gradient {
+ public:
+  explicit Gradient(const TreeRef& def) : def_(def), range_(def->range()) {}
+
+  TreeRef run(const std::string& name) {
+    collectNames(def_);
+    analyzeParams();
+    for (const auto& stmt : def_.statements()) {
+      forward_.push_back(toSSA(stmt));
+    }
+    seedOutputs();
+    for (auto it = forward_.rbegin(); it != forward_.rend(); ++it) {
+      backward(*it);
+    }
+
+    TreeList returns;
+    for (const auto& param : def_.params()) {
+      auto paramName = param.ident().name();
+      if (floatingParams_.count(paramName) == 0) {
+        continue;
+      }
+      if (gradients_.count(paramName) == 0) {
+        zeroGradient(param);
+      }
+      returns.push_back(Param::create(
+          range_,
+          ident(gradients_.at(paramName).name),
+          c(TK_INFERRED, range_, {})));
+    }
+
+    TreeList statements;
+    for (const auto& stmt : recompute()) {
+      statements.push_back(clone(stmt));
+    }
+    for (const auto& stmt : backward_) {
+      statements.push_back(clone(stmt));
+    }
+    return Def::create(
+        range_,
+        ident(name),
+        List::create(range_, std::move(params_)),
+        List::create(range_, std::move(returns)),
+        List::create(range_, std::move(statements)));
+  }
+
+ private:
+  // A definition of a tensor in SSA form: tensors defined several times get
+  // a new version per definition, the last one keeps the name of the tensor.
+  struct Version {
+    std::string name;
+    // the version updated in place by +=, if any
+    std::string previous;
+    TreeList indices;
+    int assignment;
+    TreeRef rhs;
+    TreeList whereClauses;
+  };
+
+  // The gradient of a version; seeded gradients are the gradient parameters
+  // of the outputs, which are immutable and copied on the first update.
+  struct Grad {
+    std::string name;
+    bool seeded;
+  };
+
+  void collectNames(const TreeRef& tree) {
+    if (tree->kind() == TK_IDENT) {
+      used_.insert(Ident(tree).name());
+    }
+    for (const auto& t : tree->trees()) {
+      collectNames(t);
+    }
+  }
+
+  std::string fresh(const std::string& base) {
+    auto name = base;
+    for (size_t i = 1; used_.count(name) > 0; ++i) {
+      name = base + "_" + std::to_string(i);
+    }
+    used_.insert(name);
+    return name;
+  }
+
+  void analyzeParams() {
+    for (const auto& param : def_.params()) {
+      auto paramName = param.ident().name();
+      auto type = param.tensorType();
+      tensors_.insert(paramName);
+      paramNames_.insert(paramName);
+      current_[paramName] = paramName;
+      dims_[paramName] = type.dims().tree()->trees();
+      switch (type.scalarType()) {
+        case TK_FLOAT:
+        case TK_DOUBLE:
+        case TK_FLOAT16:
+          floatingParams_.insert(paramName);
+          if (!scalarType_) {
+            scalarType_ = type.scalarTypeTree();
+          }
+          break;
+        default:
+          break;
+      }
+      params_.push_back(param.tree());
+    }
+    if (!scalarType_) {
+      scalarType_ = c(TK_FLOAT, range_, {});
+    }
+    for (const auto& stmt : def_.statements()) {
+      tensors_.insert(stmt.ident().name());
+      definitions_[stmt.ident().name()]++;
+    }
+    for (const auto& ret : def_.returns()) {
+      if (!ret.typeIsInferred()) {
+        dims_[ret.ident().name()] = ret.tensorType().dims().tree()->trees();
+      }
+    }
+  }
+
+  // Refers reads of tensors to their current version.
+  TreeRef renameReads(const TreeRef& tree) {
+    if (tree->kind() == TK_IDENT) {
+      auto it = current_.find(Ident(tree).name());
+      if (it != current_.end()) {
+        return ident(it->second);
+      }
+      return tree;
+    }
+    return tree->map([&](TreeRef t) { return renameReads(t); });
+  }
+
+  Version toSSA(Comprehension stmt) {
+    auto tensor = stmt.ident().name();
+    for (const auto& wc : stmt.whereClauses()) {
+      if (wc->kind() == TK_LET) {
+        throw ErrorReport(wc)
+            << "cannot differentiate statements with let bindings";
+      }
+    }
+
+    Version v;
+    v.indices = stmt.indices().tree()->trees();
+    v.assignment = stmt.assignment()->kind();
+    v.rhs = renameReads(stmt.rhs());
+    v.whereClauses = renameReads(stmt.whereClauses().tree())->trees();
+    switch (v.assignment) {
+      case '=':
+      case TK_PLUS_EQ_B:
+      case TK_TIMES_EQ_B:
+      case TK_MIN_EQ_B:
+      case TK_MAX_EQ_B:
+        break;
+      case TK_PLUS_EQ:
+        if (current_.count(tensor) == 0) {
+          throw ErrorReport(stmt)
+              << "cannot differentiate the update of " << tensor
+              << " before its definition, use +=! instead";
+        }
+        v.previous = current_.at(tensor);
+        break;
+      default:
+        throw ErrorReport(stmt)
+            << "cannot differentiate in place " << kindToString(v.assignment)
+            << " reductions";
+    }
+    if (--definitions_.at(tensor) == 0) {
+      v.name = tensor;
+    } else {
+      v.name = fresh(tensor);
+      tensors_.insert(v.name);
+    }
+    current_[tensor] = v.name;
+    inferDims(v);
+    return v;
+  }
+
+  // The dimensions of a version are those of the tensors its indices access,
+  // when they are known.
+  void inferDims(const Version& v) {
+    TreeList dims;
+    for (const auto& index : v.indices) {
+      auto dim = findDim(v.rhs, Ident(index).name());
+      for (const auto& wc : v.whereClauses) {
+        if (!dim && wc->kind() == TK_EXISTS) {
+          dim = findDim(wc, Ident(index).name());
+        }
+      }
+      if (!dim) {
+        return;
+      }
+      dims.push_back(dim);
+    }
+    dims_[v.name] = dims;
+  }
+
+  TreeRef findDim(const TreeRef& tree, const std::string& index) {
+    if (tree->kind() == TK_APPLY) {
+      auto apply = Apply(tree);
+      auto it = dims_.find(apply.name().name());
+      if (it != dims_.end()) {
+        auto args = apply.arguments();
+        for (size_t i = 0; i < args.size() && i < it->second.size(); ++i) {
+          if (args[i]->kind() == TK_IDENT && Ident(args[i]).name() == index) {
+            return it->second[i];
+          }
+        }
+      }
+    }
+    for (const auto& t : tree->trees()) {
+      if (auto dim = findDim(t, index)) {
+        return dim;
+      }
+    }
+    return nullptr;
+  }
+
+  void seedOutputs() {
+    for (const auto& ret : def_.returns()) {
+      auto retName = ret.ident().name();
+      auto gradName = fresh(retName + "_grad");
+      TreeRef type;
+      if (!ret.typeIsInferred()) {
+        type = ret.type();
+      } else {
+        auto it = dims_.find(retName);
+        TreeList dims;
+        if (it != dims_.end()) {
+          dims = it->second;
+        } else {
+          for (const auto& v : forward_) {
+            if (v.name == retName) {
+              for (size_t i = 0; i < v.indices.size(); ++i) {
+                dims.push_back(ident(fresh(gradName + std::to_string(i))));
+              }
+            }
+          }
+        }
+        type = TensorType::create(
+            range_, scalarType_, List::create(range_, std::move(dims)));
+      }
+      params_.push_back(Param::create(range_, ident(gradName), type));
+      gradients_[retName] = Grad{gradName, true};
+    }
+  }
+
+  // The reads of differentiable tensors in tree, the indices of the reads
+  // are not differentiated.
+  void collectReads(const TreeRef& tree, TreeList& reads) {
+    if (tree->kind() == TK_IDENT && tensors_.count(Ident(tree).name()) > 0) {
+      if (isDifferentiable(Ident(tree).name())) {
+        reads.push_back(tree);
+      }
+      return;
+    }
+    if (tree->kind() == TK_APPLY &&
+        tensors_.count(Apply(tree).name().name()) > 0) {
+      if (isDifferentiable(Apply(tree).name().name())) {
+        reads.push_back(tree);
+      }
+      return;
+    }
+    for (const auto& t : tree->trees()) {
+      collectReads(t, reads);
+    }
+  }
+
+  // versions and floating-point parameters
+  bool isDifferentiable(const std::string& tensor) {
+    return paramNames_.count(tensor) == 0 || floatingParams_.count(tensor) > 0;
+  }
+
+  void backward(const Version& v) {
+    if (gradients_.count(v.name) == 0) {
+      // nothing depends on this version
+      return;
+    }
+    auto grad = apply(gradients_.at(v.name).name, v.indices);
+    if (!v.previous.empty()) {
+      accumulate(v.previous, v.indices, grad, v);
+    }
+
+    TreeList reads;
+    collectReads(v.rhs, reads);
+    for (const auto& read : reads) {
+      auto partial = derivative(v.rhs, read);
+      if (!partial) {
+        continue;
+      }
+      TreeRef term;
+      switch (v.assignment) {
+        case TK_TIMES_EQ_B:
+          term = mul(grad, mul(div(apply(v.name, v.indices), v.rhs), partial));
+          break;
+        case TK_MIN_EQ_B:
+        case TK_MAX_EQ_B:
+          term = c('?',
+                   range_,
+                   {c(TK_EQ, range_, {v.rhs, apply(v.name, v.indices)}),
+                    mul(grad, partial),
+                    constant(0)});
+          break;
+        default:
+          term = mul(grad, partial);
+          break;
+      }
+      TreeList indices;
+      std::unordered_set<std::string> distinct;
+      std::string tensor;
+      if (read->kind() == TK_IDENT) {
+        tensor = Ident(read).name();
+      } else {
+        auto access = Apply(read);
+        tensor = access.name().name();
+        for (const auto& arg : access.arguments()) {
+          if (arg->kind() != TK_IDENT ||
+              !distinct.insert(Ident(arg).name()).second) {
+            throw ErrorReport(read)
+                << "cannot differentiate " << tensor
+                << " accessed with indices that are not distinct index "
+                << "variables";
+          }
+          indices.push_back(arg);
+        }
+      }
+      accumulate(tensor, indices, term, v, read);
+    }
+  }
+
+  // Adds term to the gradient of version, reads are the forward accesses
+  // the indices range over.
+  void accumulate(
+      const std::string& version,
+      const TreeList& indices,
+      const TreeRef& term,
+      const Version& v,
+      const TreeRef& read = nullptr) {
+    TreeList whereClauses = v.whereClauses;
+    if (read && read->kind() == TK_APPLY) {
+      whereClauses.push_back(Exists::create(range_, read));
+    }
+    auto it = gradients_.find(version);
+    if (it == gradients_.end()) {
+      auto gradName = fresh(version + "_grad");
+      gradients_[version] = Grad{gradName, false};
+      emit(gradName, indices, TK_PLUS_EQ_B, term, std::move(whereClauses));
+      return;
+    }
+    if (it->second.seeded) {
+      // copy the gradient parameter, on the dimensions of the version
+      auto gradName = fresh(it->second.name);
+      TreeList copyIndices;
+      for (const auto& def : forward_) {
+        if (def.name == version) {
+          copyIndices = def.indices;
+        }
+      }
+      emit(gradName,
+           copyIndices,
+           '=',
+           apply(it->second.name, copyIndices),
+           {});
+      it->second = Grad{gradName, false};
+    }
+    emit(it->second.name, indices, TK_PLUS_EQ, term, std::move(whereClauses));
+  }
+
+  void zeroGradient(const Param& param) {
+    auto paramName = param.ident().name();
+    auto gradName = fresh(paramName + "_grad");
+    TreeList indices;
+    TreeList whereClauses;
+    for (const auto& dim : param.tensorType().dims()) {
+      auto index = ident(fresh("i"));
+      indices.push_back(index);
+      whereClauses.push_back(
+          RangeConstraint::create(range_, index, constant(0, TK_INT32), dim));
+    }
+    emit(gradName,
+         indices,
+         '=',
+         Cast::create(range_, constant(0), param.tensorType().scalarTypeTree()),
+         std::move(whereClauses));
+    gradients_[paramName] = Grad{gradName, false};
+  }
+
+  void emit(
+      const std::string& tensor,
+      const TreeList& indices,
+      int assignment,
+      const TreeRef& rhs,
+      TreeList whereClauses) {
+    backward_.push_back(
+        comprehension(tensor, indices, assignment, rhs, whereClauses));
+  }
+
+  TreeRef comprehension(
+      const std::string& tensor,
+      const TreeList& indices,
+      int assignment,
+      const TreeRef& rhs,
+      const TreeList& whereClauses) {
+    return Comprehension::create(
+        range_,
+        ident(tensor),
+        List::create(range_, TreeList(indices)),
+        c(assignment, range_, {}),
+        rhs,
+        List::create(range_, TreeList(whereClauses)),
+        c(TK_OPTION, range_, {}),
+        List::create(range_, {}));
+  }
+
+  // The forward statements the gradients read, in SSA form.
+  TreeList recompute() {
+    std::unordered_set<std::string> needed;
+    std::function<void(const TreeRef&)> reads = [&](const TreeRef& tree) {
+      if (tree->kind() == TK_IDENT) {
+        needed.insert(Ident(tree).name());
+      }
+      for (const auto& t : tree->trees()) {
+        reads(t);
+      }
+    };
+    for (const auto& stmt : backward_) {
+      reads(Comprehension(stmt).rhs());
+      reads(Comprehension(stmt).whereClauses().tree());
+    }
+    for (auto it = forward_.rbegin(); it != forward_.rend(); ++it) {
+      if (needed.count(it->name) > 0) {
+        reads(it->rhs);
+        reads(List::create(range_, TreeList(it->whereClauses)));
+        if (!it->previous.empty()) {
+          needed.insert(it->previous);
+        }
+      }
+    }
+
+    TreeList statements;
+    for (const auto& v : forward_) {
+      if (needed.count(v.name) == 0) {
+        continue;
+      }
+      if (!v.previous.empty()) {
+        statements.push_back(comprehension(
+            v.name, v.indices, '=', apply(v.previous, v.indices), {}));
+      }
+      statements.push_back(comprehension(
+          v.name, v.indices, v.assignment, v.rhs, v.whereClauses));
+    }
+    return statements;
+  }
+
+  // The gradients share subexpressions of the forward statements, Sema
+  // requires distinct nodes.
+  static TreeRef clone(const TreeRef& tree) {
+    return tree->map(clone);
+  }
+
+  bool contains(const TreeRef& tree, const TreeRef& read) {
+    if (tree == read) {
+      return true;
+    }
+    for (const auto& t : tree->trees()) {
+      if (contains(t, read)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The partial derivative of expression e with respect to the tensor read,
+  // nullptr if it is zero.
+  TreeRef derivative(const TreeRef& e, const TreeRef& read) {
+    if (e == read) {
+      return constant(1);
+    }
+    if (!contains(e, read)) {
+      return nullptr;
+    }
+    const auto& t = e->trees();
+    switch (e->kind()) {
+      case '+':
+        return add(derivative(t[0], read), derivative(t[1], read));
+      case '-':
+        if (t.size() == 1) {
+          return neg(derivative(t[0], read));
+        }
+        return sub(derivative(t[0], read), derivative(t[1], read));
+      case '*':
+        return add(
+            mul(derivative(t[0], read), t[1]),
+            mul(t[0], derivative(t[1], read)));
+      case '/':
+        return sub(
+            div(derivative(t[0], read), t[1]),
+            div(mul(t[0], derivative(t[1], read)), mul(t[1], t[1])));
+      case '?':
+        return select(
+            t[0], derivative(t[1], read), derivative(t[2], read));
+      case TK_MIN:
+      case TK_MAX:
+        return select(
+            c(e->kind() == TK_MIN ? TK_LE : TK_GE, range_, {t[0], t[1]}),
+            derivative(t[0], read),
+            derivative(t[1], read));
+      case TK_CAST:
+        return derivative(Cast(e).value(), read);
+      case TK_APPLY:
+        return builtinDerivative(Apply(e), read);
+      default:
+        throw ErrorReport(e)
+            << "cannot differentiate " << kindToString(e->kind())
+            << " expressions";
+    }
+  }
+
+  TreeRef builtinDerivative(Apply e, const TreeRef& read) {
+    auto fn = e.name().name();
+    auto args = e.arguments();
+    if (tensors_.count(fn) > 0) {
+      throw ErrorReport(e)
+          << "cannot differentiate through the indices of " << fn;
+    }
+    auto a = args[0];
+    auto da = derivative(a, read);
+    auto call = [&](const std::string& f, TreeRef arg) {
+      return apply(f, {arg});
+    };
+    if (fn == "exp" || fn == "expm1") {
+      return mul(call("exp", a), da);
+    } else if (fn == "log") {
+      return div(da, a);
+    } else if (fn == "log1p") {
+      return div(da, add(constant(1), a));
+    } else if (fn == "sqrt") {
+      return div(da, mul(constant(2), call("sqrt", a)));
+    } else if (fn == "tanh") {
+      auto y = call("tanh", a);
+      return mul(da, sub(constant(1), mul(y, y)));
+    } else if (fn == "sin") {
+      return mul(call("cos", a), da);
+    } else if (fn == "cos") {
+      return mul(neg(call("sin", a)), da);
+    } else if (fn == "fabs") {
+      return select(c(TK_GE, range_, {a, constant(0)}), da, neg(da));
+    } else if (fn == "fmax" || fn == "fmin") {
+      return select(
+          c(fn == "fmax" ? TK_GE : TK_LE, range_, {a, args[1]}),
+          da,
+          derivative(args[1], read));
+    } else if (fn == "pow" && !contains(args[1], read)) {
+      auto b = args[1];
+      return mul(mul(b, apply("pow", {a, sub(b, constant(1))})), da);
+    }
+    throw ErrorReport(e) << "cannot differentiate built-in " << fn;
+  }
+
+  TreeRef constant(double value, int type = TK_FLOAT) {
+    return Const::create(range_, Number::create(value), c(type, range_, {}));
+  }
+  static bool isOne(const TreeRef& e) {
+    return e->kind() == TK_CONST && Const(e).value() == 1;
+  }
+  TreeRef add(TreeRef a, TreeRef b) {
+    if (!a || !b) {
+      return a ? a : b;
+    }
+    return c('+', range_, {a, b});
+  }
+  TreeRef sub(TreeRef a, TreeRef b) {
+    if (!b) {
+      return a;
+    }
+    if (!a) {
+      return neg(b);
+    }
+    return c('-', range_, {a, b});
+  }
+  TreeRef mul(TreeRef a, TreeRef b) {
+    if (!a || !b) {
+      return nullptr;
+    }
+    if (isOne(a)) {
+      return b;
+    }
+    if (isOne(b)) {
+      return a;
+    }
+    return c('*', range_, {a, b});
+  }
+  TreeRef div(TreeRef a, TreeRef b) {
+    if (!a) {
+      return nullptr;
+    }
+    return c('/', range_, {a, b});
+  }
+  TreeRef neg(TreeRef a) {
+    if (!a) {
+      return nullptr;
+    }
+    return c('-', range_, {a});
+  }
+  TreeRef select(TreeRef cond, TreeRef a, TreeRef b) {
+    if (!a && !b) {
+      return nullptr;
+    }
+    return c('?',
+             range_,
+             {cond, a ? a : constant(0), b ? b : constant(0)});
+  }
+  TreeRef ident(const std::string& name) {
+    return Ident::create(range_, name);
+  }
+  TreeRef apply(const std::string& name, const TreeList& args) {
+    if (args.empty()) {
+      return ident(name);
+    }
+    return Apply::create(
+        range_, ident(name), List::create(range_, TreeList(args)));
+  }
+  TreeRef c(int kind, const SourceRange& range, TreeList&& trees) {
+    return Compound::create(kind, range, std::move(trees));
+  }
+
+  Def def_;
+  SourceRange range_;
+  std::unordered_set<std::string> used_;
+  // the parameters and the versions of the tensors
+  std::unordered_set<std::string> tensors_;
+  std::unordered_set<std::string> paramNames_;
+  std::unordered_set<std::string> floatingParams_;
+  std::unordered_map<std::string, int> definitions_;
+  // the current version of each tensor
+  std::unordered_map<std::string, std::string> current_;
+  std::unordered_map<std::string, TreeList> dims_;
+  std::unordered_map<std::string, Grad> gradients_;
+  TreeRef scalarType_;
+  TreeList params_;
+  std::vector<Version> forward_;
+  TreeList backward_;
+};
+} // namespace detail
+
+// Derives the backward TC of a parsed TC definition by reverse-mode
+// differentiation. The backward definition, called name (the name of the
+// forward definition followed by _grad by default), takes the parameters of
+// the forward definition followed by the gradients of its outputs, called
+// <output>_grad, and returns the gradient of each floating-point parameter,
+// called <param>_grad. The result is a tree before Sema, like the ones the
+// parser returns, which can be compiled and tuned like any other TC.
+// Each statement of the forward definition is reversed: a tensor read by a
+// statement receives the gradient of the tensor the statement defines times
+// the partial derivative of the right-hand side, summed over the indices the
+// read does not use, so that broadcasts become reductions and reductions
+// become broadcasts. The forward values the gradients need are recomputed,
+// in the backward definition, as temporaries.
+// Tensors must be read with distinct index variables, and where clauses must
+// not have let bindings, ErrorReport is thrown otherwise or when an
+// expression cannot be differentiated.
+// Outputs must not alias inputs, whose values the backward definition reads.
+inline TreeRef gradient(const TreeRef& def, std::string name = "") {
+  for (const auto& ret : Def(def).returns()) {
+    if (ret.alias().present()) {
+      throw ErrorReport(ret) << "cannot differentiate " << ret.ident().name()
+                             << ", which aliases " << ret.alias().get().name();
+    }
+  }
+  if (name.empty()) {
+    name = Def(def).name().name() + "_grad";
+  }
+  return detail::Gradient(def).run(name);
+}
+} // namespace lang
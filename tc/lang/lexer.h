@@ -43,6 +43,8 @@ namespace lang {
   _(TK_WHERE, "where", "where")                  \
   _(TK_FLOAT, "float", "float")                  \
   _(TK_DOUBLE, "double", "double")               \
+  _(TK_FLOAT16, "float16", "float16")            \
+  _(TK_HALF, "half", "half")                     \
   _(TK_DEF, "def", "def")                        \
   _(TK_ARROW, "arrow", "->")                     \
   _(TK_EQUIVALENT, "equivalent", "<=>")          \
@@ -85,7 +87,9 @@ namespace lang {
   _(TK_AND, "and", "&&")                         \
   _(TK_OR, "or", "||")                           \
   _(TK_LET, "let", "")                           \
-  _(TK_EXISTS, "exists", "exists")
+  _(TK_EXISTS, "exists", "exists")               \
+  _(TK_ALIASES, "aliases", "aliases")            \
+  _(TK_CONSTRAINT, "constraint", "")
 
 static const char* valid_single_char_tokens = "+-*/()[]?:,={}><!";
 
@@ -282,6 +286,8 @@ struct SharedParserData {
       case TK_BOOL:
       case TK_FLOAT:
       case TK_DOUBLE:
+      case TK_FLOAT16:
+      case TK_HALF:
         return true;
       default:
         return false;
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tc/lang/parser.h"
+#include "tc/lang/sema.h"
+#include "tc/lang/tree.h"
+
+namespace lang {
+
+// Process-wide caches of the parsed and checked trees, so that the many
+// entry points taking TC strings, e.g., one ExecutionEngine per Caffe2
+// operator instance, do not lex and parse the same source again.
+// Trees are immutable, the cached ones are shared by all the callers.
+// The caches are never cleared, like the translation cache of tc2halide.
+
+// The definitions of "source", in order, parsed once per process.
+// Parse errors are thrown as ErrorReport and are not cached.
+inline std::vector<TreeRef> parseCached(const std::string& source) {
+  static std::mutex mutex;
+  static auto& cache =
+      *new std::unordered_map<std::string, std::vector<TreeRef>>();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(source);
+    if (it != cache.end()) {
+      return it->second;
+    }
+  }
+  // Parse outside the lock, concurrent parses of the same source are
+  // harmless, the first one is kept.
+  Parser parser(source);
+  std::vector<TreeRef> defs;
+  while (parser.L.cur().kind != TK_EOF) {
+    defs.push_back(parser.parseFunction());
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  return cache.emplace(source, std::move(defs)).first->second;
+}
+
+// The result of Sema on the definition "def", computed once per tree.
+// The cache holds on to "def", so that its address is never reused.
+inline TreeRef checkCached(const TreeRef& def) {
+  static std::mutex mutex;
+  static auto& cache =
+      *new std::unordered_map<const Tree*, std::pair<TreeRef, TreeRef>>();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(def.get());
+    if (it != cache.end()) {
+      return it->second.second;
+    }
+  }
+  auto checked = Sema().checkFunction(def);
+  std::lock_guard<std::mutex> lock(mutex);
+  return cache.emplace(def.get(), std::make_pair(def, checked))
+      .first->second.second;
+}
+} // namespace lang
@@ -160,6 +160,12 @@ struct Parser {
     auto l = parseExp();
     L.expect(':');
     auto r = parseExp();
+    auto maxLength = L.cur().range;
+    if (L.nextIf(':')) {
+      auto exp = parseExp();
+      return RangeConstraint::create(
+          id->range(), id, l, r, c(TK_OPTION, maxLength, {exp}));
+    }
     return RangeConstraint::create(id->range(), id, l, r);
   }
   TreeRef parseLetBinding() {
@@ -174,21 +180,33 @@ struct Parser {
       return parseLetBinding();
     } else if (lookahead.kind == TK_IN) {
       return parseRangeConstraint();
-    } else {
-      L.expect(TK_EXISTS);
+    } else if (L.nextIf(TK_EXISTS)) {
       auto exp = parseExp();
       return Exists::create(exp->range(), {exp});
+    } else {
+      auto exp = parseExp();
+      return Constraint::create(exp->range(), exp);
     }
   }
   TreeRef parseParam() {
     if (L.cur().kind == TK_IDENT) {
       auto ident = parseIdent();
       return Param::create(
-          ident->range(), ident, c(TK_INFERRED, ident->range(), {}));
+          ident->range(),
+          ident,
+          c(TK_INFERRED, ident->range(), {}),
+          parseAlias());
     }
     auto typ = parseType();
     auto ident = parseIdent();
-    return Param::create(typ->range(), ident, typ);
+    return Param::create(typ->range(), ident, typ, parseAlias());
+  }
+  TreeRef parseAlias() {
+    auto r = L.cur().range;
+    if (L.nextIf(TK_ALIASES)) {
+      return c(TK_OPTION, r, {parseIdent()});
+    }
+    return c(TK_OPTION, r, {});
   }
   TreeRef parseWhereClauses() {
     if (L.nextIf(TK_WHERE)) {
@@ -245,7 +263,9 @@ struct Parser {
   TreeRef parseScalarType() {
     if (shared.isScalarType(L.cur().kind)) {
       auto t = L.next();
-      return c(t.kind, t.range, {});
+      // half is a spelling of float16, only the latter exists past parsing.
+      auto kind = t.kind == TK_HALF ? TK_FLOAT16 : t.kind;
+      return c(kind, t.range, {});
     }
     L.reportError("a scalar type");
     return nullptr;
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tc/lang/error_report.h"
+#include "tc/lang/tree.h"
+#include "tc/lang/tree_views.h"
+
+namespace lang {
+
+// Inlines a pipeline of parsed TC definitions into a single definition
+// called name, so that the pipeline is compiled to a single Scop and the
+// scheduler can fuse across the definitions.
+// The definitions are connected by name: a parameter of a definition that
+// is returned by a previous definition of the pipeline reads the tensor that
+// definition computes, its declared type is dropped. The other parameters
+// are the inputs of the pipeline, in order of first appearance, parameters
+// of the same name are the same input. The outputs of the pipeline are the
+// outputs of the last definition, the outputs of the previous ones become
+// temporaries. Temporaries local to a definition are prefixed with the name
+// of the definition when another definition uses the same name.
+// The result is a tree before Sema, like the ones the parser returns.
+inline TreeRef inlinePipeline(
+    const std::string& name,
+    const std::vector<TreeRef>& defs) {
+  if (defs.empty()) {
+    throw std::runtime_error("pipeline " + name + " has no definitions");
+  }
+
+  // names of the tensors each definition declares or defines
+  std::vector<std::unordered_set<std::string>> tensorNames;
+  for (const auto& ref : defs) {
+    Def def(ref);
+    std::unordered_set<std::string> names;
+    for (const auto& param : def.params()) {
+      names.insert(param.ident().name());
+    }
+    for (const auto& ret : def.returns()) {
+      names.insert(ret.ident().name());
+    }
+    for (const auto& stmt : def.statements()) {
+      names.insert(stmt.ident().name());
+    }
+    tensorNames.push_back(std::move(names));
+  }
+
+  TreeList params;
+  TreeList returns;
+  TreeList statements;
+  std::unordered_set<std::string> inputs;
+  std::unordered_map<std::string, std::string> producers;
+  for (size_t i = 0; i < defs.size(); ++i) {
+    Def def(defs[i]);
+    auto defName = def.name().name();
+    for (const auto& param : def.params()) {
+      auto paramName = param.ident().name();
+      if (producers.count(paramName) == 0 && inputs.count(paramName) == 0) {
+        inputs.insert(paramName);
+        params.push_back(param.tree());
+      }
+    }
+    std::unordered_set<std::string> declared;
+    for (const auto& param : def.params()) {
+      declared.insert(param.ident().name());
+    }
+    for (const auto& ret : def.returns()) {
+      auto retName = ret.ident().name();
+      if (inputs.count(retName) > 0) {
+        throw ErrorReport(ret) << retName << " is an input of pipeline "
+                               << name << " but is returned by " << defName;
+      }
+      auto producer = producers.find(retName);
+      if (producer != producers.end()) {
+        throw ErrorReport(ret) << retName << " is returned by both "
+                               << producer->second << " and " << defName
+                               << " in pipeline " << name;
+      }
+      producers.emplace(retName, defName);
+      declared.insert(retName);
+      if (i + 1 == defs.size()) {
+        returns.push_back(ret.tree());
+      }
+    }
+
+    // rename the temporaries that clash with another definition's tensors
+    std::unordered_map<std::string, std::string> renames;
+    for (const auto& stmt : def.statements()) {
+      auto tensorName = stmt.ident().name();
+      if (declared.count(tensorName) > 0 || renames.count(tensorName) > 0) {
+        continue;
+      }
+      for (size_t j = 0; j < defs.size(); ++j) {
+        if (j != i && tensorNames[j].count(tensorName) > 0) {
+          renames.emplace(tensorName, defName + "_" + tensorName);
+          break;
+        }
+      }
+    }
+    std::function<TreeRef(TreeRef)> rename = [&](TreeRef node) -> TreeRef {
+      if (node->kind() == TK_IDENT) {
+        auto it = renames.find(Ident(node).name());
+        if (it != renames.end()) {
+          return Ident::create(node->range(), it->second);
+        }
+        return node;
+      }
+      return node->map(rename);
+    };
+    for (const auto& stmt : def.statements()) {
+      statements.push_back(rename(stmt.tree()));
+    }
+  }
+
+  const auto& range = defs.front()->range();
+  return Def::create(
+      range,
+      Ident::create(range, name),
+      List::create(range, std::move(params)),
+      List::create(range, std::move(returns)),
+      List::create(range, std::move(statements)));
+}
+} // namespace lang
@@ -15,6 +15,8 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <unordered_set>
 
 #include "tc/lang/builtins.h"
@@ -48,6 +50,7 @@ struct TypeInfo {
       TYPE_INFO_OPTION(TK_INT64, Int, 64)
       TYPE_INFO_OPTION(TK_FLOAT, Float, 32)
       TYPE_INFO_OPTION(TK_DOUBLE, Float, 64)
+      TYPE_INFO_OPTION(TK_FLOAT16, Float, 16)
 #undef TYPE_INFO_OPTION
       default:
         throw ErrorReport(scalar_type)
@@ -86,6 +89,8 @@ struct TypeInfo {
             return TK_FLOAT;
           case 64:
             return TK_DOUBLE;
+          case 16:
+            return TK_FLOAT16;
         }
     }
     throw std::runtime_error("Unknown type info?");
@@ -362,6 +367,7 @@ struct Sema {
         checkList(func.statements(), [&](TreeRef r) { return checkStmt(r); });
     auto returns_ =
         checkList(func.returns(), [&](TreeRef r) { return checkReturn(r); });
+    checkAliases(func, statements_);
     auto r =
         Def::create(func.range(), func.name(), params_, returns_, statements_);
     return r;
@@ -392,6 +398,9 @@ struct Sema {
   }
   TreeRef checkParam(TreeRef param) {
     auto p = Param(param);
+    if (p.alias().present()) {
+      throw ErrorReport(param) << "only outputs can alias an input";
+    }
     TreeRef type_ = checkTensorType(p.type());
     insert(env, p.ident(), type_, true);
     live_input_names.insert(p.ident().name());
@@ -402,6 +411,105 @@ struct Sema {
     TreeRef real_type = lookup(env, r.ident(), true);
     return ret;
   }
+  // An output that aliases an input may share its storage: the kernel then
+  // reads the input and writes the output through pointers to the same
+  // elements.  This is only safe if each element of the input is read by
+  // the statement instance that writes the same element of the output and
+  // by no other one, so the output must be defined by a single pointwise
+  // statement, which accesses the input and the output at its own indices
+  // only, and no other statement may read the input.
+  void checkAliases(Def func, TreeRef statements) {
+    std::unordered_set<std::string> aliased;
+    for (auto r : func.returns()) {
+      if (!r.alias().present()) {
+        continue;
+      }
+      auto output = r.ident().name();
+      auto input = r.alias().get();
+      if (inputParameters.count(input.name()) == 0) {
+        throw ErrorReport(input)
+            << output << " aliases " << input.name() << ", not an input";
+      }
+      if (!aliased.insert(input.name()).second) {
+        throw ErrorReport(input)
+            << input.name() << " is aliased by several outputs";
+      }
+      auto inputType = TensorType(lookup(env, input, true));
+      auto outputType = TensorType(lookup(env, r.ident(), true));
+      if (inputType.scalarType() != outputType.scalarType() ||
+          inputType.dims().size() != outputType.dims().size()) {
+        throw ErrorReport(r) << output << " and " << input.name()
+                             << " must have the same type to alias";
+      }
+      size_t definitions = 0;
+      for (auto stmt : ListView<Comprehension>(statements)) {
+        if (stmt.ident().name() == output) {
+          ++definitions;
+          checkAliasedDefinition(stmt, input.name());
+        } else if (accesses(stmt.tree(), input.name())) {
+          throw ErrorReport(stmt) << input.name() << " is aliased by "
+                                  << output << " and can only be read by "
+                                  << "the definition of " << output;
+        }
+      }
+      if (definitions != 1) {
+        throw ErrorReport(r) << output << " aliases " << input.name()
+                             << " and must be defined by a single statement";
+      }
+    }
+  }
+  void checkAliasedDefinition(Comprehension stmt, const std::string& input) {
+    auto output = stmt.ident().name();
+    auto kind = stmt.assignment()->kind();
+    if (stmt.reductionVariables().size() > 0 ||
+        (kind != '=' && !isNotInplace(stmt.assignment()))) {
+      throw ErrorReport(stmt)
+          << output << " aliases " << input << " and must be assigned "
+          << "pointwise";
+    }
+    for (const auto& wc : stmt.whereClauses()) {
+      if (wc->kind() == TK_RANGE_CONSTRAINT) {
+        throw ErrorReport(wc) << output << " aliases " << input
+                              << " and must be defined over all of "
+                              << input;
+      }
+    }
+    std::function<void(TreeRef)> check = [&](TreeRef tree) {
+      if (tree->kind() == TK_ACCESS) {
+        auto access = Access(tree);
+        auto name = access.name().name();
+        if (name == input || name == output) {
+          auto args = access.arguments();
+          bool pointwise = args.size() == stmt.indices().size();
+          for (size_t i = 0; pointwise && i < args.size(); ++i) {
+            pointwise = args[i]->kind() == TK_IDENT &&
+                Ident(args[i]).name() == stmt.indices()[i].name();
+          }
+          if (!pointwise) {
+            throw ErrorReport(tree)
+                << output << " aliases " << input << " so " << name
+                << " can only be accessed at the indices of " << output;
+          }
+        }
+      }
+      for (const auto& t : tree->trees()) {
+        check(t);
+      }
+    };
+    check(stmt.rhs());
+    check(stmt.whereClauses().tree());
+  }
+  static bool accesses(TreeRef tree, const std::string& name) {
+    if (tree->kind() == TK_ACCESS && Access(tree).name().name() == name) {
+      return true;
+    }
+    for (const auto& t : tree->trees()) {
+      if (accesses(t, name)) {
+        return true;
+      }
+    }
+    return false;
+  }
   TreeRef checkList(TreeRef list, std::function<TreeRef(TreeRef)> fn) {
     TC_ASSERT(list, list->kind() == TK_LIST);
     TreeList r;
@@ -411,6 +519,14 @@ struct Sema {
     return List::create(list->range(), std::move(r));
   }
   TreeRef checkRangeConstraint(RangeConstraint rc) {
+    // the bounds of a ragged range differ from one instance of the
+    // indices of the tensor to the next, so it can only constrain
+    // a reduction index
+    if (rc.ragged() && lookup(index_env, rc.ident(), false)) {
+      throw ErrorReport(rc)
+          << "ragged range of " << rc.ident().name()
+          << " can only constrain a reduction index";
+    }
     // RCs are checked _before_ the rhs of the TC, so
     // it is possible the index is not in the environment yet
     // calling lookupOrCreate ensures it exists
@@ -418,9 +534,35 @@ struct Sema {
     // calling looking directly in the index_env ensures that
     // we are actually constraining an index and not some other variable
     lookup(index_env, rc.ident(), true);
-    auto s = expectIntegral(checkExp(rc.start(), false));
-    auto e = expectIntegral(checkExp(rc.end(), false));
-    return RangeConstraint::create(rc.range(), rc.ident(), s, e);
+    // only ragged ranges may read tensors, their length is bounded by
+    // the maximal length
+    auto s = expectIntegral(checkExp(rc.start(), rc.ragged()));
+    auto e = expectIntegral(checkExp(rc.end(), rc.ragged()));
+    if (!rc.ragged()) {
+      return RangeConstraint::create(rc.range(), rc.ident(), s, e);
+    }
+    auto maxLength = rc.maxLength();
+    auto m = expectIntegral(checkExp(maxLength.get(), false));
+    return RangeConstraint::create(
+        rc.range(), rc.ident(), s, e, c(TK_OPTION, maxLength.range(), {m}));
+  }
+  TreeRef checkConstraint(Constraint c) {
+    auto exp = c.exp();
+    switch (exp->kind()) {
+      case TK_GE:
+      case TK_LE:
+      case '<':
+      case '>':
+        break;
+      default:
+        throw ErrorReport(exp)
+            << "expected a comparison of index expressions but found "
+            << kindToString(exp->kind());
+    }
+    auto nexp = checkExp(exp, false);
+    expectIntegral(nexp->tree(0));
+    expectIntegral(nexp->tree(1));
+    return Constraint::create(c.range(), nexp);
   }
   TreeRef checkLet(Let l) {
     auto rhs = checkExp(l.rhs(), true);
@@ -433,6 +575,8 @@ struct Sema {
     } else if (ref->kind() == TK_EXISTS) {
       auto exp = checkExp(Exists(ref).exp(), true);
       return Exists::create(ref->range(), exp);
+    } else if (ref->kind() == TK_CONSTRAINT) {
+      return checkConstraint(Constraint(ref));
     } else {
       return checkRangeConstraint(RangeConstraint(ref));
     }
@@ -472,6 +616,19 @@ struct Sema {
     // with a type (e.g. float(A,B)) then force the tensor to be that type
     // and check that the number of dimensions are consistent
     auto output_annotation = annotated_output_types.find(stmt.ident().name());
+
+    // Sums of 8 and 16-bit integers defining a tensor accumulate in 32 bits,
+    // e.g. the int8 x int8 products of quantized matmuls in int32, unless
+    // the output is explicitly declared with a narrower type.
+    bool narrowOutput = output_annotation != annotated_output_types.end() &&
+        TypeInfo(TensorType(output_annotation->second).scalarTypeTree())
+                .bits() < 32;
+    if (isSum(stmt.assignment()) && isNarrowInteger(scalar_type) &&
+        !narrowOutput && !lookup(env, stmt.ident(), false)) {
+      auto widened = TypeInfo(TypeInfo(scalar_type).code(), 32);
+      scalar_type = c(widened.toScalarToken(), scalar_type->range(), {});
+      rhs_ = widenTerms(rhs_, scalar_type);
+    }
     if (output_annotation != annotated_output_types.end()) {
       auto tt = TensorType(output_annotation->second);
       auto matched_type = match_types(scalar_type, tt.scalarTypeTree());
@@ -505,6 +662,50 @@ struct Sema {
       return Equivalent::create(eq.range(), eq.name(), indices_);
     });
 
+    // constraints are predicates of the reduction domain, they do not
+    // restrict the tensor that is written
+    for (const auto& wc : where_clauses_->trees()) {
+      if (wc->kind() == TK_CONSTRAINT && reduction_variables.size() == 0) {
+        throw ErrorReport(wc)
+            << "constraints can only be used in statements with reduction "
+            << "variables";
+      }
+    }
+
+    // an index of the lhs bound by a let is the index of a scatter, the
+    // statement reduces into the elements selected by the value of the
+    // binding, whose range cannot be inferred
+    for (const auto& wc : where_clauses_->trees()) {
+      if (wc->kind() != TK_LET) {
+        continue;
+      }
+      auto let = Let(wc);
+      auto name = let.name().name();
+      auto isIndex = [&name](const Ident& index) {
+        return index.name() == name;
+      };
+      if (std::none_of(
+              stmt.indices().begin(), stmt.indices().end(), isIndex)) {
+        continue;
+      }
+      expectIntegral(let.rhs());
+      if (reduction_variables.size() == 0) {
+        throw ErrorReport(wc) << "scatter through " << name
+                              << " must reduce over the indices of its value";
+      }
+      auto isRange = [&name](const TreeRef& rc) {
+        return rc->kind() == TK_RANGE_CONSTRAINT &&
+            RangeConstraint(rc).ident().name() == name;
+      };
+      if (std::none_of(
+              where_clauses_->trees().begin(),
+              where_clauses_->trees().end(),
+              isRange)) {
+        throw ErrorReport(wc)
+            << "scatter index " << name << " needs a range constraint";
+      }
+    }
+
     TreeRef assignment = stmt.assignment();
     // For semantic consistency we allow overwriting reductions like +=!
     // to be used in the language when there are no actual reduction dimensions.
@@ -532,10 +733,17 @@ struct Sema {
         equivalent_statement_,
         reduction_variable_list);
 
-    if (nonTemporaries.count(stmt.ident().name()) == 0) {
-      throw ErrorReport(stmt)
-          << stmt.ident().name()
-          << " is not listed as an input or output to this function. Temporaries tensors are not yet implemented";
+    // Tensors that are neither inputs nor outputs are temporaries, which
+    // hold no values before their first definition.
+    if (nonTemporaries.count(name) == 0 && temporaries.count(name) == 0) {
+      auto kind = stmt.assignment()->kind();
+      if (kind != '=' && !isNotInplace(stmt.assignment())) {
+        throw ErrorReport(stmt)
+            << "temporary " << name
+            << " is reduced before being initialized, use a reduction "
+            << "with initialization (e.g. +=!) instead";
+      }
+      temporaries.insert(name);
     }
 
     // clear the per-statement environments to get ready for the next statement
@@ -544,6 +752,32 @@ struct Sema {
 
     return result;
   }
+  bool isSum(TreeRef assignment) {
+    return assignment->kind() == TK_PLUS_EQ ||
+        assignment->kind() == TK_PLUS_EQ_B;
+  }
+  bool isNarrowInteger(TreeRef type) {
+    TypeInfo t(type);
+    return !t.is_float() && t.bits() > 1 && t.bits() < 32;
+  }
+  // Cast the terms of the additions, subtractions and multiplications of
+  // "exp" to "type" so that they are computed in that type rather than
+  // overflowing in the narrower type of the terms.
+  TreeRef widenTerms(TreeRef exp, TreeRef type) {
+    switch (exp->kind()) {
+      case '+':
+      case '-':
+      case '*': {
+        auto nexp = exp->map([&](TreeRef e) { return widenTerms(e, type); });
+        return withType(nexp, type);
+      }
+      default:
+        if (typeOfExpr(exp)->kind() == type->kind()) {
+          return exp;
+        }
+        return withType(Cast::create(exp->range(), exp, type), type);
+    }
+  }
   bool isNotInplace(TreeRef assignment) {
     switch (assignment->kind()) {
       case TK_PLUS_EQ_B:
@@ -623,5 +857,6 @@ struct Sema {
 
   std::unordered_set<std::string> inputParameters;
   std::unordered_set<std::string> nonTemporaries;
+  std::unordered_set<std::string> temporaries;
 };
 } // namespace lang
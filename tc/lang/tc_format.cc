@@ -21,6 +21,10 @@ namespace lang {
 namespace {
 
 void showExpr(std::ostream& s, const TreeRef& expr);
+void showWhereClause(std::ostream& s, const TreeRef& wc);
+// Declared before show, which cannot find them by argument dependent lookup.
+std::ostream& operator<<(std::ostream& s, const Ident& id);
+std::ostream& operator<<(std::ostream& s, const Param& p);
 
 template <typename T>
 void show(std::ostream& s, T x) {
@@ -56,21 +60,66 @@ std::ostream& operator<<(std::ostream& s, const Param& p) {
     showList(s, type.dims(), showExpr);
     s << ") ";
   }
-  return s << p.ident();
+  s << p.ident();
+  if (p.alias().present()) {
+    s << " aliases " << p.alias().get();
+  }
+  return s;
 }
 
 std::ostream& operator<<(std::ostream& s, const Comprehension& comp) {
   s << comp.ident() << "(" << comp.indices() << ") "
     << kindToToken(comp.assignment()->kind()) << " ";
   showExpr(s, comp.rhs());
-  if (!comp.whereClauses().empty())
-    throw std::runtime_error("Printing of where clauses is not supported yet");
-  if (comp.equivalent().present())
-    throw std::runtime_error(
-        "Printing of equivalent comprehensions is not supported yet");
+  if (comp.equivalent().present()) {
+    auto eq = comp.equivalent().get();
+    s << " <=> " << eq.name() << "(";
+    showList(s, eq.accesses(), showExpr);
+    s << ")";
+  }
+  if (!comp.whereClauses().empty()) {
+    s << " where ";
+    showList(s, comp.whereClauses(), showWhereClause);
+  }
   return s;
 }
 
+void showWhereClause(std::ostream& s, const TreeRef& wc) {
+  switch (wc->kind()) {
+    case TK_LET: {
+      Let let{wc};
+      s << let.name() << " = ";
+      showExpr(s, let.rhs());
+      break;
+    }
+    case TK_RANGE_CONSTRAINT: {
+      RangeConstraint rc{wc};
+      s << rc.ident() << " in ";
+      showExpr(s, rc.start());
+      s << ":";
+      showExpr(s, rc.end());
+      if (rc.ragged()) {
+        s << ":";
+        showExpr(s, rc.maxLength().get());
+      }
+      break;
+    }
+    case TK_EXISTS: {
+      s << "exists ";
+      showExpr(s, Exists(wc).exp());
+      break;
+    }
+    case TK_CONSTRAINT: {
+      showExpr(s, Constraint(wc).exp());
+      break;
+    }
+    default: {
+      throw std::runtime_error(
+          "Unexpected kind in showWhereClause: " + kindToString(wc->kind()));
+    }
+  }
+}
+
 void showExpr(std::ostream& s, const TreeRef& expr) {
   switch (expr->kind()) {
     case TK_IDENT: {
@@ -114,6 +163,16 @@ void showExpr(std::ostream& s, const TreeRef& expr) {
       showExpr(s, expr->tree(0));
       break;
     }
+    case '?': {
+      s << "(";
+      showExpr(s, expr->tree(0));
+      s << " ? ";
+      showExpr(s, expr->tree(1));
+      s << " : ";
+      showExpr(s, expr->tree(2));
+      s << ")";
+      break;
+    }
     case TK_CONST: {
       Const con{expr};
       int scalarType = con.type()->kind();
@@ -32,7 +32,9 @@ namespace lang {
 // -- NB: dim_list can only contain Const and Ident trees
 // -- NB: dim_list is optional (can be empty)
 // Type  = TensorType(ScalarType scalar_type, List<Expr> dim_list)      TK_TENSOR_TYPE
-// Param = Param(Ident name, Type type)                                 TK_PARAM
+// -- NB: alias is only present on outputs, which may then share the storage
+// --     of the named input
+// Param = Param(Ident name, Type type, Option<Ident> alias)            TK_PARAM
 //
 // Def   = Def(Ident name, List<Param> params, List<Param> returns, List<Stmt> body) TK_DEF
 //
@@ -44,8 +46,10 @@ namespace lang {
 //                       List<Ident> reduction_variables)
 //
 // WhereClause = Let(Ident name, Expr expr)                             TK_LET
-//             | RangeConstraint(Ident name, Expr l, Expr r)            TK_RANGE_CONSTRAINT
+//             | RangeConstraint(Ident name, Expr l, Expr r,            TK_RANGE_CONSTRAINT
+//                               Option<Expr> max_length)
 //             | Exists(Expr expr)                                      TK_EXISTS
+//             | Constraint(Expr expr)                                  TK_CONSTRAINT
 //
 // Equivalent = Equivalent(String name, List<Expr> accesses)            TK_EQUIVALENT
 //
@@ -88,6 +92,7 @@ namespace lang {
 //            | Bool()                                                  TK_BOOL
 //            | Float()                                                 TK_FLOAT
 //            | Double()                                                TK_DOUBLE
+//            | Float16()                                               TK_FLOAT16
 //
 // AssignKind = PlusEq()                                                TK_PLUS_EQ
 //            | TimesEq()                                               TK_TIMES_EQ
@@ -292,10 +297,17 @@ struct TensorType : public TreeView {
 
 struct Param : public TreeView {
   explicit Param(const TreeRef& tree) : TreeView(tree) {
-    tree_->expect(TK_PARAM, 2);
+    tree_->expect(TK_PARAM, 3);
   }
   static TreeRef create(const SourceRange& range, TreeRef ident, TreeRef type) {
-    return Compound::create(TK_PARAM, range, {ident, type});
+    return create(range, ident, type, Compound::create(TK_OPTION, range, {}));
+  }
+  static TreeRef create(
+      const SourceRange& range,
+      TreeRef ident,
+      TreeRef type,
+      TreeRef alias) {
+    return Compound::create(TK_PARAM, range, {ident, type, alias});
   }
   // when the type of a field is statically know the accessors return
   // the wrapped type. for instance here we know ident_ is an identifier
@@ -316,6 +328,10 @@ struct Param : public TreeView {
   TensorType tensorType() const {
     return TensorType(type());
   }
+  // the input whose storage an output may reuse, e.g. I in -> (O aliases I)
+  OptionView<Ident> alias() const {
+    return OptionView<Ident>(subtree(2));
+  }
 };
 
 struct Equivalent : public TreeView {
@@ -335,13 +351,27 @@ struct Equivalent : public TreeView {
   }
 };
 
+// A range constraint with a maximal length, written "k in l:r:max_length",
+// is ragged: its bounds may read tensors, e.g., offsets of segments, and
+// differ from one instance of the other indices to the next, as long as
+// they are at most max_length apart.
 struct RangeConstraint : public TreeView {
   explicit RangeConstraint(const TreeRef& tree) : TreeView(tree) {
-    tree->expect(TK_RANGE_CONSTRAINT, 3);
+    tree->expect(TK_RANGE_CONSTRAINT, 4);
   }
   static TreeRef
   create(const SourceRange& range, TreeRef ident, TreeRef start, TreeRef end) {
-    return Compound::create(TK_RANGE_CONSTRAINT, range, {ident, start, end});
+    return create(
+        range, ident, start, end, Compound::create(TK_OPTION, range, {}));
+  }
+  static TreeRef create(
+      const SourceRange& range,
+      TreeRef ident,
+      TreeRef start,
+      TreeRef end,
+      TreeRef maxLength) {
+    return Compound::create(
+        TK_RANGE_CONSTRAINT, range, {ident, start, end, maxLength});
   }
   Ident ident() const {
     return Ident(subtree(0));
@@ -352,6 +382,12 @@ struct RangeConstraint : public TreeView {
   TreeRef end() const {
     return subtree(2);
   }
+  OptionView<TreeRef> maxLength() const {
+    return OptionView<TreeRef>(subtree(3));
+  }
+  bool ragged() const {
+    return maxLength().present();
+  }
 };
 
 struct Comprehension : public TreeView {
@@ -510,4 +546,18 @@ struct Exists : public TreeView {
   }
 };
 
+// An affine comparison between index variables, e.g., j <= i, that
+// restricts the iteration domain of a reduction.
+struct Constraint : public TreeView {
+  explicit Constraint(const TreeRef& tree) : TreeView(tree) {
+    tree_->expect(TK_CONSTRAINT, 1);
+  }
+  TreeRef exp() const {
+    return subtree(0);
+  }
+  static TreeRef create(const SourceRange& range, TreeRef exp) {
+    return Compound::create(TK_CONSTRAINT, range, {exp});
+  }
+};
+
 } // namespace lang
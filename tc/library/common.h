@@ -15,6 +15,16 @@
  */
 #pragma once
 
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "tc/lang/parser.h"
+#include "tc/lang/tc_format.h"
+#include "tc/lang/tree_views.h"
+
 namespace tc {
 
 std::string replaceString(
@@ -28,4 +38,138 @@ std::string replaceString(
   }
   return str;
 }
+
+/// A pointwise operation applied to the output of the last statement of a
+/// TC (see fuseEpilogue).  expr is the new value of the output, a TC
+/// expression in which ${O} stands for its current value and ${X}, for each
+/// input X, for the element of X at the indices of the output dimensions
+/// dims of X.  The inputs are additional inputs of the TC.
+struct PostOp {
+  struct Input {
+    std::string name;
+    std::vector<size_t> dims;
+  };
+  std::string expr;
+  std::vector<Input> inputs;
+};
+
+/// Adds the 1D tensor "name" along dimension dim of the output, e.g. the
+/// bias of the output channels.
+inline PostOp biasPostOp(const std::string& name, size_t dim) {
+  return PostOp{"${O} + ${" + name + "}", {{name, {dim}}}};
+}
+
+inline PostOp reluPostOp() {
+  return PostOp{"fmax(${O}, 0)", {}};
+}
+
+/// Adds the tensor "name" of the same rank as the output, e.g. the input of
+/// a residual block.
+inline PostOp residualPostOp(const std::string& name, size_t rank) {
+  std::vector<size_t> dims;
+  for (size_t d = 0; d < rank; ++d) {
+    dims.push_back(d);
+  }
+  return PostOp{"${O} + ${" + name + "}", {{name, dims}}};
+}
+
+/// The TC with the post-ops applied in order to the output of its last
+/// statement, as pointwise statements updating that output in place, like
+/// the hand-written TC_FCRELU.  The mapper fuses them with the statement
+/// computing the output, which applies them to the values in registers
+/// before they are stored.  The inputs of the post-ops are appended to the
+/// parameters, of the scalar type of the first parameter, with sizes named
+/// after them, e.g. a bias B of size B_0.
+inline std::string fuseEpilogue(
+    const std::string& tc,
+    const std::vector<PostOp>& postOps) {
+  if (postOps.empty()) {
+    return tc;
+  }
+  lang::Def def(lang::Parser(tc).parseFunction());
+  auto numStatements = def.statements().size();
+  CHECK_GT(numStatements, 0u) << "No statement to fuse an epilogue with";
+  auto last = def.statements()[numStatements - 1];
+  auto output = last.ident().name();
+  bool returned = false;
+  for (const auto& ret : def.returns()) {
+    returned = returned || ret.ident().name() == output;
+  }
+  CHECK(returned) << "The last statement of " << def.name().name()
+                  << " does not compute an output";
+  std::vector<std::string> indices;
+  for (const auto& index : last.indices()) {
+    indices.push_back(index.name());
+  }
+  auto scalarType = def.params().size() > 0
+      ? lang::kindToString(def.params()[0].tensorType().scalarType())
+      : std::string("float");
+  auto access = [](const std::string& name,
+                   const std::vector<std::string>& args) -> std::string {
+    std::string res = name + "(";
+    for (size_t i = 0; i < args.size(); ++i) {
+      res += (i > 0 ? ", " : "") + args[i];
+    }
+    return res + ")";
+  };
+
+  // The post-ops as a TC of their own, appended to the original one.
+  std::vector<std::string> params;
+  std::stringstream statements;
+  auto value = access(output, indices);
+  for (const auto& postOp : postOps) {
+    auto expr = replaceString(postOp.expr, "${O}", value);
+    for (const auto& input : postOp.inputs) {
+      std::vector<std::string> sizes;
+      std::vector<std::string> inputIndices;
+      for (auto dim : input.dims) {
+        CHECK_LT(dim, indices.size())
+            << "Post-op input " << input.name << " indexed by dimension "
+            << dim << " of the " << indices.size() << "D output " << output;
+        sizes.push_back(input.name + "_" + std::to_string(sizes.size()));
+        inputIndices.push_back(indices[dim]);
+      }
+      params.push_back(scalarType + access("", sizes) + " " + input.name);
+      expr = replaceString(
+          expr, "${" + input.name + "}", access(input.name, inputIndices));
+    }
+    statements << "  " << value << " = " << expr << "\n";
+  }
+  std::string source = "def epilogue(";
+  for (size_t i = 0; i < params.size(); ++i) {
+    source += (i > 0 ? ", " : "") + params[i];
+  }
+  source += ") -> (" + output + ") {\n" + statements.str() + "}\n";
+  lang::Def epilogue(lang::Parser(source).parseFunction());
+
+  lang::TreeList allParams;
+  lang::TreeList allReturns;
+  lang::TreeList allStatements;
+  for (const auto& param : def.params()) {
+    allParams.push_back(param.tree());
+  }
+  for (const auto& param : epilogue.params()) {
+    allParams.push_back(param.tree());
+  }
+  for (const auto& ret : def.returns()) {
+    allReturns.push_back(ret.tree());
+  }
+  for (const auto& stmt : def.statements()) {
+    allStatements.push_back(stmt.tree());
+  }
+  for (const auto& stmt : epilogue.statements()) {
+    allStatements.push_back(stmt.tree());
+  }
+  const auto& range = def.range();
+  std::stringstream res;
+  lang::tcFormat(
+      res,
+      lang::Def::create(
+          range,
+          def.name().tree(),
+          lang::List::create(range, std::move(allParams)),
+          lang::List::create(range, std::move(allReturns)),
+          lang::List::create(range, std::move(allStatements))));
+  return res.str();
+}
 } // namespace tc
@@ -23,6 +23,9 @@ constexpr static auto CONVOLUTION2D_TC_NAME = "convolution";
 
 constexpr static auto CONVOLUTION2D_GRAD_TC_NAME = "convolution2dGrad";
 
+constexpr static auto CONVOLUTION2D_IMPLICIT_GEMM_TC_NAME =
+    "convolution_implicit_gemm";
+
 namespace {
 constexpr static auto CONVOLUTION2D_TC = R"TC(
   def convolution(float(N,C,H,W) I, float(M,C,KH,KW) W1, float(M) B) -> (O) {
@@ -31,6 +34,25 @@ constexpr static auto CONVOLUTION2D_TC = R"TC(
   }
 )TC";
 
+// The convolution as a GEMM of the filters and of the im2col matrix of I,
+// whose rows are never built: r flattens the reduction over (c, kh, kw),
+// which the mapper tiles like the reduction of a matmul, and the tiles of I
+// promoted to shared memory are the tiles of the im2col matrix.  The filter
+// sizes are constants, the subscripts are quasi-affine.
+constexpr static auto CONVOLUTION2D_IMPLICIT_GEMM_TC = R"TC(
+  def convolution_implicit_gemm(float(N,C,H,W) I, float(M,C,${kh},${kw}) W1, float(M) B)
+  -> (O)
+  {
+    O(n, m, h, w) +=!
+      I(n, r / ${khkw}, ${sh} * h + r / ${kw} - ${kh} * (r / ${khkw}), ${sw} * w + r - ${kw} * (r / ${kw}))
+      * W1(m, r / ${khkw}, r / ${kw} - ${kh} * (r / ${khkw}), r - ${kw} * (r / ${kw}))
+      where r in 0:${khkw} * C,
+            h in 0:(H - ${kh}) / ${sh} + 1,
+            w in 0:(W - ${kw}) / ${sw} + 1
+    O(n, m, h, w) = O(n, m, h, w) + B(m)
+  }
+)TC";
+
 constexpr static auto CONVOLUTION2D_GRAD_TC = R"TC(
   def convolution2dGrad(float(N,C,H,W) I, float(M,C,KH,KW) W1, float(N,M,H,W) O_grad) -> (I_grad, W1_grad, B_grad) {
     I_grad(n, c, h, w) +=! O_grad(n, m, ${sh} * h - kh, ${sw} * w - kw) * W1(m, c, kh, kw)
@@ -40,13 +62,38 @@ constexpr static auto CONVOLUTION2D_GRAD_TC = R"TC(
 )TC";
 } // namespace
 
-std::string makeConvolution2DTc(int strideH, int strideW) {
+// The post-ops, if any, apply to the output after the bias (see
+// fuseEpilogue).
+std::string makeConvolution2DTc(
+    int strideH,
+    int strideW,
+    const std::vector<PostOp>& epilogue = {}) {
   CHECK(strideH > 0 && strideW > 0) << "Stride must be greater than 0";
   std::string tcStr;
   tcStr = CONVOLUTION2D_TC;
   tcStr = replaceString(tcStr, "${sh}", std::to_string(strideH));
   tcStr = replaceString(tcStr, "${sw}", std::to_string(strideW));
-  return tcStr;
+  return fuseEpilogue(tcStr, epilogue);
+}
+
+// Same as makeConvolution2DTc, computed as an implicit GEMM (see
+// CONVOLUTION2D_IMPLICIT_GEMM_TC) for filters of kernelH x kernelW.
+std::string makeConvolution2DImplicitGemmTc(
+    int strideH,
+    int strideW,
+    int kernelH,
+    int kernelW,
+    const std::vector<PostOp>& epilogue = {}) {
+  CHECK(strideH > 0 && strideW > 0) << "Stride must be greater than 0";
+  CHECK(kernelH > 0 && kernelW > 0) << "Kernel must be greater than 0";
+  std::string tcStr;
+  tcStr = CONVOLUTION2D_IMPLICIT_GEMM_TC;
+  tcStr = replaceString(tcStr, "${sh}", std::to_string(strideH));
+  tcStr = replaceString(tcStr, "${sw}", std::to_string(strideW));
+  tcStr = replaceString(tcStr, "${khkw}", std::to_string(kernelH * kernelW));
+  tcStr = replaceString(tcStr, "${kh}", std::to_string(kernelH));
+  tcStr = replaceString(tcStr, "${kw}", std::to_string(kernelW));
+  return fuseEpilogue(tcStr, epilogue);
 }
 
 std::string makeConvolution2DGradTc(int strideH, int strideW) {
@@ -27,4 +27,13 @@ constexpr static auto TC_FCRELU = R"TC(
   }
 )TC";
 
+constexpr static auto TC_FC_NAME = "func_fc";
+
+constexpr static auto TC_FC = R"TC(
+  def func_fc(float(B,M) I, float(N,M) W1, float(N) B1) -> (O1) {
+    O1(b, n) +=! I(b, m) * W1(n, m)
+    O1(b, n) = O1(b, n) + B1(n)
+  }
+)TC";
+
 } // namespace tc
@@ -48,13 +48,18 @@ constexpr static auto GROUP_CONVOLUTION2D_GRAD_TC = R"TC(
 )TC";
 } // namespace
 
-std::string makeGroupConvolution2DTc(int strideH, int strideW) {
+// The post-ops, if any, apply to the output after the bias (see
+// fuseEpilogue).
+std::string makeGroupConvolution2DTc(
+    int strideH,
+    int strideW,
+    const std::vector<PostOp>& epilogue = {}) {
   CHECK(strideH > 0 && strideW > 0) << "Stride must be greater than 0";
   std::string tcStr;
   tcStr = GROUP_CONVOLUTION2D_TC;
   tcStr = replaceString(tcStr, "<sh>", std::to_string(strideH));
   tcStr = replaceString(tcStr, "<sw>", std::to_string(strideW));
-  return tcStr;
+  return fuseEpilogue(tcStr, epilogue);
 }
 
 std::string makeGroupConvolution2DGradTc(int strideH, int strideW) {
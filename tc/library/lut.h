@@ -25,4 +25,14 @@ static constexpr auto TC_LUT = R"TC(
    }
  )TC";
 
+static constexpr auto TC_LUT_BACKWARD_NAME = "lut_backward";
+
+// The gradient of the table of the lookup, a scatter reduction of the
+// gradient of the output into the rows of the table selected by the indices.
+static constexpr auto TC_LUT_BACKWARD = R"TC(
+   def lut_backward(float(E, D) LUT, int32(B, L) I, float(B, D) d_O) -> (d_LUT) {
+     d_LUT(e, j) +=! d_O(i, j) where e = I(i, k), e in 0:E
+   }
+ )TC";
+
 } // namespace tc
@@ -29,9 +29,11 @@ static constexpr auto TC_MATMUL = R"TC(
 )TC";
 } // namespace
 
+// The post-ops, if any, apply to the output (see fuseEpilogue).
 std::string makeMatmulTc(
     bool transposeFirst = false,
-    bool transposeSecond = false) {
+    bool transposeSecond = false,
+    const std::vector<PostOp>& epilogue = {}) {
   std::string tc(TC_MATMUL);
   tc = replaceString(tc, "${szA0}", (transposeFirst ? "K" : "N"));
   tc = replaceString(tc, "${szA1}", (transposeFirst ? "N" : "K"));
@@ -41,6 +43,6 @@ std::string makeMatmulTc(
   tc = replaceString(tc, "${itA1}", (transposeFirst ? "i" : "k"));
   tc = replaceString(tc, "${itB0}", (transposeSecond ? "j" : "k"));
   tc = replaceString(tc, "${itB1}", (transposeSecond ? "k" : "j"));
-  return tc;
+  return fuseEpilogue(tc, epilogue);
 }
 } // namespace tc
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "tc/library/common.h"
+
+namespace tc {
+
+constexpr static auto CONVOLUTION2D_WINOGRAD_TC_NAME = "convolution_winograd";
+
+// The transforms of the Winograd convolution F(2x2, 3x3), row-major, the
+// values of the inputs Bt, G and At of CONVOLUTION2D_WINOGRAD_TC.
+constexpr static float WINOGRAD_F2X2_3X3_BT[4 * 4] = {
+    1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 1, 0, 0, 1, 0, -1};
+constexpr static float WINOGRAD_F2X2_3X3_G[4 * 3] = {
+    1, 0, 0, 0.5, 0.5, 0.5, 0.5, -0.5, 0.5, 0, 0, 1};
+constexpr static float WINOGRAD_F2X2_3X3_AT[2 * 4] = {1, 1, 1, 0, 0, 1, -1, -1};
+
+namespace {
+// The stride 1 convolution by 3x3 filters as a pipeline of the Winograd
+// algorithm F(2x2, 3x3): the filters U and the 4x4 input tiles V, which
+// overlap by 2, are transformed, multiplied by a batched GEMM over the 16
+// points (a, b) of the tiles, and the 2x2 output tiles are transformed back.
+// 4 multiplications per output instead of 9.  The output sizes H - 2 and
+// W - 2 must be even, the last tiles are not padded.
+constexpr static auto CONVOLUTION2D_WINOGRAD_TC = R"TC(
+  def convolution_winograd(float(N,C,H,W) I, float(M,C,3,3) W1, float(M) B,
+                           float(4,4) Bt, float(4,3) G, float(2,4) At)
+  -> (O)
+  {
+    U(m, c, a, b) +=! G(a, i) * W1(m, c, i, j) * G(b, j)
+    V(n, c, th, tw, a, b) +=!
+      Bt(a, i) * I(n, c, 2 * th + i, 2 * tw + j) * Bt(b, j)
+      where th in 0:(H - 2) / 2, tw in 0:(W - 2) / 2
+    Mt(n, m, th, tw, a, b) +=! U(m, c, a, b) * V(n, c, th, tw, a, b)
+    O(n, m, h, w) +=!
+      At(h - 2 * (h / 2), a) * Mt(n, m, h / 2, w / 2, a, b)
+      * At(w - 2 * (w / 2), b)
+      where h in 0:H - 2, w in 0:W - 2
+    O(n, m, h, w) = O(n, m, h, w) + B(m)
+  }
+)TC";
+} // namespace
+
+// Same as makeConvolution2DTc(1, 1) for 3x3 filters, computed as a Winograd
+// F(2x2, 3x3) convolution (see CONVOLUTION2D_WINOGRAD_TC).  The TC takes the
+// transforms WINOGRAD_F2X2_3X3_* as inputs after the bias and before the
+// inputs of the post-ops.
+std::string makeConvolution2DWinogradTc(
+    const std::vector<PostOp>& epilogue = {}) {
+  return fuseEpilogue(CONVOLUTION2D_WINOGRAD_TC, epilogue);
+}
+} // namespace tc
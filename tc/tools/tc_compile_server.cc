@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_compile_server.h"
+#include "tc/core/flags.h"
+
+DEFINE_string(
+    socket,
+    "",
+    "Unix socket to serve the compile requests on, the serving processes select this server with --cuda_compile_server=<socket>");
+DEFINE_uint32(
+    threads,
+    0,
+    "Number of compilation threads, defaults to the number of cores");
+DEFINE_string(
+    cuda_cache,
+    "",
+    "CacheFile shared with the other processes of the host (see CudaCache::loadSharedCacheFromFile) the kernels are looked up in and added to, the server keeps them in memory only if empty");
+
+int main(int argc, char** argv) {
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_socket.empty()) << "--socket is required";
+  CHECK(tc::FLAGS_cuda_compile_server.empty())
+      << "a compile server does not send its requests to another one";
+
+  if (FLAGS_cuda_cache.empty()) {
+    tc::CudaCache::enableCache();
+  } else {
+    tc::CudaCache::loadSharedCacheFromFile(FLAGS_cuda_cache);
+  }
+  auto threads = FLAGS_threads > 0
+      ? FLAGS_threads
+      : std::max(std::thread::hardware_concurrency(), 1u);
+  tc::runCudaCompileServer(FLAGS_socket, threads);
+  return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <compcache.pb.h>
+
+#include "tc/core/cpu/cpu_kernel_object.h"
+#include "tc/core/polyhedral/codegen_llvm.h"
+
+DEFINE_string(tc, "", "File holding the TC definitions to compile");
+DEFINE_string(
+    options_cache,
+    "",
+    "Serialized CpuOptionsCacheProto holding the tuned options, the best options of each entry whose id is a definition of --tc are compiled");
+DEFINE_string(output, "", "Object file the kernels are written to");
+DEFINE_string(
+    shared_library,
+    "",
+    "If set, the object is also linked into this shared library, against --runtime");
+DEFINE_string(linker, "c++", "Compiler driver linking --shared_library");
+DEFINE_string(
+    runtime,
+    "",
+    "Path of libtc_core_cpu_runtime.a, which defines the runtime of the parallel loops, linked into --shared_library");
+DEFINE_string(
+    header,
+    "",
+    "If set, C declarations of the kernels' packed entry points are written to this file");
+
+namespace {
+void writeHeader(
+    const std::string& filename,
+    const std::vector<std::string>& kernels) {
+  std::ofstream header(filename);
+  CHECK(header) << "could not open " << filename;
+  header << "#pragma once\n\n"
+         << "#ifdef __cplusplus\n"
+         << "extern \"C\" {\n"
+         << "#endif\n\n";
+  for (const auto& kernel : kernels) {
+    header << "void " << kernel << tc::kPackedKernelSuffix
+           << "(void** args);\n";
+  }
+  header << "\n#ifdef __cplusplus\n"
+         << "}\n"
+         << "#endif\n";
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_tc.empty()) << "--tc is required";
+  CHECK(!FLAGS_options_cache.empty()) << "--options_cache is required";
+  CHECK(!FLAGS_output.empty()) << "--output is required";
+  CHECK(FLAGS_shared_library.empty() || !FLAGS_runtime.empty())
+      << "--shared_library requires --runtime";
+
+  std::ifstream tcFile(FLAGS_tc);
+  CHECK(tcFile) << "could not open " << FLAGS_tc;
+  std::stringstream tc;
+  tc << tcFile.rdbuf();
+
+  tc::CpuOptionsCacheProto optionsCache;
+  std::ifstream serialized(FLAGS_options_cache, std::ios::binary);
+  CHECK(serialized) << "could not open " << FLAGS_options_cache;
+  CHECK(optionsCache.ParseFromIstream(&serialized))
+      << "could not parse " << FLAGS_options_cache;
+
+  auto kernelObject = tc::compileCpuKernelObject(
+      tc.str(), optionsCache, !FLAGS_shared_library.empty());
+  {
+    std::ofstream output(FLAGS_output, std::ios::binary);
+    CHECK(output) << "could not open " << FLAGS_output;
+    output << kernelObject.object;
+  }
+  LOG(INFO) << "Wrote " << kernelObject.kernels.size() << " kernels to "
+            << FLAGS_output;
+
+  if (!FLAGS_header.empty()) {
+    writeHeader(FLAGS_header, kernelObject.kernels);
+  }
+
+  if (!FLAGS_shared_library.empty()) {
+    std::stringstream command;
+    command << FLAGS_linker << " -shared -o " << FLAGS_shared_library << " "
+            << FLAGS_output << " " << FLAGS_runtime
+            << " -lgflags -lglog -lpthread";
+    LOG(INFO) << command.str();
+    CHECK_EQ(std::system(command.str().c_str()), 0)
+        << "could not link " << FLAGS_shared_library;
+  }
+  return 0;
+}
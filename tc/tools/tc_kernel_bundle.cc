@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <compcache.pb.h>
+
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_kernel_bundle.h"
+#include "tc/core/cuda/cuda_rtc.h"
+
+DEFINE_string(tc, "", "File holding the TC definitions to compile");
+DEFINE_string(
+    options_cache,
+    "",
+    "Serialized OptionsCacheProto holding the tuned options, the best options of each entry whose id is a definition of --tc are compiled");
+DEFINE_string(
+    output,
+    "",
+    "File the bundle is written to, as a serialized CudaKernelBundleProto that CudaKernelBundle::loadCacheFromProtobuf loads");
+DEFINE_string(
+    architectures,
+    "",
+    "Comma separated real architectures to compile cubins for (e.g. sm_60,sm_70), defaults to the current device's");
+
+namespace {
+std::vector<std::string> splitArchitectures(const std::string& s) {
+  std::vector<std::string> res;
+  std::stringstream ss(s);
+  std::string arch;
+  while (std::getline(ss, arch, ',')) {
+    if (!arch.empty()) {
+      res.push_back(arch);
+    }
+  }
+  return res;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_tc.empty()) << "--tc is required";
+  CHECK(!FLAGS_options_cache.empty()) << "--options_cache is required";
+  CHECK(!FLAGS_output.empty()) << "--output is required";
+
+  std::ifstream tcFile(FLAGS_tc);
+  CHECK(tcFile) << "could not open " << FLAGS_tc;
+  std::stringstream tc;
+  tc << tcFile.rdbuf();
+
+  tc::OptionsCacheProto optionsCache;
+  std::ifstream serialized(FLAGS_options_cache, std::ios::binary);
+  CHECK(serialized) << "could not open " << FLAGS_options_cache;
+  CHECK(optionsCache.ParseFromIstream(&serialized))
+      << "could not parse " << FLAGS_options_cache;
+
+  auto architectures = splitArchitectures(FLAGS_architectures);
+  if (architectures.empty()) {
+    architectures.push_back(
+        tc::CudaRTCFunction::CurrentDeviceRealArchitecture());
+  }
+
+  tc::CudaKernelBundle::enableCache();
+  auto numberKernels = tc::compileKernelBundle(
+      *tc::CudaKernelBundle::getCache(),
+      tc.str(),
+      optionsCache,
+      architectures);
+  tc::CudaKernelBundle::dumpCacheToProtobuf(FLAGS_output);
+  LOG(INFO) << "Wrote " << numberKernels << " kernels to " << FLAGS_output;
+  return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <compcache.pb.h>
+#include <version.h>
+
+#include "tc/core/cache_file.h"
+#include "tc/core/cuda/cuda_compilation_cache.h"
+
+DEFINE_string(
+    output,
+    "",
+    "File the merged cache is written to, as a CacheFile that OptionsCache::loadCacheFromFile loads");
+DEFINE_bool(
+    protobuf,
+    false,
+    "Write --output as a serialized OptionsCacheProto instead of a CacheFile");
+DEFINE_uint64(
+    keep,
+    0,
+    "Number of best options kept for each kernel, input shapes and device, all if 0");
+DEFINE_string(
+    git_version,
+    "",
+    "Only keep the entries recorded by this version of TC, \"current\" for that of this binary, all if empty");
+
+namespace {
+// The entries of filename, either a CacheFile or a serialized
+// OptionsCacheProto.  The records of the same key in a CacheFile add up, as
+// merging them does.
+tc::OptionsCacheProto readOptionsCache(const std::string& filename) {
+  tc::OptionsCacheProto buf;
+  try {
+    tc::CacheFile file(filename);
+    for (const auto& record : file.records()) {
+      if (not buf.add_entries()->ParseFromArray(record.data, record.size)) {
+        LOG(WARNING) << "Skipping corrupt record in " << filename;
+        buf.mutable_entries()->RemoveLast();
+      }
+    }
+    return buf;
+  } catch (const std::runtime_error&) {
+    // Not a CacheFile.
+  }
+  std::ifstream serialized(filename, std::ios::binary);
+  CHECK(serialized) << "could not open " << filename;
+  CHECK(buf.ParseFromIstream(&serialized)) << "could not parse " << filename;
+  return buf;
+}
+} // namespace
+
+// Merges option caches, e.g. those written by several tuning runs, into a
+// single file with one record per key.
+int main(int argc, char** argv) {
+  ::gflags::SetUsageMessage(
+      "tc_options_cache --output=<file> [flags] <options cache>...");
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_output.empty()) << "--output is required";
+  CHECK_GT(argc, 1) << "no options cache to merge";
+  auto gitVersion = FLAGS_git_version == "current"
+      ? std::string(tc::git_version)
+      : FLAGS_git_version;
+
+  tc::OptionsCache::enableCache();
+  auto cache = tc::OptionsCache::getCache();
+  size_t numberEntries = 0;
+  for (int i = 1; i < argc; ++i) {
+    auto buf = readOptionsCache(argv[i]);
+    auto merged = cache->merge(buf, gitVersion);
+    LOG(INFO) << "Merged " << merged << " of the " << buf.entries_size()
+              << " entries of " << argv[i];
+    numberEntries += buf.entries_size();
+  }
+  if (FLAGS_keep > 0) {
+    cache->keepOnlyBestCandidates(FLAGS_keep);
+  }
+
+  if (FLAGS_protobuf) {
+    tc::OptionsCache::dumpCacheToProtobuf(FLAGS_output);
+  } else {
+    tc::OptionsCache::writeCacheToFile(FLAGS_output);
+  }
+  LOG(INFO) << "Wrote " << cache->size() << " entries with "
+            << cache->totalSize() << " options, out of " << numberEntries
+            << " entries, to " << FLAGS_output;
+  return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "tc/core/cuda/cuda_source_profile.h"
+
+DEFINE_string(
+    source,
+    "",
+    "File holding the CUDA source of the kernel (CudaTcExecutor::cudaSource, printed by --dump_cuda), generated with --cuda_line_info");
+
+namespace {
+// The samples of each line of a source-level profile exported as text, one
+// line of the source per row: its number, then its samples, separated by
+// commas or spaces, e.g. "42,1250".  Other rows, e.g. headers, are skipped,
+// the samples of a line given several times add up.
+std::map<size_t, double> readLineSamples(const std::string& filename) {
+  std::ifstream file(filename);
+  CHECK(file) << "could not open " << filename;
+  std::map<size_t, double> res;
+  std::string row;
+  while (std::getline(file, row)) {
+    for (auto& c : row) {
+      if (c == ',' || c == ';' || c == '\t' || c == '"') {
+        c = ' ';
+      }
+    }
+    std::istringstream ss(row);
+    size_t line;
+    double samples;
+    if (ss >> line >> samples) {
+      res[line] += samples;
+    }
+  }
+  return res;
+}
+} // namespace
+
+// Attributes the samples of a source-level profile of a generated kernel,
+// e.g. those of the source view of Nsight Compute, to the TC statements the
+// lines compute.
+int main(int argc, char** argv) {
+  ::gflags::SetUsageMessage(
+      "tc_source_profile --source=<kernel.cu> <line samples>");
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_source.empty()) << "--source is required";
+  CHECK_EQ(argc, 2) << "expected a single file of line samples";
+
+  std::ifstream file(FLAGS_source);
+  CHECK(file) << "could not open " << FLAGS_source;
+  std::stringstream source;
+  source << file.rdbuf();
+  CHECK_NE(source.str().find(tc::kTcStatementMarker), std::string::npos)
+      << FLAGS_source << " has no statement markers, generate it with "
+      << "--cuda_line_info";
+
+  auto statements =
+      tc::attributeToTcStatements(source.str(), readLineSamples(argv[1]));
+  double total = 0;
+  for (const auto& s : statements) {
+    total += s.samples;
+  }
+  for (const auto& s : statements) {
+    std::cout << std::setw(6) << std::fixed << std::setprecision(2)
+              << 100 * s.samples / total << "%  " << std::setw(12)
+              << std::setprecision(0) << s.samples << "  ";
+    if (s.line == 0) {
+      std::cout << "(loops, copies and synchronizations)";
+    } else {
+      std::cout << "line " << s.line << ": " << s.statement;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "tc/autotuner/distributed_tuning.h"
+#include "tc/autotuner/genetic_tuning_harness.h"
+#include "tc/core/flags.h"
+
+DEFINE_uint32(
+    port,
+    0,
+    "TCP port to serve the autotuning coordinators on, they select this worker with --tuner_workers=<host>:<port>");
+DEFINE_int32(
+    connection_fd,
+    -1,
+    "Serve the coordinator connected through this socket instead of listening on --port, set by the coordinators that start sandboxed workers (see --tuner_sandbox_worker)");
+
+int main(int argc, char** argv) {
+  ::gflags::ParseCommandLineFlags(&argc, &argv, true);
+  ::google::InitGoogleLogging(argv[0]);
+  if (FLAGS_connection_fd >= 0) {
+    auto gpus = tc::autotune::detail::parseGpus();
+    CHECK_EQ(1, gpus.size()) << "A sandboxed worker serves a single GPU";
+    tc::autotune::serveTuningConnection(FLAGS_connection_fd, gpus.front());
+    return 0;
+  }
+  CHECK(FLAGS_port > 0 and FLAGS_port < 65536) << "--port is required";
+
+  // The candidates are evaluated on --tuner_gpus, with the pruning and
+  // benchmarking flags of this process (e.g. --tuner_min_launch_total_threads)
+  tc::autotune::runTuningWorker(
+      static_cast<uint16_t>(FLAGS_port), tc::autotune::detail::parseGpus());
+  return 0;
+}
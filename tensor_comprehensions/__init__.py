@@ -18,6 +18,7 @@ from tensor_comprehensions.tc_unit import define
 from tensor_comprehensions.tc_unit import TcUnit
 from tensor_comprehensions.tc_unit import TcAutotuner
 from tensor_comprehensions.tc_unit import TcCompilationUnit
+from tensor_comprehensions.tc_unit import tune_batch
 from tensor_comprehensions.tc_unit import SetDebugFlags
 from tensor_comprehensions.tc_unit import autotuner_settings
 from tensor_comprehensions.tc_unit import small_sizes_autotuner_settings
@@ -28,5 +29,5 @@ from tensor_comprehensions.library import database
 __all__ = [
     'define', 'TcUnit', 'TcAutotuner', 'TcCompilationUnit', 'autotuner_settings',
     'small_sizes_autotuner_settings', 'SetDebugFlags', 'ATenCompilationUnit',
-    'Options', 'database', 'decode',
+    'Options', 'database', 'decode', 'tune_batch',
 ]
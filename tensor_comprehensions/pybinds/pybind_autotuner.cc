@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 #include <stdint.h>
+#include <chrono>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -28,12 +30,53 @@
 #include "tc/autotuner/genetic_autotuner_aten.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/flags.h"
+#include "tc/core/utils/time.h"
 
 namespace tc {
 namespace python {
 
 namespace py = pybind11;
 
+// The tuner reads its parameters from the global flags and benchmarks on the
+// GPUs of --tuner_gpus, concurrent tunings would race on both, so they are
+// serialized.  Python threads that do not tune keep running.
+std::mutex& tuningMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+namespace {
+// Durations are in microseconds, best is None before the first valid
+// candidate.
+py::dict progressToDict(const tc::autotune::TuningProgress::Snapshot& s) {
+  py::list workers;
+  for (const auto& w : s.workers) {
+    py::dict worker;
+    worker["name"] = w.name;
+    worker["evaluated"] = w.evaluated;
+    worker["valid"] = w.valid;
+    worker["busy_us"] = toMicroseconds(w.busy);
+    worker["utilization"] = w.utilization;
+    workers.append(worker);
+  }
+  py::dict res;
+  res["generation"] = s.generation;
+  res["elapsed_us"] = toMicroseconds(s.elapsed);
+  res["compiled"] = s.compiled;
+  res["evaluated"] = s.evaluated;
+  res["valid"] = s.valid;
+  res["candidates_per_second"] = s.candidatesPerSecond;
+  res["compile_utilization"] = s.compileUtilization;
+  res["workers"] = workers;
+  res["best_us"] = s.best == tc::Duration::max()
+      ? py::object(py::none())
+      : py::object(py::int_(toMicroseconds(s.best)));
+  res["histogram"] =
+      std::vector<size_t>(s.histogram.begin(), s.histogram.end());
+  return res;
+}
+} // namespace
+
 PYBIND11_MODULE(autotuner, m) {
   m.doc() =
       "Python bindings for autotuning the kernels starting from some options";
@@ -110,6 +153,24 @@ PYBIND11_MODULE(autotuner, m) {
             tc::FLAGS_tuner_min_launch_total_threads =
                 tuner_min_launch_total_threads;
           })
+      .def(
+          "time_budget",
+          [](tc::autotune::GeneticAutotunerATen& instance,
+             uint32_t& time_budget) {
+            tc::FLAGS_tuner_time_budget_s = time_budget;
+          })
+      .def(
+          "max_stalled_generations",
+          [](tc::autotune::GeneticAutotunerATen& instance,
+             uint32_t& max_stalled_generations) {
+            tc::FLAGS_tuner_max_stalled_generations = max_stalled_generations;
+          })
+      .def(
+          "target_speedup",
+          [](tc::autotune::GeneticAutotunerATen& instance,
+             double target_speedup) {
+            tc::FLAGS_tuner_target_speedup = target_speedup;
+          })
       .def(
           "tune",
           [dlpack](
@@ -120,6 +181,8 @@ PYBIND11_MODULE(autotuner, m) {
               tc::CudaMappingOptions& baseMapping,
               std::vector<tc::CudaMappingOptions>& startingOptions) {
             std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(tuningMutex());
             auto bestOptions = instance.tune(
                 cacheFileName, tcName, atInputs, baseMapping, startingOptions);
             if (bestOptions) {
@@ -130,6 +193,22 @@ PYBIND11_MODULE(autotuner, m) {
               return baseMapping;
             }
           })
+      .def(
+          "progress",
+          // Does not take the tuning mutex: meant to be called from another
+          // thread while tune runs.
+          [](const tc::autotune::GeneticAutotunerATen& instance) {
+            tc::autotune::TuningProgress::Snapshot snapshot;
+            {
+              py::gil_scoped_release release;
+              snapshot = instance.progress();
+            }
+            return progressToDict(snapshot);
+          },
+          "Progress of the current or last tuning: counts of compiled, "
+          "evaluated and valid candidates, throughput, utilization of the "
+          "compilation threads and of each worker, best runtime and a "
+          "histogram of the runtimes in buckets of powers of 2 us.")
       .def(
           "load",
           [dlpack](
@@ -139,10 +218,54 @@ PYBIND11_MODULE(autotuner, m) {
               py::list& inputs,
               const size_t& numCandidates) {
             std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
+            py::gil_scoped_release release;
             std::vector<tc::CudaMappingOptions> mappingOptions =
                 instance.load(cacheFileName, tcName, atInputs, numCandidates);
             return mappingOptions;
           });
+
+  m.def(
+      "tune_batch",
+      [dlpack](
+          const std::string& cacheFileName,
+          py::list& jobs,
+          py::object onResult) {
+        std::vector<tc::autotune::TuningJob> tuningJobs;
+        for (auto job : jobs) {
+          auto fields = job.cast<py::tuple>();
+          auto inputs = fields[2].cast<py::list>();
+          tuningJobs.push_back(tc::autotune::TuningJob{
+              fields[0].cast<std::string>(),
+              fields[1].cast<std::string>(),
+              getATenTensors(inputs, dlpack),
+              fields[3].cast<tc::CudaMappingOptions>()});
+        }
+        tc::autotune::TuningJobCallback callback;
+        if (!onResult.is_none()) {
+          callback = [&](size_t i,
+                         const llvm::Optional<tc::CudaMappingOptions>& best) {
+            py::gil_scoped_acquire acquire;
+            onResult(i, best ? *best : tuningJobs[i].baseMapping);
+          };
+        }
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(tuningMutex());
+        auto results =
+            tc::autotune::tuneBatch(cacheFileName, tuningJobs, callback);
+        std::vector<tc::CudaMappingOptions> bestOptions;
+        for (size_t i = 0; i < results.size(); ++i) {
+          bestOptions.push_back(
+              results[i] ? *results[i] : tuningJobs[i].baseMapping);
+        }
+        return bestOptions;
+      },
+      "Tunes the (tc, name, inputs, options) jobs into the cache file, the "
+      "jobs with the same cache key are tuned once. on_result, if not None, "
+      "is called with the index and the best options of each job when it is "
+      "tuned.",
+      py::arg("cache_file"),
+      py::arg("jobs"),
+      py::arg("on_result") = py::none());
 }
 
 } // namespace python
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -30,6 +32,7 @@
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
 #include "tc/core/scope_guard.h"
+#include "tc/core/utils/memory.h"
 
 namespace tc {
 namespace python {
@@ -38,6 +41,52 @@ namespace py = pybind11;
 
 using ATenCudaCompilationUnit = tc::ATenCompilationUnit<tc::CudaTcExecutor>;
 
+// A TC and its mapping options, which keeps the calls bound to the input
+// signatures seen so far, so that a call from PyTorch only converts the
+// tensors and launches.  The outputs are allocated by ATen, i.e., by the
+// caching allocator of PyTorch, and the kernels are launched on the current
+// stream of PyTorch.
+// Calls are serialized, concurrent calls of distinct functions compile and
+// run in parallel.
+class BoundFunction {
+ public:
+  BoundFunction(
+      ATenCudaCompilationUnit& unit,
+      const std::string& name,
+      const std::vector<at::Tensor>& inputs,
+      const tc::CudaMappingOptions& options)
+      : unit_(unit), name_(name), options_(options) {
+    calls_.push_back(unit_.bind(name_, inputs, options_));
+  }
+
+  void run(
+      const std::vector<at::Tensor>& inputs,
+      std::vector<at::Tensor>& outputs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tc::CudaRuntimeInformation info(
+        at::globalContext().getCurrentCUDAStream());
+    callFor(inputs).run(inputs, outputs, info);
+  }
+
+ private:
+  ATenCudaCompilationUnit::BoundCall& callFor(
+      const std::vector<at::Tensor>& inputs) {
+    for (auto& call : calls_) {
+      if (call.matches(inputs)) {
+        return call;
+      }
+    }
+    calls_.push_back(unit_.bind(name_, inputs, options_));
+    return calls_.back();
+  }
+
+  ATenCudaCompilationUnit& unit_;
+  std::string name_;
+  tc::CudaMappingOptions options_;
+  std::vector<ATenCudaCompilationUnit::BoundCall> calls_;
+  std::mutex mutex_;
+};
+
 PYBIND11_MODULE(tc, m) {
   m.def("set_logtostderr", [](bool logtostderr) {
     FLAGS_logtostderr = logtostderr;
@@ -67,9 +116,33 @@ PYBIND11_MODULE(tc, m) {
     std::cerr << "\n PyTorch installation is missing, binary will be useless \n"
               << e.what() << std::endl;
   }
+  py::class_<BoundFunction>(m, "BoundFunction")
+      .def(
+          "__call__",
+          [dlpack](
+              BoundFunction& instance, py::list& inputs, py::list& outputs) {
+            std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
+            std::vector<at::Tensor> atOutputs = getATenTensors(outputs, dlpack);
+            {
+              py::gil_scoped_release release;
+              instance.run(atInputs, atOutputs);
+            }
+            if (py::len(outputs) == 0) {
+              convertToPyObjects(atOutputs, dlpack, outputs);
+            }
+          });
   py::class_<ATenCudaCompilationUnit>(m, "ATenCompilationUnit")
       .def(py::init<>())
-      .def("define", &ATenCudaCompilationUnit::define, "Define the TC language")
+      .def(
+          "define",
+          &ATenCudaCompilationUnit::define,
+          "Define the TC language",
+          py::call_guard<py::gil_scoped_release>())
+      .def(
+          "define_gradient",
+          &ATenCudaCompilationUnit::defineGradient,
+          "Define the backward TC of a defined TC",
+          py::call_guard<py::gil_scoped_release>())
       .def(
           "compile",
           [dlpack](
@@ -78,8 +151,24 @@ PYBIND11_MODULE(tc, m) {
               py::list& inputs,
               const tc::CudaMappingOptions& options) {
             std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
+            py::gil_scoped_release release;
             return instance.compile(name, atInputs, options);
           })
+      .def(
+          "bind",
+          [dlpack](
+              ATenCudaCompilationUnit& instance,
+              const std::string& name,
+              py::list& inputs,
+              const tc::CudaMappingOptions& options) {
+            std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
+            py::gil_scoped_release release;
+            return tc::make_unique<BoundFunction>(
+                instance, name, atInputs, options);
+          },
+          "Compile a TC and return the function running it on PyTorch's "
+          "current stream",
+          py::keep_alive<0, 1>())
       .def(
           "run",
           [dlpack](
@@ -90,7 +179,10 @@ PYBIND11_MODULE(tc, m) {
               size_t handle) {
             std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
             std::vector<at::Tensor> atOutputs = getATenTensors(outputs, dlpack);
-            instance.run(name, atInputs, atOutputs, handle);
+            {
+              py::gil_scoped_release release;
+              instance.run(name, atInputs, atOutputs, handle);
+            }
             if (py::len(outputs) == 0) {
               convertToPyObjects(atOutputs, dlpack, outputs);
             }
@@ -105,6 +197,7 @@ PYBIND11_MODULE(tc, m) {
             CHECK_LT(0, outputs.size());
             std::vector<at::Tensor> atInputs = getATenTensors(inputs, dlpack);
             std::vector<at::Tensor> atOutputs = getATenTensors(outputs, dlpack);
+            py::gil_scoped_release release;
             instance.uncheckedRun(atInputs, atOutputs, handle);
           })
       .def(
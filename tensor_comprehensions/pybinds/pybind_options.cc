@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -55,21 +56,170 @@ PYBIND11_MODULE(mapping_options, m) {
               return tc::CudaMappingOptions::
                   makeGroupConvolutionCudaMappingOptions();
             }
+            if (type == "implicit_gemm_conv") {
+              return tc::CudaMappingOptions::
+                  makeImplicitGemmConvolutionCudaMappingOptions();
+            }
             throw std::runtime_error("Invalid option passed");
           }),
-          "Initialize the mapping options from one of the following:\n 1. naive\n 2. pointwise\n 3. mlp\n 4. conv\n 5. group_conv\n 6. single_thread")
+          "Initialize the mapping options from one of the following:\n 1. naive\n 2. pointwise\n 3. mlp\n 4. conv\n 5. group_conv\n 6. implicit_gemm_conv\n 7. single_thread")
       .def(
           "maxSharedMemory",
           &tc::CudaMappingOptions::maxSharedMemory,
           "The amount of shared memory to use, in bytes. If not provided, TC will query the active GPU and use all available shared memory.")
+      .def(
+          "useDynamicSharedMemory",
+          &tc::CudaMappingOptions::useDynamicSharedMemory,
+          "Allocate the shared memory copies dynamically at kernel launch, which allows using more than 48KB on GPUs that support it (Volta and newer).")
       .def(
           "useSharedMemory",
           &tc::CudaMappingOptions::useSharedMemory,
           "Create block-local copies of data in shared memory when this can leverage data reuse or global memory access coalescing")
+      .def(
+          "doubleBufferShared",
+          &tc::CudaMappingOptions::doubleBufferShared,
+          "Only promote inputs to shared memory, in two buffers filled alternately, which removes the synchronizations before the copies at the cost of twice the shared memory")
+      .def(
+          "warpShuffleReductions",
+          &tc::CudaMappingOptions::warpShuffleReductions,
+          "Reduce with warp shuffles and one shared memory value per warp instead of CUB block reductions, which needs less shared memory and fewer synchronizations")
+      .def(
+          "gridReductions",
+          &tc::CudaMappingOptions::gridReductions,
+          "Split a reduction that makes up the whole TC across blocks, combining the partial results with atomicAdd on an output zeroed before each launch")
+      .def(
+          "useTensorCores",
+          &tc::CudaMappingOptions::useTensorCores,
+          "Compute a TC made up of a single float16 matmul on tensor cores when its sizes and the tile sizes of its two outer loops are multiples of 16")
+      .def(
+          "splitKernels",
+          &tc::CudaMappingOptions::splitKernels,
+          "Emit one kernel per group of statements that are not fused by scheduling instead of a single kernel, launched one after the other")
+      .def(
+          "unrollPragma",
+          &tc::CudaMappingOptions::unrollPragma,
+          "Let the CUDA compiler partially unroll the innermost loops that are not fully unrolled, within the unroll factor, with #pragma unroll")
+      .def(
+          "persistentBlocks",
+          &tc::CudaMappingOptions::persistentBlocks,
+          "Launch only as many blocks as the device keeps resident at once, each iterating over several tiles")
+      .def(
+          "separateFullTiles",
+          &tc::CudaMappingOptions::separateFullTiles,
+          "Generate the full tiles without boundary conditions, separately from the partial tiles, at the cost of twice the code size")
+      .def(
+          "asyncCopies",
+          &tc::CudaMappingOptions::asyncCopies,
+          "Copy to shared memory with the asynchronous copies of sm_80 and newer devices, waited for at the following synchronizations")
+      .def(
+          "transposeShared",
+          &tc::CudaMappingOptions::transposeShared,
+          "Promote the tensors read along another dimension than the last one to shared memory arrays with that dimension innermost")
+      .def(
+          "cooperativeKernels",
+          &tc::CudaMappingOptions::cooperativeKernels,
+          "Run the children of the outermost sequence as the stages of a single cooperative kernel, synchronizing the grid between them")
+      .def(
+          "warpAggregatedAtomics",
+          &tc::CudaMappingOptions::warpAggregatedAtomics,
+          "Combine the atomic additions of the lanes of a warp that update the same element into one addition of their sum")
+      .def(
+          "dp4aPacking",
+          [](tc::CudaMappingOptions& instance, const std::string& type) {
+            tc::Dp4aPacking packing;
+            if (!tc::Dp4aPacking_Parse(type, &packing)) {
+              throw std::invalid_argument("Unknown dp4a packing: " + type);
+            }
+            instance.dp4aPacking(packing);
+          },
+          "Compute the sums of int8 products accumulated in int32 4 terms at a time with __dp4a, loading contiguous operands as one word (ContiguousDp4a) or also packing strided ones (PackedDp4a), NoDp4a disables it")
+      .def(
+          "mathPrecision",
+          [](tc::CudaMappingOptions& instance, const std::string& type) {
+            tc::MathPrecision precision;
+            if (!tc::MathPrecision_Parse(type, &precision)) {
+              throw std::invalid_argument("Unknown math precision: " + type);
+            }
+            instance.mathPrecision(precision);
+          },
+          "Lower the float builtins and divisions to library calls whose precision depends on useFastMath (CompilerMath), to precise library calls (PreciseMath), to hardware approximations such as __expf and __fdividef (FastIntrinsics), or also tanh and sigmoid to exp2 approximations (FastActivations)")
+      .def(
+          "vectorizeWidth",
+          &tc::CudaMappingOptions::vectorizeWidth,
+          "Copy inputs to shared memory with vector loads and stores of 2 or 4 float elements when the copied rows are contiguous and aligned, 1 disables it")
+      .def(
+          "blockSwizzle",
+          &tc::CudaMappingOptions::blockSwizzle,
+          "Launch the blocks in groups of this many consecutive values of the second block index so that the blocks resident at once share their operands in L2, 1 keeps the row-major order")
+      .def(
+          "batchPacking",
+          &tc::CudaMappingOptions::batchPacking,
+          "Compute this many consecutive instances of the outermost parallel loop, e.g. the batch of small matrix multiplications, per block along an additional last block dimension, the block being that of a single instance, 1 disables it")
+      .def(
+          "linearizeBlocks",
+          &tc::CudaMappingOptions::linearizeBlocks,
+          "Map this many outermost parallel loops together to the first block dimension, linearized in row-major order, and the following ones to the next block dimensions, so that more than three parallel loops are mapped to blocks, 1 disables it")
+      .def(
+          "twoDimReductions",
+          &tc::CudaMappingOptions::twoDimReductions,
+          "Map a reduction over two loops to threadIdx.y and threadIdx.x together and combine the values of both dimensions in a single tree reduction")
+      .def(
+          "threadTile",
+          &tc::CudaMappingOptions::threadTile,
+          "Compute a tile of the given sizes of the outer parallel loops of the point band per thread, in unrolled loops, instead of a single point")
+      .def(
+          "warpTile",
+          &tc::CudaMappingOptions::warpTile,
+          "Compute a sub-tile of the given sizes of the block tile per warp: the sub-tiles are mapped, linearized, to the last block dimension and their points to the previous ones, which should hold 32 threads")
+      .def(
+          "kernelOptions",
+          &tc::CudaMappingOptions::kernelOptions,
+          py::arg("kernel"),
+          py::arg("options"),
+          "Map the given kernel of splitKernels, counted from 0, with the given options instead, the kernels before it must have theirs. The outer scheduling and the settings of the whole TC are kept from these options")
       .def(
           "unrollCopyShared",
           &tc::CudaMappingOptions::unrollCopyShared,
           "Also unroll the copies to and from shared memory. If unroll value is not provided, has no effect")
+      .def(
+          "maxRegisterCount",
+          &tc::CudaMappingOptions::maxRegisterCount,
+          "Limit the number of registers per thread (0 lets the compiler decide), fewer registers allow more threads to run at once at the cost of spills")
+      .def(
+          "useFastMath",
+          &tc::CudaMappingOptions::useFastMath,
+          "Compile with faster, less precise math functions (on by default)")
+      .def(
+          "jitOptimizationLevel",
+          &tc::CudaMappingOptions::jitOptimizationLevel,
+          "Optimization level, from 0 to 4, of the compilation of PTX to machine code by the driver. If not provided, the driver default (4) is used")
+      .def(
+          "useLaunchBounds",
+          &tc::CudaMappingOptions::useLaunchBounds,
+          py::arg("b"),
+          py::arg("minBlocksPerMultiprocessor") = 0,
+          "Declare the kernel with launch bounds set to the number of threads per block and, if not 0, the minimum number of blocks per multiprocessor")
+      .def(
+          "parametricSize",
+          &tc::CudaMappingOptions::parametricSize,
+          py::arg("name"),
+          py::arg("min"),
+          py::arg("max"),
+          "Keep the size parameter symbolic over [min, max] (bounds included) instead of specializing the kernel for its value, so that one kernel serves all the sizes in range")
+      .def(
+          "sizeBuckets",
+          &tc::CudaMappingOptions::sizeBuckets,
+          py::arg("name"),
+          py::arg("upperBounds"),
+          "Compile one kernel per bucket of values of the size parameter, given by the increasing inclusive upper bounds of the buckets (e.g. powers of two), instead of one kernel per value")
+      .def(
+          "constantInputs",
+          &tc::CudaMappingOptions::constantInputs,
+          "Bake the values at compilation of the inputs at the given positions, e.g. the filters of an inference layer, into the kernels as constant memory arrays; later runs must pass the same values")
+      .def(
+          "preciseTensors",
+          &tc::CudaMappingOptions::preciseTensors,
+          "Keep the precise library calls and divisions in the statements writing the tensors with the given names whatever the math precision")
       .def(
           "scheduleFusionStrategy",
           [](tc::CudaMappingOptions& instance, const std::string& type) {
@@ -88,6 +238,22 @@ PYBIND11_MODULE(mapping_options, m) {
             instance.intraTileScheduleFusionStrategy(type);
           },
           "Require TC to try and execute different TC expressions interleaved (Max), separately (Min)\nor interleaved as long as sufficient parallelism is exploited (Preserve3Coincident) by\nperforming loop fusion and fission. Applies before tiling")
+      .def(
+          "outerScheduleNeverFuse",
+          [](tc::CudaMappingOptions& instance,
+             const std::string& first,
+             const std::string& second) {
+            instance.outerScheduleNeverFuse(first, second);
+          },
+          "Never fuse the statements writing the two given tensors, whatever the fusion strategy. Applies before tiling")
+      .def(
+          "intraTileScheduleNeverFuse",
+          [](tc::CudaMappingOptions& instance,
+             const std::string& first,
+             const std::string& second) {
+            instance.intraTileScheduleNeverFuse(first, second);
+          },
+          "Never fuse the statements writing the two given tensors, whatever the fusion strategy. Applies to inner loops created by tiling")
       .def(
           "serializeToProtobuf",
           &tc::CudaMappingOptions::toProtobufSerializedString,
@@ -118,6 +284,12 @@ PYBIND11_MODULE(mapping_options, m) {
             instance.matchLibraryCalls(match);
           },
           "Replace computation patterns with calls to highly optimized libraries (such as CUB, CUTLASS) when possible")
+      .def(
+          "inlinePointwiseTemporaries",
+          [](tc::CudaMappingOptions& instance, bool inlineTemporaries) {
+            instance.inlinePointwiseTemporaries(inlineTemporaries);
+          },
+          "Recompute the temporaries defined by a single statement without reduction in the statements reading them instead of storing them in global memory")
       .def(
           "fixParametersBeforeScheduling",
           [](tc::CudaMappingOptions& instance, bool fix) {
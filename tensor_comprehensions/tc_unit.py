@@ -21,7 +21,7 @@ from torch.autograd import Variable
 from tensor_comprehensions.tc import ATenCompilationUnit
 from tensor_comprehensions.tc import set_logtostderr, set_debug_lang, set_debug_halide, set_debug_tc_mapper, set_debug_cuda, set_debug_tuner, set_dump_cuda
 from tensor_comprehensions.torch_tc.tc_function import TCFunction, unpack_variables, get_tensors, make_contiguous
-from tensor_comprehensions.autotuner import ATenAutotuner
+from tensor_comprehensions.autotuner import ATenAutotuner, tune_batch as _tune_batch
 from tensor_comprehensions.mapping_options import Options
 
 FORMAT = '[%(levelname)s]: %(message)s'
@@ -194,7 +194,8 @@ class TcAutotuner(object):
         self, pop_size=20, crossover_rate=80, mutation_rate=7, generations=10,
         number_elites=1, threads=8, gpus="0", restore_from_proto=False,
         restore_number=10, log_generations=False,
-        tuner_min_launch_total_threads=64, **kwargs
+        tuner_min_launch_total_threads=64, time_budget=0,
+        max_stalled_generations=0, target_speedup=0, **kwargs
     ):
         self.autotuner.pop_size(pop_size)
         self.autotuner.crossover_rate(crossover_rate)
@@ -207,6 +208,9 @@ class TcAutotuner(object):
         self.autotuner.restore_number(restore_number)
         self.autotuner.log_generations(log_generations)
         self.autotuner.tuner_min_launch_total_threads(tuner_min_launch_total_threads)
+        self.autotuner.time_budget(time_budget)
+        self.autotuner.max_stalled_generations(max_stalled_generations)
+        self.autotuner.target_speedup(target_speedup)
 
     # We need to pass the inputs so that we can load the correct options from
     # the cache that correspond to the inputs sizes. This is useful when the
@@ -217,6 +221,11 @@ class TcAutotuner(object):
             return best_options[0]
         return best_options
 
+    # Progress of the current or last tuning as a dict, can be polled from
+    # another thread while autotune runs
+    def progress(self):
+        return self.autotuner.progress()
+
     # if the cache_file is not "" then the tuning results would be saved to file
     def tune_and_store(self, tc_name, inputs, mapping_options, cache_file=""):
         options = mapping_options
@@ -308,6 +317,36 @@ class TcAutotuner(object):
         return [forward_best_options, backward_best_options]
 
 
+def tune_batch(jobs, cache_file, on_result=None, **kwargs):
+    r"""Tunes many TCs and input sizes into a single options cache.
+
+    Every job is a tuple :attr:`(lang, name, inputs)` or
+    :attr:`(lang, name, inputs, options)`, where :attr:`inputs` are tensors,
+    Variables or size tuples as for :attr:`autotune` and :attr:`options`
+    defaults to "naive". The jobs are tuned one after the other on all the
+    gpus of the settings, jobs with the same TC and input sizes are tuned
+    once, and the results are saved to :attr:`cache_file` after each job.
+    The other keyword arguments are the autotuner settings of
+    :attr:`TcAutotuner`.
+
+    Args:
+        on_result (callable, optional): called with the index and the best
+            options of each job as soon as the job is tuned.
+
+    Returns:
+        The best options of each job, in order.
+    """
+    TcAutotuner("", **kwargs)
+    tuning_jobs = []
+    for job in jobs:
+        lang, name, inputs = job[:3]
+        options = job[3] if len(job) > 3 else "naive"
+        if not isinstance(options, Options):
+            options = Options(options)
+        tuning_jobs.append((lang, name, get_tensors(list(inputs)), options))
+    return _tune_batch(cache_file, tuning_jobs, on_result)
+
+
 ###############################################################################
 # TC engine - ATen based
 ###############################################################################
@@ -333,6 +372,15 @@ class TcCompilationUnit(object):
         handle = self.cu.compile(name, inputs, options)
         return handle
 
+    # returns the function running the TC on the current CUDA stream, which
+    # keeps the compiled kernels of the input sizes it has seen
+    def bind(self, name, inputs, **kwargs):
+        kwargs["tc_lang"] = self.tc_lang
+        if "type" not in kwargs:
+            kwargs["type"] = 'forward'
+        options = get_options_from_kwargs(name, *inputs, **kwargs)
+        return self.cu.bind(name, inputs, options)
+
     def run(self, handle, name, inputs, **kwargs):
         outputs = []
         if "outputs" in kwargs and kwargs["outputs"] is not None:
@@ -400,6 +448,8 @@ class TcUnit(object):
 
                 * :attr:`group_conv`: if kernel resembles a group convolution operation
 
+                * :attr:`implicit_gemm_conv`: if kernel is a convolution computed as an implicit GEMM
+
                 * :attr:`naive`: if none of the above, then chose naive *Default*
 
                 If no :attr:`Options` are passed, the naive options will be used which
@@ -483,8 +533,8 @@ class TcUnit(object):
                         name, kwargs["inject_kernel"], kwargs["cuda_code"],
                         input_tensors, kwargs["grid"], kwargs["block"]
                     )
-                handle_forward = self.cu.compile(name, input_tensors, **kwargs)
-                tc_info["forward_name"], tc_info["handle_forward"] = name, handle_forward
+                forward = self.cu.bind(name, input_tensors, **kwargs)
+                tc_info["forward_name"], tc_info["forward"] = name, forward
 
                 if backward:
                     tc_info["backward_name"] = backward_name
@@ -545,6 +595,8 @@ class TcUnit(object):
 
                 * :attr:`group_conv`: if kernel resembles a group convolution operation
 
+                * :attr:`implicit_gemm_conv`: if kernel is a convolution computed as an implicit GEMM
+
                 * :attr:`naive`: if none of the above, then chose naive *Default*
 
                 If no :attr:`Options` are passed, the naive options will be used which
@@ -586,6 +638,15 @@ class TcUnit(object):
             tuner_min_launch_total_threads (int):
                 Prune out kernels mapped to fewer than this many threads and block. Set this to 1 to avoid pruning. Default 64
 
+            time_budget (int):
+                Stop tuning after this many seconds, the candidates already compiled are still evaluated. Default 0 (no budget)
+
+            max_stalled_generations (int):
+                Stop tuning after this many generations without improvement of the best runtime. Default 0 (disabled)
+
+            target_speedup (float):
+                Stop tuning once the best options are this many times faster than the options passed to autotune. Default 0 (disabled)
+
         Returns:
             Object of type :attr:`Options` that can be directly used to run the kernel.
             If :attr:`training` = True, then the list of size two containing
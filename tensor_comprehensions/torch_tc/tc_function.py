@@ -73,11 +73,8 @@ class TCFunction(Function):
     def forward(ctx, tc_unit, tc_info, kwargs, *inputs):
         ctx.tc_unit, ctx.tc_info, ctx.kwargs = tc_unit, tc_info, kwargs
         ctx.save_for_backward(*inputs)
-        outputs = unpack_variables(tc_info["outputs"]) if "outputs" in tc_info else None
-        outputs = tc_unit.run(
-            tc_info["handle_forward"], tc_info["forward_name"],
-            make_contiguous(list(inputs)), outputs=outputs
-        )
+        outputs = unpack_variables(tc_info["outputs"]) if "outputs" in tc_info else []
+        tc_info["forward"](make_contiguous(list(inputs)), outputs)
         return tuple(outputs)
 
     @staticmethod
@@ -92,8 +89,8 @@ class TCFunction(Function):
         inputs = make_contiguous(unpack_variables(list(real_inputs) + list(rearranged_grad_outputs)))
 
         # if backwards hasn't been compiled before, we compile it  again
-        if "handle_backward" not in tc_info:
-            handle_backward = tc_unit.compile(tc_info["backward_name"], inputs, **kwargs)
-            tc_info["handle_backward"] = handle_backward
-        grad_inputs = tc_unit.run(tc_info["handle_backward"], tc_info["backward_name"], inputs)
+        if "backward" not in tc_info:
+            tc_info["backward"] = tc_unit.bind(tc_info["backward_name"], inputs, **kwargs)
+        grad_inputs = []
+        tc_info["backward"](inputs, grad_inputs)
         return (None, None, None,) + tuple(wrap_variable(grad_inputs))
@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -24,10 +25,15 @@
 #include <ATen/ATen.h>
 
 #include "tc/aten/aten_compiler.h"
+#include "tc/autotuner/genetic_autotuner.h"
 #include "tc/autotuner/genetic_autotuner_aten.h"
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/cpu/cpu_tc_executor.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
+#include "tc/core/scope_guard.h"
 
 #include "test_harness_aten_cuda.h"
 
@@ -170,6 +176,124 @@ def matmul(float(M,N) A, float(N,K) B) -> (output) {
       autotune(cacheFilename, TC, name, inputs, options, {options});
 }
 
+TEST_F(ATenCompilationUnitTest, MatmulPipelined) {
+  tc::FLAGS_tuner_gen_pipelined = true;
+  tc::ScopeGuard sg([]() { tc::FLAGS_tuner_gen_pipelined = false; });
+  at::Tensor mat1 = at::CUDA(at::kFloat).rand({72, 26});
+  at::Tensor mat2 = at::CUDA(at::kFloat).rand({26, 72});
+  std::vector<at::Tensor> inputs = {mat1, mat2};
+  std::vector<at::Tensor> outputs;
+
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+  output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto name = "matmul";
+
+  std::string cacheFilename = "";
+  auto bestOptions =
+      autotune(cacheFilename, TC, name, inputs, options, {options});
+  Check(TC, name, bestOptions, inputs, outputs);
+}
+
+TEST_F(ATenCompilationUnitTest, MatmulStopCriteria) {
+  // Many more generations than the stop criteria let run
+  auto generations = tc::FLAGS_tuner_gen_generations;
+  tc::FLAGS_tuner_gen_generations = 1000;
+  tc::FLAGS_tuner_max_stalled_generations = 2;
+  tc::FLAGS_tuner_time_budget_s = 120;
+  tc::ScopeGuard sg([generations]() {
+    tc::FLAGS_tuner_gen_generations = generations;
+    tc::FLAGS_tuner_max_stalled_generations = 0;
+    tc::FLAGS_tuner_time_budget_s = 0;
+  });
+  at::Tensor mat1 = at::CUDA(at::kFloat).rand({72, 26});
+  at::Tensor mat2 = at::CUDA(at::kFloat).rand({26, 72});
+  std::vector<at::Tensor> inputs = {mat1, mat2};
+  std::vector<at::Tensor> outputs;
+
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+  output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto name = "matmul";
+
+  std::string cacheFilename = "";
+  auto start = std::chrono::steady_clock::now();
+  auto bestOptions =
+      autotune(cacheFilename, TC, name, inputs, options, {options});
+  // The generation running when the budget expires is completed, its
+  // remaining candidates are skipped
+  ASSERT_LT(
+      std::chrono::steady_clock::now() - start, std::chrono::seconds(240));
+  Check(TC, name, bestOptions, inputs, outputs);
+}
+
+TEST_F(ATenCompilationUnitTest, MatmulJoint) {
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+  output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto name = "matmul";
+
+  std::vector<std::vector<at::Tensor>> inputSets;
+  for (auto m : {8, 64, 256}) {
+    inputSets.push_back({at::CUDA(at::kFloat).rand({m, 32}),
+                         at::CUDA(at::kFloat).rand({32, 72})});
+  }
+  tc::autotune::GeneticAutotunerATen geneticAutotuneATen(TC);
+  tc::autotune::JointTuningReport report;
+  auto bestOptions = geneticAutotuneATen.tuneJointly(
+      "", name, inputSets, {1.0, 1.0, 2.0}, options, {options}, {}, &report);
+  ASSERT_TRUE(bestOptions);
+  ASSERT_EQ(inputSets.size(), report.runtimes.size());
+  for (auto penalty : report.penalties()) {
+    // The specialized runtimes include those of the joint options
+    EXPECT_GE(penalty, 1.0);
+  }
+  for (const auto& inputs : inputSets) {
+    std::vector<at::Tensor> outputs;
+    Check(TC, name, *bestOptions, inputs, outputs);
+  }
+}
+
+TEST_F(ATenCompilationUnitTest, MatmulRetune) {
+  at::Tensor mat1 = at::CUDA(at::kFloat).rand({72, 26});
+  at::Tensor mat2 = at::CUDA(at::kFloat).rand({26, 72});
+  std::vector<at::Tensor> inputs = {mat1, mat2};
+  std::vector<at::Tensor> outputs;
+
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+  output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto name = "matmul";
+
+  auto previousCacheFilename =
+      FLAGS_save_tuner_proto_prefix + std::string("/matmul_retune_previous");
+  auto cacheFilename =
+      FLAGS_save_tuner_proto_prefix + std::string("/matmul_retune");
+  autotune(previousCacheFilename, TC, name, inputs, options, {options});
+
+  tc::autotune::GeneticAutotunerATen geneticAutotuneATen(TC);
+  auto bestOptions = geneticAutotuneATen.retune(
+      previousCacheFilename, cacheFilename, name, inputs, options);
+  ASSERT_TRUE(bestOptions);
+  Check(TC, name, *bestOptions, inputs, outputs);
+  ASSERT_THROW(
+      geneticAutotuneATen.retune(
+          cacheFilename, cacheFilename, name, inputs, options),
+      std::invalid_argument);
+}
+
 TEST_F(ATenCompilationUnitTest, TensorDot) {
   at::Tensor I0 = at::CUDA(at::kFloat).rand({N, C1, C2, H, W});
   at::Tensor I1 = at::CUDA(at::kFloat).rand({N, C2, C3, H, W});
@@ -203,6 +327,44 @@ def tensordot(float(N, C1, C2, H, W) I0, float(N, C2, C3, H, W) I1) -> (O) {
   benchmarkKernelOptions(TC, name, inputs, bestOptions);
 }
 
+TEST_F(ATenCompilationUnitTest, MatmulCpu) {
+  at::Tensor a = at::CPU(at::kFloat).rand({32, 16});
+  at::Tensor b = at::CPU(at::kFloat).rand({16, 24});
+  at::Tensor c = at::CPU(at::kFloat).zeros({32, 24});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+
+  static constexpr auto TC = R"TC(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+  )TC";
+  // Benchmarked on the core of --tuner_cpus, 0 by default
+  std::unordered_map<size_t, std::vector<const DLTensor*>> inputs{
+      {0, inputsPair.first}};
+  std::unordered_map<size_t, std::vector<DLTensor*>> outputs{
+      {0, outputsPair.first}};
+  tc::autotune::detail::GeneticAutotuner tuner(TC);
+  auto baseMapping = tc::CpuMappingOptions::makeNaiveCpuMappingOptions();
+  auto options = tuner.tuneCpu(
+      "", "matmul", inputs, outputs, baseMapping, {baseMapping}, {});
+  ASSERT_TRUE(options.hasValue()) << "no valid CPU options";
+  EXPECT_LT(0u, tc::CpuOptionsCache::getCache()->totalSize());
+
+  // The tuned options compute the matmul
+  c.zero_();
+  tc::ExecutionEngine<tc::CpuTcExecutor> engine;
+  engine.define(TC);
+  auto handle = engine.compile(
+      "matmul", inputsPair.first, options->toProtobufSerializedString());
+  engine.run(handle, inputsPair.first, outputsPair.first);
+  EXPECT_LT((c - a.mm(b)).abs().max().toFloat(), 1e-4f);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
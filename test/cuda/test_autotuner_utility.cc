@@ -13,9 +13,23 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <future>
+
 #include <gtest/gtest.h>
 
+#include <tuning.pb.h>
+
+#include "tc/autotuner/cost_model.h"
+#include "tc/autotuner/distributed_tuning.h"
+#include "tc/autotuner/search_strategy.h"
 #include "tc/autotuner/genetic_autotuner.h"
+#include "tc/autotuner/utils/memory_budget.h"
+#include "tc/autotuner/utils/resource_model.h"
 #include "tc/autotuner/utils/utils.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
@@ -43,6 +57,20 @@ TEST(DivisorsAndPowers, Default) {
   ASSERT_EQ(dp, expected);
 }
 
+TEST(Divisors, UpTo) {
+  auto d = divisorsUpTo(72, 256);
+  std::vector<size_t> expected{1, 2, 3, 4, 6, 8, 9, 12, 18, 24, 36, 72};
+  ASSERT_EQ(d, expected);
+
+  d = divisorsUpTo(72, 10);
+  expected = {1, 2, 3, 4, 6, 8, 9};
+  ASSERT_EQ(d, expected);
+
+  d = divisorsUpTo(13, 256);
+  expected = {1, 13};
+  ASSERT_EQ(d, expected);
+}
+
 std::vector<CudaMappingOptions> restoreCandidates(
     const std::string& tc,
     std::vector<at::Tensor>& inputs,
@@ -58,6 +86,27 @@ std::vector<CudaMappingOptions> restoreCandidates(
       lang::canonicalTc(tc), inputsPair.first, outputsPair.first);
 }
 
+TEST(WeightedGeometricMean, Default) {
+  using std::chrono::microseconds;
+  std::vector<Duration> runtimes{microseconds(10), microseconds(1000)};
+  ASSERT_NEAR(
+      microseconds(100).count(),
+      weightedGeometricMean(runtimes, {1.0, 1.0}).count(),
+      10);
+  // The weights are normalized
+  ASSERT_NEAR(
+      microseconds(100).count(),
+      weightedGeometricMean(runtimes, {3.0, 3.0}).count(),
+      10);
+  ASSERT_NEAR(
+      microseconds(10).count(),
+      weightedGeometricMean({microseconds(10)}, {0.5}).count(),
+      10);
+  ASSERT_LT(
+      weightedGeometricMean(runtimes, {3.0, 1.0}),
+      weightedGeometricMean(runtimes, {1.0, 3.0}));
+}
+
 TEST(RestoreCandidates, NoCache) {
   std::vector<at::Tensor> inputs{at::CUDA(at::kFloat).rand({10, 16}),
                                  at::CUDA(at::kFloat).rand({16, 20})};
@@ -129,6 +178,320 @@ TEST(RestoreCandidates, Hit) {
   ASSERT_EQ(restored.size(), 1);
 }
 
+TEST(MeasureUntilStable, StableRuntimes) {
+  MeasurementBudget budget{3, 100, std::chrono::hours(1), 0.01};
+  auto runtimes = measureUntilStable(
+      []() -> Duration { return std::chrono::microseconds(100); }, budget);
+  ASSERT_EQ(runtimes.size(), 3);
+}
+
+TEST(MeasureUntilStable, NoisyRuntimes) {
+  size_t i = 0;
+  auto noisy = [&i]() -> Duration {
+    return std::chrono::microseconds(++i % 2 ? 10 : 1000);
+  };
+  MeasurementBudget budget{3, 50, std::chrono::hours(1), 0.01};
+  ASSERT_EQ(measureUntilStable(noisy, budget).size(), 50);
+
+  // An exhausted time budget stops after the minimum number of runs
+  budget.timeBudget = std::chrono::steady_clock::duration::zero();
+  ASSERT_EQ(measureUntilStable(noisy, budget).size(), 3);
+}
+
+TEST(SuccessiveHalving, RungBudgets) {
+  SuccessiveHalving racing(3, 3);
+  MeasurementBudget budget{3, 90, std::chrono::milliseconds(90), 0.01};
+  ASSERT_EQ(racing.rungBudget(0, budget).maxIterations, 10);
+  ASSERT_EQ(racing.rungBudget(1, budget).maxIterations, 30);
+  ASSERT_EQ(racing.rungBudget(2, budget).maxIterations, 90);
+  ASSERT_EQ(racing.rungBudget(0, budget).minIterations, 3);
+  ASSERT_EQ(
+      racing.rungBudget(0, budget).timeBudget, std::chrono::milliseconds(10));
+}
+
+TEST(SuccessiveHalving, SlowCandidatesStop) {
+  SuccessiveHalving racing(3, 3);
+  MeasurementBudget budget{3, 90, std::chrono::hours(1), 0.0001};
+  auto noisy = [](size_t runtime) {
+    return [runtime]() mutable -> Duration {
+      runtime ^= 1;
+      return std::chrono::microseconds(runtime);
+    };
+  };
+  // The first candidate goes through all the rungs, the slower second one
+  // stops at the first rung
+  ASSERT_EQ(racing.measure(noisy(10), budget).size(), 10 + 30 + 90);
+  ASSERT_EQ(racing.measure(noisy(100), budget).size(), 10);
+  ASSERT_EQ(racing.stoppedPerRung(), std::vector<size_t>({1, 0, 1}));
+}
+
+namespace {
+CudaMultiprocessorLimits voltaLimits() {
+  CudaMultiprocessorLimits limits;
+  limits.multiprocessorCount = 80;
+  limits.warpSize = 32;
+  limits.maxThreadsPerBlock = 1024;
+  limits.maxThreads = 2048;
+  limits.maxBlocks = 32;
+  limits.registers = 65536;
+  limits.sharedMemory = 98304;
+  return limits;
+}
+
+KernelResources
+makeResources(size_t threads, size_t sharedMemory, size_t registers) {
+  KernelResources resources;
+  resources.threadsPerBlock = threads;
+  resources.sharedMemoryPerBlock = sharedMemory;
+  resources.registersPerThread = registers;
+  return resources;
+}
+} // namespace
+
+/*
+ * Until a compilation has completed, its peak memory is unknown and the
+ * compilations are admitted one at a time.
+ */
+TEST(MemoryBudget, OneAtATimeUntilEstimated) {
+  ASSERT_GT(MemoryBudget::residentBytes(), 0u);
+  MemoryBudget budget(MemoryBudget::residentBytes() + (size_t(1) << 34));
+  auto first = budget.admit();
+  EXPECT_EQ(1u, budget.running());
+  auto second =
+      std::async(std::launch::async, [&]() { return budget.admit(); });
+  EXPECT_EQ(
+      std::future_status::timeout,
+      second.wait_for(std::chrono::milliseconds(100)));
+  first.reset();
+  auto admitted = second.get();
+  EXPECT_EQ(1u, budget.running());
+  // Whatever the first one used, a budget this large fits another one.
+  auto third = budget.admit();
+  EXPECT_EQ(2u, budget.running());
+}
+
+TEST(MemoryBudget, Unbounded) {
+  MemoryBudget budget(0);
+  auto first = budget.admit();
+  auto second = budget.admit();
+  EXPECT_EQ(0u, budget.running());
+}
+
+TEST(StaticPruning, Occupancy) {
+  auto limits = voltaLimits();
+  ASSERT_EQ(estimateOccupancy(makeResources(256, 0, 32), limits), 1.0);
+  // Two blocks fit in shared memory
+  ASSERT_EQ(estimateOccupancy(makeResources(256, 49152, 32), limits), 0.25);
+  // Occupancy counts full warps
+  ASSERT_EQ(estimateOccupancy(makeResources(48, 0, 32), limits), 1.0);
+  ASSERT_EQ(estimateOccupancy(makeResources(1024, 0, 128), limits), 0.0);
+  // Launch bounds limit the registers so that the requested blocks fit
+  auto bounded = makeResources(1024, 0, 128);
+  bounded.minBlocksPerMultiprocessor = 1;
+  ASSERT_EQ(estimateOccupancy(bounded, limits), 0.5);
+  bounded.minBlocksPerMultiprocessor = 2;
+  ASSERT_EQ(estimateOccupancy(bounded, limits), 1.0);
+}
+
+TEST(StaticPruning, Reasons) {
+  auto limits = voltaLimits();
+  auto prune = [&limits](const KernelResources& resources) {
+    return staticallyPrune(resources, limits, 49152, 0.05);
+  };
+  ASSERT_EQ(prune(makeResources(256, 16384, 32)), PruningReason::None);
+  ASSERT_EQ(prune(makeResources(2048, 0, 32)), PruningReason::Threads);
+  ASSERT_EQ(prune(makeResources(256, 65536, 32)), PruningReason::SharedMemory);
+  ASSERT_EQ(prune(makeResources(32, 0, 300)), PruningReason::Registers);
+  ASSERT_EQ(prune(makeResources(1024, 0, 128)), PruningReason::Registers);
+  ASSERT_EQ(prune(makeResources(32, 49152, 32)), PruningReason::Occupancy);
+  auto bounded = makeResources(1024, 0, 128);
+  bounded.minBlocksPerMultiprocessor = 1;
+  ASSERT_EQ(prune(bounded), PruningReason::None);
+  // Unknown limits never prune
+  ASSERT_EQ(
+      staticallyPrune(
+          makeResources(2048, 0, 32), CudaMultiprocessorLimits(), 0, 1.0),
+      PruningReason::None);
+}
+
+TEST(StaticPruning, CompiledKernels) {
+  auto limits = voltaLimits();
+  CudaKernelAttributes attributes;
+  attributes.numRegisters = 32;
+  attributes.maxThreadsPerBlock = 1024;
+  auto prune = [&limits, &attributes](size_t threads, bool pruneSpills) {
+    return pruneCompiled(attributes, threads, 0, limits, 0.05, pruneSpills);
+  };
+  ASSERT_EQ(prune(256, true), PruningReason::None);
+  // The compiler may lower the launchable threads under the device limit
+  attributes.maxThreadsPerBlock = 128;
+  ASSERT_EQ(prune(256, true), PruningReason::Threads);
+  attributes.maxThreadsPerBlock = 1024;
+  attributes.localBytes = 16;
+  ASSERT_EQ(prune(256, true), PruningReason::Registers);
+  ASSERT_EQ(prune(256, false), PruningReason::None);
+  attributes.localBytes = 0;
+  // One block of 32 threads with 48KB of shared memory
+  attributes.staticSharedBytes = 49152;
+  ASSERT_EQ(prune(32, true), PruningReason::Occupancy);
+}
+
+TEST(GradientBoostedTrees, StepFunction) {
+  std::vector<std::vector<double>> features;
+  std::vector<double> targets;
+  for (size_t i = 0; i < 100; ++i) {
+    features.push_back({static_cast<double>(i), static_cast<double>(i % 7)});
+    targets.push_back(i < 50 ? 1.0 : 3.0);
+  }
+  auto model = GradientBoostedTrees::fit(
+      features, targets, GradientBoostedTrees::Options());
+  ASSERT_NEAR(model.predict({10.0, 3.0}), 1.0, 0.01);
+  ASSERT_NEAR(model.predict({90.0, 3.0}), 3.0, 0.01);
+}
+
+TEST(CostModel, NotEnoughSamples) {
+  auto options = CudaMappingOptions::makeNaiveCudaMappingOptions();
+  std::vector<OptionsCache::TuningSample> samples;
+  CostModelOptions modelOptions;
+  for (size_t i = 0; i + 1 < modelOptions.minTrainingSamples; ++i) {
+    samples.push_back({{}, options.tile(i + 1), std::chrono::microseconds(i)});
+  }
+  ASSERT_FALSE(CostModel::train(samples, modelOptions));
+  samples.push_back({{}, options.tile(100), std::chrono::microseconds(100)});
+  // The sample with a zero runtime is not usable
+  ASSERT_FALSE(CostModel::train(samples, modelOptions));
+  samples.push_back({{}, options.tile(101), std::chrono::microseconds(101)});
+  auto model = CostModel::train(samples, modelOptions);
+  ASSERT_TRUE(model);
+  ASSERT_LT(
+      model->predictLogRuntime(options.tile(2), {}),
+      model->predictLogRuntime(options.tile(101), {}));
+}
+
+namespace {
+// Synthetic search space whose fastest configurations unroll by 32 and tile
+// the outermost loop by 8, the other parameters do not matter
+TuningConfiguration makeSearchSpace() {
+  TuningConfiguration conf;
+  std::vector<size_t> range{1, 2, 4, 8, 16, 32, 64};
+  conf.tilingParams.setRange(2, range);
+  conf.blockParams.setRange(range, "b");
+  conf.gridParams.setRange(range, "g");
+  conf.unrollFactor =
+      RangeParameter({1, 2, 4, 8, 16, 32, 64, 128, 256}, "unroll");
+  conf.fixParameters(TuningParameterFixer()
+                         .fixBlockParameters({32, 4, 1})
+                         .fixGridParameters({1, 1, 1}));
+  return conf;
+}
+
+Duration syntheticRuntime(const TuningConfiguration& conf) {
+  auto distance = [](size_t value, double optimum) {
+    return std::abs(std::log2(static_cast<double>(value)) - optimum);
+  };
+  return std::chrono::microseconds(static_cast<int64_t>(
+      100 + 10 * distance(conf.unrollFactor.value(), 5) +
+      10 * distance(conf.tilingParams.dims.at(0).value(), 3)));
+}
+
+const std::vector<std::string> kSearchStrategies{"genetic",
+                                                 "random",
+                                                 "hill_climbing",
+                                                 "bayesian"};
+} // namespace
+
+TEST(SearchStrategy, Generations) {
+  for (const auto& name : kSearchStrategies) {
+    auto search =
+        makeSearchStrategy(name, makeSearchSpace(), {}, 10, 80, 10, 1);
+    for (size_t generation = 0; generation < 20; ++generation) {
+      for (auto& candidate : search->population) {
+        candidate->runtime = syntheticRuntime(candidate->configuration);
+      }
+      search->updateParameters();
+    }
+    ASSERT_LE(
+        syntheticRuntime(search->lastBestConf), std::chrono::microseconds(110))
+        << name;
+  }
+}
+
+TEST(SearchStrategy, SteadyState) {
+  for (const auto& name : kSearchStrategies) {
+    auto start = makeSearchSpace();
+    start.unrollFactor.selectFromValue(256);
+    auto search =
+        makeSearchStrategy(name, makeSearchSpace(), {start}, 10, 80, 10, 1);
+    // Keep a few candidates in flight, as the pipelined tuning does
+    std::deque<std::unique_ptr<CandidateConfiguration>> inFlight;
+    for (size_t i = 0; i < 200; ++i) {
+      inFlight.push_back(search->nextCandidate());
+      if (inFlight.size() > 4) {
+        auto candidate = std::move(inFlight.front());
+        inFlight.pop_front();
+        candidate->runtime = syntheticRuntime(candidate->configuration);
+        search->recordEvaluatedCandidate(std::move(candidate));
+      }
+    }
+    ASSERT_LE(
+        syntheticRuntime(search->lastBestConf), std::chrono::microseconds(110))
+        << name;
+  }
+}
+
+TEST(SearchStrategy, Unknown) {
+  ASSERT_THROW(
+      makeSearchStrategy("annealing", makeSearchSpace(), {}, 10, 80, 10, 1),
+      std::invalid_argument);
+}
+
+TEST(TuningConnection, RoundTrip) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  std::unique_ptr<TuningConnection> coordinator(new TuningConnection(fds[0]));
+  TuningConnection worker(fds[1]);
+
+  tc::TuningRequestProto request;
+  request.set_id(42);
+  request.set_tc(tc_);
+  request.set_kernel_name("matmul");
+  *request.mutable_options() =
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions().proto();
+  coordinator->send(request);
+
+  tc::TuningRequestProto received;
+  ASSERT_TRUE(worker.receive(received));
+  ASSERT_EQ(request.SerializeAsString(), received.SerializeAsString());
+
+  // Closing the connection between messages is not an error
+  coordinator = nullptr;
+  ASSERT_FALSE(worker.receive(received));
+}
+
+TEST(SandboxedTuningEvaluator, Crash) {
+  ASSERT_THROW(
+      SandboxedTuningEvaluator("/nonexistent/tc_tuning_worker", 0),
+      std::runtime_error);
+
+  // A worker that dies on every request
+  SandboxedTuningEvaluator evaluator("/bin/false", 0);
+  tc::TuningRequestProto request;
+  request.set_tc(tc_);
+  request.set_kernel_name("matmul");
+  *request.mutable_options() =
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions().proto();
+  for (size_t i = 1; i < SandboxedTuningEvaluator::kMaxConsecutiveCrashes;
+       ++i) {
+    request.set_id(i);
+    tc::TuningResultProto result;
+    ASSERT_TRUE(evaluator.evaluate(request, result));
+    ASSERT_EQ(i, result.id());
+    ASSERT_TRUE(result.invalid());
+  }
+  tc::TuningResultProto result;
+  ASSERT_FALSE(evaluator.evaluate(request, result));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
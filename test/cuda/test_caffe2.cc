@@ -20,6 +20,7 @@
 #include <gtest/gtest.h>
 
 #include "tc/c2/context.h"
+#include "tc/c2/net_fusion.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
 #include "tc/core/flags.h"
 
@@ -195,6 +196,22 @@ TEST_F(Caffe2Test, TcMatMulOp) {
   TestHarness::BasicCorrectnessTest(def, init_ws, 1e-6);
 }
 
+TEST_F(Caffe2Test, TcMatMulOp_OptionsCacheMiss) {
+  auto init_ws = [&](Workspace& w) {
+    auto AddInput =
+        TestHarness::AddDeterministicallyRandomInput<float, CUDAContext>;
+    AddInput(w, {M, K}, "I");
+    AddInput(w, {K, N}, "W");
+  };
+
+  // No entry in the cache, the operator runs with its base options.
+  Argument cacheArg = MakeArgument<string>(
+      "optionsCacheFile", "/tmp/tc_caffe2_test_options_cache_miss");
+  OperatorDef def = TestHarness::ConfigureCUDA(
+      "TcMatMulOp", {"I", "W"}, {"O"}, {cacheArg});
+  TestHarness::BasicCorrectnessTest(def, init_ws, 1e-6);
+}
+
 TEST_F(Caffe2Test, DISABLED_TcMatMulOp_Gradient) {
   auto init_ws = [&](Workspace& w) {
     auto AddInput =
@@ -528,6 +545,120 @@ TEST_F(Caffe2Test, TcGroupConvolutionOp) {
   TestHarness::CheckEqual(w1, w2, "O");
 }
 
+TEST_F(Caffe2Test, FuseFCReluChain) {
+  auto init_ws = [&](Workspace& w) {
+    auto AddInput =
+        TestHarness::AddDeterministicallyRandomInput<float, CUDAContext>;
+    AddInput(w, {B, M}, "I");
+    AddInput(w, {N, M}, "W1");
+    AddInput(w, {N}, "B1");
+    AddInput(w, {O, N}, "W2");
+    AddInput(w, {O}, "B2");
+  };
+
+  // The in-place Relu overwrites the output of the first FC, which is only
+  // read by the Relu.
+  NetDef net;
+  *net.add_op() =
+      TestHarness::ConfigureCUDA("FC", {"I", "W1", "B1"}, {"Y1"}, {});
+  *net.add_op() = TestHarness::ConfigureCUDA("Relu", {"Y1"}, {"Y1"}, {});
+  *net.add_op() =
+      TestHarness::ConfigureCUDA("FC", {"Y1", "W2", "B2"}, {"Y2"}, {});
+  *net.add_op() = TestHarness::ConfigureCUDA("Relu", {"Y2"}, {"O"}, {});
+  net.add_external_output("O");
+
+  auto fused = fuseTcSubgraphs(net);
+  ASSERT_EQ(fused.op_size(), 1);
+  EXPECT_EQ(fused.op(0).type(), "TcOp");
+  EXPECT_EQ(fused.op(0).input_size(), 5);
+  EXPECT_EQ(fused.op(0).output(0), "O");
+
+  Workspace w1;
+  init_ws(w1);
+  unique_ptr<NetBase> refNet(CreateNet(net, &w1));
+  ASSERT_TRUE(refNet.get());
+  ASSERT_TRUE(refNet->Run());
+
+  Workspace w2;
+  init_ws(w2);
+  unique_ptr<NetBase> fusedNet(CreateNet(fused, &w2));
+  ASSERT_TRUE(fusedNet.get());
+  ASSERT_TRUE(fusedNet->Run());
+
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  TestHarness::CheckEqual(w1, w2, "O", 1e-5);
+
+  // Intermediate results that are external outputs are not fused away.
+  net.add_external_output("Y2");
+  fused = fuseTcSubgraphs(net);
+  ASSERT_EQ(fused.op_size(), 2);
+  EXPECT_EQ(fused.op(0).type(), "TcOp");
+  EXPECT_EQ(fused.op(0).output(0), "Y2");
+  EXPECT_EQ(fused.op(1).type(), "Relu");
+}
+
+TEST_F(Caffe2Test, TcSubgraph) {
+  auto init_ws = [&](Workspace& w) {
+    auto AddInput =
+        TestHarness::AddDeterministicallyRandomInput<float, CUDAContext>;
+    AddInput(w, {B, M}, "I");
+    AddInput(w, {N, M}, "W1");
+    AddInput(w, {N}, "B1");
+    AddInput(w, {O, N}, "W2");
+    AddInput(w, {O}, "B2");
+    AddInput(w, {B, O}, "O2_grad");
+  };
+
+  NetDef net;
+  *net.add_op() =
+      TestHarness::ConfigureCUDA("FC", {"I", "W1", "B1"}, {"T1"}, {});
+  *net.add_op() = TestHarness::ConfigureCUDA("Relu", {"T1"}, {"O1"}, {});
+  *net.add_op() =
+      TestHarness::ConfigureCUDA("FC", {"O1", "W2", "B2"}, {"T2"}, {});
+  *net.add_op() = TestHarness::ConfigureCUDA("Relu", {"T2"}, {"O2"}, {});
+
+  Workspace w1;
+  init_ws(w1);
+  unique_ptr<NetBase> refNet(CreateNet(net, &w1));
+  ASSERT_TRUE(refNet.get());
+  ASSERT_TRUE(refNet->Run());
+  for (int i = net.op_size() - 1; i >= 0; --i) {
+    TestHarness::RunGradient(w1, net.op(i));
+  }
+
+  auto tc = R"TC(
+def fc1(float(B,M) I, float(N,M) W1, float(N) B1) -> (O1) {
+  O1(b, n) +=! I(b, r_m) * W1(n, r_m)
+  O1(b, n) = fmax(O1(b, n) + B1(n), 0)
+}
+def fc2(float(B,N) O1, float(O,N) W2, float(O) B2) -> (O2) {
+  O2(b, o) +=! O1(b, r_n) * W2(o, r_n)
+  O2(b, o) = fmax(O2(b, o) + B2(o), 0)
+}
+)TC";
+  Argument tcArg = MakeArgument<string>("tcDef", tc);
+  Argument tcNamesArg =
+      MakeArgument<vector<string>>("tcNames", {"fc1", "fc2"});
+  auto def = TestHarness::ConfigureCUDA(
+      "TcSubgraph",
+      {"I", "W1", "B1", "W2", "B2"},
+      {"O2"},
+      {tcArg, tcNamesArg});
+
+  Workspace w2;
+  init_ws(w2);
+  auto op = CreateOperator(def, &w2);
+  ASSERT_TRUE(op.get());
+  ASSERT_TRUE(op->Run());
+  TestHarness::RunGradient(w2, def);
+
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  TestHarness::CheckEqual(w1, w2, "O2", 1e-5);
+  for (auto name : {"I", "W1", "B1", "W2", "B2"}) {
+    TestHarness::CheckEqual(w1, w2, string(name) + "_grad", 1e-4);
+  }
+}
+
 TEST_F(Caffe2Test, TcConvolutionOp) {
   auto init_ws = [&](Workspace& w) {
     auto AddInput =
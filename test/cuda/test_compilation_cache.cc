@@ -13,7 +13,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <unistd.h>
+
 #include <future>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -21,6 +24,7 @@
 
 #include "tc/aten/aten_compiler.h"
 #include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_kernel_bundle.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
 #include "tc/core/flags.h"
 #include "tc/core/scope_guard.h"
@@ -357,6 +361,169 @@ TEST_F(CudaCacheTest, Serialization) {
   ASSERT_EQ(tc::CudaCache::getCache()->numberCacheAttemps, 0);
 }
 
+TEST_F(CudaCacheTest, ManyEntries) {
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+
+  constexpr int kNumEntries = 1000;
+  for (int i = 0; i < kNumEntries; ++i) {
+    tc::CudaCache::getCache()->cacheKernel(
+        "kernel" + std::to_string(i),
+        options,
+        inputPtrs,
+        outputPtrs,
+        "",
+        {i},
+        "source" + std::to_string(i),
+        {1, 1, 1},
+        {1, 1, 1});
+  }
+  ASSERT_EQ(tc::CudaCache::getCache()->size(), kNumEntries);
+
+  for (int i = kNumEntries - 1; i >= 0; --i) {
+    auto ret = tc::CudaCache::getCache()->retrieveKernel(
+        "kernel" + std::to_string(i), options, inputPtrs, outputPtrs);
+    ASSERT_TRUE(ret);
+    ASSERT_EQ(ret->source, "source" + std::to_string(i));
+    ASSERT_EQ(ret->parameters, std::vector<int>{i});
+  }
+
+  // The index must survive a serialization round trip.
+  auto buf = tc::CudaCache::getCache()->toProtobuf();
+  tc::CudaCache::loadCacheFromProtobuf(buf);
+  auto ret = tc::CudaCache::getCache()->retrieveKernel(
+      "kernel42", options, inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(ret->source, "source42");
+
+  // And must be emptied along with the entries.
+  tc::CudaCache::getCache()->clear();
+  ret = tc::CudaCache::getCache()->retrieveKernel(
+      "kernel42", options, inputPtrs, outputPtrs);
+  ASSERT_FALSE(ret);
+}
+
+TEST_F(CudaCacheTest, PtxSerialization) {
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  auto arch = tc::CudaRTCFunction::CurrentDeviceArchitecture();
+
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel", options, inputPtrs, outputPtrs, "", {}, "source", {1}, {1});
+  auto ret = tc::CudaCache::getCache()->retrieveKernel(
+      "kernel", options, inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_TRUE(ret->ptx.empty());
+
+  tc::CudaCache::getCache()->cacheKernelPtx(
+      "kernel", options, inputPtrs, outputPtrs, arch, "ptx");
+  tc::CudaCache::getCache()->cacheKernelPtx(
+      "kernel", options, inputPtrs, outputPtrs, "compute_00", "other");
+
+  auto buf = tc::CudaCache::getCache()->toProtobuf();
+  tc::CudaCache::loadCacheFromProtobuf(buf);
+  ret = tc::CudaCache::getCache()->retrieveKernel(
+      "kernel", options, inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(ret->ptx, "ptx");
+}
+
+TEST_F(CudaCacheTest, LeastRecentlyUsedEviction) {
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  tc::FLAGS_cuda_cache_max_entries = 2;
+  tc::ScopeGuard sg([]() { tc::FLAGS_cuda_cache_max_entries = 0; });
+
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel0", options, inputPtrs, outputPtrs, "", {}, "source0", {1}, {1});
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel1", options, inputPtrs, outputPtrs, "", {}, "source1", {1}, {1});
+  ASSERT_TRUE(tc::CudaCache::getCache()->retrieveKernel(
+      "kernel0", options, inputPtrs, outputPtrs));
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel2", options, inputPtrs, outputPtrs, "", {}, "source2", {1}, {1});
+
+  ASSERT_EQ(tc::CudaCache::getCache()->size(), 2);
+  ASSERT_EQ(tc::CudaCache::getCache()->numberEvictions, 1);
+  ASSERT_TRUE(tc::CudaCache::getCache()->retrieveKernel(
+      "kernel0", options, inputPtrs, outputPtrs));
+  ASSERT_FALSE(tc::CudaCache::getCache()->retrieveKernel(
+      "kernel1", options, inputPtrs, outputPtrs));
+  ASSERT_TRUE(tc::CudaCache::getCache()->retrieveKernel(
+      "kernel2", options, inputPtrs, outputPtrs));
+}
+
+TEST_F(CudaCacheTest, FileAppend) {
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  auto arch = tc::CudaRTCFunction::CurrentDeviceArchitecture();
+  auto filename = "/tmp/tc_test_cache_file." + std::to_string(getpid());
+  tc::ScopeGuard sg([&]() { unlink(filename.c_str()); });
+
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel0", options, inputPtrs, outputPtrs, "", {}, "source0", {1}, {1});
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel1", options, inputPtrs, outputPtrs, "", {}, "source1", {2}, {2});
+  tc::CudaCache::appendCacheToFile(filename);
+  ASSERT_EQ(tc::CacheFile(filename).records().size(), 2);
+
+  // Only the new and modified entries are appended.
+  tc::CudaCache::loadCacheFromFile(filename);
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel2", options, inputPtrs, outputPtrs, "", {}, "source2", {3}, {3});
+  tc::CudaCache::getCache()->cacheKernelPtx(
+      "kernel0", options, inputPtrs, outputPtrs, arch, "ptx");
+  tc::CudaCache::appendCacheToFile(filename);
+  ASSERT_EQ(tc::CacheFile(filename).records().size(), 4);
+
+  tc::CudaCache::loadCacheFromFile(filename);
+  auto ret = tc::CudaCache::getCache()->retrieveKernel(
+      "kernel0", options, inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(ret->source, "source0");
+  ASSERT_EQ(ret->ptx, "ptx");
+  ret = tc::CudaCache::getCache()->retrieveKernel(
+      "kernel2", options, inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(ret->grid, tc::Grid({3}));
+  ASSERT_EQ(tc::CudaCache::getCache()->size(), 3);
+
+  // Rewriting drops the superseded record.
+  tc::CudaCache::writeCacheToFile(filename);
+  ASSERT_EQ(tc::CacheFile(filename).records().size(), 3);
+}
+
+TEST_F(CudaCacheTest, BackgroundFlush) {
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  auto filename = "/tmp/tc_test_flush_cache_file." + std::to_string(getpid());
+  tc::ScopeGuard sg([&]() { unlink(filename.c_str()); });
+
+  tc::CudaCache::loadCacheFromFile(filename);
+  tc::CudaCache::startBackgroundFlush(filename, std::chrono::hours(1), 2);
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel0", options, inputPtrs, outputPtrs, "", {}, "source0", {1}, {1});
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel1", options, inputPtrs, outputPtrs, "", {}, "source1", {2}, {2});
+  // The second entry wakes up the flusher.
+  for (int i = 0; i < 1000 and tc::CacheFile(filename).records().size() < 2;
+       ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(tc::CacheFile(filename).records().size(), 2);
+
+  // Stopping flushes what is left.
+  tc::CudaCache::getCache()->cacheKernel(
+      "kernel2", options, inputPtrs, outputPtrs, "", {}, "source2", {3}, {3});
+  tc::CudaCache::stopBackgroundFlush();
+  ASSERT_EQ(tc::CacheFile(filename).records().size(), 3);
+}
+
 class OptionsCacheTest : public ::testing::Test {
  protected:
   void SetUp() {
@@ -465,6 +632,35 @@ TEST_F(OptionsCacheTest, DifferentOptions) {
   ASSERT_EQ(tc::OptionsCache::getCache()->numberCacheAttemps, 2);
 }
 
+TEST_F(OptionsCacheTest, ModifiedOptions) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+  auto options1 = options0;
+  ASSERT_EQ(options0.hash(), options1.hash());
+  ASSERT_EQ(options0, options1);
+
+  // The hashes cached by the comparison are dropped by the modifiers
+  options1.tile(4, 8).useSharedMemory(true);
+  ASSERT_NE(options0.hash(), options1.hash());
+  ASSERT_NE(options0, options1);
+  options0.tile(4, 8).useSharedMemory(true);
+  ASSERT_EQ(options0, options1);
+
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel", options0, inputPtrs, outputPtrs, std::chrono::microseconds(1));
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel",
+      tc::CudaMappingOptions(options1.toProtobufSerializedString()),
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(2));
+  auto ret = tc::OptionsCache::getCache()->retrieveOptionsAndRuntimes(
+      "kernel", inputPtrs, outputPtrs);
+  ASSERT_EQ(ret.size(), 1);
+  ASSERT_EQ(ret[0].recordedRuntimes.size(), 2);
+}
+
 TEST_F(OptionsCacheTest, DifferentInputs) {
   auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
   auto inputPtrs = InputPtrs();
@@ -767,6 +963,282 @@ TEST_F(OptionsCacheTest, Serialization) {
   ASSERT_EQ(tc::OptionsCache::getCache()->numberCacheAttemps, 0);
 }
 
+TEST_F(OptionsCacheTest, Merge) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(0);
+  auto options1 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+
+  // Two tuning runs of the same kernel.
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  auto first = tc::OptionsCache::getCache()->toProtobuf();
+  tc::OptionsCache::getCache()->clear();
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(12));
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0", options1, inputPtrs, outputPtrs, std::chrono::microseconds(8));
+  auto second = tc::OptionsCache::getCache()->toProtobuf();
+  tc::OptionsCache::getCache()->clear();
+  // And one by another version.
+  auto stale = first;
+  stale.mutable_entries(0)->set_git_version("stale");
+  stale.mutable_entries(0)->set_id("kernel1");
+
+  ASSERT_EQ(tc::OptionsCache::getCache()->merge(first), 1);
+  ASSERT_EQ(tc::OptionsCache::getCache()->merge(second), 1);
+  ASSERT_EQ(tc::OptionsCache::getCache()->merge(stale, tc::git_version), 0);
+  ASSERT_EQ(tc::OptionsCache::getCache()->size(), 1);
+  ASSERT_EQ(tc::OptionsCache::getCache()->totalSize(), 2);
+  auto ret = tc::OptionsCache::getCache()->retrieveOptionsAndRuntimes(
+      "kernel0", inputPtrs, outputPtrs);
+  ASSERT_EQ(ret.size(), 2);
+  ASSERT_EQ(ret[0].options, options0);
+  ASSERT_EQ(
+      ret[0].recordedRuntimes,
+      std::vector<tc::Duration>(
+          {std::chrono::microseconds(10), std::chrono::microseconds(12)}));
+  ASSERT_EQ(ret[1].options, options1);
+
+  tc::OptionsCache::getCache()->keepOnlyBestCandidates(1);
+  ret = tc::OptionsCache::getCache()->retrieveOptionsAndRuntimes(
+      "kernel0", inputPtrs, outputPtrs);
+  ASSERT_EQ(ret.size(), 1);
+  ASSERT_EQ(ret[0].options, options1);
+}
+
+TEST_F(OptionsCacheTest, SharedFile) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(0);
+  auto options1 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  auto filename = "/tmp/tc_test_shared_cache_file." + std::to_string(getpid());
+  tc::ScopeGuard sg([&]() { unlink(filename.c_str()); });
+
+  // Two caches sharing a file, as two processes would.
+  tc::OptionsCache::loadSharedCacheFromFile(filename);
+  auto first = tc::OptionsCache::getCache();
+  tc::OptionsCache::loadSharedCacheFromFile(filename);
+  auto second = tc::OptionsCache::getCache();
+
+  first->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  auto ret =
+      second->retrieveOptionsAndRuntimes("kernel0", inputPtrs, outputPtrs);
+  ASSERT_EQ(ret.size(), 1);
+  ASSERT_EQ(ret[0].recordedRuntimes.size(), 1);
+
+  second->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(12));
+  first->recordRuntime(
+      "kernel0",
+      options1,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(11));
+
+  // No runtime is lost or duplicated.
+  tc::OptionsCache::loadCacheFromFile(filename);
+  ret = tc::OptionsCache::getCache()->retrieveOptionsAndRuntimes(
+      "kernel0", inputPtrs, outputPtrs);
+  ASSERT_EQ(ret.size(), 2);
+  ASSERT_EQ(ret[0].options, options0);
+  ASSERT_EQ(
+      ret[0].recordedRuntimes,
+      std::vector<tc::Duration>(
+          {std::chrono::microseconds(10), std::chrono::microseconds(12)}));
+  ASSERT_EQ(ret[1].options, options1);
+  ASSERT_EQ(ret[1].recordedRuntimes.size(), 1);
+
+  tc::OptionsCache::writeCacheToFile(filename);
+  ASSERT_EQ(tc::CacheFile(filename).records().size(), 1);
+}
+
+TEST_F(OptionsCacheTest, NearestShape) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(0);
+  auto options1 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  inputs[0].shape[0] = 20;
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options1,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+
+  // 8 is closer to 5 than to 20.
+  inputs[0].shape[0] = 8;
+  ASSERT_FALSE(tc::OptionsCache::getCache()->retrieveBestOptions(
+      "kernel0", inputPtrs, outputPtrs));
+  tc::OptionsCache::NearestShapeQuery query;
+  query.numberEntries = 2;
+  auto ret = tc::OptionsCache::getCache()->retrieveNearestShapeOptions(
+      "kernel0", inputPtrs, outputPtrs, query);
+  ASSERT_EQ(ret.size(), 2);
+  ASSERT_EQ(ret[0].options, options0);
+  ASSERT_EQ(ret[1].options, options1);
+  ASSERT_LT(ret[0].distance, ret[1].distance);
+
+  query.maxDistance = ret[0].distance / 2;
+  ASSERT_EQ(
+      tc::OptionsCache::getCache()
+          ->retrieveNearestShapeOptions("kernel0", inputPtrs, outputPtrs, query)
+          .size(),
+      0);
+
+  // Different ranks are not comparable.
+  inputs[1].ndim = 2;
+  query.maxDistance = std::numeric_limits<double>::infinity();
+  ASSERT_EQ(
+      tc::OptionsCache::getCache()
+          ->retrieveNearestShapeOptions("kernel0", inputPtrs, outputPtrs, query)
+          .size(),
+      0);
+  inputs[1].ndim = 0;
+}
+
+TEST_F(OptionsCacheTest, TuningSamples) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(0);
+  auto options1 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  inputs[0].shape[0] = 20;
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options1,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(30));
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel1",
+      options1,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(30));
+
+  auto samples = tc::OptionsCache::getCache()->retrieveTuningSamples("kernel0");
+  ASSERT_EQ(samples.size(), 2);
+  std::sort(
+      samples.begin(),
+      samples.end(),
+      [](const tc::OptionsCache::TuningSample& a,
+         const tc::OptionsCache::TuningSample& b) {
+        return a.medianRuntime < b.medianRuntime;
+      });
+  ASSERT_EQ(samples[0].options, options0);
+  ASSERT_EQ(samples[0].medianRuntime, std::chrono::microseconds(10));
+  ASSERT_EQ(samples[1].options, options1);
+  ASSERT_EQ(samples[1].inputs[0].shape[0], 20);
+  ASSERT_EQ(
+      tc::OptionsCache::getCache()->retrieveTuningSamples("kernel2").size(), 0);
+}
+
+TEST_F(OptionsCacheTest, Metrics) {
+  auto options0 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(0);
+  auto options1 = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  tc::KernelMetrics metrics;
+  metrics.achievedOccupancy = 0.5;
+  metrics.l2HitRate = 0.25;
+  tc::OptionsCache::getCache()->recordMetrics(
+      "kernel0", options0, inputPtrs, outputPtrs, metrics);
+  // Without recorded runtimes, the metrics are dropped
+  tc::OptionsCache::getCache()->recordMetrics(
+      "kernel0", options1, inputPtrs, outputPtrs, metrics);
+
+  auto buf = tc::OptionsCache::getCache()->toProtobuf();
+  tc::OptionsCache::loadCacheFromProtobuf(buf);
+  ASSERT_EQ(tc::OptionsCache::getCache()->totalSize(), 1);
+  auto samples = tc::OptionsCache::getCache()->retrieveTuningSamples("kernel0");
+  ASSERT_EQ(samples.size(), 1);
+  ASSERT_FALSE(samples[0].metrics.empty());
+  ASSERT_EQ(samples[0].metrics.achievedOccupancy, 0.5);
+  ASSERT_EQ(samples[0].metrics.l2HitRate, 0.25);
+  ASSERT_LT(samples[0].metrics.dramUtilization, 0);
+  ASSERT_LT(samples[0].metrics.sharedBankConflicts, 0);
+}
+
+TEST_F(OptionsCacheTest, SameArchitectureFallback) {
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions().tile(0);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  tc::OptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  auto buf = tc::OptionsCache::getCache()->toProtobuf();
+  ASSERT_EQ(buf.entries_size(), 1);
+  ASSERT_EQ(
+      buf.entries(0).device_arch(),
+      tc::CudaRTCFunction::CurrentDeviceArchitecture());
+
+  tc::OptionsCache::DeviceMatch match;
+  ASSERT_TRUE(tc::OptionsCache::getCache()->retrieveBestOptions(
+      "kernel0", inputPtrs, outputPtrs, &match));
+  ASSERT_EQ(match, tc::OptionsCache::DeviceMatch::Exact);
+
+  // Tuned on another SKU with the same compute capability.
+  buf.mutable_entries(0)->set_device_str("Some Other GPU");
+  {
+    tc::OptionsCache cache(buf);
+    auto ret =
+        cache.retrieveBestOptions("kernel0", inputPtrs, outputPtrs, &match);
+    ASSERT_TRUE(ret);
+    ASSERT_EQ(*ret, options);
+    ASSERT_EQ(match, tc::OptionsCache::DeviceMatch::SameArchitecture);
+    auto all =
+        cache.retrieveOptionsAndRuntimes("kernel0", inputPtrs, outputPtrs);
+    ASSERT_EQ(all.size(), 1);
+    ASSERT_EQ(
+        all[0].deviceMatch, tc::OptionsCache::DeviceMatch::SameArchitecture);
+  }
+
+  // Neither the device nor its compute capability match.
+  buf.mutable_entries(0)->set_device_arch("compute_00");
+  {
+    tc::OptionsCache cache(buf);
+    ASSERT_FALSE(cache.retrieveBestOptions("kernel0", inputPtrs, outputPtrs));
+  }
+}
+
 TEST(
     CudaAndOptionsCacheInteraction,
     RemoveFromCudaCacheEntriesNotInOptionsCache) {
@@ -1404,6 +1876,102 @@ __global__ void add100(float* __restrict__ output, const float* __restrict__ A,
   checkRtol(diff, inputs);
 }
 
+TEST(CompilationCache, KernelTemplate) {
+  static constexpr auto tc = R"(
+def add(float(N) A, float(N) B) -> (output) {
+    output(n) = A(n) + B(n)
+})";
+
+  tc::CudaKernelTemplate kernelTemplate;
+  kernelTemplate.kernelName = "add_${N}_${block0}";
+  kernelTemplate.source = R"CUDA(
+extern "C" {
+__global__ void add_${N}_${block0}(float* __restrict__ output, const float* __restrict__ A, const float* __restrict__ B)
+{
+    int t = blockIdx.x * ${block0} + threadIdx.x;
+    if (t < ${N}) {
+        output[t] = A[t] + B[t];
+    }
+}
+}
+)CUDA";
+  kernelTemplate.isValid = [](const tc::CudaKernelTemplate::Values& v) {
+    return v.at("block0") % 32 == 0;
+  };
+  kernelTemplate.grid = [](const tc::CudaKernelTemplate::Values& v) {
+    auto block = v.at("block0");
+    return tc::Grid({static_cast<uint64_t>((v.at("N") + block - 1) / block)});
+  };
+  tc::ManualCudaCache::enableCache();
+  tc::ManualCudaCache::getCache()->registerTemplate("add", kernelTemplate);
+  tc::ScopeGuard g([]() { tc::ManualCudaCache::getCache()->clearTemplates(); });
+
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(tc);
+  std::vector<at::Tensor> inputs{at::CUDA(at::kFloat).rand({100}),
+                                 at::CUDA(at::kFloat).rand({100})};
+  auto options =
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions().mapToThreads(64);
+  std::vector<at::Tensor> outputs;
+  auto handle = atCompl.compile("add", inputs, options);
+  atCompl.run("add", inputs, outputs, handle, false);
+  at::Tensor diff = outputs[0].sub(inputs[0].add(inputs[1]));
+  checkRtol(diff, inputs);
+
+  // Values rejected by the template prune the compilation
+  options.mapToThreads(48);
+  ASSERT_EQ(tc::InvalidHandle, atCompl.compile("add", inputs, options));
+}
+
+TEST(CompilationCache, KernelBundle) {
+  static constexpr auto tc = R"(
+def add(float(N) A, float(N) B) -> (output) {
+    output(n) = A(n) + B(n)
+})";
+  std::vector<at::Tensor> inputs{at::CUDA(at::kFloat).rand({100}),
+                                 at::CUDA(at::kFloat).rand({100})};
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+
+  // Record a runtime so that the options cache holds the options to bundle.
+  tc::OptionsCache::enableCache();
+  {
+    tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+    atCompl.define(tc);
+    std::vector<at::Tensor> outputs;
+    auto handle = atCompl.compile("add", inputs, options);
+    atCompl.run("add", inputs, outputs, handle, true);
+  }
+  auto optionsCache = tc::OptionsCache::getCache()->toProtobuf();
+  tc::OptionsCache::disableCache();
+
+  tc::CudaKernelBundle::enableCache();
+  tc::ScopeGuard g([]() { tc::CudaKernelBundle::disableCache(); });
+  ASSERT_EQ(
+      1u,
+      tc::compileKernelBundle(
+          *tc::CudaKernelBundle::getCache(),
+          tc,
+          optionsCache,
+          {tc::CudaRTCFunction::CurrentDeviceRealArchitecture()}));
+  tc::CudaKernelBundle::loadCacheFromProtobuf(
+      tc::CudaKernelBundle::getCache()->toProtobuf());
+
+  // The bundled cubin is loaded, the CudaCache is not even queried.
+  tc::CudaCache::enableCache();
+  tc::ScopeGuard g2([]() { tc::CudaCache::disableCache(); });
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(tc);
+  std::vector<at::Tensor> outputs;
+  auto handle = atCompl.compile("add", inputs, options);
+  atCompl.run("add", inputs, outputs, handle, false);
+  EXPECT_EQ(1, tc::CudaKernelBundle::getCache()->numberSuccessfulRetrievals);
+  EXPECT_EQ(0, tc::CudaCache::getCache()->numberAttemptedRetrievals);
+  EXPECT_EQ(0, tc::CudaCache::getCache()->numberCacheAttemps);
+
+  at::Tensor diff = outputs[0].sub(inputs[0].add(inputs[1]));
+  checkRtol(diff, inputs);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -236,11 +236,10 @@ TEST(TestCornerCases, E19) {
       {F(1)});
 }
 TEST(TestCornerCases, E20) {
-  Fail(
-      "Temporaries tensors",
-      "def f(float(1) a) -> (b) { c(i) = a(i) b(i) = c(i)  }",
-      {F(1)},
-      {F(1)});
+  auto a = F(1);
+  auto b = F(1);
+  Succeed("def f(float(1) a) -> (b) { c(i) = a(i) b(i) = c(i)  }", {a}, {b});
+  CHECK_EQ(at::Scalar(a[0]).toFloat(), at::Scalar(b[0]).toFloat());
 }
 
 TEST(TestCornerCases, E21) {
@@ -285,6 +284,18 @@ TEST(TestCornerCases, E23) {
       at::Scalar(d[0]).toFloat());
 }
 
+TEST(TestCornerCases, E24) {
+  // freshly allocated outputs that are accumulated into start from zero
+  auto a = F(4);
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> cu;
+  cu.define("def f(float(4) a) -> (b) { b(i) += a(i) }");
+  auto handle = cu.compile(
+      "f", {a}, tc::CudaMappingOptions::makeNaiveCudaMappingOptions());
+  tensor_list outputs;
+  cu.run("f", {a}, outputs, handle);
+  CHECK_EQ(0.0f, at::Scalar((outputs[0] - a).abs().max()).toFloat());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -13,8 +13,18 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <gflags/gflags.h>
@@ -24,8 +34,27 @@
 #include <ATen/ATen.h>
 
 #include "tc/aten/aten_compiler.h"
+#include "tc/core/cuda/cuda.h"
+#include "tc/core/cuda/cuda_adaptive_selection.h"
+#include "tc/core/cuda/cuda_batching_execution.h"
+#include "tc/core/cuda/cuda_compilation_cache.h"
+#include "tc/core/cuda/cuda_compile_server.h"
+#include "tc/core/cuda/cuda_cpu_dispatch.h"
+#include "tc/core/cuda/cuda_dag_execution.h"
+#include "tc/core/cuda/cuda_data_parallel.h"
+#include "tc/core/cuda/cuda_heuristic_options.h"
+#include "tc/core/cuda/cuda_launch_graph.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_measurement.h"
+#include "tc/core/cuda/cuda_out_of_core_execution.h"
+#include "tc/core/cuda/cuda_streaming_execution.h"
 #include "tc/core/cuda/cuda_tc_executor.h"
+#include "tc/core/execution_engine.h"
+#include "tc/core/flags.h"
+#include "tc/core/scope_guard.h"
+#include "tc/core/telemetry.h"
+#include "tc/lang/canonicalize.h"
+#include "tc/lang/parse_cache.h"
 #include "tc/library/common.h"
 
 #include "test_harness_aten_cuda.h"
@@ -290,6 +319,1136 @@ def cast(float(M,N) A, int32 four) -> (int32(M,N) output) {
   CHECK_EQ(r, 0);
 }
 
+TEST_F(ATenCompilationUnitTest, BoundCall) {
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  auto call = atCompl.bind(
+      "matmul", {a, b}, tc::CudaMappingOptions::makeMlpCudaMappingOptions());
+  auto handle = call.handle();
+
+  // Same signature, new data: the bound kernel is launched as is.
+  std::vector<at::Tensor> outputs;
+  for (int i = 0; i < 2; ++i) {
+    a.uniform_();
+    call.run({a, b}, outputs);
+    EXPECT_EQ(handle, call.handle());
+    checkRtol(outputs[0].sub(a.mm(b)), {a, b}, 4);
+  }
+
+  // Another signature rebinds the call, the outputs are resized.
+  at::Tensor c = at::CUDA(at::kFloat).rand({6, 4});
+  call.run({c, b}, outputs);
+  EXPECT_NE(handle, call.handle());
+  ASSERT_EQ(outputs[0].size(0), 6);
+  checkRtol(outputs[0].sub(c.mm(b)), {c, b}, 4);
+}
+
+TEST_F(ATenCompilationUnitTest, InPlace) {
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def relu(float(M,N) I) -> (O aliases I) {
+    O(m, n) = fmax(I(m, n), 0)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({32, 64}).sub_(0.5);
+  at::Tensor expected = a.clamp(0);
+  auto handle = atCompl.compile(
+      "relu", {a}, tc::CudaMappingOptions::makePointwiseCudaMappingOptions());
+
+  // Allocated outputs reuse the storage of the input they alias.
+  std::vector<at::Tensor> outputs;
+  atCompl.run("relu", {a}, outputs, handle);
+  EXPECT_EQ(outputs[0].data_ptr(), a.data_ptr());
+  checkRtol(a.sub(expected), {expected}, 1);
+
+  // Separate outputs are still written as usual.
+  at::Tensor b = at::CUDA(at::kFloat).rand({32, 64}).sub_(0.5);
+  std::vector<at::Tensor> separate{at::CUDA(at::kFloat).zeros({32, 64})};
+  atCompl.run("relu", {b}, separate, handle);
+  EXPECT_NE(separate[0].data_ptr(), b.data_ptr());
+  checkRtol(separate[0].sub(b.clamp(0)), {b}, 1);
+}
+
+TEST_F(ATenCompilationUnitTest, Pipeline) {
+  at::Tensor I = at::CUDA(at::kFloat).rand({16, 32});
+  at::Tensor W1 = at::CUDA(at::kFloat).rand({24, 32});
+  at::Tensor B1 = at::CUDA(at::kFloat).rand({24});
+  at::Tensor W2 = at::CUDA(at::kFloat).rand({8, 24});
+  at::Tensor B2 = at::CUDA(at::kFloat).rand({8});
+
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def fc1(float(B,M) I, float(N,M) W1, float(N) B1) -> (O1) {
+    O1(b, n) +=! I(b, r_m) * W1(n, r_m)
+    O1(b, n) = fmax(O1(b, n) + B1(n), 0)
+}
+def fc2(float(B,N) O1, float(O,N) W2, float(O) B2) -> (O2) {
+    O2(b, o) +=! O1(b, r_n) * W2(o, r_n)
+    O2(b, o) = fmax(O2(b, o) + B2(o), 0)
+}
+)");
+  atCompl.definePipeline("fc2relu", {"fc1", "fc2"});
+
+  // The pipeline takes the inputs of both definitions and only returns O2.
+  std::vector<at::Tensor> inputs = {I, W1, B1, W2, B2};
+  std::vector<at::Tensor> outputs;
+  auto handle = atCompl.compile(
+      "fc2relu", inputs, tc::CudaMappingOptions::makeMlpCudaMappingOptions());
+  atCompl.run("fc2relu", inputs, outputs, handle);
+  ASSERT_EQ(outputs.size(), 1u);
+
+  auto O1 = I.mm(W1.t()).add(B1).clamp(0);
+  auto O2 = O1.mm(W2.t()).add(B2).clamp(0);
+  checkRtol(outputs[0].sub(O2), inputs, 32 * 24);
+}
+
+TEST_F(ATenCompilationUnitTest, Gradient) {
+  at::Tensor I = at::CUDA(at::kFloat).rand({16, 32});
+  at::Tensor W1 = at::CUDA(at::kFloat).rand({24, 32}).sub(0.5);
+  at::Tensor B1 = at::CUDA(at::kFloat).rand({24}).sub(0.5);
+  at::Tensor O1_grad = at::CUDA(at::kFloat).rand({16, 24});
+
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def fcrelu(float(B,M) I, float(N,M) W1, float(N) B1) -> (O1) {
+    O1(b, n) +=! I(b, r_m) * W1(n, r_m)
+    O1(b, n) = fmax(O1(b, n) + B1(n), 0)
+}
+)");
+  atCompl.defineGradient("fcrelu", "");
+
+  std::vector<at::Tensor> inputs = {I, W1, B1, O1_grad};
+  std::vector<at::Tensor> outputs;
+  auto handle = atCompl.compile(
+      "fcrelu_grad",
+      inputs,
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions());
+  atCompl.run("fcrelu_grad", inputs, outputs, handle);
+  ASSERT_EQ(outputs.size(), 3u);
+
+  auto O1 = I.mm(W1.t()).add(B1);
+  auto G = O1_grad.mul(O1.ge(0).toType(at::kFloat));
+  checkRtol(outputs[0].sub(G.mm(W1)), inputs, 24);
+  checkRtol(outputs[1].sub(G.t().mm(I)), inputs, 16);
+  checkRtol(outputs[2].sub(G.sum(0)), inputs, 16);
+}
+
+TEST_F(ATenCompilationUnitTest, FactoredContractions) {
+  at::Tensor A = at::CUDA(at::kFloat).rand({64, 8});
+  at::Tensor B = at::CUDA(at::kFloat).rand({8, 128});
+  at::Tensor C = at::CUDA(at::kFloat).rand({128, 16});
+
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def chain(float(M,K) A, float(K,L) B, float(L,N) C) -> (O) {
+    O(m, n) +=! A(m, r_k) * B(r_k, r_l) * C(r_l, n)
+}
+)");
+  atCompl.defineFactoredContractions(
+      "chain", "chain_factored", {{"M", 64}, {"K", 8}, {"L", 128}, {"N", 16}});
+
+  std::vector<at::Tensor> inputs = {A, B, C};
+  std::vector<at::Tensor> outputs;
+  auto handle = atCompl.compile(
+      "chain_factored",
+      inputs,
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions());
+  atCompl.run("chain_factored", inputs, outputs, handle);
+  ASSERT_EQ(outputs.size(), 1u);
+  checkRtol(outputs[0].sub(A.mm(B).mm(C)), inputs, 8 * 128);
+}
+
+TEST(ExecutionEngineTest, CompileAsync) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  engine.setCompilationThreads(2);
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+                     .toProtobufSerializedString();
+  tc::CudaRTCFunction::ResetCompileTimings();
+
+  std::vector<std::future<size_t>> handles;
+  std::vector<std::vector<at::Tensor>> inputs;
+  for (auto size : {3, 7, 11}) {
+    inputs.push_back({at::CUDA(at::kFloat).rand({size, 4}),
+                      at::CUDA(at::kFloat).rand({4, 5})});
+    // The DLTensors are released before the compilation completes.
+    auto inputsPair = tc::toConstDlpackTensors(inputs.back());
+    handles.push_back(engine.compileAsync("matmul", inputsPair.first, options));
+    tc::deleteDlmTensors(inputsPair.second);
+  }
+
+  for (size_t i = 0; i < handles.size(); ++i) {
+    auto handle = handles[i].get();
+    auto inputsPair = tc::toConstDlpackTensors(inputs[i]);
+    tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+    // Compiling again must hit the executor compiled asynchronously.
+    ASSERT_EQ(handle, engine.compile("matmul", inputsPair.first, options));
+  }
+
+  size_t numberCompilations = 0;
+  for (const auto& kvp : tc::CudaRTCFunction::PerThreadCompileTimings()) {
+    ASSERT_NE(kvp.first, std::this_thread::get_id());
+    numberCompilations += kvp.second.numberCompilations;
+  }
+  ASSERT_EQ(numberCompilations, handles.size());
+}
+
+TEST(ExecutionEngineTest, HandleReuse) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+                     .toProtobufSerializedString();
+  std::vector<at::Tensor> inputs;
+  std::vector<size_t> handles;
+  for (auto size : {3, 7, 11}) {
+    at::Tensor a = at::CUDA(at::kFloat).rand({size, 4});
+    at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+    auto inputsPair = tc::toConstDlpackTensors({a, b});
+    tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+    handles.push_back(engine.compile("matmul", inputsPair.first, options));
+    if (handles.size() == 1) {
+      engine.clear(handles[0]);
+      EXPECT_EQ(1u, engine.memoryUsage().freeSlots);
+    }
+  }
+  // The slot of the first handle is reused under a new handle
+  auto usage = engine.memoryUsage();
+  EXPECT_EQ(2u, usage.executors);
+  EXPECT_EQ(0u, usage.freeSlots);
+  EXPECT_EQ(1u, usage.halideComponents);
+  EXPECT_LT(0u, usage.executorBytes);
+  EXPECT_NE(handles[0], handles[1]);
+
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({3, 5});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  // The cleared handle runs nothing, not the executor of its slot
+  EXPECT_EQ(
+      tc::Duration::max(),
+      engine.run(handles[0], inputsPair.first, outputsPair.first, true));
+  EXPECT_EQ(0.0f, c.abs().sum().toFloat());
+
+  // Under a limit, the executors compiled or run the longest ago are
+  // cleared first
+  engine.setMemoryLimit(usage.executorBytes - 1);
+  usage = engine.memoryUsage();
+  EXPECT_EQ(1u, usage.executors);
+  EXPECT_EQ(
+      tc::Duration::max(),
+      engine.run(handles[1], inputsPair.first, outputsPair.first, true));
+}
+
+TEST(ExecutionEngineTest, ShapeManifest) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  engine.recordShapeManifest(true);
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+                     .toProtobufSerializedString();
+  for (auto size : {3, 7}) {
+    at::Tensor a = at::CUDA(at::kFloat).rand({size, 4});
+    at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+    at::Tensor c = at::CUDA(at::kFloat).zeros({size, 5});
+    auto inputsPair = tc::toConstDlpackTensors({a, b});
+    auto outputsPair = tc::toDlpackTensors({c});
+    tc::ScopeGuard g([&]() {
+      tc::deleteDlmTensors(inputsPair.second);
+      tc::deleteDlmTensors(outputsPair.second);
+    });
+    auto handle = engine.compile("matmul", inputsPair.first, options);
+    for (int i = 0; i < (size == 7 ? 3 : 1); ++i) {
+      engine.run(handle, inputsPair.first, outputsPair.first);
+    }
+  }
+  // The most run shapes first
+  auto manifest = engine.shapeManifest();
+  ASSERT_EQ(2, manifest.entries_size());
+  EXPECT_EQ(3u, manifest.entries(0).runs());
+  EXPECT_EQ(1u, manifest.entries(1).runs());
+  EXPECT_EQ("matmul", manifest.entries(0).name());
+  EXPECT_EQ(7u, manifest.entries(0).inputs(0).shape(0));
+  EXPECT_FALSE(manifest.entries(0).canonical_tc().empty());
+
+  // A fresh engine defines the TC from the manifest
+  tc::ExecutionEngine<tc::CudaTcExecutor> replayed;
+  EXPECT_EQ(1u, replayed.replayShapeManifest(manifest, 2).size());
+  auto handles = replayed.replayShapeManifest(manifest);
+  ASSERT_EQ(2u, handles.size());
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+  EXPECT_EQ(handles[1], replayed.compile("matmul", inputsPair.first, options));
+}
+
+TEST(ExecutionEngineTest, PreparedLaunch) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({3, 5});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+  auto handle = engine.compile(
+      "matmul",
+      inputsPair.first,
+      tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+          .toProtobufSerializedString());
+
+  auto launch = engine.prepareLaunch(handle);
+  for (int i = 0; i < 3; ++i) {
+    at::Tensor a2 = at::CUDA(at::kFloat).rand({3, 4});
+    const void* inputs[] = {a2.data_ptr(), b.data_ptr()};
+    void* outputs[] = {c.data_ptr()};
+    launch->launch(inputs, outputs, 0);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    checkRtol(c.sub(a2.mm(b)), {a2, b}, 4);
+  }
+}
+
+TEST(ExecutionEngineTest, Warmup) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def add(float(N) A, float(N) B) -> (output) {
+    output(n) = A(n) + B(n)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({37});
+  at::Tensor b = at::CUDA(at::kFloat).rand({37});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+  auto handle = engine.compile(
+      "add",
+      inputsPair.first,
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+          .toProtobufSerializedString());
+
+  // The module is loaded before the first launch and only once.
+  auto loaded = tc::CudaRTCFunction::NumberLoadedModules();
+  engine.warmup(handle, {0});
+  EXPECT_EQ(loaded + 1, tc::CudaRTCFunction::NumberLoadedModules());
+  engine.warmup(handle, {0});
+  EXPECT_EQ(loaded + 1, tc::CudaRTCFunction::NumberLoadedModules());
+}
+
+TEST(ExecutionEngineTest, ParametricSizes) {
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+                     .parametricSize("M", 1, 64);
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  auto loadedModules = tc::CudaRTCFunction::NumberLoadedModules();
+  // One kernel serves all the values of M in range.
+  for (auto m : {3, 17, 64}) {
+    at::Tensor a = at::CUDA(at::kFloat).rand({m, 4});
+    std::vector<at::Tensor> outputs;
+    auto handle = atCompl.compile("matmul", {a, b}, options);
+    atCompl.run("matmul", {a, b}, outputs, handle);
+    checkRtol(outputs[0].sub(a.mm(b)), {a, b}, 4);
+  }
+  EXPECT_EQ(loadedModules + 1, tc::CudaRTCFunction::NumberLoadedModules());
+
+  at::Tensor a = at::CUDA(at::kFloat).rand({65, 4});
+  EXPECT_THROW(
+      atCompl.compile("matmul", {a, b}, options), std::invalid_argument);
+}
+
+TEST(ExecutionEngineTest, SizeBuckets) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+                     .sizeBuckets("M", {8, 16, 32})
+                     .toProtobufSerializedString();
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  auto loadedModules = tc::CudaRTCFunction::NumberLoadedModules();
+  // Two buckets, and 40 past the last one is specialized.
+  for (auto m : {3, 8, 9, 16, 40}) {
+    at::Tensor a = at::CUDA(at::kFloat).rand({m, 4});
+    at::Tensor c = at::CUDA(at::kFloat).zeros({m, 5});
+    auto inputsPair = tc::toConstDlpackTensors({a, b});
+    auto outputsPair = tc::toDlpackTensors({c});
+    tc::ScopeGuard g([&]() {
+      tc::deleteDlmTensors(inputsPair.second);
+      tc::deleteDlmTensors(outputsPair.second);
+    });
+    engine.run("matmul", inputsPair.first, outputsPair.first, options);
+    checkRtol(c.sub(a.mm(b)), {a, b}, 4);
+  }
+  EXPECT_EQ(loadedModules + 3, tc::CudaRTCFunction::NumberLoadedModules());
+}
+
+TEST(ExecutionEngineTest, ConcurrentRunsOfOneHandle) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+  auto handle = engine.compile(
+      "matmul",
+      inputsPair.first,
+      tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+          .toProtobufSerializedString());
+
+  // Every run must execute, none is skipped because another one holds the
+  // executor.
+  constexpr int kNumThreads = 8;
+  std::vector<at::Tensor> outputs;
+  for (int i = 0; i < kNumThreads; ++i) {
+    outputs.push_back(at::CUDA(at::kFloat).zeros({3, 5}));
+  }
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < 100; ++j) {
+        engine.uncheckedRun(
+            handle,
+            {a.data_ptr(), b.data_ptr()},
+            {outputs[i].data_ptr()},
+            tc::CudaRuntimeInformation());
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  for (const auto& output : outputs) {
+    checkRtol(output.sub(a.mm(b)), {a, b}, 4);
+  }
+}
+
+TEST(ExecutionEngineTest, Telemetry) {
+  auto sink = std::make_shared<tc::KernelHistogramSink>();
+  tc::setTelemetrySink(sink);
+  auto period = tc::FLAGS_telemetry_sampling_period;
+  tc::FLAGS_telemetry_sampling_period = 1;
+  tc::ScopeGuard g0([&]() {
+    tc::setTelemetrySink(nullptr);
+    tc::FLAGS_telemetry_sampling_period = period;
+  });
+
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions()
+                     .toProtobufSerializedString();
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({3, 5});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g1([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  auto handle = engine.compile("matmul", inputsPair.first, options);
+  ASSERT_EQ(handle, engine.compile("matmul", inputsPair.first, options));
+  for (int i = 0; i < 3; ++i) {
+    // Known shapes are not reported as compilations.
+    engine.run("matmul", inputsPair.first, outputsPair.first, options);
+  }
+  engine.uncheckedRun(handle, {a.data_ptr(), b.data_ptr()}, {c.data_ptr()});
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+
+  auto stats = sink->stats().at("matmul");
+  EXPECT_EQ(1, stats.compilations.at(tc::KernelSource::Mapper));
+  EXPECT_EQ(1, stats.compilations.at(tc::KernelSource::EngineHandle));
+  EXPECT_EQ(4, stats.runs);
+  // The unchecked run is not timed.
+  EXPECT_EQ(3, stats.sampledRuns);
+  EXPECT_LT(tc::Duration::zero(), stats.sampledTime);
+  EXPECT_LT(0, stats.grid[0]);
+  EXPECT_LT(0, stats.block[0]);
+  std::stringstream ss;
+  sink->dump(ss);
+  EXPECT_NE(std::string::npos, ss.str().find("matmul: compilations:"));
+}
+
+TEST(ExecutionEngineTest, LibraryCalls) {
+  auto sink = std::make_shared<tc::KernelHistogramSink>();
+  tc::setTelemetrySink(sink);
+  tc::ScopeGuard g([&]() { tc::setTelemetrySink(nullptr); });
+
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+def tbmm(float(P,N,M) X, float(P,K,N) Y) -> (output) {
+    output(p, m, k) +=! X(p, r_n, m) * Y(p, k, r_n)
+}
+)");
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+                     .matchLibraryCalls(true);
+
+  at::Tensor a = at::CUDA(at::kFloat).rand({30, 40});
+  at::Tensor b = at::CUDA(at::kFloat).rand({40, 50});
+  std::vector<at::Tensor> outputs;
+  auto handle = atCompl.compile("matmul", {a, b}, options);
+  atCompl.run("matmul", {a, b}, outputs, handle);
+  checkRtol(outputs[0].sub(a.mm(b)), {a, b}, 40);
+
+  at::Tensor ta = at::CUDA(at::kFloat).rand({8, 40, 30});
+  at::Tensor tb = at::CUDA(at::kFloat).rand({8, 50, 40});
+  std::vector<at::Tensor> toutputs;
+  handle = atCompl.compile("tbmm", {ta, tb}, options);
+  atCompl.run("tbmm", {ta, tb}, toutputs, handle);
+  auto ref = ta.transpose(1, 2).bmm(tb.transpose(1, 2));
+  checkRtol(toutputs[0].sub(ref), {ta, tb}, 40);
+
+  // Both are computed by cuBLAS instead of generated kernels.
+  for (const auto& name : {"matmul", "tbmm"}) {
+    auto stats = sink->stats().at(name);
+    EXPECT_EQ(1, stats.compilations.at(tc::KernelSource::LibraryCall))
+        << name;
+  }
+}
+
+TEST(ExecutionEngineTest, DataParallel) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def bmm(float(B,N,K) X, float(B,K,M) Y, float(M) bias) -> (Z) {
+    Z(b, n, m) +=! X(b, n, r_k) * Y(b, r_k, m)
+    Z(b, n, m) = Z(b, n, m) + bias(m)
+}
+)");
+  at::Tensor x = at::CUDA(at::kFloat).rand({7, 30, 40});
+  at::Tensor y = at::CUDA(at::kFloat).rand({7, 40, 50});
+  at::Tensor bias = at::CUDA(at::kFloat).rand({50});
+  at::Tensor z = at::CUDA(at::kFloat).zeros({7, 30, 50});
+  auto inputsPair = tc::toConstDlpackTensors({x, y, bias});
+  auto outputsPair = tc::toDlpackTensors({z});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+
+  // The same device twice splits across streams, others are used if any.
+  std::vector<int> devices{0, 0};
+  int numberDevices;
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaGetDeviceCount(&numberDevices));
+  if (numberDevices > 1) {
+    devices.push_back(1);
+  }
+  auto execution = tc::CudaDataParallelExecution::compile(
+      engine,
+      "bmm",
+      inputsPair.first,
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+      devices);
+  ASSERT_TRUE(execution);
+  EXPECT_EQ(devices.size(), execution->numberParts());
+  execution->run(inputsPair.first, outputsPair.first);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(z.sub(x.bmm(y).add(bias.expand_as(z))), {x, y}, 40);
+}
+
+TEST(ExecutionEngineTest, Batching) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def fc(float(B,K) X, float(N,K) W) -> (Y) {
+    Y(b, n) +=! X(b, r_k) * W(n, r_k)
+}
+)");
+  constexpr int kNumThreads = 8;
+  // A window long enough for all the threads, the batch is launched once
+  // full.
+  auto batching = tc::CudaBatchingExecution::make(
+      engine,
+      "fc",
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+      kNumThreads,
+      std::chrono::microseconds(1000000));
+  ASSERT_TRUE(batching);
+  at::Tensor w = at::CUDA(at::kFloat).rand({16, 32});
+  std::vector<at::Tensor> xs, ys;
+  for (int i = 0; i < kNumThreads; ++i) {
+    xs.push_back(at::CUDA(at::kFloat).rand({1, 32}));
+    ys.push_back(at::CUDA(at::kFloat).zeros({1, 16}));
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      auto inputsPair = tc::toConstDlpackTensors({xs[i], w});
+      auto outputsPair = tc::toDlpackTensors({ys[i]});
+      tc::ScopeGuard g([&]() {
+        tc::deleteDlmTensors(inputsPair.second);
+        tc::deleteDlmTensors(outputsPair.second);
+      });
+      batching->run(inputsPair.first, outputsPair.first);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_GE(batching->numberBatches(), 1u);
+  for (int i = 0; i < kNumThreads; ++i) {
+    checkRtol(ys[i].sub(xs[i].mm(w.t())), {xs[i], w}, 32);
+  }
+}
+
+TEST(ExecutionEngineTest, HeuristicOptions) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+def add(float(M,N) A, float(M,N) B) -> (output) {
+    output(m, n) = A(m, n) + B(m, n)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({1024, 1024});
+  at::Tensor b = at::CUDA(at::kFloat).rand({1024, 1024});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({1024, 1024});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+
+  // The matmul reuses both inputs across threads and computes thread tiles.
+  auto options = tc::makeHeuristicCudaMappingOptions(
+      engine.treeForFunction("matmul"), inputsPair.first);
+  EXPECT_EQ(2, options.proto().thread_tiling().sizes_size()) << options;
+  EXPECT_TRUE(options.proto().use_shared_memory()) << options;
+  EXPECT_TRUE(options.proto().use_private_memory()) << options;
+  engine.run(
+      "matmul",
+      inputsPair.first,
+      outputsPair.first,
+      options.toProtobufSerializedString());
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(c.sub(a.mm(b)), {a, b}, 1024);
+
+  options = tc::makeHeuristicCudaMappingOptions(
+      engine.treeForFunction("add"), inputsPair.first);
+  EXPECT_FALSE(options.proto().use_shared_memory()) << options;
+  EXPECT_EQ(32u, options.proto().block().x()) << options;
+  engine.run(
+      "add",
+      inputsPair.first,
+      outputsPair.first,
+      options.toProtobufSerializedString());
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(c.sub(a.add(b)), {a, b}, 1);
+}
+
+TEST(ExecutionEngineTest, StridedOutputs) {
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def scale(float(B,D) X) -> (Y) {
+    Y(b, d) = 2 * X(b, d)
+}
+)");
+  at::Tensor x0 = at::CUDA(at::kFloat).rand({8, 16});
+  at::Tensor x1 = at::CUDA(at::kFloat).rand({8, 16});
+  at::Tensor concat = at::CUDA(at::kFloat).zeros({8, 32});
+  std::vector<at::Tensor> slice0{concat.narrow(1, 0, 16)};
+  std::vector<at::Tensor> slice1{concat.narrow(1, 16, 16)};
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions();
+
+  // Both slices have the same strides, they share the kernel.
+  auto handle = atCompl.compile("scale", {x0}, slice0, options);
+  EXPECT_EQ(handle, atCompl.compile("scale", {x1}, slice1, options));
+  EXPECT_NE(handle, atCompl.compile("scale", {x0}, options));
+  atCompl.run("scale", {x0}, slice0, handle);
+  atCompl.run("scale", {x1}, slice1, handle);
+  auto ref = at::cat({x0.mul(2), x1.mul(2)}, 1);
+  checkRtol(concat.sub(ref), {x0, x1}, 1);
+
+  // Packed outputs are not accepted by the strided kernel.
+  std::vector<at::Tensor> packed{at::CUDA(at::kFloat).zeros({8, 16})};
+  EXPECT_THROW(atCompl.run("scale", {x0}, packed, handle), lang::ErrorReport);
+}
+
+TEST(ExecutionEngineTest, Streaming) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  // Two causal layers of dilations 1 and 2, the input is copied to an
+  // output to be delayed.
+  engine.define(R"(
+def dilated(float(B,C) X, float(C,C) W0, float(C,C) V0, float(B,C) X1,
+            float(C,C) W1, float(C,C) V1, float(B,C) H2) -> (XC, H, Y) {
+    XC(b, c) = X(b, c)
+    H(b, c) +=! W0(c, r_c) * X(b, r_c) + V0(c, r_c) * X1(b, r_c)
+    Y(b, c) +=! W1(c, r_c) * H(b, r_c) + V1(c, r_c) * H2(b, r_c)
+}
+)");
+  constexpr int64_t B = 4, C = 32, T = 6;
+  std::vector<at::Tensor> weights;
+  for (int i = 0; i < 4; ++i) {
+    weights.push_back(at::CUDA(at::kFloat).rand({C, C}));
+  }
+  at::Tensor x = at::CUDA(at::kFloat).rand({B, C});
+  at::Tensor history = at::CUDA(at::kFloat).zeros({B, C});
+  at::Tensor y = at::CUDA(at::kFloat).zeros({B, C});
+  auto inputsPair = tc::toConstDlpackTensors(
+      {x, weights[0], weights[1], history, weights[2], weights[3], history});
+  auto outputsPair = tc::toDlpackTensors({y});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+
+  auto execution = tc::CudaStreamingExecution::compile(
+      engine,
+      "dilated",
+      inputsPair.first,
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+      {{0, 3, 1}, {1, 6, 2}});
+  ASSERT_TRUE(execution);
+  auto inputs = inputsPair.first;
+  inputs[3] = nullptr;
+  inputs[6] = nullptr;
+  std::vector<DLTensor*> outputs{nullptr, nullptr, outputsPair.first[0]};
+
+  // The whole sequence recomputed at each step, zero before its start
+  std::vector<at::Tensor> xs, hs;
+  auto zero = at::CUDA(at::kFloat).zeros({B, C});
+  for (int64_t t = 0; t < T; ++t) {
+    x.copy_(at::CUDA(at::kFloat).rand({B, C}));
+    xs.push_back(x.clone());
+    auto x1 = t >= 1 ? xs[t - 1] : zero;
+    hs.push_back(x.mm(weights[0].t()).add(x1.mm(weights[1].t())));
+    auto h2 = t >= 2 ? hs[t - 2] : zero;
+    auto ref = hs[t].mm(weights[2].t()).add(h2.mm(weights[3].t()));
+    execution->step(inputs, outputs);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    checkRtol(y.sub(ref), {hs[t], h2}, 2 * C);
+  }
+  EXPECT_EQ(static_cast<size_t>(T), execution->numberSteps());
+}
+
+TEST(ExecutionEngineTest, DagExecution) {
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(R"(
+def scale(float(N) X) -> (Y) {
+    Y(n) = 2 * X(n)
+}
+def add(float(N) A, float(N) B) -> (C) {
+    C(n) = A(n) + B(n)
+}
+)");
+  constexpr int64_t N = 1024;
+  at::Tensor x1 = at::CUDA(at::kFloat).rand({N});
+  at::Tensor x2 = at::CUDA(at::kFloat).rand({N});
+  at::Tensor y1 = at::CUDA(at::kFloat).zeros({N});
+  at::Tensor y2 = at::CUDA(at::kFloat).zeros({N});
+  at::Tensor z = at::CUDA(at::kFloat).zeros({N});
+  auto inputsPair = tc::toConstDlpackTensors({x1, x2, y1, y2});
+  auto outputsPair = tc::toDlpackTensors({y1, y2, z});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  const auto& in = inputsPair.first;
+  const auto& out = outputsPair.first;
+  auto options = tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+                     .toProtobufSerializedString();
+  auto scale = engine.compile("scale", {in[0]}, options);
+  auto add = engine.compile("add", {in[2], in[3]}, options);
+
+  // The two scalings are independent, the addition reads both.
+  tc::CudaDagExecution dag(engine, 2);
+  dag.add(scale, {in[0]}, {out[0]});
+  dag.add(scale, {in[1]}, {out[1]});
+  dag.add(add, {in[2], in[3]}, {out[2]});
+  EXPECT_TRUE(dag.dependences(1).empty());
+  EXPECT_EQ(std::vector<size_t>({0, 1}), dag.dependences(2));
+  dag.run();
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(z.sub(x1.add(x2).mul(2)), {x1, x2}, 2);
+
+  z.zero_();
+  tc::CudaLaunchGraph graph;
+  dag.record(graph);
+  ASSERT_EQ(graph.size(), 3u);
+  graph.launch(0);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(z.sub(x1.add(x2).mul(2)), {x1, x2}, 2);
+}
+
+TEST(ExecutionEngineTest, AdaptiveSelection) {
+  tc::OptionsCache::enableCache();
+  tc::OptionsCache::getCache()->clear();
+  tc::ScopeGuard clearCache([]() { tc::OptionsCache::getCache()->clear(); });
+  static constexpr auto kTc = R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)";
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(kTc);
+  at::Tensor a = at::CUDA(at::kFloat).rand({30, 40});
+  at::Tensor b = at::CUDA(at::kFloat).rand({40, 50});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({30, 50});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  auto outputs = tc::dlutils::constPtrs(outputsPair.first);
+
+  // No option for these sizes yet
+  EXPECT_FALSE(
+      tc::CudaAdaptiveSelection::compile(engine, "matmul", inputsPair.first));
+
+  auto id = lang::canonicalTc(kTc);
+  tc::OptionsCache::getCache()->recordRuntime(
+      id,
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+      inputsPair.first,
+      outputs,
+      std::chrono::microseconds(1));
+  tc::OptionsCache::getCache()->recordRuntime(
+      id,
+      tc::CudaMappingOptions::makeMlpCudaMappingOptions(),
+      inputsPair.first,
+      outputs,
+      std::chrono::microseconds(2));
+  auto selection = tc::CudaAdaptiveSelection::compile(
+      engine, "matmul", inputsPair.first, 2, 4, 2);
+  ASSERT_TRUE(selection);
+  EXPECT_EQ(2u, selection->numberCandidates());
+  for (int i = 0; i < 20; ++i) {
+    selection->run(inputsPair.first, outputsPair.first);
+  }
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(c.sub(a.mm(b)), {a, b}, 40);
+
+  // The sampled runs are recorded along with the tuning's
+  size_t recorded = 0;
+  for (const auto& r :
+       tc::OptionsCache::getCache()->retrieveOptionsAndRuntimes(
+           id, inputsPair.first, outputs)) {
+    recorded += r.recordedRuntimes.size();
+  }
+  EXPECT_LE(2u + 2 * 2, recorded);
+}
+
+TEST(ExecutionEngineTest, CudaCpuDispatch) {
+  static constexpr auto kTc = R"(
+def add(float(N) A, float(N) B) -> (C) {
+    C(n) = A(n) + B(n)
+}
+)";
+  tc::ExecutionEngine<tc::CudaTcExecutor> cudaEngine;
+  tc::ExecutionEngine<tc::CpuTcExecutor> cpuEngine;
+  cudaEngine.define(kTc);
+  cpuEngine.define(kTc);
+  // Up to 64 input elements on the CPU, from 1024 on on the GPU
+  auto dispatch = tc::CudaCpuDispatch::make(
+      cudaEngine,
+      cpuEngine,
+      "add",
+      tc::CudaMappingOptions::makeNaiveCudaMappingOptions(),
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions(),
+      64,
+      1024,
+      2);
+  for (int64_t n : {16, 2048, 256}) {
+    at::Tensor a = at::CUDA(at::kFloat).rand({n});
+    at::Tensor b = at::CUDA(at::kFloat).rand({n});
+    at::Tensor c = at::CUDA(at::kFloat).zeros({n});
+    auto inputsPair = tc::toConstDlpackTensors({a, b});
+    auto outputsPair = tc::toDlpackTensors({c});
+    tc::ScopeGuard g([&]() {
+      tc::deleteDlmTensors(inputsPair.second);
+      tc::deleteDlmTensors(outputsPair.second);
+    });
+    dispatch->run(inputsPair.first, outputsPair.first);
+    TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+    checkRtol(c.sub(a.add(b)), {a, b}, 1);
+  }
+  // The 512 input elements in between moved one of the bounds
+  EXPECT_TRUE(
+      dispatch->cpuMaxElements() == 512 or dispatch->gpuMinElements() == 512);
+  EXPECT_LT(dispatch->cpuMaxElements(), dispatch->gpuMinElements());
+}
+
+TEST(ExecutionEngineTest, OutOfCore) {
+  static constexpr auto kTc = R"(
+def scale(float(N, K) A, float(K) B) -> (C) {
+    C(n, k) = A(n, k) * B(k)
+}
+)";
+  tc::ExecutionEngine<tc::CudaTcExecutor> engine;
+  engine.define(kTc);
+  // Host tensors, chunks of 10 rows fit the budget next to B
+  at::Tensor a = at::CPU(at::kFloat).rand({37, 16});
+  at::Tensor b = at::CPU(at::kFloat).rand({16});
+  at::Tensor c = at::CPU(at::kFloat).zeros({37, 16});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  size_t budget = 16 * 4 + 2 * 10 * (16 * 4 + 16 * 4);
+  auto execution = tc::CudaOutOfCoreExecution::compile(
+      engine,
+      "scale",
+      inputsPair.first,
+      tc::CudaMappingOptions::makePointwiseCudaMappingOptions(),
+      budget);
+  ASSERT_TRUE(execution);
+  EXPECT_EQ(10, execution->chunkRows());
+  EXPECT_EQ(4u, execution->numberChunks());
+  // Twice, the buffers are reused
+  for (int i = 0; i < 2; ++i) {
+    c.zero_();
+    execution->run(inputsPair.first, outputsPair.first);
+    checkRtol(c.sub(a.mul(b.expand_as(a))), {a, b}, 1);
+  }
+  // A row of A and C does not fit twice
+  EXPECT_FALSE(tc::CudaOutOfCoreExecution::compile(
+      engine,
+      "scale",
+      inputsPair.first,
+      tc::CudaMappingOptions::makePointwiseCudaMappingOptions(),
+      16 * 4 + 16 * 4));
+}
+
+TEST(ExecutionEngineTest, KernelNameHasOptionsHash) {
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 5});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  tc::ScopeGuard g([&]() { tc::deleteDlmTensors(inputsPair.second); });
+  auto tree = lang::parseCached(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)")[0];
+  std::vector<std::string> names;
+  for (auto options : {tc::CudaMappingOptions::makeMlpCudaMappingOptions(),
+                       tc::CudaMappingOptions::makeNaiveCudaMappingOptions()}) {
+    auto serialized = options.toProtobufSerializedString();
+    tc::CudaTcExecutor executor("matmul", inputsPair.first, serialized, tree);
+    executor.generateCuda(options);
+    auto suffix = "_o" + tc::kernelOptionsHash(serialized);
+    ASSERT_LT(suffix.size(), executor.kernelSpecializedName.size());
+    EXPECT_EQ(
+        suffix,
+        executor.kernelSpecializedName.substr(
+            executor.kernelSpecializedName.size() - suffix.size()));
+    names.push_back(executor.kernelSpecializedName);
+  }
+  EXPECT_NE(names[0], names[1]);
+}
+
+TEST(ExecutionEngineTest, ConstantInputs) {
+  at::Tensor a = at::CUDA(at::kFloat).rand({32, 16});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({32, 16});
+  auto tree = lang::parseCached(R"(
+def scale(float(N, K) A, float(K) B) -> (C) {
+    C(n, k) = A(n, k) * B(k)
+}
+)")[0];
+  auto options = tc::CudaMappingOptions::makePointwiseCudaMappingOptions()
+                     .constantInputs({1});
+  auto serialized = options.toProtobufSerializedString();
+  std::vector<std::string> names;
+  for (int i = 0; i < 2; ++i) {
+    at::Tensor b = at::CUDA(at::kFloat).rand({16});
+    auto inputsPair = tc::toConstDlpackTensors({a, b});
+    auto outputsPair = tc::toDlpackTensors({c});
+    tc::ScopeGuard g([&]() {
+      tc::deleteDlmTensors(inputsPair.second);
+      tc::deleteDlmTensors(outputsPair.second);
+    });
+    tc::CudaTcExecutor executor("scale", inputsPair.first, serialized, tree);
+    executor.compile(options);
+    EXPECT_NE(std::string::npos, executor.cudaSource.find("__constant__"))
+        << executor.cudaSource;
+    executor.run(inputsPair.first, outputsPair.first);
+    checkRtol(c.sub(a.mul(b.expand_as(a))), {a, b}, 1);
+    names.push_back(executor.kernelSpecializedName);
+    executor.clearRuntimeCompiledFunction();
+  }
+  // Other values get another kernel
+  EXPECT_NE(names[0], names[1]);
+}
+
+TEST(ExecutionEngineTest, ColdCache) {
+  at::Tensor a = at::CUDA(at::kFloat).rand({64, 64});
+  at::Tensor b = at::CUDA(at::kFloat).rand({64, 64});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({64, 64});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  auto tree = lang::parseCached(R"(
+def add(float(N, K) A, float(N, K) B) -> (C) {
+    C(n, k) = A(n, k) + B(n, k)
+}
+)")[0];
+  auto options = tc::CudaMappingOptions::makePointwiseCudaMappingOptions();
+  tc::CudaTcExecutor executor(
+      "add", inputsPair.first, options.toProtobufSerializedString(), tree);
+  executor.compile(options);
+
+  // The flush precedes the timing and leaves the results alone.
+  tc::FLAGS_benchmark_cold_cache = true;
+  tc::ScopeGuard resetFlag([]() { tc::FLAGS_benchmark_cold_cache = false; });
+  auto cold = executor.run(inputsPair.first, outputsPair.first, true);
+  EXPECT_GT(cold, tc::Duration::zero());
+  EXPECT_LT(cold, tc::Duration::max());
+  checkRtol(c.sub(a.add(b)), {a, b}, 1);
+
+  // Reported whether or not NVML is available.
+  std::stringstream ss;
+  ss << tc::queryClockState();
+  EXPECT_FALSE(ss.str().empty());
+}
+
+TEST(ExecutionEngineTest, CompileServer) {
+  auto tree = lang::parseCached(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)")[0];
+  auto options = tc::CudaMappingOptions::makeMlpCudaMappingOptions();
+
+  // The errors of the compilation are returned to the client
+  tc::CudaCompileRequestProto broken;
+  broken.set_tc("def broken(");
+  *broken.mutable_options() = options.proto();
+  broken.set_architecture(
+      tc::CudaRTCFunction::CurrentDeviceRealArchitecture());
+  EXPECT_TRUE(tc::compileKernelRequest(broken).has_error());
+
+  std::string path =
+      "/tmp/tc_test_compile_server_" + std::to_string(getpid());
+  std::thread([path]() { tc::runCudaCompileServer(path, 2); }).detach();
+  // Wait for the server to listen
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  bool listening = false;
+  for (int i = 0; i < 500 and not listening; ++i) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    listening = connect(
+                    fd,
+                    reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)) == 0;
+    close(fd);
+    if (not listening) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  ASSERT_TRUE(listening);
+
+  auto previous = tc::FLAGS_cuda_compile_server;
+  tc::FLAGS_cuda_compile_server = path;
+  tc::ScopeGuard restore([&]() { tc::FLAGS_cuda_compile_server = previous; });
+  // Sizes no other test compiles, the kernel is not in the caches
+  at::Tensor a = at::CUDA(at::kFloat).rand({37, 19});
+  at::Tensor b = at::CUDA(at::kFloat).rand({19, 23});
+  at::Tensor c = at::CUDA(at::kFloat).zeros({37, 23});
+  auto inputsPair = tc::toConstDlpackTensors({a, b});
+  auto outputsPair = tc::toDlpackTensors({c});
+  tc::ScopeGuard g([&]() {
+    tc::deleteDlmTensors(inputsPair.second);
+    tc::deleteDlmTensors(outputsPair.second);
+  });
+  tc::CudaTcExecutor executor(
+      "matmul",
+      inputsPair.first,
+      options.toProtobufSerializedString(),
+      tree);
+  executor.compile(options);
+  EXPECT_EQ(tc::KernelSource::CompileServer, executor.kernelSource);
+  executor.run(inputsPair.first, outputsPair.first);
+  checkRtol(c.sub(a.mm(b)), {a, b}, 19);
+  executor.clearRuntimeCompiledFunction();
+}
+
+TEST(CudaLaunchGraphTest, RecordAndReplay) {
+  tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
+  atCompl.define(R"(
+def matmul(float(M,N) A, float(N,K) B) -> (output) {
+    output(m, k) +=! A(m, r_n) * B(r_n, k)
+}
+)");
+  at::Tensor a = at::CUDA(at::kFloat).rand({3, 4});
+  at::Tensor b = at::CUDA(at::kFloat).rand({4, 4});
+  auto handle = atCompl.compile(
+      "matmul", {a, b}, tc::CudaMappingOptions::makeMlpCudaMappingOptions());
+
+  // Chain two products: c = a * b, d = c * b
+  std::vector<at::Tensor> c{at::CUDA(at::kFloat).zeros({3, 4})};
+  std::vector<at::Tensor> d{at::CUDA(at::kFloat).zeros({3, 4})};
+  tc::CudaLaunchGraph graph;
+  tc::CudaRuntimeInformation info(&graph);
+  atCompl.uncheckedRun({a, b}, c, handle, info);
+  atCompl.uncheckedRun({c[0], b}, d, handle, info);
+  ASSERT_EQ(graph.size(), 2u);
+  // Recording does not launch anything.
+  ASSERT_EQ(d[0].abs().sum().toFloat(), 0.0f);
+
+  graph.launch(0);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(d[0].sub(a.mm(b).mm(b)), {a, b}, 4);
+
+  // Replay on new input pointers.
+  at::Tensor a2 = at::CUDA(at::kFloat).rand({3, 4});
+  graph.setPointers(
+      0,
+      {c[0].data_ptr()},
+      {static_cast<const void*>(a2.data_ptr()), b.data_ptr()});
+  graph.launch(0);
+  TC_CUDA_RUNTIMEAPI_ENFORCE(cudaDeviceSynchronize());
+  checkRtol(d[0].sub(a2.mm(b).mm(b)), {a2, b}, 4);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
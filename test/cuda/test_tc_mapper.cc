@@ -170,6 +170,32 @@ TEST_F(TcCudaMapper2DReductionStressTest, 7x128) {
   Check(7, 128);
 }
 
+// Rows of the reduction fitting in a warp, straddling warps and spanning
+// several warps.
+TEST_F(TcCudaMapper2DReductionStressTest, WarpShuffle) {
+  for (size_t tix : {2, 7, 16, 32, 35, 111, 128}) {
+    for (size_t tiy : {1, 3, 7}) {
+      M = tiy;
+      N = tix;
+      auto mappingOptions =
+          tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+              .tile(tiy, tix)
+              .mapToBlocks({1})
+              .mapToThreads({tix, tiy})
+              .matchLibraryCalls(true)
+              .warpShuffleReductions(true);
+      at::Tensor A = at::CUDA(at::kFloat).rand({M, N});
+      auto res = TcCudaMapper2DReductionTest::Check(A, mappingOptions);
+      std::string expected = std::string("__tc::WarpReduceAlongX<") +
+          std::to_string(tix) + "," + std::to_string(tiy) +
+          std::string(",1,__tc::ReductionOp::Sum>");
+      ASSERT_NE(std::string::npos, res.second.find(expected))
+          << "In resulting code:\n"
+          << res.second << "\ncould not find: " << expected;
+    }
+  }
+}
+
 // Run this iterative example to find new cases
 TEST_F(TcCudaMapper2DReductionStressTest, Iterate) {
   for (auto tix : {1, 2, 5, 8, 11}) {
@@ -189,7 +215,7 @@ TEST_F(TcCudaMapperMatmulTest, Matmul1DSchedule) {
                             .tile(1, 1, K)
                             .mapToBlocks({M, N})
                             .mapToThreads({std::min(32u, K)})
-                            .matchLibraryCalls(true);
+                            .matchLibraryCalls(false);
   at::Tensor A = at::CUDA(at::kFloat).rand({M, K});
   at::Tensor B = at::CUDA(at::kFloat).rand({K, N});
   Check(A, B, mappingOptions);
@@ -204,7 +230,7 @@ TEST_F(TcCudaMapperMatmulTest, Matmul1DScheduleMultipleOccurrence) {
                             .tile(32, 32, 32)
                             .mapToBlocks({8})
                             .mapToThreads({16})
-                            .matchLibraryCalls(true);
+                            .matchLibraryCalls(false);
   at::Tensor A = at::CUDA(at::kFloat).rand({M, K});
   at::Tensor B = at::CUDA(at::kFloat).rand({K, N});
   Check(A, B, mappingOptions);
@@ -215,7 +241,18 @@ TEST_F(TcCudaMapperMatmulTest, Matmul3DSchedule) {
                             .fixParametersBeforeScheduling(true)
                             .mapToBlocks({1, 1, 1})
                             .mapToThreads({4, 1, 1});
-  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.matchLibraryCalls(false);
+  at::Tensor A = at::CUDA(at::kFloat).rand({M, K});
+  at::Tensor B = at::CUDA(at::kFloat).rand({K, N});
+  Check(A, B, mappingOptions);
+}
+
+TEST_F(TcCudaMapperMatmulTest, MatmulPersistentBlocks) {
+  auto mappingOptions = tc::CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(4, 4)
+                            .mapToBlocks({M, N})
+                            .mapToThreads({4, 4})
+                            .persistentBlocks(true);
   at::Tensor A = at::CUDA(at::kFloat).rand({M, K});
   at::Tensor B = at::CUDA(at::kFloat).rand({K, N});
   Check(A, B, mappingOptions);
@@ -226,7 +263,7 @@ TEST_F(TcCudaMapperMatmulTest, Matmul3DScheduleMultipleOccurrence) {
                             .tile(32, 32, 32)
                             .mapToBlocks({8})
                             .mapToThreads({16})
-                            .matchLibraryCalls(true);
+                            .matchLibraryCalls(false);
   at::Tensor A = at::CUDA(at::kFloat).rand({M, K});
   at::Tensor B = at::CUDA(at::kFloat).rand({K, N});
   Check(A, B, mappingOptions);
@@ -243,7 +280,7 @@ TEST_F(TcCudaMapperBatchMatmulTest, BatchMatmul) {
                             .mapToBlocks({50})
                             .usePrivateMemory(true)
                             .useSharedMemory(true);
-  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.matchLibraryCalls(false);
   at::Tensor A = at::CUDA(at::kFloat).rand({50, 26, 72});
   at::Tensor B = at::CUDA(at::kFloat).rand({50, 72, 26});
   Check(A, B, mappingOptions);
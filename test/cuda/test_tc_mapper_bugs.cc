@@ -521,7 +521,7 @@ TEST_F(C3_128_1000_1024, InvalidPtx) {
                      .useSharedMemory(true)
                      .usePrivateMemory(true)
                      .unrollCopyShared(true)
-                     .matchLibraryCalls(true);
+                     .matchLibraryCalls(false);
   Check(options);
 }
 
@@ -635,7 +635,7 @@ TEST_F(TMM_128_1024_1024, TooStrictPrecisionAfterTuner) {
                      .useSharedMemory(false)
                      .usePrivateMemory(false)
                      .unrollCopyShared(true)
-                     .matchLibraryCalls(true);
+                     .matchLibraryCalls(false);
   Check(options);
 }
 
@@ -657,7 +657,7 @@ TEST_F(TMM_128_1024_1024, Tightening) {
                      .useSharedMemory(true)
                      .usePrivateMemory(true)
                      .unrollCopyShared(true)
-                     .matchLibraryCalls(true);
+                     .matchLibraryCalls(false);
   Check(options);
 }
 
@@ -733,7 +733,7 @@ def tmm_naive(float(B, X) I, float(Y, X) W) -> (O) {
           .useSharedMemory(false)
           .usePrivateMemory(false)
           .unrollCopyShared(false)
-          .matchLibraryCalls(true);
+          .matchLibraryCalls(false);
 
   tc::ATenCompilationUnit<tc::CudaTcExecutor> atCompl;
   atCompl.define(TC);
@@ -13,9 +13,12 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <atomic>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -25,11 +28,15 @@
 
 #include "tc/core/flags.h"
 #include "tc/core/halide_utils.h"
+#include "tc/core/polyhedral/schedule_tree_elem.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/scop.h"
+#include "tc/core/tc2halide.h"
 #include "tc/core/utils/dlpack.h"
 #include "tc/external/isl.h"
 #include "tc/lang/error_report.h"
+#include "tc/lang/parser.h"
+#include "tc/library/convolution.h"
 #include "tc/library/copy.h"
 #include "tc/library/matmul.h"
 
@@ -140,6 +147,19 @@ TEST_F(GenericHalideCoreTest, Matmul) {
           "      O[O_s0_i][O_s0_j] = (O[O_s0_i][O_s0_j] + (A[O_s0_i][O_s1_k]*B[O_s1_k][O_s0_j]));"});
 }
 
+TEST_F(GenericHalideCoreTest, ConvolutionEpilogue) {
+  auto tc = makeConvolution2DTc(
+      1, 1, {reluPostOp(), biasPostOp("S", 1), residualPostOp("R", 4)});
+  lang::Def def(lang::Parser(tc).parseFunction());
+  ASSERT_EQ(def.params().size(), 5u);
+  EXPECT_EQ(def.params()[3].ident().name(), "S");
+  EXPECT_EQ(def.params()[4].ident().name(), "R");
+  EXPECT_EQ(def.params()[4].tensorType().dims().size(), 4u);
+  ASSERT_EQ(def.returns().size(), 1u);
+  EXPECT_EQ(def.statements().size(), 5u);
+  CheckC(tc, {"fmax(", "S[", "R["});
+}
+
 using namespace isl::with_exceptions;
 
 struct TC2Isl : public ::testing::Test {
@@ -313,6 +333,161 @@ def fun(float(M, N) I) -> (O1, O2, O3) {
   Check(tc, {123, 13});
 }
 
+TEST(TC2Halide, TranslateCached) {
+  auto translate = [](const string& tc, bool throwWarnings)
+      -> std::shared_ptr<const tc2halide::HalideComponents> {
+    return tc2halide::translateCached(
+        globalIslCtx(), lang::Parser(tc).parseFunction(), throwWarnings);
+  };
+  string tc = R"TC(
+def fun(float(M, N) I) -> (O) {
+    O(m) +=! I(m, r_n)
+}
+)TC";
+  // Executors are created with the trees of separate parses.
+  auto components = translate(tc, false);
+  EXPECT_EQ(components, translate(tc, false));
+  EXPECT_EQ(
+      components,
+      translate("def fun(float(M, N) I) -> (O) { O(m) +=! I(m, r_n) }", false));
+  EXPECT_NE(components, translate(tc, true));
+  EXPECT_NE(
+      components,
+      translate(
+          "def fun(float(M, N) I) -> (O) { O(m) +=! I(m, r_n) * 2 }", false));
+}
+
+TEST(TC2Halide, EstimateWork) {
+  auto halide = tc2halide::translate(globalIslCtx(), R"TC(
+def matmul(float(N, K) A, float(K, M) B) -> (O) {
+    O(n, m) +=! A(n, r_k) * B(r_k, m)
+    O(n, m) = fmax(O(n, m), 0)
+}
+)TC");
+  auto ctx = getCPUDLContext();
+  DLDataType dtype;
+  dtype.code = kDLFloat;
+  dtype.bits = 32;
+  dtype.lanes = 1;
+  auto A = makeDLTensorWithSizes(ctx, dtype, {3, 5});
+  auto B = makeDLTensorWithSizes(ctx, dtype, {5, 7});
+  auto work = estimateWork(halide, {A.get(), B.get()});
+  // a multiply-add per point of the reduction, fmax at each output point
+  EXPECT_EQ(2 * 3 * 5 * 7 + 3 * 7, work.flops);
+  EXPECT_EQ(4 * (3 * 5 + 5 * 7 + 3 * 7), work.bytes);
+}
+
+TEST(IslCtx, ScopedCtx) {
+  auto threadCtx = globalIslCtx().get();
+  EXPECT_EQ(threadCtx, globalIslCtx().get());
+  {
+    ScopedCtx jobCtx;
+    auto ctx = globalIslCtx().get();
+    EXPECT_NE(threadCtx, ctx);
+    {
+      ScopedCtx nestedCtx;
+      EXPECT_NE(ctx, globalIslCtx().get());
+    }
+    EXPECT_EQ(ctx, globalIslCtx().get());
+  }
+  EXPECT_EQ(threadCtx, globalIslCtx().get());
+
+  // Compilation jobs on different threads share no isl context.
+  string tc = R"TC(
+def fun(float(M, N) I) -> (O) {
+    O(m) +=! I(m, r_n)
+}
+)TC";
+  std::vector<std::thread> jobs;
+  for (int i = 0; i < 4; ++i) {
+    jobs.emplace_back([&tc, threadCtx]() {
+      ScopedCtx jobCtx;
+      EXPECT_NE(threadCtx, globalIslCtx().get());
+      auto scop = polyhedral::Scop::makeScop(globalIslCtx(), tc);
+      EXPECT_EQ(globalIslCtx().get(), scop->domain().get_ctx().get());
+    });
+  }
+  for (auto& job : jobs) {
+    job.join();
+  }
+}
+
+using polyhedral::detail::allocateScheduleTreeNode;
+using polyhedral::detail::deallocateScheduleTreeNode;
+
+// Blocks of all the sizes can be written in full, a freed block is reused
+// for a node of the same size only.
+TEST(ScheduleTreeNodePool, Sizes) {
+  std::vector<size_t> sizes{1, 8, 16, 17, 48, 100, 255, 256, 257, 1000};
+  std::vector<void*> blocks;
+  for (auto size : sizes) {
+    blocks.push_back(allocateScheduleTreeNode(size));
+    memset(blocks.back(), 0xff, size);
+  }
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    deallocateScheduleTreeNode(blocks[i], sizes[i]);
+  }
+
+  auto small = allocateScheduleTreeNode(16);
+  deallocateScheduleTreeNode(small, 16);
+  auto large = allocateScheduleTreeNode(32);
+  EXPECT_NE(small, large);
+  memset(large, 0xff, 32);
+  EXPECT_EQ(small, allocateScheduleTreeNode(16));
+  deallocateScheduleTreeNode(small, 16);
+  deallocateScheduleTreeNode(large, 32);
+}
+
+// A block freed on another thread joins the pool of that thread, and the
+// blocks of a pool return to the heap when its thread exits.
+TEST(ScheduleTreeNodePool, OtherThread) {
+  void* block = nullptr;
+  std::thread([&block]() {
+    block = allocateScheduleTreeNode(64);
+    memset(block, 0xff, 64);
+  }).join();
+  deallocateScheduleTreeNode(block, 64);
+  EXPECT_EQ(block, allocateScheduleTreeNode(64));
+
+  std::thread([block]() {
+    deallocateScheduleTreeNode(block, 64);
+    auto reused = allocateScheduleTreeNode(64);
+    EXPECT_EQ(block, reused);
+    deallocateScheduleTreeNode(reused, 64);
+  }).join();
+}
+
+namespace {
+std::atomic<bool> freedAtThreadExit{false};
+
+// Frees its block when its thread exits.  Constructed before the pool of
+// the thread, it is destroyed after it.
+struct FreeAtThreadExit {
+  ~FreeAtThreadExit() {
+    if (!block) {
+      return;
+    }
+    deallocateScheduleTreeNode(block, 64);
+    auto other = allocateScheduleTreeNode(64);
+    memset(other, 0xff, 64);
+    deallocateScheduleTreeNode(other, 64);
+    freedAtThreadExit = true;
+  }
+  void* block = nullptr;
+};
+} // namespace
+
+// Nodes freed or allocated after the pool of their thread is destroyed,
+// e.g. by thread-local or static objects, use the heap.
+TEST(ScheduleTreeNodePool, AfterPoolDestruction) {
+  std::thread([]() {
+    thread_local FreeAtThreadExit freeAtExit;
+    freeAtExit.block = allocateScheduleTreeNode(64);
+    memset(freeAtExit.block, 0xff, 64);
+  }).join();
+  EXPECT_TRUE(freedAtThreadExit);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
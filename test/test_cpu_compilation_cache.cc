@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tc/core/cache_backend.h"
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_mapping_options.h"
+#include "tc/core/scope_guard.h"
+
+class CpuOptionsCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    tc::CpuOptionsCache::enableCache();
+    ASSERT_TRUE(tc::CpuOptionsCache::cacheEnabled());
+    tc::CpuOptionsCache::getCache()->clear();
+    ASSERT_EQ(tc::CpuOptionsCache::getCache()->size(), 0);
+
+    inputs.resize(2);
+    for (auto& input : inputs) {
+      input.ndim = 2;
+      input.shape = new int64_t[2];
+      input.shape[0] = 5;
+      input.shape[1] = 6;
+      input.strides = nullptr;
+    }
+    inputs[1].ndim = 0;
+  }
+
+  void TearDown() {
+    tc::CpuOptionsCache::disableCache();
+    ASSERT_FALSE(tc::CpuOptionsCache::cacheEnabled());
+    for (auto& input : inputs) {
+      delete[] input.shape;
+    }
+  }
+  std::vector<DLTensor> inputs;
+
+  std::vector<const DLTensor*> InputPtrs() const {
+    std::vector<const DLTensor*> ptrs;
+    for (const auto& input : inputs) {
+      ptrs.push_back(&input);
+    }
+    return ptrs;
+  }
+};
+
+TEST_F(CpuOptionsCacheTest, RetrieveBest) {
+  auto options0 =
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(0);
+  auto options1 =
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel", options0, inputPtrs, outputPtrs, std::chrono::microseconds(2));
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel", options1, inputPtrs, outputPtrs, std::chrono::microseconds(1));
+
+  auto ret = tc::CpuOptionsCache::getCache()->retrieveBestOptions(
+      "kernel", inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(*ret, options1);
+
+  ret = tc::CpuOptionsCache::getCache()->retrieveBestOptions(
+      "kernelX", inputPtrs, outputPtrs);
+  ASSERT_FALSE(ret);
+
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->size(), 1);
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->totalSize(), 2);
+}
+
+TEST_F(CpuOptionsCacheTest, Serialization) {
+  auto options0 =
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().vectorizeWidth(4);
+  auto options1 =
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().prefetchDistance(2);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options0,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(10));
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel0",
+      options1,
+      inputPtrs,
+      outputPtrs,
+      std::chrono::microseconds(11));
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel1", options0, inputPtrs, outputPtrs, std::chrono::microseconds(1));
+
+  auto buf = tc::CpuOptionsCache::getCache()->toProtobuf();
+  tc::CpuOptionsCache::loadCacheFromProtobuf(buf);
+
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->size(), 2);
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->totalSize(), 3);
+
+  auto ret = tc::CpuOptionsCache::getCache()->retrieveOptionsAndRuntimes(
+      "kernel0", inputPtrs, outputPtrs);
+  ASSERT_EQ(ret.size(), 2);
+  ASSERT_EQ(ret[0].options, options0);
+  ASSERT_EQ(ret[0].recordedRuntimes.size(), 1);
+  ASSERT_EQ(ret[0].recordedRuntimes[0], std::chrono::microseconds(10));
+  ASSERT_EQ(ret[1].options, options1);
+  ASSERT_EQ(ret[1].recordedRuntimes.size(), 1);
+  ASSERT_EQ(ret[1].recordedRuntimes[0], std::chrono::microseconds(11));
+}
+
+TEST_F(CpuOptionsCacheTest, KeepOnlyBestCandidates) {
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  for (uint32_t depth = 0; depth < 4; ++depth) {
+    tc::CpuOptionsCache::getCache()->recordRuntime(
+        "kernel",
+        tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(
+            depth),
+        inputPtrs,
+        outputPtrs,
+        std::chrono::microseconds(10 - depth));
+  }
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->totalSize(), 4);
+
+  tc::CpuOptionsCache::getCache()->keepOnlyBestCandidates(2);
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->totalSize(), 2);
+  auto ret = tc::CpuOptionsCache::getCache()->retrieveTopKOptions(
+      "kernel", inputPtrs, outputPtrs, 2);
+  ASSERT_EQ(ret.size(), 2);
+  ASSERT_EQ(
+      ret[0],
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(3));
+  ASSERT_EQ(
+      ret[1],
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(2));
+}
+
+TEST_F(CpuOptionsCacheTest, Backend) {
+  auto options0 =
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(0);
+  auto options1 =
+      tc::CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(1);
+  auto inputPtrs = InputPtrs();
+  auto outputPtrs = InputPtrs();
+  auto directory = "/tmp/tc_test_cache_backend." + std::to_string(getpid());
+  tc::CpuOptionsCache::setBackend(
+      std::make_shared<tc::DirectoryCacheBackend>(directory), "options");
+  tc::ScopeGuard sg([&]() {
+    tc::CpuOptionsCache::setBackend(nullptr, "");
+    std::system(("rm -rf " + directory).c_str());
+  });
+
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel0", options0, inputPtrs, outputPtrs, std::chrono::microseconds(2));
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel1", options0, inputPtrs, outputPtrs, std::chrono::microseconds(3));
+  tc::CpuOptionsCache::storeToBackend();
+
+  // Another host only fetches the entries it looks up.
+  tc::CpuOptionsCache::enableCache();
+  auto ret = tc::CpuOptionsCache::getCache()->retrieveBestOptions(
+      "kernel0", inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(*ret, options0);
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->size(), 1);
+
+  // Its modifications replace the entries of the key.
+  tc::CpuOptionsCache::getCache()->recordRuntime(
+      "kernel0", options1, inputPtrs, outputPtrs, std::chrono::microseconds(1));
+  tc::CpuOptionsCache::storeToBackend();
+  tc::CpuOptionsCache::enableCache();
+  ASSERT_EQ(
+      tc::CpuOptionsCache::getCache()
+          ->retrieveOptionsAndRuntimes("kernel0", inputPtrs, outputPtrs)
+          .size(),
+      2);
+  ret = tc::CpuOptionsCache::getCache()->retrieveBestOptions(
+      "kernel1", inputPtrs, outputPtrs);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(tc::CpuOptionsCache::getCache()->size(), 2);
+}
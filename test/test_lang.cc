@@ -23,7 +23,11 @@
 #include <string>
 
 #include "tc/lang/canonicalize.h"
+#include "tc/lang/contraction.h"
+#include "tc/lang/gradient.h"
+#include "tc/lang/parse_cache.h"
 #include "tc/lang/parser.h"
+#include "tc/lang/pipeline.h"
 #include "tc/lang/sema.h"
 #include "tc/lang/tc_format.h"
 
@@ -156,6 +160,394 @@ void testTcFormat() {
   std::ostringstream s;
   tcFormat(s, def_tree);
   ASSERT(s.str() == source);
+
+  auto whereSource =
+      R"(def fun3(float(N) X, float(N) A) -> (Y) {
+  Y(i) +=! (X(j) * A(k)) <=> s(j) where k = (i - j), j in 0:i, exists X(i)
+})";
+  std::ostringstream w;
+  tcFormat(w, Parser(whereSource).parseFunction());
+  ASSERT(w.str() == whereSource);
+}
+
+void testPipeline() {
+  auto fc1 = Parser(R"(
+    def fc1(float(B,M) I, float(N,M) W1, float(N) B1) -> (O1) {
+      T(b, n) +=! I(b, r_m) * W1(n, r_m)
+      O1(b, n) = fmax(T(b, n) + B1(n), 0)
+    }
+  )").parseFunction();
+  auto fc2 = Parser(R"(
+    def fc2(float(B,N) O1, float(O,N) W2, float(O) B2) -> (O2) {
+      T(b, o) +=! O1(b, r_n) * W2(o, r_n)
+      O2(b, o) = fmax(T(b, o) + B2(o), 0)
+    }
+  )").parseFunction();
+  auto fused = R"(
+    def fc2relu(float(B,M) I, float(N,M) W1, float(N) B1,
+                float(O,N) W2, float(O) B2) -> (O2) {
+      fc1_T(b, n) +=! I(b, r_m) * W1(n, r_m)
+      O1(b, n) = fmax(fc1_T(b, n) + B1(n), 0)
+      fc2_T(b, o) +=! O1(b, r_n) * W2(o, r_n)
+      O2(b, o) = fmax(fc2_T(b, o) + B2(o), 0)
+    }
+  )";
+  ASSERT(
+      lang::canonicalTc(inlinePipeline("fc2relu", {fc1, fc2})) ==
+      lang::canonicalTc(fused));
+
+  bool threw = false;
+  try {
+    inlinePipeline("fc1fc1", {fc1, fc1});
+  } catch (const ErrorReport& e) {
+    std::string report = e.what();
+    ASSERT(report.find("is returned by both fc1 and fc1") != std::string::npos);
+    threw = true;
+  }
+  ASSERT(threw);
+}
+
+void testGradient() {
+  auto matmul = Parser(R"(
+    def matmul(float(M,K) A, float(K,N) B) -> (C) {
+      C(m, n) +=! A(m, r_k) * B(r_k, n)
+    }
+  )").parseFunction();
+  auto matmulGrad = R"(
+    def matmul_grad(float(M,K) A, float(K,N) B, float(M,N) C_grad)
+        -> (A_grad, B_grad) {
+      A_grad(m, r_k) +=! C_grad(m, n) * B(r_k, n) where exists A(m, r_k)
+      B_grad(r_k, n) +=! C_grad(m, n) * A(m, r_k) where exists B(r_k, n)
+    }
+  )";
+  ASSERT(
+      lang::canonicalTc(gradient(matmul)) == lang::canonicalTc(matmulGrad));
+
+  // Redefinitions are versioned, the forward values the gradients need are
+  // recomputed.
+  auto relu = Parser(R"(
+    def relu(float(N) I) -> (O) {
+      O(n) = I(n) + 1
+      O(n) = fmax(O(n), 0)
+    }
+  )").parseFunction();
+  auto reluGrad = R"(
+    def relu_grad(float(N) I, float(N) O_grad) -> (I_grad) {
+      O_1(n) = I(n) + 1
+      O_1_grad(n) +=! O_grad(n) * (O_1(n) >= 0 ? 1.0 : 0.0)
+          where exists O_1(n)
+      I_grad(n) +=! O_1_grad(n) where exists I(n)
+    }
+  )";
+  ASSERT(lang::canonicalTc(gradient(relu)) == lang::canonicalTc(reluGrad));
+
+  bool threw = false;
+  try {
+    gradient(Parser(R"(
+      def shift(float(N) I) -> (O) {
+        O(n) = I(n + 1)
+      }
+    )").parseFunction());
+  } catch (const ErrorReport& e) {
+    std::string report = e.what();
+    ASSERT(report.find("not distinct index variables") != std::string::npos);
+    threw = true;
+  }
+  ASSERT(threw);
+}
+
+void testContractions() {
+  auto chain = Parser(R"(
+    def chain(float(M,K) A, float(K,L) B, float(L,N) C) -> (O) {
+      O(m, n) +=! A(m, r_k) * B(r_k, r_l) * C(r_l, n) * 2
+    }
+  )").parseFunction();
+  // B * C is the cheapest pair for these sizes, the product keeps r_k.
+  auto factored = R"(
+    def chain_2(float(M,K) A, float(K,L) B, float(L,N) C) -> (O) {
+      O_1(r_k, n) +=! B(r_k, r_l) * C(r_l, n)
+      O(m, n) +=! A(m, r_k) * O_1(r_k, n) * 2
+    }
+  )";
+  std::unordered_map<std::string, int64_t> sizes{
+      {"M", 1000}, {"K", 10}, {"L", 1000}, {"N", 10}};
+  ASSERT(
+      lang::canonicalTc(factorContractions(chain, "chain_2", sizes)) ==
+      lang::canonicalTc(factored));
+
+  // Batch indices come first in the temporaries, where clauses are kept.
+  auto batched = Parser(R"(
+    def batched(float(B,M,K) X, float(B,K,L) Y, float(B,L,N) Z,
+                float(B,M,N) W) -> (O, P) {
+      O(b, m, n) +=! X(b, m, r_k) * Y(b, r_k, r_l) * Z(b, r_l, n)
+      P(b, m, n) +=! W(b, m, r_n) * W(b, r_n, n) * W(b, m, n)
+          where r_n in 0:N
+    }
+  )").parseFunction();
+  auto batchedFactored = R"(
+    def batched(float(B,M,K) X, float(B,K,L) Y, float(B,L,N) Z,
+                float(B,M,N) W) -> (O, P) {
+      O_1(b, m, r_l) +=! X(b, m, r_k) * Y(b, r_k, r_l)
+      O(b, m, n) +=! O_1(b, m, r_l) * Z(b, r_l, n)
+      P(b, m, n) +=! W(b, m, r_n) * W(b, r_n, n) * W(b, m, n)
+          where r_n in 0:N
+    }
+  )";
+  ASSERT(
+      lang::canonicalTc(factorContractions(batched, "batched")) ==
+      lang::canonicalTc(batchedFactored));
+}
+
+void testRaggedRange() {
+  auto bags = Parser(R"(
+    def bags(float(E, D) LUT, int32(N) I, int32(B1) Off) -> (O) {
+      O(b, j) +=! LUT(I(k), j) where k in Off(b):Off(b + 1):64
+    }
+  )").parseFunction();
+  auto checked = Def(Sema().checkFunction(bags));
+  auto rc = RangeConstraint(checked.statements()[0].whereClauses()[0]);
+  ASSERT(rc.ragged());
+  ASSERT(rc.start()->kind() == TK_ACCESS);
+  ASSERT(rc.maxLength().get()->kind() == TK_CONST);
+
+  auto expectError = [](const std::string& tc, const std::string& error) {
+    bool threw = false;
+    try {
+      Sema().checkFunction(Parser(tc).parseFunction());
+    } catch (const ErrorReport& e) {
+      std::string report = e.what();
+      ASSERT(report.find(error) != std::string::npos);
+      threw = true;
+    }
+    ASSERT(threw);
+  };
+  // Only ragged ranges may read tensors.
+  expectError(
+      R"(
+    def bags(float(E, D) LUT, int32(N) I, int32(B1) Off) -> (O) {
+      O(b, j) +=! LUT(I(k), j) where k in Off(b):Off(b + 1)
+    }
+  )",
+      "tensor accesses cannot be used in this context");
+  expectError(
+      R"(
+    def bags(float(E, D) LUT, int32(B1) Off) -> (O) {
+      O(k, j) = LUT(k, j) where k in Off(0):Off(1):64
+    }
+  )",
+      "can only constrain a reduction index");
+}
+
+void testConstraint() {
+  auto tril = Parser(R"(
+    def tril(float(N, N) A) -> (O) {
+      O(i) +=! A(i, j) where j <= i, j < N - 1
+    }
+  )").parseFunction();
+  auto checked = Def(Sema().checkFunction(tril));
+  auto stmt = checked.statements()[0];
+  ASSERT(stmt.whereClauses()[0]->kind() == TK_CONSTRAINT);
+  ASSERT(Constraint(stmt.whereClauses()[1]).exp()->kind() == '<');
+  ASSERT(stmt.reductionVariables().size() == 1);
+
+  auto expectError = [](const std::string& tc, const std::string& error) {
+    bool threw = false;
+    try {
+      Sema().checkFunction(Parser(tc).parseFunction());
+    } catch (const ErrorReport& e) {
+      std::string report = e.what();
+      ASSERT(report.find(error) != std::string::npos);
+      threw = true;
+    }
+    ASSERT(threw);
+  };
+  expectError(
+      R"(
+    def tril(float(N, N) A) -> (O) {
+      O(i, j) = A(i, j) where j <= i
+    }
+  )",
+      "constraints can only be used in statements with reduction");
+  expectError(
+      R"(
+    def tril(float(N, N) A) -> (O) {
+      O(i) +=! A(i, j) where j + i
+    }
+  )",
+      "expected a comparison of index expressions");
+  expectError(
+      R"(
+    def tril(float(N, N) A) -> (O) {
+      O(i) +=! A(i, j) where j <= A(i, i)
+    }
+  )",
+      "tensor accesses cannot be used in this context");
+}
+
+void testAlias() {
+  auto relu = Parser(R"(
+    def relu(float(N) I) -> (O aliases I) {
+      O(i) = fmax(I(i), 0)
+    }
+  )").parseFunction();
+  auto checked = Def(Sema().checkFunction(relu));
+  ASSERT(checked.returns()[0].alias().present());
+  ASSERT(checked.returns()[0].alias().get().name() == "I");
+  ASSERT(!checked.params()[0].alias().present());
+
+  auto expectError = [](const std::string& tc, const std::string& error) {
+    bool threw = false;
+    try {
+      Sema().checkFunction(Parser(tc).parseFunction());
+    } catch (const ErrorReport& e) {
+      std::string report = e.what();
+      ASSERT(report.find(error) != std::string::npos);
+      threw = true;
+    }
+    ASSERT(threw);
+  };
+  expectError(
+      R"(
+    def shift(float(N) I) -> (O aliases I) {
+      O(i) = I(i + 1) where i in 0:N-1
+    }
+  )",
+      "must be defined over all of I");
+  expectError(
+      R"(
+    def reverse(float(N) I) -> (O aliases I) {
+      O(i) = I(N - 1 - i)
+    }
+  )",
+      "can only be accessed at the indices of O");
+  expectError(
+      R"(
+    def sum(float(N, M) I) -> (O aliases I) {
+      O(i, j) +=! I(i, k)
+    }
+  )",
+      "must be assigned pointwise");
+  expectError(
+      R"(
+    def twice(float(N) I) -> (O aliases I, P) {
+      O(i) = I(i)
+      P(i) = I(i)
+    }
+  )",
+      "can only be read by the definition of O");
+  expectError(
+      R"(
+    def narrow(float(N) I) -> (int32(N) O aliases I) {
+      O(i) = int32(I(i))
+    }
+  )",
+      "must have the same type to alias");
+  expectError(
+      R"(
+    def input(float(N) I aliases I) -> (O) {
+      O(i) = I(i)
+    }
+  )",
+      "only outputs can alias an input");
+}
+
+void testInt8Accumulation() {
+  Sema sema;
+  auto checked = Def(sema.checkFunction(Parser(R"(
+    def qmm(int8(M, K) A, int8(K, N) B) -> (C) {
+      C(m, n) +=! A(m, k) * B(k, n)
+    }
+  )").parseFunction()));
+  auto rhs = checked.statements()[0].rhs();
+  ASSERT(sema.typeOfExpr(rhs)->kind() == TK_INT32);
+  ASSERT(rhs->kind() == '*');
+  for (auto term : rhs->trees()) {
+    ASSERT(term->kind() == TK_CAST);
+    ASSERT(Cast(term).type()->kind() == TK_INT32);
+  }
+
+  // Outputs declared narrower keep accumulating in their type
+  Sema narrow;
+  checked = Def(narrow.checkFunction(Parser(R"(
+    def qmm(int8(M, K) A, int8(K, N) B) -> (int8(M, N) C) {
+      C(m, n) +=! A(m, k) * B(k, n)
+    }
+  )").parseFunction()));
+  rhs = checked.statements()[0].rhs();
+  ASSERT(narrow.typeOfExpr(rhs)->kind() == TK_INT8);
+  ASSERT(rhs->tree(0)->kind() == TK_ACCESS);
+}
+
+void testScatter() {
+  auto scatter = Parser(R"(
+    def lut_backward(int32(B, L) I, float(B, D) d_O, float(E) S) -> (d_LUT) {
+      d_LUT(e, j) +=! d_O(i, j) where e = I(i, k), e in 0:E
+    }
+  )").parseFunction();
+  auto checked = Def(Sema().checkFunction(scatter));
+  auto stmt = checked.statements()[0];
+  ASSERT(stmt.whereClauses()[0]->kind() == TK_LET);
+  ASSERT(stmt.reductionVariables().size() == 2);
+
+  auto expectError = [](const std::string& tc, const std::string& error) {
+    bool threw = false;
+    try {
+      Sema().checkFunction(Parser(tc).parseFunction());
+    } catch (const ErrorReport& e) {
+      std::string report = e.what();
+      ASSERT(report.find(error) != std::string::npos);
+      threw = true;
+    }
+    ASSERT(threw);
+  };
+  expectError(
+      R"(
+    def scatter(int32(B, L) I, float(B, D) d_O) -> (d_LUT) {
+      d_LUT(e, j) +=! d_O(i, j) where e = I(i, k)
+    }
+  )",
+      "scatter index e needs a range constraint");
+  expectError(
+      R"(
+    def scatter(int32(B) I, float(B) V, float(E) S) -> (O) {
+      O(e) +=! V(0) where e = I(0), e in 0:E
+    }
+  )",
+      "must reduce over the indices of its value");
+  expectError(
+      R"(
+    def scatter(float(B) I, float(B) V, float(E) S) -> (O) {
+      O(e) +=! V(i) where e = I(i), e in 0:E
+    }
+  )",
+      "expected integral type");
+}
+
+void testParseCache() {
+  std::string source = R"(
+    def copy(float(N) I) -> (O) {
+      O(n) = I(n)
+    }
+    def scale(float(N) I) -> (O) {
+      O(n) = 2 * I(n)
+    }
+  )";
+  auto defs = parseCached(source);
+  ASSERT(defs.size() == 2);
+  ASSERT(Def(defs[1]).name().name() == "scale");
+  auto again = parseCached(std::string(source));
+  ASSERT(again[0] == defs[0] && again[1] == defs[1]);
+  auto checked = checkCached(defs[0]);
+  ASSERT(checkCached(again[0]) == checked);
+  ASSERT(checked != defs[0]);
+
+  bool threw = false;
+  try {
+    parseCached("def broken(");
+  } catch (const ErrorReport&) {
+    threw = true;
+  }
+  ASSERT(threw);
 }
 
 int main(int argc, char** argv) {
@@ -331,6 +723,15 @@ int main(int argc, char** argv) {
   ASSERT(lang::canonicalTc(option_one) == lang::canonicalTc(option_two));
 
   testTcFormat();
+  testPipeline();
+  testGradient();
+  testContractions();
+  testRaggedRange();
+  testConstraint();
+  testAlias();
+  testInt8Accumulation();
+  testScatter();
+  testParseCache();
 
   // assertSemaEqual(
   //     "comments.expected",
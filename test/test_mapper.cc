@@ -13,7 +13,9 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <unordered_set>
@@ -25,10 +27,14 @@
 
 #include "tc/core/constants.h"
 #include "tc/core/cuda/cuda_mapping_options.h"
+#include "tc/core/cuda/cuda_source_profile.h"
+#include "tc/core/flags.h"
 #include "tc/core/libraries.h"
 #include "tc/core/polyhedral/cuda/codegen.h"
 #include "tc/core/polyhedral/cuda/mapped_scop.h"
 #include "tc/core/polyhedral/cuda/mapping_types.h"
+#include "tc/core/polyhedral/data_parallel.h"
+#include "tc/core/polyhedral/exceptions.h"
 #include "tc/core/polyhedral/functional.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/schedule_transforms.h"
@@ -37,6 +43,7 @@
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/scope_guard.h"
 #include "tc/external/isl.h"
+#include "tc/library/lut.h"
 #include "tc/library/matmul.h"
 
 using namespace std;
@@ -186,7 +193,7 @@ def fun(float(N, M) A, float(N, M) B) -> (C) {
   const float32 (*B)[M] = reinterpret_cast<const float32 (*)[M]>(pB);
   for (int c1 = 16 * b1; c1 < M; c1 += 4096) {
     if (M >= t1 + c1 + 1) {
-      C[(t0 + 16 * b0)][(t1 + c1)] = (A[(t0 + 16 * b0)][(t1 + c1)] + B[(t0 + 16 * b0)][(t1 + c1)]);
+      C[(t0 + 16 * b0)][(t1 + c1)] = (__tc::ldg(&A[(t0 + 16 * b0)][(t1 + c1)]) + __tc::ldg(&B[(t0 + 16 * b0)][(t1 + c1)]));
     }
   }
 }
@@ -228,14 +235,14 @@ def fun(float(N, N, N, N) A, float(N, N) B, float(N, N) C, float(N, N) D)
       O1[c0][c1] = 0.000000f;
       for (int c2 = 0; c2 < N; c2 += 1) {
         for (int c3 = 0; c3 < N; c3 += 1) {
-          O1[c0][c1] = (O1[c0][c1] + (A[c0][c1][c2][c3]*B[c0][c1]));
+          O1[c0][c1] = (O1[c0][c1] + (__tc::ldg(&A[c0][c1][c2][c3])*__tc::ldg(&B[c0][c1])));
         }
       }
     }
   }
   for (int c0 = 0; c0 < N; c0 += 1) {
     for (int c1 = 0; c1 < N; c1 += 1) {
-      O2[c0][c1] = (C[c0][c1]*D[c0][c1]);
+      O2[c0][c1] = (__tc::ldg(&C[c0][c1])*__tc::ldg(&D[c0][c1]));
     }
   }
   for (int c0 = 0; c0 < N; c0 += 1) {
@@ -261,14 +268,14 @@ def fun(float(N, N) A) -> (O)
   auto res = std::get<0>(mscop->codegen(specializedName));
 
   string expected(
-      R"RES(__global__ void kernel_anon(int32 N, float32* pO, const float32* pA) {
+      R"RES(__global__ void kernel_anon(int32 N, float32* pO, const float32* __restrict__ pA) {
   int b0 = blockIdx.x; int b1 = blockIdx.y; int b2 = blockIdx.z;
   int t0 = threadIdx.x; int t1 = threadIdx.y; int t2 = threadIdx.z;
   float32 (*O)[N] = reinterpret_cast<float32 (*)[N]>(pO);
   const float32 (*A)[N] = reinterpret_cast<const float32 (*)[N]>(pA);
   for (int c0 = 0; c0 < N; c0 += 1) {
     for (int c1 = 0; c1 < N; c1 += 1) {
-      O[c0][c1] = (((A[c0][c1] + float32(c0)) + float32(c1)) + float32(N));
+      O[c0][c1] = (((__tc::ldg(&A[c0][c1]) + float32(c0)) + float32(c1)) + float32(N));
     }
   }
 }
@@ -290,7 +297,7 @@ def fun(float(N, N) A, float(N, N) B, float(N) C) -> (O)
   auto res = std::get<0>(mscop->codegen(specializedName));
 
   string expected =
-      R"RES(__global__ void kernel_anon(int32 N, float32* pO, const float32* pA, const float32* pB, const float32* pC) {
+      R"RES(__global__ void kernel_anon(int32 N, float32* pO, const float32* __restrict__ pA, const float32* __restrict__ pB, const float32* __restrict__ pC) {
   int b0 = blockIdx.x; int b1 = blockIdx.y; int b2 = blockIdx.z;
   int t0 = threadIdx.x; int t1 = threadIdx.y; int t2 = threadIdx.z;
   float32 (*O)[512] = reinterpret_cast<float32 (*)[512]>(pO);
@@ -299,7 +306,7 @@ def fun(float(N, N) A, float(N, N) B, float(N) C) -> (O)
   const float32 (*C) = reinterpret_cast<const float32 (*)>(pC);
   for (int c0 = 0; c0 <= 511; c0 += 1) {
     for (int c1 = 0; c1 <= 511; c1 += 1) {
-      O[c0][c1] = (nextafter(C[c0], exp(A[c0][c1])) + log(B[c1][c0]));
+      O[c0][c1] = (nextafter(__tc::ldg(&C[c0]), exp(__tc::ldg(&A[c0][c1]))) + log(__tc::ldg(&B[c1][c0])));
     }
   }
 }
@@ -320,7 +327,7 @@ constexpr auto kExpectedMatmul_64_64_64 =
         for (int c3 = 0; c3 <= 15; c3 += 1) {
           O[(c0 + c2)][(c1 + c3)] = 0.000000f;
           for (int c4 = t0; c4 <= 63; c4 += 32) {
-            O[(c0 + c2)][(c1 + c3)] = (O[(c0 + c2)][(c1 + c3)] + (A[(c0 + c2)][c4]*B[c4][(c1 + c3)]));
+            O[(c0 + c2)][(c1 + c3)] = (O[(c0 + c2)][(c1 + c3)] + (__tc::ldg(&A[(c0 + c2)][c4])*__tc::ldg(&B[c4][(c1 + c3)])));
           }
         }
       }
@@ -466,6 +473,89 @@ TEST_F(PolyhedralMapperTest, Unroll2D) {
   ASSERT_TRUE(code.find(expected) != std::string::npos);
 }
 
+/*
+ * Check that the unrolling of Unroll2D backs off to that of Unroll1D
+ * when the 16 copies of the statement exceed the statement budget,
+ * and that kernels exceeding it without unrolling are rejected.
+ */
+TEST_F(PolyhedralMapperTest, UnrollStatementBudget) {
+  auto maxStatements = FLAGS_cuda_max_kernel_statements;
+  FLAGS_cuda_max_kernel_statements = 15;
+  ScopeGuard g([maxStatements]() {
+    FLAGS_cuda_max_kernel_statements = maxStatements;
+  });
+  auto mappingOptions = DefaultOptions().tile(64, 64).unroll(16);
+  auto scop = PrepareAndJoinBands(kTcAdd);
+  scop->fixParameters<int>({{"N", 1024}, {"M", 1024}});
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  auto code = std::get<0>(mscop->codegen(specializedName));
+  std::string expected("C[(64 * b0 + c2)][(t0 + 64 * b1)]");
+  ASSERT_TRUE(code.find(expected) != std::string::npos) << code;
+
+  auto tc = R"TC(
+def fun(float(N) I) -> (O1, O2) {
+    O1(n) = I(n)
+    O2(n) = I(n)
+}
+)TC";
+  FLAGS_cuda_max_kernel_statements = 1;
+  mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      Prepare(tc), DefaultOptions());
+  EXPECT_THROW(mscop->codegen(specializedName), KernelTooLargeException);
+}
+
+/*
+ * Check that with --cuda_line_info, the statements of the code are marked
+ * with the TC statements they compute (the reduction initialization with
+ * its reduction), and that the samples of the marked lines are attributed
+ * to them.
+ */
+TEST_F(PolyhedralMapperTest, SourceMarkers) {
+  auto lineInfo = FLAGS_cuda_line_info;
+  FLAGS_cuda_line_info = true;
+  ScopeGuard g([lineInfo]() { FLAGS_cuda_line_info = lineInfo; });
+  auto tc = R"TC(
+def fun(float(N, M) I) -> (O1, O2) {
+    O1(n, m) = I(n, m)
+    O2(n)   +=! I(n, r_m)
+}
+)TC";
+  auto code = codegenMapped(tc, DefaultOptions());
+  auto marker1 = std::string(kTcStatementMarker) + "3: O1(n, m) = I(n, m)";
+  auto marker2 = std::string(kTcStatementMarker) + "4: O2(n) +=! I(n, r_m)";
+  auto numberMarkers = [&code](const std::string& marker) {
+    size_t res = 0;
+    for (auto pos = code.find(marker); pos != std::string::npos;
+         pos = code.find(marker, pos + 1)) {
+      ++res;
+    }
+    return res;
+  };
+  ASSERT_GE(numberMarkers(marker1), 1u) << code;
+  ASSERT_GE(numberMarkers(marker2), 2u) << code;
+  // The statement of O1 follows its marker.
+  auto next = code.find('\n', code.find(marker1)) + 1;
+  EXPECT_EQ(code.find("O1", next), code.find_first_not_of(' ', next)) << code;
+
+  // One sample per line.
+  std::map<size_t, double> lineSamples;
+  size_t numberLines = std::count(code.begin(), code.end(), '\n');
+  for (size_t i = 1; i <= numberLines; ++i) {
+    lineSamples[i] = 1;
+  }
+  auto statements = attributeToTcStatements(code, lineSamples);
+  ASSERT_EQ(statements.size(), 3u);
+  EXPECT_EQ(statements[0].line, 0u);
+  std::map<size_t, double> samples;
+  for (const auto& s : statements) {
+    samples[s.line] = s.samples;
+  }
+  // The markers and the statements they mark.
+  EXPECT_EQ(samples.at(3), 2 * numberMarkers(marker1));
+  EXPECT_EQ(samples.at(4), 2 * numberMarkers(marker2));
+}
+
 /*
  * Map 1D code to 2D grid (set up by makeNaiveCudaMappingOptions()) and
  * check that the code is pinned to one particular value of
@@ -506,7 +596,8 @@ def fun() -> (O) {
  * properly, i.e., that a band is inserted above the branching.
  * Use the minimal fusion strategy to ensure the scheduler produces
  * an outer sequence.
- * Also check that synchronization is introduced between the two children.
+ * Also check that no synchronization is introduced between the two children
+ * since each thread reads the elements of O1 it wrote itself.
  */
 TEST_F(PolyhedralMapperTest, Copy2) {
   auto tc = R"TC(
@@ -518,14 +609,102 @@ def fun(float(N) I) -> (O1, O2) {
   auto mappingOptions = DefaultOptions();
   mappingOptions.scheduleFusionStrategy(FusionStrategy::Min);
   auto code = codegenMapped(tc, mappingOptions);
-  auto sync = "__syncthreads()";
   auto loop = "for (int c0 = t0; c0 < N; c0 += 32)";
   auto pos1 = code.find(loop);
-  auto pos2 = code.find(sync, pos1 + 1);
-  auto pos3 = code.find(loop, pos2 + 1);
+  auto pos2 = code.find(loop, pos1 + 1);
   EXPECT_TRUE(pos1 != std::string::npos);
   EXPECT_TRUE(pos2 != std::string::npos);
-  EXPECT_TRUE(pos3 != std::string::npos);
+  EXPECT_EQ(std::string::npos, code.find("__syncthreads()")) << code;
+  EXPECT_EQ(std::string::npos, code.find("__tc::syncWarp()")) << code;
+}
+
+/*
+ * Check that synchronization is introduced between two children of a
+ * sequence if threads read elements written by other threads, and that it
+ * only synchronizes the warps if these threads belong to the same warp.
+ */
+TEST_F(PolyhedralMapperTest, Copy2Shifted) {
+  auto tc = R"TC(
+def fun(float(N) I) -> (O1, O2) {
+    O1(n) =  I(n)
+    O2(n) = O1(n) + O1(n + 1) where n in 0:N-1
+}
+)TC";
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.scheduleFusionStrategy(FusionStrategy::Min);
+  auto code = codegenMapped(tc, mappingOptions);
+  EXPECT_NE(std::string::npos, code.find("__tc::syncWarp()")) << code;
+  EXPECT_EQ(std::string::npos, code.find("__syncthreads()")) << code;
+
+  mappingOptions.tile(64).mapToThreads(64);
+  code = codegenMapped(tc, mappingOptions);
+  EXPECT_NE(std::string::npos, code.find("__syncthreads()")) << code;
+}
+
+/*
+ * Check that requesting launch bounds annotates the kernel with the total
+ * number of threads per block and the requested occupancy.
+ */
+TEST_F(PolyhedralMapperTest, LaunchBounds) {
+  auto tc = R"TC(
+def fun(float(N) I) -> (O) {
+    O(n) = I(n)
+}
+)TC";
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.mapToThreads(128).useLaunchBounds(true, 2);
+  auto code = codegenMapped(tc, mappingOptions);
+  EXPECT_TRUE(code.find("__launch_bounds__(128, 2)") != std::string::npos)
+      << code;
+}
+
+/*
+ * Check that mapping options that only differ in tiling and mapping reuse the
+ * schedule computed for the first ones and generate the same code as without
+ * the schedule cache, while other scheduler options are scheduled again,
+ * reusing the cached dependences.
+ */
+TEST_F(PolyhedralMapperTest, ScheduleCache) {
+  auto tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  Scop::clearScheduleCache();
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.tile(32, 32).mapToThreads(32, 8);
+  codegenMapped(tc, mappingOptions);
+  mappingOptions.tile(16, 64).mapToThreads(16, 16);
+  auto code = codegenMapped(tc, mappingOptions);
+  auto statistics = Scop::scheduleCacheStatistics();
+  EXPECT_EQ(1u, statistics.size);
+  EXPECT_EQ(1u, statistics.hits);
+  EXPECT_EQ(1u, statistics.misses);
+  auto dependenceStatistics = Scop::dependenceCacheStatistics();
+  EXPECT_EQ(1u, dependenceStatistics.size);
+  EXPECT_EQ(1u, dependenceStatistics.hits);
+  EXPECT_EQ(1u, dependenceStatistics.misses);
+
+  {
+    auto maxEntries = FLAGS_schedule_cache_max_entries;
+    FLAGS_schedule_cache_max_entries = 0;
+    ScopeGuard g([maxEntries]() {
+      FLAGS_schedule_cache_max_entries = maxEntries;
+    });
+    EXPECT_EQ(code, codegenMapped(tc, mappingOptions));
+  }
+
+  mappingOptions.outerScheduleAllowSkewing(true);
+  codegenMapped(tc, mappingOptions);
+  statistics = Scop::scheduleCacheStatistics();
+  EXPECT_EQ(2u, statistics.size);
+  EXPECT_EQ(1u, statistics.hits);
+  EXPECT_EQ(2u, statistics.misses);
+  // The dependences do not depend on the scheduler options.
+  dependenceStatistics = Scop::dependenceCacheStatistics();
+  EXPECT_EQ(1u, dependenceStatistics.size);
+  EXPECT_EQ(2u, dependenceStatistics.hits);
+  EXPECT_EQ(1u, dependenceStatistics.misses);
 }
 
 /*
@@ -715,6 +894,472 @@ TEST_F(PolyhedralMapperTest, ReductionMM1D) {
   EXPECT_TRUE(code.find("C[(c0 + c3)][(t0 + c1)] = (C") != std::string::npos);
 }
 
+/*
+ * Check that warp shuffle reductions replace the CUB library call
+ * when requested and that CUB is then not included.
+ */
+TEST_F(PolyhedralMapperTest, ReductionMM1DWarpShuffle) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.mapToThreads({32});
+  mappingOptions.warpShuffleReductions(true);
+  auto code = codegenMapped(kTcMM, mappingOptions);
+  using tc::code::cuda::kWarpReductionName;
+  EXPECT_TRUE(code.find(kWarpReductionName) != std::string::npos);
+  EXPECT_TRUE(code.find("cub/nvrtc_cub.cuh") == std::string::npos);
+}
+
+/*
+ * Check that a reduction over two loops gets mapped to threadIdx.y and
+ * threadIdx.x together with twoDimReductions, reduced along both with
+ * warp shuffles even without warpShuffleReductions.
+ */
+TEST_F(PolyhedralMapperTest, ReductionTwoDim) {
+  string tc = R"TC(
+def fun(float(N, C, K) I) -> (O) {
+    O(n) +=! I(n, r_c, r_k)
+}
+)TC";
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.mapToThreads({16, 8});
+  mappingOptions.twoDimReductions(true);
+  auto code = codegenMapped(tc, mappingOptions);
+  using tc::code::cuda::kWarpReductionAlongXYName;
+  EXPECT_TRUE(
+      code.find(kWarpReductionAlongXYName + "<16,8,1,") != std::string::npos)
+      << code;
+  EXPECT_TRUE(code.find("cub/nvrtc_cub.cuh") == std::string::npos);
+}
+
+/*
+ * Check that the kernels only come with the helpers they use: neither the
+ * reduction helpers nor CUB without a mapped reduction.
+ */
+TEST_F(PolyhedralMapperTest, TrimmedPrelude) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.mapToThreads({32});
+  auto code = codegenMapped(kTcMM, mappingOptions);
+  EXPECT_TRUE(code.find("struct Reducer") != std::string::npos);
+
+  mappingOptions.matchLibraryCalls(false);
+  code = codegenMapped(kTcMM, mappingOptions);
+  EXPECT_TRUE(code.find("struct Reducer") == std::string::npos);
+  EXPECT_TRUE(code.find("cub/nvrtc_cub.cuh") == std::string::npos);
+  EXPECT_TRUE(code.find("dp4a") == std::string::npos);
+}
+
+/*
+ * Check that with a block swizzle the block indices are computed from the
+ * linear block index in groups of rows and that they are taken as is
+ * otherwise.
+ */
+TEST_F(PolyhedralMapperTest, BlockSwizzle) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.tile(32, 32).mapToBlocks(8, 8).mapToThreads(32, 8);
+  auto code = codegenMapped(kTcMM, mappingOptions);
+  EXPECT_TRUE(code.find("int b0 = blockIdx.x;") != std::string::npos);
+
+  mappingOptions.blockSwizzle(4);
+  code = codegenMapped(kTcMM, mappingOptions);
+  EXPECT_TRUE(code.find("int b0 = blockIdx.x;") == std::string::npos);
+  EXPECT_TRUE(code.find("_tc_row") != std::string::npos);
+  EXPECT_TRUE(code.find("gridDim.x") != std::string::npos);
+}
+
+/*
+ * Check that skewing a band into a wavefront replaces its first member by
+ * the sum of the first two and marks the second one coincident.
+ */
+TEST_F(PolyhedralMapperTest, BandWavefront) {
+  auto scop = PrepareAndJoinBands(R"TC(
+def fun(float(N, M) A) -> (B) {
+    B(n, m) = A(n, m)
+}
+)TC");
+  auto band = scop->scheduleRoot()->child({0});
+  auto bandNode = band->elemAs<ScheduleTreeElemBand>();
+  ASSERT_EQ(bandNode->nMember(), 2u);
+  bandNode->coincident_ = {false, false};
+  auto n = bandNode->mupa_.get_union_pw_aff(0);
+  auto m = bandNode->mupa_.get_union_pw_aff(1);
+
+  bandWavefront(band);
+  auto wavefront = bandNode->mupa_.get_union_pw_aff(0);
+  EXPECT_TRUE(isl::union_map::from(isl::multi_union_pw_aff(wavefront))
+                  .is_equal(isl::union_map::from(
+                      isl::multi_union_pw_aff(n.add(m)))));
+  EXPECT_FALSE(bandNode->coincident_[0]);
+  EXPECT_TRUE(bandNode->coincident_[1]);
+  EXPECT_EQ(bandNode->nOuterCoincident(), 0u);
+}
+
+/*
+ * Check that a reduction split across blocks adds the partial results
+ * of the blocks to the output atomically and that it is no longer
+ * replaced by a library call, which only reduces within a block.
+ */
+TEST_F(PolyhedralMapperTest, ReductionMMGrid) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.tile(32, 32, 32).mapToBlocks(8, 8, 4).mapToThreads(32, 8);
+  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.gridReductions(true);
+  auto code = codegenMapped(kTcMM, mappingOptions);
+  using tc::code::cuda::kCUBReductionName;
+  EXPECT_TRUE(code.find("atomicAdd(&C[") != std::string::npos);
+  EXPECT_TRUE(code.find(kCUBReductionName) == std::string::npos);
+}
+
+/*
+ * Check that a scatter reduction, the gradient of a lookup table, is
+ * computed with atomic additions to the rows its instances select, combined
+ * per warp if requested, and that it is not replaced by a library call,
+ * which would combine the values of different rows.
+ */
+TEST_F(PolyhedralMapperTest, AtomicScatter) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.tile(32, 32, 4).mapToBlocks(8, 8).mapToThreads(32, 4);
+  mappingOptions.matchLibraryCalls(true);
+  mappingOptions.gridReductions(true);
+  auto code = codegenMapped(TC_LUT_BACKWARD, mappingOptions);
+  using tc::code::cuda::kCUBReductionName;
+  EXPECT_TRUE(code.find("atomicAdd(&d_LUT[") != std::string::npos) << code;
+  EXPECT_TRUE(code.find(kCUBReductionName) == std::string::npos) << code;
+
+  mappingOptions.warpAggregatedAtomics(true);
+  code = codegenMapped(TC_LUT_BACKWARD, mappingOptions);
+  EXPECT_TRUE(
+      code.find("__tc::atomicAddAggregated(&d_LUT[") != std::string::npos)
+      << code;
+}
+
+/*
+ * Check that with a thread tile of 4 x 4 on a 32 x 32 tile of a matmul
+ * mapped to 8 x 8 threads, each thread keeps a 4 x 4 tile of C in registers.
+ */
+TEST_F(PolyhedralMapperTest, MatmulThreadTile) {
+  auto mappingOptions = DefaultOptions()
+                            .tile(32, 32, 32)
+                            .mapToBlocks(2, 2)
+                            .mapToThreads(8, 8)
+                            .threadTile({4, 4})
+                            .usePrivateMemory(true);
+  auto scop = Prepare(kTcMM);
+  scop->fixParameters<int>({{"M", 64}, {"N", 64}, {"K", 64}});
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  auto code = std::get<0>(mscop->codegen(specializedName));
+  EXPECT_TRUE(code.find("_C_0[4][4];") != std::string::npos) << code;
+}
+
+/*
+ * Check that TCs whose statements only read inputs at distinct points are
+ * pointwise and get a band of coincident members per statement without
+ * scheduling, while those reading intermediate tensors or reducing are not.
+ */
+TEST_F(PolyhedralMapperTest, PointwiseSchedule) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(M) Bias) -> (B, C) {
+    B(n, m) = fmax(A(n, m) + Bias(m), 0)
+    C(n, m) = 2 * A(n, m)
+})TC";
+  auto scop = Prepare(tc);
+  ASSERT_TRUE(scop->isPointwise());
+  auto scheduled = Scop::makePointwiseScheduled(*scop);
+  EXPECT_TRUE(scheduled->dependences.is_empty());
+  auto bands = ScheduleTree::collect(
+      scheduled->scheduleRoot(), detail::ScheduleTreeType::Band);
+  ASSERT_EQ(bands.size(), 2u);
+  for (auto band : bands) {
+    auto bandElem = band->elemAs<ScheduleTreeElemBand>();
+    EXPECT_TRUE(bandElem->permutable_);
+    EXPECT_EQ(bandElem->nOuterCoincident(), 2u);
+  }
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      Prepare(tc), DefaultOptions().tile(32, 32).mapToThreads(32, 8));
+  auto code = std::get<0>(mscop->codegen(specializedName));
+  EXPECT_TRUE(code.find("B[") != std::string::npos) << code;
+  EXPECT_TRUE(code.find("C[") != std::string::npos) << code;
+
+  EXPECT_FALSE(Prepare(kTcMM)->isPointwise());
+  EXPECT_FALSE(Prepare(R"TC(
+def fun(float(N) A) -> (B, C) {
+    B(n) = A(n) + 1
+    C(n) = B(n) * 2
+})TC")->isPointwise());
+}
+
+static const string kTcReluSum = R"TC(
+def fun(float(N, M) A) -> (B, C) {
+    B(n, m) = fmax(A(n, m), 0)
+    C(n) +=! B(n, r_m)
+})TC";
+
+/*
+ * Check that the statements that are not fused by scheduling are mapped to
+ * separate kernels, which together cover all statement instances once.
+ */
+TEST_F(PolyhedralMapperTest, SplitKernels) {
+  auto mappingOptions = DefaultOptions()
+                            .outerScheduleFusionStrategy(FusionStrategy::Min)
+                            .tile(32, 32)
+                            .mapToThreads(32, 8)
+                            .splitKernels(true);
+  auto scop = Prepare(kTcReluSum);
+  auto domain = scop->domain();
+  auto mscops = MappedScop::makeSplitWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  ASSERT_GE(mscops.size(), 2u);
+  auto covered = isl::union_set::empty(domain.get_space());
+  for (size_t i = 0; i < mscops.size(); ++i) {
+    auto part = mscops[i]->scop().domain();
+    EXPECT_TRUE(part.intersect(covered).is_empty());
+    covered = covered.unite(part);
+    auto name = std::string(specializedName) + std::to_string(i);
+    auto code = std::get<0>(mscops[i]->codegen(name));
+    EXPECT_TRUE(code.find("void " + name + "(") != std::string::npos) << code;
+  }
+  EXPECT_TRUE(covered.is_subset(domain));
+  EXPECT_TRUE(domain.intersect_params(mscops[0]->scop().globalParameterContext)
+                  .is_subset(covered));
+}
+
+/*
+ * Check that each split kernel is mapped with its own options, the kernels
+ * without options falling back to those of the whole TC, and that the
+ * options of the kernels are kept on a round-trip through serialization.
+ */
+TEST_F(PolyhedralMapperTest, SplitKernelOptions) {
+  auto mappingOptions = DefaultOptions()
+                            .outerScheduleFusionStrategy(FusionStrategy::Min)
+                            .tile(32, 32)
+                            .mapToThreads(32, 8)
+                            .splitKernels(true);
+  mappingOptions.kernelOptions(
+      0, DefaultOptions().tile(16, 16).mapToThreads(16, 4));
+  mappingOptions = CudaMappingOptions(
+      mappingOptions.toProtobufSerializedString());
+  EXPECT_EQ(16u, mappingOptions.optionsOfKernel(0).block.extractVector()[0]);
+  EXPECT_EQ(32u, mappingOptions.optionsOfKernel(1).block.extractVector()[0]);
+  // The outer scheduling is that of the whole TC
+  EXPECT_EQ(
+      FusionStrategy::Min,
+      mappingOptions.optionsOfKernel(0)
+          .generic.outerScheduleOptions.proto.fusion_strategy());
+
+  auto scop = Prepare(kTcReluSum);
+  auto mscops = MappedScop::makeSplitWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  ASSERT_GE(mscops.size(), 2u);
+  EXPECT_EQ(16u, mscops[0]->numThreads.view[0]);
+  EXPECT_EQ(32u, mscops[1]->numThreads.view[0]);
+}
+
+/*
+ * Check that the statements of tensors that are never fused end up in
+ * separate kernels even with maximal fusion, and that the pairs are kept on
+ * a round-trip through serialization.
+ */
+TEST_F(PolyhedralMapperTest, NeverFuse) {
+  auto mappingOptions = DefaultOptions()
+                            .outerScheduleFusionStrategy(FusionStrategy::Max)
+                            .outerScheduleNeverFuse("B", "C")
+                            .outerScheduleNeverFuse("C", "B")
+                            .tile(32, 32)
+                            .mapToThreads(32, 8)
+                            .splitKernels(true);
+  mappingOptions = CudaMappingOptions(
+      mappingOptions.toProtobufSerializedString());
+  const auto& proto = mappingOptions.generic.outerScheduleOptions.proto;
+  ASSERT_EQ(1, proto.never_fused_size());
+  EXPECT_EQ("B", proto.never_fused(0).first());
+  EXPECT_EQ("C", proto.never_fused(0).second());
+
+  auto scop = Prepare(kTcReluSum);
+  auto mscops = MappedScop::makeSplitWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  EXPECT_EQ(2u, mscops.size());
+}
+
+/*
+ * Check that the stages of a cooperative kernel are emitted in a single
+ * kernel, which calls them in order with a grid synchronization in between.
+ */
+TEST_F(PolyhedralMapperTest, CooperativeKernels) {
+  auto mappingOptions = DefaultOptions()
+                            .outerScheduleFusionStrategy(FusionStrategy::Min)
+                            .tile(32, 32)
+                            .mapToThreads(32, 8)
+                            .cooperativeKernels(true);
+  auto scop = Prepare(kTcReluSum);
+  scop->fixParameters<int>({{"N", 64}, {"M", 64}});
+  auto stages =
+      MappedScop::makeCooperativeWithOuterBlockInnerThreadStrategy(
+          std::move(scop), mappingOptions);
+  ASSERT_GE(stages.size(), 2u);
+  auto res = MappedScop::codegenCooperative(specializedName, stages);
+  auto code = std::get<0>(res);
+  auto kernel = code.find("__global__");
+  ASSERT_NE(kernel, std::string::npos) << code;
+  EXPECT_EQ(code.find("__global__", kernel + 1), std::string::npos) << code;
+  auto sync = code.find("__tc::gridSync();", kernel);
+  ASSERT_NE(sync, std::string::npos) << code;
+  auto first = code.find(std::string(specializedName) + "_stage0(", kernel);
+  auto second = code.find(std::string(specializedName) + "_stage1(", kernel);
+  EXPECT_LT(first, sync) << code;
+  EXPECT_LT(sync, second) << code;
+  EXPECT_NE(second, std::string::npos) << code;
+  EXPECT_EQ(std::get<2>(res), stages.front()->numThreads);
+}
+
+/*
+ * Check that packing the batch of small matrix multiplications in blocks
+ * maps the instances to the additional thread dimension and tiles the batch
+ * by the packing.
+ */
+TEST_F(PolyhedralMapperTest, BatchPacking) {
+  string tc = R"TC(
+def batch_matmul(float(B, N, M) X, float(B, M, K) Y) -> (Z) {
+    Z(b, n, k) +=! X(b, n, mm) * Y(b, mm, k)
+}
+)TC";
+  auto mappingOptions =
+      DefaultOptions().tile(1, 16, 16).mapToThreads(16, 16).batchPacking(4);
+  auto scop = Prepare(tc);
+  scop->fixParameters<int>({{"B", 1024}, {"N", 16}, {"M", 16}, {"K", 16}});
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  ASSERT_EQ(mscop->numThreads.view.size(), 3u);
+  EXPECT_EQ(mscop->numThreads.view[2], 4u);
+  auto code = std::get<0>(mscop->codegen(specializedName));
+  EXPECT_NE(code.find("t2 + 4 * b0"), std::string::npos) << code;
+}
+
+/*
+ * Check that linearizing the two outer loops of a 4D pointwise operation
+ * into the first block dimension maps its three outer loops to the two
+ * block dimensions, while the third one is iterated over by each block
+ * otherwise.
+ */
+TEST_F(PolyhedralMapperTest, LinearizeBlocks) {
+  string tc = R"TC(
+def add4(float(N, C, H, W) A, float(N, C, H, W) B) -> (O) {
+    O(n, c, h, w) = A(n, c, h, w) + B(n, c, h, w)
+}
+)TC";
+  auto mappingOptions =
+      DefaultOptions().tile(1, 1, 1, 32).mapToBlocks(32, 16).mapToThreads(32);
+  auto codegenFixed = [&](const CudaMappingOptions& options) {
+    auto scop = Prepare(tc);
+    scop->fixParameters<int>({{"N", 4}, {"C", 8}, {"H", 16}, {"W", 32}});
+    auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+        std::move(scop), options);
+    return std::get<0>(mscop->codegen(specializedName));
+  };
+  auto code = codegenFixed(mappingOptions);
+  EXPECT_NE(code.find("for ("), std::string::npos) << code;
+  code = codegenFixed(mappingOptions.linearizeBlocks(2));
+  EXPECT_EQ(code.find("for ("), std::string::npos) << code;
+}
+
+/*
+ * Check that with warp tiles of 4 x 8 on an 8 x 16 tile mapped to 8 x 4 x 4
+ * threads, the four sub-tiles are mapped to threadIdx.z and each thread
+ * computes a single point, while the threads of a block iterate over the
+ * tile without warp tiling.
+ */
+TEST_F(PolyhedralMapperTest, WarpTile) {
+  string tc = R"TC(
+def add2(float(M, N) A, float(M, N) B) -> (O) {
+    O(m, n) = A(m, n) + B(m, n)
+}
+)TC";
+  auto mappingOptions =
+      DefaultOptions().tile(8, 16).mapToBlocks(1, 1).mapToThreads(8, 4, 4);
+  auto codegenFixed = [&](const CudaMappingOptions& options) {
+    auto scop = Prepare(tc);
+    scop->fixParameters<int>({{"M", 8}, {"N", 16}});
+    auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+        std::move(scop), options);
+    return std::get<0>(mscop->codegen(specializedName));
+  };
+  auto code = codegenFixed(mappingOptions);
+  EXPECT_NE(code.find("for ("), std::string::npos) << code;
+  code = codegenFixed(mappingOptions.warpTile({4, 8}));
+  EXPECT_EQ(code.find("for ("), std::string::npos) << code;
+}
+
+/*
+ * Check that the reduction loop of a matmul with a parametric trip count,
+ * which is not unrolled by the mapper, is only preceded by a partial unroll
+ * pragma when requested.
+ */
+TEST_F(PolyhedralMapperTest, UnrollPragma) {
+  auto mappingOptions =
+      DefaultOptions().tile(32, 32, 32).mapToThreads(32, 8).unroll(4);
+  auto code = codegenMapped(kTcMM, mappingOptions);
+  EXPECT_TRUE(code.find("#pragma unroll") == std::string::npos) << code;
+  mappingOptions.unrollPragma(true);
+  code = codegenMapped(kTcMM, mappingOptions);
+  EXPECT_TRUE(code.find("#pragma unroll 4") != std::string::npos) << code;
+}
+
+/*
+ * Check that separating the full tiles of a pointwise operation on sizes
+ * that are not multiples of the tile sizes emits the statement separately
+ * for the full tiles and for the partial tiles.
+ */
+TEST_F(PolyhedralMapperTest, SeparateFullTiles) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  auto countStatements = [this,
+                          &tc](const CudaMappingOptions& options) -> size_t {
+    auto scop = Prepare(tc);
+    scop->fixParameters<int>({{"N", 100}, {"M", 100}});
+    auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+        std::move(scop), options);
+    auto code = std::get<0>(mscop->codegen(specializedName));
+    size_t n = 0;
+    for (auto pos = code.find("C["); pos != std::string::npos;
+         pos = code.find("C[", pos + 1)) {
+      ++n;
+    }
+    return n;
+  };
+  auto mappingOptions =
+      DefaultOptions().tile(32, 32).mapToBlocks(4, 4).mapToThreads(32, 8);
+  auto nStatements = countStatements(mappingOptions);
+  mappingOptions.separateFullTiles(true);
+  EXPECT_GT(countStatements(mappingOptions), nStatements);
+}
+
+static const string kTcMMHalf = R"TC(
+def fun(float16(M, K) A, float16(K, N) B) -> (C) {
+    C(m, n) +=! float(A(m, r_k)) * float(B(r_k, n))
+})TC";
+
+/*
+ * Check that a float16 matmul with sizes and tile sizes multiple of 16
+ * is computed on tensor cores, with one warp per 16 x 16 tile of C.
+ */
+TEST_F(PolyhedralMapperTest, MatmulTensorCores) {
+  auto mappingOptions = DefaultOptions().tile(32, 64).useTensorCores(true);
+  auto scop = Prepare(kTcMMHalf);
+  scop->fixParameters<int>({{"M", 64}, {"N", 128}, {"K", 48}});
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      std::move(scop), mappingOptions);
+  auto code = std::get<0>(mscop->codegen(specializedName));
+  using tc::code::cuda::kWmmaMatmulName;
+  std::string expected(kWmmaMatmulName + "<64, 128, 48, 32, 64>(pC, pA, pB)");
+  EXPECT_TRUE(code.find(expected) != std::string::npos) << code;
+  EXPECT_EQ(8u, mscop->numThreads.view[1]);
+  EXPECT_EQ(2u, mscop->numBlocks.view[0]);
+}
+
 /*
  * Check that a reduction mapped to a two-dimensional block
  * is properly separated into full and partial blocks and
@@ -733,6 +1378,135 @@ TEST_F(PolyhedralMapperTest, ReductionMM2D) {
   EXPECT_TRUE(code.find("C[(t1 + c0)][(t0 + c1)] = (C") != std::string::npos);
 }
 
+/*
+ * Check that the float builtins and divisions are library calls by default,
+ * hardware approximations with FastIntrinsics, that tanh and the sigmoid
+ * are computed by the fast activations with FastActivations and that the
+ * statements of the precise tensors keep the library calls.
+ */
+TEST_F(PolyhedralMapperTest, MathPrecision) {
+  constexpr auto tc = R"TC(
+def fun(float(N) I, float(N) J) -> (O, P, Q) {
+    O(n) = tanh(I(n)) / J(n)
+    P(n) = 1 / (1 + exp(-I(n)))
+    Q(n) = exp(J(n))
+}
+)TC";
+  auto mappingOptions = DefaultOptions();
+  auto code = codegenMapped(tc, mappingOptions);
+  EXPECT_TRUE(code.find("__expf(") == std::string::npos) << code;
+  EXPECT_TRUE(code.find("__fdividef(") == std::string::npos) << code;
+
+  mappingOptions.mathPrecision(MathPrecision::FastIntrinsics);
+  code = codegenMapped(tc, mappingOptions);
+  EXPECT_TRUE(code.find("__expf(") != std::string::npos) << code;
+  EXPECT_TRUE(code.find("__fdividef(tanh(") != std::string::npos) << code;
+  EXPECT_TRUE(code.find("__tc::fastTanh(") == std::string::npos) << code;
+
+  mappingOptions.mathPrecision(MathPrecision::FastActivations);
+  code = codegenMapped(tc, mappingOptions);
+  EXPECT_TRUE(code.find("__fdividef(__tc::fastTanh(") != std::string::npos)
+      << code;
+  EXPECT_TRUE(code.find("= __tc::fastSigmoid(I[") != std::string::npos)
+      << code;
+
+  mappingOptions.preciseTensors({"Q"});
+  code = codegenMapped(tc, mappingOptions);
+  EXPECT_TRUE(code.find("__expf(") == std::string::npos) << code;
+  EXPECT_TRUE(code.find("__tc::fastSigmoid(I[") != std::string::npos) << code;
+}
+
+/*
+ * Check that the first index of the outputs of a (batched) matrix
+ * multiplication splits the inputs it indexes and reads the others whole,
+ * and that a statement reading another row than the one it writes is not
+ * split.
+ */
+TEST_F(PolyhedralMapperTest, DataParallelSplit) {
+  auto split = [&](const std::string& tc) {
+    return findDataParallelSplit(
+        *Scop::makeScheduled(*Prepare(tc), SchedulerOptions().view));
+  };
+
+  auto matmul = split(makeMatmulTc());
+  ASSERT_TRUE(matmul.hasValue());
+  EXPECT_EQ(std::vector<bool>({true, false}), matmul->splitInputs);
+
+  auto batchMatmul = split(R"TC(
+def fun(float(B, N, K) X, float(B, K, M) Y) -> (Z) {
+    Z(b, n, m) +=! X(b, n, r_k) * Y(b, r_k, m)
+}
+)TC");
+  ASSERT_TRUE(batchMatmul.hasValue());
+  EXPECT_EQ(std::vector<bool>({true, true}), batchMatmul->splitInputs);
+
+  auto shifted = split(R"TC(
+def fun(float(N) I) -> (O, P) {
+    O(n) = I(n)
+    P(n) = O(n + 1)
+}
+)TC");
+  EXPECT_FALSE(shifted.hasValue());
+}
+
+/*
+ * Check that a mapped scop restored from its serialization, on a scop built
+ * from the TC again, has the same schedule tree and generates the same code.
+ */
+TEST_F(PolyhedralMapperTest, MappedScopProtobuf) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.mapToThreads({16, 8})
+      .mapToBlocks({4, 4})
+      .useSharedMemory(false)
+      .usePrivateMemory(false)
+      .matchLibraryCalls(false);
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      Prepare(makeMatmulTc()), mappingOptions);
+  auto code = std::get<0>(mscop->codegen(specializedName));
+
+  MappedScopProto proto;
+  ASSERT_TRUE(proto.ParseFromString(mscop->toProtobuf().SerializeAsString()));
+  auto restored =
+      MappedScop::makeFromProtobuf(Prepare(makeMatmulTc()), proto);
+  EXPECT_TRUE(*mscop->schedule() == *restored->schedule())
+      << *mscop->schedule() << "\nVS\n"
+      << *restored->schedule();
+  EXPECT_EQ(code, std::get<0>(restored->codegen(specializedName)));
+}
+
+/*
+ * Check that the code generation options of a mapped scop survive its
+ * serialization.
+ */
+TEST_F(PolyhedralMapperTest, MappedScopProtobufOptions) {
+  auto mappingOptions = DefaultOptions();
+  mappingOptions.mapToThreads({16, 8})
+      .mapToBlocks({4, 4})
+      .useSharedMemory(false)
+      .usePrivateMemory(false)
+      .matchLibraryCalls(false)
+      .blockSwizzle(2)
+      .asyncCopies(true)
+      .warpAggregatedAtomics(true)
+      .mathPrecision(MathPrecision::FastIntrinsics)
+      .preciseTensors({"O"});
+  auto mscop = MappedScop::makeWithOuterBlockInnerThreadStrategy(
+      Prepare(makeMatmulTc()), mappingOptions);
+  auto code = std::get<0>(mscop->codegen(specializedName));
+
+  MappedScopProto proto;
+  ASSERT_TRUE(proto.ParseFromString(mscop->toProtobuf().SerializeAsString()));
+  auto restored =
+      MappedScop::makeFromProtobuf(Prepare(makeMatmulTc()), proto);
+  EXPECT_EQ(2u, restored->blockSwizzle);
+  EXPECT_EQ(mscop->useAsyncCopies, restored->useAsyncCopies);
+  EXPECT_TRUE(restored->useWarpAggregatedAtomics);
+  EXPECT_EQ(MathPrecision::FastIntrinsics, restored->mathPrecision);
+  EXPECT_EQ(
+      std::unordered_set<std::string>({"O"}), restored->preciseTensors);
+  EXPECT_EQ(code, std::get<0>(restored->codegen(specializedName)));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -14,15 +14,24 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <limits>
+
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
 #include <ATen/ATen.h>
 
+#include <llvm/Config/llvm-config.h>
+
 #include "tc/aten/utils.h"
+#include "tc/core/cpu/cpu_compilation_cache.h"
+#include "tc/core/cpu/cpu_parallel.h"
 #include "tc/core/cpu/cpu_tc_executor.h"
+#include "tc/core/cpu/halide_cpu_tc_executor.h"
 #include "tc/core/execution_engine.h"
+#include "tc/core/flags.h"
 #include "tc/core/mapping_options.h"
 #include "tc/core/polyhedral/codegen_llvm.h"
 #include "tc/core/polyhedral/llvm_jit.h"
@@ -66,7 +75,49 @@ def fun(float(N, M) A, float(N, M) B) -> (C) {
   checkRtol(Cc - C, {A, B}, N * M);
 }
 
-TEST(LLVMCodegen, DISABLED_BasicExecutionEngine) {
+TEST(LLVMCodegen, ObjectCache) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  auto N = 40;
+  auto M = 24;
+
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  auto scop = polyhedral::Scop::makeScop(ctx, tc);
+  auto context = scop->makeContext(
+      std::unordered_map<std::string, int>{{"N", N}, {"M", M}});
+  scop = Scop::makeSpecializedScop(*scop, context);
+
+  CpuObjectCache::enableCache();
+  ScopeGuard sg([]() { CpuObjectCache::disableCache(); });
+  {
+    Jit jit;
+    jit.codegenScop("kernel_anon", *scop);
+  }
+  ASSERT_EQ(CpuObjectCache::getCache()->size(), 1);
+  ASSERT_EQ(CpuObjectCache::getCache()->numberSuccessfulRetrievals, 0);
+
+  // Round trip through the protobuf as a restarted process would.
+  CpuObjectCache::loadCacheFromProtobuf(
+      CpuObjectCache::getCache()->toProtobuf());
+  Jit jit;
+  jit.codegenScop("kernel_anon", *scop);
+  ASSERT_EQ(CpuObjectCache::getCache()->numberSuccessfulRetrievals, 1);
+  auto fptr =
+      (void (*)(float*, float*, float*))jit.getSymbolAddress("kernel_anon");
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor C = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Cc = A + B;
+  fptr(A.data<float>(), B.data<float>(), C.data<float>());
+
+  checkRtol(Cc - C, {A, B}, N * M);
+}
+
+TEST(LLVMCodegen, BasicExecutionEngine) {
   string tc = R"TC(
 def fun(float(N, M) A, float(N, M) B) -> (C) {
     C(n, m) = A(n, m) + B(n, m)
@@ -79,14 +130,458 @@ def fun(float(N, M) A, float(N, M) B) -> (C) {
   at::Tensor A = at::CPU(at::kFloat).rand({N, M});
   at::Tensor B = at::CPU(at::kFloat).rand({N, M});
   at::Tensor C = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Cc = A + B;
 
   ExecutionEngine<CpuTcExecutor> engine;
   engine.define(tc);
-  auto options = tc::MappingOptions::makeNaiveMappingOptions();
+  auto options = CpuMappingOptions::makeNaiveCpuMappingOptions();
   auto inputDLTensorsPair = toConstDlpackTensors({A, B});
   ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
-  engine.compile(
+  auto outputDLTensorsPair = toDlpackTensors({C});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
       "fun", inputDLTensorsPair.first, options.toProtobufSerializedString());
+  engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+
+  checkRtol(Cc - C, {A, B}, N * M);
+}
+
+TEST(LLVMCodegen, InlinedTemporaries) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    T(n, m) = A(n, m) + B(n, m)
+    C(n, m) = T(n, m) * T(n, m)
+}
+)TC";
+  auto N = 40;
+  auto M = 24;
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor C = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Cc = (A + B) * (A + B);
+
+  // Kernels with temporaries are not supported, T is recomputed in C.
+  ExecutionEngine<CpuTcExecutor> engine;
+  engine.define(tc);
+  auto options = CpuMappingOptions::makeNaiveCpuMappingOptions()
+                     .inlinePointwiseTemporaries(true);
+  auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto outputDLTensorsPair = toDlpackTensors({C});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
+      "fun", inputDLTensorsPair.first, options.toProtobufSerializedString());
+  engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+
+  checkRtol(Cc - C, {A, B}, N * M);
+}
+
+TEST(LLVMCodegen, RaggedRange) {
+  string tc = R"TC(
+def bags(float(E, D) LUT, int32(N) I, int32(B1) Off) -> (O) {
+    O(b, j) +=! LUT(I(k), j) where k in Off(b):Off(b + 1):5
+}
+)TC";
+
+  auto E = 10;
+  auto D = 8;
+  auto N = 7;
+  std::vector<int> offsets = {0, 2, 2, 7};
+  auto B = static_cast<int>(offsets.size()) - 1;
+
+  at::Tensor LUT = at::CPU(at::kFloat).rand({E, D});
+  at::Tensor I =
+      at::CPU(at::kFloat).rand({N}).mul_(E).floor_().toType(at::kInt);
+  at::Tensor Off = at::CPU(at::kInt).zeros({B + 1});
+  std::copy(offsets.begin(), offsets.end(), Off.data<int>());
+  at::Tensor O = at::CPU(at::kFloat).rand({B, D});
+  at::Tensor Oc = at::CPU(at::kFloat).zeros({B, D});
+  for (int b = 0; b < B; ++b) {
+    for (int k = offsets[b]; k < offsets[b + 1]; ++k) {
+      for (int j = 0; j < D; ++j) {
+        Oc.data<float>()[b * D + j] +=
+            LUT.data<float>()[I.data<int>()[k] * D + j];
+      }
+    }
+  }
+
+  ExecutionEngine<CpuTcExecutor> engine;
+  engine.define(tc);
+  auto options = CpuMappingOptions::makeNaiveCpuMappingOptions();
+  auto inputDLTensorsPair = toConstDlpackTensors({LUT, I, Off});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto outputDLTensorsPair = toDlpackTensors({O});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
+      "bags", inputDLTensorsPair.first, options.toProtobufSerializedString());
+  engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+
+  checkRtol(Oc - O, {LUT}, N * D);
+}
+
+TEST(LLVMCodegen, InferOutputTensorInfo) {
+  string tc = R"TC(
+def matmul(float(M, K) A, float(K, N) B) -> (C) {
+    C(m, n) +=! A(m, r_k) * B(r_k, n)
+}
+)TC";
+  ExecutionEngine<CpuTcExecutor> engine;
+  engine.define(tc);
+  at::Tensor A = at::CPU(at::kFloat).rand({7, 5});
+  at::Tensor B = at::CPU(at::kFloat).rand({5, 3});
+  auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+
+  auto outputs =
+      engine.inferOutputTensorInfo("matmul", inputDLTensorsPair.first);
+  ASSERT_EQ(1, outputs.size());
+  ASSERT_EQ(2, outputs[0]->ndim);
+  EXPECT_EQ(7, outputs[0]->shape[0]);
+  EXPECT_EQ(3, outputs[0]->shape[1]);
+  // Repeated queries reuse the inferred shapes.
+  EXPECT_EQ(
+      outputs,
+      engine.inferOutputTensorInfo("matmul", inputDLTensorsPair.first));
+
+  at::Tensor A2 = at::CPU(at::kFloat).rand({9, 5});
+  auto input2DLTensorsPair = toConstDlpackTensors({A2, B});
+  ScopeGuard g2([&]() { deleteDlmTensors(input2DLTensorsPair.second); });
+  auto outputs2 =
+      engine.inferOutputTensorInfo("matmul", input2DLTensorsPair.first);
+  EXPECT_EQ(9, outputs2[0]->shape[0]);
+
+  at::Tensor A3 = at::CPU(at::kFloat).rand({9});
+  auto input3DLTensorsPair = toConstDlpackTensors({A3, B});
+  ScopeGuard g3([&]() { deleteDlmTensors(input3DLTensorsPair.second); });
+  EXPECT_THROW(
+      engine.inferOutputTensorInfo("matmul", input3DLTensorsPair.first),
+      ::lang::ErrorReport);
+
+  // The queries did not create executors.
+  EXPECT_EQ(
+      0,
+      engine.compile(
+          "matmul",
+          inputDLTensorsPair.first,
+          CpuMappingOptions::makeNaiveCpuMappingOptions()
+              .toProtobufSerializedString()));
+}
+
+TEST(LLVMCodegen, CacheTiledMatMul) {
+  string tc = R"TC(
+def matmul(float(M, K) A, float(K, N) B) -> (C) {
+    C(m, n) +=! A(m, r_k) * B(r_k, n)
+}
+)TC";
+
+  auto M = 70;
+  auto K = 50;
+  auto N = 60;
+
+  at::Tensor A = at::CPU(at::kFloat).rand({M, K});
+  at::Tensor B = at::CPU(at::kFloat).rand({K, N});
+  at::Tensor C = at::CPU(at::kFloat).rand({M, N});
+  at::Tensor Cc = A.mm(B);
+
+  ExecutionEngine<CpuTcExecutor> engine;
+  engine.define(tc);
+  auto options = CpuMappingOptions::makeNaiveCpuMappingOptions()
+                     .tile(8, 8, 8)
+                     .l2Tile({32, 32, 32})
+                     .vectorizeWidth(4)
+                     .prefetchDistance(8);
+  auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto outputDLTensorsPair = toDlpackTensors({C});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
+      "matmul", inputDLTensorsPair.first, options.toProtobufSerializedString());
+  engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+
+  checkRtol(Cc - C, {A, B}, K);
+}
+
+TEST(LLVMCodegen, PackedTiledMatMul) {
+  string tc = R"TC(
+def matmul(float(M, K) A, float(K, N) B) -> (C) {
+    C(m, n) +=! A(m, r_k) * B(r_k, n)
+}
+)TC";
+
+  auto M = 70;
+  auto K = 50;
+  auto N = 60;
+
+  at::Tensor A = at::CPU(at::kFloat).rand({M, K});
+  at::Tensor B = at::CPU(at::kFloat).rand({K, N});
+  at::Tensor Cc = A.mm(B);
+
+  // The tiles of A and B are copied into buffers at either level, the
+  // partial tiles at the boundaries included.
+  for (uint32_t level : {1u, 2u}) {
+    at::Tensor C = at::CPU(at::kFloat).rand({M, N});
+    ExecutionEngine<CpuTcExecutor> engine;
+    engine.define(tc);
+    auto options = CpuMappingOptions::makeNaiveCpuMappingOptions()
+                       .tile(8, 8, 8)
+                       .l2Tile({32, 32, 32})
+                       .packingLevel(level);
+    auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+    ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+    auto outputDLTensorsPair = toDlpackTensors({C});
+    ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+    auto handle = engine.compile(
+        "matmul",
+        inputDLTensorsPair.first,
+        options.toProtobufSerializedString());
+    engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+
+    checkRtol(Cc - C, {A, B}, K);
+  }
+}
+
+TEST(LLVMCodegen, StridedInputs) {
+  string tc = R"TC(
+def matmul(float(M, K) A, float(K, N) B) -> (C) {
+    C(m, n) +=! A(m, r_k) * B(r_k, n)
+}
+)TC";
+
+  auto M = 70;
+  auto K = 50;
+  auto N = 60;
+
+  // A is a slice of the columns of a larger tensor, B a transposed view:
+  // neither is packed and both are used in place.
+  at::Tensor AFull = at::CPU(at::kFloat).rand({M, K + 10});
+  at::Tensor A = AFull.narrow(1, 5, K);
+  at::Tensor B = at::CPU(at::kFloat).rand({N, K}).t();
+  at::Tensor C = at::CPU(at::kFloat).rand({M, N});
+  at::Tensor Cc = A.mm(B);
+
+  ExecutionEngine<CpuTcExecutor> engine;
+  engine.define(tc);
+  auto options =
+      CpuMappingOptions::makeNaiveCpuMappingOptions().vectorizeWidth(4);
+  auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto outputDLTensorsPair = toDlpackTensors({C});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
+      "matmul", inputDLTensorsPair.first, options.toProtobufSerializedString());
+  engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+  checkRtol(Cc - C, {A, B}, K);
+
+  // The kernel is specialized for the strides of the inputs.
+  auto packedDLTensorsPair =
+      toConstDlpackTensors({A.contiguous(), B.contiguous()});
+  ScopeGuard g3([&]() { deleteDlmTensors(packedDLTensorsPair.second); });
+  EXPECT_THROW(
+      engine.run(handle, packedDLTensorsPair.first, outputDLTensorsPair.first),
+      ::lang::ErrorReport);
+}
+
+#ifndef TAPIR_VERSION_MAJOR
+TEST(LLVMCodegen, ParallelLoop) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  auto N = 400;
+  auto M = 24;
+
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  auto scop = polyhedral::Scop::makeScop(ctx, tc);
+  auto context = scop->makeContext(
+      std::unordered_map<std::string, int>{{"N", N}, {"M", M}});
+  scop = Scop::makeSpecializedScop(*scop, context);
+  SchedulerOptionsProto sop;
+  SchedulerOptionsView sov(sop);
+  scop = Scop::makeScheduled(*scop, sov);
+
+  Jit jit;
+  auto mod = jit.codegenScop("kernel_anon", *scop);
+  ASSERT_NE(nullptr, mod->getFunction(kParallelForName));
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor C = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Cc = A + B;
+  auto fptr =
+      (void (*)(float*, float*, float*))jit.getSymbolAddress("kernel_anon");
+  for (auto nThreads : {1u, 4u}) {
+    FLAGS_llvm_num_threads = nThreads;
+    C.zero_();
+    fptr(A.data<float>(), B.data<float>(), C.data<float>());
+    checkRtol(Cc - C, {A, B}, N * M);
+  }
+  FLAGS_llvm_num_threads = 0;
+}
+
+TEST(LLVMCodegen, NumaParallelLoop) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) + B(n, m)
+}
+)TC";
+  auto N = 400;
+  auto M = 24;
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor C = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Cc = A + B;
+  cpuFirstTouch(C.data<float>(), N * M * sizeof(float));
+  ASSERT_TRUE(std::all_of(
+      C.data<float>(), C.data<float>() + N * M, [](float f) {
+        return f == 0;
+      }));
+
+  ExecutionEngine<CpuTcExecutor> engine;
+  engine.define(tc);
+  auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto outputDLTensorsPair = toDlpackTensors({C});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
+      "fun",
+      inputDLTensorsPair.first,
+      CpuMappingOptions::makeNaiveCpuMappingOptions()
+          .toProtobufSerializedString());
+  // The iterations are split by node, or bound to the last node.
+  FLAGS_llvm_numa = true;
+  FLAGS_llvm_num_threads = 4;
+  for (auto node : {-1, static_cast<int>(cpuNumaNodes().size()) - 1}) {
+    C.zero_();
+    engine.run(
+        handle,
+        inputDLTensorsPair.first,
+        outputDLTensorsPair.first,
+        false,
+        [](const CpuTcExecutor*) { return false; },
+        CpuRuntimeInformation(node));
+    checkRtol(Cc - C, {A, B}, N * M);
+    EXPECT_EQ(-1, boundNumaNode());
+  }
+  FLAGS_llvm_num_threads = 0;
+  FLAGS_llvm_numa = false;
+}
+
+TEST(LLVMCodegen, ParallelReduction) {
+  string tc = R"TC(
+def fun(float(N, M) A) -> (S, Mx, Mn) {
+    S(n) +=! A(n, r_m)
+    Mx(n) max=! A(n, r_m)
+    Mn(n) min=! A(n, r_m)
+}
+)TC";
+  auto N = 3;
+  auto M = 1000;
+
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  auto scop = polyhedral::Scop::makeScop(ctx, tc);
+  auto context = scop->makeContext(
+      std::unordered_map<std::string, int>{{"N", N}, {"M", M}});
+  scop = Scop::makeSpecializedScop(*scop, context);
+  SchedulerOptionsProto sop;
+  sop.set_fusion_strategy(FusionStrategy::Min);
+  SchedulerOptionsView sov(sop);
+  scop = Scop::makeScheduled(*scop, sov);
+
+  // The loops over n run sequentially, the reduction loops in parallel.
+  Jit jit;
+  auto mod = jit.codegenScop(
+      "kernel_anon",
+      *scop,
+      CpuMappingOptions::makeNaiveCpuMappingOptions().parallelDepth(1));
+  ASSERT_NE(nullptr, mod->getFunction(kParallelForName));
+  ASSERT_NE(nullptr, mod->getFunction(kNumThreadsName));
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M}) - 0.5;
+  at::Tensor S = at::CPU(at::kFloat).rand({N});
+  at::Tensor Mx = at::CPU(at::kFloat).rand({N});
+  at::Tensor Mn = at::CPU(at::kFloat).rand({N});
+  auto fptr = (void (*)(float*, float*, float*, float*))jit.getSymbolAddress(
+      "kernel_anon");
+  for (auto nThreads : {1u, 3u, 8u}) {
+    FLAGS_llvm_num_threads = nThreads;
+    fptr(A.data<float>(), S.data<float>(), Mx.data<float>(), Mn.data<float>());
+    checkRtol(A.sum(1) - S, {A}, M);
+    checkRtol(std::get<0>(A.max(1)) - Mx, {A});
+    checkRtol(std::get<0>(A.min(1)) - Mn, {A});
+  }
+  FLAGS_llvm_num_threads = 0;
+}
+#endif
+
+TEST(LLVMCodegen, VectorizedLoop) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) * B(n, m) + A(n, m)
+}
+)TC";
+  // M is not a multiple of the number of lanes, which exercises the
+  // remainder loop.
+  auto N = 40;
+  auto M = 27;
+
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  auto scop = polyhedral::Scop::makeScop(ctx, tc);
+  auto context = scop->makeContext(
+      std::unordered_map<std::string, int>{{"N", N}, {"M", M}});
+  scop = Scop::makeSpecializedScop(*scop, context);
+  SchedulerOptionsProto sop;
+  SchedulerOptionsView sov(sop);
+  scop = Scop::makeScheduled(*scop, sov);
+
+  Jit jit;
+  auto mod = jit.codegenScop("kernel_anon", *scop);
+  EXPECT_NE(std::string::npos, toString(mod.get()).find(" x float>"));
+
+  at::Tensor A = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor B = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor C = at::CPU(at::kFloat).rand({N, M});
+  at::Tensor Cc = A * B + A;
+  auto fptr =
+      (void (*)(float*, float*, float*))jit.getSymbolAddress("kernel_anon");
+  fptr(A.data<float>(), B.data<float>(), C.data<float>());
+  checkRtol(Cc - C, {A, B}, 2);
+}
+
+TEST(LLVMCodegen, TargetVectorWidth) {
+  string tc = R"TC(
+def fun(float(N, M) A, float(N, M) B) -> (C) {
+    C(n, m) = A(n, m) * B(n, m) + A(n, m)
+}
+)TC";
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  auto scop = polyhedral::Scop::makeScop(ctx, tc);
+  auto context = scop->makeContext(
+      std::unordered_map<std::string, int>{{"N", 40}, {"M", 64}});
+  scop = Scop::makeSpecializedScop(*scop, context);
+  SchedulerOptionsProto sop;
+  SchedulerOptionsView sov(sop);
+  scop = Scop::makeScheduled(*scop, sov);
+
+  // The vectors fill the widest registers of the target CPU, the kernels
+  // are only compiled, not run.
+  JitTarget sse;
+  sse.cpu = "x86-64";
+  Jit sseJit(llvm::None, sse);
+  auto sseModule = sseJit.emitModule("kernel_sse", *scop);
+  EXPECT_NE(std::string::npos, toString(sseModule.get()).find("<4 x float>"));
+
+  JitTarget avx512;
+  avx512.cpu = "skylake-avx512";
+  Jit avx512Jit(llvm::None, avx512);
+  auto avx512Module = avx512Jit.emitModule("kernel_avx512", *scop);
+  EXPECT_NE(
+      std::string::npos, toString(avx512Module.get()).find("<16 x float>"));
+  std::vector<std::unique_ptr<llvm::Module>> modules;
+  modules.push_back(std::move(avx512Module));
+  EXPECT_FALSE(avx512Jit.emitObject(std::move(modules)).empty());
 }
 
 TEST(LLVMCodegen, MultiStmt) {
@@ -242,6 +737,62 @@ def convolution(float(N,C,H,W) I, float(O,C,KH,KW) W1, float(O) B) -> (tmp, O1)
   checkRtol(output - expected, {I, W1, B}, C * KH * KW, 1e-6);
 }
 
+// The temporary is not supported by CpuTcExecutor, the Halide pipeline
+// computes it internally.
+TEST(HalideCpuTcExecutor, MatMulWithTemporary) {
+  string tc = R"TC(
+def matmul_relu(float(M, K) A, float(K, N) B) -> (C) {
+    T(m, n) +=! A(m, r_k) * B(r_k, n)
+    C(m, n) = fmax(T(m, n), 0)
+}
+)TC";
+  auto M = 37;
+  auto K = 19;
+  auto N = 66;
+
+  at::Tensor A = at::CPU(at::kFloat).rand({M, K}).sub_(0.5);
+  at::Tensor B = at::CPU(at::kFloat).rand({K, N}).sub_(0.5);
+  at::Tensor C = at::CPU(at::kFloat).rand({M, N});
+  at::Tensor Cc = A.mm(B).clamp(0, std::numeric_limits<float>::max());
+
+  ExecutionEngine<HalideCpuTcExecutor> engine;
+  engine.define(tc);
+  auto options = CpuMappingOptions::makeNaiveCpuMappingOptions();
+  auto inputDLTensorsPair = toConstDlpackTensors({A, B});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto outputDLTensorsPair = toDlpackTensors({C});
+  ScopeGuard g2([&]() { deleteDlmTensors(outputDLTensorsPair.second); });
+  auto handle = engine.compile(
+      "matmul_relu",
+      inputDLTensorsPair.first,
+      options.toProtobufSerializedString());
+  engine.run(handle, inputDLTensorsPair.first, outputDLTensorsPair.first);
+
+  checkRtol(Cc - C, {A, B}, K);
+}
+
+// In-place reductions of outputs read values the Halide pipeline does not
+// define.
+TEST(HalideCpuTcExecutor, InPlaceReduction) {
+  string tc = R"TC(
+def acc(float(M, K) A) -> (S) {
+    S(m) += A(m, r_k)
+}
+)TC";
+  ExecutionEngine<HalideCpuTcExecutor> engine;
+  engine.define(tc);
+  at::Tensor A = at::CPU(at::kFloat).rand({7, 5});
+  auto inputDLTensorsPair = toConstDlpackTensors({A});
+  ScopeGuard g([&]() { deleteDlmTensors(inputDLTensorsPair.second); });
+  auto options = CpuMappingOptions::makeNaiveCpuMappingOptions();
+  EXPECT_THROW(
+      engine.compile(
+          "acc",
+          inputDLTensorsPair.first,
+          options.toProtobufSerializedString()),
+      lang::ErrorReport);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -77,6 +77,15 @@ class Sum4D : public TestMapper {
       std::vector<size_t> problemSizes,
       std::vector<size_t> tileSizes,
       std::vector<size_t> childPos) {
+    return std::get<0>(codegen(problemSizes, tileSizes, childPos, false));
+  }
+
+  std::tuple<std::string, tc::Grid, tc::Block, size_t> codegen(
+      std::vector<size_t> problemSizes,
+      std::vector<size_t> tileSizes,
+      std::vector<size_t> childPos,
+      bool useDynamicSharedMemory,
+      bool asyncCopies = false) {
     string tc = R"TC(
 def fun(float(N,M,K,L) A, float(N,M,K,L) B) -> (C) {
     C(n,m,k,l) = A(n,m,k,l) + B(n,m,k,l)
@@ -86,7 +95,9 @@ def fun(float(N,M,K,L) A, float(N,M,K,L) B) -> (C) {
     auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
                               .tile(tileSizes)
                               .useSharedMemory(false) // do not autopromote
-                              .usePrivateMemory(true);
+                              .usePrivateMemory(true)
+                              .useDynamicSharedMemory(useDynamicSharedMemory)
+                              .asyncCopies(asyncCopies);
     auto mscop = makeMappedScop(
         tc,
         mappingOptions,
@@ -96,10 +107,62 @@ def fun(float(N,M,K,L) A, float(N,M,K,L) B) -> (C) {
                                            {"L", problemSizes[3]}});
     auto& scop = const_cast<Scop&>(mscop->scop());
     scop.promoteEverythingAt(childPos);
-    return std::get<0>(mscop->codegen("fun"));
+    return mscop->codegen("fun");
   }
 };
 
+TEST_F(Sum4D, DynamicSharedMemory) {
+  auto declarations = {
+      "float32 (*_A_0)[16][16][16] = "
+      "reinterpret_cast<float32 (*)[16][16][16]>(_tc_dynamic_shared + ",
+      "float32 (*_B_0)[16][16][16] = "
+      "reinterpret_cast<float32 (*)[16][16][16]>(_tc_dynamic_shared + ",
+      "float32 (*_C_0)[16][16][16] = "
+      "reinterpret_cast<float32 (*)[16][16][16]>(_tc_dynamic_shared + "};
+
+  auto res =
+      codegen({256, 128, 192, 224}, {16, 16, 16, 16}, {0, 0, 0, 0}, true);
+  auto code = std::get<0>(res);
+  EXPECT_TRUE(
+      code.find("extern __shared__ __align__(16) char _tc_dynamic_shared[];") !=
+      std::string::npos);
+  EXPECT_EQ(code.find("__shared__ float32"), std::string::npos);
+  for (auto d : declarations) {
+    EXPECT_TRUE(code.find(d) != std::string::npos) << d;
+  }
+  // The accesses are unchanged.
+  EXPECT_TRUE(
+      code.find("_C_0[c4][c5][c6][t0] = (_A_0[c4][c5][c6][t0] + "
+                "_B_0[c4][c5][c6][t0]);") != std::string::npos);
+  EXPECT_EQ(std::get<3>(res), 3 * 16 * 16 * 16 * 16 * sizeof(float));
+}
+
+/*
+ * Check that with async copies, the copies to shared memory are
+ * asynchronous, the copies back to global memory are not, and that the
+ * synchronizations wait for the copies.
+ */
+TEST_F(Sum4D, AsyncCopies) {
+  auto copyA =
+      "__tc::cpAsync<4>(&_A_0[c4][c5][c6][c7], "
+      "&A[16 * b0 + c4][16 * b1 + c5][c2 + c6][c3 + c7]);";
+  auto copyC =
+      "C[16 * b0 + c4][16 * b1 + c5][c2 + c6][c3 + c7] = _C_0[c4][c5][c6][c7];";
+  auto sync = "__tc::cpAsyncWait(); __syncthreads();";
+
+  auto code = std::get<0>(codegen(
+      {256, 128, 192, 224}, {16, 16, 16, 16}, {0, 0, 0, 0}, false, true));
+  auto posA = code.find(copyA);
+  auto posCompute = code.find("_C_0[c4][c5][c6][t0] = (_A_0");
+  EXPECT_NE(posA, std::string::npos);
+  EXPECT_NE(code.find(copyC), std::string::npos);
+  EXPECT_NE(posCompute, std::string::npos);
+  auto posSync = code.rfind(sync, posCompute);
+  EXPECT_NE(posSync, std::string::npos);
+  EXPECT_GT(posSync, posA);
+  EXPECT_NE(code.find("__device__ void cpAsync("), std::string::npos);
+}
+
 TEST_F(Sum4D, CodeOuterBand) {
   auto declarations = {"__shared__ float32 _A_0[16][16][16][16];",
                        "__shared__ float32 _B_0[16][16][16][16];",
@@ -383,7 +446,7 @@ def fun(float(N, M) A) -> (B, C) {
       size_t maxSharedMemory) {
     auto mscop = prepareScop(
         tc, {{"N", problemSize1}, {"M", problemSize2}}, {tileSize1, tileSize2});
-    promoteGreedilyAtDepth(
+    promoteToSharedAtDepth(
         *mscop,
         mscop->threadIdxXScheduleDepthState,
         depth,
@@ -422,13 +485,15 @@ TEST_F(MapperMemoryPromotionRAW, fitAtOuterDepths) {
   EXPECT_EQ(mscop2->scop().promotedDecls().size(), 1)
       << "expected one reference group to be promoted";
 
-  // Note that due to bank conflict heuristic, we will allocate 32x33 arrays in
-  // shraed memory which require 32x33x2x4=8448 bytes.
-  auto mscop3 = makeWithSharedGreedy(42, 40, 32, 32, 2, 8448);
+  // Note that due to bank conflict heuristic, the one of B and C that
+  // adjacent threads access across its rows is allocated as a 32x33 array in
+  // shared memory, the other one as a 32x32 array, which require
+  // (32x32+32x33)x4=8320 bytes.
+  auto mscop3 = makeWithSharedGreedy(42, 40, 32, 32, 2, 8320);
   EXPECT_EQ(mscop3->scop().promotedDecls().size(), 2)
       << "expected two reference groups to fit";
 
-  auto mscop4 = makeWithSharedGreedy(42, 40, 32, 32, 2, 8447);
+  auto mscop4 = makeWithSharedGreedy(42, 40, 32, 32, 2, 8319);
   EXPECT_EQ(mscop4->scop().promotedDecls().size(), 1)
       << "expected one reference group to be promoted";
 }
@@ -443,6 +508,40 @@ TEST_F(MapperMemoryPromotionRAW, throwIfCopiesBelowThreads) {
       promotion::PromotionBelowThreadsException);
 }
 
+/*
+ * Check that the elements of B, which the first statement writes before the
+ * second one reads them in the same tile, are not exposed to the reads and
+ * therefore not copied in when B is promoted, while all the reads of the
+ * input A are.
+ */
+TEST_F(MapperMemoryPromotionRAW, exposedReads) {
+  auto mscop =
+      prepareScop(tc, {{"N", 42}, {"M", 40}}, std::vector<size_t>{64, 64});
+  auto& scop = const_cast<Scop&>(mscop->scop());
+  scop.domain() = scop.domain().intersect_params(scop.globalParameterContext);
+  auto ctx = scop.domain().get_ctx();
+  auto t = scop.scheduleRoot()->child({0, 0, 0});
+  auto groups = TensorReferenceGroup::accessedBySubtree(t, scop);
+
+  const auto& groupsA = groups.at(isl::id(ctx, std::string("A")));
+  ASSERT_EQ(groupsA.size(), 1);
+  EXPECT_TRUE(groupsA[0]->exposedReads(t, scop).is_equal(
+      groupsA[0]->scopedReads()));
+
+  const auto& groupsB = groups.at(isl::id(ctx, std::string("B")));
+  ASSERT_EQ(groupsB.size(), 1);
+  EXPECT_FALSE(groupsB[0]->scopedReads().is_empty());
+  EXPECT_TRUE(groupsB[0]->exposedReads(t, scop).is_empty())
+      << groupsB[0]->exposedReads(t, scop);
+
+  // Without reads to copy in, B is only written back from its promoted
+  // copy and never read from global memory.
+  scop.promoteEverythingAt({0, 0, 0});
+  auto code = std::get<0>(mscop->codegen("fun"));
+  EXPECT_EQ(code.find("= B["), std::string::npos) << code;
+  EXPECT_NE(code.find("= _B_0["), std::string::npos) << code;
+}
+
 class MatMulBias : public TestMapper {
  public:
   std::string emitCode(
@@ -491,6 +590,26 @@ TEST_F(MatMulBias, RegisterPromotion) {
       << "tensor A promoted to register but has elements accessed by multiple threads";
 }
 
+/*
+ * With a thread tile of 2 x 2, each thread updates 4 elements of O in the
+ * reduction loop, all kept in a private array across the loop.
+ */
+TEST_F(MatMulBias, RegisterPromotionThreadTileAccumulators) {
+  auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(32, 32, 32)
+                            .mapToThreads(16, 16)
+                            .threadTile({2, 2})
+                            .useSharedMemory(false)
+                            .usePrivateMemory(true);
+
+  auto code = emitCode({{"N", 64}, {"M", 64}, {"K", 64}}, mappingOptions);
+  EXPECT_TRUE(code.find("float32 _O_0[2][2];") != std::string::npos)
+      << "expected the accumulators of a thread in registers";
+  EXPECT_TRUE(code.find("= (_O_0[") != std::string::npos)
+      << "expected the reduction to update the registers";
+  EXPECT_TRUE(code.find("__shared__ float32 _O_0") == std::string::npos);
+}
+
 TEST_F(MatMulBias, RegisterPromotionSharedPreference) {
   auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
                             .tile(32, 32, 32)
@@ -511,6 +630,107 @@ TEST_F(MatMulBias, RegisterPromotionSharedPreference) {
       << "tensor A promoted to register but has elements accessed by multiple threads";
 }
 
+TEST_F(MatMulBias, DoubleBufferShared) {
+  auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(32, 32, 32)
+                            .maxSharedMemory(32768)
+                            .useSharedMemory(true)
+                            .usePrivateMemory(true)
+                            .doubleBufferShared(true);
+
+  auto code = emitCode({{"N", 42}, {"M", 56}, {"K", 37}}, mappingOptions);
+  EXPECT_TRUE(code.find("__shared__ float32 _A_0_buffers[2]") !=
+              std::string::npos)
+      << "expected two shared buffers for input A";
+  EXPECT_TRUE(code.find("_A_0 = _A_0 == _A_0_buffers[0] ? _A_0_buffers[1] : "
+                        "_A_0_buffers[0];") != std::string::npos)
+      << "expected A to swap buffers";
+  EXPECT_TRUE(code.find("__shared__ float32 _O_0") == std::string::npos)
+      << "output O promoted to shared memory despite double buffering";
+}
+
+TEST_F(MatMulBias, VectorizedSharedCopies) {
+  auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(32, 32, 32)
+                            .maxSharedMemory(32768)
+                            .useSharedMemory(true)
+                            .usePrivateMemory(false)
+                            .vectorizeWidth(4);
+
+  // The rows of B hold a multiple of 4 elements but those of A do not.
+  auto code = emitCode({{"N", 42}, {"M", 56}, {"K", 37}}, mappingOptions);
+  EXPECT_TRUE(code.find("__shared__ __align__(16) float32 _B_0") !=
+              std::string::npos)
+      << "expected shared copy of B aligned for vector accesses";
+  EXPECT_TRUE(code.find("*reinterpret_cast<float4*>(&_B_0[") !=
+              std::string::npos)
+      << "expected vectorized copy of B";
+  EXPECT_TRUE(code.find("*reinterpret_cast<float4*>(&_A_0[") ==
+              std::string::npos)
+      << "copy of A vectorized despite unaligned rows";
+}
+
+TEST_F(MatMulBias, SharedRowsNotPadded) {
+  auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(32, 32, 32)
+                            .maxSharedMemory(32768)
+                            .useSharedMemory(true)
+                            .usePrivateMemory(false);
+
+  // Adjacent threads access either consecutive elements of the same row or
+  // the same element, neither of which causes bank conflicts.
+  auto code = emitCode({{"N", 64}, {"M", 64}, {"K", 64}}, mappingOptions);
+  EXPECT_TRUE(code.find("[32][33]") == std::string::npos)
+      << "shared memory rows padded despite conflict-free accesses";
+}
+
+class Transpose : public TestMapper {
+ public:
+  std::string emitCode(
+      const std::unordered_map<std::string, size_t>& parameters,
+      const CudaMappingOptions& mappingOptions) {
+    std::string tc = R"TC(
+def fun(float(N,M) A) -> (B) {
+  B(m,n) = A(n,m)
+}
+)TC";
+
+    auto mscop = makeMappedScop(tc, mappingOptions, parameters);
+    return std::get<0>(mscop->codegen("fun"));
+  }
+};
+
+TEST_F(Transpose, SharedRowsPadded) {
+  auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(32, 32)
+                            .maxSharedMemory(32768)
+                            .useSharedMemory(true)
+                            .usePrivateMemory(false);
+
+  // Adjacent threads access elements of the non-coalesced tensor in
+  // different rows, which would all fall into the same bank without padding.
+  auto code = emitCode({{"N", 64}, {"M", 64}}, mappingOptions);
+  EXPECT_TRUE(code.find("[32][33];") != std::string::npos)
+      << "expected padded rows in shared memory";
+}
+
+TEST_F(Transpose, SharedTransposed) {
+  auto mappingOptions = CudaMappingOptions::makeNaiveCudaMappingOptions()
+                            .tile(32, 16)
+                            .maxSharedMemory(32768)
+                            .useSharedMemory(true)
+                            .usePrivateMemory(false)
+                            .transposeShared(true);
+
+  // Adjacent threads access consecutive elements along the first dimension
+  // of A, which becomes the last, padded dimension of the promoted array.
+  auto code = emitCode({{"N", 64}, {"M", 64}}, mappingOptions);
+  EXPECT_TRUE(code.find("[32][17];") != std::string::npos)
+      << "expected the promoted array to be transposed";
+  EXPECT_TRUE(code.find("[16][33];") == std::string::npos)
+      << "unexpected promotion in the layout of the tensor";
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -21,10 +21,14 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include "tc/core/halide_utils.h"
 #include "tc/core/polyhedral/schedule_isl_conversion.h"
 #include "tc/core/polyhedral/scop.h"
 #include "tc/core/tc2halide.h"
 #include "tc/core/utils/dlpack.h"
+#include "tc/library/convolution.h"
+#include "tc/library/lut.h"
+#include "tc/library/winograd.h"
 
 using namespace tc;
 using namespace std;
@@ -206,6 +210,246 @@ def foo(float(N) A) -> (B) {
 )TC";
   EXPECT_THROW(Check(tc, {123}), ::lang::ErrorReport);
 }
+
+TEST_F(TC2Isl, BoundedGather) {
+  string tc = R"TC(
+def fun(float(E, D) LUT, int32(B, L) I) -> (O) {
+    O(i, j) +=! LUT(I(i, k), j)
+}
+)TC";
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), halide);
+  // The data-dependent subscript is bounded by the extent of LUT.
+  auto lutId = isl::id(scop->domain().get_ctx(), std::string("LUT"));
+  auto elements = scop->tensorElements(lutId);
+  auto lutReads = scop->reads.intersect_range(
+      isl::union_set(isl::set::universe(elements.get_space())));
+  EXPECT_FALSE(lutReads.is_empty());
+  EXPECT_TRUE(lutReads.range().is_subset(isl::union_set(elements)));
+}
+
+TEST_F(TC2Isl, ScatterReduction) {
+  auto halide = tc2halide::translate(
+      isl::with_exceptions::globalIslCtx(), TC_LUT_BACKWARD);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), halide);
+  // The update reduces over the lookups into the rows they select, which
+  // are bounded by the extent of d_LUT.
+  ASSERT_EQ(scop->halide.reductions.size(), 1u);
+  EXPECT_TRUE(scop->halide.reductions[0].scatter);
+  EXPECT_EQ(scop->halide.reductions[0].dims.size(), 2u);
+  auto gradId = isl::id(scop->domain().get_ctx(), std::string("d_LUT"));
+  auto elements = isl::union_set(scop->tensorElements(gradId));
+  auto gradWrites = scop->writes.intersect_range(elements).range();
+  EXPECT_FALSE(gradWrites.is_empty());
+  EXPECT_TRUE(gradWrites.is_subset(elements));
+}
+
+TEST_F(TC2Isl, TriangularConstraint) {
+  string tc = R"TC(
+def fun(float(N, N) A) -> (O) {
+    O(i) +=! A(i, j) where j <= i
+}
+)TC";
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), halide);
+  // Only the lower triangle of A is read.
+  auto aId = isl::id(scop->domain().get_ctx(), std::string("A"));
+  auto elements = isl::union_set(scop->tensorElements(aId));
+  auto aReads = scop->reads.intersect_range(elements).range();
+  EXPECT_FALSE(aReads.is_empty());
+  EXPECT_TRUE(aReads.is_subset(elements));
+  EXPECT_FALSE(elements.is_subset(aReads));
+}
+
+TEST_F(TC2Isl, ImplicitGemmConvolution) {
+  auto tc = makeConvolution2DImplicitGemmTc(2, 1, 3, 5);
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), halide);
+  polyhedral::detail::validateSchedule(scop->scheduleRoot());
+  // The flattened reduction reads each element of the filters, for inputs
+  // large enough to have outputs.
+  auto ctx = scop->domain().get_ctx();
+  auto wId = isl::id(ctx, std::string("W1"));
+  auto nonEmpty =
+      isl::set(ctx, "[N, H, W] -> { : N > 0 and H >= 3 and W >= 5 }");
+  auto elements =
+      isl::union_set(scop->tensorElements(wId)).intersect_params(nonEmpty);
+  auto wReads = scop->reads.intersect_range(elements).range();
+  EXPECT_TRUE(wReads.intersect_params(nonEmpty).is_equal(elements));
+}
+
+TEST_F(TC2Isl, WinogradConvolution) {
+  auto tc = makeConvolution2DWinogradTc();
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  EXPECT_EQ(halide.temporaries.size(), 3u);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), halide);
+  polyhedral::detail::validateSchedule(scop->scheduleRoot());
+  // The 2x2 output tiles write each element of the output, for even output
+  // sizes.
+  auto ctx = scop->domain().get_ctx();
+  auto oId = isl::id(ctx, std::string("O"));
+  auto evenSizes = isl::set(
+      ctx,
+      "[N, H, W] -> { : N > 0 and H >= 4 and W >= 4 and "
+      "H mod 2 = 0 and W mod 2 = 0 }");
+  auto elements =
+      isl::union_set(scop->tensorElements(oId)).intersect_params(evenSizes);
+  auto oWrites = scop->writes.intersect_range(elements).range();
+  EXPECT_TRUE(oWrites.intersect_params(evenSizes).is_equal(elements));
+}
+
+TEST(TC2Halide, HalfTypes) {
+  string tc = R"TC(
+def fun(half(M) A, float16(M) B) -> (C, D) {
+  C(i) = A(i) + B(i)
+  D(i) = float(C(i))
+}
+)TC";
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  EXPECT_EQ(halide.inputs[0].type(), Halide::Float(16));
+  EXPECT_EQ(halide.inputs[1].type(), Halide::Float(16));
+  EXPECT_EQ(halide.outputs[0].type(), Halide::Float(16));
+  EXPECT_EQ(halide.outputs[1].type(), Halide::Float(32));
+}
+
+TEST(TC2Halide, Temporaries) {
+  string tc = R"TC(
+def softmax(float(N, D) I) -> (O) {
+    expsum(n) +=! exp(I(n, d))
+    O(n, d) = exp(I(n, d)) / expsum(n)
+}
+)TC";
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  ASSERT_EQ(halide.outputs.size(), 1u);
+  EXPECT_EQ(halide.outputs[0].name(), "O");
+  ASSERT_EQ(halide.temporaries.size(), 1u);
+  EXPECT_EQ(halide.temporaries[0].name(), "expsum");
+  EXPECT_EQ(halide.temporaries[0].dimensions(), 1);
+}
+
+TEST(TC2Halide, InlinedTemporaries) {
+  string tc = R"TC(
+def fun(float(N, D) I, float(D) B) -> (O) {
+    T(n, d) = I(n, d) + B(d)
+    S(n) +=! T(n, r_d)
+    U(n, d) = tanh(T(n, d))
+    O(n, d) = U(n, d) * S(n)
+}
+)TC";
+  auto ctx = isl::with_exceptions::globalIslCtx();
+  EXPECT_EQ(tc2halide::translate(ctx, tc).temporaries.size(), 3u);
+  // Only the reduction is stored, the scop has no statement for T and U.
+  auto halide = tc2halide::translate(ctx, tc, false, true);
+  ASSERT_EQ(halide.temporaries.size(), 1u);
+  EXPECT_EQ(halide.temporaries[0].name(), "S");
+  auto scop = polyhedral::Scop::makeScop(ctx, halide);
+  EXPECT_EQ(scop->halide.statements.size(), 3u);
+}
+
+TEST(TC2Halide, UninitializedTemporary) {
+  string tc = R"TC(
+def fun(float(N) A) -> (B) {
+    C(k) += A(i) where k in 0:1
+    B(i) = C(0)
+}
+)TC";
+  EXPECT_THROW(
+      tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc),
+      ::lang::ErrorReport);
+}
+
+TEST(TC2Halide, SimplifyValues) {
+  string tc = R"TC(
+def fun(float(N) A, float(N) B) -> (O) {
+    O(i) = A(i) * A(i) + log(exp(B(i))) / 2.0
+}
+)TC";
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  class Count : public Halide::Internal::IRVisitor {
+    using Halide::Internal::IRVisitor::visit;
+    void visit(const Halide::Internal::Let* op) {
+      ++lets;
+      IRVisitor::visit(op);
+    }
+    void visit(const Halide::Internal::Div* op) {
+      ++divs;
+      IRVisitor::visit(op);
+    }
+    void visit(const Halide::Internal::Call* op) {
+      calls += op->call_type == Halide::Internal::Call::PureExtern;
+      IRVisitor::visit(op);
+    }
+
+   public:
+    int lets = 0;
+    int divs = 0;
+    int calls = 0;
+  } count;
+  halide.stmt.accept(&count);
+  EXPECT_EQ(count.lets, 1);
+  EXPECT_EQ(count.divs, 0);
+  // log(exp(x)) is not x in floating point
+  EXPECT_EQ(count.calls, 2);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), halide);
+  polyhedral::detail::validateSchedule(scop->scheduleRoot());
+}
+
+TEST(TC2Halide, Dp4aReductions) {
+  string tc = R"TC(
+def fun(int8(M, K) A, int8(K, N) B, int8(N, K) C) -> (O, P) {
+    O(m, n) +=! A(m, k) * B(k, n)
+    P(m, n) +=! A(m, k) * C(n, k)
+}
+)TC";
+  auto halide = tc2halide::translate(isl::with_exceptions::globalIslCtx(), tc);
+  EXPECT_EQ(halide.outputs[0].type(), Halide::Int(32));
+  DLDataType dtype;
+  dtype.code = kDLInt;
+  dtype.bits = 8;
+  dtype.lanes = 1;
+  auto ctx = getCPUDLContext();
+  auto A = makeDLTensorWithSizes(ctx, dtype, {8, 16});
+  auto B = makeDLTensorWithSizes(ctx, dtype, {16, 4});
+  auto C = makeDLTensorWithSizes(ctx, dtype, {4, 16});
+  std::vector<const DLTensor*> inputs{A.get(), B.get(), C.get()};
+
+  class Count : public Halide::Internal::IRVisitor {
+    using Halide::Internal::IRVisitor::visit;
+    void visit(const Halide::Internal::Call* op) {
+      dp4a += op->is_intrinsic(tc2halide::kDp4a);
+      load4 += op->is_intrinsic(tc2halide::kLoad4);
+      pack4 += op->is_intrinsic(tc2halide::kPack4);
+      IRVisitor::visit(op);
+    }
+
+   public:
+    int dp4a = 0;
+    int load4 = 0;
+    int pack4 = 0;
+  };
+  // B is read across its rows, only P is rewritten unless it is packed.
+  Count contiguous;
+  packDp4aReductions(halide, inputs, false).stmt.accept(&contiguous);
+  EXPECT_EQ(contiguous.dp4a, 1);
+  EXPECT_EQ(contiguous.load4, 2);
+  EXPECT_EQ(contiguous.pack4, 0);
+  Count packed;
+  auto packedHalide = packDp4aReductions(halide, inputs, true);
+  packedHalide.stmt.accept(&packed);
+  EXPECT_EQ(packed.dp4a, 2);
+  EXPECT_EQ(packed.load4, 3);
+  EXPECT_EQ(packed.pack4, 1);
+  auto scop = polyhedral::Scop::makeScop(
+      isl::with_exceptions::globalIslCtx(), packedHalide);
+  polyhedral::detail::validateSchedule(scop->scheduleRoot());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   ::gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -14,11 +14,12 @@
 ##############################################################################
 
 import os
+import threading
 
 import torch
 import torch.cuda
 
-from tensor_comprehensions import TcCompilationUnit
+from tensor_comprehensions import TcCompilationUnit, tune_batch
 from common import TestCase, run_tests
 
 PATH_PREFIX = os.path.join(os.path.dirname(os.path.abspath(__file__)), "tc_test")
@@ -90,6 +91,89 @@ class TestMatmul(TestCase):
         diff = outputs[0] - expected
         self.assert_almost_equal(diff, inputs, 4)
 
+    def test_matmul_bound(self):
+        lang = """
+        def matmul(float(M,N) A, float(N,K) B) -> (output) {
+          output(i, j) +=! A(i, kk) * B(kk, j)
+        }
+        """
+        cu = TcCompilationUnit()
+        cu.define(lang)
+
+        mat1, mat2 = torch.randn(3, 4).cuda(), torch.randn(4, 5).cuda()
+        matmul = cu.bind("matmul", [mat1, mat2], options="mlp")
+        stream = torch.cuda.Stream()
+        with torch.cuda.stream(stream):
+            outputs = []
+            matmul([mat1, mat2], outputs)
+            expected = torch.mm(mat1, mat2)
+        stream.synchronize()
+        diff = outputs[0] - expected
+        self.assert_almost_equal(diff, [mat1, mat2], 4)
+
+        # other sizes are compiled once, then reuse their kernel
+        mat1, mat2 = torch.randn(6, 4).cuda(), torch.randn(4, 7).cuda()
+        outputs = []
+        matmul([mat1, mat2], outputs)
+        diff = outputs[0] - torch.mm(mat1, mat2)
+        self.assert_almost_equal(diff, [mat1, mat2], 4)
+
+
+class TestConcurrentCompile(TestCase):
+    def test_compile_in_threads(self):
+        lang = """
+        def add(float(N) A, float(N) B) -> (output) {
+          output(i) = A(i) + B(i)
+        }
+        def sub(float(N) A, float(N) B) -> (output) {
+          output(i) = A(i) - B(i)
+        }
+        """
+        cu = TcCompilationUnit()
+        cu.define(lang)
+        a, b = torch.randn(100).cuda(), torch.randn(100).cuda()
+        handles = {}
+
+        def compile(name):
+            handles[name] = cu.compile(name, [a, b], options="pointwise")
+
+        threads = [threading.Thread(target=compile, args=(name,)) for name in ["add", "sub"]]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        outputs = cu.run(handles["add"], "add", [a, b])
+        self.assert_almost_equal(outputs[0] - (a + b), [a, b], 4)
+        outputs = cu.run(handles["sub"], "sub", [a, b])
+        self.assert_almost_equal(outputs[0] - (a - b), [a, b], 4)
+
+
+class TestTuneBatch(TestCase):
+    def test_tune_batch(self):
+        lang = """
+        def matmul(float(M,N) A, float(N,K) B) -> (output) {
+          output(i, j) +=! A(i, kk) * B(kk, j)
+        }
+        """
+        cache_file = "{}/tune_batch_cache".format(PATH_PREFIX)
+        jobs = [
+            (lang, "matmul", [(3, 4), (4, 5)], "mlp"),
+            (lang, "matmul", [(30, 40), (40, 50)], "mlp"),
+            (lang, "matmul", [(3, 4), (4, 5)], "mlp"),
+        ]
+        tuned = []
+        options = tune_batch(
+            jobs, cache_file, on_result=lambda i, o: tuned.append(i),
+            threads=16, pop_size=10, number_elites=1, generations=1,
+            tuner_min_launch_total_threads=1
+        )
+        self.assertEqual(len(options), 3)
+        self.assertEqual(tuned, [0, 1, 2])
+        self.assertTrue(os.path.exists(cache_file + ".options"))
+        a, b = torch.randn(30, 40).cuda(), torch.randn(40, 50).cuda()
+        self.check(lang, "matmul", options[1], [a, b], outputs=None)
+
 
 if __name__ == '__main__':
     run_tests()